@@ -0,0 +1,213 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BacktestSweep.hpp>
+#include <apex/core/StrategyMain.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Time.hpp>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+/* Python module running backtests of C++ strategies in process, returning the
+ * results of the Auditor and its online stats as NumPy arrays, rather than
+ * files to parse.  Strategies are found by type name in the strategy
+ * registry, to which a shared library of strategies adds its types, with
+ * APEX_REGISTER_STRATEGY, when loaded by load_strategies.
+ *
+ * The runs of one call are those of a BacktestSweep, so share ref-data and
+ * tick files, and are spread over its worker threads; the GIL is released
+ * while they run, so that a Python thread pool can also drive several calls
+ * at once. */
+
+namespace py = pybind11;
+using namespace py::literals;
+
+namespace
+{
+
+std::vector<std::string> load_strategies(const std::string& path)
+{
+  // global, so that the library resolves apex symbols to the one registry
+  if (!::dlopen(path.c_str(), RTLD_NOW | RTLD_GLOBAL))
+    throw std::runtime_error("cannot load " + path + ": " + ::dlerror());
+  return apex::strategy_registry().types();
+}
+
+
+// a config given as a dict, or as a JSON string
+apex::Config to_config(const py::handle& obj)
+{
+  if (obj.is_none())
+    return apex::Config::empty_config();
+  std::string text = py::isinstance<py::str>(obj)
+                         ? obj.cast<std::string>()
+                         : py::module_::import("json")
+                               .attr("dumps")(obj)
+                               .cast<std::string>();
+  return apex::Config(json::parse(text));
+}
+
+
+template <typename T, typename R, typename F>
+py::array_t<T> column(const std::vector<R>& rows, F get)
+{
+  py::array_t<T> array(static_cast<py::ssize_t>(rows.size()));
+  auto out = array.template mutable_unchecked<1>();
+  for (size_t i = 0; i < rows.size(); i++)
+    out(i) = static_cast<T>(get(rows[i]));
+  return array;
+}
+
+
+py::dict to_dict(const std::vector<apex::BacktestRunResult>& results)
+{
+  using Result = apex::BacktestRunResult;
+  py::dict runs;
+  py::list labels, errors;
+  for (auto& result : results) {
+    labels.append(result.label);
+    errors.append(result.error);
+  }
+  runs["label"] = labels;
+  runs["error"] = errors;
+  runs["ok"] = column<bool>(results, [](const Result& r) { return r.ok; });
+  runs["pnl_usd"] =
+      column<double>(results, [](const Result& r) { return r.pnl_usd; });
+  runs["order_events"] = column<int64_t>(
+      results, [](const Result& r) { return r.order_events; });
+  runs["fills"] =
+      column<int64_t>(results, [](const Result& r) { return r.fills; });
+  runs["fill_value_usd"] = column<double>(
+      results, [](const Result& r) { return r.fill_value_usd; });
+  runs["max_drawdown_usd"] = column<double>(
+      results, [](const Result& r) { return r.max_drawdown_usd; });
+  runs["sharpe"] =
+      column<double>(results, [](const Result& r) { return r.sharpe; });
+  runs["fill_ratio"] =
+      column<double>(results, [](const Result& r) { return r.fill_ratio; });
+  runs["elapsed_ms"] = column<int64_t>(
+      results, [](const Result& r) { return r.elapsed.count(); });
+
+  // the bots of all runs, as columns, with the index of their run
+  struct Row {
+    size_t run;
+    const Result::BotResult* bot;
+  };
+  std::vector<Row> rows;
+  for (auto& result : results)
+    for (auto& bot : result.bots)
+      rows.push_back({result.index, &bot});
+
+  py::dict bots;
+  py::list symbols, exchanges;
+  for (auto& row : rows) {
+    symbols.append(row.bot->symbol);
+    exchanges.append(row.bot->exchange);
+  }
+  bots["run"] = column<int64_t>(rows, [](const Row& r) { return r.run; });
+  bots["symbol"] = symbols;
+  bots["exchange"] = exchanges;
+  bots["net_qty"] =
+      column<double>(rows, [](const Row& r) { return r.bot->net_qty; });
+  bots["net_position_usd"] = column<double>(
+      rows, [](const Row& r) { return r.bot->net_position_usd; });
+  bots["pnl_usd"] =
+      column<double>(rows, [](const Row& r) { return r.bot->pnl_usd; });
+  bots["fills"] =
+      column<int64_t>(rows, [](const Row& r) { return r.bot->fills; });
+  bots["turnover_usd"] =
+      column<double>(rows, [](const Row& r) { return r.bot->turnover_usd; });
+  bots["max_drawdown_usd"] = column<double>(
+      rows, [](const Row& r) { return r.bot->max_drawdown_usd; });
+  bots["sharpe"] =
+      column<double>(rows, [](const Row& r) { return r.bot->sharpe; });
+  bots["fill_ratio"] =
+      column<double>(rows, [](const Row& r) { return r.bot->fill_ratio; });
+  runs["bots"] = bots;
+  return runs;
+}
+
+
+py::dict run(const std::string& strategy, const py::object& configs,
+             const std::string& start, const std::string& end,
+             const py::object& services, size_t threads,
+             const std::string& work_dir, const py::object& labels)
+{
+  apex::BacktestSweepOptions options;
+  options.period = {apex::Time(start), apex::Time(end)};
+  options.services_config = to_config(services);
+  options.threads = threads;
+  options.work_dir = work_dir;
+
+  // one config, or a list of them, one per run
+  std::vector<apex::Config> strategy_configs;
+  if (py::isinstance<py::list>(configs) || py::isinstance<py::tuple>(configs))
+    for (auto item : configs)
+      strategy_configs.push_back(to_config(item));
+  else
+    strategy_configs.push_back(to_config(configs));
+
+  std::vector<std::string> run_labels;
+  if (!labels.is_none())
+    run_labels = labels.cast<std::vector<std::string>>();
+  if (!run_labels.empty() && run_labels.size() != strategy_configs.size())
+    throw std::invalid_argument("labels must match the configs");
+
+  auto* factory = apex::strategy_registry().find(strategy);
+  if (!factory)
+    throw std::invalid_argument("unknown strategy type '" + strategy + "'");
+
+  apex::BacktestSweep sweep(*factory, options);
+  for (size_t i = 0; i < strategy_configs.size(); i++)
+    sweep.add_run(run_labels.empty() ? std::to_string(i) : run_labels[i],
+                  strategy_configs[i]);
+
+  std::vector<apex::BacktestRunResult> results;
+  {
+    py::gil_scoped_release release;
+    results = sweep.run();
+  }
+  return to_dict(results);
+}
+
+} // namespace
+
+
+PYBIND11_MODULE(backtest, m)
+{
+  m.doc() = "In-process backtests of apex C++ strategies";
+
+  m.def("load_strategies", &load_strategies, "path"_a,
+        "Load a shared library of strategies; returns the registered types");
+  m.def("strategy_types",
+        []() { return apex::strategy_registry().types(); },
+        "Strategy types of the registry");
+  m.def("run", &run, "strategy"_a, "configs"_a, "start"_a, "end"_a,
+        "services"_a = py::none(), "threads"_a = 0, "work_dir"_a = "",
+        "labels"_a = py::none(),
+        "Backtest a strategy type from start to end, once per strategy "
+        "config; returns a dict of result arrays, one element per run, and "
+        "under 'bots' the columns of every bot, with the index of its run");
+}
@@ -0,0 +1,346 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/* Python module giving NumPy access to raw tickbin files.  The file is mapped
+ * and its records exposed as arrays over the mapping, so nothing is copied;
+ * each array keeps the mapping alive.  Every record of a file is of the same
+ * type, so records can be viewed as an array of fixed stride. */
+
+namespace py = pybind11;
+using namespace py::literals;
+
+namespace
+{
+
+using apex::tickbin::FullMsg;
+using apex::tickbin::Header;
+using apex::tickbin::IndexEntry;
+using apex::tickbin::MsgType;
+using apex::tickbin::TickAggTrade;
+using apex::tickbin::TickLevel1;
+
+struct Field {
+  const char* name;
+  const char* format;
+  size_t offset;
+};
+
+py::dtype make_dtype(const std::vector<Field>& fields, size_t itemsize)
+{
+  py::list names, formats, offsets;
+  for (auto& field : fields) {
+    names.append(field.name);
+    formats.append(field.format);
+    offsets.append(field.offset);
+  }
+  return py::dtype(names, formats, offsets, static_cast<py::ssize_t>(itemsize));
+}
+
+#define APEX_FIELD(MSG, MEMBER, FORMAT)                                  \
+  Field{#MEMBER, FORMAT, offsetof(FullMsg<MSG>, body) + offsetof(MSG, MEMBER)}
+
+std::vector<Field> header_fields()
+{
+  return {{"capture_time", "<u8", offsetof(Header, capture_time)},
+          {"msg_type", "u1", offsetof(Header, msg_type)},
+          {"size", "u1", offsetof(Header, size)}};
+}
+
+std::vector<Field> record_fields(MsgType type)
+{
+  auto fields = header_fields();
+  switch (type) {
+    case MsgType::TickLevel1:
+      fields.push_back(APEX_FIELD(TickLevel1, ask_price, "<f8"));
+      fields.push_back(APEX_FIELD(TickLevel1, ask_qty, "<f8"));
+      fields.push_back(APEX_FIELD(TickLevel1, bid_price, "<f8"));
+      fields.push_back(APEX_FIELD(TickLevel1, bid_qty, "<f8"));
+      break;
+    case MsgType::TickAggTrade:
+      fields.push_back(APEX_FIELD(TickAggTrade, price, "<f8"));
+      fields.push_back(APEX_FIELD(TickAggTrade, qty, "<f8"));
+      fields.push_back(APEX_FIELD(TickAggTrade, et, "<u8"));
+      fields.push_back(APEX_FIELD(TickAggTrade, side, "S1"));
+      break;
+    case MsgType::None:
+      break;
+  }
+  return fields;
+}
+
+#undef APEX_FIELD
+
+size_t record_size(MsgType type)
+{
+  switch (type) {
+    case MsgType::TickLevel1:
+      return sizeof(FullMsg<TickLevel1>);
+    case MsgType::TickAggTrade:
+      return sizeof(FullMsg<TickAggTrade>);
+    case MsgType::None:
+      break;
+  }
+  return 0;
+}
+
+
+class TickFile
+{
+public:
+  explicit TickFile(const std::string& fn)
+  {
+    // access is random rather than a front to back replay
+    apex::MmapOptions options;
+    options.sequential = false;
+    options.window = 0;
+    options.release = false;
+    _file = std::make_shared<const apex::MappedFile>(fn, options);
+
+    const char* addr = _file->begin();
+    if (_file->size() < apex::TickbinHeader::header_lead_length)
+      throw std::runtime_error("file too short for tickbin header: " + fn);
+
+    auto header = apex::decode_tickbin_file_header(addr);
+    if (header.version == apex::tickbin::compressed_version)
+      throw std::runtime_error(
+          "compressed tickbin files cannot be mapped without copying: " + fn);
+    if (header.version == apex::tickbin::delta_version)
+      throw std::runtime_error(
+          "delta encoded tickbin files cannot be mapped without copying: " + fn);
+    if (header.length > _file->size())
+      throw std::runtime_error("tickbin header extends beyond file: " + fn);
+
+    _version = header.version;
+    _first = header.length;
+    _meta = std::string(addr + apex::TickbinHeader::header_lead_length,
+                        strnlen(addr + apex::TickbinHeader::header_lead_length,
+                                _first - apex::TickbinHeader::header_lead_length));
+
+    // The record type is taken from the first record; a torn final record,
+    // left by a writer that did not finish, is excluded.
+    if (_file->size() >= _first + sizeof(Header)) {
+      Header head;
+      memcpy(&head, addr + _first, sizeof(head));
+      _type = static_cast<MsgType>(head.msg_type);
+      _stride = record_size(_type);
+      if (_stride == 0 || head.size != _stride)
+        throw std::runtime_error("unsupported tickbin record type " +
+                                 std::to_string(head.msg_type) + ": " + fn);
+      _count = (_file->size() - _first) / _stride;
+      _dtype = make_dtype(record_fields(_type), _stride);
+    }
+
+    load_index(apex::tickbin_index_path(fn));
+  }
+
+  const std::string& version() const { return _version; }
+
+  py::object meta() const
+  {
+    return py::module_::import("json").attr("loads")(_meta);
+  }
+
+  py::object msg_type() const
+  {
+    switch (_type) {
+      case MsgType::TickLevel1:
+        return py::str("l1");
+      case MsgType::TickAggTrade:
+        return py::str("aggtrade");
+      case MsgType::None:
+        break;
+    }
+    return py::none();
+  }
+
+  size_t size() const { return _count; }
+
+  py::array records() const { return view(0, _count); }
+
+  /* Records with capture time in [start, end), in usec since epoch. */
+  py::array slice(uint64_t start, uint64_t end) const
+  {
+    auto lo = lower_bound(start);
+    auto hi = end > start ? lower_bound(end) : lo;
+    return view(lo, hi);
+  }
+
+  /* One array per field, each a strided view over the records. */
+  py::dict columns(uint64_t start, uint64_t end) const
+  {
+    auto lo = lower_bound(start);
+    auto hi = end > start ? lower_bound(end) : lo;
+
+    py::dict cols;
+    for (auto& field : record_fields(_type))
+      cols[field.name] = column_view(field, lo, hi);
+    return cols;
+  }
+
+  py::array index() const
+  {
+    auto dtype = make_dtype({{"capture_time", "<u8", offsetof(IndexEntry, capture_time)},
+                             {"offset", "<u8", offsetof(IndexEntry, offset)}},
+                            sizeof(IndexEntry));
+    return py::array(dtype, {_index.size()}, {sizeof(IndexEntry)}, _index.data());
+  }
+
+private:
+  uint64_t capture_time(size_t i) const
+  {
+    uint64_t t;
+    memcpy(&t, _file->begin() + _first + i * _stride + offsetof(Header, capture_time),
+           sizeof(t));
+    return t;
+  }
+
+  /* Index of the first record at or after `t`.  The sparse index narrows the
+   * search to the records between two entries, so that only a few pages of
+   * a large file are touched. */
+  size_t lower_bound(uint64_t t) const
+  {
+    size_t lo = 0;
+    size_t hi = _count;
+
+    auto iter = std::lower_bound(
+        std::begin(_index), std::end(_index), t,
+        [](const IndexEntry& entry, uint64_t value) {
+          return entry.capture_time < value;
+        });
+    if (iter != std::begin(_index))
+      lo = (std::prev(iter)->offset - _first) / _stride;
+    if (iter != std::end(_index))
+      hi = (iter->offset - _first) / _stride;
+
+    while (lo < hi) {
+      auto mid = lo + (hi - lo) / 2;
+      if (capture_time(mid) < t)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo;
+  }
+
+  /* Array owner: holds a reference to the mapping until the array is
+   * released. */
+  py::capsule owner() const
+  {
+    auto holder = new std::shared_ptr<const apex::MappedFile>(_file);
+    return py::capsule(holder, [](void* p) {
+      delete static_cast<std::shared_ptr<const apex::MappedFile>*>(p);
+    });
+  }
+
+  static py::array read_only(py::array arr)
+  {
+    py::detail::array_proxy(arr.ptr())->flags &=
+        ~py::detail::npy_api::NPY_ARRAY_WRITEABLE_;
+    return arr;
+  }
+
+  py::array view(size_t lo, size_t hi) const
+  {
+    if (_stride == 0)
+      return py::array(make_dtype(header_fields(), sizeof(Header)), {size_t{0}});
+    const char* ptr = _file->begin() + _first + lo * _stride;
+    return read_only(py::array(_dtype, {hi - lo}, {_stride}, ptr, owner()));
+  }
+
+  py::array column_view(const Field& field, size_t lo, size_t hi) const
+  {
+    const char* ptr = _file->begin() + _first + lo * _stride + field.offset;
+    return read_only(
+        py::array(py::dtype(field.format), {hi - lo}, {_stride}, ptr, owner()));
+  }
+
+  /* Load the sidecar index, retaining entries as TickbinFileReader does:
+   * only those pointing at a record with the same capture time, with times
+   * increasing.  Entries must also fall on a record boundary. */
+  void load_index(const std::filesystem::path& index_fn)
+  {
+    if (_stride == 0 || !std::filesystem::exists(index_fn))
+      return;
+
+    std::ifstream is(index_fn, std::ios::binary);
+    IndexEntry entry{};
+    while (is.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+      if (entry.offset < _first || (entry.offset - _first) % _stride != 0 ||
+          (entry.offset - _first) / _stride >= _count)
+        break;
+      if (capture_time((entry.offset - _first) / _stride) != entry.capture_time)
+        break;
+      if (!_index.empty() && entry.capture_time < _index.back().capture_time)
+        break;
+      _index.push_back(entry);
+    }
+  }
+
+  std::shared_ptr<const apex::MappedFile> _file;
+  std::string _version;
+  std::string _meta;
+  size_t _first = 0;
+  MsgType _type = MsgType::None;
+  size_t _stride = 0;
+  size_t _count = 0;
+  py::dtype _dtype;
+  std::vector<IndexEntry> _index;
+};
+
+} // namespace
+
+
+PYBIND11_MODULE(tickbin, m)
+{
+  m.doc() = "Zero-copy NumPy access to apex tickbin files";
+
+  py::class_<TickFile>(m, "TickFile")
+      .def(py::init<const std::string&>(), "path"_a)
+      .def_property_readonly("version", &TickFile::version)
+      .def_property_readonly("meta", &TickFile::meta)
+      .def_property_readonly("msg_type", &TickFile::msg_type)
+      .def_property_readonly("index", &TickFile::index,
+                             "Sparse time index, a copy of the sidecar file")
+      .def("__len__", &TickFile::size)
+      .def("records", &TickFile::records,
+           "All records, as a read-only structured array over the mapping")
+      .def("slice", &TickFile::slice, "start"_a, "end"_a,
+           "Records with capture time in [start, end), usec since epoch")
+      .def("columns", &TickFile::columns, "start"_a = 0,
+           "end"_a = UINT64_MAX,
+           "Records with capture time in [start, end), as a dict of "
+           "read-only column arrays over the mapping");
+}
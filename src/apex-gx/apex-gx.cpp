@@ -20,6 +20,7 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/infra/SocketAddress.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/util/Config.hpp>
+#include <apex/util/MemoryPolicy.hpp>
 
 #include <unistd.h>
 #include <vector>
@@ -73,6 +74,7 @@ int main(int argc, char** argv)
     apex::Logger::instance().register_thread_id("main");
     apex::Logger::configure_from_config(
       config.get_sub_config("logging", apex::Config::empty_config()));
+    apex::memory::configure(config);
 
     // hard-code the run-mode based on the built-binary, since this is too
     // important a setting to try to control from configuration
@@ -0,0 +1,247 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/AsyncTickFileWriter.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+
+static constexpr int64_t usec_per_day = 86400LL * 1000000LL;
+
+
+AsyncTickbinWriter::Stream::Stream(AsyncTickbinWriter* owner, StreamInfo info,
+                                   size_t arena_size)
+  : _owner(owner),
+    _info(std::move(info))
+{
+  for (auto& arena : _arenas)
+    arena.bytes.resize(std::max(arena_size, tickbin::Serialiser::max_record_size));
+}
+
+
+template<typename T>
+void AsyncTickbinWriter::Stream::append(Time capture_time, const T& tick)
+{
+  const int64_t day = capture_time.as_epoch_us().count() / usec_per_day;
+
+  std::unique_lock<std::mutex> lock(_mutex);
+  Arena* arena = &_arenas[_front];
+
+  // an arena holds ticks of one day, because each day has its own file; this
+  // is the only case that can wait for the writer thread
+  if (arena->used && arena->day != day) {
+    _cv.wait(lock, [this]() { return !_back_busy; });
+    try_swap();
+    arena = &_arenas[_front];
+  }
+
+  if (arena->used + tickbin::Serialiser::max_record_size > arena->bytes.size()) {
+    if (try_swap()) {
+      arena = &_arenas[_front];
+    }
+    else {
+      // the writer thread has fallen behind, so grow rather than block
+      arena->bytes.resize(arena->bytes.size() * 2);
+      _owner->_arena_growths++;
+    }
+  }
+
+  if (arena->used == 0)
+    arena->day = day;
+  arena->used += tickbin::Serialiser::serialise(
+    arena->bytes.data() + arena->used, capture_time, tick);
+  _records++;
+}
+
+
+void AsyncTickbinWriter::Stream::write(Time capture_time, const TickTop& tick)
+{
+  append(capture_time, tick);
+}
+
+
+void AsyncTickbinWriter::Stream::write(Time capture_time, const TickTrade& tick)
+{
+  append(capture_time, tick);
+}
+
+
+bool AsyncTickbinWriter::Stream::try_swap()
+{
+  if (_back_busy || _arenas[_front].used == 0)
+    return false;
+  _front = 1 - _front;
+  _back_busy = true;
+  _owner->submit(this);
+  return true;
+}
+
+
+AsyncTickbinWriter::AsyncTickbinWriter(PathFn path_fn, json collect_meta,
+                                       Options options)
+  : _path_fn(std::move(path_fn)),
+    _collect_meta(std::move(collect_meta)),
+    _options(options),
+    _last_sync(std::chrono::steady_clock::now()),
+    _thread([this]() { this->run(); })
+{
+}
+
+
+AsyncTickbinWriter::~AsyncTickbinWriter()
+{
+  // write out everything captured; the front arena can only be handed over
+  // once the back arena has been written
+  for (auto& stream : _streams) {
+    std::unique_lock<std::mutex> lock(stream->_mutex);
+    auto idle = [&]() { return !stream->_back_busy; };
+    stream->_cv.wait(lock, idle);
+    stream->try_swap();
+    stream->_cv.wait(lock, idle);
+  }
+
+  {
+    auto lock = std::scoped_lock(_mutex);
+    _stop = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+
+AsyncTickbinWriter::Stream* AsyncTickbinWriter::add_stream(StreamInfo info)
+{
+  _streams.push_back(
+    std::make_unique<Stream>(this, std::move(info), _options.arena_size));
+  return _streams.back().get();
+}
+
+
+void AsyncTickbinWriter::flush()
+{
+  for (auto& stream : _streams) {
+    auto lock = std::scoped_lock(stream->_mutex);
+    stream->try_swap();
+  }
+}
+
+
+AsyncTickbinWriter::Stats AsyncTickbinWriter::stats() const
+{
+  Stats stats;
+  for (auto& stream : _streams)
+    stats.records += stream->record_count();
+  stats.bytes = _bytes;
+  stats.arena_growths = _arena_growths;
+  return stats;
+}
+
+
+void AsyncTickbinWriter::submit(Stream* stream)
+{
+  {
+    auto lock = std::scoped_lock(_mutex);
+    _pending.push_back(stream);
+  }
+  _cv.notify_one();
+}
+
+
+void AsyncTickbinWriter::run()
+{
+  Logger::instance().register_thread_id("tickwriter");
+
+  std::vector<Stream*> written;
+  while (true) {
+    Stream* stream = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      auto timeout = _options.fsync_interval.count()
+        ? _options.fsync_interval : std::chrono::milliseconds(1000);
+      _cv.wait_for(lock, timeout, [this]() { return _stop || !_pending.empty(); });
+      if (!_pending.empty()) {
+        stream = _pending.front();
+        _pending.pop_front();
+      }
+      else if (_stop)
+        break;
+    }
+
+    if (stream) {
+      try {
+        write_back_arena(stream);
+      }
+      catch (const std::exception& e) {
+        LOG_ERROR("failed to write ticks for " << stream->info().symbol()
+                  << "/" << stream->info().channel << ": " << e.what());
+      }
+      if (std::find(written.begin(), written.end(), stream) == written.end())
+        written.push_back(stream);
+
+      // release the arena back to the producer
+      {
+        auto lock = std::scoped_lock(stream->_mutex);
+        stream->_arenas[1 - stream->_front].used = 0;
+        stream->_back_busy = false;
+      }
+      stream->_cv.notify_all();
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (_options.fsync_interval.count() && !written.empty() &&
+        now - _last_sync >= _options.fsync_interval) {
+      for (auto* item : written)
+        if (item->_file)
+          item->_file->sync();
+      written.clear();
+      _last_sync = now;
+    }
+  }
+
+  for (auto* item : written)
+    if (item->_file && _options.fsync_interval.count())
+      item->_file->sync();
+}
+
+
+void AsyncTickbinWriter::write_back_arena(Stream* stream)
+{
+  // the back arena is owned by this thread until released
+  auto& arena = stream->_arenas[1 - stream->_front];
+  if (arena.used == 0)
+    return;
+
+  Time day_start{std::chrono::microseconds(arena.day * usec_per_day)};
+  auto bucketid = TickFileBucketId::from_time(day_start);
+  if (!stream->_file || !(stream->_file->bucketid() == bucketid)) {
+    auto [dir, fn] = _path_fn(stream->info(), bucketid);
+    stream->_file.reset();
+    stream->_file = std::make_unique<TickbinFileWriter>(
+      bucketid, dir, fn, stream->info(), _collect_meta, _options.file);
+  }
+
+  // a single write for the whole arena
+  stream->_file->write_bytes(arena.bytes.data(), arena.used);
+  _bytes += arena.used;
+}
+
+} // namespace apex
@@ -0,0 +1,156 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/Time.hpp>
+#include <apex/util/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace apex
+{
+
+/* Writes captured ticks to tickbin files on a dedicated thread, so that disk
+ * latency never delays the thread receiving market data.  Each stream has a
+ * pair of preallocated byte arenas: ticks are serialised in place into the
+ * front arena, while the back arena is written out by the writer thread. */
+class AsyncTickbinWriter
+{
+public:
+  struct Options {
+    // initial capacity of each arena; an arena grows if it fills while the
+    // writer thread is still busy with the other
+    size_t arena_size = 4 << 20;
+
+    // fsync written files at most this often; zero leaves syncing to the OS
+    std::chrono::milliseconds fsync_interval{0};
+
+    // format of the tick files written, e.g. compressed
+    TickbinFileWriter::Options file;
+  };
+
+  struct Stats {
+    size_t records = 0;
+    size_t bytes = 0;
+    size_t arena_growths = 0;
+  };
+
+  // Provides the directory and file name for a stream's tick file of a day.
+  using PathFn = std::function<std::pair<std::filesystem::path,
+                                         std::filesystem::path>(
+    const StreamInfo&, const TickFileBucketId&)>;
+
+  class Stream;
+
+  AsyncTickbinWriter(PathFn path_fn, json collect_meta, Options options);
+
+  /* Writes out all captured ticks before returning. */
+  ~AsyncTickbinWriter();
+
+  AsyncTickbinWriter(const AsyncTickbinWriter&) = delete;
+  AsyncTickbinWriter& operator=(const AsyncTickbinWriter&) = delete;
+
+  /* Add a stream; the returned object remains owned by the writer. */
+  Stream* add_stream(StreamInfo info);
+
+  /* Hand every non-empty front arena to the writer thread. */
+  void flush();
+
+  [[nodiscard]] Stats stats() const;
+
+private:
+  friend class Stream;
+
+  void submit(Stream*);
+  void run();
+  void write_back_arena(Stream*);
+
+  PathFn _path_fn;
+  json _collect_meta;
+  Options _options;
+
+  std::vector<std::unique_ptr<Stream>> _streams;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<Stream*> _pending;
+  bool _stop = false;
+
+  std::atomic<size_t> _bytes{0};
+  std::atomic<size_t> _arena_growths{0};
+  std::chrono::steady_clock::time_point _last_sync;
+
+  std::thread _thread;
+};
+
+
+/* A single captured stream.  Writes may come from any one thread at a time. */
+class AsyncTickbinWriter::Stream
+{
+public:
+  Stream(AsyncTickbinWriter* owner, StreamInfo info, size_t arena_size);
+
+  void write(Time capture_time, const TickTop&);
+  void write(Time capture_time, const TickTrade&);
+
+  [[nodiscard]] const StreamInfo& info() const { return _info; }
+
+  [[nodiscard]] size_t record_count() const { return _records; }
+
+private:
+  friend class AsyncTickbinWriter;
+
+  struct Arena {
+    std::vector<char> bytes;
+    size_t used = 0;
+    int64_t day = 0; // day number of the ticks held
+  };
+
+  template<typename T> void append(Time capture_time, const T& tick);
+
+  // With the stream lock held, hand a non-empty front arena to the writer
+  // thread, if the back arena is free; returns whether the arenas swapped.
+  bool try_swap();
+
+  AsyncTickbinWriter* _owner;
+  StreamInfo _info;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  Arena _arenas[2];
+  int _front = 0;
+  bool _back_busy = false;
+  std::atomic<size_t> _records{0};
+
+  // used only by the writer thread
+  std::unique_ptr<TickbinFileWriter> _file;
+};
+
+} // namespace apex
@@ -0,0 +1,305 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/BarFile.hpp>
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+
+BarAggregator::BarAggregator(std::chrono::microseconds interval,
+                             std::function<void(const Bar&)> emit)
+  : _interval(interval.count()),
+    _emit(std::move(emit))
+{
+  if (_interval <= 0)
+    THROW("bar interval must be positive");
+}
+
+
+// Emit the open bar if `t` is beyond it, and open the bar holding `t`.
+void BarAggregator::roll(Time t)
+{
+  auto us = t.as_epoch_us().count();
+  if (_open && us < _bar.end_us)
+    return;
+  flush();
+
+  _bar = Bar{};
+  _bar.start_us = us - us % _interval;
+  _bar.end_us = _bar.start_us + _interval;
+  _spread_sum = 0;
+  _open = true;
+}
+
+
+void BarAggregator::add_trade(Time t, double price, double qty)
+{
+  if (std::isnan(price))
+    return;
+  roll(t);
+  if (_bar.trades == 0) {
+    _bar.open = _bar.high = _bar.low = price;
+  }
+  else {
+    _bar.high = std::max(_bar.high, price);
+    _bar.low = std::min(_bar.low, price);
+  }
+  _bar.close = price;
+  _bar.volume += qty;
+  _bar.notional += price * qty;
+  _bar.trades++;
+}
+
+
+void BarAggregator::add_top(Time t, double bid, double ask)
+{
+  roll(t);
+  _bid = bid;
+  _ask = ask;
+  _bar.quotes++;
+  if (std::isnan(bid) || std::isnan(ask) || bid == 0.0 || ask == 0.0)
+    return;
+
+  double spread = ask - bid;
+  if (std::isnan(_bar.spread_min)) {
+    _bar.spread_min = _bar.spread_max = spread;
+  }
+  else {
+    _bar.spread_min = std::min(_bar.spread_min, spread);
+    _bar.spread_max = std::max(_bar.spread_max, spread);
+  }
+  _spread_sum += spread;
+}
+
+
+void BarAggregator::flush()
+{
+  if (!_open)
+    return;
+  if (!std::isnan(_bar.spread_min))
+    _bar.spread_mean = _spread_sum / _bar.quotes;
+  _bar.bid = _bid;
+  _bar.ask = _ask;
+  _open = false;
+  _emit(_bar);
+}
+
+
+bool BarAggregator::close_ended(Time now)
+{
+  if (!_open || now.as_epoch_us().count() < _bar.end_us)
+    return false;
+  flush();
+  return true;
+}
+
+
+// Open a tick file with the reader its name calls for.
+static std::unique_ptr<BaseTickFileReader> open_tick_file(const fs::path& fn,
+                                                          MarketData* md,
+                                                          bool trades)
+{
+  auto name = fn.filename().string();
+  auto ends_with = [&](const char* suffix) {
+    auto len = strlen(suffix);
+    return name.size() >= len && name.compare(name.size() - len, len, suffix) == 0;
+  };
+
+  auto stream = trades ? MdStream::AggTrades : MdStream::L1;
+  if (ends_with(".csv.gz"))
+    return std::make_unique<TardisFileReader>(
+        fn, md, stream,
+        trades ? TardisFileReader::DataType::trades
+               : TardisFileReader::DataType::book_snapshot_5);
+  if (ends_with(".bin2"))
+    return std::make_unique<Tickbin2FileReader>(fn, md, stream);
+  return std::make_unique<TickbinFileReader>(fn, md, stream);
+}
+
+
+size_t build_bar_file(const BarInputs& inputs, std::chrono::seconds interval,
+                      const fs::path& dest)
+{
+  struct Source {
+    MarketData md;
+    std::unique_ptr<BaseTickFileReader> reader;
+    bool trades = false;
+  };
+
+  // top of book first, so that a trade sees the quote of the same time
+  std::vector<std::unique_ptr<Source>> sources;
+  for (auto [fn, trades] : {std::make_pair(inputs.top, false),
+                            std::make_pair(inputs.trades, true)}) {
+    if (fn.empty())
+      continue;
+    auto source = std::make_unique<Source>();
+    source->reader = open_tick_file(fn, &source->md, trades);
+    source->trades = trades;
+    sources.push_back(std::move(source));
+  }
+  if (sources.empty())
+    THROW("no tick files to build bars from");
+
+  std::vector<Bar> bars;
+  BarAggregator aggregator(interval,
+                           [&](const Bar& bar) { bars.push_back(bar); });
+  for (;;) {
+    Source* next = nullptr;
+    for (auto& source : sources)
+      if (source->reader->has_next_event() &&
+          (!next || source->reader->next_event_time() <
+                        next->reader->next_event_time()))
+        next = source.get();
+    if (!next)
+      break;
+
+    auto t = next->reader->next_event_time();
+    next->reader->consume_next_event();
+    if (next->trades)
+      aggregator.add_trade(t, next->md.last().price, next->md.last().qty);
+    else
+      aggregator.add_top(t, next->md.bid(), next->md.ask());
+  }
+  aggregator.flush();
+
+  json meta;
+  meta["interval_sec"] = interval.count();
+  meta["trades"] = inputs.trades.string();
+  meta["top"] = inputs.top.string();
+  meta["bars"] = bars.size();
+  auto preamble = encode_tickbin_file_header(tickbar::version, meta);
+
+  if (dest.has_parent_path())
+    fs::create_directories(dest.parent_path());
+  std::ofstream os(dest, std::ios::binary | std::ios::trunc);
+  if (!os)
+    THROW("failed to open bar file " << dest);
+  os.write(preamble.data(), preamble.size());
+  os.write(reinterpret_cast<const char*>(bars.data()),
+           bars.size() * sizeof(Bar));
+  os.close();
+  if (os.fail())
+    THROW("failed to write bar file " << dest);
+
+  LOG_INFO("built " << bars.size() << " bars of " << interval.count()
+           << "s into " << dest);
+  return bars.size();
+}
+
+
+fs::path bar_file_path(const fs::path& tick_dir, std::chrono::seconds interval,
+                       Time date, const std::string& exchange,
+                       const std::string& symbol)
+{
+  auto fn = tick_dir;
+  fn /= "bars";
+  fn /= exchange;
+  fn /= std::to_string(interval.count()) + "s";
+  fn /= date.strftime("%Y");
+  fn /= date.strftime("%m");
+  fn /= date.strftime("%d");
+  fn /= symbol + ".bars";
+  return fn;
+}
+
+
+BarReplayer::BarReplayer(std::vector<fs::path> files,
+                         Time replay_from,
+                         std::function<void(const Bar&)> on_bar,
+                         TickFileCache* cache)
+  : _files(std::move(files)),
+    _replay_from(replay_from),
+    _on_bar(std::move(on_bar)),
+    _cache(cache)
+{
+}
+
+
+bool BarReplayer::open_next_file()
+{
+  _file.reset();
+  _head = nullptr;
+  if (_next_file >= _files.size())
+    return false;
+
+  auto& fn = _files[_next_file++];
+  LOG_INFO("reading bar file " << fn);
+  if (_cache)
+    _file = _cache->open(fn);
+  else
+    _file = std::make_shared<const MappedFile>(fn);
+
+  if (_file->size() < TickbinHeader::header_lead_length)
+    THROW("bar file has incomplete file header " << fn);
+  auto header = decode_tickbin_file_header(_file->begin());
+  if (header.version != tickbar::version)
+    THROW("file " << fn << " has tickbin version " << QUOTE(header.version)
+          << ", expected " << QUOTE(tickbar::version));
+  if (header.length > _file->size() ||
+      (_file->size() - header.length) % sizeof(Bar) != 0)
+    THROW("bar file is truncated " << fn);
+  _head = _file->begin() + header.length;
+  return true;
+}
+
+
+Time BarReplayer::get_next_event_time()
+{
+  const int64_t from = _replay_from.as_epoch_us().count();
+  for (;;) {
+    if (!_head && !open_next_file())
+      return Time{};
+
+    while (_head < _file->end()) {
+      int64_t start_us, end_us;
+      memcpy(&start_us, _head + offsetof(Bar, start_us), sizeof(start_us));
+      memcpy(&end_us, _head + offsetof(Bar, end_us), sizeof(end_us));
+      if (start_us >= from)
+        return Time{std::chrono::microseconds(end_us)};
+      _head += sizeof(Bar);
+    }
+    _head = nullptr;
+  }
+}
+
+
+void BarReplayer::consume_next_event()
+{
+  // called after get_next_event_time, so the head is a bar to replay
+  Bar bar;
+  memcpy(&bar, _head, sizeof(bar));
+  _head += sizeof(Bar);
+  _bars++;
+  _on_bar(bar);
+}
+
+} // namespace apex
@@ -0,0 +1,141 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* A bar file holds the fixed interval bars of one instrument, for research
+ * and backtests of strategies that only need bars, which replay far faster
+ * than the ticks they summarise.  After the usual tickbin preamble, whose
+ * meta-data gives the interval, the file is an array of Bar records, in time
+ * order; intervals without any tick have no bar. */
+namespace tickbar {
+
+constexpr const char* version = "TICKBAR";
+
+} // namespace tickbar
+
+/* Builds bars from ticks given in time order; a bar is emitted once a tick
+ * of a later interval arrives, or on flush. */
+class BarAggregator
+{
+public:
+  BarAggregator(std::chrono::microseconds interval,
+                std::function<void(const Bar&)> emit);
+
+  void add_trade(Time, double price, double qty);
+  void add_top(Time, double bid, double ask);
+
+  /* Emit the bar in progress, if any. */
+  void flush();
+
+  /* Emit the bar in progress if it has ended by `now`, so that a bar closes
+   * on time when no later tick arrives; returns whether it was emitted. */
+  bool close_ended(Time now);
+
+  /* End of the bar in progress, or empty if none. */
+  [[nodiscard]] Time open_bar_end() const
+  {
+    return _open ? _bar.end_time() : Time{};
+  }
+
+private:
+  void roll(Time);
+
+  int64_t _interval;
+  std::function<void(const Bar&)> _emit;
+  Bar _bar;
+  bool _open = false;
+  double _spread_sum = 0;
+  double _bid = nan;
+  double _ask = nan;
+};
+
+
+/* Tick files from which the bars of an instrument are built: trades, e.g. a
+ * tickbin "aggtrades" or Tardis "trades" file, and top of book, e.g. a tickbin
+ * "l1" or Tardis "book_snapshot_5" file.  Either may be empty.  The format of
+ * each is told by its name, as laid out by the tick collector. */
+struct BarInputs {
+  std::filesystem::path trades;
+  std::filesystem::path top;
+};
+
+/* Build a bar file, returning the number of bars written. */
+size_t build_bar_file(const BarInputs&, std::chrono::seconds interval,
+                      const std::filesystem::path& dest);
+
+/* Path of the bar file of an instrument for a day, under the tick-data
+ * directory, e.g. TICKDATA/bars/binance/60s/2024/02/01/BTCUSDT.bars. */
+std::filesystem::path bar_file_path(const std::filesystem::path& tick_dir,
+                                    std::chrono::seconds interval, Time date,
+                                    const std::string& exchange,
+                                    const std::string& symbol);
+
+
+/* Replays the bars of bar files, in order, as each bar ends, i.e. at the time
+ * its last tick would have been seen.  Bars starting before the replay start
+ * are skipped. */
+class BarReplayer : public BacktestEventSource
+{
+public:
+  BarReplayer(std::vector<std::filesystem::path> files,
+              Time replay_from,
+              std::function<void(const Bar&)> on_bar,
+              TickFileCache* cache = nullptr);
+
+  Time get_next_event_time() override;
+  void consume_next_event() override;
+  void init_backtest_time_range(Time, Time) override {}
+  const char* event_source_kind() const override { return "bars"; }
+
+  [[nodiscard]] size_t bar_count() const { return _bars; }
+
+  [[nodiscard]] const std::vector<std::filesystem::path>& files() const
+  {
+    return _files;
+  }
+
+private:
+  bool open_next_file();
+
+  std::vector<std::filesystem::path> _files;
+  size_t _next_file = 0;
+  Time _replay_from;
+  std::function<void(const Bar&)> _on_bar;
+  TickFileCache* _cache;
+  std::shared_ptr<const MappedFile> _file;
+  const char* _head = nullptr;
+  size_t _bars = 0;
+};
+
+} // namespace apex
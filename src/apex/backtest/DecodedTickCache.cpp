@@ -0,0 +1,301 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/DecodedTickCache.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace apex
+{
+
+namespace
+{
+
+// Held while an entry is created, so that only one process decodes it.
+class FileLock
+{
+public:
+  explicit FileLock(const fs::path& path)
+    : _fd(::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644))
+  {
+    if (_fd < 0 || ::flock(_fd, LOCK_EX) != 0)
+      THROW("cannot lock " << path << ", errno " << errno);
+  }
+
+  ~FileLock()
+  {
+    ::flock(_fd, LOCK_UN);
+    ::close(_fd);
+  }
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+
+private:
+  int _fd;
+};
+
+
+std::string entry_key(const fs::path& src, MdStream stream)
+{
+  auto canonical = fs::canonical(src).string();
+  auto mtime = fs::last_write_time(src).time_since_epoch().count();
+  std::ostringstream oss;
+  oss << canonical << "|" << fs::file_size(src) << "|" << mtime << "|"
+      << static_cast<int>(stream);
+
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016zx", std::hash<std::string>{}(oss.str()));
+  return std::string(hex) + "-" + src.filename().string();
+}
+
+
+void write_decoded(std::ofstream& os, const char* data, size_t len)
+{
+  os.write(data, len);
+  if (!os)
+    THROW("failed writing decoded tick file");
+}
+
+
+/* Decompress the frames of a TICKZ file, as TickbinFileReader replays them:
+ * a corrupt frame ends the file. */
+void decode_tickbin_frames(const MappedFile& file, size_t first,
+                           std::ofstream& os)
+{
+  size_t end = 0;
+  auto frames = find_tickbin_frames(file.begin(), file.size(), first, false, end);
+  std::vector<char> raw;
+  for (auto& frame : frames) {
+    tickbin::FrameHeader head;
+    memcpy(&head, file.begin() + frame.offset, sizeof(head));
+    const char* src = file.begin() + frame.offset + sizeof(head);
+    if (frame.offset + sizeof(head) + head.compressed_size > file.size())
+      break;
+
+    raw.resize(head.raw_size);
+    uLongf raw_len = head.raw_size;
+    if (crc32(0L, reinterpret_cast<const Bytef*>(src), head.compressed_size) != head.crc ||
+        uncompress(reinterpret_cast<Bytef*>(raw.data()), &raw_len,
+                   reinterpret_cast<const Bytef*>(src), head.compressed_size) != Z_OK ||
+        raw_len != head.raw_size) {
+      LOG_WARN("ignoring corrupt tickbin frame at offset " << frame.offset
+               << ", file " << file.path());
+      break;
+    }
+    write_decoded(os, raw.data(), raw.size());
+  }
+}
+
+
+/* Replay a tickbin2 file into raw records; the ticks are taken from the
+ * market data after each event. */
+void decode_tickbin2(Tickbin2FileReader& reader, MarketData& md,
+                     std::ofstream& os)
+{
+  char buf[tickbin::Serialiser::max_record_size];
+  Time time;
+  md.subscribe_events([&](MarketData::EventType et) {
+    size_t len = 0;
+    if (et.is_top()) {
+      TickTop tick;
+      tick.bid_price = md.l1_bid().price;
+      tick.bid_qty = md.l1_bid().qty;
+      tick.ask_price = md.l1_ask().price;
+      tick.ask_qty = md.l1_ask().qty;
+      len = tickbin::Serialiser::serialise(buf, time, tick);
+    }
+    else if (et.is_trade())
+      len = tickbin::Serialiser::serialise(buf, time, md.last());
+    write_decoded(os, buf, len);
+  });
+
+  while (reader.has_next_event()) {
+    time = reader.next_event_time();
+    reader.consume_next_event();
+  }
+}
+
+} // namespace
+
+
+DecodedTickCache::DecodedTickCache(fs::path dir, uint64_t budget_bytes)
+  : _dir(std::move(dir)),
+    _budget(budget_bytes)
+{
+  create_dir(_dir);
+}
+
+
+fs::path DecodedTickCache::get(const fs::path& src, MdStream stream)
+{
+  auto ext = src.extension();
+  if (ext != ".binz" && ext != ".bin2")
+    return {};
+
+  auto key = entry_key(src, stream);
+  auto entry = _dir / (key + ".bin");
+
+  // a hit only refreshes the entry's position in the LRU order
+  std::error_code err;
+  if (fs::exists(entry)) {
+    fs::last_write_time(entry, fs::file_time_type::clock::now(), err);
+    return entry;
+  }
+
+  FileLock lock(_dir / (key + ".lock"));
+  if (fs::exists(entry))
+    return entry;
+
+  auto tmp = entry;
+  tmp += ".tmp." + std::to_string(::getpid()) + "." +
+    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  try {
+    decode(src, stream, tmp);
+  }
+  catch (...) {
+    fs::remove(tmp, err);
+    fs::remove(tickbin_index_path(tmp), err);
+    throw;
+  }
+  if (!fs::exists(tmp))
+    return {};
+
+  // the index goes first, so an entry is never seen without it
+  build_tickbin_index(tmp);
+  fs::rename(tickbin_index_path(tmp), tickbin_index_path(entry));
+  fs::rename(tmp, entry);
+  LOG_INFO("decoded tick file " << src << " into cache as " << entry);
+
+  evict(entry);
+  return entry;
+}
+
+
+void DecodedTickCache::decode(const fs::path& src, MdStream stream,
+                              const fs::path& dest)
+{
+  json meta;
+  std::function<void(std::ofstream&)> write_records;
+
+  MappedFile file(src);
+  std::unique_ptr<MarketData> md;
+  std::unique_ptr<Tickbin2FileReader> reader;
+
+  if (src.extension() == ".binz") {
+    if (file.size() < TickbinHeader::header_lead_length)
+      THROW("tickbin file has incomplete file header " << src);
+    auto header = decode_tickbin_file_header(file.begin());
+    if (header.version != tickbin::compressed_version)
+      return;
+    meta = json::parse(file.begin() + TickbinHeader::header_lead_length,
+                       file.begin() + header.length);
+    write_records = [&](std::ofstream& os) {
+      decode_tickbin_frames(file, header.length, os);
+    };
+  }
+  else {
+    // depth snapshots have no raw tickbin record, so are not cached
+    md = std::make_unique<MarketData>();
+    reader = std::make_unique<Tickbin2FileReader>(src, md.get(), stream);
+    if (reader->layout() == tickbin2::Layout::Book5 ||
+        reader->layout() == tickbin2::Layout::Book25)
+      return;
+    meta = reader->meta();
+    write_records = [&](std::ofstream& os) {
+      decode_tickbin2(*reader, *md, os);
+    };
+  }
+
+  meta["decoded_from"] = src.string();
+  auto preamble = encode_tickbin_file_header("TICK1", meta);
+
+  std::ofstream os(dest, std::ios::binary | std::ios::trunc);
+  write_decoded(os, preamble.data(), preamble.size());
+  write_records(os);
+  os.close();
+  if (os.fail())
+    THROW("failed to write decoded tick file " << dest);
+}
+
+
+void DecodedTickCache::evict(const fs::path& keep)
+{
+  struct Entry {
+    fs::path path;
+    fs::file_time_type used;
+    uint64_t size;
+  };
+
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  std::error_code err;
+  for (auto& item : fs::directory_iterator(_dir, err)) {
+    if (item.path().extension() != ".bin")
+      continue;
+    auto size = item.file_size(err);
+    auto used = item.last_write_time(err);
+    if (err)
+      continue; // removed by another process
+    std::error_code index_err;
+    auto index_size = fs::file_size(tickbin_index_path(item.path()), index_err);
+    if (!index_err)
+      size += index_size;
+    entries.push_back({item.path(), used, size});
+    total += size;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& lhs, const Entry& rhs) { return lhs.used < rhs.used; });
+
+  for (auto& entry : entries) {
+    if (total <= _budget)
+      break;
+    if (entry.path == keep)
+      continue;
+    LOG_INFO("evicting decoded tick file " << entry.path);
+    fs::remove(entry.path, err);
+    fs::remove(tickbin_index_path(entry.path), err);
+    auto lock = entry.path;
+    lock.replace_extension(".lock");
+    fs::remove(lock, err);
+    total -= entry.size;
+  }
+}
+
+} // namespace apex
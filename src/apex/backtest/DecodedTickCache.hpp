@@ -0,0 +1,65 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/MarketData.hpp>
+
+#include <cstdint>
+#include <filesystem>
+
+namespace apex
+{
+
+/* Cache of decoded tick files, shared by all backtest processes on a host
+ * that use the same directory, typically under /dev/shm.  A compressed
+ * tickbin file (TICKZ), or a tickbin2 file of L1 or trades, is decoded once
+ * into a raw tickbin image, with its time index, which readers then map
+ * directly rather than each decompressing and parsing the source.
+ *
+ * Entries are keyed by the source path, size and modification time, and by
+ * stream, so a changed source gets a new entry.  Entries are created under a
+ * file lock, written to a private file and renamed into place, so readers
+ * never see a partial entry, and concurrent processes decode a file once.
+ * Once the total size exceeds the budget, the least recently used entries
+ * are removed; a process that still maps a removed entry is unaffected. */
+class DecodedTickCache
+{
+public:
+  DecodedTickCache(std::filesystem::path dir, uint64_t budget_bytes);
+
+  /* Path of the decoded image of `src`, decoding it if not yet cached; or
+   * empty if the file is of a kind not cached, and should be read from the
+   * source. */
+  std::filesystem::path get(const std::filesystem::path& src, MdStream stream);
+
+  [[nodiscard]] const std::filesystem::path& dir() const { return _dir; }
+  [[nodiscard]] uint64_t budget() const { return _budget; }
+
+  /* Remove least recently used entries, other than `keep`, until the cache
+   * is within budget. */
+  void evict(const std::filesystem::path& keep = {});
+
+private:
+  void decode(const std::filesystem::path& src, MdStream,
+              const std::filesystem::path& dest);
+
+  std::filesystem::path _dir;
+  uint64_t _budget;
+};
+
+} // namespace apex
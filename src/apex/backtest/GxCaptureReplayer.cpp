@@ -0,0 +1,144 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/GxCaptureReplayer.hpp>
+#include <apex/comm/GxClientSession.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+
+static RealtimeEventLoop::Options driven_loop_options()
+{
+  RealtimeEventLoop::Options options;
+  options.own_thread = false;
+  return options;
+}
+
+
+GxCaptureReplayer::GxCaptureReplayer(const std::filesystem::path& capture_dir,
+                                     Time replay_from)
+  : _replay_from(replay_from),
+    _evloop(driven_loop_options(), []() { return false; })
+{
+  // segments are named by stream, then creation time and sequence number, so
+  // sort in the order written
+  const std::string prefix = std::string(GxClientSession::capture_stream) + "-";
+  if (std::filesystem::is_directory(capture_dir))
+    for (auto& entry : std::filesystem::directory_iterator(capture_dir)) {
+      auto name = entry.path().filename().string();
+      if (entry.is_regular_file() && name.rfind(prefix, 0) == 0 &&
+          entry.path().extension() == ".cap")
+        _files.push_back(entry.path());
+    }
+  if (_files.empty())
+    THROW("no GX capture files found under " << capture_dir);
+  std::sort(_files.begin(), _files.end());
+  LOG_INFO("GX capture files under " << capture_dir << ": " << _files.size());
+
+  // the loop is driven here, on the backtest thread, and needs no wakeup
+  _evloop.set_wakeup_fn([]() {});
+  _evloop.attach_current_thread();
+
+  _session = std::make_shared<GxClientSession>(
+      _ioloop, _evloop, "capture", capture_dir.filename().string(), nullptr);
+  _has_next = read_next();
+}
+
+
+GxCaptureReplayer::~GxCaptureReplayer()
+{
+  _session.reset();
+  _evloop.sync_stop();
+  _ioloop.sync_stop();
+}
+
+
+void GxCaptureReplayer::subscribe(const std::string& symbol,
+                                  ExchangeId exchange, MarketData* mktdata,
+                                  int streams)
+{
+  if (_started)
+    THROW("GX capture subscription of " << QUOTE(symbol)
+          << " made after replay started");
+  _session->subscribe(symbol, exchange, mktdata, streams);
+  drain();
+}
+
+
+bool GxCaptureReplayer::read_next()
+{
+  while (true) {
+    if (_reader && _reader->next(_next))
+      return true;
+    if (_file_index == _files.size())
+      return false;
+    _reader = std::make_unique<RawCaptureReader>(_files[_file_index++]);
+  }
+}
+
+
+void GxCaptureReplayer::drain()
+{
+  while (_evloop.has_pending())
+    _evloop.run_pending();
+}
+
+
+void GxCaptureReplayer::replay_next()
+{
+  _session->replay_frame(_next.msg, _next.time);
+  drain();
+  _has_next = read_next();
+}
+
+
+void GxCaptureReplayer::start()
+{
+  // frames before the replay period only establish subscriptions
+  _started = true;
+  while (_has_next && _next.time < _replay_from) {
+    auto* header = reinterpret_cast<const gx::Header*>(_next.msg.data());
+    if (_next.msg.size() >= sizeof(gx::Header) &&
+        header->type == gx::Type::subscribe)
+      replay_next();
+    else
+      _has_next = read_next();
+  }
+}
+
+
+Time GxCaptureReplayer::get_next_event_time()
+{
+  if (!_started)
+    start();
+  return _has_next ? _next.time : Time{};
+}
+
+
+void GxCaptureReplayer::consume_next_event()
+{
+  if (!_started)
+    start();
+  if (_has_next)
+    replay_next();
+}
+
+} // namespace apex
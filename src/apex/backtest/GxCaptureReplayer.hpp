@@ -0,0 +1,87 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/infra/IoLoop.hpp>
+#include <apex/model/ExchangeId.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/util/RawCapture.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class GxClientSession;
+class MarketData;
+
+/* Replays the inbound frames of a GX session captured by
+ * GxClientSession::set_capture, as a backtest event source.  The frames are
+ * decoded by a GxClientSession, the same code that handled them live, on an
+ * event loop driven by the replayer, so that a strategy sees each tick as it
+ * did, at the time it was received.  Subscriptions are matched to those of
+ * the capture by symbol, and must be made before replay starts; frames before
+ * `replay_from` are skipped, except for the subscriptions they record. */
+class GxCaptureReplayer : public BacktestEventSource
+{
+public:
+  GxCaptureReplayer(const std::filesystem::path& capture_dir, Time replay_from);
+  ~GxCaptureReplayer() override;
+
+  GxCaptureReplayer(const GxCaptureReplayer&) = delete;
+  GxCaptureReplayer& operator=(const GxCaptureReplayer&) = delete;
+
+  /* Direct the captured ticks of a symbol to a MarketData. */
+  void subscribe(const std::string& symbol, ExchangeId, MarketData*,
+                 int streams = 0);
+
+  Time get_next_event_time() override;
+  void consume_next_event() override;
+  void init_backtest_time_range(Time, Time) override {}
+  const char* event_source_kind() const override { return "gx_capture"; }
+
+  /* Capture segment files, in replay order. */
+  [[nodiscard]] const std::vector<std::filesystem::path>& files() const
+  {
+    return _files;
+  }
+
+private:
+  bool read_next();
+  void start();
+  void replay_next();
+  void drain();
+
+  std::vector<std::filesystem::path> _files;
+  size_t _file_index = 0;
+  std::unique_ptr<RawCaptureReader> _reader;
+  RawCaptureReader::Record _next;
+  bool _has_next = false;
+  bool _started = false;
+  Time _replay_from;
+
+  IoLoop _ioloop;
+  RealtimeEventLoop _evloop;
+  std::shared_ptr<GxClientSession> _session;
+};
+
+} // namespace apex
@@ -16,113 +16,116 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/backtest/SimExchange.hpp>
+#include <apex/backtest/SimFillModel.hpp>
+#include <apex/backtest/SimLatencyModel.hpp>
+#include <apex/backtest/SimMatchingBook.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/tick_msgs.hpp>
 #include <apex/model/MarketData.hpp>
+#include <apex/model/InstrumentTable.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/core/OrderService.hpp>
 #include <apex/core/Services.hpp>
 #include <apex/core/MarketDataService.hpp>
 #include <apex/util/EventLoop.hpp>
+#include <apex/util/ObjectPool.hpp>
 #include <apex/core/Errors.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <utility>
+#include <vector>
 
 namespace apex
 {
 
 
-static bool is_zero(double d) { return fabs(d) < 0.000001; }
+// Timer delay for a message on a simulated path; timers have millisecond
+// resolution, so latencies are rounded up.
+static std::chrono::milliseconds timer_delay(SimLatencyModel& model, Time now)
+{
+  return std::chrono::ceil<std::chrono::milliseconds>(model.next(now));
+}
 
 
-class SimLimitOrder {
+class SimLimitOrder : public SimRestingOrder {
 public:
-  using OnFillFn = std::function<void(double size, bool fully_filled)>;
-
-  SimLimitOrder(Order&,
-                std::string ext_order_id,
-                double size,
-                double price,
-                Side side);
-
-  Side side() const { return _side; }
-  double size() const { return _size; }
-  double price() const { return _price; }
-  double size_remain() const { return _size_remain; }
-  void apply_fill(double d) {
-    _size_remain -= d;
+  SimLimitOrder(Order& order, uint64_t id, std::string ext_order_id,
+                double size, double price, Side side)
+    : SimRestingOrder(id, side, size, price),
+      _ext_order_id(std::move(ext_order_id)),
+      _order(order.weak_from_this())
+  {
   }
 
   std::weak_ptr<Order>& orig_order() { return _order; };
 
-  bool is_fully_filled() const;
-
-  const std::string& ext_order_id() const { return _ext_order_id; }
+  const OrderIdString& ext_order_id() const { return _ext_order_id; }
 
 private:
-  std::string _symbol;
-  std::string _ext_order_id;
-  double _size;
-  double _price;
-  Side _side;
-  double _size_remain;
+  OrderIdString _ext_order_id;
   std::weak_ptr<Order> _order;
-  OnFillFn _on_fill_fn;
 };
 
 
-class SimOrderBook {
+/* Resting orders of the backtest for one instrument.  The matching is done by
+ * a SimMatchingBook, against the instrument's MarketData, and messages to the
+ * order are delayed by the exchange's latency models.  Orders are found by
+ * their integer id, the handle of the originating Order. */
+class SimOrderBook : private MarketData::Listener,
+                     private SimMatchingBook::Handler {
 public:
-  SimOrderBook(Services *, const Instrument&);
+  SimOrderBook(Services *, const Instrument&, const SimFillModel&,
+               SimLatencies&, SimCrossFill);
+  ~SimOrderBook() override;
 
-  std::shared_ptr<SimLimitOrder> add_order(Order&, std::string ext_order_id);
-  void remove_order(std::shared_ptr<SimLimitOrder>&);
+  bool contains(uint64_t id) { return _book->find(id) != nullptr; }
 
-  void apply_trade(double price, double size);
+  void add_order(Order&, uint64_t id, std::string ext_order_id);
+  void remove_order(Order&, uint64_t id);
 
-private:
-  bool erase_order(std::shared_ptr<SimLimitOrder>&);
-  void raise_fill_event(double fill_size,
-                        bool fully_filled, std::shared_ptr<SimLimitOrder> & order);
+  // Cancel-replace: the replacement rests at the back of its level, as a new
+  // order would.
+  void replace_order(Order&, uint64_t id, std::string ext_order_id);
 
 private:
-  Services* _services;
-  MarketData* _mkt = nullptr;
-  Instrument _instrument;
+  void on_market_event(MarketData::EventType) override;
 
-  using HalfOrderBook = std::multimap<double, std::shared_ptr<SimLimitOrder>>;
-  HalfOrderBook _bids;
-  HalfOrderBook _asks;
-};
+  // without resting orders, a top of book update has nothing to match
+  bool needs_each_top() const override { return !_book->empty(); }
 
+  void on_sim_fill(SimRestingOrder&, double price, double size,
+                   bool fully_filled) override;
 
-SimLimitOrder::SimLimitOrder(Order& order,
-                             std::string ext_order_id,
-                             double size,
-                             double price,
-                             Side side)
-  : _ext_order_id(std::move(ext_order_id)),
-    _size(size),
-    _price(price),
-    _side(side),
-    _size_remain(size),
-    _order(order.weak_from_this())
-{
+  void rest_order(Order&, uint64_t id, const std::string& ext_order_id,
+                  double size, double price);
 
-}
+  // match orders marketable on arrival, whose fills are not reported before
+  // their ack, due after `ack_delay`
+  void match_crosses(std::chrono::milliseconds ack_delay);
 
+private:
+  Services* _services;
+  MarketData* _mkt = nullptr;
+  const Instrument& _instrument; // interned
+  SimLatencies& _latencies;
+  std::unique_ptr<SimMatchingBook> _book;
 
-bool SimLimitOrder::is_fully_filled() const
-{
-  return is_zero(_size_remain) || _size_remain < 0.0;
-}
+  // least delay of fills raised by the current match
+  std::chrono::milliseconds _min_fill_delay{0};
+};
 
 
 SimOrderBook::SimOrderBook(Services * services,
-                           const Instrument& instrument)
+                           const Instrument& instrument,
+                           const SimFillModel& fill_model,
+                           SimLatencies& latencies,
+                           SimCrossFill cross_fill)
   : _services(services),
     _mkt(nullptr),
-    _instrument(instrument)
+    _instrument(InstrumentTable::instance().resolve(instrument)),
+    _latencies(latencies)
 {
   // setup market data subscription
   _mkt = _services->market_data_service()->find_market_data(instrument);
@@ -130,188 +133,83 @@ SimOrderBook::SimOrderBook(Services * services,
     THROW("SimOrderBook failed to obtain a MarketData instance for instrument "
           << instrument);
   }
+  SimMatchingBook::Handler& handler = *this;
+  _book = std::make_unique<SimMatchingBook>(*_mkt, fill_model, cross_fill,
+                                            handler);
 
-  _mkt->subscribe_events([this](MarketData::EventType event_type) {
-    if (true) {
-      if (event_type.is_trade()) {
-        this->apply_trade(_mkt->last().price,
-                          _mkt->last().qty);
-      }
+  _mkt->add_listener(this, MarketData::EventType::trade |
+                               MarketData::EventType::top |
+                               MarketData::EventType::full_book);
+}
 
-      if (event_type.is_top()) {
-        // this->on_tick_book(event_type);
-      }
-    }
-  });
+
+SimOrderBook::~SimOrderBook()
+{
+  _mkt->remove_listener(this);
 }
 
 
-bool SimOrderBook::erase_order(std::shared_ptr<SimLimitOrder>& lob_order) {
-  HalfOrderBook* hb = (lob_order->side() == Side::buy)? &_bids : &_asks;
-  for (auto iter = hb->begin(); iter != hb->end(); ++iter) {
-    if (iter->second->ext_order_id() == lob_order->ext_order_id()) {
-      hb->erase(iter);
-      return true;
-    }
-  }
+void SimOrderBook::on_market_event(MarketData::EventType event_type)
+{
+  if (event_type.is_trade())
+    _book->apply_trade(_mkt->last().price, _mkt->last().qty);
+  else
+    _book->apply_book_change();
+}
+
 
-  return false;
+void SimOrderBook::match_crosses(std::chrono::milliseconds ack_delay)
+{
+  _min_fill_delay = ack_delay;
+  scope_guard on_done([&]() { _min_fill_delay = {}; });
+  _book->match_crosses();
 }
 
 
-void SimOrderBook::raise_fill_event(double fill_size,
-                                    bool fully_filled, std::shared_ptr<SimLimitOrder> & order)
+void SimOrderBook::on_sim_fill(SimRestingOrder& resting, double fill_price,
+                               double fill_size, bool fully_filled)
 {
   using namespace std::chrono_literals;
-  auto latency = 100ms;
+  auto& order = static_cast<SimLimitOrder&>(resting);
+  auto latency = std::max(timer_delay(*_latencies.fill, _services->now()),
+                          _min_fill_delay);
 
   OrderFill fill;
   fill.is_fully_filled = fully_filled;
   fill.recv_time = {};
-  fill.price = order->price();
+  fill.price = fill_price;
   fill.size = fill_size;
   _services->evloop()->dispatch(
     latency,
-    [order_wp=order->orig_order(), fill](){
+    EventLoop::inline_timer_fn([order_wp=order.orig_order(), fill](){
       if (auto order_sp = order_wp.lock()) {
         order_sp->apply(fill);
       }
       return 0ms;
-    });
+    }));
 }
 
 
-void SimOrderBook::apply_trade(double price, double size)
+void SimOrderBook::rest_order(Order& order, uint64_t id,
+                              const std::string& ext_order_id, double size,
+                              double price)
 {
-  std::list<std::shared_ptr<SimLimitOrder>> fully_filled_orders;
-  // scope guard to erase any sim-orders that were fully filled.
-  scope_guard on_done([&]() {
-    if (!fully_filled_orders.empty()) {
-      for (auto & order: fully_filled_orders)
-        erase_order(order);
-      fully_filled_orders.clear();
-    }
-  });
-
-  double qty_remain = size;
-
-  // Apply the fill to the bids
-
-  for (auto iter = _bids.rbegin();
-       iter != _bids.rend() && qty_remain > 0 && !is_zero(qty_remain);
-       ++iter) {
-    auto& order = iter->second;
-
-    // note: we assume order has been executed if trades occur at a further away
-    // price.
-
-    if (price < order->price()) {
-      // apply the fill to qty ahead, ie, the qty already resting on the
-      // book ahead of the order
-#if 0
-      const double qty_ahead_taken = std::min(qty_remain, order->size_ahead());
-      order->qty_ahead -= qty_ahead_taken;
-      qty_remain -= qty_ahead_taken;
-#endif
-
-      // apply the fill to the resting order
-
-      const double qty_fill = std::min(qty_remain, order->size_remain());
-      order->apply_fill(qty_fill);
-      qty_remain -= qty_fill;
-
-      bool order_fully_filled = is_zero(order->size_remain());
-
-      // raise a fill event
-      raise_fill_event(qty_fill, order_fully_filled, order);
-
-      if (order_fully_filled)
-        fully_filled_orders.push_back(order);
-    } else
-      break; /* no prices left to fill */
-  }
-
-  // Apply the fill to the offers
-
-  for (auto iter = _asks.begin();
-       iter != _asks.end() && qty_remain > 0 && !is_zero(qty_remain);
-       ++iter) {
-    auto& order = iter->second;
-
-    // note: we assume order has been executed if trades occur at a further away
-    // price.
-
-    if (price > order->price()) {
-      // apply the fill to qty ahead, ie, the qty already resting on the
-      // book ahead of the order
-#if 0
-      const double qty_ahead_taken = std::min(qty_remain, order->size_ahead());
-      order->qty_ahead -= qty_ahead_taken;
-      qty_remain -= qty_ahead_taken;
-#endif
-
-      // apply the fill to the order
-      const double qty_fill = std::min(qty_remain, order->size_remain());
-      order->apply_fill(qty_fill);
-      qty_remain -= qty_fill;
-
-      bool order_fully_filled = is_zero(order->size_remain());
-
-      // raise a fill event
-      raise_fill_event(qty_fill, order_fully_filled, order);
-
-      if (order_fully_filled)
-        fully_filled_orders.push_back(order);
-    } else
-      break; /* no prices left to fill */
-  }
-
+  if (order.side() == Side::buy || order.side() == Side::sell)
+    _book->rest(make_pooled<SimLimitOrder>(_book->order_pool(), order, id,
+                                           ext_order_id, size, price,
+                                           order.side()));
 }
 
 
-std::shared_ptr<SimLimitOrder> SimOrderBook::add_order(Order& order,
-                                                       std::string ext_order_id)
+void SimOrderBook::add_order(Order& order, uint64_t id,
+                             std::string ext_order_id)
 {
   using namespace std::chrono_literals;
-  auto latency = 100ms;
+  auto latency = timer_delay(*_latencies.order, _services->now());
 
   auto order_wp = order.weak_from_this();
 
-  // create the resting order object
-
-  auto sim_order = std::make_shared<SimLimitOrder>(
-    order,
-    ext_order_id,
-    order.size(),
-    order.price(),
-    order.side()
-    );
-
-
-  // auto on_fill_fn = [this, order_wp, latency](double size, double price, bool fully_filled) {
-
-  //   OrderFill fill;
-  //   fill.is_fully_filled = fully_filled;
-  //   fill.recv_time = {};
-  //   fill.price = price;
-  //   fill.size = size;
-  //   _services->evloop()->dispatch(
-  //     latency,
-  //     [order_wp, fill](){
-  //       if (auto order_sp = order_wp.lock()) {
-  //         order_sp->apply(fill);
-  //       }
-  //       return 0ms;
-  //     });
-  // };
-
-  // insert price containers
-
-  if (order.side() == Side::buy) {
-    _bids.insert({order.price(), sim_order});
-  } else if (order.side() == Side::sell) {
-    _asks.insert({order.price(), sim_order});
-  }
+  rest_order(order, id, ext_order_id, order.size(), order.price());
 
   // ack the order
   _services->evloop()->dispatch(latency,
@@ -326,22 +224,24 @@ std::shared_ptr<SimLimitOrder> SimOrderBook::add_order(Order& order,
                                   return 0ms;
                                 });
 
-  return sim_order;
+  // a marketable order fills on arrival; its fill is not reported before
+  // its ack, which is due first on an equal tick
+  match_crosses(latency);
 }
 
 
-void SimOrderBook::remove_order(std::shared_ptr<SimLimitOrder>& order) {
+void SimOrderBook::remove_order(Order& order, uint64_t id) {
   using namespace std::chrono_literals;
-  auto latency = 100ms;
-
-  const std::string ext_order_id = order->ext_order_id();
-  bool removed = erase_order(order);
+  auto latency = timer_delay(*_latencies.cancel, _services->now());
 
-  auto order_wp = order->orig_order();
-  if (removed) {
+  auto order_wp = order.weak_from_this();
+  auto* sim_order = static_cast<SimLimitOrder*>(_book->find(id));
+  if (sim_order) {
+    OrderIdString ext_order_id = sim_order->ext_order_id();
+    _book->erase(*sim_order);
     _services->evloop()->dispatch(
       latency,
-      [order_wp, ext_order_id](){
+      EventLoop::inline_timer_fn([order_wp, ext_order_id](){
         if (auto order_sp = order_wp.lock()) {
           OrderUpdate update;
           update.state = OrderState::closed;
@@ -350,26 +250,94 @@ void SimOrderBook::remove_order(std::shared_ptr<SimLimitOrder>& order) {
           order_sp->apply(update);
         }
         return 0ms;
-      });
+      }));
   }
   else {
     _services->evloop()->dispatch(
       latency,
-      [order_wp](){
+      EventLoop::inline_timer_fn([order_wp](){
         if (auto order_sp = order_wp.lock()) {
           auto text = "order not found";
-          auto code = error::e0102;
+          auto code = error::e0103;
           order_sp->apply_cancel_reject(code, text);
         }
         return 0ms;
-      });
+      }));
   }
 }
 
 
+void SimOrderBook::replace_order(Order& order, uint64_t id,
+                                 std::string ext_order_id)
+{
+  using namespace std::chrono_literals;
+  auto latency = timer_delay(*_latencies.order, _services->now());
+
+  auto order_wp = order.weak_from_this();
+  auto* sim_order = _book->find(id);
+  if (!sim_order) {
+    _services->evloop()->dispatch(
+      latency,
+      EventLoop::inline_timer_fn([order_wp](){
+        if (auto order_sp = order_wp.lock())
+          order_sp->apply_amend_reject(error::e0103, "order not found");
+        return 0ms;
+      }));
+    return;
+  }
+
+  _book->erase(*sim_order);
+  rest_order(order, id, ext_order_id, order.amend_size(), order.amend_price());
+
+  // ack the replacement
+  _services->evloop()->dispatch(
+    latency,
+    [order_wp, ext_order_id](){
+      if (auto order_sp = order_wp.lock()) {
+        OrderUpdate update;
+        update.state = OrderState::live;
+        update.ext_order_id = ext_order_id;
+        order_sp->apply_amend(update);
+      }
+      return 0ms;
+    });
+
+  // as for a new order, a marketable replacement fills after its ack
+  match_crosses(latency);
+}
+
+
 SimExchange::SimExchange(Services* services)
   : _services(services)
 {
+  auto config = services->config().get_sub_config("sim_exchange",
+                                                  Config::empty_config());
+  _fill_model = make_sim_fill_model(config.get_string("fill_model", "queue"));
+  _latencies = make_sim_latencies(
+      config.get_sub_config("latency", Config::empty_config()));
+  _cross_fill = to_sim_cross_fill(config.get_string("cross_fill", "visible"));
+}
+
+
+SimExchange::SimExchange(Services* services,
+                         std::unique_ptr<SimFillModel> fill_model,
+                         SimLatencies latencies,
+                         SimCrossFill cross_fill)
+  : _services(services),
+    _fill_model(std::move(fill_model)),
+    _latencies(std::move(latencies)),
+    _cross_fill(cross_fill)
+{
+  if (!_fill_model) {
+    THROW("SimExchange requires a fill model");
+  }
+
+  // default any path not provided
+  auto defaults = make_sim_latencies(Config::empty_config());
+  for (auto path : {&SimLatencies::order, &SimLatencies::cancel,
+                    &SimLatencies::fill})
+    if (!(_latencies.*path))
+      _latencies.*path = std::move(defaults.*path);
 }
 
 
@@ -378,29 +346,39 @@ SimExchange::~SimExchange() = default;
 void SimExchange::send_order(Order& order) {
 
   using namespace std::chrono_literals;
-  auto latency = 100ms;
 
   // invent an external order ID
   std::string ext_order_id = "sim_" + order.order_id();
 
-  if (_all_orders.find(ext_order_id) != std::end(_all_orders)) {
+  auto* book = _books.find(order.instrument());
+  if (!book) {
+    THROW("no limit-order-book for " << order.instrument());
+  }
+
+  auto id = OrderService::decode_handle(order.order_id());
+  if (!id || (*book)->contains(id)) {
     _services->evloop()->dispatch(
-      latency,
-      [order_wp=order.weak_from_this()](){
+      timer_delay(*_latencies.order, _services->now()),
+      [order_wp=order.weak_from_this(), id](){
         if (auto order_sp = order_wp.lock()) {
           auto reject_code = error::e0102;
-          auto reject_text = "duplicate external order ID";
+          auto reject_text =
+              id ? "duplicate external order ID" : "invalid order ID";
           order_sp->set_is_rejected(reject_code, reject_text);
         }
         return 0ms;
       });
+    return;
   }
 
-  auto iter = _books.find(order.instrument());
-  if (iter != std::end(_books)) {
-    auto resting_order = iter->second->add_order(order, ext_order_id);
-    if (resting_order)
-      _all_orders.insert({ext_order_id, std::move(resting_order)});
+  (*book)->add_order(order, id, std::move(ext_order_id));
+}
+
+
+void SimExchange::cancel_order(Order& order) {
+  if (auto* book = _books.find(order.instrument())) {
+    (*book)->remove_order(
+        order, OrderService::decode_handle(order.order_id()));
   }
   else {
     THROW("no limit-order-book for " << order.instrument());
@@ -408,35 +386,17 @@ void SimExchange::send_order(Order& order) {
 }
 
 
-void SimExchange::cancel_order(Order& order) {
-  using namespace std::chrono_literals;
-  auto latency = 100ms;
-
-  const std::string & ext_order_id = order.ext_order_id();
-  auto iter2 = _all_orders.find(ext_order_id);
-  if (iter2 == std::end(_all_orders)) {
-    _services->evloop()->dispatch(
-      latency,
-      [order_wp=order.weak_from_this()]() {
-        if (auto order_sp = order_wp.lock()) {
-          auto err_code = error::e0103;
-          auto err_text = "order not found";
-          order_sp->apply_cancel_reject(err_code, err_text);
-        }
-        return 0ms;
-      });
-
-    return;
-  }
-
-  auto book_iter = _books.find(order.instrument());
-  if (book_iter != std::end(_books)) {
-    book_iter->second->remove_order(iter2->second);
-    _all_orders.erase(iter2);
-  }
-  else {
+void SimExchange::replace_order(Order& order) {
+  auto* book = _books.find(order.instrument());
+  if (!book) {
     THROW("no limit-order-book for " << order.instrument());
   }
+
+  // each replacement is a new exchange order, so gets its own external id
+  std::string ext_order_id =
+      "sim_" + order.order_id() + "_" + std::to_string(++_replace_count);
+  (*book)->replace_order(order, OrderService::decode_handle(order.order_id()),
+                         std::move(ext_order_id));
 }
 
 
@@ -446,10 +406,10 @@ bool SimExchange::is_up() const {
 
 
 void SimExchange::add_instrument(const Instrument& instrument) {
-  auto iter = _books.find(instrument);
-  if (iter == std::end(_books)) {
-    auto ladder = std::make_unique<SimOrderBook>(_services, instrument);
-    _books.insert({instrument, std::move(ladder)});
+  if (!_books.find(instrument)) {
+    auto ladder = std::make_unique<SimOrderBook>(_services, instrument, *_fill_model,
+                                                 _latencies, _cross_fill);
+    _books.insert(instrument, std::move(ladder));
   }
 }
 
@@ -22,7 +22,10 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/MarketData.hpp>
 #include <apex/model/ExchangeId.hpp>
 #include <apex/model/Instrument.hpp>
+#include <apex/model/InstrumentTable.hpp>
 #include <apex/core/OrderRouter.hpp>
+#include <apex/backtest/SimFillModel.hpp>
+#include <apex/backtest/SimLatencyModel.hpp>
 
 #include <filesystem>
 
@@ -42,21 +45,30 @@ class SimOrderBook;
 class SimExchange : public OrderRouter
 {
 public:
+  /* The fill model is named by the "fill_model" field of the "sim_exchange"
+   * config, "queue" by default, the latency models of each path are set by
+   * its "latency" field, and the cross fill policy by its "cross_fill"
+   * field, "visible" by default; or these can be provided. */
   SimExchange(Services*);
+  SimExchange(Services*, std::unique_ptr<SimFillModel>, SimLatencies = {},
+              SimCrossFill = SimCrossFill::visible);
 
   ~SimExchange() override;
 
   void send_order(Order&) override;
   void cancel_order(Order&) override;
+  void replace_order(Order&) override;
   bool is_up() const override;
 
   void add_instrument(const Instrument&);
 
 private:
-  using ExtOrderId = std::string;
   Services* _services;
-  std::map<ExtOrderId, std::shared_ptr<SimLimitOrder>> _all_orders;
-  std::map<Instrument, std::unique_ptr<SimOrderBook>> _books;
+  std::unique_ptr<SimFillModel> _fill_model;
+  SimLatencies _latencies;
+  SimCrossFill _cross_fill = SimCrossFill::visible;
+  InstrumentMap<std::unique_ptr<SimOrderBook>> _books;
+  uint64_t _replace_count = 0;
 };
 
 
@@ -0,0 +1,115 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/SimFillModel.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+
+bool visible_qty(const MarketData& mkt, Side side, double price, double& qty)
+{
+  const bool is_buy = side == Side::buy;
+  const auto& touch = is_buy ? mkt.l1_bid() : mkt.l1_ask();
+
+  // a price better than the touch has nothing resting at it
+  if (std::isnan(touch.price) || touch.price == 0.0 ||
+      (is_buy ? price > touch.price : price < touch.price)) {
+    qty = 0.0;
+    return true;
+  }
+  if (price == touch.price) {
+    qty = touch.qty;
+    return true;
+  }
+
+  const auto& book = mkt.book();
+  const size_t depth = is_buy ? book.bid_depth() : book.ask_depth();
+  for (size_t i = 0; i < depth; i++) {
+    const auto& level = is_buy ? book.bid(i) : book.ask(i);
+    if (level.price == price) {
+      qty = level.qty;
+      return true;
+    }
+    if (is_buy ? level.price < price : level.price > price) {
+      qty = 0.0; // inside the visible depth, but empty
+      return true;
+    }
+  }
+  return false;
+}
+
+
+double QueueFillModel::initial_queue(const MarketData& mkt, Side side,
+                                     double price) const
+{
+  double qty = 0.0;
+  if (visible_qty(mkt, side, price, qty))
+    return qty;
+
+  // behind the visible depth: assume at least the touch size is ahead
+  const auto& touch = (side == Side::buy) ? mkt.l1_bid() : mkt.l1_ask();
+  return std::isnan(touch.qty) ? 0.0 : touch.qty;
+}
+
+
+double QueueFillModel::on_trade(double& queue_ahead, double size,
+                                bool through) const
+{
+  if (through) {
+    queue_ahead = 0.0;
+    return size;
+  }
+
+  const double reach = std::max(0.0, size - queue_ahead);
+  queue_ahead = std::max(0.0, queue_ahead - size);
+  return reach;
+}
+
+
+void QueueFillModel::on_level_qty(double& queue_ahead, double qty) const
+{
+  queue_ahead = std::min(queue_ahead, std::max(0.0, qty));
+}
+
+
+SimCrossFill to_sim_cross_fill(const std::string& name)
+{
+  if (name == "none")
+    return SimCrossFill::none;
+  if (name == "visible")
+    return SimCrossFill::visible;
+  if (name == "full")
+    return SimCrossFill::full;
+  THROW("unknown sim cross fill policy " << QUOTE(name));
+}
+
+
+std::unique_ptr<SimFillModel> make_sim_fill_model(const std::string& name)
+{
+  if (name == "queue")
+    return std::make_unique<QueueFillModel>();
+  if (name == "through")
+    return std::make_unique<ThroughFillModel>();
+  THROW("unknown sim fill model " << QUOTE(name));
+}
+
+} // namespace apex
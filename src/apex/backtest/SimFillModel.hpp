@@ -0,0 +1,102 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Order.hpp>
+
+#include <memory>
+#include <string>
+
+namespace apex
+{
+
+class MarketData;
+
+/* Model of when the resting orders of a SimOrderBook are filled.  Each order
+ * carries the size the model believes is queued ahead of it at its price; the
+ * model sets that queue when the order is inserted, and updates it as trades
+ * print and as the visible size at the price changes. */
+class SimFillModel
+{
+public:
+  virtual ~SimFillModel() = default;
+
+  /* Size queued ahead of a new order at a price. */
+  virtual double initial_queue(const MarketData&, Side, double price) const = 0;
+
+  /* Apply a trade of `size` that printed at the order's price, or through it,
+   * to the queue ahead of the order; returns the part of the trade size that
+   * reaches the order. */
+  virtual double on_trade(double& queue_ahead, double size,
+                          bool through) const = 0;
+
+  /* The visible size at the order's price is now `qty`. */
+  virtual void on_level_qty(double& queue_ahead, double qty) const = 0;
+};
+
+
+/* Fill only on trades through the order price, ignoring any queue; the
+ * original, optimistic, model. */
+class ThroughFillModel : public SimFillModel
+{
+public:
+  double initial_queue(const MarketData&, Side, double) const override
+  {
+    return 0.0;
+  }
+
+  double on_trade(double&, double size, bool through) const override
+  {
+    return through ? size : 0.0;
+  }
+
+  void on_level_qty(double&, double) const override {}
+};
+
+
+/* Join the back of the visible queue.  Trades at the price consume the queue
+ * before reaching the order, and trades through the price reach it at once.
+ * A fall in the visible size can only have come from ahead of the order once
+ * it exceeds the remaining visible size, so the queue is capped at that size;
+ * this is the conservative assumption that cancels happen behind us. */
+class QueueFillModel : public SimFillModel
+{
+public:
+  double initial_queue(const MarketData&, Side, double price) const override;
+  double on_trade(double& queue_ahead, double size, bool through) const override;
+  void on_level_qty(double& queue_ahead, double qty) const override;
+};
+
+
+/* How resting orders fill when the opposite touch moves to or through their
+ * price, including orders marketable on arrival: not at all, up to the
+ * opposite size visible at prices that cross, or in full. */
+enum class SimCrossFill { none, visible, full };
+
+/* Parse a cross fill policy, "none", "visible" or "full". */
+SimCrossFill to_sim_cross_fill(const std::string&);
+
+
+/* Visible size at a price, from the top of book or, if present, the depth
+ * book.  Returns false if the price is behind the touch and cannot be seen. */
+bool visible_qty(const MarketData&, Side, double price, double& qty);
+
+/* Create a fill model by name, "queue" or "through". */
+std::unique_ptr<SimFillModel> make_sim_fill_model(const std::string& name);
+
+} // namespace apex
@@ -0,0 +1,136 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/SimLatencyModel.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace apex
+{
+
+EmpiricalLatency::EmpiricalLatency(
+    std::vector<std::chrono::microseconds> samples, uint64_t seed)
+  : _samples(std::move(samples)), _rng(seed)
+{
+  if (_samples.empty()) {
+    THROW("empirical latency model requires at least one sample");
+  }
+}
+
+
+std::vector<std::chrono::microseconds> EmpiricalLatency::load(
+    const std::string& path)
+{
+  std::ifstream ifs(path);
+  if (!ifs) {
+    THROW("failed to open latency samples file " << QUOTE(path));
+  }
+
+  std::vector<std::chrono::microseconds> samples;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    try {
+      samples.emplace_back(std::stoll(line));
+    } catch (const std::exception&) {
+      THROW("invalid latency sample " << QUOTE(line) << " in " << QUOTE(path));
+    }
+  }
+  return samples;
+}
+
+
+std::chrono::microseconds EmpiricalLatency::next(Time)
+{
+  std::uniform_int_distribution<size_t> pick(0, _samples.size() - 1);
+  return _samples[pick(_rng)];
+}
+
+
+TimeOfDayLatency::TimeOfDayLatency(std::vector<Entry> schedule)
+  : _schedule(std::move(schedule))
+{
+  if (_schedule.empty()) {
+    THROW("time-of-day latency model requires a schedule");
+  }
+  std::sort(_schedule.begin(), _schedule.end(),
+            [](auto& a, auto& b) { return a.first < b.first; });
+}
+
+
+std::chrono::microseconds TimeOfDayLatency::next(Time now)
+{
+  constexpr std::chrono::microseconds day = std::chrono::hours(24);
+  auto tod = now.as_epoch_us() % day;
+
+  auto iter = std::upper_bound(
+      _schedule.begin(), _schedule.end(), tod,
+      [](auto t, const Entry& e) { return t < e.first; });
+  auto& entry = (iter == _schedule.begin()) ? _schedule.back() : *(iter - 1);
+  return entry.second->next(now);
+}
+
+
+std::unique_ptr<SimLatencyModel> make_sim_latency_model(Config config)
+{
+  auto type = config.get_string("type");
+
+  if (type == "constant")
+    return std::make_unique<ConstantLatency>(
+        std::chrono::microseconds(config.get_uint("usec")));
+
+  if (type == "empirical")
+    return std::make_unique<EmpiricalLatency>(
+        EmpiricalLatency::load(config.get_string("file")),
+        config.get_uint("seed", 1));
+
+  if (type == "time_of_day") {
+    auto items = config.get_sub_config("schedule");
+    std::vector<TimeOfDayLatency::Entry> schedule;
+    for (size_t i = 0; i < items.array_size(); i++) {
+      auto item = items.array_item(i);
+      schedule.emplace_back(parse_time_of_day(item.get_string("from")),
+                            make_sim_latency_model(item));
+    }
+    return std::make_unique<TimeOfDayLatency>(std::move(schedule));
+  }
+
+  THROW("unknown sim latency model " << QUOTE(type));
+}
+
+
+SimLatencies make_sim_latencies(Config config)
+{
+  auto make = [&config](const char* path) -> std::unique_ptr<SimLatencyModel> {
+    if (config.contains(path))
+      return make_sim_latency_model(config.get_sub_config(path));
+    return std::make_unique<ConstantLatency>(std::chrono::milliseconds(100));
+  };
+
+  SimLatencies latencies;
+  latencies.order = make("order");
+  latencies.cancel = make("cancel");
+  latencies.fill = make("fill");
+  return latencies;
+}
+
+} // namespace apex
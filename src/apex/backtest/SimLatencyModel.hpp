@@ -0,0 +1,116 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/Config.hpp>
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+
+/* Model of the latency of one SimExchange path, such as the time between an
+ * order being sent and its ack.  Called once per simulated message, at the
+ * time the message is sent. */
+class SimLatencyModel
+{
+public:
+  virtual ~SimLatencyModel() = default;
+  virtual std::chrono::microseconds next(Time now) = 0;
+};
+
+
+class ConstantLatency : public SimLatencyModel
+{
+public:
+  explicit ConstantLatency(std::chrono::microseconds latency)
+    : _latency(latency)
+  {
+  }
+
+  std::chrono::microseconds next(Time) override { return _latency; }
+
+private:
+  std::chrono::microseconds _latency;
+};
+
+
+/* Draw latencies uniformly from a set of observed samples, such as those of
+ * the live latency logs.  The generator is seeded, so backtests repeat. */
+class EmpiricalLatency : public SimLatencyModel
+{
+public:
+  EmpiricalLatency(std::vector<std::chrono::microseconds> samples,
+                   uint64_t seed);
+
+  /* Load samples from a text file of one latency in microseconds per line;
+   * blank lines, and lines starting with '#', are skipped. */
+  static std::vector<std::chrono::microseconds> load(const std::string& path);
+
+  std::chrono::microseconds next(Time) override;
+
+private:
+  std::vector<std::chrono::microseconds> _samples;
+  std::mt19937_64 _rng;
+};
+
+
+/* Switch between models by UTC time of day.  Each model applies from its
+ * start time until the next; before the first start time, the last applies. */
+class TimeOfDayLatency : public SimLatencyModel
+{
+public:
+  using Entry =
+      std::pair<std::chrono::microseconds, std::unique_ptr<SimLatencyModel>>;
+
+  explicit TimeOfDayLatency(std::vector<Entry> schedule);
+
+  std::chrono::microseconds next(Time now) override;
+
+private:
+  std::vector<Entry> _schedule; // sorted by start time
+};
+
+
+/* Latency models of each SimExchange path. */
+struct SimLatencies {
+  std::unique_ptr<SimLatencyModel> order; // order to ack or reject
+  std::unique_ptr<SimLatencyModel> cancel; // cancel to close or reject
+  std::unique_ptr<SimLatencyModel> fill; // trade to fill notification
+};
+
+
+/* Create a latency model from its config, whose "type" is one of:
+ *
+ *   constant:    {"usec": N}
+ *   empirical:   {"file": path, "seed": N}
+ *   time_of_day: {"schedule": [{"from": "HH:MM[:SS]", <model>}, ...]}
+ */
+std::unique_ptr<SimLatencyModel> make_sim_latency_model(Config);
+
+/* Create the models of each path from the "order", "cancel" and "fill" fields
+ * of a config; a missing path has a constant 100ms latency. */
+SimLatencies make_sim_latencies(Config);
+
+} // namespace apex
@@ -0,0 +1,273 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/SimMatchingBook.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Profiler.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace apex
+{
+
+
+static bool is_zero(double d) { return fabs(d) < 0.000001; }
+
+
+bool SimRestingOrder::is_fully_filled() const
+{
+  return is_zero(_size_remain) || _size_remain < 0.0;
+}
+
+
+SimMatchingBook::SimMatchingBook(const MarketData& mkt,
+                                 const SimFillModel& fill_model,
+                                 SimCrossFill cross_fill, Handler& handler)
+  : _mkt(mkt),
+    _fill_model(fill_model),
+    _cross_fill(cross_fill),
+    _handler(handler),
+    _order_pool(std::make_shared<BlockPool>()),
+    _node_pool(std::make_shared<BlockPool>()),
+    _bids(HalfOrderBook::allocator_type(_node_pool)),
+    _asks(HalfOrderBook::allocator_type(_node_pool))
+{
+}
+
+
+static bool has_touch(const Book::Level& touch)
+{
+  return !std::isnan(touch.price) && touch.price != 0.0 && touch.qty > 0.0;
+}
+
+
+double SimMatchingBook::opposite_qty(Side side, double price) const
+{
+  const bool is_buy = side == Side::buy;
+  const auto& book = _mkt.book();
+  const auto& touch = is_buy ? _mkt.l1_ask() : _mkt.l1_bid();
+  if (!has_touch(touch) || (is_buy ? touch.price > price : touch.price < price))
+    return 0.0;
+  const size_t depth = is_buy ? book.ask_depth() : book.bid_depth();
+  if (depth == 0 || (is_buy ? book.ask(0) : book.bid(0)).price != touch.price)
+    return touch.qty;
+
+  double qty = 0.0;
+  for (size_t i = 0; i < depth; i++) {
+    const auto& level = is_buy ? book.ask(i) : book.bid(i);
+    if (is_buy ? level.price > price : level.price < price)
+      break;
+    qty += level.qty;
+  }
+  return qty;
+}
+
+
+void SimMatchingBook::rest(std::shared_ptr<SimRestingOrder> order)
+{
+  order->_queue_ahead =
+      _fill_model.initial_queue(_mkt, order->side(), order->price());
+
+  auto& level = side_book(order->side())[order->price()];
+  order->_level = &level;
+  order->_prev = level.tail;
+  order->_next = nullptr;
+  if (level.tail)
+    level.tail->_next = order.get();
+  else
+    level.head = order.get();
+  level.tail = order.get();
+
+  auto id = order->id();
+  _orders.insert(id, std::move(order));
+}
+
+
+void SimMatchingBook::erase(SimRestingOrder& order)
+{
+  auto* level = order._level;
+  if (order._prev)
+    order._prev->_next = order._next;
+  else
+    level->head = order._next;
+  if (order._next)
+    order._next->_prev = order._prev;
+  else
+    level->tail = order._prev;
+
+  if (!level->head)
+    side_book(order.side()).erase(order.price());
+
+  _orders.erase(order.id()); // releases the order
+}
+
+
+void SimMatchingBook::fill(SimRestingOrder& order, double price, double size)
+{
+  order._size_remain -= size;
+  bool fully_filled = is_zero(order._size_remain);
+  _handler.on_sim_fill(order, price, size, fully_filled);
+  if (fully_filled)
+    _filled.push_back(&order);
+}
+
+
+void SimMatchingBook::erase_filled()
+{
+  for (auto* order : _filled)
+    erase(*order);
+  _filled.clear();
+}
+
+
+void SimMatchingBook::cross_level(SimPriceLevel& level, Side side,
+                                  double price, double touch_price,
+                                  double& used)
+{
+  double avail = (_cross_fill == SimCrossFill::full)
+                     ? std::numeric_limits<double>::infinity()
+                     : opposite_qty(side, price) - used;
+
+  for (auto* order = level.head; order && avail > 0 && !is_zero(avail);
+       order = order->_next) {
+    const double qty_fill = std::min(avail, order->size_remain());
+    order->_queue_ahead = 0.0;
+    avail -= qty_fill;
+    used += qty_fill;
+    fill(*order, touch_price, qty_fill);
+  }
+}
+
+
+void SimMatchingBook::match_crosses()
+{
+  if (_cross_fill == SimCrossFill::none)
+    return;
+
+  scope_guard on_done([&]() { erase_filled(); });
+
+  // visit only our levels at or through the opposite touch, best first; the
+  // size used by better levels is not available to worse ones
+
+  const auto& ask = _mkt.l1_ask();
+  if (has_touch(ask)) {
+    double used = 0.0;
+    for (auto iter = _bids.rbegin();
+         iter != _bids.rend() && iter->first >= ask.price; ++iter)
+      cross_level(iter->second, Side::buy, iter->first, ask.price, used);
+  }
+
+  const auto& bid = _mkt.l1_bid();
+  if (has_touch(bid)) {
+    double used = 0.0;
+    for (auto iter = _asks.begin();
+         iter != _asks.end() && iter->first <= bid.price; ++iter)
+      cross_level(iter->second, Side::sell, iter->first, bid.price, used);
+  }
+}
+
+
+void SimMatchingBook::update_queues(HalfOrderBook& book, Side side)
+{
+  // walk from our best level back, for as long as the market shows the size
+  // at the level
+  auto apply = [&](std::pair<const double, SimPriceLevel>& item) {
+    double qty = 0.0;
+    if (!visible_qty(_mkt, side, item.first, qty))
+      return false;
+    for (auto* order = item.second.head; order; order = order->_next)
+      _fill_model.on_level_qty(order->_queue_ahead, qty);
+    return true;
+  };
+
+  if (side == Side::buy) {
+    for (auto iter = book.rbegin(); iter != book.rend() && apply(*iter); ++iter)
+      ;
+  } else {
+    for (auto iter = book.begin(); iter != book.end() && apply(*iter); ++iter)
+      ;
+  }
+}
+
+
+void SimMatchingBook::apply_book_change()
+{
+  update_queues(_bids, Side::buy);
+  update_queues(_asks, Side::sell);
+  match_crosses();
+}
+
+
+void SimMatchingBook::fill_level(SimPriceLevel& level, double& qty_remain,
+                                 double trade_price, double trade_size,
+                                 bool through)
+{
+  for (auto* order = level.head;
+       order && qty_remain > 0 && !is_zero(qty_remain);
+       order = order->_next) {
+    // the trade first consumes the market queue ahead of each order, which
+    // is separate from our own orders ahead at the level
+    const double reach =
+        _fill_model.on_trade(order->_queue_ahead, trade_size, through);
+
+    const double qty_fill =
+        std::min({reach, qty_remain, order->size_remain()});
+    if (qty_fill <= 0 || is_zero(qty_fill))
+      continue;
+    qty_remain -= qty_fill;
+    fill(*order, trade_price, qty_fill);
+  }
+}
+
+
+void SimMatchingBook::apply_trade(double price, double size)
+{
+  APEX_PROFILE_ZONE("SimMatchingBook::apply_trade");
+
+  scope_guard on_done([&]() { erase_filled(); });
+
+  double qty_remain = size;
+
+  // Apply the fill to the bids, best level first.  Note: we assume order has
+  // been executed if trades occur at a further away price; trades at the
+  // price fill once the queue ahead is consumed.
+
+  for (auto iter = _bids.rbegin();
+       iter != _bids.rend() && qty_remain > 0 && !is_zero(qty_remain);
+       ++iter) {
+    if (price <= iter->first)
+      fill_level(iter->second, qty_remain, price, size, price < iter->first);
+    else
+      break; /* no prices left to fill */
+  }
+
+  // Apply the fill to the offers
+
+  for (auto iter = _asks.begin();
+       iter != _asks.end() && qty_remain > 0 && !is_zero(qty_remain);
+       ++iter) {
+    if (price >= iter->first)
+      fill_level(iter->second, qty_remain, price, size, price > iter->first);
+    else
+      break; /* no prices left to fill */
+  }
+}
+
+} // namespace apex
@@ -0,0 +1,198 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/SimFillModel.hpp>
+#include <apex/util/ObjectPool.hpp>
+#include <apex/util/OpenAddressMap.hpp>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace apex
+{
+
+class MarketData;
+struct SimPriceLevel;
+
+
+/* An order resting in a SimMatchingBook; owners derive from it to attach
+ * whatever identifies the order to them. */
+class SimRestingOrder
+{
+public:
+  SimRestingOrder(uint64_t id, Side side, double size, double price)
+    : _id(id),
+      _side(side),
+      _size(size),
+      _price(price),
+      _size_remain(size)
+  {
+  }
+  virtual ~SimRestingOrder() = default;
+
+  uint64_t id() const { return _id; }
+  Side side() const { return _side; }
+  double size() const { return _size; }
+  double price() const { return _price; }
+  double size_remain() const { return _size_remain; }
+
+  bool is_fully_filled() const;
+
+private:
+  friend class SimMatchingBook;
+
+  uint64_t _id;
+  Side _side;
+  double _size;
+  double _price;
+  double _size_remain;
+
+  // size the fill model believes is queued ahead of the order
+  double _queue_ahead = 0.0;
+
+  // intrusive links of the FIFO queue of the price level the order rests at
+  SimPriceLevel* _level = nullptr;
+  SimRestingOrder* _prev = nullptr;
+  SimRestingOrder* _next = nullptr;
+};
+
+
+// Resting orders at a single price, in time priority.
+struct SimPriceLevel {
+  SimRestingOrder* head = nullptr;
+  SimRestingOrder* tail = nullptr;
+};
+
+
+/* Price-level book of simulated resting orders for one instrument, matched
+ * against a market.  Each level is a FIFO queue of intrusively linked orders,
+ * so an order is unlinked in constant time on cancel, and levels are only
+ * erased from the price map once empty.  Orders are found by integer id in a
+ * flat table.  When orders fill is decided by a SimFillModel, from trades and
+ * from the visible size at their price; orders also fill when the opposite
+ * touch reaches their price, by the cross fill policy, and only the crossed
+ * levels are visited on each market update.
+ *
+ * The book only decides fills: each is reported to the owner's handler, and
+ * a fully filled order is then erased.  It is the core of the backtest's
+ * SimOrderBook, and of the gateway's paper exchange. */
+class SimMatchingBook
+{
+public:
+  // fills are at the price matched: the trade's price, or the opposite
+  // touch when the order is crossed, which may improve on the order's price
+  struct Handler {
+    virtual ~Handler() = default;
+    virtual void on_sim_fill(SimRestingOrder&, double price, double size,
+                             bool fully_filled) = 0;
+  };
+
+  SimMatchingBook(const MarketData&, const SimFillModel&, SimCrossFill,
+                  Handler&);
+
+  SimMatchingBook(const SimMatchingBook&) = delete;
+  SimMatchingBook& operator=(const SimMatchingBook&) = delete;
+
+  /* Pool from which owners allocate their orders, with make_pooled. */
+  const std::shared_ptr<BlockPool>& order_pool() const { return _order_pool; }
+
+  [[nodiscard]] bool empty() const { return _orders.empty(); }
+  [[nodiscard]] size_t size() const { return _orders.size(); }
+
+  /* Number of price levels holding orders of a side. */
+  [[nodiscard]] size_t level_count(Side side) const
+  {
+    return (side == Side::buy) ? _bids.size() : _asks.size();
+  }
+
+  SimRestingOrder* find(uint64_t id)
+  {
+    auto* order = _orders.find(id);
+    return order ? order->get() : nullptr;
+  }
+
+  /* Rest an order at the back of its price level, behind the queue the fill
+   * model assumes; the id must not already be in the book. */
+  void rest(std::shared_ptr<SimRestingOrder>);
+
+  /* Remove an order, releasing it. */
+  void erase(SimRestingOrder&);
+
+  /* Each resting order, bids then asks, best price first. */
+  template <typename F> void for_each_order(F&& fn)
+  {
+    for (auto iter = _bids.rbegin(); iter != _bids.rend(); ++iter)
+      for (auto* order = iter->second.head; order; order = order->_next)
+        fn(*order);
+    for (auto& item : _asks)
+      for (auto* order = item.second.head; order; order = order->_next)
+        fn(*order);
+  }
+
+  /* A trade printed in the market. */
+  void apply_trade(double price, double size);
+
+  /* The top of book, or depth, of the market changed: update the queues
+   * ahead of orders, and fill any now crossed. */
+  void apply_book_change();
+
+  /* Fill orders at or through the opposite touch, by the cross fill policy;
+   * for orders marketable on arrival. */
+  void match_crosses();
+
+  /* Size offered against an order of `side` at `price`, from the depth book
+   * if it agrees with the top of book, else from the top of book alone. */
+  double opposite_qty(Side, double price) const;
+
+private:
+  using HalfOrderBook = std::map<
+      double, SimPriceLevel, std::less<double>,
+      PoolAllocator<std::pair<const double, SimPriceLevel>>>;
+
+  void fill_level(SimPriceLevel&, double& qty_remain, double trade_price,
+                  double trade_size, bool through);
+  void update_queues(HalfOrderBook&, Side);
+  void cross_level(SimPriceLevel&, Side, double price, double touch_price,
+                   double& used);
+  void fill(SimRestingOrder&, double price, double size);
+  void erase_filled();
+  HalfOrderBook& side_book(Side side)
+  {
+    return (side == Side::buy) ? _bids : _asks;
+  }
+
+  const MarketData& _mkt;
+  const SimFillModel& _fill_model;
+  SimCrossFill _cross_fill;
+  Handler& _handler;
+
+  // resting orders, and the nodes of the book that hold them, are pooled
+  std::shared_ptr<BlockPool> _order_pool;
+  std::shared_ptr<BlockPool> _node_pool;
+
+  OpenAddressMap<std::shared_ptr<SimRestingOrder>> _orders;
+  HalfOrderBook _bids;
+  HalfOrderBook _asks;
+
+  // orders fully filled by the market event being applied; reused
+  std::vector<SimRestingOrder*> _filled;
+};
+
+} // namespace apex
@@ -18,10 +18,12 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/backtest/TardisCsvParsers.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/util/CsvScan.hpp>
 #include <apex/util/Error.hpp>
 
 #include <string_view>
 #include <cstring>
+#include <iterator>
 
 
 static void check_field(std::string_view expected, std::string_view actual)
@@ -37,47 +39,58 @@ static void check_field(std::string_view expected, std::string_view actual)
 namespace apex
 {
 
+/* Tardis prices and amounts are plain decimals, and timestamps are integer
+ * microseconds, which the fast parsers handle; anything else goes through the
+ * standard library. */
+static inline double parse_number(const char* s)
+{
+  double value;
+  return csv::parse_decimal(s, value) ? value : ::strtod(s, nullptr);
+}
+
+
+static inline apex::Time parse_timestamp(const char* s)
+{
+  uint64_t value;
+  auto epoc_usec = csv::parse_uint(s, value) ? static_cast<long long>(value)
+                                             : strtoll(s, nullptr, 10);
+  auto epoc_sec = epoc_usec / 1000000;
+  auto usec = epoc_usec - (epoc_sec * 1000000);
+  return apex::Time(epoc_sec, std::chrono::microseconds(usec));
+}
+
+
+void TardisEvent::apply(MarketData* mktdata)
+{
+  std::visit([mktdata](auto& tick) { mktdata->apply(tick); }, this->tick);
+}
+
 
 [[nodiscard]] apex::Time TardisCsvParser::event_time() const
 {
-  if (this->parse_ok()) {
-    auto epoc_usec2 = strtoll("123455", nullptr, 10);
-    auto epoc_usec = strtoll(this->p_timestamp, nullptr, 10);
-    auto epoc_sec = epoc_usec / 1000000;
-    auto usec = epoc_usec - (epoc_sec * 1000000);
-    apex::Time t(epoc_sec, std::chrono::microseconds(usec));
-    return t;
-  }
-  else { //  "1706745599997000"
+  if (this->parse_ok())
+    return parse_timestamp(this->p_timestamp);
+  else
     return Time{};
-  }
 }
 
 
-/* Search for a field delimiter.  If sound, overwrite it with null character
- * and return the field start (which is just the original value of `ptr`), and
- * update `ptr` to point to first byte after the delimiter.  If not found
- * return nullptr, which indicates an error, since the field is not
- * terminated. `end` points to first byte that should be read. */
-inline char* TardisCsvParser::parse_field(char*& ptr,
-                                          const char* end,
-                                          char ch,
-                                          bool& err)
+bool TardisCsvParser::split_line(char* line_fin, char** fields,
+                                 std::size_t count)
 {
-  char* const start = ptr;
-  char* delim = (char*)memchr(ptr, ch, end - ptr);
-  if (delim) {
-    *delim = '\0';
-    ptr = delim + 1;
-    return start;
-  } else {
-    err = true;
-    return nullptr;
-  }
+  // replace the line-final char delimiter with a field delimiter; this
+  // simplifies detection of unexpected extra delimiters
+  *line_fin = ',';
+
+  auto found = csv::split_fields(_ptr, line_fin + 1, ',', fields, count);
+  _ptr = line_fin + 1;
+  _err = _err || (found != count);
+  return !_err;
 }
 
 
-bool TardisCsvParserBookSnapshot5::next()
+template<int N>
+bool TardisCsvParserBookSnapshot<N>::next_book()
 {
   _parse_success = false;
 
@@ -88,32 +101,58 @@ bool TardisCsvParserBookSnapshot5::next()
 
     if (line_fin) {
 
-      // replace the line-final char delimiter with a field delimiter; this
-      // simplifies detection of unexpected extra delimiters
-      *line_fin = ',';
+      char* fields[4 + 4 * levels];
+      if (split_line(line_fin, fields, std::size(fields))) {
+        p_exchange = fields[0];
+        p_symbol = fields[1];
+        p_timestamp = fields[2];
+        p_local_timestamp = fields[3];
+        for (std::size_t i = 0; i < levels; i++) {
+          p_ask_price[i] = fields[4 + 4 * i];
+          p_ask_amount[i] = fields[5 + 4 * i];
+          p_bid_price[i] = fields[6 + 4 * i];
+          p_bid_amount[i] = fields[7 + 4 * i];
+        }
+        _parse_success = true;
+      }
+    }
+  }
 
-      p_exchange = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_symbol = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_timestamp = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_local_timestamp = parse_field(_ptr, line_fin + 1, ',', _err);
+  return _parse_success;
+}
 
-      for (int i=0; i<5; i++) {
-        p_ask_price[i] = parse_field(_ptr, line_fin + 1, ',', _err);
-        p_ask_amount[i] = parse_field(_ptr, line_fin + 1, ',', _err);
-        p_bid_price[i] = parse_field(_ptr, line_fin + 1, ',', _err);
-        p_bid_amount[i] = parse_field(_ptr, line_fin + 1, ',', _err);
-      }
 
-      // after parsing all fields, _ptr should point to first byte that
-      // follows the line delimiter
-      _err = _err || (_ptr != (line_fin + 1));
+template<int N>
+template<typename T>
+void TardisCsvParserBookSnapshot<N>::decode_book(TardisEvent& event) const
+{
+  static_assert(T::N == N);
 
-      if (!_err)
-        _parse_success = true;
-    }
+  // timestamp
+  apex::Time t = parse_timestamp(this->p_timestamp);
+
+  event.time = t;
+  auto& tick = event.tick.template emplace<T>();
+  tick.xt = t;
+  tick.et = t;
+  for (int i=0; i<N; i++) {
+    tick.levels[i].ask_price = parse_number(p_ask_price[i]);
+    tick.levels[i].ask_qty = parse_number(p_ask_amount[i]);
+    tick.levels[i].bid_price = parse_number(p_bid_price[i]);
+    tick.levels[i].bid_qty = parse_number(p_bid_amount[i]);
   }
+}
 
-  return _parse_success;
+
+bool TardisCsvParserBookSnapshot5::next()
+{
+  return next_book();
+}
+
+
+bool TardisCsvParserBookSnapshot25::next()
+{
+  return next_book();
 }
 
 template<int N>
@@ -121,43 +160,17 @@ void book_check_header(const TardisCsvParserBookSnapshot<N>& parser)
 {
   static_assert(N<1000);
 
-  std::vector<std::string> expected = {
-    "exchange",
-    "symbol",
-    "timestamp",
-    "local_timestamp",
-    "asks[0].price",
-    "asks[0].amount",
-    "bids[0].price",
-    "bids[0].amount",
-    "asks[1].price",
-    "asks[1].amount",
-    "bids[1].price",
-    "bids[1].amount",
-    "asks[2].price",
-    "asks[2].amount",
-    "bids[2].price",
-    "bids[2].amount",
-    "asks[3].price",
-    "asks[3].amount",
-    "bids[3].price",
-    "bids[3].amount",
-    "asks[4].price",
-    "asks[4].amount",
-    "bids[4].price",
-    "bids[4].amount",
-  };
-  int i = 0;
-  check_field(expected[i++], parser.p_exchange);
-  check_field(expected[i++], parser.p_symbol);
-  check_field(expected[i++], parser.p_timestamp);
-  check_field(expected[i++], parser.p_local_timestamp);
+  check_field("exchange", parser.p_exchange);
+  check_field("symbol", parser.p_symbol);
+  check_field("timestamp", parser.p_timestamp);
+  check_field("local_timestamp", parser.p_local_timestamp);
 
   for (int l=0; l<N; l++) {
-    check_field(expected.at(i++), parser.p_ask_price[l] );
-    check_field(expected.at(i++), parser.p_ask_amount[l] );
-    check_field(expected.at(i++), parser.p_bid_price[l] );
-    check_field(expected.at(i++), parser.p_bid_amount[l] );
+    auto level = std::to_string(l);
+    check_field("asks[" + level + "].price", parser.p_ask_price[l] );
+    check_field("asks[" + level + "].amount", parser.p_ask_amount[l] );
+    check_field("bids[" + level + "].price", parser.p_bid_price[l] );
+    check_field("bids[" + level + "].amount", parser.p_bid_amount[l] );
   }
 }
 
@@ -192,25 +205,27 @@ void TardisCsvParserBookSnapshot5::check_header() const
 }
 
 
-void TardisCsvParserBookSnapshot5::apply_event(MarketData* mktdata)
+void TardisCsvParserBookSnapshot5::decode_event(TardisEvent& event) const
 {
-  // timestamp
-  auto epoc_usec = atoll(this->p_timestamp);
-  auto epoc_sec = epoc_usec / 1000000;
-  auto usec = epoc_usec - (epoc_sec * 1000000);
-  apex::Time t(epoc_sec, std::chrono::microseconds(usec));
+  decode_book<TickBookSnapshot5>(event);
+}
 
-  TickBookSnapshot5 tick;
-  tick.xt = t;
-  tick.et = t;
-  for (int i=0; i<5; i++) {
-    tick.levels[i].ask_price = atof(p_ask_price[i]);
-    tick.levels[i].ask_qty = atof(p_ask_amount[i]);
-    tick.levels[i].bid_price = atof(p_bid_price[i]);
-    tick.levels[i].bid_qty = atof(p_bid_amount[i]);
-  }
 
-  mktdata->apply(tick);
+[[nodiscard]] std::string TardisCsvParserBookSnapshot25::to_string() const
+{
+  return book_to_string(*this);
+}
+
+
+void TardisCsvParserBookSnapshot25::check_header() const
+{
+  book_check_header(*this);
+}
+
+
+void TardisCsvParserBookSnapshot25::decode_event(TardisEvent& event) const
+{
+  decode_book<TickBookSnapshot25>(event);
 }
 
 
@@ -229,25 +244,18 @@ bool TardisCsvParserTrades::next()
 
     if (line_fin) {
 
-      // replace the line-final char delimiter with a field delimiter; this
-      // simplifies detection of unexpected extra delimiters
-      *line_fin = ',';
-
-      p_exchange = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_symbol = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_timestamp = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_local_timestamp = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_id = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_side = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_price = parse_field(_ptr, line_fin + 1, ',', _err);
-      p_amount = parse_field(_ptr, line_fin + 1, ',', _err);
-
-      // after parsing all fields, _ptr should point to first byte that
-      // follows the line delimiter
-      _err = _err || (_ptr != (line_fin + 1));
-
-      if (!_err)
+      char* fields[8];
+      if (split_line(line_fin, fields, std::size(fields))) {
+        p_exchange = fields[0];
+        p_symbol = fields[1];
+        p_timestamp = fields[2];
+        p_local_timestamp = fields[3];
+        p_id = fields[4];
+        p_side = fields[5];
+        p_price = fields[6];
+        p_amount = fields[7];
         _parse_success = true;
+      }
     }
   }
   return _parse_success;
@@ -273,15 +281,12 @@ void TardisCsvParserTrades::check_header() const
 }
 
 
-void TardisCsvParserTrades::apply_event(MarketData* md)
+void TardisCsvParserTrades::decode_event(TardisEvent& event) const
 {
   // symbol - skip
 
   // timestamp
-  auto epoc_usec = atoll(this->p_timestamp);
-  auto epoc_sec = epoc_usec / 1000000;
-  auto usec = epoc_usec - (epoc_sec * 1000000);
-  apex::Time t(epoc_sec, std::chrono::microseconds(usec));
+  apex::Time t = parse_timestamp(this->p_timestamp);
 
   // side
   Side aggr_side = Side::none;
@@ -291,19 +296,130 @@ void TardisCsvParserTrades::apply_event(MarketData* md)
     aggr_side = Side::sell;
 
   // price
-  double price = ::strtod(this->p_price, nullptr);
+  double price = parse_number(this->p_price);
 
   // amount
-  double qty = ::strtod(this->p_amount, nullptr);
+  double qty = parse_number(this->p_amount);
 
-  TickTrade tick;
+  event.time = t;
+  auto& tick = event.tick.emplace<TickTrade>();
   tick.aggr_side = aggr_side;
   tick.price = price;
   tick.qty = qty;
   tick.et = t;
   tick.xt = t;
+}
+
+
+/* The fields of a row up to and including is_snapshot; rows of the same
+ * message share them. */
+static constexpr std::size_t l2_key_fields = 5;
+
+
+bool TardisCsvParserIncrementalBookL2::next()
+{
+  _parse_success = false;
+  rows.clear();
+
+  if (_ptr >= _end || _err)
+    return false;
+
+  char* const line_fin = (char*) memchr(_ptr, '\n', _end - _ptr);
+  if (!line_fin)
+    return false;
+
+  // length of the leading fields, delimiter included
+  std::size_t key_len = 0;
+  for (std::size_t i = 0; i < l2_key_fields; i++) {
+    auto* comma = (char*) memchr(_ptr + key_len, ',', line_fin - _ptr - key_len);
+    if (!comma) {
+      _err = true;
+      return false;
+    }
+    key_len = comma + 1 - _ptr;
+  }
+
+  // find the end of the message before splitting any row, since a message
+  // cut short by the end of the buffer is parsed again once more is read
+  char* msg_end = line_fin + 1;
+  while (true) {
+    char* const fin =
+        msg_end < _end ? (char*) memchr(msg_end, '\n', _end - msg_end) : nullptr;
+    if (!fin) {
+      if (!_at_end)
+        return false;
+      break;
+    }
+    if (std::size_t(fin - msg_end) <= key_len ||
+        memcmp(msg_end, _ptr, key_len) != 0)
+      break;
+    msg_end = fin + 1;
+  }
 
-  md->apply(tick);
+  while (_ptr < msg_end) {
+    char* const fin = (char*) memchr(_ptr, '\n', msg_end - _ptr);
+    char* fields[8];
+    if (!split_line(fin, fields, std::size(fields)))
+      return false;
+    if (rows.empty()) {
+      p_exchange = fields[0];
+      p_symbol = fields[1];
+      p_timestamp = fields[2];
+      p_local_timestamp = fields[3];
+      p_is_snapshot = fields[4];
+    }
+    rows.push_back({fields[5], fields[6], fields[7]});
+  }
+
+  _parse_success = true;
+  return _parse_success;
+}
+
+
+[[nodiscard]] std::string TardisCsvParserIncrementalBookL2::to_string() const
+{
+  std::ostringstream oss;
+  oss << "exchange=" << p_exchange << ", "
+      << "symbol=" << p_symbol << ", "
+      << "timestamp=" << p_timestamp << ", "
+      << "local_timestamp=" << p_local_timestamp << ", "
+      << "is_snapshot=" << p_is_snapshot << ", "
+      << "rows=" << rows.size();
+  return oss.str();
+}
+
+
+void TardisCsvParserIncrementalBookL2::check_header() const
+{
+  check_field("exchange", p_exchange);
+  check_field("symbol", p_symbol);
+  check_field("timestamp", p_timestamp);
+  check_field("local_timestamp", p_local_timestamp);
+  check_field("is_snapshot", p_is_snapshot);
+  if (rows.size() != 1)
+    THROW("Tardis CSV header problem; expected a single header line");
+  check_field("side", rows[0].p_side);
+  check_field("price", rows[0].p_price);
+  check_field("amount", rows[0].p_amount);
+}
+
+
+void TardisCsvParserIncrementalBookL2::decode_event(TardisEvent& event) const
+{
+  event.time = parse_timestamp(this->p_timestamp);
+  auto* delta = std::get_if<TickBookDelta>(&event.tick);
+  if (delta)
+    delta->clear();
+  auto& tick = delta ? *delta : event.tick.emplace<TickBookDelta>();
+  tick.is_snapshot = strcmp(this->p_is_snapshot, "true") == 0;
+  for (auto& row : rows) {
+    TickBookDelta::Level level{parse_number(row.p_price),
+                               parse_number(row.p_amount)};
+    if (strcmp(row.p_side, "bid") == 0)
+      tick.bids.push_back(level);
+    else if (strcmp(row.p_side, "ask") == 0)
+      tick.asks.push_back(level);
+  }
 }
 
 } // namespace apex
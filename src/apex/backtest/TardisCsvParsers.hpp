@@ -17,16 +17,30 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/model/tick_msgs.hpp>
 #include <apex/util/Time.hpp>
 
 #include <string>
 #include <array>
+#include <variant>
+#include <vector>
 
 namespace apex
 {
 
 class MarketData;
 
+/* A Tardis record decoded from CSV text, ready to apply to MarketData. */
+struct TardisEvent
+{
+  Time time;
+  std::variant<TickTrade, TickBookSnapshot5, TickBookSnapshot25, TickBookDelta>
+      tick;
+
+  void apply(MarketData*);
+};
+
+
 class TardisCsvParser
 {
 public:
@@ -42,7 +56,17 @@ public:
   virtual ~TardisCsvParser() = default;
   virtual bool next() = 0;
   virtual void check_header() const = 0;
-  virtual void apply_event(MarketData*) = 0;
+
+  // Decode the fields of the current record into an event
+  virtual void decode_event(TardisEvent&) const = 0;
+
+  void apply_event(MarketData* mktdata)
+  {
+    TardisEvent event;
+    decode_event(event);
+    event.apply(mktdata);
+  }
+
   [[nodiscard]] virtual std::string to_string() const = 0;
 
   // Return the number of bytes still available for parsing
@@ -64,20 +88,22 @@ public:
     _buf = buf;
     _end = buf + len;
     _ptr = buf;
+    _at_end = false;
   }
 
+  /* The bytes available are the last of the file, so that a record running
+   * to the end of them is complete; needed by parsers that join rows. */
+  void set_at_end() { _at_end = true; }
+
 
   [[nodiscard]] apex::Time event_time() const;
 
 
 protected:
-  /* Search for a field delimiter.  If sound, overwrite it with null character
-   * and return the field start (which is just the original value of `ptr`), and
-   * update `ptr` to point to first byte after the delimiter.  If not found
-   * return nullptr, which indicates an error, since the field is not
-   * terminated. `end` points to first byte that should be read. */
-  static inline char*  parse_field(char*& ptr, const char* end, char ch,
-                                   bool& err);
+  /* Split the line ending at `line_fin` (the newline) into exactly `count`
+   * fields, each null terminated, and advance `ptr` to the following line.
+   * Sets the error flag and returns false if the field count differs. */
+  bool split_line(char* line_fin, char** fields, std::size_t count);
 
   char* _buf;
   char* _end;
@@ -87,6 +113,8 @@ protected:
 
   bool _parse_success = false;
 
+  bool _at_end = false;
+
 public:
   // parsed fields common to all Tardis CSV datasets
   char* p_exchange = nullptr;
@@ -111,6 +139,11 @@ public:
   {
   }
 
+protected:
+  // parse and decode the fields common to book snapshots of any depth
+  bool next_book();
+  template <typename T> void decode_book(TardisEvent&) const;
+
 public:
   std::array<char*, N> p_ask_price = {nullptr};
   std::array<char*, N> p_ask_amount = {nullptr};
@@ -138,8 +171,27 @@ public:
 
   void check_header() const override;
 
-  void apply_event(MarketData*) override;
+  void decode_event(TardisEvent&) const override;
+
+};
+
+
+class TardisCsvParserBookSnapshot25 : public TardisCsvParserBookSnapshot<25>
+{
+public:
+  TardisCsvParserBookSnapshot25() = default;
+  TardisCsvParserBookSnapshot25(char* buf, std::size_t len)
+    : TardisCsvParserBookSnapshot<25>(buf, len)
+  {
+  }
+
+  bool next() override;
+
+  [[nodiscard]] std::string to_string() const override;
 
+  void check_header() const override;
+
+  void decode_event(TardisEvent&) const override;
 };
 
 
@@ -162,7 +214,7 @@ public:
 
   void check_header() const override;
 
-  void apply_event(MarketData*) override;
+  void decode_event(TardisEvent&) const override;
 
 public:
   char* p_id = nullptr;
@@ -172,4 +224,40 @@ public:
 };
 
 
+/* Parser of the Tardis incremental_book_L2 dataset, which has a row per
+ * price level updated.  The rows of one exchange message share their
+ * timestamps, and are joined into a single record, decoded as a
+ * TickBookDelta; a zero amount removes the level, and a run of snapshot
+ * rows replaces the book. */
+class TardisCsvParserIncrementalBookL2 : public TardisCsvParser
+{
+public:
+  TardisCsvParserIncrementalBookL2() = default;
+  TardisCsvParserIncrementalBookL2(char* buf, std::size_t len)
+    : TardisCsvParser(buf, len)
+  {
+  }
+
+  // Parse the rows of the next message.  A message that may continue beyond
+  // the bytes available is not parsed, unless they are the last of the file.
+  bool next() override;
+
+  [[nodiscard]] std::string to_string() const override;
+
+  void check_header() const override;
+
+  void decode_event(TardisEvent&) const override;
+
+  struct Row {
+    char* p_side;
+    char* p_price;
+    char* p_amount;
+  };
+
+public:
+  char* p_is_snapshot = nullptr;
+  std::vector<Row> rows;
+};
+
+
 } // namespace apex
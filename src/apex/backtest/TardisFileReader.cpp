@@ -18,48 +18,303 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/backtest/TardisFileReader.hpp>
 #include <apex/backtest/TardisCsvParsers.hpp>
+#include <apex/backtest/TickFileCache.hpp>
 #include <apex/util/BufferedFileReader.hpp>
 #include <apex/backtest/TickbinMsgs.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/tick_msgs.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
 
-#include <fstream>
-#include <iostream>
-#include <filesystem>
-#include <string>
+#include <openssl/evp.h>
 
 #include <unistd.h>
-#include <errno.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/mman.h>
+
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace apex
 {
 
+static std::unique_ptr<TardisCsvParser> make_parser(
+  TardisFileReader::DataType datatype, char* buf, std::size_t len)
+{
+  switch (datatype) {
+    case  TardisFileReader::DataType::book_snapshot_5:
+      return std::make_unique<TardisCsvParserBookSnapshot5>(buf, len);
+    case  TardisFileReader::DataType::book_snapshot_25:
+      return std::make_unique<TardisCsvParserBookSnapshot25>(buf, len);
+    case  TardisFileReader::DataType::trades:
+      return std::make_unique<TardisCsvParserTrades>(buf, len);
+    case  TardisFileReader::DataType::incremental_book_L2:
+      return std::make_unique<TardisCsvParserIncrementalBookL2>(buf, len);
+    default:
+      THROW("Tardis parser doesn't support datatype");
+  };
+}
+
+
+/* Inflates and parses a Tardis CSV file; the parser holds the fields of the
+ * current record until advanced.  Inflate runs on the reader's background
+ * thread, overlapping with parsing.  The gzip file is indexed, so that once
+ * read through, later decoders can seek to its access points. */
+class TardisFileReader::Decoder
+{
+public:
+  Decoder(const std::filesystem::path& fn, DataType datatype)
+    : _reader(_file)
+  {
+    GzFile::Options options;
+    options.indexed = true;
+    _file.open(fn, options);
+    if (!_file.is_open()) {
+      THROW("failed to open Tardis tick-data file" << fn);
+    }
+    _seek_points = _file.seek_points();
+
+    _reader.read(); // initial read of bytes from the file
+
+    _parser = make_parser(datatype, _reader.data(), _reader.avail());
+
+    // read the header line, check that it has the fields and order we expect
+    if (_parser->next())
+      _parser->check_header();
+
+    // parse the first record, because we no longer require the header
+    // line to be sitting in the parser
+    this->advance();
+  }
+
+  [[nodiscard]] bool has_event() const { return _parser->parse_ok(); }
+
+  [[nodiscard]] apex::Time event_time() const { return _parser->event_time(); }
+
+  void apply(MarketData* mktdata)
+  {
+    // the event is reused, so that the levels of book deltas are not
+    // reallocated for each
+    _parser->decode_event(_event);
+    _event.apply(mktdata);
+  }
+
+  void decode(TardisEvent& event) const { _parser->decode_event(event); }
+
+  void advance()
+  {
+    // TODO: add better error detection in here
+
+    auto parsed = _parser->next();
+
+    // if we failed to parse, try to read in more data
+    if (!parsed) {
+      _reader.discard(_parser->bytes_parsed());
+      auto len = _reader.read(); // TODO: check failure
+      _parser->reset_pointers(_reader.data(), _reader.avail());
+      if (len == 0)
+        _parser->set_at_end();
+      _parser->next();
+    }
+  }
+
+  /* Access points of the file, as found when opened. */
+  [[nodiscard]] const std::vector<uint64_t>& seek_points() const
+  {
+    return _seek_points;
+  }
+
+  /* Resume at the first record following an access point. */
+  void seek(size_t point)
+  {
+    _reader.reset();
+    _file.seek(point);
+    _reader.read();
+
+    // the access point falls within a record, which is skipped
+    auto* nl = static_cast<char*>(memchr(_reader.data(), '\n', _reader.avail()));
+    _reader.discard(nl ? nl + 1 - _reader.data() : _reader.avail());
+    _parser->reset_pointers(_reader.data(), _reader.avail());
+    this->advance();
+  }
+
+private:
+  GzFile _file;
+  AsyncBufferedFileReader<GzFile> _reader;
+  std::unique_ptr<TardisCsvParser> _parser;
+  std::vector<uint64_t> _seek_points;
+  TardisEvent _event;
+};
+
+
+/* Runs a Decoder on a background thread, which places decoded events into a
+ * bounded queue of chunks.  Exchanging whole chunks keeps the synchronisation
+ * cost per event low.  Events the filter does not admit are dropped before
+ * being decoded. */
+class TardisFileReader::ReadAhead
+{
+public:
+  static constexpr std::size_t chunk_events = 1024;
+  static constexpr std::size_t max_chunks = 8;
+
+  ReadAhead(std::unique_ptr<Decoder> decoder, const TickFilter& filter)
+    : _decoder(std::move(decoder)),
+      _filter(filter),
+      _thread([this]() { this->run(); })
+  {
+  }
+
+  ~ReadAhead() { stop(); }
+
+  /* Stop the background thread and take back the decoder, which is left at
+   * some point beyond the events so far obtained by next(). */
+  std::unique_ptr<Decoder> release()
+  {
+    stop();
+    return std::move(_decoder);
+  }
+
+  // Obtain the next decoded event, waiting if necessary; returns false once
+  // the file is exhausted.
+  bool next(TardisEvent& event)
+  {
+    if (_pos == _current.size()) {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _current.clear();
+      _free.push_back(std::move(_current));
+      _cv.notify_all();
+      _cv.wait(lock, [this]() { return !_full.empty() || _done; });
+      if (_full.empty()) {
+        if (_error)
+          std::rethrow_exception(_error);
+        return false;
+      }
+      _current = std::move(_full.front());
+      _full.pop_front();
+      _pos = 0;
+      _cv.notify_all();
+    }
+
+    event = _current[_pos++];
+    return true;
+  }
+
+private:
+  void stop()
+  {
+    {
+      auto lock = std::scoped_lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    if (_thread.joinable())
+      _thread.join();
+  }
+
+  void run()
+  {
+    Logger::instance().register_thread_id("tardis");
+    try {
+      while (true) {
+        std::vector<TardisEvent> chunk;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _cv.wait(lock, [this]() {
+            return _stop || _full.size() < max_chunks;
+          });
+          if (_stop)
+            return;
+          if (!_free.empty()) {
+            chunk = std::move(_free.back());
+            _free.pop_back();
+          }
+        }
+
+        // decode outside of the lock
+        chunk.reserve(chunk_events);
+        while (chunk.size() < chunk_events && _decoder->has_event()) {
+          if (_filter.admits(_decoder->event_time()))
+            _decoder->decode(chunk.emplace_back());
+          _decoder->advance();
+        }
+
+        auto lock = std::scoped_lock(_mutex);
+        if (!chunk.empty())
+          _full.push_back(std::move(chunk));
+        if (!_decoder->has_event()) {
+          _done = true;
+          _cv.notify_all();
+          return;
+        }
+        _cv.notify_all();
+      }
+    }
+    catch (...) {
+      auto lock = std::scoped_lock(_mutex);
+      _error = std::current_exception();
+      _done = true;
+      _cv.notify_all();
+    }
+  }
+
+  std::unique_ptr<Decoder> _decoder;
+  const TickFilter& _filter;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<std::vector<TardisEvent>> _full;
+  std::vector<std::vector<TardisEvent>> _free;
+  bool _done = false;
+  bool _stop = false;
+  std::exception_ptr _error;
+
+  // chunk being consumed, owned by the consumer thread
+  std::vector<TardisEvent> _current;
+  std::size_t _pos = 0;
+
+  std::thread _thread;
+};
+
+
 TardisFileReader::TardisFileReader(std::filesystem::path fn,
                                    MarketData* mktdata,
                                    MdStream stream_type,
-                                   DataType datatype)
+                                   DataType datatype,
+                                   bool read_ahead,
+                                   const TickFilter& filter)
   :_fn(fn),
    _mktdata(mktdata),
-   _datatype(datatype),
-   _reader(_file)
+   _datatype(datatype)
 {
   namespace fs = std::filesystem;
   if (!fs::exists(fn) || !fs::is_regular_file(fn)) {
     THROW("Tardis tick-data file not found " << fn);
   }
-  LOG_INFO("reading Tardis tick-file " << fn);
+  LOG_INFO("reading Tardis tick-file " << fn
+           << (read_ahead ? ", with read-ahead" : ""));
 
-  _file.open(fn);
-  if (!_file.is_open()) {
-    THROW("failed to open Tardis tick-data file" << fn);
+  _filter.windows = filter.windows;
+  if (!_filter.windows.empty() && datatype == DataType::incremental_book_L2) {
+    LOG_WARN("replay windows not applied to incremental book " << fn);
+    _filter.windows.clear();
   }
 
-  this->read_header();
+  _decoder = std::make_unique<Decoder>(fn, datatype);
+  _point_times.resize(_decoder->seek_points().size());
+
+  if (read_ahead) {
+    _read_ahead = std::make_unique<ReadAhead>(std::move(_decoder), _filter);
+    _has_next = _read_ahead->next(_next);
+  }
+  else
+    skip_filtered();
 }
 
 
@@ -69,46 +324,111 @@ TardisFileReader::~TardisFileReader()
 }
 
 
-void TardisFileReader::read_header()
+/* Time of the first record following an access point, found by inflating
+ * from that point with a second handle on the file, so that the decoder is
+ * left in place.  Empty if no record could be read. */
+apex::Time TardisFileReader::point_time(size_t point)
 {
-  auto nread = _reader.read(); // initial read of bytes from the file
-
-  switch (_datatype) {
-    case  DataType::book_snapshot_5:
-      _parser = std::make_unique<TardisCsvParserBookSnapshot5>(_reader.data(), _reader.avail());
-      break;
-    case  DataType::trades:
-      _parser = std::make_unique<TardisCsvParserTrades>(_reader.data(), _reader.avail());
-      break;
-    default:
-      THROW("Tardis parser doesn't support datatype");
-  };
-
-// read the header line, check that it has the fields and order we expect
+  static constexpr std::size_t probe_size = 1 << 16;
+
+  auto& time = _point_times[point];
+  if (time)
+    return *time;
+  time = apex::Time{};
+
+  if (!_probe) {
+    GzFile::Options options;
+    options.indexed = true;
+    options.build_index = false;
+    _probe = std::make_unique<GzFile>();
+    _probe->open(_fn, options);
+  }
+  if (point >= _probe->seek_points().size())
+    return *time;
+
+  _probe->seek(point);
+  std::vector<char> buf(probe_size);
+  buf.resize(_probe->read(buf.data(), buf.size()));
+
+  auto* nl = static_cast<char*>(memchr(buf.data(), '\n', buf.size()));
+  if (nl) {
+    auto parser = make_parser(_datatype, nl + 1, buf.data() + buf.size() - nl - 1);
+    parser->set_at_end(); // only the time of the first record is wanted
+    if (parser->next())
+      time = parser->event_time();
+  }
+  return *time;
+}
 
-  if (_parser->next())
-    _parser->check_header();
 
-  // parse the first record, because we no longer require the header
-  // line to be sitting in the parser
-  this->parse_next_event();
+void TardisFileReader::seek_point(size_t point)
+{
+  if (_read_ahead) {
+    _decoder = _read_ahead->release();
+    _read_ahead.reset();
+    _decoder->seek(point);
+    _read_ahead = std::make_unique<ReadAhead>(std::move(_decoder), _filter);
+    _has_next = _read_ahead->next(_next);
+  }
+  else
+    _decoder->seek(point);
 }
 
-void TardisFileReader::wind_forward(apex::Time t)
+
+size_t TardisFileReader::skip_until(apex::Time t)
 {
-  size_t skipped = 0;
-  apex::Time earliest_skipped;
-  apex::Time latest_skipped;
+  // with an index of the gzip file, jump to the last access point whose first
+  // record is before the seek time, if beyond the next event; the remaining
+  // events are then skipped one by one
+  if (!_point_times.empty() && this->has_next_event()) {
+    size_t lo = 0;
+    size_t hi = _point_times.size();
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      auto time = point_time(mid);
+      if (!time.empty() && time < t)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo > 0 && this->next_event_time() < point_time(lo - 1)) {
+      LOG_DEBUG("wind-forward using gzip index, access point " << (lo - 1)
+                << " of " << _point_times.size());
+      seek_point(lo - 1);
+    }
+  }
 
+  size_t skipped = 0;
   while (this->has_next_event() && this->next_event_time() < t) {
-    auto next_event_time = this->next_event_time();
-    if (skipped == 0)
-      earliest_skipped = next_event_time;
+    if (_read_ahead)
+      _has_next = _read_ahead->next(_next);
     else
-      latest_skipped = next_event_time;
-    this->parse_next_event();
+      _decoder->advance();
+    _event_count++;
     skipped++;
   }
+  return skipped;
+}
+
+
+void TardisFileReader::skip_filtered()
+{
+  // with read-ahead, the background thread drops the events
+  if (_filter.windows.empty() || _read_ahead)
+    return;
+  while (_decoder->has_event() && !_filter.admits(_decoder->event_time()))
+    skip_until(_filter.next_admitted(_decoder->event_time()));
+}
+
+
+void TardisFileReader::wind_forward(apex::Time t)
+{
+  apex::Time earliest_skipped;
+  if (this->has_next_event())
+    earliest_skipped = this->next_event_time();
+
+  size_t skipped = skip_until(t);
+  skip_filtered();
 
   if (skipped == 0) {
     LOG_DEBUG("wind-forward events skipped: "
@@ -116,49 +436,147 @@ void TardisFileReader::wind_forward(apex::Time t)
               << this->next_event_time() << ", seeking time: " << t);
   } else {
     LOG_INFO("wind-forward events skipped: "
-             << skipped << "; from " << earliest_skipped << " upto "
-             << latest_skipped << "; next event time: "
-             << this->next_event_time() << ", seeking time: " << t);
+             << skipped << "; from " << earliest_skipped
+             << "; next event time: " << this->next_event_time()
+             << ", seeking time: " << t);
   }
 }
 
 
 [[nodiscard]] bool TardisFileReader::has_next_event() const {
-  return _parser->parse_ok();
+  return _read_ahead ? _has_next : _decoder->has_event();
 }
 
 
 [[nodiscard]] apex::Time TardisFileReader::next_event_time() const
 {
-  return _parser->event_time();
+  if (_read_ahead)
+    return _has_next ? _next.time : Time{};
+  else
+    return _decoder->event_time();
 }
 
 
-void TardisFileReader::parse_next_event()
+void TardisFileReader::consume_next_event()
 {
-  // TODO: add better error detection in here
+  assert(has_next_event()); // check we're only called if record parsed
 
-  auto parsed = _parser->next();
+  if (_read_ahead) {
+    _next.apply(_mktdata);
+    _has_next = _read_ahead->next(_next);
+  }
+  else {
+    _decoder->apply(_mktdata);
+    _decoder->advance();
+    skip_filtered();
+  }
 
-  // if we failed to parse, try to read in more data
-  if (!parsed) {
-    _reader.discard(_parser->bytes_parsed());
-    auto nread = _reader.read(); // TODO: check failure
-    _parser->reset_pointers(_reader.data(), _reader.avail());
-    _parser->next();
+  _event_count++;
+}
+
+
+void TardisFileReader::consume_next_event(TardisEvent& event)
+{
+  assert(has_next_event());
+
+  if (_read_ahead) {
+    event = _next;
+    _has_next = _read_ahead->next(_next);
+  }
+  else {
+    _decoder->decode(event);
+    _decoder->advance();
+    skip_filtered();
   }
 
   _event_count++;
 }
 
 
-void TardisFileReader::consume_next_event()
+size_t convert_tardis_to_tickbin2(const std::filesystem::path& src,
+                                  const std::filesystem::path& dest,
+                                  TardisFileReader::DataType datatype,
+                                  Tickbin2FileWriter::Options options)
+{
+  if (datatype == TardisFileReader::DataType::incremental_book_L2)
+    THROW("Tardis incremental_book_L2 files cannot be converted to tickbin2");
+
+  json meta;
+  meta["src"] = src.filename().string();
+  auto layout = tickbin2::Layout::Book5;
+  meta["c"] = "book_snapshot_5";
+  if (datatype == TardisFileReader::DataType::trades) {
+    layout = tickbin2::Layout::AggTrades;
+    meta["c"] = "trades";
+  }
+  else if (datatype == TardisFileReader::DataType::book_snapshot_25) {
+    layout = tickbin2::Layout::Book25;
+    meta["c"] = "book_snapshot_25";
+  }
+
+  // inflate & parse in the background, while we compress & write
+  TardisFileReader reader(src, nullptr, MdStream::Null, datatype, true);
+  Tickbin2FileWriter writer(dest, layout, meta, options);
+
+  TardisEvent event;
+  while (reader.has_next_event()) {
+    reader.consume_next_event(event);
+    std::visit(
+        [&](const auto& tick) {
+          using T = std::decay_t<decltype(tick)>;
+          if constexpr (!std::is_same_v<T, TickBookDelta>)
+            writer.write(event.time, tick);
+        },
+        event.tick);
+  }
+
+  writer.close();
+  return writer.record_count();
+}
+
+
+static std::string file_sha256(const std::filesystem::path& fn)
 {
-  assert(_parser->parse_ok()); // check we're only called if record parsed
+  MappedFile file(fn);
+
+  unsigned char md[EVP_MAX_MD_SIZE];
+  unsigned int mdlen = 0;
+  if (!EVP_Digest(file.begin(), file.size(), md, &mdlen, EVP_sha256(), nullptr))
+    THROW("failed to compute SHA-256 of " << fn);
 
-  _parser->apply_event(_mktdata);
+  return to_hex(md, mdlen);
+}
 
-  this->parse_next_event();
+
+std::filesystem::path tardis_cached_tickbin2(
+  const std::filesystem::path& cache_dir,
+  const std::filesystem::path& src,
+  TardisFileReader::DataType datatype)
+{
+  namespace fs = std::filesystem;
+
+  auto hash = file_sha256(src);
+  auto cached = cache_dir / hash.substr(0, 2) / (hash + ".bin2");
+  if (fs::exists(cached))
+    return cached;
+
+  // Convert to a private temporary file and then rename into place, so that
+  // readers, including concurrent backtests, never see a partial file.
+  auto tmp = cached;
+  tmp += ".tmp." + std::to_string(::getpid()) + "." +
+    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+  LOG_INFO("caching Tardis file " << src << " as " << cached);
+  try {
+    convert_tardis_to_tickbin2(src, tmp, datatype);
+    fs::rename(tmp, cached);
+  }
+  catch (...) {
+    std::error_code err;
+    fs::remove(tmp, err);
+    throw;
+  }
+  return cached;
 }
 
 
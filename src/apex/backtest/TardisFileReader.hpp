@@ -26,15 +26,19 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Instrument.hpp>
 #include <apex/infra/DecodeBuffer.hpp>
 #include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/TardisCsvParsers.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
 
 #include <filesystem>
+#include <memory>
+#include <optional>
+#include <vector>
 
 #include <zlib.h>
 
 namespace apex
 {
 
-class TardisDecoder;
 class TardisCsvParser;
 
 class TardisFileReader : public BaseTickFileReader
@@ -42,13 +46,24 @@ class TardisFileReader : public BaseTickFileReader
 public:
   enum class DataType {
     book_snapshot_5,
-    trades
+    book_snapshot_25,
+    trades,
+    incremental_book_L2 // full depth, as book deltas; see MdStream::L3
   };
 
+  /* With read-ahead, the file is inflated and parsed on a background thread,
+   * in parallel with the caller; otherwise parsing is done inline, as events
+   * are consumed.  Records outside the windows of the filter are parsed for
+   * their time only, and never decoded; inline, long gaps between windows
+   * are crossed with the gzip index.  L1 conflation is not applied, as it
+   * would need the time of the record after each, and incremental books are
+   * not windowed, since skipping deltas would corrupt the book. */
   explicit TardisFileReader(std::filesystem::path,
                             MarketData*,
                             MdStream,
-                            DataType datatype);
+                            DataType datatype,
+                            bool read_ahead = false,
+                            const TickFilter& filter = {});
   ~TardisFileReader();
 
   void wind_forward(apex::Time t) override;
@@ -59,19 +74,58 @@ public:
 
   void consume_next_event() override;
 
+  /* Decode the next event into `event`, rather than applying it. */
+  void consume_next_event(TardisEvent& event);
+
+  [[nodiscard]] bool filters() const override { return true; }
+
 private:
-  void read_header();
-  void parse_next_event();
+  class Decoder;
+  class ReadAhead;
+
+  apex::Time point_time(size_t point);
+  void seek_point(size_t point);
+
+  // pass over the events before `t`, using the gzip index; returns the
+  // number passed over one by one
+  size_t skip_until(apex::Time t);
+
+  // leave the reader at the next event the filter admits
+  void skip_filtered();
 
   std::filesystem::path _fn;
   MarketData* _mktdata;
   DataType _datatype;
+  TickFilter _filter;
   std::size_t _event_count = 0;
 
-  GzFile _file;
-  BufferedFileReader<GzFile> _reader;
-  std::unique_ptr<TardisCsvParser> _parser;
+  std::unique_ptr<Decoder> _decoder;
+
+  // read-ahead mode: the next event, already decoded by the background thread
+  std::unique_ptr<ReadAhead> _read_ahead;
+  TardisEvent _next;
+  bool _has_next = false;
+
+  // first record time at each access point of the gzip index, found on demand
+  std::vector<std::optional<apex::Time>> _point_times;
+  std::unique_ptr<GzFile> _probe;
 };
 
 
+/* Convert a Tardis CSV file to tickbin2, returning the number of records
+ * converted.  Book snapshots are written with the Book5 or Book25 layout, and
+ * trades with the AggTrades layout; incremental books cannot be converted. */
+size_t convert_tardis_to_tickbin2(const std::filesystem::path& src,
+                                  const std::filesystem::path& dest,
+                                  TardisFileReader::DataType datatype,
+                                  Tickbin2FileWriter::Options = {});
+
+/* Locate the tickbin2 conversion of a Tardis file within a cache directory,
+ * converting the file if not already cached.  Entries are keyed by the SHA-256
+ * of the source file, so a replaced source file is never served stale. */
+std::filesystem::path tardis_cached_tickbin2(
+  const std::filesystem::path& cache_dir,
+  const std::filesystem::path& src,
+  TardisFileReader::DataType datatype);
+
 } // namespace apex
@@ -0,0 +1,162 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+static size_t page_size()
+{
+  static const size_t size = ::sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+
+MappedFile::MappedFile(const std::filesystem::path& fn,
+                       const MmapOptions& options)
+  : _fn(fn)
+{
+  std::string fn_native = fn.native();
+
+  // try open
+  auto fd = open(fn_native.c_str(), O_RDONLY);
+  if (fd < 0) {
+    THROW("open failed, file " << fn << ", errno " << errno);
+  }
+
+  // obtain file size
+  struct stat stat_buf{};
+  if (fstat(fd, &stat_buf) < 0) {
+    auto err = errno;
+    ::close(fd);
+    THROW("fstat failed, file " << fn << ", errno " << err);
+  }
+
+  // map the file into memory; the descriptor is not needed after this
+  int flags = MAP_PRIVATE;
+  size_t size = stat_buf.st_size;
+  if (size <= options.populate_max_size)
+    flags |= MAP_POPULATE;
+  void* addr = ::mmap(NULL, size, PROT_READ, flags, fd, 0);
+  auto err = errno;
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    THROW("mmap failed, file " << fn << ", errno " << err);
+  }
+
+  _addr = static_cast<char*>(addr);
+  _size = size;
+
+  // paging hints are advisory, so failures are only logged
+  if (options.sequential && ::madvise(_addr, _size, MADV_SEQUENTIAL) != 0)
+    LOG_WARN("madvise(MADV_SEQUENTIAL) failed, file " << fn << ", errno " << errno);
+#ifdef MADV_HUGEPAGE
+  if (options.hugepages && ::madvise(_addr, _size, MADV_HUGEPAGE) != 0)
+    LOG_WARN("madvise(MADV_HUGEPAGE) failed, file " << fn << ", errno " << errno);
+#endif
+}
+
+
+MappedFile::~MappedFile()
+{
+  if (_addr)
+    ::munmap(_addr, _size);
+}
+
+
+void MappedFile::prefetch(size_t offset, size_t len) const
+{
+  if (offset >= _size)
+    return;
+  size_t begin = offset - offset % page_size();
+  size_t end = std::min(offset + len, _size);
+  ::madvise(_addr + begin, end - begin, MADV_WILLNEED);
+}
+
+
+void MappedFile::release(size_t offset, size_t len) const
+{
+  size_t begin = (offset + page_size() - 1) / page_size() * page_size();
+  size_t end = std::min(offset + len, _size);
+  if (end < _size)
+    end -= end % page_size();
+  if (begin < end)
+    ::madvise(_addr + begin, end - begin, MADV_DONTNEED);
+}
+
+
+MappedFileWindow::MappedFileWindow(const MappedFile* file, size_t window,
+                                   bool release)
+  : _file(file),
+    _window((window + page_size() - 1) / page_size() * page_size()),
+    _release(release)
+{
+  if (_window) {
+    _next = 0;
+    advance(0);
+  }
+}
+
+
+void MappedFileWindow::slide(size_t offset)
+{
+  // prefetch the window following the one being read; the kernel handles the
+  // current window, either through the initial prefetch or read-ahead
+  size_t current = offset / _window * _window;
+  _file->prefetch(current + _window, _window);
+  if (current == 0)
+    _file->prefetch(0, _window);
+
+  if (_release && current > _window + _released) {
+    _file->release(_released, current - _window - _released);
+    _released = current - _window;
+  }
+  _next = current + _window;
+}
+
+
+std::shared_ptr<const MappedFile> TickFileCache::open(
+    const std::filesystem::path& fn, const MmapOptions& options)
+{
+  auto lock = std::scoped_lock(_mutex);
+
+  auto iter = _files.find(fn);
+  if (iter == std::end(_files)) {
+    LOG_INFO("adding tick file to shared cache: " << fn);
+    iter = _files.insert({fn, std::make_shared<const MappedFile>(fn, options)}).first;
+  }
+  return iter->second;
+}
+
+
+size_t TickFileCache::size() const
+{
+  auto lock = std::scoped_lock(_mutex);
+  return _files.size();
+}
+
+} // namespace apex
@@ -0,0 +1,126 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace apex
+{
+
+/* Kernel paging hints for a mapped tick file. */
+struct MmapOptions {
+  // expect sequential access, so that the kernel reads ahead aggressively
+  bool sequential = true;
+
+  // fault in files up to this size entirely when mapped; zero disables
+  size_t populate_max_size = 0;
+
+  // request transparent huge pages, where the filesystem supports them
+  bool hugepages = false;
+
+  // bytes to prefetch ahead of the read position; zero disables
+  size_t window = 32 << 20;
+
+  // drop pages once the read position is a window past them, so that replay
+  // of large files does not grow the resident set
+  bool release = true;
+};
+
+
+/* Read-only memory mapping of an entire tick file. The mapping is released
+ * when the object is destroyed. */
+class MappedFile
+{
+public:
+  explicit MappedFile(const std::filesystem::path& fn,
+                      const MmapOptions& options = {});
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  [[nodiscard]] const char* begin() const { return _addr; }
+  [[nodiscard]] const char* end() const { return _addr + _size; }
+  [[nodiscard]] size_t size() const { return _size; }
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _fn; }
+
+  /* Ask the kernel to start reading in the given range of the file. */
+  void prefetch(size_t offset, size_t len) const;
+
+  /* Drop the pages wholly within the given range; a later read faults them
+   * back in from the page cache. */
+  void release(size_t offset, size_t len) const;
+
+private:
+  std::filesystem::path _fn;
+  char* _addr = nullptr;
+  size_t _size = 0;
+};
+
+
+/* Paging of a mapped file that is read from front to back.  The window ahead
+ * of the read position is prefetched and, optionally, pages more than a window
+ * behind are released. */
+class MappedFileWindow
+{
+public:
+  MappedFileWindow() = default;
+  MappedFileWindow(const MappedFile* file, size_t window, bool release);
+
+  /* Note the current read offset; cheap unless a window boundary is passed. */
+  void advance(size_t offset)
+  {
+    if (offset >= _next)
+      slide(offset);
+  }
+
+private:
+  void slide(size_t offset);
+
+  const MappedFile* _file = nullptr;
+  size_t _window = 0;
+  bool _release = false;
+  size_t _next = SIZE_MAX;
+  size_t _released = 0;
+};
+
+
+/* Process-wide cache of mapped tick files, allowing many backtests running in
+ * the same process (e.g. a parameter sweep) to share a single read-only copy of
+ * each file.  Safe to use from multiple threads. */
+class TickFileCache
+{
+public:
+  /* Return the mapping for the file, creating it on first request; the
+   * options only apply when the mapping is created. */
+  std::shared_ptr<const MappedFile> open(const std::filesystem::path& fn,
+                                         const MmapOptions& options = {});
+
+  [[nodiscard]] size_t size() const;
+
+private:
+  mutable std::mutex _mutex;
+  std::map<std::filesystem::path, std::shared_ptr<const MappedFile>> _files;
+};
+
+} // namespace apex
@@ -16,91 +16,438 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
 
+#include <cerrno>
+#include <cstring>
 #include <fstream>
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
 namespace fs = std::filesystem;
 
 namespace apex
 {
 
+static constexpr uint64_t usec_per_hour = 3600ULL * 1000000ULL;
+
+
+static void create_tickdata_directory(const fs::path& dir)
+{
+  std::error_code err;
+  auto created = fs::create_directories(dir, err);
+  if (err) {
+    LOG_WARN("failed to create tickdata directory " << dir << ", error " << err);
+    throw std::system_error(err, "cannot create tickdata directory");
+  }
+  if (created) {
+    LOG_INFO("created tickdata directory "<< dir << "");
+  }
+}
+
+
 TickbinFileWriter::TickbinFileWriter(
   TickFileBucketId bucketid,
   std::filesystem::path dirname,
   std::filesystem::path filename,
   StreamInfo stream_info,
   json collect_meta)
+  : TickbinFileWriter(bucketid, std::move(dirname), std::move(filename),
+                      std::move(stream_info), std::move(collect_meta),
+                      Options{})
+{
+}
+
+
+TickbinFileWriter::TickbinFileWriter(
+  TickFileBucketId bucketid,
+  std::filesystem::path dirname,
+  std::filesystem::path filename,
+  StreamInfo stream_info,
+  json collect_meta,
+  Options options)
   : _bucketid(bucketid),
     _dirname(std::move(dirname)),
-    _filename(std::move(filename)
-      ) {
+    _filename(std::move(filename)),
+    _options(options)
+{
+  if (_options.compress && _options.delta)
+    THROW("tick files cannot be both compressed and delta encoded");
+
+  // compressed files are created as records for each hour arrive
+  if (_options.compress) {
+    _meta = tickbin_stream_meta(stream_info, bucketid, std::move(collect_meta));
+    return;
+  }
+
   std::filesystem::path dir = _dirname;
   if (!std::filesystem::exists(full_path())) {
-    std::error_code err;
-    auto created = fs::create_directories(dir, err);
-    if (err) {
-      LOG_WARN("failed to create tickdata directory " << dir << ", error " << err);
-      throw std::system_error(err, "cannot create tickdata directory");
+    create_tickdata_directory(dir);
+
+    // generate meta-data information
+    auto meta = tickbin_stream_meta(stream_info, bucketid,
+                                    std::move(collect_meta));
+    if (_options.delta) {
+      _delta = std::make_unique<tickbin::DeltaSerialiser>(
+          stream_info.instrument.tick_size, stream_info.instrument.lot_size);
+      _delta->write_meta(meta);
+    }
+    auto preamble = encode_tickbin_file_header(
+        _delta ? tickbin::delta_version : "TICK1", meta);
+
+    // --- Write to file
+    LOG_INFO("creating tick-bin file: " << full_path());
+    auto file = std::ofstream(full_path(), std::ios::binary);
+    file.write(preamble.data(), preamble.size());
+    file.close();
+
+    // any existing index belongs to an earlier file
+    fs::remove(tickbin_index_path(full_path()));
+  }
+  else {
+    // Appending to an existing file; the region holding the end of the file
+    // has already been indexed, if it contains the start of a record.
+    auto size = fs::file_size(full_path());
+    _indexed_region = size ? (size - 1) / tickbin::index_stride : UINT64_MAX;
+
+    // records are appended in the format of the file; the first appended
+    // record of a delta file is a key record, as decoding state is not known
+    MappedFile file(full_path());
+    if (file.size() < TickbinHeader::header_lead_length)
+      THROW("tickbin file has incomplete file header " << full_path());
+    auto header = decode_tickbin_file_header(file.begin());
+    const bool is_delta = header.version == tickbin::delta_version;
+    if (is_delta != _options.delta)
+      LOG_WARN("appending to " << QUOTE(header.version) << " format file "
+               << full_path());
+    if (is_delta) {
+      auto meta = json::parse(file.begin() + TickbinHeader::header_lead_length,
+                              file.begin() + header.length);
+      _delta = std::make_unique<tickbin::DeltaSerialiser>(
+          tickbin::DeltaSerialiser::from_meta(meta));
+    }
+  }
+
+  _offset = fs::file_size(full_path());
+  _ostream = std::make_unique<std::ofstream>(full_path(), std::ios::binary | std::ios::app);
+  _index_ostream = std::make_unique<std::ofstream>(
+      tickbin_index_path(full_path()), std::ios::binary | std::ios::app);
+}
+
+TickbinFileWriter::~TickbinFileWriter()
+{
+  if (_options.compress) {
+    try {
+      close_part();
     }
-    if (created) {
-      LOG_INFO("created tickdata directory "<< dir << "");
+    catch (const std::exception& e) {
+      LOG_ERROR("failed to close tick file " << full_path() << ": " << e.what());
     }
+    return;
+  }
+  _ostream->close();
+  _index_ostream->close();
+}
 
-    // generate meta-data information
-    json meta;
-    meta["e"] = exchange_id_to_string(stream_info.exchange_id());
-    meta["c"] = stream_info.channel;
-    meta["s"] = stream_info.symbol();
-    meta["i"] = stream_info.instrument.id();
-    meta["bin"] = bucketid.as_string();
-    meta["cm"] = std::move(collect_meta);
-    auto meta_str = to_string(meta);
-    auto head_plus_meta_len = 8 + meta_str.size() + 1;  // +1 for null term
 
-    // Decide the preamble block size. This has to be large enough to accomodate
-    // the JSON meta-data, but also we want it be sympathetic to later memory
-    // mapping; so we ensure we allocate header space in 1024 byte blocks.
+std::filesystem::path TickbinFileWriter::full_path() const
+{
+  if (_options.compress)
+    return _dirname / tickbin_part_path(_filename, std::max(_part_hour, 0));
+  else
+    return _dirname / _filename;
+}
 
-    size_t preamble_size = (1 + (head_plus_meta_len  >> 10)) << 10;
-    assert (head_plus_meta_len < preamble_size);
 
-    // --- Build the binary image for the preamble ---
-    std::string tick_version = "TICK1   ";
-    assert(tick_version.size() == 8);
-    std::vector<char> preamble(preamble_size, '\0');
+void TickbinFileWriter::write_bytes(char* buf, size_t size) {
+  if (_options.compress) {
+    write_frames(buf, size);
+    return;
+  }
 
-    // write the tick header version
-    strcpy(&preamble[0], tick_version.c_str());
+  if (!_ostream->good())
+    return;
 
-    // write the preamble region size
-    snprintf(&preamble[8], 8, "%07lu", preamble_size);
+  if (_delta) {
+    write_delta(buf, size);
+    return;
+  }
 
-    // write the json meta data
-    strncpy(&preamble[16], meta_str.c_str(), 1024 - 16);
+  _ostream->write(buf, size);
 
-    // we should not have overritten the final preamble byte
-    assert(preamble[preamble_size-1] == '\0');
+  // add an index entry for the first record starting in each index region
+  size_t pos = 0;
+  while (pos + sizeof(tickbin::Header) <= size) {
+    tickbin::Header head;
+    memcpy(&head, buf + pos, sizeof(head));
+    if (head.size < sizeof(head))
+      break;
 
-    // --- Write to file
-    LOG_INFO("creating tick-bin file: " << full_path());
-    auto file = std::ofstream(full_path(), std::ios::binary);
-    file.write(preamble.data(), preamble_size);
-    file.close();
+    uint64_t offset = _offset + pos;
+    uint64_t region = offset / tickbin::index_stride;
+    if (region != _indexed_region && _index_ostream->good()) {
+      tickbin::IndexEntry entry{head.capture_time, offset};
+      _index_ostream->write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+      _indexed_region = region;
+    }
+    pos += head.size;
+  }
+  _offset += size;
+}
+
+
+void TickbinFileWriter::write_delta(const char* buf, size_t size)
+{
+  _delta_buf.clear();
+  size_t pos = 0;
+  while (pos + sizeof(tickbin::Header) <= size) {
+    tickbin::Header head;
+    memcpy(&head, buf + pos, sizeof(head));
+    if (head.size < sizeof(head) || pos + head.size > size)
+      break;
+
+    // the first record starting in each index region is a key record, so
+    // that a reader can begin decoding at any index entry
+    const size_t at = _delta_buf.size();
+    uint64_t offset = _offset + at;
+    uint64_t region = offset / tickbin::index_stride;
+    if (region != _indexed_region)
+      _delta->reset();
+
+    // raw records do not carry their type, which is known from their size
+    Time capture_time{std::chrono::microseconds(head.capture_time)};
+    _delta_buf.resize(at + tickbin::DeltaSerialiser::max_record_size);
+    size_t written = 0;
+    if (head.size == tickbin::Serialiser::record_size<TickTop>) {
+      TickTop tick;
+      tickbin::Serialiser::deserialise(buf + pos, tick);
+      written = _delta->serialise(_delta_buf.data() + at, capture_time, tick);
+    }
+    else if (head.size == tickbin::Serialiser::record_size<TickTrade>) {
+      TickTrade tick;
+      tickbin::Serialiser::deserialise(buf + pos, tick);
+      written = _delta->serialise(_delta_buf.data() + at, capture_time, tick);
+    }
+    _delta_buf.resize(at + written);
+
+    if (written && region != _indexed_region && _index_ostream->good()) {
+      tickbin::IndexEntry entry{head.capture_time, offset};
+      _index_ostream->write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+      _indexed_region = region;
+    }
+    pos += head.size;
   }
 
-  _ostream = std::make_unique<std::ofstream>(full_path(), std::ios::binary | std::ios::app);
+  _ostream->write(_delta_buf.data(), _delta_buf.size());
+  _offset += _delta_buf.size();
 }
 
-TickbinFileWriter::~TickbinFileWriter()
+
+void TickbinFileWriter::write_frames(const char* buf, size_t size)
+{
+  size_t pos = 0;
+  while (pos + sizeof(tickbin::Header) <= size) {
+    tickbin::Header head;
+    memcpy(&head, buf + pos, sizeof(head));
+    if (head.size < sizeof(head) || pos + head.size > size)
+      break;
+
+    // rotate at each hour, otherwise close the frame once full
+    int hour = static_cast<int>((head.capture_time / usec_per_hour) % 24);
+    if (hour != _part_hour)
+      open_part(hour);
+    else if (!_frame.empty() &&
+             (_frame.size() + head.size > _options.frame_size ||
+              head.capture_time >= _frame_first + _options.frame_span.count() * 1000000ULL))
+      flush_frame();
+
+    if (_frame.empty())
+      _frame_first = head.capture_time;
+    _frame_last = head.capture_time;
+    _frame.insert(_frame.end(), buf + pos, buf + pos + head.size);
+    pos += head.size;
+  }
+}
+
+
+void TickbinFileWriter::open_part(int hour)
+{
+  close_part();
+  _part_hour = hour;
+  auto fn = full_path();
+
+  if (!fs::exists(fn)) {
+    create_tickdata_directory(_dirname);
+    auto meta = _meta;
+    meta["hr"] = hour;
+    auto preamble = encode_tickbin_file_header(tickbin::compressed_version, meta);
+    LOG_INFO("creating tick-bin file: " << fn);
+    std::ofstream file(fn, std::ios::binary);
+    file.write(preamble.data(), preamble.size());
+  }
+  else {
+    // Appending to an existing file, which might not have been closed; drop
+    // its index, and any frame torn by a crash, so that new frames follow
+    // the last complete frame.  The index is rewritten when the file closes.
+    size_t end = 0;
+    {
+      MappedFile file(fn);
+      if (file.size() < TickbinHeader::header_lead_length)
+        THROW("tickbin file has incomplete file header " << fn);
+      auto header = decode_tickbin_file_header(file.begin());
+      if (header.version != tickbin::compressed_version)
+        THROW("cannot append compressed ticks to " << QUOTE(header.version)
+              << " format file " << fn);
+      _frames = find_tickbin_frames(file.begin(), file.size(), header.length,
+                                    true, end);
+      if (end < file.size())
+        LOG_WARN("truncating tick file " << fn << " from " << file.size()
+                 << " to " << end << " bytes");
+    }
+    fs::resize_file(fn, end);
+  }
+
+  _offset = fs::file_size(fn);
+  _ostream = std::make_unique<std::ofstream>(fn, std::ios::binary | std::ios::app);
+}
+
+
+void TickbinFileWriter::close_part()
 {
+  if (!_ostream)
+    return;
+  flush_frame();
+
+  tickbin::FrameFooter footer{_offset, static_cast<uint32_t>(_frames.size()),
+                              tickbin::frame_footer_magic};
+  _ostream->write(reinterpret_cast<const char*>(_frames.data()),
+                  _frames.size() * sizeof(tickbin::IndexEntry));
+  _ostream->write(reinterpret_cast<const char*>(&footer), sizeof(footer));
   _ostream->close();
+  if (_ostream->fail())
+    LOG_WARN("failed to write index of tick file " << full_path());
+
+  _ostream.reset();
+  _frames.clear();
 }
 
 
-void TickbinFileWriter::write_bytes(char* buf, size_t size) {
-  if (_ostream->good())
-    _ostream->write(buf, size);
+void TickbinFileWriter::flush_frame()
+{
+  if (_frame.empty() || !_ostream)
+    return;
+
+  uLongf compressed_len = compressBound(_frame.size());
+  _compressed.resize(compressed_len);
+  int rc = compress2(reinterpret_cast<Bytef*>(_compressed.data()), &compressed_len,
+                     reinterpret_cast<const Bytef*>(_frame.data()), _frame.size(),
+                     _options.compression_level);
+  if (rc != Z_OK)
+    THROW("zlib compression failed, error " << rc);
+
+  tickbin::FrameHeader head;
+  head.magic = tickbin::frame_magic;
+  head.raw_size = static_cast<uint32_t>(_frame.size());
+  head.compressed_size = static_cast<uint32_t>(compressed_len);
+  head.crc = crc32(0L, reinterpret_cast<const Bytef*>(_compressed.data()),
+                   compressed_len);
+  head.first_time = _frame_first;
+  head.last_time = _frame_last;
+
+  _ostream->write(reinterpret_cast<const char*>(&head), sizeof(head));
+  _ostream->write(_compressed.data(), compressed_len);
+  _frames.push_back({_frame_first, _offset});
+  _offset += sizeof(head) + compressed_len;
+  _frame.clear();
+}
+
+
+void TickbinFileWriter::sync()
+{
+  if (_options.compress) {
+    if (!_ostream)
+      return;
+    flush_frame();
+  }
+  _ostream->flush();
+  if (_index_ostream)
+    _index_ostream->flush();
+
+  // fsync applies to the file, so any descriptor for it can be used
+  int fd = ::open(full_path().c_str(), O_WRONLY);
+  if (fd < 0) {
+    LOG_WARN("cannot open tick file for fsync " << full_path() << ", errno " << errno);
+    return;
+  }
+  if (::fsync(fd) != 0)
+    LOG_WARN("fsync failed for tick file " << full_path() << ", errno " << errno);
+  ::close(fd);
+}
+
+
+size_t build_tickbin_index(const std::filesystem::path& fn)
+{
+  MappedFile file(fn);
+  if (file.size() < TickbinHeader::header_lead_length)
+    THROW("tickbin file has incomplete file header " << fn);
+  auto header = decode_tickbin_file_header(file.begin());
+  if (header.version == tickbin::compressed_version)
+    THROW("compressed tickbin files hold their own index " << fn);
+
+  auto index_fn = tickbin_index_path(fn);
+  auto tmp_fn = index_fn;
+  tmp_fn += ".tmp";
+  std::ofstream os(tmp_fn, std::ios::binary | std::ios::trunc);
+
+  size_t count = 0;
+  uint64_t indexed_region = UINT64_MAX;
+  uint64_t offset = header.length;
+
+  // delta encoded records are indexed at the key record beginning each region
+  if (header.version == tickbin::delta_version) {
+    while (auto size = tickbin::DeltaSerialiser::record_size(
+               file.begin() + offset, file.size() - offset)) {
+      uint64_t region = offset / tickbin::index_stride;
+      uint64_t capture_time = 0;
+      if (region != indexed_region &&
+          tickbin::DeltaSerialiser::key_time(file.begin() + offset, size,
+                                             capture_time)) {
+        tickbin::IndexEntry entry{capture_time, offset};
+        os.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        indexed_region = region;
+        count++;
+      }
+      offset += size;
+    }
+  }
+  else {
+    while (offset + sizeof(tickbin::Header) <= file.size()) {
+      tickbin::Header head;
+      memcpy(&head, file.begin() + offset, sizeof(head));
+      if (head.size < sizeof(head) || offset + head.size > file.size())
+        break;
+
+      uint64_t region = offset / tickbin::index_stride;
+      if (region != indexed_region) {
+        tickbin::IndexEntry entry{head.capture_time, offset};
+        os.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        indexed_region = region;
+        count++;
+      }
+      offset += head.size;
+    }
+  }
+
+  os.close();
+  if (os.fail())
+    THROW("failed to write tickbin index " << index_fn);
+  fs::rename(tmp_fn, index_fn);
+  return count;
 }
 
 
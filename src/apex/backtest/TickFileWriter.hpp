@@ -19,32 +19,103 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/backtest/TickbinFileReader.hpp>
 
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <vector>
+
 namespace apex
 {
 
+/* Writes the tick file of one day.  By default records are appended raw to
+ * the named file.  If compression is enabled, the day is instead written as
+ * hourly files (see tickbin_part_path), each a sequence of compressed frames;
+ * a crash then loses at most the frame being built, and the file is repaired
+ * when next opened for writing.  If delta encoding is enabled, the records
+ * are instead re-encoded into the compact records of a TICKD file. */
 class TickbinFileWriter
 {
 public:
+  struct Options {
+    // write compressed, hourly rotated files
+    bool compress = false;
+
+    // zlib compression level; low levels favour speed
+    int compression_level = 3;
+
+    // a frame is written once it holds this many bytes of records ...
+    size_t frame_size = 256 << 10;
+
+    // ... or once a record falls outside the time span of the frame
+    std::chrono::seconds frame_span{10};
+
+    // write delta encoded records; an existing file keeps its own format
+    bool delta = false;
+  };
+
   TickbinFileWriter(TickFileBucketId bucketid,
                     std::filesystem::path dirname,
                     std::filesystem::path filename,
                     StreamInfo stream_info,
                     json collect_meta = {});
 
+  TickbinFileWriter(TickFileBucketId bucketid,
+                    std::filesystem::path dirname,
+                    std::filesystem::path filename,
+                    StreamInfo stream_info,
+                    json collect_meta,
+                    Options options);
+
   ~TickbinFileWriter();
 
   [[nodiscard]] const TickFileBucketId& bucketid() const { return _bucketid; };
 
+  // Write one or more serialised tickbin records.
   void write_bytes(char* buf, size_t size);
 
-  [[nodiscard]] std::filesystem::path full_path() const { return _dirname/_filename; }
+  // Flush written records to the file, and then to stable storage.  When
+  // compressing, this first writes out the frame being built.
+  void sync();
+
+  // Path of the file being written; for compressed writing, the file of the
+  // current hour.
+  [[nodiscard]] std::filesystem::path full_path() const;
 
 private:
+  void write_frames(const char* buf, size_t size);
+  void write_delta(const char* buf, size_t size);
+  void open_part(int hour);
+  void close_part();
+  void flush_frame();
+
   TickFileBucketId _bucketid;
   std::filesystem::path _dirname;
   std::filesystem::path _filename;
+  Options _options;
   std::unique_ptr<std::ofstream> _ostream;
+  std::unique_ptr<std::ofstream> _index_ostream;
+  uint64_t _offset = 0;
+  uint64_t _indexed_region = UINT64_MAX;
+
+  // delta encoded writing only
+  std::unique_ptr<tickbin::DeltaSerialiser> _delta;
+  std::vector<char> _delta_buf;
+
+  // compressed writing only
+  json _meta;
+  int _part_hour = -1;
+  std::vector<tickbin::IndexEntry> _frames;
+  std::vector<char> _frame;
+  uint64_t _frame_first = 0;
+  uint64_t _frame_last = 0;
+  std::vector<char> _compressed;
 };
 
 
+/* Rebuild the sparse time index of an existing tickbin file, returning the
+ * number of index entries written. */
+size_t build_tickbin_index(const std::filesystem::path& fn);
+
+
 } // namespace apex
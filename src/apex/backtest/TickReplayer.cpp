@@ -16,13 +16,18 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/DecodedTickCache.hpp>
 #include <apex/backtest/TardisFileReader.hpp>
 #include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/Instrument.hpp>
+#include <apex/model/InstrumentTable.hpp>
 #include <apex/core/MarketDataService.hpp>
+#include <apex/util/Config.hpp>
 #include <apex/util/Error.hpp>
 
+#include <algorithm>
 #include <utility>
 
 namespace apex
@@ -32,25 +37,168 @@ const char* to_string(TickFormat t) {
   switch (t) {
     case TickFormat::tickbin1 : return "tickbin1";
     case TickFormat::tardis : return "tardis";
+    case TickFormat::tickbin2 : return "tickbin2";
   }
   return "";
 }
 
 
+TickFormat parse_tick_format(const std::string& s)
+{
+  for (auto fmt : {TickFormat::tickbin1, TickFormat::tardis, TickFormat::tickbin2})
+    if (s == to_string(fmt))
+      return fmt;
+
+  std::ostringstream oss;
+  oss << "invalid tick format " << QUOTE(s);
+  throw ConfigError(oss.str());
+}
+
+
+static constexpr std::chrono::microseconds one_day = std::chrono::hours(24);
+
+
+TickFilter TickFilter::parse(const std::vector<std::string>& windows,
+                             std::chrono::microseconds l1_conflate)
+{
+  TickFilter filter;
+  filter.l1_conflate = l1_conflate;
+
+  for (auto& text : windows) {
+    auto dash = text.find('-');
+    if (dash == std::string::npos)
+      THROW("invalid replay window '" << text
+            << "', expected HH:MM[:SS]-HH:MM[:SS]");
+    auto begin = parse_time_of_day(text.substr(0, dash));
+    auto end = parse_time_of_day(text.substr(dash + 1));
+    if (begin < end)
+      filter.windows.push_back({begin, end});
+    else if (end < begin) {
+      filter.windows.push_back({begin, one_day});
+      if (end.count())
+        filter.windows.push_back({std::chrono::microseconds{0}, end});
+    }
+  }
+
+  // sorted and merged, so each time falls in at most one window
+  std::sort(filter.windows.begin(), filter.windows.end(),
+            [](auto& a, auto& b) { return a.begin < b.begin; });
+  std::vector<Window> merged;
+  for (auto& window : filter.windows)
+    if (!merged.empty() && window.begin <= merged.back().end)
+      merged.back().end = std::max(merged.back().end, window.end);
+    else
+      merged.push_back(window);
+  filter.windows = std::move(merged);
+  return filter;
+}
+
+
+bool TickFilter::admits(Time t) const
+{
+  if (windows.empty())
+    return true;
+  auto tod = t.as_epoch_us() % one_day;
+  for (auto& window : windows)
+    if (tod >= window.begin && tod < window.end)
+      return true;
+  return false;
+}
+
+
+Time TickFilter::next_admitted(Time t) const
+{
+  if (windows.empty())
+    return t;
+  auto tod = t.as_epoch_us() % one_day;
+  auto midnight = t.as_epoch_us() - tod;
+  for (auto& window : windows)
+    if (tod < window.end)
+      return Time(midnight + std::max(tod, window.begin));
+  return Time(midnight + one_day + windows.front().begin);
+}
+
+
+Time TickFilter::window_end(Time t) const
+{
+  auto tod = t.as_epoch_us() % one_day;
+  for (auto& window : windows)
+    if (tod >= window.begin && tod < window.end)
+      return Time(t.as_epoch_us() - tod + window.end);
+  return Time{};
+}
+
+
+/* The windows of a filter, applied to a reader that does not filter: events
+ * outside of them are passed over by wind_forward, which does not apply
+ * them, and so uses whatever index the reader has. */
+class WindowedTickFileReader : public BaseTickFileReader
+{
+public:
+  WindowedTickFileReader(std::unique_ptr<BaseTickFileReader> reader,
+                         const TickFilter& filter)
+    : _reader(std::move(reader)),
+      _filter(filter)
+  {
+    skip_filtered();
+  }
+
+  void wind_forward(apex::Time t) override
+  {
+    _reader->wind_forward(t);
+    skip_filtered();
+  }
+
+  [[nodiscard]] bool has_next_event() const override
+  {
+    return _reader->has_next_event();
+  }
+
+  [[nodiscard]] apex::Time next_event_time() const override
+  {
+    return _reader->next_event_time();
+  }
+
+  void consume_next_event() override
+  {
+    _reader->consume_next_event();
+    skip_filtered();
+  }
+
+  [[nodiscard]] bool filters() const override { return true; }
+
+private:
+  void skip_filtered()
+  {
+    while (_reader->has_next_event()) {
+      auto t = _reader->next_event_time();
+      if (_filter.admits(t))
+        break;
+      _reader->wind_forward(_filter.next_admitted(t));
+    }
+  }
+
+  std::unique_ptr<BaseTickFileReader> _reader;
+  const TickFilter& _filter;
+};
+
+
 TickReplayer::TickReplayer(const std::filesystem::path& tick_dir,
                            TickFormat tick_format,
                            const Instrument& instrument,
                            MarketData* mktdata,
                            MdStream stream,
                            Time replay_from,
-                           std::list<Time> dates)
+                           std::list<Time> dates,
+                           TickReplayOptions options)
   : _tick_format(tick_format),
-    _instrument(instrument),
+    _instrument(InstrumentTable::instance().resolve(instrument)),
     _mktdata(mktdata),
     _stream(stream),
     _replay_from(replay_from),
     _dates(std::move(dates)),
-    _base_dir(tick_dir / to_string(tick_format) / instrument.exchange_name())
+    _base_dir(tick_dir / to_string(tick_format) / instrument.exchange_name()),
+    _options(options)
 {
   build_tick_file_options();
   auto result = find_tick_files();
@@ -100,32 +248,84 @@ void TickReplayer::consume_next_event() {
 }
 
 
+size_t TickReplayer::consume_events(BacktestBatch& batch)
+{
+  // a batch can continue into the next file
+  size_t count = 0;
+  while (_reader) {
+    count += _reader->consume_events(batch);
+    if (_reader->has_next_event())
+      break;
+    get_next_file_reader();
+  }
+  return count;
+}
+
+
 void TickReplayer::get_next_file_reader()
 {
   _reader.reset();
-  while (!_reader && !_filenames.empty()) {
-    auto next_filename = _filenames.front();
-    _filenames.pop_front();
-
-    // create a tick-file reader for the appropriate tick format
+  while (!_reader && (_prefetched.valid() || !_filenames.empty())) {
     std::unique_ptr<BaseTickFileReader> reader;
-
-    reader = _tick_reader_factory(next_filename);
-
-    LOG_INFO("tick-file first event time: " << reader->next_event_time());
-
-    // Scan for an initial event that falls within the current replay period;
-    // this typically happens for the first file that is part of a
-    // backtest. Allowing the tick-file reader to perform this action allows it
-    // to use any internal short-cuts to decide which events to skip.
-    reader->wind_forward(_replay_from);
+    if (_prefetched.valid()) {
+      reader = _prefetched.get();
+    }
+    else {
+      auto next_filename = _filenames.front();
+      _filenames.pop_front();
+      reader = open_file_reader(next_filename);
+    }
 
     // if the current reader has an event that we can use, then we retain the
     // reader
     if (reader->has_next_event())
       _reader = std::move(reader);
   }
+
+  if (_reader && _options.prefetch_next_file)
+    prefetch_next_file_reader();
+}
+
+
+std::unique_ptr<BaseTickFileReader> TickReplayer::open_file_reader(
+  const std::filesystem::path& filename)
+{
+  // create a tick-file reader for the appropriate tick format
+  auto reader = _tick_reader_factory(filename);
+  if (!_options.filter.windows.empty() && !reader->filters())
+    reader = std::make_unique<WindowedTickFileReader>(std::move(reader),
+                                                      _options.filter);
+
+  LOG_INFO("tick-file first event time: " << reader->next_event_time());
+
+  // Scan for an initial event that falls within the current replay period;
+  // this typically happens for the first file that is part of a
+  // backtest. Allowing the tick-file reader to perform this action allows it
+  // to use any internal short-cuts to decide which events to skip.
+  reader->wind_forward(_replay_from);
+
+  return reader;
 }
+
+
+void TickReplayer::prefetch_next_file_reader()
+{
+  if (_filenames.empty())
+    return;
+
+  // Opening a file can involve reading its header & index, faulting in its
+  // first pages, or starting decompression; doing this in the background
+  // avoids a stall on the backtest thread at each file boundary.  Readers
+  // don't touch MarketData until events are consumed, so this is safe; any
+  // error is rethrown when the reader is collected.
+  auto next_filename = _filenames.front();
+  _filenames.pop_front();
+  _prefetched = std::async(std::launch::async, [this, next_filename]() {
+    return open_file_reader(next_filename);
+  });
+}
+
+
 std::tuple<std::list<std::filesystem::path>,
              std::list<std::filesystem::path>> TickReplayer::find_tick_files()
 {
@@ -136,11 +336,26 @@ std::tuple<std::list<std::filesystem::path>,
   std::list<std::filesystem::path> missing;
   for (auto& date : _dates) {
     auto fn = _tick_filename_factory(date);
+    bool found = false;
     if (fs::exists(fn) && fs::is_regular_file(fn)) {
       filenames.push_back(fn);
-    } else {
-      missing.push_back(fn);
+      found = true;
     }
+
+    // a day captured as compressed tickbin is held in hourly files, which can
+    // follow a raw file if the collector changed format during the day
+    if (_tick_format == TickFormat::tickbin1) {
+      for (int hour = 0; hour < 24; hour++) {
+        auto part = tickbin_part_path(fn, hour);
+        if (fs::exists(part) && fs::is_regular_file(part)) {
+          filenames.push_back(part);
+          found = true;
+        }
+      }
+    }
+
+    if (!found)
+      missing.push_back(fn);
   }
 
   return {filenames, missing};
@@ -169,6 +384,20 @@ void TickReplayer::build_tick_file_options()
         datatype = TardisFileReader::DataType::book_snapshot_5;
         break;
 
+      // a partial book is replayed from the deepest book snapshot
+      case MdStream::L2 :
+        subdir = "book_snapshot_25";
+        datatype = TardisFileReader::DataType::book_snapshot_25;
+        break;
+
+      // the full book is replayed from its deltas, most of which are deep in
+      // the book, so only changes near the touch raise events
+      case MdStream::L3 :
+        subdir = "incremental_book_L2";
+        datatype = TardisFileReader::DataType::incremental_book_L2;
+        _mktdata->set_book_event_depth(_options.book_event_depth);
+        break;
+
       default: {
         THROW("Tardis tick-replayer doesn't support stream type " << _stream);
       }
@@ -186,16 +415,29 @@ void TickReplayer::build_tick_file_options()
     };
 
     _tick_reader_factory = [this, datatype](const std::filesystem::path& filename)
-    {
+      -> std::unique_ptr<BaseTickFileReader> {
+      if (!this->_options.tardis_cache_dir.empty() &&
+          datatype != TardisFileReader::DataType::incremental_book_L2)
+        return std::make_unique<Tickbin2FileReader>(
+          tardis_cached_tickbin2(this->_options.tardis_cache_dir, filename,
+                                 datatype),
+          this->_mktdata,
+          this->_stream,
+          this->_options.tick_cache,
+          this->_options.mmap);
+
       return std::make_unique<TardisFileReader>(
         filename,
         this->_mktdata,
         this->_stream,
-        datatype);
+        datatype,
+        this->_options.tardis_read_ahead,
+        this->_options.filter);
     };
 
   }
-  else if (_tick_format == TickFormat::tickbin1) {
+  else if (_tick_format == TickFormat::tickbin1 ||
+           _tick_format == TickFormat::tickbin2) {
     std::string subdir;
 
     switch (_stream) {
@@ -205,8 +447,19 @@ void TickReplayer::build_tick_file_options()
       case MdStream::L1 :
         subdir = "l1";
         break;
+      case MdStream::L2 :
+        if (_tick_format != TickFormat::tickbin2)
+          THROW("tickbin1 doesn't support stream type " << _stream);
+        subdir = "l2";
+        break;
 
       default: {
+        // a mixed file holds several streams
+        if (_stream == tickbin_mixed_streams &&
+            _tick_format == TickFormat::tickbin1) {
+          subdir = tickbin_mixed_channel;
+          break;
+        }
         THROW("tickbin doesn't support stream type " << _stream);
       }
     }
@@ -218,15 +471,38 @@ void TickReplayer::build_tick_file_options()
       fn /= time.strftime("%m");
       fn /= time.strftime("%d");
       fn /= _instrument.native_symbol();
-      fn += ".bin";
+      fn += (_tick_format == TickFormat::tickbin2) ? ".bin2" : ".bin";
       return fn;
     };
 
-    _tick_reader_factory = [this](const std::filesystem::path& filename) {
-      return std::make_unique<TickbinFileReader>(
-        filename,
-        this->_mktdata,
-        this->_stream);
+    _tick_reader_factory = [this](const std::filesystem::path& filename)
+      -> std::unique_ptr<BaseTickFileReader> {
+      if (this->_options.decoded_cache) {
+        auto decoded = this->_options.decoded_cache->get(filename, this->_stream);
+        if (!decoded.empty())
+          return std::make_unique<TickbinFileReader>(
+            decoded,
+            this->_mktdata,
+            this->_stream,
+            this->_options.tick_cache,
+            this->_options.mmap,
+            this->_options.filter);
+      }
+      if (this->_tick_format == TickFormat::tickbin2)
+        return std::make_unique<Tickbin2FileReader>(
+          filename,
+          this->_mktdata,
+          this->_stream,
+          this->_options.tick_cache,
+          this->_options.mmap);
+      else
+        return std::make_unique<TickbinFileReader>(
+          filename,
+          this->_mktdata,
+          this->_stream,
+          this->_options.tick_cache,
+          this->_options.mmap,
+          this->_options.filter);
     };
   }
   else {
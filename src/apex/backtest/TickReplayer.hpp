@@ -21,22 +21,71 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Instrument.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/util/BacktestEventLoop.hpp>
+#include <apex/backtest/TickFileCache.hpp>
 
+#include <chrono>
 #include <string>
 #include <filesystem>
+#include <future>
 #include <list>
+#include <vector>
 
 namespace apex
 {
 
+class DecodedTickCache;
 class TardisFileReader;
 class MarketData;
 
 enum class TickFormat {
   tickbin1 = 1,
-  tardis
+  tardis,
+  tickbin2
 };
 const char* to_string(TickFormat);
+TickFormat parse_tick_format(const std::string&);
+
+/* Filter applied to ticks as they are read, so that a reader can skip the
+ * records it excludes without decoding them, by their headers or an index.
+ * Windows are times of day, UTC, outside of which no events are replayed; a
+ * window whose end is before its begin spans midnight.  L1 conflation
+ * replays only the last top of book of each interval, which holds the state
+ * at the end of the interval; other streams are not conflated. */
+struct TickFilter {
+  struct Window {
+    std::chrono::microseconds begin{0}; // since midnight
+    std::chrono::microseconds end{0};
+  };
+
+  /* Filter of windows given as "HH:MM[:SS]-HH:MM[:SS]"; throws apex::Error
+   * if one is malformed. */
+  static TickFilter parse(const std::vector<std::string>& windows,
+                          std::chrono::microseconds l1_conflate);
+
+  [[nodiscard]] bool empty() const
+  {
+    return windows.empty() && l1_conflate.count() == 0;
+  }
+
+  [[nodiscard]] bool admits(Time) const;
+
+  /* Earliest time, at or after `t`, within a window. */
+  [[nodiscard]] Time next_admitted(Time t) const;
+
+  /* End of the window holding `t`, or an empty time if there are no
+   * windows. */
+  [[nodiscard]] Time window_end(Time t) const;
+
+  [[nodiscard]] bool same_interval(Time a, Time b) const
+  {
+    return a.as_epoch_us() / l1_conflate == b.as_epoch_us() / l1_conflate;
+  }
+
+  // sorted, disjoint and within a day; none for the whole day
+  std::vector<Window> windows;
+  std::chrono::microseconds l1_conflate{0};
+};
+
 
 class BaseTickFileReader {
 public:
@@ -44,9 +93,57 @@ public:
   [[nodiscard]] virtual bool has_next_event() const = 0;
   [[nodiscard]] virtual apex::Time next_event_time() const = 0;
   virtual void consume_next_event() = 0;
+
+  /* Consume events while `batch` admits them; see
+   * BacktestEventSource::consume_events. */
+  virtual size_t consume_events(BacktestBatch& batch)
+  {
+    size_t count = 0;
+    while (has_next_event() && batch.admit(next_event_time())) {
+      consume_next_event();
+      ++count;
+    }
+    return count;
+  }
+
+  /* Whether the reader applies the TickFilter it was given; the replayer
+   * applies the windows of readers that do not. */
+  [[nodiscard]] virtual bool filters() const { return false; }
+
   virtual ~BaseTickFileReader() = default;
 };
 
+struct TickReplayOptions {
+  // share mapped tick files with other replayers, optional
+  TickFileCache* tick_cache = nullptr;
+
+  // paging hints for mapped tick files
+  MmapOptions mmap;
+
+  // decode Tardis files on a background thread
+  bool tardis_read_ahead = false;
+
+  // open, and wind forward, the next file on a background thread while the
+  // current file is replayed
+  bool prefetch_next_file = false;
+
+  // if set, Tardis files are converted once to tickbin2 and cached here, and
+  // later replays read the cached binary files; incremental books are not
+  // cached
+  std::filesystem::path tardis_cache_dir;
+
+  // full-depth book deltas raise market data events only when they change
+  // this many levels from the touch; see MarketData::set_book_event_depth
+  size_t book_event_depth = 5;
+
+  // if set, compressed tickbin and tickbin2 files are replayed from their
+  // decoded images in this cache, which is shared with other processes
+  DecodedTickCache* decoded_cache = nullptr;
+
+  // events excluded are skipped by the readers, without being decoded
+  TickFilter filter;
+};
+
 /* Find tick-files for according to criteria: exchange, instrument, data-type and
  * stream-type; and that are between the backtest time range. */
 class TickReplayer : public BacktestEventSource
@@ -58,26 +155,40 @@ public:
                MarketData*,
                MdStream stream,
                Time replay_from,
-               std::list<Time> dates);
+               std::list<Time> dates,
+               TickReplayOptions options = {});
 
   ~TickReplayer() override;
 
   Time get_next_event_time() override;
   void consume_next_event() override;
+  size_t consume_events(BacktestBatch&) override;
   void init_backtest_time_range(Time /*start*/, Time /*end*/) override {}
+  const char* event_source_kind() const override { return "ticks"; }
 
   [[nodiscard]] size_t file_count() const { return _filenames.size(); }
 
+  /* Tick files found for the replay period, in replay order. */
+  [[nodiscard]] const std::list<std::filesystem::path>& filenames() const
+  {
+    return _filenames;
+  }
+
 private:
   std::tuple<std::list<std::filesystem::path>,
              std::list<std::filesystem::path>> find_tick_files();
 
   void get_next_file_reader();
 
+  std::unique_ptr<BaseTickFileReader> open_file_reader(
+    const std::filesystem::path&);
+
+  void prefetch_next_file_reader();
+
   void build_tick_file_options();
 
   TickFormat _tick_format;
-  Instrument _instrument;
+  const Instrument& _instrument; // interned
   MarketData* _mktdata;
   MdStream _stream;
   Time _replay_from;
@@ -85,11 +196,16 @@ private:
   std::filesystem::path _base_dir;
   std::list<std::filesystem::path> _filenames;
   std::unique_ptr<BaseTickFileReader> _reader;
+  TickReplayOptions _options;
 
   // settings related to the specific tick-file format
   std::string _tick_subdir;
   std::function<std::unique_ptr<BaseTickFileReader>(std::filesystem::path)>  _tick_reader_factory;
   std::function<std::filesystem::path(Time)> _tick_filename_factory;
+
+  // next file reader, being opened in the background; declared last, so that
+  // it is waited upon before other members are destroyed
+  std::future<std::unique_ptr<BaseTickFileReader>> _prefetched;
 };
 
 } // namespace
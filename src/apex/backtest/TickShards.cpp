@@ -0,0 +1,341 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TickShards.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <queue>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+size_t tick_stream_shard(const std::string& exchange,
+                         const std::string& symbol,
+                         const std::string& channel, size_t count)
+{
+  if (count <= 1)
+    return 0;
+
+  // FNV-1a, rather than std::hash, which may differ between builds
+  uint64_t h = 14695981039346656037ull;
+  for (auto* part : {&exchange, &symbol, &channel}) {
+    for (unsigned char c : *part)
+      h = (h ^ c) * 1099511628211ull;
+    h = (h ^ '/') * 1099511628211ull;
+  }
+  return h % count;
+}
+
+
+namespace
+{
+
+struct Input {
+  std::unique_ptr<MappedFile> file;
+  size_t preamble = 0;
+  const char* head = nullptr;
+
+  // msg_type given to the untyped records of the file, if any
+  uint8_t type = 0;
+
+  // the record at head, or null at the end or at an incomplete record
+  const tickbin::Header* record() const
+  {
+    if (head + sizeof(tickbin::Header) > file->end())
+      return nullptr;
+    auto* rec = reinterpret_cast<const tickbin::Header*>(head);
+    if (rec->size < sizeof(tickbin::Header) || head + rec->size > file->end())
+      return nullptr;
+    return rec;
+  }
+};
+
+
+std::string tickbin_version(const MappedFile& file)
+{
+  if (file.size() < TickbinHeader::header_lead_length)
+    return {};
+  return decode_tickbin_file_header(file.begin()).version;
+}
+
+
+Input open_raw(const fs::path& fn)
+{
+  Input input;
+  input.file = std::make_unique<MappedFile>(fn);
+  if (tickbin_version(*input.file) != "TICK1")
+    THROW("tick file " << fn << " is not a raw tickbin file");
+  auto header = decode_tickbin_file_header(input.file->begin());
+  if (header.length > input.file->size())
+    THROW("tick file is truncated " << fn);
+  input.preamble = header.length;
+  input.head = input.file->begin() + header.length;
+  return input;
+}
+
+
+// whether the records of a raw file run exactly to its end
+bool is_complete(const Input& input)
+{
+  const char* end = input.file->end();
+  const char* head = input.head;
+  while (head + sizeof(tickbin::Header) <= end) {
+    auto* rec = reinterpret_cast<const tickbin::Header*>(head);
+    if (rec->size < sizeof(tickbin::Header) || head + rec->size > end)
+      return false;
+    head += rec->size;
+  }
+  return head == end;
+}
+
+
+bool same_bytes(const fs::path& a, const fs::path& b)
+{
+  if (fs::file_size(a) != fs::file_size(b))
+    return false;
+  MappedFile fa(a);
+  MappedFile fb(b);
+  return fa.size() == 0 || memcmp(fa.begin(), fb.begin(), fa.size()) == 0;
+}
+
+} // namespace
+
+
+namespace
+{
+
+/* Merge the records of `files` into `dest`, after `preamble`. */
+size_t merge_records(std::vector<Input>& files, const char* preamble,
+                     size_t preamble_size, const fs::path& dest,
+                     size_t& duplicates)
+{
+  using Entry = std::pair<uint64_t, size_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  for (size_t i = 0; i < files.size(); ++i)
+    if (auto* rec = files[i].record())
+      queue.push({rec->capture_time, i});
+
+  // written to a temporary file, since dest may be an input
+  auto tmp = dest;
+  tmp += ".merge";
+  if (dest.has_parent_path())
+    fs::create_directories(dest.parent_path());
+  std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+  if (!os)
+    THROW("failed to open tick file " << tmp);
+  os.write(preamble, preamble_size);
+
+  // records written at the current capture time, each with the inputs it
+  // has been matched by
+  struct Written {
+    const tickbin::Header* rec;
+    size_t input;
+    uint64_t matched;
+  };
+  std::vector<Written> written;
+  uint64_t written_time = 0;
+
+  size_t count = 0;
+  while (!queue.empty()) {
+    auto i = queue.top().second;
+    queue.pop();
+
+    auto* rec = files[i].record();
+    if (rec->capture_time != written_time) {
+      written.clear();
+      written_time = rec->capture_time;
+    }
+
+    const uint64_t bit = uint64_t(1) << i;
+    bool duplicate = false;
+    for (auto& item : written)
+      if (item.input != i && !(item.matched & bit) &&
+          item.rec->size == rec->size &&
+          memcmp(item.rec, rec, rec->size) == 0) {
+        item.matched |= bit;
+        duplicate = true;
+        break;
+      }
+    if (duplicate)
+      duplicates++;
+    else {
+      if (rec->msg_type == 0 && files[i].type) {
+        tickbin::Header head = *rec;
+        head.msg_type = files[i].type;
+        os.write(reinterpret_cast<const char*>(&head), sizeof(head));
+        os.write(files[i].head + sizeof(head), rec->size - sizeof(head));
+      }
+      else
+        os.write(files[i].head, rec->size);
+      written.push_back({rec, i, 0});
+      count++;
+    }
+
+    files[i].head += rec->size;
+    if (auto* next = files[i].record())
+      queue.push({next->capture_time, i});
+  }
+
+  os.close();
+  if (os.fail())
+    THROW("failed to write tick file " << tmp);
+  files.clear();
+  fs::rename(tmp, dest);
+  return count;
+}
+
+
+std::vector<Input> open_inputs(const std::vector<fs::path>& inputs)
+{
+  if (inputs.empty() || inputs.size() > 64)
+    THROW("can merge from 1 to 64 tick files, not " << inputs.size());
+
+  std::vector<Input> files;
+  for (auto& fn : inputs)
+    files.push_back(open_raw(fn));
+  return files;
+}
+
+} // namespace
+
+
+size_t merge_tickbin_files(const std::vector<fs::path>& inputs,
+                           const fs::path& dest, size_t& duplicates)
+{
+  auto files = open_inputs(inputs);
+  std::vector<char> preamble(files[0].file->begin(),
+                             files[0].file->begin() + files[0].preamble);
+  return merge_records(files, preamble.data(), preamble.size(), dest,
+                       duplicates);
+}
+
+
+size_t interleave_tickbin_streams(const std::vector<fs::path>& inputs,
+                                  const fs::path& dest)
+{
+  auto files = open_inputs(inputs);
+
+  // records of files written before mixed files have no type, which is
+  // then that of the file's channel
+  json meta;
+  for (auto& input : files) {
+    const char* begin = input.file->begin();
+    auto input_meta = json::parse(begin + TickbinHeader::header_lead_length,
+                                  begin + input.preamble);
+    auto channel = input_meta.value("c", std::string{});
+    if (channel == "l1")
+      input.type = static_cast<uint8_t>(tickbin::MsgType::TickLevel1);
+    else if (channel == "aggtrades")
+      input.type = static_cast<uint8_t>(tickbin::MsgType::TickAggTrade);
+    if (meta.is_null())
+      meta = std::move(input_meta);
+  }
+  meta["c"] = tickbin_mixed_channel;
+  auto preamble = encode_tickbin_file_header("TICK1", meta);
+
+  size_t duplicates = 0;
+  return merge_records(files, preamble.data(), preamble.size(), dest,
+                       duplicates);
+}
+
+
+TickMergeStats merge_tick_trees(const std::vector<fs::path>& roots,
+                                const fs::path& dest, bool verify_only)
+{
+  // each tick file, by its path within the trees, and the trees holding it;
+  // indexes are rebuilt or copied along with their files
+  std::map<fs::path, std::vector<fs::path>> files;
+  auto collect = [&files](const fs::path& root) {
+    if (!fs::is_directory(root))
+      return;
+    for (auto& entry : fs::recursive_directory_iterator(root)) {
+      auto& path = entry.path();
+      if (!entry.is_regular_file() || path.extension() == ".idx" ||
+          path.extension() == ".merge")
+        continue;
+      files[fs::relative(path, root)].push_back(path);
+    }
+  };
+  for (auto& root : roots) {
+    if (!fs::is_directory(root))
+      THROW("tick file tree not found: " << root);
+    collect(root);
+  }
+  collect(dest);
+
+  TickMergeStats stats;
+  for (auto& [rel, paths] : files) {
+    const auto target = dest / rel;
+    try {
+      bool raw = true;
+      for (auto& path : paths) {
+        MappedFile file(path);
+        if (tickbin_version(file) != "TICK1")
+          raw = false;
+        else if (!is_complete(open_raw(path)))
+          stats.errors.push_back("incomplete record in " + path.string());
+      }
+
+      bool identical = true;
+      for (size_t i = 1; i < paths.size() && identical; i++)
+        identical = same_bytes(paths[0], paths[i]);
+
+      if (paths.size() == 1 || identical) {
+        if (std::find(paths.begin(), paths.end(), target) != paths.end())
+          continue;
+        stats.files_copied++;
+        if (verify_only)
+          continue;
+        fs::create_directories(target.parent_path());
+        fs::copy_file(paths[0], target, fs::copy_options::overwrite_existing);
+        auto index = tickbin_index_path(paths[0]);
+        if (fs::exists(index))
+          fs::copy_file(index, tickbin_index_path(target),
+                        fs::copy_options::overwrite_existing);
+        continue;
+      }
+
+      if (!raw) {
+        stats.errors.push_back("cannot merge differing files of a format "
+                               "other than raw: " + rel.string());
+        continue;
+      }
+
+      stats.files_merged++;
+      if (verify_only)
+        continue;
+      stats.records += merge_tickbin_files(paths, target, stats.duplicates);
+      build_tickbin_index(target);
+    } catch (std::exception& e) {
+      stats.errors.push_back(rel.string() + ": " + e.what());
+    }
+  }
+  return stats;
+}
+
+} // namespace apex
@@ -0,0 +1,79 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* Sharded tick collection.  The streams of a tick collector can be split
+ * over several collector processes, each with its own exchange sessions, so
+ * that no one session falls behind a large universe.  Shards normally write
+ * disjoint sets of tick files; they may also overlap, for redundancy.  Each
+ * writes a tree in the usual per-day layout, which merge_tick_trees combines
+ * into the tree read by TickReplayer. */
+
+/* Shard, of `count`, that collects a stream; a hash of the stream's
+ * exchange, symbol and channel, so stable across hosts and restarts. */
+size_t tick_stream_shard(const std::string& exchange,
+                         const std::string& symbol,
+                         const std::string& channel, size_t count);
+
+
+/* Merge raw (TICK1) tick files of one stream and day into `dest`, in capture
+ * time order, with the preamble of the first.  A record held by several
+ * inputs, the same bytes at the same capture time, is written once, and
+ * counted in `duplicates`; `dest` may be one of the inputs.  Returns the
+ * number of records written. */
+size_t merge_tickbin_files(const std::vector<std::filesystem::path>& inputs,
+                           const std::filesystem::path& dest,
+                           size_t& duplicates);
+
+
+/* Interleave raw (TICK1) tick files of different streams of one instrument
+ * and day, such as its L1 and trades, into the mixed tick file `dest`, in
+ * capture time order; the meta-data is that of the first, with the mixed
+ * channel.  Records are merged as by merge_tickbin_files.  Returns the
+ * number of records written. */
+size_t interleave_tickbin_streams(const std::vector<std::filesystem::path>& inputs,
+                                  const std::filesystem::path& dest);
+
+
+struct TickMergeStats {
+  size_t files_copied = 0; // held by one tree only
+  size_t files_merged = 0; // held by several trees
+  size_t records = 0;      // written by merges
+  size_t duplicates = 0;   // dropped by merges, as held by several trees
+  std::vector<std::string> errors;
+};
+
+/* Combine the tick file trees of shards into the tree at `dest`; a file
+ * already in `dest` is merged as if of another shard.  A file of one tree is
+ * copied, with its index.  Raw files of several trees are merged, and
+ * indexed; other formats can only be combined if identical, otherwise they
+ * are reported as errors, as are raw files with an incomplete record.  With
+ * `verify_only` nothing is written, and the stats tell what a merge would
+ * do, less the counts of records. */
+TickMergeStats merge_tick_trees(const std::vector<std::filesystem::path>& roots,
+                                const std::filesystem::path& dest,
+                                bool verify_only);
+
+} // namespace apex
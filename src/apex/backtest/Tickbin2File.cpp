@@ -0,0 +1,704 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/Tickbin2File.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Error.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+static tickbin2::Layout to_layout(MdStream stream_type)
+{
+  switch (stream_type) {
+    case MdStream::L1:
+      return tickbin2::Layout::L1;
+    case MdStream::AggTrades:
+      return tickbin2::Layout::AggTrades;
+    default:
+      THROW("tickbin2 doesn't support stream type " << stream_type);
+  }
+}
+
+
+const char* tickbin2::to_string(tickbin2::Layout layout)
+{
+  switch (layout) {
+    case tickbin2::Layout::L1:
+      return "l1";
+    case tickbin2::Layout::AggTrades:
+      return "aggtrades";
+    case tickbin2::Layout::Book5:
+      return "book5";
+    case tickbin2::Layout::Book25:
+      return "book25";
+  }
+  return "";
+}
+
+
+static tickbin2::Layout parse_layout(const std::string& name,
+                                     const fs::path& fn)
+{
+  for (auto layout : {tickbin2::Layout::L1, tickbin2::Layout::AggTrades,
+                      tickbin2::Layout::Book5, tickbin2::Layout::Book25})
+    if (name == tickbin2::to_string(layout))
+      return layout;
+  THROW("tickbin2 file " << fn << " has unknown layout " << QUOTE(name));
+}
+
+
+// An L1 stream can be replayed from the top level of a book, and a trades
+// stream from aggregated trades.
+static bool layout_suits_stream(tickbin2::Layout layout, MdStream stream_type)
+{
+  const bool is_book = layout == tickbin2::Layout::Book5 ||
+                       layout == tickbin2::Layout::Book25;
+  switch (stream_type) {
+    case MdStream::L1:
+      return layout == tickbin2::Layout::L1 || is_book;
+    case MdStream::L2:
+      return is_book;
+    case MdStream::Trades:
+    case MdStream::AggTrades:
+      return layout == tickbin2::Layout::AggTrades;
+    default:
+      return false;
+  }
+}
+
+
+// Number of double columns in a block, excluding the time column.
+static size_t double_columns(tickbin2::Layout layout)
+{
+  switch (layout) {
+    case tickbin2::Layout::L1:
+      return 4;
+    case tickbin2::Layout::AggTrades:
+      return 2;
+    case tickbin2::Layout::Book5:
+      return 4 * TickBookSnapshot5::N;
+    case tickbin2::Layout::Book25:
+      return 0;
+  }
+  return 0;
+}
+
+
+// Uncompressed block size for the given number of records; for Book25, the
+// size before the changed levels, of which there are `levels`.
+static size_t raw_block_size(tickbin2::Layout layout, size_t records,
+                             size_t levels = 0)
+{
+  size_t size = records * sizeof(int64_t) * (1 + double_columns(layout));
+  if (layout == tickbin2::Layout::AggTrades)
+    size += records * (sizeof(int64_t) + sizeof(char));
+  if (layout == tickbin2::Layout::Book25)
+    size += records * sizeof(uint64_t) + levels * 4 * sizeof(double);
+  return size;
+}
+
+
+static size_t count_levels(uint64_t mask)
+{
+  return __builtin_popcountll(mask);
+}
+
+
+template<typename T>
+static void append_column(std::vector<char>& dest, const std::vector<T>& col)
+{
+  auto ptr = reinterpret_cast<const char*>(col.data());
+  dest.insert(std::end(dest), ptr, ptr + col.size() * sizeof(T));
+}
+
+
+Tickbin2FileWriter::Tickbin2FileWriter(std::filesystem::path fn,
+                                       MdStream stream_type,
+                                       json meta)
+  : Tickbin2FileWriter(std::move(fn), stream_type, std::move(meta), Options{})
+{
+}
+
+
+Tickbin2FileWriter::Tickbin2FileWriter(std::filesystem::path fn,
+                                       MdStream stream_type,
+                                       json meta,
+                                       Options options)
+  : Tickbin2FileWriter(std::move(fn), to_layout(stream_type), std::move(meta),
+                       options)
+{
+}
+
+
+Tickbin2FileWriter::Tickbin2FileWriter(std::filesystem::path fn,
+                                       tickbin2::Layout layout,
+                                       json meta,
+                                       Options options)
+  : _fn(std::move(fn)),
+    _layout(layout),
+    _options(options),
+    _cols(double_columns(layout))
+{
+  if (_options.block_records == 0)
+    THROW("tickbin2 block size cannot be zero");
+
+  auto dir = _fn.parent_path();
+  if (!dir.empty()) {
+    std::error_code err;
+    fs::create_directories(dir, err);
+    if (err) {
+      LOG_WARN("failed to create tickdata directory " << dir << ", error " << err);
+      throw std::system_error(err, "cannot create tickdata directory");
+    }
+  }
+
+  meta["layout"] = tickbin2::to_string(_layout);
+  meta["br"] = _options.block_records;
+  auto preamble = encode_tickbin_file_header(tickbin2::version, meta);
+
+  LOG_INFO("creating tickbin2 file: " << _fn);
+  _file.open(_fn, std::ios::binary | std::ios::trunc);
+  if (!_file)
+    THROW("failed to open tickbin2 file " << _fn);
+  _file.write(preamble.data(), preamble.size());
+  _offset = preamble.size();
+}
+
+
+Tickbin2FileWriter::~Tickbin2FileWriter()
+{
+  try {
+    close();
+  }
+  catch (const std::exception& e) {
+    LOG_ERROR("failed to close tickbin2 file " << _fn << ": " << e.what());
+  }
+}
+
+
+void Tickbin2FileWriter::prepare_record(Time capture_time)
+{
+  if (_closed)
+    THROW("tickbin2 file already closed " << _fn);
+
+  auto t = static_cast<uint64_t>(capture_time.as_epoch_us().count());
+
+  // a capture time earlier than the last written is clamped to it: the
+  // reader's wind-forward searches the block index by time, so record times,
+  // and hence block first-times, must never decrease
+  if (t < _last_time) {
+    if (_clamped_count++ == 0)
+      LOG_WARN("tickbin2 capture time went backwards, from " << _last_time
+               << " to " << t << " us, clamped; file " << _fn);
+    t = _last_time;
+  }
+  _last_time = t;
+
+  // start a new block when the current is full, or the record falls outside
+  // the block time span
+  if (!_times.empty()) {
+    auto span = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            _options.block_span).count());
+    if (_times.size() >= _options.block_records ||
+        t - _times.front() >= span)
+      flush_block();
+  }
+
+  _times.push_back(t);
+  _record_count++;
+}
+
+
+void Tickbin2FileWriter::write(Time capture_time, const TickTop& tick)
+{
+  if (_layout != tickbin2::Layout::L1)
+    THROW("cannot write L1 tick to tickbin2 file of layout " << tickbin2::to_string(_layout));
+
+  prepare_record(capture_time);
+  _cols[0].push_back(tick.ask_price);
+  _cols[1].push_back(tick.ask_qty);
+  _cols[2].push_back(tick.bid_price);
+  _cols[3].push_back(tick.bid_qty);
+}
+
+
+void Tickbin2FileWriter::write(Time capture_time, const TickTrade& tick)
+{
+  if (_layout != tickbin2::Layout::AggTrades)
+    THROW("cannot write trade tick to tickbin2 file of layout " << tickbin2::to_string(_layout));
+
+  prepare_record(capture_time);
+  _cols[0].push_back(tick.price);
+  _cols[1].push_back(tick.qty);
+  _et_offsets.push_back(tick.et.as_epoch_us().count() -
+                        static_cast<int64_t>(_times.back()));
+  _sides.push_back(tickbin::Serialiser::encode_side(tick.aggr_side));
+}
+
+
+void Tickbin2FileWriter::write(Time capture_time, const TickBookSnapshot5& tick)
+{
+  if (_layout != tickbin2::Layout::Book5)
+    THROW("cannot write book tick to tickbin2 file of layout " << tickbin2::to_string(_layout));
+
+  // levels are stored in the same column order as L1, level by level; the
+  // exchange times are not kept, and are taken from the capture time on replay
+  prepare_record(capture_time);
+  for (size_t i = 0; i < tick.levels.size(); ++i) {
+    auto& level = tick.levels[i];
+    _cols[4 * i + 0].push_back(level.ask_price);
+    _cols[4 * i + 1].push_back(level.ask_qty);
+    _cols[4 * i + 2].push_back(level.bid_price);
+    _cols[4 * i + 3].push_back(level.bid_qty);
+  }
+}
+
+
+void Tickbin2FileWriter::write(Time capture_time, const TickBookSnapshot25& tick)
+{
+  if (_layout != tickbin2::Layout::Book25)
+    THROW("cannot write book tick to tickbin2 file of layout " << tickbin2::to_string(_layout));
+
+  // only the levels differing from the previous record are kept, compared
+  // bitwise so that absent levels, of NaN prices, compare equal; the mask of
+  // the tick itself is not relied upon
+  prepare_record(capture_time);
+  const bool first = _times.size() == 1;
+  uint64_t mask = 0;
+  for (size_t i = 0; i < tick.levels.size(); ++i) {
+    auto& level = tick.levels[i];
+    if (first || memcmp(&level, &_prev_book.levels[i], sizeof(level)) != 0) {
+      mask |= uint64_t{1} << i;
+      _levels.push_back(level.ask_price);
+      _levels.push_back(level.ask_qty);
+      _levels.push_back(level.bid_price);
+      _levels.push_back(level.bid_qty);
+    }
+  }
+  _masks.push_back(mask);
+  _prev_book = tick;
+}
+
+
+void Tickbin2FileWriter::flush_block()
+{
+  const size_t records = _times.size();
+  if (records == 0)
+    return;
+
+  // build the columnar image: time deltas first, then each field column
+  _raw.clear();
+  _raw.reserve(raw_block_size(_layout, records));
+
+  std::vector<int64_t> deltas(records);
+  uint64_t prev = _times.front();
+  for (size_t i = 0; i < records; ++i) {
+    deltas[i] = static_cast<int64_t>(_times[i] - prev);
+    prev = _times[i];
+  }
+  append_column(_raw, deltas);
+  for (auto& col : _cols)
+    append_column(_raw, col);
+  if (_layout == tickbin2::Layout::AggTrades) {
+    append_column(_raw, _et_offsets);
+    append_column(_raw, _sides);
+  }
+  if (_layout == tickbin2::Layout::Book25) {
+    append_column(_raw, _masks);
+    append_column(_raw, _levels);
+  }
+  assert(_raw.size() == raw_block_size(_layout, records, _levels.size() / 4));
+
+  uLongf compressed_len = compressBound(_raw.size());
+  _compressed.resize(compressed_len);
+  int rc = compress2(reinterpret_cast<Bytef*>(_compressed.data()),
+                     &compressed_len,
+                     reinterpret_cast<const Bytef*>(_raw.data()),
+                     _raw.size(),
+                     _options.compression_level);
+  if (rc != Z_OK)
+    THROW("tickbin2 block compression failed, zlib error " << rc);
+
+  tickbin2::BlockHeader header{};
+  header.magic = tickbin2::block_magic;
+  header.records = records;
+  header.raw_size = _raw.size();
+  header.compressed_size = compressed_len;
+  header.first_time = _times.front();
+  header.last_time = _times.back();
+
+  _index.push_back({header.first_time, _offset});
+  _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  _file.write(_compressed.data(), compressed_len);
+  _offset += sizeof(header) + compressed_len;
+
+  _times.clear();
+  for (auto& col : _cols)
+    col.clear();
+  _et_offsets.clear();
+  _sides.clear();
+  _masks.clear();
+  _levels.clear();
+}
+
+
+void Tickbin2FileWriter::close()
+{
+  if (_closed)
+    return;
+  _closed = true;
+
+  flush_block();
+
+  tickbin2::Footer footer{};
+  footer.index_offset = _offset;
+  footer.block_count = _index.size();
+  footer.magic = tickbin2::footer_magic;
+
+  _file.write(reinterpret_cast<const char*>(_index.data()),
+              _index.size() * sizeof(tickbin2::IndexEntry));
+  _file.write(reinterpret_cast<const char*>(&footer), sizeof(footer));
+  _file.close();
+  if (_file.fail())
+    THROW("failed to write tickbin2 file " << _fn);
+}
+
+
+Tickbin2FileReader::Tickbin2FileReader(std::filesystem::path fn,
+                                       MarketData* mktdata,
+                                       MdStream stream_type,
+                                       TickFileCache* cache,
+                                       const MmapOptions& mmap_options)
+  : _fn(std::move(fn)),
+    _mktdata(mktdata)
+{
+  if (!fs::exists(_fn) || !fs::is_regular_file(_fn)) {
+    THROW("tickbin2 file not found " << _fn);
+  }
+  LOG_INFO("reading tickbin2 file " << _fn);
+
+  if (cache)
+    _file = cache->open(_fn, mmap_options);
+  else
+    _file = std::make_shared<const MappedFile>(_fn, mmap_options);
+  _window = MappedFileWindow(_file.get(), mmap_options.window,
+                             mmap_options.release && !cache);
+
+  const char* begin = _file->begin();
+  const size_t size = _file->size();
+
+  // preamble
+  if (size < TickbinHeader::header_lead_length)
+    THROW("tickbin2 file has incomplete file header " << _fn);
+  auto header = decode_tickbin_file_header(begin);
+  if (header.version != tickbin2::version)
+    THROW("file " << _fn << " has tickbin version " << QUOTE(header.version)
+          << ", expected " << QUOTE(tickbin2::version));
+  if (header.length + sizeof(tickbin2::Footer) > size)
+    THROW("tickbin2 file is truncated " << _fn);
+
+  _meta = json::parse(begin + TickbinHeader::header_lead_length,
+                      begin + header.length);
+  _layout = parse_layout(get_string_field(_meta, "layout"), _fn);
+  if (!layout_suits_stream(_layout, stream_type))
+    THROW("tickbin2 file " << _fn << " has layout "
+          << QUOTE(tickbin2::to_string(_layout)) << ", cannot replay as stream "
+          << stream_type);
+
+  // footer & block index
+  tickbin2::Footer footer;
+  memcpy(&footer, begin + size - sizeof(footer), sizeof(footer));
+  if (footer.magic != tickbin2::footer_magic)
+    THROW("tickbin2 file has no block index, possibly incomplete " << _fn);
+
+  const size_t index_len = footer.block_count * sizeof(tickbin2::IndexEntry);
+  if (footer.index_offset < header.length ||
+      footer.index_offset + index_len + sizeof(footer) != size)
+    THROW("tickbin2 file has corrupt block index " << _fn);
+
+  _index.resize(footer.block_count);
+  memcpy(_index.data(), begin + footer.index_offset, index_len);
+
+  load_block(0);
+}
+
+
+Tickbin2FileReader::~Tickbin2FileReader() = default;
+
+
+bool Tickbin2FileReader::load_block(size_t i)
+{
+  _block = i;
+  _records = 0;
+  _pos = 0;
+  if (i >= _index.size())
+    return false;
+
+  const char* begin = _file->begin();
+  const size_t offset = _index[i].offset;
+  _window.advance(offset);
+
+  tickbin2::BlockHeader header;
+  if (offset + sizeof(header) > _file->size())
+    THROW("tickbin2 block " << i << " out of range, file " << _fn);
+  memcpy(&header, begin + offset, sizeof(header));
+
+  // the size of a Book25 block depends on its level masks, checked below
+  const size_t levels_size =
+      header.raw_size - std::min<size_t>(header.raw_size,
+                                         raw_block_size(_layout, header.records));
+  if (header.magic != tickbin2::block_magic ||
+      offset + sizeof(header) + header.compressed_size > _file->size() ||
+      header.raw_size != raw_block_size(_layout, header.records,
+                                        levels_size / (4 * sizeof(double))))
+    THROW("tickbin2 block " << i << " is corrupt, file " << _fn);
+
+  _raw.resize(header.raw_size);
+  uLongf raw_len = header.raw_size;
+  int rc = uncompress(reinterpret_cast<Bytef*>(_raw.data()), &raw_len,
+                      reinterpret_cast<const Bytef*>(begin + offset + sizeof(header)),
+                      header.compressed_size);
+  if (rc != Z_OK || raw_len != header.raw_size)
+    THROW("tickbin2 block " << i << " decompression failed, zlib error " << rc
+          << ", file " << _fn);
+
+  // rebuild the absolute capture times from the deltas
+  _times.resize(header.records);
+  uint64_t t = header.first_time;
+  for (size_t r = 0; r < header.records; ++r) {
+    t += column<int64_t>(0, r);
+    _times[r] = t;
+  }
+
+  if (_layout == tickbin2::Layout::Book25) {
+    size_t levels = 0;
+    for (size_t r = 0; r < header.records; ++r)
+      levels += count_levels(column<uint64_t>(1, r));
+    if (levels * 4 * sizeof(double) != levels_size ||
+        (header.records && count_levels(column<uint64_t>(1, 0)) !=
+                               TickBookSnapshot25::N))
+      THROW("tickbin2 block " << i << " has inconsistent levels, file " << _fn);
+    _level_offset = 2 * header.records * sizeof(uint64_t);
+  }
+
+  _records = header.records;
+  return _records > 0;
+}
+
+
+void Tickbin2FileReader::decode_book25()
+{
+  auto mask = column<uint64_t>(1, _pos);
+  for (size_t i = 0; i < _book.levels.size(); ++i) {
+    if (!(mask & (uint64_t{1} << i)))
+      continue;
+    double values[4];
+    memcpy(values, _raw.data() + _level_offset, sizeof(values));
+    _level_offset += sizeof(values);
+    auto& level = _book.levels[i];
+    level.ask_price = values[0];
+    level.ask_qty = values[1];
+    level.bid_price = values[2];
+    level.bid_qty = values[3];
+  }
+  _book.changed = static_cast<uint32_t>(mask);
+}
+
+
+template<typename T>
+T Tickbin2FileReader::column(size_t col, size_t i) const
+{
+  // columns are laid out back to back, each of _records entries; the time
+  // column and all double columns are 8 bytes wide
+  T value;
+  const size_t records = _times.size();
+  memcpy(&value, _raw.data() + col * records * 8 + i * sizeof(T), sizeof(T));
+  return value;
+}
+
+
+void Tickbin2FileReader::wind_forward(apex::Time t)
+{
+  auto target = static_cast<uint64_t>(t.as_epoch_us().count());
+
+  // find the last block starting at or before the target, and jump to it
+  auto iter = std::upper_bound(
+      std::begin(_index), std::end(_index), target,
+      [](uint64_t value, const tickbin2::IndexEntry& entry) {
+        return value < entry.first_time;
+      });
+  if (iter != std::begin(_index)) {
+    size_t block = std::distance(std::begin(_index), iter) - 1;
+    if (block > _block) {
+      load_block(block);
+      _book_skipped = true;
+    }
+  }
+
+  // then skip to the first event within the block; the levels of a Book25
+  // record are decoded, as the next record holds only its changes
+  size_t consumed = 0;
+  while (has_next_event() && _times[_pos] < target) {
+    if (_layout == tickbin2::Layout::Book25) {
+      decode_book25();
+      _book_skipped = true;
+    }
+    if (++_pos == _records)
+      load_block(_block + 1);
+    consumed++;
+  }
+
+  LOG_DEBUG("tickbin2 wind-forward to block " << _block << ", events skipped: "
+            << consumed << ", seeking time: " << t);
+}
+
+
+bool Tickbin2FileReader::has_next_event() const
+{
+  return _pos < _records;
+}
+
+
+apex::Time Tickbin2FileReader::next_event_time() const
+{
+  if (!has_next_event())
+    return Time{};
+  return Time{std::chrono::microseconds(_times[_pos])};
+}
+
+
+void Tickbin2FileReader::consume_next_event()
+{
+  if (!has_next_event())
+    return;
+
+  if (_layout == tickbin2::Layout::Book25) {
+    decode_book25();
+    if (_mktdata) {
+      _book.xt = _book.et = next_event_time();
+      if (std::exchange(_book_skipped, false))
+        _book.changed = TickBookSnapshot25::all_levels;
+      _mktdata->apply(_book);
+    }
+    else
+      _book_skipped = true;
+  }
+  else if (_mktdata) {
+    if (_layout == tickbin2::Layout::L1) {
+      TickTop tick;
+      tick.ask_price = column<double>(1, _pos);
+      tick.ask_qty = column<double>(2, _pos);
+      tick.bid_price = column<double>(3, _pos);
+      tick.bid_qty = column<double>(4, _pos);
+      _mktdata->apply(tick);
+    }
+    else if (_layout == tickbin2::Layout::Book5) {
+      TickBookSnapshot5 tick;
+      tick.xt = tick.et = next_event_time();
+      for (size_t i = 0; i < tick.levels.size(); ++i) {
+        auto& level = tick.levels[i];
+        level.ask_price = column<double>(1 + 4 * i, _pos);
+        level.ask_qty = column<double>(2 + 4 * i, _pos);
+        level.bid_price = column<double>(3 + 4 * i, _pos);
+        level.bid_qty = column<double>(4 + 4 * i, _pos);
+      }
+      _mktdata->apply(tick);
+    }
+    else {
+      const size_t records = _times.size();
+      TickTrade tick;
+      tick.price = column<double>(1, _pos);
+      tick.qty = column<double>(2, _pos);
+      tick.et = Time{std::chrono::microseconds(_times[_pos] +
+                                               column<int64_t>(3, _pos))};
+      tick.aggr_side = tickbin::Serialiser::decode_side(
+          _raw[4 * records * 8 + _pos]);
+      _mktdata->apply(tick);
+    }
+  }
+
+  if (++_pos == _records)
+    load_block(_block + 1);
+}
+
+
+size_t convert_tickbin1_to_tickbin2(const std::filesystem::path& src,
+                                    const std::filesystem::path& dest,
+                                    Tickbin2FileWriter::Options options)
+{
+  MappedFile file(src);
+  if (file.size() < TickbinHeader::header_lead_length)
+    THROW("tickbin file has incomplete file header " << src);
+
+  auto header = decode_tickbin_file_header(file.begin());
+  if (header.length > file.size())
+    THROW("tickbin file is truncated " << src);
+
+  auto meta = json::parse(file.begin() + TickbinHeader::header_lead_length,
+                          file.begin() + header.length);
+
+  auto channel = get_string_field(meta, "c");
+  MdStream stream_type;
+  if (channel == "l1")
+    stream_type = MdStream::L1;
+  else if (channel == "aggtrades")
+    stream_type = MdStream::AggTrades;
+  else
+    THROW("cannot convert tickbin file " << src << " of channel " << QUOTE(channel));
+
+  Tickbin2FileWriter writer(dest, stream_type, meta, options);
+
+  const char* ptr = file.begin() + header.length;
+  const char* const end = file.end();
+  while (ptr + sizeof(tickbin::Header) <= end) {
+    tickbin::Header head;
+    memcpy(&head, ptr, sizeof(head));
+    if (head.size < sizeof(tickbin::Header) || ptr + head.size > end)
+      break;
+
+    Time capture_time{std::chrono::microseconds(head.capture_time)};
+    if (stream_type == MdStream::L1) {
+      TickTop tick;
+      tickbin::Serialiser::deserialise(ptr, tick);
+      writer.write(capture_time, tick);
+    }
+    else {
+      TickTrade tick;
+      tickbin::Serialiser::deserialise(ptr, tick);
+      writer.write(capture_time, tick);
+    }
+    ptr += head.size;
+  }
+
+  writer.close();
+  return writer.record_count();
+}
+
+} // namespace apex
@@ -0,0 +1,237 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/Time.hpp>
+#include <apex/util/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <vector>
+
+namespace apex
+{
+
+class MarketData;
+
+/* Tickbin version 2 is a columnar, block compressed format.  After the usual
+ * tickbin preamble, the file holds a sequence of blocks, each covering a
+ * bounded number of records and a bounded time span.  Within a block, capture
+ * times are delta encoded and each tick field is stored as a separate column,
+ * and the block is then zlib compressed.  The file ends with an index of block
+ * start times and offsets, allowing readers to seek directly to the block
+ * containing a given time.
+ *
+ * Book25 blocks are not of fixed columns: after the times, a column holds for
+ * each record a mask of the levels that differ from the previous record, and
+ * then follow just those levels, as four doubles each.  The first record of a
+ * block has every level, so blocks decode independently. */
+namespace tickbin2 {
+
+constexpr const char* version = "TICK2";
+
+constexpr uint32_t block_magic = 0x4b4c4254;  // "TBLK"
+constexpr uint32_t footer_magic = 0x58444954; // "TIDX"
+
+enum class Layout : int {
+  L1 = 1,
+  AggTrades = 2,
+  Book5 = 3, // five levels of depth, replayed as TickBookSnapshot5
+  Book25 = 4, // 25 levels, replayed as TickBookSnapshot25
+};
+
+const char* to_string(Layout);
+
+#pragma pack(push, 1)
+
+struct BlockHeader {
+  uint32_t magic;
+  uint32_t records;
+  uint32_t raw_size;
+  uint32_t compressed_size;
+  uint64_t first_time; // usec since epoch
+  uint64_t last_time;  // usec since epoch
+};
+
+struct IndexEntry {
+  uint64_t first_time; // usec since epoch
+  uint64_t offset;     // file offset of block header
+};
+
+struct Footer {
+  uint64_t index_offset;
+  uint32_t block_count;
+  uint32_t magic;
+};
+
+#pragma pack(pop)
+
+} // namespace tickbin2
+
+
+class Tickbin2FileWriter
+{
+public:
+  struct Options {
+    // a block is closed once it has this many records ...
+    size_t block_records = 4096;
+
+    // ... or once a record falls outside the time span of the block
+    std::chrono::seconds block_span{60};
+
+    // zlib compression level; low levels favour speed
+    int compression_level = 1;
+  };
+
+  // The meta-data is typically built via tickbin_stream_meta().
+  Tickbin2FileWriter(std::filesystem::path fn,
+                     MdStream stream_type,
+                     json meta);
+
+  Tickbin2FileWriter(std::filesystem::path fn,
+                     MdStream stream_type,
+                     json meta,
+                     Options options);
+
+  Tickbin2FileWriter(std::filesystem::path fn,
+                     tickbin2::Layout layout,
+                     json meta,
+                     Options options);
+
+  ~Tickbin2FileWriter();
+
+  Tickbin2FileWriter(const Tickbin2FileWriter&) = delete;
+  Tickbin2FileWriter& operator=(const Tickbin2FileWriter&) = delete;
+
+  void write(Time capture_time, const TickTop&);
+  void write(Time capture_time, const TickTrade&);
+  void write(Time capture_time, const TickBookSnapshot5&);
+  void write(Time capture_time, const TickBookSnapshot25&);
+
+  /* Write any pending block and the block index; no further writes allowed. */
+  void close();
+
+  [[nodiscard]] size_t record_count() const { return _record_count; }
+  [[nodiscard]] size_t block_count() const { return _index.size(); }
+
+  /* Records whose capture time was earlier than the previous record's, and
+   * which were written at the previous time instead. */
+  [[nodiscard]] size_t clamped_count() const { return _clamped_count; }
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _fn; }
+
+private:
+  void prepare_record(Time capture_time);
+  void flush_block();
+
+  std::filesystem::path _fn;
+  tickbin2::Layout _layout;
+  Options _options;
+  std::ofstream _file;
+  uint64_t _offset = 0;
+  size_t _record_count = 0;
+  size_t _clamped_count = 0;
+  uint64_t _last_time = 0;
+  bool _closed = false;
+
+  // columns of the block under construction
+  std::vector<uint64_t> _times;
+  std::vector<std::vector<double>> _cols;
+  std::vector<int64_t> _et_offsets;
+  std::vector<char> _sides;
+
+  // Book25 only: per record level masks, the changed levels, and the record
+  // they are relative to
+  std::vector<uint64_t> _masks;
+  std::vector<double> _levels;
+  TickBookSnapshot25 _prev_book;
+
+  std::vector<tickbin2::IndexEntry> _index;
+  std::vector<char> _raw;
+  std::vector<char> _compressed;
+};
+
+
+/* The file layout must suit the requested stream; an L1 stream can replay
+ * an L1 or a book file, and an L2 stream a book file.  Paging follows
+ * TickbinFileReader. */
+class Tickbin2FileReader : public BaseTickFileReader
+{
+public:
+  Tickbin2FileReader(std::filesystem::path fn,
+                     MarketData*,
+                     MdStream stream_type,
+                     TickFileCache* cache = nullptr,
+                     const MmapOptions& mmap_options = {});
+  ~Tickbin2FileReader() override;
+
+  void wind_forward(apex::Time t) override;
+
+  [[nodiscard]] bool has_next_event() const override;
+
+  [[nodiscard]] apex::Time next_event_time() const override;
+
+  void consume_next_event() override;
+
+  [[nodiscard]] const json& meta() const { return _meta; }
+  [[nodiscard]] tickbin2::Layout layout() const { return _layout; }
+  [[nodiscard]] size_t block_count() const { return _index.size(); }
+
+private:
+  bool load_block(size_t i);
+  template<typename T> T column(size_t col_offset, size_t i) const;
+  void decode_book25();
+
+  std::filesystem::path _fn;
+  MarketData* _mktdata;
+  tickbin2::Layout _layout;
+  std::shared_ptr<const MappedFile> _file;
+  MappedFileWindow _window;
+  json _meta;
+  std::vector<tickbin2::IndexEntry> _index;
+
+  // current decompressed block
+  size_t _block = 0;
+  size_t _records = 0;
+  size_t _pos = 0;
+  std::vector<uint64_t> _times;
+  std::vector<char> _raw;
+
+  // Book25 only: the book as of the last record decoded, the offset of the
+  // next record's levels, and whether the levels were decoded without being
+  // applied, so the next snapshot applied must have every level
+  TickBookSnapshot25 _book;
+  size_t _level_offset = 0;
+  bool _book_skipped = false;
+};
+
+
+/* Convert a tickbin version 1 file to version 2, returning the number of
+ * records converted. */
+size_t convert_tickbin1_to_tickbin2(const std::filesystem::path& src,
+                                    const std::filesystem::path& dest,
+                                    Tickbin2FileWriter::Options = {});
+
+} // namespace apex
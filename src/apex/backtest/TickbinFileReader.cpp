@@ -16,22 +16,22 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickFileCache.hpp>
 #include <apex/backtest/TickbinMsgs.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/tick_msgs.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/util/Error.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <utility>
 #include <fstream>
-
-#include <unistd.h>
-#include <cerrno>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/mman.h>
-
 #include <iostream>
 
+#include <zlib.h>
+
 namespace apex
 {
 
@@ -51,10 +51,133 @@ TickbinHeader decode_tickbin_file_header(const char* ptr)
 }
 
 
+std::vector<char> encode_tickbin_file_header(const std::string& version,
+                                             const json& meta)
+{
+  auto meta_str = to_string(meta);
+  auto head_plus_meta_len = TickbinHeader::header_lead_length + meta_str.size() + 1;  // +1 for null term
+
+  // Decide the preamble block size. This has to be large enough to accomodate
+  // the JSON meta-data, but also we want it be sympathetic to later memory
+  // mapping; so we ensure we allocate header space in 1024 byte blocks.
+
+  size_t preamble_size = (1 + (head_plus_meta_len  >> 10)) << 10;
+  assert (head_plus_meta_len < preamble_size);
+
+  // the size is written as seven decimal digits
+  if (preamble_size > 9999999)
+    THROW("tickbin meta-data too large, preamble of " << preamble_size
+          << " bytes");
+
+  // --- Build the binary image for the preamble ---
+  std::string tick_version = version;
+  tick_version.resize(8, ' ');
+  std::vector<char> preamble(preamble_size, '\0');
+
+  // write the tick header version
+  memcpy(&preamble[0], tick_version.c_str(), 8);
+
+  // write the preamble region size
+  snprintf(&preamble[8], 8, "%07lu", preamble_size);
+
+  // write the json meta data
+  memcpy(&preamble[16], meta_str.c_str(), meta_str.size());
+
+  // we should not have overritten the final preamble byte
+  assert(preamble[preamble_size-1] == '\0');
+
+  return preamble;
+}
+
+
+std::filesystem::path tickbin_index_path(const std::filesystem::path& fn)
+{
+  auto path = fn;
+  path += ".idx";
+  return path;
+}
+
+
+std::filesystem::path tickbin_part_path(const std::filesystem::path& fn,
+                                        int hour)
+{
+  char suffix[16] = {0};
+  snprintf(suffix, sizeof(suffix), ".%02d.binz", hour);
+  auto path = fn;
+  path.replace_extension();
+  path += suffix;
+  return path;
+}
+
+
+std::vector<tickbin::IndexEntry> find_tickbin_frames(const char* begin,
+                                                     size_t size,
+                                                     size_t first,
+                                                     bool verify,
+                                                     size_t& end)
+{
+  std::vector<tickbin::IndexEntry> frames;
+
+  // use the index of a cleanly closed file, if it is consistent
+  if (size >= first + sizeof(tickbin::FrameFooter)) {
+    tickbin::FrameFooter footer;
+    memcpy(&footer, begin + size - sizeof(footer), sizeof(footer));
+    uint64_t index_size = uint64_t{footer.frame_count} * sizeof(tickbin::IndexEntry);
+    if (footer.magic == tickbin::frame_footer_magic &&
+        footer.index_offset >= first &&
+        footer.index_offset + index_size + sizeof(footer) == size) {
+      frames.resize(footer.frame_count);
+      memcpy(frames.data(), begin + footer.index_offset, index_size);
+      end = footer.index_offset;
+      bool valid = true;
+      for (auto& entry : frames)
+        valid = valid && entry.offset >= first && entry.offset < end;
+      if (valid && !verify)
+        return frames;
+      frames.clear();
+    }
+  }
+
+  // otherwise the file was not closed, so scan the frame headers
+  end = first;
+  while (end + sizeof(tickbin::FrameHeader) <= size) {
+    tickbin::FrameHeader head;
+    memcpy(&head, begin + end, sizeof(head));
+    if (head.magic != tickbin::frame_magic ||
+        end + sizeof(head) + head.compressed_size > size)
+      break;
+    if (verify) {
+      auto crc = crc32(0L, reinterpret_cast<const Bytef*>(begin + end + sizeof(head)),
+                       head.compressed_size);
+      if (crc != head.crc)
+        break;
+    }
+    frames.push_back({head.first_time, end});
+    end += sizeof(head) + head.compressed_size;
+  }
+  return frames;
+}
+
+
+json tickbin_stream_meta(const StreamInfo& stream_info,
+                         const TickFileBucketId& bucketid,
+                         json collect_meta)
+{
+  json meta;
+  meta["e"] = exchange_id_to_string(stream_info.exchange_id());
+  meta["c"] = stream_info.channel;
+  meta["s"] = stream_info.symbol();
+  meta["i"] = stream_info.instrument.id();
+  meta["bin"] = bucketid.as_string();
+  meta["cm"] = std::move(collect_meta);
+  return meta;
+}
+
+
 class TickbinDecoder
 {
 public:
-  TickbinDecoder(char* file_start, char* file_end)
+  TickbinDecoder(const char* file_start, const char* file_end)
     : _head(file_start), _start(file_start), _end(file_end)
   {
   }
@@ -62,7 +185,7 @@ public:
   ~TickbinDecoder() = default;
 
   virtual apex::Time get_next_event_time() const {
-    tickbin::Header* head = reinterpret_cast<tickbin::Header*>(_head);
+    auto* head = reinterpret_cast<const tickbin::Header*>(_head);
     std::chrono::microseconds event_time(head->capture_time);
     return apex::Time(event_time);
   }
@@ -70,7 +193,7 @@ public:
   virtual bool has_next_event()  {
     size_t bytes_remaining = _end - _head;
     if (bytes_remaining > sizeof(tickbin::Header)) {
-      tickbin::Header* head = reinterpret_cast<tickbin::Header*>(_head);
+      auto* head = reinterpret_cast<const tickbin::Header*>(_head);
       assert(head->size >= sizeof(tickbin::Header));
       return  bytes_remaining >= head->size;
     }
@@ -80,12 +203,69 @@ public:
 
   virtual void consume_next_event(MarketData*) {}
 
+  /* Pass over the next event, without decoding it where the format allows */
+  virtual void skip_next_event()
+  {
+    _head += reinterpret_cast<const tickbin::Header*>(_head)->size;
+  }
+
+  /* Capture time of the event following the next, if it is complete */
+  virtual bool following_event_time(apex::Time& t) const
+  {
+    const char* following =
+      _head + reinterpret_cast<const tickbin::Header*>(_head)->size;
+    size_t bytes_remaining = _end - following;
+    if (bytes_remaining <= sizeof(tickbin::Header))
+      return false;
+    auto* head = reinterpret_cast<const tickbin::Header*>(following);
+    if (bytes_remaining < head->size)
+      return false;
+    t = apex::Time(std::chrono::microseconds(head->capture_time));
+    return true;
+  }
+
+  /* Events at or beyond `until` end a run of consume_events; none if empty */
+  void set_until(apex::Time until) { _until = until; }
+
+  /* Consume up to `max` events while `batch` admits them. */
+  virtual size_t consume_events(MarketData*, BacktestBatch&, size_t /*max*/)
+  {
+    return 0;
+  }
+
   const char* read_head() const { return _head; }
 
+  void seek(const char* head) { _head = head; }
+
+  void reset(const char* start, const char* end)
+  {
+    _head = _start = start;
+    _end = end;
+  }
+
 protected:
-  char* _head;
-  char* _start;
-  char* _end;
+  // the run of events for a decoder `D`, whose calls are then not virtual
+  template <typename D>
+  static size_t consume_run(D& decoder, MarketData* mktdata,
+                            BacktestBatch& batch, size_t max)
+  {
+    size_t count = 0;
+    while (count < max && decoder.TickbinDecoder::has_next_event()) {
+      auto event_time = decoder.TickbinDecoder::get_next_event_time();
+      if (!decoder.before_until(event_time) || !batch.admit(event_time))
+        break;
+      decoder.D::consume_next_event(mktdata);
+      ++count;
+    }
+    return count;
+  }
+
+  bool before_until(apex::Time t) const { return _until.empty() || t < _until; }
+
+  const char* _head;
+  const char* _start;
+  const char* _end;
+  apex::Time _until;
 };
 
 
@@ -93,15 +273,41 @@ protected:
 class TickbinDecoderTickLevel1 : public TickbinDecoder
 {
 public:
-  TickbinDecoderTickLevel1(char* ptr, char* end)
+  TickbinDecoderTickLevel1(const char* ptr, const char* end)
     : TickbinDecoder(ptr, end)
   {
   }
 
+  size_t consume_events(MarketData* mktdata, BacktestBatch& batch,
+                        size_t max) override
+  {
+    if (!mktdata || !mktdata->tops_in_blocks())
+      return consume_run(*this, mktdata, batch, max);
+
+    // the admitted ticks are decoded into a block, applied once
+    _block_ticks.resize(max);
+    _block_times.resize(max);
+    size_t count = 0;
+    while (count < max && TickbinDecoder::has_next_event()) {
+      auto event_time = TickbinDecoder::get_next_event_time();
+      if (!before_until(event_time) || !batch.admit(event_time))
+        break;
+      auto* head = reinterpret_cast<const tickbin::Header*>(_head);
+      tickbin::Serialiser::deserialise(_head, _block_ticks[count]);
+      _block_times[count] = event_time;
+      _head += head->size;
+      ++count;
+    }
+    if (count)
+      mktdata->apply(
+          TickTopBlock{_block_ticks.data(), _block_times.data(), count});
+    return count;
+  }
+
   void consume_next_event(MarketData* mktdata) override
   {
     // TODO: should use type ID here to cast to appropriate type
-    tickbin::Header* head = reinterpret_cast<tickbin::Header*>(_head);
+    auto* head = reinterpret_cast<const tickbin::Header*>(_head);
 
     if (mktdata) {
       TickTop tick;
@@ -112,22 +318,32 @@ public:
 
     _head += head->size;
   }
+
+private:
+  std::vector<TickTop> _block_ticks;
+  std::vector<Time> _block_times;
 };
 
 
 class TickbinDecoderAggTrade : public TickbinDecoder
 {
 public:
-  TickbinDecoderAggTrade(char* ptr, char* end)
+  TickbinDecoderAggTrade(const char* ptr, const char* end)
     : TickbinDecoder(ptr, end)
   {
   }
 
+  size_t consume_events(MarketData* mktdata, BacktestBatch& batch,
+                        size_t max) override
+  {
+    return consume_run(*this, mktdata, batch, max);
+  }
+
   void consume_next_event(MarketData* mktdata) override
   {
     // TODO: should use type ID here to cast to appropriate type
 
-    tickbin::Header* head = reinterpret_cast<tickbin::Header*>(_head);
+    auto* head = reinterpret_cast<const tickbin::Header*>(_head);
     if (mktdata) {
       TickTrade tick;
       tickbin::Serialiser::deserialise(_head, tick);
@@ -140,61 +356,239 @@ public:
 };
 
 
-TickbinFileReader::TickbinFileReader(std::filesystem::path fn,
-                                     MarketData* mktdata,
-                                     MdStream stream_type)
-  :_fn(fn),
-   _mktdata(mktdata)
+/* How a raw record of each message type is applied to the market data; a
+ * type without a specialisation is passed over. */
+template <tickbin::MsgType> struct TickbinRecord {
+  static void apply(const char*, MarketData*) {}
+};
+
+template <> struct TickbinRecord<tickbin::MsgType::TickLevel1> {
+  static void apply(const char* rec, MarketData* mktdata)
+  {
+    TickTop tick;
+    tickbin::Serialiser::deserialise(rec, tick);
+    mktdata->apply(tick);
+  }
+};
+
+template <> struct TickbinRecord<tickbin::MsgType::TickAggTrade> {
+  static void apply(const char* rec, MarketData* mktdata)
+  {
+    TickTrade tick;
+    tickbin::Serialiser::deserialise(rec, tick);
+    mktdata->apply(tick);
+  }
+};
+
+
+using TickbinApplyFn = void (*)(const char*, MarketData*);
+
+template <size_t... I>
+constexpr std::array<TickbinApplyFn, sizeof...(I)> make_tickbin_apply_table(
+    std::index_sequence<I...>)
 {
-  namespace fs = std::filesystem;
+  return {&TickbinRecord<static_cast<tickbin::MsgType>(I)>::apply...};
+}
 
-  if (!fs::exists(fn) || !fs::is_regular_file(fn)) {
-    THROW("tickbin file not found " << fn);
+/* How to apply a raw record, for every value of its msg_type */
+constexpr auto tickbin_apply_table = make_tickbin_apply_table(
+    std::make_index_sequence<1 << (8 * sizeof(tickbin::Header::msg_type))>{});
+
+
+/* Decoder of raw mixed files, whose records are of any type.  Each record is
+ * applied through a table indexed by the msg_type of its header, generated
+ * at compile time with an entry for every possible value, so dispatch is
+ * one indirect call without a bounds check. */
+class TickbinDecoderMixed : public TickbinDecoder
+{
+public:
+  TickbinDecoderMixed(const char* ptr, const char* end)
+    : TickbinDecoder(ptr, end)
+  {
   }
-  LOG_INFO("reading tickbin file " << fn);
-  auto file = std::ifstream(fn, std::ios::binary);
 
-  std::string fn_native = fn.native();
+  size_t consume_events(MarketData* mktdata, BacktestBatch& batch,
+                        size_t max) override
+  {
+    return consume_run(*this, mktdata, batch, max);
+  }
+
+  void consume_next_event(MarketData* mktdata) override
+  {
+    auto* head = reinterpret_cast<const tickbin::Header*>(_head);
+    if (mktdata)
+      tickbin_apply_table[head->msg_type](_head, mktdata);
+    _head += head->size;
+  }
+};
+
+
+/* Decoder of delta encoded files, whose records are of variable size and
+ * each decoded relative to the record before.  The next record is decoded
+ * once, when first peeked at; a seek is always to a key record, which
+ * decodes without the records before it. */
+class TickbinDecoderDelta : public TickbinDecoder
+{
+public:
+  TickbinDecoderDelta(const char* ptr, const char* end,
+                      tickbin::DeltaSerialiser serialiser)
+    : TickbinDecoder(ptr, end),
+      _serialiser(std::move(serialiser))
+  {
+  }
+
+  apex::Time get_next_event_time() const override
+  {
+    peek();
+    return apex::Time(std::chrono::microseconds(_next.capture_time));
+  }
 
-  // check file is accessible
-  if (access(fn_native.c_str(), F_OK) < 0) {
-    THROW("access failed, file " << fn << ", errno " << errno);
+  bool has_next_event() override { return peek(); }
+
+  void skip_next_event() override { consume_next_event(nullptr); }
+
+  bool following_event_time(apex::Time& t) const override
+  {
+    if (!peek())
+      return false;
+
+    // decoded by a copy of the serialiser, which is left as of the next event
+    auto serialiser = _serialiser;
+    tickbin::DeltaSerialiser::Record record;
+    const char* following = _head + _next_size;
+    if (!serialiser.deserialise(following, _end - following, record))
+      return false;
+    t = apex::Time(std::chrono::microseconds(record.capture_time));
+    return true;
   }
 
-  // try open
-  auto fd = open(fn_native.c_str(), O_RDONLY);
-  if (fd < 0) {
-    THROW("open failed, file " << fn << ", errno " << errno);
+  size_t consume_events(MarketData* mktdata, BacktestBatch& batch,
+                        size_t max) override
+  {
+    size_t count = 0;
+    if (!mktdata || !mktdata->tops_in_blocks() || !peek() ||
+        _next.type != tickbin::MsgType::TickLevel1) {
+      while (count < max && peek() && before_until(get_next_event_time()) &&
+             batch.admit(get_next_event_time())) {
+        consume_next_event(mktdata);
+        ++count;
+      }
+      return count;
+    }
+
+    // the admitted ticks are decoded into a block, applied once
+    _block_ticks.resize(max);
+    _block_times.resize(max);
+    while (count < max && peek() &&
+           _next.type == tickbin::MsgType::TickLevel1) {
+      auto event_time = get_next_event_time();
+      if (!before_until(event_time) || !batch.admit(event_time))
+        break;
+      _block_ticks[count] = _next.top;
+      _block_times[count] = event_time;
+      _head += _next_size;
+      ++count;
+    }
+    if (count)
+      mktdata->apply(
+          TickTopBlock{_block_ticks.data(), _block_times.data(), count});
+    return count;
   }
 
-  // obtain file size
-  struct stat stat_buf{};
-  if (fstat(fd, &stat_buf) < 0) {
-    THROW("fstat failed, file " << fn << ", errno " << errno);
+  void consume_next_event(MarketData* mktdata) override
+  {
+    if (!peek())
+      return;
+    if (mktdata) {
+      if (_next.type == tickbin::MsgType::TickLevel1)
+        mktdata->apply(_next.top);
+      else
+        mktdata->apply(_next.trade);
+    }
+    _head += _next_size;
   }
 
-  // map the file into memory
-  char* addr = (char*) ::mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-  if (addr == MAP_FAILED) {
-    THROW("mmap failed, file " << fn << ", errno " << errno);
+private:
+  bool peek() const
+  {
+    if (_next_head != _head) {
+      _next_head = _head;
+      _next_size = _serialiser.deserialise(_head, _end - _head, _next);
+    }
+    return _next_size != 0;
   }
-  char* const end = addr + stat_buf.st_size;
+
+  mutable tickbin::DeltaSerialiser _serialiser;
+  mutable tickbin::DeltaSerialiser::Record _next;
+  mutable const char* _next_head = nullptr;
+  mutable size_t _next_size = 0;
+  std::vector<TickTop> _block_ticks;
+  std::vector<Time> _block_times;
+};
+
+
+TickbinFileReader::TickbinFileReader(std::filesystem::path fn,
+                                     MarketData* mktdata,
+                                     MdStream stream_type,
+                                     TickFileCache* cache,
+                                     const MmapOptions& mmap_options,
+                                     const TickFilter& filter)
+  :_fn(fn),
+   _mktdata(mktdata),
+   _filter(filter),
+   _filtered(!filter.empty()),
+   _conflate(stream_type == MdStream::L1 && filter.l1_conflate.count() > 0)
+{
+  namespace fs = std::filesystem;
+
+  if (!fs::exists(fn) || !fs::is_regular_file(fn)) {
+    THROW("tickbin file not found " << fn);
+  }
+  LOG_INFO("reading tickbin file " << fn);
+
+  // map the file into memory, sharing an existing mapping if a cache is used
+  if (cache)
+    _file = cache->open(fn, mmap_options);
+  else
+    _file = std::make_shared<const MappedFile>(fn, mmap_options);
+  _window = MappedFileWindow(_file.get(), mmap_options.window,
+                             mmap_options.release && !cache);
+
+  const char* addr = _file->begin();
+  const char* const end = _file->end();
 
   // read the file header
   auto result = parse_mmap_header(addr);
   size_t header_len = std::get<0>(result);
   json header_json = std::get<1>(result);
+  auto version = decode_tickbin_file_header(addr).version;
+  _compressed = version == tickbin::compressed_version;
+  _delta = version == tickbin::delta_version;
   addr += header_len;
 
-  //size_t bytes_remaining = end - addr;
-
   // int msg_size = header_json["sz"].get<int>();
   // std::string msg_type = header_json["mt"].get<std::string>();
 
   // TODO: use a factory use?
   // Build a msg decoder
 
-  if (stream_type == MdStream::AggTrades) {
+  // records of a mixed file are told apart by type; the delta decoder does
+  // so for any file
+  auto channel = header_json.find("c");
+  const bool mixed = channel != header_json.end() && channel->is_string() &&
+                     channel->get<std::string>() == tickbin_mixed_channel;
+  if (mixed)
+    _conflate = false;
+
+  if (_delta && (mixed || stream_type == MdStream::AggTrades ||
+                 stream_type == MdStream::L1)) {
+    _decoder = std::make_unique<TickbinDecoderDelta>(
+        addr, end, tickbin::DeltaSerialiser::from_meta(header_json));
+  }
+  else if (mixed) {
+    _decoder = std::make_unique<TickbinDecoderMixed>(addr, end);
+  }
+  else if (stream_type == MdStream::AggTrades) {
     _decoder = std::make_unique<TickbinDecoderAggTrade>(addr, end);
   }
   else if (stream_type == MdStream::L1) {
@@ -204,37 +598,215 @@ TickbinFileReader::TickbinFileReader(std::filesystem::path fn,
     THROW("invalid stream_type: '" << stream_type << "'");
   }
 
-  // give it the next bytes
+  // the decoder of a compressed file works on one decompressed frame at a
+  // time, and the frame index takes the place of the sidecar index
+  if (_compressed) {
+    size_t frames_end = 0;
+    _index = find_tickbin_frames(_file->begin(), _file->size(), header_len,
+                                 false, frames_end);
+    _decoder->reset(nullptr, nullptr);
+    if (!_index.empty() && load_frame(0))
+      next_frame_if_consumed();
+    LOG_DEBUG("tickbin frames: " << _index.size() << ", file " << _fn);
+  }
+  else
+    load_index();
+
+  skip_filtered();
+}
+
+
+bool TickbinFileReader::load_frame(size_t i)
+{
+  _frame = i;
+  _decoder->reset(nullptr, nullptr);
+
+  auto offset = _index[i].offset;
+  tickbin::FrameHeader head;
+  memcpy(&head, _file->begin() + offset, sizeof(head));
+  const char* src = _file->begin() + offset + sizeof(head);
+  if (offset + sizeof(head) + head.compressed_size > _file->size()) {
+    LOG_WARN("tickbin frame extends beyond end of file " << _fn);
+    return false;
+  }
+
+  // a frame torn by a crash ends the file, rather than being replayed
+  auto crc = crc32(0L, reinterpret_cast<const Bytef*>(src), head.compressed_size);
+  _frame_buf.resize(head.raw_size);
+  uLongf raw_len = head.raw_size;
+  if (crc != head.crc ||
+      uncompress(reinterpret_cast<Bytef*>(_frame_buf.data()), &raw_len,
+                 reinterpret_cast<const Bytef*>(src),
+                 head.compressed_size) != Z_OK ||
+      raw_len != head.raw_size) {
+    LOG_WARN("ignoring corrupt tickbin frame at offset " << offset << ", file " << _fn);
+    return false;
+  }
+
+  _decoder->reset(_frame_buf.data(), _frame_buf.data() + _frame_buf.size());
+  return true;
+}
+
+
+void TickbinFileReader::next_frame_if_consumed()
+{
+  while (!_decoder->has_next_event() && _frame + 1 < _index.size() &&
+         load_frame(_frame + 1)) {
+  }
+}
+
+
+size_t TickbinFileReader::read_offset() const
+{
+  if (_compressed)
+    return _index.empty() ? 0 : _index[_frame].offset;
+  else
+    return _decoder->read_head() - _file->begin();
+}
+
+
+void TickbinFileReader::load_index()
+{
+  namespace fs = std::filesystem;
+
+  auto index_fn = tickbin_index_path(_fn);
+  if (!fs::exists(index_fn))
+    return;
+
+  std::ifstream is(index_fn, std::ios::binary);
+  tickbin::IndexEntry entry{};
+  const char* begin = _file->begin();
+  const size_t file_size = _file->size();
+  const size_t first_offset = _decoder->read_head() - begin;
+
+  // Only retain entries that point at a record with the same capture time, so
+  // that a stale or partially written index is harmless; and require times to
+  // be increasing, since the index is binary searched.
+  while (is.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+    if (entry.offset < first_offset ||
+        entry.offset + sizeof(tickbin::Header) > file_size)
+      break;
+    // delta encoded entries must point at a key record
+    uint64_t capture_time = 0;
+    if (_delta) {
+      if (!tickbin::DeltaSerialiser::key_time(begin + entry.offset,
+                                              file_size - entry.offset,
+                                              capture_time))
+        break;
+    }
+    else {
+      tickbin::Header head;
+      memcpy(&head, begin + entry.offset, sizeof(head));
+      capture_time = head.capture_time;
+    }
+    if (capture_time != entry.capture_time)
+      break;
+    if (!_index.empty() && entry.capture_time < _index.back().capture_time)
+      break;
+    _index.push_back(entry);
+  }
+
+  LOG_DEBUG("tickbin index entries: " << _index.size() << ", file " << index_fn);
 }
 
 
 TickbinFileReader::~TickbinFileReader() = default;
 
-void TickbinFileReader::wind_forward(apex::Time t)
+size_t TickbinFileReader::skip_until(apex::Time t)
 {
-  size_t consumed = 0;
-  apex::Time earliest_consumed;
-  apex::Time latest_consumed;
+  // use the sparse index to jump to the last indexed record before the seek
+  // time; the remaining events are then skipped one by one
+  if (_compressed) {
+    auto target = static_cast<uint64_t>(t.as_epoch_us().count());
+    auto iter = std::upper_bound(
+        std::begin(_index), std::end(_index), target,
+        [](uint64_t value, const tickbin::IndexEntry& entry) {
+          return value < entry.capture_time;
+        });
+    if (iter != std::begin(_index)) {
+      size_t frame = std::distance(std::begin(_index), iter) - 1;
+      if (frame > _frame) {
+        LOG_DEBUG("wind-forward using index, skipping " << (frame - _frame)
+                  << " frames");
+        if (load_frame(frame))
+          next_frame_if_consumed();
+      }
+    }
+  }
+  else if (!_index.empty()) {
+    auto target = static_cast<uint64_t>(t.as_epoch_us().count());
+    auto iter = std::upper_bound(
+        std::begin(_index), std::end(_index), target,
+        [](uint64_t value, const tickbin::IndexEntry& entry) {
+          return value < entry.capture_time;
+        });
+    if (iter != std::begin(_index)) {
+      --iter;
+      const char* head = _file->begin() + iter->offset;
+      if (head > _decoder->read_head()) {
+        LOG_DEBUG("wind-forward using index, skipping "
+                  << (head - _decoder->read_head()) << " bytes");
+        _decoder->seek(head);
+      }
+    }
+  }
 
+  size_t skipped = 0;
   while (_decoder->has_next_event() && _decoder->get_next_event_time() < t) {
-    auto next_event_time = _decoder->get_next_event_time();
-    if (consumed == 0)
-      earliest_consumed = next_event_time;
-    else
-      latest_consumed = next_event_time;
-    _decoder->consume_next_event(0);
-    consumed++;
+    _decoder->skip_next_event();
+    if (_compressed)
+      next_frame_if_consumed();
+    skipped++;
   }
+  return skipped;
+}
+
+
+void TickbinFileReader::skip_filtered()
+{
+  if (!_filtered || !_decoder)
+    return;
+
+  while (_decoder->has_next_event()) {
+    auto t = _decoder->get_next_event_time();
+    if (!_filter.admits(t)) {
+      skip_until(_filter.next_admitted(t));
+      continue;
+    }
+
+    // conflation keeps the last admitted tick of each interval; a tick
+    // followed by one in another frame is kept
+    apex::Time following;
+    if (_conflate && _decoder->following_event_time(following) &&
+        _filter.same_interval(t, following) && _filter.admits(following)) {
+      _decoder->skip_next_event();
+      continue;
+    }
+    break;
+  }
+  _window.advance(read_offset());
+}
+
+
+void TickbinFileReader::wind_forward(apex::Time t)
+{
+  apex::Time earliest_consumed;
+  if (_decoder->has_next_event())
+    earliest_consumed = _decoder->get_next_event_time();
+
+  size_t consumed = skip_until(t);
+  _window.advance(read_offset());
+  skip_filtered();
 
   if (consumed == 0) {
     LOG_DEBUG("wind-forward events consumed: "
               << consumed << "; next event time: "
-              << _decoder->get_next_event_time() << ", seeking time: " << t);
+              << next_event_time() << ", seeking time: " << t);
   } else {
     LOG_INFO("wind-forward events consumed: "
-             << consumed << "; from " << earliest_consumed << " upto "
-             << latest_consumed << "; next event time: "
-             << _decoder->get_next_event_time() << ", seeking time: " << t);
+             << consumed << "; from " << earliest_consumed
+             << "; next event time: " << next_event_time()
+             << ", seeking time: " << t);
   }
 }
 
@@ -243,19 +815,58 @@ void TickbinFileReader::wind_forward(apex::Time t)
 }
 
 [[nodiscard]] apex::Time TickbinFileReader::next_event_time() const {
-  if (_decoder)
+  if (has_next_event())
     return _decoder->get_next_event_time();
   else
     return Time{};
 }
 
 void TickbinFileReader::consume_next_event() {
-    if (_decoder)
+    if (_decoder) {
       _decoder->consume_next_event(_mktdata);
+      if (_compressed)
+        next_frame_if_consumed();
+      _window.advance(read_offset());
+      skip_filtered();
+    }
+}
+
+
+size_t TickbinFileReader::consume_events(BacktestBatch& batch)
+{
+  // runs are limited, so that the mapping window still advances regularly
+  constexpr size_t max_run = 4096;
+
+  // conflated ticks are decided one at a time
+  if (_conflate)
+    return BaseTickFileReader::consume_events(batch);
+
+  size_t count = 0;
+  while (_decoder) {
+    // runs within a window stop at its end, beyond which records are skipped
+    apex::Time until;
+    if (_filtered && _decoder->has_next_event())
+      until = _filter.window_end(_decoder->get_next_event_time());
+    _decoder->set_until(until);
+
+    const size_t run = _decoder->consume_events(_mktdata, batch, max_run);
+    count += run;
+    bool refused = run < max_run && _decoder->has_next_event();
+    if (_compressed)
+      next_frame_if_consumed();
+    _window.advance(read_offset());
+    if (refused && !until.empty() &&
+        _decoder->get_next_event_time() >= until)
+      refused = false;
+    skip_filtered();
+    if (refused || !_decoder->has_next_event())
+      break;
+  }
+  return count;
 }
 
 
-std::tuple<size_t, json> TickbinFileReader::parse_mmap_header(char* ptr)
+std::tuple<size_t, json> TickbinFileReader::parse_mmap_header(const char* ptr)
 {
   auto tickbin_header = decode_tickbin_file_header(ptr);
 
@@ -22,9 +22,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/MarketData.hpp>
 #include <apex/model/ExchangeId.hpp>
 #include <apex/model/Instrument.hpp>
+#include <apex/backtest/TickFileCache.hpp>
 #include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
 
 #include <filesystem>
+#include <string>
+#include <vector>
+#include <memory>
 
 namespace apex
 {
@@ -84,14 +89,66 @@ struct TickFileBucketId {
 };
 
 
+/* Build the file preamble: the 8 byte version tag, the preamble length and the
+ * JSON meta-data, padded to a multiple of 1024 bytes. */
+std::vector<char> encode_tickbin_file_header(const std::string& version,
+                                             const json& meta);
+
+/* Path of the sidecar file holding the sparse time index of a tickbin file. */
+std::filesystem::path tickbin_index_path(const std::filesystem::path& fn);
+
+/* Path of the compressed file holding one hour of a day's tick file; for
+ * example, "BTCUSDT.bin" becomes "BTCUSDT.13.binz" for the hour from 13:00. */
+std::filesystem::path tickbin_part_path(const std::filesystem::path& fn,
+                                        int hour);
+
+/* Locate the frames of a compressed tickbin file, held in the `size` bytes at
+ * `begin`, with the first frame at offset `first`.  The trailing index is used
+ * if present; otherwise frame headers are scanned up to the first incomplete
+ * frame, also checking the frame crc if `verify` is set.  `end` is set to the
+ * offset just beyond the last complete frame. */
+std::vector<tickbin::IndexEntry> find_tickbin_frames(const char* begin,
+                                                     size_t size,
+                                                     size_t first,
+                                                     bool verify,
+                                                     size_t& end);
+
+/* Build the meta-data describing the stream held by a tick file. */
+json tickbin_stream_meta(const StreamInfo&, const TickFileBucketId&,
+                         json collect_meta = {});
+
+/* Channel of a mixed tick file, which interleaves the L1 and trade records of
+ * an instrument in capture time order, so that its complete stream is
+ * replayed by one reader; the file is a raw, compressed or delta encoded
+ * tickbin file, of records told apart by their headers. */
+constexpr const char* tickbin_mixed_channel = "mixed";
+
+/* Streams replayed from a mixed tick file, as one stream */
+constexpr MdStream tickbin_mixed_streams = static_cast<MdStream>(
+    static_cast<int>(MdStream::L1) | static_cast<int>(MdStream::AggTrades));
+
+
 class TickbinDecoder;
 
+/* Reads raw, compressed and delta encoded tickbin files.  Pages behind the read
+ * position are only released if the file mapping is private to the reader,
+ * i.e. not obtained from a TickFileCache.  The stream of a file is that of its
+ * meta-data, so a mixed file is read whatever stream is asked for.
+ *
+ * With a TickFilter, records outside its windows are passed over by their
+ * headers, the gap to the next window being crossed with the index, and L1
+ * records conflated away are skipped the same way; only delta encoded
+ * records must still be decoded, as each depends on the one before.  The L1
+ * records of a mixed file are not conflated. */
 class TickbinFileReader : public BaseTickFileReader
 {
 public:
   explicit TickbinFileReader(std::filesystem::path fn,
                              MarketData*,
-                             MdStream stream_type);
+                             MdStream stream_type,
+                             TickFileCache* cache = nullptr,
+                             const MmapOptions& mmap_options = {},
+                             const TickFilter& filter = {});
   ~TickbinFileReader();
 
   void wind_forward(apex::Time t);
@@ -102,12 +159,46 @@ public:
 
   void consume_next_event();
 
+  size_t consume_events(BacktestBatch&) override;
+
+  [[nodiscard]] bool filters() const override { return true; }
+
 private:
   std::filesystem::path _fn;
   MarketData* _mktdata;
-  std::tuple<size_t, json> parse_mmap_header(char* ptr);
+  std::tuple<size_t, json> parse_mmap_header(const char* ptr);
+
+  void load_index();
+
+  // compressed files only: decompress frame `i` into the decoder
+  bool load_frame(size_t i);
+  void next_frame_if_consumed();
+
+  [[nodiscard]] size_t read_offset() const;
+
+  // pass over the events before `t`, using the index; returns the number
+  // passed over one by one
+  size_t skip_until(apex::Time t);
 
+  // leave the decoder at the next event the filter admits
+  void skip_filtered();
+
+  std::shared_ptr<const MappedFile> _file;
+  MappedFileWindow _window;
   std::unique_ptr<TickbinDecoder> _decoder;
+  std::vector<tickbin::IndexEntry> _index;
+
+  // for compressed files, _index holds one entry per frame
+  bool _compressed = false;
+  size_t _frame = 0;
+  std::vector<char> _frame_buf;
+
+  // delta encoded files are decoded by a TickbinDecoderDelta
+  bool _delta = false;
+
+  TickFilter _filter;
+  bool _filtered = false;
+  bool _conflate = false;
 };
 
 } // namespace apex
@@ -16,79 +16,299 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/util/Error.hpp>
 
+#include <cmath>
 #include <string.h>
 
 namespace apex {
 namespace tickbin {
 
-char Serialiser::encode_side(apex::Side side)
+namespace {
+
+void put_varint(char*& ptr, uint64_t value)
 {
-  switch (side) {
-    case apex::Side::buy:
-      return 'b';
-    case apex::Side::sell:
-      return 's';
-    default:
-      return ' ';
+  while (value >= 0x80) {
+    *ptr++ = static_cast<char>(value | 0x80);
+    value >>= 7;
   }
+  *ptr++ = static_cast<char>(value);
 }
 
+void put_signed(char*& ptr, int64_t value)
+{
+  put_varint(ptr, (static_cast<uint64_t>(value) << 1) ^
+                      static_cast<uint64_t>(value >> 63));
+}
 
-Side Serialiser::decode_side(char c)
+void put_double(char*& ptr, double value)
 {
-  switch (c) {
-    case 'b':
-      return Side::buy;
-    case 's':
-      return Side::sell;
-    default:
-      return Side::none;
+  memcpy(ptr, &value, sizeof(value));
+  ptr += sizeof(value);
+}
+
+/* Reads the fields of one record, throwing if they overrun it. */
+struct FieldReader {
+  const char* ptr;
+  const char* end;
+
+  uint64_t varint()
+  {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (ptr == end)
+        break;
+      auto byte = static_cast<uint8_t>(*ptr++);
+      value |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    THROW("malformed delta tickbin record");
+  }
+
+  int64_t signed_varint()
+  {
+    auto value = varint();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+  double real()
+  {
+    if (end - ptr < static_cast<ptrdiff_t>(sizeof(double)))
+      THROW("malformed delta tickbin record");
+    double value;
+    memcpy(&value, ptr, sizeof(value));
+    ptr += sizeof(value);
+    return value;
+  }
+};
+
+// steps beyond this are not exactly held by a double
+constexpr double max_units = 9e15;
+
+} // namespace
+
+
+bool DeltaSerialiser::Grid::to_steps(double value, int64_t& steps) const
+{
+  double units = scale <= 0 ? value * pow10_of(-scale) : value / pow10_of(scale);
+  if (!(std::fabs(units) < max_units))
+    return false;
+  auto rounded = std::llround(units);
+  if (rounded % mantissa)
+    return false;
+  steps = rounded / mantissa;
+  return from_steps(steps) == value;
+}
+
+
+double DeltaSerialiser::Grid::from_steps(int64_t steps) const
+{
+  // dividing by an exact power of ten gives the double nearest the decimal
+  auto units = static_cast<double>(steps * mantissa);
+  return scale <= 0 ? units / pow10_of(-scale) : units * pow10_of(scale);
+}
+
+
+static ScaledInt grid_or_default(ScaledInt size)
+{
+  return size.mantissa() > 0 ? size : ScaledInt(1, -8);
+}
+
+
+DeltaSerialiser::DeltaSerialiser(ScaledInt tick_size, ScaledInt lot_size)
+{
+  tick_size = grid_or_default(tick_size);
+  lot_size = grid_or_default(lot_size);
+  _tick = {tick_size.mantissa(), tick_size.scale()};
+  _lot = {lot_size.mantissa(), lot_size.scale()};
+}
+
+
+DeltaSerialiser DeltaSerialiser::from_meta(const json& meta)
+{
+  auto grid = [&](const char* field) {
+    if (!meta.contains(field) || !meta[field].is_array() || meta[field].size() != 2)
+      THROW("delta tickbin meta-data lacks field '" << field << "'");
+    return ScaledInt(meta[field][0].get<int64_t>(), meta[field][1].get<int>());
+  };
+  return DeltaSerialiser(grid("tk"), grid("lt"));
+}
+
+
+void DeltaSerialiser::write_meta(json& meta) const
+{
+  meta["tk"] = {_tick.mantissa, _tick.scale};
+  meta["lt"] = {_lot.mantissa, _lot.scale};
+}
+
+
+uint8_t DeltaSerialiser::begin_record(char*& ptr, MsgType type,
+                                      uint64_t capture_time)
+{
+  // the length and flags are filled in once the record is complete
+  ptr += 2;
+  if (_key)
+    put_varint(ptr, capture_time);
+  else
+    put_signed(ptr, static_cast<int64_t>(capture_time - _time));
+  _time = capture_time;
+  return static_cast<uint8_t>(static_cast<int>(type) | (_key ? delta_key : 0));
+}
+
+
+size_t DeltaSerialiser::serialise(char* dest, Time capture_time,
+                                  const TickTop& src)
+{
+  char* ptr = dest;
+  uint8_t flags =
+      begin_record(ptr, MsgType::TickLevel1, capture_time.as_epoch_us().count());
+
+  int64_t bid, ask, bid_lots, ask_lots;
+  if (_tick.to_steps(src.bid_price, bid) && _tick.to_steps(src.ask_price, ask) &&
+      _lot.to_steps(src.bid_qty, bid_lots) && bid_lots >= 0 &&
+      _lot.to_steps(src.ask_qty, ask_lots) && ask_lots >= 0) {
+    put_signed(ptr, _key ? bid : bid - _bid);
+    put_signed(ptr, _key ? ask : ask - _ask);
+    put_varint(ptr, bid_lots);
+    put_varint(ptr, ask_lots);
+    _bid = bid;
+    _ask = ask;
+    _key = false;
+  } else {
+    // the previous prices are kept, so a key record stays pending
+    flags |= delta_raw;
+    put_double(ptr, src.bid_price);
+    put_double(ptr, src.ask_price);
+    put_double(ptr, src.bid_qty);
+    put_double(ptr, src.ask_qty);
   }
+
+  dest[0] = static_cast<char>(ptr - dest);
+  dest[1] = static_cast<char>(flags);
+  return ptr - dest;
 }
 
 
-Serialiser::bytes Serialiser::serialise(Time capture_time, TickTop& src) {
-  apex::tickbin::FullMsg<apex::tickbin::TickLevel1> msg;
-  memset(&msg, 0, sizeof(msg));
-  msg.head.capture_time = capture_time.as_epoch_us().count();
-  msg.head.size = sizeof(msg);
-  msg.body.ask_price = src.ask_price;
-  msg.body.ask_qty = src.ask_qty;
-  msg.body.bid_price = src.bid_price;
-  msg.body.bid_qty = src.bid_qty;
-  return {(char*) &msg,  ((char*)&msg) + sizeof(msg) };
+size_t DeltaSerialiser::serialise(char* dest, Time capture_time,
+                                  const TickTrade& src)
+{
+  char* ptr = dest;
+  const uint64_t capture_us = capture_time.as_epoch_us().count();
+  uint8_t flags = begin_record(ptr, MsgType::TickAggTrade, capture_us);
+  if (src.aggr_side == Side::buy)
+    flags |= delta_buy;
+  else if (src.aggr_side == Side::sell)
+    flags |= delta_sell;
+
+  int64_t price, lots;
+  if (_tick.to_steps(src.price, price) && _lot.to_steps(src.qty, lots) &&
+      lots >= 0) {
+    put_signed(ptr, _key ? price : price - _price);
+    put_varint(ptr, lots);
+    _price = price;
+    _key = false;
+  } else {
+    flags |= delta_raw;
+    put_double(ptr, src.price);
+    put_double(ptr, src.qty);
+  }
+  put_signed(ptr, static_cast<int64_t>(src.et.as_epoch_us().count() - capture_us));
+
+  dest[0] = static_cast<char>(ptr - dest);
+  dest[1] = static_cast<char>(flags);
+  return ptr - dest;
 }
 
 
-Serialiser::bytes Serialiser::serialise(Time capture_time, TickTrade& src) {
-  apex::tickbin::FullMsg<apex::tickbin::TickAggTrade> msg;
-  memset(&msg, 0, sizeof(msg));
-  msg.head.capture_time = capture_time.as_epoch_us().count();
-  msg.head.size = sizeof(msg);
-  msg.body.price = src.price;
-  msg.body.qty = src.qty;
-  msg.body.et = src.et.as_epoch_us().count();
-  msg.body.side = encode_side(src.aggr_side);
-  return {(char*) &msg,  ((char*)&msg) + sizeof(msg) };
+size_t DeltaSerialiser::record_size(const char* src, size_t avail)
+{
+  if (avail < 2)
+    return 0;
+  auto size = static_cast<uint8_t>(src[0]);
+  if (size < 2)
+    THROW("malformed delta tickbin record");
+  return size <= avail ? size : 0;
 }
 
 
-void Serialiser::deserialise(char * buf, TickTop& tick) {
-  auto * bin = reinterpret_cast<FullMsg<tickbin::TickLevel1>*>(buf);
-  tick.ask_price = bin->body.ask_price;
-  tick.ask_qty = bin->body.ask_qty;
-  tick.bid_price = bin->body.bid_price;
-  tick.bid_qty = bin->body.bid_qty;
+bool DeltaSerialiser::key_time(const char* src, size_t avail,
+                               uint64_t& capture_time)
+{
+  // not throwing, since it is used to validate index entries
+  if (avail < 2)
+    return false;
+  auto size = static_cast<uint8_t>(src[0]);
+  if (size < 2 || size > avail || !(static_cast<uint8_t>(src[1]) & delta_key))
+    return false;
+  try {
+    FieldReader reader{src + 2, src + size};
+    capture_time = reader.varint();
+    return true;
+  }
+  catch (const std::exception&) {
+    return false;
+  }
 }
 
 
-void Serialiser::deserialise(char * buf, TickTrade& tick) {
-  auto * bin = reinterpret_cast<FullMsg<tickbin::TickAggTrade>*>(buf);
-  tick.et = Time{std::chrono::microseconds{bin->body.et}};
-  tick.price = bin->body.price;
-  tick.qty = bin->body.qty;
-  tick.aggr_side = decode_side(bin->body.side);
+size_t DeltaSerialiser::deserialise(const char* src, size_t avail, Record& rec)
+{
+  auto size = record_size(src, avail);
+  if (!size)
+    return 0;
+
+  const auto flags = static_cast<uint8_t>(src[1]);
+  const bool key = flags & delta_key;
+  const bool raw = flags & delta_raw;
+  FieldReader reader{src + 2, src + size};
+
+  if (key)
+    _time = reader.varint();
+  else
+    _time += static_cast<uint64_t>(reader.signed_varint());
+  rec.capture_time = _time;
+  rec.type = static_cast<MsgType>(flags & delta_type);
+
+  switch (rec.type) {
+    case MsgType::TickLevel1: {
+      auto& top = rec.top;
+      if (raw) {
+        top.bid_price = reader.real();
+        top.ask_price = reader.real();
+        top.bid_qty = reader.real();
+        top.ask_qty = reader.real();
+        break;
+      }
+      _bid = reader.signed_varint() + (key ? 0 : _bid);
+      _ask = reader.signed_varint() + (key ? 0 : _ask);
+      top.bid_price = _tick.from_steps(_bid);
+      top.ask_price = _tick.from_steps(_ask);
+      top.bid_qty = _lot.from_steps(static_cast<int64_t>(reader.varint()));
+      top.ask_qty = _lot.from_steps(static_cast<int64_t>(reader.varint()));
+      break;
+    }
+    case MsgType::TickAggTrade: {
+      auto& trade = rec.trade;
+      if (raw) {
+        trade.price = reader.real();
+        trade.qty = reader.real();
+      } else {
+        _price = reader.signed_varint() + (key ? 0 : _price);
+        trade.price = _tick.from_steps(_price);
+        trade.qty = _lot.from_steps(static_cast<int64_t>(reader.varint()));
+      }
+      trade.et = Time{std::chrono::microseconds(
+          static_cast<int64_t>(_time) + reader.signed_varint())};
+      trade.aggr_side = (flags & delta_buy)    ? Side::buy
+                        : (flags & delta_sell) ? Side::sell
+                                               : Side::none;
+      break;
+    }
+    default:
+      THROW("unsupported delta tickbin record type " << (flags & delta_type));
+  }
+  return size;
 }
 
 }}
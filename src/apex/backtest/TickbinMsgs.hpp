@@ -20,8 +20,13 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/model/Order.hpp>
 #include <apex/model/tick_msgs.hpp>
+#include <apex/util/json.hpp>
+#include <apex/util/utils.hpp>
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <vector>
 
 namespace apex
@@ -39,7 +44,7 @@ enum class MsgType : int {
 
 struct Header {
   uint64_t capture_time; // usec since epoch
-  uint8_t msg_type;
+  uint8_t msg_type;      // MsgType; None in files written before mixed files
   uint8_t size;
 };
 static_assert(sizeof(Header) == 10);
@@ -60,6 +65,7 @@ struct TickLevel1 {
 
 
 struct TickAggTrade {
+  static const int Type = static_cast<int>(MsgType::TickAggTrade);
   double price;
   double qty;
   uint64_t et;
@@ -67,22 +73,280 @@ struct TickAggTrade {
   char pad[3];
 };
 
+// Sparse time index of a tickbin file, held in a sidecar file.  An entry is
+// added for the first record that starts within each index_stride bytes of the
+// tick file, allowing readers to seek close to a time without decoding.
+constexpr size_t index_stride = 1 << 17;
+
+struct IndexEntry {
+  uint64_t capture_time; // usec since epoch
+  uint64_t offset;       // offset of record from start of file
+};
+static_assert(sizeof(IndexEntry) == 16);
+
+// Compressed tickbin files hold the same records, grouped into frames that are
+// each zlib compressed independently, so a torn final frame never affects the
+// frames before it.  The file ends with an index of frames, one IndexEntry per
+// frame, followed by a FrameFooter; the index is absent while the file is
+// being written.
+constexpr const char* compressed_version = "TICKZ";
+
+constexpr uint32_t frame_magic = 0x4d524654;        // "TFRM"
+constexpr uint32_t frame_footer_magic = 0x58444946; // "FIDX"
+
+struct FrameHeader {
+  uint32_t magic;
+  uint32_t raw_size;
+  uint32_t compressed_size;
+  uint32_t crc;        // crc32 of the compressed bytes
+  uint64_t first_time; // usec since epoch
+  uint64_t last_time;  // usec since epoch
+};
+static_assert(sizeof(FrameHeader) == 32);
+
+struct FrameFooter {
+  uint64_t index_offset;
+  uint32_t frame_count;
+  uint32_t magic;
+};
+static_assert(sizeof(FrameFooter) == 16);
+
+// Delta encoded tickbin files hold variable length records, each encoded
+// relative to the record before it: capture times as deltas, prices as
+// offsets in ticks, and quantities as counts of lots, using the instrument
+// tick and lot sizes held in the file meta-data.  The first record of each
+// index region is a key record, of absolute values, so that decoding can
+// start from any index entry.  A record begins with its length and a flags
+// byte; the fields that follow are LEB128 varints, signed ones zigzag
+// encoded.
+constexpr const char* delta_version = "TICKD";
+
+enum DeltaFlag : uint8_t {
+  delta_type = 0x03, // MsgType of the record
+  delta_key = 0x04,  // time and prices absolute, rather than deltas
+  delta_raw = 0x08,  // prices and quantities as doubles, being off the grid
+  delta_buy = 0x10,
+  delta_sell = 0x20,
+};
+
 #pragma pack(pop)
 
+// the record layouts are part of the file format
+static_assert(sizeof(FullMsg<TickLevel1>) == 42);
+static_assert(sizeof(FullMsg<TickAggTrade>) == 38);
+static_assert(offsetof(FullMsg<TickAggTrade>, body) == sizeof(Header));
+
+
+/* Record layout of each tick type: the body of its record, and conversion
+ * between the tick and the body.  Serialiser and View are generated from
+ * the specialisations, which follow Serialiser. */
+template <typename Tick> struct Layout;
+
+
+/* Typed view of a record, read in place, as from a mapped file or the
+ * arena of a writer, without copying it out.  Records are packed, so fields
+ * are read unaligned. */
+template <typename Body> class View
+{
+public:
+  static constexpr size_t size = sizeof(FullMsg<Body>);
+
+  explicit View(const char* rec)
+    : _msg(reinterpret_cast<const FullMsg<Body>*>(rec))
+  {
+  }
+
+  /* True if `head` is of a record of this type */
+  static bool matches(const Header& head)
+  {
+    return head.size == size &&
+           (head.msg_type == Body::Type ||
+            head.msg_type == static_cast<uint8_t>(MsgType::None));
+  }
+
+  uint64_t capture_time() const { return _msg->head.capture_time; }
+
+  const FullMsg<Body>& msg() const { return *_msg; }
+  const Body& body() const { return _msg->body; }
+  const Body* operator->() const { return &_msg->body; }
+
+private:
+  const FullMsg<Body>* _msg;
+};
+
 
 class Serialiser {
 public:
   using bytes = std::vector<char>;
 
-  static char encode_side(apex::Side side);
-  static Side decode_side(char c);
+  template <typename Tick>
+  using Body = typename Layout<Tick>::Body;
+
+  template <typename Tick>
+  static constexpr size_t record_size = sizeof(FullMsg<Body<Tick>>);
+
+  static constexpr size_t max_record_size =
+    std::max(sizeof(FullMsg<TickLevel1>), sizeof(FullMsg<TickAggTrade>));
+
+  static char encode_side(apex::Side side)
+  {
+    switch (side) {
+      case apex::Side::buy:
+        return 'b';
+      case apex::Side::sell:
+        return 's';
+      default:
+        return ' ';
+    }
+  }
+
+  static Side decode_side(char c)
+  {
+    switch (c) {
+      case 'b':
+        return Side::buy;
+      case 's':
+        return Side::sell;
+      default:
+        return Side::none;
+    }
+  }
+
+  // Allocates a record; for tests and tools, writers serialise in place.
+  template <typename Tick>
+  static bytes serialise(Time capture_time, const Tick& src)
+  {
+    bytes buf(record_size<Tick>);
+    serialise(buf.data(), capture_time, src);
+    return buf;
+  }
+
+  // Serialise in place, returning the record size; `dest` must have space for
+  // max_record_size bytes.
+  template <typename Tick>
+  static size_t serialise(char* dest, Time capture_time, const Tick& src)
+  {
+    FullMsg<Body<Tick>> msg{};
+    msg.head.capture_time = capture_time.as_epoch_us().count();
+    msg.head.msg_type = Body<Tick>::Type;
+    msg.head.size = sizeof(msg);
+    Layout<Tick>::encode(src, msg.body);
+    memcpy(dest, &msg, sizeof(msg));
+    return sizeof(msg);
+  }
+
+  template <typename Tick>
+  static void deserialise(const char* buf, Tick& tick)
+  {
+    Layout<Tick>::decode(View<Body<Tick>>(buf).body(), tick);
+  }
+};
+
+
+template <> struct Layout<TickTop> {
+  using Body = TickLevel1;
+
+  static void encode(const TickTop& src, Body& body)
+  {
+    body.ask_price = src.ask_price;
+    body.ask_qty = src.ask_qty;
+    body.bid_price = src.bid_price;
+    body.bid_qty = src.bid_qty;
+  }
+
+  static void decode(const Body& body, TickTop& tick)
+  {
+    tick.ask_price = body.ask_price;
+    tick.ask_qty = body.ask_qty;
+    tick.bid_price = body.bid_price;
+    tick.bid_qty = body.bid_qty;
+  }
+};
+
+
+template <> struct Layout<TickTrade> {
+  using Body = TickAggTrade;
+
+  static void encode(const TickTrade& src, Body& body)
+  {
+    body.price = src.price;
+    body.qty = src.qty;
+    body.et = src.et.as_epoch_us().count();
+    body.side = Serialiser::encode_side(src.aggr_side);
+  }
+
+  static void decode(const Body& body, TickTrade& tick)
+  {
+    tick.et = Time{std::chrono::microseconds{body.et}};
+    tick.price = body.price;
+    tick.qty = body.qty;
+    tick.aggr_side = Serialiser::decode_side(body.side);
+  }
+};
+
+
+/* Encodes, or decodes, the records of a delta encoded tickbin file; an
+ * instance holds the values of the previous record, so serves one file.
+ * Records whose prices or quantities are not on the grid of the tick and lot
+ * sizes, or would not decode to the same doubles, are written raw, so the
+ * encoding is lossless. */
+class DeltaSerialiser {
+public:
+  static constexpr size_t max_record_size = 64;
+
+  struct Record {
+    uint64_t capture_time = 0; // usec since epoch
+    MsgType type = MsgType::None;
+    TickTop top;
+    TickTrade trade;
+  };
+
+  // a zero size, as of an instrument without ref-data, is taken as 1e-8
+  DeltaSerialiser(ScaledInt tick_size, ScaledInt lot_size);
+
+  /* The serialiser of a file, from the grid held in its meta-data */
+  static DeltaSerialiser from_meta(const json& meta);
+
+  /* Add the grid to the meta-data of a file */
+  void write_meta(json& meta) const;
+
+  /* Make the next record serialised a key record */
+  void reset() { _key = true; }
+
+  // Serialise in place, returning the record size; `dest` must have space for
+  // max_record_size bytes.
+  size_t serialise(char* dest, Time capture_time, const TickTop&);
+  size_t serialise(char* dest, Time capture_time, const TickTrade&);
+
+  /* Decode the record at `src`, of which `avail` bytes are readable,
+   * returning its size, or zero if the record is incomplete; throws for a
+   * malformed record. */
+  size_t deserialise(const char* src, size_t avail, Record&);
+
+  /* Size of the record at `src`, or zero if incomplete */
+  static size_t record_size(const char* src, size_t avail);
+
+  /* Capture time of the record at `src`, if a complete key record */
+  static bool key_time(const char* src, size_t avail, uint64_t& capture_time);
+
+private:
+  struct Grid {
+    int64_t mantissa;
+    int scale;
 
-  static bytes serialise(Time capture_time, TickTop& src);
-  static bytes serialise(Time capture_time, TickTrade& src);
+    bool to_steps(double value, int64_t& steps) const;
+    double from_steps(int64_t steps) const;
+  };
 
-  static void deserialise(char * buf, TickTop&);
-  static void deserialise(char * buf, TickTrade&);
+  uint8_t begin_record(char*& ptr, MsgType, uint64_t capture_time);
 
+  Grid _tick;
+  Grid _lot;
+  bool _key = true;
+  uint64_t _time = 0;
+  int64_t _bid = 0;
+  int64_t _ask = 0;
+  int64_t _price = 0;
 };
 
 
@@ -0,0 +1,238 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/UniverseTickFile.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <queue>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+static MdStream parse_channel(const std::string& channel,
+                              const fs::path& fn)
+{
+  if (channel == "l1")
+    return MdStream::L1;
+  if (channel == "aggtrades")
+    return MdStream::AggTrades;
+  THROW("tick file " << fn << " has unsupported channel " << QUOTE(channel));
+}
+
+
+// Return the meta-data of a mapped tickbin file, and its preamble length.
+static std::pair<json, size_t> read_tickbin_meta(const MappedFile& file)
+{
+  if (file.size() < TickbinHeader::header_lead_length)
+    THROW("tick file has incomplete file header " << file.path());
+  auto header = decode_tickbin_file_header(file.begin());
+  if (header.length > file.size())
+    THROW("tick file is truncated " << file.path());
+  auto meta = json::parse(file.begin() + TickbinHeader::header_lead_length,
+                          file.begin() + header.length);
+  return {std::move(meta), header.length};
+}
+
+
+size_t build_universe_tick_file(const std::vector<std::filesystem::path>& inputs,
+                                const std::filesystem::path& dest)
+{
+  if (inputs.size() > UINT16_MAX)
+    THROW("too many streams for a universe tick file: " << inputs.size());
+
+  struct Input {
+    std::unique_ptr<MappedFile> file;
+    const char* head;
+  };
+  std::vector<Input> files;
+  json streams = json::array();
+  for (auto& fn : inputs) {
+    auto file = std::make_unique<MappedFile>(fn);
+    auto [meta, header_len] = read_tickbin_meta(*file);
+    auto version = decode_tickbin_file_header(file->begin()).version;
+    if (version != "TICK1")
+      THROW("cannot merge tick file " << fn << " of version " << QUOTE(version));
+    auto channel = get_string_field(meta, "c");
+    parse_channel(channel, fn);
+
+    json stream;
+    stream["i"] = get_string_field(meta, "i");
+    stream["e"] = meta["e"];
+    stream["s"] = meta["s"];
+    stream["c"] = channel;
+    streams.push_back(std::move(stream));
+
+    const char* head = file->begin() + header_len;
+    files.push_back({std::move(file), head});
+  }
+
+  auto next_record = [&files](size_t i) -> const tickbin::Header* {
+    auto& input = files[i];
+    if (input.head + sizeof(tickbin::Header) > input.file->end())
+      return nullptr;
+    auto* head = reinterpret_cast<const tickbin::Header*>(input.head);
+    if (head->size < sizeof(tickbin::Header) ||
+        input.head + head->size > input.file->end())
+      return nullptr;
+    return head;
+  };
+
+  // merge by capture time; ties are taken in input order
+  using Entry = std::pair<uint64_t, size_t>;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  for (size_t i = 0; i < files.size(); ++i)
+    if (auto head = next_record(i))
+      queue.push({head->capture_time, i});
+
+  json meta;
+  meta["streams"] = std::move(streams);
+  auto preamble = encode_tickbin_file_header(tickuni::version, meta);
+
+  if (dest.has_parent_path())
+    fs::create_directories(dest.parent_path());
+  std::ofstream os(dest, std::ios::binary | std::ios::trunc);
+  if (!os)
+    THROW("failed to open universe tick file " << dest);
+  os.write(preamble.data(), preamble.size());
+
+  size_t count = 0;
+  while (!queue.empty()) {
+    auto i = queue.top().second;
+    queue.pop();
+
+    auto head = next_record(i);
+    tickuni::Header uni{static_cast<uint16_t>(i)};
+    os.write(reinterpret_cast<const char*>(&uni), sizeof(uni));
+    os.write(files[i].head, head->size);
+    files[i].head += head->size;
+    count++;
+
+    if (auto next = next_record(i))
+      queue.push({next->capture_time, i});
+  }
+
+  os.close();
+  if (os.fail())
+    THROW("failed to write universe tick file " << dest);
+  return count;
+}
+
+
+UniverseTickReplayer::UniverseTickReplayer(std::filesystem::path fn,
+                                           Time replay_from,
+                                           TickFileCache* cache,
+                                           const MmapOptions& mmap_options)
+  : _fn(std::move(fn)),
+    _replay_from(replay_from)
+{
+  if (!fs::exists(_fn) || !fs::is_regular_file(_fn))
+    THROW("universe tick file not found " << _fn);
+  LOG_INFO("reading universe tick file " << _fn);
+
+  if (cache)
+    _file = cache->open(_fn, mmap_options);
+  else
+    _file = std::make_shared<const MappedFile>(_fn, mmap_options);
+  _window = MappedFileWindow(_file.get(), mmap_options.window,
+                             mmap_options.release && !cache);
+
+  auto [meta, header_len] = read_tickbin_meta(*_file);
+  auto version = decode_tickbin_file_header(_file->begin()).version;
+  if (version != tickuni::version)
+    THROW("file " << _fn << " has tickbin version " << QUOTE(version)
+          << ", expected " << QUOTE(tickuni::version));
+
+  for (auto& item : meta.at("streams"))
+    _streams.push_back({get_string_field(item, "i"),
+                        parse_channel(get_string_field(item, "c"), _fn)});
+  _head = _file->begin() + header_len;
+}
+
+
+bool UniverseTickReplayer::subscribe(const std::string& instrument_id,
+                                     MdStream stream_type,
+                                     MarketData* mktdata)
+{
+  bool found = false;
+  for (auto& stream : _streams)
+    if (stream.instrument_id == instrument_id &&
+        stream.stream_type == stream_type) {
+      stream.mktdata = mktdata;
+      found = true;
+    }
+  return found;
+}
+
+
+Time UniverseTickReplayer::get_next_event_time()
+{
+  constexpr size_t min_record = sizeof(tickuni::Header) + sizeof(tickbin::Header);
+  const uint64_t from = _replay_from.as_epoch_us().count();
+
+  // skip records of streams without a subscriber, and before the replay start
+  while (_head + min_record <= _file->end()) {
+    tickuni::Header uni;
+    tickbin::Header head;
+    memcpy(&uni, _head, sizeof(uni));
+    memcpy(&head, _head + sizeof(uni), sizeof(head));
+    if (uni.stream >= _streams.size() || head.size < sizeof(tickbin::Header) ||
+        _head + sizeof(uni) + head.size > _file->end())
+      THROW("universe tick file is corrupt, offset "
+            << (_head - _file->begin()) << ", file " << _fn);
+
+    if (_streams[uni.stream].mktdata && head.capture_time >= from)
+      return Time{std::chrono::microseconds(head.capture_time)};
+
+    _head += sizeof(uni) + head.size;
+  }
+  return Time{};
+}
+
+
+void UniverseTickReplayer::consume_next_event()
+{
+  // called after get_next_event_time, so the head is a valid, subscribed record
+  tickuni::Header uni;
+  memcpy(&uni, _head, sizeof(uni));
+  const char* record = _head + sizeof(uni);
+  auto& stream = _streams[uni.stream];
+
+  if (stream.stream_type == MdStream::L1) {
+    TickTop tick;
+    tickbin::Serialiser::deserialise(record, tick);
+    stream.mktdata->apply(tick);
+  }
+  else {
+    TickTrade tick;
+    tickbin::Serialiser::deserialise(record, tick);
+    stream.mktdata->apply(tick);
+  }
+
+  tickbin::Header head;
+  memcpy(&head, record, sizeof(head));
+  _head = record + head.size;
+  _window.advance(_head - _file->begin());
+}
+
+} // namespace apex
@@ -0,0 +1,100 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/util/Time.hpp>
+#include <apex/util/json.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* A universe tick file is a time ordered merge of many tickbin streams, e.g.
+ * the L1 and trade streams of every instrument of a backtest universe, so that
+ * a backtest reads one file through one event source.  After the usual tickbin
+ * preamble, whose meta-data lists the streams held, each record is a stream
+ * number followed by the original tickbin record. */
+namespace tickuni {
+
+constexpr const char* version = "TICKU";
+
+#pragma pack(push, 1)
+
+struct Header {
+  uint16_t stream; // position of the stream in the meta-data "streams" list
+};
+
+#pragma pack(pop)
+
+} // namespace tickuni
+
+
+/* Merge tickbin version 1 files into a universe tick file, returning the number
+ * of records written.  Each input file holds a single stream. */
+size_t build_universe_tick_file(const std::vector<std::filesystem::path>& inputs,
+                                const std::filesystem::path& dest);
+
+
+/* Replays a universe tick file, fanning events out to the MarketData of each
+ * subscribed stream.  Records of streams without a subscriber are skipped. */
+class UniverseTickReplayer : public BacktestEventSource
+{
+public:
+  UniverseTickReplayer(std::filesystem::path fn,
+                       Time replay_from,
+                       TickFileCache* cache = nullptr,
+                       const MmapOptions& mmap_options = {});
+
+  /* Direct a stream to MarketData; returns false if the file doesn't hold the
+   * stream.  Subscribe before replay starts, since skipped records are not
+   * revisited. */
+  bool subscribe(const std::string& instrument_id, MdStream, MarketData*);
+
+  Time get_next_event_time() override;
+  void consume_next_event() override;
+  void init_backtest_time_range(Time, Time) override {}
+  const char* event_source_kind() const override { return "ticks"; }
+
+  [[nodiscard]] size_t stream_count() const { return _streams.size(); }
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _fn; }
+
+private:
+  struct Stream {
+    std::string instrument_id;
+    MdStream stream_type;
+    MarketData* mktdata = nullptr;
+  };
+
+  std::filesystem::path _fn;
+  Time _replay_from;
+  std::shared_ptr<const MappedFile> _file;
+  MappedFileWindow _window;
+  std::vector<Stream> _streams;
+  const char* _head = nullptr;
+};
+
+} // namespace apex
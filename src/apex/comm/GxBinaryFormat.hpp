@@ -0,0 +1,166 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace apex
+{
+namespace gx
+{
+namespace bin
+{
+
+/* Fixed layout encoding of the high rate GX messages, used instead of proto3
+ * when a message header carries Flags::binary.  Structs are packed and in host
+ * order, which must be little-endian, so decoding is a cast of the payload.
+ * Tick messages carry no symbol: the header id holds the subscription id that
+ * the client chose when subscribing.  Order ids are held in fixed length
+ * fields; a message with a longer id is sent as proto3 instead. */
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "GX binary encoding requires a little-endian host");
+
+constexpr size_t id_size = 32;
+
+#pragma pack(push, 1)
+
+struct TickTop {
+  double bid_price;
+  double bid_qty;
+  double ask_price;
+  double ask_qty;
+  uint64_t rt; // latency trace stamps, see trace::Stamp
+  uint64_t st;
+};
+
+struct TickTrade {
+  double price;
+  double qty;
+  int64_t xt; // usec since epoch
+  int64_t et; // usec since epoch
+  uint8_t aggr_side;
+  uint64_t rt;
+  uint64_t st;
+};
+
+struct OrderExec {
+  char order_id[id_size];
+  char ext_order_id[id_size];
+  uint32_t order_state;
+  uint32_t close_reason;
+  uint8_t reason; // pb::OrderUpdateReason
+};
+
+struct OrderFill {
+  char order_id[id_size];
+  double size;
+  double price;
+  uint8_t fully_filled;
+};
+
+constexpr size_t shm_name_size = 64;
+
+// Negotiation of the shared memory transport; see GxSessionBase.
+struct ShmAttach {
+  enum Stage : uint8_t {
+    offer = 1,  // client has created the rings
+    accept = 2, // server has opened the rings, and now sends via its ring
+    reject = 3,
+    commit = 4, // client now sends via its ring
+  };
+
+  uint8_t stage;
+  char client_ring[shm_name_size]; // written by the client
+  char server_ring[shm_name_size]; // written by the server
+};
+
+/* Multicast distribution of ticks.  Each datagram holds an McastHeader,
+ * followed by one binary tick message, header in network order, with a zero
+ * id.  Each exchange subscription publishes on its own channel, with
+ * sequence numbers that increase by one per datagram, so a receiver can
+ * detect loss and request recovery over the GX session. */
+constexpr uint32_t mcast_magic = 0x5458474d; // "MGXT"
+
+struct McastHeader {
+  uint32_t magic;
+  uint32_t channel;
+  uint64_t seq;
+};
+
+constexpr size_t mcast_group_size = 40;
+
+// Server reply to a multicast subscription, addressed with its id.
+struct McastChannel {
+  uint32_t channel;
+  char group[mcast_group_size];
+  uint16_t port;
+  uint64_t next_seq; // sequence number of the next datagram published
+};
+
+// Client request to resend the trades of a sequence range, inclusive.
+struct McastRecover {
+  uint32_t channel;
+  uint64_t from_seq;
+  uint64_t to_seq;
+};
+
+// Client probe of the link, answered at once by the server.  Times are
+// nanoseconds of CLOCK_REALTIME, each taken by the process that stamps it.
+struct Ping {
+  int64_t t1; // client send time
+};
+
+struct Pong {
+  int64_t t1; // echoed from the ping
+  int64_t t2; // server receive time
+  int64_t t3; // server send time
+};
+
+#pragma pack(pop)
+
+
+// Copy an id into a fixed length field, unless it is too long.
+inline bool set_id(char (&dest)[id_size], std::string_view src)
+{
+  if (src.size() > id_size)
+    return false;
+  memset(dest, 0, id_size);
+  memcpy(dest, src.data(), src.size());
+  return true;
+}
+
+inline std::string get_id(const char (&src)[id_size])
+{
+  return {src, strnlen(src, id_size)};
+}
+
+// Cast a received payload to a binary message, if it has the expected size.
+template<typename T>
+const T* cast(const char* payload, size_t payload_len)
+{
+  return payload_len == sizeof(T) ? reinterpret_cast<const T*>(payload)
+                                  : nullptr;
+}
+
+} // namespace bin
+} // namespace gx
+} // namespace apex
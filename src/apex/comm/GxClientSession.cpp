@@ -16,18 +16,49 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/comm/GxClientSession.hpp>
+#include <apex/comm/GxBinaryFormat.hpp>
 #include <apex/model/Account.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/model/Order.hpp>
 #include <apex/core/OrderService.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/util/Metrics.hpp>
+#include <apex/util/Profiler.hpp>
+#include <apex/util/RawCapture.hpp>
+
+#include <algorithm>
 
 #include <netinet/in.h>
 
 namespace apex
 {
 
+static metrics::Counter& gx_client_ticks = metrics::registry().counter(
+    "apex_gx_client_ticks_total", "Ticks received by GX client sessions");
+static metrics::Counter& gx_client_orders = metrics::registry().counter(
+    "apex_gx_client_orders_total", "Orders sent by GX client sessions");
+static metrics::Counter& gx_client_connects = metrics::registry().counter(
+    "apex_gx_client_connects_total", "GX client session connections made");
+static metrics::Histogram& gx_client_tick_latency =
+    metrics::registry().histogram(
+        "apex_gx_client_tick_latency_ns",
+        "Traced ticks, from gateway receipt to decode by the GX client");
+
+static metrics::Counter& gx_client_probes = metrics::registry().counter(
+    "apex_gx_client_probes_total", "GX link probes answered");
+static metrics::Counter& gx_client_stale_trades = metrics::registry().counter(
+    "apex_gx_client_stale_trades_total",
+    "Trades received later than the stale limit after their exchange time");
+
+// the stamp has just been advanced to the decode stage, so needs no clock read
+static void record_tick_latency(const trace::Stamp& stamp)
+{
+  if (stamp.is_traced() && trace::tracer().is_enabled())
+    gx_client_tick_latency.record(stamp.st > stamp.rt ? stamp.st - stamp.rt
+                                                      : 0);
+}
+
 
 static apex::pb::Exchange to_exchange(apex::ExchangeId id) {
   switch (id) {
@@ -45,6 +76,23 @@ static apex::pb::Exchange to_exchange(apex::ExchangeId id) {
 }
 
 
+static apex::ExchangeId from_exchange(apex::pb::Exchange id)
+{
+  switch (id) {
+    case apex::pb::exchange_none:
+      return ExchangeId::none;
+    case apex::pb::exchange_binance:
+      return ExchangeId::binance;
+    case apex::pb::exchange_binance_usdfut:
+      return ExchangeId::binance_usdfut;
+    case apex::pb::exchange_binance_coinfut:
+      return ExchangeId::binance_coinfut;
+    default:
+      throw std::runtime_error("invalid pb::Exchange during conversion to ExchangeId");
+  }
+}
+
+
 static apex::pb::Side to_side(apex::Side side)
 {
   switch (side) {
@@ -66,6 +114,14 @@ GxClientSession::GxClientSession(IoLoop& ioloop, RealtimeEventLoop& evloop,
   : GxSessionBase<GxClientSession>(ioloop, evloop, {}),
     _remote_addr(addr),
     _remote_port(port),
+    _session_feed(std::make_unique<FeedStats>("gateway=\"" + addr + ":" +
+                                              port + "\"")),
+    _rtt_gauge(&metrics::registry().gauge(
+        "apex_gx_client_rtt_ns{gateway=\"" + addr + ":" + port + "\"}",
+        "GX link round trip time, excluding the server's handling")),
+    _clock_offset_gauge(&metrics::registry().gauge(
+        "apex_gx_client_clock_offset_ns{gateway=\"" + addr + ":" + port + "\"}",
+        "GX server clock less the client clock")),
     _order_service(order_service),
     m_connected_subject(
         [this](std::function<void(const bool&)> fn, const bool& value) {
@@ -87,6 +143,170 @@ void GxClientSession::start_connecting()
     }
     return std::chrono::milliseconds(1000);
   });
+
+  if (_probe_interval.count() > 0)
+    _event_loop.dispatch(_probe_interval, [wp]() {
+      if (auto sp = wp.lock()) {
+        sp->send_probe();
+        return sp->_probe_interval;
+      }
+      return std::chrono::milliseconds(0);
+    });
+
+  _event_loop.dispatch(std::chrono::milliseconds(1000), [wp]() {
+    if (auto sp = wp.lock()) {
+      sp->publish_feed_latency();
+      return std::chrono::milliseconds(1000);
+    }
+    return std::chrono::milliseconds(0);
+  });
+}
+
+
+GxClientSession::FeedStats::FeedStats(const std::string& labels)
+  : median(&metrics::registry().gauge(
+        "apex_feed_lag_median_us{" + labels + "}",
+        "Median lag of trades, from exchange event time to receipt")),
+    p99(&metrics::registry().gauge("apex_feed_lag_p99_us{" + labels + "}",
+                                   "99th percentile lag of trades")),
+    min(&metrics::registry().gauge(
+        "apex_feed_lag_min_us{" + labels + "}",
+        "Least lag of trades, tracking the exchange clock skew")),
+    drift(&metrics::registry().gauge(
+        "apex_feed_lag_drift_us_per_s{" + labels + "}",
+        "Trend of the lag of trades, in microseconds per second"))
+{
+}
+
+
+void GxClientSession::publish_feed_latency()
+{
+  auto publish = [](FeedStats& feed) {
+    if (feed.latency.size() == 0)
+      return;
+    auto stats = feed.latency.stats();
+    feed.median->set(stats.median_us);
+    feed.p99->set(stats.p99_us);
+    feed.min->set(stats.min_us);
+    feed.drift->set(static_cast<int64_t>(stats.drift_us_per_sec));
+  };
+  publish(*_session_feed);
+  for (auto& feed : _feed_stats)
+    if (feed)
+      publish(*feed);
+}
+
+
+FeedLatency::Stats GxClientSession::feed_latency() const
+{
+  return _session_feed->latency.stats();
+}
+
+
+FeedLatency::Stats GxClientSession::feed_latency(
+    const std::string& symbol) const
+{
+  for (auto& feed : _feed_stats)
+    if (feed && feed->symbol == symbol)
+      return feed->latency.stats();
+  return {};
+}
+
+
+// Record the lag of a trade, and apply the stale checks; returns false if the
+// trade is to be dropped.
+bool GxClientSession::check_trade(gx::t_msgid msg_id, MarketData& target,
+                                  const TickTrade& tick, Time received)
+{
+  if (tick.et.empty())
+    return true;
+
+  auto lag = _session_feed->latency.record(tick.et, received);
+  FeedStats* feed = msg_id < _feed_stats.size() ? _feed_stats[msg_id].get()
+                                                 : nullptr;
+  if (feed)
+    feed->latency.record(tick.et, received);
+
+  if (_feed_checks.stale_after.count() == 0)
+    return true;
+  const bool stale = lag > _feed_checks.stale_after;
+  if (stale != target.is_stale()) {
+    auto symbol = feed ? feed->symbol : std::string("subscription ") +
+                                            std::to_string(msg_id);
+    if (stale)
+      LOG_WARN(symbol << ": trades are stale, lag " << lag.count() << "us");
+    else
+      LOG_INFO(symbol << ": trades no longer stale");
+    target.set_stale(stale);
+  }
+  if (stale) {
+    gx_client_stale_trades.add();
+    return !_feed_checks.drop_stale;
+  }
+  return true;
+}
+
+
+void GxClientSession::send_probe()
+{
+  if (!is_connected())
+    return;
+  gx::bin::Ping req;
+  try {
+    send_frame(sizeof(gx::Header) + sizeof(req), [&](char* dest) {
+      auto* header = reinterpret_cast<gx::Header*>(dest);
+      gx::Header::init(header, sizeof(req), gx::Type::ping,
+                       static_cast<uint8_t>(gx::Flags::binary));
+      header->hton();
+      req.t1 = static_cast<int64_t>(trace::now_ns());
+      memcpy(dest + sizeof(gx::Header), &req, sizeof(req));
+    });
+  } catch (std::exception& e) {
+    LOG_WARN("unable to send GX probe: " << e.what());
+  }
+}
+
+
+// A probe of least round trip time is the one least distorted by queueing,
+// so gives the best estimate of the clock offset; the minimum is taken over a
+// short window, so that the estimate follows any drift of the clocks.
+void GxClientSession::io_on_pong(const gx::bin::Pong& msg)
+{
+  const auto t4 = static_cast<int64_t>(trace::now_ns());
+  ProbeSample sample;
+  sample.rtt_ns = (t4 - msg.t1) - (msg.t3 - msg.t2);
+  sample.offset_ns = ((msg.t2 - msg.t1) + (msg.t3 - t4)) / 2;
+  if (sample.rtt_ns < 0)
+    sample.rtt_ns = 0;
+
+  ProbeSample best;
+  {
+    auto lock = std::scoped_lock(_probe_lock);
+    _probe_samples[_probe_count++ % probe_window] = sample;
+    auto n = std::min(_probe_count, probe_window);
+    best = _probe_samples[0];
+    for (size_t i = 1; i < n; i++)
+      if (_probe_samples[i].rtt_ns < best.rtt_ns)
+        best = _probe_samples[i];
+  }
+
+  _rtt_ns.store(best.rtt_ns);
+  _clock_offset_ns.store(best.offset_ns);
+  _probes_answered++;
+  _rtt_gauge->set(best.rtt_ns);
+  _clock_offset_gauge->set(best.offset_ns);
+  gx_client_probes.add();
+}
+
+
+// Convert a stamp taken on the server clock to the client clock.
+void GxClientSession::correct_clock(trace::Stamp& stamp) const
+{
+  auto offset = _clock_offset_ns.load(std::memory_order_relaxed);
+  if (!stamp.is_traced() || offset == 0)
+    return;
+  stamp.rt = static_cast<uint64_t>(static_cast<int64_t>(stamp.rt) - offset);
+  stamp.st = static_cast<uint64_t>(static_cast<int64_t>(stamp.st) - offset);
 }
 
 
@@ -106,6 +326,7 @@ void GxClientSession::check_connection()
       return;
 
     if (_sock->is_closed()) {
+      shm_stop();
       _sock.reset();
       m_connected_subject.next(false);
       return;
@@ -141,17 +362,36 @@ void GxClientSession::check_connection()
         // this call to _sock->close is needed
         // because the _sock still reports a state of
         // is_connected()==true, even though a socket error
-        // has occurred.
-        session._sock->close();
+        // has occurred.  Once closed, the loss is reported at once, rather
+        // than at the next periodic check, so a standby can take over.
+        auto wp = session.weak_from_this();
+        session._sock->close([wp]() {
+          if (auto sp = wp.lock())
+            sp->_event_loop.dispatch([wp]() {
+              if (auto sp = wp.lock()) {
+                try {
+                  sp->check_connection();
+                } catch (std::exception& err) {
+                  LOG_WARN("check-connection error: " << err.what());
+                }
+              }
+            });
+        });
       });
 
+      // subsequent messages use shared memory, once the server accepts
+      this->shm_offer();
+
       for (auto& item : _active_subs) {
         _pending_subs.push_back(std::move(item.second));
       }
       _active_subs.clear();
+      for (auto& item : _account_subs)
+        _pending_subs_2.push_back(item.second);
 
       this->perform_subscriptions();
 
+      gx_client_connects.add();
       m_connected_subject.next(true);
     } else {
       auto fut_status = _pending_sock_fut.wait_for(std::chrono::seconds(0));
@@ -187,79 +427,201 @@ void GxClientSession::subscribe_account(std::string exchange, Account& target)
 }
 
 
-void GxClientSession::subscribe(std::string symbol, ExchangeId exchange, apex::MarketData* mv)
+void GxClientSession::subscribe(std::string symbol, ExchangeId exchange,
+                                apex::MarketData* mv, int streams)
 {
-  // TODO: protect with mutex, or perform on event thread
-  //_subs.insert({symbol, });
+  std::vector<MarketViewSubscription> subs;
+  subs.push_back({std::move(symbol), exchange, mv, streams});
+  subscribe(std::move(subs));
+}
 
-  MarketViewSubscription sub {symbol, exchange, mv};
 
+void GxClientSession::subscribe(std::vector<MarketViewSubscription> subs)
+{
+  // Subscriptions are sent by a later event, so that those made in succession
+  // are queued by then, and sent together.
   auto wp = weak_from_this();
-  this->_event_loop.dispatch([wp, sub]() {
+  this->_event_loop.dispatch([wp, subs = std::move(subs)]() mutable {
     if (auto sp = wp.lock()) {
-      sp->_pending_subs.push_back(sub);
-      sp->perform_subscriptions();
+      for (auto& sub : subs)
+        sp->_pending_subs.push_back(std::move(sub));
+      if (sp->_subscriptions_scheduled)
+        return;
+      sp->_subscriptions_scheduled = true;
+      sp->_event_loop.dispatch([wp]() {
+        if (auto sp = wp.lock()) {
+          sp->_subscriptions_scheduled = false;
+          sp->perform_subscriptions();
+        }
+      });
     }
   });
 }
 
 
+void GxClientSession::assign_subscription(MarketViewSubscription& item,
+                                          gx::t_msgid id)
+{
+  // id zero is not used
+  if (_subscription_targets.size() <= id)
+    _subscription_targets.resize(id + 1, nullptr);
+  item.subscription_id = id;
+  _subscription_targets[id] = item.mv;
+  if (_feed_stats.size() < _subscription_targets.size())
+    _feed_stats.resize(_subscription_targets.size());
+  _feed_stats[id] = std::make_unique<FeedStats>(
+      "gateway=\"" + _remote_addr + ":" + _remote_port + "\",symbol=\"" +
+      item.symbol + "\"");
+  _feed_stats[id]->symbol = item.symbol;
+}
+
+
+void GxClientSession::capture_subscription(const MarketViewSubscription& item)
+{
+  // captured as the subscribe request that assigned the id, in host order
+  auto& msg = _tx_messages.get<apex::pb::SubscribeTicks>();
+  msg.set_symbol(item.symbol);
+  msg.set_exchange(to_exchange(item.exchange));
+  msg.set_streams(item.streams);
+  auto payload = msg.SerializeAsString();
+
+  std::string frame(sizeof(gx::Header), '\0');
+  gx::Header::init(reinterpret_cast<gx::Header*>(frame.data()), payload.size(),
+                   gx::Type::subscribe, static_cast<uint8_t>(gx::Flags::proto3));
+  reinterpret_cast<gx::Header*>(frame.data())->id = item.subscription_id;
+  frame += payload;
+  _capture->write(capture_stream, std::move(frame));
+}
+
+
+void GxClientSession::replay_frame(std::string_view frame, Time received)
+{
+  if (frame.size() < sizeof(gx::Header))
+    return;
+  _replay_frame.assign(frame);
+  auto* header = reinterpret_cast<gx::Header*>(_replay_frame.data());
+  const size_t payload_len = _replay_frame.size() - sizeof(gx::Header);
+
+  switch (header->type) {
+    case gx::Type::subscribe: {
+      auto& msg =
+          _rx_messages.parse<apex::pb::SubscribeTicks>(header->payload, payload_len);
+      auto iter = std::find_if(
+          _pending_subs.begin(), _pending_subs.end(),
+          [&](const auto& item) { return item.symbol == msg.symbol(); });
+      if (iter != _pending_subs.end()) {
+        assign_subscription(*iter, header->id);
+        _active_subs.insert_or_assign(iter->symbol, std::move(*iter));
+        _pending_subs.erase(iter);
+        return;
+      }
+      LOG_WARN("captured subscription of " << QUOTE(msg.symbol())
+               << " not subscribed in replay");
+      return;
+    }
+    case gx::Type::order_exec:
+    case gx::Type::order_fill:
+    case gx::Type::om_logon:
+    case gx::Type::account_update:
+    case gx::Type::error:
+    case gx::Type::pong:
+    case gx::Type::mcast_channel:
+      return;
+    default:
+      break;
+  }
+
+  _replay_received = received;
+  io_on_full_message(header, header->payload, payload_len);
+  _replay_received = {};
+}
+
+
 void GxClientSession::perform_subscriptions()
 {
   assert(_event_loop.this_thread_is_ev());
   if (!_sock || !_sock->is_connected())
     return;
 
+  auto flags = request_flags();
+  if (_multicast && _binary)
+    flags |= static_cast<uint8_t>(gx::Flags::multicast);
+
+  // several subscriptions are sent as batches, each within the message size
+  // limit of the header
+  const size_t max_batch_bytes = 32 * 1024;
+  pb::SubscribeTicksBatch* batch = nullptr;
+  size_t batch_bytes = 0;
+  auto send_batch = [&]() {
+    if (batch && batch->items_size())
+      send_message(gx::Type::subscribe_batch, 0, *batch, flags);
+    batch = nullptr;
+  };
+
   for (auto& item : this->_pending_subs) {
-    // TODO/EASY: check if exists, return if so
-    this->_ticks_subscription.insert({item.symbol, item.mv});
-    this->_active_subs.insert({item.symbol, item});
+    // a further subscription of the same target adds to its streams
+    auto active = _active_subs.find(item.symbol);
+    if (item.subscription_id == 0 && active != std::end(_active_subs) &&
+        active->second.mv == item.mv) {
+      item.subscription_id = active->second.subscription_id;
+      if (item.streams && active->second.streams)
+        item.streams |= active->second.streams;
+      else
+        item.streams = 0;
+    }
 
-    // construct wire-protocol message
-    apex::pb::SubscribeTicks msg;
-    msg.set_symbol(item.symbol);
-    msg.set_exchange(to_exchange(item.exchange));
+    // a subscription keeps its id across reconnects
+    if (item.subscription_id == 0) {
+      assign_subscription(
+          item, static_cast<gx::t_msgid>(
+                    std::max<size_t>(_subscription_targets.size(), 1)));
+      if (_capture)
+        capture_subscription(item);
+    }
 
-    // build wire format
-    auto payload = msg.SerializeAsString();
-    apex::gx::Header header;
-    uint16_t flags = static_cast<uint16_t>(apex::gx::Flags::proto3);
-    apex::gx::Header::init(&header, payload.size(), gx::Type::subscribe, flags);
-    header.hton();
+    this->_active_subs.insert_or_assign(item.symbol, item);
 
-    // socket write/queue
-    _sock->write((char*)&header, sizeof(header));
-    _sock->write(payload.data(), payload.size());
+    if (_pending_subs.size() == 1) {
+      // construct wire-protocol message
+      auto& msg = _tx_messages.get<apex::pb::SubscribeTicks>();
+      msg.set_symbol(item.symbol);
+      msg.set_exchange(to_exchange(item.exchange));
+      msg.set_streams(item.streams);
+
+      // socket write/queue
+      send_message(gx::Type::subscribe, item.subscription_id, msg, flags);
+      continue;
+    }
+
+    const size_t item_bytes = item.symbol.size() + 16;
+    if (batch && (batch->items_size() == max_batch_subscriptions ||
+                  batch_bytes + item_bytes > max_batch_bytes))
+      send_batch();
+    if (!batch) {
+      batch = &_tx_messages.get<apex::pb::SubscribeTicksBatch>();
+      batch_bytes = 0;
+    }
+    auto* msg = batch->add_items();
+    msg->set_symbol(item.symbol);
+    msg->set_exchange(to_exchange(item.exchange));
+    msg->set_subscription_id(item.subscription_id);
+    msg->set_streams(item.streams);
+    batch_bytes += item_bytes;
   }
+  send_batch();
   _pending_subs.clear();
 
-  /* Variants */
-
-  // for (auto& item : _pending_subs_2) {
-  //   if (std::holds_alternative<AccountSubscription>(item)) {
-  //     apex::pb::SubscribeWallet msg;
-  //     AccountSubscription& sub = std::get<AccountSubscription>(item);
-
-  //     msg.set_exchange(std::get<AccountSubscription>(item).exchange);
-  //     LOG_INFO("REMEMBER TO ADD THESE TO A LIST FOR REUSE ON RECONNECT");
-
-  //     // build wire format
-  //     auto payload = msg.SerializeAsString();
-  //     apex::gx::Header header;
-  //     uint16_t flags = static_cast<uint16_t>(apex::gx::Flags::proto3);
-  //     apex::gx::Header::init(&header, payload.size(),
-  //                           gx::Type::subscribe_account, flags);
-  //     header.hton();
-
-  //     // socket write/queue
-  //     _sock->write((char*)&header, sizeof(header));
-  //     _sock->write(payload.data(), payload.size());
-  //     LOG_INFO("written " << sizeof(header) + payload.size()
-  //                         << " bytes to socket");
-
-  //     _account_subs.insert({sub.exchange, std::move(sub)});
-  //   }
-  // }
+  // account subscriptions are kept, to be made again on reconnect; the
+  // server replies with the balances held, then sends only changes
+  for (auto& item : _pending_subs_2) {
+    if (auto* sub = std::get_if<AccountSubscription>(&item)) {
+      auto exchange = to_exchange_id(sub->exchange);
+      auto& msg = _tx_messages.get<apex::pb::SubscribeWallet>();
+      msg.set_exchange(to_exchange(exchange));
+      send_message(gx::Type::subscribe_account, 0, msg);
+      _account_subs.insert_or_assign(exchange_id_to_string(exchange), *sub);
+    }
+  }
   _pending_subs_2.clear();
 }
 
@@ -268,88 +630,193 @@ void GxClientSession::io_on_full_message(gx::Header* header, char* payload,
                                          size_t payload_len)
 {
   /* IO-thread */
+  APEX_PROFILE_ZONE("GxClientSession::io_on_full_message");
+  if (_capture)
+    _capture->write(capture_stream,
+                    std::string_view(reinterpret_cast<const char*>(header),
+                                     sizeof(gx::Header) + payload_len));
   gx::Type type = (gx::Type)header->type;
   const auto flags = header->flags;
+  const bool binary = flags & static_cast<uint8_t>(gx::Flags::binary);
+  if (type == gx::Type::trade || type == gx::Type::tick_top) {
+    gx_client_ticks.add();
+    if (!_feed_active.load(std::memory_order_relaxed))
+      return; // duplicates the ticks of the active session
+  }
 
-  if (type == gx::Type::trade) {
-    apex::pb::TickTrade msg;
-    msg.ParseFromArray(payload, payload_len);
-    _event_loop.dispatch([wp = weak_from_this(), msg]() mutable {
-      if (auto sp = wp.lock()) {
-        auto iter = sp->_ticks_subscription.find(msg.symbol());
-        if (iter != std::end(sp->_ticks_subscription)) {
-          TickTrade tick;
-          tick.price = msg.price();
-          tick.qty = msg.size();
-          switch (msg.side()) {
-            case apex::pb::Side::side_buy:
-              tick.aggr_side = apex::Side::buy;
-              break;
-            case apex::pb::Side::side_sell:
-              tick.aggr_side = apex::Side::sell;
-              break;
-            case apex::pb::Side::side_none:
-              tick.aggr_side = apex::Side::none;
-              break;
-            default: {
-              LOG_ERROR("dropping GxTickTrade message, invalid side");
-              return;
+  if (binary) {
+    // fixed layout messages are decoded in place
+    auto wp = weak_from_this();
+    const auto msg_id = header->id;
+    if (type == gx::Type::tick_top) {
+      if (auto* msg = gx::bin::cast<gx::bin::TickTop>(payload, payload_len)) {
+        TickTop tick;
+        tick.bid_price = msg->bid_price;
+        tick.bid_qty = msg->bid_qty;
+        tick.ask_price = msg->ask_price;
+        tick.ask_qty = msg->ask_qty;
+        tick.trace = {msg->rt, msg->st};
+        correct_clock(tick.trace);
+        trace::tracer().mark(trace::Stage::gx_decode, tick.trace);
+        record_tick_latency(tick.trace);
+        _event_loop.dispatch(EventLoop::inline_fn([wp, msg_id, tick]() mutable {
+          if (auto sp = wp.lock()) {
+            if (msg_id < sp->_subscription_targets.size() &&
+                sp->_subscription_targets[msg_id])
+              sp->_subscription_targets[msg_id]->apply(tick);
+            else
+              LOG_WARN("received TickTop for unknown subscription " << msg_id);
+          }
+        }));
+        return;
+      }
+    } else if (type == gx::Type::trade) {
+      if (auto* msg = gx::bin::cast<gx::bin::TickTrade>(payload, payload_len)) {
+        TickTrade tick;
+        tick.price = msg->price;
+        tick.qty = msg->qty;
+        tick.xt = Time{std::chrono::microseconds(msg->xt)};
+        tick.et = Time{std::chrono::microseconds(msg->et)};
+        tick.aggr_side = static_cast<Side>(msg->aggr_side);
+        tick.trace = {msg->rt, msg->st};
+        correct_clock(tick.trace);
+        trace::tracer().mark(trace::Stage::gx_decode, tick.trace);
+        record_tick_latency(tick.trace);
+        auto received =
+            _replay_received.empty() ? Time::fast_now() : _replay_received;
+        _event_loop.dispatch(EventLoop::inline_fn([wp, msg_id, tick,
+                                                   received]() mutable {
+          if (auto sp = wp.lock()) {
+            if (msg_id < sp->_subscription_targets.size() &&
+                sp->_subscription_targets[msg_id]) {
+              auto& target = *sp->_subscription_targets[msg_id];
+              if (sp->check_trade(msg_id, target, tick, received))
+                target.apply(tick);
             }
+            else
+              LOG_WARN("received TickTrade for unknown subscription " << msg_id);
           }
-          iter->second->apply(tick);
-        } else {
-          LOG_ERROR("received unexpected TickTrade event");
-        }
+        }));
+        return;
       }
-    });
-  } else if (type == gx::Type::account_update) {
-    // apex::pb::WalletUpdate msg;
-    // msg.ParseFromArray(payload, payload_len);
-    // _event_loop.dispatch([wp = weak_from_this(), msg]() mutable {
-    //   if (auto sp = wp.lock()) {
-
-    //     // convert from wire to model-update
-    //     apex::AccountUpdate update;
-    //     update.asset.symbol = msg.symbol();
-    //     //update.asset.exchange = msg.exchange();
-    //     update.avail = msg.position();
+    } else if (type == gx::Type::pong) {
+      if (auto* msg = gx::bin::cast<gx::bin::Pong>(payload, payload_len)) {
+        io_on_pong(*msg);
+        return;
+      }
+    } else if (type == gx::Type::mcast_channel) {
+      if (auto* msg = gx::bin::cast<gx::bin::McastChannel>(payload, payload_len)) {
+        io_on_mcast_channel(msg_id, *msg);
+        return;
+      }
+    } else if (type == gx::Type::order_exec) {
+      if (auto* msg = gx::bin::cast<gx::bin::OrderExec>(payload, payload_len)) {
+        _event_loop.dispatch(EventLoop::inline_fn([wp, msg_id, msg = *msg]() {
+          if (auto sp = wp.lock()) {
+            OrderUpdate update;
+            update.state = static_cast<OrderState>(msg.order_state);
+            update.close_reason = static_cast<OrderCloseReason>(msg.close_reason);
+            update.ext_order_id = gx::bin::get_id(msg.ext_order_id);
+            sp->on_order_exec(msg_id,
+                              static_cast<pb::OrderUpdateReason>(msg.reason),
+                              gx::bin::get_id(msg.order_id), update);
+          }
+        }));
+        return;
+      }
+    } else if (type == gx::Type::order_fill) {
+      if (auto* msg = gx::bin::cast<gx::bin::OrderFill>(payload, payload_len)) {
+        _event_loop.dispatch(EventLoop::inline_fn([wp, msg = *msg]() {
+          if (auto sp = wp.lock()) {
+            OrderFill fill;
+            fill.size = msg.size;
+            fill.price = msg.price;
+            fill.is_fully_filled = msg.fully_filled;
+            sp->_order_service->route_fill_to_order(gx::bin::get_id(msg.order_id),
+                                                    fill);
+          }
+        }));
+        return;
+      }
+    }
+    LOG_WARN("unable to handle binary GX message, type: " << (char)type
+             << ", len: " << payload_len);
+    return;
+  }
 
-    //     // apply the model-update
-    //     auto iter = sp->_account_subs.find(msg.exchange());
-    //     if (iter != std::end(sp->_account_subs)) {
-    //       iter->second.model->apply(update);
-    //     } else {
-    //       LOG_WARN("unexpected AccountUpdate, exchange '" << msg.exchange()
-    //                                                       << "'");
-    //     }
-    //   }
-    // });
-  } else if (type == gx::Type::tick_top) {
-    apex::pb::TickTop msg;
-    msg.ParseFromArray(payload, payload_len);
-    _event_loop.dispatch([wp = weak_from_this(), msg]() mutable {
+  // proto3 messages are parsed into the session's reusable instances, and
+  // converted to the model types before dispatch, so that the wire message is
+  // not copied to the event thread
+  //
+  // Ticks, like their binary encoding, are addressed by the subscription id
+  // in the frame header, rather than by symbol.
+  if (type == gx::Type::trade) {
+    auto& msg = _rx_messages.parse<apex::pb::TickTrade>(payload, payload_len);
+    TickTrade tick;
+    tick.price = msg.price();
+    tick.qty = msg.size();
+    switch (msg.side()) {
+      case apex::pb::Side::side_buy:
+        tick.aggr_side = apex::Side::buy;
+        break;
+      case apex::pb::Side::side_sell:
+        tick.aggr_side = apex::Side::sell;
+        break;
+      case apex::pb::Side::side_none:
+        tick.aggr_side = apex::Side::none;
+        break;
+      default: {
+        LOG_ERROR("dropping GxTickTrade message, invalid side");
+        return;
+      }
+    }
+    _event_loop.dispatch(EventLoop::inline_fn([wp = weak_from_this(),
+                                               msg_id = header->id, tick]() {
       if (auto sp = wp.lock()) {
+        if (msg_id < sp->_subscription_targets.size() &&
+            sp->_subscription_targets[msg_id])
+          sp->_subscription_targets[msg_id]->apply(tick);
+        else
+          LOG_WARN("received TickTrade for unknown subscription " << msg_id);
+      }
+    }));
+  } else if (type == gx::Type::account_update) {
+    auto& msg = _rx_messages.parse<apex::pb::WalletUpdate>(payload, payload_len);
+    _event_loop.dispatch([wp = weak_from_this(),
+                          exchange = from_exchange(msg.exchange()),
+                          symbol = msg.symbol(), avail = msg.position()]() {
+      if (auto sp = wp.lock()) {
+        auto name = exchange_id_to_string(exchange);
+        auto iter = sp->_account_subs.find(name);
+        if (iter != std::end(sp->_account_subs))
+          iter->second.model->apply(AccountUpdate{Asset(symbol, name, 0), avail});
+        else
+          LOG_WARN("unexpected account update, exchange " << QUOTE(name));
+      }
+    });
+  } else if (type == gx::Type::tick_top) {
+    auto& msg = _rx_messages.parse<apex::pb::TickTop>(payload, payload_len);
 
-        auto iter = sp->_ticks_subscription.find(msg.symbol());
-        if (iter != std::end(sp->_ticks_subscription)) {
-
-          // convert from wire to model-update
-          apex::TickTop tick;
-          tick.bid_price = msg.bid_price();
-          tick.ask_price = msg.ask_price();
+    // convert from wire to model-update
+    apex::TickTop tick;
+    tick.bid_price = msg.bid_price();
+    tick.ask_price = msg.ask_price();
 
-          // apply the model-update
-          iter->second->apply(tick);
-        } else {
-          LOG_WARN("received unexpected TickTop event");
-        }
+    _event_loop.dispatch(EventLoop::inline_fn([wp = weak_from_this(),
+                                               msg_id = header->id, tick]() {
+      if (auto sp = wp.lock()) {
+        if (msg_id < sp->_subscription_targets.size() &&
+            sp->_subscription_targets[msg_id])
+          sp->_subscription_targets[msg_id]->apply(tick);
+        else
+          LOG_WARN("received TickTop for unknown subscription " << msg_id);
       }
-    });
+    }));
   } else if (type == gx::Type::error) {
 
-    apex::pb::Error msg;
+    // errors are infrequent, so the message is copied to the event thread
+    apex::pb::Error msg = _rx_messages.parse<apex::pb::Error>(payload, payload_len);
     gx::Type req_type = (gx::Type)msg.orig_request_type(); // TODO: improve this
-    msg.ParseFromArray(payload, payload_len);
 
     _event_loop.dispatch(
         [wp = weak_from_this(), req_type, msg_id = header->id, msg]() mutable {
@@ -362,6 +829,14 @@ void GxClientSession::io_on_full_message(gx::Header* header, char* payload,
               case gx::Type::cancel_order:
                 sp->on_cancel_order_error(msg_id, msg.code(), msg.text());
                 return;
+              case gx::Type::replace_order:
+                sp->on_replace_order_error(msg_id, msg.code(), msg.text());
+                return;
+              case gx::Type::new_order_batch:
+              case gx::Type::mass_cancel:
+                sp->on_batch_order_error(msg_id, orig_msg_type, msg.order_id(),
+                                         msg.code(), msg.text());
+                return;
               default:
                 LOG_WARN("received GX error message for unknown request type, "
                          << " request-type: " << (char)req_type);
@@ -370,58 +845,23 @@ void GxClientSession::io_on_full_message(gx::Header* header, char* payload,
         });
   } else if (type == gx::Type::order_exec) {
     // parse response
-    apex::pb::OrderExecution msg;
-    msg.ParseFromArray(payload, payload_len);
-    OrderUpdate update;
-    update.state = static_cast<OrderState>(msg.order_state());
-    update.close_reason = static_cast<OrderCloseReason>(msg.close_reason());
-    update.ext_order_id = msg.ext_order_id();
-    auto update_reason = msg.reason(); // reason for this order_exec
-
-    _event_loop.dispatch([wp = weak_from_this(), msg_id = header->id,
-                          order_id = msg.order_id(), update = update,
-                          update_reason]() mutable {
-      if (auto sp = wp.lock()) {
-        switch (update_reason) {
-          case pb::OrderUpdateReason::NEW_ORDER_ACK: {
-            auto iter = sp->_pending_submit_order.find(msg_id);
-            if (iter != std::end(sp->_pending_submit_order)) {
-              if (auto order = iter->second.lock()) {
-                order->apply(update);
-              }
-              sp->_pending_submit_order.erase(iter);
-            } else {
-              LOG_WARN("can't find orginal order order_exec(new-order)");
-            }
-            break;
-          }
-
-          case pb::OrderUpdateReason::CANCEL_ORDER_ACK: {
-            auto iter = sp->_pending_cancel_order.find(msg_id);
-            if (iter != std::end(sp->_pending_cancel_order)) {
-
-              if (auto order = iter->second.lock()) {
-                order->apply(update);
-              }
-              sp->_pending_cancel_order.erase(iter);
-            } else {
-              LOG_WARN("can't find original order order_exec(cancel-order)");
-            }
-            break;
-          }
-
-          case pb::OrderUpdateReason::UNSOLICITED: {
-            sp->_order_service->route_update_to_order(order_id, update);
-            break;
-          }
-
-          default: {
-            LOG_WARN("unhandled GX OrderExecution message");
-            break;
+    auto& msg =
+        _rx_messages.parse<apex::pb::OrderExecution>(payload, payload_len);
+
+    // conversion to the model-update is done on the EV thread, so that only the
+    // fields used are captured, keeping within the inline capacity
+    _event_loop.dispatch(EventLoop::inline_fn(
+        [wp = weak_from_this(), msg_id = header->id, reason = msg.reason(),
+         state = msg.order_state(), close_reason = msg.close_reason(),
+         order_id = msg.order_id(), ext_order_id = msg.ext_order_id()]() mutable {
+          if (auto sp = wp.lock()) {
+            OrderUpdate update;
+            update.state = static_cast<OrderState>(state);
+            update.close_reason = static_cast<OrderCloseReason>(close_reason);
+            update.ext_order_id = std::move(ext_order_id);
+            sp->on_order_exec(msg_id, reason, order_id, update);
           }
-        }
-      }
-    });
+        }));
 
 
     // _event_loop.dispatch([wp = weak_from_this(), msg_id = header->id,
@@ -446,27 +886,24 @@ void GxClientSession::io_on_full_message(gx::Header* header, char* payload,
     //   }
     // });
   } else if (type == gx::Type::order_fill) {
-    apex::pb::OrderFill msg;
-    msg.ParseFromArray(payload, payload_len);
-
-    _event_loop.dispatch(
-        [wp = weak_from_this(), msg_id = header->id, msg]() mutable {
-          if (auto sp = wp.lock()) {
-            OrderFill fill;
-            fill.size = msg.size();
-            fill.price = msg.price();
-            fill.is_fully_filled = msg.fully_filled();
-            sp->_order_service->route_fill_to_order(msg.order_id(), fill);
-          }
-        });
+    auto& msg = _rx_messages.parse<apex::pb::OrderFill>(payload, payload_len);
+    OrderFill fill;
+    fill.size = msg.size();
+    fill.price = msg.price();
+    fill.is_fully_filled = msg.fully_filled();
+
+    _event_loop.dispatch(EventLoop::inline_fn(
+        [wp = weak_from_this(), order_id = msg.order_id(), fill]() mutable {
+          if (auto sp = wp.lock())
+            sp->_order_service->route_fill_to_order(order_id, fill);
+        }));
   } else if (type == gx::Type::om_logon) {
-    apex::pb::OmLogonReply msg;
-    msg.ParseFromArray(payload, payload_len);
+    auto& msg = _rx_messages.parse<apex::pb::OmLogonReply>(payload, payload_len);
 
     _event_loop.dispatch(
-        [wp = weak_from_this(), msg_id = header->id, msg]() mutable {
+        [wp = weak_from_this(), error = msg.error()]() mutable {
           if (auto sp = wp.lock()) {
-            sp->m_om_logon_subject.next(msg.error());
+            sp->m_om_logon_subject.next(error);
           }
         }
 
@@ -480,6 +917,178 @@ void GxClientSession::io_on_full_message(gx::Header* header, char* payload,
 }
 
 
+void GxClientSession::on_order_exec(gx::t_msgid msg_id,
+                                    pb::OrderUpdateReason reason,
+                                    const std::string& order_id,
+                                    OrderUpdate update)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  switch (reason) {
+    case pb::OrderUpdateReason::NEW_ORDER_ACK: {
+      auto iter = _pending_submit_order.find(msg_id);
+      if (iter != std::end(_pending_submit_order)) {
+        if (auto order = iter->second.lock()) {
+          order->apply(update);
+        }
+        _pending_submit_order.erase(iter);
+      } else if (std::weak_ptr<Order> wp;
+                 take_batch_order(msg_id, order_id, wp)) {
+        if (auto order = wp.lock())
+          order->apply(update);
+      } else {
+        LOG_WARN("can't find orginal order order_exec(new-order)");
+      }
+      break;
+    }
+
+    case pb::OrderUpdateReason::CANCEL_ORDER_ACK: {
+      auto iter = _pending_cancel_order.find(msg_id);
+      if (iter != std::end(_pending_cancel_order)) {
+
+        if (auto order = iter->second.lock()) {
+          order->apply(update);
+        }
+        _pending_cancel_order.erase(iter);
+      } else if (std::weak_ptr<Order> wp;
+                 take_batch_order(msg_id, order_id, wp)) {
+        if (auto order = wp.lock())
+          order->apply(update);
+      } else {
+        LOG_WARN("can't find original order order_exec(cancel-order)");
+      }
+      break;
+    }
+
+    case pb::OrderUpdateReason::REPLACE_ORDER_ACK: {
+      auto iter = _pending_replace_order.find(msg_id);
+      if (iter != std::end(_pending_replace_order)) {
+        if (auto order = iter->second.lock()) {
+          order->apply_amend(update);
+        }
+        _pending_replace_order.erase(iter);
+      } else {
+        LOG_WARN("can't find original order order_exec(replace-order)");
+      }
+      break;
+    }
+
+    case pb::OrderUpdateReason::UNSOLICITED: {
+      _order_service->route_update_to_order(order_id, update);
+      break;
+    }
+
+    default: {
+      LOG_WARN("unhandled GX OrderExecution message");
+      break;
+    }
+  }
+}
+
+
+void GxClientSession::io_on_mcast_channel(gx::t_msgid subscription_id,
+                                          const gx::bin::McastChannel& msg)
+{
+  /* session reader thread */
+  const std::string group(msg.group, strnlen(msg.group, sizeof(msg.group)));
+
+  if (!_mcast_rx || group != _mcast_group || msg.port != _mcast_port) {
+    UdpSocket::MulticastOptions options;
+    options.group = group;
+    options.port = msg.port;
+
+    auto rx = std::make_unique<UdpSocket>(_io_loop);
+    auto wp = weak_from_this();
+    auto err = rx->open_receiver(options, [wp](const char* src, size_t len) {
+                   if (auto sp = wp.lock())
+                     sp->io_on_datagram(src, len);
+                 }).get();
+    if (err) {
+      LOG_ERROR("failed to join multicast group " << group << ":" << msg.port
+                << ", error: " << err);
+      return;
+    }
+    LOG_INFO("joined multicast group " << group << ":" << msg.port);
+    _mcast_rx = std::move(rx);
+    _mcast_group = group;
+    _mcast_port = msg.port;
+  }
+
+  auto lock = std::scoped_lock(_mcast_lock);
+  _mcast_streams[msg.channel] = McastStream{subscription_id, msg.next_seq};
+}
+
+
+void GxClientSession::io_on_datagram(const char* src, size_t len)
+{
+  /* IO thread */
+  if (len < sizeof(gx::bin::McastHeader) + sizeof(gx::Header))
+    return;
+
+  gx::bin::McastHeader mh;
+  memcpy(&mh, src, sizeof(mh));
+  if (mh.magic != gx::bin::mcast_magic)
+    return;
+
+  const char* msg = src + sizeof(mh);
+  const size_t msg_len = len - sizeof(mh);
+  if (::ntohs(reinterpret_cast<const gx::Header*>(msg)->len) != msg_len)
+    return;
+
+  gx::t_msgid subscription_id;
+  uint64_t gap_from = 0;
+  {
+    auto lock = std::scoped_lock(_mcast_lock);
+    auto iter = _mcast_streams.find(mh.channel);
+    if (iter == std::end(_mcast_streams))
+      return; // a channel not subscribed to
+    auto& stream = iter->second;
+    if (mh.seq < stream.next_seq)
+      return; // duplicate
+    if (mh.seq > stream.next_seq)
+      gap_from = stream.next_seq;
+    stream.next_seq = mh.seq + 1;
+    subscription_id = stream.subscription_id;
+  }
+
+  if (gap_from) {
+    LOG_WARN("multicast gap on channel " << mh.channel << ", seq " << gap_from
+             << " to " << mh.seq - 1);
+    gx::bin::McastRecover req;
+    req.channel = mh.channel;
+    req.from_seq = gap_from;
+    req.to_seq = mh.seq - 1;
+    try {
+      send_frame(sizeof(gx::Header) + sizeof(req), [&](char* dest) {
+        auto* header = reinterpret_cast<gx::Header*>(dest);
+        gx::Header::init(header, sizeof(req), gx::Type::mcast_recover,
+                         static_cast<uint8_t>(gx::Flags::binary));
+        header->hton();
+        memcpy(dest + sizeof(gx::Header), &req, sizeof(req));
+      });
+    } catch (std::exception& e) {
+      LOG_WARN("unable to request multicast recovery: " << e.what());
+    }
+  }
+
+  // decode as if received on the session, addressed by subscription id
+  _mcast_msg.assign(msg, msg + msg_len);
+  auto* header = reinterpret_cast<gx::Header*>(_mcast_msg.data());
+  header->len = ::ntohs(header->len);
+  header->id = subscription_id;
+  io_on_full_message(header, header->payload, header->len - sizeof(gx::Header));
+}
+
+
+uint8_t GxClientSession::request_flags() const
+{
+  auto flags = static_cast<uint8_t>(gx::Flags::proto3);
+  if (_binary)
+    flags |= static_cast<uint8_t>(gx::Flags::binary);
+  return flags;
+}
+
+
 void GxClientSession::on_submit_order_error(gx::t_msgid req_id,
                                             std::string code, std::string text)
 {
@@ -515,31 +1124,201 @@ void GxClientSession::on_cancel_order_error(gx::t_msgid req_id,
 
 
 
+void GxClientSession::on_replace_order_error(gx::t_msgid req_id,
+                                             std::string code, std::string text)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  auto iter = _pending_replace_order.find(req_id);
+  if (iter == std::end(_pending_replace_order)) {
+    LOG_WARN("received unexpected replace-order error, reqId: " << req_id);
+  } else {
+    if (auto order = iter->second.lock()) {
+      order->apply_amend_reject(code, text);
+    }
+    _pending_replace_order.erase(iter);
+  }
+}
+
+
+bool GxClientSession::take_batch_order(gx::t_msgid req_id,
+                                       const std::string& order_id,
+                                       std::weak_ptr<Order>& order)
+{
+  auto iter = _pending_batch.find(req_id);
+  if (iter == std::end(_pending_batch))
+    return false;
+
+  auto& orders = iter->second;
+  auto order_iter = orders.find(order_id);
+  if (order_iter == std::end(orders))
+    return false;
+
+  order = std::move(order_iter->second);
+  orders.erase(order_iter);
+  if (orders.empty())
+    _pending_batch.erase(iter);
+  return true;
+}
+
+
+void GxClientSession::on_batch_order_error(gx::t_msgid req_id, gx::Type type,
+                                           const std::string& order_id,
+                                           std::string code, std::string text)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  // an error of the request as a whole applies to each of its orders
+  std::vector<std::weak_ptr<Order>> orders;
+  if (order_id.empty()) {
+    auto iter = _pending_batch.find(req_id);
+    if (iter != std::end(_pending_batch)) {
+      for (auto& item : iter->second)
+        orders.push_back(std::move(item.second));
+      _pending_batch.erase(iter);
+    }
+  } else if (std::weak_ptr<Order> wp; take_batch_order(req_id, order_id, wp)) {
+    orders.push_back(std::move(wp));
+  }
+
+  if (orders.empty()) {
+    LOG_WARN("received unexpected batch-order error, reqId: " << req_id
+             << ", orderId: " << order_id);
+    return;
+  }
+
+  for (auto& wp : orders) {
+    if (auto order = wp.lock()) {
+      if (type == gx::Type::new_order_batch)
+        order->set_is_rejected(code, text);
+      else
+        order->apply_cancel_reject(code, text);
+    }
+  }
+}
+
+
+/* Split orders into groups of one exchange, each of up to `max_size`. */
+static std::vector<std::vector<Order*>> batches_by_exchange(
+    const std::vector<Order*>& orders, size_t max_size)
+{
+  std::vector<std::vector<Order*>> batches;
+  std::map<ExchangeId, size_t> open; // index of the batch being filled
+  for (auto* order : orders) {
+    auto exchange = order->instrument().exchange_id();
+    auto iter = open.find(exchange);
+    if (iter == std::end(open) || batches[iter->second].size() >= max_size) {
+      batches.emplace_back();
+      iter = open.insert_or_assign(exchange, batches.size() - 1).first;
+    }
+    batches[iter->second].push_back(order);
+  }
+  return batches;
+}
+
+
+void GxClientSession::new_orders(const std::vector<Order*>& orders)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  for (auto& batch : batches_by_exchange(orders, max_batch_orders)) {
+    gx_client_orders.add(batch.size());
+
+    // construct wire-protocol message
+    auto& msg = _tx_messages.get<apex::pb::NewOrderBatch>();
+    std::map<std::string, std::weak_ptr<Order>> pending;
+    for (auto* order : batch) {
+      auto* item = msg.add_orders();
+      item->set_exchange(to_exchange(order->instrument().exchange_id()));
+      item->set_symbol(order->instrument().native_symbol());
+      item->set_side(to_side(order->side()));
+      item->set_price(order->price());
+      item->set_size(order->size());
+      item->set_tif(static_cast<uint32_t>(order->time_in_force()));
+      item->set_order_id(order->order_id());
+      pending.insert({order->order_id(), order->weak_from_this()});
+    }
+
+    const auto reqid = _next_reqid++;
+
+    _pending_batch[reqid] = std::move(pending);
+
+    // socket write/queue
+    send_message(gx::Type::new_order_batch, reqid, msg);
+  }
+}
+
+
+void GxClientSession::cancel_orders(const std::vector<Order*>& orders,
+                                    bool all_open)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  for (auto& batch : batches_by_exchange(orders, max_batch_orders)) {
+    // construct wire-protocol message
+    auto& msg = _tx_messages.get<apex::pb::MassCancel>();
+    msg.set_exchange(to_exchange(batch.front()->instrument().exchange_id()));
+    msg.set_all_open(all_open);
+    std::map<std::string, std::weak_ptr<Order>> pending;
+    for (auto* order : batch) {
+      auto* item = msg.add_orders();
+      item->set_order_id(order->order_id());
+      item->set_ext_order_id(order->exch_order_id());
+      item->set_symbol(order->instrument().native_symbol());
+      pending.insert({order->order_id(), order->weak_from_this()});
+    }
+
+    const auto reqid = _next_reqid++;
+
+    _pending_batch[reqid] = std::move(pending);
+
+    // socket write/queue
+    send_message(gx::Type::mass_cancel, reqid, msg);
+  }
+}
+
+
+void GxClientSession::replace_order(Order& order)
+{
+  assert(_event_loop.this_thread_is_ev());
+
+  // construct wire-protocol message
+  auto& msg = _tx_messages.get<apex::pb::ReplaceOrder>();
+  msg.set_exchange(to_exchange(order.instrument().exchange_id()));
+  msg.set_symbol(order.instrument().native_symbol());
+  msg.set_order_id(order.order_id());
+  msg.set_ext_order_id(order.exch_order_id());
+  msg.set_price(order.amend_price());
+  msg.set_size(order.amend_size());
+  msg.set_side(to_side(order.side()));
+  msg.set_tif(static_cast<uint32_t>(order.time_in_force()));
+
+  const auto reqid = _next_reqid++;
+
+  _pending_replace_order[reqid] = order.weak_from_this();
+
+  // socket write/queue
+  send_message(gx::Type::replace_order, reqid, msg);
+}
+
+
 void GxClientSession::cancel_order(Order& order)
 {
   assert(_event_loop.this_thread_is_ev());
 
   // construct wire-protocol message
-  apex::pb::CancelOrder msg;
+  auto& msg = _tx_messages.get<apex::pb::CancelOrder>();
   msg.set_order_id(order.order_id());
   msg.set_ext_order_id(order.exch_order_id());
   msg.set_exchange(to_exchange(order.instrument().exchange_id()));
   msg.set_symbol(order.instrument().native_symbol());
 
-  // build wire format
-  auto payload = msg.SerializeAsString();
-  apex::gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(apex::gx::Flags::proto3);
-  apex::gx::Header::init(&header, payload.size(), gx::Type::cancel_order, flags);
   const auto reqid = _next_reqid++;
-  header.id = reqid;
-  header.hton();
 
   _pending_cancel_order[reqid] = order.weak_from_this();
 
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::cancel_order, reqid, msg);
 }
 
 
@@ -548,7 +1327,7 @@ void GxClientSession::strategy_logon(std::string strategy_id, RunMode run_mode)
   assert(_event_loop.this_thread_is_ev());
 
   // construct wire-protocol message
-  apex::pb::OmLogonRequest msg;
+  auto& msg = _tx_messages.get<apex::pb::OmLogonRequest>();
   msg.set_strategy_id(strategy_id);
   switch (run_mode) {
     case RunMode::live:
@@ -561,18 +1340,10 @@ void GxClientSession::strategy_logon(std::string strategy_id, RunMode run_mode)
       throw std::runtime_error("GxClientSession cannot be used in backtest mode");
   }
 
-  // build wire format
-  auto payload = msg.SerializeAsString();
-  apex::gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(apex::gx::Flags::proto3);
-  apex::gx::Header::init(&header, payload.size(), gx::Type::om_logon, flags);
   const auto reqid = _next_reqid++;
-  header.id = reqid;
-  header.hton();
 
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::om_logon, reqid, msg, request_flags());
 }
 
 
@@ -581,7 +1352,7 @@ void GxClientSession::new_order(Order& order)
   assert(_event_loop.this_thread_is_ev());
 
   // construct wire-protocol message
-  apex::pb::NewOrder msg;
+  auto& msg = _tx_messages.get<apex::pb::NewOrder>();
   msg.set_exchange(to_exchange(order.instrument().exchange_id()));
   msg.set_symbol(order.instrument().native_symbol());
   msg.set_side(to_side(order.side()));
@@ -590,20 +1361,16 @@ void GxClientSession::new_order(Order& order)
   msg.set_tif(static_cast<uint32_t>(order.time_in_force()));
   msg.set_order_id(order.order_id());
 
-  // build wire format
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(apex::gx::Flags::proto3);
-  gx::Header::init(&header, payload.size(), gx::Type::new_order, flags);
+  auto stamp = order.trace();
+  trace::tracer().mark(trace::Stage::order_send, stamp);
+  gx_client_orders.add();
+
   const auto reqid = _next_reqid++;
-  header.id = reqid;
-  header.hton();
 
   _pending_submit_order[reqid] = order.weak_from_this();
 
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::new_order, reqid, msg);
 }
 
 rx::observable<bool>& GxClientSession::connected_observable()
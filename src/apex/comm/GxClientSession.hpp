@@ -19,25 +19,37 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/comm/GxSessionBase.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/infra/UdpSocket.hpp>
 #include <apex/model/ExchangeId.hpp>
+#include <apex/util/FeedLatency.hpp>
+#include <apex/util/LatencyTrace.hpp>
 #include <apex/util/Time.hpp>
 #include <apex/util/rx.hpp>
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstring>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <variant>
+#include <vector>
 
 namespace apex
 {
 
 class TcpSocket;
+namespace metrics { class Gauge; }
 class Account;
 class Order;
 class MarketData;
 class AccountUpdate;
 class OrderFill;
 class OrderService;
+class RawCaptureWriter;
+struct OrderUpdate;
+struct TickTrade;
 
 /*
  * Provide a GX session used by a client application, eg, a trading engine, to
@@ -45,13 +57,16 @@ class OrderService;
  */
 class GxClientSession : public GxSessionBase<GxClientSession>
 {
-
+public:
   struct MarketViewSubscription {
     std::string symbol;
     ExchangeId exchange;
     MarketData* mv;
+    int streams = 0; // MdStream mask, zero for all
+    gx::t_msgid subscription_id = 0;
   };
 
+private:
   struct AccountSubscription {
     std::string exchange;
     Account* model;
@@ -67,17 +82,114 @@ public:
 
   void strategy_logon(std::string strategy_id, RunMode run_mode);
 
-  void subscribe(std::string symbol, ExchangeId exchange, apex::MarketData* mv);
+  /* Subscribe to the ticks of a symbol.  Subscriptions made in succession
+   * are sent together, as one request of up to max_batch_subscriptions; the
+   * server replies with the last known top and trade, where it has them.
+   * `streams` is the mask of MdStream sent, zero for all; subscribing again
+   * with the same MarketData adds to the streams of the subscription. */
+  void subscribe(std::string symbol, ExchangeId exchange, apex::MarketData* mv,
+                 int streams = 0);
+
+  /* Subscribe to many symbols at once, e.g. the universe of a strategy at
+   * startup; they are queued by a single event, so are all sent together
+   * however soon the event thread gets to the first of them. */
+  void subscribe(std::vector<MarketViewSubscription>);
 
   void subscribe_account(std::string exchange, Account& target);
 
   void start_connecting();
 
+  /* Request the binary encoding for ticks and order updates; takes effect for
+   * subsequent subscriptions and logons.  Enabled by default.  Messages are
+   * decoded according to their header flags, so a server that only supports
+   * proto3 is unaffected. */
+  void set_binary_encoding(bool enabled) { _binary = enabled; }
+
+  /* Request that ticks are received via multicast, where the server offers
+   * it; requires the binary encoding.  Gaps in a multicast channel are
+   * recovered over the session.  Disabled by default. */
+  void set_multicast(bool enabled) { _multicast = enabled; }
+
+  /* Interval at which the link is probed with pings, to estimate the round
+   * trip time and the offset of the server clock, in the manner of NTP; zero
+   * disables probing.  Set before start_connecting.  One second by default. */
+  void set_probe_interval(std::chrono::milliseconds interval)
+  {
+    _probe_interval = interval;
+  }
+
+  /* Link estimates, from the probe of least round trip time among the recent
+   * probes; both are zero until a probe has been answered.  The clock offset
+   * is the server clock less the client clock, and is removed from the
+   * latency trace stamps of ticks, so that the gateway stages are comparable
+   * across hosts. */
+  [[nodiscard]] int64_t rtt_ns() const { return _rtt_ns.load(); }
+  [[nodiscard]] int64_t clock_offset_ns() const { return _clock_offset_ns.load(); }
+  [[nodiscard]] uint64_t probes_answered() const { return _probes_answered.load(); }
+
+  /* Checks of the lag of trades, from their exchange event time to their
+   * receipt by this session.  While the trades of an instrument arrive later
+   * than `stale_after` its MarketData is marked stale, and so is not good;
+   * with `drop_stale`, such trades are also discarded.  Zero disables the
+   * check.  Lag statistics are kept regardless. */
+  struct FeedCheckOptions {
+    std::chrono::milliseconds stale_after{0};
+    bool drop_stale = false;
+  };
+  void set_feed_checks(FeedCheckOptions options) { _feed_checks = options; }
+
+  /* Lag statistics of the trades of all subscriptions, or of one symbol;
+   * event thread only.  Also published as metrics every second, per gateway
+   * and per symbol. */
+  [[nodiscard]] FeedLatency::Stats feed_latency() const;
+  [[nodiscard]] FeedLatency::Stats feed_latency(const std::string& symbol) const;
+
+  /* Append every inbound GX frame, with its receive time, to a capture,
+   * along with the subscriptions made, by which ticks are addressed; set
+   * before start_connecting.  The frames are copied to the capture's writer
+   * thread.  A capture is replayed by GxCaptureReplayer. */
+  void set_capture(std::shared_ptr<RawCaptureWriter> capture)
+  {
+    _capture = std::move(capture);
+  }
+
+  /* Stream name of the capture files. */
+  static constexpr const char* capture_stream = "gx";
+
+  /* Decode a captured frame as if just received, on the thread driving the
+   * event loop, with the receive time it was captured with.  A captured
+   * subscription gives its id to the session's subscription of the same
+   * symbol, which must be made first; order traffic, which belongs to the
+   * captured session, is ignored.  For replay, on a session that is not
+   * connected. */
+  void replay_frame(std::string_view frame, Time received);
+
   void new_order(Order&);
   void cancel_order(Order&);
+  void replace_order(Order&);
+
+  /* Send, or cancel, several orders with one GX request per exchange, each
+   * of up to max_batch_orders; see Order::send_all and Order::cancel_all. */
+  void new_orders(const std::vector<Order*>&);
+  void cancel_orders(const std::vector<Order*>&, bool all_open);
+
+  static constexpr size_t max_batch_orders = 512;
+  static constexpr size_t max_batch_subscriptions = 512;
 
   bool is_connected();
 
+  /* Whether the ticks received are applied to the subscribed market data;
+   * the standby session of a GatewayFailover receives its ticks, but drops
+   * them until it becomes active.  Active by default. */
+  void set_feed_active(bool active)
+  {
+    _feed_active.store(active, std::memory_order_relaxed);
+  }
+  [[nodiscard]] bool is_feed_active() const
+  {
+    return _feed_active.load(std::memory_order_relaxed);
+  }
+
   rx::observable<bool>& connected_observable();
   rx::observable<std::string>& om_logon_observable();
 
@@ -85,15 +197,38 @@ protected:
   void check_connection();
 
   void perform_subscriptions();
+  void assign_subscription(MarketViewSubscription&, gx::t_msgid);
+  void capture_subscription(const MarketViewSubscription&);
 
   void io_on_full_message(gx::Header* header, char* payload,
                           size_t payload_len) override;
 
+  void on_order_exec(gx::t_msgid, pb::OrderUpdateReason,
+                     const std::string& order_id, OrderUpdate);
   void on_submit_order_error(gx::t_msgid, std::string code, std::string text);
+
+  uint8_t request_flags() const;
+
+  void io_on_mcast_channel(gx::t_msgid subscription_id,
+                           const gx::bin::McastChannel&);
+  void io_on_datagram(const char*, size_t);
+  void send_probe();
+  void io_on_pong(const gx::bin::Pong&);
+  void correct_clock(trace::Stamp&) const;
+  bool check_trade(gx::t_msgid, MarketData&, const TickTrade&, Time received);
+  void publish_feed_latency();
   void on_cancel_order_error(gx::t_msgid, std::string code, std::string text);
+  void on_replace_order_error(gx::t_msgid, std::string code, std::string text);
+  void on_batch_order_error(gx::t_msgid, gx::Type, const std::string& order_id,
+                            std::string code, std::string text);
+  bool take_batch_order(gx::t_msgid, const std::string& order_id,
+                        std::weak_ptr<Order>&);
 
   uint32_t _next_reqid = 1;
 
+  // outbound messages, built on the event thread
+  gx::MessageCache _tx_messages;
+
   std::string _remote_addr;
   std::string _remote_port;
 
@@ -107,16 +242,78 @@ protected:
   // Pending requests
   std::map<gx::t_msgid, std::weak_ptr<Order>> _pending_submit_order;
   std::map<gx::t_msgid, std::weak_ptr<Order>> _pending_cancel_order;
+  std::map<gx::t_msgid, std::weak_ptr<Order>> _pending_replace_order;
+
+  // Pending batch requests; each order of a batch is replied to separately,
+  // and identified by its order id
+  std::map<gx::t_msgid, std::map<std::string, std::weak_ptr<Order>>>
+      _pending_batch;
 
   // Pending subscriptions
   std::vector<MarketViewSubscription> _pending_subs;
+  bool _subscriptions_scheduled = false;
   std::map<std::string, MarketViewSubscription> _active_subs;
   std::vector<VariantSubscription> _pending_subs_2;
 
-  // Type based active subscriptions
-  std::map<std::string, apex::MarketData*> _ticks_subscription;
+  // targets of ticks, indexed by subscription id
+  std::vector<apex::MarketData*> _subscription_targets;
+
+  // lag of trades, per subscription id and of the session, with the gauges
+  // it is published to; event thread
+  struct FeedStats {
+    explicit FeedStats(const std::string& labels);
+    std::string symbol;
+    FeedLatency latency;
+    metrics::Gauge* median;
+    metrics::Gauge* p99;
+    metrics::Gauge* min;
+    metrics::Gauge* drift;
+  };
+  FeedCheckOptions _feed_checks;
+  std::vector<std::unique_ptr<FeedStats>> _feed_stats;
+  std::unique_ptr<FeedStats> _session_feed;
+  bool _binary = true;
+  std::atomic<bool> _feed_active{true};
+
+  // capture of inbound frames, if enabled; when replaying a capture, the
+  // receive time of the frame being replayed
+  std::shared_ptr<RawCaptureWriter> _capture;
+  Time _replay_received;
+  std::string _replay_frame;
+
+  // multicast reception, per channel; the receiver is only opened, and
+  // replaced, on the thread reading session messages
+  struct McastStream {
+    gx::t_msgid subscription_id;
+    uint64_t next_seq;
+  };
+  bool _multicast = false;
+  std::unique_ptr<UdpSocket> _mcast_rx;
+  std::string _mcast_group;
+  int _mcast_port = 0;
+  std::mutex _mcast_lock;
+  std::map<uint32_t, McastStream> _mcast_streams;
+  std::vector<char> _mcast_msg; // IO thread
+
   std::map<std::string, AccountSubscription> _account_subs;
 
+  // link probing; a pong can arrive on the socket or the shared memory
+  // reader thread, so the samples are guarded
+  struct ProbeSample {
+    int64_t rtt_ns;
+    int64_t offset_ns;
+  };
+  static constexpr size_t probe_window = 8;
+  std::chrono::milliseconds _probe_interval{1000};
+  std::mutex _probe_lock;
+  std::array<ProbeSample, probe_window> _probe_samples{};
+  size_t _probe_count = 0;
+  std::atomic<int64_t> _rtt_ns{0};
+  std::atomic<int64_t> _clock_offset_ns{0};
+  std::atomic<uint64_t> _probes_answered{0};
+  metrics::Gauge* _rtt_gauge;
+  metrics::Gauge* _clock_offset_gauge;
+
   OrderService* _order_service;
 
   rx::behaviour_subject<bool> m_connected_subject;
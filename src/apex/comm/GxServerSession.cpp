@@ -16,6 +16,7 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/comm/GxServerSession.hpp>
+#include <apex/comm/GxBinaryFormat.hpp>
 #include <apex/comm/GxClientSession.hpp>
 #include <apex/model/Account.hpp>
 #include <apex/model/ExchangeId.hpp>
@@ -23,6 +24,8 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/infra/UvErr.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/tick_msgs.hpp>
+#include <apex/util/LatencyTrace.hpp>
+#include <apex/util/Metrics.hpp>
 
 #include <type_traits>
 
@@ -33,6 +36,10 @@ namespace apex
 class RealtimeEventLoop;
 class TcpSocket;
 
+static metrics::Counter& gx_slow_closed = metrics::registry().counter(
+    "apex_gx_server_slow_consumer_closes_total",
+    "GX sessions closed as slow consumers");
+
 
 static apex::pb::Exchange to_exchange(apex::ExchangeId id) {
   switch (id) {
@@ -81,10 +88,34 @@ static apex::Side from_side(apex::pb::Side side)
 }
 
 
+// Client strings are copied into FixedString fields, which throw when too
+// long; check them up front so a bad request is rejected, not fatal to decode.
+template <typename M> static bool fits_order_params(const M& msg)
+{
+  return msg.symbol().size() <= SymbolString::capacity &&
+         msg.order_id().size() <= OrderIdString::capacity;
+}
+
+
+static OrderParams to_order_params(const apex::pb::NewOrder& msg)
+{
+  OrderParams params;
+  params.exchange = from_exchange(msg.exchange());
+  params.symbol = msg.symbol();
+  params.price = msg.price();
+  params.size = msg.size();
+  params.side = from_side(msg.side());
+  params.time_in_force = static_cast<TimeInForce>(msg.tif());
+  params.order_id = msg.order_id();
+  return params;
+}
+
+
 GxServerSession::GxServerSession(IoLoop& ioloop, RealtimeEventLoop& evloop,
                                  std::unique_ptr<TcpSocket> sk,
                                  EventHandlers callbacks)
   : GxSessionBase<GxServerSession>(ioloop, evloop, std::move(sk)),
+    _ticks([this]() { return send_backlog(); }),
     _server_callbacks(callbacks)
 {
   // if (!_callbacks.on_err)
@@ -100,27 +131,17 @@ void GxServerSession::on_subscribe(const apex::pb::SubscribeTicks& msg)
 }
 
 
-void GxServerSession::send(ExchangeId /*exchange*/,
-                           const std::vector<AccountUpdate>& /*updates*/)
+void GxServerSession::send(ExchangeId exchange,
+                           const std::vector<AccountUpdate>& updates)
 {
-  // for (auto& update : updates) {
-  //   apex::pb::WalletUpdate msg;
-  //   msg.set_symbol(update.asset.symbol);
-  //   msg.set_exchange(from_exchange(exchange));
-  //   msg.set_position(update.avail);
-
-  //   // build wire
-  //   auto payload = msg.SerializeAsString();
-  //   gx::Header header;
-  //   uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-  //   gx::Header::init(&header, payload.size(), gx::Type::account_update, flags);
-
-  //   header.hton();
-
-  //   // socket write/queue
-  //   _sock->write((char*)&header, sizeof(header));
-  //   _sock->write(payload.data(), payload.size());
-  // }
+  // one message per asset changed; when batching, these share a write
+  apex::pb::WalletUpdate msg;
+  for (auto& update : updates) {
+    msg.set_exchange(to_exchange(exchange));
+    msg.set_symbol(update.asset.symbol());
+    msg.set_position(update.avail);
+    send_message(gx::Type::account_update, 0, msg);
+  }
 }
 
 
@@ -149,18 +170,89 @@ void GxServerSession::io_on_full_message(gx::Header* header, char* payload,
   const auto id = header->id;
 
   if (header->type == gx::Type::subscribe) {
-    apex::pb::SubscribeTicks msg;
-    msg.ParseFromArray(payload, payload_len);
+    // subscriptions are infrequent, so the message is copied to the event
+    // thread
+    apex::pb::SubscribeTicks msg =
+        _rx_messages.parse<apex::pb::SubscribeTicks>(payload, payload_len);
     auto wp = weak_from_this();
-    _event_loop.dispatch([wp, msg]() {
+    const bool binary = flags & static_cast<uint8_t>(gx::Flags::binary);
+    const bool multicast = flags & static_cast<uint8_t>(gx::Flags::multicast);
+    _event_loop.dispatch([wp, msg, id, binary, multicast]() {
       if (auto sp = wp.lock()) {
         GxSubscribeRequest req(msg.symbol(), from_exchange(msg.exchange()));
+        req.subscription_id = id;
+        req.binary = binary;
+        req.multicast = multicast && binary;
+        req.streams = static_cast<int>(msg.streams());
         sp->_server_callbacks.on_subscribe(*sp, req);
       }
     });
+  } else if (type == gx::Type::subscribe_batch) {
+    auto& msg =
+        _rx_messages.parse<apex::pb::SubscribeTicksBatch>(payload, payload_len);
+    const bool binary = flags & static_cast<uint8_t>(gx::Flags::binary);
+    const bool multicast = flags & static_cast<uint8_t>(gx::Flags::multicast);
+
+    std::vector<GxSubscribeRequest> requests;
+    requests.reserve(msg.items_size());
+    for (auto& item : msg.items()) {
+      ExchangeId exchange;
+      try {
+        exchange = from_exchange(item.exchange());
+      } catch (std::exception& e) {
+        LOG_WARN("ignoring subscribe request for " << item.symbol() << ": "
+                 << e.what());
+        continue;
+      }
+      GxSubscribeRequest req(item.symbol(), exchange);
+      req.subscription_id = item.subscription_id();
+      req.binary = binary;
+      req.multicast = multicast && binary;
+      req.streams = static_cast<int>(item.streams());
+      requests.push_back(std::move(req));
+    }
+
+    auto wp = weak_from_this();
+    _event_loop.dispatch([wp, requests = std::move(requests)]() mutable {
+      if (auto sp = wp.lock())
+        for (auto& req : requests)
+          sp->_server_callbacks.on_subscribe(*sp, req);
+    });
+  } else if (type == gx::Type::ping) {
+    // answered at once, on this thread, so that the reply times exclude any
+    // event loop queueing
+    auto t2 = static_cast<int64_t>(trace::now_ns());
+    auto* msg = gx::bin::cast<gx::bin::Ping>(payload, payload_len);
+    if (!msg) {
+      LOG_WARN("ignoring ping with len: " << payload_len);
+      return;
+    }
+    gx::bin::Pong reply{msg->t1, t2, 0};
+    send_frame(sizeof(gx::Header) + sizeof(reply), [&](char* dest) {
+      auto* header = reinterpret_cast<gx::Header*>(dest);
+      gx::Header::init(header, sizeof(reply), gx::Type::pong,
+                       static_cast<uint8_t>(gx::Flags::binary));
+      header->id = id;
+      header->hton();
+      reply.t3 = static_cast<int64_t>(trace::now_ns());
+      memcpy(dest + sizeof(gx::Header), &reply, sizeof(reply));
+    });
+  } else if (type == gx::Type::mcast_recover) {
+    auto* msg = gx::bin::cast<gx::bin::McastRecover>(payload, payload_len);
+    if (!msg) {
+      LOG_WARN("ignoring mcast-recover request with len: " << payload_len);
+      return;
+    }
+    auto wp = weak_from_this();
+    _event_loop.dispatch([wp, msg = *msg]() {
+      if (auto sp = wp.lock()) {
+        if (sp->_server_callbacks.on_mcast_recover)
+          sp->_server_callbacks.on_mcast_recover(*sp, msg);
+      }
+    });
   } else if (type == gx::Type::subscribe_account) {
-    apex::pb::SubscribeWallet msg;
-    msg.ParseFromArray(payload, payload_len);
+    apex::pb::SubscribeWallet msg =
+        _rx_messages.parse<apex::pb::SubscribeWallet>(payload, payload_len);
     auto wp = weak_from_this();
     _event_loop.dispatch([wp, msg]() {
       if (auto sp = wp.lock()) {
@@ -170,29 +262,34 @@ void GxServerSession::io_on_full_message(gx::Header* header, char* payload,
       }
     });
   } else if (type == gx::Type::cancel_order) {
-    apex::pb::CancelOrder msg;
-    msg.ParseFromArray(payload, payload_len);
+    auto& msg = _rx_messages.parse<apex::pb::CancelOrder>(payload, payload_len);
 
     Request request;
     request.req_type = gx::Type::cancel_order;
     request.req_id = id;
 
     auto wp = weak_from_this();
-    _event_loop.dispatch([wp, request, msg]() mutable {
+    _event_loop.dispatch([wp, request, exchange = msg.exchange(),
+                          symbol = msg.symbol(), order_id = msg.order_id(),
+                          ext_order_id = msg.ext_order_id()]() mutable {
       if (auto sp = wp.lock()) {
         sp->_server_callbacks.on_cancel_order_request(
-          *sp, request, from_exchange(msg.exchange()), msg.symbol(), msg.order_id(),
-            msg.ext_order_id());
+          *sp, request, from_exchange(exchange), symbol, order_id, ext_order_id);
       }
     });
-  } else if (type == gx::Type::new_order) {
-    apex::pb::NewOrder msg;
-    msg.ParseFromArray(payload, payload_len);
+  } else if (type == gx::Type::replace_order) {
+    auto& msg = _rx_messages.parse<apex::pb::ReplaceOrder>(payload, payload_len);
 
     Request request;
-    request.req_type = gx::Type::new_order;
+    request.req_type = gx::Type::replace_order;
     request.req_id = id;
 
+    if (!fits_order_params(msg)) {
+      LOG_WARN("rejecting order-replace, symbol or order-id too long");
+      send_error(request, error::e0200, "symbol or order-id too long");
+      return;
+    }
+
     OrderParams params;
     params.exchange = from_exchange(msg.exchange());
     params.symbol = msg.symbol();
@@ -202,6 +299,34 @@ void GxServerSession::io_on_full_message(gx::Header* header, char* payload,
     params.time_in_force = static_cast<TimeInForce>(msg.tif());
     params.order_id = msg.order_id();
 
+    if (!_logon_accepted) {
+      LOG_WARN("rejecting order-replace, apex-gx session not logged-on");
+      send_error(request, error::e0200, "not logged-on to apex-gx");
+      return;
+    }
+
+    auto wp = weak_from_this();
+    _event_loop.dispatch(
+        [wp, request, ext_order_id = msg.ext_order_id(), params]() mutable {
+          if (auto sp = wp.lock())
+            sp->_server_callbacks.on_replace_order_request(
+                *sp, request, std::move(ext_order_id), std::move(params));
+        });
+  } else if (type == gx::Type::new_order) {
+    auto& msg = _rx_messages.parse<apex::pb::NewOrder>(payload, payload_len);
+
+    Request request;
+    request.req_type = gx::Type::new_order;
+    request.req_id = id;
+
+    if (!fits_order_params(msg)) {
+      LOG_WARN("rejecting order-submit, symbol or order-id too long");
+      send_error(request, error::e0200, "symbol or order-id too long");
+      return;
+    }
+
+    OrderParams params = to_order_params(msg);
+
     if (!_logon_accepted) {
       LOG_WARN("rejecting order-submit, apex-gx session not logged-on");
       send_error(request, error::e0200, "not logged-on to apex-gx");
@@ -213,9 +338,65 @@ void GxServerSession::io_on_full_message(gx::Header* header, char* payload,
       if (auto sp = wp.lock())
         sp->_server_callbacks.on_submit_order(*sp, request, params);
     });
+  } else if (type == gx::Type::new_order_batch) {
+    auto& msg = _rx_messages.parse<apex::pb::NewOrderBatch>(payload, payload_len);
+
+    Request request;
+    request.req_type = gx::Type::new_order_batch;
+    request.req_id = id;
+
+    if (!_logon_accepted) {
+      LOG_WARN("rejecting order-batch, apex-gx session not logged-on");
+      send_error(request, error::e0200, "not logged-on to apex-gx");
+      return;
+    }
+
+    std::vector<OrderParams> orders;
+    orders.reserve(msg.orders_size());
+    for (auto& item : msg.orders()) {
+      if (!fits_order_params(item)) {
+        LOG_WARN("rejecting order-batch, symbol or order-id too long");
+        send_error(request, error::e0200, "symbol or order-id too long");
+        return;
+      }
+      orders.push_back(to_order_params(item));
+    }
+
+    auto wp = weak_from_this();
+    _event_loop.dispatch([wp, request, orders = std::move(orders)]() mutable {
+      if (auto sp = wp.lock())
+        sp->_server_callbacks.on_submit_orders(*sp, request, std::move(orders));
+    });
+  } else if (type == gx::Type::mass_cancel) {
+    auto& msg = _rx_messages.parse<apex::pb::MassCancel>(payload, payload_len);
+
+    Request request;
+    request.req_type = gx::Type::mass_cancel;
+    request.req_id = id;
+
+    std::vector<CancelParams> orders;
+    orders.reserve(msg.orders_size());
+    for (auto& item : msg.orders()) {
+      if (!fits_order_params(item) ||
+          item.ext_order_id().size() > OrderIdString::capacity) {
+        LOG_WARN("rejecting mass-cancel, symbol or order-id too long");
+        send_error(request, error::e0200, "symbol or order-id too long");
+        return;
+      }
+      orders.push_back({item.symbol(), item.order_id(), item.ext_order_id()});
+    }
+
+    auto wp = weak_from_this();
+    _event_loop.dispatch([wp, request, exchange = from_exchange(msg.exchange()),
+                          all_open = msg.all_open(),
+                          orders = std::move(orders)]() mutable {
+      if (auto sp = wp.lock())
+        sp->_server_callbacks.on_mass_cancel_request(
+            *sp, request, exchange, std::move(orders), all_open);
+    });
   } else if (type == gx::Type::logon) {
-    apex::pb::LogonRequest msg;
-    msg.ParseFromArray(payload, payload_len);
+    [[maybe_unused]] auto& msg =
+        _rx_messages.parse<apex::pb::LogonRequest>(payload, payload_len);
 
     // Request request;
     // request.req_type = RequestType::new_order;
@@ -239,16 +420,18 @@ void GxServerSession::io_on_full_message(gx::Header* header, char* payload,
     //   }
     // });
   } else if (type == gx::Type::om_logon) {
-    apex::pb::OmLogonRequest msg;
-    msg.ParseFromArray(payload, payload_len);
+    apex::pb::OmLogonRequest msg =
+        _rx_messages.parse<apex::pb::OmLogonRequest>(payload, payload_len);
 
     Request request;
     request.req_type = gx::Type::new_order;
     request.req_id = id;
 
     auto wp = weak_from_this();
-    _event_loop.dispatch([wp, request, msg]() mutable {
+    const bool binary = flags & static_cast<uint8_t>(gx::Flags::binary);
+    _event_loop.dispatch([wp, request, msg, binary]() mutable {
       if (auto sp = wp.lock()) {
+        sp->_binary_orders = binary;
         GxLogonRequest logon_request;
         logon_request.strategy_id = msg.strategy_id();
         switch (msg.run_mode()) {
@@ -292,28 +475,149 @@ void GxServerSession::send_om_logon_reply(std::string error)
   apex::pb::OmLogonReply msg;
   msg.set_error(error);
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-
-  gx::Header::init(&header, payload.size(), gx::Type::om_logon, flags);
-  header.id = 0;
-  header.hton();
-
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::om_logon, 0, msg);
 }
 
 
 void GxServerSession::set_app_id(std::string id) { this->_app_id = id; }
 
 
+void GxServerSession::send_tick(const std::shared_ptr<const gx::Frame>& frame,
+                                gx::t_msgid subscription_id,
+                                const void* stream)
+{
+  // ticks are sent, and the queue drained, under the queue lock, so that a
+  // new tick cannot overtake those queued
+  auto lock = std::scoped_lock(_queue_lock);
+
+  if (_overflowed)
+    throw TcpSocket::error("GX session closed as a slow consumer");
+
+  switch (_ticks.offer(frame, subscription_id, stream)) {
+    case GxTickQueue::Offer::send:
+      send_frame(frame, subscription_id);
+      break;
+    case GxTickQueue::Offer::backed_up: {
+      LOG_WARN("GX session " << QUOTE(_app_id) << " backed up, "
+               << send_backlog() << " bytes pending; conflating ticks");
+      auto wp = weak_from_this();
+      _io_loop.defer_fn(
+        [wp]() {
+          if (auto sp = wp.lock())
+            sp->check_backlog();
+        },
+        std::chrono::milliseconds(1));
+      break;
+    }
+    case GxTickQueue::Offer::queued:
+      break;
+    case GxTickQueue::Offer::overflow:
+      overflow("trade queue limit reached");
+      throw TcpSocket::error("GX session closed as a slow consumer");
+  }
+}
+
+
+void GxServerSession::check_backlog()
+{
+  /* IO thread */
+  auto lock = std::scoped_lock(_queue_lock);
+
+  if (_overflowed)
+    return;
+
+  GxTickQueue::Check result = GxTickQueue::Check::idle;
+  try {
+    result = _ticks.check(
+        [this](const std::shared_ptr<const gx::Frame>& frame,
+               gx::t_msgid subscription_id) {
+          send_frame(frame, subscription_id);
+        });
+  } catch (TcpSocket::error&) {
+    /* socket closing, error is reported via the read callback */
+    result = GxTickQueue::Check::recovered;
+  }
+
+  switch (result) {
+    case GxTickQueue::Check::idle:
+      return;
+    case GxTickQueue::Check::recovered:
+      LOG_INFO("GX session " << QUOTE(_app_id) << " recovered, conflated "
+               << _ticks.conflated() << " ticks, dropped " << _ticks.dropped()
+               << " trades");
+      return;
+    case GxTickQueue::Check::stalled:
+      overflow("stalled");
+      return;
+    case GxTickQueue::Check::waiting:
+      break;
+  }
+
+  auto wp = weak_from_this();
+  _io_loop.defer_fn(
+    [wp]() {
+      if (auto sp = wp.lock())
+        sp->check_backlog();
+    },
+    std::chrono::milliseconds(1));
+}
+
+
+void GxServerSession::overflow(const char* reason)
+{
+  /* _queue_lock held */
+  LOG_WARN("GX session " << QUOTE(_app_id) << " is a slow consumer ("
+           << reason << "), " << send_backlog()
+           << " bytes pending; disconnecting");
+  gx_slow_closed.add();
+  _overflowed = true;
+  _ticks.clear();
+
+  try {
+    _sock->close();
+  } catch (IoLoopClosed&) { /* ignore */
+  }
+}
+
+
+template<typename T>
+void GxServerSession::send_binary(gx::Type type, gx::t_msgid id, const T& msg)
+{
+  // header and payload are contiguous, so need just one socket write
+  send_frame(sizeof(gx::Header) + sizeof(T), [&](char* dest) {
+    auto* header = reinterpret_cast<gx::Header*>(dest);
+    gx::Header::init(header, sizeof(T), type,
+                     static_cast<uint8_t>(gx::Flags::binary));
+    header->id = id;
+    header->hton();
+    memcpy(dest + sizeof(gx::Header), &msg, sizeof(T));
+  });
+}
+
+
+void GxServerSession::send_mcast_channel(gx::t_msgid subscription_id,
+                                         const gx::bin::McastChannel& msg)
+{
+  send_binary(gx::Type::mcast_channel, subscription_id, msg);
+}
+
+
 void GxServerSession::send_order_fill(ExchangeId exchange_id,
                                       const std::string& order_id,
                                       const OrderFill& fill)
 {
+  if (_binary_orders) {
+    gx::bin::OrderFill msg;
+    if (gx::bin::set_id(msg.order_id, order_id)) {
+      msg.size = fill.size;
+      msg.price = fill.price;
+      msg.fully_filled = fill.is_fully_filled;
+      send_binary(gx::Type::order_fill, 0, msg);
+      return;
+    }
+  }
+
   // build network message
   apex::pb::OrderFill msg;
 
@@ -323,17 +627,8 @@ void GxServerSession::send_order_fill(ExchangeId exchange_id,
   msg.set_price(fill.price);
   msg.set_fully_filled(fill.is_fully_filled);
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-  gx::Header::init(&header, payload.size(), gx::Type::order_fill, flags);
-  header.id = 0;
-  header.hton();
-
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::order_fill, 0, msg);
 }
 
 
@@ -341,135 +636,173 @@ void GxServerSession::send_order_unsol_cancel(ExchangeId /*exchange_id*/,
                                               const std::string& order_id,
                                               const OrderUpdate& update)
 {
+  if (_binary_orders) {
+    gx::bin::OrderExec msg;
+    if (gx::bin::set_id(msg.order_id, order_id) &&
+        gx::bin::set_id(msg.ext_order_id, update.ext_order_id)) {
+      msg.close_reason = static_cast<uint32_t>(update.close_reason);
+      msg.order_state = static_cast<uint32_t>(update.state);
+      msg.reason = pb::OrderUpdateReason::UNSOLICITED;
+      send_binary(gx::Type::order_exec, 0, msg);
+      return;
+    }
+  }
+
   // build network message
   apex::pb::OrderExecution msg;
   msg.set_order_id(order_id);
   msg.set_close_reason(static_cast<uint32_t>(update.close_reason));
   msg.set_order_state(static_cast<uint32_t>(update.state));
+  msg.set_ext_order_id(update.ext_order_id.str());
   msg.set_reason(pb::OrderUpdateReason::UNSOLICITED);
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-
-  gx::Header::init(&header, payload.size(), gx::Type::order_exec, flags);
-  header.hton();
-
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::order_exec, 0, msg);
 }
 
 
-/* Used to convey new-order-ack and cancel-order-ack. */
-void GxServerSession::send(Request orig_req, OrderUpdate& update)
+/* Used to convey new-order-ack, cancel-order-ack and replace-order-ack, also
+ * for each order of a batch request. */
+void GxServerSession::send(Request orig_req, OrderUpdate& update,
+                           const std::string& order_id)
 {
-  // build network message
-  apex::pb::OrderExecution msg;
-  msg.set_close_reason(static_cast<uint32_t>(update.close_reason));
-  msg.set_order_state(static_cast<uint32_t>(update.state));
-  msg.set_ext_order_id(update.ext_order_id);
-
+  pb::OrderUpdateReason reason;
   switch (orig_req.req_type) {
     case gx::Type::new_order:
-      msg.set_reason(pb::OrderUpdateReason::NEW_ORDER_ACK);
+    case gx::Type::new_order_batch:
+      reason = pb::OrderUpdateReason::NEW_ORDER_ACK;
       break;
     case gx::Type::cancel_order:
-      msg.set_reason(pb::OrderUpdateReason::CANCEL_ORDER_ACK);
+    case gx::Type::mass_cancel:
+      reason = pb::OrderUpdateReason::CANCEL_ORDER_ACK;
+      break;
+    case gx::Type::replace_order:
+      reason = pb::OrderUpdateReason::REPLACE_ORDER_ACK;
       break;
     default:
-      msg.set_reason(pb::OrderUpdateReason::UNSOLICITED);
+      reason = pb::OrderUpdateReason::UNSOLICITED;
   }
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
+  if (_binary_orders) {
+    gx::bin::OrderExec msg;
+    if (gx::bin::set_id(msg.ext_order_id, update.ext_order_id) &&
+        gx::bin::set_id(msg.order_id, order_id)) {
+      msg.close_reason = static_cast<uint32_t>(update.close_reason);
+      msg.order_state = static_cast<uint32_t>(update.state);
+      msg.reason = reason;
+      send_binary(gx::Type::order_exec, orig_req.req_id, msg);
+      return;
+    }
+  }
 
-  gx::Header::init(&header, payload.size(), gx::Type::order_exec, flags);
-  header.id = orig_req.req_id;
-  header.hton();
+  // build network message
+  apex::pb::OrderExecution msg;
+  msg.set_order_id(order_id);
+  msg.set_close_reason(static_cast<uint32_t>(update.close_reason));
+  msg.set_order_state(static_cast<uint32_t>(update.state));
+  msg.set_ext_order_id(update.ext_order_id.str());
+  msg.set_reason(reason);
 
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::order_exec, orig_req.req_id, msg);
 }
 
 
 void GxServerSession::send_error(Request req, std::string code,
-                                 std::string error)
+                                 std::string error, const std::string& order_id)
 {
   // build network message
   apex::pb::Error msg;
   msg.set_orig_request_type(apex::to_underlying(req.req_type));
   msg.set_code(code);
   msg.set_text(error);
-
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-
-
-  gx::Header::init(&header, payload.size(), gx::Type::error, flags);
-  header.id = req.req_id;
-  header.hton();
+  msg.set_order_id(order_id);
 
   // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  send_message(gx::Type::error, req.req_id, msg);
 }
 
 
-void GxServerSession::send(const std::string & symbol,
-                           ExchangeId exchange_id,
-                           TickTrade& tick)
+std::shared_ptr<const gx::Frame> GxServerSession::encode(const TickTrade& tick)
 {
   // build network message
   apex::pb::TickTrade msg;
-  msg.set_symbol(symbol);
-  msg.set_exchange(to_exchange(exchange_id));
   msg.set_price(tick.price);
   msg.set_size(tick.qty);
   msg.set_side(from_size(tick.aggr_side));
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-  gx::Header::init(&header, payload.size(), gx::Type::trade, flags);
-
-  header.hton();
-
-  // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+  return std::make_shared<gx::Frame>(gx::Type::trade, 0, msg);
 }
 
 
-void GxServerSession::send(const std::string & symbol,
-                           ExchangeId exchange_id,
-                           TickTop& tick)
+std::shared_ptr<const gx::Frame> GxServerSession::encode(const TickTop& tick)
 {
   // build network message
   apex::pb::TickTop msg;
-  msg.set_symbol(symbol);
-  msg.set_exchange(to_exchange(exchange_id));
   msg.set_ask_price(tick.ask_price);
   msg.set_bid_price(tick.bid_price);
+  msg.set_rt(tick.trace.rt);
 
-  // build wire
-  auto payload = msg.SerializeAsString();
-  gx::Header header;
-  uint16_t flags = static_cast<uint16_t>(gx::Flags::proto3);
-  gx::Header::init(&header, payload.size(), gx::Type::tick_top, flags);
+  return std::make_shared<gx::Frame>(gx::Type::tick_top, 0, msg);
+}
 
-  header.hton();
 
-  // socket write/queue
-  _sock->write((char*)&header, sizeof(header));
-  _sock->write(payload.data(), payload.size());
+static gx::bin::TickTrade to_binary(const TickTrade& tick)
+{
+  gx::bin::TickTrade msg;
+  msg.price = tick.price;
+  msg.qty = tick.qty;
+  msg.xt = tick.xt.as_epoch_us().count();
+  msg.et = tick.et.as_epoch_us().count();
+  msg.aggr_side = static_cast<uint8_t>(tick.aggr_side);
+  msg.rt = tick.trace.rt;
+  msg.st = tick.trace.st;
+  return msg;
+}
+
+
+static gx::bin::TickTop to_binary(const TickTop& tick)
+{
+  gx::bin::TickTop msg;
+  msg.bid_price = tick.bid_price;
+  msg.bid_qty = tick.bid_qty;
+  msg.ask_price = tick.ask_price;
+  msg.ask_qty = tick.ask_qty;
+  msg.rt = tick.trace.rt;
+  msg.st = tick.trace.st;
+  return msg;
+}
+
+
+std::shared_ptr<const gx::Frame> GxServerSession::encode_binary(
+  const TickTrade& tick)
+{
+  auto msg = to_binary(tick);
+  return std::make_shared<gx::Frame>(gx::Type::trade, 0, &msg, sizeof(msg));
+}
+
+
+std::shared_ptr<const gx::Frame> GxServerSession::encode_binary(
+  const TickTop& tick)
+{
+  auto msg = to_binary(tick);
+  return std::make_shared<gx::Frame>(gx::Type::tick_top, 0, &msg, sizeof(msg));
+}
+
+
+std::shared_ptr<const gx::Frame> GxServerSession::encode_binary(
+  gx::FramePool& pool, const TickTrade& tick)
+{
+  auto msg = to_binary(tick);
+  return pool.make(gx::Type::trade, 0, &msg, sizeof(msg));
+}
+
+
+std::shared_ptr<const gx::Frame> GxServerSession::encode_binary(
+  gx::FramePool& pool, const TickTop& tick)
+{
+  auto msg = to_binary(tick);
+  return pool.make(gx::Type::tick_top, 0, &msg, sizeof(msg));
 }
 
 }; // namespace apex
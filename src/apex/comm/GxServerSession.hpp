@@ -19,10 +19,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/core/Services.hpp>
 #include <apex/comm/GxSessionBase.hpp>
+#include <apex/comm/GxTickQueue.hpp>
 #include <apex/model/Order.hpp>
 #include <apex/model/Instrument.hpp>
 #include <apex/model/tick_msgs.hpp>
 
+#include <chrono>
+#include <deque>
+#include <map>
+#include <vector>
+
 namespace apex
 {
 class UvErr;
@@ -39,6 +45,12 @@ struct GxSubscribeRequest {
   std::string symbol;
   ExchangeId exchange;
 
+  // client chosen id, used to address ticks sent with the binary encoding
+  gx::t_msgid subscription_id = 0;
+  bool binary = false;
+  bool multicast = false; // client can receive ticks via multicast
+  int streams = 0;        // mask of MdStream sent, zero for all
+
   GxSubscribeRequest(std::string symbol,
                      ExchangeId exchange)
     : symbol(std::move(symbol)),
@@ -72,25 +84,68 @@ public:
                        std::string symbol, std::string order_id,
                        std::string ext_order_id)>
         on_cancel_order_request;
+    std::function<void(GxServerSession&, Request, std::string ext_order_id,
+                       OrderParams)>
+        on_replace_order_request;
+    std::function<void(GxServerSession&, Request, std::vector<OrderParams>)>
+        on_submit_orders;
+    std::function<void(GxServerSession&, Request, ExchangeId,
+                       std::vector<CancelParams>, bool all_open)>
+        on_mass_cancel_request;
     std::function<bool(GxServerSession&, GxLogonRequest)> on_logon;
+    std::function<void(GxServerSession&, const gx::bin::McastRecover&)>
+        on_mcast_recover;
   };
 
+  /* Protection from a slow consumer, see GxTickQueue.  The high watermark
+   * should be well below the TcpSocket pending write limit, at which the
+   * socket is closed regardless. */
+  using SlowConsumerOptions = GxTickQueue::Options;
+
   GxServerSession(IoLoop& ioloop, RealtimeEventLoop& evloop, std::unique_ptr<TcpSocket>,
                   EventHandlers);
 
+  /* Configure slow consumer protection; call before the first send. */
+  void set_slow_consumer_options(SlowConsumerOptions options)
+  {
+    _ticks.set_options(options);
+  }
+
   ~GxServerSession();
 
-  void send(const std::string & native_symbol,
-            ExchangeId exchange_id, TickTrade&);
+  // Encode ticks once, for sending to each subscribed session.  Both
+  // encodings are addressed by subscription id, which send() applies, and so
+  // carry neither symbol nor exchange.
+  static std::shared_ptr<const gx::Frame> encode(const TickTrade&);
+  static std::shared_ptr<const gx::Frame> encode(const TickTop&);
+  static std::shared_ptr<const gx::Frame> encode_binary(const TickTrade&);
+  static std::shared_ptr<const gx::Frame> encode_binary(const TickTop&);
+  static std::shared_ptr<const gx::Frame> encode_binary(gx::FramePool&,
+                                                        const TickTrade&);
+  static std::shared_ptr<const gx::Frame> encode_binary(gx::FramePool&,
+                                                        const TickTop&);
+
+  void send(const std::shared_ptr<const gx::Frame>& frame,
+            gx::t_msgid subscription_id = 0)
+  {
+    send_frame(frame, subscription_id);
+  }
 
-  void send(const std::string & symbol, ExchangeId, TickTop&);
+  /* Send a frame of tick data, from the stream identified by `stream`, via
+   * the conflating queue.  While the socket is backed up, only the latest
+   * tick_top is kept per stream, and trades are queued, up to a limit. */
+  void send_tick(const std::shared_ptr<const gx::Frame>& frame,
+                 gx::t_msgid subscription_id, const void* stream);
 
   void send(ExchangeId, const std::vector<AccountUpdate>&);
 
   // Reply to a previous request with an error result
-  void send_error(Request, std::string code, std::string error);
+  void send_error(Request, std::string code, std::string error,
+                  const std::string& order_id = {});
 
-  void send(Request, OrderUpdate&);
+  // Reply to a previous request with an order update; replies to a batch
+  // request identify the order
+  void send(Request, OrderUpdate&, const std::string& order_id = {});
 
   void send_order_fill(ExchangeId exchange_id,
                        const std::string& order_id, const OrderFill& fill);
@@ -101,6 +156,10 @@ public:
   void send_logon_reply(std::string error = "");
   void send_om_logon_reply(std::string error = "");
 
+  // Inform the client that a subscription is served via multicast
+  void send_mcast_channel(gx::t_msgid subscription_id,
+                          const gx::bin::McastChannel&);
+
   void set_app_id(std::string);
 
 private:
@@ -109,10 +168,24 @@ private:
   void io_on_full_message(gx::Header* header, char* payload,
                           size_t payload_len) override;
 
+  template<typename T>
+  void send_binary(gx::Type type, gx::t_msgid id, const T& msg);
+
+  void check_backlog();
+  void overflow(const char* reason);
+
+  // conflating queue, used while the socket is backed up
+  std::mutex _queue_lock;
+  GxTickQueue _ticks;
+  bool _overflowed = false;
+
   EventHandlers _server_callbacks;
   std::string _app_id;
 
   bool _logon_accepted = false;
+
+  // order messages use the binary encoding, as requested by the client logon
+  bool _binary_orders = false;
 };
 
 } // namespace apex
@@ -16,6 +16,13 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/comm/GxSessionBase.hpp>
+#include <apex/util/Metrics.hpp>
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+#include <unistd.h>
 
 namespace apex
 {
@@ -24,11 +31,193 @@ namespace gx
 
 void Header::hton()
 {
+  // flags is a single byte, so has no byte order
   this->len = ::htons(this->len);
-  this->flags = ::htons(this->flags);
   this->id = ::htons(this->id);
 }
 
+
+Frame::Frame(Type type, t_msgid id, const google::protobuf::MessageLite& msg,
+             uint8_t flags)
+  : _bytes(sizeof(Header) + msg.ByteSizeLong()), _id(id)
+{
+  auto* header = reinterpret_cast<Header*>(_bytes.data());
+  Header::init(header, _bytes.size() - sizeof(Header), type, flags);
+  header->id = id;
+  header->hton();
+  msg.SerializeWithCachedSizesToArray(
+    reinterpret_cast<uint8_t*>(_bytes.data() + sizeof(Header)));
+}
+
+
+Frame::Frame(Type type, t_msgid id, const void* payload, size_t payload_len,
+             uint8_t flags)
+{
+  assign(type, id, payload, payload_len, flags);
+}
+
+
+void Frame::assign(Type type, t_msgid id, const void* payload,
+                   size_t payload_len, uint8_t flags)
+{
+  _bytes.resize(sizeof(Header) + payload_len);
+  _id = id;
+  auto* header = reinterpret_cast<Header*>(_bytes.data());
+  Header::init(header, payload_len, type, flags);
+  header->id = id;
+  header->hton();
+  memcpy(_bytes.data() + sizeof(Header), payload, payload_len);
+}
+
+
+std::shared_ptr<const Frame> FramePool::make(Type type, t_msgid id,
+                                             const void* payload,
+                                             size_t payload_len, uint8_t flags)
+{
+  for (size_t i = 0; i < _frames.size(); i++) {
+    auto& frame = _frames[(_next + i) % _frames.size()];
+    if (frame.use_count() == 1) {
+      // pairs with the release of the last other reference, which may have
+      // been dropped on another thread after reading the frame
+      std::atomic_thread_fence(std::memory_order_acquire);
+      _next = (_next + i + 1) % _frames.size();
+      frame->assign(type, id, payload, payload_len, flags);
+      return frame;
+    }
+  }
+
+  auto frame = std::make_shared<Frame>(type, id, payload, payload_len, flags);
+  if (_frames.size() < _max_frames)
+    _frames.push_back(frame);
+  return frame;
+}
+
+
+std::string shm_ring_name()
+{
+  static std::atomic<unsigned> counter{0};
+  std::ostringstream oss;
+  oss << "/apex-gx-" << ::getpid() << "-" << ++counter;
+  return oss.str();
+}
+
+
+const char* type_name(Type type)
+{
+  switch (type) {
+    case Type::null: return "null";
+    case Type::subscribe: return "subscribe";
+    case Type::subscribe_batch: return "subscribe_batch";
+    case Type::new_order: return "new_order";
+    case Type::cancel_order: return "cancel_order";
+    case Type::replace_order: return "replace_order";
+    case Type::new_order_batch: return "new_order_batch";
+    case Type::mass_cancel: return "mass_cancel";
+    case Type::logon: return "logon";
+    case Type::trade: return "trade";
+    case Type::subscribe_account: return "subscribe_account";
+    case Type::account_update: return "account_update";
+    case Type::tick_top: return "tick_top";
+    case Type::error: return "error";
+    case Type::order_fill: return "order_fill";
+    case Type::om_logon: return "om_logon";
+    case Type::order_exec: return "order_exec";
+    case Type::shm_attach: return "shm_attach";
+    case Type::mcast_channel: return "mcast_channel";
+    case Type::mcast_recover: return "mcast_recover";
+    case Type::ping: return "ping";
+    case Type::pong: return "pong";
+  }
+  return "unknown";
+}
+
+
+namespace
+{
+// process wide traffic counters of one message type
+struct TypeCounters {
+  metrics::Counter* in_messages;
+  metrics::Counter* in_bytes;
+  metrics::Counter* in_nanos;
+  metrics::Counter* out_messages;
+  metrics::Counter* out_bytes;
+};
+
+TypeCounters& type_counters(Type type)
+{
+  static std::array<std::atomic<TypeCounters*>, 128> table{};
+  static std::mutex mutex;
+
+  auto& slot = table[static_cast<uint8_t>(type) & 0x7F];
+  if (auto* counters = slot.load(std::memory_order_acquire))
+    return *counters;
+
+  std::lock_guard<std::mutex> guard(mutex);
+  if (auto* counters = slot.load(std::memory_order_relaxed))
+    return *counters;
+
+  const std::string label = std::string("{type=\"") + type_name(type) + "\"}";
+  auto& registry = metrics::registry();
+  auto* counters = new TypeCounters{
+    &registry.counter("apex_gx_in_messages_total" + label,
+                      "GX messages received, by type"),
+    &registry.counter("apex_gx_in_bytes_total" + label,
+                      "GX bytes received, by message type"),
+    &registry.counter("apex_gx_in_handle_nanoseconds_total" + label,
+                      "Time spent decoding and handling received GX messages"),
+    &registry.counter("apex_gx_out_messages_total" + label,
+                      "GX messages sent, by type"),
+    &registry.counter("apex_gx_out_bytes_total" + label,
+                      "GX bytes sent, by message type")};
+  slot.store(counters, std::memory_order_release);
+  return *counters;
+}
+} // namespace
+
+
+void TrafficTable::record_in(Type type, size_t bytes, uint64_t nanos)
+{
+  auto& slot = _slots[index(type)];
+  slot.in_messages.fetch_add(1, std::memory_order_relaxed);
+  slot.in_bytes.fetch_add(bytes, std::memory_order_relaxed);
+  slot.in_nanos.fetch_add(nanos, std::memory_order_relaxed);
+
+  auto& counters = type_counters(type);
+  counters.in_messages->add();
+  counters.in_bytes->add(bytes);
+  counters.in_nanos->add(nanos);
+}
+
+
+void TrafficTable::record_out(Type type, size_t bytes)
+{
+  auto& slot = _slots[index(type)];
+  slot.out_messages.fetch_add(1, std::memory_order_relaxed);
+  slot.out_bytes.fetch_add(bytes, std::memory_order_relaxed);
+
+  auto& counters = type_counters(type);
+  counters.out_messages->add();
+  counters.out_bytes->add(bytes);
+}
+
+
+std::vector<std::pair<Type, TrafficStats>> TrafficTable::snapshot() const
+{
+  std::vector<std::pair<Type, TrafficStats>> result;
+  for (size_t i = 0; i < _slots.size(); i++) {
+    auto& slot = _slots[i];
+    TrafficStats stats;
+    stats.in_messages = slot.in_messages.load(std::memory_order_relaxed);
+    stats.in_bytes = slot.in_bytes.load(std::memory_order_relaxed);
+    stats.in_nanos = slot.in_nanos.load(std::memory_order_relaxed);
+    stats.out_messages = slot.out_messages.load(std::memory_order_relaxed);
+    stats.out_bytes = slot.out_bytes.load(std::memory_order_relaxed);
+    if (stats.in_messages || stats.out_messages)
+      result.emplace_back(static_cast<Type>(i), stats);
+  }
+  return result;
+}
+
 }
 
 } // namespace apex
@@ -17,13 +17,24 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/comm/GxBinaryFormat.hpp>
 #include <apex/comm/GxWireFormat.pb.h>
-#include <apex/infra/DecodeBuffer.hpp>
+#include <apex/infra/RingDecodeBuffer.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/infra/ShmRing.hpp>
+#include <apex/infra/SocketAddress.hpp>
 #include <apex/util/RealtimeEventLoop.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/core/Logger.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <netinet/in.h>
 
 namespace apex
@@ -39,14 +50,20 @@ namespace gx
 
 enum class Flags : uint8_t {
   proto3 = 1 << 0,
+  binary = 1 << 1, // fixed layout payload, see GxBinaryFormat.hpp
+  multicast = 1 << 2, // on subscribe, receive ticks via multicast if offered
 };
 
 
 enum class Type : char {
   null = '0',
   subscribe = 'S',
+  subscribe_batch = 'B',
   new_order = 'D',
   cancel_order = 'F',
+  replace_order = 'G',
+  new_order_batch = 'E',
+  mass_cancel = 'q',
   logon = 'A',
   trade = 't',
   subscribe_account = 's',
@@ -55,7 +72,12 @@ enum class Type : char {
   error = 'e',
   order_fill = 'f',
   om_logon = 'l',
-  order_exec = 'x'
+  order_exec = 'x',
+  shm_attach = 'm',
+  mcast_channel = 'c',
+  mcast_recover = 'r',
+  ping = 'i',
+  pong = 'o'
 };
 
 typedef uint32_t t_msgid;
@@ -77,6 +99,165 @@ struct Header {
 
   void hton();
 };
+
+
+/* An encoded GX message, header and payload.  A frame is immutable once
+ * built, so a message sent to many sessions is encoded just once, and the same
+ * bytes queued on each socket. */
+class Frame
+{
+public:
+  Frame(Type, t_msgid, const google::protobuf::MessageLite&,
+        uint8_t flags = static_cast<uint8_t>(Flags::proto3));
+
+  // fixed layout payload, as defined in GxBinaryFormat.hpp
+  Frame(Type, t_msgid, const void* payload, size_t payload_len,
+        uint8_t flags = static_cast<uint8_t>(Flags::binary));
+
+  const char* data() const { return _bytes.data(); }
+  size_t size() const { return _bytes.size(); }
+  t_msgid id() const { return _id; }
+
+private:
+  friend class FramePool;
+
+  void assign(Type, t_msgid, const void* payload, size_t payload_len,
+              uint8_t flags);
+
+  std::vector<char> _bytes;
+  t_msgid _id;
+};
+
+
+/* Recycles fixed-layout frames, so the frames of a steady tick stream are
+ * built without allocating.  A pooled frame is rebuilt only once the pool
+ * holds the sole reference to it, so a frame still queued or retained
+ * elsewhere is never modified.  Not thread safe; intended for use by a
+ * single publisher. */
+class FramePool
+{
+public:
+  explicit FramePool(size_t max_frames = 64) : _max_frames(max_frames) {}
+
+  std::shared_ptr<const Frame> make(
+    Type, t_msgid, const void* payload, size_t payload_len,
+    uint8_t flags = static_cast<uint8_t>(Flags::binary));
+
+  [[nodiscard]] size_t size() const { return _frames.size(); }
+
+private:
+  size_t _max_frames;
+  size_t _next = 0;
+  std::vector<std::shared_ptr<Frame>> _frames;
+};
+
+
+/* Reusable instances of wire messages, one per message class.  A protobuf
+ * message retains the storage of its string and repeated fields when cleared,
+ * so once each class has been seen, parsing or building a message into its
+ * cached instance does not allocate.  A message obtained from the cache is
+ * valid only until the next use of the same class; not thread safe, so each
+ * thread that handles messages uses its own cache. */
+class MessageCache
+{
+public:
+  // cached instance of `M`, cleared
+  template <typename M>
+  M& get()
+  {
+    auto& msg = slot<M>();
+    msg.Clear();
+    return msg;
+  }
+
+  /* Parse a payload into the cached instance of `M`.  As with a freshly
+   * constructed message, an unparsable payload leaves the message partially
+   * filled. */
+  template <typename M>
+  M& parse(const char* payload, size_t payload_len)
+  {
+    auto& msg = slot<M>();
+    msg.ParseFromArray(payload, static_cast<int>(payload_len));
+    return msg;
+  }
+
+private:
+  static size_t next_index()
+  {
+    static std::atomic<size_t> next{0};
+    return next++;
+  }
+
+  template <typename M>
+  static size_t index()
+  {
+    static const size_t index = next_index();
+    return index;
+  }
+
+  template <typename M>
+  M& slot()
+  {
+    const size_t i = index<M>();
+    if (i >= _messages.size())
+      _messages.resize(i + 1);
+    if (!_messages[i])
+      _messages[i] = std::make_unique<M>();
+    return static_cast<M&>(*_messages[i]);
+  }
+
+  std::vector<std::unique_ptr<google::protobuf::MessageLite>> _messages;
+};
+
+
+// Unique name for a shared memory ring created by this process.
+std::string shm_ring_name();
+
+
+// Name of a message type, as used in logs and metric labels.
+const char* type_name(Type);
+
+
+/* Traffic of one message type: counts and bytes, header included, in each
+ * direction, and the cumulative time spent decoding and handling inbound
+ * messages. */
+struct TrafficStats {
+  uint64_t in_messages = 0;
+  uint64_t in_bytes = 0;
+  uint64_t in_nanos = 0;
+  uint64_t out_messages = 0;
+  uint64_t out_bytes = 0;
+};
+
+
+/* Per message type traffic accounting of a session.  Each record also adds
+ * to process wide counters of the metrics registry, labelled by type, so
+ * that totals survive the session.  Inbound messages are recorded by the
+ * reading thread, and outbound under the session send lock; snapshot may be
+ * taken from any thread. */
+class TrafficTable
+{
+public:
+  void record_in(Type, size_t bytes, uint64_t nanos);
+  void record_out(Type, size_t bytes);
+
+  // types that have seen any traffic, in type order
+  [[nodiscard]] std::vector<std::pair<Type, TrafficStats>> snapshot() const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> in_messages{0};
+    std::atomic<uint64_t> in_bytes{0};
+    std::atomic<uint64_t> in_nanos{0};
+    std::atomic<uint64_t> out_messages{0};
+    std::atomic<uint64_t> out_bytes{0};
+  };
+
+  static size_t index(Type type) { return static_cast<uint8_t>(type) & 0x7F; }
+
+  std::array<Slot, 128> _slots;
+};
+
 } // namespace gx
 
 
@@ -91,18 +272,52 @@ public:
     std::function<void(T&)> on_err;
   };
 
+  /* Output batching.  When enabled, messages sent during an IO loop iteration
+   * are accumulated and written to the socket with a single write at the end
+   * of the iteration, or sooner, once the batch reaches max_bytes.  A nonzero
+   * max_delay allows a batch to remain open over several iterations. */
+  struct BatchOptions {
+    bool enabled = false;
+    size_t max_bytes = 64 * 1024;
+    std::chrono::microseconds max_delay{0};
+  };
+
+  struct SendStats {
+    uint64_t messages = 0;
+    uint64_t writes = 0;
+
+    // average messages per socket write
+    double batching_ratio() const
+    {
+      return writes ? static_cast<double>(messages) / writes : 0.0;
+    }
+  };
+
+  /* Shared memory transport.  When both peers are on the same host, and both
+   * enable it, the client offers a pair of shared memory rings after
+   * connecting, and once accepted, subsequent messages in each direction are
+   * sent via the rings instead of the socket.  The socket stays open, so that
+   * loss of the peer is still detected.  Each session reads its ring on a
+   * dedicated thread, which either busy polls, or sleeps on a futex. */
+  struct ShmOptions {
+    bool enabled = false;
+    bool poll = false;
+    size_t ring_size = 4 * 1024 * 1024;
+  };
+
   GxSessionBase(IoLoop& ioloop, RealtimeEventLoop& evloop,
                 std::unique_ptr<TcpSocket> sk)
     : _io_loop(ioloop),
       _event_loop(evloop),
       _sock(std::move(sk)),
-      _buf(1000, 1000000)
+      _buf(RingDecodeBuffer::Policy{})
   {
   }
 
   ~GxSessionBase()
   {
     // assert(this->_event_loop.this_)
+    shm_stop();
     if (_sock)
       _sock->close().wait();
   }
@@ -111,6 +326,50 @@ public:
 
   TcpSocket* get_socket() { return _sock.get(); }
 
+  /* Configure sizing of the inbound decode buffer; call before the first
+   * read. */
+  void set_read_buffer(DecodeBufferPolicy policy) { _buf.set_policy(policy); }
+
+  const DecodeBufferStats& read_buffer_stats() const { return _buf.stats(); }
+
+  /* Configure output batching; call before the first send. */
+  void set_batching(BatchOptions options)
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    _batching = options;
+  }
+
+  SendStats send_stats()
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    return _send_stats;
+  }
+
+  /* Enable per message type traffic accounting, see gx::TrafficTable; call
+   * before the session starts reading.  Off by default, since inbound
+   * accounting reads the clock twice per message. */
+  void set_traffic_stats(bool enabled)
+  {
+    _traffic = enabled ? std::make_unique<gx::TrafficTable>() : nullptr;
+  }
+
+  bool traffic_stats_enabled() const { return _traffic != nullptr; }
+
+  std::vector<std::pair<gx::Type, gx::TrafficStats>> traffic_stats() const
+  {
+    return _traffic ? _traffic->snapshot()
+                    : std::vector<std::pair<gx::Type, gx::TrafficStats>>{};
+  }
+
+  /* Configure the shared memory transport; call before connecting. */
+  void set_shm_options(ShmOptions options) { _shm_options = options; }
+
+  bool shm_active()
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    return _shm_tx != nullptr;
+  }
+
 
   void start_read(std::function<void(T&, apex::UvErr)> err_cb)
   {
@@ -140,51 +399,466 @@ protected:
   std::unique_ptr<TcpSocket> _sock;
 
 
-  /* Invoked on the io-thread */
+  /* Invoked on the io-thread, or on the shared memory reader thread */
   virtual void io_on_full_message(gx::Header* header, char* payload,
                                   size_t payload_len) = 0;
 
+  /* Inbound messages, for use by io_on_full_message.  The io-thread and the
+   * shared memory reader thread share the cache, since the handover to the
+   * ring ends the reading of messages from the socket. */
+  gx::MessageCache _rx_messages;
+
+  /* Bytes sent but not yet consumed by the peer. */
+  size_t send_backlog()
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    return _shm_tx ? _shm_tx->used_bytes() : _sock->bytes_pending_write();
+  }
+
+  /* Client: offer the shared memory transport, if enabled and the peer is on
+   * this host.  Failure to create the rings leaves the session on the
+   * socket. */
+  void shm_offer()
+  {
+    if (!_shm_options.enabled || !_sock->get_peer_address().is_loopback())
+      return;
+
+    gx::bin::ShmAttach msg = {};
+    msg.stage = gx::bin::ShmAttach::offer;
+    try {
+      _shm_pending_rx =
+          ShmRing::create(gx::shm_ring_name(), _shm_options.ring_size);
+      _shm_pending_tx =
+          ShmRing::create(gx::shm_ring_name(), _shm_options.ring_size);
+    } catch (std::exception& e) {
+      LOG_WARN("GX shared memory transport unavailable: " << e.what());
+      shm_discard_pending();
+      return;
+    }
+
+    strncpy(msg.client_ring, _shm_pending_tx->name().c_str(),
+            gx::bin::shm_name_size - 1);
+    strncpy(msg.server_ring, _shm_pending_rx->name().c_str(),
+            gx::bin::shm_name_size - 1);
+    send_frame(sizeof(gx::Header) + sizeof(msg),
+               [&](char* dest) { encode_shm_attach(dest, msg); });
+  }
+
+  /* Stop using the shared memory transport, and the reader thread. */
+  void shm_stop()
+  {
+    std::shared_ptr<ShmRing> rx;
+    {
+      auto lock = std::scoped_lock(_send_lock);
+      if (_shm_tx)
+        _shm_tx->close();
+      _shm_tx.reset();
+      rx = std::move(_shm_rx);
+    }
+    shm_discard_pending();
+
+    if (rx)
+      rx->close();
+    if (_shm_thread.joinable()) {
+      // the reader thread can release the final reference to the session
+      if (_shm_thread.get_id() == std::this_thread::get_id())
+        _shm_thread.detach();
+      else
+        _shm_thread.join();
+    }
+  }
+
+  /* Serialise a message, header and payload, into the session send arena,
+   * and queue it with a single socket write, or append it to the current
+   * batch.  May be called from any thread; the arena is reused, so is only
+   * allocated when a larger message or batch is sent. */
+  void send_message(gx::Type type, gx::t_msgid id,
+                    const google::protobuf::MessageLite& msg,
+                    uint8_t flags = static_cast<uint8_t>(gx::Flags::proto3))
+  {
+    const size_t payload_len = msg.ByteSizeLong();
+
+    send_frame(sizeof(gx::Header) + payload_len, [&](char* dest) {
+      auto* header = reinterpret_cast<gx::Header*>(dest);
+      gx::Header::init(header, payload_len, type, flags);
+      header->id = id;
+      header->hton();
+      msg.SerializeWithCachedSizesToArray(
+        reinterpret_cast<uint8_t*>(dest + sizeof(gx::Header)));
+    });
+  }
+
+  /* Queue a shared frame, addressed with message `id`.  When not batching,
+   * a frame built with the same id is queued without copying; otherwise the
+   * frame is copied into the send arena, with the header id rewritten. */
+  void send_frame(const std::shared_ptr<const gx::Frame>& frame, gx::t_msgid id)
+  {
+    auto lock = std::scoped_lock(_send_lock);
+
+    if (!_shm_tx && !_batching.enabled && frame->id() == id) {
+      _send_stats.messages++;
+      _send_stats.writes++;
+      if (_traffic)
+        _traffic->record_out(
+          reinterpret_cast<const gx::Header*>(frame->data())->type,
+          frame->size());
+      _sock->write(frame, frame->data(), frame->size());
+      return;
+    }
+
+    send_frame_locked(frame->size(), [&](char* dest) {
+      memcpy(dest, frame->data(), frame->size());
+      auto* header = reinterpret_cast<gx::Header*>(dest);
+      header->id = ::htons(id);
+    });
+  }
+
+  /* Reserve `len` bytes of the send arena, encode the message via `encode`,
+   * then write or batch it. */
+  template <typename F>
+  void send_frame(size_t len, F&& encode)
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    send_frame_locked(len, std::forward<F>(encode));
+  }
+
 private:
   void io_on_read(char* src, size_t src_len)
   {
     /* io-thread */
 
     while (src_len) {
+      // While no partial message is held over from an earlier read, messages
+      // are decoded directly from the socket read buffer, and only a trailing
+      // partial message is copied into the DecodeBuffer.
+      if (_buf.avail() == 0) {
+        RingDecodeBuffer::read_pointer rd(src, src_len);
+        decode_messages(rd);
+        src += rd.consumed();
+        src_len -= rd.consumed();
+        if (src_len == 0)
+          break;
+      }
+
       const size_t consumed = _buf.consume(src, src_len);
       src += consumed;
       src_len -= consumed;
 
       // now attempt to parse whatever is in the DecodeBuffer
       auto rd = _buf.read_ptr();
-      while (rd.avail() >= sizeof(apex::gx::Header)) {
-        gx::Header* header = (gx::Header*)rd.ptr();
-        const auto msglen = ::ntohs(header->len);
+      decode_messages(rd);
 
-        if (rd.avail() < msglen)
-          break;
+      // detect inbound DecodeBuffer overflow
+      if ((src_len > 0) && (consumed == 0) && (rd.consumed() == 0)) {
+        throw decode_buffer_overflow(
+            "GX connection inbound DecodeBuffer overflow");
+      }
+
+      _buf.discard(rd); /* advance past the decoded bytes */
+    }
+  }
+
+  void decode_messages(RingDecodeBuffer::read_pointer& rd)
+  {
+    while (rd.avail() >= sizeof(apex::gx::Header)) {
+      gx::Header* header = (gx::Header*)rd.ptr();
+      const auto msglen = ::ntohs(header->len);
+
+      if (rd.avail() < msglen)
+        break;
+
+      // complete header & payload is available; we can now mutate header
+      // byte(ntoh) because they will all be discarded after the following
+      // call to parse the full message
+      header->len = ::ntohs(header->len);
+      header->id = ::ntohs(header->id);
+      dispatch_message(header, [&]() {
+        if (header->type == gx::Type::shm_attach)
+          io_on_shm_attach(header->payload, header->len - sizeof(gx::Header));
+        else
+          this->io_on_full_message(header, header->payload,
+                                   header->len - sizeof(gx::Header));
+      });
+      rd.advance(msglen); // note, use msglen, instead of header->len, just in
+                          // case was changed.
+    }
+  }
+
+  /* Pass a complete message to its handler, with traffic accounting if
+   * enabled. */
+  template <typename F>
+  void dispatch_message(gx::Header* header, F&& handle)
+  {
+    /* io-thread, or shared memory reader thread */
+    if (!_traffic) {
+      handle();
+      return;
+    }
+
+    // header fields are read first, since the handler may modify them
+    const auto type = header->type;
+    const size_t len = header->len;
+    const auto start = std::chrono::steady_clock::now();
+    handle();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    _traffic->record_in(
+      type, len,
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+  }
+
+  template <typename F>
+  void send_frame_locked(size_t len, F&& user_encode)
+  {
+    /* _send_lock held */
+    _send_stats.messages++;
+
+    auto encode = [&](char* dest) {
+      user_encode(dest);
+      if (_traffic)
+        _traffic->record_out(reinterpret_cast<gx::Header*>(dest)->type, len);
+    };
+
+    if (_shm_tx) {
+      shm_write(len, encode);
+      _send_stats.writes++;
+      return;
+    }
+
+    if (!_batching.enabled) {
+      if (_send_arena.size() < len)
+        _send_arena.resize(len);
+      encode(_send_arena.data());
+      _send_stats.writes++;
+      _sock->write(_send_arena.data(), len);
+      return;
+    }
+
+    if (_send_arena.size() < _batch_len + len)
+      _send_arena.resize(std::max(_batch_len + len, 2 * _send_arena.size()));
+    encode(_send_arena.data() + _batch_len);
+    _batch_len += len;
+
+    if (_batch_len >= _batching.max_bytes)
+      write_batch();
+    else if (!_flush_scheduled) {
+      auto wp = this->weak_from_this();
+      _io_loop.defer_fn(
+        [wp]() {
+          if (auto sp = wp.lock())
+            sp->flush_batch();
+        },
+        _batching.max_delay);
+      _flush_scheduled = true;
+    }
+  }
+
+  template <typename F>
+  void shm_write(size_t len, F& encode)
+  {
+    /* _send_lock held */
+    using namespace std::chrono;
+    if (_shm_tx->write(len, encode))
+      return;
+
+    // the ring is full, so allow the reader a short time to catch up
+    auto deadline = steady_clock::now() + seconds(1);
+    while (!_shm_tx->write(len, encode)) {
+      if (_shm_tx->is_closed() || steady_clock::now() > deadline)
+        throw TcpSocket::error("GX shared memory ring full or closed");
+      std::this_thread::yield();
+    }
+  }
+
+  static void encode_shm_attach(char* dest, const gx::bin::ShmAttach& msg)
+  {
+    auto* header = reinterpret_cast<gx::Header*>(dest);
+    gx::Header::init(header, sizeof(msg), gx::Type::shm_attach,
+                     static_cast<uint8_t>(gx::Flags::binary));
+    header->hton();
+    memcpy(dest + sizeof(gx::Header), &msg, sizeof(msg));
+  }
 
-        // complete header & payload is available; we can now mutate header
-        // byte(ntoh) because they will all be discarded after the following
-        // call to parse the full message
-        header->len = ::ntohs(header->len);
-        header->flags = ::ntohs(header->flags);
-        header->id = ::ntohs(header->id);
+  /* Send a negotiation message on the socket, and then, atomically with
+   * respect to other sends, direct subsequent messages to `tx`. */
+  void shm_switch_tx(const gx::bin::ShmAttach& msg,
+                     std::unique_ptr<ShmRing> tx)
+  {
+    auto lock = std::scoped_lock(_send_lock);
+    send_frame_locked(sizeof(gx::Header) + sizeof(msg),
+                      [&](char* dest) { encode_shm_attach(dest, msg); });
+    write_batch(); // any batched messages precede those sent via the ring
+    _shm_tx = std::move(tx);
+  }
+
+  void shm_start_rx(std::unique_ptr<ShmRing> ring)
+  {
+    if (_shm_thread.joinable())
+      return;
+    {
+      auto lock = std::scoped_lock(_send_lock);
+      _shm_rx = std::move(ring);
+    }
+
+    auto wp = this->weak_from_this();
+    std::shared_ptr<ShmRing> rx = _shm_rx;
+    const bool poll = _shm_options.poll;
+    _shm_thread = std::thread([wp, rx, poll]() {
+      Logger::instance().register_thread_id("gxshm");
+      while (true) {
+        size_t count = 0;
+        {
+          auto sp = wp.lock();
+          if (!sp)
+            return;
+          count = rx->read([&](char* msg, size_t len) {
+            sp->shm_on_message(msg, len);
+          });
+        }
+        if (count == 0) {
+          if (rx->is_closed())
+            return;
+          if (!poll)
+            rx->wait(std::chrono::milliseconds(100));
+        }
+      }
+    });
+  }
+
+  void shm_on_message(char* msg, size_t len)
+  {
+    /* shared memory reader thread */
+    auto* header = reinterpret_cast<gx::Header*>(msg);
+    header->len = ::ntohs(header->len);
+    header->id = ::ntohs(header->id);
+    if (len < sizeof(gx::Header) || header->len != len) {
+      LOG_WARN("discarding invalid GX message from shared memory ring");
+      return;
+    }
+    try {
+      dispatch_message(header, [&]() {
         this->io_on_full_message(header, header->payload,
-                                 header->len - sizeof(gx::Header));
-        rd.advance(msglen); // note, use msglen, instead of header->len, just in
-                            // case was changed.
+                                 len - sizeof(gx::Header));
+      });
+    } catch (std::exception& e) {
+      LOG_ERROR("exception handling GX message from shared memory ring: "
+                << e.what());
+    }
+  }
+
+  void shm_discard_pending()
+  {
+    for (auto* ring : {&_shm_pending_rx, &_shm_pending_tx})
+      if (*ring) {
+        (*ring)->unlink();
+        ring->reset();
       }
+  }
 
-      // detect inbound DecodeBuffer overflow
-      if ((src_len > 0) && (consumed == 0) && (rd.consumed() == 0)) {
-        throw std::runtime_error("GX connection inbound DecodeBuffer overflow");
+  void io_on_shm_attach(const char* payload, size_t payload_len)
+  {
+    /* IO thread */
+    auto* msg = gx::bin::cast<gx::bin::ShmAttach>(payload, payload_len);
+    if (!msg)
+      return;
+
+    std::string client_ring(msg->client_ring,
+                            strnlen(msg->client_ring, gx::bin::shm_name_size));
+    std::string server_ring(msg->server_ring,
+                            strnlen(msg->server_ring, gx::bin::shm_name_size));
+
+    gx::bin::ShmAttach reply = *msg;
+    switch (msg->stage) {
+      case gx::bin::ShmAttach::offer: {
+        // server: the rings are named from the client's perspective
+        std::unique_ptr<ShmRing> rx, tx;
+        if (_shm_options.enabled && _sock->get_peer_address().is_loopback()) {
+          try {
+            rx = ShmRing::open(client_ring);
+            tx = ShmRing::open(server_ring);
+          } catch (std::exception& e) {
+            LOG_WARN("GX shared memory offer declined: " << e.what());
+            rx.reset();
+          }
+        }
+        if (rx && tx) {
+          LOG_INFO("GX session using shared memory transport");
+          _shm_pending_rx = std::move(rx);
+          reply.stage = gx::bin::ShmAttach::accept;
+          shm_switch_tx(reply, std::move(tx));
+        } else {
+          reply.stage = gx::bin::ShmAttach::reject;
+          send_frame(sizeof(gx::Header) + sizeof(reply),
+                     [&](char* dest) { encode_shm_attach(dest, reply); });
+        }
+        break;
+      }
+      case gx::bin::ShmAttach::commit: {
+        // server: all messages the client sent on the socket have been read
+        if (_shm_pending_rx)
+          shm_start_rx(std::move(_shm_pending_rx));
+        break;
+      }
+      case gx::bin::ShmAttach::accept: {
+        // client: all messages the server sent on the socket have been read
+        if (!_shm_pending_rx || !_shm_pending_tx)
+          break;
+        LOG_INFO("GX session using shared memory transport");
+        _shm_pending_rx->unlink();
+        _shm_pending_tx->unlink();
+        shm_start_rx(std::move(_shm_pending_rx));
+        reply.stage = gx::bin::ShmAttach::commit;
+        shm_switch_tx(reply, std::move(_shm_pending_tx));
+        break;
       }
+      case gx::bin::ShmAttach::reject: {
+        LOG_INFO("GX shared memory transport declined by server");
+        shm_discard_pending();
+        break;
+      }
+    }
+  }
 
-      _buf.discard(rd); /* shift unused bytes to front of DecodeBuffer */
+  void flush_batch()
+  {
+    /* IO thread */
+    auto lock = std::scoped_lock(_send_lock);
+    _flush_scheduled = false;
+    try {
+      write_batch();
+    } catch (TcpSocket::error&) {
+      /* socket closing, error is reported via the read callback */
     }
   }
 
-  DecodeBuffer _buf;
+  void write_batch()
+  {
+    /* _send_lock held */
+    if (_batch_len == 0)
+      return;
+    const size_t len = _batch_len;
+    _batch_len = 0;
+    _send_stats.writes++;
+    _sock->write(_send_arena.data(), len);
+  }
+
+  RingDecodeBuffer _buf;
+
+  std::mutex _send_lock;
+  std::vector<char> _send_arena;
+
+  BatchOptions _batching;
+  size_t _batch_len = 0;       // bytes of the arena holding the open batch
+  bool _flush_scheduled = false;
+  SendStats _send_stats;
+
+  std::unique_ptr<gx::TrafficTable> _traffic;
+
+  ShmOptions _shm_options;
+  std::unique_ptr<ShmRing> _shm_tx;          // under _send_lock
+  std::shared_ptr<ShmRing> _shm_rx;          // under _send_lock
+  std::unique_ptr<ShmRing> _shm_pending_rx;  // IO thread
+  std::unique_ptr<ShmRing> _shm_pending_tx;  // IO thread
+  std::thread _shm_thread;
 
 protected:
   EventHandlers _callbacks;
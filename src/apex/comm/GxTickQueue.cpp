@@ -0,0 +1,84 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/comm/GxTickQueue.hpp>
+#include <apex/util/Metrics.hpp>
+
+namespace apex
+{
+
+static metrics::Counter& gx_conflated = metrics::registry().counter(
+    "apex_gx_server_ticks_conflated_total",
+    "Queued tops replaced by a later update, for slow GX sessions");
+static metrics::Counter& gx_dropped = metrics::registry().counter(
+    "apex_gx_server_trades_dropped_total",
+    "Queued trades dropped, for slow GX sessions");
+
+
+GxTickQueue::Offer GxTickQueue::offer(
+    const std::shared_ptr<const gx::Frame>& frame, gx::t_msgid subscription_id,
+    const void* stream, Clock::time_point now)
+{
+  Offer result = Offer::queued;
+  if (!_backed_up) {
+    if (_backlog() <= _options.high_watermark)
+      return Offer::send;
+    _backed_up = true;
+    _backed_up_since = now;
+    result = Offer::backed_up;
+  }
+
+  const uint64_t seq = _queue_base + _queue.size();
+  auto* header = reinterpret_cast<const gx::Header*>(frame->data());
+
+  if (header->type == gx::Type::tick_top) {
+    auto ins = _queued_tops.insert({{stream, subscription_id}, seq});
+    if (!ins.second) {
+      // replace the queued update, retaining its place in the queue
+      _queue[ins.first->second - _queue_base].frame = frame;
+      _conflated++;
+      gx_conflated.add();
+      return result;
+    }
+  } else {
+    if (_queued_trades.size() >= _options.max_queued_trades) {
+      if (_options.policy == Options::Policy::disconnect)
+        return Offer::overflow;
+      _queue[_queued_trades.front() - _queue_base].frame.reset();
+      _queued_trades.pop_front();
+      _dropped++;
+      gx_dropped.add();
+    }
+    _queued_trades.push_back(seq);
+  }
+
+  _queue.push_back({frame, subscription_id});
+  return result;
+}
+
+
+void GxTickQueue::clear()
+{
+  _queue_base += _queue.size();
+  _queue.clear();
+  _queued_tops.clear();
+  _queued_trades.clear();
+  _backed_up = false;
+}
+
+
+} // namespace apex
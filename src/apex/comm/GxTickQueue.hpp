@@ -0,0 +1,138 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/comm/GxSessionBase.hpp>
+#include <apex/util/utils.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace apex
+{
+
+
+/* Conflating tick queue of a GX server session, its protection from a slow
+ * consumer.  Once the socket backlog exceeds the high watermark, ticks are
+ * queued instead of being written: a queued tick_top keeps its place and is
+ * replaced by later updates of its stream, while trades are queued up to
+ * max_queued_trades, beyond which the overflow policy applies.  The queue is
+ * drained once the backlog has fallen below the low watermark; should that
+ * take longer than max_stall, the session is a slow consumer.  Not thread
+ * safe; the session serialises its calls. */
+class GxTickQueue
+{
+public:
+  struct Options {
+    enum class Policy {
+      disconnect, // close the session
+      drop_oldest // drop the oldest queued trades, and continue
+    };
+
+    size_t high_watermark = 256 * 1024;
+    size_t low_watermark = 64 * 1024;
+    size_t max_queued_trades = 10000;
+    std::chrono::seconds max_stall{30};
+    Policy policy = Policy::disconnect;
+  };
+
+  enum class Offer {
+    send,      // not backed up, so the tick is to be written now
+    backed_up, // the backlog just passed the high watermark; tick queued
+    queued,    // queued, or conflated with a queued tick_top
+    overflow   // trade queue limit reached, under the disconnect policy
+  };
+
+  enum class Check {
+    idle,      // not backed up
+    recovered, // below the low watermark, and the queue drained
+    waiting,   // still backed up
+    stalled    // backed up for longer than max_stall
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  /* `backlog` reports the bytes pending on the session's socket. */
+  explicit GxTickQueue(std::function<size_t()> backlog)
+    : _backlog(std::move(backlog))
+  {
+  }
+
+  void set_options(Options options) { _options = options; }
+  const Options& options() const { return _options; }
+
+  /* Offer a tick of the stream identified by `stream`. */
+  Offer offer(const std::shared_ptr<const gx::Frame>&,
+              gx::t_msgid subscription_id, const void* stream,
+              Clock::time_point now = Clock::now());
+
+  /* Drain the queue, by `send` of each frame not dropped, once the backlog
+   * has fallen to the low watermark.  The queue is emptied even if `send`
+   * throws. */
+  template <typename F>
+  Check check(F&& send, Clock::time_point now = Clock::now())
+  {
+    if (!_backed_up)
+      return Check::idle;
+
+    if (_backlog() <= _options.low_watermark) {
+      scope_guard on_done([this]() { clear(); });
+      for (auto& item : _queue)
+        if (item.frame)
+          send(item.frame, item.subscription_id);
+      return Check::recovered;
+    }
+
+    if (_options.max_stall.count() > 0 &&
+        now - _backed_up_since > _options.max_stall)
+      return Check::stalled;
+    return Check::waiting;
+  }
+
+  /* Discard the queue, leaving the backed up state. */
+  void clear();
+
+  bool backed_up() const { return _backed_up; }
+  size_t size() const { return _queue.size(); }
+  uint64_t conflated() const { return _conflated; }
+  uint64_t dropped() const { return _dropped; }
+
+private:
+  struct QueuedTick {
+    std::shared_ptr<const gx::Frame> frame; // null once dropped
+    gx::t_msgid subscription_id;
+  };
+
+  std::function<size_t()> _backlog;
+  Options _options;
+  bool _backed_up = false;
+  Clock::time_point _backed_up_since;
+  std::deque<QueuedTick> _queue;
+  uint64_t _queue_base = 0; // sequence number of the queue front
+  std::map<std::pair<const void*, gx::t_msgid>, uint64_t> _queued_tops;
+  std::deque<uint64_t> _queued_trades;
+  uint64_t _conflated = 0;
+  uint64_t _dropped = 0;
+};
+
+
+} // namespace apex
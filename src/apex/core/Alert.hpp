@@ -54,6 +54,7 @@ public:
   }
 
   bool empty() const { return _alerts.empty(); }
+  size_t size() const { return _alerts.size(); }
 
   void log();
 
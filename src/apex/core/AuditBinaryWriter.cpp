@@ -0,0 +1,190 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/AuditBinaryWriter.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstddef>
+
+namespace apex
+{
+
+namespace auditbin
+{
+
+json record_schema()
+{
+#define APEX_AUDIT_FIELD(F, TYPE)                                       \
+  fields.push_back({{"name", #F}, {"type", TYPE}, {"offset", offsetof(Record, F)}})
+
+  json fields = json::array();
+  APEX_AUDIT_FIELD(time, "<i8");
+  APEX_AUDIT_FIELD(symbol, "<u4");
+  APEX_AUDIT_FIELD(venue, "<u4");
+  APEX_AUDIT_FIELD(order_id, "<u4");
+  APEX_AUDIT_FIELD(exch_order_id, "<u4");
+  APEX_AUDIT_FIELD(strat_id, "<u4");
+  APEX_AUDIT_FIELD(is_fill, "u1");
+  APEX_AUDIT_FIELD(order_state, "u1");
+  APEX_AUDIT_FIELD(side, "i1");
+  APEX_AUDIT_FIELD(qty, "<f8");
+  APEX_AUDIT_FIELD(price, "<f8");
+  APEX_AUDIT_FIELD(value_usd, "<f8");
+  APEX_AUDIT_FIELD(done_qty, "<f8");
+  APEX_AUDIT_FIELD(remain_qty, "<f8");
+  APEX_AUDIT_FIELD(fill_qty, "<f8");
+  APEX_AUDIT_FIELD(fill_price, "<f8");
+  APEX_AUDIT_FIELD(buy_qty, "<f8");
+  APEX_AUDIT_FIELD(sell_qty, "<f8");
+  APEX_AUDIT_FIELD(net_qty, "<f8");
+  APEX_AUDIT_FIELD(buy_cost, "<f8");
+  APEX_AUDIT_FIELD(sell_cost, "<f8");
+  APEX_AUDIT_FIELD(turnover, "<f8");
+  APEX_AUDIT_FIELD(total_pnl, "<f8");
+  APEX_AUDIT_FIELD(bid, "<f8");
+  APEX_AUDIT_FIELD(ask, "<f8");
+  APEX_AUDIT_FIELD(last, "<f8");
+  APEX_AUDIT_FIELD(last_qty, "<f8");
+  APEX_AUDIT_FIELD(last_time, "<i8");
+  APEX_AUDIT_FIELD(fx_to_usd, "<f8");
+#undef APEX_AUDIT_FIELD
+
+  return {
+    {"record_size", sizeof(Record)},
+    {"fields", fields},
+    {"string_fields", {"symbol", "venue", "order_id", "exch_order_id", "strat_id"}},
+    {"order_state", {"none", "init", "sent", "live", "closed"}},
+  };
+}
+
+} // namespace auditbin
+
+
+AuditBinaryWriter::AuditBinaryWriter(const std::filesystem::path& stem,
+                                     size_t buffer_records)
+  : _buffer_records(buffer_records)
+{
+  auto with_ext = [&stem](const char* ext) {
+    auto path = stem;
+    path += ext;
+    return path;
+  };
+
+  _records_file.open(with_ext(".bin"), std::ios::binary | std::ios::trunc);
+  _strings_file.open(with_ext(".strings"), std::ios::trunc);
+  if (!_records_file || !_strings_file)
+    THROW("cannot open audit files " << with_ext(".*"));
+
+  std::ofstream schema(with_ext(".schema.json"), std::ios::trunc);
+  schema << auditbin::record_schema().dump(2) << "\n";
+
+  for (auto& buffer : _buffers)
+    buffer.records.reserve(_buffer_records);
+
+  _thread = std::thread([this]() { run(); });
+}
+
+
+AuditBinaryWriter::~AuditBinaryWriter()
+{
+  {
+    std::unique_lock lock(_mutex);
+    // wait for the back buffer, then submit the last of the front buffer
+    _cv.wait(lock, [this]() { return !_back_busy; });
+    try_swap();
+    _stop = true;
+  }
+  _cv.notify_all();
+  _thread.join();
+}
+
+
+uint32_t AuditBinaryWriter::intern(const std::string& s)
+{
+  auto [iter, added] = _string_ids.try_emplace(s, uint32_t(_string_ids.size()));
+  if (added) {
+    auto guard = std::scoped_lock(_mutex);
+    _buffers[_front].strings.push_back(s);
+  }
+  return iter->second;
+}
+
+
+void AuditBinaryWriter::add(const auditbin::Record& record)
+{
+  _records++;
+  auto guard = std::scoped_lock(_mutex);
+  auto& front = _buffers[_front];
+  front.records.push_back(record);
+  // if the writer is still busy the front buffer just grows
+  if (front.records.size() >= _buffer_records && try_swap())
+    _cv.notify_all();
+}
+
+
+void AuditBinaryWriter::flush()
+{
+  bool swapped = false;
+  {
+    auto guard = std::scoped_lock(_mutex);
+    swapped = try_swap();
+  }
+  if (swapped)
+    _cv.notify_all();
+}
+
+
+bool AuditBinaryWriter::try_swap()
+{
+  auto& front = _buffers[_front];
+  if (_back_busy || (front.records.empty() && front.strings.empty()))
+    return false;
+  _front ^= 1;
+  _back_busy = true;
+  return true;
+}
+
+
+void AuditBinaryWriter::run()
+{
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _cv.wait(lock, [this]() { return _back_busy || _stop; });
+    if (_back_busy) {
+      auto& back = _buffers[_front ^ 1];
+      lock.unlock();
+
+      // strings precede the records that refer to them
+      for (auto& s : back.strings)
+        _strings_file << s << '\n';
+      _strings_file.flush();
+      _records_file.write(reinterpret_cast<const char*>(back.records.data()),
+                          back.records.size() * sizeof(auditbin::Record));
+      _records_file.flush();
+      back.records.clear();
+      back.strings.clear();
+
+      lock.lock();
+      _back_busy = false;
+      _cv.notify_all();
+    } else if (_stop) {
+      return;
+    }
+  }
+}
+
+} // namespace apex
@@ -0,0 +1,144 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/json.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace apex
+{
+
+namespace auditbin
+{
+
+#pragma pack(push, 1)
+
+/* One Auditor transaction.  String fields hold an index into the strings file
+ * written alongside the records; times are usec since epoch, and values that
+ * are not known are NaN. */
+struct Record {
+  int64_t time;
+  uint32_t symbol;
+  uint32_t venue;
+  uint32_t order_id;
+  uint32_t exch_order_id;
+  uint32_t strat_id;
+  uint8_t is_fill;
+  uint8_t order_state; // OrderState
+  int8_t side;         // 1 buy, -1 sell, 0 none
+  uint8_t pad;
+  double qty;
+  double price;
+  double value_usd;
+  double done_qty;
+  double remain_qty;
+  double fill_qty;
+  double fill_price;
+  double buy_qty;
+  double sell_qty;
+  double net_qty;
+  double buy_cost;
+  double sell_cost;
+  double turnover;
+  double total_pnl;
+  double bid;
+  double ask;
+  double last;
+  double last_qty;
+  int64_t last_time;
+  double fx_to_usd;
+};
+static_assert(sizeof(Record) == 192);
+
+#pragma pack(pop)
+
+/* Field names, numpy type codes and offsets of Record, as written to the
+ * schema file, e.g. for np.fromfile(path, dtype=np.dtype({...})). */
+json record_schema();
+
+} // namespace auditbin
+
+
+/* Writes Auditor transactions as fixed size binary records, from a pair of
+ * in-memory buffers: records are appended to the front buffer, while the back
+ * buffer is written out by a background thread, so the event thread does no
+ * formatting or file IO.  For a path stem of DIR/NAME the files written are
+ * NAME.bin (the records), NAME.strings (one string per line, addressed by
+ * index) and NAME.schema.json (the record layout). */
+class AuditBinaryWriter
+{
+public:
+  explicit AuditBinaryWriter(const std::filesystem::path& stem,
+                             size_t buffer_records = 64 << 10);
+
+  /* Writes out all records before returning. */
+  ~AuditBinaryWriter();
+
+  AuditBinaryWriter(const AuditBinaryWriter&) = delete;
+  AuditBinaryWriter& operator=(const AuditBinaryWriter&) = delete;
+
+  /* Append a record, handing the front buffer to the writer thread once it
+   * is full. */
+  void add(const auditbin::Record&);
+
+  /* Index of a string in the strings file, adding it if new. */
+  uint32_t intern(const std::string&);
+
+  /* Hand the front buffer, if not empty, to the writer thread. */
+  void flush();
+
+  [[nodiscard]] size_t record_count() const { return _records; }
+
+private:
+  struct Buffer {
+    std::vector<auditbin::Record> records;
+    std::vector<std::string> strings; // strings first used by these records
+  };
+
+  // With the lock held, swap a non-empty front buffer with a free back buffer.
+  bool try_swap();
+  void run();
+
+  const size_t _buffer_records;
+  std::unordered_map<std::string, uint32_t> _string_ids;
+  size_t _records = 0;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  Buffer _buffers[2];
+  int _front = 0;
+  bool _back_busy = false;
+  bool _stop = false;
+
+  // used only by the writer thread
+  std::ofstream _records_file;
+  std::ofstream _strings_file;
+
+  std::thread _thread;
+};
+
+} // namespace apex
@@ -18,10 +18,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Position.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/core/Auditor.hpp>
+#include <apex/core/AuditBinaryWriter.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/core/Services.hpp>
 #include <apex/util/EventLoop.hpp>
+#include <apex/util/json.hpp>
 
+#include <cmath>
+#include <limits>
 #include <iostream>
 
 #define FMT(X) (std::isfinite(X)? apex::format_double(X, true): "")
@@ -42,11 +46,36 @@ int to_int(Side s) {
 }
 
 
+/* The values of a transaction, captured when added; the interned strings of
+ * the record are set as it is written. */
+struct Auditor::Pending {
+  auditbin::Record rec;
+  std::shared_ptr<Order> order;
+  std::string exch_order_id;
+  std::string strat_id;
+};
+
 
  Auditor::Auditor(Services * services,
                  std::string transactions_dir)
   : _services(services)
 {
+  // the services config may redirect transactions, e.g., so that backtest
+  // runs sharing a process each write to their own directory
+  auto config = _services->config().get_sub_config("auditor",
+                                                   Config::empty_config());
+  if (transactions_dir.empty())
+    transactions_dir = config.get_string("transactions_dir", "");
+
+  auto format = config.get_string("format", "csv");
+  if (format != "csv" && format != "binary" && format != "summary")
+    THROW("auditor format must be 'csv', 'binary' or 'summary', not "
+          << QUOTE(format));
+
+  _sample_interval =
+      std::chrono::seconds(config.get_uint("performance_sample_sec", 3600));
+  _performance = PerformanceStats(_sample_interval);
+
   if (transactions_dir.empty())
     transactions_dir = apex_home() / "log";
 
@@ -60,12 +89,39 @@ int to_int(Side s) {
 
   oss << "audit-transactions-";
   oss << Time::realtime_now().strftime("%Y%m%d_%H%M%S");
+  if (_services->shard().is_sharded())
+    oss << "-shard" << _services->shard().index;
+
+  _summary_path = oss.str() + "-summary.json";
+  if (format == "summary") {
+    LOG_INFO("auditor summary file '" << _summary_path.string() << "'");
+    return;
+  }
+
+  _batch_end_hook = _services->evloop()->add_batch_end_hook([this]() {
+    try {
+      flush_transactions();
+    } catch (std::exception& e) {
+      LOG_ERROR("failed to write auditor transactions: " << e.what());
+    }
+  });
+
+  auto delay = std::chrono::seconds(5);
+
+  if (format == "binary") {
+    LOG_INFO("auditor transactions files '" << oss.str() << ".bin'");
+    _binary = std::make_unique<AuditBinaryWriter>(oss.str());
+    _services->evloop()->dispatch(delay, [this, delay]() {
+      _binary->flush();
+      return std::chrono::milliseconds(delay);
+    });
+    return;
+  }
+
   oss << ".csv";
 
   // DIR/apex_transactions-DATE.log
 
-  auto now = Time::realtime_now();
-
   auto fn = oss.str();
   LOG_INFO("auditor transactions file '" << fn << "'");
 
@@ -106,7 +162,6 @@ int to_int(Side s) {
     _file << item << ",";
   _file << "\n";
 
-  auto delay = std::chrono::seconds(5);
   _services->evloop()->dispatch(delay, [this, delay]()-> std::chrono::milliseconds {
       try {
         this->_file.flush();
@@ -118,7 +173,101 @@ int to_int(Side s) {
     });
 }
 
-Auditor::~Auditor() = default;
+Auditor::~Auditor()
+{
+  if (_batch_end_hook)
+    _services->evloop()->remove_batch_end_hook(_batch_end_hook);
+  try {
+    flush_transactions();
+    write_performance_summary();
+  } catch (std::exception& e) {
+    LOG_ERROR("failed to write auditor summary: " << e.what());
+  }
+}
+
+Auditor::Summary Auditor::summary(InstrumentId iid) const
+{
+  auto iter = _instrument_summary.find(iid);
+  return iter == _instrument_summary.end() ? Summary{} : iter->second;
+}
+
+
+PerformanceStats::Summary Auditor::performance(InstrumentId iid) const
+{
+  auto iter = _bot_performance.find(iid);
+  return iter == _bot_performance.end() ? PerformanceStats::Summary{}
+                                        : iter->second.stats.summary();
+}
+
+
+Auditor::BotPerformance& Auditor::bot_performance(const Instrument& instrument)
+{
+  auto iter = _bot_performance.find(instrument.iid());
+  if (iter == _bot_performance.end())
+    iter = _bot_performance
+               .emplace(instrument.iid(),
+                        BotPerformance{instrument.native_symbol(),
+                                       instrument.exchange_name(),
+                                       PerformanceStats(_sample_interval)})
+               .first;
+  return iter->second;
+}
+
+
+void Auditor::mark_to_market(Time time, const Instrument& instrument,
+                             double bot_pnl_usd, double strategy_pnl_usd)
+{
+  bot_performance(instrument).stats.mark(time, bot_pnl_usd);
+  _performance.mark(time, strategy_pnl_usd);
+}
+
+
+static json to_json(const PerformanceStats::Summary& summary)
+{
+  // json has no representation of NaN, so undefined values are null
+  auto number = [](double d) { return std::isfinite(d) ? json(d) : json(); };
+  return {
+    {"pnl_usd", number(summary.pnl_usd)},
+    {"peak_pnl_usd", number(summary.peak_pnl_usd)},
+    {"max_drawdown_usd", number(summary.max_drawdown_usd)},
+    {"sharpe", number(summary.sharpe)},
+    {"samples", summary.samples},
+    {"turnover_usd", number(summary.turnover_usd)},
+    {"order_value_usd", number(summary.order_value_usd)},
+    {"orders", summary.orders},
+    {"filled_orders", summary.filled_orders},
+    {"fills", summary.fills},
+    {"fill_ratio", number(summary.fill_ratio())},
+    {"fill_value_ratio", number(summary.fill_value_ratio())},
+  };
+}
+
+
+void Auditor::write_performance_summary()
+{
+  LOG_INFO("auditor performance of strategy " << QUOTE(_strategy_id) << ", "
+           << _performance.summary());
+
+  json bots = json::array();
+  for (auto& [iid, bot] : _bot_performance) {
+    auto item = to_json(bot.stats.summary());
+    item["symbol"] = bot.symbol;
+    item["exchange"] = bot.exchange;
+    bots.push_back(std::move(item));
+  }
+  json doc = {
+    {"strategy_id", _strategy_id},
+    {"sample_sec", _sample_interval.count()},
+    {"strategy", to_json(_performance.summary())},
+    {"bots", std::move(bots)},
+  };
+
+  std::ofstream os(_summary_path, std::ofstream::out | std::ofstream::trunc);
+  os << doc.dump() << "\n";
+  if (!os)
+    THROW("cannot write " << _summary_path);
+}
+
 
 void Auditor::add_transaction(Time time,
                               const std::string& strat_id,
@@ -131,44 +280,146 @@ void Auditor::add_transaction(Time time,
                               double fill_qty,
                               double fill_price)
 {
+  const auto& order = *order_event.order;
+  for (auto* summary :
+       {&_summary, &_instrument_summary[order.instrument().iid()]}) {
+    summary->order_events++;
+    if (is_fill) {
+      summary->fills++;
+      summary->fill_value_usd += fill_qty * fill_price * fx_to_usd;
+    }
+  }
+
+  // an order is counted as submitted as it leaves its initial state
+  _strategy_id = strat_id;
+  auto& bot = bot_performance(order.instrument()).stats;
+  if (order_event.is_state_change() &&
+      (order_event.old_state == OrderState::none ||
+       order_event.old_state == OrderState::init)) {
+    const double value = order.size() * order.price() * fx_to_usd;
+    bot.on_order(value);
+    _performance.on_order(value);
+  }
+  if (is_fill) {
+    const double value = fill_qty * fill_price * fx_to_usd;
+    const bool first = order.filled_size() <= fill_qty * (1.0 + 1e-9);
+    bot.on_fill(value, first);
+    _performance.on_fill(value, first);
+  }
+
+  if (!_binary && !_file.is_open())
+    return;
+
+  // the values are captured now, as the order, position and market will
+  // have moved on by the end of the batch
+  const auto last = market_data->last();
+  auto& pending = _pending.emplace_back();
+  pending.order = order_event.order;
+  pending.exch_order_id = order.exch_order_id();
+  pending.strat_id = strat_id;
+  auto& rec = pending.rec;
+  rec.time = time.as_epoch_us().count();
+  rec.is_fill = is_fill;
+  rec.order_state = static_cast<uint8_t>(order.state());
+  rec.side = static_cast<int8_t>(to_int(order.side()));
+  rec.qty = order.size();
+  rec.price = order.price();
+  rec.value_usd = order.size() * order.price() * fx_to_usd;
+  rec.done_qty = order.filled_size();
+  rec.remain_qty = order.remain_size();
+  rec.fill_qty = is_fill ? fill_qty : apex::nan;
+  rec.fill_price = is_fill ? fill_price : apex::nan;
+  rec.buy_qty = position.buy_qty();
+  rec.sell_qty = position.sell_qty();
+  rec.net_qty = position.net_qty();
+  rec.buy_cost = position.buy_cost();
+  rec.sell_cost = position.sell_cost();
+  rec.turnover = position.total_turnover(last.price);
+  rec.total_pnl = position.total_pnl(last.price);
+  rec.bid = market_data->bid();
+  rec.ask = market_data->ask();
+  rec.last = last.price;
+  rec.last_qty = last.qty;
+  rec.last_time = last.et.as_epoch_us().count();
+  rec.fx_to_usd = fx_to_usd;
+}
+
+
+size_t Auditor::pending_transactions() const { return _pending.size(); }
+
+
+void Auditor::flush_transactions()
+{
+  for (auto& pending : _pending) {
+    if (_binary)
+      write_binary(pending);
+    else
+      write_csv(pending);
+  }
+  _pending.clear();
+}
+
+
+void Auditor::write_csv(const Pending& pending)
+{
+  const auto& rec = pending.rec;
+  const auto& order = *pending.order;
+  auto as_time = [](int64_t us) {
+    return Time{std::chrono::microseconds(us)}.as_iso8601(
+        Time::Resolution::micro, true);
+  };
+
   _file
-    << time.as_iso8601(Time::Resolution::micro, true)
-    << "," << order_event.order->instrument().native_symbol()
-    << "," << order_event.order->instrument().exchange_name()
-    << "," << (is_fill? "fill": "order")
+    << as_time(rec.time)
+    << "," << order.instrument().native_symbol()
+    << "," << order.instrument().exchange_name()
+    << "," << (rec.is_fill? "fill": "order")
     // order
-    << "," << order_event.order->state()
-    << "," << order_event.order->order_id()
-    << "," << order_event.order->side()
-    << "," << FMT(order_event.order->size())
-    << "," << FMT(order_event.order->price())
-    << "," << FMT(order_event.order->size() * order_event.order->price() * fx_to_usd)
-    << "," << FMT(order_event.order->filled_size())
-    << "," << FMT(order_event.order->remain_size())
+    << "," << static_cast<OrderState>(rec.order_state)
+    << "," << order.order_id()
+    << "," << order.side()
+    << "," << FMT(rec.qty)
+    << "," << FMT(rec.price)
+    << "," << FMT(rec.value_usd)
+    << "," << FMT(rec.done_qty)
+    << "," << FMT(rec.remain_qty)
     // current fill
-    << "," << (is_fill? FMT(fill_qty) : "")
-    << "," << (is_fill? FMT(fill_price) : "")
+    << "," << FMT(rec.fill_qty)
+    << "," << FMT(rec.fill_price)
     // other order fields
-    << "," << order_event.order->exch_order_id()
+    << "," << pending.exch_order_id
     // position
-    << "," << FMT(position.buy_qty())
-    << "," << FMT(position.sell_qty())
-    << "," << FMT(position.net_qty())
-    << "," << FMT(position.buy_cost())
-    << "," << FMT(position.sell_cost())
-    << "," << FMT(position.total_turnover(market_data->last().price))
-    << "," << FMT(position.total_pnl(market_data->last().price))
+    << "," << FMT(rec.buy_qty)
+    << "," << FMT(rec.sell_qty)
+    << "," << FMT(rec.net_qty)
+    << "," << FMT(rec.buy_cost)
+    << "," << FMT(rec.sell_cost)
+    << "," << FMT(rec.turnover)
+    << "," << FMT(rec.total_pnl)
     // market data
-    << "," << FMT(market_data->bid())
-    << "," << FMT(market_data->ask())
-    << "," << FMT(market_data->last().price)
-    << "," << FMT(market_data->last().qty)
-    << "," << market_data->last().et.as_iso8601(Time::Resolution::micro, true)
-    << "," << FMT(fx_to_usd)
-    << "," << to_int(order_event.order->side())
+    << "," << FMT(rec.bid)
+    << "," << FMT(rec.ask)
+    << "," << FMT(rec.last)
+    << "," << FMT(rec.last_qty)
+    << "," << as_time(rec.last_time)
+    << "," << FMT(rec.fx_to_usd)
+    << "," << int(rec.side)
     // misc
-    << "," << strat_id
+    << "," << pending.strat_id
     << "\n";
 }
 
+
+void Auditor::write_binary(const Pending& pending)
+{
+  const auto& order = *pending.order;
+  auditbin::Record rec = pending.rec;
+  rec.symbol = _binary->intern(order.instrument().native_symbol());
+  rec.venue = _binary->intern(order.instrument().exchange_name());
+  rec.order_id = _binary->intern(order.order_id());
+  rec.exch_order_id = _binary->intern(pending.exch_order_id);
+  rec.strat_id = _binary->intern(pending.strat_id);
+  _binary->add(rec);
+}
+
 }
@@ -18,12 +18,19 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/core/PerformanceStats.hpp>
+#include <apex/model/Instrument.hpp>
 #include <apex/util/Time.hpp>
+#include <filesystem>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace apex
 {
 
+class AuditBinaryWriter;
 class MarketData;
 class Position;
 class OrderEvent;
@@ -34,9 +41,29 @@ class Services;
 // building detailed finance report, or, publishing the raw transaction data to
 // external auditor.  This differs from application monitoring, in that the
 // Auditor is only interested in financial data.
+//
+// Transactions are written as CSV by default; with the auditor "format" config
+// set to "binary" they are instead written as fixed size records by an
+// AuditBinaryWriter, which keeps formatting and file IO off the event thread.
+// With "format" set to "summary" no transactions are written at all.
+//
+// Adding a transaction only captures its values; formatting and writing are
+// deferred to the end of the event loop batch, so that a burst of fills does
+// not put file IO in front of the bots' reactions to them.
+//
+// Either way, the PerformanceStats of the strategy and of each bot are kept
+// from the transactions and the marks of the bots' PnL, and on destruction
+// are logged, and written to a "-summary.json" file beside the transactions.
+// The stats are sampled every auditor "performance_sample_sec", default 3600.
 class Auditor
 {
 public:
+  // Running totals over all transactions recorded.
+  struct Summary {
+    size_t order_events = 0;
+    size_t fills = 0;
+    double fill_value_usd = 0.0;
+  };
 
   Auditor(Services*, std::string transactions_dir="");
   ~Auditor();
@@ -52,9 +79,62 @@ public:
                        double fill_qty,
                        double fill_price);
 
+  /* Write the transactions added since the last flush; called at the end of
+   * each event loop batch, and on destruction. */
+  void flush_transactions();
+
+  [[nodiscard]] size_t pending_transactions() const;
+
+  /* Mark the PnL of a bot, and the strategy's resulting PnL. */
+  void mark_to_market(Time event_time, const Instrument&, double bot_pnl_usd,
+                      double strategy_pnl_usd);
+
+  [[nodiscard]] const Summary& summary() const { return _summary; }
+
+  // Running totals over the transactions of the orders of one instrument.
+  [[nodiscard]] Summary summary(InstrumentId) const;
+
+  [[nodiscard]] PerformanceStats::Summary performance() const
+  {
+    return _performance.summary();
+  }
+
+  // Performance of the bot of one instrument.
+  [[nodiscard]] PerformanceStats::Summary performance(InstrumentId) const;
+
+  [[nodiscard]] const std::filesystem::path& summary_path() const
+  {
+    return _summary_path;
+  }
+
 private:
+  struct BotPerformance {
+    std::string symbol;
+    std::string exchange;
+    PerformanceStats stats;
+  };
+
+  struct Pending;
+
+  BotPerformance& bot_performance(const Instrument&);
+  void write_performance_summary();
+
+  void write_csv(const Pending&);
+  void write_binary(const Pending&);
+
   Services* _services;
   std::ofstream _file;
+  std::unique_ptr<AuditBinaryWriter> _binary;
+  std::vector<Pending> _pending; // capacity kept across batches
+  size_t _batch_end_hook = 0;
+  Summary _summary;
+  std::map<InstrumentId, Summary> _instrument_summary;
+
+  std::chrono::seconds _sample_interval;
+  std::string _strategy_id;
+  PerformanceStats _performance;
+  std::map<InstrumentId, BotPerformance> _bot_performance;
+  std::filesystem::path _summary_path;
 };
 
 }
@@ -0,0 +1,137 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BacktestFork.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+static size_t process_thread_count()
+{
+  std::error_code ec;
+  size_t count = 0;
+  for (auto iter = std::filesystem::directory_iterator("/proc/self/task", ec);
+       !ec && iter != std::filesystem::directory_iterator(); iter.increment(ec))
+    count++;
+  return count;
+}
+
+
+// Flush buffered output, so that it is not written again by each child.
+static void flush_all()
+{
+  std::cout.flush();
+  std::cerr.flush();
+  std::clog.flush();
+  std::fflush(nullptr);
+}
+
+
+BacktestFork::BacktestFork(BacktestEventLoop& evloop, Time at, size_t variants,
+                           BranchFn on_branch)
+  : _evloop(evloop),
+    _variants(variants),
+    _on_branch(std::move(on_branch))
+{
+  if (variants == 0) {
+    THROW("backtest fork requires at least one variant");
+  }
+
+  using namespace std::chrono_literals;
+  auto delay = std::chrono::ceil<std::chrono::milliseconds>(
+      std::max(at - _evloop.get_time(), std::chrono::microseconds(0)));
+  _timer = _evloop.dispatch(delay, [this]() {
+    _timer = {};
+    fork_now();
+    return 0ms;
+  });
+}
+
+
+BacktestFork::~BacktestFork()
+{
+  if (!_timer.empty())
+    _evloop.cancel_timer(_timer);
+}
+
+
+void BacktestFork::fork_now()
+{
+  if (auto threads = process_thread_count(); threads > 1) {
+    THROW("cannot fork backtest, process has " << threads << " threads");
+  }
+
+  LOG_NOTICE("backtest fork: " << _variants << " variants at "
+             << _evloop.get_time());
+  flush_all();
+
+  for (size_t v = 1; v < _variants; v++) {
+    pid_t pid = ::fork();
+    if (pid < 0) {
+      THROW("backtest fork failed: " << std::strerror(errno));
+    }
+    if (pid == 0) {
+      _variant = v;
+      _children.clear();
+      break;
+    }
+    _children.push_back(pid);
+  }
+  _forked = true;
+
+  if (_on_branch)
+    _on_branch(_variant);
+}
+
+
+std::vector<int> BacktestFork::join(int status)
+{
+  if (is_child()) {
+    flush_all();
+    std::_Exit(status);
+  }
+
+  std::vector<int> results{status};
+  for (auto pid : _children) {
+    int wstatus = 0;
+    int result = -1;
+    while (::waitpid(pid, &wstatus, 0) < 0 && errno == EINTR)
+      ;
+    if (WIFEXITED(wstatus))
+      result = WEXITSTATUS(wstatus);
+    else if (WIFSIGNALED(wstatus))
+      result = 128 + WTERMSIG(wstatus);
+    results.push_back(result);
+  }
+  _children.clear();
+  return results;
+}
+
+} // namespace apex
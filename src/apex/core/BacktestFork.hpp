@@ -0,0 +1,81 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/Time.hpp>
+#include <apex/util/TimerWheel.hpp>
+
+#include <functional>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace apex
+{
+
+class BacktestEventLoop;
+
+/* Fork a backtest into variants at a checkpoint time, to evaluate several
+ * what-if branches from the same state without replaying the period before
+ * the checkpoint once per variant.
+ *
+ * When the backtest reaches the checkpoint, the process is fork()ed into one
+ * child per extra variant.  Copy-on-write gives each child the whole state at
+ * that moment: the event loop time and its timers, the replay position in the
+ * memory mapped tick files, the SimExchange books, and positions and bot
+ * state.  The calling process continues as variant 0.  Each branch then calls
+ * `on_branch` with its variant, which typically alters the strategy (eg, its
+ * exit rule) and redirects its output, and continues independently.
+ *
+ * fork() copies only the calling thread, so the process must be single
+ * threaded at the checkpoint; tick sources that read ahead on a thread, or a
+ * threaded BacktestSweep, cannot be forked. */
+class BacktestFork
+{
+public:
+  using BranchFn = std::function<void(size_t variant)>;
+
+  BacktestFork(BacktestEventLoop&, Time at, size_t variants, BranchFn on_branch);
+  ~BacktestFork();
+
+  BacktestFork(const BacktestFork&) = delete;
+  BacktestFork& operator=(const BacktestFork&) = delete;
+
+  [[nodiscard]] bool has_forked() const { return _forked; }
+  [[nodiscard]] size_t variant() const { return _variant; }
+  [[nodiscard]] bool is_child() const { return _variant != 0; }
+
+  /* Complete this branch, once its backtest has run.  A child exits with
+   * `status`, so never returns.  The parent waits for its children and returns
+   * the exit status of each variant, its own being `status`; if the backtest
+   * ended before the checkpoint, only its own status is returned. */
+  std::vector<int> join(int status = 0);
+
+private:
+  void fork_now();
+
+  BacktestEventLoop& _evloop;
+  size_t _variants;
+  BranchFn _on_branch;
+  TimerHandle _timer;
+  bool _forked = false;
+  size_t _variant = 0;
+  std::vector<pid_t> _children;
+};
+
+} // namespace apex
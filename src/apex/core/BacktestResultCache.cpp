@@ -0,0 +1,315 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BacktestResultCache.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
+
+#include <openssl/sha.h>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <tuple>
+
+#include <unistd.h>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+// Changed whenever the entry layout, or what a result depends on, changes.
+static constexpr int cache_version = 1;
+
+
+FileFingerprint FileFingerprint::of(const fs::path& path)
+{
+  FileFingerprint fp;
+  fp.path = path;
+  std::error_code err;
+  auto size = fs::file_size(path, err);
+  if (err)
+    return fp;
+  auto mtime = fs::last_write_time(path, err);
+  if (err)
+    return fp;
+  fp.size = size;
+  fp.mtime = mtime.time_since_epoch().count();
+  return fp;
+}
+
+
+static json time_to_json(Time t) { return t.as_epoch_us().count(); }
+
+
+static Time time_from_json(const json& j)
+{
+  return Time(std::chrono::microseconds(j.get<int64_t>()));
+}
+
+
+// Whether the tick files of an entry are all unchanged.
+static bool files_unchanged(const json& entry)
+{
+  for (auto& item : entry.at("tick_files")) {
+    FileFingerprint fp;
+    fp.path = item.at("path").get<std::string>();
+    fp.size = item.at("size").get<uint64_t>();
+    fp.mtime = item.at("mtime").get<int64_t>();
+    if (!(FileFingerprint::of(fp.path) == fp))
+      return false;
+  }
+  return true;
+}
+
+
+static std::optional<json> read_entry(const fs::path& path)
+{
+  std::ifstream is(path);
+  if (!is)
+    return std::nullopt;
+  try {
+    return json::parse(is);
+  }
+  catch (const std::exception& e) {
+    LOG_WARN("ignoring unreadable backtest result " << path << ": "
+             << e.what());
+    return std::nullopt;
+  }
+}
+
+
+// Write a file through a temporary file, renamed into place.
+static void write_atomic(const fs::path& path,
+                         const std::function<void(std::ofstream&)>& write)
+{
+  auto tmp = path;
+  tmp += ".tmp." + std::to_string(::getpid()) + "." +
+    std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  {
+    std::ofstream os(tmp, std::ofstream::out | std::ofstream::trunc);
+    if (!os)
+      THROW("cannot write backtest result file " << tmp);
+    write(os);
+  }
+  fs::rename(tmp, path);
+}
+
+
+BacktestResultCache::BacktestResultCache(fs::path dir) : _dir(std::move(dir))
+{
+  create_dir(_dir);
+}
+
+
+std::string BacktestResultCache::make_key(const json& bot_config,
+                                          const Instrument& instrument,
+                                          const TimeShard& shard)
+{
+  // keys of a json object are ordered, so the dump is canonical
+  json key = {
+    {"version", cache_version},
+    {"build", Services::build_datetime()},
+    {"bot", bot_config},
+    {"exchange", instrument.exchange_name()},
+    {"symbol", instrument.native_symbol()},
+    {"warmup_from", time_to_json(shard.warmup_from)},
+    {"from", time_to_json(shard.from)},
+    {"upto", time_to_json(shard.upto)},
+  };
+  auto text = key.dump();
+
+  unsigned char digest[SHA256_DIGEST_LENGTH];
+  SHA256(reinterpret_cast<const unsigned char*>(text.data()), text.size(),
+         digest);
+  return to_hex(digest, sizeof digest);
+}
+
+
+fs::path BacktestResultCache::entry_path(const std::string& key) const
+{
+  return _dir / (key + ".json");
+}
+
+
+fs::path BacktestResultCache::audit_file(const std::string& key) const
+{
+  auto path = _dir / (key + ".csv");
+  return fs::exists(path) ? path : fs::path{};
+}
+
+
+std::optional<CachedBotResult> BacktestResultCache::find(const std::string& key)
+{
+  auto entry = read_entry(entry_path(key));
+  if (!entry || !files_unchanged(*entry)) {
+    _misses++;
+    return std::nullopt;
+  }
+
+  CachedBotResult result;
+  auto& bot = entry->at("bot");
+  result.bot.symbol = bot.at("symbol").get<std::string>();
+  result.bot.exchange = bot.at("exchange").get<std::string>();
+  result.bot.net_qty = bot.at("net_qty").get<double>();
+  result.bot.net_position_usd = bot.at("net_position_usd").get<double>();
+  result.bot.pnl_usd = bot.at("pnl_usd").get<double>();
+
+  auto& audit = entry->at("audit");
+  result.audit.order_events = audit.at("order_events").get<size_t>();
+  result.audit.fills = audit.at("fills").get<size_t>();
+  result.audit.fill_value_usd = audit.at("fill_value_usd").get<double>();
+
+  for (auto& item : entry->at("tick_files"))
+    result.tick_files.push_back({item.at("path").get<std::string>(),
+                                 item.at("size").get<uint64_t>(),
+                                 item.at("mtime").get<int64_t>()});
+  _hits++;
+  return result;
+}
+
+
+void BacktestResultCache::store(const std::string& key,
+                                const TimeShard& shard,
+                                const CachedBotResult& result,
+                                const std::vector<fs::path>& audit_files)
+{
+  json files = json::array();
+  for (auto& fp : result.tick_files)
+    files.push_back(
+        {{"path", fp.path.string()}, {"size", fp.size}, {"mtime", fp.mtime}});
+
+  json entry = {
+    {"build", Services::build_datetime()},
+    {"exchange", result.bot.exchange},
+    {"symbol", result.bot.symbol},
+    {"from", time_to_json(shard.from)},
+    {"upto", time_to_json(shard.upto)},
+    {"bot", {{"symbol", result.bot.symbol},
+             {"exchange", result.bot.exchange},
+             {"net_qty", result.bot.net_qty},
+             {"net_position_usd", result.bot.net_position_usd},
+             {"pnl_usd", result.bot.pnl_usd}}},
+    {"audit", {{"order_events", result.audit.order_events},
+               {"fills", result.audit.fills},
+               {"fill_value_usd", result.audit.fill_value_usd}}},
+    {"tick_files", files},
+  };
+
+  // the audit rows go first, so an entry is never seen without them
+  auto csv = _dir / (key + ".csv");
+  std::error_code err;
+  fs::remove(csv, err);
+  std::string header;
+  std::vector<std::string> rows;
+  for (auto& fn : audit_files) {
+    std::ifstream is(fn);
+    std::string line;
+    if (!std::getline(is, line))
+      continue;
+    header = line;
+    while (std::getline(is, line)) {
+      // columns: time, symbol, venue, ...
+      auto a = line.find(',');
+      auto b = a == std::string::npos ? a : line.find(',', a + 1);
+      auto c = b == std::string::npos ? b : line.find(',', b + 1);
+      if (c == std::string::npos)
+        continue;
+      if (line.compare(a + 1, b - a - 1, result.bot.symbol) == 0 &&
+          line.compare(b + 1, c - b - 1, result.bot.exchange) == 0)
+        rows.push_back(std::move(line));
+    }
+  }
+  if (!rows.empty())
+    write_atomic(csv, [&](std::ofstream& os) {
+      os << header << "\n";
+      for (auto& row : rows)
+        os << row << "\n";
+    });
+
+  write_atomic(entry_path(key),
+               [&](std::ofstream& os) { os << entry.dump() << "\n"; });
+}
+
+
+std::vector<BacktestResultCache::EntryInfo> BacktestResultCache::entries(
+  const Filter& filter) const
+{
+  std::vector<EntryInfo> found;
+  if (!fs::is_directory(_dir))
+    return found;
+
+  for (auto& item : fs::directory_iterator(_dir)) {
+    if (item.path().extension() != ".json")
+      continue;
+    auto entry = read_entry(item.path());
+    if (!entry)
+      continue;
+
+    EntryInfo info;
+    try {
+      info.key = item.path().stem().string();
+      info.exchange = entry->at("exchange").get<std::string>();
+      info.symbol = entry->at("symbol").get<std::string>();
+      info.from = time_from_json(entry->at("from"));
+      info.upto = time_from_json(entry->at("upto"));
+      info.build = entry->at("build").get<std::string>();
+      info.stale =
+          info.build != Services::build_datetime() || !files_unchanged(*entry);
+    }
+    catch (const std::exception& e) {
+      LOG_WARN("ignoring malformed backtest result " << item.path() << ": "
+               << e.what());
+      continue;
+    }
+
+    if (!filter.symbol.empty() && info.symbol != filter.symbol)
+      continue;
+    if (!filter.from.empty() && info.upto <= filter.from)
+      continue;
+    if (!filter.upto.empty() && info.from >= filter.upto)
+      continue;
+    if (filter.stale && !info.stale)
+      continue;
+    found.push_back(std::move(info));
+  }
+
+  std::sort(found.begin(), found.end(),
+            [](const EntryInfo& a, const EntryInfo& b) {
+              return std::tie(a.symbol, a.exchange, a.from, a.key) <
+                     std::tie(b.symbol, b.exchange, b.from, b.key);
+            });
+  return found;
+}
+
+
+size_t BacktestResultCache::invalidate(const Filter& filter)
+{
+  auto found = entries(filter);
+  std::error_code err;
+  for (auto& info : found) {
+    fs::remove(entry_path(info.key), err);
+    fs::remove(_dir / (info.key + ".csv"), err);
+  }
+  return found.size();
+}
+
+} // namespace apex
@@ -0,0 +1,129 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/Auditor.hpp>
+#include <apex/core/BacktestSweep.hpp>
+#include <apex/core/ShardedBacktest.hpp>
+#include <apex/util/json.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* Size and modification time of a tick file; a cached result is only reused
+ * while every file it was computed from is unchanged. */
+struct FileFingerprint
+{
+  std::filesystem::path path;
+  uint64_t size = 0;
+  int64_t mtime = 0; // zero if the file does not exist
+
+  static FileFingerprint of(const std::filesystem::path&);
+
+  bool operator==(const FileFingerprint& rhs) const
+  {
+    return path == rhs.path && size == rhs.size && mtime == rhs.mtime;
+  }
+};
+
+
+/* Result of one bot over one shard of a backtest. */
+struct CachedBotResult
+{
+  BacktestRunResult::BotResult bot;
+  Auditor::Summary audit;
+  std::vector<FileFingerprint> tick_files;
+};
+
+
+/* Directory of per-bot, per-shard backtest results, so that a backtest rerun
+ * after a change of parameters only replays the bots and days the change can
+ * affect.  A result is keyed by a digest of the bot's config (see
+ * Strategy::bot_config), the build of the library (Services::build_datetime),
+ * the instrument and the shard period, and is stored as KEY.json, with the
+ * bot's audit transactions, if written as CSV, as KEY.csv.  The tick files
+ * replayed for the bot are recorded with the result, and checked on lookup.
+ *
+ * Only the bot's own instrument is fingerprinted; a bot that also reads the
+ * market data of other instruments must include them in its bot_config.
+ * Safe to use from several threads, and processes, at once: an entry is
+ * written to a temporary file that is then renamed into place. */
+class BacktestResultCache
+{
+public:
+  explicit BacktestResultCache(std::filesystem::path dir);
+
+  [[nodiscard]] static std::string make_key(const json& bot_config,
+                                            const Instrument&,
+                                            const TimeShard&);
+
+  /* Result for a key, unless absent or computed from tick files since
+   * changed. */
+  [[nodiscard]] std::optional<CachedBotResult> find(const std::string& key);
+
+  /* Store a result, with the audit transaction rows of its instrument taken
+   * from the CSV audit files given, which are ordered in time. */
+  void store(const std::string& key, const TimeShard&, const CachedBotResult&,
+             const std::vector<std::filesystem::path>& audit_files);
+
+  /* Audit transactions of a cached result, empty if none were stored. */
+  [[nodiscard]] std::filesystem::path audit_file(const std::string& key) const;
+
+  struct Filter {
+    std::string symbol;  // empty for any
+    Time from;           // entries of shards overlapping [from, upto); empty
+    Time upto;           // times are unbounded
+    bool stale = false;  // only entries of another build, or of changed files
+  };
+
+  struct EntryInfo {
+    std::string key;
+    std::string exchange;
+    std::string symbol;
+    Time from;
+    Time upto;
+    std::string build;
+    bool stale = false;
+  };
+
+  /* Entries matching a filter, ordered by symbol and time. */
+  [[nodiscard]] std::vector<EntryInfo> entries(const Filter&) const;
+
+  /* Remove the entries matching a filter, returning the count removed. */
+  size_t invalidate(const Filter&);
+
+  [[nodiscard]] const std::filesystem::path& dir() const { return _dir; }
+  [[nodiscard]] size_t hits() const { return _hits; }
+  [[nodiscard]] size_t misses() const { return _misses; }
+
+private:
+  std::filesystem::path entry_path(const std::string& key) const;
+
+  std::filesystem::path _dir;
+  std::atomic<size_t> _hits{0};
+  std::atomic<size_t> _misses{0};
+};
+
+} // namespace apex
@@ -15,16 +15,24 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <apex/backtest/BarFile.hpp>
+#include <apex/backtest/DecodedTickCache.hpp>
+#include <apex/backtest/GxCaptureReplayer.hpp>
 #include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/UniverseTickFile.hpp>
 #include <apex/core/BacktestService.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/core/MarketDataService.hpp>
 #include <apex/core/Services.hpp>
 
 #include <apex/model/Instrument.hpp>
+#include <apex/model/InstrumentTable.hpp>
 #include <apex/util/BacktestEventLoop.hpp>
 #include <apex/util/Error.hpp>
 
+#include <sstream>
+
 namespace apex
 {
 
@@ -51,14 +59,121 @@ std::list<apex::Time> get_dates_in_range(apex::Time from, apex::Time upto)
   return dates;
 }
 
+/* Parse the paging hints used when replaying memory mapped tick files. */
+static MmapOptions parse_mmap_options(Config config)
+{
+  const uint64_t mb = 1 << 20;
+  MmapOptions defaults;
+  MmapOptions options;
+  options.sequential = config.get_bool("sequential", defaults.sequential);
+  options.populate_max_size =
+    config.get_uint("populate_max_mb", defaults.populate_max_size / mb) * mb;
+  options.hugepages = config.get_bool("hugepages", defaults.hugepages);
+  options.window = config.get_uint("window_mb", defaults.window / mb) * mb;
+  options.release = config.get_bool("release", defaults.release);
+  return options;
+}
+
+
 BacktestService::BacktestService(Services* services, apex::Time replay_from,
                                  apex::Time replay_upto)
   : _services(services),
     _from(replay_from),
     _upto(replay_upto),
-    _dates{get_dates_in_range(_from, _upto)}
+    _dates{get_dates_in_range(_from, _upto)},
+    _tick_format(parse_tick_format(
+        services->config()
+        .get_sub_config("backtest", Config::empty_config())
+        .get_string("tick_format", to_string(TickFormat::tickbin1)))),
+    _tardis_read_ahead(services->config()
+                       .get_sub_config("backtest", Config::empty_config())
+                       .get_bool("tardis_read_ahead", true)),
+    _tardis_cache_dir(services->config()
+                      .get_sub_config("backtest", Config::empty_config())
+                      .get_string("tardis_cache_dir",
+                                  (services->paths_config().tickdata /
+                                   "cache" / "tardis").string())),
+    _prefetch_next_file(services->config()
+                        .get_sub_config("backtest", Config::empty_config())
+                        .get_bool("prefetch_next_file", true)),
+    _book_event_depth(services->config()
+                      .get_sub_config("backtest", Config::empty_config())
+                      .get_uint("book_event_depth", 5)),
+    _mmap_options(parse_mmap_options(
+        services->config()
+        .get_sub_config("backtest", Config::empty_config())
+        .get_sub_config("mmap", Config::empty_config()))),
+    _universe_file(services->config()
+                   .get_sub_config("backtest", Config::empty_config())
+                   .get_string("universe_file", "")),
+    _gx_capture_dir(services->config()
+                    .get_sub_config("backtest", Config::empty_config())
+                    .get_string("gx_capture_dir", "")),
+    _bar_interval(services->config()
+                  .get_sub_config("backtest", Config::empty_config())
+                  .get_uint("bar_interval_sec", 60))
 {
-  LOG_INFO("number of backtest dates: " << _dates.size());
+  if (!_universe_file.empty() && _universe_file.is_relative())
+    _universe_file = services->paths_config().tickdata / _universe_file;
+
+  // Backtest config "decoded_cache" of {"dir": DIR, "budget_mb": N} enables
+  // the host-wide cache of decoded tick files.
+  auto backtest_config = services->config().get_sub_config(
+      "backtest", Config::empty_config());
+  if (backtest_config.contains("decoded_cache")) {
+    auto cache_config = backtest_config.get_sub_config("decoded_cache");
+    const uint64_t mb = 1 << 20;
+    _decoded_cache = std::make_unique<DecodedTickCache>(
+        cache_config.get_string("dir", "/dev/shm/apex-ticks"),
+        cache_config.get_uint("budget_mb", 4096) * mb);
+    LOG_INFO("decoded tick cache " << _decoded_cache->dir() << ", budget "
+             << _decoded_cache->budget() / mb << " MB");
+  }
+
+  // Backtest config "progress_log_sec" sets the interval of the progress
+  // heartbeat log (0 disables it), and "time_split" whether the loop's wall
+  // time is split by phase and event source.
+  BacktestEventLoop::ProgressOptions progress;
+  progress.interval = std::chrono::seconds(
+      backtest_config.get_uint("progress_log_sec", 30));
+  progress.time_split = backtest_config.get_bool("time_split", true);
+  services->backtest_evloop()->set_progress_options(std::move(progress));
+
+  // "replay_filter" of {"windows": ["HH:MM-HH:MM", ...], "l1_conflate_ms": N,
+  // "streams": ["l1", ...]} limits replay to intraday windows, keeps only the
+  // last L1 tick of each interval, and drops the streams not listed; it is
+  // applied by the tick readers, which skip the records without decoding them
+  if (backtest_config.contains("replay_filter")) {
+    auto filter_config = backtest_config.get_sub_config("replay_filter");
+    std::vector<std::string> windows;
+    auto windows_config =
+        filter_config.get_sub_config("windows", Config(json::array()));
+    for (size_t i = 0; i < windows_config.array_size(); i++)
+      windows.push_back(windows_config.get_string(i));
+    _replay_filter = TickFilter::parse(
+        windows,
+        std::chrono::milliseconds(filter_config.get_uint("l1_conflate_ms", 0)));
+    auto streams_config =
+        filter_config.get_sub_config("streams", Config(json::array()));
+    for (size_t i = 0; i < streams_config.array_size(); i++)
+      _replay_streams |=
+          static_cast<int>(parse_md_stream(streams_config.get_string(i)));
+    LOG_INFO("replay filter windows: " << _replay_filter.windows.size()
+             << ", l1 conflation: " << _replay_filter.l1_conflate.count()
+             << " us");
+  }
+
+  _mixed_tick_files = backtest_config.get_bool("mixed_tick_files", false);
+  if (_mixed_tick_files && _tick_format != TickFormat::tickbin1)
+    throw ConfigError("mixed_tick_files requires tick_format tickbin1");
+
+  // "batch_events" lets a source consume a run of events without returning
+  // to the loop per event; disabling it is only useful for comparison
+  services->backtest_evloop()->set_batching(
+      backtest_config.get_bool("batch_events", true));
+
+  LOG_INFO("number of backtest dates: " << _dates.size()
+           << ", tick format: " << to_string(_tick_format));
 }
 
 
@@ -69,17 +184,52 @@ void BacktestService::create_tick_replayer(const Instrument& instrument,
                                            MarketData* mktdata,
                                            MdStream stream_type)
 {
-  auto tick_format = TickFormat::tickbin1;
+  auto tick_format = _tick_format;
 
   auto tick_dir = _services->paths_config().tickdata;
 
-  std::pair<Instrument, MdStream> key{instrument, stream_type};
+  auto& interned = InstrumentTable::instance().resolve(instrument);
+  std::pair<InstrumentId, MdStream> key{interned.iid(), stream_type};
+
+  // use the shared tick-file cache, if this backtest shares its process
+  auto shared = _services->shared_backtest_data();
+
+  if (!_universe_file.empty()) {
+    if (!_universe) {
+      _universe = std::make_unique<UniverseTickReplayer>(
+        _universe_file, _from, shared ? shared->tick_cache.get() : nullptr,
+        _mmap_options);
+      _services->backtest_evloop()->add_event_source(_universe.get());
+    }
+    if (!_universe->subscribe(instrument.id(), stream_type, mktdata))
+      THROW("no tick-data for stream " << instrument << "/" << stream_type
+            << " in universe tick file " << _universe_file);
+    return;
+  }
+
+  if (_replay_streams && !(_replay_streams & static_cast<int>(stream_type))) {
+    std::ostringstream os; // MdStream only streams from a non-const ref
+    os << instrument << "/" << stream_type;
+    LOG_INFO("stream " << os.str() << " excluded by replay filter");
+    return;
+  }
+
+  TickReplayOptions options;
+  options.filter = _replay_filter;
+  options.tick_cache = shared ? shared->tick_cache.get() : nullptr;
+  options.tardis_read_ahead = _tardis_read_ahead;
+  options.tardis_cache_dir = _tardis_cache_dir;
+  options.mmap = _mmap_options;
+  options.prefetch_next_file = _prefetch_next_file;
+  options.book_event_depth = _book_event_depth;
+  options.decoded_cache = _decoded_cache.get();
 
   auto sp = std::make_unique<TickReplayer>(tick_dir,
                                            tick_format,
                                            instrument, mktdata, stream_type,
                                            _from,
-                                           _dates);
+                                           _dates,
+                                           options);
 
   auto file_count = sp->file_count();
   if (!file_count) {
@@ -97,6 +247,60 @@ void BacktestService::create_tick_replayer(const Instrument& instrument,
 }
 
 
+std::vector<std::filesystem::path> BacktestService::tick_files(
+  const Instrument& instrument) const
+{
+  std::vector<std::filesystem::path> files;
+  if (_universe)
+    files.push_back(_universe_file);
+  if (_gx_capture)
+    files.insert(files.end(), _gx_capture->files().begin(),
+                 _gx_capture->files().end());
+
+  auto iid = InstrumentTable::instance().resolve(instrument).iid();
+  for (auto& [key, replayer] : _replayers)
+    if (key.first == iid)
+      files.insert(files.end(), replayer->filenames().begin(),
+                   replayer->filenames().end());
+  if (auto iter = _bar_replayers.find(iid); iter != _bar_replayers.end())
+    files.insert(files.end(), iter->second->files().begin(),
+                 iter->second->files().end());
+  return files;
+}
+
+
+void BacktestService::create_bar_replayer(const Instrument& instrument,
+                                          MarketData* mktdata)
+{
+  auto& interned = InstrumentTable::instance().resolve(instrument);
+  if (_bar_replayers.count(interned.iid()))
+    return;
+
+  std::vector<std::filesystem::path> files;
+  for (auto& date : _dates) {
+    auto fn = bar_file_path(_services->paths_config().tickdata, _bar_interval,
+                            date, instrument.exchange_name(),
+                            instrument.native_symbol());
+    if (std::filesystem::is_regular_file(fn))
+      files.push_back(fn);
+  }
+  if (files.empty())
+    THROW("no bar files of " << _bar_interval.count() << "s found for "
+          << instrument << " for dates " << _dates.front().strftime("%Y/%m/%d")
+          << " - " << _dates.back().strftime("%Y/%m/%d"));
+  LOG_INFO("bar files of " << _bar_interval.count() << "s for " << instrument
+           << ": " << files.size());
+
+  auto shared = _services->shared_backtest_data();
+  auto replayer = std::make_unique<BarReplayer>(
+      std::move(files), _from,
+      [mktdata](const Bar& bar) { mktdata->apply(bar); },
+      shared ? shared->tick_cache.get() : nullptr);
+  _services->backtest_evloop()->add_event_source(replayer.get());
+  _bar_replayers.insert({interned.iid(), std::move(replayer)});
+}
+
+
 void BacktestService::subscribe_canned_data(const Instrument& instrument,
                                             MarketData* mktdata,
                                             MdStreamParams stream_params)
@@ -105,15 +309,40 @@ void BacktestService::subscribe_canned_data(const Instrument& instrument,
     THROW("no market-data streams configured when subscribing to " << instrument);
   }
 
+  // a GX capture holds every stream the live session received
+  if (!_gx_capture_dir.empty()) {
+    if (!_gx_capture) {
+      _gx_capture = std::make_unique<GxCaptureReplayer>(_gx_capture_dir, _from);
+      _services->backtest_evloop()->add_event_source(_gx_capture.get());
+    }
+    _gx_capture->subscribe(instrument.native_symbol(), instrument.exchange_id(),
+                           mktdata, stream_params.mask);
+    return;
+  }
+
   // To resolve the market data subscribe, we need information that tells us
   // which set of tick-files to use, and which decoder to use.  This information
   // will come from the application
 
-  if (stream_params.mask & static_cast<int>(MdStream::AggTrades))
-    create_tick_replayer(instrument, mktdata, MdStream::AggTrades);
+  // both streams of a mixed tick file are replayed by one replayer, if both
+  // are wanted
+  const int mixed = static_cast<int>(tickbin_mixed_streams);
+  if (_mixed_tick_files && (stream_params.mask & mixed) == mixed &&
+      (!_replay_streams || (_replay_streams & mixed) == mixed))
+    create_tick_replayer(instrument, mktdata, tickbin_mixed_streams);
+  else {
+    if (stream_params.mask & static_cast<int>(MdStream::AggTrades))
+      create_tick_replayer(instrument, mktdata, MdStream::AggTrades);
+
+    if (stream_params.mask & static_cast<int>(MdStream::L1))
+      create_tick_replayer(instrument, mktdata, MdStream::L1);
+  }
+
+  if (stream_params.has(MdStream::L2))
+    create_tick_replayer(instrument, mktdata, MdStream::L2);
 
-  if (stream_params.mask & static_cast<int>(MdStream::L1))
-    create_tick_replayer(instrument, mktdata, MdStream::L1);
+  if (stream_params.has(MdStream::Bars))
+    create_bar_replayer(instrument, mktdata);
 }
 
 } // namespace apex
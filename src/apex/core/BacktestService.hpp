@@ -17,18 +17,28 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickReplayer.hpp>
 #include <apex/util/Time.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/core/OrderRouter.hpp>
 
+#include <chrono>
+#include <filesystem>
 #include <list>
 #include <memory>
 #include <map>
+#include <vector>
 
 namespace apex
 {
 
+class BarReplayer;
+class DecodedTickCache;
+class GxCaptureReplayer;
 class TickReplayer;
+class UniverseTickReplayer;
+enum class TickFormat;
 
 class BacktestService
 {
@@ -37,19 +47,59 @@ public:
   ~BacktestService();
   void subscribe_canned_data(const Instrument&, MarketData*, MdStreamParams stream_params);
 
+  /* Files replayed for the streams of an instrument subscribed so far. */
+  std::vector<std::filesystem::path> tick_files(const Instrument&) const;
+
 private:
 
   void create_tick_replayer(const Instrument& instrument,
                             MarketData* mktdata,
                             MdStream stream_type);
 
+  void create_bar_replayer(const Instrument&, MarketData*);
+
   Services* _services;
   apex::Time _from;
   apex::Time _upto;
   std::list<Time> _dates;
+  TickFormat _tick_format;
+  bool _tardis_read_ahead;
+
+  // empty when Tardis files are not to be cached as tickbin2
+  std::filesystem::path _tardis_cache_dir;
+
+  bool _prefetch_next_file;
+  size_t _book_event_depth;
+  MmapOptions _mmap_options;
+
+  // null unless a cache of decoded tick files, shared between processes,
+  // is configured
+  std::unique_ptr<DecodedTickCache> _decoded_cache;
 
-  std::map<std::pair<Instrument, MdStream>,
+  std::map<std::pair<InstrumentId, MdStream>,
            std::unique_ptr<TickReplayer>> _replayers;
+
+  // backtest config "replay_filter": events the tick readers pass over, and
+  // the mask of streams replayed at all, zero for every stream
+  TickFilter _replay_filter;
+  int _replay_streams = 0;
+
+  // backtest config "mixed_tick_files": the L1 and trades of an instrument
+  // are replayed together, from mixed tick files
+  bool _mixed_tick_files = false;
+
+  // if configured, all streams are replayed from a single universe tick file
+  std::filesystem::path _universe_file;
+  std::unique_ptr<UniverseTickReplayer> _universe;
+
+  // if configured, market data is replayed from a capture of the inbound
+  // frames of a live GX session, instead of from tick files
+  std::filesystem::path _gx_capture_dir;
+  std::unique_ptr<GxCaptureReplayer> _gx_capture;
+
+  // bars of the "bars" stream, of the backtest config "bar_interval_sec"
+  std::chrono::seconds _bar_interval;
+  std::map<InstrumentId, std::unique_ptr<BarReplayer>> _bar_replayers;
 };
 
 
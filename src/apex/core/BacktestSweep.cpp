@@ -0,0 +1,201 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BacktestSweep.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/core/Auditor.hpp>
+#include <apex/core/Bot.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/RefDataService.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/core/StrategyMain.hpp>
+#include <apex/util/utils.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace apex
+{
+
+std::ostream& operator<<(std::ostream& os, const BacktestRunResult& result)
+{
+  os << "run " << result.index << " " << QUOTE(result.label);
+  if (!result.ok)
+    return os << ", failed: " << result.error;
+
+  os << ", pnl_usd: " << format_double(result.pnl_usd, true)
+     << ", fills: " << result.fills
+     << ", fill_value_usd: " << format_double(result.fill_value_usd, true)
+     << ", max_drawdown_usd: " << format_double(result.max_drawdown_usd, true)
+     << ", sharpe: " << format_double(result.sharpe, true)
+     << ", fill_ratio: " << format_double(result.fill_ratio, true)
+     << ", order_events: " << result.order_events
+     << ", elapsed_ms: " << result.elapsed.count();
+  return os;
+}
+
+
+BacktestSweep::BacktestSweep(const StrategyFactoryBase& factory,
+                             BacktestSweepOptions options)
+  : _factory(factory),
+    _options(std::move(options))
+{
+  if (_options.work_dir.empty())
+    _options.work_dir = apex_home() / "sweep" /
+      Time::realtime_now().strftime("%Y%m%d_%H%M%S");
+}
+
+
+size_t BacktestSweep::add_run(std::string label, Config strategy_config)
+{
+  _runs.push_back({std::move(label), std::move(strategy_config)});
+  return _runs.size() - 1;
+}
+
+
+std::vector<BacktestRunResult> BacktestSweep::run()
+{
+  // load the read-only resources shared by all runs
+  auto shared = std::make_shared<SharedBacktestData>();
+  shared->ref_data = std::make_shared<const RefDataService>(
+      nullptr,
+      _options.services_config.get_sub_config("ref_data",
+                                              Config::empty_config()));
+  shared->tick_cache = std::make_shared<TickFileCache>();
+
+  size_t thread_count = _options.threads;
+  if (thread_count == 0)
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  thread_count = std::min(thread_count, _runs.size());
+
+  LOG_NOTICE("backtest sweep: " << _runs.size() << " runs, " << thread_count
+             << " threads, work-dir " << _options.work_dir);
+
+  std::vector<BacktestRunResult> results(_runs.size());
+  std::atomic<size_t> next{0};
+
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers.emplace_back([this, i, &next, &results, shared]() {
+      Logger::instance().register_thread_id("sweep" + std::to_string(i));
+      for (size_t j = next++; j < _runs.size(); j = next++)
+        results[j] = run_one(j, shared);
+    });
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  LOG_NOTICE("backtest sweep complete, tick files shared: "
+             << shared->tick_cache->size());
+  return results;
+}
+
+
+BacktestRunResult BacktestSweep::run_one(
+  size_t index, std::shared_ptr<const SharedBacktestData> shared)
+{
+  const Run& run = _runs[index];
+  BacktestRunResult result;
+  result.index = index;
+  result.label = run.label;
+
+  auto started = std::chrono::steady_clock::now();
+  try {
+    // give each run its own output directories
+    auto run_dir = _options.work_dir / ("run-" + std::to_string(index));
+    json services_raw = _options.services_config.raw();
+    if (!services_raw.is_object())
+      services_raw = json::object();
+    services_raw["persist"]["path"] = (run_dir / "persist").string();
+    services_raw["auditor"]["transactions_dir"] = run_dir.string();
+    if (!services_raw.contains("log_file"))
+      services_raw["log_file"] = (run_dir / "apex.log").string();
+
+    std::unique_ptr<Services> services =
+      std::make_unique<Services>(RunMode::backtest, _options.period);
+    services->set_shared_backtest_data(std::move(shared));
+    services->init_services(Config{services_raw});
+
+    Config strategy_config = run.strategy_config;
+    auto strategy = _factory.create(strategy_config, services.get());
+    if (!strategy)
+      throw std::runtime_error(
+        "strategy factory did not create a strategy instance");
+
+    strategy->create_bots();
+    strategy->init_bots();
+
+    services->run();
+
+    // collect results before the strategy is stopped
+    for (auto& item : strategy->bots()) {
+      if (!item.second)
+        continue;
+      const Bot& bot = *item.second;
+      BacktestRunResult::BotResult bot_result;
+      bot_result.symbol = bot.instrument().native_symbol();
+      bot_result.exchange = bot.instrument().exchange_name();
+      bot_result.net_qty = bot.position().net_qty();
+      bot_result.net_position_usd = bot.net_position_usd();
+      bot_result.pnl_usd = bot.pnl_usd();
+      if (auto auditor = strategy->auditor()) {
+        auto performance = auditor->performance(item.first);
+        bot_result.fills = performance.fills;
+        bot_result.turnover_usd = performance.turnover_usd;
+        bot_result.max_drawdown_usd = performance.max_drawdown_usd;
+        bot_result.sharpe = performance.sharpe;
+        bot_result.fill_ratio = performance.fill_ratio();
+      }
+      if (std::isfinite(bot_result.pnl_usd))
+        result.pnl_usd += bot_result.pnl_usd;
+      result.bots.push_back(std::move(bot_result));
+    }
+
+    if (auto auditor = strategy->auditor()) {
+      result.order_events = auditor->summary().order_events;
+      result.fills = auditor->summary().fills;
+      result.fill_value_usd = auditor->summary().fill_value_usd;
+      auto performance = auditor->performance();
+      result.max_drawdown_usd = performance.max_drawdown_usd;
+      result.sharpe = performance.sharpe;
+      result.fill_ratio = performance.fill_ratio();
+    }
+
+    strategy.reset();
+    result.ok = true;
+  }
+  catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  catch (...) {
+    result.error = "unknown exception";
+  }
+
+  result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started);
+
+  if (result.ok)
+    LOG_INFO("backtest sweep " << result);
+  else
+    LOG_ERROR("backtest sweep " << result);
+
+  return result;
+}
+
+} // namespace apex
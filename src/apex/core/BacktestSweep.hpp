@@ -0,0 +1,125 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/Services.hpp>
+#include <apex/util/Config.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <iosfwd>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class StrategyFactoryBase;
+
+struct BacktestSweepOptions
+{
+  BacktestPeriod period;
+
+  // Services config applied to every run; the sweep overrides the "persist"
+  // and "auditor" paths so that each run writes to its own directory, where
+  // it also logs, unless "log_file" is given.
+  Config services_config = Config::empty_config();
+
+  // Number of worker threads; zero selects the hardware concurrency.
+  size_t threads = 0;
+
+  // Root directory for per-run output, defaults to APEX_HOME/sweep/<time>.
+  std::filesystem::path work_dir;
+};
+
+
+struct BacktestRunResult
+{
+  struct BotResult {
+    std::string symbol;
+    std::string exchange;
+    double net_qty = 0.0;
+    double net_position_usd = 0.0;
+    double pnl_usd = 0.0;
+
+    // from the Auditor's stats of the bot
+    size_t fills = 0;
+    double turnover_usd = 0.0;
+    double max_drawdown_usd = 0.0;
+    double sharpe = std::numeric_limits<double>::quiet_NaN();
+    double fill_ratio = std::numeric_limits<double>::quiet_NaN();
+  };
+
+  size_t index = 0;
+  std::string label;
+  bool ok = false;
+  std::string error;
+
+  // totals over all bots, and from the strategy Auditor
+  double pnl_usd = 0.0;
+  size_t order_events = 0;
+  size_t fills = 0;
+  double fill_value_usd = 0.0;
+
+  // performance of the strategy, from the Auditor's online stats
+  double max_drawdown_usd = 0.0;
+  double sharpe = std::numeric_limits<double>::quiet_NaN();
+  double fill_ratio = std::numeric_limits<double>::quiet_NaN();
+
+  std::chrono::milliseconds elapsed{0};
+  std::vector<BotResult> bots;
+};
+
+std::ostream& operator<<(std::ostream&, const BacktestRunResult&);
+
+
+/* Run many backtests of a strategy, typically one per parameter set, inside a
+ * single process.  Runs are spread over a pool of worker threads; each run has
+ * its own Services, event loop and Strategy, while read-only ref-data and tick
+ * files are loaded once and shared by all runs. */
+class BacktestSweep
+{
+public:
+  BacktestSweep(const StrategyFactoryBase&, BacktestSweepOptions);
+
+  /* Add a run, returning its index into the results. */
+  size_t add_run(std::string label, Config strategy_config);
+
+  [[nodiscard]] size_t run_count() const { return _runs.size(); }
+
+  /* Execute all runs, blocking until complete.  A run that fails does not stop
+   * the sweep; instead its result carries the error. */
+  std::vector<BacktestRunResult> run();
+
+private:
+  struct Run {
+    std::string label;
+    Config strategy_config;
+  };
+
+  BacktestRunResult run_one(size_t index,
+                            std::shared_ptr<const SharedBacktestData>);
+
+  const StrategyFactoryBase& _factory;
+  BacktestSweepOptions _options;
+  std::vector<Run> _runs;
+};
+
+} // namespace apex
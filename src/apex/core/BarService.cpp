@@ -0,0 +1,217 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BarService.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/util/EventLoop.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+
+BarSeries::BarSeries(const Instrument& instrument,
+                     std::chrono::seconds interval, size_t capacity)
+  : _instrument(instrument),
+    _interval(interval),
+    _bars(capacity)
+{
+  if (capacity == 0)
+    THROW("bar series capacity must be positive");
+}
+
+
+void BarSeries::push(const Bar& bar)
+{
+  _bars[_next] = bar;
+  _next = (_next + 1) % _bars.size();
+  _size = std::min(_size + 1, _bars.size());
+  _total++;
+
+  for (auto* listener : _listeners)
+    listener->on_bar_close(*this);
+}
+
+
+void BarSeries::add_listener(Listener* listener)
+{
+  if (std::find(_listeners.begin(), _listeners.end(), listener) ==
+      _listeners.end())
+    _listeners.push_back(listener);
+}
+
+
+void BarSeries::remove_listener(Listener* listener)
+{
+  _listeners.erase(
+      std::remove(_listeners.begin(), _listeners.end(), listener),
+      _listeners.end());
+}
+
+
+/* Bars of one interval of an instrument, and their aggregator. */
+struct BarService::Timeframe
+{
+  Timeframe(const Instrument& instrument, std::chrono::seconds interval,
+            size_t capacity)
+    : series(instrument, interval, capacity),
+      aggregator(interval, [this](const Bar& bar) { series.push(bar); })
+  {
+  }
+
+  BarSeries series;
+  BarAggregator aggregator;
+  bool close_pending = false;
+};
+
+
+/* Feeds the bars of every interval of an instrument from its market data. */
+class BarService::Source : public MarketData::Listener
+{
+public:
+  Source(BarService* owner, MarketData* market)
+    : _owner(owner), _market(market)
+  {
+    _market->add_listener(this, MarketData::EventType::top |
+                                    MarketData::EventType::trade);
+  }
+
+  ~Source() override { _market->remove_listener(this); }
+
+  void on_market_event(MarketData::EventType event) override
+  {
+    // as in a bar file, a quote is taken before a trade of the same time
+    auto now = _owner->_services->now();
+    for (auto& tf : timeframes) {
+      if (event.is_top())
+        tf->aggregator.add_top(now, _market->bid(), _market->ask());
+      if (event.is_trade())
+        tf->aggregator.add_trade(now, _market->last().price,
+                                 _market->last().qty);
+      _owner->schedule_close(tf.get());
+    }
+  }
+
+  std::vector<std::unique_ptr<Timeframe>> timeframes;
+
+private:
+  BarService* _owner;
+  MarketData* _market;
+};
+
+
+BarService::BarService(Services* services, Config config)
+  : _services(services),
+    _capacity(config.get_uint("capacity", 1024))
+{
+  if (_capacity == 0)
+    throw ConfigError("bar service capacity must be positive");
+}
+
+
+BarService::~BarService() = default;
+
+
+BarSeries* BarService::find(const Instrument& instrument,
+                            std::chrono::seconds interval) const
+{
+  auto iter = _sources.find(instrument.iid());
+  if (iter == std::end(_sources))
+    return nullptr;
+  for (auto& tf : iter->second->timeframes)
+    if (tf->series.interval() == interval)
+      return &tf->series;
+  return nullptr;
+}
+
+
+BarSeries* BarService::subscribe(const Instrument& instrument,
+                                 std::chrono::seconds interval)
+{
+  if (auto* series = find(instrument, interval))
+    return series;
+  if (_sources.count(instrument.iid()))
+    return subscribe(instrument, interval, nullptr);
+
+  auto* market = _services->market_data_service()->find_market_data(
+      instrument, MdStreamParams{static_cast<int>(MdStream::AggTrades) |
+                                 static_cast<int>(MdStream::L1)});
+  if (!market)
+    return nullptr;
+  return subscribe(instrument, interval, market);
+}
+
+
+BarSeries* BarService::subscribe(const Instrument& instrument,
+                                 std::chrono::seconds interval,
+                                 MarketData* market)
+{
+  if (interval.count() <= 0)
+    THROW("bar interval must be positive");
+  if (auto* series = find(instrument, interval))
+    return series;
+
+  auto iter = _sources.find(instrument.iid());
+  if (iter == std::end(_sources))
+    iter = _sources
+               .insert({instrument.iid(), std::make_unique<Source>(this, market)})
+               .first;
+
+  LOG_INFO(interval.count() << "s bars of " << instrument);
+  auto& timeframes = iter->second->timeframes;
+  timeframes.push_back(
+      std::make_unique<Timeframe>(instrument, interval, _capacity));
+  return &timeframes.back()->series;
+}
+
+
+// Delay until a time, of at least a millisecond, as zero stops a timer.
+static std::chrono::milliseconds delay_until(Time t, Time now)
+{
+  auto ms = std::chrono::ceil<std::chrono::milliseconds>(t.as_epoch_us() -
+                                                         now.as_epoch_us());
+  return std::max(ms, std::chrono::milliseconds(1));
+}
+
+
+void BarService::schedule_close(Timeframe* tf)
+{
+  if (tf->close_pending || tf->aggregator.open_bar_end().empty())
+    return;
+
+  // the timer follows the open bar, which a tick may have replaced, until a
+  // bar closes with no tick after it
+  tf->close_pending = true;
+  auto now = _services->now();
+  _services->evloop()->dispatch(
+      delay_until(tf->aggregator.open_bar_end(), now),
+      EventLoop::timer_fn([this, tf]() {
+        auto now = _services->now();
+        tf->aggregator.close_ended(now);
+        auto end = tf->aggregator.open_bar_end();
+        if (end.empty()) {
+          tf->close_pending = false;
+          return std::chrono::milliseconds(0);
+        }
+        return delay_until(end, now);
+      }));
+}
+
+} // namespace apex
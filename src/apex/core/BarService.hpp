@@ -0,0 +1,137 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/BarFile.hpp>
+#include <apex/model/Instrument.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+class Services;
+
+/* The most recent closed bars of an instrument at one interval, held in a
+ * ring buffer of fixed capacity; the oldest bar is overwritten once full.
+ * Bars are accessed in place, by age, and stay valid until overwritten. */
+class BarSeries
+{
+public:
+  /* Notified as each bar closes; the new bar is at(0). */
+  class Listener
+  {
+  public:
+    virtual ~Listener() = default;
+    virtual void on_bar_close(const BarSeries&) = 0;
+  };
+
+  BarSeries(const Instrument&, std::chrono::seconds interval, size_t capacity);
+
+  BarSeries(const BarSeries&) = delete;
+  BarSeries& operator=(const BarSeries&) = delete;
+
+  /* Bar closed `ago` bars before the latest, which is at(0); `ago` must be
+   * less than size(). */
+  [[nodiscard]] const Bar& at(size_t ago) const
+  {
+    return _bars[(_next + _bars.size() - 1 - ago) % _bars.size()];
+  }
+
+  [[nodiscard]] const Bar& last() const { return at(0); }
+  [[nodiscard]] bool empty() const { return _size == 0; }
+
+  /* Bars held, at most the capacity */
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] size_t capacity() const { return _bars.size(); }
+
+  /* Bars closed since created, including those overwritten */
+  [[nodiscard]] uint64_t total() const { return _total; }
+
+  [[nodiscard]] const Instrument& instrument() const { return _instrument; }
+  [[nodiscard]] std::chrono::seconds interval() const { return _interval; }
+
+  /* The listener must remain valid until removed. */
+  void add_listener(Listener*);
+  void remove_listener(Listener*);
+
+private:
+  friend class BarService;
+  void push(const Bar&);
+
+  Instrument _instrument;
+  std::chrono::seconds _interval;
+  std::vector<Bar> _bars;
+  size_t _next = 0;
+  size_t _size = 0;
+  uint64_t _total = 0;
+  std::vector<Listener*> _listeners;
+};
+
+
+/* Bars of instruments, built incrementally from their market data, once per
+ * instrument and interval however many bots and strategies use them.  Bars
+ * are cut by BarAggregator, as are those of bar files, so that a backtest
+ * sees the boundaries of the offline bar store; a bar closes at its end time
+ * even if no later tick arrives.  Config field "capacity" sets the bars held
+ * per series, default 1024.  Used on the event thread. */
+class BarService
+{
+public:
+  BarService(Services*, Config = Config::empty_config());
+  ~BarService();
+
+  BarService(const BarService&) = delete;
+  BarService& operator=(const BarService&) = delete;
+
+  /* Series of an instrument's bars at an interval, created on first use,
+   * subscribing to the instrument's trades and top of book; null if the
+   * instrument has no market data. */
+  BarSeries* subscribe(const Instrument&, std::chrono::seconds interval);
+
+  /* As above, but taking the instrument's ticks from the given market, unless
+   * the instrument already has bars.  The market must outlive this service. */
+  BarSeries* subscribe(const Instrument&, std::chrono::seconds interval,
+                       MarketData*);
+
+  /* Series of an instrument's bars if already subscribed, else null. */
+  [[nodiscard]] BarSeries* find(const Instrument&,
+                                std::chrono::seconds interval) const;
+
+  [[nodiscard]] size_t capacity() const { return _capacity; }
+
+private:
+  class Source;
+  struct Timeframe;
+
+  void schedule_close(Timeframe*);
+
+  Services* _services;
+  size_t _capacity;
+  std::map<InstrumentId, std::unique_ptr<Source>> _sources;
+};
+
+} // namespace apex
@@ -0,0 +1,183 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BinaryLog.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+
+namespace apex
+{
+
+static constexpr size_t write_buffer_size = 64 << 10;
+
+// Thread ids may be zero, which the maps cannot hold as a key.
+static uint64_t thread_key(int tid) { return uint32_t(tid) | (1ull << 32); }
+
+
+BinaryLogWriter::BinaryLogWriter(const std::string& path)
+  : _path(path),
+    _os(path, std::ios::out | std::ios::binary | std::ios::trunc)
+{
+  if (!_os)
+    THROW("cannot open binary log file " << QUOTE(path));
+  _buf.reserve(write_buffer_size + 4096);
+
+  binlog::FileHeader header{};
+  memcpy(header.magic, binlog::magic, sizeof(header.magic));
+  header.version = binlog::version;
+  _os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+
+BinaryLogWriter::~BinaryLogWriter() { flush(); }
+
+
+uint32_t BinaryLogWriter::site_id(const char* file, int line)
+{
+  // __FILE__ of a site is a string literal, so its address together with the
+  // line identifies the site; user space addresses fit in 48 bits
+  auto key = reinterpret_cast<uintptr_t>(file) | (uint64_t(line) << 48);
+  if (auto* id = _sites.find(key))
+    return *id;
+
+  uint32_t id = _next_site++;
+  _sites.insert(key, id);
+
+  binlog::RecordHeader head{};
+  head.site = id;
+  head.kind = static_cast<uint8_t>(binlog::Kind::site);
+  auto file_len = strlen(file);
+  head.size = uint32_t(sizeof(uint32_t) + file_len);
+  uint32_t line32 = uint32_t(line);
+  append(head, &line32, sizeof(line32), file, file_len);
+  return id;
+}
+
+
+void BinaryLogWriter::write_entry(Logger::level lvl, Time time,
+                                  const char* file, int line, int tid,
+                                  std::string_view msg)
+{
+  binlog::RecordHeader head{};
+  head.time = time.as_epoch_us().count();
+  head.site = site_id(file, line);
+  head.tid = tid;
+  head.size = uint32_t(msg.size());
+  head.kind = static_cast<uint8_t>(binlog::Kind::entry);
+  head.level = static_cast<uint8_t>(lvl);
+  append(head, msg.data(), msg.size());
+}
+
+
+void BinaryLogWriter::write_thread(int tid, std::string_view label)
+{
+  binlog::RecordHeader head{};
+  head.tid = tid;
+  head.size = uint32_t(label.size());
+  head.kind = static_cast<uint8_t>(binlog::Kind::thread);
+  append(head, label.data(), label.size());
+}
+
+
+void BinaryLogWriter::append(const binlog::RecordHeader& head,
+                             const void* payload, size_t size,
+                             const void* extra, size_t extra_size)
+{
+  auto put = [this](const void* p, size_t n) {
+    auto* c = static_cast<const char*>(p);
+    _buf.insert(_buf.end(), c, c + n);
+  };
+  put(&head, sizeof(head));
+  put(payload, size);
+  if (extra_size)
+    put(extra, extra_size);
+  if (_buf.size() >= write_buffer_size)
+    flush();
+}
+
+
+void BinaryLogWriter::flush()
+{
+  if (!_buf.empty()) {
+    _os.write(_buf.data(), _buf.size());
+    _buf.clear();
+  }
+  _os.flush();
+}
+
+
+BinaryLogReader::BinaryLogReader(std::istream& is) : _is(is)
+{
+  binlog::FileHeader header{};
+  if (!_is.read(reinterpret_cast<char*>(&header), sizeof(header)))
+    THROW("binary log is missing its file header");
+  if (memcmp(header.magic, binlog::magic, sizeof(header.magic)) != 0)
+    THROW("not a binary log file");
+  if (header.version != binlog::version)
+    THROW("unsupported binary log version " << header.version);
+}
+
+
+bool BinaryLogReader::next(Entry& entry)
+{
+  while (true) {
+    binlog::RecordHeader head{};
+    if (!_is.read(reinterpret_cast<char*>(&head), sizeof(head)))
+      return false;
+    _payload.resize(head.size);
+    if (!_is.read(_payload.data(), head.size))
+      return false; // torn final record
+
+    switch (static_cast<binlog::Kind>(head.kind)) {
+      case binlog::Kind::site: {
+        if (head.size < sizeof(uint32_t))
+          THROW("binary log has a malformed site record");
+        Site site;
+        uint32_t line = 0;
+        memcpy(&line, _payload.data(), sizeof(line));
+        site.line = int(line);
+        site.file = _payload.substr(sizeof(line));
+        _sites.insert(head.site, std::move(site));
+        break;
+      }
+      case binlog::Kind::thread:
+        _threads.insert(thread_key(head.tid), _payload);
+        break;
+      case binlog::Kind::entry: {
+        entry.time = Time(std::chrono::microseconds(head.time));
+        entry.lvl = static_cast<Logger::level>(head.level);
+        entry.tid = head.tid;
+        entry.msg = _payload;
+        if (auto* site = _sites.find(head.site)) {
+          entry.file = site->file;
+          entry.line = site->line;
+        } else {
+          entry.file = {};
+          entry.line = 0;
+        }
+        auto* label = _threads.find(thread_key(head.tid));
+        entry.thread_label = label ? std::string_view(*label) : std::string_view{};
+        return true;
+      }
+      default:
+        break; // skip kinds from a later writer
+    }
+  }
+}
+
+} // namespace apex
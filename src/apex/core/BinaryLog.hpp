@@ -0,0 +1,145 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/Logger.hpp>
+#include <apex/util/OpenAddressMap.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace apex
+{
+
+namespace binlog
+{
+
+/* A binary log file is a FileHeader followed by records, each a fixed
+ * RecordHeader and `size` bytes of payload.  The source site of a log
+ * statement (file and line) is written once, as a site record, the first time
+ * the site logs; its entries then refer to it by id.  Payloads:
+ *
+ *   site:   uint32_t line, then the file name
+ *   entry:  the rendered message
+ *   thread: the label registered for the thread
+ */
+enum class Kind : uint8_t {
+  entry = 1,
+  site = 2,
+  thread = 3,
+};
+
+constexpr char magic[8] = {'A', 'P', 'E', 'X', 'B', 'L', 'O', 'G'};
+constexpr uint32_t version = 1;
+
+#pragma pack(push, 1)
+
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+};
+static_assert(sizeof(FileHeader) == 16);
+
+struct RecordHeader {
+  uint64_t time; // usec since epoch
+  uint32_t site;
+  int32_t tid;
+  uint32_t size; // payload bytes
+  uint8_t kind;
+  uint8_t level;
+  uint8_t pad[2];
+};
+static_assert(sizeof(RecordHeader) == 24);
+
+#pragma pack(pop)
+
+} // namespace binlog
+
+
+/* Logger sink that writes records in the binary log format, for rendering
+ * offline with apex-logcat.  Not thread safe; the Logger serialises calls. */
+class BinaryLogWriter
+{
+public:
+  explicit BinaryLogWriter(const std::string& path);
+  ~BinaryLogWriter();
+
+  BinaryLogWriter(const BinaryLogWriter&) = delete;
+  BinaryLogWriter& operator=(const BinaryLogWriter&) = delete;
+
+  void write_entry(Logger::level, Time, const char* file, int line, int tid,
+                   std::string_view msg);
+
+  void write_thread(int tid, std::string_view label);
+
+  void flush();
+
+  [[nodiscard]] const std::string& path() const { return _path; }
+
+private:
+  uint32_t site_id(const char* file, int line);
+
+  void append(const binlog::RecordHeader&, const void* payload, size_t size,
+              const void* extra = nullptr, size_t extra_size = 0);
+
+  std::string _path;
+  std::ofstream _os;
+  std::vector<char> _buf;
+  OpenAddressMap<uint32_t> _sites;
+  uint32_t _next_site = 1;
+};
+
+
+/* Sequential reader of a binary log file, resolving site and thread
+ * records so that each entry carries its source and thread label. */
+class BinaryLogReader
+{
+public:
+  struct Entry {
+    Time time;
+    Logger::level lvl = Logger::level::info;
+    int tid = 0;
+    std::string_view file;
+    int line = 0;
+    std::string_view thread_label; // empty if none was registered
+    std::string_view msg;
+  };
+
+  explicit BinaryLogReader(std::istream&);
+
+  /* Read the next entry; returns false at the end of the log.  Views held by
+   * the entry are valid until the next call. */
+  bool next(Entry&);
+
+private:
+  struct Site {
+    std::string file;
+    int line = 0;
+  };
+
+  std::istream& _is;
+  std::string _payload;
+  OpenAddressMap<Site> _sites;
+  OpenAddressMap<std::string> _threads;
+};
+
+} // namespace apex
@@ -22,11 +22,15 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/OrderRouterService.hpp>
 #include <apex/core/OrderService.hpp>
 #include <apex/core/PersistenceService.hpp>
+#include <apex/core/RiskService.hpp>
 #include <apex/core/Services.hpp>
 #include <apex/core/Strategy.hpp>
 #include <apex/core/Auditor.hpp>
 #include <apex/model/Position.hpp>
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/util/AllocGuard.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/Profiler.hpp>
 #include <apex/util/RealtimeEventLoop.hpp>
 
 #include <chrono>
@@ -39,11 +43,14 @@ namespace apex
 {
 
 Bot::Bot(const std::string& bot_typename, Strategy* strategy,
-         Instrument instrument)
+         const Instrument& instrument)
   : _services(strategy->services()),
     _strategy(strategy),
     _bot_typename(bot_typename),
-    _instrument(std::move(instrument))
+    _instrument(InstrumentTable::instance().resolve(instrument)),
+    _fixed_position(_instrument.tick_size, _instrument.lot_size),
+    _portfolio_entry(&strategy->portfolio()),
+    _order_cache(_instrument.tick_size.as_double())
 {
   bool include_bot_typename = !bot_typename.empty();
 
@@ -56,67 +63,190 @@ Bot::Bot(const std::string& bot_typename, Strategy* strategy,
 
 Bot::~Bot()
 {
+  if (_mkt)
+    _strategy->remove_timer_bot(this);
+  cancel_tasks();
+  if (_mkt)
+    unlisten(_mkt);
+  if (_batch_end_hook)
+    event_loop().remove_batch_end_hook(_batch_end_hook);
+  try {
+    persist_position(); // of fills since the last batch end
+  } catch (std::exception& e) {
+    LOG_ERROR(ticker() << ": failed to persist position, " << e.what());
+  }
   stop(); // attempt to cancel open orders
 }
 
 
+void Bot::MarketListener::on_market_event(MarketData::EventType event_type)
+{
+  if (event_type.is_trade() || event_type.is_bar())
+    bot->revalue();
+
+  if (!bot->is_stopping()) {
+    if (event_type.is_bar()) {
+      APEX_PROFILE_ZONE("Bot::on_bar");
+      bot->on_bar(bot->market().last_bar());
+    }
+
+    if (event_type.is_trade()) {
+      APEX_PROFILE_ZONE("Bot::on_tick_trade");
+      APEX_NO_ALLOC_SCOPE("Bot::on_tick_trade");
+      bot->on_tick_trade(event_type);
+    }
+
+    if (event_type.is_top()) {
+      APEX_PROFILE_ZONE("Bot::on_tick_book");
+      APEX_NO_ALLOC_SCOPE("Bot::on_tick_book");
+      bot->on_tick_book(event_type);
+    }
+  }
+}
+
+
+void Bot::BlockListener::on_top_block(const TickTopBlock& block)
+{
+  if (!bot->is_stopping()) {
+    APEX_PROFILE_ZONE("Bot::on_tick_block");
+    APEX_NO_ALLOC_SCOPE("Bot::on_tick_block");
+    bot->on_tick_block(block);
+  }
+}
+
+
+void Bot::enable_tick_blocks()
+{
+  if (_batch_end_hook)
+    THROW(ticker() << ": tick blocks must be enabled before the bot is "
+                      "initialised");
+  _tick_blocks = true;
+}
+
+
+void Bot::listen(MarketData* mkt)
+{
+  if (_tick_blocks) {
+    mkt->add_listener(_listener, _listen_mask & ~MarketData::EventType::top);
+    mkt->add_block_listener(&_block_listener);
+  }
+  else
+    mkt->add_listener(_listener, _listen_mask);
+}
+
+
+void Bot::unlisten(MarketData* mkt)
+{
+  mkt->remove_listener(_listener);
+  mkt->remove_block_listener(&_block_listener);
+}
+
+
 // Initialise this Bot, so that it becomes ready for trading.
 void Bot::init(double initial_position)
 {
   _position = Position(initial_position);
+  _fixed_position = FixedPosition(_instrument.tick_size, _instrument.lot_size,
+                                  initial_position);
   LOG_INFO(ticker() << ": initialising bot, startup-position:"
                     << _position.net_qty());
+  if (auto* risk = _services->risk_service())
+    risk->add_position(_instrument.iid(), initial_position);
 
   // setup market data subscription
-  _mkt = _services->market_data_service()->find_market_data(_instrument);
-  if (!_mkt) {
+  auto* mkt = _services->market_data_service()->find_market_data(_instrument);
+  if (!mkt) {
     THROW("failed to obtain a MarketData instance for instrument "
           << _instrument);
   }
 
-  _mkt->subscribe_events([this](MarketData::EventType event_type) {
-    if (!is_stopping()) {
-      if (event_type.is_trade()) {
-        this->on_tick_trade(event_type);
-      }
-
-      if (event_type.is_top()) {
-        this->on_tick_book(event_type);
-      }
-    }
-  });
-
-  _order_router = _services->order_router_service()->get_order_router(
+  auto* router = _services->order_router_service()->get_order_router(
     _instrument, _strategy->strategy_id());
-  assert(_order_router != nullptr);
+  assert(router != nullptr);
 
-  // setup market data subscription for an FX-rate instrument
-  if (_services->ref_data_service()->is_fx_rate_instrument(_instrument)) {
-    _mkt_fx_instr = _mkt;
+  // during a warm-up, the live market data & router are only held until
+  // end_warmup
+  if (_warming_up) {
+    _live_mkt = mkt;
+    _live_router = router;
   } else {
-    auto fx_instruments =
-        _services->ref_data_service()->get_fx_rate_instruments(_instrument);
-    auto iter = fx_instruments.begin();
-    while (iter != std::end(fx_instruments) && !_mkt_fx_instr)
-      _mkt_fx_instr = _services->market_data_service()->find_market_data(*iter);
-
-    if (!_mkt_fx_instr)
-      LOG_WARN(ticker() << ": failed to find an FX-rate instrument");
+    _mkt = mkt;
+    _order_router = router;
+  }
+
+  listen(_mkt);
+
+  // the rate of the quote currency, shared by all bots of that currency
+  _fx_rates = _services->fx_rate_service();
+  _fx_asset = _fx_rates->subscribe(_instrument);
+  if (_fx_asset == no_asset_id)
+    LOG_WARN(ticker() << ": failed to find an FX-rate instrument");
+  revalue();
+
+  if (auto* persistence = _services->persistence_service()) {
+    _journal = persistence->journal(_strategy->strategy_id());
+    if (_journal) {
+      _journal_slot = _journal->position_slot(_instrument);
+      _journal->record_position(_journal_slot, initial_position,
+                                _services->now());
+    }
   }
 
-  auto timer_interval = 1000ms;
-  _services->evloop()->dispatch(timer_interval, [=]() {
-    try {
-      this->on_timer();
-    } catch (std::runtime_error& e) {
-      LOG_ERROR("uncaught exception from Bot on_timer, " << e.what());
-      // Note, we keep the timer active by continue to return `timer_interval`
-      // below.
+  // positions changed by the fills of a batch are persisted once the bot
+  // has reacted to them
+  _batch_end_hook = event_loop().add_batch_end_hook([this]() {
+    if (!is_stopping()) {
+      APEX_PROFILE_ZONE("Bot::on_batch_end");
+      this->on_batch_end();
     }
-    return timer_interval;
+    persist_position();
   });
+
+  _strategy->add_timer_bot(this);
 }
 
+
+void Bot::handle_timer()
+{
+  try {
+    APEX_PROFILE_ZONE("Bot::on_timer");
+    this->on_timer();
+  } catch (std::runtime_error& e) {
+    // the timer remains active
+    LOG_ERROR("uncaught exception from Bot on_timer, " << e.what());
+  }
+}
+
+
+void Bot::begin_warmup(MarketData* market, OrderRouter* router)
+{
+  if (_mkt)
+    THROW(ticker() << ": warm-up must begin before the bot is initialised");
+  _warming_up = true;
+  _mkt = market;
+  _order_router = router;
+}
+
+
+void Bot::end_warmup()
+{
+  if (!_warming_up)
+    return;
+
+  unlisten(_mkt);
+  _mkt = _live_mkt;
+  _order_router = _live_router;
+  _live_mkt = nullptr;
+  _live_router = nullptr;
+  _warming_up = false;
+  listen(_mkt);
+  revalue();
+
+  LOG_INFO(ticker() << ": warm-up complete");
+  on_warmup_end();
+}
+
+
 const char* event_code(bool is_fill, OrderState o, OrderCloseReason c)
 {
   if (is_fill) {
@@ -193,18 +323,63 @@ std::shared_ptr<Order> Bot::create_order(
       _order_router, _instrument, side, size, price, tif,
       _strategy->strategy_id(), user_data, user_data_delete_fn);
 
+  auto stamp = _mkt->last_trace();
+  trace::tracer().mark(trace::Stage::order_create, stamp);
+  order->set_trace(stamp);
+
   _order_cache.add_new_order(order);
 
-  order->events().subscribe([this](OrderEvent ev) {
+  watch_order(order, _warming_up);
+  return order;
+}
+
+
+std::shared_ptr<Order> Bot::adopt_order(const StateJournal::OrderRecord& record)
+{
+  auto* router = _warming_up ? _live_router : _order_router;
+  auto order = _services->order_service()->restore(
+      router, _instrument, record, _strategy->strategy_id());
+  if (!order)
+    return order;
+
+  _order_cache.add_restored_order(order);
+  watch_order(order, false);
+  LOG_INFO(ticker() << ": restored order " << order->order_id() << " "
+                    << "side:" << order->side()
+                    << ", price:" << format_double(order->price(), true)
+                    << ", qty:" << format_double(order->size(), true)
+                    << ", qdone:" << format_double(order->filled_size(), true)
+                    << ", state:" << order->state()
+                    << ", exchId:" << order->exch_order_id());
+  return order;
+}
+
+
+/* Orders are watched from creation, or from their adoption on restart; the
+ * events of orders of a warm-up update the bot, but are not audited or
+ * logged.  The file IO an event causes, of the audit and the persisted
+ * position, is done at the end of the batch, after the bot callbacks. */
+void Bot::watch_order(const std::shared_ptr<Order>& order, bool warmup_order)
+{
+  order->events().subscribe([this, warmup_order](const OrderEvent& ev) {
     // update internal model
+    _order_cache.apply(ev);
     if (ev.is_fill()) {
       this->_position.apply_fill(ev.order->side(), ev.order->last_fill().size,
                                  ev.order->last_fill().price);
-      _services->persistence_service()->persist_instrument_positions(
-          "XYZ", ev.order->instrument(), _position.net_qty());
+      this->_fixed_position.apply_fill(ev.order->side(),
+                                       ev.order->last_fill().size,
+                                       ev.order->last_fill().price);
+      revalue();
+      _position_unpersisted = true;
+      if (!_batch_end_hook)
+        persist_position(); // not yet initialised, as during a warm-up
+      if (_journal && !warmup_order)
+        _journal->record_position(_journal_slot, _position.net_qty(),
+                                  _services->now());
     }
 
-    if (this->_strategy->auditor()) {
+    if (!warmup_order && this->_strategy->auditor()) {
       this->_strategy->auditor()->add_transaction(
         _services->now(),
         this->_strategy->strategy_id(),
@@ -219,8 +394,10 @@ std::shared_ptr<Order> Bot::create_order(
         );
     }
 
-    // logging - either it's a fill event or state event
-    if (ev.is_fill()) {
+    // logging - either it's a fill event or state event; orders of a warm-up
+    // are not logged
+    if (warmup_order) {
+    } else if (ev.is_fill()) {
       const auto& fill = ev.order->last_fill();
       LOG_INFO(
           ticker() << ": "
@@ -238,6 +415,14 @@ std::shared_ptr<Order> Bot::create_order(
                    << ccy_value("posUsd", _position.net_qty(), ev.order->price())
                    << ", exchId:" << ev.order->exch_order_id()
         );
+    } else if (ev.is_amend()) {
+      LOG_INFO(ticker() << ": "
+               << "order " << ev.order->order_id() << " AMND "
+               << "side:" << ev.order->side()
+               << ", price:" << format_double(ev.order->price(), true)
+               << ", qty:" << format_double(ev.order->size(), true)
+               << ", qdone:" << format_double(ev.order->filled_size(), true)
+               << ", exchId:" << ev.order->exch_order_id());
     } else if (ev.is_state_change()) {
       if (ev.new_state == OrderState::closed &&
           ev.order->close_reason() == OrderCloseReason::rejected) {
@@ -269,29 +454,47 @@ std::shared_ptr<Order> Bot::create_order(
     }
 
     /* invoke bot callbacks */
-    if (ev.is_fill()) {
-      this->on_order_fill(*ev.order);
-    }
-
-    if (ev.is_state_change()) {
-      switch (ev.new_state) {
-        case OrderState::none:
-        case OrderState::init:
-          break;
-        case OrderState::sent:
-          this->on_order_submitted(*ev.order);
-          break;
-        case OrderState::live:
-          this->on_order_live(*ev.order);
-          break;
-        case OrderState::closed:
-          this->on_order_closed(*ev.order);
-          break;
-      }
-    }
+    APEX_PROFILE_ZONE("Bot::on_order_event");
+    _order_callbacks(*this, ev);
   });
+}
 
-  return order;
+
+void Bot::persist_position()
+{
+  if (!_position_unpersisted)
+    return;
+  _position_unpersisted = false;
+  if (auto* persistence = _services->persistence_service())
+    persistence->persist_instrument_positions("XYZ", _instrument,
+                                              _position.net_qty());
+}
+
+
+void Bot::order_callbacks(Bot& bot, const OrderEvent& ev)
+{
+  if (ev.is_fill())
+    bot.on_order_fill(*ev.order);
+
+  if (ev.is_amend())
+    bot.on_order_amended(*ev.order);
+
+  if (ev.is_state_change()) {
+    switch (ev.new_state) {
+      case OrderState::none:
+      case OrderState::init:
+        break;
+      case OrderState::sent:
+        bot.on_order_submitted(*ev.order);
+        break;
+      case OrderState::live:
+        bot.on_order_live(*ev.order);
+        break;
+      case OrderState::closed:
+        bot.on_order_closed(*ev.order);
+        break;
+    }
+  }
 }
 
 
@@ -337,40 +540,27 @@ bool Bot::om_session_up() const
   return _order_router && _order_router->is_up();
 }
 
-bool Bot::has_fx_rate() const
-{
-  return is_fx_ccy() ||
-         (!!_mkt_fx_instr && is_finite_non_zero(_mkt_fx_instr->last().price));
-}
+bool Bot::is_stopping() { return _is_stopping; }
 
-double Bot::fx_rate() const
+void Bot::begin_stop(std::vector<std::shared_ptr<Order>>& to_cancel)
 {
-  return (is_fx_ccy()) ? 1.0 : _mkt_fx_instr->last().price;
+  if (_is_stopping)
+    return;
+  _is_stopping = true;
+
+  // open orders, then pending orders
+  for (auto& order : _order_cache.live_orders())
+    to_cancel.push_back(order);
+  for (auto& order : _order_cache.pending_orders())
+    to_cancel.push_back(order);
 }
 
-bool Bot::is_stopping() { return _is_stopping; }
-
 void Bot::stop()
 {
-  auto sleep_interval = _services->is_backtest()? 0ms: 50ms;
-
-  auto stop_on_eventloop = [this, sleep_interval]() {
-    if (!_is_stopping) {
-      _is_stopping = true;
-
-      // cancel any open orders
-      for (auto& order : _order_cache.live_orders()) {
-        if (!order->is_canceling())
-          order->cancel();
-        std::this_thread::sleep_for(sleep_interval);
-      }
-      // cancel any pending orders
-      for (auto& order : _order_cache.pending_orders()) {
-        if (!order->is_canceling())
-          order->cancel();
-        std::this_thread::sleep_for(sleep_interval);
-      }
-    }
+  auto stop_on_eventloop = [this]() {
+    std::vector<std::shared_ptr<Order>> orders;
+    begin_stop(orders);
+    Order::cancel_all(orders);
   };
 
   if (_services->evloop()->this_thread_is_ev()) {
@@ -409,6 +599,8 @@ void Bot::wait_for_stop() {
 
 EventLoop& Bot::event_loop() { return *_services->evloop(); }
 
+TaskPool& Bot::task_pool() { return *_services->task_pool(); }
+
 double Bot::last_price() const {
   return _mkt->last().price;
 }
@@ -417,6 +609,17 @@ bool Bot::has_last_price() const {
   return _mkt->has_last();
 }
 
+void Bot::revalue()
+{
+  if (has_last_price())
+    _fixed_position.mark(last_price());
+  _portfolio_entry.update(pnl_usd(), net_position_usd());
+  if (!_warming_up)
+    if (auto* auditor = _strategy->auditor())
+      auditor->mark_to_market(_services->now(), _instrument, pnl_usd(),
+                              _strategy->pnl_usd());
+}
+
 
 
 
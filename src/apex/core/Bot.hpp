@@ -20,10 +20,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Account.hpp>
 #include <apex/model/MarketData.hpp>
 #include <apex/model/Order.hpp>
+#include <apex/model/FixedPosition.hpp>
+#include <apex/model/Portfolio.hpp>
 #include <apex/model/Position.hpp>
 #include <apex/model/tick_msgs.hpp>
 #include <apex/core/Alert.hpp>
+#include <apex/core/FxRateService.hpp>
+#include <apex/core/OrderCache.hpp>
+#include <apex/core/StateJournal.hpp>
 #include <apex/util/EventLoop.hpp>
+#include <apex/util/TaskPool.hpp>
 
 #include <atomic>
 #include <memory>
@@ -39,61 +45,14 @@ class MarketData;
 class Strategy;
 class OrderRouter;
 class RealtimeEventLoop;
-
-
-// Track live and closed orders associated with a single Bot.
-class OrderCache
-{
-public:
-  [[nodiscard]] bool has_live_orders() const { return !_live_orders.empty(); }
-
-  [[nodiscard]] bool has_pending_orders() const { return !_pending_orders.empty(); }
-
-
-  void add_new_order(std::shared_ptr<apex::Order> order)
-  {
-    auto wp = order->weak_from_this();
-    _pending_orders.insert(order);
-    order->events().subscribe([this, wp](apex::OrderEvent ev) {
-      if (ev.is_state_change())
-        if (auto sp = wp.lock()) {
-          if (sp->is_live()) {
-            this->_live_orders.insert(sp);
-            this->_pending_orders.erase(sp);
-          }
-          if (sp->is_closed()) {
-            this->_live_orders.erase(sp);
-            this->_pending_orders.erase(sp);
-          }
-        }
-    });
-  }
-
-  const std::set<std::shared_ptr<apex::Order>>& live_orders()
-  {
-    return _live_orders;
-  }
-
-
-  const std::set<std::shared_ptr<apex::Order>>& pending_orders()
-  {
-    return _pending_orders;
-  }
-
-
-  size_t order_count() const { return _pending_orders.size() + _live_orders.size(); }
-
-private:
-  std::set<std::shared_ptr<apex::Order>> _pending_orders;
-  std::set<std::shared_ptr<apex::Order>> _live_orders;
-};
+template <typename> class StaticBot;
 
 
 /* This class is responsible for trading activities on a single name. */
 class Bot
 {
 public:
-  Bot(const std::string& bot_typename, Strategy*, Instrument instrument);
+  Bot(const std::string& bot_typename, Strategy*, const Instrument& instrument);
 
   virtual ~Bot();
 
@@ -125,20 +84,70 @@ public:
       void* user_data = nullptr,
       std::function<void(void*)> user_data_delete_fn = {});
 
+  /* Take over an open order of an earlier run of the strategy, found in its
+   * StateJournal on restart; its later updates from the exchange then reach
+   * the bot as for its own orders.  Returns null if the order is already
+   * known.  Done by Strategy::init_bots, after init. */
+  std::shared_ptr<Order> adopt_order(const StateJournal::OrderRecord&);
+
   /* Bot event callback handlers */
 
   virtual void on_tick_trade(MarketData::EventType) {}
   virtual void on_tick_book(MarketData::EventType) {}
+
+  /* Invoked with blocks of top of book ticks, in place of on_tick_book, by a
+   * bot that has called enable_tick_blocks. */
+  virtual void on_tick_block(const TickTopBlock&) {}
+
+  /* Invoked with each bar, as it ends, of a backtest whose market-data
+   * streams include "bars"; see BarReplayer.  Without tick streams, orders
+   * are not filled, so a bars-only backtest serves signal research. */
+  virtual void on_bar(const Bar&) {}
   virtual void on_timer() {}
   virtual void on_order_submitted(Order&) {}
   virtual void on_order_live(Order&) {}
   virtual void on_order_closed(Order&) {}
   virtual void on_order_fill(Order&) {}
 
+  // The price and size of a live order were replaced, see Order::amend.
+  virtual void on_order_amended(Order&) {}
+
+  /* Invoked once the event loop has processed a batch of events, e.g. a burst
+   * of ticks; allows quoting once per burst instead of once per tick. */
+  virtual void on_batch_end() {}
+
+  /* Invoked once a warm-up has ended, before the first live event; a bot
+   * would reset here any state learned from the synthetic ticks. */
+  virtual void on_warmup_end() {}
+
+  /* Invoked when the strategy config is replaced while running, with the
+   * part of this bot's config (see Strategy::bot_config) that changed, as a
+   * JSON merge patch; see Strategy::update_config. */
+  virtual void on_config_update(const json& /*changes*/) {}
+
+  /* Run the bot, until end_warmup, on `market`, a scratch MarketData fed with
+   * synthetic ticks, and with orders sent through `router`, which never
+   * reach an exchange; see Strategy::init_bots.  Must precede init. */
+  void begin_warmup(MarketData* market, OrderRouter* router);
+
+  /* Switch to the live market data and order router, between two events of
+   * the event thread, so that no callback sees one without the other.  The
+   * orders of the warm-up must be closed already. */
+  void end_warmup();
+
+  [[nodiscard]] bool is_warming_up() const { return _warming_up; }
+
   size_t order_count() const { return _order_cache.order_count(); }
+  size_t alert_count() const { return _alerts.size(); }
   Position& position() { return _position; }
   [[nodiscard]] const Position& position() const { return _position; }
 
+  /* The position in ticks and lots, marked at each trade. */
+  [[nodiscard]] const FixedPosition& fixed_position() const
+  {
+    return _fixed_position;
+  }
+
   // Round an order price in a passive direction.  For buy side, prices
   // are rounded downward (away from the touch); for sell side, prices are
   // rounded upward (away from the touch).
@@ -156,9 +165,19 @@ public:
 
   [[nodiscard]] bool om_session_up() const;
 
-  [[nodiscard]] bool has_fx_rate() const;
-  [[nodiscard]] double fx_rate() const;
-  [[nodiscard]] bool is_fx_ccy() const { return _mkt == _mkt_fx_instr; }
+  [[nodiscard]] bool has_fx_rate() const
+  {
+    return _fx_rates && _fx_rates->has_rate(_fx_asset);
+  }
+
+  /* Rate converting prices to the notional currency, conflated; see
+   * FxRateService.  Only valid if has_fx_rate(). */
+  [[nodiscard]] double fx_rate() const { return _fx_rates->rate(_fx_asset); }
+
+  [[nodiscard]] bool is_fx_ccy() const
+  {
+    return _fx_asset == FxRateService::notional_asset_id;
+  }
 
   double net_position_usd() const {
     return (has_last_price() && has_fx_rate())?
@@ -167,33 +186,121 @@ public:
 
   double pnl_usd() const {
     return (has_last_price() && has_fx_rate())?
-      _position.total_pnl(last_price()) * fx_rate() : apex::nan;
+      _fixed_position.total_pnl() * fx_rate() : apex::nan;
   }
 
 
   bool is_stopping();
   void stop();
+
+  /* Mark the bot as stopping, and append its open orders to `to_cancel`, so
+   * that the orders of several bots can be cancelled together; see
+   * Order::cancel_all.  Must be called on the event thread. */
+  void begin_stop(std::vector<std::shared_ptr<Order>>& to_cancel);
   void wait_for_stop();
 
   EventLoop& event_loop();
 
+  /* Run `work` on the Services task pool, and then `done` with its result on
+   * the event thread, unless the tasks of this bot have been cancelled; see
+   * TaskPool.  Use for heavy computation, such as a model refit, that would
+   * otherwise delay tick handling. */
+  template <typename W, typename D> void submit_task(W work, D done)
+  {
+    task_pool().submit(_tasks, std::move(work), std::move(done));
+  }
+
+  /* Skip the queued tasks of this bot, and discard the completions of all;
+   * done automatically when the bot is destroyed.  Subsequent submissions
+   * are also cancelled. */
+  void cancel_tasks() { _tasks.cancel(); }
+
+  TaskPool& task_pool();
+
   const std::string& bot_typename() const {return _bot_typename; }
 protected:
   std::string ccy_value(const char* field, double size, double price);
 
+  /* Receive top of book ticks in blocks, via on_tick_block, rather than one
+   * at a time, for bots that only compute signals and so can process a run
+   * of ticks at once.  Backtests then replay runs of tickbin ticks as one
+   * block, during which the market data, as seen by timers and batch-end
+   * hooks, may lag the clock until the block is delivered.  Must precede
+   * init. */
+  void enable_tick_blocks();
+
+  /* Receive the events of `mkt`; done by init, or on the scratch market
+   * data of a warm-up. */
+  void listen(MarketData* mkt);
+  void unlisten(MarketData* mkt);
+
   Services* _services;
   Strategy * _strategy;
   std::string _bot_typename;
-  Instrument _instrument;
+  const Instrument& _instrument; // interned
   std::string _ticker;
   MarketData* _mkt = nullptr;
-  MarketData* _mkt_fx_instr = nullptr;
+  FxRateService* _fx_rates = nullptr;
+  AssetId _fx_asset = no_asset_id;
   OrderRouter* _order_router = nullptr;
   Position _position;
+  FixedPosition _fixed_position;
+  Portfolio::Entry _portfolio_entry; // contribution to the strategy totals
   OrderCache _order_cache;
   AlertBoard _alerts;
 
   std::atomic<bool> _is_stopping = false;
+  size_t _batch_end_hook = 0;
+  TaskGroup _tasks;
+
+private:
+  // made by the strategy's bot timer, see Strategy::add_timer_bot
+  void handle_timer();
+  friend class Strategy;
+  template <typename> friend class StaticBot;
+
+  // invokes the virtual order callbacks
+  static void order_callbacks(Bot&, const OrderEvent&);
+
+  void watch_order(const std::shared_ptr<Order>&, bool warmup_order);
+
+  /* Persist the position, if fills have changed it since last persisted. */
+  void persist_position();
+
+  bool _warming_up = false;
+  MarketData* _live_mkt = nullptr;
+  OrderRouter* _live_router = nullptr;
+
+  // journal of the strategy, if any, and the slot of the bot's position
+  StateJournal* _journal = nullptr;
+  uint32_t _journal_slot = 0;
+
+  bool _position_unpersisted = false; // until the end of the batch
+
+  struct MarketListener : MarketData::Listener {
+    explicit MarketListener(Bot* b) : bot(b) {}
+    void on_market_event(MarketData::EventType) override;
+    Bot* bot;
+  };
+  MarketListener _market_listener{this};
+
+  struct BlockListener : MarketData::BlockListener {
+    explicit BlockListener(Bot* b) : bot(b) {}
+    void on_top_block(const TickTopBlock&) override;
+    Bot* bot;
+  };
+  BlockListener _block_listener{this};
+  bool _tick_blocks = false;
+
+  // how events reach the bot, replaced by StaticBot
+  MarketData::Listener* _listener = &_market_listener;
+  int _listen_mask = MarketData::EventType::trade | MarketData::EventType::top |
+                     MarketData::EventType::bar;
+  void (*_order_callbacks)(Bot&, const OrderEvent&) = &Bot::order_callbacks;
+
+  // mark the fixed position at the last price, and update the strategy's
+  // portfolio totals
+  void revalue();
 };
 
 } // namespace apex
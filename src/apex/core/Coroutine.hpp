@@ -0,0 +1,189 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/Logger.hpp>
+#include <apex/model/Order.hpp>
+#include <apex/util/Awaitable.hpp>
+#include <apex/util/ObjectPool.hpp>
+
+/* Coroutines need C++20, whereas the library itself is built as C++17; this
+ * header is for bots and tools compiled as C++20, and is empty otherwise. */
+#if defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <exception>
+
+namespace apex::co
+{
+
+/* Frames of coroutines are allocated from pools, by size class, since order
+ * workflows are typically started for every signal or order. */
+class FramePool
+{
+public:
+  static constexpr size_t granularity = 64;
+  static constexpr size_t max_pooled = 1024;
+
+  static void* allocate(size_t size)
+  {
+    if (size > max_pooled)
+      return ::operator new(size);
+    auto i = size_class(size);
+    return pools()[i].allocate((i + 1) * granularity);
+  }
+
+  static void deallocate(void* p, size_t size)
+  {
+    if (size > max_pooled)
+      return ::operator delete(p);
+    auto i = size_class(size);
+    pools()[i].deallocate(p, (i + 1) * granularity);
+  }
+
+private:
+  static size_t size_class(size_t size)
+  {
+    return (size + granularity - 1) / granularity - 1;
+  }
+
+  static BlockPool* pools()
+  {
+    static BlockPool pools[max_pooled / granularity];
+    return pools;
+  }
+};
+
+
+/* A coroutine that runs on the event thread, e.g. an order workflow of a bot:
+ *
+ *   co::Task Bot::enter(std::shared_ptr<Order> order)
+ *   {
+ *     order->send();
+ *     if (!co_await order->live())
+ *       co_return;
+ *     if (co_await any(order->filled(), sleep(evloop(), 5s)) == 1)
+ *       order->cancel();
+ *   }
+ *
+ * The coroutine starts at once, and runs until its first suspension.  The Task
+ * owns the coroutine: destroying the Task destroys a suspended coroutine,
+ * which stops its waits, so a bot keeps the Tasks of workflows that are to
+ * outlive the call that started them, or else detaches them.  An exception
+ * leaving the coroutine is logged and ends it. */
+class Task
+{
+public:
+  struct promise_type {
+    bool detached = false;
+
+    // the frame is kept at the end for its Task, unless detached
+    struct FinalAwait {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<promise_type> h) noexcept
+      {
+        if (h.promise().detached)
+          h.destroy();
+      }
+      void await_resume() noexcept {}
+    };
+
+    Task get_return_object()
+    {
+      return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    FinalAwait final_suspend() noexcept { return {}; }
+    void return_void() {}
+
+    void unhandled_exception()
+    {
+      try {
+        throw;
+      }
+      catch (const std::exception& e) {
+        LOG_ERROR("coroutine failed: " << e.what());
+      }
+      catch (...) {
+        LOG_ERROR("coroutine failed: unknown exception");
+      }
+    }
+
+    static void* operator new(size_t size) { return FramePool::allocate(size); }
+
+    static void operator delete(void* p, size_t size)
+    {
+      FramePool::deallocate(p, size);
+    }
+  };
+
+  Task() = default;
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  Task(Task&& other) noexcept : _handle(other._handle)
+  {
+    other._handle = nullptr;
+  }
+
+  Task& operator=(Task&& other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      _handle = other._handle;
+      other._handle = nullptr;
+    }
+    return *this;
+  }
+
+  ~Task() { reset(); }
+
+  /* Whether the coroutine has ended, or there is none. */
+  [[nodiscard]] bool done() const { return !_handle || _handle.done(); }
+
+  /* Let the coroutine run to its end without an owner. */
+  void detach()
+  {
+    if (auto h = _handle) {
+      _handle = nullptr;
+      if (h.done())
+        h.destroy();
+      else
+        h.promise().detached = true;
+    }
+  }
+
+  /* Destroy the coroutine, stopping it if still suspended. */
+  void reset()
+  {
+    if (auto h = _handle) {
+      _handle = nullptr;
+      h.destroy();
+    }
+  }
+
+private:
+  explicit Task(std::coroutine_handle<promise_type> h) : _handle(h) {}
+
+  std::coroutine_handle<promise_type> _handle;
+};
+
+} // namespace apex::co
+
+#endif
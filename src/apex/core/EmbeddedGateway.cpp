@@ -0,0 +1,312 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/EmbeddedGateway.hpp>
+#include <apex/core/Errors.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/OrderService.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/Order.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/LatencyTrace.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+
+#include <set>
+#include <utility>
+
+namespace apex
+{
+
+EmbeddedGateway::EmbeddedGateway(IoLoop& ioloop, RealtimeEventLoop& evloop,
+                                 OrderService* order_service,
+                                 const SessionFactory& factory)
+  : _event_loop(evloop),
+    _order_service(order_service)
+{
+  // the session runs on our event loop, so its events need no hand-over
+  BaseExchangeSession::EventCallbacks callbacks;
+  callbacks.on_order_fill = [this](BaseExchangeSession&, std::string order_id,
+                                   OrderFill fill) {
+    if (_order_service)
+      _order_service->route_fill_to_order(order_id, fill);
+  };
+  callbacks.on_order_cancel = [this](BaseExchangeSession&,
+                                     std::string order_id,
+                                     OrderUpdate update) {
+    if (_order_service)
+      _order_service->route_update_to_order(order_id, update);
+  };
+
+  _exchange_session = factory(std::move(callbacks), &ioloop, evloop);
+  if (!_exchange_session)
+    THROW("exchange session factory did not create a session");
+  LOG_INFO("embedded gateway for exchange "
+           << QUOTE(_exchange_session->exchange_id()));
+  _exchange_session->start();
+}
+
+
+EmbeddedGateway::~EmbeddedGateway() = default;
+
+
+void EmbeddedGateway::subscribe(const std::string& symbol, MarketData* market,
+                                int streams)
+{
+  if (streams == 0)
+    streams = static_cast<int>(MdStream::AggTrades) |
+              static_cast<int>(MdStream::L1);
+
+  auto iter = _subscriptions.find(symbol);
+  if (iter == std::end(_subscriptions))
+    iter = _subscriptions.insert({symbol, Subscription{market, 0}}).first;
+  else if (iter->second.market != market)
+    THROW("symbol " << QUOTE(symbol) << " already subscribed to another market");
+
+  auto& sub = iter->second;
+  const MdStreamParams missing{streams & ~sub.streams};
+  sub.streams |= streams;
+
+  Symbol native;
+  native.native = symbol;
+  subscription_options options(StreamType::Trades);
+  if (missing.has(MdStream::Trades) || missing.has(MdStream::AggTrades))
+    _exchange_session->subscribe_trades(
+        native, options, [market](const TickTrade& tick) { market->apply(tick); });
+  if (missing.has(MdStream::L1))
+    _exchange_session->subscribe_top(
+        native, options, [market](const TickTop& tick) { market->apply(tick); });
+  if (missing.has(MdStream::L2) || missing.has(MdStream::L3))
+    _exchange_session->subscribe_book(
+        native, options,
+        [market](const TickBookDelta& delta) { market->apply(delta); });
+}
+
+
+void EmbeddedGateway::reply(std::function<void()> fn)
+{
+  if (_in_request)
+    _event_loop.dispatch(std::move(fn));
+  else
+    fn();
+}
+
+
+BaseExchangeSession::SubmitOrderCallbacks EmbeddedGateway::order_callbacks(
+    Order& order, std::function<void(Order&, OrderUpdate)> on_reply,
+    std::function<void(Order&, std::string, std::string)> on_rejected)
+{
+  std::weak_ptr<Order> wp = order.weak_from_this();
+  std::weak_ptr<EmbeddedGateway> self = weak_from_this();
+
+  BaseExchangeSession::SubmitOrderCallbacks callbacks;
+  callbacks.on_reply = [wp, self, on_reply](OrderUpdate update) {
+    if (auto sp = self.lock())
+      sp->reply([wp, on_reply, update]() {
+        if (auto order = wp.lock())
+          on_reply(*order, update);
+      });
+  };
+  callbacks.on_rejected = [wp, self, on_rejected](std::string code,
+                                                  std::string text) {
+    if (auto sp = self.lock())
+      sp->reply([wp, on_rejected, code, text]() {
+        if (auto order = wp.lock())
+          on_rejected(*order, code, text);
+      });
+  };
+  return callbacks;
+}
+
+
+static OrderParams order_params(const Order& order, double price, double size)
+{
+  OrderParams params;
+  params.symbol = order.instrument().native_symbol();
+  params.exchange = order.instrument().exchange_id();
+  params.side = order.side();
+  params.time_in_force = order.time_in_force();
+  params.price = price;
+  params.size = size;
+  params.order_id = order.order_id();
+  return params;
+}
+
+
+void EmbeddedGateway::new_order(Order& order)
+{
+  auto stamp = order.trace();
+  trace::tracer().mark(trace::Stage::order_send, stamp);
+
+  auto callbacks = order_callbacks(
+      order, [](Order& o, OrderUpdate update) { o.apply(update); },
+      [](Order& o, std::string code, std::string text) {
+        o.set_is_rejected(code, text);
+      });
+
+  _in_request = true;
+  try {
+    _exchange_session->submit_order(
+        order_params(order, order.price(), order.size()), std::move(callbacks));
+  } catch (...) {
+    _in_request = false;
+    throw;
+  }
+  _in_request = false;
+}
+
+
+void EmbeddedGateway::cancel_order(Order& order)
+{
+  auto callbacks = order_callbacks(
+      order, [](Order& o, OrderUpdate update) { o.apply(update); },
+      [](Order& o, std::string code, std::string text) {
+        o.apply_cancel_reject(code, text);
+      });
+
+  _in_request = true;
+  try {
+    _exchange_session->cancel_order(order.instrument().native_symbol(),
+                                    order.order_id(), order.exch_order_id(),
+                                    std::move(callbacks));
+  } catch (...) {
+    _in_request = false;
+    throw;
+  }
+  _in_request = false;
+}
+
+
+void EmbeddedGateway::replace_order(Order& order)
+{
+  // As GxServer: the order sees a single outcome, a reject if the cancel
+  // failed, else the replacement's ack, or its close if the replacement was
+  // refused.
+  struct Outcome {
+    bool replied = false;
+    std::string cancel_ext_order_id;
+  };
+  auto outcome = std::make_shared<Outcome>();
+
+  auto cancel_callbacks = order_callbacks(
+      order,
+      [outcome](Order&, OrderUpdate update) {
+        outcome->cancel_ext_order_id = update.ext_order_id.str();
+      },
+      [outcome](Order& o, std::string code, std::string text) {
+        outcome->replied = true;
+        o.apply_amend_reject(code, text);
+      });
+
+  auto new_callbacks = order_callbacks(
+      order,
+      [outcome](Order& o, OrderUpdate update) {
+        if (!std::exchange(outcome->replied, true))
+          o.apply_amend(update);
+      },
+      [outcome](Order& o, std::string code, std::string text) {
+        if (std::exchange(outcome->replied, true))
+          return;
+        LOG_WARN("order " << o.order_id() << " cancelled, but its replacement "
+                 << "rejected, code: " << code << ", text: " << text);
+        OrderUpdate update;
+        update.state = OrderState::closed;
+        update.close_reason = OrderCloseReason::cancelled;
+        update.ext_order_id = outcome->cancel_ext_order_id;
+        o.apply_amend(update);
+      });
+
+  _in_request = true;
+  try {
+    _exchange_session->replace_order(
+        order.instrument().native_symbol(), order.order_id(),
+        order.exch_order_id(),
+        order_params(order, order.amend_price(), order.amend_size()),
+        std::move(cancel_callbacks), std::move(new_callbacks));
+  } catch (...) {
+    _in_request = false;
+    throw;
+  }
+  _in_request = false;
+}
+
+
+void EmbeddedGateway::cancel_orders(const std::vector<Order*>& orders,
+                                    bool all_open)
+{
+  if (!all_open) {
+    for (auto* order : orders)
+      cancel_order(*order);
+    return;
+  }
+
+  // One cancel-all per symbol, as GxServer.  Listed orders are updated from
+  // the outcome, those absent having no longer been open; other orders
+  // cancelled are routed as unsolicited cancels.
+  std::map<std::string, std::vector<std::weak_ptr<Order>>> by_symbol;
+  for (auto* order : orders)
+    by_symbol[order->instrument().native_symbol()].push_back(
+        order->weak_from_this());
+
+  std::weak_ptr<EmbeddedGateway> self = weak_from_this();
+  for (auto& [symbol, listed] : by_symbol) {
+    BaseExchangeSession::CancelAllCallbacks callbacks;
+    callbacks.on_rejected = [self, listed = listed](std::string code,
+                                                    std::string text) {
+      if (auto sp = self.lock())
+        sp->reply([listed, code, text]() {
+          for (auto& wp : listed)
+            if (auto order = wp.lock())
+              order->apply_cancel_reject(code, text);
+        });
+    };
+    callbacks.on_reply =
+        [self, listed = listed](
+            std::vector<std::pair<std::string, OrderUpdate>> cancelled) {
+          auto sp = self.lock();
+          if (!sp)
+            return;
+          sp->reply([sp, listed, cancelled = std::move(cancelled)]() mutable {
+            std::map<std::string, std::shared_ptr<Order>> pending;
+            for (auto& wp : listed)
+              if (auto order = wp.lock())
+                pending.insert({order->order_id(), order});
+            for (auto& [order_id, update] : cancelled) {
+              auto iter = pending.find(order_id);
+              if (iter != std::end(pending)) {
+                iter->second->apply(update);
+                pending.erase(iter);
+              }
+              else if (sp->_order_service)
+                sp->_order_service->route_update_to_order(order_id, update);
+            }
+            for (auto& item : pending)
+              item.second->apply_cancel_reject(error::e0103, "order not open");
+          });
+        };
+
+    _in_request = true;
+    try {
+      _exchange_session->cancel_all_orders(symbol, callbacks);
+    } catch (std::runtime_error& e) {
+      _in_request = false;
+      callbacks.on_rejected(error::e0103, e.what());
+    }
+    _in_request = false;
+  }
+}
+
+} // namespace apex
@@ -0,0 +1,108 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/gx/ExchangeSession.hpp>
+#include <apex/model/ExchangeId.hpp>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class IoLoop;
+class MarketData;
+class Order;
+class OrderService;
+class RealtimeEventLoop;
+
+/* In-process binding of an exchange session, for an engine that owns its
+ * gateway rather than connecting to a GX server, e.g. a single strategy on a
+ * colo box.  The exchange session runs on the engine's IO and event loops;
+ * its ticks are applied to the subscribed MarketData, and orders are passed
+ * to it, by direct calls, so the GX socket and message encoding are not on
+ * the tick-to-trade path.  Used on the event thread.
+ *
+ * A reply made by the exchange session within the request, as by a paper or
+ * synthetic session, is deferred to the event loop, so that the order has
+ * first become 'sent'. */
+class EmbeddedGateway : public std::enable_shared_from_this<EmbeddedGateway>
+{
+public:
+  /* Constructs the exchange session, given the callbacks by which it reports
+   * order events, and the loops it is to run on; as GxServer::SessionFactory. */
+  using SessionFactory = std::function<std::shared_ptr<BaseExchangeSession>(
+      BaseExchangeSession::EventCallbacks, IoLoop*, RealtimeEventLoop&)>;
+
+  /* Create and start the exchange session.  Fills and unsolicited cancels
+   * are routed to orders via the order service. */
+  EmbeddedGateway(IoLoop&, RealtimeEventLoop&, OrderService*,
+                  const SessionFactory&);
+  ~EmbeddedGateway();
+
+  EmbeddedGateway(const EmbeddedGateway&) = delete;
+  EmbeddedGateway& operator=(const EmbeddedGateway&) = delete;
+
+  /* Subscribe a market to the ticks of a symbol.  `streams` is the mask of
+   * MdStream wanted, zero for trades and top of book; subscribing again adds
+   * the streams not yet subscribed to. */
+  void subscribe(const std::string& symbol, MarketData*, int streams = 0);
+
+  void new_order(Order&);
+  void cancel_order(Order&);
+  void replace_order(Order&);
+
+  /* Cancel several orders; with `all_open`, every open order of the account
+   * on their symbols, in one exchange request per symbol. */
+  void cancel_orders(const std::vector<Order*>&, bool all_open);
+
+  [[nodiscard]] ExchangeId exchange_id() const
+  {
+    return _exchange_session->exchange_id();
+  }
+
+  [[nodiscard]] BaseExchangeSession& exchange_session()
+  {
+    return *_exchange_session;
+  }
+
+private:
+  struct Subscription {
+    MarketData* market;
+    int streams;
+  };
+
+  // Deliver a reply to an order, deferred if made within the request.
+  void reply(std::function<void()>);
+
+  BaseExchangeSession::SubmitOrderCallbacks order_callbacks(
+      Order&, std::function<void(Order&, OrderUpdate)> on_reply,
+      std::function<void(Order&, std::string, std::string)> on_rejected);
+
+  RealtimeEventLoop& _event_loop;
+  OrderService* _order_service;
+  std::shared_ptr<BaseExchangeSession> _exchange_session;
+  std::map<std::string, Subscription> _subscriptions;
+  bool _in_request = false;
+};
+
+} // namespace apex
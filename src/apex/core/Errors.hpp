@@ -29,6 +29,9 @@ inline const char* const e0003 = "e0003";
 // internal reject, no exchange
 inline const char* const e0001 = "e0001";
 
+// internal reject, exchange rate-limit budget exhausted
+inline const char* const e0004 = "e0004";
+
 
 // exchange new order reject
 inline const char* const e0102 = "e0102";
@@ -0,0 +1,136 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/FxRateService.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/RefDataService.hpp>
+#include <apex/core/Services.hpp>
+
+#include <cmath>
+
+namespace apex
+{
+
+/* Feeds the rate of one currency from the market data of its FX-rate
+ * instrument. */
+class FxRateService::Source : public MarketData::Listener
+{
+public:
+  Source(FxRateService* owner, AssetId id, MarketData* market)
+    : _owner(owner), _id(id), _market(market)
+  {
+    _market->add_listener(this, MarketData::EventType::top |
+                                    MarketData::EventType::trade);
+  }
+
+  ~Source() override { _market->remove_listener(this); }
+
+  void on_market_event(MarketData::EventType) override
+  {
+    _owner->on_update(_id, *_market);
+  }
+
+  // only the latest top is used, so ticks may arrive in blocks
+  [[nodiscard]] bool needs_each_top() const override { return false; }
+
+private:
+  FxRateService* _owner;
+  AssetId _id;
+  MarketData* _market;
+};
+
+
+FxRateService::FxRateService(Services* services, Config config)
+  : _services(services),
+    _interval(std::chrono::milliseconds(config.get_uint("interval_ms", 1000))),
+    _rates{1.0},
+    _updated{Time{}}
+{
+}
+
+
+FxRateService::~FxRateService() = default;
+
+
+AssetId FxRateService::subscribe(const Instrument& instrument)
+{
+  auto* ref_data = _services->ref_data_service();
+  if (ref_data->is_fx_rate_instrument(instrument))
+    return notional_asset_id;
+
+  auto iter = _ids.find(instrument.quote());
+  if (iter != std::end(_ids))
+    return iter->second;
+  if (_unavailable.count(instrument.quote()))
+    return no_asset_id;
+
+  // only the top of book of the FX-rate instrument is needed
+  for (auto& fx_instrument : ref_data->get_fx_rate_instruments(instrument)) {
+    auto* market = _services->market_data_service()->find_market_data(
+        fx_instrument, MdStreamParams{static_cast<int>(MdStream::L1)});
+    if (!market)
+      continue;
+
+    LOG_INFO("FX rate of " << instrument.quote().symbol() << " from "
+             << fx_instrument);
+    return add_source(instrument.quote(), market);
+  }
+
+  // the search of the ref-data is not repeated for each bot of the currency
+  _unavailable.insert(instrument.quote());
+  return no_asset_id;
+}
+
+
+AssetId FxRateService::add_source(const Asset& currency, MarketData* market)
+{
+  auto iter = _ids.find(currency);
+  if (iter != std::end(_ids))
+    return iter->second;
+
+  auto id = static_cast<AssetId>(_rates.size());
+  _rates.push_back(apex::nan);
+  _updated.push_back(Time{});
+  _sources.push_back(std::make_unique<Source>(this, id, market));
+  _ids.insert({currency, id});
+  on_update(id, *market);
+  return id;
+}
+
+
+void FxRateService::on_update(AssetId id, const MarketData& market)
+{
+  // a known rate is replaced at most once per interval
+  auto now = _services->now();
+  if (is_finite_non_zero(_rates[id]) && now - _updated[id] < _interval) {
+    _conflated++;
+    return;
+  }
+
+  double rate = market.mid();
+  if (!is_finite_non_zero(rate))
+    rate = market.last().price;
+  if (!is_finite_non_zero(rate))
+    return;
+
+  _rates[id] = rate;
+  _updated[id] = now;
+  _updates++;
+}
+
+} // namespace apex
@@ -0,0 +1,99 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Instrument.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Time.hpp>
+#include <apex/util/utils.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace apex
+{
+class Services;
+
+using AssetId = uint32_t;
+constexpr AssetId no_asset_id = std::numeric_limits<AssetId>::max();
+
+/* Rates converting instrument prices to the notional currency, by quote
+ * asset.  Each currency is subscribed to once, via the top of book of an
+ * FX-rate instrument, and its updates conflated to at most one per interval;
+ * the rates are held in a flat array by asset id, so that a conversion is a
+ * single load.  Config field "interval_ms" sets the interval, default 1000;
+ * zero takes every tick.  Used on the event thread. */
+class FxRateService
+{
+public:
+  /* Asset id of the notional currencies, whose rate is always one */
+  static constexpr AssetId notional_asset_id = 0;
+
+  FxRateService(Services*, Config = Config::empty_config());
+  ~FxRateService();
+
+  FxRateService(const FxRateService&) = delete;
+  FxRateService& operator=(const FxRateService&) = delete;
+
+  /* Asset id of the rate of an instrument's quote currency, subscribing to
+   * the rate if not already; no_asset_id if there is no FX-rate instrument
+   * for the currency. */
+  AssetId subscribe(const Instrument&);
+
+  /* Take the rate of a currency from the top of book, else last trade, of a
+   * market, unless the currency already has a rate; returns its asset id.
+   * The market must outlive this service. */
+  AssetId add_source(const Asset& currency, MarketData*);
+
+  /* Rate of an asset, or nan while not yet known */
+  [[nodiscard]] double rate(AssetId id) const { return _rates[id]; }
+
+  [[nodiscard]] bool has_rate(AssetId id) const
+  {
+    return id < _rates.size() && is_finite_non_zero(_rates[id]);
+  }
+
+  [[nodiscard]] std::chrono::microseconds interval() const { return _interval; }
+
+  /* Rate updates stored, and those conflated away, over all currencies */
+  [[nodiscard]] uint64_t updates() const { return _updates; }
+  [[nodiscard]] uint64_t conflated() const { return _conflated; }
+
+private:
+  class Source;
+
+  void on_update(AssetId, const MarketData&);
+
+  Services* _services;
+  std::chrono::microseconds _interval;
+  std::map<Asset, AssetId> _ids;
+  std::set<Asset> _unavailable; // currencies without an FX-rate instrument
+  std::vector<double> _rates;
+  std::vector<Time> _updated;
+  std::vector<std::unique_ptr<Source>> _sources;
+  uint64_t _updates = 0;
+  uint64_t _conflated = 0;
+};
+
+} // namespace apex
@@ -0,0 +1,102 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/GatewayFailover.hpp>
+#include <apex/comm/GxClientSession.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Metrics.hpp>
+
+#include <sstream>
+
+namespace apex
+{
+
+GatewayFailover::GatewayFailover(ExchangeId exchange,
+                                 std::shared_ptr<GxClientSession> primary,
+                                 std::shared_ptr<GxClientSession> standby)
+  : _exchange(exchange),
+    _sessions{std::move(primary), std::move(standby)}
+{
+  std::ostringstream labels;
+  labels << "{exchange=\"" << exchange << "\"}";
+  _failover_us = &metrics::registry().gauge(
+      "apex_gateway_failover_us" + labels.str(),
+      "time from the active gateway dropping to the standby taking over");
+  _failover_count = &metrics::registry().counter(
+      "apex_gateway_failovers_total" + labels.str(),
+      "switches from a dropped gateway to its standby");
+
+  _sessions[0]->set_feed_active(true);
+  _sessions[1]->set_feed_active(false);
+}
+
+
+void GatewayFailover::start()
+{
+  auto wp = weak_from_this();
+  for (size_t i = 0; i < _sessions.size(); i++)
+    _sessions[i]->connected_observable().subscribe(
+        [wp, i](const bool& is_up) {
+          if (auto sp = wp.lock())
+            sp->on_connected(i, is_up);
+        });
+}
+
+
+void GatewayFailover::on_connected(size_t index, bool is_up)
+{
+  const bool was_up = _is_up[index];
+  _is_up[index] = is_up;
+
+  if (index == _active) {
+    if (was_up && !is_up) {
+      _dropped = true;
+      _dropped_at = Time::fast_now();
+      LOG_WARN("active gateway for " << _exchange << " dropped");
+    }
+    if (!is_up && _is_up[1 - _active])
+      switch_to(1 - _active);
+  } else if (is_up && !_is_up[_active]) {
+    // the active session is down, or has not yet connected
+    switch_to(index);
+  }
+}
+
+
+void GatewayFailover::switch_to(size_t index)
+{
+  _sessions[index]->set_feed_active(true);
+  _sessions[1 - index]->set_feed_active(false);
+  _active = index;
+
+  if (_dropped) {
+    auto elapsed = Time::fast_now().as_epoch_ns() - _dropped_at.as_epoch_ns();
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed);
+    _failover_us->set(us.count());
+    _failover_count->add();
+    _failovers++;
+    _dropped = false;
+    LOG_NOTICE("gateway failover for " << _exchange << " to the "
+               << (index == 0 ? "primary" : "standby") << " in "
+               << us.count() << " us");
+  } else {
+    LOG_INFO("gateway for " << _exchange << " is now the "
+             << (index == 0 ? "primary" : "standby"));
+  }
+}
+
+} // namespace apex
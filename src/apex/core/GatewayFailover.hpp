@@ -0,0 +1,96 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/ExchangeId.hpp>
+#include <apex/util/Time.hpp>
+
+#include <array>
+#include <memory>
+
+namespace apex
+{
+
+class GxClientSession;
+
+namespace metrics
+{
+class Counter;
+class Gauge;
+} // namespace metrics
+
+
+/* A primary and a hot-standby GX session to the gateways of one exchange, see
+ * GatewayService.  Both sessions are kept connected and subscribed to the
+ * same market data, and each RealtimeOrderRouter of the exchange logs on via
+ * both; only the ticks of the active session are applied, those of the
+ * standby being dropped on receipt, and orders are sent via the active one.
+ *
+ * When the active session's connection drops, the standby becomes active at
+ * once if it is connected, else as soon as it connects.  The time from the
+ * drop being reported to the switch is published as a metric.  A session that
+ * recovers stays on standby, so the roles do not flap.  Event thread only. */
+class GatewayFailover : public std::enable_shared_from_this<GatewayFailover>
+{
+public:
+  GatewayFailover(ExchangeId, std::shared_ptr<GxClientSession> primary,
+                  std::shared_ptr<GxClientSession> standby);
+
+  GatewayFailover(const GatewayFailover&) = delete;
+  GatewayFailover& operator=(const GatewayFailover&) = delete;
+
+  /* The sessions, primary first. */
+  [[nodiscard]] const std::array<std::shared_ptr<GxClientSession>, 2>&
+  sessions() const
+  {
+    return _sessions;
+  }
+
+  /* Follow the connection state of the sessions. */
+  void start();
+
+  [[nodiscard]] size_t active_index() const { return _active; }
+  [[nodiscard]] const std::shared_ptr<GxClientSession>& active() const
+  {
+    return _sessions[_active];
+  }
+
+  [[nodiscard]] uint64_t failovers() const { return _failovers; }
+
+  /* Note the connection state of a session; called from the sessions'
+   * connected observables, and directly by tests. */
+  void on_connected(size_t index, bool is_up);
+
+private:
+  void switch_to(size_t index);
+
+  ExchangeId _exchange;
+  std::array<std::shared_ptr<GxClientSession>, 2> _sessions;
+  std::array<bool, 2> _is_up{};
+  size_t _active = 0;
+
+  // when the active session dropped, while a switch is pending
+  bool _dropped = false;
+  Time _dropped_at;
+
+  uint64_t _failovers = 0;
+  metrics::Gauge* _failover_us;
+  metrics::Counter* _failover_count;
+};
+
+} // namespace apex
@@ -18,7 +18,11 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/GatewayService.hpp>
 #include <apex/util/Config.hpp>
 #include <apex/comm/GxClientSession.hpp>
+#include <apex/core/GatewayFailover.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/gx/BinanceSession.hpp>
+#include <apex/infra/ssl.hpp>
+#include <apex/util/RawCapture.hpp>
 
 namespace apex
 {
@@ -34,21 +38,58 @@ GatewayService::GatewayService(Services* services, Config config)
   // construct all gateway sessions, based on config
   for (size_t i = 0; i < config.array_size(); i++) {
     auto gateway_config = config.array_item(i);
-    std::string node = gateway_config.get_string("host");
-    std::string port = gateway_config.get_string("port");
     auto provides = gateway_config.get_string("provides");
 
     auto provides_exchange_id = to_exchange_id(provides);
 
-    auto iter = _sessions.find(provides_exchange_id);
-    if (iter != std::end(_sessions)) {
+    if (_sessions.count(provides_exchange_id) ||
+        _embedded.count(provides_exchange_id)) {
       std::ostringstream oss;
       oss << "multiple gateways configured for exchange " << QUOTE(provides);
       throw ConfigError(oss.str());
     }
-    auto session = std::make_shared<apex::GxClientSession>(
-        *services->ioloop(), *services->realtime_evloop(), node, port,
-        services->order_service());
+
+    if (gateway_config.contains("embedded")) {
+      auto session_config = gateway_config.get_sub_config("embedded");
+      auto session_type = session_config.get_string("type");
+      if (session_type != "binance") {
+        std::ostringstream oss;
+        oss << "invalid exchange-type, " << QUOTE(session_type);
+        throw ConfigError(oss.str());
+      }
+      if (!_ssl)
+        _ssl = std::make_unique<SslContext>(SslConfig(true));
+      add_embedded_venue([this, session_config](
+                             BaseExchangeSession::EventCallbacks callbacks,
+                             IoLoop* ioloop, RealtimeEventLoop& evloop) {
+        auto config = session_config;
+        return std::make_shared<BinanceSession>(
+            std::move(callbacks), config, _services->run_mode(),
+            ioloop, evloop, _ssl.get());
+      });
+      continue;
+    }
+
+    auto session =
+        make_session(gateway_config, gateway_config.get_string("host"),
+                     gateway_config.get_string("port"));
+
+    // record the session's inbound frames, for replay by a backtest
+    if (gateway_config.contains("capture_dir"))
+      session->set_capture(std::make_shared<RawCaptureWriter>(
+          gateway_config.get_string("capture_dir")));
+
+    if (gateway_config.contains("standby")) {
+      auto standby_config = gateway_config.get_sub_config("standby");
+      auto standby =
+          make_session(gateway_config, standby_config.get_string("host"),
+                       standby_config.get_string("port"));
+      auto failover = std::make_shared<GatewayFailover>(provides_exchange_id,
+                                                        session, standby);
+      failover->start();
+      standby->start_connecting();
+      _failovers[provides_exchange_id] = std::move(failover);
+    }
 
     session->start_connecting();
     _sessions[provides_exchange_id] = std::move(session);
@@ -56,17 +97,81 @@ GatewayService::GatewayService(Services* services, Config config)
 }
 
 
+GatewayService::~GatewayService() = default;
+
+
+std::shared_ptr<GxClientSession> GatewayService::make_session(
+    Config gateway_config, const std::string& host,
+    const std::string& port)
+{
+  auto session = std::make_shared<apex::GxClientSession>(
+      *_services->ioloop(), *_services->realtime_evloop(), host, port,
+      _services->order_service());
+  session->set_binary_encoding(gateway_config.get_bool("binary", true));
+  session->set_multicast(gateway_config.get_bool("multicast", false));
+  session->set_probe_interval(
+      std::chrono::milliseconds(gateway_config.get_uint("probe_ms", 1000)));
+  GxClientSession::FeedCheckOptions feed_checks;
+  feed_checks.stale_after =
+      std::chrono::milliseconds(gateway_config.get_uint("stale_ms", 0));
+  feed_checks.drop_stale = gateway_config.get_bool("drop_stale", false);
+  session->set_feed_checks(feed_checks);
+
+  auto shm_config =
+      gateway_config.get_sub_config("shm", Config::empty_config());
+  GxClientSession::ShmOptions shm;
+  shm.enabled = shm_config.get_bool("enabled", true);
+  shm.poll = shm_config.get_bool("poll", false);
+  shm.ring_size = shm_config.get_uint("ring_kb", shm.ring_size / 1024) * 1024;
+  session->set_shm_options(shm);
+  session->set_read_buffer(parse_decode_buffer_policy(
+      gateway_config.get_sub_config("read_buffer", Config::empty_config())));
+  return session;
+}
+
+
 std::shared_ptr<GxClientSession> GatewayService::find_session(
     ExchangeId exchange)
 {
   auto iter = _sessions.find(exchange);
   if (iter != _sessions.end())
     return iter->second;
+  else if (_embedded.count(exchange))
+    return {};
   else
     return _default_session;
 }
 
 
+std::shared_ptr<GatewayFailover> GatewayService::find_failover(
+    ExchangeId exchange)
+{
+  auto iter = _failovers.find(exchange);
+  return iter != _failovers.end() ? iter->second : nullptr;
+}
+
+
+std::shared_ptr<EmbeddedGateway> GatewayService::find_embedded(
+    ExchangeId exchange)
+{
+  auto iter = _embedded.find(exchange);
+  return iter != _embedded.end() ? iter->second : nullptr;
+}
+
+
+void GatewayService::add_embedded_venue(
+    const EmbeddedGateway::SessionFactory& factory)
+{
+  auto gateway = std::make_shared<EmbeddedGateway>(
+      *_services->ioloop(), *_services->realtime_evloop(),
+      _services->order_service(), factory);
+  auto exchange = gateway->exchange_id();
+  if (_sessions.count(exchange) || _embedded.count(exchange))
+    THROW("multiple gateways for exchange " << QUOTE(exchange));
+  _embedded[exchange] = std::move(gateway);
+}
+
+
 void GatewayService::set_default_gateway(std::string port) {
   _default_session  =  std::make_shared<apex::GxClientSession>(
       *_services->ioloop(), *_services->realtime_evloop(), "127.0.0.1", port,
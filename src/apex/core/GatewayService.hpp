@@ -17,31 +17,68 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/core/EmbeddedGateway.hpp>
 #include <apex/model/ExchangeId.hpp>
 
 #include <map>
 #include <memory>
+#include <string>
 
 namespace apex
 {
 
+class GatewayFailover;
 class GxClientSession;
 class Services;
 class Config;
+class SslContext;
 
+/* Connections to the gateways providing each exchange.  A gateway is either
+ * a GX server, configured by "host" and "port", or embedded in the process,
+ * configured by "embedded", which holds the exchange session config as for
+ * a GX server's "exchanges", e.g. {"type": "binance", ...}; see
+ * EmbeddedGateway.
+ *
+ * A GX gateway may have a hot standby, configured by "standby", holding the
+ * "host" and "port" of a second GX server providing the exchange; the other
+ * session options are shared.  Both sessions are then kept connected, and
+ * the exchange's market data and orders follow the active one; see
+ * GatewayFailover. */
 class GatewayService
 {
 public:
   GatewayService(Services*, Config);
+  ~GatewayService();
+
+  /* GX session of an exchange, the primary if it has a standby. */
   std::shared_ptr<GxClientSession> find_session(ExchangeId);
 
+  /* Primary and standby sessions of an exchange, or null if it has no
+   * standby. */
+  std::shared_ptr<GatewayFailover> find_failover(ExchangeId);
+
+  /* Embedded gateway of an exchange, or null if it has none; an exchange
+   * with an embedded gateway has no GX session. */
+  std::shared_ptr<EmbeddedGateway> find_embedded(ExchangeId);
+
+  /* Add an embedded gateway with a session of any type, such as a synthetic
+   * exchange used for testing; it serves the exchange id the session
+   * reports. */
+  void add_embedded_venue(const EmbeddedGateway::SessionFactory&);
+
   void set_default_gateway(std::string port);
   void set_default_gateway(int port);
 
 private:
+  std::shared_ptr<GxClientSession> make_session(Config, const std::string& host,
+                                                const std::string& port);
+
   Services* _services;
   std::map<ExchangeId, std::shared_ptr<GxClientSession>> _sessions;
+  std::map<ExchangeId, std::shared_ptr<GatewayFailover>> _failovers;
   std::shared_ptr<GxClientSession> _default_session;
+  std::map<ExchangeId, std::shared_ptr<EmbeddedGateway>> _embedded;
+  std::unique_ptr<SslContext> _ssl;
 };
 
 } // namespace apex
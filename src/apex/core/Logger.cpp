@@ -16,10 +16,17 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/core/Logger.hpp>
+#include <apex/core/BinaryLog.hpp>
+#include <apex/util/CpuDispatch.hpp>
+#include <apex/util/MemoryAccount.hpp>
 #include <apex/util/platform.hpp>
 #include <apex/util/utils.hpp>
 #include <apex/util/Config.hpp>
+#include <apex/util/MpscQueue.hpp>
+#include <apex/util/Profiler.hpp>
 
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iostream>
 
@@ -29,6 +36,43 @@ namespace apex
 
 static const size_t thread_width = 18;
 
+static thread_local std::function<Time(void)> t_clock_fn;
+static thread_local std::shared_ptr<LogContext> t_context;
+
+
+struct Logger::Record {
+  Time time;
+  Logger::level lvl = Logger::level::info;
+  const char* file = "";
+  int line = 0;
+  int tid = 0;
+  std::string msg;
+};
+
+
+/* Ring of one logging thread; only that thread pushes, and only the writer
+ * thread pops. */
+class Logger::Ring : public MpscQueue<Logger::Record>
+{
+public:
+  explicit Ring(size_t capacity)
+    : MpscQueue<Logger::Record>(capacity), _charge(logger_memory())
+  {
+    _charge.set(this->capacity() * sizeof(Logger::Record));
+  }
+
+private:
+  static memory::Account& logger_memory()
+  {
+    static memory::Account account("logger");
+    return account;
+  }
+
+  memory::Charge _charge;
+};
+
+static std::atomic<uint64_t> g_async_session{0};
+
 static std::string format_threadid(int tid_int, const std::string& tname)
 {
   std::array<char, thread_width + 1> buf; // +1 for null
@@ -82,7 +126,12 @@ std::vector<std::string> create_banner() {
 Logger::Logger() : m_mask(mask_level_and_above(level::info)) {}
 
 /* Destructor */
-Logger::~Logger() {}
+Logger::~Logger()
+{
+  stop_async();
+  if (_binary)
+    _binary->flush();
+}
 
 int Logger::mask_level_and_above(level lvl)
 {
@@ -112,12 +161,25 @@ void Logger::log_banner(RunMode mode) {
       break;
   }
   if (!_banner_done) {
+    // the SIMD kernels linked in have been selected as the program loaded
+    std::ostringstream kernels;
+    for (auto& selection : kernel_selections())
+      kernels << (kernels.tellp() ? ", " : "") << selection.kernel << "="
+              << to_string(selection.isa);
+
     auto banner = create_banner();
     for (size_t i = 1; i < banner.size(); i++){
       std::cout << banner[i];
       if (i == 2) {
         std::cout << "   mode: " << mode_name;
       }
+      if (i == 3) {
+        std::cout << "   cpu: " << to_string(dispatch_isa()) << " ("
+                  << cpu_features() << ")";
+      }
+      if (i == 4 && kernels.tellp()) {
+        std::cout << "   kernels: " << kernels.str();
+      }
       std::cout << "\n";
     }
     _banner_done = true;
@@ -126,14 +188,62 @@ void Logger::log_banner(RunMode mode) {
 
 void Logger::write(Logger::level lvl, std::string msg, const char* file, int l)
 {
+  auto* context = t_context.get();
+
+  Record rec;
+  if (context)
+    rec.time = context->now();
+  else
+    rec.time = t_clock_fn? t_clock_fn() : (_clock_fn? _clock_fn() : Time::realtime_now());
+  rec.lvl = lvl;
+  rec.file = file;
+  rec.line = l;
+  rec.tid = apex::thread_id();
+  rec.msg = std::move(msg);
+
+  if (context && context->has_sink()) {
+    context->write(rec.time, rec.lvl, rec.tid, rec.msg, rec.file, rec.line,
+                   _detailed_logging);
+    return;
+  }
+
+  if (is_async()) {
+    auto& ring = thread_ring();
+    while (!ring.try_push(std::move(rec)))
+      std::this_thread::yield(); // full; wait for the writer to catch up
+    return;
+  }
+
   auto guard = std::scoped_lock(m_write_mutex);
-  auto parts = split(file, '/');    // TODO: keep empty tokens?
-  auto filename = *parts.rbegin();
-  auto const tid = apex::thread_id();
+  format(rec);
+}
+
+
+void Logger::format(const Record& rec)
+{
+  if (_binary) {
+    _binary->write_entry(rec.lvl, rec.time, rec.file, rec.line, rec.tid,
+                         rec.msg);
+    return;
+  }
+
+  std::string_view label;
+  if (_detailed_logging) {
+    auto guard2 = std::scoped_lock(m_thread_ids_mutex);
+    auto iter = m_thread_ids.find(rec.tid);
+    if (iter == std::end(m_thread_ids))
+      iter = m_thread_ids.emplace(rec.tid, format_threadid(rec.tid, "????")).first;
+    label = iter->second; // map entries are never removed
+  }
+  render_line(std::cout, rec.time, rec.lvl, rec.tid, label, rec.msg, rec.file,
+              rec.line, _detailed_logging);
+}
 
-  std::string timestamp;
 
-  Time t = _clock_fn? _clock_fn() : Time::realtime_now();
+void Logger::render_line(std::ostream& os, Time t, level lvl, int tid,
+                         std::string_view thread_label, std::string_view msg,
+                         std::string_view file, int line, bool detailed)
+{
   auto tm = t.tm_utc();
   auto usec = t.usec();
   char buf[32] = {0};
@@ -145,25 +255,127 @@ void Logger::write(Logger::level lvl, std::string msg, const char* file, int l)
            tm.tm_min,
            tm.tm_sec,
            usec.count());
-  std::cout << buf << "";
+  os << buf;
 
-  // _detailed_logging = false;
-  if (_detailed_logging) {
-    auto guard2 = std::scoped_lock(m_thread_ids_mutex);
-    auto iter = m_thread_ids.find(tid);
-    if (iter == std::end(m_thread_ids)) {
-      auto label = format_threadid(tid, "????");
-      std::cout << " " << label;
-      m_thread_ids[tid] = std::move(label);
-    } else {
-      std::cout << " " << iter->second;
+  if (detailed) {
+    if (thread_label.empty())
+      os << " " << format_threadid(tid, "????");
+    else
+      os << " " << thread_label;
+  }
+
+  os << " " << level_str(lvl) << msg;
+  if (detailed) {
+    auto slash = file.rfind('/');
+    auto filename = slash == std::string_view::npos ? file : file.substr(slash + 1);
+    os << " (" << filename << ":" << line << ")";
+  }
+  os << "\n";
+}
+
+
+Logger::Ring& Logger::thread_ring()
+{
+  // ring of the calling thread, tagged with the async session it belongs
+  // to, so that a restart with start_async() gives each thread a fresh ring
+  struct ThreadRing {
+    uint64_t session = 0;
+    std::shared_ptr<Ring> ring;
+  };
+  static thread_local ThreadRing t_ring;
+
+  auto session = g_async_session.load(std::memory_order_acquire);
+  if (t_ring.session != session || !t_ring.ring) {
+    t_ring.ring = std::make_shared<Ring>(_ring_capacity);
+    t_ring.session = session;
+    auto guard = std::scoped_lock(m_rings_mutex);
+    _rings.push_back(t_ring.ring);
+  }
+  return *t_ring.ring;
+}
+
+
+// Write out whatever is queued, returning false if there was nothing.  Rings
+// are popped and written while holding m_rings_mutex, so flush() can tell
+// from empty rings that everything logged has reached the stream.
+bool Logger::drain_rings()
+{
+  auto guard = std::scoped_lock(m_rings_mutex);
+  auto write_guard = std::scoped_lock(m_write_mutex);
+  bool any = false;
+  Record rec;
+  for (auto iter = _rings.begin(); iter != _rings.end();) {
+    while ((*iter)->try_pop(rec)) {
+      format(rec);
+      any = true;
     }
+    // the thread that owned this ring has exited
+    if (iter->use_count() == 1 && (*iter)->empty())
+      iter = _rings.erase(iter);
+    else
+      ++iter;
   }
+  if (any)
+    std::cout.flush();
+  return any;
+}
+
 
-  std::cout << " " << level_str(lvl) << msg;
-  if (_detailed_logging)
-    std::cout << " (" << filename << ":" << l << ")";
-  std::cout << "\n";
+void Logger::writer_loop()
+{
+  while (!_writer_stop.load(std::memory_order_acquire)) {
+    if (!drain_rings())
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+  drain_rings();
+}
+
+
+void Logger::start_async(size_t ring_capacity)
+{
+  if (is_async())
+    return;
+  _ring_capacity = ring_capacity;
+  g_async_session.fetch_add(1, std::memory_order_acq_rel);
+  _writer_stop = false;
+  _writer = std::thread([this]() { writer_loop(); });
+  _async.store(true, std::memory_order_release);
+}
+
+
+void Logger::stop_async()
+{
+  if (!is_async())
+    return;
+  _async.store(false, std::memory_order_release);
+  _writer_stop.store(true, std::memory_order_release);
+  if (_writer.joinable())
+    _writer.join();
+  drain_rings(); // anything pushed while the writer was exiting
+  auto guard = std::scoped_lock(m_rings_mutex);
+  _rings.clear();
+}
+
+
+void Logger::flush()
+{
+  if (is_async()) {
+    while (true) {
+      {
+        auto guard = std::scoped_lock(m_rings_mutex);
+        bool empty = true;
+        for (auto& ring : _rings)
+          empty = empty && ring->empty();
+        if (empty)
+          break;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+  }
+  auto guard = std::scoped_lock(m_write_mutex);
+  if (_binary)
+    _binary->flush();
+  std::cout.flush();
 }
 
 
@@ -176,9 +388,34 @@ Logger& Logger::instance()
 
 void Logger::register_thread_id(std::string label)
 {
+  auto write_guard = std::scoped_lock(m_write_mutex);
   auto guard = std::scoped_lock(m_thread_ids_mutex);
   auto tid = apex::thread_id();
-  m_thread_ids[tid] = format_threadid(tid, label);
+  auto& formatted = m_thread_ids[tid] = format_threadid(tid, label);
+  if (_binary)
+    _binary->write_thread(tid, formatted);
+  profile::profiler().set_thread_name(std::move(label));
+}
+
+
+void Logger::start_binary(const std::string& path)
+{
+  auto writer = std::make_unique<BinaryLogWriter>(path);
+  auto guard = std::scoped_lock(m_write_mutex);
+  {
+    auto guard2 = std::scoped_lock(m_thread_ids_mutex);
+    for (auto& [tid, label] : m_thread_ids)
+      writer->write_thread(tid, label);
+  }
+  _binary = std::move(writer);
+}
+
+
+void Logger::stop_binary()
+{
+  flush();
+  auto guard = std::scoped_lock(m_write_mutex);
+  _binary.reset();
 }
 
 void Logger::set_clock_source(std::function<Time(void)> fn)
@@ -187,6 +424,67 @@ void Logger::set_clock_source(std::function<Time(void)> fn)
 }
 
 
+void Logger::set_thread_clock_source(std::function<Time(void)> fn)
+{
+  t_clock_fn = std::move(fn);
+}
+
+
+void Logger::set_thread_context(std::shared_ptr<LogContext> context)
+{
+  t_context = std::move(context);
+}
+
+
+const std::shared_ptr<LogContext>& Logger::thread_context()
+{
+  return t_context;
+}
+
+
+LogContext::LogContext(std::function<Time(void)> clock,
+                       std::unique_ptr<std::ostream> sink)
+  : _clock(std::move(clock)),
+    _sink(std::move(sink))
+{
+}
+
+
+LogContext::~LogContext() { flush(); }
+
+
+std::shared_ptr<LogContext> LogContext::to_file(std::function<Time(void)> clock,
+                                                const std::string& path)
+{
+  std::error_code err;
+  auto parent = std::filesystem::path(path).parent_path();
+  if (!parent.empty())
+    std::filesystem::create_directories(parent, err);
+  auto os = std::make_unique<std::ofstream>(path, std::ofstream::out |
+                                                      std::ofstream::trunc);
+  if (!*os)
+    throw std::runtime_error("cannot open log file '" + path + "'");
+  return std::make_shared<LogContext>(std::move(clock), std::move(os));
+}
+
+
+void LogContext::write(Time t, Logger::level lvl, int tid,
+                       std::string_view msg, const char* file, int line,
+                       bool detailed)
+{
+  auto guard = std::scoped_lock(_mutex);
+  Logger::render_line(*_sink, t, lvl, tid, {}, msg, file, line, detailed);
+}
+
+
+void LogContext::flush()
+{
+  auto guard = std::scoped_lock(_mutex);
+  if (_sink)
+    _sink->flush();
+}
+
+
 Logger::level Logger::string_to_level(const std::string& s)
 {
   if (s == "debug")
@@ -207,9 +505,15 @@ Logger::level Logger::string_to_level(const std::string& s)
 void Logger::configure_from_config(Config config) {
   auto level_str = config.get_string("level", "info");
   auto detailed_logging = config.get_bool("detailed", false);
+  auto async = config.get_bool("async", false);
   auto level = apex::Logger::string_to_level(level_str);
   apex::Logger::instance().set_level(level);
   apex::Logger::instance().set_detail(detailed_logging);
+  if (config.contains("binary_file"))
+    apex::Logger::instance().start_binary(config.get_string("binary_file"));
+  if (async)
+    apex::Logger::instance().start_async(
+        config.get_uint("async_ring_size", 4096));
   apex::Logger::instance().set_is_configured(true); // mark as ready
 }
 
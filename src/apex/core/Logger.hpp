@@ -20,16 +20,25 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/Time.hpp>
 #include <apex/util/utils.hpp>
 
+#include <atomic>
+#include <charconv>
 #include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
 
 
 namespace apex
 {
+class BinaryLogWriter;
 class Config;
+class LogContext;
 
 class Logger
 {
@@ -75,19 +84,72 @@ public:
 
   void set_clock_source(std::function<Time(void)>);
 
+  /* Clock source used only for messages logged by the calling thread; takes
+   * precedence over the global clock source.  Pass an empty function to
+   * clear. */
+  static void set_thread_clock_source(std::function<Time(void)>);
+
+  /* Logging context used for messages logged by the calling thread, see
+   * LogContext; takes precedence over the thread and global clock sources.
+   * Pass null to clear. */
+  static void set_thread_context(std::shared_ptr<LogContext>);
+
+  static const std::shared_ptr<LogContext>& thread_context();
+
   static Logger& instance();
 
   static void configure_from_config(Config);
 
   void write(Logger::level, std::string, const char* file, int l);
 
+  /* Switch to asynchronous output.  Each logging thread then only captures
+   * the timestamp, level, source site and rendered message into a
+   * lock-free ring of its own, of `ring_capacity` entries; a background
+   * thread formats and writes them.  Output of a single thread stays in
+   * order; lines of different threads may interleave differently than in
+   * synchronous mode.  A thread whose ring is full waits for space, so no
+   * lines are lost. */
+  void start_async(size_t ring_capacity = 4096);
+
+  /* Write out everything pending and return to synchronous output.  Must be
+   * called before fork(), since the writer thread is not inherited. */
+  void stop_async();
+
+  bool is_async() const { return _async.load(std::memory_order_acquire); }
+
+  /* Block until all lines logged so far have been written. */
+  void flush();
+
+  /* Write log records to `path` in the binary log format (see BinaryLog.hpp)
+   * instead of as text to stdout.  Messages are still rendered by the
+   * caller, but the timestamp, level and source are written as compact
+   * fields, and the source file of each site once only.  Works with both
+   * the synchronous and the asynchronous backends. */
+  void start_binary(const std::string& path);
+
+  /* Flush and close the binary log, and return to text output. */
+  void stop_binary();
+
+  /* Render one log line, as written in text mode. */
+  static void render_line(std::ostream&, Time, level, int tid,
+                          std::string_view thread_label, std::string_view msg,
+                          std::string_view file, int line, bool detailed);
+
   void register_thread_id(std::string);
 
   void log_banner(RunMode);
 
 private:
+  struct Record;
+  class Ring;
+
   Logger();
 
+  void format(const Record&);
+  Ring& thread_ring();
+  bool drain_rings();
+  void writer_loop();
+
   Logger(const Logger&) = delete;
 
   Logger& operator=(const Logger&) = delete;
@@ -105,23 +167,155 @@ private:
   bool _detailed_logging = false;
   bool _is_configured = true;
   bool _banner_done = false;
+
+  std::atomic<bool> _async{false};
+  std::atomic<bool> _writer_stop{false};
+  size_t _ring_capacity = 0;
+  std::mutex m_rings_mutex;
+  std::vector<std::shared_ptr<Ring>> _rings;
+  std::thread _writer;
+
+  std::unique_ptr<BinaryLogWriter> _binary;
+};
+
+
+/* Logging context of one of several Services sharing a process, e.g. the runs
+ * of a backtest sweep, selected per thread with Logger::set_thread_context.
+ * Messages logged by a thread with a context are timestamped by its clock,
+ * and, if it has a sink, are written there as text, synchronously and under
+ * the context's own lock, so that instances neither share timestamps nor
+ * contend on the process-wide output.  The level mask and detail setting
+ * remain those of the Logger. */
+class LogContext
+{
+public:
+  explicit LogContext(std::function<Time(void)> clock,
+                      std::unique_ptr<std::ostream> sink = nullptr);
+  ~LogContext();
+
+  /* Context writing to a file, truncated on open. */
+  static std::shared_ptr<LogContext> to_file(std::function<Time(void)> clock,
+                                             const std::string& path);
+
+  Time now() const { return _clock ? _clock() : Time::realtime_now(); }
+
+  bool has_sink() const { return _sink != nullptr; }
+
+  void write(Time, Logger::level, int tid, std::string_view msg,
+             const char* file, int line, bool detailed);
+
+  void flush();
+
+private:
+  std::function<Time(void)> _clock;
+  std::unique_ptr<std::ostream> _sink;
+  std::mutex _mutex;
+};
+
+
+/* Message builder used by the LOG_* macros.  Strings, characters, integers and
+ * floating point values are appended directly, the latter with std::to_chars
+ * in the same form as the default ostream output, so that a typical log
+ * statement avoids constructing an ostringstream and its locale.  Other types,
+ * and stream manipulators, fall back to an ostringstream; once created it takes
+ * all further output, so manipulator state applies as it would on a stream. */
+class LogLine
+{
+public:
+  template <typename T> LogLine& operator<<(const T& v)
+  {
+    if (_os) {
+      *_os << v;
+    } else if constexpr (std::is_same_v<T, char> ||
+                         std::is_same_v<T, signed char> ||
+                         std::is_same_v<T, unsigned char>) {
+      _buf.push_back(static_cast<char>(v));
+    } else if constexpr (std::is_same_v<T, bool>) {
+      _buf.push_back(v ? '1' : '0');
+    } else if constexpr (std::is_integral_v<T>) {
+      append_chars(v);
+    } else if constexpr (std::is_floating_point_v<T>) {
+      append_chars(v, std::chars_format::general, 6);
+    } else if constexpr (std::is_convertible_v<const T&, std::string_view> &&
+                         !std::is_pointer_v<T>) {
+      _buf.append(std::string_view(v));
+    } else if constexpr (std::is_same_v<T, const char*> ||
+                         std::is_same_v<T, char*>) {
+      if (v)
+        _buf.append(v);
+    } else {
+      stream() << v;
+    }
+    return *this;
+  }
+
+  LogLine& operator<<(std::ostream& (*manip)(std::ostream&))
+  {
+    stream() << manip;
+    return *this;
+  }
+
+  LogLine& operator<<(std::ios_base& (*manip)(std::ios_base&))
+  {
+    stream() << manip;
+    return *this;
+  }
+
+  std::string str() &&
+  {
+    if (_os)
+      _buf.append(_os->str());
+    return std::move(_buf);
+  }
+
+private:
+  template <typename... A> void append_chars(A... args)
+  {
+    char tmp[32];
+    auto result = std::to_chars(tmp, tmp + sizeof(tmp), args...);
+    _buf.append(tmp, result.ptr);
+  }
+
+  std::ostream& stream()
+  {
+    if (!_os)
+      _os = std::make_unique<std::ostringstream>();
+    return *_os;
+  }
+
+  std::string _buf;
+  std::unique_ptr<std::ostringstream> _os;
 };
 
 
+/* Lowest level compiled into the LOG_* macros; statements below it are
+ * discarded at compile time, leaving neither the level test nor their
+ * formatting code.  Set to one of debug, info, note, warn or error, e.g. with
+ * -DAPEX_LOG_MIN_LEVEL=info for a release build. */
+#ifndef APEX_LOG_MIN_LEVEL
+#define APEX_LOG_MIN_LEVEL debug
+#endif
+
+#define _APEX_LOG_COMPILED_(LEVEL)                                      \
+  ((LEVEL) >= apex::Logger::level::APEX_LOG_MIN_LEVEL)
+
 #define _APEX_LOGIMPL_(msg, LEVEL)                                      \
   do {                                                                  \
-    apex::Logger& logger = apex::Logger::instance();                    \
-    if (logger.wants_level(LEVEL)) {                                    \
-      std::ostringstream _s;                                            \
-      _s << msg;                                                        \
-      logger.write(LEVEL, _s.str(), __FILE__, __LINE__);                \
+    if constexpr (_APEX_LOG_COMPILED_(LEVEL)) {                         \
+      apex::Logger& logger = apex::Logger::instance();                  \
+      if (logger.wants_level(LEVEL)) {                                  \
+        apex::LogLine _s;                                               \
+        _s << msg;                                                      \
+        logger.write(LEVEL, std::move(_s).str(), __FILE__, __LINE__);   \
+      }                                                                 \
     }} while (0)
 
 
 
 #define LOG_DEBUG(X) _APEX_LOGIMPL_(X, apex::Logger::level::debug)
 
-#define LOG_TRACE(X) _APEX_LOGIMPL_(X, apex::Logger::level::trace)
+// there is no level finer than debug, so trace output is debug output
+#define LOG_TRACE(X) _APEX_LOGIMPL_(X, apex::Logger::level::debug)
 
 #define LOG_INFO(X) _APEX_LOGIMPL_(X, apex::Logger::level::info)
 
@@ -131,7 +325,8 @@ private:
 
 #define LOG_ERROR(X) _APEX_LOGIMPL_(X, apex::Logger::level::error)
 
-#define LOG_LEVEL_ENABLED(LEVEL) (Logger::instance().wants_level(LEVEL))
+#define LOG_LEVEL_ENABLED(LEVEL)                                        \
+  (_APEX_LOG_COMPILED_(LEVEL) && apex::Logger::instance().wants_level(LEVEL))
 
 #ifndef QUOTE
 #define QUOTE(X) "'" << X << "'"
@@ -16,6 +16,8 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/comm/GxClientSession.hpp>
+#include <apex/core/EmbeddedGateway.hpp>
+#include <apex/core/GatewayFailover.hpp>
 #include <apex/core/GatewayService.hpp>
 #include <apex/core/MarketDataService.hpp>
 #include <apex/core/RefDataService.hpp>
@@ -27,48 +29,171 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 namespace apex
 {
 
-MarketDataService::MarketDataService(Services* services) :
+/* Parse a list of stream names into a stream mask */
+static MdStreamParams parse_streams(const json& raw, const std::string& what)
+{
+  if (!raw.is_array())
+    throw ConfigError("market-data streams of " + what + " must be a list");
+
+  MdStreamParams streams;
+  for (auto& item : raw) {
+    if (!item.is_string())
+      throw ConfigError("market-data streams of " + what +
+                        " must be stream names");
+    try {
+      streams.mask |= static_cast<int>(parse_md_stream(item.get<std::string>()));
+    } catch (std::runtime_error& e) {
+      throw ConfigError(std::string(e.what()) + " for " + what);
+    }
+  }
+  return streams;
+}
+
+
+MarketDataService::MarketDataService(Services* services, Config config) :
   _services(services)
 {
+  _default_streams.mask = static_cast<int>(MdStream::AggTrades) |
+                          static_cast<int>(MdStream::L1);
+
+  const auto& raw = config.raw();
+  if (!raw.is_object())
+    return;
+
+  if (raw.contains("streams"))
+    _default_streams = parse_streams(raw["streams"], "market_data");
+
+  auto instruments = config.get_sub_config("instruments", Config::empty_config());
+  for (auto& [id, value] : instruments.raw().items()) {
+    if (!value.is_object() || !value.contains("streams"))
+      throw ConfigError("market-data config of instrument '" + id +
+                        "' must be an object with a streams list");
+    _instrument_streams.insert({id, parse_streams(value["streams"], id)});
+  }
 }
 
 
 MarketDataService::~MarketDataService() {}
 
 
+MdStreamParams MarketDataService::configured_streams(
+    const Instrument& instrument, MdStreamParams fallback) const
+{
+  auto iter = _instrument_streams.find(instrument.id());
+  return iter == std::end(_instrument_streams) ? fallback : iter->second;
+}
+
+
+MdStreamParams MarketDataService::subscribed_streams(const Instrument& instrument)
+{
+  auto* existing = _markets.find(instrument);
+  return existing ? existing->streams : MdStreamParams{};
+}
+
+
 MarketData* MarketDataService::find_market_data(const Instrument& instrument)
 {
-  auto iter = _markets.find(instrument);
-  if (iter != std::end(_markets))
-    return iter->second.get();
+  return find_market_data(instrument, _default_streams);
+}
 
-  // TODO: when creating the market-data object, need to decide on the stream
-  // configuration.
-  MdStreamParams stream_params;
-  stream_params.mask |= static_cast<int>(MdStream::AggTrades);
-  stream_params.mask |= static_cast<int>(MdStream::L1);
+
+MarketData* MarketDataService::find_market_data(const Instrument& instrument,
+                                                MdStreamParams streams)
+{
+  streams = configured_streams(instrument, streams);
+
+  if (auto* existing = _markets.find(instrument)) {
+    // only the streams not yet subscribed to are added
+    MdStreamParams missing{streams.mask & ~existing->streams.mask};
+    if (missing.mask && subscribe(instrument, existing->market.get(), missing))
+      existing->streams.mask |= missing.mask;
+    return existing->market.get();
+  }
 
   auto mkt = std::make_unique<MarketData>();
   MarketData* mv = mkt.get();
 
-  if (_services->is_backtest()) {
-    auto backtest_svc = _services->backtest_service();
-    backtest_svc->subscribe_canned_data(instrument, mkt.get(), stream_params);
+  if (!subscribe(instrument, mv, streams))
+    return {};
+
+  _markets.insert(instrument, Entry{std::move(mkt), streams});
+  return mv;
+}
+
+
+void MarketDataService::subscribe_all(
+    const std::vector<const Instrument*>& instruments)
+{
+  if (_services->is_backtest())
+    return;
+
+  using Subscription = GxClientSession::MarketViewSubscription;
+  std::map<std::shared_ptr<GxClientSession>, std::vector<Subscription>>
+      requests;
+
+  for (auto* instrument : instruments) {
+    if (_markets.find(*instrument))
+      continue;
+
+    auto* gateway = _services->gateway_service();
+    auto session = gateway->find_session(instrument->exchange_id());
+    if (!session || gateway->find_embedded(instrument->exchange_id())) {
+      find_market_data(*instrument);
+      continue;
+    }
+
+    auto streams = configured_streams(*instrument, _default_streams);
+    auto mkt = std::make_unique<MarketData>();
+    Subscription sub{instrument->native_symbol(), instrument->exchange_id(),
+                     mkt.get(), streams.mask};
+    requests[session].push_back(sub);
+    if (auto failover = gateway->find_failover(instrument->exchange_id()))
+      requests[failover->sessions()[1]].push_back(sub);
+    _markets.insert(*instrument, Entry{std::move(mkt), streams});
   }
-  else {
-    auto session = _services->gateway_service()->find_session(instrument.exchange_id());
 
-    if (!session)
-      return {};
+  for (auto& [session, subs] : requests) {
+    LOG_INFO("subscribing to market data for " << subs.size()
+             << " instruments together");
+    session->subscribe(std::move(subs));
+  }
+}
 
-    LOG_INFO("subscribing to market data for " << instrument
-             << " (object: "<< mv<< ")");
-    session->subscribe(instrument.native_symbol(), instrument.exchange_id(), mv);
+
+bool MarketDataService::subscribe(const Instrument& instrument, MarketData* mv,
+                                  MdStreamParams streams)
+{
+  if (_services->is_backtest()) {
+    auto backtest_svc = _services->backtest_service();
+    backtest_svc->subscribe_canned_data(instrument, mv, streams);
+    return true;
   }
 
+  if (auto embedded = _services->gateway_service()->find_embedded(
+          instrument.exchange_id())) {
+    LOG_INFO("subscribing to embedded market data for " << instrument
+             << " (object: " << mv << ", streams: " << streams.mask << ")");
+    embedded->subscribe(instrument.native_symbol(), mv, streams.mask);
+    return true;
+  }
 
-  _markets.insert({instrument, std::move(mkt)});
-  return mv;
+  auto session = _services->gateway_service()->find_session(instrument.exchange_id());
+  if (!session)
+    return false;
+
+  LOG_INFO("subscribing to market data for " << instrument
+           << " (object: "<< mv<< ", streams: " << streams.mask << ")");
+  session->subscribe(instrument.native_symbol(), instrument.exchange_id(), mv,
+                     streams.mask);
+
+  // the standby gateway's subscription is made alike, so that its ticks are
+  // flowing when it takes over
+  if (auto failover = _services->gateway_service()->find_failover(
+          instrument.exchange_id()))
+    failover->sessions()[1]->subscribe(instrument.native_symbol(),
+                                       instrument.exchange_id(), mv,
+                                       streams.mask);
+  return true;
 }
 
 } // namespace apex
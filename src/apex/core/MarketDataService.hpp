@@ -17,29 +17,72 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Config.hpp>
+
 #include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace apex
 {
 
 class Services;
-class Instrument;
-class MarketData;
 
+/* Config field "streams" lists the streams subscribed to for an instrument,
+ * default ["aggtrades", "l1"], and "instruments" maps an instrument id to an
+ * object with a "streams" list of its own, eg:
+ *
+ *   "market_data": {"instruments": {"EURUSDT.BINANCE": {"streams": ["l1"]}}}
+ */
 class MarketDataService
 {
 public:
-  explicit MarketDataService(Services*);
+  MarketDataService(Services*, Config = Config::empty_config());
   ~MarketDataService();
 
   /* Find/create a MarketData instance for instrument, or else null if the
-   * MarketData cannot be created (eg due to no suitable session). */
+   * MarketData cannot be created (eg due to no suitable session).  The
+   * streams are those configured for the instrument. */
   MarketData* find_market_data(const Instrument&);
 
+  /* As above, but subscribing to the given streams, unless the instrument
+   * has streams of its own in config.  Streams missing from an existing
+   * MarketData are subscribed to in addition. */
+  MarketData* find_market_data(const Instrument&, MdStreamParams);
+
+  /* Create the MarketData of many instruments at once, with their configured
+   * streams, e.g. for all the bots of a strategy before they are initialised,
+   * which then find them already subscribed.  The subscriptions to each
+   * gateway are handed to its session together, to be sent in as few batch
+   * requests as fit.  Backtests subscribe as find_market_data is called, so
+   * that the order of replay is kept. */
+  void subscribe_all(const std::vector<const Instrument*>&);
+
+  /* Streams configured for an instrument, or else `fallback`. */
+  MdStreamParams configured_streams(const Instrument&,
+                                    MdStreamParams fallback) const;
+
+  /* Streams subscribed to for an instrument, none if it has no MarketData */
+  MdStreamParams subscribed_streams(const Instrument&);
+
+  /* Streams configured for instruments without streams of their own */
+  MdStreamParams default_streams() const { return _default_streams; }
+
 private:
+  struct Entry {
+    std::unique_ptr<MarketData> market;
+    MdStreamParams streams;
+  };
+
+  bool subscribe(const Instrument&, MarketData*, MdStreamParams);
+
   Services* _services;
-  std::map<Instrument, std::unique_ptr<MarketData>> _markets;
+  MdStreamParams _default_streams;
+  std::map<std::string, MdStreamParams> _instrument_streams;
+  InstrumentMap<Entry> _markets;
 };
 
 } // namespace apex
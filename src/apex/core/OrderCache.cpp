@@ -0,0 +1,188 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/OrderCache.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace apex
+{
+
+namespace
+{
+
+struct LevelLess {
+  template <typename E> bool operator()(const E& e, int64_t level) const
+  {
+    return e.level < level;
+  }
+  template <typename E> bool operator()(int64_t level, const E& e) const
+  {
+    return level < e.level;
+  }
+};
+
+// Remove an order from an unordered list, by swapping in the last element.
+bool swap_erase(std::vector<std::shared_ptr<Order>>& orders, const Order* order)
+{
+  auto iter = std::find_if(orders.begin(), orders.end(),
+                           [order](auto& sp) { return sp.get() == order; });
+  if (iter == orders.end())
+    return false;
+  if (iter != orders.end() - 1)
+    *iter = std::move(orders.back());
+  orders.pop_back();
+  return true;
+}
+
+} // namespace
+
+
+OrderCache::OrderCache(double tick_size)
+  : _tick_size(tick_size > 0.0 ? tick_size : 1e-8)
+{
+}
+
+
+int64_t OrderCache::level_of(double price) const
+{
+  return std::llround(price / _tick_size);
+}
+
+
+void OrderCache::add_new_order(std::shared_ptr<apex::Order> order)
+{
+  index_order(*order);
+  _pending_orders.push_back(std::move(order));
+}
+
+
+void OrderCache::add_restored_order(std::shared_ptr<apex::Order> order)
+{
+  index_order(*order);
+  if (order->is_live())
+    _live_orders.push_back(std::move(order));
+  else
+    _pending_orders.push_back(std::move(order));
+}
+
+
+void OrderCache::apply(const OrderEvent& ev)
+{
+  if (ev.is_amend() && ev.order) {
+    reindex_order(*ev.order);
+    return;
+  }
+
+  if (!ev.is_state_change() || !ev.order)
+    return;
+
+  auto* order = ev.order.get();
+  if (order->is_closed()) {
+    if (swap_erase(_live_orders, order) || swap_erase(_pending_orders, order))
+      unindex_order(*order);
+  } else if (order->is_live()) {
+    auto iter = std::find(_pending_orders.begin(), _pending_orders.end(),
+                          ev.order);
+    if (iter != _pending_orders.end()) {
+      _live_orders.push_back(*iter);
+      swap_erase(_pending_orders, order);
+    }
+  }
+}
+
+
+void OrderCache::index_order(apex::Order& order)
+{
+  auto& index = side_index(order.side());
+  auto level = level_of(order.price());
+  auto pos = std::upper_bound(index.begin(), index.end(), level, LevelLess{});
+  index.insert(pos, Entry{level, &order});
+}
+
+
+void OrderCache::unindex_order(apex::Order& order)
+{
+  auto& index = side_index(order.side());
+  auto range = std::equal_range(index.begin(), index.end(),
+                                level_of(order.price()), LevelLess{});
+  auto iter = std::find_if(range.first, range.second,
+                           [&order](auto& e) { return e.order == &order; });
+  if (iter != range.second)
+    index.erase(iter);
+}
+
+
+void OrderCache::reindex_order(apex::Order& order)
+{
+  // the order is indexed at its price before the amend, so is found by
+  // address alone
+  auto& index = side_index(order.side());
+  auto iter = std::find_if(index.begin(), index.end(),
+                           [&order](auto& e) { return e.order == &order; });
+  if (iter == index.end())
+    return;
+  index.erase(iter);
+  index_order(order);
+}
+
+
+size_t OrderCache::level_count(Side side) const
+{
+  auto& index = side_index(side);
+  size_t count = 0;
+  for (size_t i = 0; i < index.size(); i++)
+    if (i == 0 || index[i].level != index[i - 1].level)
+      count++;
+  return count;
+}
+
+
+double OrderCache::resting_size(Side side, double price) const
+{
+  auto& index = side_index(side);
+  auto range =
+      std::equal_range(index.begin(), index.end(), level_of(price), LevelLess{});
+  double size = 0.0;
+  for (auto iter = range.first; iter != range.second; ++iter)
+    size += iter->order->remain_size();
+  return size;
+}
+
+
+void OrderCache::orders_beyond(Side side, double touch, int ticks,
+                               std::vector<std::shared_ptr<apex::Order>>& out) const
+{
+  out.clear();
+  auto& index = side_index(side);
+  auto touch_level = level_of(touch);
+
+  if (side == Side::buy) {
+    auto end = std::lower_bound(index.begin(), index.end(),
+                                touch_level - ticks, LevelLess{});
+    for (auto iter = index.begin(); iter != end; ++iter)
+      out.push_back(iter->order->shared_from_this());
+  } else {
+    auto begin = std::upper_bound(index.begin(), index.end(),
+                                  touch_level + ticks, LevelLess{});
+    for (auto iter = begin; iter != index.end(); ++iter)
+      out.push_back(iter->order->shared_from_this());
+  }
+}
+
+} // namespace apex
@@ -0,0 +1,106 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Order.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace apex
+{
+
+/* Track live and closed orders associated with a single Bot.  Open orders, both
+ * pending and live, are also indexed by price level on each side, in a flat
+ * array sorted by level, so that requote decisions query a range of levels
+ * rather than scan every order.
+ *
+ * The order lists are updated as order events arrive, so must not be iterated
+ * across a call that can synchronously close an order. */
+class OrderCache
+{
+public:
+  explicit OrderCache(double tick_size = 0.0);
+
+  [[nodiscard]] bool has_live_orders() const { return !_live_orders.empty(); }
+
+  [[nodiscard]] bool has_pending_orders() const { return !_pending_orders.empty(); }
+
+  void add_new_order(std::shared_ptr<apex::Order> order);
+
+  /* Add an order restored on restart, in the list of its current state. */
+  void add_restored_order(std::shared_ptr<apex::Order> order);
+
+  /* Update the cache for an event of one of its orders; the owning Bot calls
+   * this from its own order event handler, so there is a single subscription
+   * per order.  An amend moves the order to its new price level. */
+  void apply(const OrderEvent&);
+
+  const std::vector<std::shared_ptr<apex::Order>>& live_orders() const
+  {
+    return _live_orders;
+  }
+
+  const std::vector<std::shared_ptr<apex::Order>>& pending_orders() const
+  {
+    return _pending_orders;
+  }
+
+  size_t order_count() const { return _pending_orders.size() + _live_orders.size(); }
+
+  /* Number of distinct price levels with open orders on a side. */
+  [[nodiscard]] size_t level_count(Side) const;
+
+  /* Unfilled size of the open orders of a side at a price level. */
+  [[nodiscard]] double resting_size(Side, double price) const;
+
+  /* Collect into `out` the open orders of a side further than `ticks` ticks
+   * from the touch, i.e. bids priced below touch-ticks, or asks above
+   * touch+ticks.  `out` is cleared first, so can be reused across calls. */
+  void orders_beyond(Side, double touch, int ticks,
+                     std::vector<std::shared_ptr<apex::Order>>& out) const;
+
+private:
+  struct Entry {
+    int64_t level;
+    apex::Order* order;
+  };
+
+  [[nodiscard]] int64_t level_of(double price) const;
+  std::vector<Entry>& side_index(Side side)
+  {
+    return side == Side::buy ? _bids : _asks;
+  }
+  const std::vector<Entry>& side_index(Side side) const
+  {
+    return side == Side::buy ? _bids : _asks;
+  }
+
+  void index_order(apex::Order&);
+  void unindex_order(apex::Order&);
+  void reindex_order(apex::Order&);
+
+  double _tick_size;
+  std::vector<std::shared_ptr<apex::Order>> _pending_orders;
+  std::vector<std::shared_ptr<apex::Order>> _live_orders;
+  std::vector<Entry> _bids; // sorted by level
+  std::vector<Entry> _asks; // sorted by level
+};
+
+} // namespace apex
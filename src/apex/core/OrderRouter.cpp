@@ -18,40 +18,81 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/OrderRouter.hpp>
 #include <apex/core/Errors.hpp>
 #include <apex/comm/GxClientSession.hpp>
+#include <apex/core/EmbeddedGateway.hpp>
+#include <apex/core/GatewayFailover.hpp>
 #include <apex/model/Order.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/util/EventLoop.hpp>
+
+#include <algorithm>
 
 
 namespace apex
 {
 
+void OrderRouter::send_orders(const std::vector<Order*>& orders)
+{
+  for (auto* order : orders)
+    send_order(*order);
+}
+
+void OrderRouter::cancel_orders(const std::vector<Order*>& orders,
+                                bool /*all_open*/)
+{
+  for (auto* order : orders)
+    cancel_order(*order);
+}
+
+
 RealtimeOrderRouter::RealtimeOrderRouter(apex::Services* services,
                                          std::shared_ptr<GxClientSession> gx_session,
                      std::string strategy_id)
   : _services(services),
-    _gx_session(std::move(gx_session)),
+    _gx_sessions{std::move(gx_session), nullptr},
     _strategy_id(strategy_id)
 {
+  watch_session(0);
+}
 
-  auto wp = _gx_session->weak_from_this();
+
+RealtimeOrderRouter::RealtimeOrderRouter(
+    apex::Services* services, std::shared_ptr<GatewayFailover> failover,
+    std::string strategy_id)
+  : _services(services),
+    _failover(std::move(failover)),
+    _gx_sessions(_failover->sessions()),
+    _strategy_id(strategy_id)
+{
+  watch_session(0);
+  watch_session(1);
+}
+
+
+void RealtimeOrderRouter::watch_session(size_t index)
+{
+  auto& session = _gx_sessions[index];
+  auto wp = session->weak_from_this();
+  auto strategy_id = _strategy_id;
+  auto services = _services;
 
   // TODO: OmSession needs to be a shared_from_this, as can see here, we are
   // capturing a this pointer.
-  _gx_session->om_logon_observable().subscribe(
-      [strategy_id, this](std::string error) {
+  session->om_logon_observable().subscribe(
+      [strategy_id, index, this](std::string error) {
         if (!error.empty()) {
-          this->_is_up = false;
+          this->_is_up[index] = false;
           LOG_ERROR("error attempting apex-gx strategy logon: " << error);
         } else {
-          this->_is_up = true;
+          this->_is_up[index] = true;
           LOG_INFO("order-router logon successful for strategyId "
                    << QUOTE(strategy_id));
         }
       });
 
-  _gx_session->connected_observable().subscribe(
-      [wp, strategy_id, services, this](const bool& is_up) {
+  session->connected_observable().subscribe(
+      [wp, strategy_id, services, index, this](const bool& is_up) {
         if (!is_up)
-          this->_is_up = false;
+          this->_is_up[index] = false;
         if (auto sp = wp.lock()) {
           if (is_up) {
             sp->strategy_logon(strategy_id, services->run_mode());
@@ -60,9 +101,16 @@ RealtimeOrderRouter::RealtimeOrderRouter(apex::Services* services,
       });
 }
 
+
+size_t RealtimeOrderRouter::active_index() const
+{
+  return _failover ? _failover->active_index() : 0;
+}
+
+
 std::shared_ptr<GxClientSession>& RealtimeOrderRouter::gx_session()
 {
-  return _gx_session;
+  return _gx_sessions[active_index()];
 }
 
 
@@ -75,14 +123,14 @@ void RealtimeOrderRouter::send_order(Order& order)
         sp->set_is_rejected(error::e0003, "gx not connected");
     });
   } else {
-    _gx_session->new_order(order);
+    gx_session()->new_order(order);
   }
 }
 
 void RealtimeOrderRouter::cancel_order(Order& order)
 {
-  if (_gx_session->is_connected()) {
-    _gx_session->cancel_order(order);
+  if (gx_session()->is_connected()) {
+    gx_session()->cancel_order(order);
   }
   else {
     LOG_ERROR("cannot cancel order " << order.order_id() << " for " << order.ticker() <<"; GX connection down");
@@ -90,7 +138,126 @@ void RealtimeOrderRouter::cancel_order(Order& order)
   }
 }
 
-bool RealtimeOrderRouter::is_up() const { return _is_up; }
+void RealtimeOrderRouter::replace_order(Order& order)
+{
+  if (gx_session()->is_connected()) {
+    gx_session()->replace_order(order);
+  }
+  else {
+    LOG_ERROR("cannot replace order " << order.order_id() << " for " << order.ticker() <<"; GX connection down");
+    throw std::runtime_error("cannot replace order");
+  }
+}
+
+void RealtimeOrderRouter::send_orders(const std::vector<Order*>& orders)
+{
+  if (!is_up()) {
+    for (auto* order : orders)
+      send_order(*order);
+  } else {
+    gx_session()->new_orders(orders);
+  }
+}
+
+void RealtimeOrderRouter::cancel_orders(const std::vector<Order*>& orders,
+                                        bool all_open)
+{
+  if (gx_session()->is_connected()) {
+    gx_session()->cancel_orders(orders, all_open);
+  }
+  else {
+    LOG_ERROR("cannot cancel " << orders.size() << " orders; GX connection down");
+    throw std::runtime_error("cannot cancel orders");
+  }
+}
+
+bool RealtimeOrderRouter::is_up() const { return _is_up[active_index()]; }
+
+
+EmbeddedOrderRouter::EmbeddedOrderRouter(
+    std::shared_ptr<EmbeddedGateway> gateway)
+  : _gateway(std::move(gateway))
+{
+}
+
+
+void EmbeddedOrderRouter::send_order(Order& order)
+{
+  _gateway->new_order(order);
+}
+
+
+void EmbeddedOrderRouter::cancel_order(Order& order)
+{
+  _gateway->cancel_order(order);
+}
+
+
+void EmbeddedOrderRouter::replace_order(Order& order)
+{
+  _gateway->replace_order(order);
+}
+
+
+void EmbeddedOrderRouter::cancel_orders(const std::vector<Order*>& orders,
+                                        bool all_open)
+{
+  _gateway->cancel_orders(orders, all_open);
+}
+
+
+WarmupOrderRouter::WarmupOrderRouter(Services* services) : _services(services)
+{
+}
+
+
+void WarmupOrderRouter::send_order(Order& order)
+{
+  // drop closed orders before the list would reallocate
+  if (_orders.size() == _orders.capacity())
+    _orders.erase(std::remove_if(_orders.begin(), _orders.end(),
+                                 [](auto& o) { return o->is_closed(); }),
+                  _orders.end());
+
+  auto sp = order.shared_from_this();
+  _orders.push_back(sp);
+  _orders_sent++;
+  _services->evloop()->dispatch([sp]() {
+    if (!sp->is_closed())
+      sp->apply(OrderUpdate{OrderState::live, OrderCloseReason::none, {}});
+  });
+}
+
+
+void WarmupOrderRouter::cancel_order(Order& order)
+{
+  auto sp = order.shared_from_this();
+  _services->evloop()->dispatch([sp]() {
+    if (!sp->is_closed())
+      sp->apply(
+          OrderUpdate{OrderState::closed, OrderCloseReason::cancelled, {}});
+  });
+}
+
+
+void WarmupOrderRouter::replace_order(Order& order)
+{
+  auto sp = order.shared_from_this();
+  _services->evloop()->dispatch([sp]() {
+    if (!sp->is_closed())
+      sp->apply_amend(OrderUpdate{OrderState::live, OrderCloseReason::none, {}});
+  });
+}
+
+
+void WarmupOrderRouter::close_all()
+{
+  // closed outright, since an order being amended would defer the close
+  for (auto& order : _orders)
+    if (!order->is_closed())
+      order->set_is_closed(_services->now(), OrderCloseReason::cancelled);
+  _orders.clear();
+}
 
 
 } // namespace apex
@@ -17,12 +17,17 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <array>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace apex
 {
 class Services;
+class EmbeddedGateway;
+class GatewayFailover;
 class GxClientSession;
 class Order;
 
@@ -50,6 +55,22 @@ public:
   virtual ~OrderRouter() = default;
   virtual void send_order(Order&) = 0;
   virtual void cancel_order(Order&) = 0;
+
+  /* Cancel an order and submit its replacement, at the order's amend_price
+   * and amend_size, as one request; see Order::amend.  Routers without
+   * cancel-replace throw. */
+  virtual void replace_order(Order&)
+  {
+    throw std::runtime_error("order replace not supported");
+  }
+
+  /* Send, or cancel, several orders; see Order::send_all and
+   * Order::cancel_all.  Routers able to combine the orders into fewer
+   * requests override these; by default each order is sent alone, and
+   * `all_open` has no effect. */
+  virtual void send_orders(const std::vector<Order*>&);
+  virtual void cancel_orders(const std::vector<Order*>&, bool all_open);
+
   virtual bool is_up() const = 0;
 };
 
@@ -60,17 +81,73 @@ public:
                       std::shared_ptr<GxClientSession> gx_session,
                       std::string strategy_id);
 
+  /* Router via the active session of a primary and standby pair; the
+   * strategy logs on via both, and orders follow a failover at once. */
+  RealtimeOrderRouter(apex::Services* services,
+                      std::shared_ptr<GatewayFailover> failover,
+                      std::string strategy_id);
+
 
   void send_order(Order&) override;
   void cancel_order(Order&) override;
+  void replace_order(Order&) override;
+  void send_orders(const std::vector<Order*>&) override;
+  void cancel_orders(const std::vector<Order*>&, bool all_open) override;
   bool is_up() const override;
 
 private:
+  void watch_session(size_t index);
+  size_t active_index() const;
   std::shared_ptr<GxClientSession>& gx_session();
   Services* _services;
-  std::shared_ptr<GxClientSession> _gx_session;
+  std::shared_ptr<GatewayFailover> _failover;
+  std::array<std::shared_ptr<GxClientSession>, 2> _gx_sessions;
   std::string _strategy_id;
-  bool _is_up = false;
+  std::array<bool, 2> _is_up{}; // logged on, per session
+};
+
+
+/* Router of orders to an exchange session embedded in the process, see
+ * EmbeddedGateway; orders are passed to the session by direct calls. */
+class EmbeddedOrderRouter : public OrderRouter
+{
+public:
+  explicit EmbeddedOrderRouter(std::shared_ptr<EmbeddedGateway> gateway);
+
+  void send_order(Order&) override;
+  void cancel_order(Order&) override;
+  void replace_order(Order&) override;
+  void cancel_orders(const std::vector<Order*>&, bool all_open) override;
+  bool is_up() const override { return true; }
+
+private:
+  std::shared_ptr<EmbeddedGateway> _gateway;
+};
+
+
+/* Router of the orders of a warm-up, see Strategy::init_bots; the orders never
+ * leave the process.  Each order is accepted, and cancels and replaces
+ * succeed, in events on the event loop, like the replies of an exchange.
+ * Orders still open at the end of the warm-up are closed by close_all. */
+class WarmupOrderRouter : public OrderRouter
+{
+public:
+  explicit WarmupOrderRouter(Services*);
+
+  void send_order(Order&) override;
+  void cancel_order(Order&) override;
+  void replace_order(Order&) override;
+  bool is_up() const override { return true; }
+
+  /* Close, as cancelled, each order not yet closed. */
+  void close_all();
+
+  [[nodiscard]] size_t orders_sent() const { return _orders_sent; }
+
+private:
+  Services* _services;
+  std::vector<std::shared_ptr<Order>> _orders;
+  size_t _orders_sent = 0;
 };
 
 } // namespace apex
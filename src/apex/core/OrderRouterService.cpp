@@ -16,6 +16,7 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/core/BacktestService.hpp>
+#include <apex/core/GatewayFailover.hpp>
 #include <apex/core/GatewayService.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/core/OrderRouterService.hpp>
@@ -39,7 +40,7 @@ OrderRouterService::~OrderRouterService() {
 
 /* Get an OrderRouter object for sending orders to the provided exchange, and
  * this is configured with the provided strategy_id. */
-OrderRouter* OrderRouterService::get_order_router(Instrument& instrument,
+OrderRouter* OrderRouterService::get_order_router(const Instrument& instrument,
                                                   const std::string& strategy_id)
 {
 
@@ -68,6 +69,19 @@ OrderRouter* OrderRouterService::get_order_router(Instrument& instrument,
 
     LOG_NOTICE("creating OrderRouter for exchange " << QUOTE(exchange));
 
+    if (auto embedded = _services->gateway_service()->find_embedded(exchange)) {
+      auto inserted = _routers.insert(
+          {key, std::make_unique<EmbeddedOrderRouter>(std::move(embedded))});
+      return inserted.first->second.get();
+    }
+
+    if (auto failover = _services->gateway_service()->find_failover(exchange)) {
+      auto inserted = _routers.insert(
+          {key, std::make_unique<RealtimeOrderRouter>(
+                    _services, std::move(failover), strategy_id)});
+      return inserted.first->second.get();
+    }
+
     auto gx_session = _services->gateway_service()->find_session(exchange);
     if (!gx_session) {
       THROW("cannot find GxSession for exchange " << QUOTE(exchange));
@@ -37,7 +37,7 @@ public:
   ~OrderRouterService();
   /* Get an OrderRouter object for sending orders to the provided exchange, and
    * this is configured with the provided strategy_id. */
-  OrderRouter* get_order_router(Instrument&,
+  OrderRouter* get_order_router(const Instrument&,
                                 const std::string& strategy_id);
 
 private:
@@ -16,10 +16,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/core/OrderService.hpp>
+#include <apex/core/PersistenceService.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/core/StateJournal.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/Metrics.hpp>
 
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <utility>
@@ -27,44 +31,93 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 namespace apex
 {
 
-class FullUniqueOrderIdGenerator
+static metrics::Counter& orders_created = metrics::registry().counter(
+    "apex_orders_created_total", "Orders created");
+static metrics::Counter& order_fills = metrics::registry().counter(
+    "apex_order_fills_total", "Fills applied to orders");
+static metrics::Gauge& orders_open = metrics::registry().gauge(
+    "apex_orders_open", "Orders created and not yet closed");
+
+static memory::Account& order_table_memory()
 {
-public:
-  explicit FullUniqueOrderIdGenerator(apex::Services* services) :
-    _services(services),
-    _order_counter(0) {
-    // TODO: need session ID
-    // TODO: need start-up-time
-    //
-  }
+  static memory::Account account("order_tables");
+  return account;
+}
 
-  template <typename T>
-  static std::string int_to_hex(T i) {
-    std::stringstream ss;
-    ss << std::setfill('0')
-       << std::setw(sizeof(int)*2)
-       << std::hex << i;
-    return ss.str();
+static memory::Account& order_pool_memory()
+{
+  static memory::Account account("order_pool");
+  return account;
+}
 
+
+/* Write the 8 hex digits of `value`, most significant first. */
+static void write_hex8(char* dest, uint32_t value)
+{
+  static constexpr char digits[] = "0123456789abcdef";
+  for (int i = 7; i >= 0; i--) {
+    dest[i] = digits[value & 0xF];
+    value >>= 4;
   }
-  std::string next(const std::string & strategy_id) {
-    Time startup_time = _services->startup_time();
+}
 
-    int epoch_sec = int(startup_time.as_epoch_ms().count() / 1000);
 
-    std::string hex = int_to_hex(epoch_sec);
+/* Order ids are the strategy id followed by the 16 hex digits of the order
+ * handle: the startup time, in epoch seconds, then the order counter.  All
+ * but the counter is constant, so the prefix is built once per strategy id,
+ * and each id is formed in a fixed buffer and copied to its string in a
+ * single allocation. */
+class FullUniqueOrderIdGenerator
+{
+public:
+  explicit FullUniqueOrderIdGenerator(apex::Services* services) :
+    _order_counter(0),
+    _order_counter_end(0xFFFFFFFF) {
+    _epoch_sec = uint32_t(services->startup_time().as_epoch_ms().count() / 1000);
+    write_hex8(_epoch_hex, _epoch_sec);
+
+    // shards of one strategy start together, so each takes its own range
+    // of the counter
+    auto& shard = services->shard();
+    if (shard.is_sharded()) {
+      uint64_t range = (uint64_t(1) << 32) / shard.count;
+      _order_counter = uint32_t(range * shard.index);
+      _order_counter_end = uint32_t(range * (shard.index + 1) - 1);
+    }
+  }
 
-    std::ostringstream oss;
-    if (_order_counter == 0xFFFFFFFF) {
+  // The id ends with the 16 hex digits of the order handle, see
+  // OrderService::decode_handle.
+  std::string next(const std::string& strategy_id, uint64_t& handle) {
+    if (_order_counter == _order_counter_end) {
       THROW("no more order IDs available, cannot create order");
     }
-    oss << strategy_id << hex << std::setfill('0') << std::setw(8) << std::hex << _order_counter++;
-    return oss.str();
+
+    if (_prefix_len == 0 || strategy_id.size() + 8 != _prefix_len ||
+        strategy_id.compare(0, strategy_id.size(), _buf,
+                            strategy_id.size()) != 0) {
+      if (strategy_id.size() + 16 > sizeof(_buf))
+        THROW("strategy id too long for order id: '" << strategy_id << "'");
+      memcpy(_buf, strategy_id.data(), strategy_id.size());
+      memcpy(_buf + strategy_id.size(), _epoch_hex, sizeof(_epoch_hex));
+      _prefix_len = strategy_id.size() + 8;
+    }
+
+    handle = (uint64_t(_epoch_sec) << 32) | _order_counter;
+    write_hex8(_buf + _prefix_len, _order_counter++);
+    return std::string(_buf, _prefix_len + 8);
   }
 
 private:
-  apex::Services* _services;
+  uint32_t _epoch_sec;
   uint32_t _order_counter;
+  uint32_t _order_counter_end;
+  char _epoch_hex[8];
+
+  // the prefix, of strategy id and startup time, of the most recent id,
+  // followed by the space for its counter
+  char _buf[128];
+  size_t _prefix_len = 0;
 };
 
 class ClientOrderIdGenerator
@@ -105,8 +158,12 @@ private:
 OrderService::OrderService(Services* services)
   : _services(services),
 //    _order_id_src(std::make_unique<ClientOrderIdGenerator>(services))
-    _order_id_src(std::make_unique<FullUniqueOrderIdGenerator>(services))
+    _order_id_src(std::make_unique<FullUniqueOrderIdGenerator>(services)),
+    _order_pool(std::make_shared<BlockPool>(4096, &order_pool_memory())),
+    _dead_orders(std::chrono::hours(1)),
+    _tables_charge(order_table_memory())
 {
+  _tables_charge.set(_orders.bytes() + _dead_orders.bytes());
 }
 
 
@@ -114,41 +171,96 @@ OrderService::~OrderService() = default;
 
 
 std::shared_ptr<Order> OrderService::create(
-  OrderRouter* router, Instrument instrument, Side side, double size,
+  OrderRouter* router, const Instrument& instrument, Side side, double size,
   double price, TimeInForce tif, const std::string& strategy_id, void* user_data,
   std::function<void(void*)> user_data_delete_fn)
 {
-  std::ostringstream oss;
-  oss << _order_id_src->next(strategy_id);
+  uint64_t handle = 0;
+  auto order_id = _order_id_src->next(strategy_id, handle);
 
   auto order =
-    std::make_shared<Order>(_services, router, instrument, side, size, price,
-                            tif, oss.str(), user_data, user_data_delete_fn);
+    make_pooled<Order>(_order_pool, _services, router, instrument, side, size,
+                       price, tif, std::move(order_id), user_data,
+                       std::move(user_data_delete_fn));
+  track(order, handle, strategy_id);
+  orders_created.add();
+  return order;
+}
+
+
+std::shared_ptr<Order> OrderService::restore(
+  OrderRouter* router, const Instrument& instrument,
+  const StateJournal::OrderRecord& record, const std::string& strategy_id)
+{
+  auto handle = decode_handle(record.order_id);
+  if (!handle || _orders.find(handle))
+    return {};
+
+  auto order = make_pooled<Order>(
+    _order_pool, _services, router, instrument, record.side, record.size,
+    record.price, record.tif, record.order_id.str());
+  order->restore(record.state, record.ext_order_id.str(), record.filled);
+  track(order, handle, strategy_id);
+  return order;
+}
+
+
+void OrderService::track(const std::shared_ptr<Order>& order, uint64_t handle,
+                         const std::string& strategy_id)
+{
+  auto* persistence = _services->persistence_service();
+  auto* journal = persistence ? persistence->journal(strategy_id) : nullptr;
 
   auto wp = order->weak_from_this();
-  order->events().subscribe([this, wp](OrderEvent ev) {
+  order->events().subscribe([this, wp, handle, journal](const OrderEvent& ev) {
+    auto sp = wp.lock();
+    if (sp && journal)
+      journal->record_order(*sp, handle, _services->now());
     if (ev.is_state_change()) {
-      auto sp = wp.lock();
       if (sp && sp->is_closed()) {
-        auto iter = _orders.find(sp->order_id());
-        if (iter != std::end(_orders)) {
-          _orders.erase(iter);
-          _dead_order_ids.insert({sp->order_id(), _services->now()});
+        if (_orders.erase(handle)) {
+          _dead_orders.insert(handle, _services->now());
+          _tables_charge.set(_orders.bytes() + _dead_orders.bytes());
+          orders_open.add(-1);
         }
       }
     }
   });
 
-  _orders.insert({order->order_id(), order});
+  _orders.insert(handle, order);
+  _tables_charge.set(_orders.bytes() + _dead_orders.bytes());
+  orders_open.add(1);
+}
 
-  return order;
+
+uint64_t OrderService::decode_handle(std::string_view order_id)
+{
+  constexpr size_t digits = 16;
+  if (order_id.size() < digits)
+    return 0;
+
+  uint64_t handle = 0;
+  for (char c : order_id.substr(order_id.size() - digits)) {
+    uint64_t v;
+    if (c >= '0' && c <= '9')
+      v = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      v = c - 'a' + 10;
+    else
+      return 0;
+    handle = (handle << 4) | v;
+  }
+  return handle;
 }
 
 
 std::shared_ptr<Order> OrderService::find_order(const std::string& order_id)
 {
-  auto iter = _orders.find(order_id);
-  return (iter != std::end(_orders)) ? iter->second : nullptr;
+  auto handle = decode_handle(order_id);
+  if (!handle)
+    return nullptr;
+  auto* order = _orders.find(handle);
+  return (order && (*order)->order_id() == order_id) ? *order : nullptr;
 }
 
 
@@ -162,6 +274,7 @@ void OrderService::route_fill_to_order(const std::string& order_id,
   // that get invoked when apply() is called - which can happen if the order is
   // now closed.
   if (order) {
+    order_fills.add();
     order->apply(fill);
   } else {
     LOG_WARN("dropping order-fill, because no order found with orderId "
@@ -182,9 +295,9 @@ void OrderService::route_update_to_order(const std::string& order_id,
   if (order) {
     order->apply(update);
   } else {
-    auto iter = _dead_order_ids.find(order_id);
+    auto handle = decode_handle(order_id);
 
-    if (iter != std::end(_dead_order_ids)) {
+    if (handle && _dead_orders.contains(handle, _services->now())) {
       // appears we have received an order-update for an order that has already
       // been closed; eg, this is typically because its a websocket cancel, but
       // the on-rest cancel has already been received; its safe to ignore these.
@@ -17,12 +17,18 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/core/StateJournal.hpp>
 #include <apex/model/Account.hpp>
 #include <apex/model/Order.hpp>
 #include <apex/model/tick_msgs.hpp>
+#include <apex/util/ExpiringKeySet.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/ObjectPool.hpp>
+#include <apex/util/OpenAddressMap.hpp>
 
 #include <memory>
 #include <mutex>
+#include <string_view>
 
 namespace apex
 {
@@ -32,7 +38,16 @@ class Services;
 class ClientOrderIdGenerator;
 class FullUniqueOrderIdGenerator;
 
-/* Responsible for tracking all orders created by the strategy */
+/* Responsible for tracking all orders created by the strategy.  Each order has
+ * a 64-bit handle, formed from the startup time and an order counter, which is
+ * encoded as the trailing 16 hex digits of its order id; so routing an update
+ * decodes the handle from the id, and needs no string comparison beyond a
+ * final check of the id.  Orders are drawn from a pool, so the storage of
+ * closed orders is recycled rather than returned to the heap.  Handles of
+ * closed orders are remembered for an hour, in time-bucketed generations that
+ * are dropped whole, so memory stays flat over multi-day runs.  The state of
+ * each order is written to the StateJournal of its strategy, if any, on
+ * every event. */
 class OrderService
 {
 public:
@@ -40,23 +55,50 @@ public:
   ~OrderService();
 
   std::shared_ptr<Order> create(
-    OrderRouter*, Instrument, Side, double size, double price,
+    OrderRouter*, const Instrument&, Side, double size, double price,
     TimeInForce tif, const std::string& strategy_id, void* user_data,
     std::function<void(void*)> user_data_delete_fn);
 
+  /* Recreate an open order of an earlier run of the engine, from its record
+   * in the strategy's StateJournal, so that updates from the exchange are
+   * routed to it; returns null if its id is not of this service's form, or
+   * the order is already tracked. */
+  std::shared_ptr<Order> restore(OrderRouter*, const Instrument&,
+                                 const StateJournal::OrderRecord&,
+                                 const std::string& strategy_id);
+
   void route_fill_to_order(const std::string& order_id, OrderFill&);
   void route_update_to_order(const std::string& order_id, OrderUpdate&);
 
   std::shared_ptr<Order> find_order(const std::string& order_id);
 
+  /* Size the table of open orders for `n` orders. */
+  void reserve(size_t n)
+  {
+    _orders.reserve(n);
+    _tables_charge.set(_orders.bytes() + _dead_orders.bytes());
+  }
+
+  /* Handle encoded in an order id, or zero if the id is not of the form
+   * created by this service. */
+  static uint64_t decode_handle(std::string_view order_id);
+
 private:
+  // track an order until closed, and journal its state
+  void track(const std::shared_ptr<Order>&, uint64_t handle,
+             const std::string& strategy_id);
+
   Services* _services;
   std::unique_ptr<FullUniqueOrderIdGenerator> _order_id_src;
-  std::map<std::string, std::shared_ptr<Order>> _orders;
+  std::shared_ptr<BlockPool> _order_pool;
+  OpenAddressMap<std::shared_ptr<Order>> _orders;
+
+  // handles of closed orders, retained for an hour so that late updates from
+  // the exchange can be recognised
+  ExpiringKeySet _dead_orders;
 
-  // Note: instead of just holding onto dead orders IDs, can hold on to the
-  // actual orders, and retain them for, say 1 hour?
-  std::map<std::string, Time> _dead_order_ids;
+  // of the two tables above, to the "order_tables" memory account
+  memory::Charge _tables_charge;
 };
 
 } // namespace apex
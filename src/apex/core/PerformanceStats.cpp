@@ -0,0 +1,121 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (
+// at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/core/PerformanceStats.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+namespace apex
+{
+
+PerformanceStats::PerformanceStats(std::chrono::seconds sample_interval)
+  : _interval(std::max(sample_interval, std::chrono::seconds(1)))
+{
+}
+
+
+void PerformanceStats::on_order(double value_usd)
+{
+  _totals.orders++;
+  if (std::isfinite(value_usd))
+    _totals.order_value_usd += std::fabs(value_usd);
+}
+
+
+void PerformanceStats::on_fill(double value_usd, bool first)
+{
+  _totals.fills++;
+  if (first)
+    _totals.filled_orders++;
+  if (std::isfinite(value_usd))
+    _totals.turnover_usd += std::fabs(value_usd);
+}
+
+
+void PerformanceStats::mark(Time time, double pnl_usd)
+{
+  if (!std::isfinite(pnl_usd))
+    return;
+
+  // the PnL of each sample is the last marked before its end
+  if (_next_sample.empty()) {
+    _next_sample = time;
+    _next_sample += _interval;
+  } else if (time >= _next_sample) {
+    const auto periods = static_cast<size_t>(
+        (time - _next_sample) / _interval + 1);
+    sample(_totals.pnl_usd - _sampled_pnl, periods - 1);
+    _sampled_pnl = _totals.pnl_usd;
+    _next_sample += _interval * periods;
+  }
+
+  _totals.pnl_usd = pnl_usd;
+  _totals.peak_pnl_usd = std::max(_totals.peak_pnl_usd, pnl_usd);
+  _totals.max_drawdown_usd =
+      std::max(_totals.max_drawdown_usd, _totals.peak_pnl_usd - pnl_usd);
+}
+
+
+void PerformanceStats::sample(double change, size_t unchanged)
+{
+  auto& n = _totals.samples;
+  n++;
+  double delta = change - _mean;
+  _mean += delta / n;
+  _m2 += delta * (change - _mean);
+
+  // merge the run of unchanged samples in one step
+  if (unchanged) {
+    const double total = double(n + unchanged);
+    delta = -_mean;
+    _m2 += delta * delta * double(n) * unchanged / total;
+    _mean += delta * unchanged / total;
+    n += unchanged;
+  }
+}
+
+
+PerformanceStats::Summary PerformanceStats::summary() const
+{
+  Summary summary = _totals;
+  if (summary.samples > 1) {
+    const double stddev = std::sqrt(_m2 / (summary.samples - 1));
+    const double per_year =
+        std::chrono::seconds(std::chrono::hours(24 * 365)) / _interval;
+    if (stddev > 0.0)
+      summary.sharpe = _mean / stddev * std::sqrt(per_year);
+  }
+  return summary;
+}
+
+
+std::ostream& operator<<(std::ostream& os,
+                         const PerformanceStats::Summary& summary)
+{
+  os << "pnl_usd: " << format_double(summary.pnl_usd, true)
+     << ", max_drawdown_usd: " << format_double(summary.max_drawdown_usd, true)
+     << ", sharpe: " << format_double(summary.sharpe, true)
+     << ", turnover_usd: " << format_double(summary.turnover_usd, true)
+     << ", orders: " << summary.orders
+     << ", fill_ratio: " << format_double(summary.fill_ratio(), true)
+     << ", fills: " << summary.fills;
+  return os;
+}
+
+} // namespace apex
@@ -0,0 +1,98 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (
+// at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cmath>
+#include <iosfwd>
+#include <limits>
+
+namespace apex
+{
+
+/* Performance of a strategy, or of one of its bots, maintained online from
+ * its audited order activity and the marks of its PnL, so that a run can be
+ * ranked without post-processing its transaction files.
+ *
+ * Drawdown is from the running peak of PnL, which starts at zero, over every
+ * mark.  The Sharpe ratio is of the changes in PnL between samples taken at
+ * a fixed interval of event time, annualised over a 365 day year; intervals
+ * without a mark count as unchanged.  Its mean and variance are kept with
+ * Welford's method, so each mark is constant time. */
+class PerformanceStats
+{
+public:
+  struct Summary {
+    size_t orders = 0;        // orders submitted
+    size_t filled_orders = 0; // of which filled, at least in part
+    size_t fills = 0;
+    double order_value_usd = 0.0;
+    double turnover_usd = 0.0; // value of the fills
+    double pnl_usd = 0.0;
+    double peak_pnl_usd = 0.0;
+    double max_drawdown_usd = 0.0;
+    size_t samples = 0;
+    double sharpe = std::numeric_limits<double>::quiet_NaN();
+
+    // share of the orders submitted that filled
+    [[nodiscard]] double fill_ratio() const
+    {
+      return orders ? double(filled_orders) / orders
+                    : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // share of the value of the orders submitted that filled
+    [[nodiscard]] double fill_value_ratio() const
+    {
+      return order_value_usd > 0.0 ? turnover_usd / order_value_usd
+                                   : std::numeric_limits<double>::quiet_NaN();
+    }
+  };
+
+  explicit PerformanceStats(
+      std::chrono::seconds sample_interval = std::chrono::hours(1));
+
+  /* An order was submitted; its value is ignored unless finite. */
+  void on_order(double value_usd);
+
+  /* An order filled; `first` if it is the order's first fill. */
+  void on_fill(double value_usd, bool first);
+
+  /* Mark the PnL at an event time; non finite marks are ignored. */
+  void mark(Time, double pnl_usd);
+
+  [[nodiscard]] Summary summary() const;
+
+private:
+  void sample(double change, size_t unchanged);
+
+  std::chrono::seconds _interval;
+  Summary _totals;
+  Time _next_sample;
+  double _sampled_pnl = 0.0;
+
+  // running mean and sum of squared deviations of the sampled changes
+  double _mean = 0.0;
+  double _m2 = 0.0;
+};
+
+std::ostream& operator<<(std::ostream&, const PerformanceStats::Summary&);
+
+} // namespace apex
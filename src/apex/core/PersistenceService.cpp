@@ -16,15 +16,23 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/core/PersistenceService.hpp>
+#include <apex/core/PositionLog.hpp>
+#include <apex/core/PositionSnapshot.hpp>
 #include <apex/core/RefDataService.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/core/StateJournal.hpp>
 #include <apex/util/Time.hpp>
 #include <apex/util/json.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/util/utils.hpp>
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
 
 namespace fs = std::filesystem;
 
@@ -46,6 +54,44 @@ void write_file(std::filesystem::path path, std::string content)
   fs::rename(tmp_path, path);
 }
 
+/* Open the log at `path`, or share the one already open in this process,
+ * as when a strategy runs as several shards; `created` is set if the log
+ * file did not exist. */
+static std::shared_ptr<PositionLog> open_position_log(
+    const fs::path& path, const PositionLog::Options& options, bool& created)
+{
+  static std::mutex mutex;
+  static std::map<fs::path, std::weak_ptr<PositionLog>> open_logs;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  created = false;
+  if (auto log = open_logs[path].lock())
+    return log;
+
+  created = !fs::exists(path);
+  auto log = std::make_shared<PositionLog>(path, options);
+  open_logs[path] = log;
+  return log;
+}
+
+
+/* As open_position_log, for the snapshot of a strategy. */
+static std::shared_ptr<PositionSnapshot> open_position_snapshot(
+    const fs::path& path, const std::string& strategy_id, bool fsync)
+{
+  static std::mutex mutex;
+  static std::map<fs::path, std::weak_ptr<PositionSnapshot>> open_snapshots;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (auto snapshot = open_snapshots[path].lock())
+    return snapshot;
+
+  auto snapshot = std::make_shared<PositionSnapshot>(path, strategy_id, fsync);
+  open_snapshots[path] = snapshot;
+  return snapshot;
+}
+
+
 PersistenceService::PersistenceService(Services* services) : _services(services)
 {
   auto default_path = services->paths_config().fdb;
@@ -56,11 +102,134 @@ PersistenceService::PersistenceService(Services* services) : _services(services)
     _persist_path = default_path;
     LOG_NOTICE("using default persistence path " << QUOTE(_persist_path));
   }
+
+  auto mode = config.get_string("mode", "wal");
+  if (mode == "wal") {
+    auto dir = fs::path(_persist_path) / "apex";
+    create_dir(dir);
+    auto wal_path = dir / "instrument_positions.wal";
+
+    // a backtest has no need to survive a crash, and a background thread
+    // would prevent it from being forked
+    PositionLog::Options options;
+    options.background = !services->is_backtest();
+    options.fsync = config.get_bool("fsync", !services->is_backtest());
+    bool is_new = false;
+    _position_log = open_position_log(wal_path, options, is_new);
+
+    if (is_new) {
+      auto imported = read_position_files();
+      for (auto& position : imported)
+        _position_log->append(position, _services->now());
+      if (!imported.empty())
+        LOG_NOTICE("imported " << imported.size()
+                   << " position files into " << wal_path);
+    }
+  } else if (mode == "snapshot") {
+    _snapshot_mode = true;
+    _snapshot_fsync = config.get_bool("fsync", !services->is_backtest());
+  } else if (mode != "files") {
+    THROW("persist mode must be 'wal', 'snapshot' or 'files', not "
+          << QUOTE(mode));
+  }
+
+  StateJournal::Options journal_options;
+  _journal_enabled = config.get_bool("journal", !services->is_backtest());
+  _journal_order_slots = static_cast<uint32_t>(
+      config.get_uint("journal_order_slots", journal_options.order_slots));
+  _journal_position_slots = static_cast<uint32_t>(config.get_uint(
+      "journal_position_slots", journal_options.position_slots));
+}
+
+
+StateJournal* PersistenceService::journal(const std::string& strategy_id)
+{
+  if (!_journal_enabled)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lock(_journals_mutex);
+  auto& journal = _journals[strategy_id];
+  if (!journal) {
+    auto dir = fs::path(_persist_path) / "apex";
+    create_dir(dir);
+    StateJournal::Options options;
+    options.order_slots = _journal_order_slots;
+    options.position_slots = _journal_position_slots;
+    journal = std::make_unique<StateJournal>(
+        dir / ("state_journal." + strategy_id + ".mmap"), strategy_id,
+        options);
+  }
+  return journal.get();
+}
+
+
+PersistenceService::~PersistenceService() = default;
+
+
+PositionSnapshot& PersistenceService::snapshot(const std::string& strategy_id)
+{
+  std::lock_guard<std::mutex> lock(_snapshots_mutex);
+  auto& snapshot = _snapshots[strategy_id];
+  if (!snapshot) {
+    auto dir = fs::path(_persist_path) / "apex";
+    create_dir(dir);
+    auto path = dir / ("positions." + strategy_id + ".json");
+    snapshot = open_position_snapshot(path, strategy_id, _snapshot_fsync);
+
+    // shards of a strategy share the snapshot, and the first imports
+    if (!snapshot->exists()) {
+      auto imported = read_position_files(strategy_id);
+      snapshot->update(imported, _services->now());
+      if (!imported.empty())
+        LOG_NOTICE("imported " << imported.size()
+                   << " position files into " << path);
+    }
+  }
+  return *snapshot;
 }
 
 
 std::vector<RestoredPosition> PersistenceService::restore_instrument_positions(
     std::string strategy_id)
+{
+  std::vector<RestoredPosition> positions;
+  if (_position_log)
+    positions = _position_log->positions(strategy_id);
+  else if (_snapshot_mode)
+    positions = snapshot(strategy_id).positions();
+  else
+    positions = read_position_files(strategy_id);
+
+  if (auto* state = journal(strategy_id)) {
+    std::map<std::pair<std::string, std::string>, size_t> index;
+    for (size_t i = 0; i < positions.size(); i++)
+      index.emplace(std::make_pair(positions[i].exchange.str(),
+                                   positions[i].native_symbol.str()),
+                    i);
+    for (auto& position : state->positions()) {
+      auto iter = index.find(std::make_pair(position.exchange.str(),
+                                            position.native_symbol.str()));
+      if (iter != index.end())
+        positions[iter->second] = position;
+      else
+        positions.push_back(position);
+    }
+  }
+  return positions;
+}
+
+
+void PersistenceService::sync()
+{
+  if (_position_log)
+    _position_log->sync();
+}
+
+
+// Read the JSON position files of a strategy, or all strategies if the id is
+// empty.
+std::vector<RestoredPosition> PersistenceService::read_position_files(
+    const std::string& strategy_id)
 {
   auto app_name = "apex";
   auto table_name = "instrument_positions";
@@ -71,28 +240,53 @@ std::vector<RestoredPosition> PersistenceService::restore_instrument_positions(
   path /= table_name;
 
   create_dir(path);
-  std::vector<RestoredPosition> records;
 
+  // the files of the strategy, with the exchange of each, in name order
+  std::vector<std::pair<fs::path, std::string>> files;
   for (const auto& entry : fs::directory_iterator(path)) {
     if (entry.is_regular_file() && entry.path().extension() == ".json") {
 
       auto tokens = split(entry.path().filename().c_str(), '.');
       if (std::size(tokens) == 4) {
-        if (tokens[0] == strategy_id) {
-          auto raw = read_json_file(entry.path().string());
-          RestoredPosition record;
-          record.strategy_id = raw["strategyid"].get_ref<const std::string&>();
-          record.exchange = raw["exchange"].get_ref<const std::string&>();
-          record.native_symbol = raw["symbol"].get_ref<const std::string&>();
-          record.qty = raw["qty"].get<double>();
-          records.push_back(std::move(record));
-        }
+        if (strategy_id.empty() || tokens[0] == strategy_id)
+          files.emplace_back(entry.path(), tokens[1]);
       } else {
         LOG_WARN("skipping position file with unexpected name-format: "
                  << entry.path());
       }
     }
   }
+  std::sort(files.begin(), files.end());
+
+  std::vector<RestoredPosition> records(files.size());
+  auto read = [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      auto raw = read_json_file(files[i].first.string());
+      auto& record = records[i];
+      record.strategy_id = raw["strategyid"].get_ref<const std::string&>();
+      // the exchange may be held as its enum value, so take it from the
+      // file name; quantities were written as strings
+      record.exchange = files[i].second;
+      record.native_symbol = raw["symbol"].get_ref<const std::string&>();
+      auto& qty = raw["qty"];
+      record.qty = qty.is_string() ? std::stod(qty.get<std::string>())
+                                   : qty.get<double>();
+    }
+  };
+
+  // there is a file per instrument, so a large universe is parsed on several
+  // threads, each taking a contiguous run of at least 64 files
+  const size_t threads = std::clamp<size_t>(
+      (files.size() + 63) / 64, 1,
+      std::max(std::thread::hardware_concurrency(), 1u));
+  const size_t per_thread = (files.size() + threads - 1) / threads;
+  std::vector<std::future<void>> parts;
+  for (size_t i = 1; i < threads; i++)
+    parts.push_back(std::async(std::launch::async, read, i * per_thread,
+                               std::min(files.size(), (i + 1) * per_thread)));
+  read(0, std::min(files.size(), per_thread));
+  for (auto& part : parts)
+    part.get();
 
   return records;
 }
@@ -101,6 +295,26 @@ std::vector<RestoredPosition> PersistenceService::restore_instrument_positions(
 void PersistenceService::persist_instrument_positions(
     std::string algo_id, const Instrument& instrument, double qty)
 {
+  if (_position_log) {
+    RestoredPosition position;
+    position.strategy_id = std::move(algo_id);
+    position.exchange = instrument.exchange_name();
+    position.native_symbol = instrument.native_symbol();
+    position.qty = qty;
+    _position_log->append(position, _services->now());
+    return;
+  }
+
+  if (_snapshot_mode) {
+    RestoredPosition position;
+    position.strategy_id = algo_id;
+    position.exchange = instrument.exchange_name();
+    position.native_symbol = instrument.native_symbol();
+    position.qty = qty;
+    snapshot(algo_id).update(position, _services->now());
+    return;
+  }
+
   // construct the record
   json record;
   record["exchange"] = instrument.exchange_id();
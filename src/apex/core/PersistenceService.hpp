@@ -17,6 +17,11 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/util/FixedString.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -25,18 +30,34 @@ namespace apex
 
 class Services;
 class Instrument;
+class PositionLog;
+class PositionSnapshot;
+class StateJournal;
 
 struct RestoredPosition {
-  std::string strategy_id;
-  std::string exchange;
-  std::string native_symbol;
+  FixedString<32> strategy_id;
+  FixedString<32> exchange;
+  FixedString<32> native_symbol;
   double qty;
 };
 
+/* Persists instrument positions.  By default positions are appended to a
+ * PositionLog, instrument_positions.wal under the persist path; the "persist"
+ * config "mode" of "files" instead selects the earlier layout of one JSON file
+ * per instrument, rewritten on every update, and "snapshot" a PositionSnapshot
+ * per strategy, positions.<strategy>.json, a single JSON document that is
+ * read in one go on restore.  On first opening the log, or a snapshot, the
+ * JSON files of the "files" layout are imported, and left in place.
+ *
+ * Outside of backtests each strategy also has a StateJournal, of its open
+ * orders and positions, unless the "persist" config "journal" is false; its
+ * positions take precedence over those of the log, as they are written
+ * synchronously. */
 class PersistenceService
 {
 public:
   explicit PersistenceService(Services* services);
+  ~PersistenceService();
 
   // position actions
   void persist_instrument_positions(std::string algo_id,
@@ -45,9 +66,33 @@ public:
   std::vector<RestoredPosition> restore_instrument_positions(
       std::string strategy_id);
 
+  /* Block until all persisted positions are durable; throws if the position
+   * log has failed to write them. */
+  void sync();
+
+  /* State journal of a strategy, opened on first use; null if disabled. */
+  StateJournal* journal(const std::string& strategy_id);
+
 private:
+  std::vector<RestoredPosition> read_position_files(
+      const std::string& strategy_id = "");
+
+  PositionSnapshot& snapshot(const std::string& strategy_id);
+
   Services* _services;
   std::string _persist_path;
+  std::shared_ptr<PositionLog> _position_log; // shared by all in the process
+
+  bool _snapshot_mode = false;
+  bool _snapshot_fsync = false;
+  std::mutex _snapshots_mutex;
+  std::map<std::string, std::shared_ptr<PositionSnapshot>> _snapshots;
+
+  bool _journal_enabled = false;
+  uint32_t _journal_order_slots = 0;
+  uint32_t _journal_position_slots = 0;
+  std::mutex _journals_mutex;
+  std::map<std::string, std::unique_ptr<StateJournal>> _journals;
 };
 
 } // namespace apex
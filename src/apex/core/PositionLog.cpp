@@ -0,0 +1,364 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/PositionLog.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/json.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace apex
+{
+
+static constexpr char wal_magic[8] = {'A', 'P', 'E', 'X', 'P', 'W', 'A', 'L'};
+
+struct FrameHeader {
+  uint32_t size; // payload bytes
+  uint32_t crc;  // crc32 of the payload
+};
+static_assert(sizeof(FrameHeader) == 8);
+
+
+static bool write_all(int fd, const char* data, size_t size)
+{
+  while (size) {
+    auto n = ::write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    data += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+
+static void append_frame(std::string& buf, const std::string& payload)
+{
+  FrameHeader head;
+  head.size = uint32_t(payload.size());
+  head.crc = uint32_t(crc32(0, reinterpret_cast<const Bytef*>(payload.data()),
+                            uInt(payload.size())));
+  buf.append(reinterpret_cast<const char*>(&head), sizeof(head));
+  buf.append(payload);
+}
+
+
+static std::string encode(const RestoredPosition& position, Time ts)
+{
+  json record;
+  record["exchange"] = position.exchange.str();
+  record["symbol"] = position.native_symbol.str();
+  record["strategyid"] = position.strategy_id.str();
+  record["ts"] = ts.as_epoch_us().count(); // usec since epoch
+  record["qty"] = position.qty;
+  return record.dump();
+}
+
+
+PositionLog::PositionLog(std::filesystem::path path, Options options)
+  : _path(std::move(path)), _options(options)
+{
+  replay();
+  open_for_append();
+  if (_options.background)
+    _thread = std::thread([this]() { run(); });
+}
+
+
+PositionLog::~PositionLog()
+{
+  if (_thread.joinable()) {
+    {
+      auto guard = std::scoped_lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+  }
+  if (_fd >= 0)
+    ::close(_fd);
+}
+
+
+std::string PositionLog::key_of(const RestoredPosition& position)
+{
+  return position.strategy_id.str() + "." + position.exchange.str() + "." +
+         position.native_symbol.str();
+}
+
+
+void PositionLog::replay()
+{
+  std::string bytes;
+  if (std::filesystem::exists(_path)) {
+    std::ifstream is(_path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(is),
+                 std::istreambuf_iterator<char>());
+  }
+
+  if (bytes.empty()) {
+    int fd = ::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || !write_all(fd, wal_magic, sizeof(wal_magic)) || ::fsync(fd) != 0) {
+      auto err = errno;
+      if (fd >= 0)
+        ::close(fd);
+      THROW("cannot create position log " << _path << ": " << strerror(err));
+    }
+    ::close(fd);
+    return;
+  }
+
+  if (bytes.size() < sizeof(wal_magic) ||
+      memcmp(bytes.data(), wal_magic, sizeof(wal_magic)) != 0)
+    THROW("not a position log file " << _path);
+
+  size_t offset = sizeof(wal_magic);
+  while (offset + sizeof(FrameHeader) <= bytes.size()) {
+    FrameHeader head;
+    memcpy(&head, bytes.data() + offset, sizeof(head));
+    auto payload_at = offset + sizeof(head);
+    if (payload_at + head.size > bytes.size())
+      break; // torn
+    auto crc = crc32(0, reinterpret_cast<const Bytef*>(bytes.data() + payload_at),
+                     uInt(head.size));
+    if (crc != head.crc)
+      break;
+
+    try {
+      auto raw = json::parse(bytes.begin() + payload_at,
+                             bytes.begin() + payload_at + head.size);
+      Update update;
+      update.position.strategy_id = raw["strategyid"].get<std::string>();
+      update.position.exchange = raw["exchange"].get<std::string>();
+      update.position.native_symbol = raw["symbol"].get<std::string>();
+      update.position.qty = raw["qty"].get<double>();
+      update.ts = Time(std::chrono::microseconds(raw["ts"].get<int64_t>()));
+      auto key = key_of(update.position);
+      _latest[key] = std::move(update);
+    } catch (const std::exception&) {
+      break;
+    }
+    offset = payload_at + head.size;
+    _frames++;
+  }
+
+  if (offset != bytes.size()) {
+    LOG_WARN("position log " << _path << " has " << (bytes.size() - offset)
+             << " bytes of incomplete or corrupt frames, truncating");
+    std::filesystem::resize_file(_path, offset);
+  }
+}
+
+
+void PositionLog::open_for_append()
+{
+  _fd = ::open(_path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+  if (_fd < 0)
+    THROW("cannot open position log " << _path << ": " << strerror(errno));
+}
+
+
+void PositionLog::append(const RestoredPosition& position, Time ts)
+{
+  std::unique_lock lock(_mutex);
+  Update update{position, ts};
+  _latest[key_of(position)] = update;
+  _pending.push_back(std::move(update));
+  _appended++;
+
+  if (_options.background) {
+    lock.unlock();
+    _cv.notify_all();
+    return;
+  }
+
+  std::vector<Update> batch;
+  batch.swap(_pending);
+  std::string error;
+  {
+    auto io_guard = std::scoped_lock(_io_mutex);
+    error = write_frames(batch);
+  }
+  _committed = _appended;
+  if (!error.empty()) {
+    if (_error.empty())
+      _error = std::move(error);
+    return;
+  }
+  _frames += batch.size();
+  if (wants_compaction())
+    compact_locked(lock);
+}
+
+
+/* Write and sync a group of frames; returns the error on failure.  A write
+ * that fails part way is cut back off the log, so later frames follow the
+ * last whole one and are not lost on replay. */
+std::string PositionLog::write_frames(const std::vector<Update>& updates)
+{
+  std::string buf;
+  for (auto& update : updates)
+    append_frame(buf, encode(update.position, update.ts));
+
+  std::ostringstream error;
+  const auto end = ::lseek(_fd, 0, SEEK_END);
+  if (!write_all(_fd, buf.data(), buf.size())) {
+    error << "position log write failed, " << _path << ": " << strerror(errno);
+    if (end >= 0 && ::ftruncate(_fd, end) != 0)
+      error << ", and the partial write was not removed";
+  }
+  else if (_options.fsync && ::fsync(_fd) != 0)
+    error << "position log fsync failed, " << _path << ": " << strerror(errno);
+
+  if (!error.str().empty())
+    LOG_ERROR(error.str());
+  return error.str();
+}
+
+
+bool PositionLog::wants_compaction() const
+{
+  return _frames >= _options.compact_min_frames && _frames > 4 * _latest.size();
+}
+
+
+void PositionLog::compact()
+{
+  std::unique_lock lock(_mutex);
+  compact_locked(lock);
+}
+
+
+void PositionLog::compact_locked(std::unique_lock<std::mutex>& lock)
+{
+  // Updates appended after the snapshot are also written to the compacted
+  // log, by the next commit; replaying one twice is harmless.
+  auto snapshot = _latest;
+  lock.unlock();
+
+  auto tmp_path = _path;
+  tmp_path += ".tmp";
+  {
+    auto io_guard = std::scoped_lock(_io_mutex);
+
+    std::string buf(wal_magic, sizeof(wal_magic));
+    for (auto& item : snapshot)
+      append_frame(buf, encode(item.second.position, item.second.ts));
+
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                    0644);
+    bool ok = fd >= 0 && write_all(fd, buf.data(), buf.size()) &&
+              ::fsync(fd) == 0;
+    if (fd >= 0)
+      ::close(fd);
+    if (!ok) {
+      LOG_ERROR("position log compaction failed, " << tmp_path << ": "
+                << strerror(errno));
+      lock.lock();
+      return;
+    }
+
+    std::filesystem::rename(tmp_path, _path);
+    int dir_fd = ::open(_path.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+      ::fsync(dir_fd);
+      ::close(dir_fd);
+    }
+
+    ::close(_fd);
+    open_for_append();
+  }
+
+  lock.lock();
+  _frames = snapshot.size();
+}
+
+
+void PositionLog::run()
+{
+  std::unique_lock lock(_mutex);
+  while (true) {
+    _cv.wait(lock, [this]() { return !_pending.empty() || _stop; });
+    if (_pending.empty())
+      return; // stopping, with everything committed
+
+    // everything queued while the last group was written commits together
+    std::vector<Update> batch;
+    batch.swap(_pending);
+    auto appended = _appended;
+    lock.unlock();
+    std::string error;
+    {
+      auto io_guard = std::scoped_lock(_io_mutex);
+      error = write_frames(batch);
+    }
+    lock.lock();
+
+    if (error.empty()) {
+      _frames += batch.size();
+      if (wants_compaction())
+        compact_locked(lock);
+    } else if (_error.empty()) {
+      _error = std::move(error);
+    }
+    _committed = appended;
+    _cv.notify_all();
+  }
+}
+
+
+std::vector<RestoredPosition> PositionLog::positions(
+    const std::string& strategy_id) const
+{
+  auto guard = std::scoped_lock(_mutex);
+  std::vector<RestoredPosition> result;
+  for (auto& item : _latest)
+    if (item.second.position.strategy_id == strategy_id)
+      result.push_back(item.second.position);
+  return result;
+}
+
+
+void PositionLog::sync()
+{
+  std::unique_lock lock(_mutex);
+  auto target = _appended;
+  _cv.wait(lock, [&]() { return _committed >= target; });
+  if (!_error.empty())
+    THROW(_error);
+}
+
+
+size_t PositionLog::frame_count() const
+{
+  auto guard = std::scoped_lock(_mutex);
+  return _frames;
+}
+
+} // namespace apex
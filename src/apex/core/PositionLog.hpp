@@ -0,0 +1,123 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/PersistenceService.hpp>
+#include <apex/util/Time.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace apex
+{
+
+/* Append-only, checksummed write-ahead log of instrument positions.  Each
+ * update is appended as a frame holding the size and crc32 of a JSON
+ * payload; on opening, the log is replayed to rebuild the latest position of
+ * every key, and any torn or corrupt tail left by a crash is truncated.  Once
+ * the log holds many more frames than keys it is compacted, by writing the
+ * latest positions to a new file that replaces the log.
+ *
+ * With `background` set, frames are written by a dedicated thread; updates
+ * queued while it writes are committed together, with a single fsync, so the
+ * caller never waits on the disk.  Otherwise updates are written inline. */
+class PositionLog
+{
+public:
+  struct Options {
+    // write and fsync from a background thread
+    bool background = true;
+
+    // fsync after each group of writes; without it durability is left to
+    // the OS
+    bool fsync = true;
+
+    // compact once the log holds at least this many frames, and more than
+    // four frames per key
+    size_t compact_min_frames = 4096;
+  };
+
+  PositionLog(std::filesystem::path path, Options options);
+
+  /* Commits all queued updates before returning. */
+  ~PositionLog();
+
+  PositionLog(const PositionLog&) = delete;
+  PositionLog& operator=(const PositionLog&) = delete;
+
+  void append(const RestoredPosition& position, Time ts);
+
+  /* Latest positions of a strategy, including those not yet committed. */
+  [[nodiscard]] std::vector<RestoredPosition> positions(
+      const std::string& strategy_id) const;
+
+  /* Block until every update appended so far is written, and synced if
+   * fsync is enabled.  Throws if any write or fsync of the log has failed;
+   * the failure is kept, so every later sync throws too. */
+  void sync();
+
+  /* Rewrite the log to hold only the latest position of each key. */
+  void compact();
+
+  /* Frames in the log file, including any being committed. */
+  [[nodiscard]] size_t frame_count() const;
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _path; }
+
+private:
+  struct Update {
+    RestoredPosition position;
+    Time ts;
+  };
+
+  static std::string key_of(const RestoredPosition&);
+
+  void replay();
+  void open_for_append();
+  std::string write_frames(const std::vector<Update>& updates);
+  void compact_locked(std::unique_lock<std::mutex>&);
+  bool wants_compaction() const;
+  void run();
+
+  std::filesystem::path _path;
+  Options _options;
+  int _fd = -1;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cv;
+  std::map<std::string, Update> _latest;
+  std::vector<Update> _pending;
+  uint64_t _appended = 0;  // updates appended
+  uint64_t _committed = 0; // updates written, and synced if enabled
+  std::string _error;      // first failure to write or fsync, if any
+  size_t _frames = 0;
+  bool _stop = false;
+
+  // IO is done by one thread at a time
+  std::mutex _io_mutex;
+
+  std::thread _thread;
+};
+
+} // namespace apex
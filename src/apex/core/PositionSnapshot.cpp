@@ -0,0 +1,170 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/PositionSnapshot.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/json.hpp>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+PositionSnapshot::PositionSnapshot(std::filesystem::path path,
+                                   std::string strategy_id, bool fsync)
+  : _path(std::move(path)), _strategy_id(std::move(strategy_id)), _fsync(fsync)
+{
+  load();
+}
+
+
+void PositionSnapshot::update(const RestoredPosition& position, Time ts)
+{
+  auto guard = std::scoped_lock(_mutex);
+  if (record(position, ts))
+    write();
+}
+
+
+void PositionSnapshot::update(const std::vector<RestoredPosition>& positions,
+                              Time ts)
+{
+  auto guard = std::scoped_lock(_mutex);
+  bool changed = false;
+  for (auto& position : positions)
+    changed |= record(position, ts);
+  if (changed)
+    write();
+}
+
+
+bool PositionSnapshot::exists() const
+{
+  auto guard = std::scoped_lock(_mutex);
+  return _exists;
+}
+
+
+std::vector<RestoredPosition> PositionSnapshot::positions() const
+{
+  auto guard = std::scoped_lock(_mutex);
+  std::vector<RestoredPosition> positions;
+  positions.reserve(_latest.size());
+  for (auto& item : _latest)
+    positions.push_back(item.second.position);
+  return positions;
+}
+
+
+bool PositionSnapshot::record(const RestoredPosition& position, Time ts)
+{
+  Key key(position.exchange.str(), position.native_symbol.str());
+  auto iter = _latest.find(key);
+  if (iter != _latest.end() && iter->second.position.qty == position.qty)
+    return false;
+  _latest[key] = Entry{position, ts};
+  return true;
+}
+
+
+void PositionSnapshot::load()
+{
+  if (!std::filesystem::exists(_path))
+    return;
+  _exists = true;
+
+  std::ifstream is(_path, std::ios::binary);
+  std::string bytes((std::istreambuf_iterator<char>(is)),
+                    std::istreambuf_iterator<char>());
+  json doc;
+  try {
+    doc = json::parse(bytes);
+  } catch (json::exception& e) {
+    THROW("invalid position snapshot " << _path << ": " << e.what());
+  }
+
+  for (auto& item : doc.at("positions")) {
+    Entry entry;
+    entry.position.strategy_id = _strategy_id;
+    entry.position.exchange = item.at("exchange").get_ref<const std::string&>();
+    entry.position.native_symbol =
+        item.at("symbol").get_ref<const std::string&>();
+    entry.position.qty = item.at("qty").get<double>();
+    entry.ts = Time{std::chrono::microseconds(item.at("ts").get<int64_t>())};
+    _latest[Key(entry.position.exchange.str(),
+                entry.position.native_symbol.str())] = entry;
+  }
+}
+
+
+void PositionSnapshot::write()
+{
+  json positions = json::array();
+  for (auto& item : _latest) {
+    auto& position = item.second.position;
+    json record;
+    record["exchange"] = position.exchange.str();
+    record["symbol"] = position.native_symbol.str();
+    record["qty"] = position.qty;
+    record["ts"] = item.second.ts.as_epoch_us().count(); // usec since epoch
+    positions.push_back(std::move(record));
+  }
+  json doc;
+  doc["strategyid"] = _strategy_id;
+  doc["positions"] = std::move(positions);
+  auto content = doc.dump(1);
+
+  auto tmp_path = _path;
+  tmp_path += ".tmp";
+  int fd =
+      ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0;
+  for (size_t done = 0; ok && done < content.size();) {
+    auto n = ::write(fd, content.data() + done, content.size() - done);
+    if (n < 0 && errno != EINTR)
+      ok = false;
+    else if (n > 0)
+      done += size_t(n);
+  }
+  ok = ok && (!_fsync || ::fsync(fd) == 0);
+  if (fd >= 0)
+    ::close(fd);
+  if (!ok) {
+    LOG_ERROR("position snapshot write failed, " << tmp_path << ": "
+              << strerror(errno));
+    return;
+  }
+
+  std::filesystem::rename(tmp_path, _path);
+  _exists = true;
+  if (_fsync) {
+    int dir_fd = ::open(_path.parent_path().c_str(), O_RDONLY | O_CLOEXEC);
+    if (dir_fd >= 0) {
+      ::fsync(dir_fd);
+      ::close(dir_fd);
+    }
+  }
+}
+
+} // namespace apex
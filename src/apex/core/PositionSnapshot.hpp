@@ -0,0 +1,81 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/PersistenceService.hpp>
+#include <apex/util/Time.hpp>
+
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+
+/* Latest instrument positions of one strategy, held in a single JSON
+ * document, so that restoring them is one read and parse however many
+ * instruments the strategy has traded.  The document is rewritten on each
+ * change of a position, to a temporary file renamed over the last, so a
+ * crash leaves either the old or the new document, never a torn one. */
+class PositionSnapshot
+{
+public:
+  PositionSnapshot(std::filesystem::path path, std::string strategy_id,
+                   bool fsync);
+
+  PositionSnapshot(const PositionSnapshot&) = delete;
+  PositionSnapshot& operator=(const PositionSnapshot&) = delete;
+
+  /* Whether the document exists, having been opened or written. */
+  [[nodiscard]] bool exists() const;
+
+  /* Record a position, rewriting the document if its quantity changed. */
+  void update(const RestoredPosition& position, Time ts);
+
+  /* Record many positions, as when importing, with one rewrite. */
+  void update(const std::vector<RestoredPosition>& positions, Time ts);
+
+  [[nodiscard]] std::vector<RestoredPosition> positions() const;
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _path; }
+
+private:
+  struct Entry {
+    RestoredPosition position;
+    Time ts;
+  };
+
+  using Key = std::pair<std::string, std::string>; // exchange, symbol
+
+  bool record(const RestoredPosition&, Time);
+  void load();
+  void write();
+
+  std::filesystem::path _path;
+  std::string _strategy_id;
+  bool _fsync;
+  bool _exists = false;
+
+  mutable std::mutex _mutex;
+  std::map<Key, Entry> _latest;
+};
+
+} // namespace apex
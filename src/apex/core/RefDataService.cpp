@@ -17,7 +17,9 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/core/Logger.hpp>
 #include <apex/core/RefDataService.hpp>
+#include <apex/core/RefDataSnapshot.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/model/InstrumentTable.hpp>
 #include <apex/util/Config.hpp>
 #include <apex/util/Error.hpp>
 #include <apex/util/utils.hpp>
@@ -25,6 +27,7 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <fast-cpp-csv-parser/csv.h>
 
 #include <filesystem>
+#include <optional>
 #include <set>
 
 namespace apex
@@ -43,12 +46,14 @@ std::string InstrumentQuery::to_string() const {
 RefDataService::RefDataService(Services* services, Config config)
   : _services(services)
 {
-  auto default_path = _services->paths_config().refdata;
+  // services is optional, to allow ref-data to be loaded once for sharing
+  auto default_path = _services ? _services->paths_config().refdata
+                                : Services::default_paths_config().refdata;
   default_path = default_path / "instruments" / "instruments.csv";
 
   auto filename = config.get_string("instruments_csv", default_path.string());
   try {
-    load_assets(filename);
+    load_assets(filename, config);
   }
   catch (std::exception& e) {
     LOG_ERROR("failed to initialse instrument ref-data: " << e.what());
@@ -56,13 +61,23 @@ RefDataService::RefDataService(Services* services, Config config)
   }
 }
 
+RefDataService::RefDataService(Services* services,
+                               const RefDataService& prototype)
+  : _services(services),
+    _instruments(prototype._instruments),
+    _by_symbol(prototype._by_symbol),
+    _assets(prototype._assets),
+    _notional_ccy_assets(prototype._notional_ccy_assets)
+{
+}
+
 Asset& RefDataService::find_or_create_asset(const std::string& venue,
                                             const std::string& symbol,
-                                            const std::string& precision)
+                                            int precision)
 {
   auto iter = _assets.find(symbol);
   if (iter == std::end(_assets)) {
-    Asset asset = Asset(symbol, venue, std::stoi(precision));
+    Asset asset = Asset(symbol, venue, precision);
     iter = _assets.insert({symbol, asset}).first;
   }
   return iter->second;
@@ -78,38 +93,58 @@ Asset& RefDataService::get_asset(const std::string& symbol)
   return iter->second;
 }
 
-Instrument& RefDataService::get_instrument(const std::string& symbol,
-                                           InstrumentType type)
+const Instrument& RefDataService::get_instrument(const std::string& symbol,
+                                                 InstrumentType type)
 {
   return get_instrument({symbol, "", type});
 }
 
 
-Instrument& RefDataService::get_instrument(InstrumentQuery q) {
-  std::vector<std::string> matches;
+uint64_t RefDataService::symbol_key(const std::string& symbol)
+{
+  // zero is not a valid key; a collision only adds candidates, which are
+  // checked against the query
+  auto h = uint64_t(std::hash<std::string>{}(symbol));
+  return h ? h : 1;
+}
+
 
-  for (auto& pair : _instruments) {
-    if ((pair.second.native_symbol() == q.symbol) &&
-        (q.exchange_id == ExchangeId::none|| (pair.second.exchange_id() == q.exchange_id)) &&
-        (q.type == InstrumentType::none || pair.second.type() == q.type)) {
-      matches.push_back(pair.first);
+InstrumentId RefDataService::get_instrument_id(const InstrumentQuery& q) const
+{
+  auto* candidates = _by_symbol.find(symbol_key(q.symbol));
+  std::optional<InstrumentId> found;
+  if (candidates) {
+    for (auto iid : *candidates) {
+      auto& instrument = instrument_at(iid);
+      if ((instrument.native_symbol() == q.symbol) &&
+          (q.exchange_id == ExchangeId::none || (instrument.exchange_id() == q.exchange_id)) &&
+          (q.type == InstrumentType::none || instrument.type() == q.type)) {
+        if (found)
+          THROW("multiple instruments match query " << q.to_string());
+        found = iid;
+      }
     }
   }
 
-  if (std::size(matches) == 1) {
-    return _instruments.find(matches[0])->second;
-  }
-  else if (std::size(matches) > 1) {
-    THROW("multiple instruments match query " << q.to_string());
-  } else {
+  if (!found)
     THROW("instrument not found for query " << q.to_string());
-  }
+  return *found;
+}
 
+
+const Instrument& RefDataService::get_instrument(InstrumentQuery q) {
+  return instrument_at(get_instrument_id(q));
 }
 
-Instrument& RefDataService::get_instrument(const std::string& symbol,
-                                           const std::string& exchange,
-                                           InstrumentType type)
+
+const Instrument& RefDataService::instrument_at(InstrumentId iid) const
+{
+  return InstrumentTable::instance().at(iid);
+}
+
+const Instrument& RefDataService::get_instrument(const std::string& symbol,
+                                                 const std::string& exchange,
+                                                 InstrumentType type)
 {
   return get_instrument({symbol, exchange, type});
 }
@@ -133,8 +168,9 @@ std::vector<Instrument> RefDataService::get_fx_rate_instruments(
   std::vector<Instrument> matches;
   for (auto& ccy : _notional_ccy_assets) {
     for (auto& iter : _instruments) {
-      if (iter.second.base() == i.quote() && iter.second.quote() == ccy)
-        matches.push_back(iter.second);
+      auto& instrument = instrument_at(iter.second);
+      if (instrument.base() == i.quote() && instrument.quote() == ccy)
+        matches.push_back(instrument);
     }
   }
 
@@ -142,48 +178,30 @@ std::vector<Instrument> RefDataService::get_fx_rate_instruments(
 }
 
 
-void RefDataService::load_assets(const std::string& filename)
+void RefDataService::load_assets(const std::string& filename, Config& config)
 {
-  LOG_INFO("reading ref-data csv file " << QUOTE(filename));
-  io::CSVReader<12> in(filename);
-
-  in.read_header(io::ignore_extra_column, "instId", "symbol", "type", "venue",
-                 "baseAsset", "quoteAsset", "lotQty", "tickSize", "minNotional",
-                 "minQty", "baseAssetPrecision", "quoteAssetPrecision");
-
-  std::string instId, symbol, type, venue, baseAsset, quoteAsset, lotQty,
-      tickSize, minNotional, minQty, baseAssetPrecision, quoteAssetPrecision;
+  std::vector<RefDataRow> rows;
+  bool use_snapshot = config.get_bool("use_snapshot", true);
+  auto snapshot = config.get_string("snapshot", filename + ".snapshot");
 
-  while (in.read_row(instId, symbol, type, venue, baseAsset, quoteAsset,
-                     lotQty, tickSize, minNotional, minQty, baseAssetPrecision,
-                     quoteAssetPrecision)) {
-    auto iter = _instruments.find(instId);
-
-    // create an Instrument object, even if already found
-    {
-      Asset& base = find_or_create_asset(venue, baseAsset, baseAssetPrecision);
-      Asset& quote =
-          find_or_create_asset(venue, quoteAsset, quoteAssetPrecision);
-      apex::InstrumentType instrument_type = apex::to_instrument_type(type);
-      Instrument instrument =
-        Instrument(instrument_type, instId, base, quote, symbol, venue);
-      instrument.minimum_size = std::atof(minQty.c_str());
-      instrument.minimum_notnl = std::atof(minNotional.c_str());
-      instrument.tick_size = ScaledInt(tickSize);
-      instrument.lot_size = ScaledInt(lotQty.c_str());
-
-      if (iter == std::end(_instruments)) {
-        LOG_DEBUG("Added instrument " << instrument);
-        _instruments.insert({instId, instrument});
-      } else {
-        if (iter->second == instrument) {
-          LOG_WARN("skipping duplicate instrument " << QUOTE(symbol));
-        } else {
-          THROW("ref-data symbol defined twice " << QUOTE(symbol));
-        }
+  if (use_snapshot && read_refdata_snapshot(snapshot, filename, rows)) {
+    LOG_INFO("reading ref-data snapshot " << QUOTE(snapshot));
+  } else {
+    rows = read_csv(filename);
+    if (use_snapshot) {
+      // the snapshot is only a cache, so failing to write it is not fatal
+      try {
+        write_refdata_snapshot(snapshot, filename, rows);
+        LOG_INFO("wrote ref-data snapshot " << QUOTE(snapshot));
+      } catch (std::exception& e) {
+        LOG_WARN("cannot write ref-data snapshot: " << e.what());
       }
     }
   }
+
+  for (auto& row : rows)
+    add_instrument(row);
+
   LOG_INFO("refdata loaded, " << _assets.size() << " assets, "
                               << _instruments.size() << " instruments");
 
@@ -205,4 +223,72 @@ void RefDataService::load_assets(const std::string& filename)
 }
 
 
+std::vector<RefDataRow> RefDataService::read_csv(const std::string& filename)
+{
+  LOG_INFO("reading ref-data csv file " << QUOTE(filename));
+  io::CSVReader<12> in(filename);
+
+  in.read_header(io::ignore_extra_column, "instId", "symbol", "type", "venue",
+                 "baseAsset", "quoteAsset", "lotQty", "tickSize", "minNotional",
+                 "minQty", "baseAssetPrecision", "quoteAssetPrecision");
+
+  std::string instId, symbol, type, venue, baseAsset, quoteAsset, lotQty,
+      tickSize, minNotional, minQty, baseAssetPrecision, quoteAssetPrecision;
+
+  std::vector<RefDataRow> rows;
+  while (in.read_row(instId, symbol, type, venue, baseAsset, quoteAsset,
+                     lotQty, tickSize, minNotional, minQty, baseAssetPrecision,
+                     quoteAssetPrecision)) {
+    RefDataRow row;
+    row.inst_id = instId;
+    row.symbol = symbol;
+    row.venue = venue;
+    row.base_asset = baseAsset;
+    row.quote_asset = quoteAsset;
+    row.type = apex::to_instrument_type(type);
+    row.base_precision = std::stoi(baseAssetPrecision);
+    row.quote_precision = std::stoi(quoteAssetPrecision);
+    row.tick_size = ScaledInt(tickSize);
+    row.lot_size = ScaledInt(lotQty);
+    row.min_qty = std::atof(minQty.c_str());
+    row.min_notional = std::atof(minNotional.c_str());
+    rows.push_back(std::move(row));
+  }
+  return rows;
+}
+
+
+void RefDataService::add_instrument(const RefDataRow& row)
+{
+  auto iter = _instruments.find(row.inst_id);
+
+  // create an Instrument object, even if already found
+  Asset& base = find_or_create_asset(row.venue, row.base_asset, row.base_precision);
+  Asset& quote = find_or_create_asset(row.venue, row.quote_asset, row.quote_precision);
+  Instrument instrument =
+    Instrument(row.type, row.inst_id, base, quote, row.symbol, row.venue);
+  instrument.minimum_size = row.min_qty;
+  instrument.minimum_notnl = row.min_notional;
+  instrument.tick_size = row.tick_size;
+  instrument.lot_size = row.lot_size;
+
+  if (iter == std::end(_instruments)) {
+    LOG_DEBUG("Added instrument " << instrument);
+    auto iid = InstrumentTable::instance().intern(instrument).iid();
+    _instruments.insert({row.inst_id, iid});
+    auto key = symbol_key(row.symbol);
+    if (auto* candidates = _by_symbol.find(key))
+      candidates->push_back(iid);
+    else
+      _by_symbol.insert(key, {iid});
+  } else {
+    if (instrument_at(iter->second) == instrument) {
+      LOG_WARN("skipping duplicate instrument " << QUOTE(row.symbol));
+    } else {
+      THROW("ref-data symbol defined twice " << QUOTE(row.symbol));
+    }
+  }
+}
+
+
 } // namespace apex
@@ -18,14 +18,18 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <apex/model/Instrument.hpp>
+#include <apex/util/OpenAddressMap.hpp>
+
 #include <map>
 #include <string>
+#include <vector>
 
 namespace apex
 {
 
 class Services;
 class Config;
+struct RefDataRow;
 
 
 std::ostream& operator<<(std::ostream& os, const Asset& asset);
@@ -67,35 +71,59 @@ struct InstrumentQuery {
   std::string to_string() const;
 };
 
+/* Instruments and assets loaded from the ref-data csv.  Parsed rows are
+ * cached as a binary snapshot alongside the csv (config "snapshot", by default
+ * the csv path with suffix ".snapshot"; "use_snapshot" false disables it), so
+ * later starts map the snapshot instead of parsing the csv.
+ *
+ * Instruments are interned in the InstrumentTable, so the references
+ * returned remain valid, and queries are resolved through a hash index of
+ * native symbols. */
 class RefDataService
 {
 public:
   RefDataService(Services*, Config);
 
+  /* Construct from already loaded ref-data, to avoid reloading the same files
+   * for each of many backtests in the one process. */
+  RefDataService(Services*, const RefDataService& prototype);
+
   Asset& get_asset(const std::string& symbol);
 
   std::vector<Instrument> get_fx_rate_instruments(const Instrument&);
 
-  Instrument& get_instrument(
+  const Instrument& get_instrument(
     const std::string& symbol, InstrumentType type);
 
-  Instrument& get_instrument(
+  const Instrument& get_instrument(
     const std::string& symbol, const std::string& exchange = {},
     InstrumentType type = InstrumentType::none);
 
-  Instrument& get_instrument(struct InstrumentQuery);
+  const Instrument& get_instrument(struct InstrumentQuery);
+
+  /* Id of the one instrument matching a query. */
+  InstrumentId get_instrument_id(const InstrumentQuery&) const;
+
+  const Instrument& instrument_at(InstrumentId) const;
+
+  [[nodiscard]] size_t instrument_count() const { return _instruments.size(); }
 
   [[nodiscard]] bool is_fx_rate_instrument(const Instrument&) const;
 
 private:
-  void load_assets(const std::string& filename);
+  void load_assets(const std::string& filename, Config& config);
+  std::vector<RefDataRow> read_csv(const std::string& filename);
+  void add_instrument(const RefDataRow&);
   Asset& find_or_create_asset(const std::string& venue,
                               const std::string& symbol,
-                              const std::string& precision);
+                              int precision);
+
+  static uint64_t symbol_key(const std::string&);
 
   Services* _services;
 
-  std::map<std::string, Instrument> _instruments;
+  std::map<std::string, InstrumentId> _instruments; // by instrument id
+  OpenAddressMap<std::vector<InstrumentId>> _by_symbol;
   std::map<std::string, Asset> _assets;
   std::vector<Asset> _notional_ccy_assets;
 };
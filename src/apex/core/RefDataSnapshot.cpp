@@ -0,0 +1,166 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/RefDataSnapshot.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <optional>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+// Identity of the source csv, [size, mtime], or nullopt if it cannot be read.
+static std::optional<std::pair<uint64_t, int64_t>> source_stamp(
+    const fs::path& source)
+{
+  std::error_code ec;
+  auto size = fs::file_size(source, ec);
+  if (ec)
+    return std::nullopt;
+  auto mtime = fs::last_write_time(source, ec);
+  if (ec)
+    return std::nullopt;
+  return std::make_pair(
+      uint64_t(size),
+      int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  mtime.time_since_epoch()).count()));
+}
+
+
+bool read_refdata_snapshot(const fs::path& snapshot, const fs::path& source,
+                           std::vector<RefDataRow>& rows)
+{
+  auto stamp = source_stamp(source);
+  if (!stamp || !fs::exists(snapshot))
+    return false;
+
+  MmapOptions options;
+  options.sequential = false;
+  MappedFile file(snapshot, options);
+
+  refsnap::Header header;
+  if (file.size() < sizeof(header))
+    return false;
+  memcpy(&header, file.begin(), sizeof(header));
+  if (memcmp(header.magic, refsnap::magic, sizeof(header.magic)) != 0 ||
+      header.version != refsnap::version ||
+      header.source_size != stamp->first ||
+      header.source_mtime != stamp->second)
+    return false;
+
+  const size_t rows_size = size_t(header.row_count) * sizeof(refsnap::Row);
+  if (file.size() != sizeof(header) + rows_size + header.strings_size)
+    return false;
+
+  const char* row_data = file.begin() + sizeof(header);
+  const char* strings = row_data + rows_size;
+  auto str = [&](const refsnap::StrRef& ref) {
+    if (uint64_t(ref.offset) + ref.size > header.strings_size)
+      THROW("ref-data snapshot " << snapshot << " has a bad string reference");
+    return std::string(strings + ref.offset, ref.size);
+  };
+
+  rows.clear();
+  rows.reserve(header.row_count);
+  for (uint32_t i = 0; i < header.row_count; i++) {
+    refsnap::Row rec;
+    memcpy(&rec, row_data + i * sizeof(rec), sizeof(rec));
+    RefDataRow row;
+    row.inst_id = str(rec.inst_id);
+    row.symbol = str(rec.symbol);
+    row.venue = str(rec.venue);
+    row.base_asset = str(rec.base_asset);
+    row.quote_asset = str(rec.quote_asset);
+    row.type = static_cast<InstrumentType>(rec.type);
+    row.base_precision = rec.base_precision;
+    row.quote_precision = rec.quote_precision;
+    row.tick_size = ScaledInt(rec.tick_mantissa, rec.tick_scale);
+    row.lot_size = ScaledInt(rec.lot_mantissa, rec.lot_scale);
+    row.min_qty = rec.min_qty;
+    row.min_notional = rec.min_notional;
+    rows.push_back(std::move(row));
+  }
+  return true;
+}
+
+
+void write_refdata_snapshot(const fs::path& snapshot, const fs::path& source,
+                            const std::vector<RefDataRow>& rows)
+{
+  auto stamp = source_stamp(source);
+  if (!stamp)
+    THROW("cannot stat ref-data source " << source);
+
+  std::string strings;
+  auto add = [&strings](const std::string& s) {
+    refsnap::StrRef ref{uint32_t(strings.size()), uint32_t(s.size())};
+    strings += s;
+    return ref;
+  };
+
+  std::vector<refsnap::Row> recs;
+  recs.reserve(rows.size());
+  for (auto& row : rows) {
+    refsnap::Row rec{};
+    rec.inst_id = add(row.inst_id);
+    rec.symbol = add(row.symbol);
+    rec.venue = add(row.venue);
+    rec.base_asset = add(row.base_asset);
+    rec.quote_asset = add(row.quote_asset);
+    rec.type = static_cast<int32_t>(row.type);
+    rec.base_precision = row.base_precision;
+    rec.quote_precision = row.quote_precision;
+    rec.tick_scale = row.tick_size.scale();
+    rec.tick_mantissa = row.tick_size.mantissa();
+    rec.lot_scale = row.lot_size.scale();
+    rec.lot_mantissa = row.lot_size.mantissa();
+    rec.min_qty = row.min_qty;
+    rec.min_notional = row.min_notional;
+    recs.push_back(rec);
+  }
+
+  refsnap::Header header{};
+  memcpy(header.magic, refsnap::magic, sizeof(header.magic));
+  header.version = refsnap::version;
+  header.row_count = uint32_t(recs.size());
+  header.strings_size = strings.size();
+  header.source_size = stamp->first;
+  header.source_mtime = stamp->second;
+
+  // written aside and renamed, so that readers never see a partial file
+  auto tmp = snapshot;
+  tmp += ".tmp";
+  {
+    std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+    os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    os.write(reinterpret_cast<const char*>(recs.data()),
+             recs.size() * sizeof(refsnap::Row));
+    os.write(strings.data(), strings.size());
+    if (!os)
+      THROW("failed to write ref-data snapshot " << tmp);
+  }
+  fs::rename(tmp, snapshot);
+}
+
+} // namespace apex
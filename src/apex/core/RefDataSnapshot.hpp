@@ -0,0 +1,107 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Instrument.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* One instrument row of the ref-data csv, with its numeric fields parsed. */
+struct RefDataRow {
+  std::string inst_id;
+  std::string symbol;
+  std::string venue;
+  std::string base_asset;
+  std::string quote_asset;
+  InstrumentType type = InstrumentType::none;
+  int base_precision = 0;
+  int quote_precision = 0;
+  ScaledInt tick_size;
+  ScaledInt lot_size;
+  double min_qty = 0.0;
+  double min_notional = 0.0;
+};
+
+namespace refsnap
+{
+
+/* A snapshot is a Header, then `row_count` fixed size Rows, then a blob of
+ * the strings they refer to.  The size and modification time of the csv it
+ * was built from are recorded, so that a stale snapshot is detected. */
+constexpr char magic[8] = {'A', 'P', 'E', 'X', 'R', 'E', 'F', 'S'};
+constexpr uint32_t version = 1;
+
+#pragma pack(push, 1)
+
+struct StrRef {
+  uint32_t offset; // into the string blob
+  uint32_t size;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t row_count;
+  uint64_t strings_size;
+  uint64_t source_size;
+  int64_t source_mtime; // nanoseconds, file clock
+};
+static_assert(sizeof(Header) == 40);
+
+struct Row {
+  StrRef inst_id;
+  StrRef symbol;
+  StrRef venue;
+  StrRef base_asset;
+  StrRef quote_asset;
+  int32_t type;
+  int32_t base_precision;
+  int32_t quote_precision;
+  int32_t tick_scale;
+  int64_t tick_mantissa;
+  int32_t lot_scale;
+  int32_t pad;
+  int64_t lot_mantissa;
+  double min_qty;
+  double min_notional;
+};
+static_assert(sizeof(Row) == 96);
+
+#pragma pack(pop)
+
+} // namespace refsnap
+
+
+/* Read the rows of a snapshot by mapping it into memory; returns false if
+ * the snapshot is missing, unreadable, or older than `source`. */
+bool read_refdata_snapshot(const std::filesystem::path& snapshot,
+                           const std::filesystem::path& source,
+                           std::vector<RefDataRow>& rows);
+
+/* Write a snapshot of rows read from `source`, replacing any existing one. */
+void write_refdata_snapshot(const std::filesystem::path& snapshot,
+                            const std::filesystem::path& source,
+                            const std::vector<RefDataRow>& rows);
+
+} // namespace apex
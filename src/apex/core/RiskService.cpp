@@ -0,0 +1,213 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/RiskService.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/model/Portfolio.hpp>
+#include <apex/util/Metrics.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iterator>
+
+namespace apex
+{
+
+static metrics::Counter& risk_rejects = metrics::registry().counter(
+    "apex_risk_rejects_total", "Orders and amends failing a pre-trade check");
+
+
+/* A limit of zero, like one absent from the default limits, is not applied;
+ * so an instrument can lift a default limit. */
+template <typename T>
+static void read_limit(const json& raw, const char* field, T& limit)
+{
+  auto iter = raw.find(field);
+  if (iter == raw.end())
+    return;
+  if (!iter->is_number() || iter->get<double>() < 0)
+    throw ConfigError(std::string("risk field '") + field +
+                      "' must be a non-negative number");
+
+  if (iter->get<double>() > 0)
+    limit = iter->get<T>();
+  else if constexpr (std::numeric_limits<T>::has_infinity)
+    limit = std::numeric_limits<T>::infinity();
+  else
+    limit = std::numeric_limits<T>::max();
+}
+
+
+RiskLimits RiskService::parse_limits(const json& raw, RiskLimits limits)
+{
+  read_limit(raw, "max_order_qty", limits.max_order_qty);
+  read_limit(raw, "max_notional", limits.max_notional);
+  read_limit(raw, "max_position", limits.max_position);
+  read_limit(raw, "price_band", limits.price_band);
+  read_limit(raw, "max_orders_per_sec", limits.max_orders_per_sec);
+  return limits;
+}
+
+
+RiskService::RiskService(Services* services, Config config)
+  : _services(services)
+{
+  const auto& raw = config.raw();
+  if (!raw.is_object())
+    return;
+
+  _defaults = parse_limits(raw, {});
+  read_limit(raw, "max_gross_usd", _max_gross_usd);
+  read_limit(raw, "max_net_usd", _max_net_usd);
+  auto instruments = config.get_sub_config("instruments", Config::empty_config());
+  for (auto& [id, value] : instruments.raw().items()) {
+    if (!value.is_object())
+      throw ConfigError("risk limits of instrument '" + id +
+                        "' must be an object");
+    _overrides.insert({id, parse_limits(value, _defaults)});
+  }
+
+  // instruments already known are resolved now, the rest on first use
+  if (auto size = InstrumentTable::instance().size())
+    resolve_upto(InstrumentId(size - 1));
+
+  if (!raw.empty())
+    LOG_INFO("risk checks configured, " << _overrides.size()
+                                        << " instrument overrides");
+}
+
+
+void RiskService::resolve_upto(InstrumentId iid)
+{
+  auto& table = InstrumentTable::instance();
+  size_t from = _entries.size();
+  _entries.resize(std::max<size_t>(iid + 1, table.size()));
+  for (size_t i = from; i < _entries.size(); i++) {
+    _entries[i].limits = _defaults;
+    if (i < table.size() && !_overrides.empty()) {
+      auto iter = _overrides.find(table.at(InstrumentId(i)).id());
+      if (iter != _overrides.end())
+        _entries[i].limits = iter->second;
+    }
+  }
+}
+
+
+unsigned RiskService::check(InstrumentId iid, Side side, double price,
+                            double size, double held)
+{
+  auto& e = entry(iid);
+  const auto& limits = e.limits;
+
+  // the market data of an order's instrument exists once a bot trades it;
+  // only the mid is needed
+  if (!e.market && _services->market_data_service())
+    e.market = _services->market_data_service()->find_market_data(
+        InstrumentTable::instance().at(iid),
+        MdStreamParams{static_cast<int>(MdStream::L1)});
+  double mid = e.market ? e.market->mid() : 0.0;
+
+  // one-second windows of the order rate
+  auto now = _services->now();
+  if (now - e.window_start >= std::chrono::seconds(1)) {
+    e.window_start = now;
+    e.window_count = 0;
+  }
+
+  // a position over its limit may still be reduced; the limit applies as if
+  // every order working on this side were filled too
+  double after = e.position + (side == Side::buy ? size : -size);
+  const bool reducing = std::fabs(after) < std::fabs(e.position);
+  const double exposed =
+      after + (side == Side::buy ? e.working_buy - held : held - e.working_sell);
+
+  double gross = 0.0;
+  double net = 0.0;
+  for (auto* portfolio : _portfolios) {
+    gross += portfolio->gross_exposure();
+    net += portfolio->net_exposure();
+  }
+
+  unsigned failed =
+      (risk_order_qty * unsigned(size > limits.max_order_qty)) |
+      (risk_notional * unsigned(price * size > limits.max_notional)) |
+      (risk_position * unsigned((std::fabs(exposed) > limits.max_position) &
+                                (std::fabs(exposed) > std::fabs(e.position)))) |
+      (risk_price_band * unsigned((mid > 0.0) & (std::fabs(price - mid) >
+                                                 limits.price_band * mid))) |
+      (risk_order_rate *
+       unsigned(e.window_count >= limits.max_orders_per_sec)) |
+      (risk_gross_exposure * unsigned((gross >= _max_gross_usd) & !reducing)) |
+      (risk_net_exposure *
+       unsigned(((net >= _max_net_usd) & (side == Side::buy)) |
+                ((net <= -_max_net_usd) & (side == Side::sell))));
+
+  e.window_count += (failed == 0);
+  if (failed) {
+    _rejects++;
+    risk_rejects.add();
+  }
+  return failed;
+}
+
+
+std::string RiskService::describe(unsigned failed)
+{
+  static const char* names[] = {"max_order_qty", "max_notional", "max_position",
+                                "price_band", "max_orders_per_sec",
+                                "max_gross_usd", "max_net_usd"};
+  std::string text;
+  for (unsigned i = 0; i < std::size(names); i++)
+    if (failed & (1u << i)) {
+      if (!text.empty())
+        text += ",";
+      text += names[i];
+    }
+  return text;
+}
+
+
+void RiskService::add_portfolio(const Portfolio* portfolio)
+{
+  _portfolios.push_back(portfolio);
+}
+
+
+void RiskService::remove_portfolio(const Portfolio* portfolio)
+{
+  _portfolios.erase(
+      std::remove(_portfolios.begin(), _portfolios.end(), portfolio),
+      _portfolios.end());
+}
+
+
+void RiskService::apply_fill(InstrumentId iid, Side side, double size)
+{
+  entry(iid).position += side == Side::buy ? size : -size;
+}
+
+
+void RiskService::add_position(InstrumentId iid, double qty)
+{
+  entry(iid).position += qty;
+}
+
+} // namespace apex
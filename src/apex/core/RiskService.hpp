@@ -0,0 +1,172 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Instrument.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/Order.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Time.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+class Portfolio;
+class Services;
+
+/* Limits of the pre-trade checks of one instrument; limits not configured are
+ * infinite, so never fail. */
+struct RiskLimits {
+  static constexpr double none = std::numeric_limits<double>::infinity();
+
+  double max_order_qty = none;
+  double max_notional = none; // price times qty, in the quote currency
+  double max_position = none; // absolute net position, were all orders on
+                              // the order's side, and the order, filled
+  double price_band = none;   // largest distance from the mid, as a fraction
+  uint32_t max_orders_per_sec = std::numeric_limits<uint32_t>::max();
+};
+
+/* Bits of the mask of failed checks returned by RiskService::check. */
+enum RiskCheck : unsigned {
+  risk_order_qty = 1,
+  risk_notional = 1 << 1,
+  risk_position = 1 << 2,
+  risk_price_band = 1 << 3,
+  risk_order_rate = 1 << 4,
+  risk_gross_exposure = 1 << 5,
+  risk_net_exposure = 1 << 6,
+};
+
+/* Pre-trade risk checks, applied by Order::send, Order::send_all and
+ * Order::amend before an order reaches its router, in every run mode.  An
+ * order failing a send check is closed as rejected, with error code "RISK";
+ * a failed amend is not requested.
+ *
+ * Limits are configured by the "risk" section of the services config, as
+ * defaults for all instruments, overridden field by field for those listed
+ * under "instruments" by instrument id:
+ *
+ *   "risk": { "max_order_qty": 1.0, "max_notional": 50000,
+ *             "max_position": 2.0, "price_band": 0.05,
+ *             "max_orders_per_sec": 20,
+ *             "max_gross_usd": 250000, "max_net_usd": 50000,
+ *             "instruments": { "BTCUSDT.BINANCE": { "max_position": 1.0 } } }
+ *
+ * The limits "max_gross_usd" and "max_net_usd" apply to the whole portfolio
+ * of the strategy, as totalled by its Portfolio, or, when several strategies
+ * share the services, to the sum of their portfolios.  Once gross exposure is at
+ * its limit only orders reducing their instrument's position pass; once net
+ * exposure is, only orders on the side that reduces it.  These read the
+ * running totals, so cost no more than the other checks.
+ *
+ * The limits, position and order count of each instrument are held in a flat
+ * array indexed by instrument id, resolved once per instrument, so a check is
+ * a few comparisons combined without branching.  The position is the net of
+ * the initial positions of the bots and the fills since; the position limit
+ * applies to it together with the size working on the order's side, so that
+ * orders sent before any fills cannot together exceed it.  Not thread safe;
+ * used on the event thread. */
+class RiskService
+{
+public:
+  static constexpr const char* reject_code = "RISK";
+
+  RiskService(Services*, Config);
+
+  /* Check an order of `size` at `price`; returns zero if it passes, else the
+   * mask of the failed RiskCheck values.  A passing order counts towards the
+   * order rate.  The position limit counts the working size on the order's
+   * side, less `held`, what the order being checked already holds there, as
+   * when it is amended. */
+  unsigned check(InstrumentId, Side, double price, double size,
+                 double held = 0.0);
+
+  /* Describe a mask of failed checks, e.g. "max_order_qty,price_band". */
+  static std::string describe(unsigned failed);
+
+  /* Totals checked by the portfolio limits; added by each Strategy. */
+  void add_portfolio(const Portfolio*);
+  void remove_portfolio(const Portfolio*);
+
+  void apply_fill(InstrumentId, Side, double size);
+
+  /* Add the initial position of a bot; bots trading the same instrument,
+   * for one strategy or several, each add theirs. */
+  void add_position(InstrumentId, double qty);
+  double position(InstrumentId iid) { return entry(iid).position; }
+
+  /* Add to, or when negative release from, the unfilled size of the orders
+   * working on one side; held by each Order from send until filled or
+   * closed. */
+  void add_working(InstrumentId iid, Side side, double size)
+  {
+    auto& e = entry(iid);
+    (side == Side::buy ? e.working_buy : e.working_sell) += size;
+  }
+  double working(InstrumentId iid, Side side)
+  {
+    auto& e = entry(iid);
+    return side == Side::buy ? e.working_buy : e.working_sell;
+  }
+
+  const RiskLimits& limits(InstrumentId iid) { return entry(iid).limits; }
+  void set_limits(InstrumentId iid, RiskLimits limits)
+  {
+    entry(iid).limits = limits;
+  }
+
+  [[nodiscard]] uint64_t rejects() const { return _rejects; }
+
+private:
+  struct Entry {
+    RiskLimits limits;
+    MarketData* market = nullptr;
+    double position = 0.0;
+    double working_buy = 0.0;
+    double working_sell = 0.0;
+    Time window_start;
+    uint32_t window_count = 0;
+  };
+
+  Entry& entry(InstrumentId iid)
+  {
+    if (iid >= _entries.size())
+      resolve_upto(iid);
+    return _entries[iid];
+  }
+
+  void resolve_upto(InstrumentId);
+  static RiskLimits parse_limits(const json&, RiskLimits defaults);
+
+  Services* _services;
+  RiskLimits _defaults;
+  double _max_gross_usd = RiskLimits::none;
+  double _max_net_usd = RiskLimits::none;
+  std::vector<const Portfolio*> _portfolios;
+  std::map<std::string, RiskLimits> _overrides;
+  std::vector<Entry> _entries;
+  uint64_t _rejects = 0;
+};
+
+} // namespace apex
@@ -15,6 +15,8 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <apex/core/BarService.hpp>
+#include <apex/core/FxRateService.hpp>
 #include <apex/core/GatewayService.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/core/MarketDataService.hpp>
@@ -22,24 +24,64 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/OrderService.hpp>
 #include <apex/core/PersistenceService.hpp>
 #include <apex/core/RefDataService.hpp>
+#include <apex/core/RiskService.hpp>
 #include <apex/core/Services.hpp>
 #include <apex/infra/IoLoop.hpp>
+#include <apex/util/AllocGuard.hpp>
 #include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/Metrics.hpp>
+#include <apex/util/Numa.hpp>
+#include <apex/util/Profiler.hpp>
 #include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/util/TaskPool.hpp>
+#include <apex/util/ThreadParams.hpp>
 #include <apex/util/BacktestEventLoop.hpp>
 #include <apex/core/BacktestService.hpp>
 
+#include <sstream>
+
 
 namespace apex
 {
 
+/* Threads config field "mode" selects whether the EV and IO loops have their
+ * own threads ("separate", the default), or whether the event loop is driven
+ * from the IO thread ("fused"). */
+static bool is_fused_mode(Config threads_config)
+{
+  auto mode = threads_config.get_string("mode", "separate");
+  if (mode == "separate")
+    return false;
+  else if (mode == "fused")
+    return true;
+  else {
+    std::ostringstream oss;
+    oss << "invalid threads mode " << QUOTE(mode);
+    throw ConfigError(oss.str());
+  }
+}
+
+
 std::unique_ptr<EventLoop> construct_event_loop(RunMode run_mode,
-                                                Time backtest_time_start) {
+                                                Time backtest_time_start,
+                                                Config threads_config,
+                                                const ShardInfo& shard) {
   if (run_mode == RunMode::backtest) {
     return std::make_unique<BacktestEventLoop>(backtest_time_start);
   }
   else {
-    return std::make_unique<RealtimeEventLoop>(
+    auto ev_config = threads_config.get_sub_config("ev", Config::empty_config());
+    auto thread_params = parse_thread_params(ev_config);
+    auto options = parse_event_loop_options(ev_config);
+    const bool fused = is_fused_mode(threads_config);
+    options.own_thread = !fused;
+    std::string thread_name = "ev";
+    if (shard.is_sharded())
+      thread_name += std::to_string(shard.index);
+    auto evloop = std::make_unique<RealtimeEventLoop>(
+              options,
               [](){
                 try {
                   throw;
@@ -53,11 +95,63 @@ std::unique_ptr<EventLoop> construct_event_loop(RunMode run_mode,
                 }
                 return false; // dont terminate the eventloop
               },
-              [] { apex::Logger::instance().register_thread_id("ev"); });
+              [thread_params, fused, thread_name] {
+                // in fused mode the IO thread is already named & scheduled
+                if (fused) {
+                  LOG_INFO("event loop running on the IO thread");
+                  return;
+                }
+                apex::Logger::instance().register_thread_id(thread_name);
+                try_apply_thread_params(thread_params, thread_name.c_str());
+              });
+
+    // optionally log the event loop instrumentation, per interval
+    auto stats_interval =
+        std::chrono::seconds(ev_config.get_uint("stats_log_sec", 0));
+    if (options.instrument && stats_interval.count() > 0) {
+      auto ptr = evloop.get();
+      evloop->dispatch(stats_interval,
+                       [ptr, stats_interval]() -> std::chrono::milliseconds {
+                         LOG_INFO("ev stats: " << ptr->stats(true));
+                         return stats_interval;
+                       });
+    }
+    return evloop;
   }
 }
 
-static PathsConfig default_paths_config() {
+
+static std::unique_ptr<IoLoop> construct_io_loop(Config threads_config)
+{
+  // the IO loop is constructed first, so placement applies to all of the
+  // service threads, and the memory of the loops constructed here
+  numa::configure(threads_config);
+
+  auto io_config = threads_config.get_sub_config("io", Config::empty_config());
+  auto thread_params = parse_thread_params(io_config);
+  auto ioloop = std::make_unique<IoLoop>(
+      [thread_params] { try_apply_thread_params(thread_params, "io"); });
+  ioloop->enable_io_uring(parse_io_uring_options(io_config));
+  ioloop->enable_busy_poll(parse_busy_poll_options(io_config));
+  return ioloop;
+}
+
+/* Threads config field "tasks" sets the number of task pool threads, default
+ * one, as "threads", and the optional scheduling parameters of each. */
+static std::unique_ptr<TaskPool> construct_task_pool(RunMode run_mode,
+                                                     EventLoop* evloop,
+                                                     Config threads_config)
+{
+  if (run_mode == RunMode::backtest)
+    return std::make_unique<TaskPool>(evloop, 0);
+
+  auto tasks_config = threads_config.get_sub_config("tasks", Config::empty_config());
+  return std::make_unique<TaskPool>(evloop, tasks_config.get_uint("threads", 1),
+                                    parse_thread_params(tasks_config));
+}
+
+
+PathsConfig Services::default_paths_config() {
   PathsConfig config;
   config.root = apex_home();
   config.refdata = apex_home() / "data"/ "refdata";
@@ -77,26 +171,53 @@ static Time calc_startup_time(RunMode run_mode,
 
 
 Services::Services(RunMode run_mode,
-                   BacktestPeriod backtest_period)
+                   BacktestPeriod backtest_period,
+                   Config threads_config,
+                   ShardInfo shard)
   : _run_mode(run_mode),
+    _shard(shard),
     _paths_config{default_paths_config()},
     _startup_time(calc_startup_time(run_mode, backtest_period)),
-    _ioloop(std::make_unique<IoLoop>()),
-    _evloop(construct_event_loop(run_mode, backtest_period.from)),
+    _ioloop(construct_io_loop(threads_config)),
+    _evloop(construct_event_loop(run_mode, backtest_period.from,
+                                 threads_config, _shard)),
     _bt_evloop(dynamic_cast<BacktestEventLoop*>(_evloop.get())),
+    _task_pool(construct_task_pool(run_mode, _evloop.get(), threads_config)),
     _backtest_period(backtest_period)
 {
+  if (_shard.count == 0 || _shard.index >= _shard.count)
+    THROW("invalid shard " << _shard.index << " of " << _shard.count);
+
+  if (run_mode != RunMode::backtest && is_fused_mode(threads_config))
+    _ioloop->attach_event_loop(realtime_evloop());
 }
 
 
 Services::~Services()
 {
   /* assumed called on main thread */
+
+  // the context clock reads this instance, so must not outlive it
+  if (_log_context && Logger::thread_context() == _log_context)
+    Logger::set_thread_context(nullptr);
+
+  _task_pool.reset();
   _ioloop->sync_stop();
   _evloop->sync_stop();
 }
 
 
+void Services::set_shared_backtest_data(
+  std::shared_ptr<const SharedBacktestData> shared)
+{
+  if (!is_backtest())
+    throw std::runtime_error("shared backtest data requires RunMode::backtest");
+  if (_ref_data_service)
+    throw std::runtime_error("shared backtest data must be set before init_services");
+  _shared_backtest_data = std::move(shared);
+}
+
+
 const char* Services::build_datetime()  {
   return __DATE__ " - " __TIME__;
 }
@@ -115,13 +236,27 @@ void Services::init_services(Config config)
   Logger::instance().log_banner(_run_mode);
 
   // initialise logging; do this very early on, so that for backtest mode
-  // the logging timestamps always refect the backtest time
+  // the logging timestamps always refect the backtest time.  When sharing
+  // the process with other backtests, this instance has a logging context of
+  // its own, selected on its threads, with its clock and optionally its own
+  // "log_file", so that instances neither share a clock nor contend on the
+  // process-wide output.
   if (is_backtest()) {
     auto clock_source = [this](){
       return this->now();
     };
 
-    Logger::instance().set_clock_source(clock_source);
+    auto log_file = config.get_string("log_file", "");
+    if (_shared_backtest_data || !log_file.empty()) {
+      _log_context = log_file.empty()
+        ? std::make_shared<LogContext>(clock_source)
+        : LogContext::to_file(clock_source, log_file);
+      Logger::set_thread_context(_log_context);
+      _ioloop->push_fn(
+        [context = _log_context]() { Logger::set_thread_context(context); });
+    }
+    else
+      Logger::instance().set_clock_source(clock_source);
   }
 
   _config = config;
@@ -141,22 +276,47 @@ void Services::init_services(Config config)
 
   _order_router_service = std::make_unique<OrderRouterService>(this);
 
-  _ref_data_service =
+  if (_shared_backtest_data && _shared_backtest_data->ref_data)
+    _ref_data_service = std::make_unique<RefDataService>(
+        this, *_shared_backtest_data->ref_data);
+  else
+    _ref_data_service =
       std::make_unique<RefDataService>(this, config.get_sub_config("ref_data", Config::empty_config()));
 
   _persistence_service = std::make_unique<PersistenceService>(this);
 
   _order_service = std::make_unique<OrderService>(this);
 
+  _risk_service = std::make_unique<RiskService>(
+      this, config.get_sub_config("risk", Config::empty_config()));
+
   if (_run_mode != RunMode::backtest) {
     _gateway_service =
       std::make_unique<GatewayService>(this, config.get_sub_config("gateways", Config::empty_config()));
   }
 
-  _market_data_service = std::make_unique<MarketDataService>(this);
+  _market_data_service = std::make_unique<MarketDataService>(
+      this, config.get_sub_config("market_data", Config::empty_config()));
+
+  _fx_rate_service = std::make_unique<FxRateService>(
+      this, config.get_sub_config("fx_rates", Config::empty_config()));
+
+  _bar_service = std::make_unique<BarService>(
+      this, config.get_sub_config("bars", Config::empty_config()));
+
+  if (_run_mode != RunMode::backtest) {
+    trace::configure(config, *_evloop);
+    metrics::configure(config, *_evloop);
+    profile::configure(config, *_evloop);
+    memory::configure_report(config, *_evloop);
+  }
+  alloc::configure(config);
 }
 
 
+metrics::Registry& Services::metrics() { return metrics::registry(); }
+
+
 Time Services::now() {
   if (_run_mode == RunMode::live || _run_mode == RunMode::paper)
     return Time::realtime_now();
@@ -36,8 +36,18 @@ class RefDataService;
 class PersistenceService;
 class GatewayService;
 class MarketDataService;
+class FxRateService;
+class BarService;
 class OrderRouterService;
+class RiskService;
 class BacktestService;
+class TickFileCache;
+class TaskPool;
+class LogContext;
+namespace metrics
+{
+class Registry;
+}
 
 struct BacktestPeriod {
   Time from;
@@ -61,13 +71,35 @@ struct PathsConfig
   std::filesystem::path fdb;
 };
 
+/* Position of a Services instance among the shards of a strategy that is
+ * partitioned across several event loops (see StrategyMain); a lone
+ * instance is shard 0 of 1. */
+struct ShardInfo
+{
+  size_t index = 0;
+  size_t count = 1;
+
+  [[nodiscard]] bool is_sharded() const { return count > 1; }
+};
+
+/* Read-only resources that can be shared between many backtest Services
+ * instances within one process, e.g. by a parameter sweep, to avoid each run
+ * reloading ref-data and tick files. */
+struct SharedBacktestData
+{
+  std::shared_ptr<const RefDataService> ref_data;
+  std::shared_ptr<TickFileCache> tick_cache;
+};
+
 /* Responsible for creating and providing access to the various core
  * components and services required by all apex application components. */
 class Services
 {
 public:
   explicit Services(RunMode run_mode,
-                    BacktestPeriod backtest_period={});
+                    BacktestPeriod backtest_period={},
+                    Config threads_config = Config::empty_config(),
+                    ShardInfo shard = {});
   ~Services();
 
   static const char* build_datetime();
@@ -78,6 +110,19 @@ public:
 
   const PathsConfig& paths_config() const { return _paths_config; }
 
+  const ShardInfo& shard() const { return _shard; }
+
+  static PathsConfig default_paths_config();
+
+  /* Use resources shared with other backtest Services instances; must be
+   * called before init_services. */
+  void set_shared_backtest_data(std::shared_ptr<const SharedBacktestData>);
+
+  const SharedBacktestData* shared_backtest_data() const
+  {
+    return _shared_backtest_data.get();
+  }
+
   /* Utility method used to create and init services with minimal config */
   static std::unique_ptr<Services> create(RunMode run_mode,
                                           BacktestPeriod backtest_period={});
@@ -88,6 +133,9 @@ public:
 
   OrderRouterService* order_router_service() { return _order_router_service.get(); }
 
+  /* Pre-trade checks of all orders sent; see RiskService. */
+  RiskService* risk_service() { return _risk_service.get(); }
+
   BacktestService* backtest_service() { return _backtest_service.get(); }
 
   PersistenceService* persistence_service()
@@ -100,11 +148,27 @@ public:
     return _market_data_service.get();
   }
 
+  /* Conflated FX rates used to convert to the notional currency; see
+   * FxRateService. */
+  FxRateService* fx_rate_service() { return _fx_rate_service.get(); }
+
+  /* Bars of instruments, shared by all bots; see BarService. */
+  BarService* bar_service() { return _bar_service.get(); }
+
   GatewayService* gateway_service() { return _gateway_service.get(); }
 
   IoLoop* ioloop() { return _ioloop.get(); }
   EventLoop* evloop() { return _evloop.get(); }
 
+  /* Worker threads for computation off the event thread; in backtest the
+   * pool has no threads, and runs tasks inline. */
+  TaskPool* task_pool() { return _task_pool.get(); }
+
+  /* Runtime metrics of the process, fed by the IO and event loops, GX
+   * sessions, exchange sessions and the order service; exported as set by
+   * the "metrics" config, see metrics::configure. */
+  metrics::Registry& metrics();
+
   Time now();
 
   [[nodiscard]] RunMode run_mode() const { return _run_mode; }
@@ -125,22 +189,29 @@ public:
 
 private:
   RunMode _run_mode;
+  ShardInfo _shard;
   Config _config;
   PathsConfig _paths_config;
   Time _startup_time;
   std::unique_ptr<IoLoop> _ioloop;
   std::unique_ptr<EventLoop> _evloop;
   BacktestEventLoop* _bt_evloop;
+  std::unique_ptr<TaskPool> _task_pool;
   std::unique_ptr<OrderRouterService> _order_router_service;
   std::unique_ptr<RefDataService> _ref_data_service;
   std::unique_ptr<PersistenceService> _persistence_service;
   std::unique_ptr<OrderService> _order_service;
+  std::unique_ptr<RiskService> _risk_service;
 
   std::unique_ptr<GatewayService> _gateway_service;
   std::unique_ptr<MarketDataService> _market_data_service;
+  std::unique_ptr<FxRateService> _fx_rate_service;
+  std::unique_ptr<BarService> _bar_service;
   std::unique_ptr<BacktestService> _backtest_service;
 
   BacktestPeriod _backtest_period;
+  std::shared_ptr<const SharedBacktestData> _shared_backtest_data;
+  std::shared_ptr<LogContext> _log_context;
 };
 
 
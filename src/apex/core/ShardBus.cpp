@@ -0,0 +1,131 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/ShardBus.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/EventLoop.hpp>
+
+#include <future>
+
+namespace apex
+{
+
+// messages handled per dispatch, so that one busy sender cannot starve the
+// receiving event loop
+static constexpr size_t drain_batch = 256;
+
+
+ShardBus::ShardBus(size_t shard_count, size_t inbox_capacity)
+{
+  if (shard_count == 0)
+    THROW("ShardBus requires at least one shard");
+  for (size_t i = 0; i < shard_count; i++)
+    _inboxes.push_back(std::make_unique<Inbox>(inbox_capacity));
+}
+
+
+ShardBus::~ShardBus() = default;
+
+
+void ShardBus::attach(size_t shard, EventLoop* evloop, handler_fn handler)
+{
+  auto& inbox = *_inboxes.at(shard);
+  inbox.evloop = evloop;
+  inbox.handler = std::move(handler);
+}
+
+
+void ShardBus::detach(size_t shard)
+{
+  auto& inbox = *_inboxes.at(shard);
+  if (!inbox.evloop)
+    return;
+
+  if (inbox.evloop->this_thread_is_ev()) {
+    inbox.handler = nullptr;
+    return;
+  }
+
+  std::promise<void> done;
+  inbox.evloop->dispatch([&]() {
+    inbox.handler = nullptr;
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+
+bool ShardBus::post(size_t to, const ShardMessage& msg)
+{
+  auto& inbox = *_inboxes.at(to);
+  if (!inbox.evloop)
+    THROW("no event loop attached for shard " << to);
+
+  ShardMessage copy = msg;
+  if (!inbox.queue.try_push(std::move(copy))) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  schedule(inbox);
+  return true;
+}
+
+
+size_t ShardBus::broadcast(const ShardMessage& msg)
+{
+  size_t accepted = 0;
+  for (size_t i = 0; i < _inboxes.size(); i++)
+    if (i != msg.from && post(i, msg))
+      accepted++;
+  return accepted;
+}
+
+
+void ShardBus::schedule(Inbox& inbox)
+{
+  // one dispatch is outstanding per inbox, however many messages are queued;
+  // the fences pair with those in drain(), so that either the drain sees the
+  // message queued, or the poster sees the flag cleared
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!inbox.scheduled.exchange(true))
+    inbox.evloop->dispatch(EventLoop::inline_fn([this, &inbox]() { drain(inbox); }));
+}
+
+
+void ShardBus::drain(Inbox& inbox)
+{
+  ShardMessage msg;
+  for (size_t i = 0; i < drain_batch && inbox.queue.try_pop(msg); i++) {
+    if (!inbox.handler)
+      continue;
+    try {
+      inbox.handler(msg);
+    } catch (const std::exception& e) {
+      LOG_ERROR("shard message handler failed: " << e.what());
+    }
+  }
+
+  // a message queued after the last pop, but before the flag is cleared,
+  // would otherwise wait for the next post
+  inbox.scheduled.store(false);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (!inbox.queue.empty())
+    schedule(inbox);
+}
+
+} // namespace apex
@@ -0,0 +1,131 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Instrument.hpp>
+#include <apex/util/MpscQueue.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace apex
+{
+
+class EventLoop;
+
+/* Message passed between the shards of a strategy.  The meaning of `type`,
+ * and of the values, is up to the strategy; e.g. a shard might periodically
+ * report its net and gross USD position. */
+struct ShardMessage {
+  size_t from = 0; // sending shard
+  int type = 0;
+  InstrumentId iid = no_instrument_id;
+  std::array<double, 4> values = {};
+};
+
+
+/* Bounded messaging between the shards of a strategy, each of which runs on
+ * its own event loop.  Every shard has an inbox, a fixed size MPSC ring, so
+ * posting never allocates or blocks; if the inbox is full the message is
+ * refused instead, and counted as dropped.  Messages are delivered, in the
+ * order posted by each sender, to the handler of the receiving shard, on that
+ * shard's event loop and in batches, with one event loop dispatch per batch.
+ * The bus must outlive the event loops it delivers to. */
+class ShardBus
+{
+public:
+  using handler_fn = std::function<void(const ShardMessage&)>;
+
+  explicit ShardBus(size_t shard_count, size_t inbox_capacity = 4096);
+  ~ShardBus();
+
+  ShardBus(const ShardBus&) = delete;
+  ShardBus& operator=(const ShardBus&) = delete;
+
+  /* Set the event loop and handler of a shard; must be done before messages
+   * are posted to it. */
+  void attach(size_t shard, EventLoop*, handler_fn);
+
+  /* Remove the handler of a shard, waiting until its event loop, which must
+   * still be running, has done so; messages delivered later are discarded.
+   * Call before destroying the object the handler refers to. */
+  void detach(size_t shard);
+
+  /* Queue a message for a shard; returns false if its inbox is full.  Can be
+   * called from any thread. */
+  bool post(size_t to, const ShardMessage&);
+
+  /* Post to every shard other than the sender; returns the number of shards
+   * that accepted the message. */
+  size_t broadcast(const ShardMessage&);
+
+  [[nodiscard]] size_t shard_count() const { return _inboxes.size(); }
+
+  /* Messages refused because an inbox was full. */
+  [[nodiscard]] uint64_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+  struct Inbox {
+    explicit Inbox(size_t capacity) : queue(capacity) {}
+    MpscQueue<ShardMessage> queue;
+    std::atomic<bool> scheduled{false};
+    EventLoop* evloop = nullptr;
+    handler_fn handler;
+  };
+
+  void schedule(Inbox&);
+  void drain(Inbox&);
+
+  std::vector<std::unique_ptr<Inbox>> _inboxes;
+  std::atomic<uint64_t> _dropped{0};
+};
+
+
+/* Portfolio level totals of metrics reported by each shard, such as net USD
+ * position or risk; holds the latest values reported by every shard, and sums
+ * them.  Not thread safe; normally updated from a ShardBus handler. */
+class ShardTotals
+{
+public:
+  using values_type = std::array<double, 4>;
+
+  explicit ShardTotals(size_t shard_count) : _values(shard_count, values_type{}) {}
+
+  /* Record the values of the sending shard. */
+  void update(const ShardMessage& msg) { update(msg.from, msg.values); }
+  void update(size_t shard, const values_type& values) { _values.at(shard) = values; }
+
+  [[nodiscard]] const values_type& of(size_t shard) const { return _values.at(shard); }
+
+  [[nodiscard]] double total(size_t metric) const
+  {
+    double sum = 0.0;
+    for (auto& values : _values)
+      sum += values.at(metric);
+    return sum;
+  }
+
+private:
+  std::vector<values_type> _values;
+};
+
+} // namespace apex
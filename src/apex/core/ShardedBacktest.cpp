@@ -0,0 +1,643 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/ShardedBacktest.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/core/Auditor.hpp>
+#include <apex/core/BacktestResultCache.hpp>
+#include <apex/core/BacktestService.hpp>
+#include <apex/core/Bot.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/RefDataService.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/core/StrategyMain.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <thread>
+#include <tuple>
+
+namespace apex
+{
+
+namespace fs = std::filesystem;
+
+static BacktestRunResult::BotResult make_bot_result(const Bot& bot)
+{
+  BacktestRunResult::BotResult bot_result;
+  bot_result.symbol = bot.instrument().native_symbol();
+  bot_result.exchange = bot.instrument().exchange_name();
+  bot_result.net_qty = bot.position().net_qty();
+  bot_result.net_position_usd = bot.net_position_usd();
+  bot_result.pnl_usd = bot.pnl_usd();
+  return bot_result;
+}
+
+
+// Add the audit transaction files written to a shard directory.
+static void find_audit_files(const fs::path& dir, std::vector<fs::path>& files)
+{
+  if (fs::is_directory(dir))
+    for (auto& entry : fs::directory_iterator(dir)) {
+      auto name = entry.path().filename().string();
+      if (name.rfind("audit-transactions-", 0) == 0 &&
+          entry.path().extension() == ".csv")
+        files.push_back(entry.path());
+    }
+}
+
+
+// Copy of the services config with the persist and auditor paths of a shard,
+// and, unless given, its own log file.
+static Config shard_services_config(const Config& services_config,
+                                    const fs::path& dir)
+{
+  json services_raw = services_config.raw();
+  if (!services_raw.is_object())
+    services_raw = json::object();
+  services_raw["persist"]["path"] = (dir / "persist").string();
+  services_raw["auditor"]["transactions_dir"] = dir.string();
+  if (!services_raw.contains("log_file"))
+    services_raw["log_file"] = (dir / "apex.log").string();
+  return Config{services_raw};
+}
+
+
+std::ostream& operator<<(std::ostream& os, const ShardedBacktestResult& result)
+{
+  os << "sharded backtest, " << result.shards.size() << " shards";
+  if (!result.ok)
+    return os << ", failed";
+
+  os << ", pnl_usd: " << format_double(result.pnl_usd, true)
+     << ", fills: " << result.fills
+     << ", fill_value_usd: " << format_double(result.fill_value_usd, true)
+     << ", order_events: " << result.order_events
+     << ", elapsed_ms: " << result.elapsed.count();
+  return os;
+}
+
+
+ShardedBacktest::ShardedBacktest(const StrategyFactoryBase& factory,
+                                 ShardedBacktestOptions options)
+  : _factory(factory),
+    _options(std::move(options))
+{
+  if (_options.shards == 0)
+    throw ConfigError("sharded backtest needs at least one shard");
+  if (_options.work_dir.empty())
+    _options.work_dir = apex_home() / "backtest" /
+      Time::realtime_now().strftime("%Y%m%d_%H%M%S");
+}
+
+
+std::filesystem::path ShardedBacktest::shard_dir(size_t index) const
+{
+  return _options.work_dir / ("shard-" + std::to_string(index));
+}
+
+
+ShardedBacktestResult ShardedBacktest::run(Config strategy_config)
+{
+  // load the read-only resources shared by all shards
+  auto shared = std::make_shared<SharedBacktestData>();
+  shared->ref_data = std::make_shared<const RefDataService>(
+      nullptr,
+      _options.services_config.get_sub_config("ref_data",
+                                              Config::empty_config()));
+  shared->tick_cache = std::make_shared<TickFileCache>();
+
+  size_t thread_count = _options.threads;
+  if (thread_count == 0)
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  thread_count = std::min(thread_count, _options.shards);
+
+  LOG_NOTICE("sharded backtest: " << _options.shards << " shards, "
+             << thread_count << " threads, work-dir " << _options.work_dir);
+
+  ShardedBacktestResult result;
+  result.shards.resize(_options.shards);
+  auto started = std::chrono::steady_clock::now();
+
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers.emplace_back([&, i]() {
+      Logger::instance().register_thread_id("shard" + std::to_string(i));
+      for (size_t j = next++; j < _options.shards; j = next++)
+        result.shards[j] = run_shard(j, strategy_config, shared);
+    });
+  }
+
+  for (auto& worker : workers)
+    worker.join();
+
+  // combine the shards, in shard order, so the totals are reproducible
+  result.ok = true;
+  std::vector<fs::path> audit_files;
+  for (auto& shard : result.shards) {
+    result.ok = result.ok && shard.ok;
+    result.pnl_usd += shard.pnl_usd;
+    result.order_events += shard.order_events;
+    result.fills += shard.fills;
+    result.fill_value_usd += shard.fill_value_usd;
+    result.bots.insert(result.bots.end(), shard.bots.begin(), shard.bots.end());
+
+    find_audit_files(shard_dir(shard.index), audit_files);
+  }
+  std::sort(result.bots.begin(), result.bots.end(),
+            [](const BacktestRunResult::BotResult& lhs,
+               const BacktestRunResult::BotResult& rhs) {
+              return std::tie(lhs.exchange, lhs.symbol) <
+                     std::tie(rhs.exchange, rhs.symbol);
+            });
+
+  if (!audit_files.empty()) {
+    result.audit_file = _options.work_dir / "audit-transactions.csv";
+    auto rows = merge_audit_files(audit_files, result.audit_file);
+    LOG_INFO("merged " << rows << " audit transactions into "
+             << result.audit_file);
+  }
+
+  result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started);
+
+  if (result.ok)
+    LOG_NOTICE(result);
+  else
+    LOG_ERROR(result);
+  return result;
+}
+
+
+BacktestRunResult ShardedBacktest::run_shard(
+  size_t index, const Config& strategy_config,
+  std::shared_ptr<const SharedBacktestData> shared)
+{
+  BacktestRunResult result;
+  result.index = index;
+  result.label = std::to_string(index);
+
+  auto started = std::chrono::steady_clock::now();
+  try {
+    auto services = std::make_unique<Services>(
+        RunMode::backtest, _options.period, Config::empty_config(),
+        ShardInfo{index, _options.shards});
+    services->set_shared_backtest_data(std::move(shared));
+    services->init_services(
+        shard_services_config(_options.services_config, shard_dir(index)));
+
+    // each shard gets its own copy of the config
+    Config shard_config = strategy_config;
+    auto strategy = _factory.create(shard_config, services.get());
+    if (!strategy)
+      throw std::runtime_error(
+        "strategy factory did not create a strategy instance");
+
+    strategy->create_bots();
+    strategy->init_bots();
+
+    services->run();
+
+    for (auto& item : strategy->bots()) {
+      if (!item.second)
+        continue;
+      auto bot_result = make_bot_result(*item.second);
+      if (std::isfinite(bot_result.pnl_usd))
+        result.pnl_usd += bot_result.pnl_usd;
+      result.bots.push_back(std::move(bot_result));
+    }
+
+    if (auto auditor = strategy->auditor()) {
+      result.order_events = auditor->summary().order_events;
+      result.fills = auditor->summary().fills;
+      result.fill_value_usd = auditor->summary().fill_value_usd;
+      auto performance = auditor->performance();
+      result.max_drawdown_usd = performance.max_drawdown_usd;
+      result.sharpe = performance.sharpe;
+      result.fill_ratio = performance.fill_ratio();
+    }
+
+    // closes the audit file, ready to be merged
+    strategy.reset();
+    result.ok = true;
+  }
+  catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  catch (...) {
+    result.error = "unknown exception";
+  }
+
+  result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started);
+
+  if (result.ok)
+    LOG_INFO("backtest shard " << result);
+  else
+    LOG_ERROR("backtest shard " << result);
+
+  return result;
+}
+
+
+std::vector<TimeShard> plan_time_shards(const BacktestPeriod& period,
+                                        std::chrono::seconds shard_length,
+                                        std::chrono::seconds warmup)
+{
+  if (shard_length.count() <= 0)
+    throw ConfigError("time shard length must be positive");
+  if (warmup.count() < 0)
+    throw ConfigError("time shard warm-up cannot be negative");
+
+  std::vector<TimeShard> shards;
+  Time from = period.from;
+  do {
+    TimeShard shard;
+    shard.from = from;
+    shard.upto = from;
+    shard.upto += shard_length;
+    if (shard.upto > period.upto)
+      shard.upto = period.upto;
+
+    // the first shard starts as a serial run would, without warm-up
+    shard.warmup_from = from;
+    if (!shards.empty())
+      shard.warmup_from -= warmup;
+
+    shards.push_back(shard);
+    from = shard.upto;
+  } while (from < period.upto);
+  return shards;
+}
+
+
+TimeShardedBacktest::TimeShardedBacktest(const StrategyFactoryBase& factory,
+                                         TimeShardedBacktestOptions options)
+  : _factory(factory),
+    _options(std::move(options))
+{
+  _shards = plan_time_shards(_options.period, _options.shard_length,
+                             _options.warmup);
+  if (_options.work_dir.empty())
+    _options.work_dir = apex_home() / "backtest" /
+      Time::realtime_now().strftime("%Y%m%d_%H%M%S");
+
+  if (!_options.result_cache_dir.empty()) {
+    if (_options.carry_positions)
+      throw ConfigError(
+        "a backtest result cache requires carry_positions to be off");
+    _cache = std::make_unique<BacktestResultCache>(_options.result_cache_dir);
+  }
+}
+
+
+TimeShardedBacktest::~TimeShardedBacktest() = default;
+
+
+std::filesystem::path TimeShardedBacktest::shard_dir(size_t index) const
+{
+  return _options.work_dir / ("shard-" + std::to_string(index));
+}
+
+
+ShardedBacktestResult TimeShardedBacktest::run(Config strategy_config)
+{
+  auto shared = std::make_shared<SharedBacktestData>();
+  shared->ref_data = std::make_shared<const RefDataService>(
+      nullptr,
+      _options.services_config.get_sub_config("ref_data",
+                                              Config::empty_config()));
+  shared->tick_cache = std::make_shared<TickFileCache>();
+
+  size_t thread_count = _options.threads;
+  if (thread_count == 0)
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  thread_count = std::min(thread_count, _shards.size());
+
+  LOG_NOTICE("time sharded backtest: " << _shards.size() << " shards of "
+             << _options.shard_length.count() << "s, warm-up "
+             << _options.warmup.count() << "s, " << thread_count
+             << " threads, work-dir " << _options.work_dir);
+
+  ShardedBacktestResult result;
+  result.shards.resize(_shards.size());
+  _reruns = 0;
+  auto started = std::chrono::steady_clock::now();
+
+  // every shard starts flat, in parallel
+  std::atomic<size_t> next{0};
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers.emplace_back([&, i]() {
+      Logger::instance().register_thread_id("shard" + std::to_string(i));
+      for (size_t j = next++; j < _shards.size(); j = next++)
+        result.shards[j] = run_shard(j, strategy_config, shared, false);
+    });
+  }
+  for (auto& worker : workers)
+    worker.join();
+
+  // then, in order, a shard whose predecessor ended holding a position is run
+  // again from that position
+  if (_options.carry_positions)
+    for (size_t j = 1; j < _shards.size(); j++) {
+      auto& prev = result.shards[j - 1];
+      bool holding = std::any_of(
+          prev.bots.begin(), prev.bots.end(),
+          [](const BacktestRunResult::BotResult& bot) {
+            return bot.net_qty != 0.0;
+          });
+      if (prev.ok && holding) {
+        result.shards[j] = run_shard(j, strategy_config, shared, true);
+        _reruns++;
+      }
+    }
+
+  // stitch the shards, in time order
+  result.ok = true;
+  std::vector<fs::path> audit_files;
+  std::map<std::pair<std::string, std::string>, BacktestRunResult::BotResult>
+      bots;
+  for (auto& shard : result.shards) {
+    result.ok = result.ok && shard.ok;
+    result.pnl_usd += shard.pnl_usd;
+    result.order_events += shard.order_events;
+    result.fills += shard.fills;
+    result.fill_value_usd += shard.fill_value_usd;
+    for (auto& bot : shard.bots) {
+      auto [iter, inserted] = bots.try_emplace({bot.exchange, bot.symbol}, bot);
+      if (!inserted) {
+        iter->second.pnl_usd += bot.pnl_usd;
+        iter->second.net_qty = bot.net_qty;
+        iter->second.net_position_usd = bot.net_position_usd;
+      }
+    }
+    find_audit_files(shard_dir(shard.index), audit_files);
+  }
+  for (auto& item : bots)
+    result.bots.push_back(std::move(item.second));
+
+  if (!audit_files.empty()) {
+    result.audit_file = _options.work_dir / "audit-transactions.csv";
+    auto rows = merge_audit_files(audit_files, result.audit_file);
+    LOG_INFO("merged " << rows << " audit transactions into "
+             << result.audit_file);
+  }
+
+  result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started);
+
+  if (_cache)
+    LOG_NOTICE("backtest result cache " << _cache->dir() << ", hits: "
+               << _cache->hits() << ", misses: " << _cache->misses());
+
+  if (result.ok)
+    LOG_NOTICE(result << ", reruns: " << _reruns);
+  else
+    LOG_ERROR(result);
+  return result;
+}
+
+
+BacktestRunResult TimeShardedBacktest::run_shard(
+  size_t index, const Config& strategy_config,
+  std::shared_ptr<const SharedBacktestData> shared, bool carry)
+{
+  const auto& shard = _shards[index];
+
+  BacktestRunResult result;
+  result.index = index;
+  result.label = shard.from.as_iso8601();
+
+  auto started = std::chrono::steady_clock::now();
+  try {
+    // a re-run replaces the output of the first run, and starts from the
+    // positions persisted by the previous shard
+    auto dir = shard_dir(index);
+    fs::remove_all(dir);
+    if (carry) {
+      fs::create_directories(dir);
+      fs::copy(shard_dir(index - 1) / "persist", dir / "persist",
+               fs::copy_options::recursive);
+    }
+
+    auto services = std::make_unique<Services>(
+        RunMode::backtest, BacktestPeriod{shard.warmup_from, shard.upto});
+    services->set_shared_backtest_data(std::move(shared));
+    services->init_services(
+        shard_services_config(_options.services_config, dir));
+
+    // the warm-up replaces any synthetic warm-up of the strategy
+    Config shard_config = strategy_config;
+    if (shard.warmup_from < shard.from) {
+      json raw = strategy_config.raw();
+      auto until = shard.from.as_iso8601(Time::Resolution::milli);
+      until.pop_back(); // the 'Z'
+      raw["warmup"] = json{{"until", until}};
+      shard_config = Config{raw};
+    }
+
+    auto strategy = _factory.create(shard_config, services.get());
+    if (!strategy)
+      throw std::runtime_error(
+        "strategy factory did not create a strategy instance");
+
+    strategy->create_bots();
+
+    // bots with a cached result for the shard are not replayed
+    std::map<InstrumentId, std::string> cache_keys;
+    std::vector<std::string> cached;
+    if (_cache) {
+      std::vector<InstrumentId> hits;
+      for (auto& item : strategy->bots()) {
+        auto& instrument = item.second->instrument();
+        auto key = BacktestResultCache::make_key(
+            strategy->bot_config(instrument), instrument, shard);
+        if (auto entry = _cache->find(key)) {
+          if (std::isfinite(entry->bot.pnl_usd))
+            result.pnl_usd += entry->bot.pnl_usd;
+          result.order_events += entry->audit.order_events;
+          result.fills += entry->audit.fills;
+          result.fill_value_usd += entry->audit.fill_value_usd;
+          result.bots.push_back(std::move(entry->bot));
+          cached.push_back(key);
+          hits.push_back(item.first);
+        }
+        else
+          cache_keys[item.first] = key;
+      }
+      for (auto iid : hits)
+        strategy->remove_bot(iid);
+    }
+
+    std::map<InstrumentId, CachedBotResult> to_store;
+    if (!_cache || !strategy->bots().empty()) {
+      strategy->init_bots();
+
+      // the price at the shard start, to mark a carried position
+      std::map<InstrumentId, double> start_price;
+      auto delay =
+          std::max(shard.from.as_epoch_ms() - services->now().as_epoch_ms(),
+                   std::chrono::milliseconds{0});
+      services->evloop()->dispatch(delay, [&]() {
+        for (auto& item : strategy->bots())
+          if (item.second && item.second->has_last_price())
+            start_price[item.first] = item.second->last_price();
+        return std::chrono::milliseconds{0};
+      });
+
+      services->run();
+
+      auto* auditor = strategy->auditor();
+      for (auto& item : strategy->bots()) {
+        if (!item.second)
+          continue;
+        const Bot& bot = *item.second;
+        auto bot_result = make_bot_result(bot);
+
+        const auto& position = bot.position();
+        double carried =
+            position.net_qty() - (position.buy_qty() - position.sell_qty());
+        auto iter = start_price.find(item.first);
+        if (carried != 0.0 && iter != start_price.end() &&
+            bot.has_last_price() && bot.has_fx_rate())
+          bot_result.pnl_usd +=
+              carried * (bot.last_price() - iter->second) * bot.fx_rate();
+
+        if (cache_keys.count(item.first)) {
+          auto& entry = to_store[item.first];
+          entry.bot = bot_result;
+          if (auditor)
+            entry.audit = auditor->summary(item.first);
+          for (auto& fn :
+               services->backtest_service()->tick_files(bot.instrument()))
+            entry.tick_files.push_back(FileFingerprint::of(fn));
+        }
+
+        if (std::isfinite(bot_result.pnl_usd))
+          result.pnl_usd += bot_result.pnl_usd;
+        result.bots.push_back(std::move(bot_result));
+      }
+
+      if (auditor) {
+        result.order_events += auditor->summary().order_events;
+        result.fills += auditor->summary().fills;
+        result.fill_value_usd += auditor->summary().fill_value_usd;
+      }
+    }
+
+    strategy.reset(); // closes the audit file
+
+    if (_cache) {
+      std::vector<fs::path> audit_files;
+      find_audit_files(dir, audit_files);
+      for (auto& [iid, entry] : to_store)
+        _cache->store(cache_keys[iid], shard, entry, audit_files);
+
+      // the audit transactions of the cached bots join those of the shard
+      fs::create_directories(dir);
+      for (size_t i = 0; i < cached.size(); i++)
+        if (auto fn = _cache->audit_file(cached[i]); !fn.empty())
+          fs::copy_file(fn, dir / ("audit-transactions-cached-" +
+                                   std::to_string(i) + ".csv"));
+    }
+
+    result.ok = true;
+  }
+  catch (const std::exception& e) {
+    result.error = e.what();
+  }
+  catch (...) {
+    result.error = "unknown exception";
+  }
+
+  result.elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    std::chrono::steady_clock::now() - started);
+
+  if (result.ok)
+    LOG_INFO("backtest time shard " << result);
+  else
+    LOG_ERROR("backtest time shard " << result);
+
+  return result;
+}
+
+
+size_t merge_audit_files(const std::vector<std::filesystem::path>& inputs,
+                         const std::filesystem::path& output)
+{
+  struct Input {
+    std::ifstream is;
+    std::string line;
+    bool has_line = false;
+
+    void next() { has_line = bool(std::getline(is, line)); }
+
+    // the time is the first column, written in a fixed width format, so
+    // times compare as strings
+    std::string_view time() const
+    {
+      std::string_view view{line};
+      return view.substr(0, view.find(','));
+    }
+  };
+
+  std::vector<Input> files(inputs.size());
+  std::string header;
+  for (size_t i = 0; i < inputs.size(); i++) {
+    files[i].is.open(inputs[i]);
+    if (!files[i].is)
+      THROW("cannot open audit file " << inputs[i]);
+    files[i].next();
+    if (files[i].has_line && header.empty())
+      header = files[i].line;
+    files[i].next();
+  }
+
+  std::ofstream os(output, std::ofstream::out | std::ofstream::trunc);
+  if (!os)
+    THROW("cannot create audit file " << output);
+  os << header << "\n";
+
+  // few inputs, one per shard, so a linear scan for the earliest row is
+  // cheaper than a heap
+  size_t rows = 0;
+  while (true) {
+    Input* earliest = nullptr;
+    for (auto& file : files)
+      if (file.has_line && (!earliest || file.time() < earliest->time()))
+        earliest = &file;
+    if (!earliest)
+      break;
+    os << earliest->line << "\n";
+    earliest->next();
+    rows++;
+  }
+
+  os.close();
+  if (os.fail())
+    THROW("failed to write audit file " << output);
+  return rows;
+}
+
+} // namespace apex
@@ -0,0 +1,220 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/BacktestSweep.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/util/Config.hpp>
+
+#include <chrono>
+#include <filesystem>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class BacktestResultCache;
+class StrategyFactoryBase;
+
+struct ShardedBacktestOptions
+{
+  BacktestPeriod period;
+
+  // Services config applied to every shard; the "persist" and "auditor"
+  // paths are overridden so that each shard writes to its own directory,
+  // where it also logs, unless "log_file" is given.
+  Config services_config = Config::empty_config();
+
+  // Number of shards the bots are partitioned into, by instrument id.
+  size_t shards = 2;
+
+  // Number of worker threads; zero selects the hardware concurrency.
+  size_t threads = 0;
+
+  // Root directory for per-shard and merged output, defaults to
+  // APEX_HOME/backtest/<time>.
+  std::filesystem::path work_dir;
+};
+
+
+struct ShardedBacktestResult
+{
+  bool ok = false;
+
+  // totals over all shards
+  double pnl_usd = 0.0;
+  size_t order_events = 0;
+  size_t fills = 0;
+  double fill_value_usd = 0.0;
+
+  std::chrono::milliseconds elapsed{0};
+
+  // one result per shard, in shard order; the label is the shard index
+  std::vector<BacktestRunResult> shards;
+
+  // bots of all shards, ordered by exchange and symbol
+  std::vector<BacktestRunResult::BotResult> bots;
+
+  // audit transactions of all shards, merged in time order; empty if the
+  // auditor does not write CSV
+  std::filesystem::path audit_file;
+};
+
+std::ostream& operator<<(std::ostream&, const ShardedBacktestResult&);
+
+
+/* Backtest of a strategy whose bots are independent of each other, with the
+ * bots partitioned into shards that are replayed in parallel.  Each shard has
+ * its own Services, and so its own BacktestEventLoop, tick replayers and
+ * simulated exchange, and runs the bots of the instruments whose id modulo
+ * the shard count is its index, as for a live sharded strategy.  Read-only
+ * ref-data and tick files are shared by the shards.
+ *
+ * A shard only sees its own events and has no ShardBus, so the result of each
+ * shard, and hence of the whole backtest, does not depend on thread timing or
+ * on the number of threads.  Bots that rely on each other, e.g. through
+ * strategy-wide state, must not be run this way. */
+class ShardedBacktest
+{
+public:
+  ShardedBacktest(const StrategyFactoryBase&, ShardedBacktestOptions);
+
+  /* Run all shards of the strategy, blocking until complete.  The result is
+   * not ok if any shard failed; the error is held by that shard's result. */
+  ShardedBacktestResult run(Config strategy_config);
+
+private:
+  BacktestRunResult run_shard(size_t index, const Config& strategy_config,
+                              std::shared_ptr<const SharedBacktestData>);
+
+  std::filesystem::path shard_dir(size_t index) const;
+
+  const StrategyFactoryBase& _factory;
+  ShardedBacktestOptions _options;
+};
+
+
+struct TimeShardedBacktestOptions
+{
+  BacktestPeriod period;
+
+  // Services config applied to every shard; the "persist" and "auditor"
+  // paths are overridden so that each shard writes to its own directory,
+  // where it also logs, unless "log_file" is given.
+  Config services_config = Config::empty_config();
+
+  // Length of each shard of the period, from its start; the last shard may
+  // be shorter.
+  std::chrono::seconds shard_length = std::chrono::hours(24);
+
+  // Market data replayed ahead of each shard but the first, with the
+  // strategy in a warm-up (see Strategy::init_bots), so that its indicators
+  // are rebuilt by the shard start; no warm-up order reaches the exchange.
+  std::chrono::seconds warmup = std::chrono::hours(1);
+
+  // Start each shard with the positions the previous shard ended with, as
+  // for a serial run, else start every shard flat.
+  bool carry_positions = true;
+
+  // Number of worker threads; zero selects the hardware concurrency.
+  size_t threads = 0;
+
+  // Root directory for per-shard and merged output, defaults to
+  // APEX_HOME/backtest/<time>.
+  std::filesystem::path work_dir;
+
+  // If set, the directory of a BacktestResultCache: a bot whose result for a
+  // shard is cached is not replayed, and the results of the bots replayed
+  // are added.  A carried position is not part of the cache key, so this
+  // requires carry_positions to be off.
+  std::filesystem::path result_cache_dir;
+};
+
+
+/* Shard of a backtest period; events from `warmup_from` up to `from` only
+ * warm up the strategy. */
+struct TimeShard
+{
+  Time warmup_from;
+  Time from;
+  Time upto;
+};
+
+std::vector<TimeShard> plan_time_shards(const BacktestPeriod&,
+                                        std::chrono::seconds shard_length,
+                                        std::chrono::seconds warmup);
+
+
+/* Backtest of one strategy over a long period, with the period split into
+ * shards of time, e.g. days, that are replayed in parallel, so that a month
+ * takes about as long as its longest day.  Each shard has its own Services,
+ * as for ShardedBacktest, and is preceded by a warm-up of market data.
+ *
+ * Shards are first all run flat.  With carry_positions, a shard whose
+ * predecessor ended holding a position is then run again, in order, starting
+ * from the persisted positions of its predecessor; so a strategy that is flat
+ * at each shard boundary costs no re-runs, while one that always holds
+ * inventory degrades to a serial run.  A carried position is marked at the
+ * shard start, as priced by the warm-up, so its revaluation over the shard
+ * is counted in the shard's pnl.
+ *
+ * Results are stitched in time order: pnl and fills are summed over the
+ * shards, a bot's final position is that of its last shard, and the audit
+ * transactions of the shards are merged.  State other than positions, e.g.
+ * of bots and of the simulated exchange, is rebuilt only as far as the
+ * warm-up allows, so results can differ from a serial run near the shard
+ * boundaries. */
+class TimeShardedBacktest
+{
+public:
+  TimeShardedBacktest(const StrategyFactoryBase&, TimeShardedBacktestOptions);
+  ~TimeShardedBacktest();
+
+  /* Run all shards, blocking until complete.  The result is not ok if any
+   * shard failed; the error is held by that shard's result. */
+  ShardedBacktestResult run(Config strategy_config);
+
+  /* Number of shards run again to carry positions, by the last run(). */
+  [[nodiscard]] size_t reruns() const { return _reruns; }
+
+private:
+  BacktestRunResult run_shard(size_t index, const Config& strategy_config,
+                              std::shared_ptr<const SharedBacktestData>,
+                              bool carry);
+
+  std::filesystem::path shard_dir(size_t index) const;
+
+  const StrategyFactoryBase& _factory;
+  TimeShardedBacktestOptions _options;
+  std::vector<TimeShard> _shards;
+  std::unique_ptr<BacktestResultCache> _cache;
+  size_t _reruns = 0;
+};
+
+
+/* Merge audit transaction CSV files, each in time order, into `output`, in
+ * time order.  Rows of equal time are taken from the inputs in the order
+ * given, so the output is the same for the same inputs.  Returns the number
+ * of rows written. */
+size_t merge_audit_files(const std::vector<std::filesystem::path>& inputs,
+                         const std::filesystem::path& output);
+
+} // namespace apex
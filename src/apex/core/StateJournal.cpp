@@ -0,0 +1,303 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/StateJournal.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/Instrument.hpp>
+#include <apex/util/Error.hpp>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+namespace
+{
+constexpr uint32_t journal_magic = 0x4c4e524a; // "JRNL"
+constexpr uint32_t journal_version = 1;
+constexpr size_t header_size = 4096;
+
+constexpr size_t max_id_size =
+    decltype(StateJournal::OrderRecord::order_id)::capacity;
+} // namespace
+
+
+struct StateJournal::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t order_slots;
+  uint32_t position_slots;
+  uint32_t order_record_size;
+  uint32_t position_record_size;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::is_trivially_copyable_v<StateJournal::OrderRecord>);
+static_assert(std::is_trivially_copyable_v<StateJournal::PositionRecord>);
+
+
+StateJournal::StateJournal(std::filesystem::path path, std::string strategy_id,
+                           Options options)
+  : _path(std::move(path)),
+    _strategy_id(std::move(strategy_id))
+{
+  _fd = ::open(_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (_fd == -1)
+    THROW("cannot open state journal " << _path << ": " << strerror(errno));
+  if (::flock(_fd, LOCK_EX | LOCK_NB) == -1) {
+    int err = errno;
+    ::close(_fd);
+    THROW("cannot lock state journal " << _path << ", which may be in use: "
+          << strerror(err));
+  }
+
+  struct stat st;
+  if (::fstat(_fd, &st) == -1) {
+    int err = errno;
+    ::close(_fd);
+    THROW("cannot stat state journal " << _path << ": " << strerror(err));
+  }
+
+  // an existing journal keeps its own slot counts
+  const bool is_new = st.st_size == 0;
+  if (!is_new) {
+    Header header{};
+    if (size_t(st.st_size) < header_size ||
+        ::pread(_fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != journal_magic || header.version != journal_version ||
+        header.order_record_size != sizeof(OrderSlot) ||
+        header.position_record_size != sizeof(PositionSlot)) {
+      ::close(_fd);
+      THROW("invalid state journal " << _path);
+    }
+    options.order_slots = header.order_slots;
+    options.position_slots = header.position_slots;
+  }
+
+  _mapped_size = header_size + options.order_slots * sizeof(OrderSlot) +
+                 options.position_slots * sizeof(PositionSlot);
+  if (size_t(st.st_size) != _mapped_size &&
+      (!is_new || ::ftruncate(_fd, _mapped_size) == -1)) {
+    int err = errno;
+    ::close(_fd);
+    THROW("state journal " << _path << " has the wrong size: "
+          << strerror(err));
+  }
+
+  _addr = ::mmap(nullptr, _mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                 _fd, 0);
+  if (_addr == MAP_FAILED) {
+    int err = errno;
+    ::close(_fd);
+    THROW("mmap failed for state journal " << _path << ": " << strerror(err));
+  }
+
+  auto* base = static_cast<char*>(_addr);
+  _header = reinterpret_cast<Header*>(base);
+  _orders = reinterpret_cast<OrderSlot*>(base + header_size);
+  _positions = reinterpret_cast<PositionSlot*>(
+      base + header_size + options.order_slots * sizeof(OrderSlot));
+
+  // a new file is zero filled, so every slot is free and unwritten
+  if (is_new) {
+    _header->order_slots = options.order_slots;
+    _header->position_slots = options.position_slots;
+    _header->order_record_size = sizeof(OrderSlot);
+    _header->position_record_size = sizeof(PositionSlot);
+    _header->version = journal_version;
+    std::atomic_thread_fence(std::memory_order_release);
+    _header->magic = journal_magic;
+  }
+
+  recover();
+  LOG_INFO("state journal " << _path << ", open orders: "
+           << open_orders().size() << ", positions: " << _position_count
+           << ", torn slots: " << _torn);
+}
+
+
+StateJournal::~StateJournal()
+{
+  ::munmap(_addr, _mapped_size);
+  ::close(_fd);
+}
+
+
+template <typename T> void StateJournal::write(Slot<T>& slot, const T& record)
+{
+  const uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(static_cast<void*>(&slot.record), &record, sizeof(T));
+  slot.seq.store(seq + 2, std::memory_order_release);
+}
+
+
+template <typename T>
+bool StateJournal::read(const Slot<T>& slot, T& record)
+{
+  const uint64_t seq = slot.seq.load(std::memory_order_acquire);
+  if (seq & 1)
+    return false;
+  std::memcpy(static_cast<void*>(&record), &slot.record, sizeof(T));
+  return true;
+}
+
+
+void StateJournal::recover()
+{
+  const uint32_t order_slots = _header->order_slots;
+  _order_slots.reserve(order_slots);
+  _free_order_slots.reserve(order_slots);
+
+  // free slots are taken lowest first
+  for (uint32_t i = order_slots; i-- > 0;) {
+    OrderRecord record;
+    if (!read(_orders[i], record)) {
+      _torn++;
+      write(_orders[i], OrderRecord{});
+      _free_order_slots.push_back(i);
+    } else if (record.handle && record.state != OrderState::closed)
+      _order_slots.insert(record.handle, i);
+    else
+      _free_order_slots.push_back(i);
+  }
+
+  for (uint32_t i = 0; i < _header->position_slots; i++) {
+    PositionRecord record;
+    if (!read(_positions[i], record)) {
+      _torn++;
+      _position_count = i + 1;
+      continue;
+    }
+    if (record.native_symbol.empty())
+      break;
+    std::string key = record.exchange.str() + "/" + record.native_symbol.str();
+    _position_slots.insert_or_assign(std::move(key), i);
+    _position_count = i + 1;
+  }
+}
+
+
+void StateJournal::record_order(const Order& order, uint64_t handle, Time time)
+{
+  auto* slot = _order_slots.find(handle);
+  if (order.is_closed() || order.order_id().size() > max_id_size) {
+    if (slot) {
+      write(_orders[*slot], OrderRecord{});
+      _free_order_slots.push_back(*slot);
+      _order_slots.erase(handle);
+    }
+    return;
+  }
+
+  if (!slot) {
+    if (_free_order_slots.empty()) {
+      LOG_WARN("state journal full, order " << order.order_id()
+               << " not journaled");
+      return;
+    }
+    slot = &_order_slots.insert(handle, _free_order_slots.back());
+    _free_order_slots.pop_back();
+  }
+
+  OrderRecord record{};
+  record.handle = handle;
+  record.order_id = order.order_id();
+  if (order.ext_order_id().size() <= max_id_size)
+    record.ext_order_id = order.ext_order_id();
+  record.exchange = order.instrument().exchange_name();
+  record.native_symbol = order.instrument().native_symbol();
+  record.size = order.size();
+  record.price = order.price();
+  record.filled = order.filled_size();
+  record.time_us = time.as_epoch_us().count();
+  record.side = order.side();
+  record.tif = order.time_in_force();
+  record.state = order.state();
+  write(_orders[*slot], record);
+}
+
+
+uint32_t StateJournal::position_slot(const Instrument& instrument)
+{
+  std::string key =
+      instrument.exchange_name() + "/" + instrument.native_symbol();
+  auto iter = _position_slots.find(key);
+  if (iter != _position_slots.end())
+    return iter->second;
+
+  if (_position_count == _header->position_slots)
+    THROW("state journal " << _path << " has no free position slots");
+  const uint32_t slot = _position_count++;
+  PositionRecord record{};
+  record.exchange = instrument.exchange_name();
+  record.native_symbol = instrument.native_symbol();
+  write(_positions[slot], record);
+  _position_slots.emplace(std::move(key), slot);
+  return slot;
+}
+
+
+void StateJournal::record_position(uint32_t slot, double qty, Time time)
+{
+  // the slot's key is unchanged, so only the values are rewritten
+  PositionRecord record;
+  std::memcpy(static_cast<void*>(&record), &_positions[slot].record,
+              sizeof(record));
+  record.qty = qty;
+  record.time_us = time.as_epoch_us().count();
+  write(_positions[slot], record);
+}
+
+
+std::vector<StateJournal::OrderRecord> StateJournal::open_orders() const
+{
+  std::vector<OrderRecord> records;
+  for (uint32_t i = 0; i < _header->order_slots; i++) {
+    OrderRecord record;
+    if (read(_orders[i], record) && record.handle &&
+        record.state != OrderState::closed)
+      records.push_back(record);
+  }
+  return records;
+}
+
+
+std::vector<RestoredPosition> StateJournal::positions() const
+{
+  std::vector<RestoredPosition> positions;
+  for (uint32_t i = 0; i < _position_count; i++) {
+    PositionRecord record;
+    if (!read(_positions[i], record) || record.native_symbol.empty())
+      continue;
+    RestoredPosition position;
+    position.strategy_id = _strategy_id;
+    position.exchange = record.exchange;
+    position.native_symbol = record.native_symbol;
+    position.qty = record.qty;
+    positions.push_back(std::move(position));
+  }
+  return positions;
+}
+
+} // namespace apex
@@ -0,0 +1,144 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Order.hpp>
+#include <apex/core/PersistenceService.hpp>
+#include <apex/util/FixedString.hpp>
+#include <apex/util/OpenAddressMap.hpp>
+#include <apex/util/Time.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class Instrument;
+
+/* Memory-mapped journal of the live orders and positions of one strategy,
+ * from which a restarted engine rehydrates its OrderService and bots without
+ * waiting on the exchange.  The file holds fixed arrays of order and
+ * position slots; an order takes a slot when it is first sent, and frees it
+ * once closed, and a position keeps its slot for the life of the file.
+ *
+ * Each slot is written as a sequence lock: its sequence number is made odd,
+ * a release fence orders the record after it, and the number is made even
+ * again with a release store.  A write is thus a few stores to mapped
+ * memory, with no system call; the kernel writes the pages back, so the
+ * journal survives a crash of the process, though not of the host.  On
+ * opening, records are read with acquire loads, and a slot left odd by a
+ * crash mid-write is discarded.
+ *
+ * Not thread safe: there is a single writer, the strategy's event thread.
+ * The file is locked while open, so that two engines cannot share it. */
+class StateJournal
+{
+public:
+  struct Options {
+    uint32_t order_slots = 4096;
+    uint32_t position_slots = 1024;
+  };
+
+  struct OrderRecord {
+    uint64_t handle; // see OrderService; zero for a free slot
+    FixedString<63> order_id;
+    FixedString<63> ext_order_id;
+    FixedString<31> exchange;
+    FixedString<31> native_symbol;
+    double size;
+    double price;
+    double filled;
+    int64_t time_us;
+    Side side;
+    TimeInForce tif;
+    OrderState state;
+  };
+
+  struct PositionRecord {
+    FixedString<31> exchange;
+    FixedString<31> native_symbol;
+    double qty;
+    int64_t time_us;
+  };
+
+  StateJournal(std::filesystem::path path, std::string strategy_id,
+               Options options);
+  ~StateJournal();
+
+  StateJournal(const StateJournal&) = delete;
+  StateJournal& operator=(const StateJournal&) = delete;
+
+  /* Record the state of an order, by its handle; a closed order frees its
+   * slot.  If every slot is taken the order is not journaled. */
+  void record_order(const Order&, uint64_t handle, Time);
+
+  /* Slot of the position of an instrument, taken on first use. */
+  uint32_t position_slot(const Instrument&);
+
+  void record_position(uint32_t slot, double qty, Time);
+
+  /* Open orders found in the journal when it was opened, less those since
+   * closed. */
+  [[nodiscard]] std::vector<OrderRecord> open_orders() const;
+
+  /* Latest positions held in the journal. */
+  [[nodiscard]] std::vector<RestoredPosition> positions() const;
+
+  /* Slots discarded on opening, having been torn by a crash. */
+  [[nodiscard]] size_t torn_slots() const { return _torn; }
+
+  [[nodiscard]] const std::filesystem::path& path() const { return _path; }
+  [[nodiscard]] const std::string& strategy_id() const { return _strategy_id; }
+
+private:
+  struct Header;
+  template <typename T> struct Slot {
+    std::atomic<uint64_t> seq;
+    T record;
+  };
+  using OrderSlot = Slot<OrderRecord>;
+  using PositionSlot = Slot<PositionRecord>;
+
+  template <typename T> static void write(Slot<T>&, const T&);
+  template <typename T> static bool read(const Slot<T>&, T&);
+
+  void recover();
+
+  std::filesystem::path _path;
+  std::string _strategy_id;
+  int _fd = -1;
+  void* _addr = nullptr;
+  size_t _mapped_size = 0;
+  Header* _header = nullptr;
+  OrderSlot* _orders = nullptr;
+  PositionSlot* _positions = nullptr;
+
+  // used by the writer, built from the file on opening
+  OpenAddressMap<uint32_t> _order_slots; // by handle
+  std::vector<uint32_t> _free_order_slots;
+  std::map<std::string, uint32_t, std::less<>> _position_slots;
+  uint32_t _position_count = 0;
+  size_t _torn = 0;
+};
+
+} // namespace apex
@@ -0,0 +1,126 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/core/Bot.hpp>
+#include <apex/util/AllocGuard.hpp>
+#include <apex/util/Profiler.hpp>
+
+#include <type_traits>
+
+namespace apex
+{
+
+/* Base for a bot whose handlers are called directly, rather than virtually:
+ *
+ *   class MyBot final : public StaticBot<MyBot> { ...
+ *     void on_tick_book(MarketData::EventType) override;
+ *
+ * Market and order events reach `Derived` through a single listener, which
+ * calls its handlers non-virtually, so that these can be inlined into the tick
+ * path.  Handlers that `Derived` does not define are skipped, and without an
+ * on_tick_book the bot is not notified of top of book ticks at all.  Trades
+ * and bars are always received, to mark the bot's position.  The handlers
+ * must be accessible to StaticBot, and not overloaded. */
+template <typename Derived> class StaticBot : public Bot
+{
+public:
+  StaticBot(const std::string& bot_typename, Strategy* strategy,
+            const Instrument& instrument)
+    : Bot(bot_typename, strategy, instrument)
+  {
+    _listener = &_static_listener;
+    _listen_mask = MarketData::EventType::trade | MarketData::EventType::bar;
+    if (defines(&Derived::on_tick_book))
+      _listen_mask |= MarketData::EventType::top;
+    _order_callbacks = &StaticBot::static_order_callbacks;
+  }
+
+private:
+  // whether a handler is declared by Derived, rather than inherited from Bot
+  template <typename C, typename... A>
+  static constexpr bool defines(void (C::*)(A...))
+  {
+    return !std::is_same_v<C, Bot>;
+  }
+
+  struct Listener final : MarketData::Listener {
+    explicit Listener(Derived* b) : bot(b) {}
+
+    void on_market_event(MarketData::EventType event_type) override
+    {
+      if (event_type.is_trade() || event_type.is_bar())
+        bot->revalue();
+      if (bot->is_stopping())
+        return;
+
+      if constexpr (defines(&Derived::on_bar)) {
+        if (event_type.is_bar()) {
+          APEX_PROFILE_ZONE("Bot::on_bar");
+          bot->Derived::on_bar(bot->market().last_bar());
+        }
+      }
+      if constexpr (defines(&Derived::on_tick_trade)) {
+        if (event_type.is_trade()) {
+          APEX_PROFILE_ZONE("Bot::on_tick_trade");
+          APEX_NO_ALLOC_SCOPE("Bot::on_tick_trade");
+          bot->Derived::on_tick_trade(event_type);
+        }
+      }
+      if constexpr (defines(&Derived::on_tick_book)) {
+        if (event_type.is_top()) {
+          APEX_PROFILE_ZONE("Bot::on_tick_book");
+          APEX_NO_ALLOC_SCOPE("Bot::on_tick_book");
+          bot->Derived::on_tick_book(event_type);
+        }
+      }
+    }
+
+    Derived* bot;
+  };
+  Listener _static_listener{static_cast<Derived*>(this)};
+
+  static void static_order_callbacks(Bot& base, const OrderEvent& ev)
+  {
+    auto& bot = static_cast<Derived&>(base);
+    if constexpr (defines(&Derived::on_order_fill)) {
+      if (ev.is_fill())
+        bot.Derived::on_order_fill(*ev.order);
+    }
+    if constexpr (defines(&Derived::on_order_amended)) {
+      if (ev.is_amend())
+        bot.Derived::on_order_amended(*ev.order);
+    }
+    if (!ev.is_state_change())
+      return;
+    if constexpr (defines(&Derived::on_order_submitted)) {
+      if (ev.new_state == OrderState::sent)
+        bot.Derived::on_order_submitted(*ev.order);
+    }
+    if constexpr (defines(&Derived::on_order_live)) {
+      if (ev.new_state == OrderState::live)
+        bot.Derived::on_order_live(*ev.order);
+    }
+    if constexpr (defines(&Derived::on_order_closed)) {
+      if (ev.new_state == OrderState::closed)
+        bot.Derived::on_order_closed(*ev.order);
+    }
+  }
+};
+
+} // namespace apex
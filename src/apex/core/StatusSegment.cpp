@@ -0,0 +1,336 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/StatusSegment.hpp>
+#include <apex/core/Bot.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <future>
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+namespace
+{
+constexpr size_t header_size = 4096;
+
+// a reader gives up on a slot whose writer died mid-write
+constexpr int max_read_attempts = 1000;
+
+template <size_t N> void copy_field(char (&dest)[N], const std::string& src)
+{
+  auto len = std::min(src.size(), N - 1);
+  memcpy(dest, src.data(), len);
+  dest[len] = '\0';
+}
+} // namespace
+
+
+struct StatusSegment::Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t slot_size;
+  uint32_t status_size;
+  uint64_t capacity;
+  int64_t engine_pid;
+
+  alignas(64) std::atomic<uint64_t> claimed;
+
+  alignas(64) std::atomic<uint64_t> publish_count;
+  std::atomic<int64_t> published_us;
+};
+
+
+// an odd sequence number marks a slot being written, zero one never written
+struct alignas(64) StatusSegment::Slot {
+  std::atomic<uint64_t> seq;
+  BotStatus status;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+
+
+std::unique_ptr<StatusSegment> StatusSegment::create(const std::string& name,
+                                                     size_t slots)
+{
+  static_assert(sizeof(Header) <= header_size);
+  if (slots == 0)
+    THROW("status segment " << name << " must have at least one slot");
+  const size_t mapped_size = header_size + slots * sizeof(Slot);
+
+  // a segment left by an earlier run is replaced; its readers keep their
+  // mapping of the old one until they reopen
+  ::shm_unlink(name.c_str());
+  int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd == -1)
+    THROW("shm_open failed for " << name << ": " << strerror(errno));
+
+  if (::ftruncate(fd, mapped_size) == -1) {
+    int err = errno;
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    THROW("ftruncate failed for " << name << ": " << strerror(err));
+  }
+
+  void* addr =
+      ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    ::shm_unlink(name.c_str());
+    THROW("mmap failed for " << name << ": " << strerror(errno));
+  }
+
+  // the segment is zero filled, so only the fixed fields need be set
+  auto* header = new (addr) Header();
+  header->version = version;
+  header->slot_size = sizeof(Slot);
+  header->status_size = sizeof(BotStatus);
+  header->capacity = slots;
+  header->engine_pid = ::getpid();
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = magic;
+
+  return std::unique_ptr<StatusSegment>(
+      new StatusSegment(name, addr, mapped_size, true));
+}
+
+
+std::unique_ptr<StatusSegment> StatusSegment::open(const std::string& name)
+{
+  int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd == -1)
+    THROW("shm_open failed for " << name << ": " << strerror(errno));
+
+  struct stat st;
+  if (::fstat(fd, &st) == -1 || size_t(st.st_size) <= header_size) {
+    ::close(fd);
+    THROW("invalid status segment " << name);
+  }
+
+  const size_t mapped_size = st.st_size;
+  void* addr = ::mmap(nullptr, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+    THROW("mmap failed for " << name << ": " << strerror(errno));
+
+  auto* header = static_cast<const Header*>(addr);
+  if (header->magic != magic || header->version != version ||
+      header->slot_size != sizeof(Slot) ||
+      header->status_size != sizeof(BotStatus) ||
+      header_size + header->capacity * sizeof(Slot) > mapped_size) {
+    ::munmap(addr, mapped_size);
+    THROW("invalid status segment " << name);
+  }
+  return std::unique_ptr<StatusSegment>(
+      new StatusSegment(name, addr, mapped_size, false));
+}
+
+
+StatusSegment::StatusSegment(std::string name, void* addr, size_t mapped_size,
+                             bool owner)
+  : _name(std::move(name)),
+    _addr(addr),
+    _mapped_size(mapped_size),
+    _owner(owner),
+    _header(static_cast<Header*>(addr)),
+    _slots(reinterpret_cast<Slot*>(static_cast<char*>(addr) + header_size)),
+    _capacity(_header->capacity)
+{
+}
+
+
+StatusSegment::~StatusSegment()
+{
+  ::munmap(_addr, _mapped_size);
+  if (_owner)
+    ::shm_unlink(_name.c_str());
+}
+
+
+size_t StatusSegment::size() const
+{
+  return _header->claimed.load(std::memory_order_acquire);
+}
+
+
+int64_t StatusSegment::claim(size_t count)
+{
+  auto first = _header->claimed.load(std::memory_order_relaxed);
+  do {
+    if (first + count > _capacity)
+      return -1;
+  } while (!_header->claimed.compare_exchange_weak(
+      first, first + count, std::memory_order_acq_rel,
+      std::memory_order_relaxed));
+  return static_cast<int64_t>(first);
+}
+
+
+void StatusSegment::write(size_t slot, const BotStatus& status)
+{
+  auto& dest = _slots[slot];
+  auto seq = dest.seq.load(std::memory_order_relaxed);
+  dest.seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(&dest.status, &status, sizeof(status));
+  dest.seq.store(seq + 2, std::memory_order_release);
+}
+
+
+void StatusSegment::mark_published(int64_t now_us)
+{
+  _header->published_us.store(now_us, std::memory_order_relaxed);
+  _header->publish_count.fetch_add(1, std::memory_order_release);
+}
+
+
+bool StatusSegment::read(size_t slot, BotStatus& status) const
+{
+  if (slot >= _capacity)
+    return false;
+  const auto& src = _slots[slot];
+  for (int attempt = 0; attempt < max_read_attempts; attempt++) {
+    auto before = src.seq.load(std::memory_order_acquire);
+    if (before & 1)
+      continue;
+    memcpy(&status, &src.status, sizeof(status));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (src.seq.load(std::memory_order_relaxed) == before)
+      return before != 0;
+  }
+  return false;
+}
+
+
+uint64_t StatusSegment::publish_count() const
+{
+  return _header->publish_count.load(std::memory_order_acquire);
+}
+
+
+int64_t StatusSegment::published_us() const
+{
+  return _header->published_us.load(std::memory_order_relaxed);
+}
+
+
+int64_t StatusSegment::engine_pid() const { return _header->engine_pid; }
+
+
+StatusPublisher::StatusPublisher(StatusSegment& segment, Strategy& strategy,
+                                 std::chrono::milliseconds interval)
+  : _segment(segment), _strategy(strategy), _interval(interval)
+{
+  // bots are only read on the event thread, which also claims their slots
+  auto* evloop = _strategy.services()->evloop();
+  evloop->dispatch([this, evloop]() {
+    if (_stopped)
+      return;
+    auto first = _segment.claim(_strategy.bots().size());
+    if (first < 0) {
+      LOG_WARN("status segment " << _segment.name() << " is full, bots of "
+               << _strategy.strategy_id() << " are not published");
+      return;
+    }
+    for (auto& item : _strategy.bots())
+      _slots.emplace_back(item.second.get(), first++);
+    publish();
+    _timer = evloop->dispatch(_interval, [this]() {
+      publish();
+      return _interval;
+    });
+    _timing = true;
+  });
+  LOG_INFO("publishing status of " << _strategy.strategy_id() << " to "
+           << _segment.name() << " every " << _interval.count() << " ms");
+}
+
+
+StatusPublisher::~StatusPublisher() { stop(); }
+
+
+void StatusPublisher::stop()
+{
+  if (_stopped)
+    return;
+  _stopped = true;
+
+  auto* evloop = _strategy.services()->evloop();
+  auto cancel = [this, evloop]() {
+    if (_timing)
+      evloop->cancel_timer(_timer);
+    _timing = false;
+  };
+  if (evloop->this_thread_is_ev()) {
+    cancel();
+    return;
+  }
+  std::promise<void> done;
+  evloop->dispatch([&]() {
+    cancel();
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+
+void StatusPublisher::fill(Bot& bot, const std::string& strategy_id,
+                           int64_t now_us, BotStatus& status)
+{
+  memset(&status, 0, sizeof(status));
+  copy_field(status.strategy_id, strategy_id);
+  copy_field(status.instrument_id, bot.instrument().id());
+  status.update_us = now_us;
+  status.position = bot.position().net_qty();
+  status.pnl_usd = bot.pnl_usd();
+  status.net_usd = bot.net_position_usd();
+
+  auto& market = bot.market();
+  status.bid = market.l1_bid().price;
+  status.bid_qty = market.l1_bid().qty;
+  status.ask = market.l1_ask().price;
+  status.ask_qty = market.l1_ask().qty;
+  status.last_price = market.has_last() ? market.last().price : apex::nan;
+  status.open_orders = static_cast<uint32_t>(bot.order_count());
+  status.alerts = static_cast<uint32_t>(bot.alert_count());
+}
+
+
+void StatusPublisher::publish()
+{
+  const auto now_us = _strategy.services()->now().as_epoch_us().count();
+  BotStatus status;
+  for (auto& [bot, slot] : _slots) {
+    fill(*bot, _strategy.strategy_id(), now_us, status);
+    _segment.write(slot, status);
+  }
+  _segment.mark_published(now_us);
+}
+
+} // namespace apex
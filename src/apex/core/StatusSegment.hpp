@@ -0,0 +1,162 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/EventLoop.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace apex
+{
+
+class Bot;
+class Strategy;
+
+/* Status of one bot, as published in a StatusSegment.  Plain data, so that a
+ * monitor in another process, or language, can read it by layout. */
+struct BotStatus {
+  char strategy_id[24];   // null terminated
+  char instrument_id[40]; // null terminated
+  int64_t update_us;      // engine time of the update, us since the epoch
+  double position;        // net quantity
+  double pnl_usd;         // NaN until priced
+  double net_usd;         // NaN until priced
+  double bid;
+  double bid_qty;
+  double ask;
+  double ask_qty;
+  double last_price;
+  uint32_t open_orders;
+  uint32_t alerts; // raised on the bot
+};
+
+static_assert(std::is_trivially_copyable_v<BotStatus>);
+
+
+/* Engine status published in a POSIX shared memory segment, for monitors on
+ * the same host, without sockets or serialisation.  The segment holds a
+ * header and a fixed number of slots, one per bot; each slot is written
+ * under its own seqlock, so that a reader never blocks the engine and only
+ * retries a slot caught mid-write.  Monitors map the segment read-only.
+ *
+ * The engine creates the segment, replacing one of the same name left by an
+ * earlier run, and claims a slot per bot; the name is unlinked when the
+ * creator closes it. */
+class StatusSegment
+{
+public:
+  static constexpr uint32_t magic = 0x54535041; // "APST"
+  static constexpr uint32_t version = 1;
+
+  /* Create a segment of `slots` slots. */
+  static std::unique_ptr<StatusSegment> create(const std::string& name,
+                                               size_t slots);
+
+  /* Open a segment, read-only; throws if not found or invalid. */
+  static std::unique_ptr<StatusSegment> open(const std::string& name);
+
+  ~StatusSegment();
+
+  StatusSegment(const StatusSegment&) = delete;
+  StatusSegment& operator=(const StatusSegment&) = delete;
+
+  const std::string& name() const { return _name; }
+  size_t capacity() const { return _capacity; }
+
+  /* Slots claimed so far. */
+  size_t size() const;
+
+  /* Writer: claim `count` consecutive slots, returning the first, or -1 if
+   * the segment is full.  Thread safe, so that each shard can claim its
+   * own. */
+  int64_t claim(size_t count);
+
+  /* Writer: publish the status of a claimed slot.  Slots must each have one
+   * writer. */
+  void write(size_t slot, const BotStatus&);
+
+  /* Writer: note that a round of writes is complete, at engine time `now`. */
+  void mark_published(int64_t now_us);
+
+  /* Reader: copy a consistent status of a slot; returns false if the slot
+   * has not been written. */
+  bool read(size_t slot, BotStatus&) const;
+
+  /* Reader: rounds published, by any writer, and the engine time of the
+   * latest. */
+  uint64_t publish_count() const;
+  int64_t published_us() const;
+
+  /* Process id of the engine. */
+  int64_t engine_pid() const;
+
+private:
+  struct Header;
+  struct Slot;
+
+  StatusSegment(std::string name, void* addr, size_t mapped_size,
+                bool owner);
+
+  std::string _name;
+  void* _addr;
+  size_t _mapped_size;
+  bool _owner;
+  Header* _header;
+  Slot* _slots;
+  size_t _capacity;
+};
+
+
+/* Publishes the status of the bots of a strategy to a StatusSegment, from
+ * its event loop, every `interval`, so the cost to the engine is capped at a
+ * copy of each bot's status per interval, however often monitors read.
+ * Slots are claimed for the bots of the strategy when publishing starts; if
+ * they do not all fit, none are published, with a warning.  Must be stopped
+ * before the bots are deleted. */
+class StatusPublisher
+{
+public:
+  StatusPublisher(StatusSegment&, Strategy&, std::chrono::milliseconds);
+  ~StatusPublisher();
+
+  /* Cancel publication, waiting for the event loop to do so. */
+  void stop();
+
+  /* Fill the status of a bot. */
+  static void fill(Bot&, const std::string& strategy_id, int64_t now_us,
+                   BotStatus&);
+
+private:
+  void publish();
+
+  StatusSegment& _segment;
+  Strategy& _strategy;
+  std::chrono::milliseconds _interval;
+  TimerHandle _timer{};
+  std::vector<std::pair<Bot*, size_t>> _slots;
+  bool _timing = false; // on the event thread
+  bool _stopped = false;
+};
+
+} // namespace apex
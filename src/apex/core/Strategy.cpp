@@ -23,13 +23,97 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/GatewayService.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/core/Auditor.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/OrderService.hpp>
+#include <apex/core/RiskService.hpp>
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/Order.hpp>
 #include <apex/util/Error.hpp>
-
+#include <apex/util/EventLoop.hpp>
+#include <apex/util/TaskPool.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
 #include <future>
+#include <mutex>
+#include <optional>
 
 namespace apex
 {
 
+struct Strategy::Warmup {
+  explicit Warmup(Services* services) : router(services) {}
+
+  // synthetic market of one bot, a bounded random walk about `anchor`
+  struct Feed {
+    Bot* bot = nullptr;
+    std::unique_ptr<MarketData> market;
+    double anchor = 0.0;
+    double tick = 0.0;
+    int offset = 0;
+  };
+
+  WarmupOrderRouter router;
+  std::vector<Feed> feeds;
+  Time until; // for a warm-up on live market data
+  double price = 0.0;
+  size_t ticks = 0;
+  size_t done = 0;
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+  std::chrono::steady_clock::time_point started;
+  std::atomic<bool> active{true};
+};
+
+
+struct Strategy::ConfigWatch {
+  std::string filename;
+  std::chrono::milliseconds interval;
+  std::filesystem::file_time_type mtime; // of the config last read
+  bool checking = false;
+  TimerHandle handle;
+  TaskGroup tasks;
+
+  // outcome of a check on the task pool: the file's time, and its strategy
+  // config, if changed and valid
+  struct Check {
+    std::filesystem::file_time_type mtime;
+    std::optional<json> config;
+  };
+};
+
+
+// event thread only, once the first bot is added
+struct Strategy::BotTimer {
+  std::chrono::milliseconds interval{1000};
+  size_t stagger = 1;
+  bool skip_idle = false;
+
+  struct Entry {
+    Bot* bot;
+    uint64_t md_updates; // market data update count at its last on_timer
+  };
+  std::vector<std::vector<Entry>> groups; // `stagger` of them
+  size_t next_group = 0;
+  size_t next_slot = 0; // group of the next bot added
+  TimerHandle handle;
+  bool started = false;
+
+  // group being served by on_bot_timer, and the index of its next entry,
+  // kept in step by removals made during an on_timer
+  std::vector<Entry>* active = nullptr;
+  size_t cursor = 0;
+
+  // bots add and remove themselves from any thread, and a bot freed off the
+  // EV thread must be gone from the groups before ~Bot returns; recursive,
+  // as an on_timer may create or delete bots
+  std::recursive_mutex mutex;
+};
+
+
   Strategy::Strategy(apex::Services* services,
                    Config config)
     : _services(services),
@@ -37,7 +121,11 @@ namespace apex
       _strategy_id(config.get_string("code"))
   {
     validate_strategy_id(_strategy_id);
+    configure_bot_timer(
+        _config.get_sub_config("bot_timer", Config::empty_config()));
     _auditor = std::make_unique<Auditor>(_services);
+    if (auto* risk = _services->risk_service())
+      risk->add_portfolio(&_portfolio);
   }
 
   Strategy::Strategy(apex::Services* services,
@@ -46,7 +134,10 @@ namespace apex
       _strategy_id(std::move(strategy_id))
   {
     validate_strategy_id(_strategy_id);
+    configure_bot_timer(Config::empty_config());
     _auditor = std::make_unique<Auditor>(_services);
+    if (auto* risk = _services->risk_service())
+      risk->add_portfolio(&_portfolio);
   }
 
   Strategy::Strategy(std::unique_ptr<apex::Services>& services,
@@ -58,6 +149,10 @@ namespace apex
 
   Strategy::~Strategy() {
   this->stop();
+  if (_shard_bus)
+    _shard_bus->detach(_services->shard().index);
+  if (auto* risk = _services->risk_service())
+    risk->remove_portfolio(&_portfolio);
 }
 
 std::set<std::string> Strategy::parse_flat_instruments_config()
@@ -100,6 +195,8 @@ void Strategy::stop_bots()
 void Strategy::stop()
 {
   if (_services->is_backtest()) {
+    cancel_bot_timer();
+    cancel_config_watch();
     LOG_INFO("stopping bots");
     for (auto& item : _bots)
       item.second->stop();
@@ -125,8 +222,13 @@ void Strategy::stop()
   std::promise<void> promise_stop_bots;
   _services->evloop()->dispatch([&]() {
     LOG_INFO("stopping bots");
+    // the orders of all bots are cancelled together, needing one request per
+    // exchange rather than one per order
+    std::vector<std::shared_ptr<Order>> orders;
     for (auto& item : _bots)
-      item.second->stop();
+      item.second->begin_stop(orders);
+    auto sent = Order::cancel_all(orders);
+    LOG_INFO("sent cancel requests for " << sent << " orders");
     promise_stop_bots.set_value();
   });
   promise_stop_bots.get_future().wait();
@@ -141,6 +243,8 @@ void Strategy::stop()
   // delete bots
   std::promise<void> delete_bots;
   _services->evloop()->dispatch([&]() {
+    cancel_bot_timer();
+    cancel_config_watch();
     LOG_INFO("deleting bots");
     for (auto& item : _bots) {
       item.second.release();
@@ -153,17 +257,33 @@ void Strategy::stop()
 void Strategy::init_bots()
 {
   // load all instrument positions for this strategy
-  std::map<apex::Instrument, double> instrument_positions;
+  std::map<InstrumentId, double> instrument_positions;
   for (auto& instrument_position :
        _services->persistence_service()->restore_instrument_positions(
            _strategy_id)) {
     LOG_INFO("GOT: " << instrument_position.native_symbol << ", "
                      << instrument_position.qty);
-    apex::Instrument instrument = _services->ref_data_service()->get_instrument(
-        instrument_position.native_symbol, instrument_position.exchange);
-    instrument_positions.insert({instrument, instrument_position.qty});
+    auto& instrument = _services->ref_data_service()->get_instrument(
+        instrument_position.native_symbol.str(),
+        instrument_position.exchange.str());
+    instrument_positions.insert({instrument.iid(), instrument_position.qty});
   }
 
+  auto warmup_config = _config.get_sub_config("warmup", Config::empty_config());
+  if (warmup_config.contains("until"))
+    begin_history_warmup(Time(warmup_config.get_string("until")));
+  else if (warmup_config.get_uint("ticks", 0) > 0)
+    begin_warmup(warmup_config);
+
+  // the market data of all bots is subscribed to up front, in bulk, rather
+  // than by a request per bot as each is initialised
+  const auto init_start = std::chrono::steady_clock::now();
+  std::vector<const Instrument*> instruments;
+  instruments.reserve(_bots.size());
+  for (auto& item : _bots)
+    instruments.push_back(&item.second->instrument());
+  _services->market_data_service()->subscribe_all(instruments);
+
   // initialise all bots
   LOG_INFO("initialising bots");
   for (auto& item : _bots) {
@@ -172,20 +292,446 @@ void Strategy::init_bots()
     if (iter != std::end(instrument_positions)) {
       init_instrument_position = iter->second;
     } else {
-      LOG_WARN("no instrument position restored for " << item.first);
+      LOG_WARN("no instrument position restored for "
+               << item.second->instrument());
     }
     item.second->init(init_instrument_position);
   }
+  LOG_NOTICE("initialised " << _bots.size() << " bots in "
+             << std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - init_start)
+                    .count()
+             << " ms");
+
+  // hand the orders left open by an earlier run back to their bots
+  if (auto* journal = _services->persistence_service()->journal(_strategy_id)) {
+    size_t restored = 0;
+    for (auto& record : journal->open_orders()) {
+      auto& instrument = _services->ref_data_service()->get_instrument(
+          record.native_symbol.str(), record.exchange.str());
+      auto iter = _bots.find(instrument.iid());
+      if (iter == std::end(_bots)) {
+        LOG_WARN("no bot for restored order " << record.order_id.str()
+                                              << " of " << instrument);
+        continue;
+      }
+      if (iter->second->adopt_order(record))
+        restored++;
+    }
+    if (restored)
+      LOG_NOTICE("restored " << restored << " open orders from "
+                             << journal->path());
+  }
+
+  if (_warmup && !_warmup->until.empty()) {
+    auto delay = std::max(_warmup->until.as_epoch_ms() -
+                              _services->now().as_epoch_ms(),
+                          std::chrono::milliseconds{0});
+    _warmup->started = std::chrono::steady_clock::now();
+    _services->evloop()->dispatch(delay, [this]() {
+      end_warmup();
+      return std::chrono::milliseconds{0};
+    });
+  }
+  else if (_warmup)
+    _services->evloop()->dispatch([this]() { warmup_step(); });
+}
+
+
+void Strategy::configure_bot_timer(Config config)
+{
+  _bot_timer = std::make_unique<BotTimer>();
+  _bot_timer->interval = std::chrono::milliseconds(
+      config.get_uint("interval_ms", _bot_timer->interval.count()));
+  _bot_timer->stagger = config.get_uint("stagger", _bot_timer->stagger);
+  _bot_timer->skip_idle =
+      config.get_bool("skip_idle", _services->is_backtest());
+
+  if (_bot_timer->interval.count() <= 0)
+    throw ConfigError("bot_timer interval_ms must be positive");
+  if (_bot_timer->stagger < 1 ||
+      _bot_timer->stagger > size_t(_bot_timer->interval.count()))
+    throw ConfigError("bot_timer stagger must be between 1 and interval_ms");
+  _bot_timer->groups.resize(_bot_timer->stagger);
+}
+
+
+void Strategy::add_timer_bot(Bot* bot)
+{
+  auto* evloop = _services->evloop();
+  auto& timer = *_bot_timer;
+  std::lock_guard<std::recursive_mutex> lock(timer.mutex);
+  timer.groups[timer.next_slot].push_back({bot, ~uint64_t(0)});
+  timer.next_slot = (timer.next_slot + 1) % timer.groups.size();
+
+  if (!timer.started) {
+    timer.started = true;
+    auto period = timer.interval / timer.groups.size();
+    timer.handle = evloop->dispatch(period, [this, period]() {
+      on_bot_timer();
+      return period;
+    });
+  }
+}
+
+
+void Strategy::remove_timer_bot(Bot* bot)
+{
+  auto& timer = *_bot_timer;
+  std::lock_guard<std::recursive_mutex> lock(timer.mutex);
+
+  for (auto& group : timer.groups)
+    for (size_t i = 0; i < group.size();) {
+      if (group[i].bot != bot) {
+        i++;
+        continue;
+      }
+      group.erase(group.begin() + i);
+      if (&group == timer.active && i < timer.cursor)
+        timer.cursor--;
+    }
+}
+
+
+void Strategy::on_bot_timer()
+{
+  auto& timer = *_bot_timer;
+  std::lock_guard<std::recursive_mutex> lock(timer.mutex);
+  auto& group = timer.groups[timer.next_group];
+  timer.next_group = (timer.next_group + 1) % timer.groups.size();
+
+  // by cursor, as an on_timer may delete a bot of the group, which then
+  // steps the cursor back over the erased entry
+  timer.active = &group;
+  scope_guard clear_active([&timer]() { timer.active = nullptr; });
+  for (timer.cursor = 0; timer.cursor < group.size();) {
+    auto& entry = group[timer.cursor++];
+    if (timer.skip_idle) {
+      auto updates = entry.bot->market().update_count();
+      if (updates == entry.md_updates)
+        continue;
+      entry.md_updates = updates;
+    }
+    entry.bot->handle_timer();
+  }
+}
+
+
+void Strategy::cancel_bot_timer()
+{
+  if (_bot_timer->started) {
+    _services->evloop()->cancel_timer(_bot_timer->handle);
+    _bot_timer->started = false;
+  }
+}
+
+
+bool Strategy::is_warming_up() const { return _warmup && _warmup->active; }
+
+
+void Strategy::update_config(Config config)
+{
+  assert(_services->evloop()->this_thread_is_ev());
+
+  if (config.get_string("code", _strategy_id) != _strategy_id) {
+    LOG_ERROR("strategy config not updated, its code cannot change");
+    return;
+  }
+
+  std::vector<json> before;
+  before.reserve(_bots.size());
+  for (auto& item : _bots)
+    before.push_back(bot_config(item.second->instrument()));
+
+  auto changes = json_merge_diff(_config.raw(), config.raw());
+  _config = std::move(config);
+  if (changes.empty())
+    return;
+  LOG_NOTICE("strategy config updated: " << changes.dump());
+  on_config_update(changes);
+
+  size_t updated = 0;
+  size_t i = 0;
+  for (auto& item : _bots) {
+    auto bot_changes =
+        json_merge_diff(before[i++], bot_config(item.second->instrument()));
+    if (!bot_changes.empty()) {
+      item.second->on_config_update(bot_changes);
+      updated++;
+    }
+  }
+  LOG_INFO("config update applied to " << updated << " bots");
+}
+
+
+void Strategy::watch_config(std::string filename,
+                            std::chrono::milliseconds interval)
+{
+  if (interval.count() <= 0)
+    throw ConfigError("config_watch_ms must be positive");
+
+  _config_watch = std::make_unique<ConfigWatch>();
+  _config_watch->filename = std::move(filename);
+  _config_watch->interval = interval;
+  std::error_code ec;
+  _config_watch->mtime =
+      std::filesystem::last_write_time(_config_watch->filename, ec);
+
+  auto* evloop = _services->evloop();
+  evloop->dispatch([this, evloop]() {
+    _config_watch->handle =
+        evloop->dispatch(_config_watch->interval, [this]() {
+          check_config_file();
+          return _config_watch->interval;
+        });
+  });
+  LOG_INFO("watching config file " << QUOTE(_config_watch->filename)
+           << " every " << interval.count() << " ms");
+}
+
+
+/* The config of a strategy in a config file, either its "strategy" section,
+ * or, for a host of several strategies, its entry in "strategies". */
+static json strategy_section(const json& raw, const std::string& strategy_id)
+{
+  if (!raw.contains("strategies"))
+    return raw.at("strategy");
+  for (auto& item : raw.at("strategies"))
+    if (item.value("code", "") == strategy_id)
+      return item;
+  throw ConfigError("no strategy " + strategy_id + " in strategies");
+}
+
+
+void Strategy::check_config_file()
+{
+  auto& watch = *_config_watch;
+  if (watch.checking)
+    return;
+  watch.checking = true;
+
+  // the file is read and parsed off the event thread, so a large config does
+  // not delay events
+  _services->task_pool()->submit(
+      watch.tasks,
+      [filename = watch.filename, mtime = watch.mtime, id = _strategy_id]() {
+        ConfigWatch::Check check{mtime, std::nullopt};
+        std::error_code ec;
+        auto now = std::filesystem::last_write_time(filename, ec);
+        if (ec || now == mtime)
+          return check;
+        check.mtime = now;
+        try {
+          auto raw = read_json_config_file(filename);
+          check.config = strategy_section(raw, id);
+        } catch (std::exception& e) {
+          LOG_WARN("config file " << QUOTE(filename)
+                   << " changed, but not applied: " << e.what());
+        }
+        return check;
+      },
+      [this](ConfigWatch::Check check) {
+        _config_watch->checking = false;
+        _config_watch->mtime = check.mtime;
+        if (check.config)
+          update_config(Config(std::move(*check.config)));
+      });
 }
 
+
+void Strategy::cancel_config_watch()
+{
+  if (_config_watch) {
+    _config_watch->tasks.cancel();
+    _services->evloop()->cancel_timer(_config_watch->handle);
+  }
+}
+
+
+void Strategy::begin_warmup(Config config)
+{
+  _warmup = std::make_unique<Warmup>(_services);
+  _warmup->ticks = config.get_uint("ticks");
+  _warmup->price = config.raw().value("price", 100.0);
+  if (config.contains("reserve_orders"))
+    _services->order_service()->reserve(config.get_uint("reserve_orders"));
+
+  for (auto& item : _bots) {
+    Warmup::Feed feed;
+    feed.bot = item.second.get();
+    feed.market = std::make_unique<MarketData>();
+    feed.bot->begin_warmup(feed.market.get(), &_warmup->router);
+    _warmup->feeds.push_back(std::move(feed));
+  }
+  LOG_INFO("warming up " << _warmup->feeds.size() << " bots, with "
+                         << _warmup->ticks << " synthetic ticks");
+}
+
+
+void Strategy::begin_history_warmup(Time until)
+{
+  _warmup = std::make_unique<Warmup>(_services);
+  _warmup->until = until;
+
+  // the bots see the live market data throughout; only their orders are
+  // diverted until the warm-up ends
+  auto* mds = _services->market_data_service();
+  for (auto& item : _bots) {
+    Warmup::Feed feed;
+    feed.bot = item.second.get();
+    auto* market = mds->find_market_data(feed.bot->instrument());
+    if (!market)
+      THROW("failed to obtain a MarketData instance for instrument "
+            << feed.bot->instrument());
+    feed.bot->begin_warmup(market, &_warmup->router);
+    _warmup->feeds.push_back(std::move(feed));
+  }
+  LOG_INFO("warming up " << _warmup->feeds.size()
+                         << " bots, on market data until " << until);
+}
+
+
+void Strategy::warmup_step()
+{
+  auto& warmup = *_warmup;
+  auto* evloop = _services->evloop();
+
+  if (warmup.done == 0) {
+    warmup.started = std::chrono::steady_clock::now();
+    for (auto& feed : warmup.feeds) {
+      auto* live =
+          _services->market_data_service()->find_market_data(feed.bot->instrument());
+      feed.anchor = (live && live->has_last()) ? live->last().price : warmup.price;
+      feed.tick = feed.bot->instrument().tick_size.as_double();
+      if (!(feed.tick > 0.0) || feed.tick * 100 > feed.anchor)
+        feed.tick = feed.anchor * 1e-4;
+    }
+  }
+
+  // alternate quotes and trades, so that each bot sees both kinds of tick
+  for (auto& feed : warmup.feeds) {
+    warmup.rng = warmup.rng * 6364136223846793005ull + 1442695040888963407ull;
+    int move = static_cast<int>((warmup.rng >> 33) % 3) - 1;
+    feed.offset = std::clamp(feed.offset + move, -50, 50);
+    double bid = feed.anchor + (feed.offset - 1) * feed.tick;
+    double ask = feed.anchor + (feed.offset + 1) * feed.tick;
+
+    try {
+      if (warmup.done % 2 == 0) {
+        TickTop top;
+        top.bid_price = bid;
+        top.bid_qty = 1.0;
+        top.ask_price = ask;
+        top.ask_qty = 1.0;
+        feed.market->apply(top);
+      } else {
+        TickTrade trade;
+        bool buy = warmup.rng & (1ull << 40);
+        trade.price = buy ? ask : bid;
+        trade.qty = 1.0;
+        trade.aggr_side = buy ? Side::buy : Side::sell;
+        trade.xt = trade.et = _services->now();
+        feed.market->apply(trade);
+      }
+    } catch (std::exception& e) {
+      LOG_ERROR(feed.bot->ticker() << ": exception during warm-up, "
+                                   << e.what());
+    }
+  }
+
+  // one step per event, so that order replies interleave with the ticks
+  if (++warmup.done < warmup.ticks) {
+    evloop->dispatch([this]() { warmup_step(); });
+    return;
+  }
+
+  end_warmup();
+}
+
+
+void Strategy::end_warmup()
+{
+  _warmup->router.close_all();
+  _services->evloop()->dispatch([this]() {
+    for (auto& feed : _warmup->feeds)
+      feed.bot->end_warmup();
+    _warmup->active = false;
+    auto elapsed = std::chrono::steady_clock::now() - _warmup->started;
+    LOG_INFO("warm-up complete, ticks:"
+             << _warmup->done << ", orders:" << _warmup->router.orders_sent()
+             << ", ms:"
+             << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                    .count());
+  });
+}
+
+bool Strategy::owns_instrument(const Instrument& instrument) const
+{
+  auto& shard = _services->shard();
+  if (!shard.is_sharded())
+    return true;
+  auto iid = InstrumentTable::instance().resolve(instrument).iid();
+  return iid % shard.count == shard.index;
+}
+
+
+void Strategy::attach_shard_bus(ShardBus* bus)
+{
+  if (bus->shard_count() != _services->shard().count)
+    THROW("shard bus has " << bus->shard_count() << " shards, expected "
+          << _services->shard().count);
+  _shard_bus = bus;
+  bus->attach(_services->shard().index, _services->evloop(),
+              [this](const ShardMessage& msg) { on_shard_message(msg); });
+}
+
+
+bool Strategy::post_to_shard(size_t shard, ShardMessage msg)
+{
+  if (!_shard_bus)
+    return false;
+  msg.from = _services->shard().index;
+  return _shard_bus->post(shard, msg);
+}
+
+
+size_t Strategy::broadcast_to_shards(ShardMessage msg)
+{
+  if (!_shard_bus)
+    return 0;
+  msg.from = _services->shard().index;
+  return _shard_bus->broadcast(msg);
+}
+
+
 void Strategy::add_bot(std::unique_ptr<Bot> bot) {
-  const Instrument instrument = bot->instrument();
-  auto iter = _bots.find(instrument);
+  auto& instrument = bot->instrument();
+  if (!owns_instrument(instrument)) {
+    LOG_DEBUG("bot for " << instrument << " belongs to another shard");
+    return;
+  }
+  auto iter = _bots.find(instrument.iid());
   if (iter != std::end(_bots)) {
    THROW("cannot add duplicate bot for instrument " << instrument);
   }
 
-  _bots.insert({instrument, std::move(bot)});
+  _bots.insert({instrument.iid(), std::move(bot)});
+}
+
+
+
+void Strategy::remove_bot(InstrumentId iid)
+{
+  _bots.erase(iid);
+}
+
+
+json Strategy::bot_config(const Instrument&) const
+{
+  json config = _config.raw();
+  if (config.is_object())
+    config.erase("universe");
+  return config;
 }
 
 } // namespace apex
@@ -19,9 +19,12 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/core/Services.hpp>
 #include <apex/core/RefDataService.hpp>
+#include <apex/core/ShardBus.hpp>
 #include <apex/util/Config.hpp>
+#include <apex/model/Portfolio.hpp>
 #include <apex/model/StrategyId.hpp>
 
+#include <chrono>
 #include <map>
 #include <set>
 #include <utility>
@@ -30,7 +33,6 @@ namespace apex
 {
 
 class Bot;
-class Instrument;
 class Auditor;
 
 class Strategy
@@ -48,14 +50,60 @@ public:
   };
 
   virtual void create_bots(){};
+
+  /* Initialise the bots, with their restored positions.  If the strategy
+   * config has a "warmup" section, of {"ticks": N}, the bots first handle N
+   * synthetic ticks, on scratch market data, with orders sent through a
+   * WarmupOrderRouter, so that caches, branch predictors and allocators are
+   * primed before the first live event; they then switch to live data and
+   * routing, on the event thread.  The ticks are around the live last
+   * price, or else the optional "price" of the section; the optional
+   * "reserve_orders" pre-sizes the order table.
+   *
+   * A warm-up section of {"until": TIME} instead warms the bots on the live
+   * market data, as replayed, with orders still kept from the exchange,
+   * until that time, e.g. to rebuild indicators before a backtest shard. */
   virtual void init_bots();
 
+  [[nodiscard]] bool is_warming_up() const;
+
+  /* Replace the strategy config while running, on the event thread, e.g.
+   * to change a parameter without a restart and so keep the warm state.
+   * The strategy, and each bot whose bot_config changed, are passed the
+   * changes, as a JSON merge patch, by on_config_update; all within the one
+   * event, so no event sees the update half applied.  The "code" of the
+   * strategy cannot change; the universe, shards, warm-up and bot timer
+   * remain as started with. */
+  void update_config(Config);
+
+  /* Poll the config file of the strategy, every `interval`, for a changed
+   * "strategy" section, to apply by update_config.  The file is checked and
+   * parsed on the task pool, off the event thread.  Configured by the
+   * optional "config_watch_ms" of the strategy config; see StrategyMain. */
+  void watch_config(std::string filename, std::chrono::milliseconds interval);
+
+  /* Invoked by update_config with the changes to the strategy config. */
+  virtual void on_config_update(const json& /*changes*/) {}
+
   void stop();
 
   void add_bot(std::unique_ptr<Bot> bot);
 
+  /* Remove a bot before init_bots, e.g. one whose backtest result is already
+   * known. */
+  void remove_bot(InstrumentId);
+
+  /* The part of the strategy config that the bot of an instrument depends
+   * on, by default all of it but the "universe".  Keys the cached backtest
+   * results of the bot (see BacktestResultCache), so a strategy with
+   * per-instrument parameters should narrow it to those of the instrument,
+   * so that a change to one instrument does not invalidate the others. */
+  [[nodiscard]] virtual json bot_config(const Instrument&) const;
+
   template<typename T>
   void create_bot(const Instrument& instrument) {
+    if (!owns_instrument(instrument))
+      return;
     auto bot = std::make_unique<T>(this, instrument);
     this->add_bot(std::move(bot));
   }
@@ -63,10 +111,31 @@ public:
   template<typename T>
   void create_bot(const InstrumentQuery& query) {
     auto & instrument = _services->ref_data_service()->get_instrument(query);
-    auto bot = std::make_unique<T>(this, instrument);
-    this->add_bot(std::move(bot));
+    create_bot<T>(instrument);
   }
 
+  /* When the strategy runs as several shards, each instance only runs the
+   * bots of the instruments of its own shard; bots of other instruments are
+   * not created by create_bot, and are discarded by add_bot. */
+  [[nodiscard]] bool owns_instrument(const Instrument&) const;
+
+  /* Connect the shards of a strategy; done by StrategyMain before the bots
+   * are created.  Messages for this shard are passed to on_shard_message,
+   * until the strategy is destroyed, which must happen while its event loop
+   * is still running. */
+  void attach_shard_bus(ShardBus*);
+
+  ShardBus* shard_bus() { return _shard_bus; }
+
+  /* Send to one, or all other, shards of this strategy, with the sending
+   * shard filled in; returns false, or a count short of all, if an inbox is
+   * full or the strategy is not sharded. */
+  bool post_to_shard(size_t shard, ShardMessage);
+  size_t broadcast_to_shards(ShardMessage);
+
+  /* Invoked on this shard's event loop for each message posted to it. */
+  virtual void on_shard_message(const ShardMessage&) {}
+
   ~Strategy();
 
   const std::string& strategy_id() { return _strategy_id; }
@@ -75,6 +144,33 @@ public:
 
   Auditor* auditor() { return _auditor.get(); }
 
+  /* Totals over the bots, in USD, as of the last trade or fill of each;
+   * read in constant time, however many bots.  The portfolio is also
+   * checked by the risk service's portfolio limits. */
+  double pnl_usd() const { return _portfolio.pnl(); }
+  double net_exposure_usd() const { return _portfolio.net_exposure(); }
+  double gross_exposure_usd() const { return _portfolio.gross_exposure(); }
+
+  Portfolio& portfolio() { return _portfolio; }
+
+  /* The on_timer callbacks of the bots are made by one strategy timer,
+   * rather than a timer per bot: the bots are spread round-robin over
+   * `stagger` groups, and the timer serves one group every interval/stagger,
+   * so that each bot is called once per interval, but not all at once.  With
+   * skip_idle, the default in backtests, a bot whose market data is
+   * unchanged since its previous on_timer is not called.  Configured by the
+   * optional "bot_timer" section, of "interval_ms", "stagger" and
+   * "skip_idle".  Bots add and remove themselves, in Bot::init and ~Bot;
+   * both can be called from any thread, and take effect before returning. */
+  void add_timer_bot(Bot*);
+  void remove_timer_bot(Bot*);
+
+  /* Bots by the id of their interned instrument. */
+  const std::map<InstrumentId, std::unique_ptr<Bot>>& bots() const
+  {
+    return _bots;
+  }
+
 protected:
   std::set<std::string> parse_flat_instruments_config();
   void stop_bots();
@@ -82,9 +178,36 @@ protected:
   Services* _services;
   Config _config;
   std::string _strategy_id;
-  std::map<apex::Instrument, std::unique_ptr<Bot>> _bots;
+
+  // declared ahead of the bots, which contribute to it
+  Portfolio _portfolio;
+
+  // declared ahead of the bots, which remove themselves from it
+  struct BotTimer;
+  std::unique_ptr<BotTimer> _bot_timer;
+
+  // state of the warm-up, see init_bots; declared ahead of the bots, which
+  // may refer to its market data and router
+  struct Warmup;
+  std::unique_ptr<Warmup> _warmup;
+  std::map<InstrumentId, std::unique_ptr<Bot>> _bots;
 
   std::unique_ptr<Auditor> _auditor;
+  ShardBus* _shard_bus = nullptr;
+
+private:
+  void begin_warmup(Config);
+  void begin_history_warmup(Time until);
+  void warmup_step();
+  void end_warmup();
+  void configure_bot_timer(Config);
+  void on_bot_timer();
+  void cancel_bot_timer();
+  void check_config_file();
+  void cancel_config_watch();
+
+  struct ConfigWatch;
+  std::unique_ptr<ConfigWatch> _config_watch;
 };
 
 } // namespace apex
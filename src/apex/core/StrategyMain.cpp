@@ -20,12 +20,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/OrderRouter.hpp>
 #include <apex/core/OrderService.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/core/ShardBus.hpp>
+#include <apex/core/StatusSegment.hpp>
 #include <apex/core/Strategy.hpp>
 #include <apex/core/StrategyMain.hpp>
 #include <apex/util/Config.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/MemoryPolicy.hpp>
 
 #include <iostream>
+#include <set>
 
 #include <csignal>
 
@@ -51,6 +55,9 @@ StrategyMain::StrategyMain(const StrategyFactoryBase& factory,
 }
 
 
+StrategyMain::~StrategyMain() = default;
+
+
 void StrategyMain::start(std::future<int>& interrupt_code)
 {
   apex::Logger::instance().set_is_configured(false);
@@ -61,23 +68,33 @@ void StrategyMain::start(std::future<int>& interrupt_code)
   apex::Logger::configure_from_config(root_config.get_sub_config("logging", Config{}));
   LOG_NOTICE("application config file '" << this->config_file << "'");
 
-  auto run_mode = root_config.get_string("run_mode");
-
-  // set up apex services
-  _services = std::make_unique<apex::Services>(parse_run_mode(run_mode));
-  _services->init_services(root_config.get_sub_config("services"));
+  // before any services exist, so that their pools and queues use the arena
+  apex::memory::configure(root_config);
 
-  auto strategy_config = root_config.get_sub_config("strategy");
+  auto run_mode = parse_run_mode(root_config.get_string("run_mode"));
 
-  auto strategy = this->factory.create(strategy_config, _services.get());
+  const bool hosted = root_config.contains("strategies");
+  auto strategies = hosted ? create_hosted(run_mode, root_config)
+                           : create_sharded(run_mode, root_config);
 
-  if (!strategy)
-    throw std::runtime_error(
-        "strategy factory did not create a strategy instance");
+  // bus handlers are attached for all shards before any bot can post
+  for (auto& strategy : strategies) {
+    strategy->create_bots();
+    strategy->init_bots();
+  }
 
-  strategy->create_bots();
+  // parameters can then be changed by editing the config file
+  for (size_t i = 0; i < strategies.size(); i++) {
+    auto strategy_config =
+        hosted ? root_config.get_sub_config("strategies").array_item(i)
+               : root_config.get_sub_config("strategy");
+    if (auto ms = strategy_config.get_uint("config_watch_ms", 0))
+      strategies[i]->watch_config(this->config_file,
+                                  std::chrono::milliseconds(ms));
+  }
 
-  strategy->init_bots();
+  if (root_config.contains("status"))
+    start_status(root_config.get_sub_config("status"), strategies);
 
   interrupt_code.wait();
 
@@ -87,7 +104,141 @@ void StrategyMain::start(std::future<int>& interrupt_code)
 
   LOG_INFO("*** strategy stopping ***");
 
-  strategy->stop();
+  for (auto& publisher : _status_publishers)
+    publisher->stop();
+  for (auto& strategy : strategies)
+    strategy->stop();
+}
+
+
+std::vector<std::unique_ptr<Strategy>> StrategyMain::create_sharded(
+    RunMode run_mode, Config root_config)
+{
+  auto strategy_config = root_config.get_sub_config("strategy");
+
+  size_t shard_count = strategy_config.get_uint("shards", 1);
+  if (shard_count == 0)
+    throw ConfigError("strategy 'shards' must be at least 1");
+  if (shard_count > 1 && run_mode == RunMode::backtest)
+    throw ConfigError("strategy 'shards' is not supported for backtest, "
+                      "use ShardedBacktest");
+  if (shard_count > 1) {
+    LOG_INFO("strategy bots partitioned across " << shard_count << " shards");
+    _shard_bus = std::make_unique<ShardBus>(shard_count);
+  }
+
+  std::vector<std::unique_ptr<Strategy>> strategies;
+  for (size_t i = 0; i < shard_count; i++) {
+    // set up apex services; the optional "threads" config controls the
+    // wait-mode, cpu pinning and priority of the EV & IO threads
+    auto services = std::make_unique<apex::Services>(
+        run_mode, BacktestPeriod{},
+        root_config.get_sub_config("threads", Config::empty_config()),
+        ShardInfo{i, shard_count});
+    services->init_services(root_config.get_sub_config("services"));
+
+    // each shard gets its own copy of the config
+    auto shard_config = strategy_config;
+    auto strategy = this->factory.create(shard_config, services.get());
+
+    if (!strategy)
+      throw std::runtime_error(
+          "strategy factory did not create a strategy instance");
+
+    if (i == 0)
+      _services = std::move(services);
+    else
+      _shard_services.push_back(std::move(services));
+
+    if (_shard_bus)
+      strategy->attach_shard_bus(_shard_bus.get());
+    strategies.push_back(std::move(strategy));
+  }
+  return strategies;
+}
+
+
+std::vector<std::unique_ptr<Strategy>> StrategyMain::create_hosted(
+    RunMode run_mode, Config root_config)
+{
+  if (root_config.contains("strategy"))
+    throw ConfigError("config cannot have both 'strategy' and 'strategies'");
+  auto strategies_config = root_config.get_sub_config("strategies");
+  if (strategies_config.array_size() == 0)
+    throw ConfigError("strategies is empty");
+
+  _services = std::make_unique<apex::Services>(
+      run_mode, BacktestPeriod{},
+      root_config.get_sub_config("threads", Config::empty_config()));
+  _services->init_services(root_config.get_sub_config("services"));
+
+  std::vector<std::unique_ptr<Strategy>> strategies;
+  std::set<std::string> codes;
+  for (size_t i = 0; i < strategies_config.array_size(); i++) {
+    auto strategy_config = strategies_config.array_item(i);
+    if (strategy_config.get_uint("shards", 1) != 1)
+      throw ConfigError("strategy 'shards' is not supported for hosted "
+                        "strategies");
+    auto strategy = this->factory.create(strategy_config, _services.get());
+    if (!strategy)
+      throw std::runtime_error(
+          "strategy factory did not create a strategy instance");
+    if (!codes.insert(strategy->strategy_id()).second)
+      throw ConfigError("strategies contains duplicate code '" +
+                        strategy->strategy_id() + "'");
+    strategies.push_back(std::move(strategy));
+  }
+  LOG_INFO("hosting " << strategies.size() << " strategies on one engine");
+  return strategies;
+}
+
+
+void StrategyMain::start_status(
+    Config status_config, const std::vector<std::unique_ptr<Strategy>>& strategies)
+{
+  auto interval =
+      std::chrono::milliseconds(status_config.get_uint("interval_ms", 500));
+  if (interval.count() < 10)
+    throw ConfigError("status 'interval_ms' must be at least 10");
+  _status_segment = StatusSegment::create(status_config.get_string("shm_name"),
+                                          status_config.get_uint("slots", 1024));
+  for (auto& strategy : strategies)
+    _status_publishers.push_back(
+        std::make_unique<StatusPublisher>(*_status_segment, *strategy, interval));
+}
+
+
+std::unique_ptr<Strategy> StrategyFactories::create(Config& config,
+                                                    Services* services) const
+{
+  auto type = config.get_string("type");
+  auto* factory = find(type);
+  if (!factory)
+    throw ConfigError("unknown strategy type '" + type + "'");
+  return factory->create(config, services);
+}
+
+
+const StrategyFactoryBase* StrategyFactories::find(const std::string& type) const
+{
+  auto iter = _factories.find(type);
+  return iter == _factories.end() ? nullptr : iter->second.get();
+}
+
+
+std::vector<std::string> StrategyFactories::types() const
+{
+  std::vector<std::string> types;
+  for (auto& item : _factories)
+    types.push_back(item.first);
+  return types;
+}
+
+
+StrategyFactories& strategy_registry()
+{
+  static StrategyFactories registry;
+  return registry;
 }
 
 
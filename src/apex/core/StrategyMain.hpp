@@ -19,19 +19,26 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <functional>
 #include <future>
+#include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace apex
 {
+enum class RunMode;
 class Services;
 class Strategy;
 class Config;
+class ShardBus;
+class StatusSegment;
+class StatusPublisher;
 
 
 class StrategyFactoryBase
 {
 public:
+  virtual ~StrategyFactoryBase() = default;
   virtual std::unique_ptr<apex::Strategy> create(
       apex::Config& config, apex::Services* services) const = 0;
 };
@@ -48,12 +55,75 @@ public:
 };
 
 
+/* Factory of several strategy types, creating the one named by the "type" of
+ * the strategy config; for a host of different strategies (see StrategyMain).
+ *
+ *   StrategyFactories factories;
+ *   factories.add<MarketMaker>("market_maker").add<Momentum>("momentum");
+ */
+class StrategyFactories : public StrategyFactoryBase
+{
+public:
+  template <typename T> StrategyFactories& add(const std::string& type)
+  {
+    _factories[type] = std::make_unique<StrategyFactory<T>>();
+    return *this;
+  }
+
+  std::unique_ptr<apex::Strategy> create(apex::Config& config,
+                                        apex::Services* services) const override;
+
+  /* The factory of a type, or null if there is none. */
+  [[nodiscard]] const StrategyFactoryBase* find(const std::string& type) const;
+
+  [[nodiscard]] std::vector<std::string> types() const;
+
+private:
+  std::map<std::string, std::unique_ptr<StrategyFactoryBase>> _factories;
+};
+
+
+/* Strategy types of the process, by name, for drivers that choose the
+ * strategy at run time, such as the Python backtest module; a library of
+ * strategies adds its types as it is loaded, with APEX_REGISTER_STRATEGY. */
+StrategyFactories& strategy_registry();
+
+#define _APEX_STRATEGY_CONCAT2_(A, B) A##B
+#define _APEX_STRATEGY_CONCAT_(A, B) _APEX_STRATEGY_CONCAT2_(A, B)
+
+#define APEX_REGISTER_STRATEGY(TYPE, NAME)                              \
+  static const bool _APEX_STRATEGY_CONCAT_(_apex_strategy_registered_,  \
+                                           __LINE__) =                  \
+      (apex::strategy_registry().add<TYPE>(NAME), true)
+
+
 int strategy_runner(int argc, char** argv, const StrategyFactoryBase& factory);
 
 
 /*
 Create a strategy instance, using the provided factory object, then initialise
 and start that strategy until interrupted.
+
+If the strategy config has "shards" greater than one, the bots are instead
+partitioned across that many strategy instances, each with its own Services,
+and so its own event loop thread, market data and order routing; the
+instances are connected by a ShardBus.  Sharding is for live and paper
+trading only; a backtest is instead sharded with ShardedBacktest.
+
+If the config instead has a "strategies" array, of strategy configs each with
+its own "code", the process hosts all of them on one Services.  They share
+its gateway sessions, market data and event loop, so that a symbol traded by
+several strategies is subscribed to, decoded and held once, while orders go
+out through a router per strategy code, and positions, journals and audit
+are kept per strategy.  The risk limits of the services apply to the
+instruments and portfolio of the engine as a whole.  Hosted strategies
+cannot be sharded.
+
+An optional "status" section publishes the status of every bot to a shared
+memory segment, for external monitors; its "shm_name" names the segment,
+"slots" is the number of bots it can hold (default 1024), and "interval_ms"
+how often each strategy updates it (default 500, at least 10).  See
+StatusSegment.
  */
 class StrategyMain
 {
@@ -62,11 +132,29 @@ public:
   const StrategyFactoryBase& factory;
 
   StrategyMain(const StrategyFactoryBase& factory, std::string config);
+  ~StrategyMain();
 
   void start(std::future<int>& interrupt_code);
 
+private:
+  std::vector<std::unique_ptr<Strategy>> create_sharded(RunMode,
+                                                        Config root_config);
+  std::vector<std::unique_ptr<Strategy>> create_hosted(RunMode,
+                                                       Config root_config);
+  void start_status(Config status_config,
+                    const std::vector<std::unique_ptr<Strategy>>&);
+
 public:
+  // declared first, since it must outlive the event loops of the shards
+  std::unique_ptr<apex::ShardBus> _shard_bus;
+
   std::unique_ptr<apex::Services> _services;
+
+  // services of shards 1 and above, when sharded; _services is shard 0
+  std::vector<std::unique_ptr<apex::Services>> _shard_services;
+
+  std::unique_ptr<apex::StatusSegment> _status_segment;
+  std::vector<std::unique_ptr<apex::StatusPublisher>> _status_publishers;
 };
 
 } // namespace apex
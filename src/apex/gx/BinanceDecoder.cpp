@@ -0,0 +1,487 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/gx/BinanceDecoder.hpp>
+
+#include <charconv>
+
+namespace apex
+{
+namespace binance
+{
+
+namespace
+{
+
+enum class value_type { string, object, array, literal };
+
+/* Iterates over the members of a json object, without unescaping strings or
+ * descending into nested values. */
+class ObjectScanner
+{
+public:
+  explicit ObjectScanner(std::string_view src)
+    : _p(src.data()), _end(src.data() + src.size())
+  {
+    skip_ws();
+    _ok = (_p < _end && *_p == '{');
+    if (_ok)
+      ++_p;
+  }
+
+  /* Advance to the next member, returning false at the end of the object, or
+   * if the input is malformed, distinguished by complete(). */
+  bool next(std::string_view& key, std::string_view& value, value_type& type)
+  {
+    if (!_ok || _done)
+      return false;
+
+    skip_ws();
+    if (_p == _end)
+      return fail();
+    if (*_p == '}') {
+      ++_p;
+      _done = true;
+      return false;
+    }
+    if (_members) {
+      if (*_p++ != ',')
+        return fail();
+      skip_ws();
+    }
+
+    if (!read_string(key))
+      return fail();
+    skip_ws();
+    if (_p == _end || *_p++ != ':')
+      return fail();
+    skip_ws();
+    if (_p == _end)
+      return fail();
+
+    const char* start = _p;
+    if (*_p == '"') {
+      if (!read_string(value))
+        return fail();
+      type = value_type::string;
+    } else if (*_p == '{' || *_p == '[') {
+      type = (*_p == '{') ? value_type::object : value_type::array;
+      if (!skip_nested())
+        return fail();
+      value = std::string_view(start, _p - start);
+    } else {
+      while (_p < _end && *_p != ',' && *_p != '}' && !is_ws(*_p))
+        ++_p;
+      if (_p == start)
+        return fail();
+      value = std::string_view(start, _p - start);
+      type = value_type::literal;
+    }
+
+    _members++;
+    return true;
+  }
+
+  /* Whether the whole object was scanned without error. */
+  [[nodiscard]] bool complete() const { return _ok && _done; }
+
+private:
+  static bool is_ws(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  }
+
+  void skip_ws()
+  {
+    while (_p < _end && is_ws(*_p))
+      ++_p;
+  }
+
+  bool fail()
+  {
+    _ok = false;
+    return false;
+  }
+
+  bool read_string(std::string_view& out)
+  {
+    if (_p == _end || *_p != '"')
+      return false;
+    const char* start = ++_p;
+    while (_p < _end && *_p != '"') {
+      if (*_p == '\\')
+        return false; // escapes would need a copy
+      ++_p;
+    }
+    if (_p == _end)
+      return false;
+    out = std::string_view(start, _p - start);
+    ++_p;
+    return true;
+  }
+
+  bool skip_nested()
+  {
+    int depth = 0;
+    while (_p < _end) {
+      const char c = *_p++;
+      if (c == '"') {
+        while (_p < _end && *_p != '"') {
+          if (*_p == '\\')
+            ++_p;
+          ++_p;
+        }
+        if (_p >= _end)
+          return false;
+        ++_p;
+      } else if (c == '{' || c == '[') {
+        depth++;
+      } else if (c == '}' || c == ']') {
+        if (--depth == 0)
+          return true;
+      }
+    }
+    return false;
+  }
+
+  const char* _p;
+  const char* _end;
+  bool _ok;
+  bool _done = false;
+  size_t _members = 0;
+};
+
+
+bool to_double(std::string_view s, double& out, ScaledInt& exact)
+{
+  if (parse_decimal(s, exact, out))
+    return true;
+  auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+  return r.ec == std::errc() && r.ptr == s.data() + s.size();
+}
+
+
+bool to_double(std::string_view s, double& out)
+{
+  ScaledInt unused;
+  return to_double(s, out, unused);
+}
+
+
+bool to_uint(std::string_view s, uint64_t& out)
+{
+  auto r = std::from_chars(s.data(), s.data() + s.size(), out);
+  return r.ec == std::errc() && r.ptr == s.data() + s.size();
+}
+
+
+Time to_time(uint64_t binance_timestamp)
+{
+  int ms = binance_timestamp % 1000;
+  int sec = (binance_timestamp - ms) / 1000;
+  return Time{sec, std::chrono::milliseconds(ms)};
+}
+
+/* Parse an array of [price, quantity] string pairs. */
+bool decode_levels(std::string_view src,
+                   std::vector<TickBookDelta::Level>& levels)
+{
+  const char* p = src.data();
+  const char* const end = p + src.size();
+
+  auto skip_ws = [&]() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+      ++p;
+  };
+  auto expect = [&](char c) {
+    skip_ws();
+    if (p == end || *p != c)
+      return false;
+    ++p;
+    return true;
+  };
+  auto read_number = [&](double& out) {
+    skip_ws();
+    if (p == end || *p != '"')
+      return false;
+    const char* start = ++p;
+    while (p < end && *p != '"')
+      ++p;
+    if (p == end)
+      return false;
+    std::string_view field(start, p++ - start);
+    return to_double(field, out);
+  };
+
+  if (!expect('['))
+    return false;
+  skip_ws();
+  if (p < end && *p == ']')
+    return true;
+
+  do {
+    TickBookDelta::Level level;
+    if (!expect('[') || !read_number(level.price) || !expect(',') ||
+        !read_number(level.qty) || !expect(']'))
+      return false;
+    levels.push_back(level);
+    skip_ws();
+  } while (p < end && *p++ == ',');
+
+  return p == end && *(p - 1) == ']';
+}
+
+} // namespace
+
+
+bool decode_stream_message(std::string_view src, StreamMessage& msg)
+{
+  ObjectScanner scanner(src);
+  std::string_view key, value;
+  value_type type;
+  bool has_stream = false, has_data = false;
+
+  while (scanner.next(key, value, type)) {
+    if (key == "stream" && type == value_type::string) {
+      msg.stream = value;
+      has_stream = true;
+    } else if (key == "data" && type == value_type::object) {
+      msg.data = value;
+      has_data = true;
+    }
+  }
+  return scanner.complete() && has_stream && has_data;
+}
+
+
+bool decode_book_ticker(std::string_view data, TickTop& tick)
+{
+  ObjectScanner scanner(data);
+  std::string_view key, value;
+  value_type type;
+  unsigned fields = 0;
+
+  while (scanner.next(key, value, type)) {
+    if (key.size() != 1 || type != value_type::string)
+      continue;
+    switch (key[0]) {
+      case 'a':
+        fields |= to_double(value, tick.ask_price, tick.exact_ask_price) << 0;
+        break;
+      case 'A':
+        fields |= to_double(value, tick.ask_qty) << 1;
+        break;
+      case 'b':
+        fields |= to_double(value, tick.bid_price, tick.exact_bid_price) << 2;
+        break;
+      case 'B':
+        fields |= to_double(value, tick.bid_qty) << 3;
+        break;
+    }
+  }
+  return scanner.complete() && fields == 0xF;
+}
+
+
+bool decode_symbol(std::string_view data, std::string_view& symbol)
+{
+  ObjectScanner scanner(data);
+  std::string_view key, value;
+  value_type type;
+
+  while (scanner.next(key, value, type))
+    if (key.size() == 1 && key[0] == 's') {
+      symbol = value;
+      return type == value_type::string;
+    }
+  return false;
+}
+
+
+bool decode_agg_trade(std::string_view data, TickTrade& tick)
+{
+  ObjectScanner scanner(data);
+  std::string_view key, value;
+  value_type type;
+  unsigned fields = 0;
+  uint64_t timestamp;
+
+  while (scanner.next(key, value, type)) {
+    if (key.size() != 1)
+      continue;
+    switch (key[0]) {
+      case 'p':
+        fields |= (type == value_type::string &&
+                   to_double(value, tick.price, tick.exact_price))
+                  << 0;
+        break;
+      case 'q':
+        fields |= (type == value_type::string && to_double(value, tick.qty))
+                  << 1;
+        break;
+      case 'T':
+        if (type == value_type::literal && to_uint(value, timestamp)) {
+          tick.xt = to_time(timestamp);
+          fields |= 1 << 2;
+        }
+        break;
+      case 'E':
+        if (type == value_type::literal && to_uint(value, timestamp)) {
+          tick.et = to_time(timestamp);
+          fields |= 1 << 3;
+        }
+        break;
+      case 'm':
+        // buyer is the market maker, so seller is the aggressor
+        if (value == "true")
+          tick.aggr_side = Side::sell;
+        else if (value == "false")
+          tick.aggr_side = Side::buy;
+        else
+          break;
+        fields |= 1 << 4;
+        break;
+    }
+  }
+  return scanner.complete() && fields == 0x1F;
+}
+
+
+bool decode_update_id(std::string_view data, char id_key, uint64_t& id)
+{
+  ObjectScanner scanner(data);
+  std::string_view key, value;
+  value_type type;
+
+  while (scanner.next(key, value, type))
+    if (key.size() == 1 && key[0] == id_key)
+      return type == value_type::literal && to_uint(value, id);
+  return false;
+}
+
+
+bool decode_depth_update(std::string_view data, DepthUpdate& update,
+                         TickBookDelta& delta)
+{
+  ObjectScanner scanner(data);
+  std::string_view key, value;
+  value_type type;
+  unsigned fields = 0;
+
+  while (scanner.next(key, value, type)) {
+    if (key.size() != 1)
+      continue;
+    switch (key[0]) {
+      case 'U':
+        fields |= (type == value_type::literal &&
+                   to_uint(value, update.first_update_id))
+                  << 0;
+        break;
+      case 'u':
+        fields |= (type == value_type::literal &&
+                   to_uint(value, update.final_update_id))
+                  << 1;
+        break;
+      case 'b':
+        fields |= (type == value_type::array && decode_levels(value, delta.bids))
+                  << 2;
+        break;
+      case 'a':
+        fields |= (type == value_type::array && decode_levels(value, delta.asks))
+                  << 3;
+        break;
+    }
+  }
+  return scanner.complete() && fields == 0xF;
+}
+
+
+bool decode_depth_snapshot(std::string_view src, uint64_t& last_update_id,
+                           TickBookDelta& delta)
+{
+  ObjectScanner scanner(src);
+  std::string_view key, value;
+  value_type type;
+  unsigned fields = 0;
+
+  while (scanner.next(key, value, type)) {
+    if (key == "lastUpdateId")
+      fields |= (type == value_type::literal && to_uint(value, last_update_id))
+                << 0;
+    else if (key == "bids")
+      fields |= (type == value_type::array && decode_levels(value, delta.bids))
+                << 1;
+    else if (key == "asks")
+      fields |= (type == value_type::array && decode_levels(value, delta.asks))
+                << 2;
+  }
+  delta.is_snapshot = true;
+  return scanner.complete() && fields == 0x7;
+}
+
+
+bool decode_execution_report(std::string_view src, ExecutionReport& report)
+{
+  ObjectScanner scanner(src);
+  std::string_view key, value;
+  value_type type;
+  unsigned fields = 0;
+
+  while (scanner.next(key, value, type)) {
+    if (key == "i" && type == value_type::literal) {
+      report.order_id = value;
+      continue;
+    }
+    if (key.size() != 1 || type != value_type::string)
+      continue;
+    switch (key[0]) {
+      case 'e':
+        report.event_type = value;
+        fields |= 1 << 0;
+        break;
+      case 'x':
+        report.execution_type = value;
+        fields |= 1 << 1;
+        break;
+      case 'X':
+        report.order_status = value;
+        fields |= 1 << 2;
+        break;
+      case 'c':
+        report.client_order_id = value;
+        fields |= 1 << 3;
+        break;
+      case 'C':
+        report.orig_client_order_id = value;
+        fields |= 1 << 4;
+        break;
+      case 'L':
+        report.last_executed_price = value;
+        fields |= 1 << 5;
+        break;
+      case 'l':
+        report.last_executed_qty = value;
+        fields |= 1 << 6;
+        break;
+    }
+  }
+  return scanner.complete() && fields == 0x7F &&
+         report.event_type == "executionReport";
+}
+
+} // namespace binance
+} // namespace apex
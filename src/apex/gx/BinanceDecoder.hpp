@@ -0,0 +1,90 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/tick_msgs.hpp>
+
+#include <cstdint>
+#include <string_view>
+
+namespace apex
+{
+namespace binance
+{
+
+/* Single pass decoding of the Binance stream messages that arrive at high
+ * rate, without building a json document.  Decoded strings are views into the
+ * source buffer.  Each decode function returns false if the message does not
+ * have the expected form, in which case the caller should fall back to the
+ * general json parser; escaped strings are not supported. */
+
+/* Members of a combined-stream message, {"stream":"...","data":{...}} */
+struct StreamMessage {
+  std::string_view stream;
+  std::string_view data; // including the enclosing braces
+};
+
+bool decode_stream_message(std::string_view src, StreamMessage&);
+
+/* Decode the data object of a bookTicker stream message. */
+bool decode_book_ticker(std::string_view data, TickTop&);
+
+/* Find the "s" symbol member of a stream data object, such as a message of
+ * the all-market !bookTicker stream; scanning stops at the member. */
+bool decode_symbol(std::string_view data, std::string_view& symbol);
+
+/* Decode the data object of an aggTrade stream message. */
+bool decode_agg_trade(std::string_view data, TickTrade&);
+
+/* Find the integer member `key` of a stream data object, such as the "u"
+ * update id of a bookTicker or depthUpdate, or the "a" id of an aggTrade;
+ * scanning stops at the member. */
+bool decode_update_id(std::string_view data, char key, uint64_t& id);
+
+/* Update ids of a diff-depth stream message. */
+struct DepthUpdate {
+  uint64_t first_update_id = 0; // "U"
+  uint64_t final_update_id = 0; // "u"
+};
+
+/* Decode the data object of a depthUpdate stream message; the price levels
+ * are appended to the delta. */
+bool decode_depth_update(std::string_view data, DepthUpdate&, TickBookDelta&);
+
+/* Decode a REST depth snapshot, the reply to /api/v3/depth. */
+bool decode_depth_snapshot(std::string_view src, uint64_t& last_update_id,
+                           TickBookDelta&);
+
+/* Fields of a user-data executionReport that are used for order handling. */
+struct ExecutionReport {
+  std::string_view event_type;           // "e"
+  std::string_view execution_type;       // "x"
+  std::string_view order_status;         // "X"
+  std::string_view client_order_id;      // "c"
+  std::string_view orig_client_order_id; // "C"
+  std::string_view last_executed_price;  // "L"
+  std::string_view last_executed_qty;    // "l"
+  std::string_view order_id;             // "i", exchange order id; optional
+};
+
+/* Decode a user-data message; returns false for any event type other than
+ * executionReport. */
+bool decode_execution_report(std::string_view src, ExecutionReport&);
+
+} // namespace binance
+} // namespace apex
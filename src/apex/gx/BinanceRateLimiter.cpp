@@ -0,0 +1,152 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/gx/BinanceRateLimiter.hpp>
+#include <apex/core/Logger.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+
+namespace apex
+{
+namespace binance
+{
+
+using namespace std::chrono_literals;
+
+
+RateLimiter::RateLimiter(Limits limits)
+  : _weight(limits.weight_per_min, 1min, limits.cancel_reserve),
+    _orders_10s(limits.orders_per_10s, 10s),
+    _orders_day(limits.orders_per_day, 24h)
+{
+}
+
+
+bool RateLimiter::try_acquire(Request request, TokenBucket::clock::time_point now)
+{
+  bool is_order = request == Request::new_order || request == Request::replace;
+  bool priority = !is_order;
+
+  // check the order counts first, as taking weight for a refused order would
+  // waste it; weight taken is not returned should a concurrent request take
+  // the last order count, which errs on the side of sending less
+  bool ok = !is_order || (_orders_10s.available(now) > 0 &&
+                          _orders_day.available(now) > 0);
+  ok = ok && _weight.try_acquire(1, priority, now);
+  if (ok && is_order)
+    ok = _orders_10s.try_acquire(1, true, now) &&
+         _orders_day.try_acquire(1, true, now);
+
+  if (!ok)
+    _throttled.fetch_add(1, std::memory_order_relaxed);
+  return ok;
+}
+
+
+/* Case-insensitive test that `line` starts with the lower-case `prefix`. */
+static bool starts_with(std::string_view line, std::string_view prefix)
+{
+  if (line.size() < prefix.size())
+    return false;
+  for (size_t i = 0; i < prefix.size(); i++)
+    if (std::tolower(static_cast<unsigned char>(line[i])) != prefix[i])
+      return false;
+  return true;
+}
+
+
+/* The unsigned integer value of a "name: value" header line. */
+static bool header_value(std::string_view line, uint32_t& value)
+{
+  auto colon = line.find(':');
+  if (colon == std::string_view::npos)
+    return false;
+  auto pos = line.find_first_not_of(' ', colon + 1);
+  if (pos == std::string_view::npos)
+    return false;
+  auto result = std::from_chars(line.data() + pos, line.data() + line.size(), value);
+  return result.ec == std::errc();
+}
+
+
+void RateLimiter::on_header(std::string_view line, TokenBucket::clock::time_point now)
+{
+  uint32_t value = 0;
+  if (starts_with(line, "http/")) {
+    auto space = line.find(' ');
+    if (space != std::string_view::npos &&
+        (line.substr(space + 1, 3) == "429" || line.substr(space + 1, 3) == "418")) {
+      _violations.fetch_add(1, std::memory_order_relaxed);
+      LOG_WARN("binance rate limit exceeded: " << line);
+    }
+  } else if (starts_with(line, "x-mbx-used-weight-1m:")) {
+    if (header_value(line, value))
+      _weight.sync_used(value, now);
+  } else if (starts_with(line, "x-mbx-order-count-10s:")) {
+    if (header_value(line, value))
+      _orders_10s.sync_used(value, now);
+  } else if (starts_with(line, "x-mbx-order-count-1d:")) {
+    if (header_value(line, value))
+      _orders_day.sync_used(value, now);
+  } else if (starts_with(line, "retry-after:")) {
+    if (header_value(line, value)) {
+      LOG_WARN("binance requests paused for " << value << " seconds");
+      _weight.block(now + std::chrono::seconds(value));
+    }
+  }
+}
+
+
+void RateLimiter::on_ws_rate_limits(const json& limits,
+                                    TokenBucket::clock::time_point now)
+{
+  if (!limits.is_array())
+    return;
+  for (auto& item : limits) {
+    if (!item.is_object())
+      continue;
+    auto type = item.value("rateLimitType", "");
+    auto interval = item.value("interval", "");
+    auto num = item.value("intervalNum", 0);
+    auto count = item.value("count", 0u);
+    if (type == "REQUEST_WEIGHT" && interval == "MINUTE" && num == 1)
+      _weight.sync_used(count, now);
+    else if (type == "ORDERS" && interval == "SECOND" && num == 10)
+      _orders_10s.sync_used(count, now);
+    else if (type == "ORDERS" && interval == "DAY" && num == 1)
+      _orders_day.sync_used(count, now);
+  }
+}
+
+
+RateLimiter::Budget RateLimiter::budget(TokenBucket::clock::time_point now) const
+{
+  Budget budget;
+  budget.weight = _weight.available(now);
+  budget.orders_10s = _orders_10s.available(now);
+  budget.orders_day = _orders_day.available(now);
+  uint32_t weight_for_orders =
+      budget.weight > _weight.reserve() ? budget.weight - _weight.reserve() : 0;
+  budget.new_orders =
+      std::min({weight_for_orders, budget.orders_10s, budget.orders_day});
+  return budget;
+}
+
+} // namespace binance
+} // namespace apex
@@ -0,0 +1,91 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/RateLimiter.hpp>
+#include <apex/util/json.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+
+namespace apex
+{
+namespace binance
+{
+
+/* Pacing of order requests against the Binance limits: the request weight
+ * of the IP, per minute, and the order counts of the account, per ten
+ * seconds and per day.  Each limit is a TokenBucket, kept in step with the
+ * usage Binance reports, in the X-MBX-USED-WEIGHT-1M and X-MBX-ORDER-COUNT-*
+ * headers of REST replies and the "rateLimits" of WebSocket API replies.  A
+ * Retry-After, sent with a 429 or 418 reply, stops all requests for the time
+ * given.  Cancels have priority: new orders leave `cancel_reserve` of the
+ * request weight unused.  Lock-free; headers are read on the HTTP pool
+ * thread, while requests are made on the event thread. */
+class RateLimiter
+{
+public:
+  struct Limits {
+    uint32_t weight_per_min = 6000;
+    uint32_t orders_per_10s = 100;
+    uint32_t orders_per_day = 200000;
+    uint32_t cancel_reserve = 600;
+  };
+
+  enum class Request { new_order, cancel, replace, cancel_all };
+
+  explicit RateLimiter(Limits);
+
+  /* Take the budget of a request, if available; each request has a weight
+   * of one, and new orders and replaces also count as an order. */
+  bool try_acquire(Request,
+                   TokenBucket::clock::time_point = TokenBucket::clock::now());
+
+  /* Apply one response header line, or the status line, of a REST reply. */
+  void on_header(std::string_view line,
+                 TokenBucket::clock::time_point = TokenBucket::clock::now());
+
+  /* Apply the "rateLimits" array of a WebSocket API reply. */
+  void on_ws_rate_limits(const json&,
+                         TokenBucket::clock::time_point = TokenBucket::clock::now());
+
+  struct Budget {
+    uint32_t weight = 0;      // request weight, for cancels
+    uint32_t orders_10s = 0;
+    uint32_t orders_day = 0;
+    uint32_t new_orders = 0;  // new orders that could be sent now
+  };
+
+  [[nodiscard]] Budget budget(
+      TokenBucket::clock::time_point = TokenBucket::clock::now()) const;
+
+  /* Requests refused for lack of budget, and 429 or 418 replies seen. */
+  [[nodiscard]] uint64_t throttled() const { return _throttled.load(); }
+  [[nodiscard]] uint64_t violations() const { return _violations.load(); }
+
+private:
+  TokenBucket _weight;
+  TokenBucket _orders_10s;
+  TokenBucket _orders_day;
+  std::atomic<uint64_t> _throttled{0};
+  std::atomic<uint64_t> _violations{0};
+};
+
+} // namespace binance
+} // namespace apex
@@ -16,32 +16,64 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/gx/BinanceSession.hpp>
+#include <apex/gx/BinanceWsApi.hpp>
 #include <apex/core/Errors.hpp>
 #include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/infra/AddressCache.hpp>
+#include <apex/infra/HttpClientPool.hpp>
+#include <apex/infra/IoLoop.hpp>
 #include <apex/infra/SslSocket.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/infra/WebsocketClient.hpp>
 #include <apex/util/json.hpp>
+#include <apex/util/Metrics.hpp>
 #include <apex/util/platform.hpp>
+#include <apex/util/Profiler.hpp>
+#include <apex/util/RequestSigner.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/model/tick_msgs.hpp>
 #include <apex/util/Config.hpp>
 
+#include <charconv>
 #include <filesystem>
 #include <sstream>
 #include <unistd.h>
 
-#include <curl/curl.h>
-
 namespace apex
 {
+
+static metrics::Counter& binance_md_messages = metrics::registry().counter(
+    "apex_binance_md_messages_total", "Binance market data messages received");
+static metrics::Counter& binance_md_unsubscribed = metrics::registry().counter(
+    "apex_binance_md_unsubscribed_total",
+    "Binance all-market stream updates dropped, of symbols not subscribed");
+static metrics::Counter& binance_md_stale = metrics::registry().counter(
+    "apex_binance_md_stale_total",
+    "Binance market data updates dropped, as older than one delivered");
+static metrics::Counter& binance_orders = metrics::registry().counter(
+    "apex_binance_orders_total", "Orders submitted to Binance");
+static metrics::Counter& binance_reconnects = metrics::registry().counter(
+    "apex_binance_reconnects_total", "Binance session reconnections");
+static metrics::Counter& binance_throttled = metrics::registry().counter(
+    "apex_binance_throttled_total",
+    "Binance order requests refused for lack of rate-limit budget");
+static metrics::Gauge& binance_budget_weight = metrics::registry().gauge(
+    "apex_binance_rate_budget{limit=\"weight_1m\"}",
+    "Remaining budget of a Binance rate limit");
+static metrics::Gauge& binance_budget_orders_10s = metrics::registry().gauge(
+    "apex_binance_rate_budget{limit=\"orders_10s\"}",
+    "Remaining budget of a Binance rate limit");
+static metrics::Gauge& binance_budget_orders_1d = metrics::registry().gauge(
+    "apex_binance_rate_budget{limit=\"orders_1d\"}",
+    "Remaining budget of a Binance rate limit");
+
 namespace binance
 {
 
 // As for the Binance Websocket Limits, the limit is 5 incoming messages per
-// second (200ms), so, we translate that a required interval delay with some
-// safety overhead.
-#define BINANCE_SPOT_SUBSCRIBE_DELAY_MILLISEC 300
+// second, which includes pong frames, so a connection sends fewer requests per
+// second than that.
+#define BINANCE_SPOT_REQUESTS_PER_SEC 4
 
 
 static const std::string CLIENT_ORDER_ID = "c";
@@ -78,32 +110,60 @@ enum class ExecType {
   expired,
 };
 
-static EventType to_event_type(const std::string& s)
+/* The enum decoders select the one candidate by length, and a character
+ * where candidates of that length differ, then confirm with one compare. */
+static EventType to_event_type(std::string_view s)
 {
-  if (s == "outboundAccountPosition")
-    return EventType::account_update;
-  else if (s == "executionReport")
-    return EventType::order_update;
-  else
-    return EventType::none;
-}
-
-static ExecType to_exec_type(const std::string& s)
-{
-  if (s == "NEW")
-    return ExecType::accepted;
-  else if (s == "CANCELED")
-    return ExecType::canceled;
-  else if (s == "REPLACED")
-    return ExecType::replaced;
-  else if (s == "REJECTED")
-    return ExecType::rejected;
-  else if (s == "TRADE")
-    return ExecType::trade;
-  else if (s == "EXPIRED")
-    return ExecType::expired;
-  else
+  switch (s.size()) {
+    case 23:
+      if (s == "outboundAccountPosition")
+        return EventType::account_update;
+      break;
+    case 15:
+      if (s == "executionReport")
+        return EventType::order_update;
+      break;
+  }
+  return EventType::none;
+}
+
+static ExecType to_exec_type(std::string_view s)
+{
+  std::string_view expected;
+  ExecType type = ExecType::accepted;
+  switch (s.size()) {
+    case 3:
+      expected = "NEW";
+      type = ExecType::accepted;
+      break;
+    case 5:
+      expected = "TRADE";
+      type = ExecType::trade;
+      break;
+    case 7:
+      expected = "EXPIRED";
+      type = ExecType::expired;
+      break;
+    case 8:
+      switch (s[2]) {
+        case 'N':
+          expected = "CANCELED";
+          type = ExecType::canceled;
+          break;
+        case 'P':
+          expected = "REPLACED";
+          type = ExecType::replaced;
+          break;
+        case 'J':
+          expected = "REJECTED";
+          type = ExecType::rejected;
+          break;
+      }
+      break;
+  }
+  if (expected.empty() || s != expected)
     THROW_PARSE_ERROR("unknown execution-type '" << s << "'");
+  return type;
 }
 
 
@@ -140,17 +200,6 @@ static long build_timestamp()
 }
 
 
-// TODO: this is duplicated across files
-static size_t write_callback(void* content, size_t size, size_t nmemb,
-                             void* user)
-{
-  size_t const realsize = size * nmemb;
-  std::string* result = reinterpret_cast<std::string*>(user);
-  result->append((char*)content, realsize);
-  return realsize;
-}
-
-
 const char* to_binance(OrderType ot)
 {
   switch (ot) {
@@ -313,6 +362,49 @@ BinanceSession::Params build_params(Config config) {
   BinanceSession::Params params;
   params.raw_capture_dir = config.get_string("raw_capture_dir", "");
   params.api_key_file = config.get_string("api_key_file", "");
+  params.md_connections =
+      config.get_uint("md_connections", params.md_connections);
+  params.md_streams_per_connection = config.get_uint(
+      "md_streams_per_connection", params.md_streams_per_connection);
+  params.md_io_threads = config.get_uint("md_io_threads", params.md_io_threads);
+  params.md_standby_connections = config.get_uint(
+      "md_standby_connections", params.md_standby_connections);
+  params.md_dual_feed = config.get_bool("md_dual_feed", params.md_dual_feed);
+  params.md_mirror_host =
+      config.get_string("md_mirror_host", params.md_mirror_host);
+  params.md_mirror_port =
+      config.get_uint("md_mirror_port", params.md_mirror_port);
+  params.md_all_book_ticker =
+      config.get_bool("md_all_book_ticker", params.md_all_book_ticker);
+  params.http_connections =
+      config.get_uint("http_connections", params.http_connections);
+  params.http_warm_connections =
+      config.get_uint("http_warm_connections", params.http_warm_connections);
+  params.http_keep_warm_sec =
+      config.get_uint("http_keep_warm_sec", params.http_keep_warm_sec);
+  params.http2 = config.get_bool("http2", params.http2);
+  params.order_entry = config.get_string("order_entry", params.order_entry);
+  params.md_permessage_deflate =
+      config.get_bool("md_permessage_deflate", params.md_permessage_deflate);
+  params.user_permessage_deflate = config.get_bool(
+      "user_permessage_deflate", params.user_permessage_deflate);
+  params.ws_api_permessage_deflate = config.get_bool(
+      "ws_api_permessage_deflate", params.ws_api_permessage_deflate);
+  params.rx_timestamps = config.get_bool("rx_timestamps", params.rx_timestamps);
+  params.account_reconcile_sec = config.get_uint(
+      "account_reconcile_sec", params.account_reconcile_sec);
+
+  auto& limits = params.rate_limits;
+  auto rate_config =
+      config.get_sub_config("rate_limits", Config::empty_config());
+  limits.weight_per_min =
+      rate_config.get_uint("weight_per_min", limits.weight_per_min);
+  limits.orders_per_10s =
+      rate_config.get_uint("orders_per_10s", limits.orders_per_10s);
+  limits.orders_per_day =
+      rate_config.get_uint("orders_per_day", limits.orders_per_day);
+  limits.cancel_reserve =
+      rate_config.get_uint("cancel_reserve", limits.cancel_reserve);
   return params;
 }
 
@@ -350,9 +442,61 @@ BinanceSession::BinanceSession(BaseExchangeSession::EventCallbacks callbacks,
   if (ssl == nullptr)
     throw std::runtime_error("SslContext cannot be none for BinanceSession");
 
-  _raw_capture_dir = config.raw_capture_dir;
-  if (!_raw_capture_dir.empty())
-    create_dir(_raw_capture_dir);
+
+  _params.md_connections = std::max(config.md_connections, 1u);
+  _params.md_streams_per_connection =
+      std::clamp(config.md_streams_per_connection, 1u, 1024u);
+  _params.md_standby_connections = config.md_standby_connections;
+  _params.md_dual_feed = config.md_dual_feed;
+  _params.md_mirror_host = config.md_mirror_host;
+  _params.md_mirror_port = config.md_mirror_port;
+  _params.md_all_book_ticker = config.md_all_book_ticker;
+  _params.md_permessage_deflate = config.md_permessage_deflate;
+  _params.user_permessage_deflate = config.user_permessage_deflate;
+  _params.ws_api_permessage_deflate = config.ws_api_permessage_deflate;
+  _params.rx_timestamps = config.rx_timestamps;
+  _params.account_reconcile_sec = config.account_reconcile_sec;
+  for (unsigned i = 0; i < config.md_io_threads; i++)
+    _md_ioloops.push_back(std::make_unique<IoLoop>());
+
+  if (config.rate_limits.cancel_reserve >= config.rate_limits.weight_per_min)
+    throw ConfigError("binance rate_limits cancel_reserve must be less than "
+                      "weight_per_min");
+  _rate_limiter = std::make_unique<binance::RateLimiter>(config.rate_limits);
+  _rate_limit_collector = metrics::registry().add_collector(
+      [limiter = _rate_limiter.get()]() {
+        auto budget = limiter->budget();
+        binance_budget_weight.set(budget.weight);
+        binance_budget_orders_10s.set(budget.orders_10s);
+        binance_budget_orders_1d.set(budget.orders_day);
+      });
+
+  HttpClientPool::Options http_options;
+  http_options.max_connections = std::max(config.http_connections, 1u);
+  http_options.warm_connections =
+      std::min(config.http_warm_connections, http_options.max_connections);
+  http_options.keep_warm_url = _params.api_endpoint + "/api/v3/ping";
+  http_options.keep_warm_interval = std::chrono::seconds(
+      std::max(config.http_keep_warm_sec, 1u));
+  http_options.http2 = config.http2;
+  http_options.on_header = [limiter = _rate_limiter.get()](std::string_view line) {
+    limiter->on_header(line);
+  };
+  _http = std::make_unique<HttpClientPool>(http_options);
+
+  if (!config.raw_capture_dir.empty())
+    _raw_capture = std::make_unique<RawCaptureWriter>(config.raw_capture_dir);
+
+  // resolve the websocket hosts now, so that connects, and reconnects, find
+  // their addresses ready
+  auto& addresses = AddressCache::instance();
+  addresses.prefetch(_params.md_host, std::to_string(_params.md_port));
+  addresses.prefetch(_params.user_host, std::to_string(_params.user_port));
+  if (!_params.md_mirror_host.empty())
+    addresses.prefetch(_params.md_mirror_host,
+                       std::to_string(_params.md_mirror_port));
+  if (config.order_entry == "websocket")
+    addresses.prefetch(_params.ws_api_host, std::to_string(_params.ws_api_port));
 
   std::filesystem::path secrets_file = config.api_key_file;
 
@@ -370,14 +514,39 @@ BinanceSession::BinanceSession(BaseExchangeSession::EventCallbacks callbacks,
     }
   }
 
-  // we have a separate event-loop for curl, because the requests are
-  // synchronous
-  _curl_requests.dispatch(
-      []() { Logger::instance().register_thread_id("curl"); });
+  _hmac = std::make_unique<HmacSha256>(_user_api_secret);
+  _api_key_headers = std::make_shared<const HttpClientPool::HeaderList>(
+      std::vector<std::string>{"X-MBX-APIKEY: " + _user_api_key});
+
+  if (config.order_entry == "websocket") {
+    _ws_api = std::make_unique<binance::WsApiRequests>(
+        _user_api_key, _user_api_secret, _params.recv_window);
+  } else if (config.order_entry != "rest") {
+    std::ostringstream oss;
+    oss << "invalid binance order_entry " << QUOTE(config.order_entry)
+        << ", expected 'rest' or 'websocket'";
+    throw ConfigError(oss.str());
+  }
 }
 
 
 
+BinanceSession::~BinanceSession()
+{
+  // stop REST requests first, so that no replies are delivered during
+  // destruction
+  _http.reset();
+  metrics::registry().remove_collector(_rate_limit_collector);
+
+  // close the market-data websockets before stopping their IO threads
+  _md_connections.clear();
+  _md_standby.clear();
+  _md_mirrors.clear();
+  for (auto& ioloop : _md_ioloops)
+    ioloop->sync_stop();
+}
+
+
 void BinanceSession::start()
 {
   using namespace std::chrono_literals;
@@ -391,6 +560,22 @@ void BinanceSession::start()
 }
 
 
+/* event-thread: whether a json stream update is no newer than the last
+ * delivered by `arbiter`, which otherwise advances to it. */
+static bool is_stale_update(FeedArbiter& arbiter, const json& data, char key)
+{
+  auto iter = data.find(std::string(1, key));
+  if (iter == data.end() || !iter->is_number_unsigned())
+    return false;
+  auto id = iter->get<uint64_t>();
+  auto lock = std::scoped_lock(arbiter.mtx);
+  if (id <= arbiter.last_id)
+    return true;
+  arbiter.last_id = id;
+  return false;
+}
+
+
 Side buyer_market_maker_to_aggrSide(bool buyer_is_maker)
 {
   if (buyer_is_maker)
@@ -401,33 +586,49 @@ Side buyer_market_maker_to_aggrSide(bool buyer_is_maker)
 
 
 void BinanceSession::subscribe_top(Symbol symbol, subscription_options,
-                                   std::function<void(TickTop)> callback)
+                                   std::function<void(const TickTop&)> callback)
 {
   // Note: this is called from user-thread
 
   if (!callback)
     throw std::runtime_error("subscribe_top() provided with a none callback");
 
-  const int subscribe_id = _next_id++;
+  if (_params.md_all_book_ticker) {
+    subscribe_all_top(symbol.native, std::move(callback));
+    return;
+  }
 
   Subscription sub;
-  sub.id = subscribe_id;
   std::string stream = str_tolower(symbol.native) + "@bookTicker";
-
-  sub.build_request = [stream, subscribe_id]() -> std::string {
-    std::ostringstream oss;
-    oss << "{\"method\": \"SUBSCRIBE\", \"params\": [" << '"' << stream << '"'
-        << "], \"id\":" << subscribe_id << "}";
-    return oss.str();
-  };
+  sub.update_id_key = 'u';
+  // quotes superseded by one already delivered are dropped, so that engines
+  // never see the top of book regress, with one feed or two
+  sub.arbiter = std::make_shared<FeedArbiter>();
 
   auto wp = weak_from_this();
 
+  sub.decode = [wp, callback](std::string_view data,
+                               const trace::Stamp& stamp) {
+    TickTop tick;
+    if (!binance::decode_book_ticker(data, tick))
+      return false;
+    tick.trace = stamp;
+    if (auto sp = wp.lock())
+      sp->_event_loop.dispatch(EventLoop::inline_fn([wp, &callback, tick] {
+        if (wp.lock())
+          callback(tick);
+      }));
+    return true;
+  };
 
-  sub.handler = [wp, callback](json msg) {
+  sub.handler = [wp, callback, arbiter = sub.arbiter](json msg) {
     if (auto sp = wp.lock()) {
       if (auto data = msg.find("data"); data != msg.end()) {
         if (data->is_object()) {
+          if (is_stale_update(*arbiter, *data, 'u')) {
+            sp->count_dropped_update();
+            return;
+          }
           TickTop tick;
           tick.ask_price = std::stod(get_string_field(*data, "a"));
           tick.ask_qty = std::stod(get_string_field(*data, "A"));
@@ -443,6 +644,7 @@ void BinanceSession::subscribe_top(Symbol symbol, subscription_options,
     auto lock = std::scoped_lock(m_subscriptions_mtx);
     if (m_subscriptions.find(stream) == std::end(m_subscriptions)) {
       m_subscriptions.insert({stream, std::move(sub)});
+      index_subscriptions();
       run_on_evloop(
           [](BinanceSession* self) { self->make_pending_subscriptions(); });
     }
@@ -450,8 +652,133 @@ void BinanceSession::subscribe_top(Symbol symbol, subscription_options,
 }
 
 
+/* Called from the user thread, with md_all_book_ticker: the symbol joins the
+ * demux table of the all-market stream, which is subscribed to with the
+ * first symbol. */
+void BinanceSession::subscribe_all_top(
+    const std::string& symbol, std::function<void(const TickTop&)> callback)
+{
+  const std::string stream = "!bookTicker";
+  auto key = str_toupper(symbol);
+
+  auto lock = std::scoped_lock(m_subscriptions_mtx);
+  if (_top_subscribers.find(key) != _top_subscribers.end())
+    return;
+
+  auto& top = _top_subscribers[key];
+  top.callback = std::move(callback);
+  top.arbiter = std::make_shared<FeedArbiter>();
+
+  std::vector<std::pair<std::string, TopSubscriber*>> items;
+  items.reserve(_top_subscribers.size());
+  for (auto& [name, subscriber] : _top_subscribers)
+    items.emplace_back(name, &subscriber);
+  _top_index = PerfectHashMap<TopSubscriber*>(std::move(items));
+
+  if (m_subscriptions.find(stream) != m_subscriptions.end())
+    return;
+
+  Subscription sub;
+  sub.update_id_key = 'u';
+  sub.decode_arbitrates = _params.md_dual_feed;
+  auto wp = weak_from_this();
+  sub.decode = [wp](std::string_view data, const trace::Stamp& stamp) {
+    auto sp = wp.lock();
+    return sp && sp->decode_all_top(data, stamp);
+  };
+  sub.handler = [wp](json msg) {
+    if (auto sp = wp.lock())
+      sp->on_all_top_msg(msg);
+  };
+
+  m_subscriptions.insert({stream, std::move(sub)});
+  index_subscriptions();
+  run_on_evloop(
+      [](BinanceSession* self) { self->make_pending_subscriptions(); });
+}
+
+
+/* io-thread: route an update of the all-market stream by its symbol, which
+ * is found ahead of the prices, so updates of symbols not subscribed cost
+ * only the scan to their "s" member and one probe of the index. */
+bool BinanceSession::decode_all_top(std::string_view data,
+                                    const trace::Stamp& stamp, int feed)
+{
+  std::string_view symbol;
+  if (!binance::decode_symbol(data, symbol))
+    return false;
+
+  TopSubscriber* top = nullptr;
+  {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    if (auto* found = _top_index.find(symbol))
+      top = *found;
+  }
+  if (!top) {
+    binance_md_unsubscribed.add();
+    return true;
+  }
+
+  // as arbitrate_md_update, but with the arbiter of the symbol
+  uint64_t id;
+  if (!binance::decode_update_id(data, 'u', id))
+    return false;
+  auto order = std::scoped_lock(top->arbiter->mtx);
+  if (id <= top->arbiter->last_id) {
+    count_dropped_update();
+    return true;
+  }
+
+  TickTop tick;
+  if (!binance::decode_book_ticker(data, tick))
+    return false;
+  tick.trace = stamp;
+  top->arbiter->last_id = id;
+  _md_feed_first[feed].fetch_add(1, std::memory_order_relaxed);
+
+  _event_loop.dispatch(
+      EventLoop::inline_fn([wp = weak_from_this(), top, tick] {
+        if (wp.lock())
+          top->callback(tick);
+      }));
+  return true;
+}
+
+
+void BinanceSession::on_all_top_msg(const json& msg)
+{
+  assert(is_event_thread());
+
+  auto data = msg.find("data");
+  if (data == msg.end() || !data->is_object())
+    return;
+
+  TopSubscriber* top = nullptr;
+  {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    if (auto* found = _top_index.find(get_string_field(*data, "s")))
+      top = *found;
+  }
+  if (!top) {
+    binance_md_unsubscribed.add();
+    return;
+  }
+  if (is_stale_update(*top->arbiter, *data, 'u')) {
+    count_dropped_update();
+    return;
+  }
+
+  TickTop tick;
+  tick.ask_price = std::stod(get_string_field(*data, "a"));
+  tick.ask_qty = std::stod(get_string_field(*data, "A"));
+  tick.bid_price = std::stod(get_string_field(*data, "b"));
+  tick.bid_qty = std::stod(get_string_field(*data, "B"));
+  top->callback(tick);
+}
+
+
 void BinanceSession::subscribe_trades(Symbol sym, subscription_options,
-                                      std::function<void(TickTrade)> callback)
+                                      std::function<void(const TickTrade&)> callback)
 {
   // Note: this is called from user-thread
 
@@ -467,18 +794,26 @@ void BinanceSession::subscribe_trades(Symbol sym, subscription_options,
   // TODO: create localised subscription request
 
   Subscription sub;
-  const int subscribe_id = _next_id++;
-  sub.id = subscribe_id;
   std::string stream = str_tolower(sym.native) + "@aggTrade";
+  sub.update_id_key = 'a';
+  if (_params.md_dual_feed)
+    sub.arbiter = std::make_shared<FeedArbiter>();
 
-  sub.build_request = [stream, subscribe_id]() -> std::string {
-    std::ostringstream oss;
-    oss << "{\"method\": \"SUBSCRIBE\", \"params\": [" << '"' << stream << '"'
-        << "], \"id\": " << subscribe_id << " }";
-    return oss.str();
+  auto wp = weak_from_this();
+  sub.decode = [wp, callback](std::string_view data,
+                               const trace::Stamp& stamp) {
+    TickTrade tick;
+    if (!binance::decode_agg_trade(data, tick))
+      return false;
+    tick.trace = stamp;
+    if (auto sp = wp.lock())
+      sp->_event_loop.dispatch(EventLoop::inline_fn([wp, &callback, tick] {
+        if (wp.lock())
+          callback(tick);
+      }));
+    return true;
   };
 
-  auto wp = weak_from_this();
   sub.handler = [wp, callback, sym](json msg) {
     if (auto sp = wp.lock()) {
       if (auto data = msg.find("data"); data != msg.end()) {
@@ -500,6 +835,57 @@ void BinanceSession::subscribe_trades(Symbol sym, subscription_options,
     auto lock = std::scoped_lock(m_subscriptions_mtx);
     if (m_subscriptions.find(stream) == std::end(m_subscriptions)) {
       m_subscriptions.insert({stream, std::move(sub)});
+      index_subscriptions();
+      run_on_evloop(
+          [](BinanceSession* self) { self->make_pending_subscriptions(); });
+    }
+  }
+}
+
+
+void BinanceSession::subscribe_book(
+    Symbol sym, subscription_options,
+    std::function<void(const TickBookDelta&)> callback)
+{
+  // Note: this is called from user-thread
+
+  if (!callback)
+    throw std::runtime_error("subscribe_book() provided with a none callback");
+
+  Subscription sub;
+  std::string stream = str_tolower(sym.native) + "@depth@100ms";
+  sub.update_id_key = 'u'; // final update id; overlapping diffs are applied
+  if (_params.md_dual_feed)
+    sub.arbiter = std::make_shared<FeedArbiter>();
+
+  auto sync = std::make_shared<DepthSync>();
+  sync->symbol = str_toupper(sym.native);
+  sync->callback = std::move(callback);
+
+  auto wp = weak_from_this();
+  sub.decode = [wp, sync](std::string_view data, const trace::Stamp&) {
+    binance::DepthUpdate update;
+    TickBookDelta delta;
+    if (!binance::decode_depth_update(data, update, delta))
+      return false;
+    if (auto sp = wp.lock())
+      sp->run_on_evloop([sync, update, delta = std::move(delta)](
+                            BinanceSession* self) mutable {
+        self->on_depth_update(sync, update, delta);
+      });
+    return true;
+  };
+
+  sub.handler = [stream](json msg) {
+    LOG_WARN("unexpected binance message for stream '" << stream
+                                                       << "': " << msg);
+  };
+
+  {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    if (m_subscriptions.find(stream) == std::end(m_subscriptions)) {
+      m_subscriptions.insert({stream, std::move(sub)});
+      index_subscriptions();
       run_on_evloop(
           [](BinanceSession* self) { self->make_pending_subscriptions(); });
     }
@@ -507,49 +893,279 @@ void BinanceSession::subscribe_trades(Symbol sym, subscription_options,
 }
 
 
+void BinanceSession::on_depth_update(const std::shared_ptr<DepthSync>& sync,
+                                     binance::DepthUpdate update,
+                                     TickBookDelta& delta)
+{
+  assert(is_event_thread());
+
+  // the diff buffer is bounded, in case snapshots are slow or failing
+  static constexpr size_t max_pending = 1000;
+
+  if (sync->synced) {
+    if (apply_depth_update(*sync, update, delta))
+      return;
+    LOG_WARN("gap in binance depth updates for " << sync->symbol
+             << ", last " << sync->last_update_id << ", next "
+             << update.first_update_id << "; resynchronising");
+    sync->synced = false;
+    sync->pending.clear();
+  }
+
+  if (sync->pending.size() >= max_pending)
+    sync->pending.erase(sync->pending.begin());
+  sync->pending.emplace_back(update, std::move(delta));
+
+  if (!sync->snapshot_requested &&
+      std::chrono::steady_clock::now() >= sync->next_snapshot)
+    request_depth_snapshot(sync);
+}
+
+
+bool BinanceSession::apply_depth_update(DepthSync& sync,
+                                        binance::DepthUpdate update,
+                                        const TickBookDelta& delta)
+{
+  if (update.final_update_id <= sync.last_update_id)
+    return true; // already reflected in the book
+  if (update.first_update_id > sync.last_update_id + 1)
+    return false;
+  sync.last_update_id = update.final_update_id;
+  sync.callback(delta);
+  return true;
+}
+
+
+void BinanceSession::request_depth_snapshot(
+    const std::shared_ptr<DepthSync>& sync)
+{
+  assert(is_event_thread());
+
+  // snapshots carry a high request weight, so are rate limited per symbol
+  sync->snapshot_requested = true;
+  sync->next_snapshot = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+
+  std::string path = "/api/v3/depth?symbol=" + sync->symbol + "&limit=1000";
+  LOG_INFO("requesting binance depth snapshot for " << sync->symbol);
+
+  auto wp = weak_from_this();
+  this->http_request(HttpRequestType::get, _params.api_endpoint, path, {}, nullptr,
+                     [wp, sync](std::string result, std::string error) {
+                       auto sp = wp.lock();
+                       if (!sp)
+                         return;
+                       sync->snapshot_requested = false;
+                       if (!error.empty()) {
+                         LOG_ERROR("http error when requesting depth snapshot: "
+                                   << error);
+                         return;
+                       }
+                       sp->on_depth_snapshot(sync, result);
+                     });
+}
+
+
+void BinanceSession::on_depth_snapshot(const std::shared_ptr<DepthSync>& sync,
+                                       const std::string& result)
+{
+  assert(is_event_thread());
+
+  TickBookDelta snapshot;
+  uint64_t last_update_id = 0;
+  if (!binance::decode_depth_snapshot(result, last_update_id, snapshot)) {
+    log_message_exception("on_depth_snapshot", result);
+    return;
+  }
+
+  // diffs held in the snapshot are dropped; if the oldest diff that follows
+  // it does not join up, the snapshot is too old and another is needed
+  auto& pending = sync->pending;
+  auto first = std::find_if(pending.begin(), pending.end(), [&](auto& item) {
+    return item.first.final_update_id > last_update_id;
+  });
+  if (first != pending.end() &&
+      first->first.first_update_id > last_update_id + 1) {
+    LOG_WARN("binance depth snapshot for " << sync->symbol
+             << " is older than buffered updates; retrying");
+    return;
+  }
+
+  sync->last_update_id = last_update_id;
+  sync->synced = true;
+  sync->callback(snapshot);
+
+  auto buffered = std::move(pending);
+  pending.clear();
+  for (auto& item : buffered)
+    if (sync->synced && !apply_depth_update(*sync, item.first, item.second)) {
+      sync->synced = false;
+      pending.emplace_back(std::move(item));
+    } else if (!sync->synced) {
+      pending.emplace_back(std::move(item));
+    }
+}
+
+
 void BinanceSession::retry_connect_market_data_stream()
 {
   assert(is_event_thread());
 
-  if (not _mktdata_stream) {
-    LOG_INFO("attempting binance-spot market-data stream connection");
+  // more connections are needed once the subscriptions exceed the limit
+  size_t required = _params.md_connections;
+  {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    const size_t limit = _params.md_streams_per_connection;
+    required = std::max(required, (m_subscriptions.size() + limit - 1) / limit);
+  }
+  while (_md_connections.size() < required) {
+    MdConnection conn;
+    conn.ioloop = _md_ioloops.empty()
+                      ? _ioloop
+                      : _md_ioloops[_md_connections.size() % _md_ioloops.size()]
+                            .get();
+    _md_connections.push_back(std::move(conn));
+  }
 
-    auto wp = weak_from_this();
+  for (size_t i = 0; i < _md_connections.size(); i++) {
+    auto& conn = _md_connections[i];
+    if (conn.ws && !conn.ws->is_open())
+      on_md_connection_down(conn.id);
+    if (!conn.ws)
+      connect_md_connection(i);
+  }
 
-    auto on_down = [wp]() {
-      /* io-thread */
-      if (auto sp = wp.lock())
-        sp->run_on_evloop(
-            [](BinanceSession* self) {
-              self->on_mktdata_websocket_down();
-            });
-    };
+  if (_params.md_dual_feed) {
+    _md_mirrors.resize(_md_connections.size());
+    for (size_t i = 0; i < _md_mirrors.size(); i++) {
+      auto& mirror = _md_mirrors[i];
+      if (mirror.ws && !mirror.ws->is_open())
+        on_md_connection_down(mirror.id);
+      if (!mirror.ws)
+        connect_md_mirror(i);
+    }
+  }
 
-    auto on_msg = [wp](json j) mutable {
-      /* io-thread */
-      if (auto sp = wp.lock()) {
-        sp->run_on_evloop([j](BinanceSession* self) {
-          self->on_websocket_msg(std::move(j));
-        });
-      }
-    };
+  for (size_t i = 0; i < _md_standby.size();) {
+    if (_md_standby[i].ws->is_open())
+      i++;
+    else
+      on_md_connection_down(_md_standby[i].id);
+  }
+  while (_md_standby.size() < _params.md_standby_connections) {
+    size_t before = _md_standby.size();
+    connect_md_standby();
+    if (_md_standby.size() == before)
+      break; // try again later
+  }
+}
 
-    try {
-      auto ws =
-          open_websocket("binance market-data channel", _params.md_host,
-                         _params.md_port, _params.md_path, on_down, on_msg);
-      if (ws) {
-        run_on_evloop(
-            [ws](BinanceSession* self) { self->on_websocket_up(ws); });
-      }
-    } catch (const std::runtime_error& e) {
-      LOG_WARN("failed to establish binance market-data websocket, "
-               << e.what());
+
+std::shared_ptr<WebsocketClient> BinanceSession::open_md_websocket(
+    const std::string& name, IoLoop* ioloop, uint64_t id, bool mirror)
+{
+  assert(is_event_thread());
+
+  auto wp = weak_from_this();
+
+  auto on_down = [wp, id]() {
+    /* io-thread */
+    if (auto sp = wp.lock())
+      sp->run_on_evloop(
+          [id](BinanceSession* self) { self->on_md_connection_down(id); });
+  };
+
+  auto on_msg = [wp, id](json j) mutable {
+    /* io-thread */
+    if (auto sp = wp.lock()) {
+      sp->run_on_evloop([j, id](BinanceSession* self) {
+        self->on_websocket_msg(std::move(j), id);
+      });
     }
+  };
+
+  auto on_raw = [wp, id](const char* buf, size_t len, uint64_t rx_time) {
+    /* io-thread */
+    if (auto sp = wp.lock())
+      return sp->io_on_websocket_raw(buf, len, id, rx_time);
+    return true;
+  };
+
+  try {
+    return open_websocket(name, mirror ? _params.md_mirror_host : _params.md_host,
+                          mirror ? _params.md_mirror_port : _params.md_port,
+                          _params.md_path, on_down, on_msg, on_raw, ioloop,
+                          _params.md_permessage_deflate);
+  } catch (const std::runtime_error& e) {
+    LOG_WARN("failed to establish binance market-data websocket, "
+             << e.what());
+    return {};
+  }
+}
+
+
+void BinanceSession::connect_md_connection(size_t index)
+{
+  assert(is_event_thread());
+
+  LOG_INFO("attempting binance-spot market-data stream connection "
+           << index + 1 << "/" << _md_connections.size());
+
+  const uint64_t id = _next_md_connection_id++;
+  if (auto ws = open_md_websocket("binance market-data channel",
+                                  _md_connections[index].ioloop, id)) {
+    _md_connections[index].ws = std::move(ws);
+    _md_connections[index].id = id;
+    on_md_connection_up(index);
+  }
+}
+
+
+void BinanceSession::connect_md_mirror(size_t index)
+{
+  assert(is_event_thread());
+
+  LOG_INFO("attempting binance-spot market-data mirror connection "
+           << index + 1 << "/" << _md_mirrors.size());
+
+  // served by another IO thread than the connection it mirrors, if there is
+  // one, so that the feeds do not queue behind each other
+  auto& mirror = _md_mirrors[index];
+  mirror.ioloop = _md_ioloops.empty()
+                      ? _ioloop
+                      : _md_ioloops[(index + 1) % _md_ioloops.size()].get();
+  const uint64_t id = _next_md_connection_id++;
+  if (auto ws = open_md_websocket("binance market-data mirror", mirror.ioloop,
+                                  id, true)) {
+    mirror.ws = std::move(ws);
+    mirror.id = id;
+    LOG_INFO("binance-spot market-data mirror " << index + 1 << " connected");
+    make_pending_subscriptions();
   }
 }
 
 
+void BinanceSession::connect_md_standby()
+{
+  assert(is_event_thread());
+
+  LOG_INFO("attempting binance-spot market-data standby connection "
+           << _md_standby.size() + 1 << "/" << _params.md_standby_connections);
+
+  MdConnection standby;
+  standby.ioloop =
+      _md_ioloops.empty()
+          ? _ioloop
+          : _md_ioloops[(_md_connections.size() + _md_standby.size()) %
+                        _md_ioloops.size()]
+                .get();
+  standby.id = _next_md_connection_id++;
+  standby.ws = open_md_websocket("binance market-data standby", standby.ioloop,
+                                 standby.id);
+  if (standby.ws)
+    _md_standby.push_back(std::move(standby));
+}
+
+
 void BinanceSession::retry_connect_user_data_stream()
 {
   assert(is_event_thread());
@@ -582,10 +1198,16 @@ void BinanceSession::retry_connect_user_data_stream()
           });
         };
 
+        auto on_raw = [this](const char* buf, size_t len, uint64_t) {
+          /* io-thread */
+          return this->io_on_userdata_raw(buf, len);
+        };
+
         try {
           auto ws =
               open_websocket("binance-user-data channel", _params.user_host,
-                             _params.user_port, path, on_down, on_msg);
+                             _params.user_port, path, on_down, on_msg, on_raw,
+                             nullptr, _params.user_permessage_deflate);
           if (ws) {
             run_on_evloop([ws](BinanceSession* self) {
               self->on_user_data_stream_up(ws);
@@ -623,22 +1245,32 @@ void BinanceSession::manage_connection()
 
   switch (_service_state) {
     case ServiceState::reseting: {
-      _mktdata_stream.reset();
+      _md_standby.clear();
+      for (auto& conn : _md_connections)
+        on_md_connection_down(conn.id);
+      for (auto& mirror : _md_mirrors)
+        on_md_connection_down(mirror.id);
       _user_stream.reset();
+      if (_order_ws)
+        on_order_entry_down(_order_ws);
 
       LOG_INFO("*** binance-spot reconnecting ***");
+      binance_reconnects.add();
       _service_state = ServiceState::connecting;
       break;
     }
     case ServiceState::connecting: {
       refresh_user_stream_listen_key();
       retry_connect_user_data_stream();
+      retry_connect_order_entry();
       break;
     }
     case ServiceState::connected: {
       refresh_user_stream_listen_key();
+      retry_connect_order_entry();
       ping_market_data();
       retry_connect_market_data_stream();
+      log_md_feed_stats();
     }
   }
 
@@ -659,7 +1291,7 @@ void BinanceSession::ping_market_data()
     }
   };
 
-  this->http_request(HttpRequestType::get, _params.api_endpoint, path, {}, {},
+  this->http_request(HttpRequestType::get, _params.api_endpoint, path, {}, nullptr,
                      on_result);
 }
 
@@ -671,6 +1303,8 @@ bool BinanceSession::eval_connection_state()
       return false;
     if (_user_stream && !_user_stream->is_open())
       return false;
+    if (ws_order_entry() && !(_order_ws && _order_ws->is_open()))
+      return false;
   }
 
   return true;
@@ -705,44 +1339,160 @@ void BinanceSession::on_user_data_stream_up(std::shared_ptr<WebsocketClient> ws)
 }
 
 
-std::shared_ptr<apex::WebsocketClient> BinanceSession::open_websocket(
-    std::string streamname, std::string host, int port, std::string path,
-    std::function<void()> on_down, std::function<void(json)> on_msg)
+void BinanceSession::retry_connect_order_entry()
 {
-  LOG_INFO(streamname << ": attempting websocket connection to '" << host << ":"
-                      << port << path << "'");
+  assert(is_event_thread());
 
-  std::unique_ptr<TcpSocket> sock(new SslSocket(*_ssl, *_ioloop));
-  auto fut = sock->connect(host, port);
+  if (!ws_order_entry() || is_paper_trading())
+    return;
+  if (_order_ws && _order_ws->is_open())
+    return;
 
-  if (fut.wait_for(std::chrono::milliseconds(4000)) !=
-      std::future_status::ready)
-    throw std::runtime_error("timeout during connect");
+  LOG_INFO("attempting binance-spot order-entry connection");
 
-  if (UvErr ec = fut.get())
-    throw std::runtime_error(
-        "connect failed: " + std::to_string(ec.os_value()) + ", " +
-        ec.message());
+  // each connection reports its own loss, so that of a replaced connection
+  // is ignored
+  auto ws_holder = std::make_shared<std::weak_ptr<WebsocketClient>>();
 
-  auto msg_cb = [on_msg](const char* buf, size_t len) {
+  auto on_down = [this, ws_holder]() {
     /* io-thread */
-    on_msg(json::parse(buf, buf + len));
+    this->run_on_evloop([ws_holder](BinanceSession* self) {
+      if (auto ws = ws_holder->lock())
+        self->on_order_entry_down(ws);
+    });
   };
 
-
-  auto completion_promise = std::make_shared<std::promise<void>>();
-
-  auto on_open = [&] {
+  auto on_msg = [this](json j) mutable {
     /* io-thread */
-    completion_promise->set_value();
+    this->run_on_evloop([j](BinanceSession* self) {
+      self->on_order_entry_msg(std::move(j));
+    });
   };
 
-  auto on_error = on_down;
+  try {
+    auto ws = open_websocket("binance-order-entry channel", _params.ws_api_host,
+                             _params.ws_api_port, _params.ws_api_path, on_down,
+                             on_msg, {}, nullptr,
+                             _params.ws_api_permessage_deflate);
+    if (ws) {
+      *ws_holder = ws;
+      on_order_entry_up(std::move(ws));
+    }
+  } catch (const std::runtime_error& e) {
+    LOG_WARN("failed to establish websocket, " << e.what());
+  }
+}
 
-  std::shared_ptr<WebsocketClient> ws = std::make_shared<WebsocketClient>(
-    _event_loop, std::move(sock), path, msg_cb, on_open, on_error);
 
-  {
+void BinanceSession::on_order_entry_up(std::shared_ptr<WebsocketClient> ws)
+{
+  assert(is_event_thread());
+  _order_ws = std::move(ws);
+  LOG_INFO("binance-spot order-entry channel connected");
+  check_connection_state();
+}
+
+
+void BinanceSession::on_order_entry_down(const std::shared_ptr<WebsocketClient>& ws)
+{
+  assert(is_event_thread());
+  if (ws != _order_ws)
+    return;
+
+  LOG_WARN("binance-spot order-entry channel lost");
+  _order_ws.reset();
+
+  // the outcome of requests in flight is unknown; their orders are reported
+  // as rejected, as for a failed REST request, and any fills still arrive on
+  // the user data stream
+  _ws_api->fail_all("order-entry websocket lost");
+  check_connection_state();
+}
+
+
+void BinanceSession::on_order_entry_msg(json msg)
+{
+  assert(is_event_thread());
+
+  if (_raw_capture)
+    _raw_capture->write("ws_api_reply", msg.dump());
+
+  try {
+    if (auto iter = msg.find("rateLimits"); iter != msg.end())
+      _rate_limiter->on_ws_rate_limits(*iter);
+    if (!_ws_api->on_message(msg))
+      LOG_WARN("unexpected order-entry message: " << msg);
+  } catch (...) {
+    log_message_exception("on_order_entry_msg", msg.dump());
+  }
+}
+
+
+bool BinanceSession::send_ws_request(
+    const char* method, std::vector<std::pair<std::string, json>> params,
+    std::function<void(int status, json& body)> on_reply)
+{
+  assert(is_event_thread());
+  if (!_order_ws || !_order_ws->is_open())
+    return false;
+
+  auto request = _ws_api->make_signed(method, std::move(params),
+                                      binance::build_timestamp(),
+                                      std::move(on_reply));
+  LOG_DEBUG("WS-API:" << method);
+  _order_ws->send(request.c_str(), request.size());
+  return true;
+}
+
+
+std::shared_ptr<apex::WebsocketClient> BinanceSession::open_websocket(
+    std::string streamname, std::string host, int port, std::string path,
+    std::function<void()> on_down, std::function<void(json)> on_msg,
+    std::function<bool(const char*, size_t, uint64_t)> on_raw, IoLoop* ioloop,
+    bool permessage_deflate)
+{
+  LOG_INFO(streamname << ": attempting websocket connection to '" << host << ":"
+                      << port << path << "'");
+
+  TcpSocket::options sockopts;
+  sockopts.rx_timestamps = _params.rx_timestamps;
+  std::unique_ptr<TcpSocket> sock(
+      new SslSocket(*_ssl, ioloop ? *ioloop : *_ioloop, sockopts));
+  auto fut = sock->connect(host, port);
+
+  if (fut.wait_for(std::chrono::milliseconds(4000)) !=
+      std::future_status::ready)
+    throw std::runtime_error("timeout during connect");
+
+  if (UvErr ec = fut.get())
+    throw std::runtime_error(
+        "connect failed: " + std::to_string(ec.os_value()) + ", " +
+        ec.message());
+
+  // frames are delivered during the socket read they complete, so the
+  // socket's receive time is that of the frame
+  auto msg_cb = [on_msg, on_raw, rx = sock.get()](const char* buf, size_t len) {
+    /* io-thread */
+    if (on_raw && on_raw(buf, len, rx->rx_time()))
+      return;
+    on_msg(json::parse(buf, buf + len));
+  };
+
+
+  auto completion_promise = std::make_shared<std::promise<void>>();
+
+  auto on_open = [&] {
+    /* io-thread */
+    completion_promise->set_value();
+  };
+
+  auto on_error = on_down;
+
+  std::shared_ptr<WebsocketClient> ws = std::make_shared<WebsocketClient>(
+      _event_loop, std::move(sock), path, msg_cb, on_open, on_error,
+      permessage_deflate);
+
+  {
     // wait for the websocket to become open
     auto fut = completion_promise->get_future();
     if (fut.wait_for(std::chrono::milliseconds(4000)) !=
@@ -750,33 +1500,124 @@ std::shared_ptr<apex::WebsocketClient> BinanceSession::open_websocket(
       throw std::runtime_error("timeout during websocket initiation");
   }
 
-  LOG_INFO(streamname << ": websocket established");
+  LOG_INFO(streamname << ": websocket established"
+                      << (ws->is_deflate_enabled() ? ", with permessage-deflate"
+                          : permessage_deflate ? ", permessage-deflate declined"
+                                               : ""));
   return ws;
 }
 
 
-void BinanceSession::on_mktdata_websocket_down()
+void BinanceSession::on_md_connection_down(uint64_t id)
 {
-  LOG_WARN("binance-spot market-data websocket down");
-  _mktdata_stream.reset();
+  assert(is_event_thread());
+
+  if (id == 0)
+    return;
+
+  auto standby =
+      std::find_if(_md_standby.begin(), _md_standby.end(),
+                   [id](const MdConnection& c) { return c.id == id; });
+  if (standby != _md_standby.end()) {
+    LOG_WARN("binance-spot market-data standby websocket down");
+    _md_standby.erase(standby);
+    return;
+  }
+
+  auto mirror =
+      std::find_if(_md_mirrors.begin(), _md_mirrors.end(),
+                   [id](const MdConnection& c) { return c.id == id; });
+  if (mirror != _md_mirrors.end()) {
+    LOG_WARN("binance-spot market-data mirror "
+             << mirror - _md_mirrors.begin() + 1 << " down");
+    mirror->ws.reset();
+    mirror->id = 0;
+    mirror->streams = 0;
+    mirror->to_subscribe.clear();
+    mirror->to_unsubscribe.clear();
+    mirror->requests_sent.clear();
+    {
+      auto lock = std::scoped_lock(m_subscriptions_mtx);
+      for (auto& item : m_subscriptions)
+        if (item.second.mirror == id)
+          item.second.mirror = 0;
+    }
+    make_pending_subscriptions();
+    return;
+  }
+
+  auto iter =
+      std::find_if(_md_connections.begin(), _md_connections.end(),
+                   [id](const MdConnection& c) { return c.id == id; });
+  if (iter == _md_connections.end())
+    return; // an earlier connection
+
+  const size_t index = iter - _md_connections.begin();
+  auto& conn = *iter;
+  LOG_WARN("binance-spot market-data websocket " << index + 1 << " down");
+  if (conn.ws && conn.ws->is_deflate_enabled()) {
+    auto stats = conn.ws->get_inflate_stats();
+    LOG_INFO("binance-spot market-data websocket "
+             << index + 1 << " permessage-deflate received " << stats.bytes_in
+             << " bytes, inflated to " << stats.bytes_out);
+  }
+  conn.ws.reset();
+  conn.id = 0;
+  conn.streams = 0;
+  conn.to_subscribe.clear();
+  conn.to_unsubscribe.clear();
+  conn.requests_sent.clear();
+  conn.down_since = std::chrono::steady_clock::now();
+
+  {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+
+    // a replacement lost before its first tick continues the earlier outage
+    if (auto r = _md_recovering.find(id); r != _md_recovering.end()) {
+      conn.down_since = r->second;
+      _md_recovering.erase(r);
+    }
+
+    for (auto& item : m_subscriptions)
+      if (item.second.connection == id)
+        item.second.connection = 0;
+  }
+
+  // a standby takes over the streams at once; without one, they fail over to
+  // the remaining connections
+  while (!_md_standby.empty()) {
+    MdConnection standby = std::move(_md_standby.back());
+    _md_standby.pop_back();
+    if (!standby.ws->is_open())
+      continue;
+
+    LOG_INFO("binance-spot market-data standby websocket replaces "
+             << index + 1);
+    conn.ioloop = standby.ioloop;
+    conn.ws = std::move(standby.ws);
+    conn.id = standby.id;
+    on_md_connection_up(index);
+    return;
+  }
+
+  make_pending_subscriptions();
 }
 
 
-void BinanceSession::on_websocket_msg(json msg)
+void BinanceSession::on_websocket_msg(json msg, uint64_t connection)
 {
   assert(is_event_thread());
-
-  std::ostringstream oss;
-  oss << msg;
+  APEX_PROFILE_ZONE("BinanceSession::on_websocket_msg");
 
   if (msg.is_object()) {
 
     if (auto istream = msg.find("stream"); istream != msg.end()) {
-      auto stream = istream->get<std::string>();
+      auto& stream = istream->get_ref<const std::string&>();
 
-      if (auto iter = m_subscriptions.find(stream);
-          iter != std::end(m_subscriptions)) {
-        iter->second.handler(msg);
+      if (auto* sub = _ev_stream_index.find(stream)) {
+        // ignore updates from a connection the stream has moved from
+        if ((*sub)->connection == connection)
+          (*sub)->handler(msg);
       } else {
         LOG_ERROR("no handler set up for stream update '" << stream << "'");
       }
@@ -791,59 +1632,401 @@ void BinanceSession::on_websocket_msg(json msg)
 }
 
 
-void BinanceSession::on_websocket_up(std::shared_ptr<WebsocketClient> ws)
+bool BinanceSession::io_on_websocket_raw(const char* buf, size_t len,
+                                         uint64_t connection, uint64_t rx_time)
 {
-  assert(is_event_thread());
-  _mktdata_stream = std::move(ws);
-  LOG_INFO("binance-spot market-data channel connected");
+  /* io-thread */
+  auto stamp = trace::tracer().receive(rx_time);
+  binance_md_messages.add();
 
-  // We need to reissue all subscriptions, so, set them all to inactive to allow
-  // that to happen.
+  if (_raw_capture)
+    _raw_capture->write("market_data", std::string_view(buf, len));
 
+  binance::StreamMessage msg;
+  if (!binance::decode_stream_message({buf, len}, msg))
+    return false;
+
+  // subscriptions are never removed, so the entry outlives the lock
+  Subscription* sub = nullptr;
+  int feed = 0;
   {
     auto lock = std::scoped_lock(m_subscriptions_mtx);
-    for (auto& item : m_subscriptions)
-      item.second.is_requested = false;
+    if (auto* indexed = m_stream_index.find(msg.stream)) {
+      if ((*indexed)->connection == connection)
+        feed = 0;
+      else if ((*indexed)->mirror && (*indexed)->mirror == connection)
+        feed = 1;
+      else
+        return true; // the stream has moved to another connection
+      sub = *indexed;
+      if (!_md_recovering.empty())
+        note_md_recovery(connection);
+    }
+  }
+
+  if (!sub || !sub->decode)
+    return false;
+  if (sub->arbiter)
+    return arbitrate_md_update(*sub, feed, msg.data, stamp);
+  if (sub->decode_arbitrates)
+    return decode_all_top(msg.data, stamp, feed);
+  return sub->decode(msg.data, stamp);
+}
+
+
+void BinanceSession::replay_md_frame(std::string_view frame, bool json_path)
+{
+  /* io-thread, or a thread standing in for one */
+  uint64_t connection = 0;
+  binance::StreamMessage msg;
+  if (binance::decode_stream_message(frame, msg)) {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    if (auto* sub = m_stream_index.find(msg.stream))
+      connection = (*sub)->connection;
+  }
+
+  if (!json_path && io_on_websocket_raw(frame.data(), frame.size(), connection))
+    return;
+
+  run_on_evloop([j = json::parse(frame), connection](BinanceSession* self) {
+    self->on_websocket_msg(j, connection);
+  });
+}
+
+
+void BinanceSession::replay_md_frame(std::string_view frame,
+                                     uint64_t connection)
+{
+  /* io-thread, or a thread standing in for one */
+  if (io_on_websocket_raw(frame.data(), frame.size(), connection))
+    return;
+
+  run_on_evloop([j = json::parse(frame), connection](BinanceSession* self) {
+    self->on_websocket_msg(j, connection);
+  });
+}
+
+
+uint64_t BinanceSession::replay_md_connection(
+    bool mirror, std::function<void(const std::string&)> on_request)
+{
+  std::promise<uint64_t> attached;
+  run_on_evloop([&attached, mirror, &on_request](BinanceSession* self) {
+    MdConnection conn;
+    conn.id = self->_next_md_connection_id++;
+    conn.replay_requests = std::move(on_request);
+    auto id = conn.id;
+    if (mirror) {
+      self->_md_mirrors.push_back(std::move(conn));
+      self->make_pending_subscriptions();
+    } else {
+      self->_md_connections.push_back(std::move(conn));
+      self->on_md_connection_up(self->_md_connections.size() - 1);
+    }
+    attached.set_value(id);
+  });
+  return attached.get_future().get();
+}
+
+
+bool BinanceSession::arbitrate_md_update(Subscription& sub, int feed,
+                                         std::string_view data,
+                                         const trace::Stamp& stamp)
+{
+  /* io-thread */
+  uint64_t id;
+  if (!binance::decode_update_id(data, sub.update_id_key, id))
+    return feed == 1; // left to the json handler, of the primary copy only
+
+  // the feeds are served by different IO threads, so the arbiter lock is
+  // held over the decode, to keep the deliveries in update order
+  auto lock = std::scoped_lock(sub.arbiter->mtx);
+  if (id <= sub.arbiter->last_id) {
+    count_dropped_update();
+    return true;
+  }
+  if (!sub.decode(data, stamp))
+    return feed == 1;
+  sub.arbiter->last_id = id;
+  _md_feed_first[feed].fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+
+/* An update dropped by an arbiter: with dual-feed, usually the late copy of
+ * an update, otherwise one superseded, as after a reconnect. */
+void BinanceSession::count_dropped_update()
+{
+  if (_params.md_dual_feed)
+    _md_feed_duplicates.fetch_add(1, std::memory_order_relaxed);
+  else
+    binance_md_stale.add();
+}
+
+
+BinanceSession::md_feed_stats BinanceSession::get_md_feed_stats() const
+{
+  md_feed_stats stats;
+  stats.primary_first = _md_feed_first[0].load(std::memory_order_relaxed);
+  stats.mirror_first = _md_feed_first[1].load(std::memory_order_relaxed);
+  stats.duplicates = _md_feed_duplicates.load(std::memory_order_relaxed);
+  return stats;
+}
+
+
+void BinanceSession::log_md_feed_stats()
+{
+  assert(is_event_thread());
+
+  const auto now = std::chrono::steady_clock::now();
+  if (!_params.md_dual_feed || now - _md_feed_stats_logged < std::chrono::minutes(1))
+    return;
+  _md_feed_stats_logged = now;
+
+  auto stats = get_md_feed_stats();
+  const uint64_t total = stats.primary_first + stats.mirror_first;
+  if (total == 0)
+    return;
+  LOG_INFO("binance-spot market-data dual feed: primary first "
+           << stats.primary_first << " (" << 100.0 * stats.primary_first / total
+           << "%), mirror first " << stats.mirror_first << " ("
+           << 100.0 * stats.mirror_first / total << "%), late copies dropped "
+           << stats.duplicates);
+}
+
+
+/* Called with m_subscriptions_mtx held, after a subscription is added. */
+void BinanceSession::index_subscriptions()
+{
+  std::vector<std::pair<std::string, Subscription*>> items;
+  items.reserve(m_subscriptions.size());
+  for (auto& [stream, sub] : m_subscriptions)
+    items.emplace_back(stream, &sub);
+  m_stream_index = PerfectHashMap<Subscription*>(std::move(items));
+}
+
+
+/* Called with m_subscriptions_mtx held, for a tick on `connection`. */
+void BinanceSession::note_md_recovery(uint64_t connection)
+{
+  auto iter = _md_recovering.find(connection);
+  if (iter == _md_recovering.end())
+    return;
+
+  auto elapsed = std::chrono::steady_clock::now() - iter->second;
+  _md_recovering.erase(iter);
+  _md_recovery_latency.record(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+
+  LOG_INFO("binance-spot market-data first tick "
+           << std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                  .count()
+           << " ms after connection loss; recoveries "
+           << _md_recovery_latency.snapshot());
+}
+
+
+LatencyHistogram::Snapshot BinanceSession::md_recovery_latency()
+{
+  auto lock = std::scoped_lock(m_subscriptions_mtx);
+  return _md_recovery_latency.snapshot();
+}
+
+
+void BinanceSession::on_md_connection_up(size_t index)
+{
+  assert(is_event_thread());
+  LOG_INFO("binance-spot market-data channel " << index + 1 << " connected");
+
+  auto& conn = _md_connections[index];
+  if (conn.down_since != std::chrono::steady_clock::time_point{}) {
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    _md_recovering[conn.id] = conn.down_since;
+    conn.down_since = {};
   }
 
+  // streams without a connection go to the new one first, so that only a
+  // remaining shortfall is moved over from other connections
   make_pending_subscriptions();
+  rebalance_md_connections(index);
+  send_md_requests();
 }
 
 
-void BinanceSession::make_pending_subscriptions()
+void BinanceSession::rebalance_md_connections(size_t target_index)
 {
   assert(is_event_thread());
 
-  if (not _mktdata_stream)
+  size_t total = 0, connected = 0;
+  for (auto& conn : _md_connections)
+    if (conn.id) {
+      total += conn.streams;
+      connected++;
+    }
+  if (connected < 2)
     return;
 
+  // move streams from the most loaded connections until the target has its
+  // share; updates are taken from the new connection from the moment of the
+  // move, so none are duplicated
+  MdConnection& target = _md_connections[target_index];
+  const size_t share = total / connected;
   auto lock = std::scoped_lock(m_subscriptions_mtx);
 
   for (auto& item : m_subscriptions) {
+    if (target.streams >= share)
+      break;
+
     Subscription& sub = item.second;
+    auto source = std::find_if(
+        _md_connections.begin(), _md_connections.end(),
+        [&](const MdConnection& c) { return c.id && c.id == sub.connection; });
+    if (source == _md_connections.end() || &*source == &target ||
+        source->streams <= share)
+      continue;
+
+    source->streams--;
+    auto pending = std::find(source->to_subscribe.begin(),
+                             source->to_subscribe.end(), item.first);
+    if (pending != source->to_subscribe.end())
+      source->to_subscribe.erase(pending);
+    else
+      source->to_unsubscribe.push_back(item.first);
+
+    sub.connection = target.id;
+    target.streams++;
+    target.to_subscribe.push_back(item.first);
+  }
+}
 
-    if (!sub.is_requested) {
-      sub.is_requested = true;
-      std::string request = sub.build_request();
-      LOG_INFO("sending binance subscribe request for '"
-               << item.first << "', request: " << request);
 
-      _mktdata_stream->send(request.c_str(), request.size());
+void BinanceSession::make_pending_subscriptions()
+{
+  assert(is_event_thread());
 
-      _event_loop.dispatch(
-        std::chrono::milliseconds(BINANCE_SPOT_SUBSCRIBE_DELAY_MILLISEC),
-        [weak{this->weak_from_this()}]() -> std::chrono::milliseconds {
-          if (auto sp = weak.lock())
-            sp->make_pending_subscriptions();
-          return std::chrono::milliseconds{0};
-        }
-        );
+  {
+    // assign each unassigned stream to the least loaded connection
+    auto lock = std::scoped_lock(m_subscriptions_mtx);
+    _ev_stream_index = m_stream_index;
+    for (auto& item : m_subscriptions) {
+      Subscription& sub = item.second;
+      if (sub.connection)
+        continue;
+
+      MdConnection* best = nullptr;
+      for (auto& conn : _md_connections)
+        if (conn.id && conn.streams < _params.md_streams_per_connection &&
+            (!best || conn.streams < best->streams))
+          best = &conn;
+      if (!best)
+        break; // wait for a connection
+
+      sub.connection = best->id;
+      best->streams++;
+      best->to_subscribe.push_back(item.first);
+    }
+
+    // and likewise to the least loaded mirror
+    for (auto& item : m_subscriptions) {
+      Subscription& sub = item.second;
+      if (sub.mirror || !(sub.arbiter || sub.decode_arbitrates))
+        continue;
+
+      MdConnection* best = nullptr;
+      for (auto& mirror : _md_mirrors)
+        if (mirror.id && mirror.streams < _params.md_streams_per_connection &&
+            (!best || mirror.streams < best->streams))
+          best = &mirror;
+      if (!best)
+        break;
+
+      sub.mirror = best->id;
+      best->streams++;
+      best->to_subscribe.push_back(item.first);
+    }
+  }
+
+  send_md_requests();
+}
+
+
+static std::string build_stream_request(const char* method,
+                                        std::vector<std::string>& streams,
+                                        size_t max_streams, int id)
+{
+  const size_t count = std::min(streams.size(), max_streams);
+  std::ostringstream oss;
+  oss << "{\"method\": \"" << method << "\", \"params\": [";
+  for (size_t i = 0; i < count; i++)
+    oss << (i ? "," : "") << '"' << streams[i] << '"';
+  oss << "], \"id\": " << id << "}";
+  streams.erase(streams.begin(), streams.begin() + count);
+  return oss.str();
+}
 
-      // we only make 1 request per call to make_pending_subscriptions; other
-      // requests happen on delayed invocations of this function, so as to not
-      // breach the Binance incoming-message-rate limit.
+
+void BinanceSession::send_md_requests()
+{
+  assert(is_event_thread());
+
+  // Binance limits the incoming messages per second of each connection, so
+  // each request carries many streams, and a connection sends as many as its
+  // budget over the last second allows; a new connection, so, subscribes
+  // with a burst of requests rather than one at a time
+  using clock = std::chrono::steady_clock;
+  static constexpr size_t max_streams_per_request = 200;
+  const auto window = std::chrono::seconds(1);
+  const auto now = clock::now();
+  auto next = clock::time_point::max();
+
+  auto service = [&](MdConnection& conn, const char* channel, size_t index) {
+    if (!(conn.ws || conn.replay_requests) ||
+        (conn.to_subscribe.empty() && conn.to_unsubscribe.empty()))
       return;
+
+    auto& sent = conn.requests_sent;
+    while (!sent.empty() && sent.front() + window <= now)
+      sent.pop_front();
+
+    while ((!conn.to_subscribe.empty() || !conn.to_unsubscribe.empty()) &&
+           sent.size() < BINANCE_SPOT_REQUESTS_PER_SEC) {
+      std::string request =
+          conn.to_unsubscribe.empty()
+              ? build_stream_request("SUBSCRIBE", conn.to_subscribe,
+                                     max_streams_per_request, _next_id++)
+              : build_stream_request("UNSUBSCRIBE", conn.to_unsubscribe,
+                                     max_streams_per_request, _next_id++);
+      LOG_INFO("sending binance request on market-data " << channel << " "
+               << index + 1 << ": " << request);
+      if (conn.ws)
+        conn.ws->send(request.c_str(), request.size());
+      else
+        conn.replay_requests(request);
+      sent.push_back(now);
     }
+
+    if (!conn.to_subscribe.empty() || !conn.to_unsubscribe.empty())
+      next = std::min(next, sent.front() + window);
+  };
+
+  for (size_t i = 0; i < _md_connections.size(); i++)
+    service(_md_connections[i], "channel", i);
+  for (size_t i = 0; i < _md_mirrors.size(); i++)
+    service(_md_mirrors[i], "mirror", i);
+
+  if (next != clock::time_point::max() && !_md_request_timer) {
+    _md_request_timer = true;
+    auto delay = std::max(
+        std::chrono::ceil<std::chrono::milliseconds>(next - now),
+        std::chrono::milliseconds(1));
+    _event_loop.dispatch(
+        delay, [weak{this->weak_from_this()}]() -> std::chrono::milliseconds {
+          if (auto sp = weak.lock()) {
+            sp->_md_request_timer = false;
+            sp->send_md_requests();
+          }
+          return std::chrono::milliseconds{0};
+        });
   }
 }
 
@@ -871,14 +2054,11 @@ void BinanceSession::refresh_user_stream_listen_key()
     if (request_listenKey) {
       std::string path = "/api/v3/userDataStream";
 
-      std::vector<std::string> headers;
-      headers.push_back("X-MBX-APIKEY: " + _user_api_key);
-
       LOG_INFO("requesting binance-spot user_stream listenKey");
       LOG_INFO("making http POST request to '" << _params.api_endpoint << path << "'");
       this->http_request(
           HttpRequestType::post, _params.api_endpoint, path, {},
-          std::move(headers), [this](std::string result, std::string error) {
+          _api_key_headers, [this](std::string result, std::string error) {
             if (error.empty()) {
               try {
                 this->on_user_data_stream_reply(json::parse(result));
@@ -912,9 +2092,22 @@ void BinanceSession::on_user_data_stream_reply(json msg)
 }
 
 
+/* Pass an http result, from the pool thread, to the event thread. */
+static HttpClientPool::result_fn to_event_loop(
+    RealtimeEventLoop& loop, std::function<void(std::string, std::string)> on_result)
+{
+  return [&loop, on_result = std::move(on_result)](std::string result,
+                                                   std::string error) {
+    loop.dispatch([on_result, result = std::move(result),
+                   error = std::move(error)]() { on_result(result, error); });
+  };
+}
+
+
 void BinanceSession::http_request(
     HttpRequestType type, std::string endpoint, std::string path,
-    std::string post_data, std::vector<std::string> headers,
+    std::string post_data,
+    std::shared_ptr<const HttpClientPool::HeaderList> headers,
     std::function<void(std::string, std::string)> on_result)
 {
   if (endpoint.empty())
@@ -926,63 +2119,10 @@ void BinanceSession::http_request(
 
   std::string url = endpoint + path;
 
-  auto fn = [this, url, type, post_data, headers = std::move(headers),
-             on_result]() {
-    LOG_DEBUG("URL:" << url);
-    CURL* curl = curl_easy_init();
-
-    std::string result;
-    std::string error;
-
-    if (curl) {
-      curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);
-      curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-      curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-      curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, binance::write_callback);
-      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result);
-
-      if (type == HttpRequestType::put ||
-          type == HttpRequestType::post ||
-          type == HttpRequestType::del) {
-        if (type == HttpRequestType::del)
-          curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
-
-        if (type == HttpRequestType::put)
-          curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_data.c_str());
-      }
-
-      if (type == HttpRequestType::get) {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-      }
-
-      struct curl_slist* list = nullptr;
-      if (!headers.empty()) {
-        for (auto& header : headers)
-          list = curl_slist_append(list, header.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
-      }
-
-      CURLcode res = curl_easy_perform(curl);
-
-      /* Check for errors */
-      if (res != CURLE_OK) {
-        std::ostringstream oss;
-        oss << "http-request failed, error '" << curl_easy_strerror(res) << "'";
-        error = oss.str();
-      }
-
-      /* always cleanup */
-      curl_easy_cleanup(curl);
-      curl_slist_free_all(list);
-    }
-
-    _event_loop.dispatch(
-        [on_result, result, error]() { on_result(result, error); });
-  };
-  _curl_requests.dispatch(std::move(fn));
+  // requests run concurrently on the pool thread, over connections kept
+  // open between requests; replies are passed back to the event thread
+  _http->request(type, std::move(url), std::move(post_data), std::move(headers),
+                 to_event_loop(_event_loop, std::move(on_result)));
 }
 
 
@@ -997,20 +2137,15 @@ void BinanceSession::refresh_account()
   auto params = oss.str();
 
   /* calculate the hmac-sha256 signature of the request parameters */
-  std::string digest = HMACSHA256_base4(_user_api_secret.c_str(), _user_api_secret.size(),
-                                        params.c_str(), params.size());
+  std::string digest = _hmac->sign_hex(params);
 
   /* create the signed request */
   std::string request = api_path + "?" + params + "&signature=" + digest;
 
-  /* request headers */
-  std::vector<std::string> headers;
-  headers.push_back("X-MBX-APIKEY: " + _user_api_key);
-
   auto wp = weak_from_this();
   this->http_request(
       HttpRequestType::get, _params.api_endpoint, request, {},
-      std::move(headers), [wp](std::string result, std::string error) {
+      _api_key_headers, [wp](std::string result, std::string error) {
         if (error.empty()) {
           try {
             if (auto sp = wp.lock())
@@ -1036,20 +2171,15 @@ void BinanceSession::http_get_account_information()
   auto params = oss.str();
 
   /* calculate the hmac-sha256 signature of the request parameters */
-  std::string digest = HMACSHA256_base4(_user_api_secret.c_str(), _user_api_secret.size(),
-                                        params.c_str(), params.size());
+  std::string digest = _hmac->sign_hex(params);
 
   /* create the signed request */
   std::string request = api_path + "?" + params + "&signature=" + digest;
 
-  /* request headers */
-  std::vector<std::string> headers;
-  headers.push_back("X-MBX-APIKEY: " + _user_api_key);
-
   auto wp = weak_from_this();
   this->http_request(
       HttpRequestType::get, _params.api_endpoint, request, {},
-      std::move(headers), [wp](std::string result, std::string error) {
+      _api_key_headers, [wp](std::string result, std::string error) {
         if (error.empty()) {
           try {
             if (auto sp = wp.lock())
@@ -1077,49 +2207,104 @@ void BinanceSession::subscribe_account(
 
       if (!sp->_account_stream) {
         sp->_account_stream = std::make_unique<AccountStream>(callback);
+
+        // the snapshot, then the changes from the user stream, with an
+        // occasional snapshot to reconcile
         sp->http_get_account_information();
-        // now we can issue the POST request
+        if (auto interval = sp->_params.account_reconcile_sec)
+          sp->_event_loop.dispatch(std::chrono::seconds(interval), [wp]() {
+            if (auto sp = wp.lock()) {
+              sp->http_get_account_information();
+              return std::chrono::milliseconds(
+                  sp->_params.account_reconcile_sec * 1000);
+            }
+            return std::chrono::milliseconds(0);
+          });
       } else {
         LOG_WARN(
             "Ignoring repeated call to BinanceSession::subscribe_account(");
       }
-
-      // TODO: if this is the first time, then maybe we need to start with the
-      // snapshot request, followed by the updates. Or, perhaps just assume that
-      // there is no further calls to this method.
-      //
-      //
     }
   });
 }
 
-void BinanceSession::on_account_reply(std::string /*raw_response*/)
+void BinanceSession::on_account_reply(std::string raw_response)
 {
-  // TODO: need to handle case where the result is a json string that indicates
-  // an error, eg, such as can happen if we get the HMAC signature incorrect.
+  auto msg = json::parse(raw_response);
+  if (!msg.is_object() || !msg.contains("balances")) {
+    LOG_ERROR("binance account request failed: " << raw_response);
+    return;
+  }
 
-  // if (!_account_stream)
-  //   return;
+  const auto exchange = exchange_id_to_string(exchange_id());
+  std::vector<AccountUpdate> updates;
+  for (const auto& item : apex::get_array(msg, "balances")) {
+    if (!item.is_object())
+      continue;
+    Asset asset(apex::get_string_field(item, "asset"), exchange, 0);
+    updates.push_back(
+        {std::move(asset), std::stod(apex::get_string_field(item, "free"))});
+  }
+
+  int64_t update_time = 0;
+  if (auto iter = msg.find("updateTime");
+      iter != msg.end() && iter->is_number())
+    update_time = iter->get<int64_t>();
+  on_balances(std::move(updates), update_time, true);
+}
+
+
+void BinanceSession::on_balances(std::vector<AccountUpdate> updates,
+                                 int64_t update_time, bool is_snapshot)
+{
+  assert(is_event_thread());
+
+  // a snapshot taken before the latest change applied would undo it
+  if (is_snapshot && _have_balances && update_time < _balances_time)
+    return;
+  _balances_time = std::max(_balances_time, update_time);
+
+  auto changed = _balances.apply(updates);
+  if (is_snapshot && _have_balances && !changed.empty())
+    LOG_WARN("account reconciliation corrected " << changed.size()
+             << " balances");
+  _have_balances = _have_balances || is_snapshot;
+
+  if (_account_stream && !changed.empty())
+    _account_stream->on_update(std::move(changed));
+}
+
+
+/* Body of a signed request; kept per thread so that its capacity is reused,
+ * and each request built without allocation. */
+static SignedQuery& signing_buffer()
+{
+  static thread_local SignedQuery query;
+  return query;
+}
+
+
+bool BinanceSession::acquire_rate_limit(binance::RateLimiter::Request request)
+{
+  if (_rate_limiter->try_acquire(request))
+    return true;
+  binance_throttled.add();
+  auto budget = _rate_limiter->budget();
+  LOG_WARN("binance order request refused, rate-limit budget spent; weight:"
+           << budget.weight << ", orders-10s:" << budget.orders_10s
+           << ", orders-1d:" << budget.orders_day);
+  return false;
+}
 
-  // auto msg = json::parse(raw_response);
 
-  // // convert from the binance-json to a normalised type
-  // std::vector<AccountUpdate> updates;
-  // if (msg.is_object()) {
-  //   auto& balances = apex::get_array(msg, "balances");
-  //   for (const auto& item : balances) {
-  //     if (item.is_object()) {
-  //       auto field = apex::get_string_field(item, "asset");
-  //       auto qty = std::stod(apex::get_string_field(item, "free"));
-  //       Asset asset;
-  //       asset.symbol = field;
-  //       //asset.exchange = exchangeId();
-  //       AccountUpdate au{asset, qty};
-  //       updates.push_back(std::move(au));
-  //     }
-  //   }
-  // }
-  // _account_stream->on_update(updates);
+void BinanceSession::reject_throttled(
+    std::function<void(std::string, std::string)> on_rejected, const char* text)
+{
+  // rejects are delivered as other replies are, after the request call
+  run_on_evloop([on_rejected = std::move(on_rejected), text](BinanceSession*) {
+    if (on_rejected)
+      on_rejected(error::e0004, text);
+  });
 }
 
 
@@ -1131,35 +2316,39 @@ void BinanceSession::cancel_order(std::string symbol, std::string order_id,
     LOG_WARN("cancel-order not valid for paper-trading");
     return;
   }
+  if (!acquire_rate_limit(binance::RateLimiter::Request::cancel)) {
+    reject_throttled(callbacks.on_rejected);
+    return;
+  }
 
-  auto path = "/api/v3/order";
-  auto timestamp = binance::build_timestamp();
-
-  /* build the request body */
-
-  std::ostringstream oss;
-  oss << "symbol=" << str_toupper(symbol) << "&orderId=" << ext_order_id
-      << "&recvWindow=" << _params.recv_window << "&timestamp=" << timestamp;
-  std::string body = oss.str();
-
-  /* obtain the hmac-sha256 signature*/
-
-  std::string digest = HMACSHA256_base4(_user_api_secret.c_str(), _user_api_secret.size(),
-                                        body.c_str(), body.size());
+  if (ws_order_entry()) {
+    if (is_event_thread())
+      cancel_order_ws(std::move(symbol), std::move(ext_order_id),
+                      std::move(callbacks));
+    else
+      run_on_evloop([symbol, ext_order_id, callbacks](BinanceSession* self) {
+        self->cancel_order_ws(symbol, ext_order_id, callbacks);
+      });
+    return;
+  }
 
-  /* create the signed request body */
-  std::string post_data;
-  post_data = body + "&signature=" + digest;
+  auto path = "/api/v3/order";
 
-  std::vector<std::string> headers;
-  headers.push_back("X-MBX-APIKEY: " + _user_api_key);
+  /* build the signed request body */
+  auto& query = signing_buffer();
+  query.clear()
+      .add("symbol", str_toupper(symbol))
+      .add("orderId", ext_order_id)
+      .add("recvWindow", int64_t(_params.recv_window))
+      .add("timestamp", int64_t(binance::build_timestamp()))
+      .sign(*_hmac);
 
   auto on_result = [this, callbacks](std::string result, std::string error) {
     this->on_cancel_order_reply(result, error, callbacks);
   };
 
   this->http_request(HttpRequestType::del, _params.api_endpoint, path,
-                     post_data, std::move(headers), on_result);
+                     query.str(), _api_key_headers, on_result);
 }
 
 
@@ -1170,37 +2359,39 @@ void BinanceSession::submit_order(OrderParams params,
     LOG_WARN("submit-order not valid for paper-trading");
     return;
   }
+  if (!acquire_rate_limit(binance::RateLimiter::Request::new_order)) {
+    reject_throttled(callbacks.on_rejected);
+    return;
+  }
+  binance_orders.add();
+
+  if (ws_order_entry()) {
+    if (is_event_thread())
+      submit_order_ws(std::move(params), std::move(callbacks));
+    else
+      run_on_evloop([params, callbacks](BinanceSession* self) {
+        self->submit_order_ws(params, callbacks);
+      });
+    return;
+  }
 
   auto path = endpoint("/api/v3/order");
 
-  auto tv = apex::time_now();
-  auto timestamp = tv.sec * 1000 + tv.usec / 1000;
-
-  /* build the request body */
-  std::ostringstream oss;
-  oss << "symbol=" << str_toupper(params.symbol)
-      << "&side=" << binance::to_binance(params.side)
-      << "&type=" << binance::to_binance(params.order_type)
-      << "&timeInForce=" << binance::to_binance(params.time_in_force)
-      << "&quantity=" << format_double(params.size, true, 8)
-      << "&newClientOrderId=" << params.order_id
-      << "&price=" << format_double(params.price, true)
-      << "&recvWindow=" << _params.recv_window << "&timestamp=" << timestamp;
-  std::string body = oss.str();
-
-  /* obtain the hmac-sha256 signature*/
-
-  std::string digest = HMACSHA256_base4(_user_api_secret.c_str(), _user_api_secret.size(),
-                                        body.c_str(), body.size());
-
-  /* create the signed request body */
-  std::string post_data;
-  post_data = body + "&signature=" + digest;
-
-  LOG_DEBUG("POST-DATA:" << post_data);
-
-  std::vector<std::string> headers;
-  headers.push_back("X-MBX-APIKEY: " + _user_api_key);
+  /* build the signed request body */
+  auto& query = signing_buffer();
+  query.clear()
+      .add("symbol", str_toupper(params.symbol.str()))
+      .add("side", binance::to_binance(params.side))
+      .add("type", binance::to_binance(params.order_type))
+      .add("timeInForce", binance::to_binance(params.time_in_force))
+      .add("quantity", params.size, true, 8)
+      .add("newClientOrderId", params.order_id)
+      .add("price", params.price, true, 9)
+      .add("recvWindow", int64_t(_params.recv_window))
+      .add("timestamp", int64_t(binance::build_timestamp()))
+      .sign(*_hmac);
+
+  LOG_DEBUG("POST-DATA:" << query.view());
 
   auto on_result = [this, callbacks](std::string result, std::string error) {
     if (error.empty()) {
@@ -1217,7 +2408,338 @@ void BinanceSession::submit_order(OrderParams params,
   };
 
   this->http_request(HttpRequestType::post, _params.api_endpoint, path,
-                     post_data, std::move(headers), on_result);
+                     query.str(), _api_key_headers, on_result);
+}
+
+
+void BinanceSession::replace_order(std::string symbol, std::string /*order_id*/,
+                                   std::string ext_order_id, OrderParams params,
+                                   SubmitOrderCallbacks cancel_callbacks,
+                                   SubmitOrderCallbacks new_callbacks)
+{
+  if (is_paper_trading()) {
+    LOG_WARN("replace-order not valid for paper-trading");
+    return;
+  }
+  if (!acquire_rate_limit(binance::RateLimiter::Request::replace)) {
+    reject_throttled(cancel_callbacks.on_rejected);
+    reject_throttled(new_callbacks.on_rejected, "new order not attempted");
+    return;
+  }
+
+  if (ws_order_entry()) {
+    if (is_event_thread())
+      replace_order_ws(std::move(symbol), std::move(ext_order_id),
+                       std::move(params), std::move(cancel_callbacks),
+                       std::move(new_callbacks));
+    else
+      run_on_evloop([=](BinanceSession* self) {
+        self->replace_order_ws(symbol, ext_order_id, params, cancel_callbacks,
+                               new_callbacks);
+      });
+    return;
+  }
+
+  auto path = endpoint("/api/v3/order/cancelReplace");
+
+  /* build the signed request body */
+  auto& query = signing_buffer();
+  query.clear()
+      .add("symbol", str_toupper(params.symbol.str()))
+      .add("cancelReplaceMode", "STOP_ON_FAILURE")
+      .add("cancelOrderId", ext_order_id)
+      .add("side", binance::to_binance(params.side))
+      .add("type", binance::to_binance(params.order_type))
+      .add("timeInForce", binance::to_binance(params.time_in_force))
+      .add("quantity", params.size, true, 8)
+      .add("newClientOrderId", params.order_id)
+      .add("price", params.price, true, 9)
+      .add("recvWindow", int64_t(_params.recv_window))
+      .add("timestamp", int64_t(binance::build_timestamp()))
+      .sign(*_hmac);
+
+  auto on_result = [this, cancel_callbacks, new_callbacks](std::string result,
+                                                           std::string error) {
+    if (!error.empty()) {
+      cancel_callbacks.on_rejected(error::e0103, error);
+      new_callbacks.on_rejected(error::e0102, error);
+      return;
+    }
+    try {
+      if (_raw_capture)
+        _raw_capture->write("cancel_replace_reply", std::string_view(result));
+      auto reply = json::parse(result);
+      apply_cancel_replace_reply(reply, cancel_callbacks, new_callbacks);
+    } catch (...) {
+      log_message_exception("on_cancel_replace_reply", result);
+      cancel_callbacks.on_rejected(error::e0103, "unknown reason");
+      new_callbacks.on_rejected(error::e0102, "unknown reason");
+    }
+  };
+
+  this->http_request(HttpRequestType::post, _params.api_endpoint, path,
+                     query.str(), _api_key_headers, on_result);
+}
+
+
+void BinanceSession::cancel_all_orders(std::string symbol,
+                                       CancelAllCallbacks callbacks)
+{
+  if (is_paper_trading()) {
+    LOG_WARN("cancel-all-orders not valid for paper-trading");
+    return;
+  }
+  if (!acquire_rate_limit(binance::RateLimiter::Request::cancel_all)) {
+    reject_throttled(callbacks.on_rejected);
+    return;
+  }
+
+  if (ws_order_entry()) {
+    if (is_event_thread())
+      cancel_all_orders_ws(std::move(symbol), std::move(callbacks));
+    else
+      run_on_evloop([symbol, callbacks](BinanceSession* self) {
+        self->cancel_all_orders_ws(symbol, callbacks);
+      });
+    return;
+  }
+
+  auto path = "/api/v3/openOrders";
+
+  /* build the signed request body */
+  auto& query = signing_buffer();
+  query.clear()
+      .add("symbol", str_toupper(symbol))
+      .add("recvWindow", int64_t(_params.recv_window))
+      .add("timestamp", int64_t(binance::build_timestamp()))
+      .sign(*_hmac);
+
+  auto on_result = [this, callbacks](std::string result, std::string error) {
+    if (!error.empty()) {
+      callbacks.on_rejected(error::e0103, error);
+      return;
+    }
+    try {
+      if (_raw_capture)
+        _raw_capture->write("cancel_all_reply", std::string_view(result));
+      auto reply = json::parse(result);
+      apply_cancel_all_reply(reply, callbacks);
+    } catch (...) {
+      log_message_exception("on_cancel_all_reply", result);
+      callbacks.on_rejected(error::e0103, "unknown reason");
+    }
+  };
+
+  this->http_request(HttpRequestType::del, _params.api_endpoint, path,
+                     query.str(), _api_key_headers, on_result);
+}
+
+
+/* Order params of order.place, and of the new order of order.cancelReplace,
+ * as for the REST request. */
+static std::vector<std::pair<std::string, json>> ws_new_order_params(
+    const OrderParams& params)
+{
+  return {{"symbol", str_toupper(params.symbol.str())},
+          {"side", binance::to_binance(params.side)},
+          {"type", binance::to_binance(params.order_type)},
+          {"timeInForce", binance::to_binance(params.time_in_force)},
+          {"quantity", format_double(params.size, true, 8)},
+          {"newClientOrderId", params.order_id.str()},
+          {"price", format_double(params.price, true)}};
+}
+
+
+/* Report a WebSocket API reply that is not a success, i.e. an error, or a
+ * status 0 if the request was abandoned, as a rejection. */
+static void ws_reject(int status, json& body,
+                      const BaseExchangeSession::SubmitOrderCallbacks& callbacks,
+                      const char* transport_error)
+{
+  binance::ErrorReply error(body);
+  if (status == 0 || error.code.empty())
+    callbacks.on_rejected(transport_error, error.text);
+  else
+    callbacks.on_rejected(error.code, error.text);
+}
+
+
+void BinanceSession::submit_order_ws(OrderParams params,
+                                     SubmitOrderCallbacks callbacks)
+{
+  assert(is_event_thread());
+
+  auto on_reply = [this, callbacks](int status, json& body) {
+    if (status != 200)
+      return ws_reject(status, body, callbacks, error::e0102);
+    try {
+      this->apply_new_order_reply(body, callbacks);
+    } catch (...) {
+      log_message_exception("on_new_order_reply", body.dump());
+      callbacks.on_rejected(error::e0102, "unknown reason");
+    }
+  };
+
+  const char* method = _params.use_test ? "order.test" : "order.place";
+  if (!send_ws_request(method, ws_new_order_params(params), std::move(on_reply)))
+    callbacks.on_rejected(error::e0102, "order-entry websocket not connected");
+}
+
+
+void BinanceSession::cancel_order_ws(std::string symbol, std::string ext_order_id,
+                                     SubmitOrderCallbacks callbacks)
+{
+  assert(is_event_thread());
+
+  auto on_reply = [this, callbacks](int status, json& body) {
+    if (status != 200)
+      return ws_reject(status, body, callbacks, error::e0103);
+    try {
+      this->apply_cancel_order_reply(body, callbacks);
+    } catch (...) {
+      log_message_exception("on_cancel_order_reply", body.dump());
+      callbacks.on_rejected(error::e0103, "unknown reason");
+    }
+  };
+
+  std::vector<std::pair<std::string, json>> params = {
+      {"symbol", str_toupper(symbol)}, {"orderId", ext_order_id}};
+  if (!send_ws_request("order.cancel", std::move(params), std::move(on_reply)))
+    callbacks.on_rejected(error::e0103, "order-entry websocket not connected");
+}
+
+
+void BinanceSession::replace_order_ws(std::string /*symbol*/,
+                                      std::string ext_order_id,
+                                      OrderParams params,
+                                      SubmitOrderCallbacks cancel_callbacks,
+                                      SubmitOrderCallbacks new_callbacks)
+{
+  assert(is_event_thread());
+
+  auto on_reply = [this, cancel_callbacks, new_callbacks](int status, json& body) {
+    if (status == 0) {
+      ws_reject(status, body, cancel_callbacks, error::e0103);
+      ws_reject(status, body, new_callbacks, error::e0102);
+      return;
+    }
+    try {
+      this->apply_cancel_replace_reply(body, cancel_callbacks, new_callbacks);
+    } catch (...) {
+      log_message_exception("on_cancel_replace_reply", body.dump());
+      cancel_callbacks.on_rejected(error::e0103, "unknown reason");
+      new_callbacks.on_rejected(error::e0102, "unknown reason");
+    }
+  };
+
+  auto request = ws_new_order_params(params);
+  request.emplace_back("cancelReplaceMode", "STOP_ON_FAILURE");
+  request.emplace_back("cancelOrderId", ext_order_id);
+  if (!send_ws_request("order.cancelReplace", std::move(request),
+                       std::move(on_reply))) {
+    cancel_callbacks.on_rejected(error::e0103, "order-entry websocket not connected");
+    new_callbacks.on_rejected(error::e0102, "order-entry websocket not connected");
+  }
+}
+
+
+void BinanceSession::cancel_all_orders_ws(std::string symbol,
+                                          CancelAllCallbacks callbacks)
+{
+  assert(is_event_thread());
+
+  auto on_reply = [this, callbacks](int status, json& body) {
+    if (status != 200) {
+      binance::ErrorReply error(body);
+      if (status == 0 || error.code.empty())
+        callbacks.on_rejected(error::e0103, error.text);
+      else
+        callbacks.on_rejected(error.code, error.text);
+      return;
+    }
+    try {
+      this->apply_cancel_all_reply(body, callbacks);
+    } catch (...) {
+      log_message_exception("on_cancel_all_reply", body.dump());
+      callbacks.on_rejected(error::e0103, "unknown reason");
+    }
+  };
+
+  std::vector<std::pair<std::string, json>> params = {
+      {"symbol", str_toupper(symbol)}};
+  if (!send_ws_request("openOrders.cancelAll", std::move(params),
+                       std::move(on_reply)))
+    callbacks.on_rejected(error::e0103, "order-entry websocket not connected");
+}
+
+
+void BinanceSession::apply_cancel_all_reply(json& reply,
+                                            const CancelAllCallbacks& callbacks)
+{
+  binance::ErrorReply error(reply);
+  if (error.is_error) {
+    callbacks.on_rejected(error.code, error.text);
+    return;
+  }
+
+  // one item per order, or per order list, whose orders are then nested
+  std::vector<std::pair<std::string, OrderUpdate>> cancelled;
+  auto add = [&cancelled](json& item) {
+    OrderUpdate update;
+    update.state = OrderState::closed;
+    update.close_reason = OrderCloseReason::cancelled;
+    update.ext_order_id = std::to_string(item["orderId"].get<long>());
+    cancelled.emplace_back(item["origClientOrderId"].get<std::string>(),
+                           std::move(update));
+  };
+  for (auto& item : reply) {
+    auto iter = item.find("orderReports");
+    if (iter != std::end(item))
+      for (auto& report : *iter)
+        add(report);
+    else
+      add(item);
+  }
+
+  callbacks.on_reply(std::move(cancelled));
+}
+
+
+void BinanceSession::apply_cancel_replace_reply(
+    json& reply, const SubmitOrderCallbacks& cancel_callbacks,
+    const SubmitOrderCallbacks& new_callbacks)
+{
+  // a success carries the outcomes directly, and a failure, of either part,
+  // inside the "data" of the error
+  json* outcome = &reply;
+  if (reply.contains("code")) {
+    auto iter = reply.find("data");
+    if (iter == reply.end()) {
+      binance::ErrorReply error(reply);
+      cancel_callbacks.on_rejected(error.code, error.text);
+      new_callbacks.on_rejected(error.code, error.text);
+      return;
+    }
+    outcome = &*iter;
+  }
+
+  auto cancel_result = outcome->value("cancelResult", std::string{});
+  if (cancel_result == "SUCCESS")
+    apply_cancel_order_reply((*outcome)["cancelResponse"], cancel_callbacks);
+  else {
+    binance::ErrorReply error((*outcome)["cancelResponse"]);
+    cancel_callbacks.on_rejected(error.code, error.text);
+  }
+
+  auto new_result = outcome->value("newOrderResult", std::string{});
+  if (new_result == "SUCCESS")
+    apply_new_order_reply((*outcome)["newOrderResponse"], new_callbacks);
+  else if (new_result == "FAILURE") {
+    binance::ErrorReply error((*outcome)["newOrderResponse"]);
+    new_callbacks.on_rejected(error.code, error.text);
+  } else {
+    new_callbacks.on_rejected(error::e0102, "new order not attempted");
+  }
 }
 
 
@@ -1237,20 +2759,11 @@ void BinanceSession::on_cancel_order_reply(std::string result,
   if (error.empty()) {
     try {
 
-      if (!_raw_capture_dir.empty())
-        write_json_message(_raw_capture_dir, "cancel_order_reply", result);
+      if (_raw_capture)
+        _raw_capture->write("cancel_order_reply", std::string_view(result));
 
       auto msg = json::parse(result);
-
-      binance::ErrorReply error(msg);
-      if (error.is_error) {
-        callbacks.on_rejected(error.code, error.text);
-      } else {
-        OrderUpdate update;
-        update.state = OrderState::closed;
-        update.close_reason = OrderCloseReason::cancelled;
-        callbacks.on_reply(update);
-      }
+      apply_cancel_order_reply(msg, callbacks);
     } catch (...) {
       log_message_exception("on_cancel_order_reply", result);
       callbacks.on_rejected(error::e0103, "unknown reason");
@@ -1260,18 +2773,39 @@ void BinanceSession::on_cancel_order_reply(std::string result,
   }
 }
 
+void BinanceSession::apply_cancel_order_reply(json& reply,
+                                              const SubmitOrderCallbacks& callbacks)
+{
+  binance::ErrorReply error(reply);
+  if (error.is_error) {
+    callbacks.on_rejected(error.code, error.text);
+  } else {
+    OrderUpdate update;
+    update.state = OrderState::closed;
+    update.close_reason = OrderCloseReason::cancelled;
+    callbacks.on_reply(update);
+  }
+}
+
+
 void BinanceSession::on_new_order_reply(std::string raw,
                                         SubmitOrderCallbacks callbacks)
 {
   assert(is_event_thread());
 
-  if (!_raw_capture_dir.empty())
-    write_json_message(_raw_capture_dir, "new_order_reply", raw);
-
-  OrderUpdate update;
+  if (_raw_capture)
+    _raw_capture->write("new_order_reply", std::string_view(raw));
 
   // TODO: handle case of json parse error here
   auto reply = json::parse(raw);
+  apply_new_order_reply(reply, callbacks);
+}
+
+
+void BinanceSession::apply_new_order_reply(json& reply,
+                                           const SubmitOrderCallbacks& callbacks)
+{
+  OrderUpdate update;
 
   {
     binance::ErrorReply error(reply);
@@ -1307,7 +2841,7 @@ void BinanceSession::on_new_order_reply(std::string raw,
     update.state = OrderState::closed;
     update.close_reason = OrderCloseReason::lapsed;
   } else {
-    LOG_WARN("unhandled on_new_order_reply, raw-msg: " + raw);
+    LOG_WARN("unhandled on_new_order_reply, raw-msg: " << reply);
   }
 
   callbacks.on_reply(update);
@@ -1318,12 +2852,6 @@ void BinanceSession::on_userdata_msg(json msg)
 {
   assert(is_event_thread());
 
-  if (!_raw_capture_dir.empty()) {
-    std::ostringstream oss;
-    oss << msg;
-    write_json_message(_raw_capture_dir, "userdata", oss.str());
-  }
-
   LOG_DEBUG("Binance::on_userdata_msg: " << msg);
 
   auto event_type_str = get_string_field(msg, binance::EVENT_TYPE);
@@ -1336,58 +2864,127 @@ void BinanceSession::on_userdata_msg(json msg)
     }
 
     case binance::EventType::account_update: {
-      // Not currently processing account updates
+      // the balances of just the assets changed
+      const auto exchange = exchange_id_to_string(exchange_id());
+      std::vector<AccountUpdate> updates;
+      if (auto iter = msg.find("B"); iter != msg.end() && iter->is_array())
+        for (const auto& item : *iter) {
+          Asset asset(get_string_field(item, "a"), exchange, 0);
+          updates.push_back(
+              {std::move(asset), std::stod(get_string_field(item, "f"))});
+        }
+      int64_t update_time = 0;
+      if (auto iter = msg.find("u"); iter != msg.end() && iter->is_number())
+        update_time = iter->get<int64_t>();
+      on_balances(std::move(updates), update_time, false);
       break;
     }
 
     case binance::EventType::order_update: {
-      auto exec_type_str = get_string_field(msg, binance::EXECUTION_TYPE);
-      auto exec_type = binance::to_exec_type(exec_type_str);
+      static const std::string none;
+      binance::ExecutionReport report;
+      report.event_type = event_type_str;
+      report.execution_type = get_string_field(msg, binance::EXECUTION_TYPE);
+      report.order_status = get_string_field(msg, binance::ORDER_STATUS, none);
+      report.client_order_id =
+          get_string_field(msg, binance::CLIENT_ORDER_ID, none);
+      report.orig_client_order_id =
+          get_string_field(msg, binance::ORIG_CLIENT_ORDER_ID, none);
+      report.last_executed_price =
+          get_string_field(msg, binance::LAST_EXECUTED_PRICE, none);
+      report.last_executed_qty =
+          get_string_field(msg, binance::LAST_EXECUTED_QUANTITY, none);
+      std::string order_id;
+      if (auto iter = msg.find("i"); iter != msg.end() && iter->is_number())
+        order_id = std::to_string(iter->get<long>());
+      report.order_id = order_id;
+      on_execution_report(report);
+      break;
+    }
+    default: {
+      LOG_WARN("unhandled Binance user-data message: " << event_type_str);
+      break;
+    }
+  }
+}
 
-      switch (exec_type) {
 
-        case binance::ExecType::replaced:
-        case binance::ExecType::rejected:
-        case binance::ExecType::accepted: {
-          // These are update types are being ignored because instead we respond
-          // to the REST request, ie, immediate order accept / reject.
-          break;
-        }
+bool BinanceSession::io_on_userdata_raw(const char* buf, size_t len)
+{
+  /* io-thread */
+
+  // every frame is captured as received, before either decode path
+  if (_raw_capture)
+    _raw_capture->write("userdata", std::string_view(buf, len));
+
+  // messages other than execution reports use the json path
+  binance::ExecutionReport report;
+  if (!binance::decode_execution_report({buf, len}, report))
+    return false;
+
+  // the report refers into the frame, so the frame is copied for the event
+  // thread, which decodes it again
+  run_on_evloop([raw = std::string(buf, len)](BinanceSession* self) {
+    binance::ExecutionReport report;
+    if (binance::decode_execution_report(raw, report))
+      self->on_execution_report(report);
+  });
+  return true;
+}
 
-        case binance::ExecType::expired:
-        case binance::ExecType::canceled: {
-          const auto& orig_order_id =
-            get_string_field(msg, binance::ORIG_CLIENT_ORDER_ID);
-          OrderUpdate update;
-          update.state = OrderState::closed;
-          update.close_reason = OrderCloseReason::lapsed;
-          _callbacks.on_order_cancel(*this, orig_order_id, update);
-          break;
-        };
 
-        case binance::ExecType::trade: {
-          const auto& order_id = get_string_field(msg, binance::CLIENT_ORDER_ID);
-          auto& order_status = get_string_field(msg, binance::ORDER_STATUS);
-          OrderFill fill;
-          fill.is_fully_filled = (order_status == binance::OrderState::FILLED);
-          fill.size =
-              std::stod(get_string_field(msg, binance::LAST_EXECUTED_QUANTITY));
-          fill.price =
-              std::stod(get_string_field(msg, binance::LAST_EXECUTED_PRICE));
-          fill.recv_time = Time::realtime_now();
-          _callbacks.on_order_fill(*this, order_id, fill);
-          break;
-        }
-        default: {
-          LOG_WARN("unhandled Binance order-update: " << msg);
-          break;
-        }
-      }
+static double parse_decimal(std::string_view field, const char* name)
+{
+  double value;
+  auto r = std::from_chars(field.data(), field.data() + field.size(), value);
+  if (r.ec != std::errc() || r.ptr != field.data() + field.size())
+    THROW_PARSE_ERROR("invalid decimal for field '" << name << "'");
+  return value;
+}
+
+
+void BinanceSession::on_execution_report(const binance::ExecutionReport& report)
+{
+  assert(is_event_thread());
+
+  auto exec_type = binance::to_exec_type(report.execution_type);
+
+  switch (exec_type) {
 
+    case binance::ExecType::replaced:
+    case binance::ExecType::rejected:
+    case binance::ExecType::accepted: {
+      // These are update types are being ignored because instead we respond
+      // to the REST request, ie, immediate order accept / reject.
+      break;
+    }
+
+    case binance::ExecType::expired:
+    case binance::ExecType::canceled: {
+      OrderUpdate update;
+      update.state = OrderState::closed;
+      update.close_reason = OrderCloseReason::lapsed;
+      update.ext_order_id = std::string(report.order_id);
+      _callbacks.on_order_cancel(
+          *this, std::string(report.orig_client_order_id), update);
+      break;
+    };
+
+    case binance::ExecType::trade: {
+      OrderFill fill;
+      fill.is_fully_filled =
+          (report.order_status == binance::OrderState::FILLED);
+      fill.size = parse_decimal(report.last_executed_qty,
+                                binance::LAST_EXECUTED_QUANTITY.c_str());
+      fill.price = parse_decimal(report.last_executed_price,
+                                 binance::LAST_EXECUTED_PRICE.c_str());
+      fill.recv_time = Time::realtime_now();
+      _callbacks.on_order_fill(*this, std::string(report.client_order_id),
+                               fill);
       break;
     }
     default: {
-      LOG_WARN("unhandled Binance user-data message: " << event_type_str);
+      LOG_WARN("unhandled Binance order-update: " << report.execution_type);
       break;
     }
   }
@@ -17,22 +17,61 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/gx/BinanceDecoder.hpp>
+#include <apex/gx/BinanceRateLimiter.hpp>
 #include <apex/gx/ExchangeSession.hpp>
+#include <apex/infra/HttpClientPool.hpp>
 #include <apex/model/Order.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/PerfectHashMap.hpp>
+#include <apex/util/RawCapture.hpp>
 #include <apex/util/StopFlag.hpp>
 #include <apex/util/json.hpp>
 
+#include <array>
+#include <deque>
+#include <mutex>
+
 namespace apex
 {
 
 class RealtimeEventLoop;
 class WebsocketClient;
+class HmacSha256;
+namespace binance
+{
+class WsApiRequests;
+}
+
+/* Delivery of a stream in update order: an update older than, or the same
+ * as, one already delivered is dropped, such as one resent after a
+ * reconnect, or, with dual-feed, the copy of an update that arrives
+ * second. */
+struct FeedArbiter {
+  std::mutex mtx; // also keeps deliveries in update order
+  uint64_t last_id = 0;
+};
 
 struct Subscription {
-  int id;
-  bool is_requested = false;
-  std::function<std::string(void)> build_request;
+  // market-data connection carrying the stream, or 0 if not yet assigned
+  uint64_t connection = 0;
   std::function<void(json)> handler;
+
+  // Optional fast path, called on the IO thread with the data member of a
+  // stream message, and the latency trace stamp of its frame.  Returns false
+  // to fall back to the json handler.
+  std::function<bool(std::string_view, const trace::Stamp&)> decode;
+
+  // With dual-feed market data: the mirror connection carrying the second
+  // copy of the stream, or 0, and the member of the stream data holding the
+  // update id by which copies are matched
+  uint64_t mirror = 0;
+  char update_id_key = 0;
+  std::shared_ptr<FeedArbiter> arbiter;
+
+  // the decode drops late copies itself, for a stream of several symbols,
+  // whose update ids are per symbol; the stream is mirrored without arbiter
+  bool decode_arbitrates = false;
 };
 
 /* Represent an active subscription to Binance account info */
@@ -62,6 +101,63 @@ public:
   struct Params {
     std::string raw_capture_dir;
     std::string api_key_file;
+
+    // Market-data streams are spread over this many websockets, with more
+    // opened once the streams exceed the per-connection limit.  Connections
+    // are served by the session IO loop, or by dedicated IO threads.
+    unsigned md_connections = 1;
+    unsigned md_streams_per_connection = 1024; // the Binance limit
+    unsigned md_io_threads = 0;
+
+    // Websockets kept connected, without streams, to take the place of a
+    // market-data connection that drops, so that its streams resume without
+    // waiting for a new connection
+    unsigned md_standby_connections = 0;
+
+    // Receive every market-data stream twice, over a second set of
+    // connections, to the mirror endpoint, and deliver whichever copy of each
+    // update arrives first
+    bool md_dual_feed = false;
+    std::string md_mirror_host = "stream.binance.com";
+    int md_mirror_port = 443;
+
+    // Take the top of book of every symbol from the one all-market
+    // !bookTicker stream, rather than a <symbol>@bookTicker stream each;
+    // updates of symbols not subscribed are dropped as they arrive
+    bool md_all_book_ticker = false;
+
+    // REST requests share a pool of keep-alive connections, this many of
+    // which are kept open, and warm, by periodic pings
+    unsigned http_connections = 4;
+    unsigned http_warm_connections = 2;
+    unsigned http_keep_warm_sec = 30;
+    bool http2 = false;
+
+    // "rest", or "websocket" to place and cancel orders over the WebSocket
+    // API instead
+    std::string order_entry = "rest";
+
+    // Offer permessage-deflate on each kind of websocket, so that Binance can
+    // compress what it sends; saves bandwidth, at a CPU cost to the IO thread
+    bool md_permessage_deflate = false;
+    bool user_permessage_deflate = false;
+    bool ws_api_permessage_deflate = false;
+
+    // Take the receive time of websocket frames, as stamped on ticks for
+    // latency tracing, from kernel receive timestamps; see
+    // TcpSocket::options::rx_timestamps
+    bool rx_timestamps = false;
+
+    // Account balances are kept from the outboundAccountPosition events of
+    // the user stream, which carry only the assets changed, and reconciled
+    // with a REST account snapshot, of request weight 20, this often; 0 for
+    // only the snapshot taken on subscription
+    unsigned account_reconcile_sec = 900;
+
+    // Order requests are paced to these Binance limits, and refused, with
+    // error e0004, once a budget is spent; see binance::RateLimiter.  New
+    // orders leave the cancel reserve of the request weight for cancels.
+    binance::RateLimiter::Limits rate_limits;
   };
 public:
   BinanceSession(BaseExchangeSession::EventCallbacks, Config& config,
@@ -72,29 +168,85 @@ public:
                  RunMode run_mode, IoLoop* ioloop,
                  RealtimeEventLoop& event_loop,
                  SslContext* ssl);
+  ~BinanceSession();
 
   void start();
 
   void subscribe_trades(Symbol, subscription_options,
-                        std::function<void(TickTrade)>) override;
+                        std::function<void(const TickTrade&)>) override;
 
   void subscribe_account(
       std::function<void(std::vector<AccountUpdate>)> callback) override;
 
   void subscribe_top(Symbol, subscription_options,
-                     std::function<void(TickTop)>) override;
+                     std::function<void(const TickTop&)>) override;
+
+  void subscribe_book(Symbol, subscription_options,
+                      std::function<void(const TickBookDelta&)>) override;
 
   void submit_order(OrderParams, SubmitOrderCallbacks) override;
 
   void cancel_order(std::string symbol, std::string order_id,
                     std::string ext_order_id, SubmitOrderCallbacks) override;
 
+  void replace_order(std::string symbol, std::string order_id,
+                     std::string ext_order_id, OrderParams,
+                     SubmitOrderCallbacks cancel_callbacks,
+                     SubmitOrderCallbacks new_callbacks) override;
+
+  void cancel_all_orders(std::string symbol, CancelAllCallbacks) override;
+
+  /* Time from the drop of a market-data connection to the first tick on the
+   * connection that replaces it, in nanoseconds. */
+  LatencyHistogram::Snapshot md_recovery_latency();
+
+  /* Of the market-data updates received on both feeds, how many were first on
+   * the primary and on the mirror feed, and the copies dropped as late. */
+  struct md_feed_stats {
+    uint64_t primary_first = 0;
+    uint64_t mirror_first = 0;
+    uint64_t duplicates = 0;
+  };
+  md_feed_stats get_md_feed_stats() const;
+
+  /* Remaining budgets of the Binance rate limits. */
+  binance::RateLimiter::Budget rate_budget() const
+  {
+    return _rate_limiter->budget();
+  }
+
+  uint32_t order_budget() const override { return rate_budget().new_orders; }
+
+  /* Deliver a captured market-data frame as if received on the connection
+   * serving its stream: through the raw decoders, and for frames they leave,
+   * or all frames if `json_path`, parsed and passed to the json handler on the
+   * event thread.  For replay harnesses; called from a single thread standing
+   * in for the IO thread, and with start() not called. */
+  void replay_md_frame(std::string_view frame, bool json_path = false);
+
+  /* As above, but as received on the market-data connection `connection`,
+   * through the raw decoders; a frame of a stream the connection does not
+   * carry is dropped, as by a live connection. */
+  void replay_md_frame(std::string_view frame, uint64_t connection);
+
+  /* For replay harnesses and tests, with start() not called: attach a
+   * market-data connection, or with dual-feed a mirror, without a websocket,
+   * as if it had just connected, so that streams are assigned, and
+   * rebalanced, to it as to a live one.  The requests it would send are
+   * passed to `on_request` on the event thread.  Called from a thread other
+   * than the event thread; returns the id of the connection. */
+  uint64_t replay_md_connection(bool mirror,
+                                std::function<void(const std::string&)> on_request);
+
 private:
   // void dispatch(std::function<void(BinanceSession* self)>);
   std::shared_ptr<WebsocketClient> open_websocket(std::string, std::string, int,
                                                   std::string,
                                                   std::function<void()>,
-                                                  std::function<void(json)>);
+                                                  std::function<void(json)>,
+                                                  std::function<bool(const char*, size_t, uint64_t)> on_raw = {},
+                                                  IoLoop* ioloop = nullptr,
+                                                  bool permessage_deflate = false);
 
   bool eval_connection_state();
   void check_connection_state();
@@ -111,35 +263,164 @@ private:
 
 
   void on_userdata_msg(json);
+  bool io_on_userdata_raw(const char*, size_t);
+  void on_execution_report(const binance::ExecutionReport&);
 
   std::string endpoint(std::string url);
 
 
+  // exchange messages captured for replay, if raw_capture_dir is set; declared
+  // ahead of the websockets, which may capture until they are destroyed
+  std::unique_ptr<RawCaptureWriter> _raw_capture;
+
   // TODO: make remove, since all usage of m_subscriptions appears to be on the
   // event thread?
   std::mutex m_subscriptions_mtx;
-  std::map<std::string, Subscription> m_subscriptions;
+  std::map<std::string, Subscription, std::less<>> m_subscriptions;
+
+  // the subscriptions by stream name, rebuilt as each is added, for routing
+  // stream messages with a single probe
+  PerfectHashMap<Subscription*> m_stream_index;
+  void index_subscriptions();
+
+  // event-thread copy of m_stream_index, refreshed when subscriptions are
+  // made, so json stream messages are routed without the mutex
+  PerfectHashMap<Subscription*> _ev_stream_index;
+
+  /* Subscriber to the top of book of a symbol, from the all-market
+   * !bookTicker stream.  Update ids are per symbol, so each symbol has its
+   * own arbiter. */
+  struct TopSubscriber {
+    std::function<void(const TickTop&)> callback;
+    std::shared_ptr<FeedArbiter> arbiter;
+  };
+
+  // by exchange symbol, as in the "s" member of updates; like subscriptions,
+  // never removed, and guarded by m_subscriptions_mtx, as is the index
+  std::map<std::string, TopSubscriber, std::less<>> _top_subscribers;
+  PerfectHashMap<TopSubscriber*> _top_index;
+  void subscribe_all_top(const std::string& symbol,
+                         std::function<void(const TickTop&)>);
+  bool decode_all_top(std::string_view data, const trace::Stamp&,
+                      int feed = 0);
+  void on_all_top_msg(const json&);
+  void count_dropped_update();
+
+  /* A market-data websocket, carrying a share of the subscriptions. */
+  struct MdConnection {
+    IoLoop* ioloop = nullptr;
+    std::shared_ptr<WebsocketClient> ws;
+    uint64_t id = 0; // unique to each websocket; 0 while down
+    size_t streams = 0;
+    std::vector<std::string> to_subscribe;
+    std::vector<std::string> to_unsubscribe;
+    std::deque<std::chrono::steady_clock::time_point> requests_sent;
+
+    // in place of the websocket, of a connection attached for replay
+    std::function<void(const std::string&)> replay_requests;
+
+    // when the connection last serving this slot dropped, if not yet replaced
+    std::chrono::steady_clock::time_point down_since{};
+  };
+
+  // dedicated IO loops must outlive the connections they serve
+  std::vector<std::unique_ptr<IoLoop>> _md_ioloops;
+  std::vector<MdConnection> _md_connections;
+  std::vector<MdConnection> _md_standby;
+  std::vector<MdConnection> _md_mirrors; // with dual-feed, one per connection
+  uint64_t _next_md_connection_id = 1;
+  bool _md_request_timer = false;
+
+  // connections awaiting their first tick after replacing a dropped one, and
+  // the time of the drop; guarded by m_subscriptions_mtx, as is the histogram
+  std::map<uint64_t, std::chrono::steady_clock::time_point> _md_recovering;
+  LatencyHistogram _md_recovery_latency;
+
+  std::array<std::atomic<uint64_t>, 2> _md_feed_first{};
+  std::atomic<uint64_t> _md_feed_duplicates{0};
+  std::chrono::steady_clock::time_point _md_feed_stats_logged;
 
-  std::shared_ptr<WebsocketClient> _mktdata_stream;
   std::shared_ptr<WebsocketClient> _user_stream;
 
-  void on_mktdata_websocket_down();
-  void on_websocket_msg(json);
-  void on_websocket_up(std::shared_ptr<WebsocketClient>);
+  std::shared_ptr<WebsocketClient> open_md_websocket(const std::string& name,
+                                                     IoLoop*, uint64_t id,
+                                                     bool mirror = false);
+  void connect_md_connection(size_t);
+  void connect_md_standby();
+  void connect_md_mirror(size_t);
+  bool arbitrate_md_update(Subscription&, int feed, std::string_view data,
+                           const trace::Stamp&);
+  void log_md_feed_stats();
+  void on_md_connection_up(size_t);
+  void on_md_connection_down(uint64_t id);
+  void note_md_recovery(uint64_t connection);
+  void rebalance_md_connections(size_t);
+  void on_websocket_msg(json, uint64_t connection);
+  bool io_on_websocket_raw(const char*, size_t, uint64_t connection,
+                           uint64_t rx_time = 0);
   void make_pending_subscriptions();
+  void send_md_requests();
+
+  /* Local book synchronisation of a diff-depth stream, per the Binance
+   * procedure: diffs are buffered while a REST snapshot is fetched, those
+   * following the snapshot are then applied, and any gap in the update ids
+   * starts a new snapshot. */
+  struct DepthSync {
+    std::string symbol;
+    std::function<void(const TickBookDelta&)> callback;
+    bool synced = false;
+    bool snapshot_requested = false;
+    uint64_t last_update_id = 0;
+    std::chrono::steady_clock::time_point next_snapshot;
+    std::vector<std::pair<binance::DepthUpdate, TickBookDelta>> pending;
+  };
+
+  void on_depth_update(const std::shared_ptr<DepthSync>&, binance::DepthUpdate,
+                       TickBookDelta&);
+  bool apply_depth_update(DepthSync&, binance::DepthUpdate,
+                          const TickBookDelta&);
+  void request_depth_snapshot(const std::shared_ptr<DepthSync>&);
+  void on_depth_snapshot(const std::shared_ptr<DepthSync>&, const std::string&);
 
   void retry_connect_market_data_stream();
   void retry_connect_user_data_stream();
 
   void http_request(
       HttpRequestType type, std::string endpoint, std::string path,
-      std::string post_data, std::vector<std::string> headers,
+      std::string post_data,
+      std::shared_ptr<const HttpClientPool::HeaderList> headers,
       std::function<void(std::string reply, std::string error)> on_result);
 
 
   void on_user_data_stream_up(std::shared_ptr<WebsocketClient>);
   void on_user_data_stream_reply(json);
 
+  /* Order entry over the WebSocket API; requests are correlated with their
+   * replies by id, on the event thread. */
+  void retry_connect_order_entry();
+  void on_order_entry_up(std::shared_ptr<WebsocketClient>);
+  void on_order_entry_down(const std::shared_ptr<WebsocketClient>&);
+  void on_order_entry_msg(json);
+  bool ws_order_entry() const { return _ws_api != nullptr; }
+  void submit_order_ws(OrderParams, SubmitOrderCallbacks);
+  void cancel_order_ws(std::string symbol, std::string ext_order_id,
+                       SubmitOrderCallbacks);
+  void replace_order_ws(std::string symbol, std::string ext_order_id,
+                        OrderParams, SubmitOrderCallbacks, SubmitOrderCallbacks);
+  void cancel_all_orders_ws(std::string symbol, CancelAllCallbacks);
+  bool send_ws_request(const char* method,
+                       std::vector<std::pair<std::string, json>> params,
+                       std::function<void(int status, json& body)>);
+
+  void apply_new_order_reply(json& reply, const SubmitOrderCallbacks&);
+  void apply_cancel_order_reply(json& reply, const SubmitOrderCallbacks&);
+  void apply_cancel_replace_reply(json& reply, const SubmitOrderCallbacks&,
+                                  const SubmitOrderCallbacks&);
+  void apply_cancel_all_reply(json& reply, const CancelAllCallbacks&);
+
+  std::shared_ptr<WebsocketClient> _order_ws;
+  std::unique_ptr<binance::WsApiRequests> _ws_api;
+
   std::mutex _listen_key_lock;
   std::string _listen_key;
   std::chrono::time_point<std::chrono::steady_clock> _listen_key_created;
@@ -150,10 +431,38 @@ private:
 
   std::unique_ptr<AccountStream> _account_stream;
 
+  // balances of the account, and the exchange time, in ms, of the last
+  // change applied; a REST snapshot older than that is not applied
+  void on_balances(std::vector<AccountUpdate>, int64_t update_time,
+                   bool is_snapshot);
+  Account _balances;
+  int64_t _balances_time = 0;
+  bool _have_balances = false;
+
+  // created ahead of the HTTP pool, which reads rate-limit headers into it
+  std::unique_ptr<binance::RateLimiter> _rate_limiter;
+  size_t _rate_limit_collector = 0;
+  bool acquire_rate_limit(binance::RateLimiter::Request);
+  void reject_throttled(std::function<void(std::string, std::string)>,
+                        const char* text = "rate limit budget exhausted");
+
+  std::unique_ptr<HttpClientPool> _http;
+
+  // signing key schedule, and the API key header, of order requests
+  std::unique_ptr<HmacSha256> _hmac;
+  std::shared_ptr<const HttpClientPool::HeaderList> _api_key_headers;
+
   struct {
     std::string md_host = "stream.binance.com";
     int md_port = 9443;
     std::string md_path = "/stream";
+    unsigned md_connections = 1;
+    unsigned md_streams_per_connection = 1024;
+    unsigned md_standby_connections = 0;
+    bool md_dual_feed = false;
+    std::string md_mirror_host;
+    int md_mirror_port = 443;
+    bool md_all_book_ticker = false;
 
     std::string user_host = "stream.binance.com";
     int user_port = 9443;
@@ -161,7 +470,17 @@ private:
     int recv_window = 5000;
 
     std::string api_endpoint = "https://api.binance.com";
+
+    std::string ws_api_host = "ws-api.binance.com";
+    int ws_api_port = 443;
+    std::string ws_api_path = "/ws-api/v3";
     bool use_test = false;
+
+    bool md_permessage_deflate = false;
+    bool user_permessage_deflate = false;
+    bool ws_api_permessage_deflate = false;
+    bool rx_timestamps = false;
+    unsigned account_reconcile_sec = 0;
   } _params;
 
   int _next_id = 1;
@@ -169,8 +488,6 @@ private:
   std::string _user_api_key;
   std::string _user_api_secret;
 
-  std::string _raw_capture_dir;
-
   enum class ServiceState {
     connecting,
     connected,
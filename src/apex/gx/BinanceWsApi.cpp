@@ -0,0 +1,106 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/gx/BinanceWsApi.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+namespace binance
+{
+
+std::string WsApiRequests::signature_payload(const param_list& params)
+{
+  std::string payload;
+  for (auto& [key, value] : params) {
+    if (!payload.empty())
+      payload += '&';
+    payload += key;
+    payload += '=';
+    payload += value.is_string() ? value.get_ref<const std::string&>()
+                                 : value.dump();
+  }
+  return payload;
+}
+
+
+std::string WsApiRequests::make_signed(const char* method, param_list params,
+                                       long timestamp, reply_fn on_reply)
+{
+  params.emplace_back("apiKey", _api_key);
+  params.emplace_back("recvWindow", _recv_window);
+  params.emplace_back("timestamp", timestamp);
+  std::sort(params.begin(), params.end(),
+            [](auto& a, auto& b) { return a.first < b.first; });
+
+  auto payload = signature_payload(params);
+  auto signature = _hmac.sign_hex(payload);
+
+  json request_params = json::object();
+  for (auto& [key, value] : params)
+    request_params[key] = std::move(value);
+  request_params["signature"] = std::move(signature);
+
+  auto id = _next_id++;
+  json request = {{"id", id}, {"method", method}, {"params", std::move(request_params)}};
+  _pending.emplace(id, std::move(on_reply));
+  return request.dump();
+}
+
+
+bool WsApiRequests::on_message(json& msg)
+{
+  auto id_iter = msg.find("id");
+  if (id_iter == msg.end() || !id_iter->is_number_unsigned())
+    return false;
+
+  auto iter = _pending.find(id_iter->get<uint64_t>());
+  if (iter == _pending.end())
+    return false;
+  auto on_reply = std::move(iter->second);
+  _pending.erase(iter);
+
+  int status = 0;
+  if (auto status_iter = msg.find("status"); status_iter != msg.end())
+    status = status_iter->get<int>();
+
+  if (auto result = msg.find("result"); result != msg.end()) {
+    on_reply(status, *result);
+  } else if (auto error = msg.find("error"); error != msg.end()) {
+    on_reply(status, *error);
+  } else {
+    json empty = json::object();
+    on_reply(status, empty);
+  }
+  return true;
+}
+
+
+void WsApiRequests::fail_all(const std::string& reason)
+{
+  auto pending = std::move(_pending);
+  _pending.clear();
+  for (auto& item : pending) {
+    json error = {{"msg", reason}};
+    item.second(0, error);
+  }
+}
+
+} // namespace binance
+} // namespace apex
@@ -0,0 +1,90 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/RequestSigner.hpp>
+#include <apex/util/json.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+namespace binance
+{
+
+/* Request and reply handling for the Binance WebSocket API, the websocket
+ * alternative to the REST order endpoints.  A request is a JSON object
+ *
+ *   {"id":1,"method":"order.place","params":{...,"signature":"..."}}
+ *
+ * whose params are signed as the REST query string would be, with the keys
+ * in alphabetical order, and a reply carries the id of its request plus
+ * either a "result", which is as the REST reply, or an "error".  This class
+ * only builds requests and correlates replies, leaving the websocket to the
+ * caller, and is used on a single thread. */
+class WsApiRequests
+{
+public:
+  using param_list = std::vector<std::pair<std::string, json>>;
+
+  /* Invoked with the reply status, 200 on success, and the result, or the
+   * error object.  Status 0 means that no reply will arrive, e.g. because
+   * the connection was lost. */
+  using reply_fn = std::function<void(int status, json& body)>;
+
+  WsApiRequests(std::string api_key, const std::string& api_secret,
+                int recv_window)
+    : _api_key(std::move(api_key)), _hmac(api_secret), _recv_window(recv_window)
+  {
+  }
+
+  /* Build a signed request, returning its text, and hold the handler until
+   * the reply arrives.  The apiKey, recvWindow, timestamp and signature
+   * params are added. */
+  std::string make_signed(const char* method, param_list params,
+                          long timestamp, reply_fn);
+
+  /* Pass a message to the handler of its request; returns false if it is
+   * not a reply to a pending request. */
+  bool on_message(json& msg);
+
+  /* Complete all pending requests with status 0, and an error object holding
+   * the reason. */
+  void fail_all(const std::string& reason);
+
+  [[nodiscard]] size_t pending() const { return _pending.size(); }
+
+  /* The payload that is signed: params in key order, as key=value joined by
+   * '&', with string values unquoted. */
+  static std::string signature_payload(const param_list&);
+
+private:
+  std::string _api_key;
+  HmacSha256 _hmac;
+  int _recv_window;
+  uint64_t _next_id = 1;
+  std::map<uint64_t, reply_fn> _pending;
+};
+
+} // namespace binance
+} // namespace apex
@@ -25,7 +25,10 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Order.hpp>
 
 #include <functional>
+#include <limits>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace apex
 {
@@ -34,6 +37,7 @@ class IoLoop;
 class SslContext;
 class TickTrade;
 class TickTop;
+struct TickBookDelta;
 
 class Symbol
 {
@@ -63,6 +67,13 @@ public:
     std::function<void(OrderUpdate)> on_reply;
   };
 
+  struct CancelAllCallbacks {
+    std::function<void(std::string, std::string)> on_rejected;
+    // the orders cancelled, by client order id
+    std::function<void(std::vector<std::pair<std::string, OrderUpdate>>)>
+        on_reply;
+  };
+
   struct EventCallbacks {
     std::function<void(BaseExchangeSession& exchange, std::string order_id,
                        OrderFill)>
@@ -94,14 +105,22 @@ public:
 
 
   virtual void subscribe_trades(Symbol, subscription_options,
-                                std::function<void(TickTrade)>) = 0;
+                                std::function<void(const TickTrade&)>) = 0;
 
   virtual void subscribe_top(Symbol /*symbol*/, subscription_options,
-                             std::function<void(TickTop)> /*callback*/)
+                             std::function<void(const TickTop&)> /*callback*/)
   {
     throw std::runtime_error("subscribe_topsubscribe_top not implemented");
   }
 
+  /* Subscribe to an incrementally maintained order book.  The first update,
+   * and the first after any resynchronisation, is a snapshot. */
+  virtual void subscribe_book(Symbol, subscription_options,
+                              std::function<void(const TickBookDelta&)>)
+  {
+    throw std::runtime_error("subscribe_book not implemented");
+  }
+
   ExchangeId exchange_id() const { return _exchange_id; }
 
   virtual void submit_order(OrderParams, SubmitOrderCallbacks) = 0;
@@ -109,8 +128,32 @@ public:
   virtual void cancel_order(std::string symbol, std::string order_id,
                             std::string ext_order_id, SubmitOrderCallbacks) = 0;
 
+  /* Cancel an order and submit its replacement in one request; the first
+   * callbacks report the cancel, the second the new order.  The new order
+   * is not attempted if the cancel fails. */
+  virtual void replace_order(std::string /*symbol*/, std::string /*order_id*/,
+                             std::string /*ext_order_id*/, OrderParams,
+                             SubmitOrderCallbacks /*cancel_callbacks*/,
+                             SubmitOrderCallbacks /*new_callbacks*/)
+  {
+    throw std::runtime_error("replace_order not implemented");
+  }
+
+  /* Cancel every open order of the account on a symbol, in one request. */
+  virtual void cancel_all_orders(std::string /*symbol*/, CancelAllCallbacks)
+  {
+    throw std::runtime_error("cancel_all_orders not implemented");
+  }
+
   bool is_paper_trading() const { return _run_mode == RunMode::paper; }
 
+  /* New orders that could be sent now without exceeding the rate limits of
+   * the exchange, for sessions that track them. */
+  virtual uint32_t order_budget() const
+  {
+    return std::numeric_limits<uint32_t>::max();
+  }
+
 protected:
   EventCallbacks _callbacks;
 private:
@@ -132,21 +175,7 @@ public:
                           run_mode),
        _event_loop(event_loop),
        _ioloop(ioloop),
-       _ssl(ssl),
-      _curl_requests([](){
-         try {
-           throw;
-         }
-         catch (const std::exception& e) {
-           LOG_ERROR("caught exception at event loop: ("
-                 << demangle(typeid(e).name()) << ") " << e.what());
-         }
-         catch (...) {
-           LOG_ERROR("caught unknown exception at event loop");
-         }
-         return false; // don't terminate the curl eventloop
-       },
-         [] { apex::Logger::instance().register_thread_id("curl"); })
+       _ssl(ssl)
   {
   }
 
@@ -154,10 +183,11 @@ public:
 
   void run_on_evloop(std::function<void(T* self)> fn)
   {
-    _event_loop.dispatch([fn2 = std::move(fn), weak{this->weak_from_this()}] {
-      if (auto sp = weak.lock())
-        fn2(sp.get());
-    });
+    _event_loop.dispatch(EventLoop::inline_fn(
+        [fn2 = std::move(fn), weak{this->weak_from_this()}] {
+          if (auto sp = weak.lock())
+            fn2(sp.get());
+        }));
   }
 
 
@@ -165,7 +195,6 @@ protected:
   RealtimeEventLoop& _event_loop;
   IoLoop* _ioloop;
   SslContext* _ssl;
-  RealtimeEventLoop _curl_requests;
 };
 
 } // namespace apex
@@ -22,11 +22,33 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/infra/SocketAddress.hpp>
 #include <apex/model/StrategyId.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/Metrics.hpp>
+#include <apex/util/Numa.hpp>
+#include <apex/util/Profiler.hpp>
+#include <apex/util/ThreadParams.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
 #define DEFAULT_GX_PORT 5780
 
 namespace apex {
 
+static metrics::Counter& gx_ticks = metrics::registry().counter(
+    "apex_gx_server_ticks_total", "Ticks received from exchange sessions");
+static metrics::Counter& gx_tick_sends = metrics::registry().counter(
+    "apex_gx_server_tick_sends_total", "Ticks fanned out to GX subscribers");
+static metrics::Counter& gx_order_requests = metrics::registry().counter(
+    "apex_gx_server_order_requests_total", "Orders submitted by GX sessions");
+static metrics::Gauge& gx_sessions = metrics::registry().gauge(
+    "apex_gx_server_sessions", "Connected GX sessions");
+
 ExchangeSubscription::ExchangeSubscription(
   std::shared_ptr<apex::BaseExchangeSession> exchange_session,
   ExchangeSubscriptionKey sym)
@@ -38,7 +60,7 @@ ExchangeSubscription::ExchangeSubscription(
 }
 
 
-void ExchangeSubscription::activate()
+void ExchangeSubscription::activate(bool with_book)
 {
   apex::Symbol symbol;
   symbol.native = _symbol.symbol;
@@ -47,39 +69,12 @@ void ExchangeSubscription::activate()
   // need to have the wp yet.
 
   auto sp = shared_from_this();
-  std::function<void(TickTrade)> callback = [sp](TickTrade tick) {
+  std::function<void(const TickTrade&)> callback = [sp](const TickTrade& tick) {
     // update local market-view, for later snapshot requests
     sp->_market.apply(tick);
 
     // broadcast the update to all connect server-sessions
-    std::set<std::shared_ptr<GxServerSession>> drop_list;
-    for (auto& item : sp->_subscribers) {
-      try {
-        item->send(sp->_symbol.symbol, sp->_symbol.exchange_id, tick);
-      } catch (std::exception& err) {
-        // if write has failed, indicates session has an
-        // error, so no longer want to send updates;
-        // move to drop list
-        drop_list.insert(std::move(item));
-      }
-    }
-
-    if (!drop_list.empty()) {
-      // if we have sessions to drop, we rebuild the
-      // subscriber list here
-      std::vector<std::shared_ptr<GxServerSession>> newsubs;
-      for (auto& item : sp->_subscribers) {
-        if (item)
-          newsubs.push_back(std::move(item));
-      }
-
-      sp->_subscribers = std::move(newsubs);
-
-      // finally, clear the drop-list; we do this
-      // deliberately post-loop so that GxSessionClient
-      // destructors are triggered from here.
-      drop_list.clear();
-    }
+    sp->broadcast(tick);
   };
   apex::subscription_options options(apex::StreamType::Trades);
 
@@ -87,45 +82,413 @@ void ExchangeSubscription::activate()
   // conveyed in the subscription options.
 
   _exchange_session->subscribe_trades(symbol, options, callback);
-  _exchange_session->subscribe_top(symbol, options, [sp](TickTop tick) {
+  _exchange_session->subscribe_top(symbol, options, [sp](const TickTop& tick) {
     sp->_market.apply(tick);
 
     // broadcast the update to all connect server-sessions
-    for (auto& item : sp->_subscribers) {
-      try {
-        item->send(sp->_symbol.symbol, sp->_symbol.exchange_id, tick);
-      } catch (std::exception& e) {
-        LOG_ERROR("exception during GX send: " << e.what());
-        // TODO: how best to drop this client?
+    sp->broadcast(tick);
+  });
+
+  // book deltas update the local market-view only; they are not yet
+  // forwarded to GX sessions
+  if (with_book)
+    _exchange_session->subscribe_book(
+        symbol, options, [sp](const TickBookDelta& delta) {
+          sp->_market.apply(delta);
+        });
+}
+
+
+/* Stream mask of a tick type */
+template <typename T> static constexpr int stream_mask()
+{
+  if constexpr (std::is_same_v<T, TickTrade>)
+    return static_cast<int>(MdStream::Trades) |
+           static_cast<int>(MdStream::AggTrades);
+  else
+    return static_cast<int>(MdStream::L1);
+}
+
+
+template <typename T>
+bool ExchangeSubscription::Subscriber::wants() const
+{
+  return streams & stream_mask<T>();
+}
+
+
+template <typename T>
+void ExchangeSubscription::broadcast(const T& tick_in)
+{
+  // Each encoding of the tick is built at most once, on first use, and the
+  // resulting frame shared by all subscribers using that encoding.
+  std::shared_ptr<const gx::Frame> proto_frame;
+  std::shared_ptr<const gx::Frame> binary_frame;
+
+  // the stamp is advanced to this stage before it is encoded
+  T traced = tick_in;
+  trace::tracer().mark(trace::Stage::gx_encode, traced.trace);
+  const T& tick = traced;
+
+  if (_mcast_sock) {
+    binary_frame = GxServerSession::encode_binary(_frames, tick);
+    publish(binary_frame, std::is_same_v<T, TickTrade>);
+  }
+
+  gx_ticks.add();
+  gx_tick_sends.add(_subscribers.size());
+
+  std::set<std::shared_ptr<GxServerSession>> drop_list;
+  for (auto& item : _subscribers) {
+    if (item.multicast || !item.wants<T>())
+      continue;
+    try {
+      if (item.binary) {
+        if (!binary_frame)
+          binary_frame = GxServerSession::encode_binary(_frames, tick);
+        item.session->send_tick(binary_frame, item.subscription_id, this);
+      } else {
+        if (!proto_frame)
+          proto_frame = GxServerSession::encode(tick);
+        item.session->send_tick(proto_frame, item.subscription_id, this);
       }
+    } catch (std::exception& err) {
+      // if write has failed, indicates session has an
+      // error, so no longer want to send updates;
+      // move to drop list
+      LOG_ERROR("exception during GX send: " << err.what());
+      drop_list.insert(std::move(item.session));
     }
+  }
 
+  if (!drop_list.empty()) {
+    // if we have sessions to drop, we rebuild the
+    // subscriber list here
+    std::vector<Subscriber> newsubs;
+    for (auto& item : _subscribers) {
+      if (item.session)
+        newsubs.push_back(std::move(item));
+    }
 
-    // TODO: prune any bad connections
-  });
+    _subscribers = std::move(newsubs);
+
+    // finally, clear the drop-list; we do this
+    // deliberately post-loop so that GxSessionClient
+    // destructors are triggered from here.
+    drop_list.clear();
+  }
+}
+
+void ExchangeSubscription::subscribe(GxServerSession& session,
+                                     const GxSubscribeRequest& req)
+{
+  const bool multicast = req.multicast && _mcast_sock;
+
+  // Take the sequence number before adding the subscriber, so that any tick
+  // published in between is seen by the client as a gap, and recovered.
+  gx::bin::McastChannel channel;
+  memset(&channel, 0, sizeof(channel));
+  if (multicast) {
+    channel.channel = _mcast_channel;
+    strncpy(channel.group, _mcast_options.group.c_str(),
+            sizeof(channel.group) - 1);
+    channel.port = _mcast_options.port;
+    auto lock = std::scoped_lock(_mcast_lock);
+    channel.next_seq = _mcast_seq;
+  }
+
+  // a request for no particular streams is for all of them
+  const int streams = req.streams ? req.streams : ~0;
+
+  // a repeated subscription changes the streams of the subscriber, which is
+  // sent the snapshot of only those added
+  auto iter = std::find_if(
+      std::begin(_subscribers), std::end(_subscribers), [&](const Subscriber& item) {
+        return item.session.get() == &session &&
+               item.subscription_id == req.subscription_id;
+      });
+  int added = streams;
+  if (iter != std::end(_subscribers)) {
+    added = streams & ~iter->streams;
+    iter->streams = streams;
+  } else {
+    _subscribers.push_back({session.shared_from_this(), req.subscription_id,
+                            req.binary, multicast, streams});
+    iter = std::prev(std::end(_subscribers));
+    if (multicast)
+      session.send_mcast_channel(req.subscription_id, channel);
+  }
+
+  try {
+    send_snapshot(*iter, added);
+  } catch (std::exception& err) {
+    // a failed session is dropped on the next broadcast
+    LOG_ERROR("exception during GX send: " << err.what());
+  }
+}
+
+
+void ExchangeSubscription::send_snapshot(const Subscriber& item, int streams)
+{
+  // The snapshot is sent via the session, also to multicast subscribers,
+  // since their channel carries only subsequent ticks.  It carries no latency
+  // trace, being older than the trace would suggest.
+  const auto& bid = _market.l1_bid();
+  const auto& ask = _market.l1_ask();
+  if ((streams & stream_mask<TickTop>()) && std::isfinite(bid.price) &&
+      std::isfinite(ask.price)) {
+    TickTop top;
+    top.bid_price = bid.price;
+    top.bid_qty = bid.qty;
+    top.ask_price = ask.price;
+    top.ask_qty = ask.qty;
+    if (item.binary)
+      item.session->send_tick(GxServerSession::encode_binary(_frames, top),
+                              item.subscription_id, this);
+    else
+      item.session->send_tick(GxServerSession::encode(top),
+                              item.subscription_id, this);
+  }
+
+  if ((streams & stream_mask<TickTrade>()) && _market.has_last()) {
+    TickTrade trade = _market.last();
+    trade.trace = {};
+    if (item.binary)
+      item.session->send_tick(GxServerSession::encode_binary(_frames, trade),
+                              item.subscription_id, this);
+    else
+      item.session->send_tick(GxServerSession::encode(trade),
+                              item.subscription_id, this);
+  }
+}
+
+
+void ExchangeSubscription::enable_multicast(UdpSocket* sock,
+                                            UdpSocket::MulticastOptions options,
+                                            uint32_t channel, size_t retain)
+{
+  _mcast_sock = sock;
+  _mcast_options = std::move(options);
+  _mcast_channel = channel;
+  _mcast_retain = retain;
+}
+
+
+void ExchangeSubscription::publish(const std::shared_ptr<const gx::Frame>& frame,
+                                   bool retain)
+{
+  auto lock = std::scoped_lock(_mcast_lock);
+  const uint64_t seq = _mcast_seq++;
+
+  _mcast_packet.resize(sizeof(gx::bin::McastHeader) + frame->size());
+  auto* header = reinterpret_cast<gx::bin::McastHeader*>(_mcast_packet.data());
+  header->magic = gx::bin::mcast_magic;
+  header->channel = _mcast_channel;
+  header->seq = seq;
+  memcpy(_mcast_packet.data() + sizeof(gx::bin::McastHeader), frame->data(),
+         frame->size());
+  _mcast_sock->send(_mcast_packet.data(), _mcast_packet.size());
+
+  if (retain && _mcast_retain) {
+    _mcast_history.emplace_back(seq, frame);
+    while (_mcast_history.size() > _mcast_retain)
+      _mcast_history.pop_front();
+  }
+}
+
+
+void ExchangeSubscription::recover(GxServerSession& session, uint64_t from_seq,
+                                   uint64_t to_seq)
+{
+  auto iter = std::find_if(_subscribers.begin(), _subscribers.end(),
+                           [&session](const Subscriber& item) {
+                             return item.session.get() == &session &&
+                                    item.multicast;
+                           });
+  if (iter == _subscribers.end())
+    return;
+  const auto subscription_id = iter->subscription_id;
+
+  std::vector<std::shared_ptr<const gx::Frame>> frames;
+  {
+    auto lock = std::scoped_lock(_mcast_lock);
+    if (_mcast_history.empty() || _mcast_history.front().first > from_seq)
+      LOG_WARN("multicast recovery for " << _symbol.symbol << " from seq "
+               << from_seq << " is incomplete, retained trades exhausted");
+    for (auto& item : _mcast_history)
+      if (item.first >= from_seq && item.first <= to_seq)
+        frames.push_back(item.second);
+  }
+
+  for (auto& frame : frames)
+    session.send(frame, subscription_id);
+}
+
+
+AccountTopic::AccountTopic(std::shared_ptr<BaseExchangeSession> session)
+  : _exchange_session(std::move(session))
+{
+}
+
+
+void AccountTopic::start_exchange_subscription()
+{
+  auto wp = weak_from_this();
+  _exchange_session->subscribe_account(
+      [wp](std::vector<AccountUpdate> updates) {
+        if (auto sp = wp.lock())
+          sp->on_update(updates);
+      });
+}
+
+
+void AccountTopic::subscribe(GxServerSession& session)
+{
+  auto iter = std::find_if(
+      _subscribers.begin(), _subscribers.end(),
+      [&session](const auto& item) { return item.get() == &session; });
+  if (iter == _subscribers.end())
+    _subscribers.push_back(session.shared_from_this());
+
+  std::vector<AccountUpdate> snapshot;
+  for (auto& [asset, avail] : _model.data())
+    snapshot.push_back({asset, avail});
+  if (!snapshot.empty())
+    session.send(_exchange_session->exchange_id(), snapshot);
+}
+
+
+void AccountTopic::on_update(const std::vector<AccountUpdate>& updates)
+{
+  // the session passes on only changes, but a repeated balance is dropped
+  // here too, as subscribers need never be sent one
+  auto changed = _model.apply(updates);
+  if (changed.empty())
+    return;
+  for (auto& session : _subscribers)
+    session->send(_exchange_session->exchange_id(), changed);
+}
+
+
+static Config threads_config(Config& config, const std::string& thread)
+{
+  return config.get_sub_config("threads", Config::empty_config())
+      .get_sub_config(thread, Config::empty_config());
+}
+
+
+static GxServerSession::BatchOptions parse_batch_options(Config& config)
+{
+  auto batching_config =
+      config.get_sub_config("batching", Config::empty_config());
+
+  GxServerSession::BatchOptions options;
+  options.enabled = batching_config.get_bool("enabled", true);
+  options.max_bytes = batching_config.get_uint("max_kb", 64) * 1024;
+  options.max_delay =
+      std::chrono::microseconds(batching_config.get_uint("max_delay_us", 0));
+  return options;
+}
+
+
+static GxServerSession::SlowConsumerOptions parse_slow_consumer_options(
+    Config& config)
+{
+  auto sc_config =
+      config.get_sub_config("slow_consumer", Config::empty_config());
+
+  GxServerSession::SlowConsumerOptions options;
+  options.high_watermark =
+      sc_config.get_uint("high_watermark_kb", options.high_watermark / 1024) *
+      1024;
+  options.low_watermark =
+      sc_config.get_uint("low_watermark_kb", options.low_watermark / 1024) *
+      1024;
+  options.max_queued_trades =
+      sc_config.get_uint("max_queued_trades", options.max_queued_trades);
+  options.max_stall = std::chrono::seconds(
+      sc_config.get_uint("max_stall_sec", options.max_stall.count()));
+
+  auto policy = sc_config.get_string("policy", "disconnect");
+  if (policy == "disconnect")
+    options.policy = GxServerSession::SlowConsumerOptions::Policy::disconnect;
+  else if (policy == "drop_oldest")
+    options.policy = GxServerSession::SlowConsumerOptions::Policy::drop_oldest;
+  else {
+    std::ostringstream oss;
+    oss << "invalid slow_consumer policy, " << QUOTE(policy);
+    throw ConfigError(oss.str());
+  }
+
+  if (options.low_watermark > options.high_watermark)
+    throw ConfigError("slow_consumer low_watermark_kb exceeds high_watermark_kb");
+
+  return options;
 }
 
-void ExchangeSubscription::subscribe(GxServerSession& session)
+
+static GxServerSession::ShmOptions parse_shm_options(Config& config)
 {
-  _subscribers.push_back(session.shared_from_this());
+  auto shm_config = config.get_sub_config("shm", Config::empty_config());
+
+  GxServerSession::ShmOptions options;
+  options.enabled = shm_config.get_bool("enabled", true);
+  options.poll = shm_config.get_bool("poll", false);
+  return options;
 }
 
 
-void AccountTopic::start_exchange_subscription(
-  std::shared_ptr<apex::BaseExchangeSession> session)
+static bool parse_multicast_options(Config& config,
+                                    UdpSocket::MulticastOptions& options,
+                                    size_t& retain)
 {
-  _exchange_session = std::move(session);
-  // _exchange_session->subscribe_account(
-  //   [this](std::vector<AccountUpdate> updates) {
-  //     // apply the exchange update to the model
-  //     this->_model.apply(updates);
+  auto mcast_config =
+      config.get_sub_config("multicast", Config::empty_config());
+
+  options.group = mcast_config.get_string("group", "239.192.0.1");
+  options.port = mcast_config.get_uint("port", 5781);
+  options.interface = mcast_config.get_string("interface", "");
+  options.ttl = mcast_config.get_uint("ttl", options.ttl);
+  options.loopback = mcast_config.get_bool("loopback", options.loopback);
+  retain = mcast_config.get_uint("retain", 10000);
 
-  //     // notify subscribers
-  //     for (auto& item : _subscribers) {
-  //       item->send(this->_exchange_session->exchangeId(),
-  //                  updates); // TODO: handle exceptions
-  //     }
-  //   });
+  if (options.group.size() >= gx::bin::mcast_group_size)
+    throw ConfigError("multicast group address too long");
+
+  return mcast_config.get_bool("enabled", false);
+}
+
+
+static std::function<void()> io_thread_start_fn(Config& config)
+{
+  // called first, so placement applies to all of the server threads
+  numa::configure(config.get_sub_config("threads", Config::empty_config()));
+  auto params = parse_thread_params(threads_config(config, "io"));
+  return [params]() { try_apply_thread_params(params, "io"); };
+}
+
+
+// Start function for the additional server threads, which take their
+// placement from their own section of the threads config.
+static std::function<void()> thread_start_fn(Config config, std::string name)
+{
+  auto params = parse_thread_params(config);
+  return [params, name]() {
+    apex::Logger::instance().register_thread_id(name);
+    try_apply_thread_params(params, name.c_str());
+  };
+}
+
+
+// Event loop options; when work is handed between loops the queue defaults
+// to lock-free.
+static RealtimeEventLoop::Options handoff_loop_options(Config config,
+                                                       bool handoff)
+{
+  auto options = parse_event_loop_options(config);
+  if (handoff && !config.contains("queue"))
+    options.queue_type = RealtimeEventLoop::QueueType::lockfree;
+  return options;
 }
 
 
@@ -134,23 +497,43 @@ GxServer::GxServer(apex::RunMode run_mode,
   : _run_mode(run_mode),
     _config(std::move(config)),
     _external_event_loop(nullptr),
+    _ioloop(io_thread_start_fn(_config)),
     _port(0)
 {
   if (run_mode == apex::RunMode::backtest)
     throw std::runtime_error("GxServer does not support RunMode::backtest");
 
+  _ioloop.enable_io_uring(parse_io_uring_options(threads_config(_config, "io")));
+  _ioloop.enable_busy_poll(parse_busy_poll_options(threads_config(_config, "io")));
+
   SslConfig sslconf(true);
+  sslconf.ktls = _config.get_bool("ktls", false);
   _ssl = std::make_unique<SslContext>(sslconf);
 
+  _venue_threads = _config.get_bool("venue_threads", false);
+
+  auto ev_config = threads_config(_config, "ev");
+  auto ev_params = parse_thread_params(ev_config);
   _own_event_loop = std::make_unique<apex::RealtimeEventLoop>(
+      handoff_loop_options(ev_config, _venue_threads),
       [](){
         return false;
       },
-      [] {
+      [ev_params] {
         apex::Logger::instance().register_thread_id("gxev");
+        try_apply_thread_params(ev_params, "gxev");
       });
 
   _port = _config.get_uint("port", DEFAULT_GX_PORT);
+  _batching = parse_batch_options(_config);
+  _slow_consumer = parse_slow_consumer_options(_config);
+  _shm = parse_shm_options(_config);
+  _read_buffer = parse_decode_buffer_policy(
+      _config.get_sub_config("read_buffer", Config::empty_config()));
+  _traffic_stats = _config.get_bool("traffic_stats", false);
+  _mcast_enabled =
+      parse_multicast_options(_config, _mcast_options, _mcast_retain);
+  start_gx_io_loops();
 }
 
 
@@ -160,6 +543,7 @@ GxServer::GxServer(RealtimeEventLoop* external_event_loop,
   : _run_mode(run_mode),
     _config(std::move(config)),
     _external_event_loop(external_event_loop),
+    _ioloop(io_thread_start_fn(_config)),
     _try_other_ports(true),
     _port(0)
 {
@@ -167,8 +551,86 @@ GxServer::GxServer(RealtimeEventLoop* external_event_loop,
     throw std::runtime_error("GxServer does not support RunMode::backtest");
 
   SslConfig sslconf(true);
+  sslconf.ktls = _config.get_bool("ktls", false);
   _ssl = std::make_unique<SslContext>(sslconf);
   _port = _config.get_uint("port", 5780);
+  _batching = parse_batch_options(_config);
+  _slow_consumer = parse_slow_consumer_options(_config);
+  _shm = parse_shm_options(_config);
+  _read_buffer = parse_decode_buffer_policy(
+      _config.get_sub_config("read_buffer", Config::empty_config()));
+  _traffic_stats = _config.get_bool("traffic_stats", false);
+  _mcast_enabled =
+      parse_multicast_options(_config, _mcast_options, _mcast_retain);
+  _venue_threads = _config.get_bool("venue_threads", false);
+  start_gx_io_loops();
+}
+
+
+void GxServer::start_gx_io_loops()
+{
+  auto count = _config.get_uint("gx_io_threads", 1);
+  if (count <= 1)
+    return;
+
+  auto io_config = threads_config(_config, "gx_io");
+  for (size_t i = 0; i < count; i++) {
+    auto name = "gxio" + std::to_string(i + 1);
+    auto loop = std::make_unique<IoLoop>(thread_start_fn(io_config, name));
+    if (_ioloop.uring())
+      loop->enable_io_uring(
+          parse_io_uring_options(threads_config(_config, "io")));
+    loop->enable_busy_poll(parse_busy_poll_options(io_config));
+    _gx_ioloops.push_back(std::move(loop));
+  }
+}
+
+
+std::pair<IoLoop*, RealtimeEventLoop*> GxServer::new_venue_loops()
+{
+  if (!_venue_threads)
+    return {&_ioloop, event_loop()};
+
+  auto n = std::to_string(_venue_loops.size() + 1);
+  auto io_config = threads_config(_config, "venue_io");
+  auto ev_config = threads_config(_config, "venue_ev");
+
+  auto loops = std::make_unique<VenueLoops>();
+  loops->io =
+      std::make_unique<IoLoop>(thread_start_fn(io_config, "venueio" + n));
+  if (_ioloop.uring())
+    loops->io->enable_io_uring(
+        parse_io_uring_options(threads_config(_config, "io")));
+  loops->io->enable_busy_poll(parse_busy_poll_options(io_config));
+  loops->ev = std::make_unique<RealtimeEventLoop>(
+      handoff_loop_options(ev_config, true), []() { return false; },
+      thread_start_fn(ev_config, "venueev" + n));
+
+  std::pair<IoLoop*, RealtimeEventLoop*> result{loops->io.get(),
+                                                loops->ev.get()};
+  _venue_loops.push_back(std::move(loops));
+  return result;
+}
+
+
+void GxServer::run_on_venue(const BaseExchangeSession& venue,
+                            std::function<void()> fn)
+{
+  auto iter = _venue_event_loops.find(venue.exchange_id());
+  auto* loop = iter != _venue_event_loops.end() ? iter->second : event_loop();
+  if (loop->this_thread_is_ev())
+    fn();
+  else
+    loop->dispatch(std::move(fn));
+}
+
+
+void GxServer::run_on_server(std::function<void()> fn)
+{
+  if (event_loop()->this_thread_is_ev())
+    fn();
+  else
+    event_loop()->dispatch(std::move(fn));
 }
 
 
@@ -186,6 +648,18 @@ GxServer::~GxServer()
   if (_own_event_loop)
     _own_event_loop->sync_stop();
 
+  // sessions whose disconnect has not yet been handled are closed while
+  // their IO loops still run, since a socket can only be closed by its loop
+  for (auto& session : _gx_sessions)
+    session->close();
+
+  for (auto& loops : _venue_loops)
+    loops->ev->sync_stop();
+  for (auto& loops : _venue_loops)
+    loops->io->sync_stop();
+  for (auto& loop : _gx_ioloops)
+    loop->sync_stop();
+
   _ioloop.sync_stop();
 }
 
@@ -198,8 +672,14 @@ bool GxServer::on_logon_request(GxServerSession& s, std::string id,
     return false;
   }
 
-  if (_gx_session_map.find(id) == std::end(_gx_session_map)) {
-    _gx_session_map.insert({id, s.shared_from_this()});
+  const uint64_t key = id.size() == strategy_id_size ? strategy_key(id) : 0;
+  if (key == 0) {
+    LOG_WARN("om-logon rejected, invalid strategy-id " << QUOTE(id));
+    return false;
+  }
+
+  if (_logons.find(key) == nullptr) {
+    _logons.insert(key, s.shared_from_this());
     LOG_INFO("om-logon accepted, strategyId: " << QUOTE(id));
     return true;
   } else {
@@ -210,22 +690,68 @@ bool GxServer::on_logon_request(GxServerSession& s, std::string id,
   }
 }
 
-void GxServer::add_venue(BinanceSession::Params params)
+BaseExchangeSession::EventCallbacks GxServer::session_callbacks()
 {
+  // invoked on the venue's event loop; the GX sessions are found on the
+  // server's
   BaseExchangeSession::EventCallbacks callbacks;
   callbacks.on_order_fill = [this](BaseExchangeSession& exchange,
                                    std::string order_id, OrderFill msg) {
-    this->on_fill(exchange, std::move(order_id), msg);
+    run_on_server([this, &exchange, order_id = std::move(order_id), msg]() {
+      this->on_fill(exchange, order_id, msg);
+    });
   };
   callbacks.on_order_cancel = [this](BaseExchangeSession& exchange,
                                      std::string order_id, OrderUpdate msg) {
-    this->on_unsol_cancel(exchange, order_id, msg);
+    run_on_server([this, &exchange, order_id = std::move(order_id), msg]() {
+      this->on_unsol_cancel(exchange, order_id, msg);
+    });
   };
+  return callbacks;
+}
+
 
+std::shared_ptr<BaseExchangeSession>
+GxServer::with_paper_exchange(std::shared_ptr<BaseExchangeSession> venue,
+                              IoLoop* ioloop, RealtimeEventLoop& evloop)
+{
+  if (_run_mode != RunMode::paper)
+    return venue;
+
+  auto config = _config.get_sub_config("paper_exchange", Config::empty_config());
+  PaperExchange::Options options;
+  options.fill_model = config.get_string("fill_model", options.fill_model);
+  options.cross_fill =
+      to_sim_cross_fill(config.get_string("cross_fill", "visible"));
+  return std::make_shared<PaperExchange>(session_callbacks(), std::move(venue),
+                                         ioloop, evloop, options);
+}
+
+
+void GxServer::add_venue(BinanceSession::Params params)
+{
   // TODO: check, if binance already added, throw.
-  auto sp = std::make_shared<apex::BinanceSession>(
-      callbacks, params, _run_mode, &_ioloop, *event_loop(), _ssl.get());
+  auto [ioloop, evloop] = new_venue_loops();
+  auto sp = with_paper_exchange(
+      std::make_shared<apex::BinanceSession>(session_callbacks(), params,
+                                             _run_mode, ioloop, *evloop,
+                                             _ssl.get()),
+      ioloop, *evloop);
   _exchange_sessions.insert({ExchangeId::binance, sp});
+  _venue_event_loops[ExchangeId::binance] = evloop;
+  sp->start();
+}
+
+
+void GxServer::add_venue(const SessionFactory& factory)
+{
+  auto [ioloop, evloop] = new_venue_loops();
+  auto sp = factory(session_callbacks(), ioloop, *evloop);
+  if (!sp)
+    THROW("exchange session factory did not create a session");
+  sp = with_paper_exchange(std::move(sp), ioloop, *evloop);
+  _exchange_sessions[sp->exchange_id()] = sp;
+  _venue_event_loops[sp->exchange_id()] = evloop;
   sp->start();
 }
 
@@ -245,15 +771,7 @@ void GxServer::start()
 
   // const bool paper_mode = _run_mode == RunMode::paper;
 
-  BaseExchangeSession::EventCallbacks callbacks;
-  callbacks.on_order_fill = [this](BaseExchangeSession& exchange,
-                                   std::string order_id, OrderFill msg) {
-    this->on_fill(exchange, std::move(order_id), msg);
-  };
-  callbacks.on_order_cancel = [this](BaseExchangeSession& exchange,
-                                     std::string order_id, OrderUpdate msg) {
-    this->on_unsol_cancel(exchange, order_id, msg);
-  };
+  auto callbacks = session_callbacks();
 
   // create connections to venues
 
@@ -265,9 +783,15 @@ void GxServer::start()
       auto config = exchanges_config.array_item(i);
       auto session_type = config.get_string("type");
       if (session_type == "binance") {
-        auto sp = std::make_shared<apex::BinanceSession>(
-            callbacks, config, _run_mode, &_ioloop, *event_loop(), _ssl.get());
+        auto [ioloop, evloop] = new_venue_loops();
+        auto sp = with_paper_exchange(
+            std::make_shared<apex::BinanceSession>(
+                callbacks, config, _run_mode, ioloop, *evloop, _ssl.get()),
+            ioloop, *evloop);
         _exchange_sessions.insert({ExchangeId::binance, sp});
+        _venue_event_loops[ExchangeId::binance] = evloop;
+        if (config.get_bool("depth", false))
+          _depth_exchanges.insert(ExchangeId::binance);
         sp->start();
       } // else if (session_type == "binance_usdfut") {
         // auto sp = std::make_shared<apex::BinanceUsdFutSession>(
@@ -284,10 +808,38 @@ void GxServer::start()
     }
   }
 
+  if (_mcast_enabled) {
+    _mcast_sock = std::make_unique<UdpSocket>(_ioloop);
+    auto err = _mcast_sock->open_sender(_mcast_options).get();
+    if (err)
+      THROW("failed to open multicast socket for group "
+            << _mcast_options.group << ":" << _mcast_options.port
+            << ", error: " << err);
+    LOG_INFO("publishing ticks to multicast group " << _mcast_options.group
+             << ":" << _mcast_options.port);
+  }
+
+  // optionally log the GX send statistics, per interval
+  auto stats_interval = std::chrono::seconds(
+      _config.get_sub_config("batching", Config::empty_config())
+          .get_uint("stats_log_sec", 0));
+  if (stats_interval.count() > 0) {
+    event_loop()->dispatch(stats_interval,
+                           [this, stats_interval]() -> std::chrono::milliseconds {
+                             log_send_stats();
+                             return stats_interval;
+                           });
+  }
+
+  trace::configure(_config, *event_loop());
+  metrics::configure(_config, *event_loop());
+  profile::configure(_config, *event_loop());
+  memory::configure_report(_config, *event_loop());
+
   int remaining_port_attempts = _try_other_ports? 100 : 1;
 
   while (true) {
-    auto err = create_listen_socket();
+    auto err = create_listen_sockets();
     if (!err)
       break;
     if (--remaining_port_attempts > 0)
@@ -297,10 +849,35 @@ void GxServer::start()
   }
 }
 
-UvErr GxServer::create_listen_socket() {
+UvErr GxServer::create_listen_sockets()
+{
+  if (_gx_ioloops.empty())
+    return create_listen_socket(_ioloop, false);
+
+  // Note, with SO_REUSEPORT the bind succeeds even if another server, of the
+  // same user, also listens on the port with the option set.
+  for (auto& loop : _gx_ioloops) {
+    auto err = create_listen_socket(*loop, true);
+    if (err) {
+      for (auto& sock : _server_socks)
+        sock->close().wait();
+      _server_socks.clear();
+      return err;
+    }
+  }
+  LOG_INFO("GX connections served by " << _gx_ioloops.size()
+           << " IO threads");
+  return UvErr{};
+}
+
+
+UvErr GxServer::create_listen_socket(IoLoop& ioloop, bool reuse_port)
+{
   // create the GX server socket
-  auto sock = std::make_unique<TcpSocket>(_ioloop);
-  auto on_accept = [this](std::unique_ptr<TcpSocket>& sk, UvErr e) {
+  TcpSocket::options sockopts;
+  sockopts.reuse_port = reuse_port;
+  auto sock = std::make_unique<TcpSocket>(ioloop, sockopts);
+  auto on_accept = [this, &ioloop](std::unique_ptr<TcpSocket>& sk, UvErr e) {
     if (e) {
       THROW("accept() failed: " << e);
     }
@@ -309,8 +886,8 @@ UvErr GxServer::create_listen_socket() {
         [this](GxServerSession& s, GxSubscribeRequest& req) {
           on_subscribe(s, req);
         },
-        [this](GxServerSession& /*s*/, ExchangeId /*exchange*/) {
-          //on_subscribe_wallet(s, exchange);
+        [this](GxServerSession& s, ExchangeId exchange) {
+          on_subscribe_account(s, exchange);
         },
         [this](GxServerSession& s, GxServerSession::Request r, OrderParams p) {
           on_submit_order(s, r, p);
@@ -319,13 +896,33 @@ UvErr GxServer::create_listen_socket() {
                std::string sym, std::string oid, std::string eid) {
           this->on_cancel_order_request(s, r, exch, sym, oid, eid);
         },
+        [this](GxServerSession& s, GxServerSession::Request r,
+               std::string eid, OrderParams p) {
+          this->on_replace_order_request(s, r, std::move(eid), p);
+        },
+        [this](GxServerSession& s, GxServerSession::Request r,
+               std::vector<OrderParams> orders) {
+          this->on_submit_orders(s, r, orders);
+        },
+        [this](GxServerSession& s, GxServerSession::Request r, ExchangeId exch,
+               std::vector<CancelParams> orders, bool all_open) {
+          this->on_mass_cancel_request(s, r, exch, orders, all_open);
+        },
         [this](GxServerSession& s, GxLogonRequest request) -> bool {
           return this->on_logon_request(s, request.strategy_id,
                                         request.run_mode);
+        },
+        [this](GxServerSession& s, const gx::bin::McastRecover& msg) {
+          on_mcast_recover(s, msg);
         }
     };
-    auto client = std::make_shared<GxServerSession>(_ioloop, *event_loop(),
+    auto client = std::make_shared<GxServerSession>(ioloop, *event_loop(),
                                                     std::move(sk), handlers);
+    client->set_batching(_batching);
+    client->set_read_buffer(_read_buffer);
+    client->set_slow_consumer_options(_slow_consumer);
+    client->set_shm_options(_shm);
+    client->set_traffic_stats(_traffic_stats);
     event_loop()->dispatch([this, client]() { this->new_client(client); });
   };
   auto node = "0.0.0.0";
@@ -340,7 +937,7 @@ UvErr GxServer::create_listen_socket() {
     return uv_err;
   }
   else {
-    _server_sock = std::move(sock);
+    _server_socks.push_back(std::move(sock));
     LOG_INFO("listening for GX connections on " << node << ":" << _port);
     return UvErr{};
   }
@@ -355,42 +952,94 @@ void GxServer::new_client(std::shared_ptr<GxServerSession> session)
            << sock->get_peer_address().to_string() << ":"
            << sock->get_peer_port());
   _gx_sessions.push_back(session);
+  gx_sessions.add(1);
 
   session->start_read([&](GxServerSession& session, apex::UvErr err) {
     LOG_INFO("session closed, error: " << err);
-    // on socket err, just remove the session
+    // on socket err, just remove the session; its socket is closed first, so
+    // that the session can be released by any thread, including the IO
+    // thread, which may still hold it
+    session.close();
     for (auto iter = _gx_sessions.begin(); iter != _gx_sessions.end(); ++iter) {
       if (iter->get() == &session) {
         _gx_sessions.erase(iter);
+        gx_sessions.add(-1);
         break;
       }
     }
 
-    // note:  the session might appear several times in the strategy_id map
-    for (auto iter = _gx_session_map.begin(); iter != _gx_session_map.end();) {
-      if (iter->second.get() == &session) {
-        LOG_INFO("removing om-logon for strategyId: " << QUOTE(iter->first));
-        _gx_session_map.erase(iter++);
-      } else
-        ++iter;
+    // note:  the session might be logged on for several strategies
+    std::vector<uint64_t> logons;
+    _logons.for_each([&](uint64_t key, std::shared_ptr<GxServerSession>& sp) {
+      if (sp.get() == &session)
+        logons.push_back(key);
+    });
+    for (auto key : logons) {
+      LOG_INFO("removing om-logon for strategyId: " << QUOTE(strategy_of(key)));
+      _logons.erase(key);
     }
   });
 }
 
 
+void GxServer::log_send_stats()
+{
+  assert(event_loop()->this_thread_is_ev());
+
+  GxServerSession::SendStats total;
+  for (auto& session : _gx_sessions) {
+    auto stats = session->send_stats();
+    total.messages += stats.messages;
+    total.writes += stats.writes;
+  }
+
+  LOG_INFO("gx send stats: sessions " << _gx_sessions.size() << ", messages "
+           << total.messages << ", writes " << total.writes
+           << ", batching ratio " << total.batching_ratio());
+
+  for (auto& session : _gx_sessions) {
+    if (!session->traffic_stats_enabled())
+      continue;
+    auto* sock = session->get_socket();
+    for (auto& [type, stats] : session->traffic_stats()) {
+      LOG_INFO("gx traffic: session " << sock->get_peer_address().to_string()
+               << ":" << sock->get_peer_port() << ", type "
+               << gx::type_name(type) << ", in " << stats.in_messages
+               << " msgs " << stats.in_bytes << " bytes, handle "
+               << (stats.in_messages ? stats.in_nanos / stats.in_messages : 0)
+               << " ns/msg, out " << stats.out_messages << " msgs "
+               << stats.out_bytes << " bytes");
+    }
+  }
+
+  std::vector<IoLoop*> ioloops{&_ioloop};
+  for (auto& loop : _gx_ioloops)
+    ioloops.push_back(loop.get());
+
+  for (auto* ioloop : ioloops) {
+    auto buffers = ioloop->read_buffers().stats();
+    LOG_INFO("gx read buffers: in flight " << buffers.in_flight << ", peak "
+             << buffers.peak_in_flight << ", pooled " << buffers.capacity);
+
+    if (auto* ring = ioloop->uring()) {
+      auto uring = ring->stats();
+      LOG_INFO("gx io_uring: submits " << uring.submits << ", requests "
+               << uring.requests << ", completions " << uring.completions
+               << ", recv bytes " << uring.recv_bytes);
+    }
+  }
+}
+
+
 void GxServer::on_unsol_cancel(BaseExchangeSession& exchange,
                                std::string order_id, OrderUpdate msg)
 {
-  // TODO: handle order_id too short
-  std::string strategy_id = order_id.substr(0, strategy_id_size);
-
-  auto iter = _gx_session_map.find(strategy_id);
-  if (iter != std::end(_gx_session_map)) {
-    iter->second->send_order_unsol_cancel(exchange.exchange_id(), order_id, msg);
+  const uint64_t key = strategy_key(order_id);
+  if (auto* session = key ? _logons.find(key) : nullptr) {
+    (*session)->send_order_unsol_cancel(exchange.exchange_id(), order_id, msg);
   } else {
     LOG_WARN("no GX-session found for order-unsol-cancel, exchange:"
-             << exchange.exchange_id() << ", orderId:" << order_id
-             << ", strategyId:" << strategy_id);
+             << exchange.exchange_id() << ", orderId:" << order_id);
   }
 }
 
@@ -398,16 +1047,12 @@ void GxServer::on_unsol_cancel(BaseExchangeSession& exchange,
 void GxServer::on_fill(BaseExchangeSession& exchange, std::string order_id,
                        OrderFill fill)
 {
-  // TODO: handle order_id too short
-  std::string strategy_id = order_id.substr(0, strategy_id_size);
-
-  auto iter = _gx_session_map.find(strategy_id);
-  if (iter != std::end(_gx_session_map)) {
-    iter->second->send_order_fill(exchange.exchange_id(), order_id, fill);
+  const uint64_t key = strategy_key(order_id);
+  if (auto* session = key ? _logons.find(key) : nullptr) {
+    (*session)->send_order_fill(exchange.exchange_id(), order_id, fill);
   } else {
     LOG_WARN("no GX-session found for order-fill, exchange:"
-             << exchange.exchange_id() << ", orderId:" << order_id
-             << ", strategyId:" << strategy_id);
+             << exchange.exchange_id() << ", orderId:" << order_id);
   }
 }
 
@@ -434,19 +1079,92 @@ void GxServer::on_cancel_order_request(GxServerSession& session,
   }
 
 
-  // TODO: session should be a weak-pointer here?
-
-  // order callbacks
+  // order callbacks, invoked on the venue's event loop
+  auto sp = session.shared_from_this();
   BaseExchangeSession::SubmitOrderCallbacks callbacks;
-  callbacks.on_rejected = [&session, request](std::string code,
-                                              std::string error) {
-    session.send_error(request, code, error);
+  callbacks.on_rejected = [sp, request](std::string code, std::string error) {
+    sp->send_error(request, code, error);
   };
-  callbacks.on_reply = [&session, request](OrderUpdate update) {
-    session.send(request, update);
+  callbacks.on_reply = [sp, request](OrderUpdate update) {
+    sp->send(request, update);
   };
 
-  iter->second->cancel_order(symbol, order_id, ext_order_id, callbacks);
+  run_on_venue(*iter->second,
+               [exchange_session = iter->second, symbol = std::move(symbol),
+                order_id = std::move(order_id),
+                ext_order_id = std::move(ext_order_id),
+                callbacks = std::move(callbacks)]() {
+                 exchange_session->cancel_order(symbol, order_id, ext_order_id,
+                                                callbacks);
+               });
+}
+
+
+void GxServer::on_replace_order_request(GxServerSession& session,
+                                        GxServerSession::Request request,
+                                        std::string ext_order_id,
+                                        OrderParams& params)
+{
+  auto iter = _exchange_sessions.find(params.exchange);
+  if (iter == std::end(_exchange_sessions)) {
+    LOG_WARN("no exchange session for requested venue "
+             << QUOTE(params.exchange));
+    session.send_error(request, error::e0001, "exchange not found");
+    return;
+  }
+
+  // The exchange reports the cancel and the replacement separately, but the
+  // client receives a single reply: an error if the cancel failed, leaving
+  // the order as it was; else the replacement's ack, or, if the replacement
+  // was refused, the close of the order.
+  struct Outcome {
+    bool replied = false;
+    std::string cancel_ext_order_id;
+  };
+  auto outcome = std::make_shared<Outcome>();
+  auto sp = session.shared_from_this();
+
+  BaseExchangeSession::SubmitOrderCallbacks cancel_callbacks;
+  cancel_callbacks.on_rejected = [sp, request, outcome](std::string code,
+                                                        std::string error) {
+    outcome->replied = true;
+    sp->send_error(request, code, error);
+  };
+  cancel_callbacks.on_reply = [outcome](OrderUpdate update) {
+    outcome->cancel_ext_order_id = update.ext_order_id;
+  };
+
+  BaseExchangeSession::SubmitOrderCallbacks new_callbacks;
+  new_callbacks.on_rejected = [sp, request, outcome,
+                               order_id = params.order_id](std::string code,
+                                                           std::string error) {
+    if (std::exchange(outcome->replied, true))
+      return;
+    LOG_WARN("order " << order_id << " cancelled, but its replacement "
+             << "rejected, code: " << code << ", text: " << error);
+    OrderUpdate update;
+    update.state = OrderState::closed;
+    update.close_reason = OrderCloseReason::cancelled;
+    update.ext_order_id = outcome->cancel_ext_order_id;
+    sp->send(request, update);
+  };
+  new_callbacks.on_reply = [sp, request, outcome](OrderUpdate update) {
+    if (std::exchange(outcome->replied, true))
+      return;
+    sp->send(request, update);
+  };
+
+  run_on_venue(*iter->second,
+               [exchange_session = iter->second, params,
+                ext_order_id = std::move(ext_order_id),
+                cancel_callbacks = std::move(cancel_callbacks),
+                new_callbacks = std::move(new_callbacks)]() mutable {
+                 exchange_session->replace_order(
+                     params.symbol.str(), params.order_id.str(),
+                     std::move(ext_order_id),
+                     params, std::move(cancel_callbacks),
+                     std::move(new_callbacks));
+               });
 }
 
 
@@ -468,55 +1186,73 @@ void GxServer::on_subscribe(GxServerSession& session,
     auto exchange_session = _exchange_sessions[ExchangeId::binance];
     std::shared_ptr<ExchangeSubscription> sub =
       std::make_shared<ExchangeSubscription>(exchange_session, key);
+    if (_mcast_sock) {
+      auto channel = static_cast<uint32_t>(_mcast_channels.size() + 1);
+      sub->enable_multicast(_mcast_sock.get(), _mcast_options, channel,
+                            _mcast_retain);
+      _mcast_channels.insert({channel, sub});
+    }
     auto ins = _exchange_subscriptions.insert({key, sub});
-    sub->activate();
+    run_on_venue(*exchange_session,
+                 [sub, with_book = _depth_exchanges.count(key.exchange_id) > 0]() {
+                   sub->activate(with_book);
+                 });
     iter = ins.first;
   }
 
-  iter->second->subscribe(session);
+  // subscribers are tracked on the venue's event loop, where ticks arrive
+  auto& sub = iter->second;
+  run_on_venue(sub->exchange_session(),
+               [sub, sp = session.shared_from_this(), req]() {
+                 sub->subscribe(*sp, req);
+               });
 }
 
 
-// // TODO: rename this method to refer to account
-// void GxServer::on_subscribe_wallet(GxServerSession& session,
-//                                    std::string exchange)
-// {
-//   assert(event_loop()->this_thread_is_ev());
-
-//   auto exchange_iter = _exchange_sessions.find(exchange);
-//   if (exchange_iter == std::end(_exchange_sessions)) {
-//     LOG_WARN("ignoring subscription request for unsupported exchange '"
-//              << exchange << "'");
-//     // TODO: here we need to reply to the client to indicate the subscription
-//     // has failed.
-//     return;
-//   }
-
-//   ExchangeId2 eid{exchange};
-
-//   auto iter = _wallets.find(eid);
-//   if (iter == std::end(_wallets)) {
-
-//     auto up = std::make_unique<AccountTopic>();
-//     iter = _wallets.insert({eid, std::move(up)}).first;
-//     // TODO: resolve the exchange name to BinanceSession, or other session etc.
-//     // TODO: check the session actually exists
-//     iter->second->start_exchange_subscription(exchange_iter->second);
-//   }
-
-//   iter->second->add_subscriber(session.shared_from_this());
+void GxServer::on_mcast_recover(GxServerSession& session,
+                                const gx::bin::McastRecover& msg)
+{
+  assert(event_loop()->this_thread_is_ev());
 
-//   // TODO: need to send the initial snapshot
+  auto iter = _mcast_channels.find(msg.channel);
+  if (iter == std::end(_mcast_channels)) {
+    LOG_WARN("ignoring recovery request for unknown multicast channel "
+             << msg.channel);
+    return;
+  }
+  auto& sub = iter->second;
+  run_on_venue(sub->exchange_session(),
+               [sub, sp = session.shared_from_this(), from_seq = msg.from_seq,
+                to_seq = msg.to_seq]() { sub->recover(*sp, from_seq, to_seq); });
+}
 
-//   // TODO/NEXT:  continue here.  This should trigger the creation of the Account
-//   // model, it's setup, and then add the GxServerSession as a subscriber.
 
-//   // TODO: create the account model
+void GxServer::on_subscribe_account(GxServerSession& session,
+                                    ExchangeId exchange)
+{
+  assert(event_loop()->this_thread_is_ev());
 
-//   // TODO: request all sessions start the stream, which menas snapshot & updates
+  auto iter = _wallets.find(exchange);
+  if (iter == std::end(_wallets)) {
+    auto session_iter = _exchange_sessions.find(exchange);
+    if (session_iter == std::end(_exchange_sessions)) {
+      LOG_WARN("ignoring account subscription for unsupported exchange "
+               << QUOTE(exchange));
+      return;
+    }
+    auto topic = std::make_shared<AccountTopic>(session_iter->second);
+    iter = _wallets.insert({exchange, topic}).first;
+    run_on_venue(topic->exchange_session(),
+                 [topic]() { topic->start_exchange_subscription(); });
+  }
 
-//   //
-// }
+  // subscribers are tracked on the venue's event loop, where updates arrive
+  auto& topic = iter->second;
+  run_on_venue(topic->exchange_session(),
+               [topic, sp = session.shared_from_this()]() {
+                 topic->subscribe(*sp);
+               });
+}
 
 
 void GxServer::on_submit_order(GxServerSession& session,
@@ -530,20 +1266,144 @@ void GxServer::on_submit_order(GxServerSession& session,
     session.send_error(req, error::e0001, "exchange not found");
     return;
   }
+  gx_order_requests.add();
 
-  // TODO: session should be a weak-pointer here?
-
-  // order callbacks
+  // order callbacks, invoked on the venue's event loop
+  auto sp = session.shared_from_this();
   BaseExchangeSession::SubmitOrderCallbacks callbacks;
-  callbacks.on_rejected = [&session, req](std::string code, std::string error) {
+  callbacks.on_rejected = [sp, req](std::string code, std::string error) {
     LOG_INFO("ERROR : " << code << "," << error);
-    session.send_error(req, code, error);
+    sp->send_error(req, code, error);
   };
-  callbacks.on_reply = [&session, req](OrderUpdate update) {
-    session.send(req, update);
+  callbacks.on_reply = [sp, req](OrderUpdate update) {
+    sp->send(req, update);
   };
 
-  iter->second->submit_order(params, callbacks);
+  run_on_venue(*iter->second,
+               [exchange_session = iter->second, params,
+                callbacks = std::move(callbacks)]() {
+                 exchange_session->submit_order(params, callbacks);
+               });
+}
+
+
+void GxServer::on_submit_orders(GxServerSession& session,
+                                GxServerSession::Request req,
+                                std::vector<OrderParams>& orders)
+{
+  // Binance spot has no batch order entry, so each order is its own exchange
+  // request; these are all issued now, to run concurrently over the order
+  // entry websocket or the REST connection pool.
+  auto sp = session.shared_from_this();
+  for (auto& params : orders) {
+    auto iter = _exchange_sessions.find(params.exchange);
+    if (iter == std::end(_exchange_sessions)) {
+      LOG_WARN("no exchange session for requested venue "
+               << QUOTE(params.exchange));
+      session.send_error(req, error::e0001, "exchange not found",
+                         params.order_id.str());
+      continue;
+    }
+    gx_order_requests.add();
+
+    BaseExchangeSession::SubmitOrderCallbacks callbacks;
+    callbacks.on_rejected = [sp, req, order_id = params.order_id.str()](
+                                std::string code, std::string error) {
+      sp->send_error(req, code, error, order_id);
+    };
+    callbacks.on_reply = [sp, req, order_id = params.order_id.str()](
+                             OrderUpdate update) {
+      sp->send(req, update, order_id);
+    };
+
+    run_on_venue(*iter->second,
+                 [exchange_session = iter->second, params,
+                  callbacks = std::move(callbacks)]() {
+                   exchange_session->submit_order(params, callbacks);
+                 });
+  }
+}
+
+
+void GxServer::on_mass_cancel_request(GxServerSession& session,
+                                      GxServerSession::Request req,
+                                      ExchangeId exchange,
+                                      std::vector<CancelParams>& orders,
+                                      bool all_open)
+{
+  auto iter = _exchange_sessions.find(exchange);
+  if (iter == std::end(_exchange_sessions)) {
+    LOG_WARN("no exchange session for requested venue " << QUOTE(exchange));
+    session.send_error(req, error::e0001, "exchange not found");
+    return;
+  }
+  auto exchange_session = iter->second;
+  auto sp = session.shared_from_this();
+
+  if (!all_open) {
+    for (auto& order : orders) {
+      BaseExchangeSession::SubmitOrderCallbacks callbacks;
+      callbacks.on_rejected = [sp, req, order_id = order.order_id.str()](
+                                  std::string code, std::string error) {
+        sp->send_error(req, code, error, order_id);
+      };
+      callbacks.on_reply = [sp, req, order_id = order.order_id.str()](
+                               OrderUpdate update) {
+        sp->send(req, update, order_id);
+      };
+      run_on_venue(*exchange_session,
+                   [exchange_session, order,
+                    callbacks = std::move(callbacks)]() {
+                     exchange_session->cancel_order(order.symbol.str(),
+                                                    order.order_id.str(),
+                                                    order.ext_order_id.str(),
+                                                    callbacks);
+                   });
+    }
+    return;
+  }
+
+  // One cancel-all per symbol.  Listed orders are replied to individually;
+  // those absent from the outcome were no longer open.  Other orders
+  // cancelled, e.g. of other strategies, are reported to their strategy as
+  // unsolicited cancels.
+  std::map<std::string, std::vector<std::string>> by_symbol;
+  for (auto& order : orders)
+    by_symbol[order.symbol.str()].push_back(order.order_id.str());
+
+  for (auto& [symbol, listed] : by_symbol) {
+    BaseExchangeSession::CancelAllCallbacks callbacks;
+    callbacks.on_rejected = [sp, req, listed = listed](std::string code,
+                                                       std::string error) {
+      for (auto& order_id : listed)
+        sp->send_error(req, code, error, order_id);
+    };
+    callbacks.on_reply =
+        [this, sp, req, exchange = exchange_session.get(), listed = listed](
+            std::vector<std::pair<std::string, OrderUpdate>> cancelled) {
+          std::set<std::string> pending(listed.begin(), listed.end());
+          for (auto& [order_id, update] : cancelled) {
+            if (pending.erase(order_id))
+              sp->send(req, update, order_id);
+            else
+              run_on_server([this, exchange, order_id = order_id,
+                             update = update]() {
+                on_unsol_cancel(*exchange, order_id, update);
+              });
+          }
+          for (auto& order_id : pending)
+            sp->send_error(req, error::e0103, "order not open", order_id);
+        };
+
+    run_on_venue(*exchange_session, [exchange_session, symbol = symbol,
+                                     callbacks = std::move(callbacks)]() {
+      try {
+        exchange_session->cancel_all_orders(symbol, callbacks);
+      } catch (std::runtime_error& e) {
+        callbacks.on_rejected(error::e0103, e.what());
+      }
+    });
+  }
 }
 
 } // namespace apex
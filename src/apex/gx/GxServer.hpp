@@ -19,14 +19,22 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/gx/ExchangeSession.hpp>
 #include <apex/gx/BinanceSession.hpp>
+#include <apex/gx/PaperExchange.hpp>
 
 #include <apex/model/MarketData.hpp>
 #include <apex/comm/GxServerSession.hpp>
 #include <apex/infra/IoLoop.hpp>
+#include <apex/infra/UdpSocket.hpp>
 #include <apex/infra/ssl.hpp>
+#include <apex/util/OpenAddressMap.hpp>
 
+#include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <utility>
+#include <vector>
 
 namespace apex {
 
@@ -42,7 +50,8 @@ struct ExchangeSubscriptionKey {
 };
 
 /* Represent a single stream subscription on an exchange a set of associated
- * targets that shall receive updates. */
+ * targets that shall receive updates.  Other than construction, its methods
+ * are called on the event loop of the exchange session. */
 class ExchangeSubscription
   : public std::enable_shared_from_this<ExchangeSubscription>
 {
@@ -56,55 +65,90 @@ public:
     std::shared_ptr<apex::BaseExchangeSession> exchange_session,
     ExchangeSubscriptionKey sym);
 
-  void activate();
-  void subscribe(GxServerSession& session);
+  // if with_book is set, an incremental depth feed also maintains the
+  // local book
+  void activate(bool with_book = false);
+  /* Add a subscriber, and send it the last known top and trade, so that a
+   * late joiner need not wait for the next exchange tick.  A subscriber is
+   * sent only the streams it requested; a repeated request, of the same
+   * session and subscription id, replaces those streams. */
+  void subscribe(GxServerSession& session, const GxSubscribeRequest& req);
 
-private:
-  std::shared_ptr<apex::BaseExchangeSession> _exchange_session;
-  ExchangeSubscriptionKey _symbol;
-  std::vector<std::shared_ptr<GxServerSession>> _subscribers;
-  MarketData _market;
-};
+  /* Publish ticks on a multicast channel, in addition to the GX sessions;
+   * subscribers able to receive multicast are then not sent ticks via their
+   * session.  The most recent `retain` trades are kept for gap recovery. */
+  void enable_multicast(UdpSocket* sock, UdpSocket::MulticastOptions options,
+                        uint32_t channel, size_t retain);
 
+  /* Resend, via the session, the retained trades within a range of multicast
+   * sequence numbers.  Tops are not resent, since the next update replaces
+   * any that were lost. */
+  void recover(GxServerSession& session, uint64_t from_seq, uint64_t to_seq);
 
-struct ExchangeId2 {
-  std::string name;
+  BaseExchangeSession& exchange_session() { return *_exchange_session; }
 
-  explicit ExchangeId2(std::string exchange_name)
-    : name(std::move(exchange_name))
-  {
-  }
+private:
+  template <typename T> void broadcast(const T& tick);
+  void publish(const std::shared_ptr<const gx::Frame>& frame, bool retain);
 
-  bool operator<(const ExchangeId2& other) const
-  {
-    return this->name < other.name;
-  }
-};
+  struct Subscriber {
+    std::shared_ptr<GxServerSession> session;
+    gx::t_msgid subscription_id;
+    bool binary;
+    bool multicast;
+    int streams; // MdStream mask
 
+    template <typename T> bool wants() const;
+  };
 
-class Topic
-{
-public:
-  void add_subscriber(std::shared_ptr<GxServerSession> sp)
-  {
-    _subscribers.push_back(std::move(sp));
-  }
+  // send the snapshot of those `streams` of the subscriber
+  void send_snapshot(const Subscriber&, int streams);
 
-  std::vector<std::shared_ptr<GxServerSession>> _subscribers;
+  std::shared_ptr<apex::BaseExchangeSession> _exchange_session;
+  ExchangeSubscriptionKey _symbol;
+  std::vector<Subscriber> _subscribers;
+  MarketData _market;
+
+  // binary tick frames, reused once no longer queued
+  gx::FramePool _frames;
+
+  // multicast publishing
+  UdpSocket* _mcast_sock = nullptr;
+  UdpSocket::MulticastOptions _mcast_options;
+  uint32_t _mcast_channel = 0;
+  size_t _mcast_retain = 0;
+  std::vector<char> _mcast_packet;
+  std::mutex _mcast_lock;
+  uint64_t _mcast_seq = 1; // next sequence number
+  std::deque<std::pair<uint64_t, std::shared_ptr<const gx::Frame>>>
+      _mcast_history;
 };
 
 
-class AccountTopic : public Topic
+/* Balances of an exchange account, kept from the account updates of its
+ * exchange session, which carry only the assets changed.  A subscriber is
+ * sent the balances held when it subscribes, and from then only the changes.
+ * Runs on the venue's event loop, on which the session reports updates. */
+class AccountTopic : public std::enable_shared_from_this<AccountTopic>
 {
 public:
-  void start_exchange_subscription(
-    std::shared_ptr<apex::BaseExchangeSession> session);
+  explicit AccountTopic(std::shared_ptr<BaseExchangeSession> session);
+
+  void start_exchange_subscription();
 
-  Account& model() { return _model; }
+  void subscribe(GxServerSession&);
+
+  const BaseExchangeSession& exchange_session() const
+  {
+    return *_exchange_session;
+  }
 
 private:
+  void on_update(const std::vector<AccountUpdate>&);
+
   Account _model;
-  std::shared_ptr<apex::BaseExchangeSession> _exchange_session;
+  std::shared_ptr<BaseExchangeSession> _exchange_session;
+  std::vector<std::shared_ptr<GxServerSession>> _subscribers;
 };
 
 
@@ -124,6 +168,16 @@ public:
 
   void add_venue(BinanceSession::Params);
 
+  /* Constructs an exchange session, given the callbacks by which it reports
+   * order events, and the loops it is to run on. */
+  using SessionFactory = std::function<std::shared_ptr<BaseExchangeSession>(
+      BaseExchangeSession::EventCallbacks, IoLoop*, RealtimeEventLoop&)>;
+
+  /* Add a venue served by a session of any type, such as a synthetic
+   * exchange used for testing; the session is started, and then serves the
+   * exchange id it reports. */
+  void add_venue(const SessionFactory&);
+
   int get_listen_port() const { return _port; }
 
 private:
@@ -134,22 +188,63 @@ private:
 
   void on_subscribe(GxServerSession&, GxSubscribeRequest&);
 
+  void on_mcast_recover(GxServerSession&, const gx::bin::McastRecover&);
+
   void on_cancel_order_request(GxServerSession&, GxServerSession::Request,
                                ExchangeId exchange, std::string symbol,
                                std::string order_id, std::string ext_ord);
 
+  void on_replace_order_request(GxServerSession&, GxServerSession::Request,
+                                std::string ext_order_id, OrderParams&);
+
+  void on_submit_orders(GxServerSession&, GxServerSession::Request,
+                        std::vector<OrderParams>&);
+
+  void on_mass_cancel_request(GxServerSession&, GxServerSession::Request,
+                              ExchangeId exchange, std::vector<CancelParams>&,
+                              bool all_open);
+
   bool on_logon_request(GxServerSession&, std::string, RunMode);
 
+  BaseExchangeSession::EventCallbacks session_callbacks();
+
+  // In paper mode, a venue session is wrapped by a PaperExchange, which
+  // matches the orders of all engines against the venue's market data;
+  // configured by "paper_exchange", with the fields of "sim_exchange".
+  std::shared_ptr<BaseExchangeSession>
+  with_paper_exchange(std::shared_ptr<BaseExchangeSession>, IoLoop*,
+                      RealtimeEventLoop&);
+
   void on_fill(BaseExchangeSession&, std::string order_id, OrderFill);
   void on_unsol_cancel(BaseExchangeSession&, std::string order_id, OrderUpdate);
 
-  UvErr create_listen_socket();
+  UvErr create_listen_sockets();
+  UvErr create_listen_socket(IoLoop&, bool reuse_port);
 
   RealtimeEventLoop* event_loop();
 
+  void start_gx_io_loops();
+
+  // the loops on which a new exchange session is to run
+  std::pair<IoLoop*, RealtimeEventLoop*> new_venue_loops();
+
+  // Invoke a function on the event loop of an exchange session, or of the
+  // server; directly, if already on that loop.
+  void run_on_venue(const BaseExchangeSession&, std::function<void()>);
+  void run_on_server(std::function<void()>);
+
+  void log_send_stats();
+
   RunMode _run_mode;
   Config _config;
 
+  // output batching applied to each new GX-session
+  GxServerSession::BatchOptions _batching;
+  GxServerSession::SlowConsumerOptions _slow_consumer;
+  GxServerSession::ShmOptions _shm;
+  DecodeBufferPolicy _read_buffer;
+  bool _traffic_stats = false; // per message type accounting of sessions
+
 
   std::unique_ptr<apex::RealtimeEventLoop> _own_event_loop;
   apex::RealtimeEventLoop* _external_event_loop;
@@ -157,10 +252,39 @@ private:
   apex::IoLoop _ioloop;
   std::unique_ptr<apex::SslContext> _ssl;
 
+  // By default every exchange session runs on the server's IO and event
+  // loops.  With "venue_threads" each has a dedicated pair instead, so that
+  // a burst of market data on one venue does not delay the order traffic of
+  // another; requests and replies cross between the server's event loop and
+  // the venue's via their dispatch queues, lock-free unless configured
+  // otherwise.
+  struct VenueLoops {
+    std::unique_ptr<IoLoop> io;
+    std::unique_ptr<RealtimeEventLoop> ev;
+  };
+  bool _venue_threads = false;
+  std::vector<std::unique_ptr<VenueLoops>> _venue_loops;
+  std::map<ExchangeId, RealtimeEventLoop*> _venue_event_loops;
+
+  // IO loops serving GX sessions, if "gx_io_threads" exceeds one; each has a
+  // listen socket on the GX port, and the kernel spreads connections across
+  // them.  Otherwise GX sessions use the server's IO loop.
+  std::vector<std::unique_ptr<IoLoop>> _gx_ioloops;
+
+  // optional multicast distribution of ticks, one channel per subscription
+  bool _mcast_enabled = false;
+  UdpSocket::MulticastOptions _mcast_options;
+  size_t _mcast_retain = 0;
+  std::unique_ptr<UdpSocket> _mcast_sock;
+  std::map<uint32_t, std::shared_ptr<ExchangeSubscription>> _mcast_channels;
+
   // exchange connections
   std::map<ExchangeId, std::shared_ptr<apex::BaseExchangeSession>>
   _exchange_sessions;
 
+  // exchanges configured to maintain a full local book per subscription
+  std::set<ExchangeId> _depth_exchanges;
+
   // exchange subscriptions
   std::map<ExchangeSubscriptionKey, std::shared_ptr<ExchangeSubscription>>
   _exchange_subscriptions;
@@ -168,20 +292,24 @@ private:
   // for embedded mode, convenient to allow listen port discovery
   bool _try_other_ports = false;
 
-  // port & socket for accepting new GX-sessions
+  // port & sockets for accepting new GX-sessions, one per GX IO loop
   int _port;
-  std::unique_ptr<TcpSocket> _server_sock;
+  std::vector<std::unique_ptr<TcpSocket>> _server_socks;
 
   // GX-sessions
   std::vector<std::shared_ptr<GxServerSession>> _gx_sessions;
 
-  //void on_subscribe_wallet(GxServerSession& session, std::string);
+  void on_subscribe_account(GxServerSession&, ExchangeId);
 
-  std::map<ExchangeId2, std::unique_ptr<AccountTopic>> _wallets;
+  // account balances, per exchange, for subscribed sessions
+  std::map<ExchangeId, std::shared_ptr<AccountTopic>> _wallets;
   void on_submit_order(GxServerSession&, GxServerSession::Request,
                        OrderParams&);
 
-  std::map<std::string, std::shared_ptr<GxServerSession>> _gx_session_map;
+  // om-logon sessions, keyed by strategy id packed into an integer; every
+  // order id begins with its strategy id, so an execution is routed to its
+  // session by a single probe, without a copy or compare of strings
+  OpenAddressMap<std::shared_ptr<GxServerSession>> _logons;
 };
 
 
@@ -0,0 +1,326 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/gx/PaperExchange.hpp>
+#include <apex/core/Errors.hpp>
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
+
+#include <cstdlib>
+
+namespace apex
+{
+
+PaperExchange::Market::Market(PaperExchange& owner,
+                              const SimFillModel& fill_model,
+                              SimCrossFill cross_fill)
+  : owner(owner),
+    book(market, fill_model, cross_fill, *this)
+{
+}
+
+
+void PaperExchange::Market::on_sim_fill(SimRestingOrder& resting, double price,
+                                        double size, bool fully_filled)
+{
+  auto& order = static_cast<PaperOrder&>(resting);
+  OrderFill fill;
+  fill.is_fully_filled = fully_filled;
+  fill.recv_time = Time::realtime_now();
+  fill.price = price;
+  fill.size = size;
+  if (owner._callbacks.on_order_fill)
+    owner._callbacks.on_order_fill(owner, order.order_id, fill);
+}
+
+
+PaperExchange::PaperExchange(EventCallbacks callbacks,
+                             std::shared_ptr<BaseExchangeSession> venue,
+                             IoLoop* ioloop, RealtimeEventLoop& event_loop,
+                             Options options)
+  : ExchangeSession(std::move(callbacks), venue->exchange_id(),
+                    RunMode::paper, ioloop, event_loop, nullptr),
+    _venue(std::move(venue)),
+    _fill_model(make_sim_fill_model(options.fill_model)),
+    _cross_fill(options.cross_fill)
+{
+}
+
+
+void PaperExchange::start()
+{
+  LOG_INFO("paper exchange started for " << exchange_id());
+  _venue->start();
+}
+
+
+void PaperExchange::subscribe_account(
+    std::function<void(std::vector<AccountUpdate>)> callback)
+{
+  _venue->subscribe_account(std::move(callback));
+}
+
+
+PaperExchange::Market& PaperExchange::market(const std::string& symbol)
+{
+  auto iter = _markets.find(symbol);
+  if (iter == _markets.end())
+    iter = _markets
+               .emplace(symbol, std::make_unique<Market>(*this, *_fill_model,
+                                                         _cross_fill))
+               .first;
+  return *iter->second;
+}
+
+
+PaperExchange::Market* PaperExchange::find_market(const std::string& symbol)
+{
+  auto iter = _markets.find(symbol);
+  return iter == _markets.end() ? nullptr : iter->second.get();
+}
+
+
+size_t PaperExchange::open_orders(const std::string& symbol) const
+{
+  auto iter = _markets.find(str_toupper(symbol));
+  return iter == _markets.end() ? 0 : iter->second->book.size();
+}
+
+
+/* The venue's ticks, which arrive on the event thread, update the market of
+ * the symbol, and are matched against its paper orders, before being passed
+ * on.  The market is found on the first tick, rather than on subscription,
+ * which may be made from another thread. */
+
+void PaperExchange::subscribe_trades(
+    Symbol symbol, subscription_options options,
+    std::function<void(const TickTrade&)> callback)
+{
+  auto key = str_toupper(symbol.native);
+  _venue->subscribe_trades(
+      symbol, options,
+      [wp = weak_from_this(), key, callback,
+       mkt = static_cast<Market*>(nullptr)](const TickTrade& tick) mutable {
+        auto sp = wp.lock();
+        if (!sp)
+          return;
+        if (!mkt)
+          mkt = &sp->market(key);
+        mkt->market.apply(tick);
+        mkt->book.apply_trade(tick.price, tick.qty);
+        callback(tick);
+      });
+}
+
+
+void PaperExchange::subscribe_top(Symbol symbol, subscription_options options,
+                                  std::function<void(const TickTop&)> callback)
+{
+  auto key = str_toupper(symbol.native);
+  _venue->subscribe_top(
+      symbol, options,
+      [wp = weak_from_this(), key, callback,
+       mkt = static_cast<Market*>(nullptr)](const TickTop& tick) mutable {
+        auto sp = wp.lock();
+        if (!sp)
+          return;
+        if (!mkt)
+          mkt = &sp->market(key);
+        mkt->market.apply(tick);
+        if (!mkt->book.empty())
+          mkt->book.apply_book_change();
+        callback(tick);
+      });
+}
+
+
+void PaperExchange::subscribe_book(
+    Symbol symbol, subscription_options options,
+    std::function<void(const TickBookDelta&)> callback)
+{
+  auto key = str_toupper(symbol.native);
+  _venue->subscribe_book(
+      symbol, options,
+      [wp = weak_from_this(), key, callback,
+       mkt = static_cast<Market*>(nullptr)](const TickBookDelta& delta) mutable {
+        auto sp = wp.lock();
+        if (!sp)
+          return;
+        if (!mkt)
+          mkt = &sp->market(key);
+        mkt->market.apply(delta);
+        if (!mkt->book.empty())
+          mkt->book.apply_book_change();
+        callback(delta);
+      });
+}
+
+
+void PaperExchange::submit_order(OrderParams params,
+                                 SubmitOrderCallbacks callbacks)
+{
+  if (!is_event_thread()) {
+    run_on_evloop([params, callbacks](PaperExchange* self) {
+      self->submit_order(params, callbacks);
+    });
+    return;
+  }
+
+  auto* mkt = find_market(str_toupper(params.symbol.str()));
+  if (!mkt || !mkt->market.has_bid_ask()) {
+    callbacks.on_rejected(error::e0102, "no market data for symbol");
+    return;
+  }
+  const bool is_buy = params.side == Side::buy;
+  if ((!is_buy && params.side != Side::sell) || !(params.size > 0.0) ||
+      (params.order_type == OrderType::limit && !(params.price > 0.0))) {
+    callbacks.on_rejected(error::e0102, "invalid order");
+    return;
+  }
+
+  // a market order takes the opposite touch, and what it does not fill there
+  // is not left resting
+  double price = params.price;
+  auto tif = params.time_in_force;
+  if (params.order_type == OrderType::market) {
+    price = is_buy ? mkt->market.ask() : mkt->market.bid();
+    tif = TimeInForce::ioc;
+  }
+
+  const uint64_t id = _next_id++;
+  OrderUpdate update;
+  update.ext_order_id = std::to_string(id);
+
+  // fill-or-kill, unless all of the order can fill against the market now
+  if (tif == TimeInForce::fok && _cross_fill != SimCrossFill::full &&
+      mkt->book.opposite_qty(params.side, price) < params.size) {
+    update.state = OrderState::closed;
+    update.close_reason = OrderCloseReason::lapsed;
+    callbacks.on_reply(update);
+    return;
+  }
+
+  mkt->book.rest(make_pooled<PaperOrder>(mkt->book.order_pool(), id,
+                                         params.side, params.size, price,
+                                         params.order_id.str()));
+  update.state = OrderState::live;
+  callbacks.on_reply(update);
+
+  // an order marketable on arrival fills now, after its ack; the rest of an
+  // immediate-or-cancel order then expires
+  mkt->book.match_crosses();
+  if (tif == TimeInForce::ioc || tif == TimeInForce::fok) {
+    if (auto* order = mkt->book.find(id)) {
+      mkt->book.erase(*order);
+      update.state = OrderState::closed;
+      update.close_reason = OrderCloseReason::lapsed;
+      if (_callbacks.on_order_cancel)
+        _callbacks.on_order_cancel(*this, params.order_id.str(), update);
+    }
+  }
+}
+
+
+bool PaperExchange::cancel(Market* mkt, const std::string& order_id,
+                           const std::string& ext_order_id,
+                           const SubmitOrderCallbacks& callbacks)
+{
+  const uint64_t id = std::strtoull(ext_order_id.c_str(), nullptr, 10);
+  auto* order = mkt && id ? static_cast<PaperOrder*>(mkt->book.find(id))
+                          : nullptr;
+  if (!order || order->order_id != order_id) {
+    callbacks.on_rejected(error::e0103, "order not found");
+    return false;
+  }
+  mkt->book.erase(*order);
+
+  OrderUpdate update;
+  update.state = OrderState::closed;
+  update.close_reason = OrderCloseReason::cancelled;
+  update.ext_order_id = ext_order_id;
+  callbacks.on_reply(update);
+  return true;
+}
+
+
+void PaperExchange::cancel_order(std::string symbol, std::string order_id,
+                                 std::string ext_order_id,
+                                 SubmitOrderCallbacks callbacks)
+{
+  if (!is_event_thread()) {
+    run_on_evloop([=](PaperExchange* self) {
+      self->cancel_order(symbol, order_id, ext_order_id, callbacks);
+    });
+    return;
+  }
+  cancel(find_market(str_toupper(symbol)), order_id, ext_order_id, callbacks);
+}
+
+
+void PaperExchange::replace_order(std::string symbol, std::string order_id,
+                                  std::string ext_order_id, OrderParams params,
+                                  SubmitOrderCallbacks cancel_callbacks,
+                                  SubmitOrderCallbacks new_callbacks)
+{
+  if (!is_event_thread()) {
+    run_on_evloop([=](PaperExchange* self) {
+      self->replace_order(symbol, order_id, ext_order_id, params,
+                          cancel_callbacks, new_callbacks);
+    });
+    return;
+  }
+  if (cancel(find_market(str_toupper(symbol)), order_id, ext_order_id,
+             cancel_callbacks))
+    submit_order(params, new_callbacks);
+  else
+    new_callbacks.on_rejected(error::e0102, "new order not attempted");
+}
+
+
+void PaperExchange::cancel_all_orders(std::string symbol,
+                                      CancelAllCallbacks callbacks)
+{
+  if (!is_event_thread()) {
+    run_on_evloop([=](PaperExchange* self) {
+      self->cancel_all_orders(symbol, callbacks);
+    });
+    return;
+  }
+
+  // as on the venue, where the engines share an account, this cancels the
+  // orders of every engine
+  std::vector<std::pair<std::string, OrderUpdate>> cancelled;
+  if (auto* mkt = find_market(str_toupper(symbol))) {
+    std::vector<SimRestingOrder*> orders;
+    mkt->book.for_each_order([&](SimRestingOrder& order) {
+      orders.push_back(&order);
+    });
+    for (auto* order : orders) {
+      OrderUpdate update;
+      update.state = OrderState::closed;
+      update.close_reason = OrderCloseReason::cancelled;
+      update.ext_order_id = std::to_string(order->id());
+      cancelled.emplace_back(static_cast<PaperOrder*>(order)->order_id,
+                             update);
+      mkt->book.erase(*order);
+    }
+  }
+  callbacks.on_reply(std::move(cancelled));
+}
+
+} // namespace apex
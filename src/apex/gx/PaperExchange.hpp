@@ -0,0 +1,121 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/backtest/SimMatchingBook.hpp>
+#include <apex/gx/ExchangeSession.hpp>
+#include <apex/model/MarketData.hpp>
+
+#include <map>
+#include <memory>
+#include <string>
+
+namespace apex
+{
+
+/* Paper-trading exchange of the gateway, standing in for the order entry of
+ * a venue session while passing through its market data.  Every engine
+ * trading the venue via the gateway sends its orders to the one instance, so
+ * that all paper orders rest in, and fill from, shared books.
+ *
+ * Each symbol has a MarketData, kept from the venue's ticks as they are
+ * forwarded to the gateway's ExchangeSubscription, and a SimMatchingBook
+ * matching the paper orders against it, with the fill model and cross fill
+ * policy of the backtest.  Orders can only be placed on symbols with market
+ * data.  Everything runs on the venue's event loop, to which the gateway
+ * hands requests from the GX sessions; replies, fills and cancels are
+ * reported as the venue session would.  Order ids assigned by the exchange
+ * are decimal integers. */
+class PaperExchange : public ExchangeSession<PaperExchange>
+{
+public:
+  struct Options {
+    std::string fill_model = "queue";
+    SimCrossFill cross_fill = SimCrossFill::visible;
+  };
+
+  PaperExchange(EventCallbacks, std::shared_ptr<BaseExchangeSession> venue,
+                IoLoop*, RealtimeEventLoop&, Options);
+  PaperExchange(EventCallbacks callbacks,
+                std::shared_ptr<BaseExchangeSession> venue, IoLoop* ioloop,
+                RealtimeEventLoop& event_loop)
+    : PaperExchange(std::move(callbacks), std::move(venue), ioloop, event_loop,
+                    Options{})
+  {
+  }
+
+  void start() override;
+
+  void subscribe_account(
+      std::function<void(std::vector<AccountUpdate>)> callback) override;
+  void subscribe_trades(Symbol, subscription_options,
+                        std::function<void(const TickTrade&)>) override;
+  void subscribe_top(Symbol, subscription_options,
+                     std::function<void(const TickTop&)>) override;
+  void subscribe_book(Symbol, subscription_options,
+                      std::function<void(const TickBookDelta&)>) override;
+
+  void submit_order(OrderParams, SubmitOrderCallbacks) override;
+  void cancel_order(std::string symbol, std::string order_id,
+                    std::string ext_order_id, SubmitOrderCallbacks) override;
+  void replace_order(std::string symbol, std::string order_id,
+                     std::string ext_order_id, OrderParams,
+                     SubmitOrderCallbacks cancel_callbacks,
+                     SubmitOrderCallbacks new_callbacks) override;
+  void cancel_all_orders(std::string symbol, CancelAllCallbacks) override;
+
+  /* Paper orders resting on a symbol; on the event thread. */
+  size_t open_orders(const std::string& symbol) const;
+
+private:
+  struct PaperOrder : SimRestingOrder {
+    PaperOrder(uint64_t id, Side side, double size, double price,
+               std::string order_id)
+      : SimRestingOrder(id, side, size, price),
+        order_id(std::move(order_id))
+    {
+    }
+    std::string order_id; // of the client
+  };
+
+  struct Market : SimMatchingBook::Handler {
+    Market(PaperExchange& owner, const SimFillModel&, SimCrossFill);
+    void on_sim_fill(SimRestingOrder&, double price, double size,
+                     bool fully_filled) override;
+
+    PaperExchange& owner;
+    MarketData market;
+    SimMatchingBook book;
+  };
+
+  Market& market(const std::string& symbol);
+  Market* find_market(const std::string& symbol);
+
+  // cancel an order, replying either way; returns whether it was cancelled
+  bool cancel(Market*, const std::string& order_id,
+              const std::string& ext_order_id, const SubmitOrderCallbacks&);
+
+  std::shared_ptr<BaseExchangeSession> _venue;
+  std::unique_ptr<SimFillModel> _fill_model;
+  SimCrossFill _cross_fill;
+
+  std::map<std::string, std::unique_ptr<Market>, std::less<>> _markets;
+  uint64_t _next_id = 1;
+};
+
+} // namespace apex
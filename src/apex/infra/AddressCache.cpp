@@ -0,0 +1,280 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/infra/AddressCache.hpp>
+#include <apex/core/Logger.hpp>
+
+#include <uv.h>
+
+#include <algorithm>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace apex
+{
+
+
+AddressCache& AddressCache::instance()
+{
+  static AddressCache cache;
+  return cache;
+}
+
+
+AddressCache::AddressCache(Options options) : _options(options) {}
+
+
+AddressCache::~AddressCache()
+{
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    _stop = true;
+  }
+  _cond.notify_one();
+  if (_thread.joinable())
+    _thread.join();
+}
+
+
+void AddressCache::prefetch(const std::string& node, const std::string& service)
+{
+  // numeric addresses need no resolving, nor probing
+  char buf[sizeof(in6_addr)];
+  if (uv_inet_pton(AF_INET, node.c_str(), buf) == 0 ||
+      uv_inet_pton(AF_INET6, node.c_str(), buf) == 0)
+    return;
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto [iter, inserted] = _hosts.try_emplace({node, service});
+  if (!inserted)
+    return;
+
+  _stats.hosts = _hosts.size();
+  if (!_thread.joinable())
+    _thread = std::thread([this]() { this->run(); });
+  _cond.notify_one();
+}
+
+
+std::vector<SocketAddress> AddressCache::lookup(const std::string& node,
+                                                const std::string& service,
+                                                int family) const
+{
+  std::vector<SocketAddress> result;
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto iter = _hosts.find({node, service});
+  if (iter == _hosts.end())
+    return result;
+
+  for (auto& item : iter->second.addresses)
+    if (family == AF_UNSPEC || item.addr._impl->ss_family == family)
+      result.push_back(item.addr);
+  return result;
+}
+
+
+AddressCache::Stats AddressCache::stats() const
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  return _stats;
+}
+
+
+void AddressCache::run()
+{
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stop) {
+    // hosts are never removed, so the keys can be worked on unlocked
+    auto now = clock::now();
+    auto wake = now + _options.refresh_interval;
+    std::vector<host_key> to_resolve;
+    std::vector<host_key> to_probe;
+    for (auto& [key, host] : _hosts) {
+      if (host.next_resolve <= now)
+        to_resolve.push_back(key);
+      else if (_options.probe_interval.count() && host.next_probe <= now)
+        to_probe.push_back(key);
+      wake = std::min(wake, host.next_resolve);
+      if (_options.probe_interval.count())
+        wake = std::min(wake, host.next_probe);
+    }
+
+    if (to_resolve.empty() && to_probe.empty()) {
+      _cond.wait_until(lock, wake);
+      continue;
+    }
+
+    lock.unlock();
+    for (auto& key : to_resolve) {
+      resolve(key);
+      if (_options.probe_interval.count())
+        probe(key);
+    }
+    for (auto& key : to_probe)
+      probe(key);
+    lock.lock();
+  }
+}
+
+
+void AddressCache::resolve(const host_key& key)
+{
+  /* cache thread, unlocked */
+
+  struct addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+
+  struct addrinfo* info = nullptr;
+  int err = ::getaddrinfo(key.first.empty() ? nullptr : key.first.c_str(),
+                          key.second.empty() ? nullptr : key.second.c_str(),
+                          &hints, &info);
+
+  std::vector<SocketAddress> found;
+  for (auto* ai = info; ai != nullptr; ai = ai->ai_next) {
+    sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    memcpy(&ss, ai->ai_addr, std::min<size_t>(ai->ai_addrlen, sizeof(ss)));
+    SocketAddress addr(ss);
+    if (std::find(found.begin(), found.end(), addr) == found.end())
+      found.push_back(std::move(addr));
+  }
+  if (info)
+    ::freeaddrinfo(info);
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto& host = _hosts[key];
+  host.next_resolve = clock::now() + _options.refresh_interval;
+  _stats.resolves++;
+
+  if (err != 0 || found.empty()) {
+    // keep serving the previous addresses, which may well still be good, but
+    // retry soon if there are none
+    _stats.resolve_failures++;
+    if (host.addresses.empty())
+      host.next_resolve = clock::now() + std::chrono::seconds(5);
+    LOG_WARN("failed to resolve " << key.first << ":" << key.second << ", "
+                                  << gai_strerror(err));
+    return;
+  }
+
+  // carry over the probe results of addresses seen before
+  std::vector<Address> addresses;
+  for (auto& addr : found) {
+    auto prev = std::find_if(host.addresses.begin(), host.addresses.end(),
+                             [&](const Address& a) { return a.addr == addr; });
+    if (prev != host.addresses.end())
+      addresses.push_back(*prev);
+    else
+      addresses.push_back({std::move(addr)});
+  }
+  rank(addresses);
+  host.addresses = std::move(addresses);
+}
+
+
+/* Time a TCP connect to each address of a host.  Failed and timed out
+ * connects mark the address unreachable, which ranks it last. */
+void AddressCache::probe(const host_key& key)
+{
+  /* cache thread, unlocked */
+
+  std::vector<SocketAddress> targets;
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    auto& host = _hosts[key];
+    host.next_probe = clock::now() + _options.probe_interval;
+    for (auto& item : host.addresses)
+      targets.push_back(item.addr);
+  }
+
+#ifndef _WIN32
+  std::vector<Address> results;
+  for (auto& addr : targets) {
+    const sockaddr_storage* ss = addr._impl.get();
+    socklen_t len = (ss->ss_family == AF_INET6) ? sizeof(sockaddr_in6)
+                                                : sizeof(sockaddr_in);
+    Address result{addr, std::chrono::microseconds{0}, false};
+
+    int fd = ::socket(ss->ss_family, SOCK_STREAM, IPPROTO_TCP);
+    if (fd >= 0) {
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+      auto start = clock::now();
+      int rc = ::connect(fd, (const sockaddr*)ss, len);
+      if (rc != 0 && errno == EINPROGRESS) {
+        pollfd pfd{fd, POLLOUT, 0};
+        rc = -1;
+        if (::poll(&pfd, 1, static_cast<int>(_options.probe_timeout.count())) ==
+            1) {
+          int so_error = 0;
+          socklen_t so_len = sizeof(so_error);
+          ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &so_len);
+          rc = so_error == 0 ? 0 : -1;
+        }
+      }
+      if (rc == 0) {
+        result.reachable = true;
+        result.rtt = std::max(
+            std::chrono::duration_cast<std::chrono::microseconds>(clock::now() -
+                                                                  start),
+            std::chrono::microseconds{1});
+      }
+      ::close(fd);
+    }
+    results.push_back(std::move(result));
+  }
+
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto& host = _hosts[key];
+  for (auto& result : results) {
+    auto iter = std::find_if(
+        host.addresses.begin(), host.addresses.end(),
+        [&](const Address& a) { return a.addr == result.addr; });
+    if (iter != host.addresses.end()) { // else dropped by a resolve meanwhile
+      iter->rtt = result.rtt;
+      iter->reachable = result.reachable;
+    }
+    _stats.probes++;
+  }
+  rank(host.addresses);
+#endif
+}
+
+
+/* Reachable addresses first, fastest first; addresses not yet probed follow
+ * the probed ones, in resolver order. */
+void AddressCache::rank(std::vector<Address>& addresses)
+{
+  std::stable_sort(addresses.begin(), addresses.end(),
+                   [](const Address& a, const Address& b) {
+                     if (a.reachable != b.reachable)
+                       return a.reachable;
+                     auto unprobed = std::chrono::microseconds::max();
+                     return (a.rtt.count() ? a.rtt : unprobed) <
+                            (b.rtt.count() ? b.rtt : unprobed);
+                   });
+}
+
+} // namespace apex
@@ -0,0 +1,114 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/infra/SocketAddress.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+
+/* Cache of resolved addresses of remote hosts, so that a connect, and in
+ * particular a reconnect, need not wait on name resolution.  Hosts are
+ * registered with prefetch(), after which a background thread resolves them,
+ * re-resolves them periodically, and times a TCP connect to each address
+ * found; lookup() then returns the addresses lowest connect time first.
+ *
+ * getaddrinfo() does not expose the TTL of the records it returns, so
+ * addresses are refreshed at a fixed interval rather than at expiry. */
+class AddressCache
+{
+public:
+  struct Options {
+    std::chrono::seconds refresh_interval{60};
+
+    // zero disables probing, in which case resolver order is kept
+    std::chrono::seconds probe_interval{30};
+    std::chrono::milliseconds probe_timeout{1000};
+  };
+
+  /* Process wide cache, used by TcpSocket::connect. */
+  static AddressCache& instance();
+
+  explicit AddressCache(Options options);
+  AddressCache() : AddressCache(Options{}) {}
+  ~AddressCache();
+
+  AddressCache(const AddressCache&) = delete;
+  AddressCache& operator=(const AddressCache&) = delete;
+
+  /* Register a host, as node and service, for background resolution; it is
+   * resolved soon after, and kept fresh thereafter.  Numeric addresses are
+   * ignored.  Safe from any thread. */
+  void prefetch(const std::string& node, const std::string& service);
+
+  /* Addresses of a registered host, best first, limited to an address family
+   * (AF_INET, AF_INET6, or AF_UNSPEC for both).  Empty if the host is not yet
+   * resolved.  Safe from any thread. */
+  [[nodiscard]] std::vector<SocketAddress> lookup(const std::string& node,
+                                                  const std::string& service,
+                                                  int family) const;
+
+  struct Stats {
+    size_t hosts = 0;
+    size_t resolves = 0;
+    size_t resolve_failures = 0;
+    size_t probes = 0;
+  };
+  [[nodiscard]] Stats stats() const;
+
+private:
+  using clock = std::chrono::steady_clock;
+  using host_key = std::pair<std::string, std::string>;
+
+  struct Address {
+    SocketAddress addr;
+    std::chrono::microseconds rtt{0}; // zero until probed
+    bool reachable = true;
+  };
+
+  struct Host {
+    std::vector<Address> addresses;
+    clock::time_point next_resolve;
+    clock::time_point next_probe;
+  };
+
+  void run();
+  void resolve(const host_key&);
+  void probe(const host_key&);
+  static void rank(std::vector<Address>&);
+
+  Options _options;
+
+  mutable std::mutex _mutex;
+  std::condition_variable _cond;
+  std::map<host_key, Host> _hosts;
+  Stats _stats;
+  bool _stop = false;
+  std::thread _thread; // started by the first prefetch
+};
+
+} // namespace apex
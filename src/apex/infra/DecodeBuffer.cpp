@@ -16,29 +16,150 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/infra/DecodeBuffer.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Metrics.hpp>
 
+#include <algorithm>
 #include <cstring>
 #include <stdexcept>
 
 namespace apex
 {
 
+memory::Account& decode_buffer_memory()
+{
+  static memory::Account account("decode_buffers");
+  return account;
+}
+
+static metrics::Counter& decode_buffer_grows = metrics::registry().counter(
+    "apex_decode_buffer_grows_total", "Decode buffers grown to fit a read");
+
+static metrics::Counter& decode_buffer_shrinks = metrics::registry().counter(
+    "apex_decode_buffer_shrinks_total",
+    "Decode buffers shrunk back to their initial size after a burst");
+
+static metrics::Counter& decode_buffer_overflows = metrics::registry().counter(
+    "apex_decode_buffer_overflows_total",
+    "Messages too large for a decode buffer at its max size");
+
+static metrics::Gauge& decode_buffer_high_water = metrics::registry().gauge(
+    "apex_decode_buffer_high_water_bytes",
+    "Most bytes held awaiting decode by any decode buffer");
+
+
+decode_buffer_overflow::decode_buffer_overflow(const std::string& msg)
+  : std::runtime_error(msg.c_str())
+{
+  decode_buffer_overflows.add();
+}
+
+
+DecodeBufferSizing::DecodeBufferSizing(const DecodeBufferPolicy& policy)
+{
+  set_policy(policy);
+}
+
+
+void DecodeBufferSizing::set_policy(const DecodeBufferPolicy& policy)
+{
+  _policy = policy;
+  _policy.max_size = std::max(_policy.initial_size, _policy.max_size);
+  _policy.growth = std::max(1.0, _policy.growth);
+  _quiet_discards = 0;
+}
+
+
+size_t DecodeBufferSizing::grow_to(size_t capacity, size_t needed)
+{
+  auto geometric = static_cast<size_t>(capacity * _policy.growth);
+  auto target = std::min(_policy.max_size, std::max(needed, geometric));
+  if (target > capacity) {
+    _stats.grows++;
+    decode_buffer_grows.add();
+  }
+  return std::max(target, capacity);
+}
+
+
+void DecodeBufferSizing::on_consume(size_t avail)
+{
+  if (avail <= _stats.high_water)
+    return;
+  _stats.high_water = avail;
+  if (static_cast<int64_t>(avail) > decode_buffer_high_water.value())
+    decode_buffer_high_water.set(avail);
+}
+
+
+bool DecodeBufferSizing::on_discard(size_t capacity, size_t baseline,
+                                    size_t avail)
+{
+  if (capacity <= baseline || avail > baseline || _policy.shrink_after == 0) {
+    _quiet_discards = 0;
+    return false;
+  }
+  if (++_quiet_discards < _policy.shrink_after)
+    return false;
+  _quiet_discards = 0;
+  _stats.shrinks++;
+  decode_buffer_shrinks.add();
+  return true;
+}
+
+
+DecodeBufferPolicy parse_decode_buffer_policy(Config config)
+{
+  DecodeBufferPolicy policy;
+  if (config.contains("initial_kb"))
+    policy.initial_size = config.get_uint("initial_kb") * 1024;
+  if (config.contains("max_kb"))
+    policy.max_size = config.get_uint("max_kb") * 1024;
+  policy.growth = config.raw().value("growth", policy.growth);
+  policy.shrink_after = config.get_uint("shrink_after", policy.shrink_after);
+  if (policy.initial_size == 0)
+    throw ConfigError("read_buffer initial_kb must be greater than zero");
+  if (policy.growth < 1.0)
+    throw ConfigError("read_buffer growth must be at least 1");
+  return policy;
+}
+
+
+DecodeBuffer::DecodeBuffer(const Policy& policy)
+  : _mem(policy.initial_size),
+    _sizing(policy),
+    _bytes_avail(0),
+    _charge(decode_buffer_memory())
+{
+  _charge.set(_mem.capacity());
+}
+
 
 DecodeBuffer::DecodeBuffer(size_t initial_size, size_t max_size)
-  : _mem(initial_size), _max_size(max_size), _bytes_avail(0)
+  : DecodeBuffer(Policy{initial_size, max_size})
 {
 }
 
 
+void DecodeBuffer::set_policy(const Policy& policy)
+{
+  _sizing.set_policy(policy);
+  if (_bytes_avail <= policy.initial_size)
+    resize(policy.initial_size);
+}
+
+
 void DecodeBuffer::update_max_size(size_t new_max)
 {
-  if (new_max == _max_size)
+  auto policy = _sizing.policy();
+  if (new_max == policy.max_size)
     return;
 
-  if ((new_max < _max_size) && (new_max < _mem.size()))
+  if ((new_max < policy.max_size) && (new_max < _mem.size()))
     throw std::runtime_error("unable to reduce DecodeBuffer max size");
 
-  _max_size = new_max;
+  policy.max_size = new_max;
+  _sizing.set_policy(policy);
 
   // Note: don't perform any actual DecodeBuffer modification, since it would
   // invalidate any read_pointer
@@ -48,24 +169,35 @@ void DecodeBuffer::update_max_size(size_t new_max)
 size_t DecodeBuffer::consume(const char* src, size_t len)
 {
   if (space() < len)
-    grow_by(len - space());
+    resize(_sizing.grow_to(_mem.size(), _bytes_avail + len));
 
   size_t consume_len = (std::min)(space(), len);
   if (len && consume_len == 0)
-    throw std::runtime_error("DecodeBuffer full, cannot consume data");
+    throw decode_buffer_overflow("DecodeBuffer full, cannot consume data");
 
   memcpy(_mem.data() + _bytes_avail, src, consume_len);
   _bytes_avail += consume_len;
+  _sizing.on_consume(_bytes_avail);
 
   return consume_len;
 }
 
-void DecodeBuffer::grow_by(size_t len)
+
+void DecodeBuffer::resize(size_t capacity)
 {
-  size_t grow_max = _max_size - _mem.size();
-  size_t grow_size = (std::min)(grow_max, len);
-  if (grow_size)
-    _mem.resize(_mem.size() + grow_size);
+  if (capacity == _mem.size())
+    return;
+  if (capacity < _mem.size()) {
+    // shrink_to_fit would not release the memory of a larger vector
+    std::vector<char> mem(capacity);
+    memcpy(mem.data(), _mem.data(), _bytes_avail);
+    _mem.swap(mem);
+  }
+  else {
+    _mem.reserve(capacity);
+    _mem.resize(capacity);
+  }
+  _charge.set(_mem.capacity());
 }
 
 
@@ -74,6 +206,9 @@ void DecodeBuffer::discard(const read_pointer& rd)
   _bytes_avail = rd.avail();
   if (rd.ptr() != _mem.data() && rd.avail())
     memmove(_mem.data(), rd.ptr(), rd.avail());
+  if (_sizing.on_discard(_mem.size(), _sizing.policy().initial_size,
+                         _bytes_avail))
+    resize(_sizing.policy().initial_size);
 }
 
 } // namespace apex
@@ -17,20 +17,93 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/util/MemoryAccount.hpp>
+
+#include <stdexcept>
+#include <string>
 #include <vector>
 
 #include <cstddef>
+#include <cstdint>
 
 namespace apex
 {
 
+class Config;
+
+/* Raised when a message does not fit a decode buffer at its max size; each is
+ * counted in apex_decode_buffer_overflows_total. */
+class decode_buffer_overflow : public std::runtime_error
+{
+public:
+  explicit decode_buffer_overflow(const std::string& msg);
+};
+
+
+/* Sizing of a decode buffer.  The buffer starts at the initial size and, when
+ * a read does not fit, grows by the growth factor, or to the size needed if
+ * more, up to the max size.  Once `shrink_after` discards in a row have found
+ * it holding no more than the initial size, it shrinks back to that size, so
+ * that a burst does not leave every connection holding its largest buffer. */
+struct DecodeBufferPolicy {
+  size_t initial_size = 1000;
+  size_t max_size = 1000000;
+  double growth = 2.0;
+  size_t shrink_after = 1024; // zero to never shrink
+};
+
+
+struct DecodeBufferStats {
+  size_t high_water = 0; // most bytes held awaiting decode
+  uint64_t grows = 0;
+  uint64_t shrinks = 0;
+};
+
+
+/* Growth and shrink decisions of a DecodeBufferPolicy, shared by the decode
+ * buffers, which also record their stats and metrics here. */
+class DecodeBufferSizing
+{
+public:
+  explicit DecodeBufferSizing(const DecodeBufferPolicy&);
+
+  /* Replace the policy, keeping the stats. */
+  void set_policy(const DecodeBufferPolicy&);
+
+  const DecodeBufferPolicy& policy() const { return _policy; }
+  const DecodeBufferStats& stats() const { return _stats; }
+
+  /* Capacity to grow to, from `capacity`, to hold `needed` bytes; capped at
+   * the max size, so may be less than needed. */
+  size_t grow_to(size_t capacity, size_t needed);
+
+  /* Note the bytes held after a consume. */
+  void on_consume(size_t avail);
+
+  /* Note the bytes held after a discard; true if the buffer, of `capacity`,
+   * should now shrink to `baseline`, the initial size as the buffer rounds
+   * it. */
+  bool on_discard(size_t capacity, size_t baseline, size_t avail);
+
+private:
+  DecodeBufferPolicy _policy;
+  DecodeBufferStats _stats;
+  size_t _quiet_discards = 0;
+};
+
+
 /* Represent a buffer of bytes that have been read off a socket and
- * are awaiting decode. */
+ * are awaiting decode, sized by a DecodeBufferPolicy. */
 class DecodeBuffer
 {
 public:
+  using Policy = DecodeBufferPolicy;
+  using Stats = DecodeBufferStats;
+
   struct read_pointer {
-    read_pointer(char* p , size_t avail) : _ptr(p), _avail(avail) {}
+    read_pointer(char* p, size_t avail) : _ptr(p), _avail(avail), _consumed(0)
+    {
+    }
 
     char operator[](size_t i) const { return _ptr[i]; }
 
@@ -57,8 +130,17 @@ public:
     size_t _consumed;
   };
 
+  explicit DecodeBuffer(const Policy&);
   DecodeBuffer(size_t initial_size, size_t max_size);
 
+  /* Replace the policy; the buffer is resized to the new initial size if it
+   * holds no more than that.  Invalidates any read_pointer. */
+  void set_policy(const Policy&);
+
+  const Policy& policy() const { return _sizing.policy(); }
+
+  const Stats& stats() const { return _sizing.stats(); }
+
   /** size of data present in the buffer ready to be processed */
   size_t avail() const { return _bytes_avail; }
 
@@ -82,11 +164,21 @@ public:
   void update_max_size(size_t);
 
 private:
-  void grow_by(size_t len);
+  void resize(size_t capacity);
 
   std::vector<char> _mem;
-  size_t _max_size;
+  DecodeBufferSizing _sizing;
   size_t _bytes_avail;
+  memory::Charge _charge; // "decode_buffers"
 };
 
+
+/* Memory account of the decode buffers. */
+memory::Account& decode_buffer_memory();
+
+
+/* Parse a policy from config fields "initial_kb", "max_kb", "growth" and
+ * "shrink_after"; fields absent keep the defaults. */
+DecodeBufferPolicy parse_decode_buffer_policy(Config config);
+
 } // namespace apex
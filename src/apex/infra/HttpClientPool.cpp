@@ -0,0 +1,305 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/infra/HttpClientPool.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Numa.hpp>
+
+#include <curl/curl.h>
+
+#include <memory>
+#include <sstream>
+
+namespace apex
+{
+
+// state of a request in progress, owned via CURLOPT_PRIVATE of its handle
+struct HttpClientPool::Transfer {
+  Request request;
+  std::string reply;
+  curl_slist* headers = nullptr;
+};
+
+
+static size_t write_callback(void* content, size_t size, size_t nmemb,
+                             void* user)
+{
+  size_t const realsize = size * nmemb;
+  auto* reply = reinterpret_cast<std::string*>(user);
+  reply->append((char*)content, realsize);
+  return realsize;
+}
+
+
+static size_t header_callback(char* content, size_t size, size_t nitems,
+                              void* user)
+{
+  size_t const realsize = size * nitems;
+  auto* on_header = reinterpret_cast<std::function<void(std::string_view)>*>(user);
+  std::string_view line(content, realsize);
+  while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+    line.remove_suffix(1);
+  if (!line.empty())
+    (*on_header)(line);
+  return realsize;
+}
+
+
+HttpClientPool::HeaderList::HeaderList(const std::vector<std::string>& headers)
+{
+  curl_slist* list = nullptr;
+  for (auto& header : headers)
+    list = curl_slist_append(list, header.c_str());
+  _slist = list;
+}
+
+
+HttpClientPool::HeaderList::~HeaderList()
+{
+  curl_slist_free_all(static_cast<curl_slist*>(_slist));
+}
+
+
+HttpClientPool::HttpClientPool(Options options)
+  : _options(std::move(options)),
+    _multi(curl_multi_init())
+{
+  if (!_multi)
+    throw std::runtime_error("curl_multi_init failed");
+
+  auto* multi = static_cast<CURLM*>(_multi);
+  long max_connections = std::max(_options.max_connections, 1u);
+  curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_connections);
+  curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, max_connections);
+  curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+                    _options.http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+
+  _next_keep_warm = std::chrono::steady_clock::now();
+  _thread = std::thread([this]() { run(); });
+}
+
+
+HttpClientPool::~HttpClientPool()
+{
+  _stop = true;
+  curl_multi_wakeup(static_cast<CURLM*>(_multi));
+  _thread.join();
+
+  for (auto* easy : _idle_handles)
+    curl_easy_cleanup(static_cast<CURL*>(easy));
+  curl_multi_cleanup(static_cast<CURLM*>(_multi));
+}
+
+
+void HttpClientPool::request(HttpRequestType type, std::string url,
+                             std::string body, std::vector<std::string> headers,
+                             result_fn on_result)
+{
+  {
+    auto lock = std::scoped_lock(_pending_mutex);
+    _pending.push_back(Request{type, std::move(url), std::move(body),
+                               std::move(headers), std::move(on_result),
+                               nullptr});
+  }
+  curl_multi_wakeup(static_cast<CURLM*>(_multi));
+}
+
+
+void HttpClientPool::request(HttpRequestType type, std::string url,
+                             std::string body,
+                             std::shared_ptr<const HeaderList> headers,
+                             result_fn on_result)
+{
+  {
+    auto lock = std::scoped_lock(_pending_mutex);
+    _pending.push_back(Request{type, std::move(url), std::move(body), {},
+                               std::move(on_result), std::move(headers)});
+  }
+  curl_multi_wakeup(static_cast<CURLM*>(_multi));
+}
+
+
+void HttpClientPool::start_transfer(Request request)
+{
+  CURL* curl;
+  if (_idle_handles.empty()) {
+    curl = curl_easy_init();
+    if (!curl) {
+      if (request.on_result)
+        request.on_result({}, "http-request failed, error 'curl_easy_init'");
+      return;
+    }
+  } else {
+    // a reused handle keeps its DNS cache and TLS session ids
+    curl = static_cast<CURL*>(_idle_handles.back());
+    _idle_handles.pop_back();
+    curl_easy_reset(curl);
+  }
+
+  auto transfer = std::make_unique<Transfer>();
+  transfer->request = std::move(request);
+  auto& req = transfer->request;
+
+  LOG_DEBUG("URL:" << req.url);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long)_options.connect_timeout.count());
+  curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long)_options.timeout.count());
+  curl_easy_setopt(curl, CURLOPT_URL, req.url.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_NODELAY, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer->reply);
+  curl_easy_setopt(curl, CURLOPT_PRIVATE, transfer.get());
+  if (_options.on_header) {
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_callback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &_options.on_header);
+  }
+  if (_options.http2) {
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+    curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+  }
+
+  switch (req.type) {
+    case HttpRequestType::del:
+      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req.body.c_str());
+      break;
+    case HttpRequestType::put:
+      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req.body.c_str());
+      break;
+    case HttpRequestType::post:
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req.body.c_str());
+      break;
+    case HttpRequestType::get:
+      curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
+      break;
+  }
+
+  for (auto& header : req.headers)
+    transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+  if (transfer->headers)
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, transfer->headers);
+  else if (req.shared_headers)
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+                     static_cast<curl_slist*>(req.shared_headers->slist()));
+
+  curl_multi_add_handle(static_cast<CURLM*>(_multi), curl);
+  _active_handles.insert(curl);
+  transfer.release();
+}
+
+
+void HttpClientPool::finish_transfer(void* easy, int result)
+{
+  auto* curl = static_cast<CURL*>(easy);
+  char* priv = nullptr;
+  curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+  std::unique_ptr<Transfer> transfer(reinterpret_cast<Transfer*>(priv));
+
+  long connects = 0;
+  curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+  _connections_opened.fetch_add(connects, std::memory_order_relaxed);
+
+  curl_multi_remove_handle(static_cast<CURLM*>(_multi), curl);
+  curl_slist_free_all(transfer->headers);
+  _active_handles.erase(curl);
+  _idle_handles.push_back(curl);
+  _requests_completed.fetch_add(1, std::memory_order_relaxed);
+
+  std::string error;
+  if (result != CURLE_OK) {
+    std::ostringstream oss;
+    oss << "http-request failed, error '"
+        << curl_easy_strerror(static_cast<CURLcode>(result)) << "'";
+    error = oss.str();
+  }
+
+  if (transfer->request.on_result) {
+    try {
+      transfer->request.on_result(std::move(transfer->reply), std::move(error));
+    } catch (const std::exception& e) {
+      LOG_ERROR("http-request result callback failed: " << e.what());
+    }
+  }
+}
+
+
+void HttpClientPool::keep_warm()
+{
+  auto now = std::chrono::steady_clock::now();
+  if (_options.keep_warm_url.empty() || now < _next_keep_warm)
+    return;
+  _next_keep_warm = now + _options.keep_warm_interval;
+
+  // concurrent requests each take a connection of their own from the cache,
+  // or open one, so every warm connection is exercised
+  for (unsigned i = 0; i < _options.warm_connections; i++)
+    start_transfer(Request{HttpRequestType::get, _options.keep_warm_url, {}, {},
+                           [](std::string, std::string error) {
+                             if (!error.empty())
+                               LOG_WARN("http keep-warm failed: " << error);
+                           },
+                           nullptr});
+}
+
+
+void HttpClientPool::run()
+{
+  Logger::instance().register_thread_id("http");
+  numa::try_bind_to_default_node("http");
+  auto* multi = static_cast<CURLM*>(_multi);
+
+  std::vector<Request> requests;
+  while (!_stop) {
+    {
+      auto lock = std::scoped_lock(_pending_mutex);
+      requests.swap(_pending);
+    }
+    for (auto& request : requests)
+      start_transfer(std::move(request));
+    requests.clear();
+
+    keep_warm();
+
+    int running = 0;
+    curl_multi_perform(multi, &running);
+
+    int remaining = 0;
+    while (CURLMsg* msg = curl_multi_info_read(multi, &remaining))
+      if (msg->msg == CURLMSG_DONE)
+        finish_transfer(msg->easy_handle, msg->data.result);
+
+    // woken early by curl_multi_wakeup, when a request is queued
+    curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+
+  // abandon transfers still in progress
+  for (auto* easy : _active_handles) {
+    auto* curl = static_cast<CURL*>(easy);
+    char* priv = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+    std::unique_ptr<Transfer> transfer(reinterpret_cast<Transfer*>(priv));
+    curl_multi_remove_handle(multi, curl);
+    curl_slist_free_all(transfer->headers);
+    curl_easy_cleanup(curl);
+  }
+  _active_handles.clear();
+}
+
+} // namespace apex
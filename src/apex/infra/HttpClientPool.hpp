@@ -0,0 +1,137 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/utils.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace apex
+{
+
+/* HTTP client that keeps its connections open between requests, so that a
+ * request, such as an order submit, normally avoids the TCP connect and TLS
+ * handshake.  Requests are performed concurrently, by a curl multi handle on
+ * a thread of the pool, over a connection cache shared by all requests; at
+ * most `max_connections` are opened per host, and further requests wait for
+ * a free connection (or, with HTTP/2, are multiplexed onto one).
+ *
+ * With a `keep_warm_url`, `warm_connections` concurrent GETs of it are made
+ * at start and then at each `keep_warm_interval`, so that that many
+ * connections are open before the first request, and are not closed as idle
+ * by either end. */
+class HttpClientPool
+{
+public:
+  struct Options {
+    unsigned max_connections = 4;
+    unsigned warm_connections = 2;
+    std::string keep_warm_url;
+    std::chrono::seconds keep_warm_interval{30};
+    std::chrono::seconds connect_timeout{5};
+    std::chrono::seconds timeout{10};
+    bool http2 = false;
+
+    // invoked on the pool thread with each line of the response headers,
+    // the status line included, e.g. to read rate-limit usage headers
+    std::function<void(std::string_view)> on_header;
+  };
+
+  // invoked on the pool thread; `error` is empty on success
+  using result_fn = std::function<void(std::string reply, std::string error)>;
+
+  /* Request headers built once, such as an API key header, for use by many
+   * requests, which then avoid rebuilding the header list each time. */
+  class HeaderList
+  {
+  public:
+    explicit HeaderList(const std::vector<std::string>& headers);
+    ~HeaderList();
+
+    HeaderList(const HeaderList&) = delete;
+    HeaderList& operator=(const HeaderList&) = delete;
+
+    [[nodiscard]] void* slist() const { return _slist; }
+
+  private:
+    void* _slist = nullptr;
+  };
+
+  explicit HttpClientPool(Options);
+  ~HttpClientPool();
+
+  HttpClientPool(const HttpClientPool&) = delete;
+  HttpClientPool& operator=(const HttpClientPool&) = delete;
+
+  /* Queue a request; can be called from any thread.  Requests still in
+   * progress when the pool is destroyed are abandoned, without a result. */
+  void request(HttpRequestType, std::string url, std::string body,
+               std::vector<std::string> headers, result_fn);
+  void request(HttpRequestType, std::string url, std::string body,
+               std::shared_ptr<const HeaderList> headers, result_fn);
+
+  /* Connections opened so far; requests that reuse a connection open none. */
+  [[nodiscard]] uint64_t connections_opened() const
+  {
+    return _connections_opened.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint64_t requests_completed() const
+  {
+    return _requests_completed.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Request {
+    HttpRequestType type;
+    std::string url;
+    std::string body;
+    std::vector<std::string> headers;
+    result_fn on_result;
+    std::shared_ptr<const HeaderList> shared_headers;
+  };
+  struct Transfer;
+
+  void run();
+  void start_transfer(Request);
+  void finish_transfer(void* easy, int result);
+  void keep_warm();
+
+  Options _options;
+  void* _multi;
+  std::mutex _pending_mutex;
+  std::vector<Request> _pending;
+  std::vector<void*> _idle_handles;
+  std::set<void*> _active_handles;
+  std::atomic<bool> _stop{false};
+  std::atomic<uint64_t> _connections_opened{0};
+  std::atomic<uint64_t> _requests_completed{0};
+  std::chrono::steady_clock::time_point _next_keep_warm;
+  std::thread _thread;
+};
+
+} // namespace apex
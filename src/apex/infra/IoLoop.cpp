@@ -18,8 +18,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/infra/IoLoop.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Metrics.hpp>
+#include <apex/util/Numa.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
 #include <apex/util/utils.hpp>
 
+#include <algorithm>
+#include <future>
 #include <system_error>
 
 #include <assert.h>
@@ -28,6 +34,17 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 namespace apex
 {
 
+static metrics::Counter& io_requests = metrics::registry().counter(
+    "apex_io_requests_total", "Requests and functions run by IO loops");
+static metrics::Counter& io_wakeups = metrics::registry().counter(
+    "apex_io_wakeups_total", "Async wake-ups sent to IO loops");
+static metrics::Counter& io_request_overflows = metrics::registry().counter(
+    "apex_io_request_overflows_total",
+    "IO loop requests queued beyond the request ring");
+
+// slots of the request ring of each IO loop
+static constexpr size_t io_request_capacity = 4096;
+
 void free_socket(uv_handle_t* h)
 {
   if (h) {
@@ -41,11 +58,12 @@ struct io_request {
     cancel_handle,
     close_loop,
     function,
-  } type;
+  } type = request_type::function;
 
   uv_tcp_t* tcp_handle = nullptr;
   std::function<void()> user_fn;
 
+  io_request() = default;
   explicit io_request(request_type __type) : type(__type) {}
 };
 
@@ -53,7 +71,10 @@ struct io_request {
 IoLoop::IoLoop(std::function<void()> io_started_cb)
   : _uv_loop(new uv_loop_t()),
     _async(new uv_async_t()),
-    _pending_requests_state(state::open)
+    _deferred_check(new uv_check_t()),
+    _deferred_timer(new uv_timer_t()),
+    _pending_requests_state(state::open),
+    _requests(std::make_unique<MpscQueue<io_request>>(io_request_capacity))
 {
   uv_loop_init(_uv_loop);
   _uv_loop->data = this;
@@ -65,6 +86,12 @@ IoLoop::IoLoop(std::function<void()> io_started_cb)
   });
   _async->data = this;
 
+  // handles for deferred functions, only started while functions are pending
+  uv_check_init(_uv_loop, _deferred_check.get());
+  uv_timer_init(_uv_loop, _deferred_timer.get());
+  _deferred_check->data = this;
+  _deferred_timer->data = this;
+
   // prevent SIGPIPE from crashing application when socket writes are
   // interrupted
 #ifndef _WIN32
@@ -75,6 +102,8 @@ IoLoop::IoLoop(std::function<void()> io_started_cb)
     scope_guard undo_thread_id([this]() { _io_thread_id.release(); });
     _io_thread_id.set_value(std::this_thread::get_id());
     Logger::instance().register_thread_id("libuv");
+    if (!io_started_cb)
+      numa::try_bind_to_default_node("libuv");
     if (io_started_cb)
       try {
         io_started_cb();
@@ -91,11 +120,8 @@ IoLoop::IoLoop(std::function<void()> io_started_cb)
 
 void IoLoop::sync_stop()
 {
-  std::unique_ptr<io_request> r(
-      new io_request(io_request::request_type::close_loop));
-
   try {
-    push_request(std::move(r));
+    push_request(io_request(io_request::request_type::close_loop));
   } catch (IoLoopClosed&) { /* ignore */
   }
 
@@ -106,6 +132,7 @@ void IoLoop::sync_stop()
 
 IoLoop::~IoLoop()
 {
+  _uring.reset();
   uv_loop_close(_uv_loop);
   delete _uv_loop;
 }
@@ -114,63 +141,129 @@ IoLoop::~IoLoop()
 void IoLoop::on_async()
 {
   /* IO thread */
-  std::vector<std::unique_ptr<io_request>> work;
 
-  {
-    std::lock_guard<std::mutex> guard(_pending_requests_lock);
-    work.swap(_pending_requests);
-    if (_pending_requests_state == state::closing)
-      _pending_requests_state = state::closed;
+  // cleared before the requests are taken, so that a request pushed from now
+  // on sends a further wake-up
+  _wakeup_pending.store(false);
+
+  bool close_loop = false;
+  size_t count = drain_requests(close_loop);
+
+  if (close_loop) {
+    // once no thread can still be pushing, take any last requests, which
+    // were pushed before the state changed
+    _pending_requests_state.store(state::closed);
+    while (_pushers.load() != 0)
+      std::this_thread::yield();
+    count += drain_requests(close_loop);
+  }
+  if (count)
+    io_requests.add(count);
+
+  if (close_loop)
+    close_handles();
+}
+
+
+/* Run the queued requests, returning how many. */
+size_t IoLoop::drain_requests(bool& close_loop)
+{
+  /* IO thread */
+  size_t count = 0;
+  io_request req;
+  while (_requests->try_pop(req)) {
+    run_request(req, close_loop);
+    count++;
   }
 
-  for (auto& user_req : work) {
-    if (user_req->type == io_request::request_type::cancel_handle) {
-      auto handle_to_cancel = (uv_handle_t*)user_req->tcp_handle;
-      if (!uv_is_closing(handle_to_cancel))
-        uv_close(handle_to_cancel, [](uv_handle_t* handle) { delete handle; });
-    } else if (user_req->type == io_request::request_type::close_loop) {
-      /* close event handler run at function exit */
-    } else if (user_req->type == io_request::request_type::function) {
-      user_req->user_fn();
-    } else {
-      assert(false);
+  // the overflow holds requests pushed after any still in the ring, so it is
+  // only taken once the ring is empty; a ring request still being written
+  // brings a further wake-up when complete.  The ring is checked under the
+  // lock, which orders it after the ring pushes of every thread whose
+  // requests are in the overflow.
+  if (_overflow_size.load(std::memory_order_acquire)) {
+    std::vector<std::unique_ptr<io_request>> work;
+    {
+      std::lock_guard<std::mutex> guard(_overflow_lock);
+      if (_requests->size_approx() == 0) {
+        work.swap(_overflow);
+        _overflow_size.store(0, std::memory_order_release);
+      }
     }
+    for (auto& user_req : work)
+      run_request(*user_req, close_loop);
+    count += work.size();
+  }
+  return count;
+}
+
+
+void IoLoop::run_request(io_request& user_req, bool& close_loop)
+{
+  /* IO thread */
+  if (user_req.type == io_request::request_type::cancel_handle) {
+    auto handle_to_cancel = (uv_handle_t*)user_req.tcp_handle;
+    if (!uv_is_closing(handle_to_cancel))
+      uv_close(handle_to_cancel, [](uv_handle_t* handle) { delete handle; });
+  } else if (user_req.type == io_request::request_type::close_loop) {
+    close_loop = true; /* close event handler run after all requests */
+  } else if (user_req.type == io_request::request_type::function) {
+    user_req.user_fn();
+  } else {
+    assert(false);
+  }
+}
+
+
+void IoLoop::close_handles()
+{
+  /* IO thread */
+  uv_close((uv_handle_t*)_async.get(), 0);
+  uv_close((uv_handle_t*)_deferred_check.get(), 0);
+  uv_close((uv_handle_t*)_deferred_timer.get(), 0);
+  _deferred.clear();
+  if (_uring)
+    _uring->close();
+  if (_busy_prepare)
+    uv_close((uv_handle_t*)_busy_prepare.get(), 0);
+  if (_fused_check) {
+    uv_close((uv_handle_t*)_fused_prepare.get(), 0);
+    uv_close((uv_handle_t*)_fused_check.get(), 0);
+    uv_close((uv_handle_t*)_fused_idle.get(), 0);
+    uv_close((uv_handle_t*)_fused_timer.get(), 0);
   }
 
-  if (_pending_requests_state == state::closed) {
-    uv_close((uv_handle_t*)_async.get(), 0);
-
-    // While there are active handles, progress the event loop here and on
-    // each iteration identify and request close any handles which have not
-    // been requested to close.
-    uv_walk(
-        _uv_loop,
-        [](uv_handle_t* handle, void* /*arg*/) {
-          if (!uv_is_closing(handle)) {
-            HandleData* ptr = (HandleData*)handle->data;
-
-            if (ptr == 0) {
-              // We are uv_walking a handle which does not have the data member
-              // set. Common cause of this is a shutdown of the kernel & ioloop
-              // while a connector exists which has not had its UV handle used.
+  // While there are active handles, progress the event loop here and on
+  // each iteration identify and request close any handles which have not
+  // been requested to close.
+  uv_walk(
+      _uv_loop,
+      [](uv_handle_t* handle, void* /*arg*/) {
+        if (!uv_is_closing(handle)) {
+          HandleData* ptr = (HandleData*)handle->data;
+
+          if (ptr == 0) {
+            // We are uv_walking a handle which does not have the data member
+            // set. Common cause of this is a shutdown of the kernel & ioloop
+            // while a connector exists which has not had its UV handle used.
+            uv_close(handle, [](uv_handle_t* h) { delete h; });
+          } else {
+            assert(ptr->check() == HandleData::DATA_CHECK);
+
+            if (ptr->type() == HandleData::handle_type::tcp_socket)
+              ptr->tcp_socket_ptr()->begin_close();
+            else if (ptr->type() == HandleData::handle_type::tcp_connect ||
+                     ptr->type() == HandleData::handle_type::udp_socket)
+              uv_close(handle, free_socket);
+            else {
+              /* unknown handle, so just close it */
+              assert(0);
               uv_close(handle, [](uv_handle_t* h) { delete h; });
-            } else {
-              assert(ptr->check() == HandleData::DATA_CHECK);
-
-              if (ptr->type() == HandleData::handle_type::tcp_socket)
-                ptr->tcp_socket_ptr()->begin_close();
-              else if (ptr->type() == HandleData::handle_type::tcp_connect)
-                uv_close(handle, free_socket);
-              else {
-                /* unknown handle, so just close it */
-                assert(0);
-                uv_close(handle, [](uv_handle_t* h) { delete h; });
-              }
             }
           }
-        },
-        nullptr);
-  }
+        }
+      },
+      nullptr);
 }
 
 
@@ -184,7 +277,9 @@ void IoLoop::run_loop()
 {
   while (true) {
     try {
-      int r = uv_run(_uv_loop, UV_RUN_DEFAULT);
+      int r = uv_run(_uv_loop, _busy_poll.load(std::memory_order_relaxed)
+                                   ? UV_RUN_NOWAIT
+                                   : UV_RUN_DEFAULT);
 
       if (r == 0) /*  no more handles; we are shutting down */
         return;
@@ -199,44 +294,284 @@ void IoLoop::run_loop()
 
 void IoLoop::cancel_connect(uv_tcp_t* handle)
 {
-  std::unique_ptr<io_request> r(
-      new io_request(io_request::request_type::cancel_handle));
-  r->tcp_handle = handle;
+  io_request r(io_request::request_type::cancel_handle);
+  r.tcp_handle = handle;
   push_request(std::move(r));
 }
 
 
-void IoLoop::push_request(std::unique_ptr<io_request> r)
+void IoLoop::push_request(io_request r)
 {
   // The io_request represents some IO operation, eg, send data on the
   // socket. This needs to be completed by the IO thread, so here all we do is
   // store the request in pending queue, and notify the libuv-IO thread that we
   // have asynchronous work for it.
-  {
-    std::lock_guard<std::mutex> guard(_pending_requests_lock);
+  _pushers.fetch_add(1);
+  scope_guard pushed([this]() { _pushers.fetch_sub(1); });
 
-    if (_pending_requests_state == state::closed)
-      throw IoLoopClosed();
+  if (_pending_requests_state.load() == state::closed)
+    throw IoLoopClosed();
 
-    if (r->type == io_request::request_type::close_loop)
-      _pending_requests_state = state::closing;
+  if (r.type == io_request::request_type::close_loop) {
+    auto expected = state::open;
+    _pending_requests_state.compare_exchange_strong(expected, state::closing);
+  }
 
-    _pending_requests.push_back(std::move(r));
+  if (_overflow_size.load(std::memory_order_acquire) ||
+      !_requests->try_push(std::move(r))) {
+    std::lock_guard<std::mutex> guard(_overflow_lock);
+    _overflow.push_back(std::make_unique<io_request>(std::move(r)));
+    _overflow_size.store(_overflow.size(), std::memory_order_release);
+    io_request_overflows.add();
   }
 
-  uv_async_send(_async.get()); // wake-up IO thread
+  // wake-up IO thread, unless already due to wake, or spinning
+  if (_busy_poll.load(std::memory_order_acquire))
+    return;
+  if (!_wakeup_pending.exchange(true)) {
+    io_wakeups.add();
+    uv_async_send(_async.get());
+  }
 }
 
 
 void IoLoop::push_fn(std::function<void()> fn)
 {
-  std::unique_ptr<io_request> r(
-      new io_request(io_request::request_type::function));
-  r->user_fn = std::move(fn);
+  io_request r(io_request::request_type::function);
+  r.user_fn = std::move(fn);
   push_request(std::move(r));
 }
 
 
+bool IoLoop::enable_io_uring(IoUring::Options options)
+{
+  if (!options.enabled)
+    return false;
+
+  if (!IoUring::is_supported()) {
+    LOG_WARN("io_uring not supported by kernel, using libuv IO");
+    return false;
+  }
+
+  auto create = [this, options]() {
+    try {
+      _uring = std::make_unique<IoUring>(_uv_loop, options);
+      LOG_INFO("using io_uring for socket IO");
+      return true;
+    } catch (std::exception& e) {
+      LOG_WARN("io_uring unavailable, using libuv IO: " << e.what());
+      return false;
+    }
+  };
+
+  if (this_thread_is_io())
+    return create();
+
+  std::promise<bool> created;
+  push_fn([&]() { created.set_value(create()); });
+  return created.get_future().get();
+}
+
+
+void IoLoop::enable_busy_poll(BusyPollOptions options)
+{
+  if (!options.enabled)
+    return;
+
+  auto enable = [this, options]() {
+    if (_busy_prepare)
+      return;
+    _socket_busy_poll = options.socket_busy_poll;
+    _busy_prepare = std::make_unique<uv_prepare_t>();
+    uv_prepare_init(_uv_loop, _busy_prepare.get());
+    _busy_prepare->data = this;
+    uv_prepare_start(_busy_prepare.get(), [](uv_prepare_t* h) {
+      static_cast<IoLoop*>(h->data)->on_async();
+    });
+    _busy_poll.store(true, std::memory_order_release);
+
+    // leave the blocking run, for the loop to continue without blocking
+    uv_stop(_uv_loop);
+    LOG_INFO("IO thread busy polling, socket busy poll "
+             << _socket_busy_poll.count() << " us");
+  };
+
+  if (this_thread_is_io()) {
+    enable();
+    return;
+  }
+  std::promise<void> enabled;
+  push_fn([&]() {
+    enable();
+    enabled.set_value();
+  });
+  enabled.get_future().get();
+}
+
+
+IoLoop::BusyPollOptions parse_busy_poll_options(Config config)
+{
+  IoLoop::BusyPollOptions options;
+  if (config.is_empty())
+    return options;
+  options.enabled = config.get_bool("busy_poll", options.enabled);
+  options.socket_busy_poll = std::chrono::microseconds(
+      config.get_uint("socket_busy_poll_us", options.socket_busy_poll.count()));
+  return options;
+}
+
+
+void IoLoop::defer_fn(std::function<void()> fn,
+                      std::chrono::microseconds delay)
+{
+  auto due = std::chrono::steady_clock::now() + delay;
+  if (this_thread_is_io())
+    add_deferred(due, std::move(fn));
+  else
+    push_fn([this, due, fn = std::move(fn)]() mutable {
+      add_deferred(due, std::move(fn));
+    });
+}
+
+
+void IoLoop::add_deferred(std::chrono::steady_clock::time_point due,
+                          std::function<void()> fn)
+{
+  /* IO thread */
+  if (uv_is_closing((uv_handle_t*)_deferred_check.get()))
+    return;
+
+  _deferred.push_back({due, std::move(fn)});
+
+  uv_check_start(_deferred_check.get(), [](uv_check_t* h) {
+    static_cast<IoLoop*>(h->data)->on_deferred_check();
+  });
+
+  // Arm the timer for the earliest due time.  Timers run before the poll, so
+  // the timer invokes due functions itself, rather than relying on the check
+  // handle after a poll that might then block; a zero timeout also covers a
+  // function added after the check handle has run in the current iteration.
+  arm_deferred_timer();
+}
+
+
+void IoLoop::arm_deferred_timer()
+{
+  /* IO thread */
+  auto earliest = _deferred.front().due;
+  for (auto& item : _deferred)
+    earliest = std::min(earliest, item.due);
+
+  auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+      earliest - std::chrono::steady_clock::now());
+  uv_timer_start(
+      _deferred_timer.get(),
+      [](uv_timer_t* h) { static_cast<IoLoop*>(h->data)->on_deferred_check(); },
+      wait.count() > 0 ? wait.count() : 0, 0);
+}
+
+
+void IoLoop::on_deferred_check()
+{
+  /* IO thread */
+  auto now = std::chrono::steady_clock::now();
+
+  std::vector<deferred_fn> due;
+  std::vector<deferred_fn> later;
+  for (auto& item : _deferred)
+    (item.due <= now ? due : later).push_back(std::move(item));
+  _deferred = std::move(later);
+
+  // functions may defer further functions, which are appended to _deferred
+  for (auto& item : due)
+    item.fn();
+
+  if (_deferred.empty()) {
+    uv_check_stop(_deferred_check.get());
+    uv_timer_stop(_deferred_timer.get());
+  } else
+    arm_deferred_timer();
+}
+
+
+void IoLoop::attach_event_loop(RealtimeEventLoop* evloop)
+{
+  _fused_evloop = evloop;
+  evloop->set_wakeup_fn([this]() { wake_fused(); });
+  push_fn([this]() { start_fused_handles(); });
+}
+
+
+void IoLoop::start_fused_handles()
+{
+  /* IO thread */
+  _fused_prepare = std::make_unique<uv_prepare_t>();
+  _fused_check = std::make_unique<uv_check_t>();
+  _fused_idle = std::make_unique<uv_idle_t>();
+  _fused_timer = std::make_unique<uv_timer_t>();
+
+  uv_prepare_init(_uv_loop, _fused_prepare.get());
+  uv_check_init(_uv_loop, _fused_check.get());
+  uv_idle_init(_uv_loop, _fused_idle.get());
+  uv_timer_init(_uv_loop, _fused_timer.get());
+  _fused_prepare->data = this;
+  _fused_check->data = this;
+  _fused_idle->data = this;
+  _fused_timer->data = this;
+
+  _fused_evloop->attach_current_thread();
+
+  uv_prepare_start(_fused_prepare.get(), [](uv_prepare_t* h) {
+    static_cast<IoLoop*>(h->data)->on_fused_prepare();
+  });
+  uv_check_start(_fused_check.get(), [](uv_check_t* h) {
+    static_cast<IoLoop*>(h->data)->on_fused_check();
+  });
+
+  // the check callback only runs once a poll completes, so process anything
+  // dispatched before the handles were started
+  _fused_evloop->run_pending();
+}
+
+
+void IoLoop::on_fused_prepare()
+{
+  /* IO thread */
+  if (_fused_evloop->has_pending())
+    uv_idle_start(_fused_idle.get(), [](uv_idle_t*) {});
+  else
+    uv_idle_stop(_fused_idle.get());
+
+  if (auto due = _fused_evloop->next_timer_due()) {
+    auto delay = std::chrono::ceil<std::chrono::milliseconds>(
+        *due - std::chrono::steady_clock::now());
+    uv_timer_start(_fused_timer.get(), [](uv_timer_t*) {},
+                   delay.count() > 0 ? delay.count() : 0, 0);
+  } else
+    uv_timer_stop(_fused_timer.get());
+}
+
+
+void IoLoop::on_fused_check()
+{
+  /* IO thread */
+  _fused_evloop->run_pending();
+}
+
+
+void IoLoop::wake_fused()
+{
+  // counted as a pusher, so the async handle cannot be closed while we signal
+  // it
+  _pushers.fetch_add(1);
+  scope_guard pushed([this]() { _pushers.fetch_sub(1); });
+  if (_pending_requests_state.load() != state::closed &&
+      !_busy_poll.load(std::memory_order_acquire) &&
+      !_wakeup_pending.exchange(true))
+    uv_async_send(_async.get());
+}
+
+
 void libuv_version_runtime(int& major, int& minor)
 {
   // version we are linked to at runtime
@@ -17,10 +17,15 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/infra/IoUring.hpp>
+#include <apex/infra/ReadBufferPool.hpp>
 #include <apex/infra/UvErr.hpp>
+#include <apex/util/MpscQueue.hpp>
 #include <apex/util/utils.hpp>
 
 #include <atomic>
+#include <chrono>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <thread>
@@ -32,6 +37,7 @@ namespace apex
 {
 
 class IoLoop;
+class RealtimeEventLoop;
 class TcpSocket;
 struct io_request;
 
@@ -40,7 +46,7 @@ class HandleData
 public:
   const static uint64_t DATA_CHECK = 0x5555555555555555;
 
-  enum class handle_type { unknown = 0, tcp_socket, tcp_connect };
+  enum class handle_type { unknown = 0, tcp_socket, tcp_connect, udp_socket };
 
   HandleData(TcpSocket* ptr)
     : m_check(DATA_CHECK),
@@ -49,19 +55,24 @@ public:
   {
   }
 
-  HandleData(handle_type ht)
-    : m_check(DATA_CHECK), m_type(ht), m_tcp_socket_ptr(nullptr)
+  HandleData(handle_type ht, void* user_ptr = nullptr)
+    : m_check(DATA_CHECK),
+      m_type(ht),
+      m_tcp_socket_ptr(nullptr),
+      m_user_ptr(user_ptr)
   {
   }
 
   uint64_t check() const { return m_check; }
   TcpSocket* tcp_socket_ptr() { return m_tcp_socket_ptr; }
   handle_type type() const noexcept { return m_type; }
+  void* user_ptr() { return m_user_ptr; }
 
 private:
   uint64_t m_check; /* retain as first member */
   handle_type m_type;
   TcpSocket* m_tcp_socket_ptr;
+  void* m_user_ptr = nullptr;
 };
 
 void free_socket(uv_handle_t* h);
@@ -94,8 +105,66 @@ public:
    */
   void push_fn(std::function<void()>);
 
+  /** Invoke a function on the IO thread at the end of a loop iteration (after
+   * the poll phase), once at least `delay` has elapsed; with zero delay, at the
+   * end of the current iteration.  Allows IO produced during an iteration to be
+   * coalesced and flushed once.  Can be called from any thread; throws
+   * IoLoopClosed if the IO loop is closing or closed.
+   */
+  void defer_fn(std::function<void()>,
+                std::chrono::microseconds delay = std::chrono::microseconds{0});
+
   uv_loop_t* uv_loop() { return _uv_loop; }
 
+  /** Socket read buffers, see ReadBufferPool; acquire & release on the IO
+   * thread only. */
+  ReadBufferPool& read_buffers() { return _read_buffers; }
+
+  /** Use io_uring for the reads and writes of sockets that subsequently
+   * start reading, see IoUring.  Returns false, leaving libuv in use, if not
+   * enabled by the options or not supported by the kernel. */
+  bool enable_io_uring(IoUring::Options);
+
+  /** The io_uring backend, if enabled; fixed after startup, and other than
+   * stats() its methods are for the IO thread only. */
+  IoUring* uring() { return _uring.get(); }
+
+  struct BusyPollOptions {
+    bool enabled = false;
+    // SO_BUSY_POLL of the loop's sockets, for which a receive finding no data
+    // polls the device queue in the kernel; zero leaves the option unset
+    std::chrono::microseconds socket_busy_poll{0};
+  };
+
+  /** Spin the IO thread on non-blocking polls of its sockets, rather than
+   * sleeping in the poll until one is readable, so a packet does not wait for
+   * the thread to be woken, at the cost of a whole core.  Requests pushed to
+   * the loop, and events for a fused event loop, are taken on the next spin,
+   * so other threads no longer make the system call of an async wake-up.
+   * A user-space network stack that takes over the socket calls, such as
+   * OpenOnload, polls the NIC on each of these polls, so with it the receive
+   * path bypasses the kernel with no change to sockets or sessions. */
+  void enable_busy_poll(BusyPollOptions);
+
+  bool is_busy_polling() const
+  {
+    return _busy_poll.load(std::memory_order_relaxed);
+  }
+
+  /** SO_BUSY_POLL applied to sockets of the loop, see BusyPollOptions; IO
+   * thread only. */
+  std::chrono::microseconds socket_busy_poll() const
+  {
+    return _socket_busy_poll;
+  }
+
+  /** Drive the event loop from the IO thread ("fused" mode), so that events
+   * dispatched by IO callbacks are processed on the same thread, in the same
+   * libuv iteration, without a thread handoff.  The event loop must have been
+   * created without its own thread, and this must be called before any work is
+   * dispatched to it. */
+  void attach_event_loop(RealtimeEventLoop*);
+
   /** Test whether current thread is the IO thread */
   bool this_thread_is_io() const;
 
@@ -104,18 +173,82 @@ private:
 
   void on_tcp_connect_cb(uv_connect_t* __req, int status);
 
-  void push_request(std::unique_ptr<io_request>);
+  void push_request(io_request);
+  size_t drain_requests(bool& close_loop);
+  void run_request(io_request&, bool& close_loop);
+  void close_handles();
+
+  void start_fused_handles();
+  void on_fused_prepare();
+  void on_fused_check();
+  void wake_fused();
+
+  void add_deferred(std::chrono::steady_clock::time_point due,
+                    std::function<void()>);
+  void arm_deferred_timer();
+  void on_deferred_check();
 
   uv_loop_t* _uv_loop;
   std::unique_ptr<uv_async_t> _async;
 
-  enum state { open, closing, closed } _pending_requests_state;
-  std::vector<std::unique_ptr<io_request>> _pending_requests;
-  std::mutex _pending_requests_lock;
+  ReadBufferPool _read_buffers;
+  std::unique_ptr<IoUring> _uring;
+
+  // fused mode: the check handle runs the event loop after each poll, and the
+  // prepare handle decides whether the next poll may block; idle and timer
+  // handles keep the poll from blocking while events are pending or a timer
+  // falls due
+  RealtimeEventLoop* _fused_evloop = nullptr;
+  std::unique_ptr<uv_prepare_t> _fused_prepare;
+  std::unique_ptr<uv_check_t> _fused_check;
+  std::unique_ptr<uv_idle_t> _fused_idle;
+  std::unique_ptr<uv_timer_t> _fused_timer;
+
+  // busy polling: the prepare handle takes pushed requests before each
+  // non-blocking poll
+  std::atomic<bool> _busy_poll{false};
+  std::chrono::microseconds _socket_busy_poll{0};
+  std::unique_ptr<uv_prepare_t> _busy_prepare;
+
+  // deferred functions, run by the check handle at the end of an iteration, or
+  // by the timer armed for the earliest due time (IO thread only)
+  struct deferred_fn {
+    std::chrono::steady_clock::time_point due;
+    std::function<void()> fn;
+  };
+  std::vector<deferred_fn> _deferred;
+  std::unique_ptr<uv_check_t> _deferred_check;
+  std::unique_ptr<uv_timer_t> _deferred_timer;
+
+  enum state { open, closing, closed };
+  std::atomic<state> _pending_requests_state;
+
+  // Requests from any thread, for the IO thread, held in the preallocated
+  // slots of a lock-free ring.  Should the ring fill, requests go instead to
+  // the overflow, under its lock, and keep doing so until the IO thread has
+  // emptied it, so that each thread's requests still run in order.
+  std::unique_ptr<MpscQueue<io_request>> _requests;
+  std::vector<std::unique_ptr<io_request>> _overflow;
+  std::atomic<size_t> _overflow_size{0};
+  std::mutex _overflow_lock;
+
+  // set by the thread that sends the async wake-up, and cleared by the IO
+  // thread before it takes requests, so that only the first request pushed
+  // while the IO thread is not already due to wake pays for the wake-up
+  std::atomic<bool> _wakeup_pending{false};
+
+  // threads inside push_request or wake_fused; the async handle is closed only
+  // once none remain, so it is never signalled after closing
+  std::atomic<int> _pushers{0};
 
   synchronized_optional<std::thread::id> _io_thread_id;
 
   std::thread _thread; // prefer as final member, avoid race condition
 };
 
+/* Threads config of an IO loop: "busy_poll" enables busy polling, default
+ * false, and "socket_busy_poll_us" sets the SO_BUSY_POLL of its sockets,
+ * default 0. */
+IoLoop::BusyPollOptions parse_busy_poll_options(Config);
+
 } // namespace apex
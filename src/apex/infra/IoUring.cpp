@@ -0,0 +1,557 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/infra/IoUring.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+static constexpr uint16_t buffer_group = 0;
+
+// user_data of cancel requests, whose completions need no action
+static constexpr uint64_t cancel_user_data = 0;
+
+struct IoUring::Op {
+  enum class kind { recv, send } type;
+  uint64_t socket;
+
+  // send state; iov is advanced over partial sends
+  std::vector<iovec> iov;
+  size_t iov_pos = 0;
+  msghdr msg;
+  std::vector<Write> writes;
+
+  Op(kind k, uint64_t id) : type(k), socket(id) { memset(&msg, 0, sizeof(msg)); }
+};
+
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p)
+{
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete,
+                              unsigned flags)
+{
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+
+static int sys_io_uring_register(int fd, unsigned opcode, void* arg,
+                                 unsigned nr_args)
+{
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+
+static void* map_or_throw(size_t len, int fd, off_t offset)
+{
+  void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+  if (ptr == MAP_FAILED)
+    THROW("io_uring mmap failed: " << strerror(errno));
+  return ptr;
+}
+
+
+static unsigned round_up_pow2(unsigned n)
+{
+  unsigned r = 1;
+  while (r < n)
+    r <<= 1;
+  return r;
+}
+
+
+bool IoUring::is_supported()
+{
+  // multishot receive, and provided buffer rings, need linux 6.0
+  utsname uts;
+  int major = 0, minor = 0;
+  if (uname(&uts) != 0 || sscanf(uts.release, "%d.%d", &major, &minor) != 2 ||
+      major < 6)
+    return false;
+
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  int fd = sys_io_uring_setup(4, &p);
+  if (fd < 0)
+    return false; // such as when disabled by sysctl or seccomp
+  ::close(fd);
+  return (p.features & IORING_FEAT_SINGLE_MMAP) &&
+         (p.features & IORING_FEAT_NODROP);
+}
+
+
+IoUring::IoUring(uv_loop_t* loop, Options options)
+  : _loop(loop), _poll(new uv_poll_t()), _prepare(new uv_prepare_t())
+{
+  io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  p.flags = IORING_SETUP_CQSIZE;
+  p.cq_entries = 4 * round_up_pow2(std::max(options.entries, 4u));
+
+  _ring_fd = sys_io_uring_setup(std::max(options.entries, 4u), &p);
+  if (_ring_fd < 0)
+    THROW("io_uring_setup failed: " << strerror(errno));
+
+  // the SQ and CQ rings share a single mapping
+  _sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  _cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+  _sq_ptr = map_or_throw(_sq_size, _ring_fd, IORING_OFF_SQ_RING);
+  _cq_ptr = _sq_ptr;
+  _sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+  _sqes = static_cast<io_uring_sqe*>(
+      map_or_throw(_sqes_size, _ring_fd, IORING_OFF_SQES));
+
+  auto* sq = static_cast<char*>(_sq_ptr);
+  _sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+  _sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+  _sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+  _sq_entries = p.sq_entries;
+  _sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+  _sq_local_tail = *_sq_tail;
+
+  auto* cq = static_cast<char*>(_cq_ptr);
+  _cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+  _cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+  _cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+  _cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+  // register the receive buffers, as a provided buffer ring
+  _buf_entries = std::min(round_up_pow2(std::max(options.recv_buffers, 2u)),
+                          32768u);
+  _buf_size = std::max<size_t>(options.recv_buffer_size, 1024);
+  _buf_ring_size = _buf_entries * sizeof(io_uring_buf);
+  _buf_ring = mmap(nullptr, _buf_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  _buf_mem_size = _buf_entries * _buf_size;
+  _buf_mem = static_cast<char*>(mmap(nullptr, _buf_mem_size,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (_buf_ring == MAP_FAILED || _buf_mem == MAP_FAILED)
+    THROW("io_uring buffer mmap failed: " << strerror(errno));
+
+  io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = reinterpret_cast<uint64_t>(_buf_ring);
+  reg.ring_entries = _buf_entries;
+  reg.bgid = buffer_group;
+  if (sys_io_uring_register(_ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    THROW("io_uring buffer ring registration failed: " << strerror(errno));
+  for (unsigned i = 0; i < _buf_entries; i++)
+    recycle_buffer(i);
+
+  // completions are signalled via an eventfd, polled by libuv
+  _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (_event_fd < 0)
+    THROW("eventfd failed: " << strerror(errno));
+  if (sys_io_uring_register(_ring_fd, IORING_REGISTER_EVENTFD, &_event_fd, 1) <
+      0)
+    THROW("io_uring eventfd registration failed: " << strerror(errno));
+
+  uv_poll_init(_loop, _poll.get(), _event_fd);
+  _poll->data = this;
+  uv_poll_start(_poll.get(), UV_READABLE, [](uv_poll_t* h, int, int) {
+    auto* self = static_cast<IoUring*>(h->data);
+    uint64_t count;
+    while (::read(self->_event_fd, &count, sizeof(count)) > 0) {
+    }
+    self->reap();
+  });
+
+  // requests prepared during an iteration are submitted together, just
+  // before libuv polls
+  uv_prepare_init(_loop, _prepare.get());
+  _prepare->data = this;
+  uv_prepare_start(_prepare.get(), [](uv_prepare_t* h) {
+    static_cast<IoUring*>(h->data)->submit();
+  });
+}
+
+
+IoUring::~IoUring()
+{
+  if (_ring_fd >= 0)
+    ::close(_ring_fd);
+  if (_event_fd >= 0)
+    ::close(_event_fd);
+  if (_sqes)
+    munmap(_sqes, _sqes_size);
+  if (_sq_ptr)
+    munmap(_sq_ptr, _sq_size);
+  if (_buf_ring && _buf_ring != MAP_FAILED)
+    munmap(_buf_ring, _buf_ring_size);
+  if (_buf_mem && _buf_mem != MAP_FAILED)
+    munmap(_buf_mem, _buf_mem_size);
+}
+
+
+void IoUring::close()
+{
+  if (_closed)
+    return;
+  _closed = true;
+  uv_close(reinterpret_cast<uv_handle_t*>(_poll.get()), nullptr);
+  uv_close(reinterpret_cast<uv_handle_t*>(_prepare.get()), nullptr);
+}
+
+
+io_uring_sqe* IoUring::get_sqe()
+{
+  const unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+  if (_sq_local_tail - head >= _sq_entries) {
+    // the submission queue is full, so submit now, and reap completions to
+    // make room in the completion queue
+    submit();
+    reap();
+  }
+
+  const unsigned index = _sq_local_tail & _sq_mask;
+  io_uring_sqe* sqe = &_sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  _sq_array[index] = index;
+  _sq_local_tail++;
+  _to_submit++;
+  return sqe;
+}
+
+
+void IoUring::submit()
+{
+  if (_to_submit == 0)
+    return;
+
+  __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+
+  while (_to_submit) {
+    int r = sys_io_uring_enter(_ring_fd, _to_submit, 0, 0);
+    if (r > 0) {
+      _submits++;
+      _requests += r;
+      _to_submit -= std::min<unsigned>(_to_submit, r);
+    } else if (r < 0 && (errno == EINTR)) {
+      continue;
+    } else if (r < 0 && (errno == EBUSY || errno == EAGAIN)) {
+      // completion queue overflowed; make room, then retry
+      reap();
+    } else {
+      LOG_ERROR("io_uring_enter failed: " << strerror(errno));
+      return;
+    }
+  }
+}
+
+
+void IoUring::reap()
+{
+  unsigned head = *_cq_head;
+  while (head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE)) {
+    const io_uring_cqe cqe = _cqes[head & _cq_mask];
+    __atomic_store_n(_cq_head, ++head, __ATOMIC_RELEASE);
+    _completions++;
+    try {
+      on_completion(cqe);
+    } catch (std::exception& e) {
+      LOG_ERROR("exception during io_uring completion: " << e.what());
+    }
+    head = *_cq_head; // the completion may itself have reaped
+  }
+}
+
+
+void IoUring::on_completion(const io_uring_cqe& cqe)
+{
+  if (cqe.user_data == cancel_user_data)
+    return;
+
+  auto* op = reinterpret_cast<Op*>(cqe.user_data);
+  if (op->type == Op::kind::recv)
+    on_recv(op, cqe);
+  else
+    on_send(op, cqe);
+}
+
+
+void IoUring::recycle_buffer(unsigned bid)
+{
+  auto* bufs = static_cast<io_uring_buf*>(_buf_ring);
+  io_uring_buf& buf = bufs[_buf_tail & (_buf_entries - 1)];
+  buf.addr = reinterpret_cast<uint64_t>(_buf_mem + bid * _buf_size);
+  buf.len = static_cast<uint32_t>(_buf_size);
+  buf.bid = static_cast<uint16_t>(bid);
+  _buf_tail++;
+
+  // publish via the ring tail, held in the resv field of the first entry
+  auto* ring = static_cast<io_uring_buf_ring*>(_buf_ring);
+  __atomic_store_n(&ring->tail, _buf_tail, __ATOMIC_RELEASE);
+}
+
+
+uint64_t IoUring::add_socket(int fd, on_read_cb on_read)
+{
+  const uint64_t id = _next_id++;
+  auto& sock = _sockets[id];
+  sock.fd = fd;
+  sock.on_read = std::move(on_read);
+  arm_recv(id, sock);
+  return id;
+}
+
+
+void IoUring::arm_recv(uint64_t id, Socket& sock)
+{
+  auto* op = new Op(Op::kind::recv, id);
+  io_uring_sqe* sqe = get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = sock.fd;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = buffer_group;
+  sqe->user_data = reinterpret_cast<uint64_t>(op);
+  sock.inflight++;
+}
+
+
+void IoUring::on_recv(Op* op, const io_uring_cqe& cqe)
+{
+  const bool more = cqe.flags & IORING_CQE_F_MORE;
+  const bool has_buffer = cqe.flags & IORING_CQE_F_BUFFER;
+  const unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+  const uint64_t id = op->socket;
+
+  auto iter = _sockets.find(id);
+  if (iter != _sockets.end() && !iter->second.removing) {
+    uv_buf_t buf = uv_buf_init(nullptr, 0);
+    if (cqe.res > 0 && has_buffer) {
+      _recv_bytes += cqe.res;
+      buf = uv_buf_init(_buf_mem + bid * _buf_size, cqe.res);
+      iter->second.on_read(cqe.res, &buf);
+    } else if (cqe.res == 0) {
+      iter->second.on_read(UV_EOF, &buf);
+    } else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED) {
+      // negative errno values are libuv error codes, on unix
+      iter->second.on_read(cqe.res, &buf);
+    }
+  }
+
+  if (has_buffer)
+    recycle_buffer(bid);
+
+  if (more)
+    return;
+
+  // the multishot receive has ended; restart it, unless the stream has
+  // ended, such as when buffers ran out
+  delete op;
+  iter = _sockets.find(id);
+  if (iter == _sockets.end())
+    return;
+  Socket& sock = iter->second;
+  sock.inflight--;
+  if (!sock.removing && (cqe.res > 0 || cqe.res == -ENOBUFS)) {
+    _recv_rearms++;
+    arm_recv(id, sock);
+  }
+}
+
+
+void IoUring::write(uint64_t id, uv_write_t* req, const uv_buf_t bufs[],
+                    unsigned nbufs, uv_write_cb cb)
+{
+  auto iter = _sockets.find(id);
+  if (iter == _sockets.end() || iter->second.removing) {
+    cb(req, UV_ECANCELED);
+    return;
+  }
+
+  Socket& sock = iter->second;
+  sock.queued.push_back({req, cb});
+  for (unsigned i = 0; i < nbufs; i++)
+    if (bufs[i].len)
+      sock.queued_iov.push_back({bufs[i].base, bufs[i].len});
+
+  if (!sock.send)
+    start_send(id, sock);
+}
+
+
+void IoUring::start_send(uint64_t id, Socket& sock)
+{
+  auto* op = new Op(Op::kind::send, id);
+  op->writes.swap(sock.queued);
+  op->iov.swap(sock.queued_iov);
+  sock.send = op;
+  sock.inflight++;
+  prep_send(op, sock.fd);
+}
+
+
+void IoUring::prep_send(Op* op, int fd)
+{
+  op->msg.msg_iov = op->iov.data() + op->iov_pos;
+  op->msg.msg_iovlen = std::min<size_t>(op->iov.size() - op->iov_pos, IOV_MAX);
+
+  io_uring_sqe* sqe = get_sqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(&op->msg);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = reinterpret_cast<uint64_t>(op);
+}
+
+
+void IoUring::on_send(Op* op, const io_uring_cqe& cqe)
+{
+  auto iter = _sockets.find(op->socket);
+  Socket* sock = iter == _sockets.end() ? nullptr : &iter->second;
+
+  if (cqe.res > 0 && sock && !sock->removing) {
+    // advance over the bytes sent, and continue if any remain
+    size_t sent = cqe.res;
+    while (op->iov_pos < op->iov.size() && sent >= op->iov[op->iov_pos].iov_len)
+      sent -= op->iov[op->iov_pos++].iov_len;
+    if (op->iov_pos < op->iov.size()) {
+      auto& iov = op->iov[op->iov_pos];
+      iov.iov_base = static_cast<char*>(iov.iov_base) + sent;
+      iov.iov_len -= sent;
+      prep_send(op, sock->fd);
+      return;
+    }
+  }
+
+  const int status = cqe.res < 0 ? cqe.res : (op->iov_pos < op->iov.size()
+                                                  ? UV_ECANCELED
+                                                  : 0);
+  std::vector<Write> writes;
+  writes.swap(op->writes);
+  const uint64_t id = op->socket;
+  delete op;
+
+  if (sock) {
+    sock->send = nullptr;
+    sock->inflight--;
+  }
+
+  for (auto& w : writes)
+    w.cb(w.req, status);
+
+  // callbacks may have queued further writes
+  iter = _sockets.find(id);
+  if (iter != _sockets.end() && !iter->second.removing &&
+      !iter->second.send && !iter->second.queued.empty())
+    start_send(id, iter->second);
+}
+
+
+void IoUring::remove_socket(uint64_t id)
+{
+  auto iter = _sockets.find(id);
+  if (iter == _sockets.end())
+    return;
+
+  iter->second.removing = true;
+
+  // writes not yet sent are cancelled
+  std::vector<Write> queued;
+  queued.swap(iter->second.queued);
+  iter->second.queued_iov.clear();
+  for (auto& w : queued)
+    w.cb(w.req, UV_ECANCELED);
+
+  iter = _sockets.find(id);
+  if (iter != _sockets.end() && iter->second.inflight > 0) {
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = iter->second.fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = cancel_user_data;
+    submit();
+
+    // wait for each request to complete, so that no completion can refer to
+    // the socket once it is closed
+    while ((iter = _sockets.find(id)) != _sockets.end() &&
+           iter->second.inflight > 0) {
+      int r = sys_io_uring_enter(_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+      if (r < 0 && errno != EINTR) {
+        LOG_ERROR("io_uring_enter failed: " << strerror(errno));
+        break;
+      }
+      reap();
+    }
+  }
+
+  _sockets.erase(id);
+}
+
+
+IoUring::Stats IoUring::stats() const
+{
+  Stats stats;
+  stats.submits = _submits;
+  stats.requests = _requests;
+  stats.completions = _completions;
+  stats.recv_bytes = _recv_bytes;
+  stats.recv_rearms = _recv_rearms;
+  return stats;
+}
+
+
+IoUring::Options parse_io_uring_options(Config config)
+{
+  IoUring::Options options;
+  if (config.is_empty())
+    return options;
+
+  auto backend = config.get_string("backend", "libuv");
+  if (backend == "io_uring")
+    options.enabled = true;
+  else if (backend != "libuv") {
+    std::ostringstream oss;
+    oss << "invalid IO backend " << QUOTE(backend) << ", " << config.path();
+    throw ConfigError(oss.str());
+  }
+
+  options.entries = config.get_uint("uring_entries", options.entries);
+  options.recv_buffers = config.get_uint("uring_buffers", options.recv_buffers);
+  options.recv_buffer_size =
+      config.get_uint("uring_buffer_kb", options.recv_buffer_size / 1024) * 1024;
+  return options;
+}
+
+} // namespace apex
@@ -0,0 +1,179 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <uv.h>
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace apex
+{
+
+class Config;
+
+/* Optional io_uring data path for connected TcpSockets, owned by the IoLoop.
+ * Connection setup, timers & cross thread requests remain with libuv, but once
+ * a socket starts reading, its reads and writes are performed by the ring:
+ *
+ *   - each socket has a multishot receive, filled from a ring of buffers
+ *     registered with the kernel, so a stream of reads costs no syscalls;
+ *
+ *   - writes are queued as send requests, and all requests prepared during an
+ *     IoLoop iteration are submitted with one system call, before libuv next
+ *     polls; writes to a socket are sent in order, with those queued while a
+ *     send is in progress gathered into the next.
+ *
+ * Completions are signalled via an eventfd polled by libuv.  Only to be used
+ * on the IO thread, apart from stats(). */
+class IoUring
+{
+public:
+  struct Options {
+    bool enabled = false;
+    unsigned entries = 1024;       // submission queue size
+    unsigned recv_buffers = 256;   // rounded up to a power of two
+    size_t recv_buffer_size = 16 * 1024;
+  };
+
+  struct Stats {
+    uint64_t submits = 0;     // io_uring_enter calls that submitted requests
+    uint64_t requests = 0;    // requests submitted
+    uint64_t completions = 0;
+    uint64_t recv_bytes = 0;
+    uint64_t recv_rearms = 0; // multishot receives restarted
+  };
+
+  typedef std::function<void(ssize_t, const uv_buf_t*)> on_read_cb;
+
+  /* Create the ring and register its receive buffers; throws on failure. */
+  IoUring(uv_loop_t*, Options);
+  ~IoUring();
+
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+
+  /* Test whether the kernel provides the required io_uring features. */
+  static bool is_supported();
+
+  /* Begin reading a connected socket; data, and then EOF or an error, are
+   * passed to the callback, as for a libuv read callback. */
+  uint64_t add_socket(int fd, on_read_cb);
+
+  /* Cancel the requests of a socket, returning once all have completed; any
+   * writes not yet sent are completed with UV_ECANCELED.  Must be called
+   * before the socket is closed. */
+  void remove_socket(uint64_t id);
+
+  /* Queue a write, with the same completion semantics as uv_write(). */
+  void write(uint64_t id, uv_write_t* req, const uv_buf_t bufs[],
+             unsigned nbufs, uv_write_cb cb);
+
+  /* Stop polling for completions, as the IoLoop shuts down; sockets can
+   * still be removed. */
+  void close();
+
+  Stats stats() const;
+
+private:
+  struct Op;
+  struct Write {
+    uv_write_t* req;
+    uv_write_cb cb;
+  };
+  struct Socket {
+    int fd;
+    on_read_cb on_read;
+    bool removing = false;
+    int inflight = 0; // requests awaiting a final completion
+    Op* send = nullptr;
+    std::vector<Write> queued;
+    std::vector<iovec> queued_iov;
+  };
+
+  io_uring_sqe* get_sqe();
+  void submit();
+  void reap();
+  void on_completion(const io_uring_cqe&);
+  void on_recv(Op*, const io_uring_cqe&);
+  void on_send(Op*, const io_uring_cqe&);
+  void arm_recv(uint64_t id, Socket&);
+  void start_send(uint64_t id, Socket&);
+  void prep_send(Op*, int fd);
+  void recycle_buffer(unsigned bid);
+
+  // submission & completion rings, mapped from the kernel
+  int _ring_fd = -1;
+  void* _sq_ptr = nullptr;
+  size_t _sq_size = 0;
+  void* _cq_ptr = nullptr;
+  size_t _cq_size = 0;
+  io_uring_sqe* _sqes = nullptr;
+  size_t _sqes_size = 0;
+  unsigned* _sq_head;
+  unsigned* _sq_tail;
+  unsigned* _sq_array;
+  unsigned _sq_mask;
+  unsigned _sq_entries;
+  unsigned* _cq_head;
+  unsigned* _cq_tail;
+  unsigned _cq_mask;
+  io_uring_cqe* _cqes;
+  unsigned _sq_local_tail = 0; // prepared, but not yet published to kernel
+  unsigned _to_submit = 0;
+
+  // provided buffer ring, for multishot receives
+  void* _buf_ring = nullptr;
+  size_t _buf_ring_size = 0;
+  char* _buf_mem = nullptr;
+  size_t _buf_mem_size = 0;
+  unsigned _buf_entries = 0;
+  size_t _buf_size = 0;
+  uint16_t _buf_tail = 0;
+
+  int _event_fd = -1;
+  uv_loop_t* _loop;
+  std::unique_ptr<uv_poll_t> _poll;
+  std::unique_ptr<uv_prepare_t> _prepare;
+  bool _closed = false;
+
+  uint64_t _next_id = 1;
+  std::unordered_map<uint64_t, Socket> _sockets;
+
+  std::atomic<uint64_t> _submits{0};
+  std::atomic<uint64_t> _requests{0};
+  std::atomic<uint64_t> _completions{0};
+  std::atomic<uint64_t> _recv_bytes{0};
+  std::atomic<uint64_t> _recv_rearms{0};
+};
+
+/** Parse io_uring options from the IO thread config, supporting the optional
+ * fields "backend" ("libuv" or "io_uring"), "uring_entries", "uring_buffers"
+ * and "uring_buffer_kb". */
+IoUring::Options parse_io_uring_options(Config config);
+
+} // namespace apex
@@ -0,0 +1,197 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <apex/infra/Ktls.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <openssl/evp.h>
+#include <openssl/kdf.h>
+#include <openssl/ssl.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+namespace apex::ktls
+{
+
+/* HKDF-Expand-Label(secret, label, "", len) */
+static bool expand_label(const EVP_MD* md, const std::string& secret,
+                         const char* label, unsigned char* out, size_t len)
+{
+  unsigned char info[64];
+  size_t label_len = strlen("tls13 ") + strlen(label);
+  info[0] = static_cast<unsigned char>(len >> 8);
+  info[1] = static_cast<unsigned char>(len);
+  info[2] = static_cast<unsigned char>(label_len);
+  memcpy(info + 3, "tls13 ", 6);
+  memcpy(info + 9, label, strlen(label));
+  info[3 + label_len] = 0; // empty context
+  size_t info_len = 4 + label_len;
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_HKDF, nullptr);
+  if (!ctx)
+    return false;
+
+  bool ok =
+      EVP_PKEY_derive_init(ctx) > 0 &&
+      EVP_PKEY_CTX_set_hkdf_mode(ctx, EVP_PKEY_HKDEF_MODE_EXPAND_ONLY) > 0 &&
+      EVP_PKEY_CTX_set_hkdf_md(ctx, md) > 0 &&
+      EVP_PKEY_CTX_set1_hkdf_key(
+          ctx, reinterpret_cast<const unsigned char*>(secret.data()),
+          static_cast<int>(secret.size())) > 0 &&
+      EVP_PKEY_CTX_add1_hkdf_info(ctx, info, static_cast<int>(info_len)) > 0 &&
+      EVP_PKEY_derive(ctx, out, &len) > 0;
+
+  EVP_PKEY_CTX_free(ctx);
+  return ok;
+}
+
+
+bool derive_keys(const SSL_CIPHER* cipher, const std::string& secret,
+                 TrafficKeys& keys)
+{
+  if (!cipher)
+    return false;
+
+  const EVP_MD* md = nullptr;
+  switch (SSL_CIPHER_get_protocol_id(cipher)) {
+    case 0x1301: // TLS_AES_128_GCM_SHA256
+      keys.cipher_type = TLS_CIPHER_AES_GCM_128;
+      keys.key_len = 16;
+      md = EVP_sha256();
+      break;
+    case 0x1302: // TLS_AES_256_GCM_SHA384
+      keys.cipher_type = TLS_CIPHER_AES_GCM_256;
+      keys.key_len = 32;
+      md = EVP_sha384();
+      break;
+    case 0x1303: // TLS_CHACHA20_POLY1305_SHA256
+      keys.cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+      keys.key_len = 32;
+      md = EVP_sha256();
+      break;
+    default:
+      return false;
+  }
+
+  if (secret.size() != static_cast<size_t>(EVP_MD_get_size(md)))
+    return false;
+
+  return expand_label(md, secret, "key", keys.key, keys.key_len) &&
+         expand_label(md, secret, "iv", keys.iv, sizeof(keys.iv));
+}
+
+
+int attach(int fd)
+{
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0)
+    return errno;
+  return 0;
+}
+
+
+template <typename T>
+static int install_info(int fd, bool tx, const TrafficKeys& keys, uint64_t seq,
+                        T& info)
+{
+  info.info.version = TLS_1_3_VERSION;
+  info.info.cipher_type = keys.cipher_type;
+  memcpy(info.key, keys.key, sizeof(info.key));
+
+  // a 12 byte nonce is taken as a salt and an explicit iv, by AES-GCM
+  memcpy(info.salt, keys.iv, sizeof(info.salt));
+  memcpy(info.iv, keys.iv + sizeof(info.salt), sizeof(info.iv));
+
+  for (size_t i = 0; i < sizeof(info.rec_seq); ++i)
+    info.rec_seq[i] = static_cast<unsigned char>(seq >> (8 * (7 - i)));
+
+  int rc = setsockopt(fd, SOL_TLS, tx ? TLS_TX : TLS_RX, &info, sizeof(info));
+  return rc == 0 ? 0 : errno;
+}
+
+
+int install(int fd, bool tx, const TrafficKeys& keys, uint64_t seq)
+{
+  switch (keys.cipher_type) {
+    case TLS_CIPHER_AES_GCM_128: {
+      tls12_crypto_info_aes_gcm_128 info{};
+      return install_info(fd, tx, keys, seq, info);
+    }
+    case TLS_CIPHER_AES_GCM_256: {
+      tls12_crypto_info_aes_gcm_256 info{};
+      return install_info(fd, tx, keys, seq, info);
+    }
+    case TLS_CIPHER_CHACHA20_POLY1305: {
+      tls12_crypto_info_chacha20_poly1305 info{};
+      return install_info(fd, tx, keys, seq, info);
+    }
+  }
+  return EINVAL;
+}
+
+
+void RecordCounter::feed(const char* src, size_t len)
+{
+  while (len) {
+    if (_body_remain) {
+      size_t take = std::min(_body_remain, len);
+      _body_remain -= take;
+      _offset += take;
+      src += take;
+      len -= take;
+      if (_body_remain == 0 && _header[0] == application_data)
+        _ends.push_back(_offset);
+      continue;
+    }
+
+    _header[_header_len++] = *src++;
+    --len;
+    ++_offset;
+    if (_header_len == sizeof(_header)) {
+      _header_len = 0;
+      _body_remain = (size_t(_header[3]) << 8) | _header[4];
+      if (_body_remain == 0 && _header[0] == application_data)
+        _ends.push_back(_offset);
+    }
+  }
+}
+
+
+uint64_t RecordCounter::records_before(uint64_t offset)
+{
+  while (!_ends.empty() && _ends.front() <= offset) {
+    _ends.pop_front();
+    ++_counted;
+  }
+  return _counted;
+}
+
+} // namespace apex::ktls
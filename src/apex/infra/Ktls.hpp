@@ -0,0 +1,86 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+typedef struct ssl_cipher_st SSL_CIPHER;
+
+namespace apex::ktls
+{
+
+/* Record protection of one direction of a TLS 1.3 connection, in the form
+ * the kernel takes it. */
+struct TrafficKeys {
+  int cipher_type = 0; // TLS_CIPHER_* of linux/tls.h
+  unsigned char key[32];
+  size_t key_len = 0;
+  unsigned char iv[12];
+};
+
+/* Derive the key and iv of a TLS 1.3 traffic secret (RFC8446 section 7.3).
+ * Returns false for ciphers the kernel cannot offload. */
+bool derive_keys(const SSL_CIPHER*, const std::string& secret, TrafficKeys&);
+
+/* Attach the kernel TLS upper layer protocol to a connected TCP socket.
+ * Returns 0, or an errno value if the kernel lacks TLS support. */
+int attach(int fd);
+
+/* Hand record protection of one direction over to the kernel, starting at
+ * record sequence number `seq`.  Returns 0 or an errno value. */
+int install(int fd, bool tx, const TrafficKeys&, uint64_t seq);
+
+
+/* Follow the TLS record boundaries in one direction of a connection's byte
+ * stream, to establish how many encrypted records have passed a point, and so
+ * the sequence number the kernel must continue from. TLS 1.3 sends every
+ * encrypted record with the outer application_data type. */
+class RecordCounter
+{
+public:
+  static constexpr uint8_t application_data = 23;
+
+  /* Add the next bytes of the stream */
+  void feed(const char*, size_t);
+
+  /* Number of application_data records ending within the first `offset`
+   * bytes of the stream; offsets must not decrease between calls. */
+  uint64_t records_before(uint64_t offset);
+
+  /* Bytes fed so far */
+  uint64_t offset() const { return _offset; }
+
+  /* Whether the bytes fed end on a record boundary */
+  bool at_boundary() const { return _header_len == 0 && _body_remain == 0; }
+
+private:
+  uint64_t _offset = 0;
+  unsigned char _header[5];
+  size_t _header_len = 0;
+  size_t _body_remain = 0;
+
+  // ends of the complete application_data records not yet counted
+  std::deque<uint64_t> _ends;
+  uint64_t _counted = 0;
+};
+
+} // namespace apex::ktls
@@ -0,0 +1,63 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/infra/ReadBufferPool.hpp>
+
+namespace apex
+{
+
+char* ReadBufferPool::acquire()
+{
+  /* IO thread */
+  if (_free.empty()) {
+    _slabs.emplace_back(new char[buffer_size * buffers_per_slab]);
+    char* slab = _slabs.back().get();
+    _free.reserve(_free.size() + buffers_per_slab);
+    for (size_t i = buffers_per_slab; i > 0; i--)
+      _free.push_back(slab + (i - 1) * buffer_size);
+    _capacity += buffers_per_slab;
+  }
+
+  char* buf = _free.back();
+  _free.pop_back();
+
+  _acquired++;
+  auto in_flight = ++_in_flight;
+  if (in_flight > _peak_in_flight)
+    _peak_in_flight = in_flight;
+  return buf;
+}
+
+
+void ReadBufferPool::release(char* buf)
+{
+  /* IO thread */
+  _free.push_back(buf);
+  _in_flight--;
+}
+
+
+ReadBufferPool::Stats ReadBufferPool::stats() const
+{
+  Stats stats;
+  stats.in_flight = _in_flight;
+  stats.peak_in_flight = _peak_in_flight;
+  stats.capacity = _capacity;
+  stats.acquired = _acquired;
+  return stats;
+}
+
+} // namespace apex
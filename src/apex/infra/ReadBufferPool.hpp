@@ -0,0 +1,65 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace apex
+{
+
+/* Pool of fixed size socket read buffers, owned by an IoLoop.  Buffers are
+ * carved from slabs, allocated as demand grows and retained for the life of
+ * the pool, so that once warmed up, a socket read needs no heap allocation.
+ * A buffer is held only while the read callback runs, so the number in flight
+ * is normally at most one per loop.  Acquire and release are for the IO thread
+ * only; the statistics may be read from any thread. */
+class ReadBufferPool
+{
+public:
+  static constexpr size_t buffer_size = 64 * 1024;
+  static constexpr size_t buffers_per_slab = 8;
+
+  struct Stats {
+    size_t in_flight = 0;      // buffers currently held by read callbacks
+    size_t peak_in_flight = 0;
+    size_t capacity = 0;       // buffers allocated
+    size_t acquired = 0;       // total acquisitions
+  };
+
+  ReadBufferPool() = default;
+  ReadBufferPool(const ReadBufferPool&) = delete;
+  ReadBufferPool& operator=(const ReadBufferPool&) = delete;
+
+  char* acquire();
+  void release(char*);
+
+  Stats stats() const;
+
+private:
+  std::vector<std::unique_ptr<char[]>> _slabs;
+  std::vector<char*> _free;
+
+  std::atomic<size_t> _in_flight{0};
+  std::atomic<size_t> _peak_in_flight{0};
+  std::atomic<size_t> _capacity{0};
+  std::atomic<size_t> _acquired{0};
+};
+
+} // namespace apex
@@ -0,0 +1,163 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/infra/RingDecodeBuffer.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/MemoryPolicy.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+static size_t round_to_pages(size_t len)
+{
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  return std::max<size_t>(1, (len + page_size - 1) / page_size) * page_size;
+}
+
+
+RingDecodeBuffer::RingDecodeBuffer(const Policy& policy)
+  : _max_size(round_to_pages(std::max(policy.initial_size, policy.max_size))),
+    _sizing(policy),
+    _charge(decode_buffer_memory())
+{
+  remap(round_to_pages(policy.initial_size));
+}
+
+
+RingDecodeBuffer::RingDecodeBuffer(size_t initial_size, size_t max_size)
+  : RingDecodeBuffer(Policy{initial_size, max_size})
+{
+}
+
+
+RingDecodeBuffer::~RingDecodeBuffer()
+{
+  if (_mem)
+    munmap(_mem, 2 * _capacity);
+}
+
+
+void RingDecodeBuffer::update_max_size(size_t new_max)
+{
+  new_max = round_to_pages(new_max);
+  if (new_max == _max_size)
+    return;
+
+  if ((new_max < _max_size) && (new_max < _capacity))
+    throw std::runtime_error("unable to reduce RingDecodeBuffer max size");
+
+  _max_size = new_max;
+  auto policy = _sizing.policy();
+  policy.max_size = new_max;
+  _sizing.set_policy(policy);
+}
+
+
+void RingDecodeBuffer::set_policy(const Policy& policy)
+{
+  _sizing.set_policy(policy);
+  _max_size = round_to_pages(std::max(policy.initial_size, policy.max_size));
+  const size_t baseline = round_to_pages(policy.initial_size);
+  if (_bytes_avail <= baseline && _capacity != baseline)
+    remap(baseline);
+}
+
+
+size_t RingDecodeBuffer::consume(const char* src, size_t len)
+{
+  if (space() < len && _capacity < _max_size)
+    remap(std::min(_max_size, round_to_pages(_sizing.grow_to(
+                                  _capacity, _bytes_avail + len))));
+
+  size_t consume_len = (std::min)(space(), len);
+  if (len && consume_len == 0)
+    throw decode_buffer_overflow("RingDecodeBuffer full, cannot consume data");
+
+  // the second mapping makes the free space contiguous too
+  memcpy(_mem + _head + _bytes_avail, src, consume_len);
+  _bytes_avail += consume_len;
+  _sizing.on_consume(_bytes_avail);
+
+  return consume_len;
+}
+
+
+void RingDecodeBuffer::discard(const read_pointer& rd)
+{
+  _head = (_head + rd.consumed()) % _capacity;
+  _bytes_avail = rd.avail();
+  if (_bytes_avail == 0)
+    _head = 0;
+
+  const size_t baseline = round_to_pages(_sizing.policy().initial_size);
+  if (_sizing.on_discard(_capacity, baseline, _bytes_avail))
+    remap(baseline);
+}
+
+
+void RingDecodeBuffer::remap(size_t capacity)
+{
+  int fd = memfd_create("apex-decode-ring", MFD_CLOEXEC);
+  if (fd == -1)
+    THROW("memfd_create failed: " << strerror(errno));
+
+  if (ftruncate(fd, capacity) == -1) {
+    int err = errno;
+    ::close(fd);
+    THROW("ftruncate failed: " << strerror(err));
+  }
+
+  // reserve the address range, then map the ring into each half
+  char* mem = static_cast<char*>(
+      mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+  if (mem == MAP_FAILED) {
+    int err = errno;
+    ::close(fd);
+    THROW("mmap failed: " << strerror(err));
+  }
+
+  // optionally pre-fault, so the first messages after growth do not fault
+  const int populate = memory::prefault_enabled() ? MAP_POPULATE : 0;
+  for (size_t offset : {size_t(0), capacity}) {
+    if (mmap(mem + offset, capacity, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED | populate, fd, 0) == MAP_FAILED) {
+      int err = errno;
+      munmap(mem, 2 * capacity);
+      ::close(fd);
+      THROW("mmap failed: " << strerror(err));
+    }
+  }
+  ::close(fd);
+
+  if (_mem) {
+    memcpy(mem, _mem + _head, _bytes_avail);
+    munmap(_mem, 2 * _capacity);
+  }
+  _mem = mem;
+  _capacity = capacity;
+  _head = 0;
+  _charge.set(_capacity);
+}
+
+} // namespace apex
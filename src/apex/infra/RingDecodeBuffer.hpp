@@ -0,0 +1,88 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <apex/infra/DecodeBuffer.hpp>
+
+#include <cstddef>
+
+namespace apex
+{
+
+/* A DecodeBuffer held in a ring, for decoding a stream of messages without
+ * compaction.  The ring memory is mapped twice, at consecutive addresses, so
+ * the unread bytes are always contiguous, even when they wrap around the end
+ * of the ring; discarding decoded bytes just advances the read offset.  The
+ * capacity is a multiple of the page size, and is sized by a
+ * DecodeBufferPolicy: the ring grows only when it cannot hold the unread bytes
+ * plus the new data, and shrinks after a burst; growth, like consume(),
+ * invalidates any read_pointer. */
+class RingDecodeBuffer
+{
+public:
+  using read_pointer = DecodeBuffer::read_pointer;
+  using Policy = DecodeBufferPolicy;
+  using Stats = DecodeBufferStats;
+
+  explicit RingDecodeBuffer(const Policy&);
+  RingDecodeBuffer(size_t initial_size, size_t max_size);
+  ~RingDecodeBuffer();
+
+  RingDecodeBuffer(const RingDecodeBuffer&) = delete;
+  RingDecodeBuffer& operator=(const RingDecodeBuffer&) = delete;
+
+  /** size of data present in the buffer ready to be processed */
+  size_t avail() const { return _bytes_avail; }
+
+  /** current space for new data */
+  size_t space() const { return _capacity - _bytes_avail; }
+
+  /** current ring capacity */
+  size_t capacity() const { return _capacity; }
+
+  /** copy in new bytes, growing the ring if necessary */
+  size_t consume(const char* src, size_t len);
+
+  /** obtain a read pointer, to all unread bytes */
+  read_pointer read_ptr() { return {_mem + _head, _bytes_avail}; }
+
+  /** drop the bytes consumed via the read pointer */
+  void discard(const read_pointer&);
+
+  void update_max_size(size_t);
+
+  /* Replace the policy; the ring is remapped at the new initial size if it
+   * holds no more than that.  Invalidates any read_pointer. */
+  void set_policy(const Policy&);
+
+  const Policy& policy() const { return _sizing.policy(); }
+
+  const Stats& stats() const { return _sizing.stats(); }
+
+private:
+  void remap(size_t capacity);
+
+  char* _mem = nullptr; // two mappings of the ring, each of _capacity bytes
+  size_t _capacity = 0;
+  size_t _max_size;
+  size_t _head = 0; // offset of first unread byte
+  size_t _bytes_avail = 0;
+  DecodeBufferSizing _sizing;
+  memory::Charge _charge; // "decode_buffers", of one mapping
+};
+
+} // namespace apex
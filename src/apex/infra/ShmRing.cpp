@@ -0,0 +1,284 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/infra/ShmRing.hpp>
+#include <apex/util/Error.hpp>
+
+#include <climits>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace apex
+{
+
+namespace
+{
+constexpr uint32_t ring_magic = 0x474e5253; // "SRNG"
+constexpr uint32_t ring_version = 1;
+constexpr size_t control_size = 4096;
+
+constexpr uint32_t record_message = 1;
+constexpr uint32_t record_padding = 2;
+
+size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+// futexes in shared memory must not use the FUTEX_PRIVATE_FLAG variants
+void futex_wait(std::atomic<uint32_t>* addr, uint32_t expected,
+                std::chrono::microseconds timeout)
+{
+  timespec ts;
+  ts.tv_sec = timeout.count() / 1000000;
+  ts.tv_nsec = (timeout.count() % 1000000) * 1000;
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT,
+            expected, &ts, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t>* addr)
+{
+  ::syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE, INT_MAX,
+            nullptr, nullptr, 0);
+}
+} // namespace
+
+
+struct ShmRing::Control {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+
+  // written by the producer
+  alignas(64) std::atomic<uint64_t> head;
+
+  // written by the consumer
+  alignas(64) std::atomic<uint64_t> tail;
+
+  alignas(64) std::atomic<uint32_t> futex_seq;
+  std::atomic<uint32_t> waiting;
+  std::atomic<uint32_t> closed;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+
+std::unique_ptr<ShmRing> ShmRing::create(const std::string& name,
+                                         size_t capacity)
+{
+  size_t cap = 4096;
+  while (cap < capacity)
+    cap <<= 1;
+  const size_t mapped_size = control_size + cap;
+
+  int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd == -1)
+    THROW("shm_open failed for " << name << ": " << strerror(errno));
+
+  if (::ftruncate(fd, mapped_size) == -1) {
+    int err = errno;
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    THROW("ftruncate failed for " << name << ": " << strerror(err));
+  }
+
+  void* addr =
+      ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    ::shm_unlink(name.c_str());
+    THROW("mmap failed for " << name << ": " << strerror(errno));
+  }
+
+  // the segment is zero filled, so only the fixed fields need be set
+  auto* control = new (addr) Control();
+  control->capacity = cap;
+  control->version = ring_version;
+  std::atomic_thread_fence(std::memory_order_release);
+  control->magic = ring_magic;
+
+  return std::unique_ptr<ShmRing>(new ShmRing(name, addr, mapped_size));
+}
+
+
+std::unique_ptr<ShmRing> ShmRing::open(const std::string& name)
+{
+  int fd = ::shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd == -1)
+    THROW("shm_open failed for " << name << ": " << strerror(errno));
+
+  struct stat st;
+  if (::fstat(fd, &st) == -1 || size_t(st.st_size) <= control_size) {
+    ::close(fd);
+    THROW("invalid shared memory ring " << name);
+  }
+
+  const size_t mapped_size = st.st_size;
+  void* addr =
+      ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED)
+    THROW("mmap failed for " << name << ": " << strerror(errno));
+
+  auto* control = static_cast<Control*>(addr);
+  if (control->magic != ring_magic || control->version != ring_version ||
+      control->capacity + control_size != mapped_size) {
+    ::munmap(addr, mapped_size);
+    THROW("invalid shared memory ring " << name);
+  }
+
+  return std::unique_ptr<ShmRing>(new ShmRing(name, addr, mapped_size));
+}
+
+
+ShmRing::ShmRing(std::string name, void* addr, size_t mapped_size)
+  : _name(std::move(name)),
+    _addr(addr),
+    _mapped_size(mapped_size),
+    _control(static_cast<Control*>(addr)),
+    _data(static_cast<char*>(addr) + control_size),
+    _capacity(_control->capacity)
+{
+}
+
+
+ShmRing::~ShmRing() { ::munmap(_addr, _mapped_size); }
+
+
+void ShmRing::unlink() { ::shm_unlink(_name.c_str()); }
+
+
+size_t ShmRing::used_bytes() const
+{
+  return _control->head.load(std::memory_order_acquire) -
+         _control->tail.load(std::memory_order_acquire);
+}
+
+
+void ShmRing::close()
+{
+  _control->closed.store(1);
+  wake();
+}
+
+
+bool ShmRing::is_closed() const { return _control->closed.load() != 0; }
+
+
+char* ShmRing::reserve(size_t len)
+{
+  static_assert(sizeof(Record) == 8);
+  const size_t rec_len = align8(sizeof(Record) + len);
+  if (len > max_message_size())
+    THROW("message of " << len << " bytes exceeds shared memory ring limit");
+
+  uint64_t head = _control->head.load(std::memory_order_relaxed);
+  const uint64_t tail = _control->tail.load(std::memory_order_acquire);
+
+  size_t pos = head & (_capacity - 1);
+  const size_t contiguous = _capacity - pos;
+  const size_t needed = rec_len + (rec_len > contiguous ? contiguous : 0);
+  if (_capacity - (head - tail) < needed)
+    return nullptr;
+
+  if (rec_len > contiguous) {
+    // pad to the end of the ring; published along with the message
+    auto* pad = reinterpret_cast<Record*>(_data + pos);
+    pad->len = contiguous - sizeof(Record);
+    pad->type = record_padding;
+    head += contiguous;
+    pos = 0;
+  }
+
+  auto* record = reinterpret_cast<Record*>(_data + pos);
+  record->len = len;
+  record->type = record_message;
+  _reserved_head = head + rec_len;
+  return reinterpret_cast<char*>(record + 1);
+}
+
+
+void ShmRing::publish()
+{
+  _control->head.store(_reserved_head, std::memory_order_release);
+
+  // pairs with the consumer setting `waiting` before it checks for messages
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (_control->waiting.load(std::memory_order_relaxed))
+    wake();
+}
+
+
+char* ShmRing::front(size_t& len)
+{
+  uint64_t tail = _control->tail.load(std::memory_order_relaxed);
+  const uint64_t head = _control->head.load(std::memory_order_acquire);
+
+  while (tail != head) {
+    auto* record = reinterpret_cast<Record*>(_data + (tail & (_capacity - 1)));
+    if (record->type == record_padding) {
+      tail += sizeof(Record) + record->len;
+      _control->tail.store(tail, std::memory_order_release);
+      continue;
+    }
+    len = record->len;
+    return reinterpret_cast<char*>(record + 1);
+  }
+  return nullptr;
+}
+
+
+void ShmRing::pop()
+{
+  uint64_t tail = _control->tail.load(std::memory_order_relaxed);
+  auto* record = reinterpret_cast<Record*>(_data + (tail & (_capacity - 1)));
+  tail += align8(sizeof(Record) + record->len);
+  _control->tail.store(tail, std::memory_order_release);
+}
+
+
+bool ShmRing::wait(std::chrono::microseconds timeout)
+{
+  auto available = [this]() {
+    return _control->head.load(std::memory_order_acquire) !=
+           _control->tail.load(std::memory_order_relaxed);
+  };
+
+  if (available())
+    return true;
+
+  const uint32_t seq = _control->futex_seq.load(std::memory_order_acquire);
+  _control->waiting.store(1, std::memory_order_seq_cst);
+
+  if (!available() && !is_closed())
+    futex_wait(&_control->futex_seq, seq, timeout);
+
+  _control->waiting.store(0, std::memory_order_relaxed);
+  return available();
+}
+
+
+void ShmRing::wake()
+{
+  _control->futex_seq.fetch_add(1, std::memory_order_release);
+  futex_wake(&_control->futex_seq);
+}
+
+} // namespace apex
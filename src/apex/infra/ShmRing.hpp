@@ -0,0 +1,140 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace apex
+{
+
+/* A single producer, single consumer ring of messages, held in a POSIX shared
+ * memory segment, for low latency messaging between processes on the same
+ * host.  One process creates the ring, and its peer opens it by name.
+ *
+ * Messages are stored contiguously, each as a record of a small prefix and the
+ * message bytes, padded to 8 bytes; a message that does not fit before the end
+ * of the ring is preceded by a padding record, so a reader can always process
+ * a message in place.  The consumer either polls for messages, or sleeps on a
+ * futex in the segment, which the producer wakes only when a consumer is
+ * waiting.
+ *
+ * Producers must be serialised by the caller; the ring itself provides no
+ * locking. */
+class ShmRing
+{
+public:
+  /* Create a ring of `capacity` bytes, rounded up to a power of two. */
+  static std::unique_ptr<ShmRing> create(const std::string& name,
+                                         size_t capacity);
+
+  /* Open a ring created by a peer; throws if not found or invalid. */
+  static std::unique_ptr<ShmRing> open(const std::string& name);
+
+  ~ShmRing();
+
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  /* Remove the segment name; the mapping remains valid in each process that
+   * has the ring open. */
+  void unlink();
+
+  const std::string& name() const { return _name; }
+  size_t capacity() const { return _capacity; }
+
+  // largest message that can be written
+  size_t max_message_size() const { return _capacity / 2 - sizeof(Record); }
+
+  /* Bytes written but not yet consumed. */
+  size_t used_bytes() const;
+
+  /* Mark the ring closed, waking any waiting consumer.  Messages already
+   * written can still be read. */
+  void close();
+  bool is_closed() const;
+
+  /* Producer: reserve space for a message of `len` bytes, encode it in place
+   * via `encode(char*)`, then publish it.  Returns false, without calling
+   * `encode`, if the ring has insufficient free space. */
+  template <typename F> bool write(size_t len, F&& encode)
+  {
+    char* dest = reserve(len);
+    if (!dest)
+      return false;
+    encode(dest);
+    publish();
+    return true;
+  }
+
+  bool write(const char* src, size_t len)
+  {
+    return write(len, [&](char* dest) { memcpy(dest, src, len); });
+  }
+
+  /* Consumer: invoke `fn(char*, size_t)` for each available message, which
+   * can be modified in place, and return the number of messages read.  The
+   * space of each message is released once `fn` returns. */
+  template <typename F> size_t read(F&& fn)
+  {
+    size_t count = 0;
+    char* msg;
+    size_t len;
+    while ((msg = front(len)) != nullptr) {
+      fn(msg, len);
+      pop();
+      count++;
+    }
+    return count;
+  }
+
+  /* Consumer: sleep until a message is available, the ring is closed, or the
+   * timeout elapses.  Returns true if a message is available. */
+  bool wait(std::chrono::microseconds timeout);
+
+private:
+  struct Record {
+    uint32_t len; // message length, excluding this prefix
+    uint32_t type;
+  };
+
+  struct Control;
+
+  ShmRing(std::string name, void* addr, size_t mapped_size);
+
+  char* reserve(size_t len);
+  void publish();
+  char* front(size_t& len);
+  void pop();
+  void wake();
+
+  std::string _name;
+  void* _addr;
+  size_t _mapped_size;
+  Control* _control;
+  char* _data;
+  size_t _capacity;
+
+  // producer state, the record being written
+  uint64_t _reserved_head = 0;
+};
+
+} // namespace apex
@@ -115,4 +115,28 @@ int SocketAddress::port() const
 }
 
 
+bool SocketAddress::is_loopback() const
+{
+  ::sockaddr_storage* ss = _impl.get();
+  if (ss == nullptr)
+    return false;
+
+  if (ss->ss_family == AF_INET) {
+    auto* addr = (::sockaddr_in*)ss;
+    return (ntohl(addr->sin_addr.s_addr) >> 24) == 127;
+  }
+
+  if (ss->ss_family == AF_INET6) {
+    auto* addr = (::sockaddr_in6*)ss;
+    if (IN6_IS_ADDR_LOOPBACK(&addr->sin6_addr))
+      return true;
+    // IPv4 mapped, ::ffff:127.x.x.x
+    return IN6_IS_ADDR_V4MAPPED(&addr->sin6_addr) &&
+           addr->sin6_addr.s6_addr[12] == 127;
+  }
+
+  return false;
+}
+
+
 } // namespace apex
@@ -27,6 +27,7 @@ namespace apex
 {
 
 class TcpSocket;
+class AddressCache;
 
 /** Socket address, essentially a wrapper around the socket API's
  * sockaddr_storage structure, with some utility methods provided. */
@@ -52,12 +53,17 @@ public:
   /** Return the local port. */
   [[nodiscard]] int port() const;
 
+  /** Test whether the address is a loopback address, i.e., of this host. */
+  [[nodiscard]] bool is_loopback() const;
+
   void swap(SocketAddress&);
 
 private:
   using impl_type = std::unique_ptr<sockaddr_storage>;
   impl_type _impl;
   friend class TcpSocket;
+  friend class AddressCache;
+class AddressCache;
 };
 
 } // namespace apex
@@ -18,13 +18,12 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/infra/SslSocket.hpp>
 #include <apex/infra/IoLoop.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/infra/Ktls.hpp>
 #include <apex/infra/ssl.hpp>
 #include <apex/util/utils.hpp>
 
 #include <cassert>
 
-#define DEFAULT_BUF_SIZE 4096
-
 /* For SSL failure, represent that during the user on_error callback with a
  * suitable UV error code. */
 #define SSL_UV_FAIL UV_EPROTO
@@ -52,6 +51,24 @@ SslSocket::SslSocket(SslContext& sslContext, IoLoop& io_loop_, uv_tcp_t* h,
 }
 
 
+struct SslSocket::KtlsSetup {
+  // record boundaries of the encrypted streams, in & out
+  ktls::RecordCounter rx;
+  ktls::RecordCounter tx;
+
+  // records of each stream sent under handshake keys, known once the
+  // handshake is finished
+  bool established = false;
+  uint64_t rx_base = 0;
+  uint64_t tx_base = 0;
+
+  // wait for the first application data before switching, since a server
+  // sends its session tickets ahead of it, and the kernel fails a read on
+  // any record that is not application data
+  bool app_data_seen = false;
+};
+
+
 SslSocket::SslSocket(SslContext& sslContext, IoLoop& io_loop_,
                      TcpSocket::options options)
   : TcpSocket(io_loop_, options),
@@ -59,6 +76,8 @@ SslSocket::SslSocket(SslContext& sslContext, IoLoop& io_loop_,
     _ssl(new SslSession(&sslContext, connect_mode::active)),
     _handshake_state(t_handshake_state::pending)
 {
+  if (sslContext.ktls_enabled())
+    _ktls = std::make_unique<KtlsSetup>();
 }
 
 
@@ -91,22 +110,41 @@ std::future<UvErr> SslSocket::listen(const std::string& node,
 }
 
 
-/* Service bytes waiting on the m_pending_write queue, which are due to be
+void SslSocket::write(std::shared_ptr<const void> owner, const char* src,
+                      size_t len)
+{
+  // bytes are encrypted on the IO thread, so a copy must be queued, unless the
+  // kernel does the encryption
+  if (is_ktls_tx())
+    TcpSocket::write(std::move(owner), src, len);
+  else
+    TcpSocket::write(src, len);
+}
+
+
+/* Service bytes waiting on the write queue, which are due to be
  * written out of the SSL socket. These bytes must first be encrypted, and then
  * written to the underlying socket. */
 void SslSocket::service_pending_write()
 {
   assert(get_io_loop().this_thread_is_io() == true);
 
-  // accept all unencrypted bytes that are waiting to be written
-  std::vector<uv_buf_t> bufs;
-  {
-    std::lock_guard<std::mutex> guard(_pending_write_lock);
-    if (_pending_write.empty())
-      return;
-    _pending_write.swap(bufs);
+  if (is_ktls_tx()) {
+    TcpSocket::service_pending_write();
+    return;
   }
 
+  // encrypted output of all the writes below goes to the socket as one write
+  scope_guard flush_guard([this]() {
+    if (!flush_ssl_output())
+      _io_on_error(UvErr(SSL_UV_FAIL));
+  });
+
+  // accept all unencrypted bytes that are waiting to be written
+  std::vector<uv_buf_t> bufs = take_pending_write();
+  if (bufs.empty())
+    return;
+
   scope_guard buf_guard([&bufs]() {
     for (auto& i : bufs)
       delete[] i.base;
@@ -118,6 +156,7 @@ void SslSocket::service_pending_write()
       auto r = do_encrypt_and_write(it->base + consumed, it->len - consumed);
 
       if (r.first == -1) {
+        flush_guard.release();
         _io_on_error(UvErr(SSL_UV_FAIL));
         return; /* SSL failed, so okay to discard all objects in 'bufs' */
       }
@@ -138,9 +177,7 @@ void SslSocket::service_pending_write()
         it->base = nullptr; /* prevent scope guard freeing the unused bytes */
       }
 
-      std::lock_guard<std::mutex> guard(_pending_write_lock);
-      tmp.insert(tmp.end(), _pending_write.begin(), _pending_write.end());
-      _pending_write.swap(tmp);
+      return_pending_write(std::move(tmp));
 
       /* break loop, because iterator has been incremented in loop body,
        * otherwise the it!=end check() can be skipped over */
@@ -151,14 +188,12 @@ void SslSocket::service_pending_write()
 
 
 /* Attempt to encrypt a single block of data, by putting it through the SSL
- * object, and then take the output (representing the encrypted data) and queue
- * for socket write. Returns first==-1 on failure. */
+ * object; the output, representing the encrypted data, is left in the write
+ * bio for flush_ssl_output. Returns first==-1 on failure. */
 std::pair<int, size_t> SslSocket::do_encrypt_and_write(char* src, size_t len)
 {
   assert(get_io_loop().this_thread_is_io() == true);
 
-  char buf[DEFAULT_BUF_SIZE];
-
   if (!SSL_is_init_finished(_ssl->ssl)) {
     if (do_handshake() == sslstatus::fail)
       return {-1, 0};
@@ -170,22 +205,35 @@ std::pair<int, size_t> SslSocket::do_encrypt_and_write(char* src, size_t len)
   if (get_sslstatus(_ssl->ssl, w) == sslstatus::fail)
     return {-1, 0};
 
-  /* take the output of the SSL object and queue it for socket write */
-  int n;
-  do {
-    /* If BIO_read successfully obtained data, then n > 0.  A return value
-     * of 0 or -1 does not necessarily indicate an error, in particular,
-     * when used with our non-blocking memory bio. To check for an error, we
-     * must use BIO_should_retry.*/
+  return {0, w};
+}
 
-    n = BIO_read(_ssl->wbio, buf, sizeof(buf));
-    if (n > 0)
-      write_encrypted_bytes(buf, n);
-    else if (!BIO_should_retry(_ssl->wbio))
-      return {-1, 0};
-  } while (n > 0);
 
-  return {0, w};
+/* Take all output of the SSL object, and queue it as a single socket write.
+ * Returns false on failure. */
+bool SslSocket::flush_ssl_output()
+{
+  assert(get_io_loop().this_thread_is_io() == true);
+
+  size_t len = BIO_ctrl_pending(_ssl->wbio);
+  if (len == 0)
+    return true;
+
+  uv_buf_t buf = uv_buf_init(new char[len], len);
+  scope_guard buf_guard([&buf]() { delete[] buf.base; });
+
+  /* A memory bio hands over all its pending bytes in one read. */
+  if (BIO_read(_ssl->wbio, buf.base, static_cast<int>(len)) !=
+      static_cast<int>(len))
+    return false;
+
+  if (_ktls)
+    _ktls->tx.feed(buf.base, len);
+
+  std::vector<uv_buf_t> bufs{buf};
+  buf_guard.release();
+  do_write(bufs);
+  return true;
 }
 
 
@@ -217,8 +265,6 @@ sslstatus SslSocket::do_handshake()
 {
   assert(get_io_loop().this_thread_is_io() == true);
 
-  char buf[DEFAULT_BUF_SIZE];
-
   int n = SSL_do_handshake(_ssl->ssl);
   sslstatus status = get_sslstatus(_ssl->ssl, n);
 
@@ -230,20 +276,20 @@ sslstatus SslSocket::do_handshake()
     return status;
   }
 
-  /* Did SSL request to write bytes? */
-  if (status == sslstatus::want_io)
-    do {
-      n = BIO_read(_ssl->wbio, buf, sizeof(buf));
-      if (n > 0)
-        write_encrypted_bytes(buf, n);
-      else if (!BIO_should_retry(_ssl->wbio))
-        return sslstatus::fail;
-    } while (n > 0);
+  /* Send whatever SSL wants written; a finishing handshake can leave output
+   * without requesting more IO. */
+  if (!flush_ssl_output())
+    return sslstatus::fail;
 
   if (SSL_is_init_finished(_ssl->ssl) &&
       _handshake_state == t_handshake_state::pending) {
     _handshake_state = t_handshake_state::success;
-    LOG_DEBUG("fd: " << fd_info().second << ", ssl handshake success");
+    const bool resumed = SSL_session_reused(_ssl->ssl);
+    LOG_DEBUG("fd: " << fd_info().second << ", ssl handshake success"
+                     << (resumed ? ", session resumed" : ""));
+    if (_ssl->session_cache)
+      _ssl_context.count_handshake(_ssl->ssl);
+    on_handshake_finished();
     _prom_handshake.set_value(_handshake_state);
   }
 
@@ -251,15 +297,86 @@ sslstatus SslSocket::do_handshake()
 }
 
 
-void SslSocket::write_encrypted_bytes(const char* src, size_t len)
+void SslSocket::on_handshake_finished()
 {
-  assert(get_io_loop().this_thread_is_io() == true);
+  if (!_ktls)
+    return;
+
+  if (SSL_version(_ssl->ssl) != TLS1_3_VERSION || reads_via_io_uring()) {
+    /* Only TLS 1.3 secrets are captured.  An io_uring read may already hold
+     * ciphertext when the kernel takes over, so those sockets stay put. */
+    _ktls.reset();
+    return;
+  }
 
-  uv_buf_t buf = uv_buf_init(new char[len], len);
-  memcpy(buf.base, src, len);
+  /* Any records still unread by SSL were sent under the traffic keys, as are
+   * any we send from now. */
+  uint64_t rx_consumed = _ktls->rx.offset() - BIO_ctrl_pending(_ssl->rbio);
+  _ktls->rx_base = _ktls->rx.records_before(rx_consumed);
+  _ktls->tx_base = _ktls->tx.records_before(_ktls->tx.offset());
+  _ktls->established = true;
+}
 
-  std::vector<uv_buf_t> bufs{buf};
-  do_write(bufs);
+
+/* Hand record protection to the kernel, if the connection is at a point where
+ * it can be: SSL holds no partial input or unsent output, and the socket has
+ * no encrypted bytes still to write. */
+void SslSocket::try_enable_ktls()
+{
+  if (!_ktls || !_ktls->established || !_ktls->app_data_seen)
+    return;
+
+  if (BIO_ctrl_pending(_ssl->rbio) || !_ktls->rx.at_boundary() ||
+      SSL_has_pending(_ssl->ssl) || BIO_ctrl_pending(_ssl->wbio) ||
+      bytes_pending_write())
+    return; // try again after a later read
+
+  std::unique_ptr<KtlsSetup> setup = std::move(_ktls);
+  const std::string fd = fd_info().second;
+
+  const SSL_CIPHER* cipher = SSL_get_current_cipher(_ssl->ssl);
+  ktls::TrafficKeys rx_keys, tx_keys;
+  if (!ktls::derive_keys(cipher, _ssl->server_traffic_secret, rx_keys) ||
+      !ktls::derive_keys(cipher, _ssl->client_traffic_secret, tx_keys)) {
+    LOG_INFO("fd: " << fd << ", kTLS not available for cipher "
+                    << SSL_CIPHER_get_name(cipher));
+    return;
+  }
+
+  scope_guard cleanse([&]() {
+    OPENSSL_cleanse(&rx_keys, sizeof(rx_keys));
+    OPENSSL_cleanse(&tx_keys, sizeof(tx_keys));
+  });
+
+  int sock = native_fd();
+  if (int err = ktls::attach(sock)) {
+    LOG_INFO("fd: " << fd << ", kTLS not available, " << strerror(err));
+    return;
+  }
+
+  /* Until a direction is installed the socket passes bytes unchanged, so a
+   * failure of either leaves that direction with SSL. */
+  uint64_t tx_seq = setup->tx.records_before(setup->tx.offset()) -
+                    setup->tx_base;
+  if (int err = ktls::install(sock, true, tx_keys, tx_seq))
+    LOG_INFO("fd: " << fd << ", kTLS tx not enabled, " << strerror(err));
+  else
+    _ktls_tx.store(true, std::memory_order_release);
+
+  uint64_t rx_seq = setup->rx.records_before(setup->rx.offset()) -
+                    setup->rx_base;
+  if (int err = ktls::install(sock, false, rx_keys, rx_seq))
+    LOG_INFO("fd: " << fd << ", kTLS rx not enabled, " << strerror(err));
+  else
+    _ktls_rx = true;
+
+  OPENSSL_cleanse(_ssl->client_traffic_secret.data(),
+                  _ssl->client_traffic_secret.size());
+  OPENSSL_cleanse(_ssl->server_traffic_secret.data(),
+                  _ssl->server_traffic_secret.size());
+
+  LOG_INFO("fd: " << fd << ", kTLS enabled, tx " << _ktls_tx.load() << ", rx "
+                  << _ktls_rx << ", " << SSL_CIPHER_get_name(cipher));
 }
 
 
@@ -271,6 +388,14 @@ void SslSocket::handle_read_bytes(ssize_t nread, const uv_buf_t* buf)
 {
   assert(get_io_loop().this_thread_is_io() == true);
 
+  /* Bytes are already decrypted by the kernel.  A read fails, with EIO, on
+   * arrival of a record other than application data, such as a key update or
+   * an alert, and so ends the connection. */
+  if (_ktls_rx) {
+    TcpSocket::handle_read_bytes(nread, buf);
+    return;
+  }
+
   if (nread > 0 && ssl_do_read(buf->base, size_t(nread)) == 0)
     return; /* data received and successfully fed into SSL */
 
@@ -286,19 +411,49 @@ void SslSocket::handle_read_bytes(ssize_t nread, const uv_buf_t* buf)
 }
 
 
+/* Read out all the decrypted bytes SSL has available, collecting them into a
+ * pooled socket read buffer so that they are delivered in as few callbacks as
+ * possible.  Returns the result of the final SSL_read. */
+int SslSocket::read_plaintext()
+{
+  auto& pool = get_io_loop().read_buffers();
+  char* buf = pool.acquire();
+  scope_guard buf_guard([&pool, buf]() { pool.release(buf); });
+
+  const size_t cap = ReadBufferPool::buffer_size;
+  size_t len = 0;
+  int n;
+  do {
+    n = SSL_read(_ssl->ssl, buf + len, static_cast<int>(cap - len));
+    if (n > 0)
+      len += n;
+    if (len && (len == cap || n <= 0)) {
+      if (_ktls)
+        _ktls->app_data_seen = true;
+      if (_io_on_read)
+        _io_on_read(buf, len);
+      len = 0;
+    }
+  } while (n > 0);
+
+  return n;
+}
+
+
 /* Pass raw bytes from the socket into SSL for unencryption. */
 int SslSocket::ssl_do_read(char* src, size_t len)
 {
   assert(get_io_loop().this_thread_is_io() == true);
 
-  char buf[DEFAULT_BUF_SIZE];
-
   while (len > 0) {
     int n = BIO_write(_ssl->rbio, src, len);
 
     if (n <= 0)
       return -1; /* assume mem bio write error is unrecoverable */
 
+    if (_ktls)
+      _ktls->rx.feed(src, n);
+
     src += n;
     len -= n;
 
@@ -317,24 +472,14 @@ int SslSocket::ssl_do_read(char* src, size_t len)
 
     /* The encrypted data is now in the input bio so now we can perform actual
      * read of unencrypted data. */
-    do {
-      n = SSL_read(_ssl->ssl, buf, sizeof(buf));
-      if (n > 0 && _io_on_read)
-        _io_on_read(buf, (size_t)n);
-    } while (n > 0);
+    n = read_plaintext();
 
     sslstatus status = get_sslstatus(_ssl->ssl, n);
 
-    /* Did SSL request to write bytes? This can happen if peer has requested SSL
-     * renegotiation. */
-    if (status == sslstatus::want_io)
-      do {
-        n = BIO_read(_ssl->wbio, buf, sizeof(buf));
-        if (n > 0)
-          write_encrypted_bytes(buf, n);
-        else if (!BIO_should_retry(_ssl->wbio))
-          return -1;
-      } while (n > 0);
+    /* Did SSL produce bytes to write? This can happen if peer has requested
+     * SSL renegotiation, or a key update. */
+    if (!flush_ssl_output())
+      return -1;
 
     if (status == sslstatus::fail) {
       _ssl_context.log_ssl_error_queue();
@@ -346,6 +491,8 @@ int SslSocket::ssl_do_read(char* src, size_t len)
    * SSL_write that are waiting a retry, make attempt to service them. */
   service_pending_write();
 
+  try_enable_ktls();
+
   return 0;
 }
 
@@ -372,6 +519,7 @@ std::future<UvErr> SslSocket::connect(const std::string& node,
                                       addr_family family,
                                       bool resolve_addr)
 {
+  _ssl_context.resume_session(*_ssl, node + ":" + service);
   auto fut = TcpSocket::connect(node,
                                 service,
                                 family,
@@ -19,6 +19,8 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/infra/TcpSocket.hpp>
 
+#include <atomic>
+
 namespace apex
 {
 
@@ -67,24 +69,44 @@ public:
                              const std::string& service,
                              addr_family = addr_family::unspec,
                              bool resolve_addr = true) override;
+
+  using TcpSocket::write;
+  void write(std::shared_ptr<const void> owner, const char*, size_t) override;
+
+  /* Whether the kernel has taken over record encryption (tx) and decryption
+   * (rx); see SslConfig::ktls. */
+  bool is_ktls_tx() const { return _ktls_tx.load(std::memory_order_acquire); }
+  bool is_ktls_rx() const { return _ktls_rx; }
+
 private:
   SslSocket(SslContext&, IoLoop&, uv_tcp_t*, socket_state ss,
             TcpSocket::options);
 
   void handle_read_bytes(ssize_t, const uv_buf_t*) override;
   void service_pending_write() override;
+  bool direct_write_allowed() const override { return is_ktls_tx(); }
   static SslSocket* create(SslContext&, IoLoop&, uv_tcp_t*,
                            TcpSocket::socket_state, TcpSocket::options);
 
   std::pair<int, size_t> do_encrypt_and_write(char*, size_t);
   sslstatus do_handshake();
-  void write_encrypted_bytes(const char* src, size_t len);
+  bool flush_ssl_output();
+  int read_plaintext();
   int ssl_do_read(char* src, size_t len);
+  void on_handshake_finished();
+  void try_enable_ktls();
 
   SslContext& _ssl_context;
   std::unique_ptr<SslSession> _ssl;
   t_handshake_state _handshake_state;
   std::promise<t_handshake_state> _prom_handshake;
+
+  /* Record accounting kept while kTLS is still to be enabled; null once
+   * enabled, or when it will not be. */
+  struct KtlsSetup;
+  std::unique_ptr<KtlsSetup> _ktls;
+  std::atomic<bool> _ktls_tx{false};
+  bool _ktls_rx = false;
 };
 
 } // namespace apex
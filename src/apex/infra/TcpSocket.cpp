@@ -16,20 +16,39 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/infra/TcpSocket.hpp>
+#include <apex/infra/AddressCache.hpp>
 #include <apex/infra/IoLoop.hpp>
 #include <apex/infra/SocketAddress.hpp>
 #include <apex/core/Logger.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/Metrics.hpp>
 #include <apex/util/utils.hpp>
 
 #include <uv.h>
 
 #include <assert.h>
+#include <thread>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
 
 namespace apex
 {
 
 constexpr std::chrono::seconds TcpSocket::options::default_keep_alive_delay;
 
+static metrics::Counter& tcp_bytes_read = metrics::registry().counter(
+    "apex_tcp_read_bytes_total", "Bytes read from TCP sockets");
+static metrics::Counter& tcp_bytes_written = metrics::registry().counter(
+    "apex_tcp_written_bytes_total", "Bytes written to TCP sockets");
+static metrics::Counter& tcp_direct_writes = metrics::registry().counter(
+    "apex_tcp_direct_writes_total",
+    "Writes sent, in whole or part, from the calling thread");
+
 tcp_socket_guard::tcp_socket_guard(std::unique_ptr<TcpSocket>& __sock)
   : sock(__sock)
 {
@@ -75,6 +94,7 @@ struct write_req {
   uv_buf_t* bufs;
   size_t nbufs;
   size_t total_bytes;
+  std::vector<std::shared_ptr<const void>> owners; // empty, or one per buf
   write_req(size_t n, size_t total)
     : bufs(new uv_buf_t[n]), nbufs(n), total_bytes(total)
   {
@@ -83,7 +103,8 @@ struct write_req {
   ~write_req()
   {
     for (size_t i = 0; i < nbufs; i++)
-      delete[] bufs[i].base;
+      if (owners.empty() || !owners[i])
+        delete[] bufs[i].base;
     delete[] bufs;
   }
 
@@ -92,18 +113,112 @@ struct write_req {
 };
 
 
-static void iohandle_alloc_buffer(uv_handle_t* /* handle */,
-                                  size_t suggested_size, uv_buf_t* buf)
+/* Writes requested of a socket: a lock-free stack, onto which any thread
+ * pushes, and from which the IO thread takes every write at once, restoring
+ * the order pushed.  Tasks queued on the IO loop to service it share it, so a
+ * task that runs after the socket has closed, and perhaps been deleted, finds
+ * no socket, rather than a dangling pointer. */
+struct TcpSocket::WriteQueue {
+  struct Node {
+    uv_buf_t buf;
+    std::shared_ptr<const void> owner; // null when the buffer is owned
+    Node* next;
+  };
+
+  explicit WriteQueue(TcpSocket* socket) : socket(socket) {}
+  ~WriteQueue()
+  {
+    release(remainder.exchange(nullptr));
+    release(head.exchange(nullptr));
+  }
+
+  void push(Node* node)
+  {
+    node->next = head.load(std::memory_order_relaxed);
+    while (!head.compare_exchange_weak(node->next, node,
+                                       std::memory_order_release,
+                                       std::memory_order_relaxed))
+      ;
+  }
+
+  // the remainder of a partial direct write, then every write pushed, oldest
+  // first
+  Node* take_all()
+  {
+    Node* node = head.exchange(nullptr, std::memory_order_acquire);
+    Node* prev = remainder.exchange(nullptr, std::memory_order_acquire);
+    while (node) {
+      Node* next = node->next;
+      node->next = prev;
+      prev = node;
+      node = next;
+    }
+    return prev;
+  }
+
+  bool empty() const
+  {
+    return head.load() == nullptr && remainder.load() == nullptr;
+  }
+
+  static void release(Node* node)
+  {
+    while (node) {
+      std::unique_ptr<Node> item(node);
+      node = node->next;
+      if (!item->owner)
+        delete[] item->buf.base;
+    }
+  }
+
+  std::atomic<Node*> head{nullptr};
+
+  // what a partial direct write left unsent, parked before the sender gives
+  // up its claim, so that it precedes any write pushed after that send
+  std::atomic<Node*> remainder{nullptr};
+
+  // set while a task to service the queue is pending on the IO loop, so that
+  // a burst of writes from other threads is handed over once
+  std::atomic<bool> scheduled{false};
+
+  // cleared as the socket closes; IO thread only
+  TcpSocket* socket;
+};
+
+
+/* Wait for a write being sent from another thread to complete; spins, as it
+ * is a single non-blocking send. */
+static memory::Account& pending_write_memory()
+{
+  static memory::Account account("tcp_pending_writes");
+  return account;
+}
+
+
+static void wait_for_direct_write(const std::atomic<bool>& direct_writing)
 {
-  // improve memory efficiency
-  *buf = uv_buf_init((char*)new char[suggested_size], suggested_size);
+  while (direct_writing.load())
+    std::this_thread::yield();
+}
+
+
+static void iohandle_alloc_buffer(uv_handle_t* handle,
+                                  size_t /* suggested_size */, uv_buf_t* buf)
+{
+  // buffers come from the IO loop pool, and are returned after the read
+  auto* loop = static_cast<IoLoop*>(handle->loop->data);
+  *buf = uv_buf_init(loop->read_buffers().acquire(),
+                     ReadBufferPool::buffer_size);
 }
 
 
 TcpSocket::options::options()
   : tcp_no_delay_enable(default_tcp_no_delay_enable),
     keep_alive_enable(default_keep_alive_enable),
-    keep_alive_delay(default_keep_alive_delay)
+    keep_alive_delay(default_keep_alive_delay),
+    reuse_port(false),
+    direct_write(true),
+    rx_timestamps(false)
 {
 }
 
@@ -117,7 +232,9 @@ TcpSocket::TcpSocket(IoLoop& io_loop_, uv_tcp_t* h, socket_state ss,
     _io_closed_promise(new std::promise<void>),
     _io_closed_future(_io_closed_promise->get_future()),
     _bytes_pending_write(0),
+    _pending_write_charge(pending_write_memory()),
     _bytes_written(0),
+    _write_queue(std::make_shared<WriteQueue>(this)),
     _bytes_read(0),
     m_self(this, [](TcpSocket*) { /* none deleter */ })
 {
@@ -176,44 +293,40 @@ TcpSocket::~TcpSocket()
     delete _tcp;
   }
 
-  {
-    std::lock_guard<std::mutex> guard(_pending_write_lock);
-    for (auto& i : _pending_write)
-      delete[] i.base;
-  }
+  // writes still queued are released with the queue
+  for (auto& buf : _write_backlog)
+    delete[] buf.base;
 }
 
 
 bool TcpSocket::is_listening() const
 {
-  std::lock_guard<std::mutex> guard(_state_lock);
   return _state == socket_state::listening;
 }
 
 
 bool TcpSocket::is_connected() const
 {
-  std::lock_guard<std::mutex> guard(_state_lock);
   return _state == socket_state::connected;
 }
 
 
 bool TcpSocket::is_connect_failed() const
 {
-  std::lock_guard<std::mutex> guard(_state_lock);
   return _state == socket_state::connect_failed;
 }
 
 
 bool TcpSocket::is_closing() const
 {
-  std::lock_guard<std::mutex> guard(_state_lock);
   return _state == socket_state::closing;
 }
 
 
 bool TcpSocket::is_closed() const
 {
+  // locked, unlike the other queries: once closed the socket may be deleted,
+  // so close_impl must have released the lock before closed is seen
   std::lock_guard<std::mutex> guard(_state_lock);
   return _state == socket_state::closed;
 }
@@ -239,6 +352,16 @@ void TcpSocket::begin_close(bool no_linger)
   // decouple from IO request that might still be pending on the IO thread
   m_self.reset();
 
+  // a write being sent from another thread, which checked the state before
+  // closing was set, must complete before the descriptor is closed
+  wait_for_direct_write(_direct_writing);
+
+  // io_uring requests must complete before the descriptor is closed
+  if (_uring_id) {
+    _io_loop.uring()->remove_socket(_uring_id);
+    _uring_id = 0;
+  }
+
   if (_tcp) {
 
 #ifndef _WIN32
@@ -275,6 +398,9 @@ void TcpSocket::close_impl()
   decltype(_user_close_fn) user_close_fn;
   decltype(_io_closed_promise) closed_promise;
 
+  // service tasks still queued on the IO loop must not find the socket
+  _write_queue->socket = nullptr;
+
   /* Once the state is set to closed, this TcpSocket object may be immediately
    * deleted by another thread. So this must be the last action that makes use
    * of the TcpSocket members. */
@@ -291,6 +417,7 @@ void TcpSocket::close_impl()
     closed_promise = std::move(_io_closed_promise);
   }
 
+
   /* Run the user callback first, and then set the promise (the promise is set
    * as the last action, so that an owner of TcpSocket can wait on a future to
    * know when all callbacks are complete). This user callback must not perform
@@ -318,6 +445,15 @@ std::pair<bool, std::string> TcpSocket::fd_info() const
 }
 
 
+int TcpSocket::native_fd() const
+{
+  uv_os_fd_t fd;
+  if (_tcp && uv_fileno((uv_handle_t*)_tcp, &fd) == 0)
+    return fd;
+  return -1;
+}
+
+
 /** User request to close socket */
 std::shared_future<void> TcpSocket::close()
 {
@@ -384,11 +520,36 @@ std::future<UvErr> TcpSocket::start_read(io_on_read on_read,
   auto completion_promise = std::make_shared<std::promise<UvErr>>();
 
   auto fn = [this, completion_promise]() {
+    uv_os_fd_t fd;
+    if (_io_loop.uring() && uv_fileno((uv_handle_t*)_tcp, &fd) == 0) {
+      _uring_id = _io_loop.uring()->add_socket(
+          fd, [this](ssize_t nread, const uv_buf_t* buf) {
+            on_read_cb(nread, buf);
+          });
+      completion_promise->set_value(UvErr{});
+      return;
+    }
+
+    // with timestamping, each read is preceded by a peek for its timestamp
+    uv_alloc_cb alloc_cb = iohandle_alloc_buffer;
+    if (_rx_timestamping)
+      alloc_cb = [](uv_handle_t* h, size_t suggested, uv_buf_t* buf) {
+        ((HandleData*)h->data)->tcp_socket_ptr()->sample_rx_time();
+        iohandle_alloc_buffer(h, suggested, buf);
+      };
+
     UvErr ec =
-        uv_read_start((uv_stream_t*)this->_tcp, iohandle_alloc_buffer,
+        uv_read_start((uv_stream_t*)this->_tcp, alloc_cb,
                       [](uv_stream_t* uvh, ssize_t nread, const uv_buf_t* buf) {
                         auto* ptr = (HandleData*)uvh->data;
                         ptr->tcp_socket_ptr()->on_read_cb(nread, buf);
+
+                        // the socket may now be deleted, so return the buffer
+                        // via the handle; an error can arrive without one
+                        if (buf->base)
+                          static_cast<IoLoop*>(uvh->loop->data)
+                              ->read_buffers()
+                              .release(buf->base);
                       });
     completion_promise->set_value(ec);
   };
@@ -438,16 +599,168 @@ void TcpSocket::handle_read_bytes(ssize_t nread, const uv_buf_t* buf)
 void TcpSocket::on_read_cb(ssize_t nread, const uv_buf_t* buf)
 {
   /* IO thread */
-  if (nread > 0)
+  if (nread > 0) {
     _bytes_read += nread;
+    tcp_bytes_read.add(nread);
+  }
 
   try {
     handle_read_bytes(nread, buf);
   } catch (...) {
     log_exception("IO thread in on_read_cb");
   }
+}
+
+
+void TcpSocket::queue_write(uv_buf_t buf, std::shared_ptr<const void> owner)
+{
+  // a check only; a write that races with close is discarded by the IO thread
+  if (_state == socket_state::closing || _state == socket_state::closed)
+    throw TcpSocket::error("TcpSocket::write() when closing or closed");
+
+  auto node = std::make_unique<WriteQueue::Node>(
+      WriteQueue::Node{buf, std::move(owner), nullptr});
+
+  // off the IO thread, attempt to send at once
+  const bool io_thread = _io_loop.this_thread_is_io();
+  if (!io_thread && try_direct_write(node->buf, node->owner))
+    return;
+
+  // a partial direct write has already parked what remains
+  if (node->buf.base)
+    _write_queue->push(node.release());
+
+  // on the IO thread the write can be started without a thread handoff;
+  // otherwise one task services all writes pushed before it runs
+  if (io_thread)
+    service_pending_write();
+  else if (!_write_queue->scheduled.exchange(true))
+    _io_loop.push_fn([queue = _write_queue]() {
+      queue->scheduled.store(false);
+      if (queue->socket)
+        queue->socket->service_pending_write();
+    });
+}
+
+
+/* Returns true if the whole buffer was sent, and released.  After a partial
+ * send the remainder is parked as the head of the queue, for the IO thread
+ * to write, and `buf` is cleared; otherwise `buf` is left to be queued. */
+bool TcpSocket::try_direct_write(uv_buf_t& buf,
+                                 std::shared_ptr<const void>& owner)
+{
+#ifndef _WIN32
+  if (!_sockopts.direct_write || !direct_write_allowed())
+    return false;
+
+  // one thread sends at a time; others queue
+  if (_direct_writing.exchange(true))
+    return false;
+  scope_guard claim_guard([this]() { _direct_writing.store(false); });
+
+  // checked once the claim is made, so that the IO thread, which marks a
+  // write in flight, or the socket closing, before testing the claim, either
+  // is seen here or waits for the send; the queue is checked first, as the
+  // IO thread counts a write in flight before taking the queue
+  if (_state != socket_state::connected || !_write_queue->empty() ||
+      _writes_in_flight != 0)
+    return false;
+
+  const int fd = native_fd();
+  if (fd < 0)
+    return false;
+
+  // on EAGAIN, or any error, the IO thread writes instead, and so meets and
+  // handles the error in the usual way
+  const ssize_t n = ::send(fd, buf.base, buf.len, MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (n <= 0)
+    return false;
+
+  _bytes_written += n;
+  tcp_bytes_written.add(n);
+  tcp_direct_writes.add();
+
+  if (size_t(n) == buf.len) {
+    if (!owner)
+      delete[] buf.base;
+    return true;
+  }
+
+  // the remainder of a buffer owned by the socket is copied, so that the
+  // queued buffer can later be deleted
+  const size_t rest = buf.len - n;
+  if (owner) {
+    buf = uv_buf_init(buf.base + n, rest);
+  } else {
+    char* copy = new char[rest];
+    memcpy(copy, buf.base + n, rest);
+    delete[] buf.base;
+    buf = uv_buf_init(copy, rest);
+  }
+
+  // parked while the claim is held: a writer that next claims it, and the IO
+  // thread, which waits for the claim before taking the queue, both find it
+  _write_queue->remainder.store(
+      new WriteQueue::Node{buf, std::move(owner), nullptr},
+      std::memory_order_release);
+  buf = uv_buf_init(nullptr, 0);
+#endif
+  return false;
+}
+
+
+/* Account for a write request that has completed, or was never submitted. */
+void TcpSocket::end_write()
+{
+  size_t count = _writes_in_flight.load();
+  while (count && !_writes_in_flight.compare_exchange_weak(count, count - 1))
+    ;
+}
+
+
+void TcpSocket::take_writes(std::vector<uv_buf_t>& bufs,
+                            std::vector<std::shared_ptr<const void>>& owners)
+{
+  /* IO thread */
+  if (!_write_backlog.empty()) {
+    bufs.swap(_write_backlog);
+    end_write(); // counted while held as a backlog
+  }
 
-  delete[] buf->base;
+  for (auto* node = _write_queue->take_all(); node;) {
+    std::unique_ptr<WriteQueue::Node> item(node);
+    node = node->next;
+    if (item->owner && owners.empty())
+      owners.resize(bufs.size());
+    if (item->owner || !owners.empty())
+      owners.push_back(std::move(item->owner));
+    bufs.push_back(item->buf);
+  }
+}
+
+
+std::vector<uv_buf_t> TcpSocket::take_pending_write()
+{
+  /* IO thread */
+  std::vector<uv_buf_t> bufs;
+  std::vector<std::shared_ptr<const void>> owners;
+  take_writes(bufs, owners);
+  assert(owners.empty());
+  return bufs;
+}
+
+
+void TcpSocket::return_pending_write(std::vector<uv_buf_t> bufs)
+{
+  /* IO thread */
+  if (bufs.empty())
+    return;
+
+  // a backlog holds off direct writes, as does a write in flight
+  if (_write_backlog.empty())
+    _writes_in_flight++;
+  bufs.insert(bufs.end(), _write_backlog.begin(), _write_backlog.end());
+  _write_backlog.swap(bufs);
 }
 
 
@@ -460,54 +773,39 @@ void TcpSocket::write(const char* src, size_t len)
   buf = uv_buf_init(new char[len], len);
   memcpy(buf.base, src, len);
 
-  {
-    std::lock_guard<std::mutex> guard(_state_lock);
-    if (_state == socket_state::closing || _state == socket_state::closed)
-      throw TcpSocket::error("TcpSocket::write() when closing or closed");
+  queue_write(buf);
+  buf_guard.release();
+}
 
-    {
-      std::lock_guard<std::mutex> guard2(_pending_write_lock);
-      _pending_write.push_back(buf);
-      buf_guard.release();
-    }
 
-    _io_loop.push_fn([this]() { service_pending_write(); });
-  }
+void TcpSocket::write(std::shared_ptr<const void> owner, const char* src,
+                      size_t len)
+{
+  queue_write(uv_buf_init(const_cast<char*>(src), len), std::move(owner));
 }
 
 
 void TcpSocket::write(std::pair<const char*, size_t>* srcbuf, size_t count)
 {
-  // improve memory usage here
-  std::vector<uv_buf_t> bufs;
+  // gather the buffers into a single allocation, so that they are queued as
+  // one pending write
+  size_t len = 0;
+  for (size_t i = 0; i < count; i++)
+    len += srcbuf[i].second;
 
-  scope_guard buf_guard([&bufs]() {
-    for (auto& i : bufs)
-      delete[] i.base;
-  });
+  uv_buf_t buf;
+
+  scope_guard buf_guard([&buf]() { delete[] buf.base; });
 
-  bufs.reserve(count);
+  buf = uv_buf_init(new char[len], len);
+  char* dest = buf.base;
   for (size_t i = 0; i < count; i++) {
-    uv_buf_t buf = uv_buf_init(new char[srcbuf->second], srcbuf->second);
-    memcpy(buf.base, srcbuf->first, srcbuf->second);
-    srcbuf++;
-    bufs.push_back(buf);
+    memcpy(dest, srcbuf[i].first, srcbuf[i].second);
+    dest += srcbuf[i].second;
   }
 
-  {
-    std::lock_guard<std::mutex> guard(_state_lock);
-    if (_state == socket_state::closing || _state == socket_state::closed)
-      throw TcpSocket::error("TcpSocket::write() when closing or closed");
-
-    {
-      std::lock_guard<std::mutex> guard(_pending_write_lock);
-      _pending_write.insert(_pending_write.end(), bufs.begin(), bufs.end());
-      bufs.clear();
-      buf_guard.release();
-    }
-
-    _io_loop.push_fn([this]() { service_pending_write(); });
-  }
+  queue_write(buf);
+  buf_guard.release();
 }
 
 
@@ -541,12 +839,11 @@ void TcpSocket::do_write(std::vector<uv_buf_t>& bufs)
       wr->bufs[i] = bufs[i];
 
     _bytes_pending_write += bytes_to_send;
+    _pending_write_charge.set(_bytes_pending_write);
+    _writes_in_flight++;
+    wait_for_direct_write(_direct_writing);
 
-    int r = uv_write((uv_write_t*)wr, (uv_stream_t*)_tcp, wr->bufs,
-                     wr->nbufs, [](uv_write_t* req, int status) {
-                       TcpSocket* the_tcp_socket = (TcpSocket*)req->data;
-                       the_tcp_socket->on_write_cb(req, status);
-                     });
+    int r = submit_write((uv_write_t*)wr, wr->bufs, wr->nbufs);
     buf_guard.release();
 
     if (r) {
@@ -554,6 +851,7 @@ void TcpSocket::do_write(std::vector<uv_buf_t>& bufs)
                                          << uv_strerror(r)
                                          << "); closing connection");
       delete wr;
+      end_write();
       close_once_on_io();
       return;
     };
@@ -565,15 +863,27 @@ void TcpSocket::do_write()
   /* IO thread */
   assert(_io_loop.this_thread_is_io() == true);
 
+  // counted before the queue is taken, so no direct write can overtake these
+  // bytes, and once any direct write in progress is sent, so none is
+  // overtaken by them
+  _writes_in_flight++;
+  wait_for_direct_write(_direct_writing);
+
+  // until submitted, the request counted above has to be uncounted on return
+  bool submitted = false;
+  scope_guard in_flight_guard([this, &submitted]() {
+    if (!submitted)
+      end_write();
+  });
+
   std::vector<uv_buf_t> copy;
-  {
-    std::lock_guard<std::mutex> guard(_pending_write_lock);
-    _pending_write.swap(copy);
-  }
+  std::vector<std::shared_ptr<const void>> owners;
+  take_writes(copy, owners);
 
-  scope_guard buf_guard([&copy]() {
-    for (auto& i : copy)
-      delete[] i.base;
+  scope_guard buf_guard([&copy, &owners]() {
+    for (size_t i = 0; i < copy.size(); i++)
+      if (owners.empty() || !owners[i])
+        delete[] copy[i].base;
   });
 
   size_t bytes_to_send = 0;
@@ -602,15 +912,14 @@ void TcpSocket::do_write()
     wr->req.data = this;
     for (size_t i = 0; i < copy.size(); i++)
       wr->bufs[i] = copy[i];
+    wr->owners = std::move(owners);
 
     _bytes_pending_write += bytes_to_send;
+    _pending_write_charge.set(_bytes_pending_write);
 
-    int r = uv_write((uv_write_t*)wr, (uv_stream_t*)_tcp, wr->bufs,
-                     wr->nbufs, [](uv_write_t* req, int status) {
-                       TcpSocket* the_tcp_socket = (TcpSocket*)req->data;
-                       the_tcp_socket->on_write_cb(req, status);
-                     });
+    int r = submit_write((uv_write_t*)wr, wr->bufs, wr->nbufs);
     buf_guard.release();
+    submitted = (r == 0);
 
     if (r) {
       LOG_WARN("uv_write failed, errno " << std::abs(r) << " ("
@@ -624,11 +933,29 @@ void TcpSocket::do_write()
 }
 
 
+int TcpSocket::submit_write(uv_write_t* req, const uv_buf_t bufs[],
+                            unsigned nbufs)
+{
+  /* IO thread */
+  auto cb = [](uv_write_t* req, int status) {
+    TcpSocket* the_tcp_socket = (TcpSocket*)req->data;
+    the_tcp_socket->on_write_cb(req, status);
+  };
+
+  if (_uring_id) {
+    _io_loop.uring()->write(_uring_id, req, bufs, nbufs, cb);
+    return 0;
+  }
+  return uv_write(req, (uv_stream_t*)_tcp, bufs, nbufs, cb);
+}
+
+
 void TcpSocket::on_write_cb(uv_write_t* req, int status)
 {
   /* IO thread */
 
   std::unique_ptr<write_req> wr((write_req*)req); // ensure deletion
+  end_write();
 
   try {
     if (status == 0) {
@@ -638,10 +965,12 @@ void TcpSocket::on_write_cb(uv_write_t* req, int status)
         total += req->bufsml[i].len;
       */
       _bytes_written += total;
+      tcp_bytes_written.add(total);
       if (_bytes_pending_write > total)
         _bytes_pending_write -= total;
       else
         _bytes_pending_write = 0;
+      _pending_write_charge.set(_bytes_pending_write);
     } else {
       /* write failed - this can happen if we actively terminated the socket
          while there were still a long queue of bytes awaiting output (eg inthe
@@ -808,11 +1137,29 @@ void TcpSocket::do_listen(const std::string& node, const std::string& service,
 
     h = new uv_tcp_t();
     assert(h->data == 0);
-    if (uv_tcp_init(_io_loop.uv_loop(), h) != 0) {
+
+    /* With reuse_port the socket must exist before the bind, so that the
+     * option can be set on it. */
+    int init_err = _sockopts.reuse_port
+                       ? uv_tcp_init_ex(_io_loop.uv_loop(), h, ai->ai_family)
+                       : uv_tcp_init(_io_loop.uv_loop(), h);
+    if (init_err != 0) {
       delete h;
       continue;
     }
 
+#ifndef _WIN32
+    if (_sockopts.reuse_port) {
+      uv_os_fd_t fd;
+      int on = 1;
+      if (uv_fileno((uv_handle_t*)h, &fd) != 0 ||
+          setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof on) != 0) {
+        uv_close((uv_handle_t*)h, free_socket);
+        continue;
+      }
+    }
+#endif
+
     if (uv_tcp_bind(h, ai->ai_addr, tcp_bind_flags) == 0)
       break; /* success */
 
@@ -921,25 +1268,44 @@ void TcpSocket::do_connect(const std::string& node, const std::string& service,
   hints.ai_protocol = IPPROTO_TCP;
   hints.ai_socktype = resolve_addr ? 0 : (AI_NUMERICHOST | AI_NUMERICSERV);
 
+  /* Named hosts are normally already resolved, by the address cache, so that
+   * a reconnect does not wait on the resolver.  A host not yet cached is
+   * resolved here, and registered so that it is cached from now on. */
+  std::vector<SocketAddress> cached;
+  if (resolve_addr && !node.empty()) {
+    cached = AddressCache::instance().lookup(node, service, hints.ai_family);
+    if (cached.empty())
+      AddressCache::instance().prefetch(node, service);
+  }
+
+  std::vector<const sockaddr*> targets;
+  for (auto& addr : cached)
+    targets.push_back((const sockaddr*)addr._impl.get());
+
   /* getaddrinfo() returns a list of address structures that can be used in
    * later calls to bind or connect */
   uv_getaddrinfo_t req;
-  UvErr ec =
-      uv_getaddrinfo(_io_loop.uv_loop(), &req, nullptr /* no callback */,
-                     node.empty() ? nullptr : node.c_str(),
-                     service.empty() ? nullptr : service.c_str(), &hints);
+  req.addrinfo = nullptr;
+  if (targets.empty()) {
+    UvErr ec =
+        uv_getaddrinfo(_io_loop.uv_loop(), &req, nullptr /* no callback */,
+                       node.empty() ? nullptr : node.c_str(),
+                       service.empty() ? nullptr : service.c_str(), &hints);
 
-  if (ec) {
-    completion->set_value(ec);
-    return;
+    if (ec) {
+      completion->set_value(ec);
+      return;
+    }
+    for (auto* ai = req.addrinfo; ai != nullptr; ai = ai->ai_next)
+      targets.push_back(ai->ai_addr);
   }
 
   /* Try each address until a call to connect is successful. On any error we
    * close the socket and try the next address. */
+  UvErr ec;
   uv_tcp_t* h = nullptr;
-  struct addrinfo* ai = nullptr;
-  for (ai = req.addrinfo; ai != nullptr; ai = ai->ai_next) {
-
+  auto target = targets.begin();
+  for (; target != targets.end(); ++target) {
     h = new uv_tcp_t();
     assert(h->data == 0);
     if (uv_tcp_init(_io_loop.uv_loop(), h) != 0) {
@@ -951,7 +1317,7 @@ void TcpSocket::do_connect(const std::string& node, const std::string& service,
     auto* ctx = new connect_context(completion, m_self);
 
     ec = uv_tcp_connect(
-        (uv_connect_t*)ctx, h, ai->ai_addr, [](uv_connect_t* req, int status) {
+        (uv_connect_t*)ctx, h, *target, [](uv_connect_t* req, int status) {
           std::unique_ptr<connect_context> ctx((connect_context*)req);
 
           if (auto sp = ctx->wp.lock()) {
@@ -977,9 +1343,10 @@ void TcpSocket::do_connect(const std::string& node, const std::string& service,
     uv_close((uv_handle_t*)h, free_socket);
   }
 
-  uv_freeaddrinfo(req.addrinfo);
+  if (req.addrinfo)
+    uv_freeaddrinfo(req.addrinfo);
 
-  if (ai == nullptr) {
+  if (target == targets.end()) {
     /* no address worked, use the last error code seen if non-zero */
     completion->set_value(ec ? ec : UV_EADDRNOTAVAIL);
     return;
@@ -1002,13 +1369,16 @@ void TcpSocket::connect_completed(
   assert(_state == socket_state::connecting || _state == socket_state::closing);
 
   if (ec == 0) {
-    _state = socket_state::connected;
     _tcp = h;
     auto ptr = (HandleData*)_tcp->data;
     *ptr = HandleData(this);
 
     // established-socket is ready, so apply options
     apply_socket_options(false);
+
+    // set last, as a direct write checks the state, without the lock, before
+    // using the handle
+    _state = socket_state::connected;
   } else {
     _state = socket_state::connect_failed;
     uv_close((uv_handle_t*)h, free_socket);
@@ -1141,7 +1511,70 @@ void TcpSocket::apply_socket_options(bool is_listen_socket)
                           _sockopts.keep_alive_delay.count());
     if (ec)
       LOG_WARN("uv_tcp_keepalive failed, " << ec.message());
+
+#ifdef __linux__
+    if (_sockopts.rx_timestamps) {
+      int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |
+                  SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE;
+      uv_os_fd_t fd;
+      if (uv_fileno((uv_handle_t*)_tcp, &fd) == 0 &&
+          ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+                       sizeof(flags)) == 0)
+        _rx_timestamping = true;
+      else
+        LOG_WARN("SO_TIMESTAMPING failed, " << strerror(errno));
+    }
+
+    // on a busy polling IO loop, receives also spin on the device queue
+    if (auto busy_poll = _io_loop.socket_busy_poll().count()) {
+      int usec = static_cast<int>(busy_poll);
+      uv_os_fd_t fd;
+      if (uv_fileno((uv_handle_t*)_tcp, &fd) != 0 ||
+          ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) != 0)
+        LOG_WARN("SO_BUSY_POLL failed, " << strerror(errno));
+    }
+#endif
   }
 }
 
+
+/* A TCP receive reports the timestamps of the segments it reads only as
+ * control messages of recvmsg(), which libuv does not use; so before libuv
+ * reads, peek at the first byte waiting, for the time its segment arrived.
+ * A hardware timestamp is in the NIC clock, which is only comparable with
+ * CLOCK_REALTIME if the two are kept in sync, e.g. by phc2sys. */
+void TcpSocket::sample_rx_time()
+{
+  /* IO thread */
+
+  _rx_time = 0;
+#ifdef __linux__
+  uv_os_fd_t fd;
+  if (uv_fileno((uv_handle_t*)_tcp, &fd) != 0)
+    return;
+
+  char byte;
+  iovec iov{&byte, 1};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(scm_timestamping))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (::recvmsg(fd, &msg, MSG_PEEK | MSG_DONTWAIT) <= 0)
+    return;
+
+  for (cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+    if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SO_TIMESTAMPING)
+      continue;
+    scm_timestamping ts;
+    memcpy(&ts, CMSG_DATA(cm), sizeof(ts));
+    // ts[0] is software, ts[2] raw hardware
+    const timespec& t =
+        (ts.ts[2].tv_sec || ts.ts[2].tv_nsec) ? ts.ts[2] : ts.ts[0];
+    _rx_time = uint64_t(t.tv_sec) * 1000000000 + uint64_t(t.tv_nsec);
+  }
+#endif
+}
+
 } // namespace apex
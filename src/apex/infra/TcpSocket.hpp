@@ -18,7 +18,9 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <apex/infra/UvErr.hpp>
+#include <apex/util/MemoryAccount.hpp>
 
+#include <atomic>
 #include <future>
 #include <iostream>
 #include <string>
@@ -71,6 +73,12 @@ A TCP socket with both server and client operation.
 A socket is created and run in either server mode or in client mode.  Server
 mode involves use of the listen() method; in client mode uses connect().
 
+Writes may be requested from any thread.  They take no lock: each is pushed
+onto a lock-free queue of the socket, from which the IO thread, which alone
+submits writes to the descriptor, takes them in batches.  The socket state is
+atomic, so the checks made before each write, and the state queries, are also
+lock free; state transitions remain serialised by a lock, as they are rare.
+
 The owner of a TcpSocket must take care during its deletion.  It is
 undefined behaviour to invoke the TcpSocket destructor via the internal IO
 thread for an instance not in the closed state.
@@ -145,6 +153,23 @@ public:
     bool keep_alive_enable;
     std::chrono::seconds keep_alive_delay;
 
+    /* Listen sockets only: set SO_REUSEPORT, so that several sockets, each
+     * on its own IO loop, can listen on one port, the kernel spreading new
+     * connections across them.  Not supported on Windows. */
+    bool reuse_port;
+
+    /* Writes made off the IO thread, while the socket has no writes queued
+     * or in flight, are first attempted by a non-blocking send from the
+     * calling thread, so skip the handoff to the IO thread; only bytes the
+     * kernel does not accept are queued.  Not supported on Windows. */
+    bool direct_write;
+
+    /* Enable kernel receive timestamps (SO_TIMESTAMPING), software, and NIC
+     * hardware where the interface provides them, so that rx_time() reports
+     * when the data being read arrived.  Costs a peeking recvmsg() per read.
+     * Linux only, and not available on the io_uring data path. */
+    bool rx_timestamps;
+
     options();
   };
 
@@ -187,10 +212,17 @@ public:
   std::future<UvErr> listen(const std::string& node, const std::string& service,
                             on_accept_cb, addr_family = addr_family::unspec);
 
-  /* Request a write */
+  /* Request a write; from any thread.  Several buffers are gathered into one
+   * contiguous write, so cost a single pending write request. */
   void write(std::pair<const char*, size_t>* srcbuf, size_t count);
   void write(const char*, size_t);
 
+  /* Request a write of bytes held by a shared, immutable `owner`, which is
+   * retained until the write completes, so the bytes are not copied.  Allows
+   * one buffer to be queued on many sockets.  SSL sockets must encrypt each
+   * write, so copy the bytes instead. */
+  virtual void write(std::shared_ptr<const void> owner, const char*, size_t);
+
   /** Request asynchronous socket close. To detect when close has occurred, the
    * caller can wait upon the returned future.  Throws IoLoopClosed if IO loop
    * has already been closed. */
@@ -231,6 +263,17 @@ public:
   size_t bytes_read() const { return _bytes_read; }
   size_t bytes_written() const { return _bytes_written; }
 
+  /* Kernel receive time, in nanoseconds since the epoch, of the data being
+   * passed to the read callback, preferring a NIC hardware timestamp; zero
+   * unless options::rx_timestamps is set and a timestamp was found.  Data
+   * that a layer above buffers, e.g. a partial TLS record, is delivered with
+   * the time of the read that completes it.  IO thread only. */
+  uint64_t rx_time() const { return _rx_time; }
+
+  /* Bytes passed to the kernel write queue but not yet written, i.e. the
+   * backlog due to a slow peer. */
+  size_t bytes_pending_write() const { return _bytes_pending_write; }
+
   /** Return the node name, as provided during the connect / listen call. */
   const std::string& node() const;
 
@@ -265,9 +308,33 @@ protected:
   virtual void handle_read_bytes(ssize_t, const uv_buf_t*);
   virtual void service_pending_write();
 
+  /* Whether bytes queued for writing may instead be sent directly to the
+   * descriptor, i.e. are not transformed on the IO thread. */
+  virtual bool direct_write_allowed() const { return true; }
+
+  /* Queue a buffer for writing.  Without an owner, the socket takes ownership
+   * of the buffer once queued, otherwise it retains the owner. */
+  void queue_write(uv_buf_t, std::shared_ptr<const void> owner = nullptr);
+
+  /* Take every buffer waiting to be written, oldest first, including those
+   * returned by return_pending_write; IO thread.  For subclasses that
+   * transform the bytes, so only queue buffers the socket owns. */
+  std::vector<uv_buf_t> take_pending_write();
+
+  /* Return buffers, taken but not consumed, to the front of the writes
+   * waiting; IO thread. */
+  void return_pending_write(std::vector<uv_buf_t>);
+
   typedef std::function<std::unique_ptr<TcpSocket>(UvErr ec, uv_tcp_t* h)>
       acceptor_fn_t;
   void do_write(std::vector<uv_buf_t>&);
+
+  /* Underlying file descriptor, or -1 if there is none */
+  int native_fd() const;
+
+  /* Whether reads are served by the IO loop's io_uring backend */
+  bool reads_via_io_uring() const { return _uring_id != 0; }
+
   std::future<UvErr> listen_impl(const std::string&, const std::string&,
                                  addr_family, acceptor_fn_t);
 
@@ -275,16 +342,12 @@ protected:
 
   options _sockopts;
 
-  /* Store user requests to write bytes. These are queued until handled by
-   * the IO thread, via service_pending_write(). */
-  std::vector<uv_buf_t> _pending_write;
-  std::mutex _pending_write_lock;
-
   /* User callbacks. */
   io_on_read _io_on_read;
   io_on_error _io_on_error;
 
-  socket_state _state;
+  /* Read without a lock; changed only with _state_lock held. */
+  std::atomic<socket_state> _state;
   mutable std::mutex _state_lock;
 
   mutable std::mutex _details_lock;
@@ -297,8 +360,16 @@ private:
 
   static const char* to_string(TcpSocket::socket_state);
 
+  struct WriteQueue;
+
   void on_read_cb(ssize_t, const uv_buf_t*);
+  void sample_rx_time();
   void on_write_cb(uv_write_t*, int);
+  int submit_write(uv_write_t*, const uv_buf_t[], unsigned);
+  bool try_direct_write(uv_buf_t&, std::shared_ptr<const void>&);
+  void end_write();
+  void take_writes(std::vector<uv_buf_t>&,
+                   std::vector<std::shared_ptr<const void>>&);
   void close_once_on_io();
   void do_write();
   void begin_close(bool no_linger = false);
@@ -314,11 +385,39 @@ private:
 
   uv_tcp_t* _tcp;
 
+  // registration with the IoLoop io_uring backend, once reading; IO thread
+  uint64_t _uring_id = 0;
+
+  // SO_TIMESTAMPING enabled, and the latest receive timestamp; IO thread
+  bool _rx_timestamping = false;
+  uint64_t _rx_time = 0;
+
   std::unique_ptr<std::promise<void>> _io_closed_promise;
   std::shared_future<void> _io_closed_future;
 
   std::atomic<size_t> _bytes_pending_write;
-  size_t _bytes_written;
+  memory::Charge _pending_write_charge; // of the above; IO thread
+  std::atomic<size_t> _bytes_written;
+
+  /* User requests to write bytes, pushed by any thread and taken by the IO
+   * thread, via service_pending_write(); shared with the tasks queued to
+   * service it, which may outlive the socket. */
+  std::shared_ptr<WriteQueue> _write_queue;
+
+  /* Buffers returned by return_pending_write; IO thread. */
+  std::vector<uv_buf_t> _write_backlog;
+
+  /* Write requests being taken from the queue, or submitted, and not yet
+   * completed, counting a backlog as one.  A direct write is only made when
+   * there are none, and the queue is empty, so that bytes are never
+   * reordered. */
+  std::atomic<size_t> _writes_in_flight{0};
+
+  /* Set by the one thread making a direct write, during the send.  The IO
+   * thread waits for it to clear before submitting a write, or closing the
+   * descriptor, having first marked the write in flight, or the socket
+   * closing, which the direct writer checks once it has set the flag. */
+  std::atomic<bool> _direct_writing{false};
   size_t _bytes_read;
 
   on_close_cb _user_close_fn;
@@ -0,0 +1,196 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/infra/UdpSocket.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/core/Logger.hpp>
+
+#include <cstring>
+
+namespace apex
+{
+
+UdpSocket::UdpSocket(IoLoop& loop) : _io_loop(loop)
+{
+  memset(&_dest, 0, sizeof(_dest));
+}
+
+
+UdpSocket::~UdpSocket() { close(); }
+
+
+std::future<UvErr> UdpSocket::open_sender(MulticastOptions options)
+{
+  auto prom = std::make_shared<std::promise<UvErr>>();
+  auto fut = prom->get_future();
+  if (_io_loop.this_thread_is_io())
+    prom->set_value(io_open(options, false));
+  else
+    _io_loop.push_fn([this, prom, options]() {
+      prom->set_value(io_open(options, false));
+    });
+  return fut;
+}
+
+
+std::future<UvErr> UdpSocket::open_receiver(MulticastOptions options,
+                                            on_read_cb cb)
+{
+  auto prom = std::make_shared<std::promise<UvErr>>();
+  auto fut = prom->get_future();
+  auto fn = [this, prom, options, cb]() {
+    _on_read = cb;
+    prom->set_value(io_open(options, true));
+  };
+  if (_io_loop.this_thread_is_io())
+    fn();
+  else
+    _io_loop.push_fn(fn);
+  return fut;
+}
+
+
+UvErr UdpSocket::io_open(const MulticastOptions& options, bool receiver)
+{
+  /* IO thread */
+  if (_udp)
+    return UvErr(UV_EALREADY);
+
+  int r = uv_ip4_addr(options.group.c_str(), options.port,
+                      (sockaddr_in*)&_dest);
+  if (r == 0 && receiver) {
+    // allow several receivers on the one host
+    sockaddr_in any;
+    uv_ip4_addr("0.0.0.0", options.port, &any);
+    _udp = new uv_udp_t();
+    uv_udp_init(_io_loop.uv_loop(), _udp);
+    _udp->data = new HandleData(HandleData::handle_type::udp_socket, this);
+    r = uv_udp_bind(_udp, (const sockaddr*)&any, UV_UDP_REUSEADDR);
+    if (r == 0)
+      r = uv_udp_set_membership(
+          _udp, options.group.c_str(),
+          options.interface.empty() ? nullptr : options.interface.c_str(),
+          UV_JOIN_GROUP);
+    if (r == 0) {
+      _read_buf.resize(65536);
+      r = uv_udp_recv_start(
+          _udp,
+          [](uv_handle_t* h, size_t, uv_buf_t* buf) {
+            auto* self = static_cast<UdpSocket*>(
+                static_cast<HandleData*>(h->data)->user_ptr());
+            *buf = uv_buf_init(self->_read_buf.data(), self->_read_buf.size());
+          },
+          [](uv_udp_t* h, ssize_t nread, const uv_buf_t* buf,
+             const sockaddr* addr, unsigned /*flags*/) {
+            auto* self = static_cast<UdpSocket*>(
+                static_cast<HandleData*>(h->data)->user_ptr());
+            if (nread > 0 && addr && self->_on_read) {
+              try {
+                self->_on_read(buf->base, nread);
+              } catch (std::exception& e) {
+                LOG_ERROR("exception in UDP read callback: " << e.what());
+              }
+            }
+          });
+    }
+  } else if (r == 0) {
+    _udp = new uv_udp_t();
+    uv_udp_init(_io_loop.uv_loop(), _udp);
+    _udp->data = new HandleData(HandleData::handle_type::udp_socket, this);
+    // bind to an ephemeral port, so the socket exists for the options below
+    sockaddr_in any;
+    uv_ip4_addr("0.0.0.0", 0, &any);
+    r = uv_udp_bind(_udp, (const sockaddr*)&any, 0);
+    if (r == 0)
+      r = uv_udp_set_multicast_ttl(_udp, options.ttl);
+    if (r == 0)
+      r = uv_udp_set_multicast_loop(_udp, options.loopback ? 1 : 0);
+    if (r == 0 && !options.interface.empty())
+      r = uv_udp_set_multicast_interface(_udp, options.interface.c_str());
+  }
+
+  if (r && _udp) {
+    uv_close((uv_handle_t*)_udp, free_socket);
+    _udp = nullptr;
+  }
+  return UvErr(r);
+}
+
+
+void UdpSocket::send(const char* src, size_t len)
+{
+  if (_io_loop.this_thread_is_io()) {
+    io_send(src, len);
+    return;
+  }
+
+  auto copy = std::make_shared<std::vector<char>>(src, src + len);
+  try {
+    _io_loop.push_fn([this, copy]() { io_send(copy->data(), copy->size()); });
+  } catch (IoLoopClosed&) {
+    _send_failures++;
+  }
+}
+
+
+void UdpSocket::io_send(const char* src, size_t len)
+{
+  /* IO thread */
+  if (!_udp) {
+    _send_failures++;
+    return;
+  }
+
+  uv_buf_t buf = uv_buf_init(const_cast<char*>(src), len);
+  int r = uv_udp_try_send(_udp, &buf, 1, (const sockaddr*)&_dest);
+  if (r < 0)
+    _send_failures++;
+  else
+    _sent++;
+}
+
+
+void UdpSocket::close()
+{
+  auto do_close = [this]() {
+    if (_udp && !uv_is_closing((uv_handle_t*)_udp)) {
+      uv_udp_recv_stop(_udp);
+      uv_close((uv_handle_t*)_udp, free_socket);
+    }
+    _udp = nullptr;
+  };
+
+  if (_io_loop.this_thread_is_io()) {
+    do_close();
+    return;
+  }
+
+  auto prom = std::make_shared<std::promise<void>>();
+  auto fut = prom->get_future();
+  try {
+    _io_loop.push_fn([do_close, prom]() {
+      do_close();
+      prom->set_value();
+    });
+  } catch (IoLoopClosed&) {
+    // the IO loop closes all remaining handles as it stops
+    _udp = nullptr;
+    return;
+  }
+  fut.wait();
+}
+
+} // namespace apex
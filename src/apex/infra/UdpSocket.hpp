@@ -0,0 +1,88 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <apex/infra/UvErr.hpp>
+
+#include <atomic>
+#include <functional>
+#include <future>
+#include <string>
+#include <vector>
+
+#include <uv.h>
+
+namespace apex
+{
+
+class IoLoop;
+
+/* A UDP socket, for sending to, or receiving from, a multicast group.  Sends
+ * are not queued: a datagram that cannot be sent immediately is dropped, and
+ * counted, which suits sequenced feeds that recover gaps by other means. */
+class UdpSocket
+{
+public:
+  typedef std::function<void(const char*, size_t)> on_read_cb;
+
+  struct MulticastOptions {
+    std::string group;
+    int port = 0;
+    std::string interface; // local address of the interface; empty for any
+    int ttl = 1;
+    bool loopback = true; // deliver to receivers on the sending host
+  };
+
+  explicit UdpSocket(IoLoop&);
+  ~UdpSocket();
+
+  UdpSocket(const UdpSocket&) = delete;
+  UdpSocket& operator=(const UdpSocket&) = delete;
+
+  /* Prepare to send datagrams to the multicast group.  When called on the IO
+   * thread, the socket is opened before returning. */
+  std::future<UvErr> open_sender(MulticastOptions);
+
+  /* Bind to the group port and join the group; the read callback is invoked
+   * on the IO thread for each datagram received. */
+  std::future<UvErr> open_receiver(MulticastOptions, on_read_cb);
+
+  /* Send a datagram to the group.  Can be called from any thread, although
+   * sends from other threads first copy the datagram to the IO thread. */
+  void send(const char*, size_t);
+
+  /* Close the socket; on return, no further callbacks are made. */
+  void close();
+
+  uint64_t datagrams_sent() const { return _sent; }
+  uint64_t send_failures() const { return _send_failures; }
+
+private:
+  UvErr io_open(const MulticastOptions&, bool receiver);
+  void io_send(const char*, size_t);
+
+  IoLoop& _io_loop;
+  uv_udp_t* _udp = nullptr; // IO thread
+  sockaddr_storage _dest;
+  on_read_cb _on_read;
+  std::vector<char> _read_buf;
+
+  std::atomic<uint64_t> _sent{0};
+  std::atomic<uint64_t> _send_failures{0};
+};
+
+} // namespace apex
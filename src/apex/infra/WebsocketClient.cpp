@@ -27,7 +27,8 @@ WebsocketClient::WebsocketClient(RealtimeEventLoop& evloop,
                                  std::unique_ptr<TcpSocket> sock,
                                  std::string path, MsgCallback msg_cb,
                                  OnOpenCallback on_open,
-                                 OnCloseCallback on_close)
+                                 OnCloseCallback on_close,
+                                 bool permessage_deflate, int serialisers)
   : _event_loop(evloop),
     _socket(std::move(sock)),
     _path(path),
@@ -65,6 +66,8 @@ WebsocketClient::WebsocketClient(RealtimeEventLoop& evloop,
   // build the wire level protocol handler
   WebsocketProtocol::options protocol_options;
   protocol_options.request_uri = path;
+  protocol_options.permessage_deflate = permessage_deflate;
+  protocol_options.serialisers = serialisers;
   _proto = new WebsocketProtocol(
       this->_socket.get(), msg_cb,
       {std::move(request_timer_cb), std::move(protocol_closed_fn)},
@@ -51,7 +51,9 @@ public:
                   std::string path,
                   MsgCallback msg_cb,
                   OnOpenCallback on_open,
-                  OnCloseCallback on_close);
+                  OnCloseCallback on_close,
+                  bool permessage_deflate = false,
+                  int serialisers = (int)serialiser_type::json);
 
   ~WebsocketClient();
 
@@ -60,6 +62,18 @@ public:
 
   bool is_open() const { return _is_open; }
 
+  bool is_deflate_enabled() const { return _proto->is_deflate_enabled(); }
+
+  /* Totals of compressed bytes received and what they inflated to, both zero
+   * unless permessage-deflate was negotiated. */
+  WebsocketProtocol::inflate_stats get_inflate_stats() const
+  {
+    return _proto->get_inflate_stats();
+  }
+
+  /* Serialisation agreed in the handshake, from those offered. */
+  serialiser_type serialiser() const { return _proto->serialiser(); }
+
   void sync_close();
 
 private:
@@ -0,0 +1,161 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <apex/infra/WebsocketDeflate.hpp>
+#include <apex/infra/WebsocketProtocol.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <zlib.h>
+
+namespace apex::ws
+{
+
+static int parse_window_bits(const std::string& param, const std::string& value)
+{
+  if (value.size() == 0 || value.size() > 2 ||
+      !std::all_of(value.begin(), value.end(), ::isdigit))
+    throw handshake_error("invalid permessage-deflate " + param);
+  int bits = std::stoi(value);
+  if (bits < 8 || bits > 15)
+    throw handshake_error("invalid permessage-deflate " + param);
+  return bits;
+}
+
+
+bool parse_deflate_response(const std::string& header, DeflateParams& params)
+{
+  bool accepted = false;
+
+  for (auto& extension : split(header, ',')) {
+    auto fields = split(extension, ';');
+    if (fields.empty() || trim(fields[0]).empty())
+      continue;
+
+    if (trim(fields[0]) != "permessage-deflate" || accepted)
+      throw handshake_error("websocket extension not offered: " +
+                            trim(extension));
+
+    accepted = true;
+    params = DeflateParams{};
+    for (size_t i = 1; i < fields.size(); ++i) {
+      std::string param = trim(fields[i]);
+      std::string value;
+      if (auto eq = param.find('='); eq != std::string::npos) {
+        value = trim(trim(param.substr(eq + 1)), "\"");
+        param = trim(param.substr(0, eq));
+      }
+
+      if (param == "server_no_context_takeover" && value.empty())
+        params.server_no_context_takeover = true;
+      else if (param == "client_no_context_takeover" && value.empty())
+        params.client_no_context_takeover = true;
+      else if (param == "server_max_window_bits")
+        params.server_max_window_bits = parse_window_bits(param, value);
+      else if (param == "client_max_window_bits")
+        params.client_max_window_bits = parse_window_bits(param, value);
+      else
+        throw handshake_error("invalid permessage-deflate parameter: " +
+                              param);
+    }
+  }
+
+  return accepted;
+}
+
+
+struct Inflater::Impl {
+  z_stream zs{};
+};
+
+
+Inflater::Inflater(const DeflateParams& params)
+  : _impl(new Impl), _reset_per_msg(params.server_no_context_takeover)
+{
+  // a raw deflate stream, without zlib header or trailer
+  if (inflateInit2(&_impl->zs, -params.server_max_window_bits) != Z_OK)
+    throw std::runtime_error("inflateInit2 failed");
+}
+
+
+Inflater::~Inflater() { inflateEnd(&_impl->zs); }
+
+
+std::string_view Inflater::inflate(const char* src, size_t len, char* buf,
+                                   size_t cap, size_t max_len)
+{
+  /* The sender strips the empty stored block that ends each message, which
+   * is restored here so that all of the message's output is flushed. */
+  static const char tail[4] = {0x00, 0x00, char(0xFF), char(0xFF)};
+
+  z_stream& zs = _impl->zs;
+  char* out = buf;
+  size_t out_cap = cap;
+  size_t out_len = 0;
+  bool stream_end = false;
+
+  auto run = [&](const char* in, size_t in_len) {
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+    zs.avail_in = static_cast<uInt>(in_len);
+    zs.avail_out = 1; // any non-zero, to enter the loop
+
+    while (!stream_end && (zs.avail_in > 0 || zs.avail_out == 0)) {
+      if (out_len == out_cap) {
+        if (out_len >= max_len)
+          throw protocol_error("websocket message too big");
+        if (out != _spill.data())
+          _spill.assign(out, out + out_len);
+        out_cap = std::max<size_t>({2 * out_len, 64 * 1024, _spill.capacity()});
+        _spill.resize(out_cap);
+        out = _spill.data();
+      }
+
+      zs.next_out = reinterpret_cast<Bytef*>(out + out_len);
+      zs.avail_out = static_cast<uInt>(out_cap - out_len);
+      int rc = ::inflate(&zs, Z_SYNC_FLUSH);
+      out_len = out_cap - zs.avail_out;
+
+      if (rc == Z_STREAM_END) {
+        // the sender ended the deflate stream; the next message starts anew
+        stream_end = true;
+      } else if (rc == Z_BUF_ERROR) {
+        break; // no progress possible, all output is flushed
+      } else if (rc != Z_OK) {
+        throw protocol_error(std::string("websocket inflate failed: ") +
+                             (zs.msg ? zs.msg : "unknown error"));
+      }
+    }
+  };
+
+  run(src, len);
+  run(tail, sizeof(tail));
+
+  if (out_len > max_len)
+    throw protocol_error("websocket message too big");
+
+  if (stream_end || _reset_per_msg)
+    inflateReset(&zs);
+
+  _bytes_in.fetch_add(len, std::memory_order_relaxed);
+  _bytes_out.fetch_add(out_len, std::memory_order_relaxed);
+  return {out, out_len};
+}
+
+} // namespace apex::ws
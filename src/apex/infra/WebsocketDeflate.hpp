@@ -0,0 +1,89 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace apex::ws
+{
+
+/* Extension offered by a client wanting compressed messages.  We never compress
+ * the messages we send, so make no offer about our own window. */
+static constexpr const char* permessage_deflate_offer = "permessage-deflate";
+
+/* Parameters of a permessage-deflate extension (RFC7692) accepted by the
+ * server. */
+struct DeflateParams {
+  bool server_no_context_takeover = false;
+  bool client_no_context_takeover = false;
+  int server_max_window_bits = 15;
+  int client_max_window_bits = 15;
+};
+
+/* Parse the Sec-WebSocket-Extensions header of a handshake response.  Returns
+ * true if the server accepted permessage-deflate, filling in its parameters.
+ * Throws handshake_error for any other extension, or invalid parameters. */
+bool parse_deflate_response(const std::string& header, DeflateParams&);
+
+
+/* Decompressor for the messages of one connection.  Unless the server resets
+ * its context per message, the deflate window carries across messages, so
+ * every compressed message of the connection must pass through the same
+ * Inflater, in order. */
+class Inflater
+{
+public:
+  explicit Inflater(const DeflateParams&);
+  ~Inflater();
+
+  Inflater(const Inflater&) = delete;
+  Inflater& operator=(const Inflater&) = delete;
+
+  /* Decompress one message.  Output is written to `buf`, of `cap` bytes; a
+   * message that does not fit is instead completed in a spill buffer that the
+   * Inflater retains, and so reuses, for later messages.  The returned view is
+   * valid until the next call.  Throws protocol_error for corrupt input, or
+   * output longer than `max_len`. */
+  std::string_view inflate(const char* src, size_t len, char* buf, size_t cap,
+                           size_t max_len);
+
+  /* Totals of compressed input and inflated output, for the connection; may
+   * be read from any thread. */
+  uint64_t bytes_in() const { return _bytes_in.load(std::memory_order_relaxed); }
+  uint64_t bytes_out() const
+  {
+    return _bytes_out.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> _impl;
+  bool _reset_per_msg;
+  std::vector<char> _spill;
+  std::atomic<uint64_t> _bytes_in{0};
+  std::atomic<uint64_t> _bytes_out{0};
+};
+
+} // namespace apex::ws
@@ -0,0 +1,274 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <apex/infra/WebsocketFrame.hpp>
+#include <apex/infra/WebsocketProtocol.hpp>
+#include <apex/util/CpuDispatch.hpp>
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define APEX_WS_X86
+#endif
+
+namespace apex::ws
+{
+
+namespace
+{
+
+// Key with its bytes rotated to start at payload position `offset`, so that a
+// word of payload at that position is masked with a single XOR.
+uint32_t rotate_key(uint32_t mask_key, size_t offset)
+{
+  unsigned char key[4], rotated[4];
+  memcpy(key, &mask_key, 4);
+  for (size_t i = 0; i < 4; ++i)
+    rotated[i] = key[(i + offset) & 3];
+  uint32_t result;
+  memcpy(&result, rotated, 4);
+  return result;
+}
+
+
+void mask_scalar(char* dst, const char* src, size_t len, uint32_t key)
+{
+  unsigned char k[4];
+  memcpy(k, &key, 4);
+  for (size_t i = 0; i < len; ++i)
+    dst[i] = src[i] ^ k[i & 3];
+}
+
+
+// Word-sized steps keep the key phase, so the scalar loop can complete the
+// tail with the same key.
+void mask_words(char* dst, const char* src, size_t len, uint32_t key)
+{
+  uint64_t key64 = (uint64_t(key) << 32) | key;
+  size_t i = 0;
+  for (; len - i >= 8; i += 8) {
+    uint64_t word;
+    memcpy(&word, src + i, 8);
+    word ^= key64;
+    memcpy(dst + i, &word, 8);
+  }
+  mask_scalar(dst + i, src + i, len - i, key);
+}
+
+
+#ifdef APEX_WS_X86
+
+__attribute__((target("avx2")))
+void mask_avx2(char* dst, const char* src, size_t len, uint32_t key);
+
+
+__attribute__((target("avx512f")))
+void mask_avx512(char* dst, const char* src, size_t len, uint32_t key)
+{
+  const __m512i k = _mm512_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; len - i >= 64; i += 64) {
+    __m512i bytes = _mm512_loadu_si512(src + i);
+    _mm512_storeu_si512(dst + i, _mm512_xor_si512(bytes, k));
+  }
+  mask_avx2(dst + i, src + i, len - i, key);
+}
+
+
+__attribute__((target("avx2")))
+void mask_avx2(char* dst, const char* src, size_t len, uint32_t key)
+{
+  const __m256i k = _mm256_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; len - i >= 32; i += 32) {
+    __m256i bytes =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_xor_si256(bytes, k));
+  }
+  mask_words(dst + i, src + i, len - i, key);
+}
+
+
+void mask_sse2(char* dst, const char* src, size_t len, uint32_t key)
+{
+  const __m128i k = _mm_set1_epi32(static_cast<int>(key));
+  size_t i = 0;
+  for (; len - i >= 16; i += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_xor_si128(bytes, k));
+  }
+  mask_words(dst + i, src + i, len - i, key);
+}
+
+#endif
+
+
+using MaskFn = void (*)(char*, const char*, size_t, uint32_t);
+
+
+const KernelVariant<MaskFn>& kernel()
+{
+  static const auto selected = select_kernel<MaskFn>(
+      "ws_mask",
+      {
+#ifdef APEX_WS_X86
+          {Isa::avx512, mask_avx512},
+          {Isa::avx2, mask_avx2},
+          {Isa::sse2, mask_sse2},
+#endif
+          {Isa::scalar, mask_words}});
+  return selected;
+}
+
+// resolved while the program loads
+[[maybe_unused]] const auto& resolved_kernel = kernel();
+
+} // namespace
+
+
+const char* to_string(Opcode op)
+{
+  switch (op) {
+    case Opcode::continuation:
+      return "continuation";
+    case Opcode::text:
+      return "text";
+    case Opcode::binary:
+      return "binary";
+    case Opcode::close:
+      return "close";
+    case Opcode::ping:
+      return "ping";
+    case Opcode::pong:
+      return "pong";
+  }
+  return "unknown";
+}
+
+
+size_t decode_header(const char* src, size_t avail, FrameHeader& fh)
+{
+  if (avail < 2)
+    return 0;
+
+  auto b0 = static_cast<uint8_t>(src[0]);
+  auto b1 = static_cast<uint8_t>(src[1]);
+
+  if (b0 & 0x30)
+    throw protocol_error("websocket frame has reserved bits set");
+
+  fh.fin = b0 & 0x80;
+  fh.rsv1 = b0 & 0x40;
+  fh.opcode = static_cast<Opcode>(b0 & 0x0F);
+  fh.masked = b1 & 0x80;
+
+  switch (fh.opcode) {
+    case Opcode::continuation:
+    case Opcode::text:
+    case Opcode::binary:
+    case Opcode::close:
+    case Opcode::ping:
+    case Opcode::pong:
+      break;
+    default:
+      throw protocol_error("websocket frame has unknown opcode");
+  }
+
+  size_t len7 = b1 & 0x7F;
+  size_t header_len = 2 + (len7 == 126 ? 2 : len7 == 127 ? 8 : 0) +
+                      (fh.masked ? 4 : 0);
+  if (avail < header_len)
+    return 0;
+
+  const auto* p = reinterpret_cast<const uint8_t*>(src) + 2;
+  if (len7 == 126) {
+    fh.payload_len = (uint64_t(p[0]) << 8) | p[1];
+    p += 2;
+  } else if (len7 == 127) {
+    fh.payload_len = 0;
+    for (int i = 0; i < 8; ++i)
+      fh.payload_len = (fh.payload_len << 8) | p[i];
+    p += 8;
+    if (fh.payload_len >> 63)
+      throw protocol_error("websocket frame length has top bit set");
+  } else
+    fh.payload_len = len7;
+
+  fh.mask_key = 0;
+  if (fh.masked)
+    memcpy(&fh.mask_key, p, 4);
+
+  if (is_control(fh.opcode) &&
+      (!fh.fin || fh.rsv1 || fh.payload_len > max_control_payload))
+    throw protocol_error("websocket control frame fragmented, compressed or "
+                         "too long");
+
+  return header_len;
+}
+
+
+size_t encode_header(char* dst, bool fin, Opcode op, uint64_t payload_len,
+                     const uint32_t* mask_key)
+{
+  auto* p = reinterpret_cast<uint8_t*>(dst);
+  p[0] = (fin ? 0x80 : 0x00) | static_cast<uint8_t>(op);
+  uint8_t mask_bit = mask_key ? 0x80 : 0x00;
+  size_t len = 2;
+
+  if (payload_len < 126) {
+    p[1] = mask_bit | static_cast<uint8_t>(payload_len);
+  } else if (payload_len <= 0xFFFF) {
+    p[1] = mask_bit | 126;
+    p[2] = static_cast<uint8_t>(payload_len >> 8);
+    p[3] = static_cast<uint8_t>(payload_len);
+    len = 4;
+  } else {
+    p[1] = mask_bit | 127;
+    for (int i = 0; i < 8; ++i)
+      p[2 + i] = static_cast<uint8_t>(payload_len >> (8 * (7 - i)));
+    len = 10;
+  }
+
+  if (mask_key) {
+    memcpy(p + len, mask_key, 4);
+    len += 4;
+  }
+  return len;
+}
+
+
+void apply_mask(char* dst, const char* src, size_t len, uint32_t mask_key,
+                size_t offset)
+{
+  kernel().fn(dst, src, len, rotate_key(mask_key, offset));
+}
+
+
+void apply_mask_scalar(char* dst, const char* src, size_t len,
+                       uint32_t mask_key, size_t offset)
+{
+  mask_scalar(dst, src, len, rotate_key(mask_key, offset));
+}
+
+
+const char* apply_mask_isa() { return to_string(kernel().isa); }
+
+} // namespace apex::ws
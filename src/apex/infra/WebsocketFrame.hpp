@@ -0,0 +1,94 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace apex::ws
+{
+
+/* RFC6455 frame opcodes */
+enum class Opcode : uint8_t {
+  continuation = 0x0,
+  text = 0x1,
+  binary = 0x2,
+  close = 0x8,
+  ping = 0x9,
+  pong = 0xA
+};
+
+inline bool is_control(Opcode op) { return static_cast<uint8_t>(op) & 0x8; }
+
+const char* to_string(Opcode);
+
+/* RFC6455 close status codes */
+namespace close_code
+{
+static constexpr uint16_t normal = 1000;
+static constexpr uint16_t protocol_error = 1002;
+static constexpr uint16_t message_too_big = 1009;
+} // namespace close_code
+
+/* Largest possible frame header: two fixed bytes, a 64 bit extended length,
+ * and the masking key. */
+static constexpr size_t max_header_size = 14;
+
+/* Control frames carry at most this many payload bytes, and are never
+ * fragmented. */
+static constexpr size_t max_control_payload = 125;
+
+struct FrameHeader {
+  bool fin;
+  bool rsv1; // compressed message, under permessage-deflate
+  Opcode opcode;
+  bool masked;
+  uint32_t mask_key; // key bytes in wire order, loaded as a native word
+  uint64_t payload_len;
+};
+
+/* Decode the frame header at the start of [src, src+avail).  Returns the
+ * header length, or 0 if more bytes are needed.  Throws protocol_error for
+ * headers no peer should send: RSV2 or RSV3 set (no extension uses them), an
+ * unknown opcode, a fragmented, oversized or compressed control frame, or a
+ * 64 bit length with the top bit set.  Whether RSV1 is valid depends on the
+ * extensions negotiated, so is left to the caller. */
+size_t decode_header(const char* src, size_t avail, FrameHeader&);
+
+/* Write a frame header to `dst`, which must have room for max_header_size
+ * bytes, and return its length.  A masking key is written when `mask_key` is
+ * not null. */
+size_t encode_header(char* dst, bool fin, Opcode, uint64_t payload_len,
+                     const uint32_t* mask_key);
+
+/* XOR `len` bytes from `src` with the masking key into `dst`, which may be the
+ * same as `src` but must not otherwise overlap it.  `offset` is the position
+ * of `src` within the frame payload, so that a payload can be processed in
+ * several pieces.  Uses the best of AVX-512, AVX2 and SSE2 the host has. */
+void apply_mask(char* dst, const char* src, size_t len, uint32_t mask_key,
+                size_t offset = 0);
+
+/* Byte-at-a-time version of apply_mask, having the same results. */
+void apply_mask_scalar(char* dst, const char* src, size_t len,
+                       uint32_t mask_key, size_t offset = 0);
+
+/* Name of the instruction set used by apply_mask. */
+const char* apply_mask_isa();
+
+} // namespace apex::ws
@@ -17,14 +17,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/infra/WebsocketProtocol.hpp>
 #include <apex/infra/HttpParser.hpp>
+#include <apex/infra/IoLoop.hpp>
 #include <apex/infra/TcpSocket.hpp>
-#include <apex/infra/WebsocketppImpl.hpp>
 #include <apex/core/Logger.hpp>
 #include <apex/util/platform.hpp>
 #include <apex/util/utils.hpp>
 
 #include <apache/base64.h> // from 3rdparty
 
+#include <algorithm>
+
 #include <assert.h>
 #include <string.h>
 
@@ -64,14 +66,6 @@ protocol::protocol(TcpSocket* h, t_msg_cb cb, protocol_callbacks callbacks,
 std::string protocol::fd() const { return m_socket->fd_info().second; }
 
 
-/**
- * This struct is used to hide the websocketpp types from public headers.
- */
-struct websocketpp_msg {
-  WebsocketConfig::message_type::ptr ptr;
-};
-
-
 WebsocketProtocol::WebsocketProtocol(TcpSocket* h, t_msg_cb msg_cb,
                                      protocol::protocol_callbacks callbacks,
                                      connect_mode mode, options opts)
@@ -82,7 +76,7 @@ WebsocketProtocol::WebsocketProtocol(TcpSocket* h, t_msg_cb msg_cb,
                                      ? HttpParser::e_http_request
                                      : HttpParser::e_http_response)),
     _options(std::move(opts)),
-    _websock_impl(new WebsocketppImpl(mode)),
+    _mask_seq(std::random_device{}()),
     _last_pong(std::chrono::steady_clock::now()),
     _missed_pings(0)
 {
@@ -126,29 +120,7 @@ static bool header_contains(const std::string& source, const std::string& match)
 
 void WebsocketProtocol::send_msg(const char* buf, size_t len)
 {
-  websocketpp::frame::opcode::value op{};
-  op = websocketpp::frame::opcode::text;
-
-  auto msg_ptr = _websock_impl->msg_manager()->get_message(op, len);
-  msg_ptr->append_payload(buf, len);
-  auto out_msg_ptr = _websock_impl->msg_manager()->get_message();
-
-  if (out_msg_ptr == nullptr)
-    throw std::runtime_error("failed to obtain msg object");
-
-  auto ec =
-      _websock_impl->processor()->prepare_data_frame(msg_ptr, out_msg_ptr);
-  if (ec)
-    throw std::runtime_error(ec.message());
-
-  LOG_DEBUG("fd: " << fd() << ", frame_tx: "
-                   << WebsocketppImpl::frame_to_string(out_msg_ptr));
-
-  std::pair<const char*, size_t> bufs[2] = {
-      {out_msg_ptr->get_header().data(), out_msg_ptr->get_header().size()},
-      {out_msg_ptr->get_payload().data(), out_msg_ptr->get_payload().size()}};
-
-  m_socket->write(bufs, 2);
+  send_frame(to_opcode(_serialiser), buf, len);
 }
 
 
@@ -168,114 +140,152 @@ void WebsocketProtocol::io_on_read(char* src, size_t len)
   /* IO thread */
 
   while (len) {
+    // Bytes are decoded directly from the socket read buffer, unless some
+    // are held over from an earlier read.
+    if (m_buf.avail() == 0) {
+      RingDecodeBuffer::read_pointer rd(src, len);
+      process_input(rd);
+      src += rd.consumed();
+      len -= rd.consumed();
+      if (len == 0)
+        break;
+    }
+
     size_t consume_len = m_buf.consume(src, len);
     src += consume_len;
     len -= consume_len;
 
     auto rd = m_buf.read_ptr();
-    while (rd.avail()) {
-      if (_state == state::handling_http_request) {
-        auto consumed = _http_parser->handle_input(rd.ptr(), rd.avail());
-        LOG_DEBUG("fd: " << fd()
-                         << ", http_rx: " << std::string(rd.ptr(), consumed));
-        rd.advance(consumed);
-
-        if (_http_parser->is_good() == false)
-          throw handshake_error("bad http header: " +
-                                _http_parser->error_text());
-
-        if (_http_parser->is_complete()) {
-          if (_http_parser->is_upgrade() && _http_parser->has("upgrade") &&
-              header_contains(_http_parser->get("upgrade"), "websocket") &&
-              _http_parser->has("sec-websocket-key") &&
-              _http_parser->has("sec-websocket-version")) {
-            auto& websock_key = header_field("sec-websocket-key");
-            auto& websock_ver = header_field("sec-websocket-version");
-
-            if (websock_ver != RFC6455 /* 13 */)
-              throw handshake_error("incorrect websocket version");
-
-            bool sec_websocket_protocol_present =
-                _http_parser->has("sec-websocket-protocol");
-            if (sec_websocket_protocol_present) {
-              // auto& websock_sub = header_field("sec-websocket-protocol");
-
-              /* Note, here we would identify common protocol to use, but
-               * binance has no options other that json */
+    process_input(rd);
+
+    m_buf.discard(rd); /* advance past the decoded bytes */
+  }
+}
+
+
+void WebsocketProtocol::process_input(RingDecodeBuffer::read_pointer& rd)
+{
+  while (rd.avail()) {
+    if (_state == state::handling_http_request) {
+      auto consumed = _http_parser->handle_input(rd.ptr(), rd.avail());
+      LOG_DEBUG("fd: " << fd()
+                       << ", http_rx: " << std::string(rd.ptr(), consumed));
+      rd.advance(consumed);
+
+      if (_http_parser->is_good() == false)
+        throw handshake_error("bad http header: " +
+                              _http_parser->error_text());
+
+      if (_http_parser->is_complete()) {
+        if (_http_parser->is_upgrade() && _http_parser->has("upgrade") &&
+            header_contains(_http_parser->get("upgrade"), "websocket") &&
+            _http_parser->has("sec-websocket-key") &&
+            _http_parser->has("sec-websocket-version")) {
+          auto& websock_key = header_field("sec-websocket-key");
+          auto& websock_ver = header_field("sec-websocket-version");
+
+          if (websock_ver != RFC6455 /* 13 */)
+            throw handshake_error("incorrect websocket version");
+
+          // the client's first listed serialiser that is also enabled here;
+          // a client offering none is taken to use JSON
+          if (_http_parser->has("sec-websocket-protocol")) {
+            auto& offered = header_field("sec-websocket-protocol");
+            _serialiser = select_subprotocol(offered, _options.serialisers);
+            if (_serialiser == serialiser_type::none)
+              throw handshake_error("no supported websocket subprotocol in " +
+                                    offered);
+          }
+
+          std::ostringstream os;
+          os << "HTTP/1.1 101 Switching Protocols\r\n"
+             << "Upgrade: websocket\r\n"
+             << "Connection: Upgrade\r\n"
+             << "Sec-WebSocket-Accept: " << make_accept_key(websock_key)
+             << "\r\n";
+          os << "Sec-WebSocket-Protocol: " << to_header(_serialiser) << "\r\n";
+          os << "\r\n";
+          std::string msg = os.str();
+
+          LOG_DEBUG("fd: " << fd() << ", http_tx: " << msg);
+
+          m_socket->write(msg.c_str(), msg.size());
+          _state = state::open;
+        } else if (_http_parser->has("connection") &&
+                   header_contains(_http_parser->get("connection"),
+                                   "close")) {
+          /* Received a http header that requests connection close.  This is
+           * straight-forward to obey (just echo the header and close the
+           * socket). This kind of request can be received when connected to a
+           * load balancer that is checking server health. */
+
+          LOG_DEBUG("fd: " << fd() << ", http_tx: " << http_200_response);
+          m_socket->write(http_200_response.c_str(),
+                          http_200_response.size());
+          _state = state::closed;
+
+          // request session closure after delay, gives time of peer to close,
+          // and for message to be fully written
+          m_callbacks.protocol_closed(std::chrono::milliseconds(3000));
+        } else
+          throw handshake_error("http header is not a websocket upgrade");
+      }
+    } else if (_state == state::handling_http_response) {
+      auto consumed = _http_parser->handle_input(rd.ptr(), rd.avail());
+      LOG_DEBUG("fd: " << fd()
+                       << ", http_rx: " << std::string(rd.ptr(), consumed));
+      rd.advance(consumed);
+
+      if (_http_parser->is_good() == false)
+        throw handshake_error("bad http header: " +
+                              _http_parser->error_text());
+
+      if (_http_parser->is_complete()) {
+        if (_http_parser->is_upgrade() && _http_parser->has("upgrade") &&
+            header_contains(_http_parser->get("upgrade"), "websocket") &&
+            _http_parser->has("sec-websocket-accept") &&
+            _http_parser->http_status_phrase() == "Switching Protocols" &&
+            _http_parser->http_status_code() ==
+                HttpParser::status_code_switching_protocols) {
+          auto& websock_key = header_field("sec-websocket-accept");
+
+          if (websock_key != _expected_accept_key)
+            throw handshake_error("incorrect key for Sec-WebSocket-Accept");
+
+          // servers that name no subprotocol, such as exchanges, use JSON
+          if (_http_parser->has("sec-websocket-protocol")) {
+            auto& chosen = header_field("sec-websocket-protocol");
+            _serialiser = select_subprotocol(chosen, _options.serialisers);
+            if (_serialiser == serialiser_type::none)
+              throw handshake_error("websocket subprotocol not offered: " +
+                                    chosen);
+          } else if (!(_options.serialisers & serialiser_type::json))
+            throw handshake_error("websocket subprotocol not accepted");
+
+          if (_http_parser->has("sec-websocket-extensions")) {
+            auto& extensions = header_field("sec-websocket-extensions");
+            ws::DeflateParams params;
+            if (!_options.permessage_deflate)
+              throw handshake_error("websocket extension not offered: " +
+                                    extensions);
+            if (ws::parse_deflate_response(extensions, params)) {
+              _inflater.reset(new ws::Inflater(params));
+              LOG_DEBUG("fd: " << fd() << ", permessage-deflate enabled");
             }
+          }
 
-            std::ostringstream os;
-            os << "HTTP/1.1 101 Switching Protocols\r\n"
-               << "Upgrade: websocket\r\n"
-               << "Connection: Upgrade\r\n"
-               << "Sec-WebSocket-Accept: " << make_accept_key(websock_key)
-               << "\r\n";
-            os << "Sec-WebSocket-Protocol: json\r\n";
-            // if (sec_websocket_protocol_present)
-            //   os << "Sec-WebSocket-Protocol: " << to_header(m_codec->type())
-            //   << "\r\n";
-            os << "\r\n";
-            std::string msg = os.str();
-
-            LOG_DEBUG("fd: " << fd() << ", http_tx: " << msg);
-
-            m_socket->write(msg.c_str(), msg.size());
-            _state = state::open;
-          } else if (_http_parser->has("connection") &&
-                     header_contains(_http_parser->get("connection"),
-                                     "close")) {
-            /* Received a http header that requests connection close.  This is
-             * straight-forward to obey (just echo the header and close the
-             * socket). This kind of request can be received when connected to a
-             * load balancer that is checking server health. */
-
-            LOG_DEBUG("fd: " << fd() << ", http_tx: " << http_200_response);
-            m_socket->write(http_200_response.c_str(),
-                            http_200_response.size());
-            _state = state::closed;
-
-            // request session closure after delay, gives time of peer to close,
-            // and for message to be fully written
-            m_callbacks.protocol_closed(std::chrono::milliseconds(3000));
-          } else
-            throw handshake_error("http header is not a websocket upgrade");
-        }
-      } else if (_state == state::handling_http_response) {
-        auto consumed = _http_parser->handle_input(rd.ptr(), rd.avail());
-        LOG_DEBUG("fd: " << fd()
-                         << ", http_rx: " << std::string(rd.ptr(), consumed));
-        rd.advance(consumed);
-
-        if (_http_parser->is_good() == false)
-          throw handshake_error("bad http header: " +
-                                _http_parser->error_text());
-
-        if (_http_parser->is_complete()) {
-          if (_http_parser->is_upgrade() && _http_parser->has("upgrade") &&
-              header_contains(_http_parser->get("upgrade"), "websocket") &&
-              _http_parser->has("sec-websocket-accept") &&
-              _http_parser->http_status_phrase() == "Switching Protocols" &&
-              _http_parser->http_status_code() ==
-                  HttpParser::status_code_switching_protocols) {
-            auto& websock_key = header_field("sec-websocket-accept");
-            // auto& websock_sub = header_field("sec-websocket-protocol");
-
-            if (websock_key != _expected_accept_key)
-              throw handshake_error("incorrect key for Sec-WebSocket-Accept");
-
-
-            _state = state::open;
-            _initiate_cb();
-          } else
-            throw handshake_error("http header is not a websocket upgrade");
-        }
-      } else {
-        /* for all other websocket states, use the websocketpp parser */
-        process_frame_bytes(rd);
+
+          _state = state::open;
+          _initiate_cb();
+        } else
+          throw handshake_error("http header is not a websocket upgrade");
       }
+    } else {
+      /* for all other websocket states, decode frames; stop when the next
+       * frame is incomplete, leaving its bytes to be held over */
+      if (!process_frame_bytes(rd))
+        break;
     }
-
-    m_buf.discard(rd); /* shift unused bytes to front of DecodeBuffer */
   }
 }
 
@@ -325,13 +335,16 @@ void WebsocketProtocol::initiate(t_initiate_cb cb)
       break;
   }
 
-  oss << "Sec-WebSocket-Key: " << sec_websocket_key
-      << "\r\n"
-         "Sec-WebSocket-Protocol: json"
+  oss << "Sec-WebSocket-Key: " << sec_websocket_key << "\r\n"
+      << "Sec-WebSocket-Protocol: " << subprotocol_offer(_options.serialisers)
       << "\r\n";
 
   oss << "Sec-WebSocket-Version: " << RFC6455 << "\r\n";
 
+  if (_options.permessage_deflate)
+    oss << "Sec-WebSocket-Extensions: " << ws::permessage_deflate_offer
+        << "\r\n";
+
   for (auto& item : _options.extra_headers)
     oss << item.first << ": " << item.second << "\r\n";
 
@@ -345,43 +358,75 @@ void WebsocketProtocol::initiate(t_initiate_cb cb)
 }
 
 
-void WebsocketProtocol::send_impl(const websocketpp_msg& msg)
+uint32_t WebsocketProtocol::next_mask_key()
 {
-  LOG_DEBUG("fd: " << fd() << ", frame_tx: "
-                   << WebsocketppImpl::frame_to_string(msg.ptr));
+  /* Masking keys need only be unpredictable to the peer's intermediaries, so
+   * a mixed Weyl sequence suffices; it is safe to draw from on any thread. */
+  uint32_t x = _mask_seq.fetch_add(0x9E3779B9, std::memory_order_relaxed);
+  x ^= x >> 16;
+  x *= 0x7FEB352D;
+  x ^= x >> 15;
+  x *= 0x846CA68B;
+  x ^= x >> 16;
+  return x;
+}
 
-  if (msg.ptr->get_payload().empty()) {
-    m_socket->write(msg.ptr->get_header().data(), msg.ptr->get_header().size());
+
+void WebsocketProtocol::send_frame(ws::Opcode op, const char* payload,
+                                   size_t len)
+{
+  /* Frames from a client must be masked.  The payload is masked as it is
+   * copied into the frame, which the socket then takes as-is. */
+  uint32_t mask_key = 0;
+  const bool masked = (mode() == connect_mode::active);
+  if (masked)
+    mask_key = next_mask_key();
+
+  char header[ws::max_header_size];
+  size_t header_len =
+      ws::encode_header(header, true, op, len, masked ? &mask_key : nullptr);
+
+  LOG_DEBUG("fd: " << fd() << ", frame_tx: fin 1, opcode " << ws::to_string(op)
+                   << ", payload_len " << len);
+
+  auto fill = [&](char* frame) {
+    memcpy(frame, header, header_len);
+    if (masked)
+      ws::apply_mask(frame + header_len, payload, len, mask_key);
+    else if (len)
+      memcpy(frame + header_len, payload, len);
+  };
+
+  if (ws::is_control(op)) {
+    /* control frames are small enough to build on the stack */
+    char frame[ws::max_header_size + ws::max_control_payload];
+    fill(frame);
+    m_socket->write(frame, header_len + len);
   } else {
-    std::pair<const char*, size_t> bufs[2] = {
-        {msg.ptr->get_header().data(), msg.ptr->get_header().size()},
-        {msg.ptr->get_payload().data(), msg.ptr->get_payload().size()}};
-    m_socket->write(bufs, 2);
+    std::shared_ptr<char[]> frame(new char[header_len + len]);
+    fill(frame.get());
+    m_socket->write(frame, frame.get(), header_len + len);
   }
 }
 
 
-void WebsocketProtocol::send_ping()
-{
-  websocketpp_msg msg{_websock_impl->msg_manager()->get_message()};
-  _websock_impl->processor()->prepare_ping("", msg.ptr);
-  send_impl(msg);
-}
+void WebsocketProtocol::send_ping() { send_frame(ws::Opcode::ping, "", 0); }
 
 
-void WebsocketProtocol::send_pong(const std::string& payload)
+void WebsocketProtocol::send_pong(const char* payload, size_t len)
 {
-  websocketpp_msg msg{_websock_impl->msg_manager()->get_message()};
-  _websock_impl->processor()->prepare_pong(payload, msg.ptr);
-  send_impl(msg);
+  send_frame(ws::Opcode::pong, payload, len);
 }
 
 
 void WebsocketProtocol::send_close(uint16_t code, const std::string& reason)
 {
-  websocketpp_msg msg{_websock_impl->msg_manager()->get_message()};
-  _websock_impl->processor()->prepare_close(code, reason, msg.ptr);
-  send_impl(msg);
+  char payload[ws::max_control_payload];
+  payload[0] = static_cast<char>(code >> 8);
+  payload[1] = static_cast<char>(code);
+  size_t reason_len = std::min(reason.size(), sizeof(payload) - 2);
+  memcpy(payload + 2, reason.data(), reason_len);
+  send_frame(ws::Opcode::close, payload, 2 + reason_len);
 }
 
 
@@ -390,7 +435,7 @@ void WebsocketProtocol::on_timer()
   /* EV thread */
   if (_state == state::open) {
     if (_missed_pings.load() >= _options.max_missed_pings) {
-      send_close(websocketpp::close::status::protocol_error, "");
+      send_close(ws::close_code::protocol_error, "");
       _state = state::closed;
       m_callbacks.protocol_closed(std::chrono::milliseconds(0));
     } else {
@@ -409,103 +454,204 @@ const char* WebsocketProtocol::to_header(serialiser_type p)
     case serialiser_type::none:
       return "";
     case serialiser_type::json:
-      return WAMPV2_JSON_SUBPROTOCOL;
+      return JSON_SUBPROTOCOL;
+    case serialiser_type::msgpack:
+      return MSGPACK_SUBPROTOCOL;
   }
   return "";
 }
 
 
-void WebsocketProtocol::process_frame_bytes(DecodeBuffer::read_pointer& rd)
+ws::Opcode WebsocketProtocol::to_opcode(serialiser_type p)
 {
-  /* Feed bytes into the websocketpp stream parser. The parser will take only
-   * the bytes required to build the next websocket message; it won't slurp all
-   * the available bytes (i.e. its possible the consumed-count can be non-zero
-   * after the consume() operation). */
-  websocketpp::lib::error_code ec;
-  size_t consumed =
-      _websock_impl->processor()->consume((uint8_t*)rd.ptr(), rd.avail(), ec);
-  rd.advance(consumed);
+  return p == serialiser_type::msgpack ? ws::Opcode::binary : ws::Opcode::text;
+}
 
-  if (ec)
-    throw std::runtime_error(ec.message());
 
-  if (_websock_impl->processor()->get_error())
-    throw std::runtime_error("websocket parser fatal error");
+std::string WebsocketProtocol::subprotocol_offer(int serialisers)
+{
+  std::string offer;
+  for (auto type : {serialiser_type::msgpack, serialiser_type::json})
+    if (serialisers & type) {
+      if (!offer.empty())
+        offer += ", ";
+      offer += to_header(type);
+    }
+  return offer;
+}
 
+
+serialiser_type WebsocketProtocol::select_subprotocol(const std::string& offered,
+                                                      int serialisers)
+{
+  for (auto& item : split(offered, ',')) {
+    std::string name = trim(item);
+    for (auto type : {serialiser_type::msgpack, serialiser_type::json})
+      if ((serialisers & type) && strcasecmp(name.c_str(), to_header(type)) == 0)
+        return type;
+  }
+  return serialiser_type::none;
+}
+
+
+bool WebsocketProtocol::process_frame_bytes(RingDecodeBuffer::read_pointer& rd)
+{
   // treat arrival of any data as reseting the missed pings counter
   _missed_pings.store(0);
 
-  if (_websock_impl->processor()->ready()) {
-    // shared_ptr<message_buffer::message<...> >
-    auto msg = _websock_impl->processor()->get_message();
+  if (_rx_frame_remain) {
+    consume_payload(rd);
+    return true;
+  }
 
-    if (!msg)
-      throw std::runtime_error("none message from websocketpp");
+  ws::FrameHeader fh;
+  size_t header_len = ws::decode_header(rd.ptr(), rd.avail(), fh);
+  if (header_len == 0)
+    return false;
+
+  // a server only accepts masked frames, and a client only unmasked
+  if (fh.masked != (mode() == connect_mode::passive))
+    throw protocol_error(fh.masked ? "websocket frame masked by server"
+                                   : "websocket frame not masked by client");
+
+  LOG_DEBUG("fd: " << fd() << ", frame_rx: fin " << fh.fin << ", opcode "
+                   << ws::to_string(fh.opcode) << ", payload_len "
+                   << fh.payload_len);
+
+  size_t payload_avail = rd.avail() - header_len;
+
+  if (ws::is_control(fh.opcode)) {
+    /* control frames are at most 139 bytes, so wait for all of it */
+    if (payload_avail < fh.payload_len)
+      return false;
+    rd.advance(header_len);
+    char* payload = rd.ptr();
+    if (fh.masked)
+      ws::apply_mask(payload, payload, fh.payload_len, fh.mask_key);
+    rd.advance(fh.payload_len);
+    on_control_frame(fh.opcode, payload, fh.payload_len);
+    return true;
+  }
 
-    LOG_DEBUG("fd: " << fd() << ", frame_rx: "
-                     << WebsocketppImpl::frame_to_string(msg));
+  // only the first frame of a message carries the compressed bit
+  if (fh.rsv1 && (!_inflater || fh.opcode == ws::Opcode::continuation))
+    throw protocol_error("websocket frame has reserved bits set");
 
-    // if (msg->get_payload().size())
-    //   LOG_INFO(std::string(msg->get_payload().data(),
-    //   msg->get_payload().size()));
+  if ((fh.opcode == ws::Opcode::continuation) != _rx_msg_active)
+    throw protocol_error(_rx_msg_active
+                             ? "websocket data frame inside fragmented message"
+                             : "websocket continuation frame without message");
 
-    if (_state == state::closed)
-      return; // ingore bytes after protocol closed
+  if (_rx_msg.size() + fh.payload_len > MAX_MESSAGE_SIZE)
+    throw protocol_error("websocket message too big");
 
-    if (!is_control(msg->get_opcode())) {
-      // data message, dispatch to user
-      if ((msg->get_opcode() == websocketpp::frame::opcode::binary) ||
-          (msg->get_opcode() == websocketpp::frame::opcode::text)) {
+  rd.advance(header_len);
 
+  if (fh.fin && !_rx_msg_active && payload_avail >= fh.payload_len) {
+    /* an unfragmented message that is already whole: hand it over in place */
+    char* payload = rd.ptr();
+    if (fh.masked)
+      ws::apply_mask(payload, payload, fh.payload_len, fh.mask_key);
+    rd.advance(fh.payload_len);
+    on_data_msg(payload, fh.payload_len, fh.rsv1);
+    return true;
+  }
 
-        // TODO: is user throws, what should
-        /* user callback of raw data */
-        m_msg_processor(msg->get_payload().data(), msg->get_payload().size());
-      }
-    } else {
-      // control message
-      websocketpp::frame::opcode::value op = msg->get_opcode();
-
-      if (op == websocketpp::frame::opcode::PING) {
-        const auto now = std::chrono::steady_clock::now();
-        if ((now > _last_pong) &&
-            (now - _last_pong >= _options.pong_min_interval)) {
-          _last_pong = now;
-          send_pong(msg->get_payload());
-          return;
-        }
-      } else if (op == websocketpp::frame::opcode::PONG) {
-        // no-op
-      } else if (op == websocketpp::frame::opcode::CLOSE) {
-        if (_state == state::closing) {
-          // sent & received close-frame, so protocol closed
-          _state = state::closed;
-          m_callbacks.protocol_closed(std::chrono::milliseconds(0));
-        } else if (_state == state::open) {
-          // received & sending close-frame, so protocol closed
-          send_close(websocketpp::close::status::normal, "");
-          _state = state::closed;
+  if (!_rx_msg_active)
+    _rx_msg_compressed = fh.rsv1;
+  _rx_msg_active = true;
+  _rx_frame = fh;
+  _rx_frame_remain = fh.payload_len;
+  _rx_frame_offset = 0;
+  consume_payload(rd);
+  return true;
+}
 
-          // extract close code & message -- optional
-          //
-          //  first 2 bytes, are an error code
-          //  remainer might be an error string
-          //
-          //
-
-
-          // LOG_WARN("got a close frame");
-          // if ( msg->get_payload().size() > 0 ){
-          //   if ( msg->get_payload().size() > 2) {
-          //     msg->get_payload().size()
-          //     return ntohs(addrin->sin_port);
-          //   }
-          // }
-
-          send_pong(msg->get_payload());
-          m_callbacks.protocol_closed(std::chrono::milliseconds(0));
-        }
-      }
+
+void WebsocketProtocol::consume_payload(RingDecodeBuffer::read_pointer& rd)
+{
+  /* Copy the available part of the current frame's payload onto the message
+   * being reassembled, unmasking as it is copied. */
+  size_t take = std::min<uint64_t>(_rx_frame_remain, rd.avail());
+  if (take) {
+    size_t pos = _rx_msg.size();
+    _rx_msg.resize(pos + take);
+    if (_rx_frame.masked)
+      ws::apply_mask(_rx_msg.data() + pos, rd.ptr(), take, _rx_frame.mask_key,
+                     _rx_frame_offset);
+    else
+      memcpy(_rx_msg.data() + pos, rd.ptr(), take);
+    rd.advance(take);
+    _rx_frame_remain -= take;
+    _rx_frame_offset += take;
+  }
+
+  if (_rx_frame_remain == 0 && _rx_frame.fin) {
+    _rx_msg_active = false;
+    on_data_msg(_rx_msg.data(), _rx_msg.size(), _rx_msg_compressed);
+    _rx_msg.clear();
+  }
+}
+
+
+void WebsocketProtocol::on_data_msg(const char* payload, size_t len,
+                                    bool compressed)
+{
+  if (_state == state::closed)
+    return; // ignore bytes after protocol closed
+
+  if (compressed) {
+    auto& pool = m_socket->get_io_loop().read_buffers();
+    char* buf = pool.acquire();
+    scope_guard release_buf([&pool, buf]() { pool.release(buf); });
+    auto msg = _inflater->inflate(payload, len, buf,
+                                  ReadBufferPool::buffer_size, MAX_MESSAGE_SIZE);
+    m_msg_processor(msg.data(), msg.size());
+    return;
+  }
+
+  // TODO: is user throws, what should
+  /* user callback of raw data */
+  m_msg_processor(payload, len);
+}
+
+
+WebsocketProtocol::inflate_stats WebsocketProtocol::get_inflate_stats() const
+{
+  inflate_stats stats;
+  if (_inflater) {
+    stats.bytes_in = _inflater->bytes_in();
+    stats.bytes_out = _inflater->bytes_out();
+  }
+  return stats;
+}
+
+
+void WebsocketProtocol::on_control_frame(ws::Opcode op, const char* payload,
+                                         size_t len)
+{
+  if (_state == state::closed)
+    return; // ignore bytes after protocol closed
+
+  if (op == ws::Opcode::ping) {
+    const auto now = std::chrono::steady_clock::now();
+    if ((now > _last_pong) &&
+        (now - _last_pong >= _options.pong_min_interval)) {
+      _last_pong = now;
+      send_pong(payload, len);
+    }
+  } else if (op == ws::Opcode::pong) {
+    // no-op
+  } else if (op == ws::Opcode::close) {
+    if (_state == state::closing) {
+      // sent & received close-frame, so protocol closed
+      _state = state::closed;
+      m_callbacks.protocol_closed(std::chrono::milliseconds(0));
+    } else if (_state == state::open) {
+      // received & sending close-frame, so protocol closed
+      send_close(ws::close_code::normal, "");
+      _state = state::closed;
+      m_callbacks.protocol_closed(std::chrono::milliseconds(0));
     }
   }
 }
@@ -515,8 +661,32 @@ bool WebsocketProtocol::initiate_close()
 {
   /* Start the graceful close sequence. */
   _state = state::closing;
-  send_close(websocketpp::close::status::normal, "");
+  send_close(ws::close_code::normal, "");
   return true;
 }
 
+std::string encode_payload(const json& msg, serialiser_type type)
+{
+  if (type == serialiser_type::msgpack) {
+    std::string bytes;
+    json::to_msgpack(msg, nlohmann::detail::output_adapter<char>(bytes));
+    return bytes;
+  }
+  return msg.dump();
+}
+
+
+json decode_payload(const char* payload, size_t len, serialiser_type type)
+{
+  try {
+    if (type == serialiser_type::msgpack)
+      return json::from_msgpack(payload, payload + len);
+    return json::parse(payload, payload + len);
+  } catch (const json::exception& e) {
+    throw protocol_error(std::string("malformed websocket message, ") +
+                         e.what());
+  }
+}
+
+
 } // namespace apex
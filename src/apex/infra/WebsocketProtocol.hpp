@@ -17,24 +17,26 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
-#include <apex/infra/DecodeBuffer.hpp>
+#include <apex/infra/RingDecodeBuffer.hpp>
 #include <apex/infra/HttpParser.hpp>
+#include <apex/infra/WebsocketDeflate.hpp>
+#include <apex/infra/WebsocketFrame.hpp>
+#include <apex/util/json.hpp>
 #include <apex/util/utils.hpp>
 
 #include <atomic>
 #include <chrono>
 #include <functional>
 #include <random>
+#include <vector>
 
 namespace apex
 {
 
 class HttpParser;
-class WebsocketppImpl;
-struct websocketpp_msg;
 
 
-enum class serialiser_type { none = 0x00, json = 0x01 };
+enum class serialiser_type { none = 0x00, json = 0x01, msgpack = 0x02 };
 
 enum class protocol_type { none = 0x00, websocket = 0x01 };
 
@@ -169,7 +171,7 @@ protected:
   TcpSocket* m_socket; /* non owning */
   t_msg_cb m_msg_processor;
   protocol_callbacks m_callbacks;
-  DecodeBuffer m_buf;
+  RingDecodeBuffer m_buf;
 
 private:
   connect_mode m_mode;
@@ -204,6 +206,17 @@ public:
 
     /** Additional HTTP headers to place in the GET request */
     std::vector<std::pair<std::string, std::string>> extra_headers;
+
+    /** Offer the permessage-deflate extension, so that the server may send
+     * compressed messages, which are inflated before delivery.  Trades CPU
+     * on the IO thread for bandwidth. */
+    bool permessage_deflate = false;
+  };
+
+  /* Compressed bytes received, and the bytes they inflated to */
+  struct inflate_stats {
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
   };
 
   static constexpr const char* NAME = "websocket";
@@ -213,8 +226,16 @@ public:
 
   static constexpr const char* WAMPV2_JSON_SUBPROTOCOL = "wamp.2.json";
 
+  /* Subprotocols naming the serialisation of data messages: JSON text, sent
+   * as text frames, or MessagePack, sent as binary frames. */
+  static constexpr const char* JSON_SUBPROTOCOL = "json";
+  static constexpr const char* MSGPACK_SUBPROTOCOL = "msgpack";
+
   static constexpr const char* RFC6455 = "13";
 
+  /* Messages longer than this are rejected, and the connection failed. */
+  static constexpr uint64_t MAX_MESSAGE_SIZE = 32000000;
+
   WebsocketProtocol(TcpSocket*, t_msg_cb, protocol::protocol_callbacks,
                     connect_mode _mode, options);
 
@@ -226,19 +247,43 @@ public:
   [[nodiscard]] const char* name() const override { return NAME; }
   void send_msg(const char*, size_t) override;
 
+  /* Whether the server accepted permessage-deflate; set once the handshake
+   * completes. */
+  [[nodiscard]] bool is_deflate_enabled() const { return _inflater != nullptr; }
+
+  [[nodiscard]] inflate_stats get_inflate_stats() const;
+
+  /* Serialisation agreed with the peer; set once the handshake completes.  A
+   * peer that names no subprotocol is taken to use JSON. */
+  [[nodiscard]] serialiser_type serialiser() const { return _serialiser; }
+
+  /* Sec-WebSocket-Protocol value offering the serialisers of a mask, in order
+   * of preference: MessagePack, then JSON. */
+  static std::string subprotocol_offer(int serialisers);
+
+  /* Serialiser of the first subprotocol listed in a Sec-WebSocket-Protocol
+   * value that is also in the mask, or none if there is no such. */
+  static serialiser_type select_subprotocol(const std::string& offered,
+                                            int serialisers);
+
 private:
-  void process_frame_bytes(DecodeBuffer::read_pointer&);
+  void process_input(RingDecodeBuffer::read_pointer&);
+  bool process_frame_bytes(RingDecodeBuffer::read_pointer&);
+  void consume_payload(RingDecodeBuffer::read_pointer&);
+  void on_data_msg(const char*, size_t, bool compressed);
+  void on_control_frame(ws::Opcode, const char*, size_t);
 
   const std::string& header_field(const char*) const;
 
 
   static const char* to_header(serialiser_type);
-  static int to_opcode(serialiser_type);
+  static ws::Opcode to_opcode(serialiser_type);
 
   void send_ping();
-  void send_pong(const std::string& payload = {});
+  void send_pong(const char* payload, size_t len);
   void send_close(uint16_t, const std::string&);
-  void send_impl(const websocketpp_msg&);
+  void send_frame(ws::Opcode, const char*, size_t);
+  uint32_t next_mask_key();
 
   // TODO: add the mutex
   enum class state {
@@ -258,7 +303,25 @@ private:
 
   std::string _expected_accept_key;
 
-  std::unique_ptr<WebsocketppImpl> _websock_impl;
+  serialiser_type _serialiser = serialiser_type::json;
+
+  /* Data messages arriving whole, in a single unfragmented frame, are handed
+   * to the user directly from the read buffer.  Fragmented messages, and
+   * frames whose payload spans reads, instead collect in _rx_msg, which keeps
+   * its capacity between messages. */
+  std::vector<char> _rx_msg;
+  bool _rx_msg_active = false; // part way through a message
+  bool _rx_msg_compressed = false;
+  ws::FrameHeader _rx_frame{};  // data frame whose payload is arriving
+  uint64_t _rx_frame_remain = 0;
+  uint64_t _rx_frame_offset = 0;
+
+  /* Set when permessage-deflate is negotiated.  Compressed messages inflate
+   * into a buffer borrowed from the IO loop's read buffer pool. */
+  std::unique_ptr<ws::Inflater> _inflater;
+
+  /* Source of masking keys, for client-to-server frames */
+  std::atomic<uint32_t> _mask_seq;
 
   std::chrono::time_point<std::chrono::steady_clock> _last_pong;
 
@@ -266,4 +329,13 @@ private:
 };
 
 
+/* Encode a data message in a websocket serialisation.  MessagePack encodes
+ * and decodes without formatting or parsing text, so is cheaper than JSON for
+ * peers that support it. */
+std::string encode_payload(const json&, serialiser_type);
+
+/* Decode a data message; throws protocol_error if it is malformed. */
+json decode_payload(const char*, size_t, serialiser_type);
+
+
 } // namespace apex
@@ -1,32 +0,0 @@
-/* Copyright 2024 Automated Algo (www.automatedalgo.com)
-
-This file is part of Automated Algo's "Apex" project.
-
-Apex is free software: you can redistribute it and/or modify it under the terms
-of the GNU Lesser General Public License as published by the Free Software
-Foundation, either version 3 of the License, or (at your option) any later
-version.
-
-Apex is distributed in the hope that it will be useful, but WITHOUT ANY
-WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
-PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
-
-You should have received a copy of the GNU Lesser General Public License along
-with Apex. If not, see <https://www.gnu.org/licenses/>.
-*/
-
-#include <apex/infra/WebsocketppImpl.hpp>
-
-namespace apex
-{
-
-std::string WebsocketppImpl::frame_to_string(
-    const WebsocketConfig::message_type::ptr& ptr)
-{
-  std::ostringstream oss;
-  oss << "fin " << ptr->get_fin() << ", opcode " << ptr->get_opcode()
-      << ", payload_len " << ptr->get_payload().size();
-  return oss.str();
-}
-
-} // namespace apex
@@ -36,6 +36,36 @@ sslstatus get_sslstatus(SSL* ssl, int n)
   }
 }
 
+/* Capture the application traffic secrets of sessions set up for kTLS, from
+ * the keylog lines OpenSSL produces during the handshake. */
+static void keylog_cb(const SSL* ssl, const char* line)
+{
+  auto* session = static_cast<SslSession*>(SSL_get_app_data(ssl));
+  if (!session)
+    return;
+
+  std::string* target = nullptr;
+  const char* client = "CLIENT_TRAFFIC_SECRET_0 ";
+  const char* server = "SERVER_TRAFFIC_SECRET_0 ";
+  if (strncmp(line, client, strlen(client)) == 0)
+    target = &session->client_traffic_secret;
+  else if (strncmp(line, server, strlen(server)) == 0)
+    target = &session->server_traffic_secret;
+  else
+    return;
+
+  // the line continues with the client random, and then the secret, in hex
+  const char* hex = strrchr(line, ' ');
+  if (!hex)
+    return;
+  target->clear();
+  for (++hex; isxdigit(hex[0]) && isxdigit(hex[1]); hex += 2) {
+    char byte[3] = {hex[0], hex[1], 0};
+    target->push_back(static_cast<char>(strtol(byte, nullptr, 16)));
+  }
+}
+
+
 SslContext::SslContext(const SslConfig& conf)
   : _ctx(nullptr), _config(conf), _is_custom_ctx(false)
 {
@@ -100,14 +130,109 @@ SslContext::SslContext(const SslConfig& conf)
     else
       _is_custom_ctx = true;
   }
+
+  if (_config.ktls)
+    SSL_CTX_set_keylog_callback(_ctx, keylog_cb);
+
+  if (_config.session_cache) {
+    /* Sessions are kept here, per peer, rather than in the OpenSSL internal
+     * cache, which is only looked up by servers.  Server sockets resume from
+     * stateless tickets, which need no cache. */
+    SSL_CTX_set_session_cache_mode(
+        _ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(_ctx, on_new_session);
+  }
 }
 
 SslContext::~SslContext()
 {
+  for (auto& item : _sessions)
+    for (SSL_SESSION* sess : item.second)
+      SSL_SESSION_free(sess);
+
   if (_ctx && !_is_custom_ctx)
     SSL_CTX_free(_ctx);
 }
 
+
+/* Called by OpenSSL, on the IO thread, for each session ticket received;
+ * returning 1 takes ownership of the session. */
+int SslContext::on_new_session(SSL* ssl, SSL_SESSION* sess)
+{
+  auto* session = static_cast<SslSession*>(SSL_get_app_data(ssl));
+  if (!session || !session->session_cache || !SSL_SESSION_is_resumable(sess))
+    return 0;
+
+  SslContext* self = session->session_cache;
+  auto lock = std::scoped_lock(self->_sessions_mtx);
+  auto& held = self->_sessions[session->peer];
+  held.push_front(sess);
+  while (held.size() > max_sessions_per_peer) {
+    SSL_SESSION_free(held.back());
+    held.pop_back();
+  }
+  return 1;
+}
+
+
+void SslContext::resume_session(SslSession& session, std::string peer)
+{
+  if (!_config.session_cache)
+    return;
+
+  session.session_cache = this;
+  session.peer = std::move(peer);
+
+  SSL_SESSION* sess = nullptr;
+  {
+    auto lock = std::scoped_lock(_sessions_mtx);
+    auto iter = _sessions.find(session.peer);
+    if (iter == _sessions.end())
+      return;
+
+    // take the newest session still in date; each is used only once
+    const long now = time(nullptr); // as SSL_SESSION_get_time
+    auto& held = iter->second;
+    while (!held.empty() && !sess) {
+      SSL_SESSION* front = held.front();
+      held.pop_front();
+      if (SSL_SESSION_is_resumable(front) &&
+          SSL_SESSION_get_time(front) + SSL_SESSION_get_timeout(front) > now)
+        sess = front;
+      else
+        SSL_SESSION_free(front);
+    }
+    if (held.empty())
+      _sessions.erase(iter);
+  }
+
+  if (sess) {
+    SSL_set_session(session.ssl, sess); // takes its own reference
+    SSL_SESSION_free(sess);
+  }
+}
+
+
+void SslContext::count_handshake(const SSL* ssl)
+{
+  if (SSL_session_reused(ssl))
+    _resumed++;
+  else
+    _full++;
+}
+
+
+SslContext::session_stats SslContext::get_session_stats()
+{
+  session_stats stats;
+  stats.resumed = _resumed.load();
+  stats.full = _full.load();
+  auto lock = std::scoped_lock(_sessions_mtx);
+  for (auto& item : _sessions)
+    stats.cached += item.second.size();
+  return stats;
+}
+
 void SslContext::log_ssl_error_queue()
 {
   unsigned long l;
@@ -131,6 +256,9 @@ SslSession::SslSession(SslContext* ctx, connect_mode cm)
   ssl = SSL_new(ctx->context());
   SSL_set_bio(ssl, rbio, wbio);
 
+  // found by the keylog & new session callbacks
+  SSL_set_app_data(ssl, this);
+
   if (cm == connect_mode::active)
     SSL_set_connect_state(ssl);
   if (cm == connect_mode::passive)
@@ -140,8 +268,16 @@ SslSession::SslSession(SslContext* ctx, connect_mode cm)
 
 SslSession::~SslSession()
 {
-  if (ssl)
+  OPENSSL_cleanse(client_traffic_secret.data(), client_traffic_secret.size());
+  OPENSSL_cleanse(server_traffic_secret.data(), server_traffic_secret.size());
+  if (ssl) {
+    /* Freeing a connection that was not shut down marks its session as not
+     * resumable; under TLS 1.3 that is the session of the last ticket
+     * received, which is independent of the connection, so keep it usable. */
+    if (session_cache && SSL_version(ssl) == TLS1_3_VERSION)
+      SSL_set_shutdown(ssl, SSL_get_shutdown(ssl) | SSL_SENT_SHUTDOWN);
     SSL_free(ssl); // will also free associated BIO
+  }
 }
 
 
@@ -19,7 +19,11 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/util/utils.hpp>
 
+#include <atomic>
+#include <deque>
 #include <functional>
+#include <map>
+#include <mutex>
 
 #include <openssl/bio.h>
 #include <openssl/err.h>
@@ -47,9 +51,22 @@ struct SslConfig {
    * will be internally cast to an SSL_CTX* pointer. */
   std::function<void*(const struct SslConfig&)> custom_ctx_creator;
 
+  /* Hand record encryption & decryption of client connections over to the
+   * kernel (kTLS), once a TLS 1.3 session is established, where the kernel
+   * supports it; connections otherwise stay with OpenSSL.  Installs a keylog
+   * callback on the SSL_CTX, to obtain the traffic secrets. */
+  bool ktls = false;
+
+  /* Keep the session tickets servers issue to client connections, per peer,
+   * so that a reconnect can resume the session, saving a round trip and the
+   * certificate exchange. */
+  bool session_cache = true;
+
   explicit SslConfig(bool use_ssl_) : enable(use_ssl_) {}
 };
 
+struct SslSession;
+
 /* Represent the global context OpenSSL object. */
 class SslContext
 {
@@ -80,10 +97,37 @@ public:
 
   SSL_CTX* context() { return _ctx; };
 
+  bool ktls_enabled() const { return _config.ktls; }
+
+  /* Prepare a client session for connection to `peer` (eg, "host:port"):
+   * attach a cached session to resume, if one is held, and cache the tickets
+   * the server issues.  Must be called before the handshake starts. */
+  void resume_session(SslSession&, std::string peer);
+
+  /* Count a completed client handshake, as resumed or full. */
+  void count_handshake(const SSL*);
+
+  struct session_stats {
+    uint64_t resumed = 0; // client handshakes that resumed a session
+    uint64_t full = 0;    // client handshakes of a new session
+    size_t cached = 0;    // sessions held, over all peers
+  };
+  session_stats get_session_stats();
+
 private:
+  static int on_new_session(SSL*, SSL_SESSION*);
+
   SSL_CTX* _ctx; /* can be internal, or custom */
   SslConfig _config;
   bool _is_custom_ctx;
+
+  // Newest first.  TLS 1.3 tickets are used once, and a server issues
+  // several per connection, so a few are kept for concurrent reconnects.
+  static constexpr size_t max_sessions_per_peer = 4;
+  std::mutex _sessions_mtx;
+  std::map<std::string, std::deque<SSL_SESSION*>> _sessions;
+  std::atomic<uint64_t> _resumed{0};
+  std::atomic<uint64_t> _full{0};
 };
 
 
@@ -94,6 +138,15 @@ struct SslSession {
   BIO* rbio; /* SSL reads from, we write to. */
   BIO* wbio; /* SSL writes to, we read from. */
 
+  /* TLS 1.3 application traffic secrets, captured only for kTLS */
+  std::string client_traffic_secret;
+  std::string server_traffic_secret;
+
+  /* Context and key under which new session tickets are cached; see
+   * SslContext::resume_session */
+  SslContext* session_cache = nullptr;
+  std::string peer;
+
   SslSession(SslContext* ctx, apex::connect_mode);
   ~SslSession();
 };
@@ -21,17 +21,27 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 namespace apex
 {
 
-/* TODO: Account updates still under development. */
-
-void Account::apply(AccountUpdate update)
+bool Account::apply(AccountUpdate update)
 {
   std::scoped_lock<std::mutex> guard(_mutex);
-  _holdings[update.asset] = update.avail;
+  auto [iter, inserted] = _holdings.try_emplace(update.asset, update.avail);
+  if (inserted)
+    return true;
+  if (iter->second == update.avail)
+    return false;
+  iter->second = update.avail;
+  return true;
 }
 
-void Account::apply(const std::vector<AccountUpdate>&)
+
+std::vector<AccountUpdate> Account::apply(
+    const std::vector<AccountUpdate>& updates)
 {
-  std::scoped_lock<std::mutex> guard(_mutex);
+  std::vector<AccountUpdate> changed;
+  for (auto& update : updates)
+    if (apply(update))
+      changed.push_back(update);
+  return changed;
 }
 
 
@@ -39,9 +39,12 @@ class Account
 {
 
 public:
-  void apply(AccountUpdate);
+  /* Set the balance of an asset; returns whether it changed. */
+  bool apply(AccountUpdate);
 
-  void apply(const std::vector<AccountUpdate>&);
+  /* Set the balances of several assets, returning the updates that changed
+   * a balance, so that only those need be passed on. */
+  std::vector<AccountUpdate> apply(const std::vector<AccountUpdate>&);
 
   std::map<Asset, double> data() const;
 
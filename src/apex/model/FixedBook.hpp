@@ -0,0 +1,171 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/MarketData.hpp>
+#include <apex/model/Order.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+
+namespace apex
+{
+
+/* Fixed-depth book, holding the best N levels of each side inline, with
+ * prices and quantities in separate arrays, best first.  Storage is padded to
+ * a multiple of the lane count and unused levels have zero quantity, so the
+ * analytics below run a fixed number of iterations over all slots without
+ * branching on depth, which the compiler vectorises.  Nothing allocates, so a
+ * FixedBook can be refreshed from the full Book on every tick. */
+template <size_t N>
+class FixedBook
+{
+public:
+  static_assert(N > 0);
+
+  static constexpr size_t capacity = N;
+
+  // independent accumulators per loop, for vectorisable reductions
+  static constexpr size_t lanes = 4;
+  static constexpr size_t slots = (N + lanes - 1) / lanes * lanes;
+
+  struct SideLevels {
+    alignas(64) std::array<double, slots> price{};
+    alignas(64) std::array<double, slots> qty{};
+    size_t depth = 0;
+  };
+
+  [[nodiscard]] bool is_valid() const {
+    return _bids.depth > 0 && _asks.depth > 0;
+  }
+
+  void clear() {
+    _bids = {};
+    _asks = {};
+  }
+
+  // Copy the best N levels of each side.
+  void assign(const Book& book) {
+    assign(_bids, book.bid_depth(), [&](size_t i) { return book.bid(i); });
+    assign(_asks, book.ask_depth(), [&](size_t i) { return book.ask(i); });
+  }
+
+  void assign(const TickBookSnapshot5& tick) {
+    size_t depth = std::min(N, tick.levels.size());
+    assign(_bids, depth, [&](size_t i) {
+      return Book::Level{tick.levels[i].bid_price, tick.levels[i].bid_qty};
+    });
+    assign(_asks, depth, [&](size_t i) {
+      return Book::Level{tick.levels[i].ask_price, tick.levels[i].ask_qty};
+    });
+  }
+
+  [[nodiscard]] const SideLevels& bids() const { return _bids; }
+  [[nodiscard]] const SideLevels& asks() const { return _asks; }
+
+  // Levels on the side an order of `side` would trade against.
+  [[nodiscard]] const SideLevels& contra(Side side) const {
+    return side == Side::buy ? _asks : _bids;
+  }
+
+  /* Total quantity of the best `levels` levels of a side. */
+  [[nodiscard]] static double cumulative_qty(const SideLevels& s,
+                                             size_t levels = N) {
+    double acc[lanes] = {};
+    for (size_t i = 0; i < slots; i += lanes)
+      for (size_t j = 0; j < lanes; j++)
+        acc[j] += (i + j < levels) ? s.qty[i + j] : 0.0;
+    return sum(acc);
+  }
+
+  /* Price of the deepest level needed to fill `size` against the contra side
+   * of an order of `side`, or NaN if the held depth is insufficient. */
+  [[nodiscard]] double depth_to_size(Side side, double size) const {
+    const SideLevels& s = contra(side);
+    double cum = 0;
+    for (size_t i = 0; i < s.depth; i++) {
+      cum += s.qty[i];
+      if (cum >= size)
+        return s.price[i];
+    }
+    return std::nan("");
+  }
+
+  /* Average price to fill `size` against the contra side of an order of
+   * `side`, or NaN if the held depth is insufficient. */
+  [[nodiscard]] double vwap_to_fill(Side side, double size) const {
+    const SideLevels& s = contra(side);
+
+    // quantity at better levels, for each level
+    std::array<double, slots> before;
+    double cum = 0;
+    for (size_t i = 0; i < slots; i++) {
+      before[i] = cum;
+      cum += s.qty[i];
+    }
+    if (!(size > 0) || cum < size)
+      return std::nan("");
+
+    double notional[lanes] = {};
+    for (size_t i = 0; i < slots; i += lanes)
+      for (size_t j = 0; j < lanes; j++) {
+        double take = std::min(std::max(size - before[i + j], 0.0),
+                               s.qty[i + j]);
+        notional[j] += take * s.price[i + j];
+      }
+    return sum(notional) / size;
+  }
+
+  /* Order-book imbalance over the best `levels` levels, in [-1, 1], positive
+   * when bid quantity dominates; NaN if both sides are empty. */
+  [[nodiscard]] double imbalance(size_t levels = N) const {
+    double bid_qty = cumulative_qty(_bids, levels);
+    double ask_qty = cumulative_qty(_asks, levels);
+    double total = bid_qty + ask_qty;
+    return total > 0 ? (bid_qty - ask_qty) / total : std::nan("");
+  }
+
+private:
+  template <typename F>
+  static void assign(SideLevels& s, size_t depth, F level) {
+    s.depth = 0;
+    for (size_t i = 0; i < N && i < depth; i++) {
+      auto l = level(i);
+      if (std::isnan(l.price) || std::isnan(l.qty) || l.qty <= 0)
+        break;
+      s.price[i] = l.price;
+      s.qty[i] = l.qty;
+      s.depth = i + 1;
+    }
+    for (size_t i = s.depth; i < slots; i++) {
+      s.price[i] = 0;
+      s.qty[i] = 0;
+    }
+  }
+
+  static double sum(const double (&acc)[lanes]) {
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  }
+
+  SideLevels _bids;
+  SideLevels _asks;
+};
+
+} // namespace apex
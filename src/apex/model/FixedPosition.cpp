@@ -0,0 +1,84 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/model/FixedPosition.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace apex
+{
+
+// grid for instruments without a tick or lot size
+static const ScaledInt default_increment{1, -8};
+
+static double increment(const ScaledInt& size)
+{
+  return size.mantissa() > 0 ? size.as_double() : default_increment.as_double();
+}
+
+
+FixedPosition::FixedPosition(ScaledInt tick_size, ScaledInt lot_size,
+                             double startup)
+  : _tick_size(increment(tick_size)),
+    _lot_size(increment(lot_size)),
+    _ticks_per_unit(1.0 / _tick_size),
+    _lots_per_unit(1.0 / _lot_size),
+    _unit_value(_tick_size * _lot_size),
+    _startup_lots(to_lots(startup))
+{
+}
+
+
+void FixedPosition::apply_fill(Side side, double qty, double price)
+{
+  int64_t lots = to_lots(qty);
+  if (side == Side::sell)
+    lots = -lots;
+  else if (side != Side::buy)
+    return;
+  const int64_t ticks = to_ticks(price);
+
+  _traded += static_cast<__int128>(std::abs(lots)) * ticks;
+
+  // A fill against the open position first closes it, realising the
+  // difference to its average cost; the cost released is rounded, but is
+  // moved between the realised PnL and the open cost, so that the total PnL
+  // remains exact.  Any remainder opens a position the other way.
+  if (_lots != 0 && (lots < 0) != (_lots < 0)) {
+    const int64_t closing = std::min(std::abs(lots), std::abs(_lots));
+    const int64_t signed_closing = lots < 0 ? -closing : closing;
+    const __int128 released = _open_cost * closing / std::abs(_lots);
+    _realised += -static_cast<__int128>(signed_closing) * ticks - released;
+    _open_cost -= released;
+    _lots += signed_closing;
+    lots -= signed_closing;
+  }
+
+  _lots += lots;
+  _open_cost += static_cast<__int128>(lots) * ticks;
+  _unrealised = static_cast<__int128>(_lots) * _mark - _open_cost;
+}
+
+
+void FixedPosition::mark(double price)
+{
+  _mark = to_ticks(price);
+  _unrealised = static_cast<__int128>(_lots) * _mark - _open_cost;
+}
+
+} // namespace apex
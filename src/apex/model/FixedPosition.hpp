@@ -0,0 +1,111 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Order.hpp>
+#include <apex/util/utils.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace apex
+{
+
+/* Position and PnL held in integers: prices as a count of ticks, quantities
+ * as a count of lots, and values in units of one tick times one lot.  Sums
+ * are then exact, and realised and unrealised PnL, split by average cost,
+ * are maintained as fills arrive and the mark price moves, so that reading
+ * them costs no arithmetic beyond a conversion to double.  As for Position,
+ * PnL covers the trading of the session, not the startup position.
+ *
+ * Instruments lacking a tick or lot size are held on a grid of 1e-8. */
+class FixedPosition
+{
+public:
+  FixedPosition() : FixedPosition(ScaledInt{}, ScaledInt{}) {}
+  FixedPosition(ScaledInt tick_size, ScaledInt lot_size, double startup = 0.0);
+
+  // Prices and quantities, rounded to the nearest tick or lot
+  [[nodiscard]] int64_t to_ticks(double price) const
+  {
+    return std::llround(price * _ticks_per_unit);
+  }
+  [[nodiscard]] int64_t to_lots(double qty) const
+  {
+    return std::llround(qty * _lots_per_unit);
+  }
+
+  void apply_fill(Side side, double qty, double price);
+
+  /* Revalue the open position at a new price, typically the last trade. */
+  void mark(double price);
+
+  [[nodiscard]] int64_t net_lots() const { return _startup_lots + _lots; }
+  [[nodiscard]] double net_qty() const { return net_lots() * _lot_size; }
+
+  // Price of the last mark, in ticks
+  [[nodiscard]] int64_t mark_ticks() const { return _mark; }
+
+  // Value of one tick times one lot, in asset currency
+  [[nodiscard]] double unit_value() const { return _unit_value; }
+
+  // PnL of closed quantity, against the average cost of the position
+  [[nodiscard]] double realised_pnl() const { return to_value(_realised); }
+
+  // PnL of the open quantity, at the last mark
+  [[nodiscard]] double unrealised_pnl() const { return to_value(_unrealised); }
+
+  [[nodiscard]] double total_pnl() const
+  {
+    return to_value(_realised + _unrealised);
+  }
+
+  // Value traded, plus the open quantity at the last mark, in asset currency
+  [[nodiscard]] double total_turnover() const
+  {
+    return to_value(_traded + static_cast<__int128>(std::abs(_lots)) * _mark);
+  }
+
+private:
+  [[nodiscard]] double to_value(__int128 units) const
+  {
+    return static_cast<double>(units) * _unit_value;
+  }
+
+  double _tick_size;
+  double _lot_size;
+  double _ticks_per_unit;
+  double _lots_per_unit;
+  double _unit_value;
+
+  int64_t _startup_lots;
+
+  // open quantity of the session, and its cost; both signed, negative when
+  // short
+  int64_t _lots = 0;
+  __int128 _open_cost = 0;
+
+  int64_t _mark = 0;
+  __int128 _realised = 0;
+  __int128 _unrealised = 0;
+  __int128 _traded = 0;
+};
+
+
+} // namespace apex
@@ -0,0 +1,123 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/model/Indicators.hpp>
+
+namespace apex
+{
+
+static double decay(Time now, Time& last, double tau)
+{
+  auto dt = std::max<int64_t>((now - last).count(), 0);
+  last = now;
+  return std::exp(-static_cast<double>(dt) / tau);
+}
+
+
+void DecayVwap::update(Time t, double price, double qty)
+{
+  double d = decay(t, _time, _tau);
+  _notional = _notional * d + price * qty;
+  _qty = _qty * d + qty;
+}
+
+
+void FlowImbalance::update(Time t, Side aggr_side, double qty)
+{
+  double d = decay(t, _time, _tau);
+  double sign = aggr_side == Side::buy ? 1 : (aggr_side == Side::sell ? -1 : 0);
+  _signed = _signed * d + sign * qty;
+  _total = _total * d + qty;
+}
+
+
+const Ewma& IndicatorSet::trade_price_ewma(std::chrono::microseconds halflife)
+{
+  return find_or_add(_trade_ewmas, halflife);
+}
+
+
+const DecayVwap& IndicatorSet::vwap(std::chrono::microseconds halflife)
+{
+  return find_or_add(_vwaps, halflife);
+}
+
+
+const FlowImbalance& IndicatorSet::trade_flow(std::chrono::microseconds halflife)
+{
+  return find_or_add(_flows, halflife);
+}
+
+
+const RollingMax& IndicatorSet::trade_high(std::chrono::microseconds window)
+{
+  return find_or_add(_highs, window);
+}
+
+
+const RollingMin& IndicatorSet::trade_low(std::chrono::microseconds window)
+{
+  return find_or_add(_lows, window);
+}
+
+
+const Welford& IndicatorSet::trade_returns()
+{
+  _has_returns = true;
+  return _returns;
+}
+
+
+const Ewma& IndicatorSet::mid_ewma(double alpha)
+{
+  return find_or_add(_mid_ewmas, alpha);
+}
+
+
+void IndicatorSet::on_trade(const TickTrade& trade)
+{
+  if (!trade.is_valid())
+    return;
+
+  for (auto& item : _trade_ewmas)
+    item.second.update(trade.et, trade.price);
+  for (auto& item : _vwaps)
+    item.second.update(trade.et, trade.price, trade.qty);
+  for (auto& item : _flows)
+    item.second.update(trade.et, trade.aggr_side, trade.qty);
+  for (auto& item : _highs)
+    item.second.update(trade.et, trade.price);
+  for (auto& item : _lows)
+    item.second.update(trade.et, trade.price);
+
+  if (_has_returns && _last_price > 0 && trade.price > 0)
+    _returns.update(std::log(trade.price / _last_price));
+  _last_price = trade.price;
+}
+
+
+void IndicatorSet::on_top(double bid, double ask)
+{
+  if (_mid_ewmas.empty() || !(bid > 0) || !(ask > 0))
+    return;
+
+  double mid = (bid + ask) / 2.0;
+  for (auto& item : _mid_ewmas)
+    item.second.update(mid);
+}
+
+} // namespace apex
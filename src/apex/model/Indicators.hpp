@@ -0,0 +1,222 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/tick_msgs.hpp>
+#include <apex/util/Time.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <map>
+#include <utility>
+
+namespace apex
+{
+
+class MarketData;
+
+/* Streaming indicators.  Each update is O(1), amortised for the rolling
+ * extremes, and none hold a window of samples other than the rolling
+ * extremes, which hold only the samples that can still become the extreme. */
+
+
+/* Exponentially weighted moving average.  Updates given a time decay by
+ * elapsed time, so that a sample's weight halves every `halflife`; otherwise
+ * each sample has weight `alpha`. */
+class Ewma
+{
+public:
+  explicit Ewma(double alpha) : _alpha(alpha) {}
+  explicit Ewma(std::chrono::microseconds halflife)
+    : _tau(static_cast<double>(halflife.count()) / M_LN2) {}
+
+  void update(double x) {
+    _value = is_valid() ? _value + _alpha * (x - _value) : x;
+  }
+
+  void update(Time t, double x) {
+    if (is_valid()) {
+      double w = 1.0 - std::exp(-elapsed(t) / _tau);
+      _value += w * (x - _value);
+    }
+    else
+      _value = x;
+    _time = t;
+  }
+
+  [[nodiscard]] bool is_valid() const { return !std::isnan(_value); }
+  [[nodiscard]] double value() const { return _value; }
+
+private:
+  double elapsed(Time t) const {
+    return static_cast<double>(std::max<int64_t>((t - _time).count(), 0));
+  }
+
+  double _alpha = 0;
+  double _tau = 0;
+  double _value = std::nan("");
+  Time _time;
+};
+
+
+/* Volume weighted average price, with the weight of each trade decaying by
+ * half every `halflife`. */
+class DecayVwap
+{
+public:
+  explicit DecayVwap(std::chrono::microseconds halflife)
+    : _tau(static_cast<double>(halflife.count()) / M_LN2) {}
+
+  void update(Time t, double price, double qty);
+
+  [[nodiscard]] bool is_valid() const { return _qty > 0; }
+  [[nodiscard]] double value() const {
+    return is_valid() ? _notional / _qty : std::nan("");
+  }
+
+private:
+  double _tau;
+  double _notional = 0;
+  double _qty = 0;
+  Time _time;
+};
+
+
+/* Ratio of decayed buy volume less sell volume to decayed total volume, in
+ * [-1, 1]; positive when aggressive buying dominates. */
+class FlowImbalance
+{
+public:
+  explicit FlowImbalance(std::chrono::microseconds halflife)
+    : _tau(static_cast<double>(halflife.count()) / M_LN2) {}
+
+  void update(Time t, Side aggr_side, double qty);
+
+  [[nodiscard]] bool is_valid() const { return _total > 0; }
+  [[nodiscard]] double value() const {
+    return is_valid() ? _signed / _total : std::nan("");
+  }
+
+private:
+  double _tau;
+  double _signed = 0;
+  double _total = 0;
+  Time _time;
+};
+
+
+/* Mean and variance of a sample stream, by Welford's method. */
+class Welford
+{
+public:
+  void update(double x) {
+    _count++;
+    double delta = x - _mean;
+    _mean += delta / static_cast<double>(_count);
+    _m2 += delta * (x - _mean);
+  }
+
+  [[nodiscard]] size_t count() const { return _count; }
+  [[nodiscard]] double mean() const { return _count ? _mean : std::nan(""); }
+  [[nodiscard]] double variance() const {
+    return _count > 1 ? _m2 / static_cast<double>(_count - 1) : std::nan("");
+  }
+  [[nodiscard]] double stddev() const { return std::sqrt(variance()); }
+
+private:
+  size_t _count = 0;
+  double _mean = 0;
+  double _m2 = 0;
+};
+
+
+/* Extreme value over a trailing time window, via a monotonic deque; `Better`
+ * orders values so that the extreme is the best. */
+template <typename Better> class RollingExtreme
+{
+public:
+  explicit RollingExtreme(std::chrono::microseconds window) : _window(window) {}
+
+  void update(Time t, double x) {
+    while (!_samples.empty() && !Better()(_samples.back().second, x))
+      _samples.pop_back();
+    _samples.emplace_back(t, x);
+    while ((t - _samples.front().first) > _window)
+      _samples.pop_front();
+  }
+
+  [[nodiscard]] bool is_valid() const { return !_samples.empty(); }
+  [[nodiscard]] double value() const {
+    return is_valid() ? _samples.front().second : std::nan("");
+  }
+
+private:
+  std::chrono::microseconds _window;
+  std::deque<std::pair<Time, double>> _samples;
+};
+
+using RollingMax = RollingExtreme<std::greater<double>>;
+using RollingMin = RollingExtreme<std::less<double>>;
+
+
+/* Indicators of a single MarketData, shared by every user of the instrument
+ * so each is updated once per tick.  An indicator is created on first request
+ * and then updated, ahead of event listeners, on every relevant event; the
+ * returned references remain valid for the life of the MarketData.  Trade
+ * indicators are timed by exchange time; book indicators are updated per
+ * event. */
+class IndicatorSet
+{
+public:
+  [[nodiscard]] const Ewma& trade_price_ewma(std::chrono::microseconds halflife);
+  [[nodiscard]] const DecayVwap& vwap(std::chrono::microseconds halflife);
+  [[nodiscard]] const FlowImbalance& trade_flow(std::chrono::microseconds halflife);
+  [[nodiscard]] const RollingMax& trade_high(std::chrono::microseconds window);
+  [[nodiscard]] const RollingMin& trade_low(std::chrono::microseconds window);
+
+  // Log returns between successive trade prices, eg. for realised volatility.
+  [[nodiscard]] const Welford& trade_returns();
+
+  // Mid price, with weight `alpha` for each top-of-book update.
+  [[nodiscard]] const Ewma& mid_ewma(double alpha);
+
+  void on_trade(const TickTrade&);
+  void on_top(double bid, double ask);
+
+private:
+  template <typename T, typename K>
+  static T& find_or_add(std::map<K, T>& items, K key) {
+    return items.try_emplace(key, key).first->second;
+  }
+
+  std::map<std::chrono::microseconds, Ewma> _trade_ewmas;
+  std::map<std::chrono::microseconds, DecayVwap> _vwaps;
+  std::map<std::chrono::microseconds, FlowImbalance> _flows;
+  std::map<std::chrono::microseconds, RollingMax> _highs;
+  std::map<std::chrono::microseconds, RollingMin> _lows;
+  std::map<double, Ewma> _mid_ewmas;
+
+  bool _has_returns = false;
+  Welford _returns;
+  double _last_price = std::nan("");
+};
+
+} // namespace apex
@@ -20,9 +20,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/utils.hpp>
 #include <apex/model/ExchangeId.hpp>
 
+#include <cstdint>
+#include <limits>
+
 namespace apex
 {
 
+/* Dense integer id of an instrument interned in the InstrumentTable. */
+using InstrumentId = uint32_t;
+constexpr InstrumentId no_instrument_id = std::numeric_limits<InstrumentId>::max();
+
 enum class InstrumentType : int { none = 0, coinpair, perpetual, future };
 
 InstrumentType to_instrument_type(const std::string& s);
@@ -70,8 +77,8 @@ private:
 struct Instrument {
 
   ScaledInt lot_size;
-  double minimum_size;
-  double minimum_notnl;
+  double minimum_size = 0.0;
+  double minimum_notnl = 0.0;
   ScaledInt tick_size;
 
   Instrument(InstrumentType type, std::string inst_id, Asset base, Asset quote,
@@ -107,7 +114,13 @@ struct Instrument {
 
  [[nodiscard]] const std::string& id() const { return _id; }
 
+  /* Id of the interned copy of this instrument, or no_instrument_id if it
+   * has not been interned. */
+  [[nodiscard]] InstrumentId iid() const { return _iid; }
+
 private:
+  friend class InstrumentTable;
+
   InstrumentType _type;
   std::string _id;
   Asset _base;
@@ -115,6 +128,7 @@ private:
   std::string _symbol;
   std::string _venue;
   ExchangeId _exchange_id;
+  InstrumentId _iid = no_instrument_id;
 };
 
 std::ostream& operator<<(std::ostream&, const Instrument&);
@@ -0,0 +1,58 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/util/Error.hpp>
+
+namespace apex
+{
+
+InstrumentTable& InstrumentTable::instance()
+{
+  static InstrumentTable table;
+  return table;
+}
+
+
+const Instrument& InstrumentTable::intern(const Instrument& instrument)
+{
+  std::lock_guard<std::mutex> lock(_mutex);
+
+  auto& ids = _by_id[instrument.id()];
+  for (auto iid : ids)
+    if (at(iid) == instrument)
+      return at(iid);
+
+  auto iid = InstrumentId(_entries.size());
+  if (iid / chunk_size >= max_chunks)
+    THROW("instrument table is full");
+
+  if (iid % chunk_size == 0) {
+    _chunk_storage.push_back(std::make_unique<const Instrument*[]>(chunk_size));
+    _chunks[iid / chunk_size].store(_chunk_storage.back().get(),
+                                    std::memory_order_release);
+  }
+
+  auto& entry = _entries.emplace_back(instrument);
+  entry._iid = iid;
+  _chunks[iid / chunk_size].load(std::memory_order_relaxed)[iid % chunk_size] = &entry;
+  ids.push_back(iid);
+  _size.store(_entries.size(), std::memory_order_release);
+  return entry;
+}
+
+} // namespace apex
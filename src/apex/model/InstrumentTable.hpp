@@ -0,0 +1,114 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/model/Instrument.hpp>
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace apex
+{
+
+/* Process wide table of interned instruments.  Entries are immutable and are
+ * never removed, so references to them, and their ids, stay valid for the
+ * life of the process and can be shared by all Services instances.  Ids are
+ * dense, in order of interning, so that per-instrument state can be held in
+ * vectors indexed by id.  Lookup by id takes no lock. */
+class InstrumentTable
+{
+public:
+  static InstrumentTable& instance();
+
+  /* Return the interned copy of an instrument, adding it if no equal
+   * instrument of the same id is present. */
+  const Instrument& intern(const Instrument&);
+
+  /* Interned copy of an instrument that may or may not have been interned. */
+  const Instrument& resolve(const Instrument& instrument)
+  {
+    return instrument.iid() == no_instrument_id ? intern(instrument)
+                                                : at(instrument.iid());
+  }
+
+  const Instrument& at(InstrumentId iid) const
+  {
+    return *_chunks[iid / chunk_size].load(std::memory_order_acquire)[iid % chunk_size];
+  }
+
+  [[nodiscard]] size_t size() const { return _size.load(std::memory_order_acquire); }
+
+private:
+  static constexpr size_t chunk_size = 4096;
+  static constexpr size_t max_chunks = 1024;
+
+  InstrumentTable() = default;
+
+  std::mutex _mutex;
+  std::deque<Instrument> _entries;
+  std::map<std::string, std::vector<InstrumentId>> _by_id;
+
+  // index from id to entry, in chunks that never move once published
+  std::vector<std::unique_ptr<const Instrument*[]>> _chunk_storage;
+  std::atomic<const Instrument**> _chunks[max_chunks] = {};
+  std::atomic<size_t> _size{0};
+};
+
+
+/* Map from instrument to value, held in a vector indexed by instrument id.
+ * Instruments that are not yet interned are interned on first use. */
+template <typename V> class InstrumentMap
+{
+public:
+  V* find(const Instrument& instrument)
+  {
+    auto iid = instrument.iid();
+    if (iid == no_instrument_id)
+      iid = InstrumentTable::instance().resolve(instrument).iid();
+    return (iid < _values.size() && _values[iid]) ? &*_values[iid] : nullptr;
+  }
+
+  /* Insert, if absent, the value of an instrument, which is interned first if
+   * necessary; returns the value held for it. */
+  V& insert(const Instrument& instrument, V value)
+  {
+    auto iid = InstrumentTable::instance().resolve(instrument).iid();
+    if (iid >= _values.size())
+      _values.resize(iid + 1);
+    if (!_values[iid])
+      _values[iid].emplace(std::move(value));
+    return *_values[iid];
+  }
+
+  template <typename F> void for_each(F&& fn)
+  {
+    for (size_t i = 0; i < _values.size(); i++)
+      if (_values[i])
+        fn(InstrumentTable::instance().at(InstrumentId(i)), *_values[i]);
+  }
+
+private:
+  std::vector<std::optional<V>> _values;
+};
+
+} // namespace apex
@@ -16,14 +16,32 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/model/MarketData.hpp>
+#include <apex/model/Indicators.hpp>
+#include <apex/util/AllocGuard.hpp>
+#include <apex/util/Profiler.hpp>
 
+#include <algorithm>
 #include <ostream>
+#include <sstream>
+#include <stdexcept>
 
 namespace apex
 {
 
+static memory::Account& market_data_memory()
+{
+  static memory::Account account("market_data");
+  return account;
+}
+
+
+Book::Book() : _charge(market_data_memory()) {}
+
+
 MarketData::MarketData() = default;
 
+MarketData::~MarketData() = default;
+
 std::ostream& operator<<(std::ostream& os, MdStream& st)
 {
   switch (st) {
@@ -33,67 +51,358 @@ std::ostream& operator<<(std::ostream& os, MdStream& st)
     case MdStream::L3 : os << "l3"; break;
     case MdStream::Trades : os << "trades"; break;
     case MdStream::AggTrades : os << "aggtrades"; break;
+    case MdStream::Bars : os << "bars"; break;
+    default: {
+      // a combination, as of streams replayed from one file
+      const char* sep = "";
+      for (auto stream : {MdStream::L1, MdStream::L2, MdStream::L3,
+                          MdStream::Trades, MdStream::AggTrades,
+                          MdStream::Bars})
+        if (static_cast<int>(st) & static_cast<int>(stream)) {
+          os << sep << stream;
+          sep = "+";
+        }
+    }
   }
   return os;
 }
 
+MdStream parse_md_stream(const std::string& name)
+{
+  for (auto stream : {MdStream::L1, MdStream::L2, MdStream::L3,
+                      MdStream::Trades, MdStream::AggTrades,
+                      MdStream::Bars}) {
+    std::ostringstream os;
+    os << stream;
+    if (os.str() == name)
+      return stream;
+  }
+  throw std::runtime_error("unknown market-data stream '" + name + "'");
+}
+
 std::ostream& operator<<(std::ostream& os, const TickTrade& trade)
 {
   os << trade.aggr_side << " " << trade.qty << " @ " << trade.price;
   return os;
 }
 
-void MarketData::subscribe_events(std::function<void(EventType)> fn)
+void MarketData::add_listener(Listener* listener, int mask)
+{
+  _listeners.push_back({listener, mask});
+}
+
+
+void MarketData::remove_listener(Listener* listener)
+{
+  _listeners.erase(std::remove_if(_listeners.begin(), _listeners.end(),
+                                  [listener](const Registration& r) {
+                                    return r.listener == listener;
+                                  }),
+                   _listeners.end());
+}
+
+
+void MarketData::add_block_listener(BlockListener* listener)
+{
+  _block_listeners.push_back(listener);
+}
+
+
+void MarketData::remove_block_listener(BlockListener* listener)
+{
+  _block_listeners.erase(std::remove(_block_listeners.begin(),
+                                     _block_listeners.end(), listener),
+                         _block_listeners.end());
+}
+
+
+bool MarketData::tops_in_blocks() const
+{
+  if (_block_listeners.empty() || _snapshot || _indicators)
+    return false;
+  for (auto& item : _listeners)
+    if ((item.mask & EventType::top) && item.listener->needs_each_top())
+      return false;
+  return true;
+}
+
+
+void MarketData::subscribe_events(std::function<void(EventType)> fn, int mask)
+{
+  struct FunctionListener : Listener {
+    explicit FunctionListener(std::function<void(EventType)> f)
+      : fn(std::move(f)) {}
+    void on_market_event(EventType event) override { fn(event); }
+    std::function<void(EventType)> fn;
+  };
+
+  _fn_listeners.push_back(std::make_unique<FunctionListener>(std::move(fn)));
+  add_listener(_fn_listeners.back().get(), mask);
+}
+
+
+void MarketData::enable_snapshot()
+{
+  if (!_snapshot) {
+    _snapshot = std::make_unique<SeqLock<MarketSnapshot>>();
+    publish_snapshot();
+  }
+}
+
+
+void MarketData::publish_snapshot()
+{
+  MarketSnapshot snap;
+  snap.bid = _l1_bid;
+  snap.ask = _l1_ask;
+  snap.last_price = _last.price;
+  snap.last_qty = _last.qty;
+  snap.last_side = _last.aggr_side;
+  snap.last_et = _last.et.as_epoch_us().count();
+  for (size_t i = 0; i < MarketSnapshot::depth; i++) {
+    if (i < _book.bid_depth())
+      snap.bids[i] = _book.bid(i);
+    if (i < _book.ask_depth())
+      snap.asks[i] = _book.ask(i);
+  }
+  _snapshot->write(snap);
+}
+
+
+IndicatorSet& MarketData::indicators()
 {
-  _events_listeners.push_back(std::move(fn));
+  if (!_indicators)
+    _indicators = std::make_unique<IndicatorSet>();
+  return *_indicators;
 }
 
 
-void MarketData::apply(TickTrade& t)
+void MarketData::notify(int flags)
 {
+  _updates++;
+
+  if (_snapshot)
+    publish_snapshot();
+
+  if (_indicators) {
+    if (flags & EventType::trade)
+      _indicators->on_trade(_last);
+    if (flags & EventType::top)
+      _indicators->on_top(_l1_bid.price, _l1_ask.price);
+  }
+
+  EventType event(flags);
+  for (auto& item : _listeners)
+    if (item.mask & flags)
+      item.listener->on_market_event(event);
+}
+
+
+void MarketData::apply(const TickTrade& t)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(trade)");
+  APEX_NO_ALLOC_SCOPE("MarketData::apply(trade)");
   this->_last = t;
-  EventType mask = {};
-  mask.value = EventType::trade;
-  for (auto& item : _events_listeners) {
-    item(mask);
+  trace::tracer().mark(trace::Stage::md_apply, _last.trace);
+  _last_trace = _last.trace;
+  notify(EventType::trade);
+}
+
+
+void MarketData::apply(const Bar& bar)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(bar)");
+  _last_bar = bar;
+  if (bar.trades) {
+    _last = TickTrade{};
+    _last.price = bar.close;
+    _last.qty = bar.volume;
+    _last.xt = _last.et = bar.end_time();
   }
+  _l1_bid = {bar.bid, 0};
+  _l1_ask = {bar.ask, 0};
+  notify(EventType::bar);
 }
 
 
-void MarketData::apply(TickTop& tick)
+void MarketData::set_top(const TickTop& tick)
 {
   _l1_bid.price = tick.bid_price;
   _l1_bid.qty = tick.bid_qty;
   _l1_ask.price = tick.ask_price;
   _l1_ask.qty = tick.ask_qty;
 
-  EventType mask = {};
-  mask.value = EventType::top;
-  for (auto& item : _events_listeners)
-    item(mask);
+  _last_trace = tick.trace;
+  trace::tracer().mark(trace::Stage::md_apply, _last_trace);
 }
 
 
-void Book::apply(TickBookSnapshot5& tick)
+void MarketData::apply(const TickTop& tick)
 {
-  unsigned N = TickBookSnapshot5::N;
+  APEX_PROFILE_ZONE("MarketData::apply(top)");
+  APEX_NO_ALLOC_SCOPE("MarketData::apply(top)");
+  set_top(tick);
+  notify(EventType::top);
+  if (!_block_listeners.empty())
+    notify_blocks({&tick, nullptr, 1});
+}
+
 
-  if (_bids.size() != N) {
-    _bids = std::vector<Level>(N, {0,0});
-    _asks = std::vector<Level>(N, {0,0});
+void MarketData::apply(const TickTopBlock& block)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(top-block)");
+  APEX_NO_ALLOC_SCOPE("MarketData::apply(top-block)");
+  if (block.empty())
+    return;
+
+  if (tops_in_blocks()) {
+    set_top(block.ticks[block.size - 1]);
+    notify(EventType::top);
+  }
+  else {
+    for (auto& tick : block) {
+      set_top(tick);
+      notify(EventType::top);
+    }
+  }
+  notify_blocks(block);
+}
+
+
+void MarketData::notify_blocks(const TickTopBlock& block)
+{
+  for (auto* listener : _block_listeners)
+    listener->on_top_block(block);
+}
+
+
+/* Copy the levels of a snapshot; if the book holds the previous snapshot of
+ * the same depth, only the levels flagged as changed. */
+template <typename T>
+void Book::apply_snapshot(const T& tick, uint32_t changed)
+{
+  constexpr unsigned N = T::N;
+
+  if (_snapshot_depth != T::N) {
+    _bids.resize(N);
+    _asks.resize(N);
+    _snapshot_depth = T::N;
+    changed = ~0u;
+    charge();
+  }
+
+  for (std::size_t i = 0; i < N; i++) {
+    if (!(changed & (1u << i)))
+      continue;
+    _bids[N - 1 - i].price = tick.levels[i].bid_price;
+    _bids[N - 1 - i].qty = tick.levels[i].bid_qty;
+    _asks[N - 1 - i].price = tick.levels[i].ask_price;
+    _asks[N - 1 - i].qty = tick.levels[i].ask_qty;
   }
+}
+
+
+void Book::apply(const TickBookSnapshot5& tick)
+{
+  apply_snapshot(tick, ~0u);
+}
+
 
-  for (std::size_t i = 0; i < 5; i++) {
-    _bids[i].price = tick.levels[i].bid_price;
-    _bids[i].qty = tick.levels[i].bid_qty;
-    _asks[i].price = tick.levels[i].ask_price;
-    _asks[i].qty = tick.levels[i].ask_qty;
+void Book::apply(const TickBookSnapshot25& tick)
+{
+  apply_snapshot(tick, tick.changed);
+}
+
+
+/* Set the quantity at a price, on a side ordered so that `better` holds for
+ * each later element over each earlier one.  Returns the depth of the level
+ * from the touch, or no_change if its quantity was already as given. */
+template <typename Better>
+static size_t update_level(std::vector<Book::Level>& side, double price,
+                           double qty, Better better)
+{
+  static constexpr int max_scan = 8;
+
+  // find the first level better than the price
+  auto pos = side.end();
+  for (int i = 0;
+       i < max_scan && pos != side.begin() && better((pos - 1)->price, price);
+       i++)
+    --pos;
+  if (pos != side.begin() && better((pos - 1)->price, price))
+    pos = std::partition_point(side.begin(), pos, [&](const Book::Level& l) {
+      return !better(l.price, price);
+    });
+
+  const size_t depth = side.end() - pos;
+  const bool exists = pos != side.begin() && (pos - 1)->price == price;
+  if (qty == 0) {
+    if (!exists)
+      return Book::no_change;
+    side.erase(pos - 1);
+  } else if (exists) {
+    if ((pos - 1)->qty == qty)
+      return Book::no_change;
+    (pos - 1)->qty = qty;
+  } else {
+    side.insert(pos, {price, qty});
   }
+  return depth;
 }
 
 
-void MarketData::apply(TickBookSnapshot5& tick)
+template <typename Better>
+static void assign_levels(std::vector<Book::Level>& side,
+                          const std::vector<TickBookDelta::Level>& levels,
+                          Better better)
 {
+  side.clear();
+  for (auto& level : levels)
+    if (level.qty != 0)
+      side.push_back({level.price, level.qty});
+  std::sort(side.begin(), side.end(),
+            [&](const Book::Level& a, const Book::Level& b) {
+              return better(b.price, a.price);
+            });
+}
+
+
+size_t Book::apply(const TickBookDelta& delta)
+{
+  auto higher = [](double a, double b) { return a > b; };
+  auto lower = [](double a, double b) { return a < b; };
+  _snapshot_depth = 0;
+
+  if (delta.is_snapshot) {
+    assign_levels(_bids, delta.bids, higher);
+    assign_levels(_asks, delta.asks, lower);
+    charge();
+    return 0;
+  }
+
+  size_t changed = no_change;
+  for (auto& level : delta.bids)
+    changed = std::min(changed,
+                       update_level(_bids, level.price, level.qty, higher));
+  for (auto& level : delta.asks)
+    changed = std::min(changed,
+                       update_level(_asks, level.price, level.qty, lower));
+  charge();
+  return changed;
+}
+
+
+void Book::clear()
+{
+  _bids.clear();
+  _asks.clear();
+  _snapshot_depth = 0;
+}
+
+
+void MarketData::apply(const TickBookSnapshot5& tick)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(snapshot)");
   _book.apply(tick);
 
   _l1_bid.price = tick.levels[0].bid_price;
@@ -101,11 +410,38 @@ void MarketData::apply(TickBookSnapshot5& tick)
   _l1_ask.price = tick.levels[0].ask_price;
   _l1_ask.qty = tick.levels[0].ask_qty;
 
-  EventType mask(EventType::top | EventType::full_book);
-  for (auto& item : _events_listeners)
-    item(mask);
+  notify(EventType::top | EventType::full_book);
 }
 
+void MarketData::apply(const TickBookSnapshot25& tick)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(snapshot25)");
+  _book.apply(tick);
+
+  _l1_bid.price = tick.levels[0].bid_price;
+  _l1_bid.qty = tick.levels[0].bid_qty;
+  _l1_ask.price = tick.levels[0].ask_price;
+  _l1_ask.qty = tick.levels[0].ask_qty;
+
+  notify(EventType::top | EventType::full_book | EventType::deep_book);
+}
+
+void MarketData::apply(const TickBookDelta& delta)
+{
+  APEX_PROFILE_ZONE("MarketData::apply(delta)");
+  APEX_NO_ALLOC_SCOPE("MarketData::apply(delta)");
+  const size_t changed = _book.apply(delta);
+
+  _l1_bid = _book.bid_depth() ? _book.bid(0) : Book::Level{};
+  _l1_ask = _book.ask_depth() ? _book.ask(0) : Book::Level{};
+
+  if (_book_event_depth == 0 || changed == 0)
+    notify(EventType::top | EventType::full_book);
+  else if (changed < _book_event_depth)
+    notify(EventType::full_book);
+}
+
+
 [[nodiscard]] double MarketData::mid() const
 {
   if (bid() == 0.0 || ask() == 0.0)
@@ -18,8 +18,15 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <apex/model/tick_msgs.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/MemoryPolicy.hpp>
+#include <apex/util/SeqLock.hpp>
 
+#include <array>
 #include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 #include <cmath>
 
 namespace apex
@@ -31,7 +38,8 @@ enum class MdStream : int {
   L2 = 1 << 1,        // partial book, default depth
   L3 = 1 << 2,        // full depth
   Trades = 1 << 10,   // individual trades
-  AggTrades = 1 << 11 // trades aggregated at price
+  AggTrades = 1 << 11, // trades aggregated at price
+  Bars = 1 << 12      // precomputed bars, backtest only; see BarReplayer
 };
 
 std::ostream& operator<<(std::ostream&, MdStream&);
@@ -39,9 +47,18 @@ std::ostream& operator<<(std::ostream&, MdStream&);
 struct MdStreamParams
 {
   int mask = 0;
+
+  bool has(MdStream stream) const { return mask & static_cast<int>(stream); }
 };
 
+/* Parse a stream name, as written by operator<<; throws for an unknown
+ * name. */
+MdStream parse_md_stream(const std::string&);
+
 
+/* Price-level book.  Each side is a flat array sorted with the best price
+ * last: most changes are near the touch, so are found by a short scan from
+ * the back, and inserts and erases move few elements. */
 class Book
 {
 public:
@@ -51,16 +68,83 @@ public:
     double qty = nan;
   };
 
+  Book();
+
   [[nodiscard]] bool is_valid() const {
-    // TODO: also check vector size
-    return !std::isnan(_bids[0].price) && !std::isnan(_asks[0].price);
+    return !_bids.empty() && !_asks.empty() && !std::isnan(bid(0).price) &&
+           !std::isnan(ask(0).price);
   }
- 
-  void apply(TickBookSnapshot5&);
+
+  void apply(const TickBookSnapshot5&);
+  void apply(const TickBookSnapshot25&);
+
+  /* Apply a delta, returning the depth from the touch of the best level it
+   * changed on either side; zero for a snapshot, or no_change. */
+  size_t apply(const TickBookDelta&);
+  void clear();
+
+  static constexpr size_t no_change = static_cast<size_t>(-1);
+
+  [[nodiscard]] size_t bid_depth() const { return _bids.size(); }
+  [[nodiscard]] size_t ask_depth() const { return _asks.size(); }
+
+  /* Level at a depth from the touch, which must be less than the side
+   * depth; 0 is the best. */
+  [[nodiscard]] const Level& bid(size_t i) const { return _bids[_bids.size() - 1 - i]; }
+  [[nodiscard]] const Level& ask(size_t i) const { return _asks[_asks.size() - 1 - i]; }
 
 private:
-  std::vector<Level> _bids;
-  std::vector<Level> _asks;
+  template <typename T> void apply_snapshot(const T&, uint32_t changed);
+
+  void charge()
+  {
+    _charge.set((_bids.capacity() + _asks.capacity()) * sizeof(Level));
+  }
+
+  std::vector<Level> _bids; // ascending price
+  std::vector<Level> _asks; // descending price
+
+  // depth of the snapshot the book holds, or zero if since changed by deltas
+  int _snapshot_depth = 0;
+
+  memory::Charge _charge; // of the levels, to "market_data"
+};
+
+
+/* Copy of the state of a MarketData, published for reading on other threads.
+ * Absent levels have NaN prices; times are usec since epoch. */
+struct MarketSnapshot
+{
+  static constexpr size_t depth = 5;
+
+  Book::Level bid;
+  Book::Level ask;
+
+  double last_price = nan;
+  double last_qty = 0;
+  Side last_side = Side::none;
+  int64_t last_et = 0;
+
+  std::array<Book::Level, depth> bids; // best first
+  std::array<Book::Level, depth> asks;
+};
+
+
+class IndicatorSet;
+
+
+/* A run of top-of-book ticks, in event order, applied at once.  `times`
+ * holds the event time of each tick, or is null if the ticks were applied
+ * singly, in which case the time is that of the event loop. */
+struct TickTopBlock {
+  const TickTop* ticks = nullptr;
+  const Time* times = nullptr;
+  size_t size = 0;
+
+  [[nodiscard]] const TickTop* begin() const { return ticks; }
+  [[nodiscard]] const TickTop* end() const { return ticks + size; }
+  [[nodiscard]] bool empty() const { return size == 0; }
+  const TickTop& operator[](size_t i) const { return ticks[i]; }
 };
 
 
@@ -76,24 +160,101 @@ public:
     enum Flag {
       trade = 0x01,
       top = 0x02,
-      full_book = 0x04
+      full_book = 0x04,
+      deep_book = 0x08, // levels beyond the fifth, as of a 25 level snapshot
+      bar = 0x10
     };
 
     int value;
 
     [[nodiscard]] bool is_trade() const { return value & Flag::trade; }
     [[nodiscard]] bool is_top() const { return value & Flag::top; }
+    [[nodiscard]] bool is_deep_book() const { return value & Flag::deep_book; }
+    [[nodiscard]] bool is_bar() const { return value & Flag::bar; }
+  };
+
+  static constexpr int all_events = EventType::trade | EventType::top |
+                                    EventType::full_book |
+                                    EventType::deep_book | EventType::bar;
+
+  /* Receives market events, once registered via add_listener.  A listener
+   * is only called for events matching its mask, and must remain valid until
+   * removed. */
+  class Listener
+  {
+  public:
+    virtual ~Listener() = default;
+    virtual void on_market_event(EventType) = 0;
+
+    /* Whether the listener must see each top-of-book tick; if not, ticks may
+     * be applied in blocks, and the listener notified once per block. */
+    [[nodiscard]] virtual bool needs_each_top() const { return true; }
+  };
+
+  /* Receives top-of-book ticks in blocks, once registered via
+   * add_block_listener; ticks applied singly arrive as blocks of one.  For
+   * analytics that process a run of ticks at a time. */
+  class BlockListener
+  {
+  public:
+    virtual ~BlockListener() = default;
+    virtual void on_top_block(const TickTopBlock&) = 0;
   };
 
 
 public:
   MarketData();
+  ~MarketData();
 
-  void apply(TickTrade&);
-  void apply(TickTop&);
-  void apply(TickBookSnapshot5&);
+  // instances are long lived and hot, so come from the memory arena, if any
+  static void* operator new(size_t size)
+  {
+    return memory::allocate(size, alignof(MarketData));
+  }
+  static void operator delete(void* p)
+  {
+    memory::deallocate(p, alignof(MarketData));
+  }
+
+  void apply(const TickTrade&);
+  void apply(const TickTop&);
+  void apply(const TickBookSnapshot5&);
+  void apply(const TickBookSnapshot25&);
+  void apply(const TickBookDelta&);
+
+  /* Raise events for book deltas only when they change one of the best
+   * `depth` levels of a side, and top events only when they change the
+   * touch; with zero, the default, every delta raises both.  For replays of
+   * full-depth feeds, whose many updates deep in the book would otherwise
+   * wake the listeners to the top of book. */
+  void set_book_event_depth(size_t depth) { _book_event_depth = depth; }
+
+  /* Apply a bar, which also sets the last trade to its close, if it had
+   * trades, and the top of book to its closing bid and ask, without sizes;
+   * listeners are notified of a bar event only. */
+  void apply(const Bar&);
+
+  /* Apply a block of top-of-book ticks, leaving the top of book at the last.
+   * If tops_in_blocks(), top event listeners are notified once for the
+   * block, else once per tick; block listeners always receive the block. */
+  void apply(const TickTopBlock&);
+
+  void add_listener(Listener*, int mask = all_events);
+  void remove_listener(Listener*);
+
+  void add_block_listener(BlockListener*);
+  void remove_block_listener(BlockListener*);
+
+  [[nodiscard]] bool has_block_listeners() const {
+    return !_block_listeners.empty();
+  }
+
+  /* Whether top-of-book ticks can now be applied in blocks: there are block
+   * listeners, and nothing needs to see each tick, i.e. no snapshot, no
+   * indicators, and no top event listener that needs_each_top(). */
+  [[nodiscard]] bool tops_in_blocks() const;
 
-  void subscribe_events(std::function<void(EventType)>);
+  void subscribe_events(std::function<void(EventType)>, int mask = all_events);
 
   [[nodiscard]] bool has_last() const { return _last.is_valid(); }
 
@@ -103,28 +264,85 @@ public:
 
   [[nodiscard]] double ask() const { return _l1_ask.price; };
 
+  /* Top of book levels, with their sizes. */
+  [[nodiscard]] const Book::Level& l1_bid() const { return _l1_bid; }
+  [[nodiscard]] const Book::Level& l1_ask() const { return _l1_ask; }
+
   [[nodiscard]] double mid() const;
 
   [[nodiscard]] const TickTrade& last() const { return _last; }
 
+  [[nodiscard]] const Bar& last_bar() const { return _last_bar; }
+
+  [[nodiscard]] const Book& book() const { return _book; }
+
+  /* Count of updates applied, of any kind; lets a periodic reader tell
+   * whether anything has changed since it last looked. */
+  [[nodiscard]] uint64_t update_count() const { return _updates; }
+
+  // Latency trace of the tick most recently applied.
+  [[nodiscard]] const trace::Stamp& last_trace() const { return _last_trace; }
+
+  /* Streaming indicators of this instrument, shared by all users. */
+  [[nodiscard]] IndicatorSet& indicators();
+
+  /* Start publishing a MarketSnapshot after every update, so that other
+   * threads can read the market state without dispatching onto the event
+   * thread.  Must be called on the event thread, before the snapshot is
+   * shared. */
+  void enable_snapshot();
+
+  /* Published snapshot, or null if not enabled; safe to read from any
+   * thread. */
+  [[nodiscard]] const SeqLock<MarketSnapshot>* snapshot() const {
+    return _snapshot.get();
+  }
+
 
   [[nodiscard]] double is_good() const {
     return (bid() != 0.0) &&
            (ask() != 0.0) &&
            (!is_crossed()) &&
-           has_last();
+           has_last() &&
+           !_stale;
   }
 
+  /* Whether the feed is known to be delayed, e.g. ticks arriving later than
+   * the configured limit after their exchange time; stale market data is not
+   * good.  Set by the feed. */
+  [[nodiscard]] bool is_stale() const { return _stale; }
+  void set_stale(bool stale) { _stale = stale; }
+
   [[nodiscard]] bool has_bid_ask() const { return (bid() != 0.0) &&
                                                   (ask() != 0.0) &&
                                                   (!is_crossed()); }
 private:
+  void notify(int flags);
+  void notify_blocks(const TickTopBlock&);
+  void set_top(const TickTop&);
+  void publish_snapshot();
+
+  struct Registration {
+    Listener* listener;
+    int mask;
+  };
+
   TickTrade _last;
+  bool _stale = false;
+  Bar _last_bar;
   Book _book;
   Book::Level _l1_bid;
   Book::Level _l1_ask;
+  trace::Stamp _last_trace;
+  uint64_t _updates = 0;
+  size_t _book_event_depth = 0;
+
+  std::vector<Registration> _listeners;
+  std::vector<std::unique_ptr<Listener>> _fn_listeners;
+  std::vector<BlockListener*> _block_listeners;
 
-  std::vector<std::function<void(EventType)>> _events_listeners;
+  std::unique_ptr<SeqLock<MarketSnapshot>> _snapshot;
+  std::unique_ptr<IndicatorSet> _indicators;
 };
 
 } // namespace apex
@@ -18,9 +18,13 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/model/Order.hpp>
 #include <apex/comm/GxClientSession.hpp>
 #include <apex/core/OrderRouter.hpp>
+#include <apex/core/RiskService.hpp>
 #include <apex/core/Services.hpp>
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/util/AllocGuard.hpp>
 #include <apex/util/Error.hpp>
 
+#include <algorithm>
 #include <utility>
 
 namespace apex
@@ -81,13 +85,13 @@ std::ostream& operator<<(std::ostream& os, OrderCloseReason v)
 }
 
 
-Order::Order(Services* services, OrderRouter* router, Instrument instrument,
+Order::Order(Services* services, OrderRouter* router, const Instrument& instrument,
              Side side, double size, double price, TimeInForce tif,
              std::string order_id, void* user_data,
              std::function<void(void*)> user_data_delete_fn)
   : _services(services),
     _router(router),
-    _instrument(std::move(instrument)),
+    _instrument(InstrumentTable::instance().resolve(instrument)),
     _side(side),
     _size(size),
     _price(price),
@@ -124,6 +128,116 @@ bool Order::cancel()
   }
 }
 
+bool Order::amend(double price, double size)
+{
+  if (_order_state != OrderState::live || is_canceling() || is_amending()) {
+    LOG_WARN(_instrument.native_symbol()
+             << ": order " << _order_id << " cannot be amended, state: "
+             << _order_state << (is_canceling() ? ", canceling" : "")
+             << (is_amending() ? ", amending" : ""));
+    return false;
+  }
+
+  if (auto failed = risk_check(price, size)) {
+    LOG_WARN(_instrument.native_symbol()
+             << ": order " << _order_id << " amend failed risk checks: "
+             << RiskService::describe(failed));
+    return false;
+  }
+
+  _amend_state = OrderAmendState::amending;
+  _amend_price = price;
+  _amend_size = size;
+  _deferred_close = OrderCloseReason::none;
+  try {
+    _router->replace_order(*this);
+    return true;
+  }
+  catch (const std::runtime_error& e) {
+    LOG_ERROR("error when attempting amend: " << e.what());
+    _amend_state = OrderAmendState::error;
+    return false;
+  }
+}
+
+/* Group orders by their router, keeping their order within each group. */
+static std::vector<std::pair<OrderRouter*, std::vector<Order*>>> by_router(
+    const std::vector<Order*>& orders, OrderRouter* (*router_of)(Order&))
+{
+  std::vector<std::pair<OrderRouter*, std::vector<Order*>>> groups;
+  for (auto* order : orders) {
+    auto* router = router_of(*order);
+    auto iter = std::find_if(groups.begin(), groups.end(),
+                             [router](auto& g) { return g.first == router; });
+    if (iter == groups.end())
+      iter = groups.insert(groups.end(), {router, {}});
+    iter->second.push_back(order);
+  }
+  return groups;
+}
+
+
+void Order::send_all(const std::vector<std::shared_ptr<Order>>& orders)
+{
+  std::vector<Order*> batch;
+  for (auto& order : orders) {
+    if (order->_order_state != OrderState::init)
+      THROW("cannot send order " << order->_order_id
+            << ", must be in 'init' state");
+    batch.push_back(order.get());
+  }
+
+  // orders failing the risk checks are rejected, and not sent
+  batch.erase(std::remove_if(batch.begin(), batch.end(),
+                             [](Order* order) {
+                               auto failed =
+                                   order->risk_check(order->_price, order->_size);
+                               if (failed)
+                                 order->reject_by_risk(failed);
+                               else
+                                 order->hold_risk(order->_size);
+                               return failed != 0;
+                             }),
+              batch.end());
+
+  for (auto& [router, group] :
+       by_router(batch, [](Order& o) { return o._router; }))
+    router->send_orders(group);
+
+  for (auto* order : batch) {
+    order->_sent_time = order->_services->now();
+    order->set_state_impl(order->_services->now(), OrderState::sent);
+  }
+}
+
+
+size_t Order::cancel_all(const std::vector<std::shared_ptr<Order>>& orders,
+                         bool all_open)
+{
+  std::vector<Order*> batch;
+  for (auto& order : orders)
+    if (!order->is_closed() && !order->is_canceling()) {
+      order->_cancel_state = OrderCancelState::canceling;
+      batch.push_back(order.get());
+    }
+
+  size_t sent = 0;
+  for (auto& [router, group] :
+       by_router(batch, [](Order& o) { return o._router; })) {
+    try {
+      router->cancel_orders(group, all_open);
+      sent += group.size();
+    }
+    catch (const std::runtime_error& e) {
+      LOG_ERROR("error when attempting cancel of " << group.size()
+                << " orders: " << e.what());
+      for (auto* order : group)
+        order->_cancel_state = OrderCancelState::error;
+    }
+  }
+  return sent;
+}
+
 const std::string& Order::ticker() const { return _instrument.native_symbol(); }
 
 std::chrono::microseconds Order::duration_since_sent() const
@@ -147,13 +261,53 @@ void Order::send()
     THROW("cannot send order, must be in 'init' state");
   }
 
-  _router->send_order(*this);
+  if (auto failed = risk_check(_price, _size)) {
+    reject_by_risk(failed);
+    return;
+  }
+
+  APEX_NO_ALLOC_SCOPE("Order::send");
+  hold_risk(_size);
+  try {
+    _router->send_order(*this);
+  } catch (...) {
+    hold_risk(0.0);
+    throw;
+  }
 
   _sent_time = _services->now();
   set_state_impl(_services->now(), OrderState::sent);
 }
 
 
+unsigned Order::risk_check(double price, double size)
+{
+  auto* risk = _services ? _services->risk_service() : nullptr;
+  return risk ? risk->check(_instrument.iid(), _side, price, size, _risk_held)
+              : 0;
+}
+
+
+/* Hold `size` as working in the RiskService, until filled or closed. */
+void Order::hold_risk(double size)
+{
+  if (size == _risk_held)
+    return;
+  if (auto* risk = _services ? _services->risk_service() : nullptr)
+    risk->add_working(_instrument.iid(), _side, size - _risk_held);
+  _risk_held = size;
+}
+
+
+void Order::reject_by_risk(unsigned failed)
+{
+  auto text = RiskService::describe(failed);
+  LOG_WARN(_instrument.native_symbol()
+           << ": order " << _order_id << " failed risk checks: " << text);
+  set_is_rejected(RiskService::reject_code, "failed risk checks: " + text);
+}
+
+
 void Order::set_is_closed(Time time, OrderCloseReason reason)
 {
   _close_reason = reason;
@@ -169,6 +323,20 @@ void Order::set_is_rejected(std::string code, std::string text)
 }
 
 
+void Order::restore(OrderState state, std::string exch_order_id,
+                    double filled_size)
+{
+  _order_state = state;
+  _exch_order_id = std::move(exch_order_id);
+  _total_fill_qty = filled_size;
+  if (state != OrderState::closed)
+    hold_risk(std::max(0.0, _size - filled_size));
+  _sent_time = _services->now();
+  if (state == OrderState::live)
+    _live_time = _sent_time;
+}
+
+
 void Order::set_state_impl(Time time, OrderState new_state, bool with_fill,
                            OrderCloseReason close_reason)
 {
@@ -185,8 +353,10 @@ void Order::set_state_impl(Time time, OrderState new_state, bool with_fill,
     if (new_state == OrderState::live)
       _live_time = _services->now();
 
-    if (new_state == OrderState::closed)
+    if (new_state == OrderState::closed) {
       _close_reason = close_reason;
+      hold_risk(0.0);
+    }
 
     _order_state = new_state;
   }
@@ -199,12 +369,69 @@ void Order::set_state_impl(Time time, OrderState new_state, bool with_fill,
 
   OrderEvent ev(shared_from_this(), flags, time, old_state, new_state);
   _events.next(ev);
+  notify_waiters();
+}
+
+
+void OrderAwait::arm()
+{
+  _armed = true;
+  _order->_waiters.push_back(this);
+}
+
+
+void OrderAwait::disarm()
+{
+  if (!_armed)
+    return;
+  _armed = false;
+  auto& waiters = _order->_waiters;
+  auto it = std::find(waiters.begin(), waiters.end(), this);
+  if (it == waiters.end())
+    return;
+  if (_order->_notifying)
+    *it = nullptr;
+  else
+    waiters.erase(it);
+}
+
+
+// Complete the waiters whose state is now reached; a completed waiter resumes
+// its coroutine, which may add or remove waiters meanwhile.
+void Order::notify_waiters()
+{
+  _notifying++;
+  for (size_t i = 0; i < _waiters.size(); i++) {
+    auto* waiter = _waiters[i];
+    if (waiter && waiter->is_ready()) {
+      _waiters[i] = nullptr;
+      waiter->_armed = false;
+      waiter->complete();
+    }
+  }
+  if (--_notifying == 0)
+    _waiters.erase(std::remove(_waiters.begin(), _waiters.end(), nullptr),
+                   _waiters.end());
 }
 
 const std::string& Order::symbol() const { return _instrument.native_symbol(); }
 
 void Order::apply(const OrderUpdate& update)
 {
+  if (update.state == OrderState::closed) {
+    // the close of an exchange order that this one has since replaced
+    if (!update.ext_order_id.empty() && !_exch_order_id.empty() &&
+        update.ext_order_id != _exch_order_id)
+      return;
+
+    if (is_amending() &&
+        (update.close_reason == OrderCloseReason::cancelled ||
+         update.close_reason == OrderCloseReason::lapsed)) {
+      _deferred_close = update.close_reason;
+      return;
+    }
+  }
+
   if (!update.ext_order_id.empty())
     _exch_order_id = update.ext_order_id;
 
@@ -217,6 +444,9 @@ void Order::apply(const OrderFill& fill)
 {
   _fills.push_back(fill);
   _total_fill_qty += fill.size;
+  if (auto* risk = _services ? _services->risk_service() : nullptr)
+    risk->apply_fill(_instrument.iid(), _side, fill.size);
+  hold_risk(std::max(0.0, _risk_held - fill.size));
 
   if (fill.is_fully_filled) {
     set_state_impl(fill.recv_time, OrderState::closed, true,
@@ -228,6 +458,59 @@ void Order::apply(const OrderFill& fill)
 }
 
 
+void Order::apply_amend(const OrderUpdate& update)
+{
+  if (!is_amending()) {
+    LOG_WARN(_instrument.native_symbol()
+             << ": order " << _order_id << ", unexpected amend reply");
+    return;
+  }
+  _amend_state = OrderAmendState::none;
+  _deferred_close = OrderCloseReason::none;
+
+  Time time = _services->now(); // TODO: take this from `update`
+
+  if (update.state != OrderState::live) {
+    // the original was cancelled, but its replacement not accepted
+    set_state_impl(time, OrderState::closed, false,
+                   update.close_reason == OrderCloseReason::none
+                       ? OrderCloseReason::cancelled
+                       : update.close_reason);
+    return;
+  }
+
+  // the replacement takes over the fills so far, so that filled_size remains
+  // the total over the life of the order
+  _price = _amend_price;
+  _size = _total_fill_qty + _amend_size;
+  hold_risk(_amend_size);
+  if (!update.ext_order_id.empty())
+    _exch_order_id = update.ext_order_id;
+
+  OrderEvent ev(shared_from_this(), OrderEvent::Flags::amend, time,
+                _order_state, _order_state);
+  _events.next(ev);
+  notify_waiters();
+}
+
+
+void Order::apply_amend_reject(std::string code, std::string text)
+{
+  _amend_state = OrderAmendState::rejected;
+  _error_code = std::move(code);
+  _error_text = std::move(text);
+
+  LOG_WARN(_instrument.native_symbol()
+           << ": order " << _order_id << " RAMD reject-code: " << _error_code
+           << ", reject-text: " << _error_text);
+
+  // a close held back while the amend was pending was not its own cancel
+  auto reason = std::exchange(_deferred_close, OrderCloseReason::none);
+  if (reason != OrderCloseReason::none && !is_closed())
+    set_is_closed(_services->now(), reason);
+}
+
+
 void Order::apply_cancel_reject(std::string code, std::string text)
 {
   // TODO: invoke an appropriate Bot callback
@@ -18,14 +18,19 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <apex/model/Instrument.hpp>
+#include <apex/util/Awaitable.hpp>
+#include <apex/util/FixedString.hpp>
+#include <apex/util/LatencyTrace.hpp>
 #include <apex/util/Time.hpp>
 #include <apex/util/rx.hpp>
 
 #include <memory>
+#include <vector>
 
 namespace apex
 {
 class Order;
+class OrderAwait;
 class Services;
 class OrderRouter;
 
@@ -61,6 +66,14 @@ enum class OrderCancelState : unsigned int {
 };
 
 
+enum class OrderAmendState : unsigned int {
+  none = 0,
+  amending, // cancel-replace request is pending
+  rejected, // request rejected, the order is unchanged
+  error     // request failed internally
+};
+
+
 enum class OrderState : unsigned int {
   none = 0,
   init,
@@ -74,10 +87,13 @@ const char * to_string(OrderState);
 
 struct OrderEvent {
 
-  enum Flags { state_change = 1 << 0, fill = 1 << 1 };
+  enum Flags { state_change = 1 << 0, fill = 1 << 1, amend = 1 << 2 };
 
   [[nodiscard]] bool is_fill() const { return flags & Flags::fill; }
 
+  // the price, size and exchange id of a live order were replaced
+  [[nodiscard]] bool is_amend() const { return flags & Flags::amend; }
+
   [[nodiscard]] bool is_state_change() const
   {
     return flags & Flags::state_change;
@@ -119,15 +135,29 @@ struct OrderEvent {
 // }
 
 
+// Symbols and order ids, of Binance and of OrderService, fit in 32 bytes, so
+// the structs passed between threads hold them inline.
+using SymbolString = FixedString<32>;
+using OrderIdString = FixedString<32>;
+
+
 struct OrderParams {
-  std::string symbol;
+  SymbolString symbol;
   ExchangeId exchange;
   Side side = Side::none;
   OrderType order_type = OrderType::limit;
   TimeInForce time_in_force = TimeInForce::fok;
   double size = 0.0;
   double price = 0.0;
-  std::string order_id;
+  OrderIdString order_id;
+};
+
+
+// An order to cancel, as one of a mass-cancel request
+struct CancelParams {
+  SymbolString symbol;
+  OrderIdString order_id;
+  OrderIdString ext_order_id;
 };
 
 
@@ -135,9 +165,13 @@ struct OrderUpdate {
   // TODO: this needs to have a recv_time
   OrderState state = OrderState::none;
   OrderCloseReason close_reason = OrderCloseReason::none;
-  std::string ext_order_id;
+  OrderIdString ext_order_id;
 };
 
+static_assert(std::is_trivially_copyable_v<OrderParams>);
+static_assert(std::is_trivially_copyable_v<CancelParams>);
+static_assert(std::is_trivially_copyable_v<OrderUpdate>);
+
 struct OrderFill {
   bool is_fully_filled = false;
   Time recv_time = {};
@@ -152,7 +186,7 @@ struct OrderFill {
 class Order : public std::enable_shared_from_this<Order>
 {
 public:
-  Order(Services* services, OrderRouter* session, Instrument instrument,
+  Order(Services* services, OrderRouter* session, const Instrument& instrument,
         Side side, double size, double price, TimeInForce tif,
         std::string order_id, void* user_data = nullptr,
         std::function<void(void*)> user_data_delete_fn = {});
@@ -169,6 +203,10 @@ public:
   [[nodiscard]] double size() const { return _size; }
   [[nodiscard]] double price() const { return _price; }
   [[nodiscard]] TimeInForce time_in_force() const { return _tif; }
+
+  // Latency trace of the tick that led to the order, if any.
+  [[nodiscard]] const trace::Stamp& trace() const { return _trace; }
+  void set_trace(const trace::Stamp& stamp) { _trace = stamp; }
   [[nodiscard]] OrderCloseReason close_reason() const { return _close_reason; }
   [[nodiscard]] std::string error_code() const { return _error_code; }
   [[nodiscard]] std::string error_text() const { return _error_text; }
@@ -184,6 +222,31 @@ public:
    * request will only be determined later. */
   bool cancel();
 
+  /* Attempt to replace the price and open size of a live order, by a
+   * cancel-replace at the exchange; `size` is the size of the replacement,
+   * i.e. the new remain_size.  Returns false if the order cannot be amended
+   * now (not live, or a cancel or amend already pending), or on an internal
+   * error.  Until the outcome arrives the order keeps its current
+   * attributes.  On success the new price, size and exchange order id are
+   * applied together, raising a single amend event; if the cancel part is
+   * rejected the order is unchanged, and if the cancel succeeds but the
+   * replacement is refused, the order closes as cancelled. */
+  bool amend(double price, double size);
+
+  /* Send several orders, all in the 'init' state, with as few requests as
+   * their routers allow, e.g. one GX message per exchange; otherwise as
+   * send() of each. */
+  static void send_all(const std::vector<std::shared_ptr<Order>>&);
+
+  /* Cancel several orders with as few requests as their routers allow, e.g.
+   * when flattening a strategy; orders already closed or canceling are
+   * skipped.  With `all_open`, the router also cancels any other open orders
+   * of the account on the instruments of these orders, where it can, with
+   * one exchange request per instrument.  Returns the number of orders for
+   * which a cancel was sent. */
+  static size_t cancel_all(const std::vector<std::shared_ptr<Order>>&,
+                           bool all_open = false);
+
   // TODO: change this to have an appy_***** name, like the other apply_
   // methods.
   void set_is_rejected(std::string code, std::string text);
@@ -214,7 +277,26 @@ public:
     return _cancel_state == OrderCancelState::rejected;
   }
 
-  rx::observable<OrderEvent>& events() { return _events; }
+  bool is_amending() const { return _amend_state == OrderAmendState::amending; }
+
+  bool is_amend_rejected() const
+  {
+    return _amend_state == OrderAmendState::rejected;
+  }
+
+  // Price and size of the pending amend request.
+  [[nodiscard]] double amend_price() const { return _amend_price; }
+  [[nodiscard]] double amend_size() const { return _amend_size; }
+
+  // Order events are raised, and observed, only on the event loop thread.
+  rx::local_observable<OrderEvent>& events() { return _events; }
+
+  /* Awaitable states of the order, for coroutines on the event loop thread
+   * (see core/Coroutine.hpp); each also completes if the order closes
+   * first, and co_await yields whether the state was reached. */
+  OrderAwait live();   // live, or since filled
+  OrderAwait filled(); // fully filled
+  OrderAwait closed();
 
   // Engine's internal order ID
   const std::string& order_id() const { return _order_id; }
@@ -240,10 +322,21 @@ public:
   }
 
 
+  /* Restore the state of an order sent by an earlier run of the engine, as
+   * recorded in its StateJournal; raises no event. */
+  void restore(OrderState, std::string exch_order_id, double filled_size);
+
   void apply(const OrderUpdate&);
   void apply_cancel_reject(std::string code, std::string text);
   void apply(const OrderFill&);
 
+  /* Outcome of an amend: the replacement is live, with the new exchange order
+   * id, else the order closed. */
+  void apply_amend(const OrderUpdate&);
+
+  /* The cancel part of an amend was rejected; the order is unchanged. */
+  void apply_amend_reject(std::string code, std::string text);
+
 
   double filled_size() const { return _total_fill_qty; }
   double remain_size() const { return _size - filled_size(); }
@@ -258,12 +351,20 @@ public:
   }
 
 private:
+  // see RiskService; zero if the order passes, or there are no checks
+  unsigned risk_check(double price, double size);
+  void reject_by_risk(unsigned failed);
+  void hold_risk(double size);
+
   void set_state_impl(Time time, OrderState new_state, bool with_fill = false,
                       OrderCloseReason reason = OrderCloseReason::none);
 
+  friend class OrderAwait;
+  void notify_waiters();
+
   Services* _services;
   OrderRouter* _router;
-  Instrument _instrument;
+  const Instrument& _instrument; // interned
   Side _side;
   double _size;
   double _price;
@@ -272,17 +373,89 @@ private:
   std::function<void(void*)> _user_data_delete_fn;
   OrderState _order_state;
   OrderCancelState _cancel_state = OrderCancelState::none;
+  OrderAmendState _amend_state = OrderAmendState::none;
+  double _amend_price = 0.0;
+  double _amend_size = 0.0;
+  double _risk_held = 0.0; // working size counted by the RiskService
+
+  // close reported while an amend is pending, which is normally the cancel
+  // part of the amend, and so applied only if the amend is rejected
+  OrderCloseReason _deferred_close = OrderCloseReason::none;
   OrderCloseReason _close_reason = OrderCloseReason::none;
   std::string _order_id;
   std::string _exch_order_id;
   OrderEvent _last_event;
-  rx::subject<OrderEvent> _events;
+  rx::local_subject<OrderEvent> _events;
+  std::vector<OrderAwait*> _waiters; // removed as null while notifying
+  int _notifying = 0;
   std::string _error_code;
   std::string _error_text;
   Time _sent_time;
   Time _live_time; // time order went live
   double _total_fill_qty = 0.0;
   std::list<OrderFill> _fills;
+  trace::Stamp _trace;
 };
 
+
+class OrderAwait : public Awaitable
+{
+public:
+  enum class Kind { live, filled, closed };
+
+  OrderAwait(std::shared_ptr<Order> order, Kind kind)
+    : _order(std::move(order)),
+      _kind(kind)
+  {
+  }
+
+  ~OrderAwait() override { disarm(); }
+
+  bool await_resume()
+  {
+    disarm();
+    return reached();
+  }
+
+protected:
+  bool reached() const
+  {
+    switch (_kind) {
+      case Kind::live:
+        return _order->is_live() || _order->remain_size() <= 0;
+      case Kind::filled:
+        return _order->remain_size() <= 0;
+      case Kind::closed:
+        return _order->is_closed();
+    }
+    return false;
+  }
+
+  bool is_ready() const override { return reached() || _order->is_closed(); }
+  void arm() override;
+  void disarm() override;
+
+private:
+  friend class Order;
+  std::shared_ptr<Order> _order;
+  Kind _kind;
+  bool _armed = false;
+};
+
+
+inline OrderAwait Order::live()
+{
+  return {shared_from_this(), OrderAwait::Kind::live};
+}
+
+inline OrderAwait Order::filled()
+{
+  return {shared_from_this(), OrderAwait::Kind::filled};
+}
+
+inline OrderAwait Order::closed()
+{
+  return {shared_from_this(), OrderAwait::Kind::closed};
+}
+
 } // namespace apex
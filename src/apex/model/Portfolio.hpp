@@ -0,0 +1,76 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cmath>
+
+namespace apex
+{
+
+/* Running totals, in USD, over the positions of many bots: PnL, net exposure
+ * and gross exposure.  Each bot contributes via an Entry, replacing its
+ * values whenever it has a fill or is marked at a new price, so the totals
+ * are maintained without a scan over the bots and read in constant time.  An
+ * Entry must not outlive its Portfolio.  Not thread safe; used on the event
+ * thread. */
+class Portfolio
+{
+public:
+  class Entry
+  {
+  public:
+    Entry() = default;
+    explicit Entry(Portfolio* portfolio) : _portfolio(portfolio) {}
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+    ~Entry() { update(0.0, 0.0); }
+
+    /* Replace the contribution of this entry; non finite values, such as
+     * those of a position lacking an FX rate, count as zero. */
+    void update(double pnl, double net_exposure)
+    {
+      if (!std::isfinite(pnl))
+        pnl = 0.0;
+      if (!std::isfinite(net_exposure))
+        net_exposure = 0.0;
+      if (_portfolio) {
+        _portfolio->_pnl += pnl - _pnl;
+        _portfolio->_net += net_exposure - _net;
+        _portfolio->_gross += std::fabs(net_exposure) - std::fabs(_net);
+      }
+      _pnl = pnl;
+      _net = net_exposure;
+    }
+
+  private:
+    Portfolio* _portfolio = nullptr;
+    double _pnl = 0.0;
+    double _net = 0.0;
+  };
+
+  [[nodiscard]] double pnl() const { return _pnl; }
+  [[nodiscard]] double net_exposure() const { return _net; }
+  [[nodiscard]] double gross_exposure() const { return _gross; }
+
+private:
+  double _pnl = 0.0;
+  double _net = 0.0;
+  double _gross = 0.0;
+};
+
+} // namespace apex
@@ -17,7 +17,10 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
 
 namespace apex
 {
@@ -26,4 +29,23 @@ constexpr int strategy_id_size = 5;
 
 void validate_strategy_id(const std::string&);
 
+/* Key of the strategy that an order id, or a strategy id, begins with; zero
+ * if too short.  Only the first strategy_id_size bytes are packed, so ids of
+ * any other length cannot be told apart by key and GX refuses them at
+ * om-logon. */
+inline uint64_t strategy_key(std::string_view id)
+{
+  static_assert(strategy_id_size <= sizeof(uint64_t));
+  if (id.size() < strategy_id_size)
+    return 0;
+  uint64_t key = 0;
+  memcpy(&key, id.data(), strategy_id_size);
+  return key;
+}
+
+inline std::string strategy_of(uint64_t key)
+{
+  return {reinterpret_cast<const char*>(&key), strategy_id_size};
+}
+
 }
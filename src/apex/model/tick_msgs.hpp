@@ -18,11 +18,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <apex/model/Order.hpp>
+#include <apex/util/LatencyTrace.hpp>
 #include <apex/util/Time.hpp>
+#include <apex/util/utils.hpp>
 
 #include <array>
 #include <cmath>
 #include <limits>
+#include <vector>
 
 namespace apex
 {
@@ -39,6 +42,11 @@ struct TickTrade {
   Side aggr_side = Side::none;
   TradeType type = TradeType::null;
 
+  // Exact price, when decoded from an exchange decimal string; zero otherwise.
+  ScaledInt exact_price;
+
+  trace::Stamp trace;
+
   [[nodiscard]] bool is_valid() const { return !std::isnan(price); }
 };
 
@@ -48,6 +56,13 @@ struct TickTop {
   double bid_qty = 0;
   double ask_price = nan;
   double ask_qty = 0;
+
+  // Exact prices, when decoded from exchange decimal strings; zero otherwise.
+  // Prices from one exchange share a scale, so compare as integers.
+  ScaledInt exact_bid_price;
+  ScaledInt exact_ask_price;
+
+  trace::Stamp trace;
 };
 
 
@@ -69,13 +84,90 @@ struct TickBookSnapshot5
   std::array<TickBookLevel, N> levels;
 };
 
+/* Snapshot of 25 levels.  `changed` has a bit set for each level that may
+ * differ from the previous snapshot of the same book, so that applying it
+ * need only copy those levels; a fresh snapshot has all bits set. */
 struct TickBookSnapshot25
 {
+  static constexpr int N = 25;
+  static constexpr uint32_t all_levels = (1u << N) - 1;
+
   Time xt = {};
   Time et = {};
-  std::array<TickBookLevel, 25> levels;
+  std::array<TickBookLevel, N> levels;
+  uint32_t changed = all_levels;
+};
+
+/* Changes to price levels of an order book, each holding the new quantity at
+ * the price, with zero removing the level.  A snapshot instead holds every
+ * level, and replaces the whole book. */
+struct TickBookDelta
+{
+  struct Level {
+    double price;
+    double qty;
+  };
+
+  bool is_snapshot = false;
+  std::vector<Level> bids;
+  std::vector<Level> asks;
+
+  void clear()
+  {
+    is_snapshot = false;
+    bids.clear();
+    asks.clear();
+  }
 };
 
+
+/* Summary of the ticks of an instrument over a fixed interval; see
+ * BarAggregator.  Packed, being also the record of a bar file. */
+#pragma pack(push, 1)
+
+struct Bar {
+  int64_t start_us = 0; // the bar covers [start, end), in epoch microseconds
+  int64_t end_us = 0;
+
+  // prices of the trades, NaN if there were none
+  double open = nan;
+  double high = nan;
+  double low = nan;
+  double close = nan;
+
+  double volume = 0;
+  double notional = 0; // sum of price times quantity over the trades
+  uint32_t trades = 0;
+
+  // top of book updates within the bar, and the spread over them, NaN if
+  // there were none
+  uint32_t quotes = 0;
+  double spread_min = nan;
+  double spread_max = nan;
+  double spread_mean = nan;
+
+  // top of book at the end of the bar, which may be from an earlier bar
+  double bid = nan;
+  double ask = nan;
+
+  [[nodiscard]] Time start_time() const
+  {
+    return Time{std::chrono::microseconds(start_us)};
+  }
+  [[nodiscard]] Time end_time() const
+  {
+    return Time{std::chrono::microseconds(end_us)};
+  }
+
+  [[nodiscard]] double vwap() const
+  {
+    return volume > 0 ? notional / volume : nan;
+  }
+};
+
+#pragma pack(pop)
+
+
 // logging utilities
 std::ostream& operator<<(std::ostream&, const TickTrade&);
 
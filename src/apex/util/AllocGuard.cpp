@@ -0,0 +1,142 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/AllocGuard.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+
+#include <cstdlib>
+#include <ostream>
+
+namespace apex
+{
+namespace alloc
+{
+
+thread_local ThreadCounters thread_counters;
+
+// violations of a site that are logged; later ones are only counted
+static constexpr uint64_t max_logged = 8;
+
+static std::atomic<bool> installed{false};
+static std::atomic<Site*> sites{nullptr};
+
+
+bool hook_installed() { return installed.load(std::memory_order_relaxed); }
+
+void set_hook_installed() { installed.store(true, std::memory_order_relaxed); }
+
+
+GuardMode guard_mode()
+{
+  return NoAllocScope::_mode.load(std::memory_order_relaxed);
+}
+
+void set_guard_mode(GuardMode mode)
+{
+  NoAllocScope::_mode.store(mode, std::memory_order_relaxed);
+}
+
+
+Site::Site(const char* name) : name(name)
+{
+  next = sites.load(std::memory_order_relaxed);
+  while (!sites.compare_exchange_weak(next, this, std::memory_order_release,
+                                      std::memory_order_relaxed)) {
+  }
+}
+
+
+size_t write_report(std::ostream& os)
+{
+  size_t count = 0;
+  for (auto* site = sites.load(std::memory_order_acquire); site;
+       site = site->next) {
+    auto violations = site->violations.load(std::memory_order_relaxed);
+    if (!violations)
+      continue;
+    os << site->name << ": " << violations << " violations, "
+       << site->allocations.load(std::memory_order_relaxed)
+       << " allocations\n";
+    ++count;
+  }
+  return count;
+}
+
+
+uint64_t total_violations()
+{
+  uint64_t total = 0;
+  for (auto* site = sites.load(std::memory_order_acquire); site;
+       site = site->next)
+    total += site->violations.load(std::memory_order_relaxed);
+  return total;
+}
+
+
+void reset_violations()
+{
+  for (auto* site = sites.load(std::memory_order_acquire); site;
+       site = site->next) {
+    site->violations.store(0, std::memory_order_relaxed);
+    site->allocations.store(0, std::memory_order_relaxed);
+  }
+}
+
+
+void NoAllocScope::violated(Site& site, uint64_t allocations)
+{
+  // the allocations made in reporting are hidden from enclosing scopes
+  const auto saved = thread_counters;
+
+  site.allocations.fetch_add(allocations, std::memory_order_relaxed);
+  auto n = site.violations.fetch_add(1, std::memory_order_relaxed) + 1;
+  if (guard_mode() == GuardMode::abort) {
+    LOG_ERROR("allocation in no-alloc scope " << site.name << ", "
+              << allocations << " allocations");
+    Logger::instance().flush();
+    std::abort();
+  }
+  if (n <= max_logged)
+    LOG_WARN("allocation in no-alloc scope " << site.name << ", "
+             << allocations << " allocations"
+             << (n == max_logged ? "; further violations not logged" : ""));
+
+  thread_counters = saved;
+}
+
+
+void configure(Config config)
+{
+  auto guard_config =
+      config.get_sub_config("alloc_guard", Config::empty_config());
+  auto mode = guard_config.get_string("mode", "off");
+  if (mode == "off")
+    return;
+  if (mode != "log" && mode != "abort")
+    throw ConfigError("alloc_guard mode must be off, log or abort, not '" +
+                      mode + "'");
+  if (!hook_installed()) {
+    LOG_WARN("alloc_guard has no effect, the allocation hook is not linked");
+    return;
+  }
+  set_guard_mode(mode == "log" ? GuardMode::log : GuardMode::abort);
+  LOG_INFO("allocation guards enabled, mode " << mode);
+}
+
+} // namespace alloc
+} // namespace apex
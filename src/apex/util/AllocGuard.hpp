@@ -0,0 +1,137 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+namespace apex
+{
+
+class Config;
+
+/* Allocation tracking, to keep hot paths, such as tick handling and order
+ * sending, free of heap allocations.  A program that links util/AllocHook.cpp
+ * replaces the global operator new and delete with ones that count the
+ * allocations of each thread; the library itself never replaces them.
+ *
+ * APEX_NO_ALLOC_SCOPE("name") at the top of a scope marks it as one that
+ * must not allocate.  When guards are enabled, and the hook linked, a scope
+ * that allocated is counted against its site, and either logged, for the
+ * first few violations of the site, or fails the process.  A scope costs one
+ * relaxed load while guards are disabled; build with -DAPEX_ALLOC_GUARDS=0
+ * to compile scopes out.  Site names must be string literals. */
+namespace alloc
+{
+
+/* Allocations of the calling thread, counted by the hook. */
+struct ThreadCounters {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+extern thread_local ThreadCounters thread_counters;
+
+/* Whether the counting hook is linked into the program. */
+bool hook_installed();
+
+// done by the hook, as the program starts
+void set_hook_installed();
+
+enum class GuardMode { off, log, abort };
+
+GuardMode guard_mode();
+void set_guard_mode(GuardMode);
+
+/* A scope that must not allocate, with the violations found there. */
+struct Site {
+  explicit Site(const char* name);
+
+  const char* name;
+  std::atomic<uint64_t> violations{0};
+  std::atomic<uint64_t> allocations{0}; // made by the violating scopes
+  Site* next = nullptr;                 // of all sites
+};
+
+/* Write the sites with violations, one per line; returns their number. */
+size_t write_report(std::ostream&);
+
+/* Total violations of all sites. */
+uint64_t total_violations();
+
+void reset_violations();
+
+/* Scope guard checking one site. */
+class NoAllocScope
+{
+public:
+  explicit NoAllocScope(Site& site)
+    : _site(site),
+      _enabled(_mode.load(std::memory_order_relaxed) != GuardMode::off),
+      _start(_enabled ? thread_counters.count : 0)
+  {
+  }
+
+  ~NoAllocScope()
+  {
+    if (_enabled && thread_counters.count != _start)
+      violated(_site, thread_counters.count - _start);
+  }
+
+  NoAllocScope(const NoAllocScope&) = delete;
+  NoAllocScope& operator=(const NoAllocScope&) = delete;
+
+private:
+  friend GuardMode guard_mode();
+  friend void set_guard_mode(GuardMode);
+
+  static void violated(Site&, uint64_t allocations);
+
+  static inline std::atomic<GuardMode> _mode{GuardMode::off};
+
+  Site& _site;
+  bool _enabled;
+  uint64_t _start;
+};
+
+/* If the "alloc_guard" sub-config sets "mode" to "log" or "abort", enable
+ * the guards; they are only effective if the hook is linked. */
+void configure(Config);
+
+} // namespace alloc
+} // namespace apex
+
+
+#ifndef APEX_ALLOC_GUARDS
+#define APEX_ALLOC_GUARDS 1
+#endif
+
+#define _APEX_ALLOC_CONCAT2_(A, B) A##B
+#define _APEX_ALLOC_CONCAT_(A, B) _APEX_ALLOC_CONCAT2_(A, B)
+
+#if APEX_ALLOC_GUARDS
+#define APEX_NO_ALLOC_SCOPE(NAME)                                       \
+  static apex::alloc::Site _APEX_ALLOC_CONCAT_(_apex_alloc_site_,       \
+                                               __LINE__)(NAME);         \
+  apex::alloc::NoAllocScope _APEX_ALLOC_CONCAT_(_apex_alloc_scope_,     \
+                                                __LINE__)(              \
+      _APEX_ALLOC_CONCAT_(_apex_alloc_site_, __LINE__))
+#else
+#define APEX_NO_ALLOC_SCOPE(NAME) do {} while (0)
+#endif
@@ -0,0 +1,154 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Replacement global operator new and delete, counting the allocations of
+ * each thread into alloc::thread_counters.  This file is not part of the
+ * library: a program opts in to allocation tracking by compiling it in, after
+ * which the "alloc_guard" config, and APEX_NO_ALLOC_SCOPE, take effect.
+ * Memory comes from malloc, so the replacements cost two thread-local adds
+ * over the default operators. */
+
+#include <apex/util/AllocGuard.hpp>
+
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+inline void* counted_alloc(std::size_t size) noexcept
+{
+  auto& counters = apex::alloc::thread_counters;
+  counters.count++;
+  counters.bytes += size;
+  return std::malloc(size ? size : 1);
+}
+
+inline void* counted_alloc(std::size_t size, std::align_val_t al) noexcept
+{
+  auto& counters = apex::alloc::thread_counters;
+  counters.count++;
+  counters.bytes += size;
+  auto alignment = static_cast<std::size_t>(al);
+  if (alignment < sizeof(void*))
+    alignment = sizeof(void*);
+  void* ptr = nullptr;
+  if (posix_memalign(&ptr, alignment, size ? size : 1) != 0)
+    return nullptr;
+  return ptr;
+}
+
+template <typename... A>
+void* throwing_alloc(std::size_t size, A... al)
+{
+  for (;;) {
+    if (void* ptr = counted_alloc(size, al...))
+      return ptr;
+    auto handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+struct InstallHook {
+  InstallHook() { apex::alloc::set_hook_installed(); }
+} install_hook;
+
+} // namespace
+
+
+void* operator new(std::size_t size) { return throwing_alloc(size); }
+
+void* operator new[](std::size_t size) { return throwing_alloc(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t al)
+{
+  return throwing_alloc(size, al);
+}
+
+void* operator new[](std::size_t size, std::align_val_t al)
+{
+  return throwing_alloc(size, al);
+}
+
+void* operator new(std::size_t size, std::align_val_t al,
+                   const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size, al);
+}
+
+void* operator new[](std::size_t size, std::align_val_t al,
+                     const std::nothrow_t&) noexcept
+{
+  return counted_alloc(size, al);
+}
+
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t,
+                     const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t,
+                       const std::nothrow_t&) noexcept
+{
+  std::free(ptr);
+}
@@ -0,0 +1,229 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/EventLoop.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace apex
+{
+
+/* Awaitable conditions, for coroutines that run on the event thread, such as
+ * order workflows written with co::Task (see core/Coroutine.hpp).  The
+ * awaitables themselves need only C++17: the coroutine handle is taken by a
+ * template, and kept type-erased, so that the library, and code awaiting
+ * nothing, is unaffected by the language standard of its users.
+ *
+ * An awaitable registers itself, by address, with whatever completes it, so
+ * it can be neither copied nor moved; it is awaited as a temporary, or as a
+ * local of the coroutine, and deregisters itself when destroyed, e.g. when a
+ * suspended coroutine is destroyed.  A coroutine is resumed directly from the
+ * completing event, as the equivalent Bot callback would be invoked. */
+class Awaitable
+{
+public:
+  Awaitable() = default;
+  Awaitable(const Awaitable&) = delete;
+  Awaitable& operator=(const Awaitable&) = delete;
+  virtual ~Awaitable() = default;
+
+  bool await_ready() { return is_ready(); }
+
+  template <typename Handle> void await_suspend(Handle h)
+  {
+    _resume.set(h);
+    arm();
+  }
+
+  void await_resume() { disarm(); }
+
+protected:
+  template <size_t> friend class AnyOf;
+
+  // Resumption of a suspended coroutine, without reference to its type.
+  struct Resumer {
+    void* address = nullptr;
+    void (*fn)(void*) = nullptr;
+
+    template <typename Handle> void set(Handle h)
+    {
+      address = h.address();
+      fn = [](void* a) { Handle::from_address(a).resume(); };
+    }
+
+    void operator()()
+    {
+      auto f = fn;
+      fn = nullptr;
+      if (f)
+        f(address);
+    }
+  };
+
+  /* Whether the condition already holds, so that there is no suspension. */
+  virtual bool is_ready() const = 0;
+
+  /* Start waiting for the condition; complete() is then called once it
+   * holds, unless disarmed first. */
+  virtual void arm() = 0;
+
+  /* Stop waiting; harmless if not waiting. */
+  virtual void disarm() = 0;
+
+  /* The condition holds: resume the waiting coroutine, or notify the AnyOf
+   * this awaitable is part of. */
+  void complete();
+
+private:
+  struct Parent {
+    virtual void child_complete(Awaitable*) = 0;
+  };
+  Resumer _resume;
+  Parent* _parent = nullptr;
+};
+
+
+/* Suspend for a duration of event loop time, i.e. of backtest time in a
+ * backtest. */
+class Sleep : public Awaitable
+{
+public:
+  Sleep(EventLoop& evloop, std::chrono::milliseconds duration)
+    : _evloop(evloop),
+      _duration(duration)
+  {
+  }
+
+  ~Sleep() override { disarm(); }
+
+protected:
+  bool is_ready() const override { return _duration.count() <= 0; }
+
+  void arm() override
+  {
+    _pending = true;
+    _timer = _evloop.dispatch(_duration, EventLoop::inline_timer_fn([this]() {
+      _pending = false;
+      complete();
+      return std::chrono::milliseconds(0);
+    }));
+  }
+
+  void disarm() override
+  {
+    if (_pending) {
+      _pending = false;
+      _evloop.cancel_timer(_timer);
+    }
+  }
+
+private:
+  EventLoop& _evloop;
+  std::chrono::milliseconds _duration;
+  TimerHandle _timer;
+  bool _pending = false;
+};
+
+
+inline Sleep sleep(EventLoop& evloop, std::chrono::milliseconds duration)
+{
+  return Sleep(evloop, duration);
+}
+
+
+/* Wait for the first of several awaitables, resuming with its index; the
+ * others stop waiting.  If several are ready at once, the first of them is
+ * taken. */
+template <size_t N> class AnyOf : private Awaitable::Parent
+{
+public:
+  explicit AnyOf(std::array<Awaitable*, N> items) : _items(items) {}
+  AnyOf(const AnyOf&) = delete;
+  AnyOf& operator=(const AnyOf&) = delete;
+
+  ~AnyOf()
+  {
+    for (auto* item : _items) {
+      item->_parent = nullptr;
+      item->disarm();
+    }
+  }
+
+  bool await_ready()
+  {
+    for (size_t i = 0; i < N; i++)
+      if (_items[i]->is_ready()) {
+        _index = i;
+        return true;
+      }
+    return false;
+  }
+
+  template <typename Handle> void await_suspend(Handle h)
+  {
+    _resume.set(h);
+    for (auto* item : _items) {
+      item->_parent = this;
+      item->arm();
+    }
+  }
+
+  size_t await_resume()
+  {
+    for (auto* item : _items)
+      item->disarm();
+    return _index;
+  }
+
+private:
+  void child_complete(Awaitable* child) override
+  {
+    for (size_t i = 0; i < N; i++) {
+      if (_items[i] == child)
+        _index = i;
+      else
+        _items[i]->disarm();
+    }
+    _resume();
+  }
+
+  std::array<Awaitable*, N> _items;
+  Awaitable::Resumer _resume;
+  size_t _index = 0;
+};
+
+
+/* e.g. `if (co_await any(order.filled(), sleep(evloop, 5s)) == 1) ...` */
+template <typename... A> AnyOf<sizeof...(A)> any(A&&... items)
+{
+  return AnyOf<sizeof...(A)>({static_cast<Awaitable*>(&items)...});
+}
+
+
+inline void Awaitable::complete()
+{
+  if (_parent)
+    _parent->child_complete(this);
+  else
+    _resume();
+}
+
+} // namespace apex
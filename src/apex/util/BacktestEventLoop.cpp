@@ -19,25 +19,36 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/utils.hpp>
 #include <apex/core/Logger.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <iomanip>
+#include <ostream>
+#include <string_view>
 
 namespace apex
 {
 
 // This class is only used by BacktestEventLoop, so is placed only with this .cc
-// file
+// file.  Timers are held on a TimerWheel with ticks of epoch microseconds.
+// Timers added before the backtest start time is known are held on the wheel
+// with due ticks relative to zero, and rebased once the start time is known.
+// The inline storage is sized so that an EventLoop::inline_timer_fn can itself
+// be wrapped without allocation.
 class BacktestTimers : public BacktestEventSource {
 public:
+  typedef InlineFunction<std::chrono::milliseconds(), 128> timer_type;
 
   void init_backtest_time_range(Time , Time ) override
   {
     // TODO: integrate these limits with the on the fly timer
   }
 
+  const char* event_source_kind() const override { return "timers"; }
+
   Time get_next_event_time() override
   {
-    if (std::size(m_timers))
-      return m_timers.begin()->first;
+    if (!m_timers.empty() && m_started)
+      return Time(std::chrono::microseconds(m_timers.next_due()));
     else
       return {};
   }
@@ -46,73 +57,148 @@ public:
   {
     // this assert ensures that the backtest event loop only asks for
     // an event if one is infact due
-    assert(std::empty(m_timers) == false);
-
-    auto iter = m_timers.begin();
+    assert(m_timers.empty() == false);
+
+    TimerHandle handle;
+    TimerWheel<timer_type>::tick_type due = 0;
+    timer_type fn;
+    m_timers.expire(
+        m_timers.next_due(),
+        [&](TimerHandle h, auto t, timer_type&& f) {
+          handle = h;
+          due = t;
+          fn = std::move(f);
+        },
+        1);
 
     // invoke the callback function, which can return a time-interval to reset
     // the timer
-    std::chrono::milliseconds reset_interval = iter->second();
-
-    // TODO: in a multimap, is this the correct thing to do?
+    std::chrono::milliseconds reset_interval{0};
+    try {
+      reset_interval = fn();
+    } catch (...) {
+      m_timers.release(handle);
+      throw;
+    }
 
-    if (reset_interval.count() != 0) {
-      Time current = iter->first;
-      EventLoop::timer_fn fn = std::move(iter->second);
-      m_timers.erase(iter);
-      schedule_timer(current, reset_interval, std::move(fn));
+    if (reset_interval.count() > 0) {
+      auto delay = std::chrono::microseconds(reset_interval).count();
+      m_timers.rearm(handle, due + delay, std::move(fn));
     }
     else {
-      m_timers.erase(iter);
+      m_timers.release(handle);
     }
   }
 
 
-  void add_timer(Time current,
-                 std::chrono::milliseconds interval,
-                 EventLoop::timer_fn fn)
+  TimerHandle add_timer(Time current,
+                        std::chrono::milliseconds interval,
+                        timer_type fn)
   {
+    const auto delay = std::chrono::microseconds(interval).count();
     if (current.empty())
-      m_pending_timers.push_back({interval, fn});
+      return m_timers.schedule(delay, std::move(fn));
     else
-      schedule_timer(current, interval, fn);
+      return m_timers.schedule(current.as_epoch_us().count() + delay,
+                               std::move(fn));
   };
 
 
-  void schedule_timer(Time current,
-                      std::chrono::milliseconds interval,
-                      EventLoop::timer_fn fn)
-  {
-    auto due = current;
-    due += interval;
-    m_timers.insert({due, fn});
-  }
+  bool cancel(TimerHandle handle) { return m_timers.cancel(handle); }
+
 
   void schedule_pending_timers(Time current)
   {
-    for (auto & item: m_pending_timers)
-      schedule_timer(current, item.interval, item.fn);
-    m_pending_timers.clear();
+    m_started = true;
+    const auto start = current.as_epoch_us().count();
+
+    // expire all timers added before the start time, and then re-arm them
+    // relative to the start time, which preserves their handles
+    struct Pending {
+      TimerHandle handle;
+      TimerWheel<timer_type>::tick_type delay;
+      timer_type fn;
+    };
+    std::vector<Pending> pending;
+    m_timers.expire(start, [&](TimerHandle h, auto t, timer_type&& fn) {
+      pending.push_back({h, t, std::move(fn)});
+    });
+    for (auto& item : pending)
+      m_timers.rearm(item.handle, start + item.delay, std::move(item.fn));
   }
 
 
 private:
-  std::multimap<Time, EventLoop::timer_fn> m_timers;
+  TimerWheel<timer_type> m_timers;
+  bool m_started = false;
+};
 
-  struct PendingTimer {
-    std::chrono::milliseconds interval;
-    EventLoop::timer_fn fn;
-  };
 
-  std::vector<PendingTimer> m_pending_timers; // not scheduled yet
-};
+// fixed slots of the time split; source kinds follow
+static constexpr size_t scheduling_slot = 0;
+static constexpr size_t dispatch_slot = 1;
+static constexpr size_t batch_end_slot = 2;
+
+
+double BacktestProgress::events_per_sec() const
+{
+  const double secs = std::chrono::duration<double>(wall).count();
+  return secs > 0 ? events / secs : 0.0;
+}
+
+
+double BacktestProgress::sim_speed() const
+{
+  const double secs = std::chrono::duration<double>(wall).count();
+  if (secs <= 0 || sim_start.empty() || sim_time.empty())
+    return 0.0;
+  return std::chrono::duration<double>(sim_time - sim_start).count() / secs;
+}
+
+
+std::ostream& operator<<(std::ostream& os, const BacktestProgress& progress)
+{
+  const auto wall = std::chrono::duration<double>(progress.wall).count();
+  const auto flags = os.flags();
+  const auto precision = os.precision();
+
+  os << std::fixed << std::setprecision(3) << "events: " << progress.events
+     << ", sim-time: "
+     << (progress.sim_time.empty() ? std::string("none")
+                                   : progress.sim_time.as_iso8601())
+     << ", wall: " << wall << "s" << std::setprecision(1)
+     << ", events/sec: " << progress.events_per_sec()
+     << ", sim-speed: " << progress.sim_speed() << "x";
+  if (!progress.time_split.empty()) {
+    os << ", time-split: {";
+    const char* sep = "";
+    for (auto& [name, spent] : progress.time_split) {
+      const auto secs = std::chrono::duration<double>(spent).count();
+      os << sep << name << ": " << std::setprecision(3) << secs << "s"
+         << std::setprecision(1);
+      if (wall > 0)
+        os << " (" << 100.0 * secs / wall << "%)";
+      sep = ", ";
+    }
+    os << "}";
+  }
+
+  os.flags(flags);
+  os.precision(precision);
+  return os;
+}
 
 
 BacktestEventLoop::BacktestEventLoop(Time backtest_time_start)
   : _current(backtest_time_start)
 {
   _timers.reset(new BacktestTimers);
+  if (!_current.empty())
+    _timers->schedule_pending_timers(_current);
   _sources.push_back(_timers.get());
+
+  _split_names = {"scheduling", "dispatch", "batch_end"};
+  _split_times.assign(_split_names.size(), std::chrono::nanoseconds{0});
 }
 
 
@@ -124,6 +210,7 @@ BacktestEventLoop::~BacktestEventLoop()
 void BacktestEventLoop::add_event_source(BacktestEventSource* source)
 {
   _sources.push_back(source);
+  _tree_dirty = true;
 }
 
 
@@ -131,53 +218,139 @@ void BacktestEventLoop::add_event_sources(std::vector< std::shared_ptr<BacktestE
 {
   for (auto & item : sources)
     _sp_sources.push_back(std::move(item));
+  _tree_dirty = true;
 
 }
 
 
-void BacktestEventLoop::dispatch(std::chrono::milliseconds interval,
-                                 EventLoop::timer_fn fn)
+TimerHandle BacktestEventLoop::dispatch(std::chrono::milliseconds interval,
+                                        EventLoop::timer_fn fn)
 {
-  _timers->add_timer(_current, interval, fn);
+  _timers_changed = true;
+  return _timers->add_timer(_current, interval,
+                            BacktestTimers::timer_type(std::move(fn)));
+}
+
+
+TimerHandle BacktestEventLoop::dispatch(std::chrono::milliseconds interval,
+                                        EventLoop::inline_timer_fn fn)
+{
+  _timers_changed = true;
+  return _timers->add_timer(_current, interval,
+                            BacktestTimers::timer_type(std::move(fn)));
+}
+
+
+bool BacktestEventLoop::cancel_timer(TimerHandle handle)
+{
+  return _timers->cancel(handle);
 }
 
 
 void BacktestEventLoop::dispatch(std::function<void()> fn)
 {
-  // to implement the dispatch of an immediate callback, we just create a 1
-  // millisecond timer.
-
-  _timers->add_timer(_current, std::chrono::milliseconds(1),
-                      [fn]() -> std::chrono::milliseconds {
-                        fn();
-                        return {};
-                      });
+  dispatch(EventLoop::inline_fn(std::move(fn)));
+}
+
+
+void BacktestEventLoop::dispatch(EventLoop::inline_fn fn)
+{
+  // immediate callbacks are invoked at the current simulated time, after the
+  // current event and before the next
+  _immediate.push_back(std::move(fn));
+}
+
+
+void BacktestEventLoop::drain_immediate()
+{
+  // items dispatched while draining are appended, and so also invoked, in
+  // order; the vector is only cleared once empty, so retains its capacity
+  while (_immediate_next < _immediate.size()) {
+    auto fn = std::move(_immediate[_immediate_next++]);
+    fn();
+  }
+  _immediate.clear();
+  _immediate_next = 0;
 }
 
 
 std::pair<Time, BacktestEventSource*> BacktestEventLoop::find_earliest()
 {
-  std::pair<Time, BacktestEventSource*> earliest {{},nullptr};
-
-  // TODO: these two sections are (almost) identical, so need to find a way to combine
-  // them, easiest would be just to reply on shared pointer.
-  for (auto p : _sources) {
-    auto t = p->get_next_event_time();
-    if (!t.empty() &&
-        (t < earliest.first || earliest.first.empty())) {
-      earliest = {t, p};
-    }
+  if (_tree_dirty)
+    rebuild_tree();
+  else {
+    // the timers are always source 0
+    if (_tree[1] != npos && _tree[1] != 0)
+      update_tree(_tree[1]);
+    update_tree(0);
   }
-  for (auto p : _sp_sources) {
-    auto t = p->get_next_event_time();
-    if (!t.empty() &&
-        (t < earliest.first || earliest.first.empty())) {
-      earliest = {t, p.get()};
-    }
+
+  const size_t winner = _tree[1];
+  if (winner == npos || _tree_keys[winner].empty())
+    return {{}, nullptr};
+  else
+    return {_tree_keys[winner], _tree_sources[winner]};
+}
+
+
+/* Return the source which has the earlier event; ties are won by the source
+ * added first, and sources without events never win. */
+size_t BacktestEventLoop::tree_winner(size_t a, size_t b) const
+{
+  if (a == npos)
+    return b;
+  if (b == npos)
+    return a;
+  const Time& ta = _tree_keys[a];
+  const Time& tb = _tree_keys[b];
+  if (ta.empty() != tb.empty())
+    return ta.empty() ? b : a;
+  if (!ta.empty()) {
+    if (ta < tb)
+      return a;
+    if (tb < ta)
+      return b;
   }
+  return a < b ? a : b;
+}
 
 
-  return earliest;
+void BacktestEventLoop::rebuild_tree()
+{
+  _tree_sources.clear();
+  for (auto p : _sources)
+    _tree_sources.push_back(p);
+  for (auto& p : _sp_sources)
+    _tree_sources.push_back(p.get());
+
+  _tree_keys.clear();
+  for (auto p : _tree_sources)
+    _tree_keys.push_back(p->get_next_event_time());
+
+  _source_slot.clear();
+  for (auto p : _tree_sources)
+    _source_slot.push_back(split_slot(p->event_source_kind()));
+  _batch_backoff.assign(_tree_sources.size(), BatchBackoff{});
+
+  _tree_leaves = 1;
+  while (_tree_leaves < _tree_sources.size())
+    _tree_leaves <<= 1;
+
+  _tree.assign(2 * _tree_leaves, npos);
+  for (size_t i = 0; i < _tree_sources.size(); ++i)
+    _tree[_tree_leaves + i] = i;
+  for (size_t node = _tree_leaves - 1; node >= 1; --node)
+    _tree[node] = tree_winner(_tree[2 * node], _tree[2 * node + 1]);
+
+  _tree_dirty = false;
+}
+
+
+void BacktestEventLoop::update_tree(size_t source)
+{
+  _tree_keys[source] = _tree_sources[source]->get_next_event_time();
+  for (size_t node = (_tree_leaves + source) / 2; node >= 1; node /= 2)
+    _tree[node] = tree_winner(_tree[2 * node], _tree[2 * node + 1]);
 }
 
 
@@ -201,11 +374,11 @@ void BacktestEventLoop::update_current_time(Time t)
 
 void BacktestEventLoop::run_loop(Time upto)
 {
-  int event_count = 0;
   for (auto p : _sources)
     p->init_backtest_time_range(_from, upto);
   for (auto p : _sp_sources)
     p->init_backtest_time_range(_from, upto);
+  _tree_dirty = true;
 
   //if (!m_current.empty())
   //  throw std::runtime_error("backtest loop already run");
@@ -215,18 +388,78 @@ void BacktestEventLoop::run_loop(Time upto)
   else
     update_current_time(_from);
 
+  _event_count = 0;
+  _sim_start = _current;
+  _complete = false;
+  std::fill(_split_times.begin(), _split_times.end(),
+            std::chrono::nanoseconds{0});
+  _wall_start = std::chrono::steady_clock::now();
+  _lap_start = _wall_start;
+  _next_report = _wall_start + _progress_options.interval;
+
+  // a batch is the set of events sharing the same simulated time, so the
+  // batch-end hooks are run each time the clock is about to advance
+  _batch_pending = false;
 
   LOG_INFO("starting backtest event loop");
   while (true) {
     try {
+      // callbacks dispatched before the loop started, or by batch-end hooks
+      if (!_immediate.empty()) {
+        drain_immediate();
+        lap(dispatch_slot);
+      }
+
       // find source that has next evet
       const auto [next_time, next_source] = find_earliest();
+      lap(scheduling_slot);
+
+      if (_batch_pending && (next_source == nullptr || next_time != _current)) {
+        _batch_pending = false;
+        run_batch_end_hooks();
+        lap(batch_end_slot);
+        if (!_immediate.empty())
+          continue;
+      }
 
       if (next_source != nullptr)
       {
+        const size_t winner = _tree[1];
+        const size_t slot = _source_slot[winner];
         update_current_time(next_time);
-        event_count ++;
+        _timers_changed = false;
+        _event_count ++;
         next_source->consume_next_event();
+        lap(slot);
+        if (!_immediate.empty()) {
+          drain_immediate();
+          lap(dispatch_slot);
+        }
+        _batch_pending = true;
+
+        if ((_event_count & 1023) == 0)
+          check_heartbeat();
+
+        // the source may go on to consume its events up to the next event of
+        // any other source; the timers are excluded, since consuming a timer
+        // can itself schedule the next timer
+        if (_batching && winner != 0 && !(!upto.empty() && upto < _current)) {
+          auto& backoff = _batch_backoff[winner];
+          if (backoff.skip > 0)
+            --backoff.skip;
+          else {
+            BacktestBatch batch(*this, runner_up_time(winner), upto, slot);
+            if (next_source->consume_events(batch)) {
+              backoff.wait = 0;
+              lap(slot);
+            }
+            else {
+              backoff.wait = std::min(std::max(2 * backoff.wait, 1u),
+                                      max_batch_backoff);
+              backoff.skip = backoff.wait;
+            }
+          }
+        }
       }
       else {
         LOG_INFO("backtest ran out of data");
@@ -234,22 +467,135 @@ void BacktestEventLoop::run_loop(Time upto)
       }
 
       if (!upto.empty() && upto < _current) {
+        run_batch_end_hooks();
+        lap(batch_end_slot);
         LOG_INFO("backtest reached end time -- backtest complete");
         break;
       }
     }
     catch (const std::exception & e) {
       LOG_ERROR("caught exception at backtest event loop: (" << demangle(typeid(e).name()) << ") " << e.what());
-      return; /* terminate event loop */
+      break; /* terminate event loop */
     }
     catch (...) {
       LOG_ERROR("caught unknown exception at backtest event loop");
-      return; /* terminate event loop */
+      break; /* terminate event loop */
+    }
+  }
+
+  _wall_end = std::chrono::steady_clock::now();
+  _complete = true;
+  report_progress(true);
+}
+
+
+/* Earliest next event of the sources other than `winner`, as keyed in the
+ * tree, or empty if none has an event.  These are the winners of the
+ * subtrees adjacent to the path from the winner to the root. */
+Time BacktestEventLoop::runner_up_time(size_t winner) const
+{
+  size_t best = npos;
+  for (size_t node = _tree_leaves + winner; node > 1; node /= 2)
+    best = tree_winner(best, _tree[node ^ 1]);
+  if (best == npos)
+    return {};
+  return _tree_keys[best];
+}
+
+
+/* Advance the clock to `t` within a batch, first running the batch-end hooks
+ * for the events at the current time.  Returns false if the hooks dispatched
+ * callbacks or added timers, which must be run before the event at `t`. */
+bool BacktestEventLoop::batch_advance(Time t, size_t slot)
+{
+  if (_batch_pending) {
+    lap(slot);
+    _batch_pending = false;
+    run_batch_end_hooks();
+    lap(batch_end_slot);
+    if (!_immediate.empty() || _timers_changed)
+      return false;
+  }
+  update_current_time(t);
+  return true;
+}
+
+
+void BacktestEventLoop::check_heartbeat()
+{
+  if (_progress_options.interval.count() == 0)
+    return;
+  auto now = std::chrono::steady_clock::now();
+  if (now >= _next_report) {
+    _next_report = now + _progress_options.interval;
+    report_progress(false);
+  }
+}
+
+
+size_t BacktestEventLoop::split_slot(const char* name)
+{
+  for (size_t i = 0; i < _split_names.size(); ++i)
+    if (std::string_view(_split_names[i]) == name)
+      return i;
+  _split_names.push_back(name);
+  _split_times.push_back(std::chrono::nanoseconds{0});
+  return _split_names.size() - 1;
+}
+
+
+void BacktestEventLoop::lap(size_t slot)
+{
+  if (_progress_options.time_split) {
+    auto now = std::chrono::steady_clock::now();
+    _split_times[slot] += now - _lap_start;
+    _lap_start = now;
+  }
+}
+
+
+void BacktestEventLoop::report_progress(bool complete)
+{
+  auto progress = this->progress();
+  if (complete)
+    LOG_INFO("backtest summary: " << progress);
+  else
+    LOG_INFO("backtest progress: " << progress);
+
+  if (_progress_options.callback) {
+    try {
+      _progress_options.callback(progress);
+    }
+    catch (const std::exception& e) {
+      LOG_WARN("backtest progress callback failed: " << e.what());
     }
   }
 }
 
 
+BacktestProgress BacktestEventLoop::progress() const
+{
+  BacktestProgress progress;
+  progress.events = _event_count;
+  progress.sim_start = _sim_start;
+  progress.sim_time = _current;
+  progress.complete = _complete;
+  if (_wall_start != std::chrono::steady_clock::time_point{})
+    progress.wall = (_complete ? _wall_end : std::chrono::steady_clock::now()) -
+                    _wall_start;
+  if (_progress_options.time_split)
+    for (size_t i = 0; i < _split_names.size(); ++i)
+      progress.time_split.emplace_back(_split_names[i], _split_times[i]);
+  return progress;
+}
+
+
+void BacktestEventLoop::set_progress_options(ProgressOptions options)
+{
+  _progress_options = std::move(options);
+}
+
+
 void BacktestEventLoop::set_time(Time start)
 {
   _from = start;
@@ -20,21 +20,96 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/EventLoop.hpp>
 #include <apex/util/Time.hpp>
 
+#include <chrono>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
 namespace apex
 {
 
 class BacktestTimers;
+class BacktestEventLoop;
+
+
+/* A run of events consumed by one source without returning to the event
+ * loop.  The source asks admit() before consuming each event; while no other
+ * source, timer or zero-delay callback is due first, the event is admitted,
+ * and the loop clock advanced to its time. */
+class BacktestBatch
+{
+public:
+  inline bool admit(Time t);
+
+private:
+  friend class BacktestEventLoop;
+
+  BacktestBatch(BacktestEventLoop& loop, Time bound, Time upto, size_t slot)
+    : _loop(loop), _bound(bound), _upto(upto), _slot(slot)
+  {
+  }
+
+  BacktestEventLoop& _loop;
+  Time _bound; // earliest event of any other source, or empty if none
+  Time _upto;
+  size_t _slot;
+};
 
 
 class BacktestEventSource {
 public:
   virtual Time get_next_event_time() = 0;
   virtual void consume_next_event() = 0;
+
+  /* Consume events for as long as `batch` admits them, returning the number
+   * consumed.  Sources override this to consume a run of events without a
+   * virtual call per event. */
+  virtual size_t consume_events(BacktestBatch& batch)
+  {
+    size_t count = 0;
+    for (Time t = get_next_event_time(); !t.empty() && batch.admit(t);
+         t = get_next_event_time()) {
+      consume_next_event();
+      ++count;
+    }
+    return count;
+  }
+
   virtual void init_backtest_time_range(Time start, Time end) = 0;
+
+  /* Name under which time spent consuming this source's events is reported
+   * in BacktestProgress::time_split; must be a string literal. */
+  virtual const char* event_source_kind() const { return "other"; }
+
   virtual ~BacktestEventSource() {}
 };
 
 
+/* Progress of a backtest event loop, as reported to the progress callback,
+ * by the heartbeat log, and at the end of the loop.  The time split is the
+ * wall time spent in each phase of the loop: "scheduling" is finding the
+ * next event, which for tick sources includes reading and decoding ahead;
+ * "dispatch" is the zero-delay callbacks, such as order routing and
+ * SimExchange fills; "batch_end" is the batch-end hooks; and the remainder is
+ * consuming events, by BacktestEventSource::event_source_kind, which includes
+ * the strategy callbacks made synchronously by each event. */
+struct BacktestProgress {
+  uint64_t events = 0;
+  Time sim_start;
+  Time sim_time;
+  std::chrono::nanoseconds wall{0};
+  std::vector<std::pair<std::string, std::chrono::nanoseconds>> time_split;
+  bool complete = false;
+
+  double events_per_sec() const;
+  double sim_speed() const; // simulated seconds per wall second
+};
+
+std::ostream& operator<<(std::ostream&, const BacktestProgress&);
+
+
 class BacktestEventLoop : public EventLoop
 {
 public:
@@ -42,8 +117,12 @@ public:
   ~BacktestEventLoop();
 
   void dispatch(std::function<void()> fn) override;
-  void dispatch(std::chrono::milliseconds interval,
-                EventLoop::timer_fn fn) override;
+  void dispatch(EventLoop::inline_fn fn) override;
+  TimerHandle dispatch(std::chrono::milliseconds interval,
+                       EventLoop::timer_fn fn) override;
+  TimerHandle dispatch(std::chrono::milliseconds interval,
+                       EventLoop::inline_timer_fn fn) override;
+  bool cancel_timer(TimerHandle) override;
 
   Time get_time() const { return _current; }
   void add_event_source(BacktestEventSource* source);
@@ -52,20 +131,121 @@ public:
 
   void set_time(Time start);
 
+  typedef std::function<void(const BacktestProgress&)> progress_fn;
+
+  struct ProgressOptions {
+    // wall interval of the heartbeat log and of the progress callback; zero
+    // disables both
+    std::chrono::milliseconds interval{std::chrono::seconds(30)};
+    bool time_split = true; // time each phase, at two clock reads per event
+    progress_fn callback;
+  };
+
+  void set_progress_options(ProgressOptions options);
+
+  /* Progress of the current, or the last completed, run_loop(). */
+  BacktestProgress progress() const;
+
+  /* Whether, after consuming an event, a source may go on to consume a run
+   * of events up to the next event of any other source, without a return
+   * to the loop per event; enabled by default.  The order of events, and of
+   * callbacks and hooks, is the same either way. */
+  void set_batching(bool enabled) { _batching = enabled; }
+
   BacktestEventLoop(const BacktestEventLoop&) = delete;
   BacktestEventLoop& operator=(const BacktestEventLoop&) = delete;
 
   bool this_thread_is_ev() const override { return true; }
 
 private:
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
   std::pair<Time, BacktestEventSource*> find_earliest();
   void update_current_time(Time t);
+  void drain_immediate();
+
+  void rebuild_tree();
+  void update_tree(size_t source);
+  size_t tree_winner(size_t a, size_t b) const;
+
+  size_t split_slot(const char* name);
+  void lap(size_t slot);
+  void report_progress(bool complete);
+  void check_heartbeat();
+
+  friend class BacktestBatch;
+  Time runner_up_time(size_t winner) const;
+  bool batch_advance(Time t, size_t slot);
 
   std::vector<BacktestEventSource*> _sources;
   std::vector<std::shared_ptr<BacktestEventSource>> _sp_sources;
+
+  // Tournament tree over all sources, keyed on their next event time, so that
+  // finding the earliest source is O(1) and re-keying a source is O(log n).
+  // Only the previous winner (which has since been consumed) and the timers
+  // (which any event can schedule) are re-keyed per event.  Leaves are stored
+  // at [_tree_leaves, 2*_tree_leaves), each internal node holds the index of
+  // the winning source of its subtree, or npos.
+  std::vector<BacktestEventSource*> _tree_sources;
+  std::vector<Time> _tree_keys;
+  std::vector<size_t> _tree;
+  size_t _tree_leaves = 0;
+  bool _tree_dirty = true;
   Time _current;
   std::unique_ptr<BacktestTimers> _timers;
   Time _from;
+
+  // zero-delay dispatches, and the next to invoke
+  std::vector<EventLoop::inline_fn> _immediate;
+  size_t _immediate_next = 0;
+
+  // batching; a batch ends once a timer is added, since the timer may be due
+  // before the next event of the batch
+  bool _batching = true;
+  bool _batch_pending = false;
+  bool _timers_changed = false;
+
+  // per tree source; after a batch consumes nothing, the next batches of the
+  // source are skipped, for an interval doubling up to max_batch_backoff
+  static constexpr uint32_t max_batch_backoff = 64;
+  struct BatchBackoff {
+    uint32_t skip = 0;
+    uint32_t wait = 0;
+  };
+  std::vector<BatchBackoff> _batch_backoff;
+
+  // progress; _split_names and _split_times are the time split slots, and
+  // _source_slot the slot of each tree source
+  ProgressOptions _progress_options;
+  uint64_t _event_count = 0;
+  Time _sim_start;
+  std::chrono::steady_clock::time_point _wall_start;
+  std::chrono::steady_clock::time_point _lap_start;
+  std::chrono::steady_clock::time_point _wall_end;
+  std::chrono::steady_clock::time_point _next_report;
+  std::vector<const char*> _split_names;
+  std::vector<std::chrono::nanoseconds> _split_times;
+  std::vector<size_t> _source_slot;
+  bool _complete = false;
 };
 
+
+bool BacktestBatch::admit(Time t)
+{
+  auto& loop = _loop;
+  if (!loop._immediate.empty() || loop._timers_changed || loop._tree_dirty)
+    return false;
+  if (!_bound.empty() && !(t < _bound))
+    return false;
+  if (!_upto.empty() && _upto < t)
+    return false;
+  if (t != loop._current && !loop.batch_advance(t, _slot))
+    return false;
+
+  loop._batch_pending = true;
+  if ((++loop._event_count & 1023) == 0)
+    loop.check_heartbeat();
+  return true;
+}
+
 }
@@ -17,7 +17,13 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace apex {
@@ -105,4 +111,195 @@ private:
 };
 
 
+
+/* Variant of BufferedFileReader that reads, and for a compressed file
+ * inflates, on a background thread, into a ring of chunk buffers, so that
+ * file IO overlaps with the parsing of the chunk already read.  The file is
+ * then only used by the background thread, which starts on the first read().
+ *
+ * A read() hands over the next filled chunk, rather than copying it.  The
+ * bytes not yet discarded, normally a partial record, are copied in front of
+ * the chunk, into headroom reserved for that, so that data() stays
+ * contiguous. */
+template <typename T>
+class AsyncBufferedFileReader {
+
+public:
+  explicit AsyncBufferedFileReader(T& file,
+                                   std::size_t chunk_size = 1024*1024,
+                                   std::size_t chunk_count = 3,
+                                   std::size_t headroom = 64*1024)
+    : _file(file),
+      _chunk_size(chunk_size),
+      _headroom(headroom),
+      _buffers(std::max<std::size_t>(chunk_count, 2))
+  {
+    for (std::size_t i = 0; i < _buffers.size(); i++) {
+      _buffers[i].resize(_headroom + _chunk_size);
+      _free.push_back(i);
+    }
+  }
+
+  ~AsyncBufferedFileReader() { stop(); }
+
+  AsyncBufferedFileReader(const AsyncBufferedFileReader&) = delete;
+  AsyncBufferedFileReader& operator=(const AsyncBufferedFileReader&) = delete;
+
+  /* Make the next chunk available, waiting for it if necessary, and return
+   * its size; zero once the file is exhausted.  Rethrows any exception from
+   * reading the file. */
+  std::size_t read() {
+    if (!_thread.joinable() && !_done)
+      _thread = std::thread([this]() { this->run(); });
+
+    Chunk chunk;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _cv.wait(lock, [this]() { return !_full.empty() || _done; });
+      if (_full.empty()) {
+        if (_error)
+          std::rethrow_exception(_error);
+        return 0;
+      }
+      chunk = _full.front();
+      _full.pop_front();
+    }
+
+    char* begin = _buffers[chunk.buffer].data() + _headroom;
+    const std::size_t carry = avail();
+    const std::size_t prev = _current;
+    if (carry <= _headroom) {
+      begin -= carry;
+      if (carry)
+        ::memcpy(begin, _head, carry);
+      _current = chunk.buffer;
+    }
+    else {
+      // too much to carry in front of the chunk, so join the two in a
+      // separate buffer
+      std::vector<char> joined(carry + chunk.size);
+      ::memcpy(joined.data(), _head, carry);
+      ::memcpy(joined.data() + carry, begin, chunk.size);
+      _spill.swap(joined);
+      begin = _spill.data();
+      _current = none;
+      release(chunk.buffer);
+    }
+    if (prev != none)
+      release(prev);
+
+    _head = begin;
+    _tail = begin + carry + chunk.size;
+    return chunk.size;
+  }
+
+  /* Stop the background thread and drop all buffered bytes, to be called
+   * before the file is repositioned; the next read() resumes from the file's
+   * new position. */
+  void reset() {
+    stop();
+    _full.clear();
+    _free.clear();
+    for (std::size_t i = 0; i < _buffers.size(); i++)
+      _free.push_back(i);
+    _current = none;
+    _head = _tail = nullptr;
+    _done = false;
+    _stop = false;
+    _error = nullptr;
+  }
+
+  T& file() { return _file; }
+
+  void discard(std::size_t len) { _head += len; }
+
+  char* data() { return _head; }
+
+  /* Number of bytes ready to be processed */
+  [[nodiscard]] std::size_t avail() const { return _tail - _head; }
+
+private:
+  static constexpr std::size_t none = static_cast<std::size_t>(-1);
+
+  struct Chunk {
+    std::size_t buffer = none;
+    std::size_t size = 0;
+  };
+
+  void release(std::size_t buffer) {
+    {
+      auto lock = std::scoped_lock(_mutex);
+      _free.push_back(buffer);
+    }
+    _cv.notify_all();
+  }
+
+  void stop() {
+    {
+      auto lock = std::scoped_lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    if (_thread.joinable())
+      _thread.join();
+  }
+
+  void run() {
+    try {
+      while (true) {
+        std::size_t buffer;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _cv.wait(lock, [this]() { return _stop || !_free.empty(); });
+          if (_stop)
+            return;
+          buffer = _free.back();
+          _free.pop_back();
+        }
+
+        // read outside of the lock
+        std::size_t nread = 0;
+        if (_file.is_open() && !_file.is_eof())
+          nread = _file.read(_buffers[buffer].data() + _headroom, _chunk_size);
+
+        auto lock = std::scoped_lock(_mutex);
+        if (nread == 0) {
+          _free.push_back(buffer);
+          _done = true;
+          _cv.notify_all();
+          return;
+        }
+        _full.push_back({buffer, nread});
+        _cv.notify_all();
+      }
+    }
+    catch (...) {
+      auto lock = std::scoped_lock(_mutex);
+      _error = std::current_exception();
+      _done = true;
+      _cv.notify_all();
+    }
+  }
+
+  T& _file;
+  const std::size_t _chunk_size;
+  const std::size_t _headroom;
+  std::vector<std::vector<char>> _buffers;
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::deque<Chunk> _full;
+  std::vector<std::size_t> _free;
+  bool _done = false;
+  bool _stop = false;
+  std::exception_ptr _error;
+  std::thread _thread;
+
+  // owned by the consumer: the buffer holding data(), or none if _spill
+  std::size_t _current = none;
+  std::vector<char> _spill;
+  char * _head = nullptr;
+  char * _tail = nullptr;
+};
+
 }
@@ -99,6 +99,11 @@ Config Config::get_sub_config(const std::string& field, Config default_value)
 
 bool Config::is_empty() const { return _raw.empty(); }
 
+bool Config::contains(const std::string& field) const
+{
+  return _raw.is_object() && _raw.find(field) != _raw.end();
+}
+
 bool Config::is_array() const { return _raw.is_array(); }
 
 Config Config::array_item(size_t i)
@@ -72,10 +72,15 @@ public:
   uint64_t get_uint(const std::string& field);
   uint64_t get_uint(const std::string& field, uint64_t default_value);
 
+  /** Test whether this config object has the named field. */
+  [[nodiscard]] bool contains(const std::string& field) const;
+
   void dump();
 
   const std::string& path() { return _path; }
 
+  [[nodiscard]] const json& raw() const { return _raw; }
+
   [[nodiscard]] bool is_array() const;
   [[nodiscard]] bool is_empty() const;
 
@@ -0,0 +1,144 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/CpuDispatch.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <ostream>
+
+namespace apex
+{
+
+const char* to_string(Isa isa)
+{
+  switch (isa) {
+    case Isa::scalar:
+      return "scalar";
+    case Isa::sse2:
+      return "sse2";
+    case Isa::avx2:
+      return "avx2";
+    case Isa::avx512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+
+static CpuFeatures detect_features()
+{
+  CpuFeatures features;
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init();
+  features.sse2 = __builtin_cpu_supports("sse2");
+  features.sse42 = __builtin_cpu_supports("sse4.2");
+  features.avx = __builtin_cpu_supports("avx");
+  features.avx2 = __builtin_cpu_supports("avx2");
+  features.bmi2 = __builtin_cpu_supports("bmi2");
+  features.avx512f = __builtin_cpu_supports("avx512f");
+  features.avx512bw = __builtin_cpu_supports("avx512bw");
+  features.avx512vl = __builtin_cpu_supports("avx512vl");
+
+  if (features.avx512f && features.avx512bw && features.avx512vl)
+    features.best = Isa::avx512;
+  else if (features.avx2)
+    features.best = Isa::avx2;
+  else if (features.sse2)
+    features.best = Isa::sse2;
+#endif
+  return features;
+}
+
+
+const CpuFeatures& cpu_features()
+{
+  static const CpuFeatures features = detect_features();
+  return features;
+}
+
+
+std::ostream& operator<<(std::ostream& os, const CpuFeatures& features)
+{
+  const std::pair<const char*, bool> flags[] = {
+      {"sse2", features.sse2},         {"sse4.2", features.sse42},
+      {"avx", features.avx},           {"avx2", features.avx2},
+      {"bmi2", features.bmi2},         {"avx512f", features.avx512f},
+      {"avx512bw", features.avx512bw}, {"avx512vl", features.avx512vl}};
+  const char* sep = "";
+  for (auto& [name, present] : flags)
+    if (present) {
+      os << sep << name;
+      sep = ",";
+    }
+  if (!*sep)
+    os << "none";
+  return os;
+}
+
+
+static Isa select_dispatch_isa()
+{
+  Isa isa = cpu_features().best;
+  if (const char* limit = std::getenv("APEX_MAX_ISA")) {
+    for (auto level : {Isa::scalar, Isa::sse2, Isa::avx2, Isa::avx512})
+      if (std::strcmp(limit, to_string(level)) == 0 && level < isa)
+        isa = level;
+  }
+  return isa;
+}
+
+
+Isa dispatch_isa()
+{
+  static const Isa isa = select_dispatch_isa();
+  return isa;
+}
+
+
+namespace
+{
+struct KernelRegistry {
+  std::mutex mutex;
+  std::vector<KernelSelection> selections;
+};
+
+KernelRegistry& registry()
+{
+  static KernelRegistry instance;
+  return instance;
+}
+} // namespace
+
+
+void record_kernel(const char* kernel, Isa isa)
+{
+  auto& reg = registry();
+  auto lock = std::scoped_lock(reg.mutex);
+  reg.selections.push_back({kernel, isa});
+}
+
+
+std::vector<KernelSelection> kernel_selections()
+{
+  auto& reg = registry();
+  auto lock = std::scoped_lock(reg.mutex);
+  return reg.selections;
+}
+
+} // namespace apex
@@ -0,0 +1,96 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <initializer_list>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+/* Instruction set levels of SIMD kernels, lowest first; avx512 is taken to
+ * mean the F, BW and VL subsets. */
+enum class Isa : int { scalar, sse2, avx2, avx512 };
+
+const char* to_string(Isa);
+
+/* SIMD features of the host CPU, detected once. */
+struct CpuFeatures {
+  bool sse2 = false;
+  bool sse42 = false;
+  bool avx = false;
+  bool avx2 = false;
+  bool bmi2 = false;
+  bool avx512f = false;
+  bool avx512bw = false;
+  bool avx512vl = false;
+
+  Isa best = Isa::scalar; // highest level fully supported
+};
+
+std::ostream& operator<<(std::ostream&, const CpuFeatures&);
+
+const CpuFeatures& cpu_features();
+
+/* Level that kernels are dispatched to: the best of the host, unless lowered
+ * by the environment variable APEX_MAX_ISA, set to the name of a level, e.g.
+ * to compare kernels, or to keep a host from AVX-512 frequency throttling. */
+Isa dispatch_isa();
+
+
+/* A kernel implementation and the level it requires. */
+template <typename Fn> struct KernelVariant {
+  Isa isa;
+  Fn fn;
+};
+
+/* Choice made for a kernel, as listed by kernel_selections. */
+struct KernelSelection {
+  std::string kernel;
+  Isa isa;
+};
+
+void record_kernel(const char* kernel, Isa);
+
+/* Kernels selected so far, in order of selection. */
+std::vector<KernelSelection> kernel_selections();
+
+/* Pick the first of `variants`, listed best first, that the dispatch level
+ * allows, and record the choice under the kernel's name; the list should end
+ * with a scalar variant.  A kernel resolves its function pointer once, and
+ * resolves it during static initialisation (see CsvScan.cpp), so that each
+ * call is then a plain indirect call, and the choice is known by the time
+ * Logger::log_banner reports it. */
+template <typename Fn>
+KernelVariant<Fn> select_kernel(const char* kernel,
+                                std::initializer_list<KernelVariant<Fn>> variants)
+{
+  const Isa limit = dispatch_isa();
+  const KernelVariant<Fn>* chosen = nullptr;
+  for (auto& variant : variants) {
+    chosen = &variant;
+    if (variant.isa <= limit)
+      break;
+  }
+  record_kernel(kernel, chosen->isa);
+  return *chosen;
+}
+
+} // namespace apex
@@ -0,0 +1,159 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/CsvScan.hpp>
+#include <apex/util/CpuDispatch.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define APEX_CSV_X86
+#endif
+
+namespace apex::csv
+{
+
+namespace
+{
+
+struct Splitter {
+  char* start;
+  char** fields;
+  std::size_t count = 0;
+  std::size_t limit;
+
+  // record a delimiter found at `p`; returns false once scanning should stop
+  bool found(char* p)
+  {
+    *p = '\0';
+    if (count < limit)
+      fields[count] = start;
+    start = p + 1;
+    return ++count < limit + 1;
+  }
+};
+
+
+std::size_t scan_scalar(char* ptr, char* end, char delim, Splitter& s)
+{
+  for (; ptr < end; ++ptr)
+    if (*ptr == delim && !s.found(ptr))
+      break;
+  return s.count;
+}
+
+
+#ifdef APEX_CSV_X86
+
+// Each ISA variant searches a block of bytes at a time; each set bit of the
+// comparison mask is a delimiter, taken in order of position.  The scalar scan
+// then completes the tail.  The loops are written out per variant, because AVX2
+// intrinsics can only be used directly within a target("avx2") function.
+
+__attribute__((target("avx2")))
+std::size_t scan_avx2(char* ptr, char* end, char delim, Splitter& s);
+
+
+__attribute__((target("avx512f,avx512bw")))
+std::size_t scan_avx512(char* ptr, char* end, char delim, Splitter& s)
+{
+  const __m512i needle = _mm512_set1_epi8(delim);
+  for (; end - ptr >= 64; ptr += 64) {
+    __m512i bytes = _mm512_loadu_si512(ptr);
+    uint64_t mask = _mm512_cmpeq_epi8_mask(bytes, needle);
+    for (; mask; mask &= mask - 1)
+      if (!s.found(ptr + __builtin_ctzll(mask)))
+        return s.count;
+  }
+  return scan_avx2(ptr, end, delim, s);
+}
+
+
+__attribute__((target("avx2")))
+std::size_t scan_avx2(char* ptr, char* end, char delim, Splitter& s)
+{
+  const __m256i needle = _mm256_set1_epi8(delim);
+  for (; end - ptr >= 32; ptr += 32) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+    auto mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, needle)));
+    for (; mask; mask &= mask - 1)
+      if (!s.found(ptr + __builtin_ctz(mask)))
+        return s.count;
+  }
+  return scan_scalar(ptr, end, delim, s);
+}
+
+
+std::size_t scan_sse2(char* ptr, char* end, char delim, Splitter& s)
+{
+  const __m128i needle = _mm_set1_epi8(delim);
+  for (; end - ptr >= 16; ptr += 16) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    auto mask = static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, needle)));
+    for (; mask; mask &= mask - 1)
+      if (!s.found(ptr + __builtin_ctz(mask)))
+        return s.count;
+  }
+  return scan_scalar(ptr, end, delim, s);
+}
+
+#endif
+
+
+using ScanFn = std::size_t (*)(char*, char*, char, Splitter&);
+
+
+const KernelVariant<ScanFn>& kernel()
+{
+  static const auto selected = select_kernel<ScanFn>(
+      "csv_split",
+      {
+#ifdef APEX_CSV_X86
+          {Isa::avx512, scan_avx512},
+          {Isa::avx2, scan_avx2},
+          {Isa::sse2, scan_sse2},
+#endif
+          {Isa::scalar, scan_scalar}});
+  return selected;
+}
+
+// resolved while the program loads
+[[maybe_unused]] const auto& resolved_kernel = kernel();
+
+} // namespace
+
+
+std::size_t split_fields(char* begin, char* end, char delim, char** fields,
+                         std::size_t max_fields)
+{
+  Splitter s{begin, fields, 0, max_fields};
+  return kernel().fn(begin, end, delim, s);
+}
+
+
+std::size_t split_fields_scalar(char* begin, char* end, char delim,
+                                char** fields, std::size_t max_fields)
+{
+  Splitter s{begin, fields, 0, max_fields};
+  return scan_scalar(begin, end, delim, s);
+}
+
+
+const char* split_fields_isa() { return to_string(kernel().isa); }
+
+} // namespace apex::csv
@@ -0,0 +1,101 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace apex::csv
+{
+
+/* Split the text [begin, end) into fields at each `delim` byte, overwriting
+ * each delimiter with a null character so that fields can be read as C
+ * strings.  Text after the final delimiter is not a field; callers wanting the
+ * whole range split should ensure it ends in a delimiter.  Field starts are
+ * written to `fields`, and the number of fields found is returned; scanning
+ * stops once `max_fields` + 1 delimiters are found, so a return value greater
+ * than `max_fields` indicates too many fields.  The delimiter search uses the
+ * best of AVX-512, AVX2 and SSE2 the host has; see CpuDispatch. */
+std::size_t split_fields(char* begin, char* end, char delim, char** fields,
+                         std::size_t max_fields);
+
+/* Byte-at-a-time version of split_fields, having the same results. */
+std::size_t split_fields_scalar(char* begin, char* end, char delim,
+                                char** fields, std::size_t max_fields);
+
+/* Name of the instruction set used by split_fields. */
+const char* split_fields_isa();
+
+
+/* Parse a null terminated plain decimal, like "-1234.5678", as found in
+ * exchange price & quantity fields.  The result is identical to strtod, and is
+ * obtained from a single exact division.  Returns false if the text is not of
+ * that form, or has more than 15 significant digits, in which case the caller
+ * should fall back to strtod. */
+inline bool parse_decimal(const char* s, double& value)
+{
+  static constexpr double pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                     1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15};
+  const char* p = s;
+  bool negative = (*p == '-');
+  if (negative)
+    ++p;
+
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int fraction = 0;
+  while (*p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10 + (*p++ - '0');
+    ++digits;
+  }
+  if (*p == '.') {
+    ++p;
+    while (*p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10 + (*p++ - '0');
+      ++digits;
+      ++fraction;
+    }
+  }
+
+  // digits are limited, so that the mantissa is exactly representable
+  if (*p != '\0' || digits == 0 || digits > 15)
+    return false;
+
+  value = static_cast<double>(mantissa) / pow10[fraction];
+  if (negative)
+    value = -value;
+  return true;
+}
+
+
+/* Parse a null terminated, unsigned decimal integer, without overflow
+ * detection beyond a limit of 19 digits.  Returns false on any other text. */
+inline bool parse_uint(const char* s, uint64_t& value)
+{
+  uint64_t result = 0;
+  int digits = 0;
+  for (; *s >= '0' && *s <= '9'; ++s, ++digits)
+    result = result * 10 + (*s - '0');
+  if (*s != '\0' || digits == 0 || digits > 19)
+    return false;
+  value = result;
+  return true;
+}
+
+} // namespace apex::csv
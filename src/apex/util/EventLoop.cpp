@@ -15,4 +15,49 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <apex/util/EventLoop.hpp>
\ No newline at end of file
+#include <apex/util/EventLoop.hpp>
+namespace apex
+{
+
+size_t EventLoop::add_batch_end_hook(std::function<void()> fn)
+{
+  std::lock_guard<std::mutex> guard(_hooks_mutex);
+  auto hooks = _hooks ? std::make_shared<hook_list>(*_hooks)
+                      : std::make_shared<hook_list>();
+  const size_t id = _next_hook_id++;
+  hooks->push_back({id, std::move(fn)});
+  _hooks = std::move(hooks);
+  _has_hooks.store(true, std::memory_order_release);
+  return id;
+}
+
+
+void EventLoop::remove_batch_end_hook(size_t id)
+{
+  std::lock_guard<std::mutex> guard(_hooks_mutex);
+  if (!_hooks)
+    return;
+  auto hooks = std::make_shared<hook_list>();
+  for (auto& item : *_hooks)
+    if (item.first != id)
+      hooks->push_back(item);
+  _has_hooks.store(!hooks->empty(), std::memory_order_release);
+  _hooks = std::move(hooks);
+}
+
+
+void EventLoop::run_batch_end_hooks()
+{
+  if (!_has_hooks.load(std::memory_order_acquire))
+    return;
+
+  std::shared_ptr<const hook_list> hooks;
+  {
+    std::lock_guard<std::mutex> guard(_hooks_mutex);
+    hooks = _hooks;
+  }
+  for (auto& item : *hooks)
+    item.second();
+}
+
+} // namespace apex
@@ -17,10 +17,17 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <apex/util/InlineFunction.hpp>
+#include <apex/util/TimerWheel.hpp>
+
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <vector>
 
 namespace apex
 {
@@ -34,17 +41,59 @@ public:
    * the timer function, or 0 if the function should not be invoked again. */
   typedef std::function<std::chrono::milliseconds()> timer_fn;
 
+  /* Allocation-free alternatives to std::function, for hot dispatch sites.
+   * Captures larger than the inline capacity fail to compile; the capacity is
+   * chosen to admit a weak_ptr plus a decoded, latency traced tick. */
+  static constexpr size_t inline_capacity = 128;
+  typedef InlineFunction<void(), inline_capacity> inline_fn;
+  typedef InlineFunction<std::chrono::milliseconds(), inline_capacity>
+      inline_timer_fn;
+
   virtual ~EventLoop() {}
 
   /** Post a function object that is later invoked on the event thread. */
   virtual void dispatch(std::function<void()> fn) = 0;
 
-  /** Post a timer function which is invoked after the elapsed time. */
-  virtual void dispatch(std::chrono::milliseconds, timer_fn fn) = 0;
+  /** As above, but without heap allocation of the function object. */
+  virtual void dispatch(inline_fn fn) = 0;
+
+  /** Post a timer function which is invoked after the elapsed time.  The
+   * returned handle can be used to cancel the timer, and remains valid for
+   * each repeat of the timer. */
+  virtual TimerHandle dispatch(std::chrono::milliseconds, timer_fn fn) = 0;
+  virtual TimerHandle dispatch(std::chrono::milliseconds,
+                               inline_timer_fn fn) = 0;
+
+  /** Cancel a timer, returning false if it has already completed or been
+   * cancelled.  Must be called on the event thread. */
+  virtual bool cancel_timer(TimerHandle) = 0;
 
   virtual void sync_stop() {};
 
   virtual bool this_thread_is_ev() const = 0;
+
+  /** Register a function to be invoked on the event thread at the end of each
+   * batch of events, i.e. once the currently pending events have been
+   * processed.  Allows a consumer to react once per burst rather than once per
+   * event.  Returns an id for use with remove_batch_end_hook.  Can be called
+   * from any thread. */
+  size_t add_batch_end_hook(std::function<void()> fn);
+  void remove_batch_end_hook(size_t id);
+
+protected:
+  /** Invoke the batch-end hooks; called by implementations on the event
+   * thread.  Exceptions thrown by a hook are propagated. */
+  void run_batch_end_hooks();
+
+private:
+  typedef std::vector<std::pair<size_t, std::function<void()>>> hook_list;
+
+  // copy-on-write, so that hooks are invoked without holding the mutex, and
+  // can themselves add or remove hooks
+  std::mutex _hooks_mutex;
+  std::shared_ptr<const hook_list> _hooks;
+  std::atomic<bool> _has_hooks{false};
+  size_t _next_hook_id = 1;
 };
 
 }
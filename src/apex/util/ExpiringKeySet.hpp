@@ -0,0 +1,102 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/OpenAddressMap.hpp>
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace apex
+{
+
+/* Set of non-zero 64-bit keys that are forgotten after a retention period.
+ * Keys are held in a ring of generations, each covering an equal slice of
+ * time; when the ring turns, the oldest generation is cleared as a whole, so
+ * there is no per-key expiry work.  A key is kept for at least the retention
+ * period, and at most one slice longer.  Cleared generations keep their
+ * tables, so memory stays flat once the insert rate is steady. */
+class ExpiringKeySet
+{
+public:
+  explicit ExpiringKeySet(std::chrono::microseconds retention,
+                          size_t generations = 4)
+    : _slice(retention / (generations > 1 ? generations - 1 : 1)),
+      _generations(generations > 1 ? generations : 2)
+  {
+  }
+
+  void insert(uint64_t key, Time now)
+  {
+    advance(now);
+    _generations[_current].insert(key, true);
+  }
+
+  [[nodiscard]] bool contains(uint64_t key, Time now)
+  {
+    advance(now);
+    for (auto& gen : _generations)
+      if (gen.find(key))
+        return true;
+    return false;
+  }
+
+  [[nodiscard]] size_t size() const
+  {
+    size_t n = 0;
+    for (auto& gen : _generations)
+      n += gen.size();
+    return n;
+  }
+
+  [[nodiscard]] size_t bytes() const
+  {
+    size_t n = 0;
+    for (auto& gen : _generations)
+      n += gen.bytes();
+    return n;
+  }
+
+private:
+  void advance(Time now)
+  {
+    auto t = now.as_epoch_us();
+    if (_slice_end.count() == 0) {
+      _slice_end = t + _slice;
+      return;
+    }
+
+    // turn the ring once per elapsed slice, but no more than once around
+    for (size_t i = 0; t >= _slice_end && i < _generations.size(); i++) {
+      _current = (_current + 1) % _generations.size();
+      _generations[_current].clear();
+      _slice_end += _slice;
+    }
+    if (t >= _slice_end)
+      _slice_end = t + _slice;
+  }
+
+  std::chrono::microseconds _slice;
+  std::chrono::microseconds _slice_end{0};
+  std::vector<OpenAddressMap<bool>> _generations;
+  size_t _current = 0;
+};
+
+} // namespace apex
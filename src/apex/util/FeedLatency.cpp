@@ -0,0 +1,82 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/util/FeedLatency.hpp>
+
+#include <algorithm>
+
+namespace apex
+{
+
+FeedLatency::FeedLatency(size_t window) : _window(std::max<size_t>(window, 1))
+{
+  _samples.reserve(_window);
+}
+
+
+std::chrono::microseconds FeedLatency::record(Time event_time, Time local_time)
+{
+  Sample sample{local_time.as_epoch_us().count(),
+                (local_time.as_epoch_us() - event_time.as_epoch_us()).count()};
+  if (_samples.size() < _window)
+    _samples.push_back(sample);
+  else
+    _samples[_next] = sample;
+  _next = (_next + 1) % _window;
+  return std::chrono::microseconds(sample.lag_us);
+}
+
+
+FeedLatency::Stats FeedLatency::stats() const
+{
+  Stats stats;
+  const size_t n = _samples.size();
+  if (n == 0)
+    return stats;
+  stats.samples = n;
+
+  std::vector<int64_t> lags;
+  lags.reserve(n);
+  for (auto& sample : _samples)
+    lags.push_back(sample.lag_us);
+  auto at = [&](double q) {
+    auto k = std::min(n - 1, static_cast<size_t>(q * n));
+    std::nth_element(lags.begin(), lags.begin() + k, lags.end());
+    return lags[k];
+  };
+  stats.median_us = at(0.5);
+  stats.p99_us = at(0.99);
+  stats.min_us = *std::min_element(lags.begin(), lags.end());
+
+  // slope of lag against local time, relative to the first sample so that
+  // the sums keep their precision
+  const int64_t origin = _samples[0].local_us;
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (auto& sample : _samples) {
+    double x = (sample.local_us - origin) / 1e6;
+    double y = static_cast<double>(sample.lag_us);
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double denom = n * sxx - sx * sx;
+  if (n > 1 && denom > 0)
+    stats.drift_us_per_sec = (n * sxy - sx * sy) / denom;
+  return stats;
+}
+
+} // namespace apex
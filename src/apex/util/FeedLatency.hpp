@@ -0,0 +1,72 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace apex
+{
+
+/* Rolling statistics of the lag of a feed: the local receive time of each
+ * event less its exchange event time, over the most recent events.  The lag
+ * is the route latency plus the skew of the exchange clock, so its minimum
+ * tracks the skew, and its drift, the trend of the lag over the window,
+ * shows a clock running away or a route slowing down.
+ *
+ * Not thread safe; events are recorded, and statistics taken, on one
+ * thread. */
+class FeedLatency
+{
+public:
+  static constexpr size_t default_window = 1024;
+
+  explicit FeedLatency(size_t window = default_window);
+
+  /* Record an event, returning its lag, which is negative if the exchange
+   * clock is ahead. */
+  std::chrono::microseconds record(Time event_time, Time local_time);
+
+  struct Stats {
+    size_t samples = 0;
+    int64_t median_us = 0;
+    int64_t p99_us = 0;
+    int64_t min_us = 0;
+    double drift_us_per_sec = 0; // least squares slope of lag over time
+  };
+
+  /* Statistics of the events in the window; all zero if none. */
+  [[nodiscard]] Stats stats() const;
+
+  [[nodiscard]] size_t size() const { return _samples.size(); }
+
+private:
+  struct Sample {
+    int64_t local_us;
+    int64_t lag_us;
+  };
+
+  size_t _window;
+  std::vector<Sample> _samples; // ring, once full
+  size_t _next = 0;
+};
+
+} // namespace apex
@@ -0,0 +1,129 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/Error.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace apex
+{
+
+/* String of at most N characters, held inline.  Its layout is trivially
+ * copyable, so structs holding it are copied with a memcpy and no
+ * allocation.  Construction from a longer string throws.  Conversion to
+ * std::string_view is implicit; to std::string, which allocates, it is by
+ * str(), so is visible at the wire and JSON boundaries that need it. */
+template <size_t N> class FixedString
+{
+  static_assert(N > 0 && N < 256, "FixedString size must fit its length byte");
+
+  template <typename T>
+  static constexpr bool is_other_string =
+      std::is_convertible_v<const T&, std::string_view> &&
+      !std::is_same_v<T, FixedString>;
+
+public:
+  static constexpr size_t capacity = N;
+
+  FixedString() = default;
+
+  FixedString(std::string_view s) { assign(s); }
+  FixedString(const std::string& s) { assign(s); }
+  FixedString(const char* s) { assign(s); }
+
+  FixedString& operator=(std::string_view s)
+  {
+    assign(s);
+    return *this;
+  }
+  FixedString& operator=(const std::string& s)
+  {
+    assign(s);
+    return *this;
+  }
+  FixedString& operator=(const char* s)
+  {
+    assign(s);
+    return *this;
+  }
+
+  void assign(std::string_view s)
+  {
+    if (s.size() > N)
+      THROW("string too long for FixedString<" << N << ">: '" << s << "'");
+    std::memcpy(_data, s.data(), s.size());
+    std::memset(_data + s.size(), 0, N + 1 - s.size());
+    _size = static_cast<uint8_t>(s.size());
+  }
+
+  [[nodiscard]] const char* data() const { return _data; }
+  [[nodiscard]] const char* c_str() const { return _data; }
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] size_t length() const { return _size; }
+  [[nodiscard]] bool empty() const { return _size == 0; }
+  void clear() { assign({}); }
+
+  [[nodiscard]] std::string_view view() const { return {_data, _size}; }
+  [[nodiscard]] std::string str() const { return {_data, _size}; }
+  operator std::string_view() const { return view(); }
+
+  // comparisons with other strings take them as they are, rather than by
+  // conversion to FixedString, which could throw; the reversed forms are
+  // those rewritten by the compiler
+  friend bool operator==(const FixedString& lhs, const FixedString& rhs)
+  {
+    return lhs.view() == rhs.view();
+  }
+  friend bool operator!=(const FixedString& lhs, const FixedString& rhs)
+  {
+    return lhs.view() != rhs.view();
+  }
+  template <typename T, typename = std::enable_if_t<is_other_string<T>>>
+  friend bool operator==(const FixedString& lhs, const T& rhs)
+  {
+    return lhs.view() == std::string_view(rhs);
+  }
+  template <typename T, typename = std::enable_if_t<is_other_string<T>>>
+  friend bool operator!=(const FixedString& lhs, const T& rhs)
+  {
+    return lhs.view() != std::string_view(rhs);
+  }
+  friend bool operator<(const FixedString& lhs, const FixedString& rhs)
+  {
+    return lhs.view() < rhs.view();
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const FixedString& s)
+  {
+    return os << s.view();
+  }
+
+private:
+  // trailing bytes are zeroed, so the string is terminated and copies of
+  // equal strings are bitwise equal
+  char _data[N + 1] = {};
+  uint8_t _size = 0;
+};
+
+} // namespace apex
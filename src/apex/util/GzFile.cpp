@@ -16,17 +16,328 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/util/GzFile.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
 
 #include <zlib.h>
 
+#ifdef APEX_HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+
 namespace apex {
 
+namespace {
+
+constexpr size_t window_size = 32768; // deflate history
+constexpr size_t input_size = 1 << 18;
+
+constexpr char index_magic[8] = {'A', 'P', 'X', 'G', 'Z', 'I', '1', '\0'};
+
+#ifdef APEX_HAVE_LIBDEFLATE
+// files up to this compressed size are inflated whole by libdeflate
+constexpr uint64_t whole_file_max = 64 << 20;
+#endif
+
+struct IndexHeader {
+  char magic[8];
+  uint64_t file_size; // size and modification time of the gzip file, which
+  int64_t mtime;      // detect a stale index
+  uint64_t count;
+};
+
+struct IndexEntry {
+  uint64_t out;  // uncompressed offset
+  uint64_t in;   // compressed offset of the first whole byte
+  uint32_t bits; // bits of the byte before `in` still to be inflated
+  uint32_t pad;
+  // followed by the window_size bytes of output preceding `out`
+};
+
+}
+
 
 struct GzFileImpl
 {
-  gzFile file = nullptr;
+  struct Point {
+    uint64_t out;
+    uint64_t in;
+    uint32_t bits;
+  };
+
+  std::FILE* file = nullptr;
+  std::filesystem::path path;
+  GzFile::Options options;
+  uint64_t file_size = 0;
+  int64_t mtime = 0;
+
+  z_stream strm{};
+  bool strm_init = false;
+  bool raw = false;  // resumed at an access point, so inflating bare deflate
+  bool copy = false; // not gzip, so read as is, as gzread does
+  bool eof = false;
+  std::vector<unsigned char> input;
+  uint64_t in_total = 0;
+  uint64_t out_total = 0;
+
+  // access points; their windows are left in the sidecar until a seek
+  std::vector<Point> points;
+  bool index_complete = false;
+
+  // while the index is built, the sidecar is written to a temporary file
+  std::FILE* building = nullptr;
+  std::filesystem::path building_path;
+  std::vector<unsigned char> history; // ring of the latest output
+  size_t history_pos = 0;
+  uint64_t last_point = 0;
+
+  // libdeflate: the whole file, inflated
+  bool whole_mode = false;
+  std::vector<char> whole;
 };
 
+
+std::filesystem::path gz_index_path(const std::filesystem::path& fn)
+{
+  auto path = fn;
+  path += ".gzi";
+  return path;
+}
+
+
+static bool fill_input(GzFileImpl& h)
+{
+  auto n = std::fread(h.input.data(), 1, h.input.size(), h.file);
+  h.in_total += n;
+  h.strm.next_in = h.input.data();
+  h.strm.avail_in = static_cast<uInt>(n);
+  return n > 0;
+}
+
+
+static bool load_index(GzFileImpl& h)
+{
+  auto fn = gz_index_path(h.path);
+  std::error_code err;
+  auto size = std::filesystem::file_size(fn, err);
+  if (err)
+    return false;
+
+  std::FILE* f = std::fopen(fn.c_str(), "rb");
+  if (!f)
+    return false;
+
+  // only an index of this very file, and complete, is used
+  IndexHeader header;
+  bool ok = std::fread(&header, sizeof(header), 1, f) == 1 &&
+            memcmp(header.magic, index_magic, sizeof(index_magic)) == 0 &&
+            header.file_size == h.file_size && header.mtime == h.mtime &&
+            size == sizeof(header) +
+                        header.count * (sizeof(IndexEntry) + window_size);
+  for (uint64_t i = 0; ok && i < header.count; i++) {
+    IndexEntry entry;
+    ok = std::fread(&entry, sizeof(entry), 1, f) == 1 && entry.bits < 8 &&
+         entry.in < h.file_size &&
+         (h.points.empty() || entry.out > h.points.back().out) &&
+         std::fseek(f, window_size, SEEK_CUR) == 0;
+    if (ok)
+      h.points.push_back({entry.out, entry.in, entry.bits});
+  }
+  std::fclose(f);
+
+  if (!ok)
+    h.points.clear();
+  LOG_DEBUG("gzip index " << (ok ? "loaded" : "ignored") << ", "
+            << h.points.size() << " access points, file " << fn);
+  return ok;
+}
+
+
+static void abandon_index(GzFileImpl& h)
+{
+  if (h.building) {
+    std::fclose(h.building);
+    h.building = nullptr;
+    std::error_code err;
+    std::filesystem::remove(h.building_path, err);
+  }
+  h.points.clear();
+}
+
+
+static void start_index(GzFileImpl& h)
+{
+  // a private temporary file, renamed into place once complete, so that
+  // concurrent readers never see a partial index
+  h.building_path = gz_index_path(h.path);
+  h.building_path +=
+      ".tmp." + std::to_string(::getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+  h.building = std::fopen(h.building_path.c_str(), "wb");
+  if (!h.building) {
+    LOG_DEBUG("cannot write gzip index " << h.building_path << ": "
+                                         << strerror(errno));
+    return;
+  }
+
+  IndexHeader header{};
+  if (std::fwrite(&header, sizeof(header), 1, h.building) != 1) {
+    abandon_index(h);
+    return;
+  }
+  h.history.assign(window_size, 0);
+  h.history_pos = 0;
+  h.last_point = 0;
+}
+
+
+static void finish_index(GzFileImpl& h)
+{
+  // an index without access points would save nothing
+  if (h.points.empty()) {
+    abandon_index(h);
+    return;
+  }
+
+  IndexHeader header{};
+  memcpy(header.magic, index_magic, sizeof(index_magic));
+  header.file_size = h.file_size;
+  header.mtime = h.mtime;
+  header.count = h.points.size();
+  bool ok = std::fseek(h.building, 0, SEEK_SET) == 0 &&
+            std::fwrite(&header, sizeof(header), 1, h.building) == 1;
+  ok = (std::fclose(h.building) == 0) && ok;
+  h.building = nullptr;
+
+  std::error_code err;
+  if (ok)
+    std::filesystem::rename(h.building_path, gz_index_path(h.path), err);
+  if (!ok || err) {
+    std::filesystem::remove(h.building_path, err);
+    h.points.clear();
+    return;
+  }
+
+  h.index_complete = true;
+  LOG_DEBUG("gzip index written, " << h.points.size() << " access points, file "
+            << gz_index_path(h.path));
+}
+
+
+static void record_history(GzFileImpl& h, const unsigned char* p, size_t n)
+{
+  if (n >= window_size) {
+    memcpy(h.history.data(), p + n - window_size, window_size);
+    h.history_pos = 0;
+    return;
+  }
+  size_t first = std::min(n, window_size - h.history_pos);
+  memcpy(h.history.data() + h.history_pos, p, first);
+  memcpy(h.history.data(), p + first, n - first);
+  h.history_pos = (h.history_pos + n) % window_size;
+}
+
+
+static void add_point(GzFileImpl& h)
+{
+  IndexEntry entry{};
+  entry.out = h.out_total;
+  entry.in = h.in_total - h.strm.avail_in;
+  entry.bits = h.strm.data_type & 7;
+
+  // the window, oldest byte first
+  const auto* ring = h.history.data();
+  bool ok =
+      std::fwrite(&entry, sizeof(entry), 1, h.building) == 1 &&
+      std::fwrite(ring + h.history_pos, 1, window_size - h.history_pos,
+                  h.building) == window_size - h.history_pos &&
+      std::fwrite(ring, 1, h.history_pos, h.building) == h.history_pos;
+  if (!ok) {
+    abandon_index(h);
+    return;
+  }
+  h.points.push_back({entry.out, entry.in, entry.bits});
+  h.last_point = h.out_total;
+}
+
+
+/* Prepare for a further gzip member, returning false if there is none. */
+static bool next_member(GzFileImpl& h)
+{
+  // an index only covers a single member, and a seek skips the trailer
+  if (h.raw)
+    return false;
+  if (h.strm.avail_in == 0 && !fill_input(h))
+    return false;
+
+  // anything else following is ignored, as by gzread
+  if (h.strm.next_in[0] != 0x1f)
+    return false;
+
+  if (h.building)
+    abandon_index(h);
+  inflateReset(&h.strm);
+  return true;
+}
+
+
+#ifdef APEX_HAVE_LIBDEFLATE
+static bool inflate_whole(GzFileImpl& h)
+{
+  std::vector<unsigned char> in(h.file_size);
+  if (std::fread(in.data(), 1, in.size(), h.file) != in.size())
+    return false;
+
+  // a member's trailer holds its size, modulo 2^32; that of the last member
+  // sizes the first attempt at each
+  size_t avail = 1 << 16;
+  if (in.size() >= 4)
+    avail = std::max<size_t>(avail, in[in.size() - 4] |
+                                        (in[in.size() - 3] << 8) |
+                                        (in[in.size() - 2] << 16) |
+                                        (size_t{in[in.size() - 1]} << 24));
+
+  auto* decompressor = libdeflate_alloc_decompressor();
+  if (!decompressor)
+    return false;
+
+  bool ok = true;
+  size_t pos = 0;
+  while (ok && pos + 1 < in.size() && in[pos] == 0x1f && in[pos + 1] == 0x8b) {
+    size_t start = h.whole.size();
+    h.whole.resize(start + avail);
+    size_t in_used = 0;
+    size_t out_used = 0;
+    auto rc = libdeflate_gzip_decompress_ex(
+        decompressor, in.data() + pos, in.size() - pos, h.whole.data() + start,
+        avail, &in_used, &out_used);
+    if (rc == LIBDEFLATE_INSUFFICIENT_SPACE) {
+      h.whole.resize(start);
+      avail *= 2;
+      continue;
+    }
+    h.whole.resize(start + out_used);
+    ok = rc == LIBDEFLATE_SUCCESS;
+    pos += in_used;
+  }
+  libdeflate_free_decompressor(decompressor);
+  return ok;
+}
+#endif
+
+
 GzFile::GzFile()
 : _handle(std::make_unique<GzFileImpl>()),
   _errno(0),
@@ -41,59 +352,244 @@ GzFile::~GzFile()
 }
 
 
-void GzFile::open(std::filesystem::path filename)
+void GzFile::open(std::filesystem::path filename, Options options)
 {
-  if (_handle->file)
+  if (is_open())
     this->close();
 
   _errno = 0;
   _is_bad = false;
 
-  _handle->file = ::gzopen(filename.c_str() , "rb");
+  auto& h = *_handle;
+  h.path = filename;
+  h.options = options;
+  h.options.index_span = std::max(options.index_span, 2 * window_size);
 
-  if (!_handle->file) {
+  h.file = std::fopen(filename.c_str(), "rb");
+  if (!h.file) {
     _is_bad = true;
     _errno = errno;
+    return;
+  }
+
+  std::error_code err;
+  h.file_size = std::filesystem::file_size(filename, err);
+  h.mtime = std::filesystem::last_write_time(filename, err)
+                .time_since_epoch()
+                .count();
+
+  unsigned char magic[2] = {0, 0};
+  bool gzip = std::fread(magic, 1, 2, h.file) == 2 && magic[0] == 0x1f &&
+              magic[1] == 0x8b;
+  std::rewind(h.file);
+
+#ifdef APEX_HAVE_LIBDEFLATE
+  if (gzip && h.file_size <= whole_file_max) {
+    h.whole_mode = true;
+    if (!inflate_whole(h)) {
+      _is_bad = true;
+      return;
+    }
+    std::fclose(h.file);
+    h.file = nullptr;
+    h.eof = h.whole.empty();
+
+    // access points are free, since the output is all in memory
+    if (options.indexed) {
+      for (uint64_t off = h.options.index_span; off < h.whole.size();
+           off += h.options.index_span)
+        h.points.push_back({off, 0, 0});
+      h.index_complete = true;
+    }
+    return;
+  }
+#endif
+
+  h.input.resize(input_size);
+  if (!gzip) {
+    h.copy = true;
+    return;
+  }
+
+  // automatic header detection, as for gzread, which accepts zlib streams too
+  if (inflateInit2(&h.strm, 15 + 32) != Z_OK)
+    THROW("failed to initialise zlib inflate for " << filename);
+  h.strm_init = true;
+
+  if (options.indexed) {
+    h.index_complete = load_index(h);
+    if (!h.index_complete && options.build_index)
+      start_index(h);
   }
 }
 
 
 bool GzFile::is_open() const {
-  return !! _handle->file;
+  return _handle->file || _handle->whole_mode;
 }
 
 
 size_t GzFile::read(char * buf, size_t len)
 {
-  if (!is_eof() && !is_bad()) {
-    auto nread = ::gzread(_handle->file, buf, len);
+  if (is_eof() || is_bad())
+    return 0;
+
+  auto& h = *_handle;
+
+  if (h.whole_mode) {
+    size_t n = std::min<size_t>(len, h.whole.size() - h.out_total);
+    memcpy(buf, h.whole.data() + h.out_total, n);
+    h.out_total += n;
+    h.eof = h.out_total == h.whole.size();
+    return n;
+  }
 
-    if (nread == 0) {
-      _errno = errno;
-      if (!is_eof())
+  if (h.copy) {
+    size_t n = std::fread(buf, 1, len, h.file);
+    h.out_total += n;
+    if (n < len) {
+      if (std::ferror(h.file)) {
         _is_bad = true;
+        _errno = errno;
+      }
+      else
+        h.eof = true;
     }
-
-    return nread;
+    return n;
   }
-  else {
-    return 0;
+
+  h.strm.next_out = reinterpret_cast<Bytef*>(buf);
+  h.strm.avail_out = static_cast<uInt>(std::min<size_t>(len, UINT_MAX));
+  const size_t wanted = h.strm.avail_out;
+
+  while (h.strm.avail_out) {
+    if (h.strm.avail_in == 0 && !fill_input(h)) {
+      // the file has ended before the gzip stream
+      _is_bad = true;
+      _errno = std::ferror(h.file) ? errno : 0;
+      break;
+    }
+
+    // while indexing, inflate stops at each block boundary, where an access
+    // point might be added
+    auto* out = h.strm.next_out;
+    const auto out_before = h.strm.avail_out;
+    int rc = ::inflate(&h.strm, h.building ? Z_BLOCK : Z_NO_FLUSH);
+    const size_t produced = out_before - h.strm.avail_out;
+    h.out_total += produced;
+    if (h.building)
+      record_history(h, out, produced);
+
+    if (rc == Z_STREAM_END) {
+      if (next_member(h))
+        continue;
+      h.eof = true;
+      if (h.building)
+        finish_index(h);
+      break;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+      LOG_WARN("gzip inflate failed, " << (h.strm.msg ? h.strm.msg : "")
+               << ", file " << h.path);
+      _is_bad = true;
+      break;
+    }
+
+    if (h.building && (h.strm.data_type & 128) && !(h.strm.data_type & 64) &&
+        h.out_total - h.last_point > h.options.index_span)
+      add_point(h);
   }
+
+  return wanted - h.strm.avail_out;
 }
 
 
 bool GzFile::is_eof() const
 {
-  return (_handle->file)? !!::gzeof(_handle->file) : true;
+  return is_open() ? _handle->eof : true;
 }
 
 
-void GzFile::close()
+std::vector<uint64_t> GzFile::seek_points() const
+{
+  std::vector<uint64_t> offsets;
+  if (_handle->index_complete)
+    for (auto& point : _handle->points)
+      offsets.push_back(point.out);
+  return offsets;
+}
+
+
+void GzFile::seek(size_t point)
 {
-  if (_handle->file) {
-    ::gzclose(_handle->file);
-    _handle->file = nullptr;
+  auto& h = *_handle;
+  if (!h.index_complete || point >= h.points.size())
+    THROW("gzip access point " << point << " not available, file " << h.path);
+  const auto& p = h.points[point];
+
+  _is_bad = false;
+  _errno = 0;
+  h.eof = false;
+  h.out_total = p.out;
+
+  if (h.whole_mode)
+    return;
+
+  // the window for this point, from the sidecar
+  std::vector<unsigned char> window(window_size);
+  {
+    auto fn = gz_index_path(h.path);
+    std::FILE* f = std::fopen(fn.c_str(), "rb");
+    long offset = sizeof(IndexHeader) +
+                  point * (sizeof(IndexEntry) + window_size) +
+                  sizeof(IndexEntry);
+    bool ok = f && std::fseek(f, offset, SEEK_SET) == 0 &&
+              std::fread(window.data(), 1, window_size, f) == window_size;
+    if (f)
+      std::fclose(f);
+    if (!ok)
+      THROW("failed to read gzip index " << fn);
   }
+
+  // resume the deflate stream at the block boundary, which, unless at a byte
+  // boundary, starts within the byte before `in`
+  inflateEnd(&h.strm);
+  h.strm = z_stream{};
+  if (inflateInit2(&h.strm, -15) != Z_OK)
+    THROW("failed to initialise zlib inflate for " << h.path);
+  h.raw = true;
+
+  const uint64_t start = p.in - (p.bits ? 1 : 0);
+  if (fseeko(h.file, static_cast<off_t>(start), SEEK_SET) != 0)
+    THROW("failed to seek in " << h.path << ": " << strerror(errno));
+  h.in_total = start;
+  h.strm.avail_in = 0;
+  if (p.bits) {
+    if (!fill_input(h))
+      THROW("failed to read " << h.path);
+    int byte = *h.strm.next_in++;
+    h.strm.avail_in--;
+    inflatePrime(&h.strm, p.bits, byte >> (8 - p.bits));
+  }
+  inflateSetDictionary(&h.strm, window.data(), window_size);
+}
+
+
+uint64_t GzFile::tell() const
+{
+  return _handle->out_total;
+}
+
+
+void GzFile::close()
+{
+  auto& h = *_handle;
+  abandon_index(h);
+  if (h.strm_init)
+    inflateEnd(&h.strm);
+  if (h.file)
+    std::fclose(h.file);
+  h = GzFileImpl();
 }
 
 
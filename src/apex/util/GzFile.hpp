@@ -17,24 +17,47 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
 #include <memory>
+#include <vector>
 
 namespace apex {
 
-/* Read a gzipped file. */
+/* Read a gzipped file.
+ *
+ * Inflate is by zlib, or, when built with APEX_WITH_LIBDEFLATE, by libdeflate
+ * for files small enough to inflate whole into memory.  A zlib-ng built for
+ * zlib compatibility can stand in for zlib itself, by pointing ZLIB_ROOT at
+ * it.
+ *
+ * An indexed file is given random access.  On its first complete read, an
+ * access point is recorded every `index_span` bytes of output, as the offset
+ * into the compressed stream of a deflate block boundary along with the 32K
+ * window preceding it, and written to a sidecar file (see gz_index_path) once
+ * the end is reached.  Later opens load the sidecar, after which seek() can
+ * resume inflating at any access point. */
 
 struct GzFileImpl;
 
 class GzFile {
 public:
+  struct Options {
+    // use the file's index, building it if absent or stale, unless
+    // build_index is false
+    bool indexed = false;
+    bool build_index = true;
+    size_t index_span = 8 << 20;
+  };
+
   GzFile();
   ~GzFile();
 
   GzFile(const GzFile&) = delete;
   GzFile& operator=(const GzFile&) = delete;
 
-  void open(std::filesystem::path filename);
+  void open(std::filesystem::path filename) { open(filename, Options{}); }
+  void open(std::filesystem::path filename, Options);
   void close();
 
   size_t read(char * buf, size_t len);
@@ -45,6 +68,16 @@ public:
 
   int last_errno() const { return _errno; }
 
+  /* Uncompressed offsets of the access points, ascending; empty unless the
+   * file is indexed and its index is complete. */
+  std::vector<uint64_t> seek_points() const;
+
+  /* Resume reading at the access point `point`, an index into seek_points. */
+  void seek(size_t point);
+
+  /* Uncompressed offset of the next byte to be read. */
+  uint64_t tell() const;
+
 private:
   std::unique_ptr<GzFileImpl> _handle; // pimpl pattern
   int _errno;
@@ -52,4 +85,8 @@ private:
 };
 
 
+/* Path of the sidecar file holding the access points of an indexed gzip
+ * file. */
+std::filesystem::path gz_index_path(const std::filesystem::path& fn);
+
 }
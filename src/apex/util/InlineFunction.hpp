@@ -0,0 +1,139 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace apex
+{
+
+/* Move-only callable wrapper with fixed inline storage.  Unlike std::function,
+ * which heap allocates callables larger than its small-object buffer (two
+ * pointers in libstdc++), this never allocates: a callable whose size exceeds
+ * Capacity fails to compile.  Construction from a callable is explicit, so that
+ * overloads taking both std::function and InlineFunction remain unambiguous. */
+template <typename Sig, size_t Capacity = 64> class InlineFunction;
+
+template <typename R, typename... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity>
+{
+public:
+  static constexpr size_t capacity = Capacity;
+
+  InlineFunction() noexcept = default;
+  InlineFunction(std::nullptr_t) noexcept {}
+
+  template <typename F,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<F>, InlineFunction> &&
+                std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+  explicit InlineFunction(F&& f)
+  {
+    using Fn = std::decay_t<F>;
+    static_assert(sizeof(Fn) <= Capacity,
+                  "callable too large for InlineFunction; reduce the capture "
+                  "size or increase Capacity");
+    static_assert(alignof(Fn) <= alignof(std::max_align_t),
+                  "callable over-aligned for InlineFunction");
+    static_assert(std::is_nothrow_move_constructible_v<Fn>,
+                  "InlineFunction requires a nothrow-movable callable");
+    ::new (static_cast<void*>(_storage)) Fn(std::forward<F>(f));
+    _ops = &ops_for<Fn>;
+  }
+
+  InlineFunction(InlineFunction&& other) noexcept { move_from(other); }
+
+  InlineFunction& operator=(InlineFunction&& other) noexcept
+  {
+    if (this != &other) {
+      reset();
+      move_from(other);
+    }
+    return *this;
+  }
+
+  InlineFunction& operator=(std::nullptr_t) noexcept
+  {
+    reset();
+    return *this;
+  }
+
+  InlineFunction(const InlineFunction&) = delete;
+  InlineFunction& operator=(const InlineFunction&) = delete;
+
+  ~InlineFunction() { reset(); }
+
+  explicit operator bool() const noexcept { return _ops != nullptr; }
+
+  /** Invoke the callable; undefined if empty. */
+  R operator()(Args... args)
+  {
+    return _ops->invoke(_storage, std::forward<Args>(args)...);
+  }
+
+private:
+  struct Ops {
+    R (*invoke)(void*, Args&&...);
+    void (*move)(void* dst, void* src) noexcept;
+    void (*destroy)(void*) noexcept;
+  };
+
+  template <typename Fn> static R invoke_impl(void* p, Args&&... args)
+  {
+    return (*static_cast<Fn*>(p))(std::forward<Args>(args)...);
+  }
+
+  template <typename Fn> static void move_impl(void* dst, void* src) noexcept
+  {
+    ::new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+    static_cast<Fn*>(src)->~Fn();
+  }
+
+  template <typename Fn> static void destroy_impl(void* p) noexcept
+  {
+    static_cast<Fn*>(p)->~Fn();
+  }
+
+  template <typename Fn>
+  static constexpr Ops ops_for = {&invoke_impl<Fn>, &move_impl<Fn>,
+                                  &destroy_impl<Fn>};
+
+  void move_from(InlineFunction& other) noexcept
+  {
+    if (other._ops) {
+      other._ops->move(_storage, other._storage);
+      _ops = other._ops;
+      other._ops = nullptr;
+    }
+  }
+
+  void reset() noexcept
+  {
+    if (_ops) {
+      _ops->destroy(_storage);
+      _ops = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char _storage[Capacity];
+  const Ops* _ops = nullptr;
+};
+
+} // namespace apex
@@ -0,0 +1,116 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include <apex/util/LatencyHistogram.hpp>
+
+#include <iomanip>
+#include <limits>
+#include <ostream>
+
+namespace apex
+{
+
+uint64_t LatencyHistogram::bucket_upper(size_t index)
+{
+  if (index < sub_bucket_count)
+    return index;
+  const int shift = int(index / sub_bucket_count) - 1;
+  const uint64_t sub = index % sub_bucket_count;
+  const uint64_t lower = (sub_bucket_count + sub) << shift;
+  const uint64_t width = uint64_t(1) << shift;
+  if (lower > std::numeric_limits<uint64_t>::max() - (width - 1))
+    return std::numeric_limits<uint64_t>::max();
+  return lower + (width - 1);
+}
+
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot(bool reset)
+{
+  Snapshot snap;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    snap.counts[i] = reset ? _counts[i].exchange(0, std::memory_order_relaxed)
+                           : _counts[i].load(std::memory_order_relaxed);
+    snap.count += snap.counts[i];
+  }
+  // derive the count from the buckets, so that percentiles are consistent
+  if (reset) {
+    _count.store(0, std::memory_order_relaxed);
+    snap.sum = _sum.exchange(0, std::memory_order_relaxed);
+    snap.max = _max.exchange(0, std::memory_order_relaxed);
+  } else {
+    snap.sum = _sum.load(std::memory_order_relaxed);
+    snap.max = _max.load(std::memory_order_relaxed);
+  }
+  return snap;
+}
+
+
+uint64_t LatencyHistogram::Snapshot::value_at(double q) const
+{
+  if (count == 0)
+    return 0;
+  if (q < 0.0)
+    q = 0.0;
+  if (q > 1.0)
+    q = 1.0;
+
+  // rank of the requested value, 1-based
+  uint64_t rank = static_cast<uint64_t>(q * count + 0.5);
+  if (rank < 1)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count; ++i) {
+    seen += counts[i];
+    if (seen >= rank) {
+      auto upper = LatencyHistogram::bucket_upper(i);
+      return (max && upper > max) ? max : upper;
+    }
+  }
+  return max;
+}
+
+
+void LatencyHistogram::Snapshot::merge(const Snapshot& other)
+{
+  for (size_t i = 0; i < bucket_count; ++i)
+    counts[i] += other.counts[i];
+  count += other.count;
+  sum += other.sum;
+  if (other.max > max)
+    max = other.max;
+}
+
+
+std::ostream& operator<<(std::ostream& os,
+                         const LatencyHistogram::Snapshot& snap)
+{
+  auto us = [](double ns) { return ns / 1000.0; };
+  auto flags = os.flags();
+  auto precision = os.precision();
+  os << std::fixed << std::setprecision(1) << "n=" << snap.count
+     << " mean=" << us(snap.mean()) << "us"
+     << " p50=" << us(snap.value_at(0.50)) << "us"
+     << " p90=" << us(snap.value_at(0.90)) << "us"
+     << " p99=" << us(snap.value_at(0.99)) << "us"
+     << " p99.9=" << us(snap.value_at(0.999)) << "us"
+     << " max=" << us(snap.max) << "us";
+  os.flags(flags);
+  os.precision(precision);
+  return os;
+}
+
+} // namespace apex
@@ -0,0 +1,93 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+
+namespace apex
+{
+
+/* Log-linear histogram of non-negative integer values (typically nanosecond
+ * durations), in the style of HdrHistogram.  Each power-of-two range is split
+ * into 16 sub-buckets, so reported values are within 6.25% of the recorded
+ * ones, across the full uint64 range, in fixed storage.
+ *
+ * Designed for a single recording thread; snapshot() may be taken from any
+ * thread, and counts recorded concurrently with a resetting snapshot are
+ * attributed to either the old or the next interval. */
+class LatencyHistogram
+{
+public:
+  static constexpr int sub_bucket_bits = 4;
+  static constexpr size_t sub_bucket_count = size_t(1) << sub_bucket_bits;
+  static constexpr size_t bucket_count =
+      (64 - sub_bucket_bits + 1) * sub_bucket_count;
+
+  struct Snapshot {
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+
+    /** Value at quantile q (0..1), reported as the upper bound of the bucket
+     * holding it, but never above the recorded maximum. */
+    uint64_t value_at(double q) const;
+    double mean() const { return count ? double(sum) / count : 0.0; }
+
+    void merge(const Snapshot&);
+  };
+
+  void record(uint64_t value)
+  {
+    _counts[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(value, std::memory_order_relaxed);
+    if (value > _max.load(std::memory_order_relaxed))
+      _max.store(value, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot(bool reset = false);
+
+  static size_t bucket_of(uint64_t value)
+  {
+    if (value < sub_bucket_count)
+      return value;
+    const int msb = 63 - __builtin_clzll(value);
+    const int shift = msb - sub_bucket_bits;
+    return (shift + 1) * sub_bucket_count +
+           ((value >> shift) & (sub_bucket_count - 1));
+  }
+
+  /** Largest value mapped to the bucket. */
+  static uint64_t bucket_upper(size_t index);
+
+private:
+  std::array<std::atomic<uint64_t>, bucket_count> _counts{};
+  std::atomic<uint64_t> _count{0};
+  std::atomic<uint64_t> _sum{0};
+  std::atomic<uint64_t> _max{0};
+};
+
+
+/* Write a one-line summary, "n=.. mean=.. p50=.. p90=.. p99=.. p99.9=..
+ * max=..", treating values as nanoseconds and displaying as microseconds. */
+std::ostream& operator<<(std::ostream&, const LatencyHistogram::Snapshot&);
+
+} // namespace apex
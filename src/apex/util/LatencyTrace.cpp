@@ -0,0 +1,95 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/LatencyTrace.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/EventLoop.hpp>
+
+#include <ostream>
+#include <sstream>
+
+namespace apex
+{
+namespace trace
+{
+
+const char* to_string(Stage stage)
+{
+  switch (stage) {
+    case Stage::ws_receive: return "ws_receive";
+    case Stage::gx_encode: return "gx_encode";
+    case Stage::gx_decode: return "gx_decode";
+    case Stage::md_apply: return "md_apply";
+    case Stage::order_create: return "order_create";
+    case Stage::order_send: return "order_send";
+    case Stage::count: break;
+  }
+  return "unknown";
+}
+
+
+LatencyTracer& LatencyTracer::instance()
+{
+  static LatencyTracer tracer;
+  return tracer;
+}
+
+
+LatencyTracer::StageSnapshot LatencyTracer::snapshot(Stage stage, bool reset)
+{
+  auto i = static_cast<size_t>(stage);
+  return {_since_previous[i].snapshot(reset), _since_receive[i].snapshot(reset)};
+}
+
+
+void LatencyTracer::report(std::ostream& os, bool reset)
+{
+  for (size_t i = 0; i < stage_count; i++) {
+    auto stage = static_cast<Stage>(i);
+    auto snap = snapshot(stage, reset);
+    if (snap.since_previous.count == 0)
+      continue;
+    os << "\n  " << to_string(stage) << ": since previous stage "
+       << snap.since_previous << "; since receive " << snap.since_receive;
+  }
+}
+
+
+void configure(Config config, EventLoop& event_loop)
+{
+  auto trace_config =
+      config.get_sub_config("latency_tracing", Config::empty_config());
+  if (!trace_config.get_bool("enabled", false))
+    return;
+
+  tracer().enable(true);
+  LOG_INFO("latency tracing enabled");
+
+  auto interval = std::chrono::seconds(trace_config.get_uint("log_sec", 0));
+  if (interval.count() > 0)
+    event_loop.dispatch(interval, [interval]() -> std::chrono::milliseconds {
+      std::ostringstream oss;
+      tracer().report(oss, true);
+      if (oss.tellp() > 0)
+        LOG_INFO("latency trace:" << oss.str());
+      return interval;
+    });
+}
+
+} // namespace trace
+} // namespace apex
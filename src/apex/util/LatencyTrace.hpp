@@ -0,0 +1,137 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/LatencyHistogram.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+#include <time.h>
+
+namespace apex
+{
+
+class Config;
+class EventLoop;
+
+/* End-to-end latency tracing, of ticks and of the orders they trigger.  A
+ * traced tick carries the time its exchange frame arrived, taken from the
+ * kernel receive timestamp where the socket provides one, and the time it
+ * passed the most recent traced stage; each later stage records the time
+ * since the previous stage, and since arrival, in per-stage histograms.
+ * Stamps use CLOCK_REALTIME rather than the TSC so that they remain
+ * comparable between the GX server and client processes.  Across hosts, the
+ * GX client removes the server clock offset it estimates by probing the link
+ * (see GxClientSession::clock_offset_ns), so the cross-process stages are
+ * accurate to about half the link's round trip asymmetry.  Ticks are traced
+ * across GX only when using the binary encoding. */
+namespace trace
+{
+
+enum class Stage : int {
+  ws_receive = 0, // websocket frame arrived at the gateway
+  gx_encode,      // tick encoded for GX sessions
+  gx_decode,      // tick decoded by the GX client
+  md_apply,       // tick applied to MarketData
+  order_create,   // bot created an order, following the tick
+  order_send,     // order written to the GX session
+  count
+};
+
+const char* to_string(Stage);
+
+// Nanoseconds since epoch; a zero `rt` indicates untraced.
+struct Stamp {
+  uint64_t rt = 0; // frame receive time
+  uint64_t st = 0; // time of previous stage
+
+  [[nodiscard]] bool is_traced() const { return rt != 0; }
+};
+
+inline uint64_t now_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+class LatencyTracer
+{
+public:
+  static LatencyTracer& instance();
+
+  void enable(bool on) { _enabled.store(on, std::memory_order_relaxed); }
+  [[nodiscard]] bool is_enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  /* Stamp arriving at the first stage, or an untraced stamp if disabled. */
+  [[nodiscard]] Stamp receive() const { return receive(0); }
+
+  /* As receive(), but for a frame whose data the kernel timestamped as
+   * arriving at `rx_time` (nanoseconds since epoch), when non-zero. */
+  [[nodiscard]] Stamp receive(uint64_t rx_time) const {
+    if (!is_enabled())
+      return {};
+    auto now = now_ns();
+    return {rx_time ? rx_time : now, now};
+  }
+
+  /* Record a traced stamp passing `stage`, and advance it to now. */
+  void mark(Stage stage, Stamp& stamp) {
+    if (!stamp.is_traced() || !is_enabled())
+      return;
+    auto now = now_ns();
+    auto i = static_cast<size_t>(stage);
+    _since_previous[i].record(now > stamp.st ? now - stamp.st : 0);
+    _since_receive[i].record(now > stamp.rt ? now - stamp.rt : 0);
+    stamp.st = now;
+  }
+
+  struct StageSnapshot {
+    LatencyHistogram::Snapshot since_previous;
+    LatencyHistogram::Snapshot since_receive;
+  };
+
+  StageSnapshot snapshot(Stage, bool reset = false);
+
+  /* Write one line per stage that has recorded samples. */
+  void report(std::ostream&, bool reset = false);
+
+private:
+  static constexpr size_t stage_count = static_cast<size_t>(Stage::count);
+
+  std::atomic<bool> _enabled{false};
+  std::array<LatencyHistogram, stage_count> _since_previous;
+  std::array<LatencyHistogram, stage_count> _since_receive;
+};
+
+inline LatencyTracer& tracer() { return LatencyTracer::instance(); }
+
+/* Enable tracing if the "latency_tracing" sub-config sets "enabled", and if
+ * it sets "log_sec", log and reset the report at that interval, via timers
+ * on the event loop. */
+void configure(Config, EventLoop&);
+
+} // namespace trace
+
+} // namespace apex
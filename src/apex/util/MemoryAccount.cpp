@@ -0,0 +1,134 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/EventLoop.hpp>
+#include <apex/util/Metrics.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace apex
+{
+namespace memory
+{
+
+static std::atomic<Account*> accounts{nullptr};
+
+
+Account::Account(const char* subsystem)
+  : _name(subsystem),
+    _bytes_gauge(metrics::registry().gauge(
+        std::string("apex_memory_bytes{subsystem=\"") + subsystem + "\"}",
+        "Bytes held by a subsystem, as accounted by its owners")),
+    _peak_gauge(metrics::registry().gauge(
+        std::string("apex_memory_peak_bytes{subsystem=\"") + subsystem + "\"}",
+        "Peak of the bytes held by a subsystem"))
+{
+  next = accounts.load(std::memory_order_relaxed);
+  while (!accounts.compare_exchange_weak(next, this, std::memory_order_release,
+                                         std::memory_order_relaxed)) {
+  }
+}
+
+
+void Account::add(int64_t bytes)
+{
+  auto now = _bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  _bytes_gauge.set(now);
+
+  auto peak = _peak.load(std::memory_order_relaxed);
+  while (now > peak && !_peak.compare_exchange_weak(
+                           peak, now, std::memory_order_relaxed)) {
+  }
+  if (now > peak)
+    _peak_gauge.set(now);
+}
+
+
+size_t resident_bytes()
+{
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0, resident = 0;
+  if (!(statm >> pages >> resident))
+    return 0;
+  return resident * static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+}
+
+
+int64_t write_report(std::ostream& os)
+{
+  std::vector<const Account*> all;
+  for (auto* account = accounts.load(std::memory_order_acquire); account;
+       account = account->next)
+    all.push_back(account);
+  std::sort(all.begin(), all.end(), [](const Account* a, const Account* b) {
+    return a->bytes() > b->bytes();
+  });
+
+  int64_t total = 0;
+  for (auto* account : all) {
+    os << std::left << std::setw(20) << account->name() << std::right
+       << std::setw(14) << account->bytes() << " bytes, peak "
+       << account->peak() << "\n";
+    total += account->bytes();
+  }
+  os << std::left << std::setw(20) << "total" << std::right << std::setw(14)
+     << total << " bytes, of resident " << resident_bytes() << "\n";
+  return total;
+}
+
+
+static std::atomic<bool> report_requested{false};
+
+static void on_report_signal(int) { report_requested.store(true); }
+
+
+void configure_report(Config config, EventLoop& event_loop)
+{
+  auto memory_config = config.get_sub_config("memory", Config::empty_config());
+  if (!memory_config.get_bool("report_signal", true))
+    return;
+
+  struct sigaction action = {};
+  action.sa_handler = on_report_signal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR1, &action, nullptr);
+
+  auto interval = std::chrono::milliseconds(250);
+  event_loop.dispatch(interval, [interval]() -> std::chrono::milliseconds {
+    if (report_requested.exchange(false)) {
+      std::ostringstream os;
+      write_report(os);
+      LOG_NOTICE("memory by subsystem:\n" << os.str());
+    }
+    return interval;
+  });
+}
+
+} // namespace memory
+} // namespace apex
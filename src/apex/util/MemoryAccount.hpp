@@ -0,0 +1,149 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+namespace apex
+{
+
+class Config;
+class EventLoop;
+
+namespace metrics
+{
+class Gauge;
+}
+
+/* Memory accounting by subsystem, to explain the resident size of a long
+ * running process: which buffers and tables hold its memory, and which grow
+ * without bound.  Each subsystem has an Account, of the bytes its owners
+ * report they hold, and the peak, exported as the gauges
+ * apex_memory_bytes{subsystem="..."} and apex_memory_peak_bytes{...}.
+ * Figures are what the owners size their storage at, such as the capacity of
+ * a buffer, not heap overheads, so they account for part of the resident
+ * size. */
+namespace memory
+{
+
+/* Bytes held by a subsystem.  Accounts are created once, as statics, and
+ * are never removed. */
+class Account
+{
+public:
+  explicit Account(const char* subsystem);
+
+  Account(const Account&) = delete;
+  Account& operator=(const Account&) = delete;
+
+  void add(int64_t bytes);
+
+  [[nodiscard]] const char* name() const { return _name; }
+  [[nodiscard]] int64_t bytes() const
+  {
+    return _bytes.load(std::memory_order_relaxed);
+  }
+  [[nodiscard]] int64_t peak() const
+  {
+    return _peak.load(std::memory_order_relaxed);
+  }
+
+  Account* next = nullptr; // of all accounts
+
+private:
+  const char* _name;
+  std::atomic<int64_t> _bytes{0};
+  std::atomic<int64_t> _peak{0};
+  metrics::Gauge& _bytes_gauge;
+  metrics::Gauge& _peak_gauge;
+};
+
+
+/* The share of an Account held by one owner, such as a buffer, set to what
+ * the owner currently holds, and released with it.  A set that does not
+ * change the size touches no shared state, so an owner may set it after each
+ * operation that can grow its storage.  Copies charge the same size again. */
+class Charge
+{
+public:
+  explicit Charge(Account& account) : _account(&account) {}
+  ~Charge() { _account->add(-_bytes); }
+
+  Charge(const Charge& other) : _account(other._account)
+  {
+    set(other._bytes);
+  }
+
+  Charge(Charge&& other) noexcept
+    : _account(other._account), _bytes(other._bytes)
+  {
+    other._bytes = 0;
+  }
+
+  Charge& operator=(const Charge& other)
+  {
+    if (this != &other)
+      set(other._bytes);
+    return *this;
+  }
+
+  Charge& operator=(Charge&& other) noexcept
+  {
+    if (this != &other) {
+      _account->add(-_bytes);
+      _account = other._account;
+      _bytes = other._bytes;
+      other._bytes = 0;
+    }
+    return *this;
+  }
+
+  void set(size_t bytes)
+  {
+    auto now = static_cast<int64_t>(bytes);
+    if (now != _bytes) {
+      _account->add(now - _bytes);
+      _bytes = now;
+    }
+  }
+
+  [[nodiscard]] size_t bytes() const { return static_cast<size_t>(_bytes); }
+
+private:
+  Account* _account;
+  int64_t _bytes = 0;
+};
+
+
+/* Resident set size of the process, in bytes, or zero if unknown. */
+size_t resident_bytes();
+
+/* Write each account, largest first, with its peak, then the total and the
+ * resident size of the process; returns the total. */
+int64_t write_report(std::ostream&);
+
+/* Log the report on each SIGUSR1, unless the "memory" sub-config sets
+ * "report_signal" false.  The signal is noticed by a timer on the event
+ * loop. */
+void configure_report(Config, EventLoop&);
+
+} // namespace memory
+} // namespace apex
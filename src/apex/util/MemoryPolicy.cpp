@@ -0,0 +1,214 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/MemoryPolicy.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+
+namespace apex
+{
+namespace memory
+{
+
+static constexpr size_t huge_page_size = 2 * 1024 * 1024;
+static constexpr size_t page_size = 4096;
+
+static std::atomic<Arena*> process_arena{nullptr};
+static std::atomic<bool> prefault{false};
+
+
+const char* to_string(Backing backing)
+{
+  switch (backing) {
+    case Backing::huge_tlb: return "explicit 2MB huge pages";
+    case Backing::transparent: return "transparent huge pages";
+    case Backing::normal: return "normal pages";
+  }
+  return "unknown";
+}
+
+
+Arena::Arena(size_t size, bool huge_pages)
+{
+  _size = (size + huge_page_size - 1) / huge_page_size * huge_page_size;
+  if (_size == 0)
+    THROW("memory arena size must be nonzero");
+
+  if (huge_pages) {
+    void* mem = ::mmap(nullptr, _size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE,
+                       -1, 0);
+    if (mem != MAP_FAILED) {
+      _mapped = _base = static_cast<char*>(mem);
+      _mapped_size = _size;
+      _backing = Backing::huge_tlb;
+      return;
+    }
+  }
+
+  // over-allocate, so the arena can start on a 2MB boundary, as transparent
+  // huge pages require
+  _mapped_size = _size + huge_page_size;
+  void* mem = ::mmap(nullptr, _mapped_size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED)
+    THROW("failed to map memory arena of " << _size << " bytes: "
+          << strerror(errno));
+  _mapped = static_cast<char*>(mem);
+  auto addr = reinterpret_cast<uintptr_t>(_mapped);
+  _base = _mapped + ((huge_page_size - addr % huge_page_size) % huge_page_size);
+
+  if (huge_pages && ::madvise(_base, _size, MADV_HUGEPAGE) == 0)
+    _backing = Backing::transparent;
+
+  // pre-fault, with one write per page
+  for (size_t offset = 0; offset < _size; offset += page_size)
+    _base[offset] = 0;
+
+  if (_backing == Backing::transparent && huge_page_bytes() == 0)
+    _backing = Backing::normal;
+}
+
+
+Arena::~Arena()
+{
+  if (_mapped)
+    ::munmap(_mapped, _mapped_size);
+}
+
+
+void* Arena::allocate(size_t size, size_t align)
+{
+  size_t used = _used.load(std::memory_order_relaxed);
+  while (true) {
+    const size_t start = (used + align - 1) / align * align;
+    if (start + size > _size)
+      return nullptr;
+    if (_used.compare_exchange_weak(used, start + size,
+                                    std::memory_order_relaxed))
+      return _base + start;
+  }
+}
+
+
+size_t Arena::huge_page_bytes() const
+{
+  if (_backing == Backing::huge_tlb)
+    return _size;
+
+  // find the mapping holding the arena in smaps, and its AnonHugePages
+  std::ifstream smaps("/proc/self/smaps");
+  const auto base = reinterpret_cast<uintptr_t>(_base);
+  std::string line;
+  bool in_arena = false;
+  while (std::getline(smaps, line)) {
+    uintptr_t begin = 0, end = 0;
+    char dash = 0;
+    std::istringstream iss(line);
+    if (iss >> std::hex >> begin >> dash >> end && dash == '-') {
+      in_arena = base >= begin && base < end;
+      continue;
+    }
+    if (in_arena && line.rfind("AnonHugePages:", 0) == 0) {
+      size_t kb = 0;
+      std::istringstream(line.substr(14)) >> kb;
+      return std::min(kb * 1024, _size);
+    }
+  }
+  return 0;
+}
+
+
+Arena* arena() { return process_arena.load(std::memory_order_acquire); }
+
+
+void* allocate(size_t size, size_t align)
+{
+  if (auto* a = arena())
+    if (void* p = a->allocate(size, align))
+      return p;
+  if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    return ::operator new(size, std::align_val_t(align));
+  return ::operator new(size);
+}
+
+
+void deallocate(void* p, size_t align)
+{
+  if (!p || in_arena(p))
+    return;
+  if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+    ::operator delete(p, std::align_val_t(align));
+  else
+    ::operator delete(p);
+}
+
+
+bool prefault_enabled() { return prefault.load(std::memory_order_relaxed); }
+
+
+Report configure(Config config)
+{
+  auto memory_config = config.get_sub_config("memory", Config::empty_config());
+  const size_t arena_mb = memory_config.get_uint("arena_mb", 0);
+  const bool lock = memory_config.get_bool("lock", false);
+  prefault.store(memory_config.get_bool("prefault", lock || arena_mb > 0));
+
+  if (arena_mb > 0 && !arena()) {
+    auto* created =
+        new Arena(arena_mb * 1024 * 1024,
+                  memory_config.get_bool("huge_pages", true));
+    process_arena.store(created, std::memory_order_release);
+  }
+
+  Report report;
+  if (lock) {
+    if (::mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      report.locked = true;
+    else
+      LOG_WARN("mlockall failed, memory not locked: " << strerror(errno));
+  }
+
+  if (auto* a = arena()) {
+    report.arena_size = a->size();
+    report.arena_backing = a->backing();
+    report.huge_page_bytes = a->huge_page_bytes();
+    LOG_INFO("memory arena: " << (report.arena_size >> 20) << " MB, "
+             << to_string(report.arena_backing) << ", huge pages "
+             << (report.huge_page_bytes >> 20) << " MB");
+    if (memory_config.get_bool("huge_pages", true) &&
+        report.huge_page_bytes < report.arena_size)
+      LOG_WARN("memory arena not fully backed by huge pages; reserve them "
+               "via /proc/sys/vm/nr_hugepages, or enable transparent huge "
+               "pages");
+  }
+  if (lock || arena_mb > 0)
+    LOG_INFO("memory policy: locked " << (report.locked ? "yes" : "no")
+             << ", prefault " << (prefault_enabled() ? "yes" : "no"));
+  return report;
+}
+
+} // namespace memory
+} // namespace apex
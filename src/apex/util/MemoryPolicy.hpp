@@ -0,0 +1,147 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+
+namespace apex
+{
+
+class Config;
+
+/* Process memory policy, to avoid page faults and TLB misses on the hot
+ * paths once trading has started: locking of all pages, and an arena of
+ * pre-faulted, preferably huge page, memory from which long lived hot
+ * structures (event loop queues, object pools, MarketData) draw their
+ * storage.  Both are off unless configured, by a call to configure() at
+ * startup, before the services are constructed. */
+namespace memory
+{
+
+enum class Backing {
+  huge_tlb,    // explicit 2MB pages, from the hugetlbfs pool
+  transparent, // transparent huge pages
+  normal       // 4KB pages
+};
+
+const char* to_string(Backing);
+
+/* Region allocated and pre-faulted up front.  It is first requested as
+ * explicit 2MB pages, then as 2MB aligned memory advised for transparent
+ * huge pages, and otherwise uses normal pages.  Allocation bumps an atomic
+ * offset, and memory is never returned to the arena, so it suits storage
+ * allocated once, or recycled by a pool above it. */
+class Arena
+{
+public:
+  Arena(size_t size, bool huge_pages);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  // nullptr once exhausted
+  void* allocate(size_t size, size_t align);
+
+  bool contains(const void* p) const
+  {
+    return p >= _base && p < _base + _size;
+  }
+
+  [[nodiscard]] Backing backing() const { return _backing; }
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] size_t used() const
+  {
+    return _used.load(std::memory_order_relaxed);
+  }
+
+  /* Bytes of the arena currently backed by huge pages, explicit or
+   * transparent, as reported by the kernel. */
+  [[nodiscard]] size_t huge_page_bytes() const;
+
+private:
+  char* _base = nullptr;
+  size_t _size = 0;
+  size_t _mapped_size = 0;
+  char* _mapped = nullptr;
+  Backing _backing = Backing::normal;
+  std::atomic<size_t> _used{0};
+};
+
+// The process arena, or nullptr if none is configured.
+Arena* arena();
+
+inline bool in_arena(const void* p)
+{
+  auto* a = arena();
+  return a && a->contains(p);
+}
+
+/* Storage from the process arena, if configured and not exhausted, else
+ * from the heap.  Deallocating arena storage does nothing. */
+void* allocate(size_t size, size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+void deallocate(void* p, size_t align = __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+
+// Whether mappings made after startup should be pre-faulted.
+bool prefault_enabled();
+
+
+template <typename T> struct ArrayDeleter {
+  size_t count = 0;
+
+  void operator()(T* p) const
+  {
+    for (size_t i = 0; i < count; i++)
+      p[i].~T();
+    deallocate(p, alignof(T));
+  }
+};
+
+template <typename T> using unique_array = std::unique_ptr<T[], ArrayDeleter<T>>;
+
+/* Value-initialised array, drawn from the arena if configured. */
+template <typename T> unique_array<T> make_array(size_t count)
+{
+  auto* p = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+  for (size_t i = 0; i < count; i++)
+    new (p + i) T();
+  return unique_array<T>(p, ArrayDeleter<T>{count});
+}
+
+
+struct Report {
+  bool locked = false;       // mlockall succeeded
+  size_t arena_size = 0;     // zero if no arena
+  Backing arena_backing = Backing::normal;
+  size_t huge_page_bytes = 0;
+};
+
+/* Apply the "memory" sub-config: "lock" calls mlockall for current and
+ * future pages; "arena_mb" sizes the process arena, which "huge_pages"
+ * (default true) requests in huge pages; "prefault" (default true when
+ * locking or with an arena) pre-faults later mappings, such as socket
+ * decode buffers.  Logs, and returns, what was actually obtained.  Only the
+ * first call creates the arena. */
+Report configure(Config);
+
+} // namespace memory
+} // namespace apex
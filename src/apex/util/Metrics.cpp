@@ -0,0 +1,243 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/Metrics.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/EventLoop.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace apex
+{
+namespace metrics
+{
+
+size_t assign_thread_cell()
+{
+  static std::atomic<size_t> next{0};
+  return next.fetch_add(1, std::memory_order_relaxed) % cell_count;
+}
+
+
+uint64_t Counter::value() const
+{
+  uint64_t total = 0;
+  for (auto& cell : _cells)
+    total += cell.value.load(std::memory_order_relaxed);
+  return total;
+}
+
+
+Histogram::Snapshot Histogram::snapshot() const
+{
+  Snapshot snap;
+  for (auto& cell : _cells) {
+    for (size_t i = 0; i < bucket_count; i++) {
+      auto n = cell.counts[i].load(std::memory_order_relaxed);
+      snap.counts[i] += n;
+      snap.count += n;
+    }
+    snap.sum += cell.sum.load(std::memory_order_relaxed);
+  }
+  return snap;
+}
+
+
+Registry& Registry::instance()
+{
+  // never destroyed, so that metrics remain valid for threads still running
+  // during process exit
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+
+Registry::Entry& Registry::find_or_create(const std::string& name,
+                                          const std::string& help,
+                                          const char* type)
+{
+  auto ins = _entries.insert({name, Entry{}});
+  auto& entry = ins.first->second;
+  if (ins.second)
+    entry.help = help;
+  const char* existing = entry.counter     ? "counter"
+                         : entry.gauge     ? "gauge"
+                         : entry.histogram ? "histogram"
+                                           : type;
+  if (std::string(existing) != type)
+    throw std::runtime_error("metric '" + name + "' already registered as a " +
+                             existing);
+  return entry;
+}
+
+
+Counter& Registry::counter(const std::string& name, const std::string& help)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto& entry = find_or_create(name, help, "counter");
+  if (!entry.counter)
+    entry.counter = std::make_unique<Counter>();
+  return *entry.counter;
+}
+
+
+Gauge& Registry::gauge(const std::string& name, const std::string& help)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto& entry = find_or_create(name, help, "gauge");
+  if (!entry.gauge)
+    entry.gauge = std::make_unique<Gauge>();
+  return *entry.gauge;
+}
+
+
+Histogram& Registry::histogram(const std::string& name,
+                               const std::string& help)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto& entry = find_or_create(name, help, "histogram");
+  if (!entry.histogram)
+    entry.histogram = std::make_unique<Histogram>();
+  return *entry.histogram;
+}
+
+
+size_t Registry::add_collector(std::function<void()> fn)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  auto id = _next_collector++;
+  _collectors.insert({id, std::move(fn)});
+  return id;
+}
+
+
+void Registry::remove_collector(size_t id)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  _collectors.erase(id);
+}
+
+
+void Registry::write_prometheus(std::ostream& os)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  for (auto& item : _collectors)
+    item.second();
+
+  // labelled metrics of a family are adjacent in name order, since '{'
+  // follows every character valid in a metric name
+  std::string family_written;
+  for (auto& [name, entry] : _entries) {
+    const auto brace = name.find('{');
+    const std::string family = name.substr(0, brace);
+    const std::string labels =
+        brace == std::string::npos ? ""
+                                   : name.substr(brace + 1, name.size() - brace - 2);
+    const char* type = entry.counter ? "counter"
+                       : entry.gauge ? "gauge"
+                                     : "histogram";
+
+    if (family != family_written) {
+      if (!entry.help.empty())
+        os << "# HELP " << family << " " << entry.help << "\n";
+      os << "# TYPE " << family << " " << type << "\n";
+      family_written = family;
+    }
+
+    if (entry.counter) {
+      os << name << " " << entry.counter->value() << "\n";
+    } else if (entry.gauge) {
+      os << name << " " << entry.gauge->value() << "\n";
+    } else if (entry.histogram) {
+      auto snap = entry.histogram->snapshot();
+      const std::string bucket_labels = labels.empty() ? "" : labels + ",";
+      const std::string suffix_labels =
+          labels.empty() ? "" : "{" + labels + "}";
+      uint64_t cumulative = 0;
+      for (size_t i = 0; i + 1 < Histogram::bucket_count; i++) {
+        cumulative += snap.counts[i];
+        os << family << "_bucket{" << bucket_labels << "le=\""
+           << (uint64_t(1) << i) << "\"} " << cumulative << "\n";
+      }
+      os << family << "_bucket{" << bucket_labels << "le=\"+Inf\"} "
+         << snap.count << "\n"
+         << family << "_sum" << suffix_labels << " " << snap.sum << "\n"
+         << family << "_count" << suffix_labels << " " << snap.count << "\n";
+    }
+  }
+}
+
+
+static void write_file(const std::filesystem::path& path)
+{
+  std::ostringstream oss;
+  registry().write_prometheus(oss);
+
+  auto tmp = path;
+  tmp += ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    file << oss.str();
+    if (!file) {
+      LOG_WARN("failed to write metrics to " << tmp);
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec)
+    LOG_WARN("failed to replace metrics file " << path << ": " << ec.message());
+}
+
+
+void configure(Config config, EventLoop& event_loop)
+{
+  auto metrics_config = config.get_sub_config("metrics", Config::empty_config());
+
+  if (metrics_config.contains("path")) {
+    std::filesystem::path path = metrics_config.get_string("path");
+    auto interval =
+        std::chrono::seconds(metrics_config.get_uint("interval_sec", 10));
+    if (interval.count() == 0)
+      interval = std::chrono::seconds(10);
+    LOG_INFO("writing metrics to " << path << " every " << interval.count()
+                                   << "s");
+    event_loop.dispatch(interval, [path, interval]() -> std::chrono::milliseconds {
+      write_file(path);
+      return interval;
+    });
+  }
+
+  auto log_interval = std::chrono::seconds(metrics_config.get_uint("log_sec", 0));
+  if (log_interval.count() > 0)
+    event_loop.dispatch(log_interval,
+                        [log_interval]() -> std::chrono::milliseconds {
+                          std::ostringstream oss;
+                          registry().write_prometheus(oss);
+                          LOG_INFO("metrics:\n" << oss.str());
+                          return log_interval;
+                        });
+}
+
+} // namespace metrics
+} // namespace apex
@@ -0,0 +1,186 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace apex
+{
+class Config;
+class EventLoop;
+
+/* Runtime metrics: counters, gauges and histograms, registered by name in a
+ * process wide registry, and exported in the Prometheus text format.  An
+ * update is a relaxed atomic add to a cell of the updating thread; cells are
+ * cache-line padded, so that threads do not contend, and are summed when the
+ * metric is read.  Threads beyond the cell count share cells, which remains
+ * correct but may contend.  Metrics are registered once, typically into a
+ * function-local static at the update site, and are never removed. */
+namespace metrics
+{
+
+constexpr size_t cell_count = 16;
+
+// Cell index of the calling thread, assigned on first use.
+size_t assign_thread_cell();
+
+inline size_t this_thread_cell()
+{
+  thread_local const size_t cell = assign_thread_cell();
+  return cell;
+}
+
+
+/* Monotonic count of events, or of bytes, etc. */
+class Counter
+{
+public:
+  void add(uint64_t n = 1)
+  {
+    _cells[this_thread_cell()].value.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] uint64_t value() const;
+
+private:
+  struct alignas(64) Cell {
+    std::atomic<uint64_t> value{0};
+  };
+  std::array<Cell, cell_count> _cells;
+};
+
+
+/* Level that may rise and fall, such as a number of sessions; either set by
+ * a single owner, or adjusted by several. */
+class Gauge
+{
+public:
+  void set(int64_t v) { _value.store(v, std::memory_order_relaxed); }
+  void add(int64_t n) { _value.fetch_add(n, std::memory_order_relaxed); }
+
+  [[nodiscard]] int64_t value() const
+  {
+    return _value.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<int64_t> _value{0};
+};
+
+
+/* Distribution of values, such as latencies in nanoseconds, in power of two
+ * buckets: bucket i counts values above 2^(i-1) and up to 2^i, and the last
+ * bucket all greater values.  A record is two relaxed adds, of the bucket and
+ * of the sum. */
+class Histogram
+{
+public:
+  static constexpr size_t bucket_count = 40;
+
+  void record(uint64_t value)
+  {
+    auto& cell = _cells[this_thread_cell()];
+    cell.counts[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+    cell.sum.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  static size_t bucket_of(uint64_t value)
+  {
+    if (value <= 1)
+      return 0;
+    const size_t bits = 64 - __builtin_clzll(value - 1); // ceil(log2(value))
+    return bits < bucket_count ? bits : bucket_count - 1;
+  }
+
+  struct Snapshot {
+    std::array<uint64_t, bucket_count> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+  };
+
+  [[nodiscard]] Snapshot snapshot() const;
+
+private:
+  struct alignas(64) Cell {
+    std::array<std::atomic<uint64_t>, bucket_count> counts{};
+    std::atomic<uint64_t> sum{0};
+  };
+  std::array<Cell, cell_count> _cells;
+};
+
+
+class Registry
+{
+public:
+  static Registry& instance();
+
+  /* Find or create the named metric; throws if the name is already held by
+   * a metric of another type.  The reference remains valid for the life of
+   * the process.  A name may carry labels, as in
+   * `requests_total{type="new_order"}`; metrics of one name and different
+   * labels form a family, which shares the help text of its first member. */
+  Counter& counter(const std::string& name, const std::string& help);
+  Gauge& gauge(const std::string& name, const std::string& help);
+  Histogram& histogram(const std::string& name, const std::string& help);
+
+  /* Collectors are invoked whenever the metrics are read, to refresh gauges
+   * from state maintained elsewhere; they may be called on any thread, and
+   * must not themselves register metrics or collectors.  Once
+   * remove_collector returns, the collector is no longer being called.
+   * Returns an id for remove_collector. */
+  size_t add_collector(std::function<void()>);
+  void remove_collector(size_t id);
+
+  /* Write all metrics, in name order, in the Prometheus text format. */
+  void write_prometheus(std::ostream&);
+
+private:
+  struct Entry {
+    std::string help;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  Entry& find_or_create(const std::string& name, const std::string& help,
+                        const char* type);
+
+  std::mutex _mutex;
+  std::map<std::string, Entry> _entries;
+  std::map<size_t, std::function<void()>> _collectors;
+  size_t _next_collector = 1;
+};
+
+inline Registry& registry() { return Registry::instance(); }
+
+/* If the "metrics" sub-config sets "path", write the metrics to that file in
+ * the Prometheus text format every "interval_sec" (default 10), replacing it
+ * atomically, as suits the node exporter textfile collector; if it sets
+ * "log_sec", also log them at that interval.  Timers run on the event loop. */
+void configure(Config, EventLoop&);
+
+} // namespace metrics
+} // namespace apex
@@ -0,0 +1,139 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/MemoryPolicy.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+namespace apex
+{
+
+/* Bounded multi-producer, single-consumer queue, based on the sequenced-slot
+ * ring design by Dmitry Vyukov.  All slots are allocated at construction, so
+ * push & pop never allocate (other than whatever T itself does when moved).
+ * Producers contend only on a single atomic counter; the consumer makes no
+ * atomic read-modify-write operations at all.  Capacity is rounded up to the
+ * next power of two.  Slots come from the memory arena, if configured. */
+template <typename T> class MpscQueue
+{
+public:
+  explicit MpscQueue(size_t capacity)
+    : _mask(round_up_pow2(capacity) - 1),
+      _slots(memory::make_array<Slot>(_mask + 1)),
+      _head(0),
+      _tail(0)
+  {
+    for (size_t i = 0; i <= _mask; ++i)
+      _slots[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  /** Attempt to push an item; returns false if the queue is full, in which
+   * case `item` is left untouched. Safe to call from any thread. */
+  bool try_push(T&& item)
+  {
+    size_t pos = _head.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = _slots[pos & _mask];
+      const size_t seq = slot.seq.load(std::memory_order_acquire);
+      const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (_head.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+        {
+          slot.value = std::move(item);
+          slot.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; /* full */
+      } else {
+        pos = _head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /** Attempt to pop an item; returns false if the queue is empty.  Must only be
+   * called from the single consumer thread. */
+  bool try_pop(T& item)
+  {
+    Slot& slot = _slots[_tail & _mask];
+    const size_t seq = slot.seq.load(std::memory_order_acquire);
+    if (static_cast<std::ptrdiff_t>(seq - (_tail + 1)) < 0)
+      return false; /* empty, or producer has not yet completed its write */
+    item = std::move(slot.value);
+    slot.value = T{};
+    slot.seq.store(_tail + _mask + 1, std::memory_order_release);
+    ++_tail;
+    return true;
+  }
+
+  /** Approximate test for emptiness.  Exact when called from the consumer
+   * thread with no concurrent producers. */
+  bool empty() const
+  {
+    const Slot& slot = _slots[_tail & _mask];
+    const size_t seq = slot.seq.load(std::memory_order_acquire);
+    return static_cast<std::ptrdiff_t>(seq - (_tail + 1)) < 0;
+  }
+
+  /** Approximate number of items, including any still being written.  Must
+   * only be called from the consumer thread. */
+  size_t size_approx() const
+  {
+    const size_t head = _head.load(std::memory_order_relaxed);
+    return head > _tail ? head - _tail : 0;
+  }
+
+  size_t capacity() const { return _mask + 1; }
+
+private:
+  static constexpr size_t cache_line = 64;
+
+  static size_t round_up_pow2(size_t n)
+  {
+    if (n < 2)
+      throw std::invalid_argument("MpscQueue capacity must be at least 2");
+    size_t v = 1;
+    while (v < n)
+      v <<= 1;
+    return v;
+  }
+
+  struct Slot {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  const size_t _mask;
+  memory::unique_array<Slot> _slots;
+
+  // producer and consumer positions are kept on separate cache lines
+  alignas(cache_line) std::atomic<size_t> _head;
+  alignas(cache_line) size_t _tail;
+};
+
+} // namespace apex
@@ -0,0 +1,200 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/Numa.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace apex
+{
+namespace numa
+{
+
+static const std::filesystem::path nodes_dir = "/sys/devices/system/node";
+
+static std::atomic<int> process_default_node{-1};
+
+
+int node_count()
+{
+  std::error_code ec;
+  int count = 0;
+  for (auto& entry : std::filesystem::directory_iterator(nodes_dir, ec)) {
+    auto name = entry.path().filename().string();
+    if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+        std::isdigit(static_cast<unsigned char>(name[4])))
+      count++;
+  }
+  return count;
+}
+
+
+std::vector<int> node_cpus(int node)
+{
+  // a cpulist has the form "0-3,8-11"
+  std::ifstream file(nodes_dir / ("node" + std::to_string(node)) / "cpulist");
+  std::string list;
+  std::vector<int> cpus;
+  if (!std::getline(file, list))
+    return cpus;
+
+  std::istringstream iss(list);
+  std::string range;
+  while (std::getline(iss, range, ',')) {
+    int first = 0, last = 0;
+    char dash = 0;
+    std::istringstream rs(range);
+    if (!(rs >> first))
+      continue;
+    last = (rs >> dash >> last && dash == '-') ? last : first;
+    for (int cpu = first; cpu <= last; cpu++)
+      cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+
+int interface_node(const std::string& interface)
+{
+  std::ifstream file(std::filesystem::path("/sys/class/net") / interface /
+                     "device" / "numa_node");
+  int node = -1;
+  if (!(file >> node))
+    return -1;
+  return node;
+}
+
+
+void bind_thread(int node, bool set_affinity)
+{
+#ifndef _WIN32
+  if (set_affinity) {
+    auto cpus = node_cpus(node);
+    if (cpus.empty())
+      THROW("no cpus found for numa node " << node);
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    for (int cpu : cpus)
+      if (cpu < CPU_SETSIZE)
+        CPU_SET(cpu, &cpuset);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (err)
+      THROW("failed to set affinity to numa node " << node << ": "
+            << strerror(err));
+  }
+
+  // set_mempolicy(MPOL_PREFERRED), as libnuma does
+  constexpr int mpol_preferred = 1;
+  constexpr size_t mask_words = 16;
+  unsigned long mask[mask_words] = {};
+  const size_t bits = sizeof(unsigned long) * 8;
+  if (node < 0 || static_cast<size_t>(node) >= mask_words * bits)
+    THROW("numa node " << node << " out of range");
+  mask[node / bits] |= 1UL << (node % bits);
+  if (::syscall(SYS_set_mempolicy, mpol_preferred, mask,
+                mask_words * bits + 1) != 0)
+    THROW("failed to prefer memory of numa node " << node << ": "
+          << strerror(errno));
+#else
+  THROW("numa placement not supported on this platform");
+#endif
+}
+
+
+void set_default_node(int node) { process_default_node.store(node); }
+
+int default_node() { return process_default_node.load(); }
+
+
+void try_bind_to_default_node(const char* thread_name)
+{
+  const int node = default_node();
+  if (node < 0)
+    return;
+  try {
+    bind_thread(node);
+    LOG_INFO(thread_name << " thread placed on numa node " << node);
+  } catch (std::exception& e) {
+    LOG_WARN(thread_name << " thread numa placement not applied: "
+             << e.what());
+  }
+}
+
+
+int configure(Config threads_config)
+{
+  auto numa_config = threads_config.get_sub_config("numa", Config::empty_config());
+  if (numa_config.is_empty())
+    return -1;
+
+  const int nodes = node_count();
+  std::ostringstream topology;
+  for (int node = 0; node < nodes; node++) {
+    auto cpus = node_cpus(node);
+    topology << (node ? "; " : "") << "node " << node << ": " << cpus.size()
+             << " cpus";
+  }
+  LOG_INFO("numa topology: " << nodes << " nodes" << (nodes ? ", " : "")
+           << topology.str());
+
+  int node = -1;
+  if (numa_config.contains("nic")) {
+    auto nic = numa_config.get_string("nic");
+    node = interface_node(nic);
+    if (node < 0) {
+      LOG_WARN("numa node of interface " << QUOTE(nic)
+               << " unknown, threads not placed");
+      return -1;
+    }
+    LOG_INFO("interface " << QUOTE(nic) << " is on numa node " << node);
+  } else {
+    node = static_cast<int>(numa_config.get_uint("node"));
+  }
+
+  if (node >= nodes) {
+    std::ostringstream oss;
+    oss << "numa node " << node << " does not exist, " << numa_config.path();
+    throw ConfigError(oss.str());
+  }
+
+  set_default_node(node);
+  try {
+    bind_thread(node, false);
+    LOG_INFO("service threads and memory placed on numa node " << node);
+  } catch (std::exception& e) {
+    LOG_WARN("numa memory placement not applied: " << e.what());
+  }
+  return node;
+}
+
+} // namespace numa
+} // namespace apex
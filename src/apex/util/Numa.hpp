@@ -0,0 +1,67 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class Config;
+
+/* NUMA topology and placement.  The topology is read from sysfs, without a
+ * dependency on libnuma.  Placing a thread on a node restricts it to the
+ * node's cpus, and makes the node its preferred source of memory, so that
+ * the queues and buffers it allocates, and first touches, are node local.
+ * Threads inherit the memory policy of the thread that creates them. */
+namespace numa
+{
+
+// Number of nodes, or 0 if the topology is unavailable.
+int node_count();
+
+// CPUs of a node, in ascending order; empty if unknown.
+std::vector<int> node_cpus(int node);
+
+// Node a network interface is attached to, or -1 if unknown or virtual.
+int interface_node(const std::string& interface);
+
+/* Place the calling thread on `node`: prefer its memory, and unless
+ * `set_affinity` is false, such as for a thread pinned to a single cpu,
+ * restrict it to the node's cpus.  Throws upon failure. */
+void bind_thread(int node, bool set_affinity = true);
+
+/* Node for service threads without their own placement, or -1 for none. */
+void set_default_node(int node);
+int default_node();
+
+/* Place the calling thread on the default node, if any, logging rather
+ * than throwing upon failure; for threads created outside of the services'
+ * thread configuration, such as the HTTP client thread. */
+void try_bind_to_default_node(const char* thread_name);
+
+/* Apply the "numa" field of a threads config: the node is given either as
+ * "node", or as "nic", the network interface whose node to use.  Logs the
+ * topology, sets the default node, and binds the memory policy of the
+ * calling thread, which should be the one about to construct the event and
+ * IO loops.  Returns the node, or -1 if not configured. */
+int configure(Config threads_config);
+
+} // namespace numa
+} // namespace apex
@@ -0,0 +1,187 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/MemoryPolicy.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace apex
+{
+
+/* Free list of fixed size memory blocks, for objects that are created and
+ * destroyed at a high rate.  Released blocks are kept for reuse, up to
+ * max_free of them, rather than returned to the heap.  The block size is set
+ * by the first allocation; requests of any other size go to the heap.  Blocks
+ * can be released from any thread.  New blocks come from the memory arena, if
+ * configured; those are always kept for reuse, since the arena cannot take
+ * them back.  The blocks held, in use or free, are charged to `account`, if
+ * given. */
+class BlockPool
+{
+public:
+  explicit BlockPool(size_t max_free = 4096,
+                     memory::Account* account = nullptr)
+    : _max_free(max_free), _account(account)
+  {
+  }
+
+  ~BlockPool()
+  {
+    if (_account)
+      _account->add(-static_cast<int64_t>(_free * _block_size));
+    while (_head) {
+      auto* next = _head->next;
+      memory::deallocate(_head);
+      _head = next;
+    }
+  }
+
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+
+  void* allocate(size_t size)
+  {
+    {
+      auto lock = std::scoped_lock(_mutex);
+      if (_block_size == 0)
+        _block_size = std::max(size, sizeof(FreeBlock));
+      if (size <= _block_size && _head) {
+        auto* block = _head;
+        _head = block->next;
+        _free--;
+        return block;
+      }
+      if (size <= _block_size)
+        size = _block_size;
+    }
+    if (_account)
+      _account->add(size);
+    return memory::allocate(size);
+  }
+
+  void deallocate(void* p, size_t size)
+  {
+    {
+      auto lock = std::scoped_lock(_mutex);
+      if (size <= _block_size &&
+          (_free < _max_free || memory::in_arena(p))) {
+        _head = new (p) FreeBlock{_head};
+        _free++;
+        return;
+      }
+      if (_account)
+        _account->add(-static_cast<int64_t>(std::max(size, _block_size)));
+    }
+    memory::deallocate(p);
+  }
+
+  [[nodiscard]] size_t free_count() const
+  {
+    auto lock = std::scoped_lock(_mutex);
+    return _free;
+  }
+
+  [[nodiscard]] size_t block_size() const
+  {
+    auto lock = std::scoped_lock(_mutex);
+    return _block_size;
+  }
+
+private:
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  mutable std::mutex _mutex;
+  FreeBlock* _head = nullptr;
+  size_t _block_size = 0;
+  size_t _free = 0;
+  size_t _max_free;
+  memory::Account* _account;
+};
+
+
+/* Allocator drawing single objects from a BlockPool.  Each allocator keeps its
+ * pool alive, so objects may safely outlive the owner of the pool. */
+template <typename T> class PoolAllocator
+{
+public:
+  using value_type = T;
+
+  explicit PoolAllocator(std::shared_ptr<BlockPool> pool)
+    : _pool(std::move(pool))
+  {
+  }
+
+  template <typename U>
+  PoolAllocator(const PoolAllocator<U>& other) : _pool(other.pool())
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+    if (n == 1)
+      return static_cast<T*>(_pool->allocate(sizeof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t n)
+  {
+    if (n == 1)
+      _pool->deallocate(p, sizeof(T));
+    else
+      ::operator delete(p);
+  }
+
+  [[nodiscard]] const std::shared_ptr<BlockPool>& pool() const { return _pool; }
+
+  template <typename U> bool operator==(const PoolAllocator<U>& rhs) const
+  {
+    return _pool == rhs.pool();
+  }
+
+  template <typename U> bool operator!=(const PoolAllocator<U>& rhs) const
+  {
+    return _pool != rhs.pool();
+  }
+
+private:
+  std::shared_ptr<BlockPool> _pool;
+};
+
+
+/* Construct a shared object whose storage, including the reference counts,
+ * comes from a pool.  Weak pointers work as for std::make_shared; the block
+ * returns to the pool once the last weak pointer is released. */
+template <typename T, typename... Args>
+std::shared_ptr<T> make_pooled(const std::shared_ptr<BlockPool>& pool,
+                               Args&&... args)
+{
+  return std::allocate_shared<T>(PoolAllocator<T>(pool),
+                                 std::forward<Args>(args)...);
+}
+
+} // namespace apex
@@ -0,0 +1,167 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+
+/* Hash map of non-zero 64-bit integer keys, held in a flat array with linear
+ * probing; zero marks an empty slot.  Erase shifts later entries of the probe
+ * run back, so there are no tombstones and lookups stay short under churn.
+ * The table doubles when over half full.  Pointers to values are invalidated
+ * by any insert or erase. */
+template <typename V> class OpenAddressMap
+{
+public:
+  explicit OpenAddressMap(size_t capacity = 16)
+  {
+    size_t n = 16;
+    while (n < capacity * 2)
+      n <<= 1;
+    _slots.resize(n);
+  }
+
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] bool empty() const { return _size == 0; }
+
+  /* Bytes of the table, which grows but never shrinks. */
+  [[nodiscard]] size_t bytes() const { return _slots.capacity() * sizeof(Slot); }
+
+  V* find(uint64_t key)
+  {
+    if (key == 0) // marks an empty slot, so is never present
+      return nullptr;
+    for (size_t i = index_of(key);; i = next(i)) {
+      auto& slot = _slots[i];
+      if (slot.key == key)
+        return &slot.value;
+      if (slot.key == 0)
+        return nullptr;
+    }
+  }
+
+  const V* find(uint64_t key) const
+  {
+    return const_cast<OpenAddressMap*>(this)->find(key);
+  }
+
+  /* Insert, or replace, the value of a key, which must be non-zero. */
+  V& insert(uint64_t key, V value)
+  {
+    assert(key != 0);
+    if ((_size + 1) * 2 > _slots.size())
+      grow();
+    for (size_t i = index_of(key);; i = next(i)) {
+      auto& slot = _slots[i];
+      if (slot.key == 0) {
+        slot.key = key;
+        slot.value = std::move(value);
+        _size++;
+        return slot.value;
+      }
+      if (slot.key == key) {
+        slot.value = std::move(value);
+        return slot.value;
+      }
+    }
+  }
+
+  bool erase(uint64_t key)
+  {
+    if (key == 0)
+      return false;
+    size_t i = index_of(key);
+    while (_slots[i].key != key) {
+      if (_slots[i].key == 0)
+        return false;
+      i = next(i);
+    }
+
+    // shift back any later entry of the run that may occupy the hole
+    size_t hole = i;
+    for (size_t j = next(hole); _slots[j].key != 0; j = next(j)) {
+      size_t home = index_of(_slots[j].key);
+      if (((j - home) & mask()) >= ((j - hole) & mask())) {
+        _slots[hole] = std::move(_slots[j]);
+        hole = j;
+      }
+    }
+    _slots[hole] = Slot{};
+    _size--;
+    return true;
+  }
+
+  template <typename F> void for_each(F&& fn)
+  {
+    for (auto& slot : _slots)
+      if (slot.key)
+        fn(slot.key, slot.value);
+  }
+
+  /* Size the table for `n` entries without further growth. */
+  void reserve(size_t n)
+  {
+    while (_slots.size() < n * 2)
+      grow();
+  }
+
+  void clear()
+  {
+    for (auto& slot : _slots)
+      slot = Slot{};
+    _size = 0;
+  }
+
+private:
+  struct Slot {
+    uint64_t key = 0;
+    V value{};
+  };
+
+  size_t mask() const { return _slots.size() - 1; }
+  size_t next(size_t i) const { return (i + 1) & mask(); }
+
+  size_t index_of(uint64_t key) const
+  {
+    // Fibonacci hashing, so sequential keys spread across the table
+    return (key * 0x9e3779b97f4a7c15ull) >> (64 - _bits()) & mask();
+  }
+
+  int _bits() const { return __builtin_ctzll(_slots.size()); }
+
+  void grow()
+  {
+    std::vector<Slot> old(_slots.size() * 2);
+    old.swap(_slots);
+    _size = 0;
+    for (auto& slot : old)
+      if (slot.key)
+        insert(slot.key, std::move(slot.value));
+  }
+
+  std::vector<Slot> _slots;
+  size_t _size = 0;
+};
+
+} // namespace apex
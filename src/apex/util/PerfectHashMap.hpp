@@ -0,0 +1,189 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace apex
+{
+
+/* Immutable map of string keys, built once from a known set of keys, so
+ * that no two keys share a slot.  Keys are hashed once into buckets of a few
+ * keys each, and each bucket has its own seed, chosen so that its keys land
+ * in slots left free by the buckets placed before it ("hash and displace"),
+ * which keeps the table at twice the keys however many there are.  A lookup
+ * is then a hash of the key, one seed, one slot, and one compare to reject
+ * keys not in the set, with no probing.  Intended for routing tables that
+ * are rebuilt, off the hot path, only when their set of keys changes. */
+template <typename V> class PerfectHashMap
+{
+public:
+  PerfectHashMap() = default;
+
+  explicit PerfectHashMap(std::vector<std::pair<std::string, V>> items)
+  {
+    // a table of at least twice the keys, and a bucket for every two keys,
+    // usually admits a seed for every bucket within a few attempts; the table
+    // grows if one is not found
+    size_t n = 4;
+    while (n < items.size() * 2)
+      n <<= 1;
+
+    for (;; n <<= 1)
+      if (try_build(items, n))
+        return;
+  }
+
+  [[nodiscard]] size_t size() const { return _size; }
+  [[nodiscard]] bool empty() const { return _size == 0; }
+
+  const V* find(std::string_view key) const
+  {
+    if (_slots.empty())
+      return nullptr;
+    const uint64_t h = hash(key);
+    auto& slot = _slots[displace(h, _seeds[h >> _bucket_shift]) & _mask];
+    return (slot.used && slot.key == key) ? &slot.value : nullptr;
+  }
+
+  V* find(std::string_view key)
+  {
+    return const_cast<V*>(std::as_const(*this).find(key));
+  }
+
+private:
+  static constexpr uint32_t max_seed_attempts = 1u << 12;
+
+  struct Slot {
+    std::string key;
+    V value{};
+    bool used = false;
+  };
+
+  /* FNV-1a over the key, with a final mix so that the high bits, which
+   * select the bucket, depend on every byte. */
+  static uint64_t hash(std::string_view key)
+  {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : key) {
+      h ^= c;
+      h *= 0x100000001b3ull;
+    }
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    h ^= h >> 32;
+    return h;
+  }
+
+  /* The slot of a key hashing to `h`, in a bucket with `seed`; the low bits
+   * select the slot. */
+  static uint64_t displace(uint64_t h, uint32_t seed)
+  {
+    h ^= seed * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ull;
+    h ^= h >> 32;
+    return h;
+  }
+
+  bool try_build(const std::vector<std::pair<std::string, V>>& items, size_t n)
+  {
+    // a bucket for every four slots, so for every two keys, at least two
+    unsigned bits = 1;
+    while ((size_t(1) << bits) < n / 4)
+      bits++;
+    const unsigned shift = 64 - bits;
+    const size_t bucket_count = size_t(1) << bits;
+
+    // the items of each bucket, a repeated key keeping its first value
+    std::vector<uint64_t> hashes(items.size());
+    std::vector<std::vector<size_t>> buckets(bucket_count);
+    for (size_t i = 0; i < items.size(); i++) {
+      hashes[i] = hash(items[i].first);
+      auto& bucket = buckets[hashes[i] >> shift];
+      bool repeated = false;
+      for (auto j : bucket)
+        repeated |= items[j].first == items[i].first;
+      if (!repeated)
+        bucket.push_back(i);
+    }
+
+    // the largest buckets are placed first, while most slots are free
+    std::vector<size_t> order(bucket_count);
+    for (size_t b = 0; b < bucket_count; b++)
+      order[b] = b;
+    std::stable_sort(order.begin(), order.end(), [&buckets](size_t x, size_t y) {
+      return buckets[x].size() > buckets[y].size();
+    });
+
+    std::vector<Slot> slots(n);
+    std::vector<uint32_t> seeds(bucket_count, 0);
+    std::vector<size_t> placed;
+    for (auto b : order) {
+      auto& bucket = buckets[b];
+      if (bucket.empty())
+        break;
+
+      uint32_t seed = 1;
+      for (; seed <= max_seed_attempts; seed++) {
+        placed.clear();
+        for (auto i : bucket) {
+          size_t at = displace(hashes[i], seed) & (n - 1);
+          if (slots[at].used ||
+              std::find(placed.begin(), placed.end(), at) != placed.end())
+            break;
+          placed.push_back(at);
+        }
+        if (placed.size() == bucket.size())
+          break;
+      }
+      if (seed > max_seed_attempts)
+        return false;
+
+      seeds[b] = seed;
+      for (size_t k = 0; k < bucket.size(); k++) {
+        auto& slot = slots[placed[k]];
+        slot.key = items[bucket[k]].first;
+        slot.value = items[bucket[k]].second;
+        slot.used = true;
+      }
+    }
+
+    _slots = std::move(slots);
+    _seeds = std::move(seeds);
+    _mask = n - 1;
+    _bucket_shift = shift;
+    _size = 0;
+    for (auto& slot : _slots)
+      _size += slot.used;
+    return true;
+  }
+
+  std::vector<Slot> _slots;
+  std::vector<uint32_t> _seeds; // by bucket
+  uint64_t _mask = 0;
+  unsigned _bucket_shift = 63;
+  size_t _size = 0;
+};
+
+} // namespace apex
@@ -0,0 +1,310 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/Profiler.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/EventLoop.hpp>
+#include <apex/util/platform.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <ostream>
+#include <thread>
+
+namespace apex
+{
+namespace profile
+{
+
+/* Ring of the most recent zones of one thread, written only by that thread.
+ * Like a sequence lock, the writer claims an index before overwriting its
+ * slot, and commits it afterwards; a reader copies the committed zones, and
+ * then discards those whose slots were claimed again during the copy. */
+class Profiler::Ring
+{
+public:
+  struct Event {
+    const char* name;
+    int64_t start_ns;
+    int64_t duration_ns;
+  };
+
+  Ring(size_t capacity, long tid, std::string name)
+    : tid(tid), name(std::move(name)), _slots(capacity)
+  {
+  }
+
+  void push(const char* zone, int64_t start_ns, int64_t end_ns)
+  {
+    const uint64_t n = _committed.load(std::memory_order_relaxed);
+    _claimed.store(n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    auto& slot = _slots[n % _slots.size()];
+    slot.name.store(zone, std::memory_order_relaxed);
+    slot.start_ns.store(start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+    _committed.store(n + 1, std::memory_order_release);
+  }
+
+  std::vector<Event> read() const
+  {
+    const uint64_t capacity = _slots.size();
+    const uint64_t end = _committed.load(std::memory_order_acquire);
+    const uint64_t begin = end > capacity ? end - capacity : 0;
+
+    std::vector<Event> events;
+    events.reserve(end - begin);
+    for (uint64_t i = begin; i < end; i++) {
+      auto& slot = _slots[i % capacity];
+      events.push_back({slot.name.load(std::memory_order_relaxed),
+                        slot.start_ns.load(std::memory_order_relaxed),
+                        slot.duration_ns.load(std::memory_order_relaxed)});
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const uint64_t claimed = _claimed.load(std::memory_order_relaxed);
+    const uint64_t valid = claimed > capacity ? claimed - capacity : 0;
+    if (valid > begin)
+      events.erase(events.begin(),
+                   events.begin() + std::min<uint64_t>(valid - begin,
+                                                        events.size()));
+    return events;
+  }
+
+  const long tid;
+  std::string name; // under the profiler mutex
+
+private:
+  struct Slot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> start_ns{0};
+    std::atomic<int64_t> duration_ns{0};
+  };
+
+  std::vector<Slot> _slots;
+  std::atomic<uint64_t> _claimed{0};
+  std::atomic<uint64_t> _committed{0};
+};
+
+
+namespace
+{
+// Ring of the calling thread, removed from the profiler as the thread exits.
+struct ThreadState {
+  std::shared_ptr<Profiler::Ring> ring;
+  std::string name;
+  std::function<void(Profiler::Ring*)> on_exit;
+
+  ~ThreadState()
+  {
+    if (ring && on_exit)
+      on_exit(ring.get());
+  }
+};
+
+thread_local ThreadState thread_state;
+
+
+void write_json_string(std::ostream& os, const char* s)
+{
+  os << '"';
+  for (; s && *s; s++) {
+    const char c = *s;
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (static_cast<unsigned char>(c) >= 0x20)
+      os << c;
+  }
+  os << '"';
+}
+
+
+// Microseconds, as the Chrome trace format expects, to nanosecond precision.
+void write_micros(std::ostream& os, int64_t ns)
+{
+  if (ns < 0) {
+    os << '-';
+    ns = -ns;
+  }
+  const auto frac = ns % 1000;
+  os << ns / 1000 << '.' << char('0' + frac / 100) << char('0' + frac / 10 % 10)
+     << char('0' + frac % 10);
+}
+} // namespace
+
+
+Profiler& Profiler::instance()
+{
+  // never destroyed, so that threads still running during process exit can
+  // record zones
+  static Profiler* profiler = new Profiler;
+  return *profiler;
+}
+
+
+void Profiler::set_ring_capacity(size_t zones)
+{
+  std::lock_guard<std::mutex> guard(_mutex);
+  _ring_capacity = std::max<size_t>(zones, 1);
+}
+
+
+void Profiler::set_thread_name(std::string name)
+{
+  auto& state = thread_state;
+  state.name = std::move(name);
+  if (state.ring) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    state.ring->name = state.name;
+  }
+}
+
+
+Profiler::Ring& Profiler::thread_ring()
+{
+  auto& state = thread_state;
+  if (!state.ring) {
+    std::lock_guard<std::mutex> guard(_mutex);
+    state.ring =
+        std::make_shared<Ring>(_ring_capacity, apex::thread_id(), state.name);
+    state.on_exit = [this](Ring* ring) {
+      std::lock_guard<std::mutex> guard(_mutex);
+      _rings.erase(std::remove_if(_rings.begin(), _rings.end(),
+                                  [ring](auto& r) { return r.get() == ring; }),
+                   _rings.end());
+    };
+    _rings.push_back(state.ring);
+  }
+  return *state.ring;
+}
+
+
+void Profiler::record(const char* name, int64_t start_ns, int64_t end_ns)
+{
+  thread_ring().push(name, start_ns, end_ns);
+}
+
+
+size_t Profiler::write_chrome_trace(std::ostream& os)
+{
+  std::vector<std::pair<std::shared_ptr<Ring>, std::string>> rings;
+  {
+    std::lock_guard<std::mutex> guard(_mutex);
+    for (auto& ring : _rings)
+      rings.emplace_back(ring, ring->name);
+  }
+
+  const int pid = apex::getpid();
+  size_t written = 0;
+  const char* sep = "\n";
+  os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+  for (auto& [ring, name] : rings) {
+    if (!name.empty()) {
+      os << sep << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+         << ",\"tid\":" << ring->tid << ",\"args\":{\"name\":";
+      write_json_string(os, name.c_str());
+      os << "}}";
+      sep = ",\n";
+    }
+    for (auto& event : ring->read()) {
+      os << sep << "{\"ph\":\"X\",\"name\":";
+      write_json_string(os, event.name);
+      os << ",\"pid\":" << pid << ",\"tid\":" << ring->tid << ",\"ts\":";
+      write_micros(os, event.start_ns);
+      os << ",\"dur\":";
+      write_micros(os, event.duration_ns);
+      os << "}";
+      sep = ",\n";
+      written++;
+    }
+  }
+  os << "\n]}\n";
+  return written;
+}
+
+
+size_t Profiler::dump(const std::string& path)
+{
+  const std::string tmp = path + ".tmp";
+  size_t written = 0;
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    written = write_chrome_trace(file);
+    if (!file)
+      THROW("failed to write profile to '" << tmp << "'");
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp, path, ec);
+  if (ec)
+    THROW("failed to replace profile '" << path << "': " << ec.message());
+  return written;
+}
+
+
+static std::atomic<bool> dump_requested{false};
+static std::atomic<bool> dump_running{false};
+
+static void on_dump_signal(int) { dump_requested.store(true); }
+
+
+void configure(Config config, EventLoop& event_loop)
+{
+  auto profile_config =
+      config.get_sub_config("profiling", Config::empty_config());
+  if (!profile_config.get_bool("enabled", false))
+    return;
+
+  auto& p = profiler();
+  p.set_ring_capacity(profile_config.get_uint("ring_size", 32768));
+  p.enable(true);
+
+  const std::string path = profile_config.get_string(
+      "path", "/tmp/apex-profile-" + std::to_string(apex::getpid()) + ".json");
+
+  struct sigaction action = {};
+  action.sa_handler = on_dump_signal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGUSR2, &action, nullptr);
+  LOG_INFO("profiling enabled, send SIGUSR2 to dump to '" << path << "'");
+
+  auto interval = std::chrono::milliseconds(250);
+  event_loop.dispatch(interval, [path, interval]() -> std::chrono::milliseconds {
+    if (dump_requested.exchange(false) && !dump_running.exchange(true)) {
+      std::thread([path]() {
+        try {
+          auto zones = profiler().dump(path);
+          LOG_INFO("profile of " << zones << " zones written to '" << path
+                                 << "'");
+        } catch (std::exception& e) {
+          LOG_WARN(e.what());
+        }
+        dump_running.store(false);
+      }).detach();
+    }
+    return interval;
+  });
+}
+
+} // namespace profile
+} // namespace apex
@@ -0,0 +1,142 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/TscClock.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace apex
+{
+
+class Config;
+class EventLoop;
+
+/* Continuous profiling of scoped zones, for a flame chart view of stalls in
+ * a live process.  A zone, marked by APEX_PROFILE_ZONE("name") at the top of
+ * a scope, records its name, start and duration into a ring of the calling
+ * thread while profiling is enabled.  Each ring keeps the most recent zones
+ * of its thread, so profiling can be left enabled, and the rings dumped at
+ * any time, in the Chrome trace format, as loaded by chrome://tracing and by
+ * ui.perfetto.dev.  A zone costs one relaxed load while profiling is
+ * disabled, and two TSC reads and a ring write while enabled; build with
+ * -DAPEX_PROFILE_ZONES=0 to compile zones out.  Zone names must be string
+ * literals, since only the pointer is recorded. */
+namespace profile
+{
+
+class Profiler
+{
+public:
+  static Profiler& instance();
+
+  void enable(bool on) { _enabled.store(on, std::memory_order_relaxed); }
+
+  static bool is_enabled()
+  {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+
+  /* Capacity, in zones, of the rings of threads yet to record a zone. */
+  void set_ring_capacity(size_t zones);
+
+  /* Name the calling thread in dumped traces; the logger does so for each
+   * thread it registers. */
+  void set_thread_name(std::string);
+
+  // Record a completed zone, into the ring of the calling thread.
+  void record(const char* name, int64_t start_ns, int64_t end_ns);
+
+  /* Write the zones held by all rings, as a Chrome trace; rings are read
+   * while their threads continue to record.  Returns the zones written. */
+  size_t write_chrome_trace(std::ostream&);
+
+  /* Write the trace to `path`, replacing it atomically. */
+  size_t dump(const std::string& path);
+
+  class Ring; // zones of one thread
+
+private:
+  Profiler() = default;
+
+  Ring& thread_ring();
+
+  static inline std::atomic<bool> _enabled{false};
+
+  std::mutex _mutex;
+  std::vector<std::shared_ptr<Ring>> _rings;
+  size_t _ring_capacity = 32768;
+};
+
+inline Profiler& profiler() { return Profiler::instance(); }
+
+
+/* Scope guard recording one zone. */
+class Zone
+{
+public:
+  explicit Zone(const char* name)
+    : _name(name),
+      _start(Profiler::is_enabled() ? TscClock::instance().now_ns() : 0)
+  {
+  }
+
+  ~Zone()
+  {
+    if (_start)
+      Profiler::instance().record(_name, _start, TscClock::instance().now_ns());
+  }
+
+  Zone(const Zone&) = delete;
+  Zone& operator=(const Zone&) = delete;
+
+private:
+  const char* _name;
+  int64_t _start;
+};
+
+/* If the "profiling" sub-config sets "enabled", enable profiling, with rings
+ * of "ring_size" zones (default 32768) per thread, and dump them to "path"
+ * (default /tmp/apex-profile-<pid>.json) on each SIGUSR2.  The signal is
+ * noticed by a timer on the event loop, and the dump written by a background
+ * thread, so that neither stalls the engine. */
+void configure(Config, EventLoop&);
+
+} // namespace profile
+} // namespace apex
+
+
+#ifndef APEX_PROFILE_ZONES
+#define APEX_PROFILE_ZONES 1
+#endif
+
+#define _APEX_PROFILE_CONCAT2_(A, B) A##B
+#define _APEX_PROFILE_CONCAT_(A, B) _APEX_PROFILE_CONCAT2_(A, B)
+
+#if APEX_PROFILE_ZONES
+#define APEX_PROFILE_ZONE(NAME)                                         \
+  apex::profile::Zone _APEX_PROFILE_CONCAT_(_apex_zone_, __LINE__)(NAME)
+#else
+#define APEX_PROFILE_ZONE(NAME) do {} while (0)
+#endif
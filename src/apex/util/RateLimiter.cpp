@@ -0,0 +1,94 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/RateLimiter.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace apex
+{
+
+static int64_t to_ns(TokenBucket::clock::time_point t)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             t.time_since_epoch())
+      .count();
+}
+
+
+TokenBucket::TokenBucket(uint32_t capacity, std::chrono::nanoseconds interval,
+                         uint32_t reserve)
+  : _capacity(capacity),
+    _reserve(std::min(reserve, capacity)),
+    _interval_ns(interval.count()),
+    _token_ns(capacity ? interval.count() / capacity : 0)
+{
+  if (capacity == 0 || _token_ns <= 0)
+    throw std::runtime_error("token bucket needs a capacity and interval");
+}
+
+
+bool TokenBucket::try_acquire(uint32_t cost, bool priority,
+                              clock::time_point now)
+{
+  int64_t t = to_ns(now);
+  int64_t limit = t + (priority ? _capacity : _capacity - _reserve) * _token_ns;
+
+  int64_t full_at = _full_at.load(std::memory_order_relaxed);
+  while (true) {
+    int64_t next = std::max(full_at, t) + cost * _token_ns;
+    if (next > limit)
+      return false;
+    if (_full_at.compare_exchange_weak(full_at, next,
+                                       std::memory_order_relaxed))
+      return true;
+  }
+}
+
+
+void TokenBucket::raise_full_time(int64_t at_least)
+{
+  int64_t full_at = _full_at.load(std::memory_order_relaxed);
+  while (full_at < at_least &&
+         !_full_at.compare_exchange_weak(full_at, at_least,
+                                         std::memory_order_relaxed)) {
+  }
+}
+
+
+void TokenBucket::sync_used(uint32_t used, clock::time_point now)
+{
+  raise_full_time(to_ns(now) + std::min(used, _capacity) * _token_ns);
+}
+
+
+void TokenBucket::block(clock::time_point until)
+{
+  raise_full_time(to_ns(until) + _interval_ns);
+}
+
+
+uint32_t TokenBucket::available(clock::time_point now) const
+{
+  int64_t t = to_ns(now);
+  int64_t used_ns = std::max<int64_t>(0, _full_at.load(std::memory_order_relaxed) - t);
+  int64_t used = (used_ns + _token_ns - 1) / _token_ns;
+  return used >= _capacity ? 0 : uint32_t(_capacity - used);
+}
+
+} // namespace apex
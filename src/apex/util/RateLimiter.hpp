@@ -0,0 +1,73 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace apex
+{
+
+/* Token bucket of one rate limit of an exchange: `capacity` tokens, refilled
+ * evenly over each `interval`.  Implemented as a generic cell rate algorithm,
+ * holding only the time at which the bucket would again be full, in one
+ * atomic, so the bucket is lock-free and can be shared by threads.
+ *
+ * Requests without priority leave the last `reserve` tokens untouched, so
+ * that cancels, say, can still be sent once new orders are throttled.  The
+ * usage reported by the exchange, which also counts requests not made
+ * through the bucket, tightens the bucket when it is the higher; after a
+ * ban, or a 429 reply, block stops all requests until the given time. */
+class TokenBucket
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+  TokenBucket(uint32_t capacity, std::chrono::nanoseconds interval,
+              uint32_t reserve = 0);
+
+  /* Take `cost` tokens, if available; else no tokens are taken. */
+  bool try_acquire(uint32_t cost, bool priority,
+                   clock::time_point now = clock::now());
+
+  /* Apply the usage of the current interval reported by the exchange. */
+  void sync_used(uint32_t used, clock::time_point now = clock::now());
+
+  /* Block all requests until `until`, after which the bucket refills. */
+  void block(clock::time_point until);
+
+  /* Tokens available to a request with priority; those without priority
+   * have `reserve` fewer. */
+  [[nodiscard]] uint32_t available(clock::time_point now = clock::now()) const;
+
+  [[nodiscard]] uint32_t capacity() const { return _capacity; }
+  [[nodiscard]] uint32_t reserve() const { return _reserve; }
+
+private:
+  // the time at which the bucket is full again, in steady-clock nanoseconds
+  void raise_full_time(int64_t at_least);
+
+  uint32_t _capacity;
+  uint32_t _reserve;
+  int64_t _interval_ns;
+  int64_t _token_ns; // refill time of one token
+  std::atomic<int64_t> _full_at{0};
+};
+
+} // namespace apex
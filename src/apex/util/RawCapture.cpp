@@ -0,0 +1,202 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/RawCapture.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/utils.hpp>
+
+#include <cinttypes>
+#include <cstring>
+
+namespace apex
+{
+
+
+RawCaptureWriter::RawCaptureWriter(std::filesystem::path dir, Options options)
+  : _dir(std::move(dir)),
+    _options(options),
+    _queue(options.queue_capacity)
+{
+  create_dir(_dir);
+  _thread = std::thread([this]() { this->run(); });
+}
+
+
+RawCaptureWriter::~RawCaptureWriter()
+{
+  _stop.store(true, std::memory_order_release);
+  _thread.join();
+}
+
+
+void RawCaptureWriter::write(const char* stream, std::string msg)
+{
+  Record rec;
+  rec.time = Time::fast_now();
+  rec.stream = stream;
+  rec.msg = std::move(msg);
+  if (!_queue.try_push(std::move(rec)))
+    _dropped++;
+}
+
+
+RawCaptureWriter::Stats RawCaptureWriter::stats() const
+{
+  Stats stats;
+  stats.records = _records.load();
+  stats.bytes = _bytes.load();
+  stats.dropped = _dropped.load();
+  stats.segments = _segment_count.load();
+  return stats;
+}
+
+
+void RawCaptureWriter::run()
+{
+  size_t dropped_logged = 0;
+  while (!_stop.load(std::memory_order_acquire)) {
+    if (!drain())
+      std::this_thread::sleep_for(std::chrono::microseconds(500));
+
+    if (auto dropped = _dropped.load(); dropped != dropped_logged) {
+      LOG_WARN("raw capture queue full, " << (dropped - dropped_logged)
+                                          << " messages dropped");
+      dropped_logged = dropped;
+    }
+  }
+  drain(); // anything pushed before the stop
+
+  for (auto& item : _segments)
+    close(item.second);
+}
+
+
+// Append whatever is queued, then, with the queue empty, write out every
+// stream's batch; returns false if there was nothing queued.
+bool RawCaptureWriter::drain()
+{
+  bool any = false;
+  Record rec;
+  while (_queue.try_pop(rec)) {
+    append(rec);
+    any = true;
+  }
+  if (any)
+    for (auto& item : _segments)
+      write_pending(item.first.data(), item.second);
+  return any;
+}
+
+
+void RawCaptureWriter::append(const Record& rec)
+{
+  auto& segment = _segments[rec.stream];
+
+  char header[48];
+  int len = snprintf(header, sizeof header, "%" PRId64 " %zu\n",
+                     static_cast<int64_t>(rec.time.as_epoch_us().count()),
+                     rec.msg.size());
+  segment.pending.append(header, len);
+  segment.pending.append(rec.msg);
+  segment.pending.push_back('\n');
+  _records++;
+
+  if (segment.pending.size() >= _options.batch_size)
+    write_pending(rec.stream, segment);
+}
+
+
+void RawCaptureWriter::write_pending(const char* stream, Segment& segment)
+{
+  if (segment.pending.empty())
+    return;
+
+  // records are never split across segments
+  if (segment.file && segment.size >= _options.segment_size)
+    close(segment);
+
+  if (!segment.file) {
+    // numbered, so the segments of a stream sort in the order written
+    char seqno[16];
+    snprintf(seqno, sizeof seqno, "%06zu", _segment_count.load());
+    auto path = _dir / (std::string(stream) + "-" +
+                        utc_timestamp_condensed(true) + "-" + seqno + ".cap");
+    segment.file = std::fopen(path.c_str(), "ab");
+    if (!segment.file) {
+      LOG_ERROR("failed to open raw capture file " << path << ": "
+                                                   << strerror(errno));
+      segment.pending.clear();
+      return;
+    }
+    _segment_count++;
+  }
+
+  auto written = std::fwrite(segment.pending.data(), 1, segment.pending.size(),
+                             segment.file);
+  std::fflush(segment.file);
+  segment.size += written;
+  _bytes += written;
+  segment.pending.clear();
+}
+
+
+void RawCaptureWriter::close(Segment& segment)
+{
+  if (segment.file) {
+    std::fclose(segment.file);
+    segment.file = nullptr;
+  }
+  segment.size = 0;
+}
+
+
+RawCaptureReader::RawCaptureReader(const std::filesystem::path& file)
+  : _file(std::fopen(file.c_str(), "rb")),
+    _path(file)
+{
+  if (!_file)
+    THROW("cannot open raw capture file " << file << ": " << strerror(errno));
+}
+
+
+RawCaptureReader::~RawCaptureReader()
+{
+  if (_file)
+    std::fclose(_file);
+}
+
+
+bool RawCaptureReader::next(Record& rec)
+{
+  int64_t usec = 0;
+  size_t len = 0;
+  int fields = std::fscanf(_file, "%" SCNd64 " %zu", &usec, &len);
+  if (fields == EOF)
+    return false;
+  if (fields != 2 || std::fgetc(_file) != '\n')
+    THROW("malformed raw capture record in " << _path);
+
+  rec.time = Time(std::chrono::microseconds(usec));
+  rec.msg.resize(len);
+  if (std::fread(rec.msg.data(), 1, len, _file) != len ||
+      std::fgetc(_file) != '\n')
+    THROW("truncated raw capture record in " << _path);
+  return true;
+}
+
+} // namespace apex
@@ -0,0 +1,153 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/MpscQueue.hpp>
+#include <apex/util/Time.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace apex
+{
+
+/* Captures raw exchange messages to disk on a dedicated thread, so that a
+ * capture never delays the thread handling the message.  Messages are pushed,
+ * with their capture time, onto a lock-free queue; the writer thread batches
+ * them into append-only segment files, one series per stream, rolling to a
+ * new segment once a file reaches the segment size.
+ *
+ * Each record is written as a text header followed by the message bytes:
+ *
+ *     <epoch-microseconds> <length>\n<message>\n
+ *
+ * so that a segment can be both read by eye and replayed, byte for byte, by
+ * RawCaptureReader.  If the queue is full the message is dropped, and
+ * counted, rather than block the caller. */
+class RawCaptureWriter
+{
+public:
+  struct Options {
+    size_t queue_capacity = 1 << 14;
+
+    // a stream's file is closed and a new one started beyond this size
+    size_t segment_size = 64 << 20;
+
+    // bytes of a stream held before they are written out; whatever is held is
+    // written anyway whenever the queue runs empty
+    size_t batch_size = 64 << 10;
+  };
+
+  struct Stats {
+    size_t records = 0;
+    size_t bytes = 0;
+    size_t dropped = 0;
+    size_t segments = 0;
+  };
+
+  RawCaptureWriter(std::filesystem::path dir, Options options);
+  explicit RawCaptureWriter(std::filesystem::path dir)
+    : RawCaptureWriter(std::move(dir), Options{})
+  {
+  }
+
+  /* Writes out all queued messages before returning. */
+  ~RawCaptureWriter();
+
+  RawCaptureWriter(const RawCaptureWriter&) = delete;
+  RawCaptureWriter& operator=(const RawCaptureWriter&) = delete;
+
+  /* Queue a message of a stream, which names its segment files and must be a
+   * string with static storage, e.g. a literal.  Safe from any thread. */
+  void write(const char* stream, std::string msg);
+  void write(const char* stream, std::string_view msg)
+  {
+    write(stream, std::string(msg));
+  }
+
+  [[nodiscard]] const std::filesystem::path& dir() const { return _dir; }
+
+  [[nodiscard]] Stats stats() const;
+
+private:
+  struct Record {
+    Time time;
+    const char* stream = nullptr;
+    std::string msg;
+  };
+
+  struct Segment {
+    std::FILE* file = nullptr;
+    size_t size = 0;
+    std::string pending;
+  };
+
+  void run();
+  bool drain();
+  void append(const Record&);
+  void write_pending(const char* stream, Segment&);
+  void close(Segment&);
+
+  std::filesystem::path _dir;
+  Options _options;
+  MpscQueue<Record> _queue;
+
+  // used only by the writer thread
+  std::map<std::string_view, Segment> _segments;
+
+  std::atomic<size_t> _records{0};
+  std::atomic<size_t> _bytes{0};
+  std::atomic<size_t> _dropped{0};
+  std::atomic<size_t> _segment_count{0};
+
+  std::atomic<bool> _stop{false};
+  std::thread _thread;
+};
+
+
+/* Reads back the records of one segment file written by RawCaptureWriter. */
+class RawCaptureReader
+{
+public:
+  struct Record {
+    Time time;
+    std::string msg;
+  };
+
+  explicit RawCaptureReader(const std::filesystem::path& file);
+  ~RawCaptureReader();
+
+  RawCaptureReader(const RawCaptureReader&) = delete;
+  RawCaptureReader& operator=(const RawCaptureReader&) = delete;
+
+  /* Read the next record, returning false at the end of the file.  Throws
+   * if the file is truncated or malformed. */
+  bool next(Record&);
+
+private:
+  std::FILE* _file = nullptr;
+  std::filesystem::path _path;
+};
+
+} // namespace apex
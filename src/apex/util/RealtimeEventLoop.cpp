@@ -16,40 +16,51 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/Metrics.hpp>
 
+#include <algorithm>
 #include <iostream>
+#include <limits>
 
 namespace apex
 {
 
-struct Event {
-  enum event_type { kill = 0, function_dispatch, timer_dispatch } type;
-  explicit Event(event_type t) : type(t) {}
-  virtual ~Event() = default;
-};
+static metrics::Counter& ev_events = metrics::registry().counter(
+    "apex_evloop_events_total", "Functions run by realtime event loops");
+static metrics::Counter& ev_timers = metrics::registry().counter(
+    "apex_evloop_timers_total", "Timers run by realtime event loops");
 
+static memory::Account& queue_memory()
+{
+  static memory::Account account("event_loop_queues");
+  return account;
+}
 
-struct ev_function_dispatch : Event {
-  ev_function_dispatch(std::function<void()> fn_)
-    : Event(Event::function_dispatch), fn(std::move(fn_))
-  {
-  }
-
-  std::function<void()> fn;
-};
-
+static inline void cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
 
-struct ev_timer_dispatch : Event {
-  ev_timer_dispatch(RealtimeEventLoop::timer_fn fn_)
-    : Event(Event::timer_dispatch), fn(std::move(fn_))
-  {
-  }
 
-  RealtimeEventLoop::timer_fn fn;
-};
+RealtimeEventLoop::RealtimeEventLoop(
+    std::function<bool()> on_exception,
+    std::function<void()> on_start,
+    std::function<void()> on_stop)
+  : RealtimeEventLoop(Options(), std::move(on_exception), std::move(on_start),
+                      std::move(on_stop))
+{
+}
 
 
 RealtimeEventLoop::RealtimeEventLoop(
+    Options options,
     std::function<bool()> on_exception,
     std::function<void()> on_start,
     std::function<void()> on_stop)
@@ -57,7 +68,23 @@ RealtimeEventLoop::RealtimeEventLoop(
     m_on_start(std::move(on_start)),
     m_on_stop(std::move(on_stop)),
     m_continue(true),
-    m_thread(&RealtimeEventLoop::eventmain, this)
+    m_wait_mode(options.wait_mode),
+    m_spin_duration(options.spin_duration),
+    m_batch_budget(options.batch_budget),
+    m_instrument(options.instrument),
+    m_wakeups(0),
+    m_ring(options.queue_type == QueueType::lockfree
+               ? std::make_unique<MpscQueue<Queued>>(
+                     options.queue_capacity)
+               : nullptr),
+    m_sleeping(false),
+    m_overflow(false),
+    m_queue_charge(queue_memory()),
+    m_epoch(std::chrono::steady_clock::now()),
+    m_queue_depth_hwm(0),
+    m_thread(options.own_thread
+                 ? std::thread(&RealtimeEventLoop::eventmain, this)
+                 : std::thread())
 {
 }
 
@@ -67,13 +94,13 @@ RealtimeEventLoop::~RealtimeEventLoop() { sync_stop(); }
 
 void RealtimeEventLoop::sync_stop()
 {
-  auto kill_event = std::make_shared<Event>(Event::kill);
-
   {
     std::lock_guard<std::mutex> guard(m_mutex);
-    m_queue.push_back(std::move(kill_event));
+    m_queue.push_back({inline_fn([this]() { m_continue = false; }), {}});
+    m_wakeups.fetch_add(1, std::memory_order_release);
     m_condvar.notify_one();
   }
+  wake_driver();
 
   if (m_thread.joinable())
     m_thread.join();
@@ -82,99 +109,426 @@ void RealtimeEventLoop::sync_stop()
 
 void RealtimeEventLoop::dispatch(std::function<void()> fn)
 {
-  auto event = std::make_shared<ev_function_dispatch>(std::move(fn));
+  dispatch(inline_fn(std::move(fn)));
+}
+
+
+void RealtimeEventLoop::dispatch(inline_fn fn)
+{
+  Queued item{std::move(fn), {}};
+  if (m_instrument)
+    item.enqueued = std::chrono::steady_clock::now();
+
+  if (m_ring && !m_overflow.load(std::memory_order_acquire) &&
+      m_ring->try_push(std::move(item))) {
+    // Only take the mutex if the EV thread is, or is about to be, waiting on
+    // the condvar.  The fence pairs with the one in eventloop(), so that
+    // either we see m_sleeping, or the EV thread sees our item.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_condvar.notify_one();
+    }
+    wake_driver();
+    return;
+  }
 
+  // default path, also taken if the ring is full
   {
     std::lock_guard<std::mutex> guard(m_mutex);
-    m_queue.push_back(std::move(event));
+    if (m_ring)
+      m_overflow.store(true, std::memory_order_release);
+    m_queue.push_back(std::move(item));
+    m_wakeups.fetch_add(1, std::memory_order_release);
     m_condvar.notify_one();
   }
+  wake_driver();
 }
 
 
-void RealtimeEventLoop::dispatch(std::chrono::milliseconds delay, timer_fn fn)
+TimerHandle RealtimeEventLoop::dispatch(std::chrono::milliseconds delay,
+                                        timer_fn fn)
 {
-  dispatch(delay, std::make_shared<ev_timer_dispatch>(std::move(fn)));
+  return dispatch(delay, inline_timer_fn(std::move(fn)));
 }
 
 
-void RealtimeEventLoop::dispatch(std::chrono::milliseconds delay,
-                         std::shared_ptr<Event> sp)
+TimerHandle RealtimeEventLoop::dispatch(std::chrono::milliseconds delay,
+                                        inline_timer_fn fn)
 {
-  auto tp_due = std::chrono::steady_clock::now() + delay;
-  auto event = std::make_pair(tp_due, std::move(sp));
+  const auto due = to_tick(std::chrono::steady_clock::now() + delay);
 
+  TimerHandle handle;
   {
     std::lock_guard<std::mutex> guard(m_mutex);
-    m_schedule.insert(std::move(event));
+    handle = m_timers.schedule(due, std::move(fn));
+    m_wakeups.fetch_add(1, std::memory_order_release);
     m_condvar.notify_one();
   }
+  wake_driver();
+  return handle;
+}
+
+
+bool RealtimeEventLoop::cancel_timer(TimerHandle handle)
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return m_timers.cancel(handle);
+}
+
+
+TimerWheel<EventLoop::inline_timer_fn>::tick_type
+RealtimeEventLoop::to_tick(std::chrono::steady_clock::time_point tp) const
+{
+  if (tp <= m_epoch)
+    return 0;
+  return std::chrono::duration_cast<std::chrono::microseconds>(tp - m_epoch)
+      .count();
+}
+
+
+std::chrono::steady_clock::time_point RealtimeEventLoop::from_tick(
+    TimerWheel<inline_timer_fn>::tick_type tick) const
+{
+  return m_epoch + std::chrono::microseconds(tick);
 }
 
 
 void RealtimeEventLoop::eventloop()
 {
-  /* A note on memory management of the event objects.  Once they are pushed,
-   * they are stored as shared pointers.  This allows other parts of the code to
-   * take ownership of the resource, if they so wish.
-   */
-  std::list<std::shared_ptr<Event>> to_process;
   while (m_continue) {
-    to_process.clear();
+    begin_pass();
+    bool spin_expired = false;
     {
       std::unique_lock<std::mutex> guard(m_mutex);
+      resume_ring();
+
+      while (m_continue) {
+        expire_timers();
+
+        if (!m_to_process.empty() || !m_queue.empty() || !ring_empty() ||
+            !m_due_timers.empty())
+          break;
+
+        const bool has_timer = !m_timers.empty();
+        const auto next_due = has_timer ? from_tick(m_timers.next_due())
+                                        : std::chrono::steady_clock::now();
+
+        // in the spin modes, first busy-poll without the lock
+        if (m_wait_mode != WaitMode::block && !spin_expired) {
+          const auto wakeups = m_wakeups.load(std::memory_order_relaxed);
+          guard.unlock();
+          spin_expired = !spin_wait(wakeups, has_timer, next_due);
+          guard.lock();
+          continue;
+        }
 
-      while (m_continue && m_queue.empty()) {
-
-        // identify range of scheduled events which are now due
-        const auto tp_now = std::chrono::steady_clock::now();
-        const auto upper_iter = m_schedule.upper_bound(tp_now);
-
-        if (upper_iter == m_schedule.begin()) {
-          // no events due now so need to sleep, which is either indefinitely or
-          // until the next scheduled item
-          if (m_schedule.empty())
-            m_condvar.wait(guard);
-          else {
-            auto sleep_for = m_schedule.begin()->first - tp_now;
-            m_condvar.wait_for(guard, sleep_for);
+        // no events due now so need to sleep, which is either indefinitely or
+        // until the next scheduled item
+        if (m_ring) {
+          m_sleeping.store(true, std::memory_order_relaxed);
+          std::atomic_thread_fence(std::memory_order_seq_cst);
+          if (!m_ring->empty()) {
+            m_sleeping.store(false, std::memory_order_relaxed);
+            break;
           }
-        } else {
-          for (auto iter = m_schedule.begin(); iter != upper_iter; ++iter)
-            m_queue.push_back(std::move(iter->second));
-          m_schedule.erase(m_schedule.begin(), upper_iter);
         }
+        if (!has_timer)
+          m_condvar.wait(guard);
+        else
+          m_condvar.wait_until(guard, next_due);
+        m_sleeping.store(false, std::memory_order_relaxed);
       }
-      to_process.swap(m_queue);
+      take_queue();
     }
+    process_pass();
+  }
+}
 
-    for (auto& ev : to_process) {
-      if (m_continue)  // always recheck, just in case set in handle_exception
-        try {
-          switch (ev->type) {
-            case Event::function_dispatch: {
-              ev_function_dispatch* ev2 =
-                dynamic_cast<ev_function_dispatch*>(ev.get());
-              ev2->fn();
-              break;
-            }
-            case Event::timer_dispatch: {
-              ev_timer_dispatch* ev2 = dynamic_cast<ev_timer_dispatch*>(ev.get());
-              auto repeat_ms = ev2->fn();
-              if (repeat_ms.count() > 0)
-                dispatch(repeat_ms, std::move(ev));
-              break;
-            }
-            case Event::kill: {
-              m_continue = false;
-              return;
-            }
-          }
-        } catch (...) {
-          handle_exception();
-        }
-    } // loop end
+
+void RealtimeEventLoop::run_pending()
+{
+  if (!m_continue)
+    return;
+  try {
+    begin_pass();
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      resume_ring();
+      expire_timers();
+      take_queue();
+    }
+    process_pass();
+  } catch (...) {
+    handle_exception();
+  }
+}
+
+
+bool RealtimeEventLoop::has_pending()
+{
+  if (!m_continue)
+    return false;
+  if (m_next < m_to_process.size() || !ring_empty())
+    return true;
+  std::lock_guard<std::mutex> guard(m_mutex);
+  return !m_queue.empty();
+}
+
+
+std::optional<std::chrono::steady_clock::time_point>
+RealtimeEventLoop::next_timer_due()
+{
+  std::lock_guard<std::mutex> guard(m_mutex);
+  if (!m_continue || m_timers.empty())
+    return std::nullopt;
+  return from_tick(m_timers.next_due());
+}
+
+
+void RealtimeEventLoop::attach_current_thread()
+{
+  m_thread_id.set_value(std::this_thread::get_id());
+  if (m_on_start)
+    try {
+      m_on_start();
+    } catch (...) {
+      handle_exception();
+    }
+}
+
+
+void RealtimeEventLoop::set_wakeup_fn(std::function<void()> fn)
+{
+  m_wakeup_fn = std::move(fn);
+}
+
+
+void RealtimeEventLoop::wake_driver()
+{
+  if (m_wakeup_fn && !this_thread_is_ev())
+    m_wakeup_fn();
+}
+
+
+void RealtimeEventLoop::begin_pass()
+{
+  if (m_next == m_to_process.size()) {
+    m_to_process.clear();
+    m_next = 0;
   }
+  m_due_timers.clear();
+}
+
+
+/* Caller must hold m_mutex. */
+void RealtimeEventLoop::resume_ring()
+{
+  // all overflow items have now been processed, so the ring can resume
+  if (m_ring && m_queue.empty() && m_to_process.empty())
+    m_overflow.store(false, std::memory_order_release);
+}
+
+
+/* Caller must hold m_mutex. */
+void RealtimeEventLoop::expire_timers()
+{
+  m_timers.expire(to_tick(std::chrono::steady_clock::now()),
+                  [&](TimerHandle h, auto due, inline_timer_fn&& fn) {
+                    m_due_timers.push_back({h, due, std::move(fn), {}});
+                  });
+}
+
+
+/* Caller must hold m_mutex. */
+void RealtimeEventLoop::take_queue()
+{
+  // take the entire pending queue in the one lock acquisition, appending to any
+  // items left over from a previous pass; in steady state the swap means
+  // neither vector needs to reallocate
+  if (m_to_process.empty())
+    m_to_process.swap(m_queue);
+  else {
+    for (auto& item : m_queue)
+      m_to_process.push_back(std::move(item));
+    m_queue.clear();
+  }
+
+  m_queue_charge.set(
+      ((m_ring ? m_ring->capacity() : 0) + m_queue.capacity() +
+       m_to_process.capacity()) *
+      sizeof(Queued));
+}
+
+
+void RealtimeEventLoop::process_pass()
+{
+  const size_t budget = m_batch_budget ? m_batch_budget
+                                       : std::numeric_limits<size_t>::max();
+
+  if (m_instrument)
+    note_queue_depth((m_to_process.size() - m_next) +
+                     (m_ring ? m_ring->size_approx() : 0));
+
+  // ring items were necessarily pushed before any ring-full overflow onto
+  // m_queue, so drain them first; if the budget is spent, the remaining items
+  // wait until after the due timers have run
+  size_t processed = drain_ring(budget);
+
+  // the kill request is queued as a function that clears m_continue
+  for (; m_next < m_to_process.size() && processed < budget; ++m_next) {
+    if (!m_continue)  // always recheck, just in case set in handle_exception
+      break;
+    invoke(m_to_process[m_next]);
+    m_to_process[m_next].fn = nullptr;
+    ++processed;
+  }
+
+  for (auto& timer : m_due_timers) {
+    if (!m_continue)
+      continue;
+    const auto start = m_instrument ? std::chrono::steady_clock::now()
+                                    : std::chrono::steady_clock::time_point{};
+    try {
+      timer.repeat = timer.fn();
+    } catch (...) {
+      handle_exception();
+    }
+    if (m_instrument) {
+      const auto due = from_tick(timer.due);
+      m_timer_lateness.record(
+          start > due ? std::chrono::nanoseconds(start - due).count() : 0);
+      m_handler_duration.record(
+          std::chrono::nanoseconds(std::chrono::steady_clock::now() - start)
+              .count());
+    }
+  }
+
+  if (processed)
+    ev_events.add(processed);
+  if (!m_due_timers.empty())
+    ev_timers.add(m_due_timers.size());
+
+  if (m_continue && (processed || !m_due_timers.empty()))
+    try {
+      run_batch_end_hooks();
+    } catch (...) {
+      handle_exception();
+    }
+
+  if (m_due_timers.empty() || !m_continue)
+    return;
+
+  // re-arm repeating timers, keeping their handles, and release the others
+  const auto tp_now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> guard(m_mutex);
+  for (auto& timer : m_due_timers) {
+    if (timer.repeat.count() > 0)
+      m_timers.rearm(timer.handle, to_tick(tp_now + timer.repeat),
+                     std::move(timer.fn));
+    else
+      m_timers.release(timer.handle);
+  }
+}
+
+
+/* Busy-poll until there is potentially new work, returning true, or until the
+ * spin duration is exhausted, returning false. */
+bool RealtimeEventLoop::spin_wait(uint64_t wakeups, bool has_timer,
+                                  std::chrono::steady_clock::time_point next_due)
+{
+  const auto spin_start = std::chrono::steady_clock::now();
+  while (true) {
+    if (m_wakeups.load(std::memory_order_acquire) != wakeups || !ring_empty())
+      return true;
+
+    const auto tp_now = std::chrono::steady_clock::now();
+    if (has_timer && tp_now >= next_due)
+      return true;
+
+    if (m_wait_mode == WaitMode::spin_then_block &&
+        (tp_now - spin_start) >= m_spin_duration)
+      return false;
+
+    cpu_relax();
+  }
+}
+
+
+size_t RealtimeEventLoop::drain_ring(size_t limit)
+{
+  if (!m_ring)
+    return 0;
+
+  // bound the number of items taken per pass, so that a constant stream of
+  // dispatches cannot starve timers and the locked queue
+  limit = std::min(limit, m_ring->capacity());
+  Queued item;
+  size_t count = 0;
+  for (; count < limit && m_continue; ++count) {
+    if (!m_ring->try_pop(item))
+      break;
+    invoke(item);
+    item.fn = nullptr; // release captured resources now, not on the next pop
+  }
+  return count;
+}
+
+
+void RealtimeEventLoop::invoke(Queued& item)
+{
+  if (!m_instrument) {
+    try {
+      item.fn();
+    } catch (...) {
+      handle_exception();
+    }
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  if (item.enqueued != std::chrono::steady_clock::time_point{})
+    m_queue_latency.record(
+        std::chrono::nanoseconds(start - item.enqueued).count());
+  try {
+    item.fn();
+  } catch (...) {
+    handle_exception();
+  }
+  m_handler_duration.record(
+      std::chrono::nanoseconds(std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+
+void RealtimeEventLoop::note_queue_depth(size_t depth)
+{
+  // only the EV thread writes, so no compare-exchange is needed
+  if (depth > m_queue_depth_hwm.load(std::memory_order_relaxed))
+    m_queue_depth_hwm.store(depth, std::memory_order_relaxed);
+}
+
+
+EventLoopStats RealtimeEventLoop::stats(bool reset)
+{
+  EventLoopStats stats;
+  stats.queue_latency = m_queue_latency.snapshot(reset);
+  stats.handler_duration = m_handler_duration.snapshot(reset);
+  stats.timer_lateness = m_timer_lateness.snapshot(reset);
+  stats.queue_depth_hwm =
+      reset ? m_queue_depth_hwm.exchange(0, std::memory_order_relaxed)
+            : m_queue_depth_hwm.load(std::memory_order_relaxed);
+  return stats;
+}
+
+
+std::ostream& operator<<(std::ostream& os, const EventLoopStats& stats)
+{
+  os << "queue-latency: {" << stats.queue_latency << "}, handler: {"
+     << stats.handler_duration << "}, timer-lateness: {"
+     << stats.timer_lateness << "}, queue-depth-hwm: "
+     << stats.queue_depth_hwm;
+  return os;
 }
 
 
@@ -230,4 +584,45 @@ bool RealtimeEventLoop::this_thread_is_ev() const
   return m_thread_id.compare(std::this_thread::get_id());
 }
 
+
+RealtimeEventLoop::Options parse_event_loop_options(Config config)
+{
+  RealtimeEventLoop::Options options;
+  if (config.is_empty())
+    return options;
+
+  auto queue = config.get_string("queue", "locked");
+  if (queue == "locked")
+    options.queue_type = RealtimeEventLoop::QueueType::locked;
+  else if (queue == "lockfree")
+    options.queue_type = RealtimeEventLoop::QueueType::lockfree;
+  else {
+    std::ostringstream oss;
+    oss << "invalid event loop queue type " << QUOTE(queue);
+    throw ConfigError(oss.str());
+  }
+  options.queue_capacity =
+      config.get_uint("queue_capacity", options.queue_capacity);
+
+  auto wait_mode = config.get_string("wait_mode", "block");
+  if (wait_mode == "block")
+    options.wait_mode = RealtimeEventLoop::WaitMode::block;
+  else if (wait_mode == "spin")
+    options.wait_mode = RealtimeEventLoop::WaitMode::spin;
+  else if (wait_mode == "spin_then_block")
+    options.wait_mode = RealtimeEventLoop::WaitMode::spin_then_block;
+  else {
+    std::ostringstream oss;
+    oss << "invalid event loop wait mode " << QUOTE(wait_mode);
+    throw ConfigError(oss.str());
+  }
+  options.spin_duration = std::chrono::microseconds(
+      config.get_uint("spin_usec", options.spin_duration.count()));
+  options.batch_budget =
+      config.get_uint("batch_budget", options.batch_budget);
+  options.instrument = config.get_bool("instrument", options.instrument);
+
+  return options;
+}
+
 } // namespace apex
@@ -19,30 +19,93 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include <apex/util/utils.hpp>
 #include <apex/util/EventLoop.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/MpscQueue.hpp>
+#include <apex/util/TimerWheel.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
-#include <list>
-#include <map>
+#include <iosfwd>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <stdexcept>
+#include <vector>
 
 namespace apex
 {
 
-struct Event;
+class Config;
+
+
+/* Event loop instrumentation, recorded when enabled via
+ * RealtimeEventLoop::Options::instrument.  Durations are in nanoseconds. */
+struct EventLoopStats {
+  LatencyHistogram::Snapshot queue_latency;    // dispatch to start of handler
+  LatencyHistogram::Snapshot handler_duration; // for events and timers
+  LatencyHistogram::Snapshot timer_lateness;   // due time to start of timer
+  size_t queue_depth_hwm = 0; // most events pending at the start of a pass
+};
+
+std::ostream& operator<<(std::ostream&, const EventLoopStats&);
 
 
 /** Event thread */
 class RealtimeEventLoop : public EventLoop
 {
 public:
+  /** Queue used to convey dispatched functions to the EV thread. */
+  enum class QueueType {
+    locked,  // mutex protected vector
+    lockfree // preallocated MPSC ring; falls back to the locked queue if full
+  };
+
+  /** How the EV thread waits when it has no work. */
+  enum class WaitMode {
+    block,          // sleep on the condvar
+    spin,           // busy-poll; lowest wakeup latency, consumes a full core
+    spin_then_block // busy-poll for spin_duration, then sleep on the condvar
+  };
+
+  struct Options {
+    QueueType queue_type;
+    size_t queue_capacity;
+    WaitMode wait_mode;
+    std::chrono::microseconds spin_duration;
+
+    // maximum number of dispatched functions invoked per loop iteration,
+    // before due timers are run and batch-end hooks invoked; 0 for no limit
+    size_t batch_budget;
+
+    // record EventLoopStats; adds two clock reads per event
+    bool instrument;
+
+    // if false, no EV thread is started, and instead the loop is driven by
+    // another loop calling run_pending(), eg, IoLoop in fused mode
+    bool own_thread;
+
+    Options()
+      : queue_type(QueueType::locked),
+        queue_capacity(65536),
+        wait_mode(WaitMode::block),
+        spin_duration(100),
+        batch_budget(0),
+        instrument(false),
+        own_thread(true)
+    {
+    }
+  };
+
   explicit RealtimeEventLoop(std::function<bool()> on_exception,
             std::function<void()> on_start = {},
             std::function<void()> on_stop = {});
+  RealtimeEventLoop(Options options, std::function<bool()> on_exception,
+                    std::function<void()> on_start = {},
+                    std::function<void()> on_stop = {});
   RealtimeEventLoop(const RealtimeEventLoop&) = delete;
   RealtimeEventLoop& operator=(const RealtimeEventLoop&) = delete;
   ~RealtimeEventLoop();
@@ -53,36 +116,133 @@ public:
 
   /** Post a function object that is later invoked on the event thread. */
   void dispatch(std::function<void()> fn) override;
+  void dispatch(inline_fn fn) override;
 
   /** Post a timer_fn function which is invoked after the elapsed time. The
    * function will be repeatedly invoked until it returns 0. */
-  void dispatch(std::chrono::milliseconds, timer_fn fn) override;
+  TimerHandle dispatch(std::chrono::milliseconds, timer_fn fn) override;
+  TimerHandle dispatch(std::chrono::milliseconds, inline_timer_fn fn) override;
+
+  /** Cancel a timer.  Can be called from any thread; a timer currently being
+   * invoked will complete, but not be repeated. */
+  bool cancel_timer(TimerHandle) override;
 
   /** Determine whether the current thread is the EV thread. */
   bool this_thread_is_ev()  const override;
 
+  /** Snapshot of the instrumentation; empty unless enabled by the options.
+   * Can be called from any thread; if `reset`, a new interval is started. */
+  EventLoopStats stats(bool reset = false);
+
+  /* Interface for driving a loop created without its own thread.  The driving
+   * thread first calls attach_current_thread(), which makes it the EV thread
+   * and invokes the on-start callback, and then repeatedly calls
+   * run_pending(), which processes pending events and due timers without
+   * blocking.  Before blocking the driver should consult has_pending() and
+   * next_timer_due().  The wakeup function, which must be set before any
+   * dispatch, is invoked whenever another thread dispatches work. */
+  void attach_current_thread();
+  void run_pending();
+  bool has_pending();
+  std::optional<std::chrono::steady_clock::time_point> next_timer_due();
+  void set_wakeup_fn(std::function<void()>);
+
 private:
+  // dispatched function, with its dispatch time if instrumentation is enabled
+  struct Queued {
+    inline_fn fn;
+    std::chrono::steady_clock::time_point enqueued;
+  };
+
+  struct DueTimer {
+    TimerHandle handle;
+    TimerWheel<inline_timer_fn>::tick_type due;
+    inline_timer_fn fn;
+    std::chrono::milliseconds repeat;
+  };
+
+  void invoke(Queued&);
+  void note_queue_depth(size_t);
+  void wake_driver();
+
+  // steps of each loop iteration
+  void begin_pass();
+  void resume_ring();
+  void expire_timers();
+  void take_queue();
+  void process_pass();
+
   void handle_exception();
   void eventloop();
   void eventmain();
 
-  void dispatch(std::chrono::milliseconds, std::shared_ptr<Event>);
+  TimerWheel<inline_timer_fn>::tick_type to_tick(
+      std::chrono::steady_clock::time_point) const;
+  std::chrono::steady_clock::time_point from_tick(
+      TimerWheel<inline_timer_fn>::tick_type) const;
+  bool ring_empty() const { return !m_ring || m_ring->empty(); }
+  size_t drain_ring(size_t);
+  bool spin_wait(uint64_t, bool, std::chrono::steady_clock::time_point);
 
   std::function<bool()> m_on_exception;
   std::function<void()> m_on_start;
   std::function<void()> m_on_stop;
+  std::function<void()> m_wakeup_fn;
 
   bool m_continue;
 
-  std::list<std::shared_ptr<Event>> m_queue;
+  WaitMode m_wait_mode;
+  std::chrono::microseconds m_spin_duration;
+  size_t m_batch_budget;
+  const bool m_instrument;
+
+  // incremented under m_mutex for each locked queue or schedule insertion;
+  // allows a spinning EV thread to detect new work without the lock
+  std::atomic<uint64_t> m_wakeups;
+
+  std::vector<Queued> m_queue;
   std::mutex m_mutex;
   std::condition_variable m_condvar;
-  std::multimap<std::chrono::steady_clock::time_point, std::shared_ptr<Event>>
-      m_schedule;
+
+  // EV thread only: the queue taken in the current pass, of which m_next is
+  // the first unprocessed item (short of the end if the batch budget was
+  // exhausted), and the timers due in the current pass
+  std::vector<Queued> m_to_process;
+  size_t m_next = 0;
+  std::vector<DueTimer> m_due_timers;
+
+  // scheduled timers, with ticks of microseconds elapsed since m_epoch
+  TimerWheel<inline_timer_fn> m_timers;
+
+  // optional lock-free dispatch path, and flag to indicate when the EV thread
+  // is about to block on the condvar, so producers know to wake it
+  std::unique_ptr<MpscQueue<Queued>> m_ring;
+  std::atomic<bool> m_sleeping;
+
+  // set while ring-full overflow items are waiting on m_queue; producers then
+  // bypass the ring, to preserve dispatch order
+  std::atomic<bool> m_overflow;
+
+  // of the ring and the queue vectors, to "event_loop_queues"; EV thread
+  memory::Charge m_queue_charge;
+
+  const std::chrono::steady_clock::time_point m_epoch;
+
+  LatencyHistogram m_queue_latency;
+  LatencyHistogram m_handler_duration;
+  LatencyHistogram m_timer_lateness;
+  std::atomic<size_t> m_queue_depth_hwm;
 
   synchronized_optional<std::thread::id> m_thread_id;
 
   std::thread m_thread; // prefer as final member, avoid race conditions
 };
 
+
+/** Parse event loop options from config, supporting fields "queue"
+ * ("locked"/"lockfree"), "queue_capacity", "wait_mode"
+ * ("block"/"spin"/"spin_then_block"), "spin_usec", "batch_budget" and
+ * "instrument".  Fused mode, and so "own_thread", is selected by Services. */
+RealtimeEventLoop::Options parse_event_loop_options(Config config);
+
 } // namespace apex
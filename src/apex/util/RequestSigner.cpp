@@ -0,0 +1,168 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/RequestSigner.hpp>
+#include <apex/util/utils.hpp>
+
+#include <openssl/evp.h>
+
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+namespace apex
+{
+
+static constexpr size_t sha256_block_size = 64;
+
+
+struct HmacSha256::Contexts {
+  EVP_MD_CTX* inner = EVP_MD_CTX_new();
+  EVP_MD_CTX* outer = EVP_MD_CTX_new();
+
+  Contexts()
+  {
+    if (!inner || !outer)
+      throw std::runtime_error("EVP_MD_CTX_new failed");
+  }
+
+  ~Contexts()
+  {
+    EVP_MD_CTX_free(inner);
+    EVP_MD_CTX_free(outer);
+  }
+
+  Contexts(const Contexts&) = delete;
+  Contexts& operator=(const Contexts&) = delete;
+};
+
+
+HmacSha256::HmacSha256(std::string_view key)
+  : _keyed(std::make_unique<Contexts>())
+{
+  // RFC 2104: a key longer than a block is replaced by its digest
+  unsigned char block[sha256_block_size] = {};
+  if (key.size() > sha256_block_size) {
+    unsigned int len = 0;
+    EVP_Digest(key.data(), key.size(), block, &len, EVP_sha256(), nullptr);
+  } else {
+    memcpy(block, key.data(), key.size());
+  }
+
+  unsigned char ipad[sha256_block_size];
+  unsigned char opad[sha256_block_size];
+  for (size_t i = 0; i < sha256_block_size; i++) {
+    ipad[i] = block[i] ^ 0x36;
+    opad[i] = block[i] ^ 0x5c;
+  }
+
+  if (!EVP_DigestInit_ex(_keyed->inner, EVP_sha256(), nullptr) ||
+      !EVP_DigestUpdate(_keyed->inner, ipad, sizeof(ipad)) ||
+      !EVP_DigestInit_ex(_keyed->outer, EVP_sha256(), nullptr) ||
+      !EVP_DigestUpdate(_keyed->outer, opad, sizeof(opad)))
+    throw std::runtime_error("HMAC-SHA256 key setup failed");
+}
+
+
+HmacSha256::~HmacSha256() = default;
+
+
+void HmacSha256::sign(std::string_view msg,
+                      unsigned char (&digest)[digest_size]) const
+{
+  // working context of the calling thread, reused across signatures
+  static thread_local Contexts work;
+
+  unsigned int len = 0;
+  unsigned char inner_digest[digest_size];
+  if (!EVP_MD_CTX_copy_ex(work.inner, _keyed->inner) ||
+      !EVP_DigestUpdate(work.inner, msg.data(), msg.size()) ||
+      !EVP_DigestFinal_ex(work.inner, inner_digest, &len) ||
+      !EVP_MD_CTX_copy_ex(work.outer, _keyed->outer) ||
+      !EVP_DigestUpdate(work.outer, inner_digest, sizeof(inner_digest)) ||
+      !EVP_DigestFinal_ex(work.outer, digest, &len))
+    throw std::runtime_error("HMAC-SHA256 signing failed");
+}
+
+
+void HmacSha256::sign_hex(std::string_view msg, char* out) const
+{
+  static constexpr char digits[] = "0123456789abcdef";
+  unsigned char digest[digest_size];
+  sign(msg, digest);
+  for (size_t i = 0; i < digest_size; i++) {
+    out[2 * i] = digits[digest[i] >> 4];
+    out[2 * i + 1] = digits[digest[i] & 0x0F];
+  }
+}
+
+
+std::string HmacSha256::sign_hex(std::string_view msg) const
+{
+  std::string hex(hex_size, '\0');
+  sign_hex(msg, hex.data());
+  return hex;
+}
+
+
+void SignedQuery::append_key(std::string_view key)
+{
+  if (!_buf.empty())
+    _buf += '&';
+  _buf.append(key);
+  _buf += '=';
+}
+
+
+SignedQuery& SignedQuery::add(std::string_view key, std::string_view value)
+{
+  append_key(key);
+  _buf.append(value);
+  return *this;
+}
+
+
+SignedQuery& SignedQuery::add(std::string_view key, int64_t value)
+{
+  append_key(key);
+  char tmp[24];
+  auto result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+  _buf.append(tmp, result.ptr);
+  return *this;
+}
+
+
+SignedQuery& SignedQuery::add(std::string_view key, double value,
+                              bool trim_zeros, int precision)
+{
+  append_key(key);
+  char tmp[64];
+  _buf.append(tmp, format_double(tmp, sizeof(tmp), value, trim_zeros, precision));
+  return *this;
+}
+
+
+SignedQuery& SignedQuery::sign(const HmacSha256& hmac, std::string_view key)
+{
+  char hex[HmacSha256::hex_size];
+  hmac.sign_hex(_buf, hex);
+  append_key(key);
+  _buf.append(hex, sizeof(hex));
+  return *this;
+}
+
+} // namespace apex
@@ -0,0 +1,94 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace apex
+{
+
+/* HMAC-SHA256 with the key schedule computed once: the digest states after
+ * absorbing the inner and outer padded keys are kept, and each signature
+ * starts from copies of them, rather than rehashing the key.  Signing can be
+ * done from several threads at once; each thread reuses its own working
+ * digest contexts. */
+class HmacSha256
+{
+public:
+  static constexpr size_t digest_size = 32;
+  static constexpr size_t hex_size = 2 * digest_size;
+
+  explicit HmacSha256(std::string_view key);
+  ~HmacSha256();
+
+  HmacSha256(const HmacSha256&) = delete;
+  HmacSha256& operator=(const HmacSha256&) = delete;
+
+  void sign(std::string_view msg, unsigned char (&digest)[digest_size]) const;
+
+  /* Write the lower case hex signature, of hex_size characters, to `out`. */
+  void sign_hex(std::string_view msg, char* out) const;
+
+  [[nodiscard]] std::string sign_hex(std::string_view msg) const;
+
+private:
+  struct Contexts;
+  std::unique_ptr<Contexts> _keyed;
+};
+
+
+/* Builder of a signed query string, key=value&...&signature=<hex>, as used by
+ * exchange REST APIs.  The buffer is kept between requests, so once it has
+ * grown to the typical request size, building a request does not allocate. */
+class SignedQuery
+{
+public:
+  explicit SignedQuery(size_t capacity = 512) { _buf.reserve(capacity); }
+
+  SignedQuery& clear()
+  {
+    _buf.clear();
+    return *this;
+  }
+
+  SignedQuery& add(std::string_view key, std::string_view value);
+  SignedQuery& add(std::string_view key, const char* value)
+  {
+    return add(key, std::string_view(value));
+  }
+  SignedQuery& add(std::string_view key, int64_t value);
+
+  /* Value formatted as by format_double. */
+  SignedQuery& add(std::string_view key, double value, bool trim_zeros,
+                   int precision);
+
+  /* Append the signature of the query so far, as the last field. */
+  SignedQuery& sign(const HmacSha256&, std::string_view key = "signature");
+
+  [[nodiscard]] std::string_view view() const { return _buf; }
+  [[nodiscard]] const std::string& str() const { return _buf; }
+
+private:
+  void append_key(std::string_view key);
+  std::string _buf;
+};
+
+} // namespace apex
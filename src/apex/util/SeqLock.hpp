@@ -0,0 +1,106 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace apex
+{
+
+/* Single-writer sequence lock, for publishing a small trivially copyable
+ * value to any number of reader threads.  The writer never waits, and takes
+ * no lock.  Readers copy the value and retry if a write overlapped the copy;
+ * try_read makes a single attempt, so is wait-free.  The value is held as
+ * relaxed atomic words, so concurrent copies are not data races. */
+template <typename T> class SeqLock
+{
+  static_assert(std::is_trivially_copyable_v<T>);
+
+  static constexpr size_t word_count =
+      (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+public:
+  SeqLock() : SeqLock(T{}) {}
+
+  explicit SeqLock(const T& value) { store_words(value); }
+
+  SeqLock(const SeqLock&) = delete;
+  SeqLock& operator=(const SeqLock&) = delete;
+
+  /** Publish a new value.  Must only be called from the single writer. */
+  void write(const T& value)
+  {
+    uint64_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    store_words(value);
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  /** Make one attempt to copy the value; returns false if a write was in
+   * progress, in which case `out` is unspecified. */
+  bool try_read(T& out) const
+  {
+    uint64_t before = _seq.load(std::memory_order_acquire);
+    if (before & 1)
+      return false;
+
+    uint64_t words[word_count];
+    for (size_t i = 0; i < word_count; i++)
+      words[i] = _words[i].load(std::memory_order_relaxed);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (_seq.load(std::memory_order_relaxed) != before)
+      return false;
+
+    std::memcpy(&out, words, sizeof(T));
+    return true;
+  }
+
+  /** Copy the value, retrying while writes overlap. */
+  [[nodiscard]] T read() const
+  {
+    T out;
+    while (!try_read(out)) {
+    }
+    return out;
+  }
+
+  /** Count of writes so far. */
+  [[nodiscard]] uint64_t version() const
+  {
+    return _seq.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  void store_words(const T& value)
+  {
+    uint64_t words[word_count] = {};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < word_count; i++)
+      _words[i].store(words[i], std::memory_order_relaxed);
+  }
+
+  alignas(64) std::atomic<uint64_t> _seq{0};
+  std::atomic<uint64_t> _words[word_count];
+};
+
+} // namespace apex
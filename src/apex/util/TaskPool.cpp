@@ -0,0 +1,161 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/TaskPool.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/EventLoop.hpp>
+
+#include <string>
+
+namespace apex
+{
+
+// index of the calling worker within its pool, for submissions made by tasks
+static thread_local const TaskPool* tl_pool = nullptr;
+static thread_local size_t tl_worker = 0;
+
+
+TaskPool::TaskPool(EventLoop* completion_loop, size_t threads,
+                   ThreadParams thread_params)
+  : _completion_loop(completion_loop)
+{
+  for (size_t i = 0; i < threads; i++)
+    _workers.push_back(std::make_unique<Worker>());
+  for (size_t i = 0; i < threads; i++)
+    _workers[i]->thread =
+        std::thread([this, i, thread_params]() { worker_loop(i, thread_params); });
+}
+
+
+TaskPool::~TaskPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(_idle_mutex);
+    _stop = true;
+  }
+  _idle_cv.notify_all();
+  for (auto& worker : _workers)
+    worker->thread.join();
+}
+
+
+void TaskPool::enqueue(TaskGroup& group, work_fn work)
+{
+  Task task{group._cancelled, std::move(work)};
+
+  if (_workers.empty()) {
+    execute(task);
+    return;
+  }
+
+  size_t target = (tl_pool == this)
+                      ? tl_worker
+                      : _next.fetch_add(1, std::memory_order_relaxed) % _workers.size();
+  {
+    // counted first, so that the count is never behind the deques; the
+    // mutex is taken so that an idle worker cannot miss the notification
+    // between testing the count and waiting
+    std::lock_guard<std::mutex> lock(_idle_mutex);
+    _queued.fetch_add(1, std::memory_order_relaxed);
+  }
+  {
+    std::lock_guard<std::mutex> lock(_workers[target]->mutex);
+    _workers[target]->tasks.push_back(std::move(task));
+  }
+  _idle_cv.notify_one();
+}
+
+
+void TaskPool::execute(Task& task)
+{
+  if (task.cancelled->load(std::memory_order_acquire))
+    return;
+
+  std::function<void()> completion;
+  try {
+    completion = task.work();
+  } catch (const std::exception& e) {
+    LOG_ERROR("task pool work failed: " << e.what());
+    return;
+  } catch (...) {
+    LOG_ERROR("task pool work failed with unknown exception");
+    return;
+  }
+
+  // the group is checked again on the event thread, where its owner cancels
+  _completion_loop->dispatch(
+      [cancelled = std::move(task.cancelled), completion = std::move(completion)]() {
+        if (!cancelled->load(std::memory_order_acquire))
+          completion();
+      });
+}
+
+
+bool TaskPool::take(size_t self, Task& task)
+{
+  {
+    auto& own = *_workers[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+
+  for (size_t i = 1; i < _workers.size(); i++) {
+    auto& victim = *_workers[(self + i) % _workers.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void TaskPool::worker_loop(size_t self, ThreadParams thread_params)
+{
+  tl_pool = this;
+  tl_worker = self;
+  std::string name = "task" + std::to_string(self);
+  Logger::instance().register_thread_id(name);
+  try_apply_thread_params(thread_params, name.c_str());
+
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(_idle_mutex);
+      _idle_cv.wait(lock, [this]() { return _stop || _queued.load() > 0; });
+      if (_stop)
+        return;
+    }
+
+    // the count can be ahead of the deques, momentarily, so a worker that
+    // finds nothing simply waits again
+    Task task;
+    if (take(self, task)) {
+      _queued.fetch_sub(1, std::memory_order_relaxed);
+      execute(task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+} // namespace apex
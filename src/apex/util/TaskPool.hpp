@@ -0,0 +1,151 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/ThreadParams.hpp>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace apex
+{
+
+class EventLoop;
+
+/* Cancellation scope for tasks submitted to a TaskPool, typically one per
+ * owner, such as a Bot.  Once cancelled, tasks of the group that have not
+ * started are skipped, and the completions of all its tasks are discarded.
+ * Because completions are discarded on the event thread, an owner that
+ * cancels on the event thread, as a Bot does on destruction, is never called
+ * back afterwards.  A task already running is not interrupted. */
+class TaskGroup
+{
+public:
+  TaskGroup() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+  ~TaskGroup() { cancel(); }
+
+  TaskGroup(const TaskGroup&) = delete;
+  TaskGroup& operator=(const TaskGroup&) = delete;
+
+  void cancel() { _cancelled->store(true, std::memory_order_release); }
+
+  [[nodiscard]] bool is_cancelled() const
+  {
+    return _cancelled->load(std::memory_order_acquire);
+  }
+
+private:
+  friend class TaskPool;
+  std::shared_ptr<std::atomic<bool>> _cancelled;
+};
+
+
+/* Pool of worker threads for computation that should not run on the event
+ * thread, e.g. refitting a model.  A task is a work function, run on a
+ * worker, and a completion function, which is passed the result of the work
+ * and invoked on the event loop.
+ *
+ * Each worker has its own deque of tasks.  Tasks submitted from outside the
+ * pool are spread round-robin across the workers; tasks submitted by a
+ * worker go to its own deque.  A worker takes its newest task first, and when
+ * it has none, steals the oldest task of another worker.
+ *
+ * With no worker threads the work is instead run inline by submit, and the
+ * completion dispatched to the event loop; this is how the pool runs in
+ * backtest, so that results arrive at the same simulated time on every run.
+ *
+ * Work functions must not reference their owner, which may be destroyed
+ * while they run; capture the inputs by value instead.  An exception thrown
+ * by the work is logged, and the completion is not invoked. */
+class TaskPool
+{
+public:
+  TaskPool(EventLoop* completion_loop, size_t threads,
+           ThreadParams thread_params = {});
+  ~TaskPool();
+
+  TaskPool(const TaskPool&) = delete;
+  TaskPool& operator=(const TaskPool&) = delete;
+
+  [[nodiscard]] size_t thread_count() const { return _workers.size(); }
+
+  /* Run `work` on the pool, then `done(result)`, or `done()` for work
+   * returning void, on the event loop.  Can be called from any thread. */
+  template <typename W, typename D> void submit(TaskGroup& group, W work, D done)
+  {
+    using R = std::invoke_result_t<W&>;
+    struct State {
+      W work;
+      D done;
+      std::conditional_t<std::is_void_v<R>, bool, std::optional<R>> result{};
+    };
+    // held by shared_ptr, so that move-only work, results and completions
+    // can pass through std::function
+    auto state = std::make_shared<State>(State{std::move(work), std::move(done)});
+    enqueue(group, [state]() -> std::function<void()> {
+      if constexpr (std::is_void_v<R>) {
+        state->work();
+        return [state]() { state->done(); };
+      } else {
+        state->result.emplace(state->work());
+        return [state]() { state->done(std::move(*state->result)); };
+      }
+    });
+  }
+
+  /* Tasks queued, but not yet started. */
+  [[nodiscard]] size_t queued() const { return _queued.load(std::memory_order_relaxed); }
+
+private:
+  // returns the completion to post to the event loop
+  using work_fn = std::function<std::function<void()>()>;
+
+  struct Task {
+    std::shared_ptr<std::atomic<bool>> cancelled;
+    work_fn work;
+  };
+
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  void enqueue(TaskGroup&, work_fn);
+  void execute(Task&);
+  bool take(size_t self, Task&);
+  void worker_loop(size_t self, ThreadParams);
+
+  EventLoop* _completion_loop;
+  std::vector<std::unique_ptr<Worker>> _workers;
+  std::atomic<size_t> _next{0};
+  std::atomic<size_t> _queued{0};
+  std::atomic<bool> _stop{false};
+  std::mutex _idle_mutex;
+  std::condition_variable _idle_cv;
+};
+
+} // namespace apex
@@ -0,0 +1,112 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/ThreadParams.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/Numa.hpp>
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace apex
+{
+
+ThreadParams parse_thread_params(Config config)
+{
+  ThreadParams params;
+  params.numa_node = numa::default_node();
+  if (config.is_empty())
+    return params;
+
+  if (config.contains("numa_node"))
+    params.numa_node = static_cast<int>(config.get_uint("numa_node"));
+
+  if (config.contains("cpu"))
+    params.cpu = static_cast<int>(config.get_uint("cpu"));
+
+  params.rt_priority = static_cast<int>(config.get_uint("rt_priority", 0));
+  if (params.rt_priority > 99) {
+    std::ostringstream oss;
+    oss << "rt_priority must be in range 0-99, " << config.path();
+    throw ConfigError(oss.str());
+  }
+
+  return params;
+}
+
+
+void apply_thread_params(const ThreadParams& params)
+{
+#ifndef _WIN32
+  // a thread pinned to a cpu keeps that pinning, but its memory still
+  // prefers the node
+  if (params.numa_node >= 0)
+    numa::bind_thread(params.numa_node, params.cpu < 0);
+
+  if (params.cpu >= 0) {
+    if (params.cpu >= CPU_SETSIZE)
+      THROW("cpu " << params.cpu << " out of range");
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(params.cpu, &cpuset);
+    int err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    if (err)
+      THROW("failed to set affinity to cpu " << params.cpu << ": "
+                                             << strerror(err));
+  }
+
+  if (params.rt_priority > 0) {
+    sched_param sp{};
+    sp.sched_priority = params.rt_priority;
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (err)
+      THROW("failed to set SCHED_FIFO priority " << params.rt_priority << ": "
+                                                  << strerror(err));
+  }
+#else
+  if (!params.empty())
+    THROW("thread params not supported on this platform");
+#endif
+}
+
+
+bool try_apply_thread_params(const ThreadParams& params,
+                             const char* thread_name)
+{
+  if (params.empty())
+    return true;
+
+  try {
+    apply_thread_params(params);
+    LOG_INFO(thread_name << " thread scheduling: cpu " << params.cpu
+                         << ", rt_priority " << params.rt_priority
+                         << ", numa_node " << params.numa_node);
+    return true;
+  } catch (std::exception& e) {
+    LOG_WARN(thread_name << " thread scheduling not applied: " << e.what());
+    return false;
+  }
+}
+
+} // namespace apex
@@ -0,0 +1,47 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+namespace apex
+{
+
+class Config;
+
+/* Scheduling parameters for a service thread, such as the EV or IO thread.
+ * Default values leave the thread as created by the OS. */
+struct ThreadParams {
+  int cpu = -1;        // CPU to pin the thread to, or -1 for no pinning
+  int rt_priority = 0; // SCHED_FIFO priority (1-99), or 0 for SCHED_OTHER
+  int numa_node = -1;  // NUMA node to place the thread on, see Numa.hpp
+
+  bool empty() const { return cpu < 0 && rt_priority == 0 && numa_node < 0; }
+};
+
+/** Parse thread parameters from a config object, supporting the optional
+ * fields "cpu", "rt_priority" and "numa_node"; the NUMA node defaults to
+ * numa::default_node(). */
+ThreadParams parse_thread_params(Config config);
+
+/** Apply parameters to the calling thread; throws upon failure. */
+void apply_thread_params(const ThreadParams&);
+
+/** Apply parameters to the calling thread, logging the outcome rather than
+ * throwing, so suitable for use in thread start callbacks. */
+bool try_apply_thread_params(const ThreadParams&, const char* thread_name);
+
+} // namespace apex
@@ -16,11 +16,16 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <apex/util/Time.hpp>
+#include <apex/util/TscClock.hpp>
+#include <apex/util/Error.hpp>
 
+#include <cstdio>
 #include <sstream>
 #include <stdexcept>
 #include <iomanip>
 
+#include <time.h>
+
 namespace apex
 {
 
@@ -91,22 +96,15 @@ static TimeVal parse_time(const std::string& s)
   }
 }
 
-Time::Time(std::chrono::microseconds usec) : _tv{0, 0}
-{
-  _tv.sec = usec.count() / 1000000;
-  _tv.usec = usec.count() - _tv.sec * 1000000;
-}
-
-
-Time::Time(const char* s) : _tv(parse_time(std::string(s))) {}
+Time::Time(const char* s) : Time(parse_time(std::string(s))) {}
 
 
-Time::Time(const std::string& s) : _tv(parse_time(s)) {}
+Time::Time(const std::string& s) : Time(parse_time(s)) {}
 
 struct tm Time::tm_utc() const
 {
   struct tm parts;
-  time_t rawtime = this->_tv.sec;
+  time_t rawtime = sec();
 
 #ifndef _WIN32
   gmtime_r(&rawtime, &parts);
@@ -120,6 +118,7 @@ struct tm Time::tm_utc() const
 
 std::string Time::as_iso8601(Resolution resolution, bool simpler) const
 {
+  static constexpr char nano_format[]  = "2017-05-21T07:51:17.000000000Z"; // 30
   static constexpr char micro_format[] = "2017-05-21T07:51:17.000000Z"; // 27
   static constexpr char milli_format[] = "2017-05-21T07:51:17.000Z";    // 24
   static constexpr char short_format[] = "2017-05-21T07:51:17";         // 19
@@ -133,10 +132,11 @@ std::string Time::as_iso8601(Resolution resolution, bool simpler) const
   static_assert(sizeof buf > (sizeof milli_format));
   static_assert(sizeof milli_format > sizeof short_format);
   static_assert(sizeof micro_format > sizeof short_format);
-  static_assert((sizeof buf + 1) > sizeof micro_format);
+  static_assert((sizeof buf + 1) > sizeof nano_format);
 
   struct tm parts;
-  time_t rawtime = this->_tv.sec;
+  time_t rawtime = sec();
+  const int subsec_us = int(subsec_ns() / 1000);
 
 #ifndef _WIN32
   gmtime_r(&rawtime, &parts);
@@ -156,19 +156,28 @@ std::string Time::as_iso8601(Resolution resolution, bool simpler) const
     case Resolution::milli:
  #ifndef _WIN32
       ec = snprintf(&buf[short_len], sizeof(buf) - short_len, ".%03dZ",
-                    (int)_tv.usec / 1000);
+                    subsec_us / 1000);
 #else
       ec = sprintf_s(&buf[short_len], sizeof(buf) - short_len, ".%03dZ",
-                     (int)tv.usec / 1000);
+                     subsec_us / 1000);
 #endif
       break;
     case Resolution::micro:
  #ifndef _WIN32
       ec = snprintf(&buf[short_len], sizeof(buf) - short_len, ".%06dZ",
-                    (int)_tv.usec);
+                    subsec_us);
 #else
       ec = snprintf_s(&buf[short_len], sizeof(buf) - short_len, ".%06dZ",
-                      (int)_tv.usec);
+                      subsec_us);
+#endif
+      break;
+    case Resolution::nano:
+ #ifndef _WIN32
+      ec = snprintf(&buf[short_len], sizeof(buf) - short_len, ".%09dZ",
+                    int(subsec_ns()));
+#else
+      ec = snprintf_s(&buf[short_len], sizeof(buf) - short_len, ".%09dZ",
+                      int(subsec_ns()));
 #endif
       break;
   }
@@ -183,9 +192,12 @@ std::string Time::as_iso8601(Resolution resolution, bool simpler) const
     case Resolution::micro:
       buf[sizeof micro_format - 1 - int(simpler)] = '\0';
       break;
+    case Resolution::nano:
+      buf[sizeof nano_format - 1 - int(simpler)] = '\0';
+      break;
   }
 
-  buf[sizeof buf] = '\0';
+  buf[sizeof buf - 1] = '\0';
   return buf;
 }
 
@@ -197,7 +209,20 @@ std::ostream& operator<<(std::ostream& os, const Time& t)
 }
 
 
-Time Time::realtime_now() { return Time(time_now()); }
+Time Time::realtime_now()
+{
+#ifndef _WIN32
+  // served from the vDSO, without a system call
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return Time(std::chrono::nanoseconds(int64_t(ts.tv_sec) * ns_per_sec + ts.tv_nsec));
+#else
+  return Time(time_now());
+#endif
+}
+
+
+Time Time::fast_now() { return TscClock::instance().now(); }
 
 
 std::chrono::microseconds operator-(const Time& a, const Time& b)
@@ -206,6 +231,20 @@ std::chrono::microseconds operator-(const Time& a, const Time& b)
 }
 
 
+std::chrono::microseconds parse_time_of_day(const std::string& s)
+{
+  int h = 0, m = 0, sec = 0;
+  char c1 = 0, c2 = 0;
+  int n = std::sscanf(s.c_str(), "%d%c%d%c%d", &h, &c1, &m, &c2, &sec);
+  if ((n != 3 && n != 5) || c1 != ':' || (n == 5 && c2 != ':') || h < 0 ||
+      h > 23 || m < 0 || m > 59 || sec < 0 || sec > 59) {
+    THROW("invalid time of day '" << s << "', expected HH:MM[:SS]");
+  }
+  return std::chrono::hours(h) + std::chrono::minutes(m) +
+         std::chrono::seconds(sec);
+}
+
+
 apex::Time Time::round_to_earliest_day() const {
   using namespace std::chrono;
   using namespace std;
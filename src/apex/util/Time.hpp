@@ -20,91 +20,84 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/platform.hpp>
 
 #include <chrono>
+#include <cstdint>
+#include <string>
 
 namespace apex
 {
 
+/* A point in time, as a count of nanoseconds since the epoch, so that
+ * comparisons are a single integer compare and nanosecond intervals, as used
+ * by latency tracing, can be represented. */
 class Time
 {
 
 public:
-  enum class Resolution { milli, micro };
+  enum class Resolution { milli, micro, nano };
 
-  Time() : _tv{0, 0} {}
-  Time(int sec, std::chrono::milliseconds ms) : _tv{sec, ms.count() * 1000} {}
-  Time(int sec, std::chrono::microseconds us) : _tv{sec, us.count()} {}
+  Time() : _ns(0) {}
+  Time(int sec, std::chrono::milliseconds ms)
+    : _ns(sec * ns_per_sec + ms.count() * 1000000) {}
+  Time(int sec, std::chrono::microseconds us)
+    : _ns(sec * ns_per_sec + us.count() * 1000) {}
   Time(const Time& other) = default;
-  explicit Time(std::chrono::microseconds);
+  template <typename Rep, typename Period>
+  explicit Time(std::chrono::duration<Rep, Period> since_epoch)
+    : _ns(std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count())
+  {
+  }
   explicit Time(const char* s);
   explicit Time(const std::string& s);
-  explicit Time(TimeVal tv) : _tv{tv} {}
+  explicit Time(TimeVal tv) : _ns(tv.sec * ns_per_sec + tv.usec * 1000) {}
 
   /* Caution -- this must not be used by any part of the program/strategy that
    * might operate in backtest mode. This always returns the real world
    * wall-clock time, never the simulation time. */
   static Time realtime_now();
 
-  Time& operator=(const Time& other)
-  {
-    this->_tv = other._tv;
-    return *this;
-  }
+  /* As realtime_now(), but read from the calibrated CPU timestamp counter
+   * where available; see TscClock. */
+  static Time fast_now();
+
+  Time& operator=(const Time& other) = default;
 
-  void operator+=(std::chrono::milliseconds interval)
+  template <typename Rep, typename Period>
+  Time& operator+=(std::chrono::duration<Rep, Period> interval)
   {
-    auto usec = _tv.usec + interval.count() * 1000;
-    auto secs = usec / 1000000;
-    auto remainder = usec % 1000000;
-    _tv.sec += secs;
-    _tv.usec = remainder;
+    _ns += std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    return *this;
   }
 
-
-  bool operator==(const Time& other) const
+  template <typename Rep, typename Period>
+  Time& operator-=(std::chrono::duration<Rep, Period> interval)
   {
-    return this->_tv.sec == other._tv.sec && this->_tv.usec == other._tv.usec;
+    _ns -= std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
+    return *this;
   }
 
-
-  bool operator!=(const Time& other) const {
-    return !(*this == other);
-  }
+  bool operator==(const Time& other) const { return _ns == other._ns; }
+  bool operator!=(const Time& other) const { return _ns != other._ns; }
+  bool operator<(const Time& other) const { return _ns < other._ns; }
+  bool operator>(const Time& other) const { return _ns > other._ns; }
+  bool operator<=(const Time& other) const { return _ns <= other._ns; }
+  bool operator>=(const Time& other) const { return _ns >= other._ns; }
 
   [[nodiscard]] std::chrono::milliseconds as_epoch_ms() const
   {
-    return std::chrono::milliseconds(_tv.sec * 1000 + _tv.usec / 1000);
+    return std::chrono::milliseconds(_ns / 1000000);
   }
 
   [[nodiscard]] std::chrono::microseconds as_epoch_us() const
   {
-    return std::chrono::microseconds(_tv.sec * 1000000 + _tv.usec);
+    return std::chrono::microseconds(_ns / 1000);
   }
 
-  bool operator<=(const Time& other) const
+  [[nodiscard]] std::chrono::nanoseconds as_epoch_ns() const
   {
-    return *this == other || *this < other;
+    return std::chrono::nanoseconds(_ns);
   }
 
-  bool operator>=(const Time& other) const
-  {
-    return *this == other || *this > other;
-  }
-
-  bool operator>(const Time& other) const
-  {
-    return (this->_tv.sec > other._tv.sec) or
-           ((this->_tv.sec == other._tv.sec) and
-            (this->_tv.usec > other._tv.usec));
-  }
-
-  bool operator<(const Time& other) const
-  {
-    return (this->_tv.sec < other._tv.sec) or
-           ((this->_tv.sec == other._tv.sec) and
-            (this->_tv.usec < other._tv.usec));
-  }
-
-  [[nodiscard]] bool empty() const { return _tv.sec == 0 && _tv.usec == 0; }
+  [[nodiscard]] bool empty() const { return _ns == 0; }
 
   // The `simpler` option makes the datetime string a little more human readable
   // format
@@ -113,9 +106,13 @@ public:
   /* Return the UTC representation in a struct tm */
   [[nodiscard]] struct tm tm_utc() const;
 
-
+  /* Microseconds and nanoseconds within the second. */
   [[nodiscard]] std::chrono::microseconds usec() const {
-    return std::chrono::microseconds{_tv.usec};
+    return std::chrono::microseconds{subsec_ns() / 1000};
+  }
+
+  [[nodiscard]] std::chrono::nanoseconds nsec() const {
+    return std::chrono::nanoseconds{subsec_ns()};
   }
 
   [[nodiscard]] apex::Time round_to_earliest_day() const;
@@ -123,14 +120,28 @@ public:
   [[nodiscard]] std::string strftime(const char* format) const;
 
 private:
-  struct TimeVal _tv; // implementation
+  static constexpr int64_t ns_per_sec = 1000000000;
+
+  // whole seconds and the remainder, rounded towards the past
+  [[nodiscard]] int64_t sec() const {
+    return _ns >= 0 ? _ns / ns_per_sec : -((-_ns + ns_per_sec - 1) / ns_per_sec);
+  }
+  [[nodiscard]] int64_t subsec_ns() const { return _ns - sec() * ns_per_sec; }
+
+  int64_t _ns;
 };
 
 
+/* Interval between two times, truncated to microseconds; use as_epoch_ns()
+ * for nanosecond intervals. */
 std::chrono::microseconds operator-(const Time&, const Time&);
 
 std::ostream& operator<<(std::ostream&, const Time&);
 
+/* Parse a time of day, "HH:MM[:SS]", as the interval since midnight; throws
+ * apex::Error if malformed. */
+std::chrono::microseconds parse_time_of_day(const std::string&);
+
 
 
 } // namespace apex
@@ -0,0 +1,375 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace apex
+{
+
+/* Identify a timer scheduled on a TimerWheel, or on an EventLoop.  Handles are
+ * cheap to copy, and become stale once a timer is cancelled or completes, so
+ * cancelling via a stale handle is harmless. */
+struct TimerHandle {
+  static constexpr uint32_t npos = std::numeric_limits<uint32_t>::max();
+
+  uint32_t index = npos;
+  uint32_t generation = 0;
+
+  bool empty() const { return index == npos; }
+};
+
+
+/* Hierarchical timer wheel, with O(1) schedule and cancel.
+ *
+ * Time is measured in integer ticks, with the unit chosen by the caller (eg,
+ * microseconds).  The wheel has `levels` levels each of 256 slots; a timer is
+ * placed at the level of the most significant byte in which its due tick
+ * differs from the wheel's current tick, so level 0 slots each hold timers of
+ * exactly one tick.  As the wheel advances, only the single higher level slot
+ * whose range has been entered is cascaded down.  Timers beyond the range of
+ * the top level are held on an overflow list.
+ *
+ * Timer nodes live in a slab that is recycled via a free list, so in steady
+ * state scheduling does not allocate.  Timers due on the same tick expire in
+ * the order they were scheduled.
+ *
+ * Expiry is two-phase, to allow callbacks to be invoked outside of any lock
+ * protecting the wheel: `expire` hands out each due timer's value, after which
+ * the caller must either `rearm` (for a repeating timer) or `release` it.
+ * Cancelling a timer which is being fired causes the following `rearm` to be
+ * declined. */
+template <typename T> class TimerWheel
+{
+public:
+  typedef uint64_t tick_type;
+
+  explicit TimerWheel(tick_type now = 0) : _now(now)
+  {
+    std::fill(&_heads[0][0], &_heads[0][0] + (levels + 1) * slots, nil);
+    std::fill(&_bitmap[0][0], &_bitmap[0][0] + levels * bitmap_words, 0);
+  }
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  /** Current tick of the wheel; advanced only by expire(). */
+  tick_type now() const { return _now; }
+
+  /** Number of armed timers. */
+  size_t size() const { return _armed; }
+  bool empty() const { return _armed == 0; }
+
+  /** Schedule a timer; a due tick in the past is treated as due now. */
+  TimerHandle schedule(tick_type due, T value)
+  {
+    const uint32_t i = alloc_node();
+    _nodes[i].value = std::move(value);
+    arm(i, due);
+    return {i, _nodes[i].generation};
+  }
+
+  /** Cancel a timer.  Returns false if the handle is stale. */
+  bool cancel(TimerHandle h)
+  {
+    if (!is_live(h))
+      return false;
+    Node& node = _nodes[h.index];
+    switch (node.state) {
+      case state_armed:
+        unlink(h.index);
+        --_armed;
+        if (_next_due_valid && node.due == _next_due)
+          _next_due_valid = false;
+        free_node(h.index);
+        return true;
+      case state_firing:
+        node.state = state_cancelled;
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /** Test whether a handle refers to an armed or firing timer. */
+  bool is_active(TimerHandle h) const
+  {
+    return is_live(h) && (_nodes[h.index].state == state_armed ||
+                          _nodes[h.index].state == state_firing);
+  }
+
+  /** Return the due tick of the earliest armed timer; wheel must not be
+   * empty. */
+  tick_type next_due()
+  {
+    assert(_armed > 0);
+    if (!_next_due_valid) {
+      _next_due = find_next_due();
+      _next_due_valid = true;
+    }
+    return _next_due;
+  }
+
+  /** Expire, in order, up to `max_count` timers which are due at or before
+   * `upto`.  For each, `fn(TimerHandle, tick_type due, T&& value)` is invoked;
+   * `fn` must not otherwise access the wheel.  If all due timers were
+   * expired, the wheel then advances to `upto`.  Returns the number expired. */
+  template <typename F>
+  size_t expire(tick_type upto, F&& fn,
+                size_t max_count = std::numeric_limits<size_t>::max())
+  {
+    size_t count = 0;
+    while (_armed && count < max_count) {
+      const tick_type due = next_due();
+      if (due > upto)
+        break;
+      advance_to(due);
+
+      // select the earliest-scheduled timer on this tick
+      const size_t slot = due & slot_mask;
+      uint32_t best = _heads[0][slot];
+      for (uint32_t i = _nodes[best].next; i != nil; i = _nodes[i].next)
+        if (_nodes[i].seq < _nodes[best].seq)
+          best = i;
+
+      unlink(best);
+      --_armed;
+      if (_heads[0][slot] == nil)
+        _next_due_valid = false;
+
+      Node& node = _nodes[best];
+      node.state = state_firing;
+      fn(TimerHandle{best, node.generation}, due, std::move(node.value));
+      ++count;
+    }
+    if (upto > _now && (_armed == 0 || next_due() > upto))
+      advance_to(upto);
+    return count;
+  }
+
+  /** Re-arm a timer previously handed out by expire().  Returns false, and
+   * releases the timer, if it was cancelled while firing. */
+  bool rearm(TimerHandle h, tick_type due, T value)
+  {
+    if (!is_live(h))
+      return false;
+    Node& node = _nodes[h.index];
+    if (node.state != state_firing) {
+      free_node(h.index);
+      return false;
+    }
+    node.value = std::move(value);
+    arm(h.index, due);
+    return true;
+  }
+
+  /** Release a timer previously handed out by expire(). */
+  void release(TimerHandle h)
+  {
+    if (is_live(h) && _nodes[h.index].state != state_armed)
+      free_node(h.index);
+  }
+
+private:
+  static constexpr int bits = 8;
+  static constexpr size_t slots = 1 << bits;
+  static constexpr tick_type slot_mask = slots - 1;
+  static constexpr int levels = 5;
+  static constexpr size_t bitmap_words = slots / 64;
+  static constexpr uint32_t nil = TimerHandle::npos;
+
+  enum : uint8_t { state_free, state_armed, state_firing, state_cancelled };
+
+  struct Node {
+    tick_type due = 0;
+    uint64_t seq = 0;
+    uint32_t prev = nil;
+    uint32_t next = nil;
+    uint32_t generation = 0;
+    uint16_t slot = 0;
+    uint8_t level = 0;
+    uint8_t state = state_free;
+    T value{};
+  };
+
+  bool is_live(TimerHandle h) const
+  {
+    return h.index < _nodes.size() &&
+           _nodes[h.index].generation == h.generation &&
+           _nodes[h.index].state != state_free;
+  }
+
+  uint32_t alloc_node()
+  {
+    if (_free != nil) {
+      const uint32_t i = _free;
+      _free = _nodes[i].next;
+      return i;
+    }
+    _nodes.emplace_back();
+    return static_cast<uint32_t>(_nodes.size() - 1);
+  }
+
+  void free_node(uint32_t i)
+  {
+    Node& node = _nodes[i];
+    node.value = T{};
+    node.state = state_free;
+    node.generation++;
+    node.next = _free;
+    _free = i;
+  }
+
+  void arm(uint32_t i, tick_type due)
+  {
+    Node& node = _nodes[i];
+    node.due = std::max(due, _now);
+    node.seq = _next_seq++;
+    node.state = state_armed;
+    link(i);
+    if (_armed == 0) {
+      _next_due = node.due;
+      _next_due_valid = true;
+    } else if (_next_due_valid && node.due < _next_due)
+      _next_due = node.due;
+    ++_armed;
+  }
+
+  static int level_of(tick_type due, tick_type now)
+  {
+    const tick_type diff = due ^ now;
+    if (diff == 0)
+      return 0;
+    return (63 - __builtin_clzll(diff)) / bits;
+  }
+
+  void link(uint32_t i)
+  {
+    Node& node = _nodes[i];
+    const int level = std::min(level_of(node.due, _now), levels);
+    const size_t slot =
+        (level < levels) ? ((node.due >> (level * bits)) & slot_mask) : 0;
+    node.level = static_cast<uint8_t>(level);
+    node.slot = static_cast<uint16_t>(slot);
+    node.prev = nil;
+    node.next = _heads[level][slot];
+    if (node.next != nil)
+      _nodes[node.next].prev = i;
+    _heads[level][slot] = i;
+    if (level < levels)
+      _bitmap[level][slot / 64] |= (uint64_t(1) << (slot % 64));
+  }
+
+  void unlink(uint32_t i)
+  {
+    Node& node = _nodes[i];
+    if (node.prev != nil)
+      _nodes[node.prev].next = node.next;
+    else
+      _heads[node.level][node.slot] = node.next;
+    if (node.next != nil)
+      _nodes[node.next].prev = node.prev;
+    if (node.level < levels && _heads[node.level][node.slot] == nil)
+      _bitmap[node.level][node.slot / 64] &=
+          ~(uint64_t(1) << (node.slot % 64));
+  }
+
+  /* Find first non-empty slot at or after `from` on a level, or -1. */
+  int find_slot(int level, size_t from) const
+  {
+    for (size_t w = from / 64; w < bitmap_words; ++w) {
+      uint64_t word = _bitmap[level][w];
+      if (w == from / 64)
+        word &= ~uint64_t(0) << (from % 64);
+      if (word)
+        return static_cast<int>(w * 64 + __builtin_ctzll(word));
+    }
+    return -1;
+  }
+
+  tick_type min_due(uint32_t head) const
+  {
+    tick_type result = std::numeric_limits<tick_type>::max();
+    for (uint32_t i = head; i != nil; i = _nodes[i].next)
+      result = std::min(result, _nodes[i].due);
+    return result;
+  }
+
+  tick_type find_next_due() const
+  {
+    // level 0 slots hold exactly one tick each
+    int slot = find_slot(0, _now & slot_mask);
+    if (slot >= 0)
+      return (_now & ~slot_mask) | static_cast<tick_type>(slot);
+
+    // otherwise the earliest non-empty slot of the lowest non-empty level
+    for (int level = 1; level < levels; ++level) {
+      const size_t from = ((_now >> (level * bits)) & slot_mask) + 1;
+      if (from < slots) {
+        slot = find_slot(level, from);
+        if (slot >= 0)
+          return min_due(_heads[level][slot]);
+      }
+    }
+
+    return min_due(_heads[levels][0]);
+  }
+
+  /* Advance the current tick to `t`, which must not be later than any armed
+   * timer.  Lower levels are then necessarily empty, and so only the slot
+   * which `t` has entered, on the highest level that changed, needs to be
+   * cascaded. */
+  void advance_to(tick_type t)
+  {
+    if (t <= _now)
+      return;
+    const int level = std::min(level_of(t, _now), levels);
+    _now = t;
+    if (level == 0)
+      return;
+
+    const size_t slot =
+        (level < levels) ? ((t >> (level * bits)) & slot_mask) : 0;
+    uint32_t i = _heads[level][slot];
+    _heads[level][slot] = nil;
+    if (level < levels)
+      _bitmap[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    while (i != nil) {
+      const uint32_t next = _nodes[i].next;
+      link(i);
+      i = next;
+    }
+  }
+
+  tick_type _now;
+  uint64_t _next_seq = 0;
+  size_t _armed = 0;
+  tick_type _next_due = 0;
+  bool _next_due_valid = false;
+
+  std::vector<Node> _nodes;
+  uint32_t _free = nil;
+  uint32_t _heads[levels + 1][slots];
+  uint64_t _bitmap[levels][bitmap_words];
+};
+
+} // namespace apex
@@ -0,0 +1,151 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/util/TscClock.hpp>
+
+#include <thread>
+
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define APEX_HAVE_TSC 1
+#endif
+
+namespace apex
+{
+
+static bool has_invariant_tsc()
+{
+#ifdef APEX_HAVE_TSC
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+    return false;
+  return edx & (1u << 8);
+#else
+  return false;
+#endif
+}
+
+
+TscClock& TscClock::instance()
+{
+  static TscClock clock;
+  return clock;
+}
+
+
+TscClock::TscClock() : _use_tsc(has_invariant_tsc())
+{
+  if (!_use_tsc)
+    return;
+
+  // an initial rate over a short interval; recalibrate() refines it
+  _anchor = sample();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  recalibrate();
+}
+
+
+uint64_t TscClock::read_tsc()
+{
+#ifdef APEX_HAVE_TSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+int64_t TscClock::realtime_ns()
+{
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return int64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+
+/* Pair a TSC reading with the system time, keeping the tightest of a few
+ * attempts so that preemption between the readings does not skew it. */
+TscClock::Sample TscClock::sample()
+{
+  Sample best{};
+  uint64_t best_span = UINT64_MAX;
+  for (int i = 0; i < 8; i++) {
+    auto before = read_tsc();
+    auto ns = realtime_ns();
+    auto after = read_tsc();
+    if (after - before < best_span) {
+      best_span = after - before;
+      best = {before + (after - before) / 2, ns};
+    }
+  }
+  return best;
+}
+
+
+void TscClock::recalibrate()
+{
+  if (!_use_tsc)
+    return;
+
+  auto now = sample();
+  auto ticks = now.tsc - _anchor.tsc;
+  auto ns = now.ns - _anchor.ns;
+  if (ticks == 0 || ns <= 0)
+    return; // clock stepped backwards; keep the previous rate
+
+  auto mult = uint64_t((static_cast<unsigned __int128>(ns) << 32) / ticks);
+  publish(now, mult);
+  _anchor = now;
+}
+
+
+void TscClock::publish(const Sample& base, uint64_t mult)
+{
+  auto seq = _seq.load(std::memory_order_relaxed);
+  _seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _base_tsc.store(base.tsc, std::memory_order_relaxed);
+  _base_ns.store(base.ns, std::memory_order_relaxed);
+  _mult.store(mult, std::memory_order_relaxed);
+  _seq.store(seq + 2, std::memory_order_release);
+}
+
+
+int64_t TscClock::now_ns() const
+{
+  if (!_use_tsc)
+    return realtime_ns();
+
+  uint64_t seq, base_tsc, mult;
+  int64_t base_ns;
+  do {
+    seq = _seq.load(std::memory_order_acquire);
+    base_tsc = _base_tsc.load(std::memory_order_relaxed);
+    base_ns = _base_ns.load(std::memory_order_relaxed);
+    mult = _mult.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((seq & 1) || seq != _seq.load(std::memory_order_relaxed));
+
+  auto ticks = int64_t(read_tsc() - base_tsc);
+  auto delta = (static_cast<__int128>(ticks) * mult) >> 32;
+  return base_ns + int64_t(delta);
+}
+
+} // namespace apex
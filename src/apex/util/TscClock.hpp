@@ -0,0 +1,76 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <apex/util/Time.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace apex
+{
+
+/* Wall-clock time derived from the CPU timestamp counter, which can be read
+ * in a few nanoseconds without entering the kernel.  The counter is
+ * calibrated against CLOCK_REALTIME when the clock is first used, and again
+ * by each call to recalibrate(), which long running processes should make
+ * periodically (say every few seconds) so that it follows adjustments of the
+ * system clock.  On CPUs without an invariant TSC, now() reads
+ * CLOCK_REALTIME instead. */
+class TscClock
+{
+public:
+  static TscClock& instance();
+
+  [[nodiscard]] Time now() const { return Time(std::chrono::nanoseconds(now_ns())); }
+
+  [[nodiscard]] int64_t now_ns() const;
+
+  [[nodiscard]] bool uses_tsc() const { return _use_tsc; }
+
+  /* Re-anchor to the current system time, with a rate measured over the
+   * interval since the previous calibration.  Readers may run concurrently,
+   * but only one thread may recalibrate. */
+  void recalibrate();
+
+private:
+  TscClock();
+
+  struct Sample {
+    uint64_t tsc;
+    int64_t ns;
+  };
+
+  static Sample sample();
+  static uint64_t read_tsc();
+  static int64_t realtime_ns();
+
+  void publish(const Sample& base, uint64_t mult);
+
+  bool _use_tsc = false;
+  Sample _anchor{};
+
+  // ns = base_ns + ((tsc - base_tsc) * mult) >> 32, published under a
+  // sequence lock so that readers never see a torn set
+  std::atomic<uint64_t> _seq{0};
+  std::atomic<uint64_t> _base_tsc{0};
+  std::atomic<int64_t> _base_ns{0};
+  std::atomic<uint64_t> _mult{0};
+};
+
+} // namespace apex
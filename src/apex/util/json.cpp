@@ -38,6 +38,28 @@ json read_json_config_file(const std::string& path)
   return j;
 }
 
+json json_merge_diff(const json& from, const json& to)
+{
+  if (!from.is_object() || !to.is_object())
+    return from == to ? json::object() : to;
+
+  json patch = json::object();
+  for (auto& [key, value] : to.items()) {
+    auto iter = from.find(key);
+    if (iter == from.end())
+      patch[key] = value;
+    else if (*iter != value)
+      patch[key] = (iter->is_object() && value.is_object())
+                       ? json_merge_diff(*iter, value)
+                       : value;
+  }
+  for (auto& [key, value] : from.items())
+    if (!to.contains(key))
+      patch[key] = nullptr;
+  return patch;
+}
+
+
 json read_json_file(const std::string& path)
 {
   /* read the file */
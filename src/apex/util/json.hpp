@@ -96,4 +96,9 @@ json read_json_file(const std::string& path);
 
 json read_json_config_file(const std::string& path);
 
+/* The JSON merge patch (RFC 7386) that takes `from` to `to`: the members of
+ * objects added or changed, with those removed as null; any other value is
+ * replaced whole.  Empty if the two are equal. */
+json json_merge_diff(const json& from, const json& to);
+
 } // namespace apex
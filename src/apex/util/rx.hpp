@@ -38,7 +38,17 @@ template <typename T> struct observer {
 };
 
 
-template <typename T> class observable
+/* Lock policy for observables used only on a single thread, such as the event
+ * loop thread; it meets the Lockable requirements but does nothing. */
+struct null_mutex {
+  void lock() {}
+  void unlock() {}
+  bool try_lock() { return true; }
+};
+
+
+/* Observable with a list of observers, guarded by a lock of type Mutex. */
+template <typename T, typename Mutex = std::mutex> class observable
 {
 public:
   using observable_type = observer<T>;
@@ -67,22 +77,20 @@ protected:
     this->broadcast_nolock(v);
   }
 
-  void broadcast_nolock(const T& v)
+  // an observer that throws terminates the program, via noexcept
+  void broadcast_nolock(const T& v) noexcept
   {
     for (auto& item : m_observers)
-      try {
-        item.on_next(v);
-      } catch (...) {
-        std::terminate();
-      }
+      item.on_next(v);
   }
 
-  mutable std::mutex m_mutex;
+  mutable Mutex m_mutex;
   std::vector<observable_type> m_observers;
 };
 
 
-template <typename T> class subject : public observable<T>
+template <typename T, typename Mutex = std::mutex>
+class subject : public observable<T, Mutex>
 {
 public:
   subject() = default;
@@ -95,6 +103,11 @@ private:
 };
 
 
+/* Single-threaded variants, which take no lock on subscribe or next. */
+template <typename T> using local_observable = observable<T, null_mutex>;
+template <typename T> using local_subject = subject<T, null_mutex>;
+
+
 template <typename T> class behaviour_subject : public observable<T>
 {
 
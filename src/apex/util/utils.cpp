@@ -21,6 +21,8 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/core/Logger.hpp>
 #include <apex/util/platform.hpp>
 
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <memory>
 
@@ -212,18 +214,27 @@ void log_message_exception(const char* source, const std::string& data)
   }
 }
 
-std::string format_double(double d, bool trim_zeros, int precision)
+size_t format_double(char* buf, size_t size, double d, bool trim_zeros,
+                     int precision)
 {
-  char buf[256] = {};
-  int written = snprintf(buf, sizeof(buf) - 1, "%.*f", precision, d);
+  int written = snprintf(buf, size, "%.*f", precision, d);
+  if (written < 0)
+    return 0;
+  size_t len = std::min(static_cast<size_t>(written), size - 1);
+
+  // trailing zeros are removed, but one is kept after the point: 50.0
+  if (trim_zeros)
+    while (len > 1 && buf[len - 1] == '0' && buf[len - 2] != '.')
+      len--;
+  buf[len] = 0;
+  return len;
+}
 
-  // TODO: unit test this!
-  if (written > 0 && trim_zeros) // 50.02000###
-    for (int i = written + 1;
-         i > 0 && ((buf[i] == '0' && buf[i - 1] != '.') || buf[i] == 0); i--)
-      buf[i] = 0;
 
-  return buf;
+std::string format_double(double d, bool trim_zeros, int precision)
+{
+  char buf[256];
+  return std::string(buf, format_double(buf, sizeof(buf), d, trim_zeros, precision));
 }
 
 
@@ -307,25 +318,123 @@ std::ostream& operator<<(std::ostream& os, const ScaledInt& i)
 
 
 ScaledInt::ScaledInt(int64_t mantissa, int scale)
-  : _mantissa(mantissa), _scale(scale), _exponent_pow10(pow(10, scale))
+  : _mantissa(mantissa), _scale(scale)
+{
+}
+
+
+int ScaledInt::compare(const ScaledInt& other) const
+{
+  // bring the value with fewer decimal places to the scale of the other
+  const bool this_coarser = _scale > other._scale;
+  const ScaledInt& coarse = this_coarser ? *this : other;
+  const ScaledInt& fine = this_coarser ? other : *this;
+  const int shift = coarse._scale - fine._scale;
+
+  int64_t aligned;
+  if (shift <= 18 && __builtin_mul_overflow(coarse._mantissa,
+                                            (int64_t)pow10_of(shift),
+                                            &aligned) == false) {
+    const int c = (aligned > fine._mantissa) - (aligned < fine._mantissa);
+    return this_coarser ? c : -c;
+  }
+
+  // the aligned mantissa is beyond int64, so compare approximately
+  const double a = as_double(), b = other.as_double();
+  return (a > b) - (a < b);
+}
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+static inline bool is_eight_digits(uint64_t v)
 {
+  return (((v & 0xF0F0F0F0F0F0F0F0) |
+           (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+          0x3333333333333333);
+}
+
+
+/* Value of eight ascii digits, loaded little-endian; combines pairs, then
+ * quads, then the two halves, with three multiplies. */
+static inline uint64_t parse_eight_digits(uint64_t v)
+{
+  v -= 0x3030303030303030;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+       (((v >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+      32;
+  return v;
+}
+#endif
+
+
+bool parse_decimal(std::string_view src, ScaledInt& exact, double& value)
+{
+  const char* p = src.data();
+  const char* const end = p + src.size();
+
+  const bool negative = (p != end && *p == '-');
+  p += negative;
+
+  // up to 18 digits cannot overflow the mantissa, so no checks are needed
+  // while accumulating
+  if (end - p > 19)
+    return false;
+
+  uint64_t mantissa = 0;
+  const char* whole = p;
+  while (p != end && unsigned(*p - '0') < 10)
+    mantissa = mantissa * 10 + unsigned(*p++ - '0');
+  size_t digits = p - whole;
+
+  int decimals = 0;
+  if (p != end && *p == '.') {
+    const char* fract = ++p;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t chunk;
+    while (end - p >= 8 && (memcpy(&chunk, p, 8), is_eight_digits(chunk))) {
+      mantissa = mantissa * 100000000 + parse_eight_digits(chunk);
+      p += 8;
+    }
+#endif
+    while (p != end && unsigned(*p - '0') < 10)
+      mantissa = mantissa * 10 + unsigned(*p++ - '0');
+    decimals = p - fract;
+    digits += decimals;
+  }
+
+  if (p != end || digits == 0 || digits > 18)
+    return false;
+
+  const int64_t signed_mantissa =
+      negative ? -int64_t(mantissa) : int64_t(mantissa);
+  exact = ScaledInt(signed_mantissa, -decimals);
+
+  // exact integer divided by an exact power of ten is correctly rounded
+  if (mantissa <= (uint64_t(1) << 53))
+    value = double(signed_mantissa) / pow10_of(decimals);
+  else
+    std::from_chars(src.data(), end, value);
+  return true;
 }
 
 
 double ScaledInt::ceil(double raw) const
 {
-  double raw_mantissa = raw / _exponent_pow10;
+  const double pow10 = exponent_pow10();
+  double raw_mantissa = raw / pow10;
   double raw_mantissa_factor = raw_mantissa / _mantissa;
   double raw_mantissa_factor_round = std::ceil(raw_mantissa_factor);
-  return raw_mantissa_factor_round * _mantissa * _exponent_pow10;
+  return raw_mantissa_factor_round * _mantissa * pow10;
 }
 
 double ScaledInt::trunc(double raw) const
 {
-  double raw_mantissa = raw / _exponent_pow10;
+  const double pow10 = exponent_pow10();
+  double raw_mantissa = raw / pow10;
   double raw_mantissa_factor = raw_mantissa / _mantissa;
   double raw_mantissa_factor_round = std::trunc(raw_mantissa_factor);
-  return raw_mantissa_factor_round * _mantissa * _exponent_pow10;
+  return raw_mantissa_factor_round * _mantissa * pow10;
 }
 
 /*
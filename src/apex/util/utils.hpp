@@ -17,11 +17,14 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #pragma once
 
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <functional>
 #include <list>
 #include <mutex>
 #include <string>
+#include <string_view>
 
 
 #ifndef STRINGIFY
@@ -175,6 +178,19 @@ private:
   std::function<void()> _fn;
 };
 
+/* Return 10^e; exact for |e| <= 22, without a call to pow. */
+inline double pow10_of(int e)
+{
+  static constexpr double table[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  if (e >= 0 && e <= 22)
+    return table[e];
+  if (e < 0 && e >= -22)
+    return 1.0 / table[-e];
+  return std::pow(10.0, e);
+}
+
 /* Represent values like 0.0001 etc, as  pair (1, -4). Does not have to be
    normalised, eg, the _mantissa can be like 10000. */
 struct ScaledInt {
@@ -195,7 +211,19 @@ struct ScaledInt {
     return _mantissa != other._mantissa or _scale != other._scale;
   }
 
-  double exponent_pow10() const { return _exponent_pow10; }
+  /* Ordering is by value, and exact; values of equal scale, such as prices
+   * parsed from an exchange that uses fixed decimal places, compare as
+   * integers. */
+  bool operator<(const ScaledInt& other) const
+  {
+    return _scale == other._scale ? _mantissa < other._mantissa
+                                  : compare(other) < 0;
+  }
+  bool operator>(const ScaledInt& other) const { return other < *this; }
+  bool operator<=(const ScaledInt& other) const { return !(other < *this); }
+  bool operator>=(const ScaledInt& other) const { return !(*this < other); }
+
+  double exponent_pow10() const { return pow10_of(_scale); }
 
   int64_t mantissa() const { return _mantissa; }
   int scale() const { return _scale; }
@@ -205,14 +233,21 @@ struct ScaledInt {
   double ceil(double) const;
 
   // get value as double
-  double as_double() const { return _mantissa * _exponent_pow10; }
+  double as_double() const { return _mantissa * exponent_pow10(); }
 
 private:
+  int compare(const ScaledInt&) const;
+
   int64_t _mantissa;
   int _scale;
-  double _exponent_pow10;
 };
 
+/* Parse a plain decimal string, like "19894.70000000", in a single pass into
+ * both its exact value and the nearest double.  The scale of `exact` follows
+ * the count of decimal places, so trailing zeros are kept.  Returns false for
+ * other forms, such as exponents, or more than 18 digits. */
+bool parse_decimal(std::string_view src, ScaledInt& exact, double& value);
+
 std::string demangle(const char* name);
 
 std::string to_hex(const unsigned char* p, size_t size);
@@ -225,6 +260,10 @@ void log_exception(const char* site);
 
 std::string format_double(double d, bool trim_zeros = false, int precision = 9);
 
+/* As above, but written to a buffer, returning the length written. */
+size_t format_double(char* buf, size_t size, double d, bool trim_zeros,
+                     int precision);
+
 void log_message_exception(const char* source, const std::string& data);
 
 std::string str_toupper(std::string s);
@@ -0,0 +1,92 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of BacktestEventLoop event throughput against the number of event
+ * sources.  Each source emits events at a fixed interval, staggered so that
+ * sources interleave.  Results are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace apex;
+
+class SyntheticSource : public BacktestEventSource
+{
+public:
+  SyntheticSource(Time start, std::chrono::microseconds interval, size_t count)
+    : _next(start), _interval(interval), _remaining(count)
+  {
+  }
+
+  Time get_next_event_time() override { return _remaining ? _next : Time(); }
+
+  void consume_next_event() override
+  {
+    _next = Time(_next.as_epoch_us() + _interval);
+    --_remaining;
+  }
+
+  void init_backtest_time_range(Time, Time) override {}
+
+private:
+  Time _next;
+  std::chrono::microseconds _interval;
+  size_t _remaining;
+};
+
+
+static void run(size_t source_count, size_t total_events, bool batching)
+{
+  const Time start(std::chrono::microseconds(1672531200000000)); // 2023-01-01
+  const size_t per_source = total_events / source_count;
+
+  BacktestEventLoop evloop(start);
+  evloop.set_batching(batching);
+  std::vector<std::shared_ptr<BacktestEventSource>> sources;
+  for (size_t i = 0; i < source_count; ++i)
+    sources.push_back(std::make_shared<SyntheticSource>(
+        Time(start.as_epoch_us() + std::chrono::microseconds(i)),
+        std::chrono::microseconds(1000 + (i % 7)), per_source));
+  evloop.add_event_sources(sources);
+
+  const auto t0 = std::chrono::steady_clock::now();
+  evloop.run_loop({});
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  const size_t events = per_source * source_count;
+  std::cout << "{\"bench\":\"backtest_sources\",\"sources\":" << source_count
+            << ",\"batching\":" << (batching ? "true" : "false")
+            << ",\"events\":" << events
+            << ",\"events_per_sec\":" << static_cast<uint64_t>(events / secs)
+            << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  for (size_t n : {1, 10, 50, 200, 500, 1000})
+    for (bool batching : {false, true})
+      run(n, 2000000, batching);
+  return 0;
+}
@@ -0,0 +1,146 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of Binance stream message decoding, in messages per second, for
+ * the bookTicker, aggTrade and depthUpdate streams.  Each message is decoded
+ * by the single pass decoders, from the combined-stream envelope onwards, and
+ * for comparison by the general json parser that they fall back to.  Results
+ * are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/gx/BinanceDecoder.hpp>
+#include <apex/util/json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+using namespace apex;
+
+static const std::string book_ticker_msg =
+    R"({"stream":"btcusdt@bookTicker","data":{"u":400900217,"s":"BTCUSDT",)"
+    R"("b":"37012.51000000","B":"31.21000000","a":"37012.52000000","A":"40.66000000"}})";
+
+static const std::string agg_trade_msg =
+    R"({"stream":"btcusdt@aggTrade","data":{"e":"aggTrade","E":1672515782136,)"
+    R"("s":"BTCUSDT","a":12345,"p":"37012.51000000","q":"0.01200000","f":100,)"
+    R"("l":105,"T":1672515782135,"m":true,"M":true}})";
+
+static const std::string depth_update_msg =
+    R"({"stream":"btcusdt@depth@100ms","data":{"e":"depthUpdate","E":1672515782136,)"
+    R"("s":"BTCUSDT","U":157,"u":160,)"
+    R"("b":[["37012.51000000","1.50000000"],["37012.40000000","0.25000000"],)"
+    R"(["37011.00000000","0.00000000"]],)"
+    R"("a":[["37012.52000000","2.00000000"],["37013.10000000","0.00000000"]]}})";
+
+
+template <typename F>
+static void run(const char* message, const char* decoder,
+                const std::string& src, size_t total, F fn)
+{
+  double checksum = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i)
+    checksum += fn(src);
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"binance_decode\",\"message\":\"" << message
+            << "\",\"decoder\":\"" << decoder << "\",\"bytes\":" << src.size()
+            << ",\"messages\":" << total
+            << ",\"msgs_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << ",\"checksum\":" << checksum << "}" << std::endl;
+}
+
+
+static double to_double(const json& value)
+{
+  return std::strtod(value.get_ref<const std::string&>().c_str(), nullptr);
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const size_t total = 200000;
+
+  run("bookTicker", "fast", book_ticker_msg, total, [](const std::string& src) {
+    binance::StreamMessage msg;
+    TickTop tick;
+    if (!binance::decode_stream_message(src, msg) ||
+        !binance::decode_book_ticker(msg.data, tick))
+      throw std::runtime_error("bookTicker decode failed");
+    return tick.bid_price;
+  });
+  run("bookTicker", "json", book_ticker_msg, total, [](const std::string& src) {
+    auto msg = json::parse(src);
+    auto& data = msg["data"];
+    TickTop tick;
+    tick.bid_price = to_double(data["b"]);
+    tick.bid_qty = to_double(data["B"]);
+    tick.ask_price = to_double(data["a"]);
+    tick.ask_qty = to_double(data["A"]);
+    return tick.bid_price;
+  });
+
+  run("aggTrade", "fast", agg_trade_msg, total, [](const std::string& src) {
+    binance::StreamMessage msg;
+    TickTrade tick;
+    if (!binance::decode_stream_message(src, msg) ||
+        !binance::decode_agg_trade(msg.data, tick))
+      throw std::runtime_error("aggTrade decode failed");
+    return tick.price;
+  });
+  run("aggTrade", "json", agg_trade_msg, total, [](const std::string& src) {
+    auto msg = json::parse(src);
+    auto& data = msg["data"];
+    TickTrade tick;
+    tick.price = to_double(data["p"]);
+    tick.qty = to_double(data["q"]);
+    tick.xt = Time(std::chrono::milliseconds(data["T"].get<int64_t>()));
+    tick.et = Time(std::chrono::milliseconds(data["E"].get<int64_t>()));
+    tick.aggr_side = data["m"].get<bool>() ? Side::sell : Side::buy;
+    return tick.price;
+  });
+
+  TickBookDelta delta;
+  run("depthUpdate", "fast", depth_update_msg, total,
+      [&delta](const std::string& src) {
+        binance::StreamMessage msg;
+        binance::DepthUpdate update;
+        delta.clear();
+        if (!binance::decode_stream_message(src, msg) ||
+            !binance::decode_depth_update(msg.data, update, delta))
+          throw std::runtime_error("depthUpdate decode failed");
+        return delta.bids[0].price + update.final_update_id;
+      });
+  run("depthUpdate", "json", depth_update_msg, total,
+      [&delta](const std::string& src) {
+        auto msg = json::parse(src);
+        auto& data = msg["data"];
+        delta.clear();
+        for (auto& level : data["b"])
+          delta.bids.push_back({to_double(level[0]), to_double(level[1])});
+        for (auto& level : data["a"])
+          delta.asks.push_back({to_double(level[0]), to_double(level[1])});
+        return delta.bids[0].price + data["u"].get<uint64_t>();
+      });
+  return 0;
+}
@@ -0,0 +1,142 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of RealtimeEventLoop dispatch, for each queue type and wait mode.
+ * Throughput is measured as one producer thread dispatching a stream of
+ * functions as fast as the queue accepts them, the rate being that at which
+ * the EV thread completes them.  Latency is measured by ping-pong, each
+ * function being dispatched only once the previous one has run, and is the
+ * time from dispatch to the start of the handler, in nanoseconds.  The spin
+ * wait modes need a core for each of the producer and the EV thread, so are
+ * skipped on a single CPU.  Results are written as one JSON object per
+ * line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+using namespace apex;
+
+using QueueType = RealtimeEventLoop::QueueType;
+using WaitMode = RealtimeEventLoop::WaitMode;
+
+
+static const char* to_string(QueueType queue_type)
+{
+  return queue_type == QueueType::locked ? "locked" : "lockfree";
+}
+
+
+static const char* to_string(WaitMode wait_mode)
+{
+  switch (wait_mode) {
+    case WaitMode::block: return "block";
+    case WaitMode::spin: return "spin";
+    case WaitMode::spin_then_block: return "spin_then_block";
+  }
+  return "unknown";
+}
+
+
+static uint64_t now_ns()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+
+static void run_throughput(QueueType queue_type, WaitMode wait_mode,
+                           size_t total)
+{
+  RealtimeEventLoop::Options options;
+  options.queue_type = queue_type;
+  options.wait_mode = wait_mode;
+  RealtimeEventLoop evloop(options, []() { return false; });
+
+  std::atomic<size_t> done{0};
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i)
+    evloop.dispatch(EventLoop::inline_fn([&done]() {
+      done.store(done.load(std::memory_order_relaxed) + 1,
+                 std::memory_order_release);
+    }));
+  while (done.load(std::memory_order_acquire) != total)
+    std::this_thread::yield();
+  const auto t1 = std::chrono::steady_clock::now();
+  evloop.sync_stop();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"event_loop\",\"test\":\"throughput\",\"queue\":\""
+            << to_string(queue_type) << "\",\"wait\":\""
+            << to_string(wait_mode) << "\",\"events\":" << total
+            << ",\"events_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << "}" << std::endl;
+}
+
+
+static void run_latency(QueueType queue_type, WaitMode wait_mode, size_t total)
+{
+  RealtimeEventLoop::Options options;
+  options.queue_type = queue_type;
+  options.wait_mode = wait_mode;
+  RealtimeEventLoop evloop(options, []() { return false; });
+
+  LatencyHistogram latency;
+  std::atomic<size_t> done{0};
+  for (size_t i = 0; i < total; ++i) {
+    const uint64_t sent = now_ns();
+    evloop.dispatch(EventLoop::inline_fn([&latency, &done, sent]() {
+      latency.record(now_ns() - sent);
+      done.fetch_add(1, std::memory_order_release);
+    }));
+    while (done.load(std::memory_order_acquire) != i + 1)
+      std::this_thread::yield();
+  }
+  evloop.sync_stop();
+
+  auto snap = latency.snapshot();
+  std::cout << "{\"bench\":\"event_loop\",\"test\":\"latency\",\"queue\":\""
+            << to_string(queue_type) << "\",\"wait\":\""
+            << to_string(wait_mode) << "\",\"events\":" << total
+            << ",\"p50_ns\":" << snap.value_at(0.5)
+            << ",\"p99_ns\":" << snap.value_at(0.99)
+            << ",\"p999_ns\":" << snap.value_at(0.999)
+            << ",\"max_ns\":" << snap.max << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const bool can_spin = std::thread::hardware_concurrency() > 1;
+  for (auto queue_type : {QueueType::locked, QueueType::lockfree})
+    for (auto wait_mode : {WaitMode::block, WaitMode::spin,
+                           WaitMode::spin_then_block}) {
+      if (wait_mode != WaitMode::block && !can_spin)
+        continue;
+      run_throughput(queue_type, wait_mode, 2000000);
+      run_latency(queue_type, wait_mode, 100000);
+    }
+  return 0;
+}
@@ -0,0 +1,161 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of GX tick message encoding and decoding, in messages per second,
+ * for the proto3 messages and for the fixed layout binary messages.  Binary
+ * frames are built from a FramePool, as the server does for its tick stream,
+ * and decoded by a cast of the payload, as the client does.  Results are
+ * written as one JSON object per line. */
+
+#include <apex/comm/GxBinaryFormat.hpp>
+#include <apex/comm/GxServerSession.hpp>
+#include <apex/core/Logger.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+
+using namespace apex;
+
+
+template <typename F>
+static void run(const char* message, const char* format, const char* op,
+                size_t total, size_t frame_size, F fn)
+{
+  double checksum = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i)
+    checksum += fn(i);
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"gx_codec\",\"message\":\"" << message
+            << "\",\"format\":\"" << format << "\",\"op\":\"" << op
+            << "\",\"frame_bytes\":" << frame_size << ",\"messages\":" << total
+            << ",\"msgs_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << ",\"checksum\":" << checksum << "}" << std::endl;
+}
+
+
+static const char* payload(const gx::Frame& frame)
+{
+  return frame.data() + sizeof(gx::Header);
+}
+
+
+static size_t payload_len(const gx::Frame& frame)
+{
+  return frame.size() - sizeof(gx::Header);
+}
+
+
+static void bench_trades(size_t total)
+{
+  TickTrade tick;
+  tick.price = 37012.5;
+  tick.qty = 0.125;
+  tick.xt = Time(std::chrono::microseconds(1700000000000000));
+  tick.et = Time(std::chrono::microseconds(1700000000001500));
+  tick.aggr_side = Side::buy;
+
+  auto proto = GxServerSession::encode(tick);
+  run("trade", "proto3", "encode", total, proto->size(), [&](size_t i) {
+    tick.price = 37000 + (i & 255);
+    return GxServerSession::encode(tick)->size();
+  });
+  run("trade", "proto3", "decode", total, proto->size(), [&](size_t) {
+    apex::pb::TickTrade msg;
+    msg.ParseFromArray(payload(*proto), payload_len(*proto));
+    TickTrade decoded;
+    decoded.price = msg.price();
+    decoded.qty = msg.size();
+    decoded.aggr_side =
+        msg.side() == apex::pb::side_buy ? Side::buy : Side::sell;
+    return decoded.price;
+  });
+
+  gx::FramePool pool;
+  auto binary = GxServerSession::encode_binary(pool, tick);
+  run("trade", "binary", "encode", total, binary->size(), [&](size_t i) {
+    tick.price = 37000 + (i & 255);
+    return GxServerSession::encode_binary(pool, tick)->size();
+  });
+  run("trade", "binary", "decode", total, binary->size(), [&](size_t) {
+    auto* msg =
+        gx::bin::cast<gx::bin::TickTrade>(payload(*binary), payload_len(*binary));
+    TickTrade decoded;
+    decoded.price = msg->price;
+    decoded.qty = msg->qty;
+    decoded.xt = Time(std::chrono::microseconds(msg->xt));
+    decoded.et = Time(std::chrono::microseconds(msg->et));
+    decoded.aggr_side = static_cast<Side>(msg->aggr_side);
+    return decoded.price;
+  });
+}
+
+
+static void bench_tops(size_t total)
+{
+  TickTop tick;
+  tick.bid_price = 37012.5;
+  tick.bid_qty = 1.5;
+  tick.ask_price = 37012.6;
+  tick.ask_qty = 0.75;
+
+  auto proto = GxServerSession::encode(tick);
+  run("top", "proto3", "encode", total, proto->size(), [&](size_t i) {
+    tick.bid_price = 37000 + (i & 255);
+    return GxServerSession::encode(tick)->size();
+  });
+  run("top", "proto3", "decode", total, proto->size(), [&](size_t) {
+    apex::pb::TickTop msg;
+    msg.ParseFromArray(payload(*proto), payload_len(*proto));
+    TickTop decoded;
+    decoded.bid_price = msg.bid_price();
+    decoded.ask_price = msg.ask_price();
+    return decoded.bid_price;
+  });
+
+  gx::FramePool pool;
+  auto binary = GxServerSession::encode_binary(pool, tick);
+  run("top", "binary", "encode", total, binary->size(), [&](size_t i) {
+    tick.bid_price = 37000 + (i & 255);
+    return GxServerSession::encode_binary(pool, tick)->size();
+  });
+  run("top", "binary", "decode", total, binary->size(), [&](size_t) {
+    auto* msg =
+        gx::bin::cast<gx::bin::TickTop>(payload(*binary), payload_len(*binary));
+    TickTop decoded;
+    decoded.bid_price = msg->bid_price;
+    decoded.bid_qty = msg->bid_qty;
+    decoded.ask_price = msg->ask_price;
+    decoded.ask_qty = msg->ask_qty;
+    return decoded.bid_price;
+  });
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const size_t total = 2000000;
+  bench_trades(total);
+  bench_tops(total);
+  return 0;
+}
@@ -0,0 +1,339 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* End-to-end loopback latency harness: a GxServer, serving a synthetic
+ * exchange session in place of Binance, and an engine connected to it over a
+ * GX session, running a bot that answers every trade with an order.  The
+ * synthetic exchange emits trades at a fixed rate, and measures the time from
+ * each trade leaving it to the resulting order arriving back at it, so the
+ * path covers the GX server event loop, the GX transport in both directions,
+ * and the engine event loop and bot.  The trade sequence number is carried in
+ * its price, which the bot copies to its order.
+ *
+ * By default the server runs its own threads; with "embedded" it shares the
+ * engine event loop, as an embedded gateway does.  Options are given by an
+ * optional JSON config file:
+ *
+ *   {
+ *     "rate": 1000,           // trades per second
+ *     "seconds": 5,           // measured period
+ *     "warmup_seconds": 1,    // trades emitted before measuring
+ *     "embedded": false,
+ *     "gx": {},               // GxServer config, eg "port", "batching", "shm", "threads"
+ *     "gateway": {},          // engine gateway config, eg "binary", "shm"
+ *     "threads": {}           // engine threads config
+ *   }
+ *
+ * Latencies are nanoseconds.  The trace stages of the path are also reported,
+ * each as the time since the trade was emitted.  Results are written as one
+ * JSON object per line. */
+
+#include <apex/core/Bot.hpp>
+#include <apex/core/Errors.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/gx/ExchangeSession.hpp>
+#include <apex/gx/GxServer.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/LatencyTrace.hpp>
+#include <apex/util/json.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace apex;
+
+
+/* Exchange session standing in for a venue: trades are generated, and orders
+ * are answered with an immediate expiry, as for an unfilled IOC order. */
+class SyntheticExchange : public ExchangeSession<SyntheticExchange>
+{
+public:
+  SyntheticExchange(EventCallbacks callbacks, IoLoop* ioloop,
+                    RealtimeEventLoop& event_loop, size_t total,
+                    size_t warmup)
+    : ExchangeSession(std::move(callbacks), ExchangeId::binance,
+                      RunMode::live, ioloop, event_loop, nullptr),
+      _tick_in(total),
+      _warmup(warmup)
+  {
+  }
+
+  void start() override {}
+
+  void subscribe_account(
+      std::function<void(std::vector<AccountUpdate>)>) override
+  {
+  }
+
+  void subscribe_trades(Symbol, subscription_options,
+                        std::function<void(const TickTrade&)> callback) override
+  {
+    _on_trade = std::move(callback);
+    _subscribed = true;
+  }
+
+  void subscribe_top(Symbol, subscription_options,
+                     std::function<void(const TickTop&)>) override
+  {
+  }
+
+  void submit_order(OrderParams params, SubmitOrderCallbacks callbacks) override
+  {
+    const uint64_t now = trace::now_ns();
+    const auto seq = static_cast<size_t>(params.price) - 1;
+    if (seq >= _warmup && seq < _tick_in.size())
+      _latency.record(now - _tick_in[seq]);
+    _orders++;
+
+    callbacks.on_reply(OrderUpdate{OrderState::closed, OrderCloseReason::lapsed,
+                                   "SYN" + std::to_string(_orders.load())});
+  }
+
+  void cancel_order(std::string, std::string, std::string,
+                    SubmitOrderCallbacks callbacks) override
+  {
+    callbacks.on_rejected(error::e0103, "order not found");
+  }
+
+  /* Emit all trades, paced to `rate` per second, from the calling thread;
+   * each is handed to the server event loop, as a decoded exchange message
+   * is. */
+  void run_feed(size_t rate)
+  {
+    const auto interval = std::chrono::nanoseconds(1000000000 / rate);
+    auto due = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < _tick_in.size(); i++) {
+      std::this_thread::sleep_until(due);
+      due += interval;
+
+      TickTrade tick;
+      tick.price = static_cast<double>(i + 1);
+      tick.qty = 1.0;
+      tick.aggr_side = Side::buy;
+      tick.trace = trace::tracer().receive();
+      _tick_in[i] = tick.trace.is_traced() ? tick.trace.rt : trace::now_ns();
+      run_on_evloop([tick](SyntheticExchange* self) {
+        if (self->_on_trade)
+          self->_on_trade(tick);
+      });
+    }
+  }
+
+  [[nodiscard]] bool is_subscribed() const { return _subscribed; }
+  [[nodiscard]] size_t order_count() const { return _orders; }
+  LatencyHistogram::Snapshot latency() { return _latency.snapshot(); }
+
+private:
+  std::function<void(const TickTrade&)> _on_trade;
+  std::atomic<bool> _subscribed{false};
+  std::vector<uint64_t> _tick_in; // emit time of each trade
+  size_t _warmup;
+  std::atomic<size_t> _orders{0};
+  LatencyHistogram _latency;
+};
+
+
+/* Sends an order at the price of each trade, once its order session is up. */
+class EchoBot : public Bot
+{
+public:
+  EchoBot(Strategy* strategy, const Instrument& instrument)
+    : Bot("EchoBot", strategy, instrument)
+  {
+  }
+
+  void on_tick_trade(MarketData::EventType) override
+  {
+    if (!om_session_up())
+      return;
+    create_order(Side::buy, 1.0, last_price(), TimeInForce::ioc)->send();
+  }
+
+  void on_timer() override { ready = om_session_up(); }
+
+  static std::atomic<bool> ready;
+};
+
+std::atomic<bool> EchoBot::ready{false};
+
+
+// Reference data for the traded instrument, in a temporary APEX_HOME.
+static void write_apex_home(const std::filesystem::path& home)
+{
+  auto refdata = home / "data" / "refdata" / "instruments";
+  std::filesystem::create_directories(refdata);
+  std::ofstream(refdata / "instruments.csv")
+      << "instId,symbol,type,venue,baseAsset,quoteAsset,lotQty,tickSize,"
+         "minNotional,minQty,baseAssetPrecision,quoteAssetPrecision\n"
+         "BTCUSDT.BNC,BTCUSDT,coinpair,binance,BTC,USDT,0.00001,0.01,5,"
+         "0.00001,8,8\n";
+}
+
+
+static void print_latency(const std::string& fields,
+                          const LatencyHistogram::Snapshot& snap)
+{
+  std::cout << "{" << fields << ",\"samples\":" << snap.count
+            << ",\"p50_ns\":" << snap.value_at(0.5)
+            << ",\"p90_ns\":" << snap.value_at(0.9)
+            << ",\"p99_ns\":" << snap.value_at(0.99)
+            << ",\"p999_ns\":" << snap.value_at(0.999)
+            << ",\"max_ns\":" << snap.max << "}" << std::endl;
+}
+
+
+template <typename F>
+static bool wait_for(F condition, std::chrono::seconds timeout)
+{
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+
+int main(int argc, char** argv)
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  try {
+    Config config = argc > 1 ? Config{read_json_config_file(argv[1])}
+                             : Config::empty_config();
+    const size_t rate = config.get_uint("rate", 1000);
+    const size_t seconds = config.get_uint("seconds", 5);
+    const size_t warmup = rate * config.get_uint("warmup_seconds", 1);
+    const bool embedded = config.get_bool("embedded", false);
+    if (rate == 0)
+      throw std::runtime_error("rate must be positive");
+
+    auto home = std::filesystem::temp_directory_path() /
+                ("apex_bench_gx_loopback_" + std::to_string(::getpid()));
+    std::filesystem::remove_all(home);
+    write_apex_home(home);
+    ::setenv("APEX_HOME", home.c_str(), 1);
+
+    trace::tracer().enable(true);
+
+    // the engine; without its gateway, which needs the server port
+    auto engine_threads =
+        config.get_sub_config("threads", Config::empty_config());
+    auto services = std::make_unique<Services>(RunMode::live, BacktestPeriod{},
+                                               engine_threads);
+
+    json gx_config = config.get_sub_config("gx", Config::empty_config()).raw();
+    if (gx_config.is_null())
+      gx_config = json::object();
+    if (!gx_config.contains("port"))
+      gx_config["port"] = 5799;
+
+    std::unique_ptr<GxServer> server;
+    if (embedded)
+      server = std::make_unique<GxServer>(services->realtime_evloop(),
+                                          RunMode::live, Config{gx_config});
+    else
+      server = std::make_unique<GxServer>(RunMode::live, Config{gx_config});
+
+    std::shared_ptr<SyntheticExchange> exchange;
+    server->add_venue([&](BaseExchangeSession::EventCallbacks callbacks,
+                          IoLoop* ioloop, RealtimeEventLoop& event_loop) {
+      exchange = std::make_shared<SyntheticExchange>(
+          std::move(callbacks), ioloop, event_loop, warmup + rate * seconds,
+          warmup);
+      return exchange;
+    });
+    server->start();
+
+    json gateway =
+        config.get_sub_config("gateway", Config::empty_config()).raw();
+    if (gateway.is_null())
+      gateway = json::object();
+    gateway["host"] = "127.0.0.1";
+    gateway["port"] = std::to_string(server->get_listen_port());
+    gateway["provides"] = "binance";
+    json engine_config = json::object();
+    engine_config["gateways"] = json::array({gateway});
+    services->init_services(Config{engine_config});
+    Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+    auto strategy = std::make_unique<Strategy>(services.get(), "LAT01");
+    strategy->create_bot<EchoBot>(
+        InstrumentQuery("BTCUSDT", ExchangeId::binance));
+    strategy->init_bots();
+
+    if (!wait_for([&] { return exchange->is_subscribed() && EchoBot::ready; },
+                  std::chrono::seconds(30)))
+      throw std::runtime_error("engine did not connect to the GX server");
+
+    exchange->run_feed(rate);
+
+    // wait for the last orders, unless they stop arriving
+    const size_t expected = warmup + rate * seconds;
+    size_t seen = 0;
+    auto last_progress = std::chrono::steady_clock::now();
+    wait_for([&] {
+      auto orders = exchange->order_count();
+      auto now = std::chrono::steady_clock::now();
+      if (orders != seen) {
+        seen = orders;
+        last_progress = now;
+      }
+      return orders == expected || now - last_progress > std::chrono::seconds(1);
+    }, std::chrono::seconds(10));
+
+    const std::string common = std::string("\"embedded\":") +
+                               (embedded ? "true" : "false") +
+                               ",\"rate\":" + std::to_string(rate);
+    print_latency("\"bench\":\"gx_loopback\"," + common +
+                      ",\"ticks\":" + std::to_string(expected) +
+                      ",\"orders\":" + std::to_string(exchange->order_count()),
+                  exchange->latency());
+
+    for (int i = 0; i < static_cast<int>(trace::Stage::count); i++) {
+      auto stage = static_cast<trace::Stage>(i);
+      auto snap = trace::tracer().snapshot(stage).since_receive;
+      if (snap.count)
+        print_latency("\"bench\":\"gx_loopback_stage\"," + common +
+                          ",\"stage\":\"" + trace::to_string(stage) + "\"",
+                      snap);
+    }
+
+    strategy.reset();
+    server.reset();
+    services.reset();
+    std::filesystem::remove_all(home);
+  }
+  catch (std::exception& e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
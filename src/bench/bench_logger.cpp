@@ -0,0 +1,115 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+/* Benchmark of the cost of a log statement, in nanoseconds per call, as seen
+ * by the logging thread.  Output goes to a discarding stream buffer, so only
+ * the formatting and the logger itself are measured.  This file is compiled
+ * with a minimum log level of warn, so that LOG_DEBUG shows the cost of a
+ * statement removed at compile time; the previous ostringstream-based macro is
+ * reproduced for comparison.  Results are written as one JSON object per
+ * line. */
+
+#define APEX_LOG_MIN_LEVEL warn
+
+#include <apex/core/Logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <streambuf>
+
+using namespace apex;
+
+#define LOG_ERROR_OSTREAM(msg)                                          \
+  do {                                                                  \
+    apex::Logger& logger = apex::Logger::instance();                    \
+    if (logger.wants_level(apex::Logger::level::error)) {               \
+      std::ostringstream _s;                                            \
+      _s << msg;                                                        \
+      logger.write(apex::Logger::level::error, _s.str(), __FILE__,      \
+                   __LINE__);                                           \
+    }} while (0)
+
+
+class NullBuf : public std::streambuf
+{
+protected:
+  int overflow(int c) override { return traits_type::not_eof(c); }
+  std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+
+// Time `calls` statements, in bursts of `burst`; the logger is flushed,
+// untimed, between bursts, so that an async ring does not fill up and the
+// figure is the cost on the logging thread.
+template <typename F>
+static void run(const char* path, size_t calls, size_t burst, F fn)
+{
+  std::chrono::steady_clock::duration elapsed{};
+  for (size_t i = 0; i < calls;) {
+    const auto t0 = std::chrono::steady_clock::now();
+    for (size_t end = std::min(calls, i + burst); i < end; ++i)
+      fn(i);
+    elapsed += std::chrono::steady_clock::now() - t0;
+    Logger::instance().flush();
+  }
+
+  const double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+  std::cout.flush();
+  std::clog << "{\"bench\":\"logger\",\"path\":\"" << path
+            << "\",\"calls\":" << calls << ",\"ns_per_call\":" << ns / calls
+            << "}" << std::endl;
+}
+
+
+int main()
+{
+  NullBuf null_buf;
+  std::cout.rdbuf(&null_buf);
+
+  // only error is enabled at runtime; warn is disabled at runtime, and debug
+  // is not compiled in
+  auto& logger = Logger::instance();
+  logger.set_mask(Logger::mask_level_and_above(Logger::error));
+
+  const size_t calls = 2000000;
+  const size_t burst = 1024;
+  const double price = 16500.25;
+
+  run("compiled_out", calls, burst, [&](size_t i) {
+    LOG_DEBUG("order " << i << " px " << price << " qty " << 0.01 << " side buy");
+  });
+  run("runtime_disabled", calls, burst, [&](size_t i) {
+    LOG_WARN("order " << i << " px " << price << " qty " << 0.01 << " side buy");
+  });
+  run("ostringstream", calls, burst, [&](size_t i) {
+    LOG_ERROR_OSTREAM("order " << i << " px " << price << " qty " << 0.01
+                      << " side buy");
+  });
+  run("logline", calls, burst, [&](size_t i) {
+    LOG_ERROR("order " << i << " px " << price << " qty " << 0.01 << " side buy");
+  });
+
+  logger.start_async(burst);
+  run("logline_async", calls, burst, [&](size_t i) {
+    LOG_ERROR("order " << i << " px " << price << " qty " << 0.01 << " side buy");
+  });
+  logger.stop_async();
+  std::cout.rdbuf(nullptr);
+  return 0;
+}
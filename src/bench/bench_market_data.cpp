@@ -0,0 +1,132 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of MarketData::apply, in ticks per second, for trades, tops, five
+ * level book snapshots and book deltas.  Each is run with no listeners, and
+ * with one listener that reads the updated state, as a strategy would.  Book
+ * deltas change a few levels near the touch of a book some hundred levels
+ * deep.  Results are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+using namespace apex;
+
+class ReadingListener : public MarketData::Listener
+{
+public:
+  explicit ReadingListener(MarketData& md) : _md(md) {}
+
+  void on_market_event(MarketData::EventType event) override
+  {
+    checksum += event.is_trade() ? _md.last().price : _md.bid();
+  }
+
+  double checksum = 0;
+
+private:
+  MarketData& _md;
+};
+
+
+template <typename Tick, typename F>
+static void run(const char* tick_type, bool listener, size_t total,
+                Tick& tick, F update)
+{
+  MarketData md;
+  ReadingListener reader(md);
+  if (listener)
+    md.add_listener(&reader);
+
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i) {
+    update(tick, i);
+    md.apply(tick);
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+  if (listener)
+    md.remove_listener(&reader);
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"market_data\",\"tick\":\"" << tick_type
+            << "\",\"listeners\":" << (listener ? 1 : 0)
+            << ",\"ticks\":" << total
+            << ",\"ticks_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << ",\"checksum\":" << reader.checksum << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const size_t total = 5000000;
+
+  for (bool listener : {false, true}) {
+    TickTrade trade;
+    trade.qty = 0.01;
+    trade.aggr_side = Side::buy;
+    run("trade", listener, total, trade, [](TickTrade& tick, size_t i) {
+      tick.price = 37000 + (i & 63) * 0.1;
+    });
+
+    TickTop top;
+    top.bid_qty = 1.5;
+    top.ask_qty = 0.5;
+    run("top", listener, total, top, [](TickTop& tick, size_t i) {
+      tick.bid_price = 37000 + (i & 63) * 0.1;
+      tick.ask_price = tick.bid_price + 0.1;
+    });
+
+    TickBookSnapshot5 snapshot;
+    run("book_snapshot_5", listener, total, snapshot,
+        [](TickBookSnapshot5& tick, size_t i) {
+          const double mid = 37000 + (i & 63) * 0.1;
+          for (int level = 0; level < TickBookSnapshot5::N; level++) {
+            tick.levels[level].bid_price = mid - 0.05 - level * 0.1;
+            tick.levels[level].bid_qty = 1.0 + level;
+            tick.levels[level].ask_price = mid + 0.05 + level * 0.1;
+            tick.levels[level].ask_qty = 1.0 + level;
+          }
+        });
+
+    // a deep book to start with, which the deltas then update near the touch
+    TickBookDelta delta;
+    delta.is_snapshot = true;
+    for (int level = 0; level < 100; level++) {
+      delta.bids.push_back({36999.9 - level * 0.1, 1.0 + level});
+      delta.asks.push_back({37000.0 + level * 0.1, 1.0 + level});
+    }
+    run("book_delta", listener, total, delta,
+        [](TickBookDelta& tick, size_t i) {
+          if (i == 0)
+            return;
+          tick.is_snapshot = false;
+          tick.bids.clear();
+          tick.asks.clear();
+          const double depth = (i & 3) * 0.1;
+          const double qty = (i & 4) ? 0.0 : 2.5; // alternately remove, insert
+          tick.bids.push_back({36999.9 - depth, qty});
+          tick.asks.push_back({37000.0 + depth, 1.0 + (i & 7)});
+        });
+  }
+  return 0;
+}
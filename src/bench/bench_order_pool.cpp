@@ -0,0 +1,96 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of Order objects created per second, from the heap and from a
+ * BlockPool.  A window of orders is kept live, as a market-making bot keeps
+ * its resting quotes, and the oldest is released as each new order is made.
+ * Results are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/core/OrderRouter.hpp>
+#include <apex/model/Order.hpp>
+#include <apex/util/ObjectPool.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace apex;
+
+class NullRouter : public OrderRouter
+{
+public:
+  void send_order(Order&) override {}
+  void cancel_order(Order&) override {}
+  bool is_up() const override { return true; }
+};
+
+
+template <typename F>
+static void run(const char* alloc, size_t window, size_t total, F make_order)
+{
+  NullRouter router;
+  Instrument instrument(InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                        Asset("BTC", "binance", 8), Asset("USDT", "binance", 8),
+                        "BTCUSDT", "binance");
+  std::vector<std::shared_ptr<Order>> live(window);
+
+  // order ids are prepared up front, so that only the Order itself is timed
+  std::vector<std::string> ids;
+  ids.reserve(total);
+  for (size_t i = 0; i < total; ++i)
+    ids.push_back("TST65a0f3c1" + std::to_string(10000000 + i));
+
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i)
+    live[i % window] = make_order(&router, instrument, std::move(ids[i]));
+  live.clear();
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"order_pool\",\"alloc\":\"" << alloc
+            << "\",\"window\":" << window << ",\"orders\":" << total
+            << ",\"orders_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const size_t total = 2000000;
+  for (size_t window : {16, 256, 4096}) {
+    run("heap", window, total,
+        [](OrderRouter* router, const Instrument& instrument, std::string id) {
+          return std::make_shared<Order>(nullptr, router, instrument, Side::buy,
+                                         0.01, 16500.0, TimeInForce::gtc,
+                                         std::move(id));
+        });
+
+    auto pool = std::make_shared<BlockPool>(window);
+    run("pool", window, total,
+        [&pool](OrderRouter* router, const Instrument& instrument,
+                std::string id) {
+          return make_pooled<Order>(pool, nullptr, router, instrument,
+                                    Side::buy, 0.01, 16500.0, TimeInForce::gtc,
+                                    std::move(id));
+        });
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of building and signing an order request body, as sent for a
+ * Binance REST order: with an ostringstream and the one-shot HMAC, which
+ * rehashes the key for each request, and with a reused SignedQuery and a
+ * precomputed HmacSha256.  Results are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/util/RequestSigner.hpp>
+#include <apex/util/utils.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace apex;
+
+static const std::string secret =
+    "NhqPtmdSJYdKjVHjA7PZj4Mge3R5YNiP1e3UZjInClVN65XAbvqqM6A7H5fATj0j";
+
+
+template <typename F> static void run(const char* method, size_t total, F sign)
+{
+  size_t bytes = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < total; ++i)
+    bytes += sign(int64_t(1700000000000 + i));
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  std::cout << "{\"bench\":\"request_signer\",\"method\":\"" << method
+            << "\",\"requests\":" << total
+            << ",\"ns_per_request\":" << static_cast<uint64_t>(ns / total)
+            << ",\"bytes\":" << bytes / total << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  const size_t total = 500000;
+
+  run("ostream", total, [](int64_t timestamp) {
+    std::ostringstream oss;
+    oss << "symbol=BTCUSDT&side=BUY&type=LIMIT&timeInForce=GTC"
+        << "&quantity=" << format_double(0.0125, true, 8)
+        << "&newClientOrderId=TST65a0f3c110000001"
+        << "&price=" << format_double(16500.25, true)
+        << "&recvWindow=5000&timestamp=" << timestamp;
+    std::string body = oss.str();
+    std::string digest = HMACSHA256_base4(secret.c_str(), secret.size(),
+                                          body.c_str(), body.size());
+    std::string post_data = body + "&signature=" + digest;
+    return post_data.size();
+  });
+
+  HmacSha256 hmac(secret);
+  SignedQuery query;
+  run("signed_query", total, [&](int64_t timestamp) {
+    query.clear()
+        .add("symbol", "BTCUSDT")
+        .add("side", "BUY")
+        .add("type", "LIMIT")
+        .add("timeInForce", "GTC")
+        .add("quantity", 0.0125, true, 8)
+        .add("newClientOrderId", "TST65a0f3c110000001")
+        .add("price", 16500.25, true, 9)
+        .add("recvWindow", int64_t(5000))
+        .add("timestamp", timestamp)
+        .sign(hmac);
+    return query.view().size();
+  });
+  return 0;
+}
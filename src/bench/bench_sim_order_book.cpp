@@ -0,0 +1,192 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of the simulated exchange order book, in operations per second:
+ * orders added, orders cancelled, and market trades applied against resting
+ * orders.  The book is that of a SimExchange in a backtest Services, set up
+ * from a temporary APEX_HOME holding an empty instrument list and a single
+ * tick for each market-data stream; the backtest is never run, so its order
+ * acks and fills are only queued, and the market data is applied directly.
+ * Results are written as one JSON object per line. */
+
+#include <apex/backtest/SimExchange.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/OrderService.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/Order.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace apex;
+
+static const Time start{std::chrono::microseconds(1700000000000000)}; // 2023-11-14
+
+static const int levels = 50;
+static const double tick_size = 0.1;
+static const double best_bid = 37000.0;
+
+
+// Files needed for a backtest Services to subscribe to market data.
+static void write_apex_home(const std::filesystem::path& home,
+                            const Instrument& instrument)
+{
+  auto refdata = home / "data" / "refdata" / "instruments";
+  std::filesystem::create_directories(refdata);
+  std::ofstream(refdata / "instruments.csv")
+      << "instId,symbol,type,venue,baseAsset,quoteAsset,lotQty,tickSize,"
+         "minNotional,minQty,baseAssetPrecision,quoteAssetPrecision\n";
+
+  auto bucketid = TickFileBucketId::from_time(start);
+  for (std::string channel : {"l1", "aggtrades"}) {
+    auto dir = home / "data" / "tickdata" / "tickbin1" /
+               instrument.exchange_name() / channel / start.strftime("%Y") /
+               start.strftime("%m") / start.strftime("%d");
+    std::filesystem::create_directories(dir);
+    TickbinFileWriter writer(bucketid, dir, instrument.native_symbol() + ".bin",
+                             StreamInfo{instrument, channel});
+    tickbin::Serialiser::bytes bytes;
+    if (channel == "l1") {
+      TickTop tick;
+      tick.bid_price = best_bid;
+      tick.ask_price = best_bid + tick_size;
+      bytes = tickbin::Serialiser::serialise(start, tick);
+    } else {
+      TickTrade tick;
+      tick.price = best_bid;
+      tick.qty = 1;
+      bytes = tickbin::Serialiser::serialise(start, tick);
+    }
+    writer.write_bytes(bytes.data(), bytes.size());
+  }
+}
+
+
+static void report(const char* op, size_t resting, size_t total,
+                   std::chrono::steady_clock::time_point t0,
+                   std::chrono::steady_clock::time_point t1)
+{
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"sim_order_book\",\"op\":\"" << op
+            << "\",\"resting\":" << resting << ",\"ops\":" << total
+            << ",\"ops_per_sec\":" << static_cast<uint64_t>(total / secs) << "}"
+            << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  auto home = std::filesystem::temp_directory_path() /
+              ("apex_bench_sim_order_book_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(home);
+
+  Instrument instrument(InstrumentType::coinpair, "BTCUSDT.BNC",
+                        {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                        "BTCUSDT", "binance");
+  write_apex_home(home, instrument);
+  ::setenv("APEX_HOME", home.c_str(), 1);
+
+  Time upto = start;
+  upto += std::chrono::hours(1);
+  Services services(RunMode::backtest, {start, upto});
+  services.init_services();
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  SimExchange exchange(&services);
+  exchange.add_instrument(instrument);
+  auto* md = services.market_data_service()->find_market_data(instrument);
+
+  TickTop top;
+  top.bid_price = best_bid;
+  top.bid_qty = 10;
+  top.ask_price = best_bid + tick_size;
+  top.ask_qty = 10;
+  md->apply(top);
+
+  auto make_orders = [&](size_t count, int depth) {
+    std::vector<std::shared_ptr<Order>> orders;
+    orders.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      const bool buy = i & 1;
+      const int level = (i / 2) % depth;
+      const double price = buy ? best_bid - level * tick_size
+                               : best_bid + (level + 1) * tick_size;
+      orders.push_back(services.order_service()->create(
+          &exchange, instrument, buy ? Side::buy : Side::sell, 1.0, price,
+          TimeInForce::gtc, "BENCH", nullptr, {}));
+    }
+    return orders;
+  };
+
+  for (size_t resting : {size_t{1000}, size_t{100000}}) {
+    // orders are created up front, so that only the book is timed
+    auto orders = make_orders(resting, levels);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (auto& order : orders)
+      exchange.send_order(*order);
+    auto t1 = std::chrono::steady_clock::now();
+    report("add", resting, orders.size(), t0, t1);
+
+    t0 = std::chrono::steady_clock::now();
+    for (auto& order : orders)
+      exchange.cancel_order(*order);
+    t1 = std::chrono::steady_clock::now();
+    report("cancel", resting, orders.size(), t0, t1);
+  }
+
+  // small trades at the touch and a few levels behind, each working through
+  // the market queue ahead of the resting orders, and then filling them
+  for (size_t resting : {size_t{1000}, size_t{100000}}) {
+    auto orders = make_orders(resting, 5);
+    for (auto& order : orders)
+      exchange.send_order(*order);
+
+    const size_t total = 1000000;
+    TickTrade trade;
+    trade.qty = 0.05;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < total; i++) {
+      const int level = i % 5;
+      trade.price = (i & 1) ? best_bid - level * tick_size
+                            : best_bid + (level + 1) * tick_size;
+      md->apply(trade);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    report("trade", resting, total, t0, t1);
+
+    for (auto& order : orders)
+      exchange.cancel_order(*order);
+  }
+
+  std::filesystem::remove_all(home);
+  return 0;
+}
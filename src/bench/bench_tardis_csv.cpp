@@ -0,0 +1,194 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of Tardis book_snapshot_5 CSV parsing.  Compares the original
+ * approach, a memchr per field followed by strtod, with the vectorised field
+ * splitter and fixed-decimal parser, and also times the complete parser.  Real
+ * Tardis .csv.gz files can be given as arguments; otherwise a synthetic file
+ * is generated.  Results are written as one JSON object per line. */
+
+#include <apex/backtest/TardisCsvParsers.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/CsvScan.hpp>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace apex;
+
+static constexpr std::size_t book_fields = 24;
+
+
+static std::vector<char> inflate_file(const char* fn)
+{
+  gzFile gz = gzopen(fn, "rb");
+  if (!gz)
+    throw std::runtime_error(std::string("cannot open ") + fn);
+  std::vector<char> text;
+  char buf[1 << 16];
+  int n;
+  while ((n = gzread(gz, buf, sizeof(buf))) > 0)
+    text.insert(text.end(), buf, buf + n);
+  gzclose(gz);
+  return text;
+}
+
+
+static std::vector<char> synthetic_file(std::size_t rows)
+{
+  std::string text = "exchange,symbol,timestamp,local_timestamp";
+  for (int level = 0; level < 5; level++)
+    text += ",asks[" + std::to_string(level) + "].price,asks[" +
+            std::to_string(level) + "].amount,bids[" + std::to_string(level) +
+            "].price,bids[" + std::to_string(level) + "].amount";
+  text += "\n";
+
+  char line[512];
+  for (std::size_t i = 0; i < rows; i++) {
+    long t = 1700000000000000 + i * 100;
+    int len = snprintf(line, sizeof(line), "binance-futures,BTCUSDT,%ld,%ld",
+                       t, t + 1500);
+    for (int level = 0; level < 5; level++)
+      len += snprintf(line + len, sizeof(line) - len,
+                      ",%zu.%d,%.3f,%zu.%d,%.3f", 37000 + i % 500, level,
+                      0.001 * (i % 997 + level), 36999 + i % 500, 9 - level,
+                      0.002 * (i % 991 + level));
+    text.append(line, len);
+    text += "\n";
+  }
+  return {text.begin(), text.end()};
+}
+
+
+// Original parsing: find each delimiter with memchr, then strtod each number.
+static double parse_baseline(char* ptr, char* end)
+{
+  double sum = 0;
+  while (char* line_fin = (char*) memchr(ptr, '\n', end - ptr)) {
+    *line_fin = ',';
+    char* fields[book_fields];
+    for (auto& field : fields) {
+      char* delim = (char*) memchr(ptr, ',', line_fin + 1 - ptr);
+      *delim = '\0';
+      field = ptr;
+      ptr = delim + 1;
+    }
+    sum += atoll(fields[2]) * 1e-12;
+    for (std::size_t i = 4; i < book_fields; i++)
+      sum += strtod(fields[i], nullptr);
+  }
+  return sum;
+}
+
+
+template<typename Split>
+static double parse_fast(char* ptr, char* end, Split split)
+{
+  double sum = 0;
+  while (char* line_fin = (char*) memchr(ptr, '\n', end - ptr)) {
+    *line_fin = ',';
+    char* fields[book_fields];
+    split(ptr, line_fin + 1, ',', fields, book_fields);
+    ptr = line_fin + 1;
+
+    uint64_t t = 0;
+    csv::parse_uint(fields[2], t);
+    sum += t * 1e-12;
+    for (std::size_t i = 4; i < book_fields; i++) {
+      double value;
+      if (!csv::parse_decimal(fields[i], value))
+        value = strtod(fields[i], nullptr);
+      sum += value;
+    }
+  }
+  return sum;
+}
+
+
+static double parse_tardis(char* ptr, char* end)
+{
+  double sum = 0;
+  TardisCsvParserBookSnapshot5 parser(ptr, end - ptr);
+  TardisEvent event;
+  while (parser.next()) {
+    parser.decode_event(event);
+    sum += std::get<TickBookSnapshot5>(event.tick).levels[0].bid_price;
+  }
+  return sum;
+}
+
+
+static void run(const std::string& source, const std::vector<char>& text,
+                const char* variant, std::function<double(char*, char*)> fn)
+{
+  constexpr int repeats = 5;
+
+  // skip the header line
+  auto body_start = std::find(text.begin(), text.end(), '\n') + 1;
+  std::size_t rows = std::count(body_start, text.end(), '\n');
+
+  double best = 0;
+  double checksum = 0;
+  std::vector<char> work;
+  for (int r = 0; r < repeats; r++) {
+    work.assign(body_start, text.end()); // parsing writes into the buffer
+    const auto t0 = std::chrono::steady_clock::now();
+    checksum = fn(work.data(), work.data() + work.size());
+    const auto t1 = std::chrono::steady_clock::now();
+    double secs = std::chrono::duration<double>(t1 - t0).count();
+    if (r == 0 || secs < best)
+      best = secs;
+  }
+
+  std::cout << "{\"bench\":\"tardis_csv\",\"source\":\"" << source
+            << "\",\"variant\":\"" << variant << "\",\"rows\":" << rows
+            << ",\"rows_per_sec\":" << static_cast<uint64_t>(rows / best)
+            << ",\"mb_per_sec\":" << static_cast<uint64_t>(work.size() / best / 1e6)
+            << ",\"checksum\":" << checksum << "}" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  std::vector<std::pair<std::string, std::vector<char>>> inputs;
+  for (int i = 1; i < argc; i++)
+    inputs.emplace_back(argv[i], inflate_file(argv[i]));
+  if (inputs.empty())
+    inputs.emplace_back("synthetic", synthetic_file(1000000));
+
+  for (auto& [source, text] : inputs) {
+    run(source, text, "baseline", parse_baseline);
+    run(source, text, "scalar", [](char* ptr, char* end) {
+      return parse_fast(ptr, end, csv::split_fields_scalar);
+    });
+    run(source, text, csv::split_fields_isa(), [](char* ptr, char* end) {
+      return parse_fast(ptr, end, csv::split_fields);
+    });
+    run(source, text, "parser", parse_tardis);
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of TcpSocket writes under contention.  1, 2 and 4 producer
+ * threads write small messages to one loopback socket, as fast as it accepts
+ * them, both queued for the IO thread and with direct writes enabled; the
+ * rate is that at which the peer has read all the bytes.  Each run's total
+ * stays within the socket's limit of pending write bytes, as producers are
+ * not paced.  Results are written as one JSON object per line. */
+
+#include <apex/core/Logger.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/infra/TcpSocket.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace apex;
+
+
+static void run_contention(size_t producers, bool direct_write,
+                           size_t messages, size_t msg_size)
+{
+  IoLoop ioloop;
+
+  const size_t total_bytes = producers * messages * msg_size;
+  std::atomic<size_t> bytes_read{0};
+  std::promise<void> all_read;
+
+  std::unique_ptr<TcpSocket> accepted;
+  std::promise<void> ready;
+  TcpSocket server(ioloop);
+  server
+      .listen("127.0.0.1", "0",
+              [&](std::unique_ptr<TcpSocket>& sock, UvErr ec) {
+                if (ec)
+                  return;
+                accepted = std::move(sock);
+                accepted->start_read(
+                    [&](char*, size_t len) {
+                      if ((bytes_read += len) == total_bytes)
+                        all_read.set_value();
+                    },
+                    [](UvErr) {});
+                ready.set_value();
+              })
+      .get();
+
+  TcpSocket::options options;
+  options.direct_write = direct_write;
+  TcpSocket client(ioloop, options);
+  client.connect("127.0.0.1", server.get_local_port()).get();
+  ready.get_future().wait();
+
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (size_t p = 0; p < producers; p++)
+    threads.emplace_back([&]() {
+      std::vector<char> msg(msg_size, 'x');
+      while (!go.load())
+        std::this_thread::yield();
+      for (size_t i = 0; i < messages; i++)
+        client.write(msg.data(), msg.size());
+    });
+
+  const auto t0 = std::chrono::steady_clock::now();
+  go.store(true);
+  for (auto& t : threads)
+    t.join();
+  const auto t1 = std::chrono::steady_clock::now();
+  all_read.get_future().wait();
+  const auto t2 = std::chrono::steady_clock::now();
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+
+  const size_t total = producers * messages;
+  const double write_secs = std::chrono::duration<double>(t1 - t0).count();
+  const double secs = std::chrono::duration<double>(t2 - t0).count();
+  std::cout << "{\"bench\":\"tcp_write\",\"producers\":" << producers
+            << ",\"direct_write\":" << (direct_write ? "true" : "false")
+            << ",\"messages\":" << total << ",\"msg_bytes\":" << msg_size
+            << ",\"writes_per_sec\":" << static_cast<uint64_t>(total / write_secs)
+            << ",\"delivered_per_sec\":" << static_cast<uint64_t>(total / secs)
+            << ",\"mb_per_sec\":"
+            << static_cast<uint64_t>(total_bytes / secs / (1 << 20)) << "}"
+            << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  // 4 x 12000 x 16 bytes stays within the 1 MB pending write limit
+  for (bool direct_write : {false, true})
+    for (size_t producers : {1, 2, 4})
+      run_contention(producers, direct_write, 48000 / producers, 16);
+  return 0;
+}
@@ -0,0 +1,195 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Benchmark of backtest tick file replay, in events per second, for the
+ * TickbinFileReader, raw and compressed, and the TardisFileReader, with and
+ * without read-ahead.  Synthetic files of L1 ticks, trades and five level book
+ * snapshots are written to a temporary directory, and each is replayed into a
+ * MarketData.  Results are written as one JSON object per line. */
+
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+
+#include <zlib.h>
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <utility>
+
+#include <unistd.h>
+
+using namespace apex;
+
+static const Time start{std::chrono::microseconds(1700000000000000)}; // 2023-11-14
+
+
+static Time at(size_t i)
+{
+  Time t = start;
+  t += std::chrono::milliseconds(i);
+  return t;
+}
+
+
+static std::filesystem::path write_tickbin(const std::filesystem::path& dir,
+                                           const std::string& channel,
+                                           size_t events, bool compress)
+{
+  Instrument instrument(InstrumentType::coinpair, "BTCUSDT.BNC",
+                        {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                        "BTCUSDT", "binance");
+  StreamInfo info{instrument, channel};
+  std::string filename = channel + (compress ? "_z.bin" : ".bin");
+
+  TickbinFileWriter::Options options;
+  options.compress = compress;
+  {
+    TickbinFileWriter writer(TickFileBucketId::from_time(start), dir, filename,
+                             info, {}, options);
+    for (size_t i = 0; i < events; i++) {
+      tickbin::Serialiser::bytes bytes;
+      if (channel == "l1") {
+        TickTop tick;
+        tick.bid_price = 37000 + (i & 255) * 0.1;
+        tick.bid_qty = 1.5;
+        tick.ask_price = tick.bid_price + 0.1;
+        tick.ask_qty = 0.5;
+        bytes = tickbin::Serialiser::serialise(at(i), tick);
+      } else {
+        TickTrade tick;
+        tick.price = 37000 + (i & 255) * 0.1;
+        tick.qty = 0.01;
+        tick.et = at(i);
+        tick.aggr_side = (i & 1) ? Side::sell : Side::buy;
+        bytes = tickbin::Serialiser::serialise(at(i), tick);
+      }
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+
+  // compressed days are written as hourly parts; all events fall in the first
+  auto fn = dir / filename;
+  return compress ? tickbin_part_path(fn, start.tm_utc().tm_hour) : fn;
+}
+
+
+static std::filesystem::path write_tardis(const std::filesystem::path& dir,
+                                          TardisFileReader::DataType type,
+                                          size_t rows)
+{
+  const bool trades = type == TardisFileReader::DataType::trades;
+  auto fn = dir / (trades ? "trades.csv.gz" : "book_snapshot_5.csv.gz");
+  gzFile gz = gzopen(fn.c_str(), "wb");
+  if (trades) {
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp,id,side,price,amount\n");
+  } else {
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp");
+    for (int level = 0; level < 5; level++)
+      gzprintf(gz, ",asks[%d].price,asks[%d].amount,bids[%d].price,bids[%d].amount",
+               level, level, level, level);
+    gzprintf(gz, "\n");
+  }
+
+  const long t0 = start.as_epoch_us().count();
+  for (size_t i = 0; i < rows; i++) {
+    long t = t0 + i * 1000;
+    if (trades) {
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,%zu,%s,%zu.5,0.25\n", t, t + 10, i,
+               (i & 1) ? "sell" : "buy", 37000 + (i & 255));
+    } else {
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld", t, t + 10);
+      for (int level = 0; level < 5; level++)
+        gzprintf(gz, ",%zu.%d,%.3f,%zu.%d,%.3f", 37000 + (i & 255), 5 + level,
+                 0.5 + level, 37000 + (i & 255), 4 - level, 1.5 + level);
+      gzprintf(gz, "\n");
+    }
+  }
+  gzclose(gz);
+  return fn;
+}
+
+
+template <typename Reader>
+static void run(const char* reader_name, const char* stream,
+                const std::filesystem::path& fn, Reader& reader,
+                MarketData& md, bool l1)
+{
+  double checksum = 0;
+  size_t events = 0;
+  const auto t0 = std::chrono::steady_clock::now();
+  reader.wind_forward(start);
+  while (reader.has_next_event()) {
+    reader.consume_next_event();
+    checksum += l1 ? md.bid() : md.last().price;
+    events++;
+  }
+  const auto t1 = std::chrono::steady_clock::now();
+
+  const double secs = std::chrono::duration<double>(t1 - t0).count();
+  std::cout << "{\"bench\":\"tick_readers\",\"reader\":\"" << reader_name
+            << "\",\"stream\":\"" << stream
+            << "\",\"file_bytes\":" << std::filesystem::file_size(fn)
+            << ",\"events\":" << events
+            << ",\"events_per_sec\":" << static_cast<uint64_t>(events / secs)
+            << ",\"checksum\":" << checksum << "}" << std::endl;
+}
+
+
+int main()
+{
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_bench_tick_readers_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+
+  const size_t events = 2000000;
+
+  for (bool compress : {false, true}) {
+    for (auto [channel, stream] : {std::pair{"l1", MdStream::L1},
+                                   std::pair{"aggtrades", MdStream::AggTrades}}) {
+      auto fn = write_tickbin(dir, channel, events, compress);
+      MarketData md;
+      TickbinFileReader reader(fn, &md, stream);
+      run(compress ? "tickbin_compressed" : "tickbin", channel, fn, reader, md,
+          stream == MdStream::L1);
+    }
+  }
+
+  for (auto type : {TardisFileReader::DataType::trades,
+                    TardisFileReader::DataType::book_snapshot_5}) {
+    const bool trades = type == TardisFileReader::DataType::trades;
+    auto fn = write_tardis(dir, type, events / 2);
+    for (bool read_ahead : {false, true}) {
+      MarketData md;
+      TardisFileReader reader(fn, &md, trades ? MdStream::Trades : MdStream::L1,
+                              type, read_ahead);
+      run(read_ahead ? "tardis_read_ahead" : "tardis",
+          trades ? "trades" : "book_snapshot_5", fn, reader, md, !trades);
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+  return 0;
+}
@@ -0,0 +1,37 @@
+# Runs each benchmark program listed, comma separated, in PROGRAMS, and writes
+# their results to OUTPUT.  Each result is a line of output holding a JSON
+# object, to which the time of the run and the source revision are added, so
+# that results of successive runs can be appended to one history and compared;
+# other output, such as log lines, is discarded.
+
+string(REPLACE "," ";" PROGRAMS "${PROGRAMS}")
+string(TIMESTAMP RUN_TIME "%Y-%m-%dT%H:%M:%SZ" UTC)
+
+execute_process(COMMAND git rev-parse --short HEAD
+        WORKING_DIRECTORY ${CMAKE_CURRENT_LIST_DIR}
+        OUTPUT_VARIABLE REVISION
+        OUTPUT_STRIP_TRAILING_WHITESPACE
+        ERROR_QUIET)
+if (NOT REVISION)
+    set(REVISION "unknown")
+endif ()
+
+file(WRITE ${OUTPUT} "")
+foreach (prog ${PROGRAMS})
+    message(STATUS "running ${prog}")
+    execute_process(COMMAND ${prog}
+            OUTPUT_VARIABLE output
+            RESULT_VARIABLE result)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "${prog} failed: ${result}")
+    endif ()
+    string(REPLACE "\n" ";" lines "${output}")
+    foreach (line ${lines})
+        if (line MATCHES "^{")
+            string(SUBSTRING "${line}" 1 -1 line)
+            file(APPEND ${OUTPUT}
+                 "{\"time\":\"${RUN_TIME}\",\"revision\":\"${REVISION}\",${line}\n")
+        endif ()
+    endforeach ()
+endforeach ()
+message(STATUS "benchmark results written to ${OUTPUT}")
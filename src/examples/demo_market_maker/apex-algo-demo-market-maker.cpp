@@ -50,12 +50,11 @@ public:
   {
     auto symbols = parse_flat_instruments_config();
     for (const std::string& symbol : symbols) {
-      apex::Instrument instrument =
+      auto& instrument =
           _services->ref_data_service()->get_instrument(
               symbol, apex::InstrumentType::coinpair);
 
-      auto bot = std::unique_ptr<apex::Bot>(construct_bot(instrument));
-      _bots.insert({instrument, std::move(bot)});
+      add_bot(std::unique_ptr<apex::Bot>(construct_bot(instrument)));
     }
   }
 };
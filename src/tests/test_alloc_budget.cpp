@@ -0,0 +1,185 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Allocation budget of the tick path.  A mixed L1 and trades tick file is
+ * written, then replayed into a sample bot, with the counting allocation hook
+ * linked and the guards logging.  After the warmup ticks, the allocations
+ * made in replaying each tick must be within the budget, of allocations per
+ * tick, given as the first argument (default 0), and no no-alloc scope may be
+ * violated.  Exits non-zero otherwise. */
+
+#include <apex/backtest/TickReplayer.hpp>
+#include <apex/backtest/TickShards.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/core/StaticBot.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/util/AllocGuard.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+
+#include <unistd.h>
+
+using namespace apex;
+
+
+/* Keeps a fast and slow average of the mid and trade prices, as a signal. */
+struct SignalBot final : StaticBot<SignalBot> {
+  SignalBot(Strategy* strategy, const Instrument& instrument)
+    : StaticBot<SignalBot>("signal", strategy, instrument)
+  {
+  }
+
+  void attach(MarketData* md)
+  {
+    begin_warmup(md, nullptr);
+    listen(md);
+  }
+
+  void on_tick_book(MarketData::EventType) override
+  {
+    update((market().bid() + market().ask()) / 2);
+  }
+
+  void on_tick_trade(MarketData::EventType) override
+  {
+    update(market().last().price);
+  }
+
+  void update(double price)
+  {
+    fast += 0.2 * (price - fast);
+    slow += 0.02 * (price - slow);
+    signal = std::copysign(1.0, fast - slow);
+    ticks++;
+  }
+
+  double fast = 0;
+  double slow = 0;
+  double signal = 0;
+  size_t ticks = 0;
+};
+
+
+static void write_ticks(const std::filesystem::path& dir,
+                        const Instrument& instrument, Time date, int total)
+{
+  auto bucketid = TickFileBucketId::from_time(date);
+  auto day_path = [&](const std::string& stream) {
+    return dir / "tickbin1" / instrument.exchange_name() / stream /
+           date.strftime("%Y") / date.strftime("%m") / date.strftime("%d");
+  };
+  {
+    TickbinFileWriter l1(bucketid, day_path("l1"), "BTCUSDT.bin",
+                         {instrument, "l1"});
+    TickbinFileWriter trades(bucketid, day_path("aggtrades"), "BTCUSDT.bin",
+                             {instrument, "aggtrades"});
+    for (int i = 0; i < total; i++) {
+      Time at{date.as_epoch_us() + std::chrono::milliseconds(i)};
+      double price = 100.0 + std::sin(i / 50.0);
+      if (i % 3) {
+        TickTop tick;
+        tick.bid_price = price - 0.01;
+        tick.ask_price = price + 0.01;
+        tick.bid_qty = tick.ask_qty = 1;
+        auto bytes = tickbin::Serialiser::serialise(at, tick);
+        l1.write_bytes(bytes.data(), bytes.size());
+      }
+      else {
+        TickTrade tick;
+        tick.price = price;
+        tick.qty = 1;
+        tick.aggr_side = i % 2 ? Side::buy : Side::sell;
+        auto bytes = tickbin::Serialiser::serialise(at, tick);
+        trades.write_bytes(bytes.data(), bytes.size());
+      }
+    }
+  }
+  interleave_tickbin_streams({day_path("l1") / "BTCUSDT.bin",
+                              day_path("aggtrades") / "BTCUSDT.bin"},
+                             day_path(tickbin_mixed_channel) / "BTCUSDT.bin");
+}
+
+
+int main(int argc, char** argv)
+{
+  const uint64_t budget = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 0;
+  const int total = 20000;
+  const int warmup = 1000;
+
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+  if (!alloc::hook_installed()) {
+    std::cerr << "allocation hook not linked" << std::endl;
+    return 1;
+  }
+
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_alloc_budget_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  Instrument instrument(InstrumentType::coinpair, "BTCUSDT.BNC",
+                        {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                        "BTCUSDT", "binance");
+  Time date{std::chrono::seconds(1700006400)};
+  write_ticks(dir, instrument, date, total);
+
+  Services services(RunMode::backtest, {date, date});
+  Strategy strategy(&services, Config(json::parse(R"({ "code": "ALLOC" })")));
+  MarketData md;
+  SignalBot bot(&strategy, instrument);
+  bot.attach(&md);
+
+  // a tick's allocations are those made in replaying it: decoding, applying
+  // it to the market data, and the bot's handlers
+  uint64_t over_budget = 0;
+  uint64_t worst = 0;
+  size_t ticks = 0;
+  alloc::set_guard_mode(alloc::GuardMode::log);
+  TickReplayer replayer(dir, TickFormat::tickbin1, instrument, &md,
+                        tickbin_mixed_streams, date, {date}, {});
+  while (replayer.get_next_event_time() != Time{}) {
+    auto start = alloc::thread_counters.count;
+    replayer.consume_next_event();
+    if (++ticks <= warmup)
+      continue;
+    auto allocations = alloc::thread_counters.count - start;
+    worst = std::max(worst, allocations);
+    if (allocations > budget)
+      over_budget++;
+  }
+  alloc::set_guard_mode(alloc::GuardMode::off);
+  std::filesystem::remove_all(dir);
+
+  std::cout << "{\"test\":\"alloc_budget\",\"ticks\":" << ticks
+            << ",\"budget\":" << budget << ",\"worst\":" << worst
+            << ",\"over_budget\":" << over_budget
+            << ",\"violations\":" << alloc::total_violations() << "}"
+            << std::endl;
+  alloc::write_report(std::cerr);
+
+  if (ticks != static_cast<size_t>(total) || bot.ticks != ticks) {
+    std::cerr << "expected " << total << " ticks" << std::endl;
+    return 1;
+  }
+  return over_budget || alloc::total_violations() ? 1 : 0;
+}
@@ -17,10 +17,138 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 #include "quicktest.hpp"
 
+#include <apex/backtest/AsyncTickFileWriter.hpp>
+#include <apex/backtest/BarFile.hpp>
+#include <apex/backtest/GxCaptureReplayer.hpp>
+#include <apex/backtest/SimExchange.hpp>
+#include <apex/backtest/SimFillModel.hpp>
+#include <apex/backtest/SimLatencyModel.hpp>
+#include <apex/backtest/SimMatchingBook.hpp>
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/DecodedTickCache.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickShards.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
+#include <apex/backtest/TickbinMsgs.hpp>
+#include <apex/backtest/UniverseTickFile.hpp>
+#include <apex/comm/GxBinaryFormat.hpp>
+#include <apex/comm/GxClientSession.hpp>
+#include <apex/comm/GxServerSession.hpp>
+#include <apex/comm/GxSessionBase.hpp>
+#include <apex/comm/GxTickQueue.hpp>
+#include <apex/core/AuditBinaryWriter.hpp>
+#include <apex/core/Auditor.hpp>
+#include <apex/core/BarService.hpp>
+#include <apex/core/BacktestFork.hpp>
+#include <apex/core/BacktestResultCache.hpp>
+#include <apex/core/BinaryLog.hpp>
+#include <apex/core/Coroutine.hpp>
+#include <apex/core/EmbeddedGateway.hpp>
+#include <apex/core/GatewayFailover.hpp>
+#include <apex/core/Errors.hpp>
+#include <apex/core/Bot.hpp>
+#include <apex/core/FxRateService.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/core/MarketDataService.hpp>
+#include <apex/core/OrderCache.hpp>
+#include <apex/core/OrderRouter.hpp>
+#include <apex/core/OrderService.hpp>
+#include <apex/core/PositionLog.hpp>
+#include <apex/core/PositionSnapshot.hpp>
+#include <apex/core/RefDataService.hpp>
+#include <apex/core/RefDataSnapshot.hpp>
+#include <apex/core/RiskService.hpp>
+#include <apex/core/Services.hpp>
+#include <apex/core/StateJournal.hpp>
+#include <apex/core/ShardBus.hpp>
+#include <apex/core/ShardedBacktest.hpp>
+#include <apex/core/StaticBot.hpp>
+#include <apex/core/StatusSegment.hpp>
+#include <apex/core/Strategy.hpp>
+#include <apex/core/StrategyMain.hpp>
+#include <apex/gx/BinanceDecoder.hpp>
+#include <apex/gx/BinanceRateLimiter.hpp>
+#include <apex/gx/BinanceSession.hpp>
+#include <apex/gx/BinanceWsApi.hpp>
+#include <apex/gx/ExchangeSession.hpp>
+#include <apex/gx/GxServer.hpp>
+#include <apex/gx/PaperExchange.hpp>
+#include <apex/model/InstrumentTable.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/model/FixedBook.hpp>
+#include <apex/model/FixedPosition.hpp>
+#include <apex/model/Portfolio.hpp>
+#include <apex/model/Position.hpp>
+#include <apex/model/StrategyId.hpp>
+#include <apex/model/Indicators.hpp>
+#include <apex/infra/AddressCache.hpp>
+#include <apex/infra/DecodeBuffer.hpp>
+#include <apex/infra/HttpClientPool.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/infra/IoUring.hpp>
+#include <apex/infra/Ktls.hpp>
+#include <apex/infra/ReadBufferPool.hpp>
+#include <apex/infra/RingDecodeBuffer.hpp>
+#include <apex/infra/ShmRing.hpp>
+#include <apex/infra/ssl.hpp>
+#include <apex/infra/TcpSocket.hpp>
+#include <apex/infra/UdpSocket.hpp>
+#include <apex/infra/WebsocketDeflate.hpp>
+#include <apex/infra/WebsocketFrame.hpp>
+#include <apex/infra/WebsocketProtocol.hpp>
 #include <apex/util/utils.hpp>
 #include <apex/util/platform.hpp>
+#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/util/CpuDispatch.hpp>
+#include <apex/util/CsvScan.hpp>
+#include <apex/util/ExpiringKeySet.hpp>
+#include <apex/util/FeedLatency.hpp>
+#include <apex/util/FixedString.hpp>
+#include <apex/util/InlineFunction.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/MemoryAccount.hpp>
+#include <apex/util/MemoryPolicy.hpp>
+#include <apex/util/AllocGuard.hpp>
+#include <apex/util/Metrics.hpp>
+#include <apex/util/Profiler.hpp>
+#include <apex/util/MpscQueue.hpp>
+#include <apex/util/Numa.hpp>
+#include <apex/util/ObjectPool.hpp>
+#include <apex/util/PerfectHashMap.hpp>
+#include <apex/util/RateLimiter.hpp>
+#include <apex/util/RawCapture.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/util/RequestSigner.hpp>
+#include <apex/util/TaskPool.hpp>
+#include <apex/util/ThreadParams.hpp>
+#include <apex/util/TimerWheel.hpp>
+#include <apex/util/TscClock.hpp>
+#include <apex/util/rx.hpp>
 
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <new>
+#include <list>
+#include <map>
+#include <random>
+#include <set>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <openssl/evp.h>
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
 
 using namespace std;
 
@@ -44,6 +172,9082 @@ TEST_CASE("utils")
 }
 
 
+TEST_CASE("time_ns")
+{
+  using namespace std::chrono;
+
+  // nanoseconds are kept, and the coarser accessors truncate
+  apex::Time t{nanoseconds(1700000000123456789)};
+  REQUIRE(t.as_epoch_ns().count() == 1700000000123456789);
+  REQUIRE(t.as_epoch_us().count() == 1700000000123456);
+  REQUIRE(t.as_epoch_ms().count() == 1700000000123);
+  REQUIRE(t.usec().count() == 123456);
+  REQUIRE(t.nsec().count() == 123456789);
+  REQUIRE(t.as_iso8601() == "2023-11-14T22:13:20.123Z");
+  REQUIRE(t.as_iso8601(apex::Time::Resolution::micro) == "2023-11-14T22:13:20.123456Z");
+  REQUIRE(t.as_iso8601(apex::Time::Resolution::nano) == "2023-11-14T22:13:20.123456789Z");
+
+  // compatible with the second/microsecond constructors
+  REQUIRE(apex::Time(1700000000, microseconds(123456)) == apex::Time(microseconds(1700000000123456)));
+  REQUIRE(apex::Time(1700000000, milliseconds(5)) == apex::Time(seconds(1700000000) + milliseconds(5)));
+  REQUIRE(apex::Time("2023-11-14 22:13:20.123") == apex::Time(milliseconds(1700000000123)));
+
+  auto u = t;
+  u += milliseconds(1500);
+  REQUIRE(u - t == microseconds(1500000));
+  REQUIRE(t < u);
+  REQUIRE(!(u <= t));
+  u -= nanoseconds(1);
+  REQUIRE(u.as_epoch_ns().count() == 1700000001623456788);
+
+  // the TSC clock tracks the system clock
+  auto& clock = apex::TscClock::instance();
+  clock.recalibrate();
+  auto before = apex::Time::realtime_now();
+  auto fast = apex::Time::fast_now();
+  auto after = apex::Time::realtime_now();
+  REQUIRE(fast.as_epoch_ns() > before.as_epoch_ns() - milliseconds(1));
+  REQUIRE(fast.as_epoch_ns() < after.as_epoch_ns() + milliseconds(1));
+  auto first = clock.now();
+  auto second = clock.now();
+  REQUIRE(first <= second);
+}
+
+
+TEST_CASE("parse_decimal")
+{
+  apex::ScaledInt exact;
+  double value;
+
+  REQUIRE(apex::parse_decimal("19894.70000000", exact, value));
+  REQUIRE(exact == apex::ScaledInt(1989470000000, -8));
+  REQUIRE(value == 19894.7);
+
+  REQUIRE(apex::parse_decimal("0.00129000", exact, value));
+  REQUIRE(exact == apex::ScaledInt(129000, -8));
+  REQUIRE(value == 0.00129);
+
+  REQUIRE(apex::parse_decimal("-42", exact, value));
+  REQUIRE(exact == apex::ScaledInt(-42, 0));
+  REQUIRE(value == -42);
+
+  // every double must match strtod, including those not exact in binary
+  std::mt19937 gen(7);
+  for (int i = 0; i < 10000; i++) {
+    auto s = std::to_string(gen() % 100000000) + "." +
+             std::to_string(10000000 + gen() % 90000000);
+    REQUIRE(apex::parse_decimal(s, exact, value));
+    REQUIRE(value == std::strtod(s.c_str(), nullptr));
+    REQUIRE(exact.scale() == -8);
+  }
+
+  REQUIRE(!apex::parse_decimal("", exact, value));
+  REQUIRE(!apex::parse_decimal(".", exact, value));
+  REQUIRE(!apex::parse_decimal("1e5", exact, value));
+  REQUIRE(!apex::parse_decimal("1.2.3", exact, value));
+  REQUIRE(!apex::parse_decimal("1234567890.1234567890", exact, value));
+
+  // ordering is exact, and by value across scales
+  REQUIRE(apex::ScaledInt(1989470000000, -8) < apex::ScaledInt(1989470000001, -8));
+  REQUIRE(apex::ScaledInt(15, -1) > apex::ScaledInt(149, -2));
+  REQUIRE(apex::ScaledInt(15, -1) <= apex::ScaledInt(150, -2));
+  REQUIRE(apex::ScaledInt(15, -1) >= apex::ScaledInt(150, -2));
+  REQUIRE(!(apex::ScaledInt(2, 0) < apex::ScaledInt(2000, -3)));
+}
+
+
+TEST_CASE("mpsc_queue")
+{
+  apex::MpscQueue<int> queue(3);
+  REQUIRE(queue.capacity() == 4);
+  REQUIRE(queue.empty());
+
+  for (int i = 0; i < 4; i++)
+    REQUIRE(queue.try_push(int{i}));
+  REQUIRE(!queue.try_push(99));
+
+  int value = -1;
+  for (int i = 0; i < 4; i++) {
+    REQUIRE(queue.try_pop(value));
+    REQUIRE(value == i);
+  }
+  REQUIRE(!queue.try_pop(value));
+  REQUIRE(queue.empty());
+
+  // lock-free event loop, with several producers and a small ring so that
+  // the overflow path is also exercised
+  apex::RealtimeEventLoop::Options options;
+  options.queue_type = apex::RealtimeEventLoop::QueueType::lockfree;
+  options.queue_capacity = 16;
+  apex::RealtimeEventLoop evloop(options, []() { return false; });
+
+  const int producers = 4;
+  const int per_producer = 10000;
+  int count = 0;
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++)
+    threads.emplace_back([&]() {
+      for (int i = 0; i < per_producer; i++)
+        evloop.dispatch([&count]() { ++count; });
+    });
+  for (auto& t : threads)
+    t.join();
+
+  std::promise<int> result;
+  evloop.dispatch([&]() { result.set_value(count); });
+  REQUIRE(result.get_future().get() == producers * per_producer);
+}
+
+
+TEST_CASE("event_loop_wait_modes")
+{
+  for (auto mode : {apex::RealtimeEventLoop::WaitMode::spin,
+                    apex::RealtimeEventLoop::WaitMode::spin_then_block}) {
+    apex::RealtimeEventLoop::Options options;
+    options.wait_mode = mode;
+    options.spin_duration = std::chrono::microseconds(10);
+    apex::RealtimeEventLoop evloop(options, []() { return false; });
+
+    // timer, followed by immediate dispatch from another thread
+    std::promise<int> timer_result;
+    evloop.dispatch(std::chrono::milliseconds(5), [&]() {
+      timer_result.set_value(1);
+      return std::chrono::milliseconds(0);
+    });
+    REQUIRE(timer_result.get_future().get() == 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    std::promise<int> result;
+    std::thread([&]() { evloop.dispatch([&]() { result.set_value(2); }); })
+        .join();
+    REQUIRE(result.get_future().get() == 2);
+  }
+}
+
+
+TEST_CASE("event_loop_batching")
+{
+  // events queued while the EV thread is busy are processed in order, in
+  // batches no larger than the budget, with the hook run after each batch
+  for (auto queue :
+       {apex::RealtimeEventLoop::QueueType::locked,
+        apex::RealtimeEventLoop::QueueType::lockfree}) {
+    apex::RealtimeEventLoop::Options options;
+    options.queue_type = queue;
+    options.batch_budget = 3;
+    apex::RealtimeEventLoop evloop(options, []() { return false; });
+
+    std::vector<int> seen;
+    std::vector<size_t> batches;
+    evloop.add_batch_end_hook([&]() { batches.push_back(seen.size()); });
+
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> blocked;
+    evloop.dispatch([&, released]() {
+      blocked.set_value();
+      released.wait();
+    });
+    blocked.get_future().wait();
+    for (int i = 0; i < 10; i++)
+      evloop.dispatch([&seen, i]() { seen.push_back(i); });
+    std::promise<void> done;
+    evloop.dispatch([&]() { done.set_value(); });
+    release.set_value();
+    done.get_future().wait();
+
+    // the final hook runs after the `done` event
+    evloop.sync_stop();
+    REQUIRE(seen.size() == 10);
+    for (int i = 0; i < 10; i++)
+      REQUIRE(seen[i] == i);
+    REQUIRE(batches.size() >= 4);
+    for (size_t i = 1; i < batches.size(); i++)
+      REQUIRE(batches[i] - batches[i - 1] <= 3);
+  }
+}
+
+
+TEST_CASE("latency_histogram")
+{
+  // buckets are contiguous, and each value lies within its bucket's range
+  for (uint64_t v : {0ull, 1ull, 15ull, 16ull, 17ull, 31ull, 32ull, 1000ull,
+                     123456789ull, ~0ull}) {
+    auto index = apex::LatencyHistogram::bucket_of(v);
+    REQUIRE(index < apex::LatencyHistogram::bucket_count);
+    REQUIRE(apex::LatencyHistogram::bucket_upper(index) >= v);
+    if (index > 0)
+      REQUIRE(apex::LatencyHistogram::bucket_upper(index - 1) < v);
+  }
+
+  apex::LatencyHistogram hist;
+  for (uint64_t v = 1; v <= 1000; v++)
+    hist.record(v * 1000);
+  auto snap = hist.snapshot(true);
+  REQUIRE(snap.count == 1000);
+  REQUIRE(snap.max == 1000000);
+  auto p50 = snap.value_at(0.5);
+  REQUIRE(p50 >= 500000 && p50 <= 500000 * 1.0625);
+  REQUIRE(snap.value_at(1.0) == 1000000);
+  REQUIRE(hist.snapshot().count == 0);
+
+  // event loop stats
+  apex::RealtimeEventLoop::Options options;
+  options.instrument = true;
+  apex::RealtimeEventLoop evloop(options, []() { return false; });
+  std::promise<void> done;
+  evloop.dispatch(std::chrono::milliseconds(1), [&]() {
+    done.set_value();
+    return std::chrono::milliseconds(0);
+  });
+  done.get_future().wait();
+  std::promise<void> flushed;
+  evloop.dispatch([&]() { flushed.set_value(); });
+  flushed.get_future().wait();
+  evloop.sync_stop();
+  auto stats = evloop.stats();
+  REQUIRE(stats.timer_lateness.count == 1);
+  // the kill request is also queued
+  REQUIRE(stats.queue_latency.count >= 1);
+  REQUIRE(stats.handler_duration.count >= 2);
+}
+
+
+TEST_CASE("feed_latency")
+{
+  // lags of 1000us plus 0..99us, growing by 50us per second of local time,
+  // within a window holding only the last 100 events
+  apex::FeedLatency feed(100);
+  REQUIRE(feed.stats().samples == 0);
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  for (int i = 0; i < 300; i++) {
+    auto local = start;
+    local += std::chrono::milliseconds(10 * i);
+    auto lag = std::chrono::microseconds(1000 + (i * 37) % 100 + i / 2);
+    auto event = local;
+    event -= lag;
+    REQUIRE(feed.record(event, local) == lag);
+  }
+
+  auto stats = feed.stats();
+  REQUIRE(stats.samples == 100);
+  REQUIRE(stats.min_us >= 1100);
+  REQUIRE(stats.median_us > stats.min_us);
+  REQUIRE(stats.p99_us >= stats.median_us);
+  REQUIRE(stats.p99_us <= 1000 + 99 + 149);
+  REQUIRE(stats.drift_us_per_sec > 40);
+  REQUIRE(stats.drift_us_per_sec < 60);
+}
+
+
+TEST_CASE("fused_event_loop")
+{
+  // the event loop is driven from the IO thread, including for work
+  // dispatched from other threads, nested dispatches and timers
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop::Options options;
+  options.own_thread = false;
+  apex::RealtimeEventLoop evloop(options, []() { return false; });
+  ioloop.attach_event_loop(&evloop);
+
+  std::promise<bool> on_io;
+  evloop.dispatch([&]() {
+    evloop.dispatch([&]() {
+      on_io.set_value(ioloop.this_thread_is_io() && evloop.this_thread_is_ev());
+    });
+  });
+  REQUIRE(on_io.get_future().get());
+
+  std::promise<bool> timer_on_io;
+  evloop.dispatch(std::chrono::milliseconds(5), [&]() {
+    timer_on_io.set_value(ioloop.this_thread_is_io());
+    return std::chrono::milliseconds(0);
+  });
+  REQUIRE(timer_on_io.get_future().get());
+
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("backtest_immediate_dispatch")
+{
+  // a chain of immediate dispatches runs in order, without advancing time,
+  // and ahead of a timer due at the same time
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::BacktestEventLoop evloop(start);
+  evloop.set_time(start);
+  std::vector<std::pair<int, apex::Time>> seen;
+  evloop.dispatch(std::chrono::milliseconds(1), [&]() {
+    seen.push_back({100, evloop.get_time()});
+    return std::chrono::milliseconds(0);
+  });
+  evloop.dispatch([&]() {
+    seen.push_back({1, evloop.get_time()});
+    evloop.dispatch([&]() { seen.push_back({3, evloop.get_time()}); });
+  });
+  evloop.dispatch([&]() { seen.push_back({2, evloop.get_time()}); });
+  evloop.run_loop({});
+
+  REQUIRE(seen.size() == 4);
+  for (int i = 0; i < 3; i++) {
+    REQUIRE(seen[i].first == i + 1);
+    REQUIRE(seen[i].second == start);
+  }
+  REQUIRE(seen[3].first == 100);
+  REQUIRE(seen[3].second.as_epoch_us() ==
+          start.as_epoch_us() + std::chrono::milliseconds(1));
+}
+
+
+TEST_CASE("backtest_fork")
+{
+  // state built before the checkpoint is inherited by every variant, which
+  // then continue independently; each reports its result as exit status
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::BacktestEventLoop evloop(start);
+  evloop.set_time(start);
+
+  int ticks = 0;
+  size_t step = 1;
+  evloop.dispatch(std::chrono::milliseconds(1), [&]() {
+    ticks += step;
+    return ticks < 20 ? std::chrono::milliseconds(1)
+                      : std::chrono::milliseconds(0);
+  });
+
+  int ticks_at_fork = -1;
+  apex::BacktestFork fork(
+      evloop, apex::Time(start.as_epoch_us() + std::chrono::milliseconds(5)), 3,
+      [&](size_t variant) {
+        ticks_at_fork = ticks;
+        step = variant + 1;
+      });
+  evloop.run_loop({});
+
+  // the fork was scheduled ahead of the tick due at the same time, so sees
+  // four ticks; variants then step by 1, 2 and 3 to reach 20
+  auto results = fork.join(ticks_at_fork == 4 ? ticks : 255);
+  REQUIRE(fork.has_forked());
+  REQUIRE(!fork.is_child());
+  REQUIRE((results == std::vector<int>{20, 20, 22}));
+}
+
+
+TEST_CASE("task_pool")
+{
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto sync = [&]() {
+    std::promise<void> done;
+    evloop.dispatch([&]() { done.set_value(); });
+    done.get_future().wait();
+  };
+
+  bool failed_completion = false;
+  {
+    apex::TaskPool pool(&evloop, 3);
+    REQUIRE(pool.thread_count() == 3);
+
+    // completions run on the event thread; counters are only touched there
+    const int task_count = 1000;
+    apex::TaskGroup group;
+    std::promise<void> all_done;
+    long long sum = 0;
+    int completed = 0;
+    bool on_ev = true;
+    for (int i = 0; i < task_count; i++)
+      pool.submit(
+          group, [i]() { return (long long)i * i; },
+          [&](long long r) {
+            on_ev = on_ev && evloop.this_thread_is_ev();
+            sum += r;
+            if (++completed == task_count)
+              all_done.set_value();
+          });
+    all_done.get_future().wait();
+    REQUIRE(on_ev);
+    REQUIRE(sum == 332833500LL);
+
+    // move-only results, void work, and work that throws
+    std::promise<int> moved;
+    pool.submit(
+        group, []() { return std::make_unique<int>(7); },
+        [&](std::unique_ptr<int> r) { moved.set_value(*r); });
+    REQUIRE(moved.get_future().get() == 7);
+
+    std::promise<void> void_done;
+    pool.submit(group, []() {}, [&]() { void_done.set_value(); });
+    void_done.get_future().wait();
+
+    pool.submit(
+        group, []() -> int { throw std::runtime_error("test"); },
+        [&](int) { failed_completion = true; });
+
+    // a cancelled group runs neither queued work nor completions
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    apex::TaskGroup blocker;
+    std::atomic<int> blocked{0};
+    for (int i = 0; i < 3; i++)
+      pool.submit(
+          blocker, [released, &blocked]() { blocked++; released.wait(); },
+          []() {});
+    while (blocked < 3)
+      std::this_thread::yield();
+    std::atomic<int> ran{0};
+    int cancelled_completions = 0;
+    {
+      apex::TaskGroup cancelled;
+      for (int i = 0; i < 10; i++)
+        pool.submit(
+            cancelled, [&ran]() { ran++; }, [&]() { cancelled_completions++; });
+      cancelled.cancel();
+      REQUIRE(cancelled.is_cancelled());
+      release.set_value();
+    }
+    while (pool.queued() > 0)
+      std::this_thread::yield();
+    REQUIRE(ran == 0);
+    sync();
+    REQUIRE(cancelled_completions == 0);
+  }
+  sync();
+  REQUIRE(!failed_completion);
+
+  // without threads, work runs inline and its completion is dispatched at
+  // the current simulated time
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::BacktestEventLoop bt_evloop(start);
+  bt_evloop.set_time(start);
+  apex::TaskPool inline_pool(&bt_evloop, 0);
+  apex::TaskGroup group;
+  std::vector<int> seen;
+  inline_pool.submit(
+      group, [&]() { seen.push_back(1); return 2; },
+      [&](int v) {
+        seen.push_back(v);
+        REQUIRE(bt_evloop.get_time() == start);
+      });
+  REQUIRE(seen.size() == 1);
+  bt_evloop.run_loop({});
+  REQUIRE(seen.size() == 2);
+  REQUIRE(seen[1] == 2);
+}
+
+
+TEST_CASE("timer_wheel")
+{
+  // compare expiry order against a multimap, over widely ranging due times,
+  // with random cancellation and re-arming
+  apex::TimerWheel<int> wheel(1000);
+  std::multimap<std::pair<uint64_t, int>, apex::TimerHandle> expected;
+  std::vector<std::pair<apex::TimerHandle, std::pair<uint64_t, int>>> handles;
+  std::mt19937_64 rng(42);
+
+  int next_value = 0;
+  uint64_t now = 1000;
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < 50; i++) {
+      const int shift = rng() % 44;
+      const uint64_t due = now + (rng() % (uint64_t(1) << shift));
+      const int value = next_value++;
+      auto h = wheel.schedule(due, value);
+      expected.insert({{due, value}, h});
+      handles.push_back({h, {due, value}});
+    }
+
+    // cancel a few
+    for (int i = 0; i < 5; i++) {
+      auto& item = handles[rng() % handles.size()];
+      auto iter = expected.find(item.second);
+      REQUIRE(wheel.cancel(item.first) == (iter != expected.end()));
+      if (iter != expected.end())
+        expected.erase(iter);
+    }
+    REQUIRE(wheel.size() == expected.size());
+
+    // expire a batch, checking order
+    const size_t batch = 1 + rng() % 40;
+    std::vector<apex::TimerHandle> fired;
+    size_t count = wheel.expire(
+        std::numeric_limits<uint64_t>::max(),
+        [&](apex::TimerHandle h, uint64_t due, int&& value) {
+          REQUIRE(!expected.empty());
+          REQUIRE(expected.begin()->first == std::make_pair(due, value));
+          REQUIRE(expected.begin()->second.index == h.index);
+          expected.erase(expected.begin());
+          fired.push_back(h);
+          now = due;
+        },
+        batch);
+    for (auto h : fired)
+      wheel.release(h);
+    REQUIRE(count == std::min(batch, count + expected.size()));
+    REQUIRE(wheel.now() == now);
+  }
+
+  // handles are released after expiry, and are stale thereafter
+  apex::TimerWheel<int> small(0);
+  auto h1 = small.schedule(10, 1);
+  apex::TimerHandle fired;
+  small.expire(20, [&](apex::TimerHandle h, uint64_t, int&&) { fired = h; });
+  REQUIRE(small.now() == 20);
+  REQUIRE(small.is_active(h1));
+  REQUIRE(small.rearm(fired, 30, 1));
+  REQUIRE(small.cancel(h1));
+  REQUIRE(!small.cancel(h1));
+  REQUIRE(small.empty());
+
+  // realtime event loop: cancel a repeating timer
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  std::atomic<int> calls{0};
+  auto handle = evloop.dispatch(std::chrono::milliseconds(1), [&]() {
+    ++calls;
+    return std::chrono::milliseconds(1);
+  });
+  while (calls < 3)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  REQUIRE(evloop.cancel_timer(handle));
+  std::promise<void> flushed;
+  evloop.dispatch([&]() { flushed.set_value(); });
+  flushed.get_future().wait();
+  const int calls_after_cancel = calls;
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(calls == calls_after_cancel);
+  REQUIRE(!evloop.cancel_timer(handle));
+}
+
+
+TEST_CASE("inline_function")
+{
+  // move-only captures are supported, and destroyed exactly once
+  auto owned = std::make_shared<int>(7);
+  std::weak_ptr<int> watch = owned;
+  apex::InlineFunction<int(int)> fn(
+      [p = std::unique_ptr<std::shared_ptr<int>>(
+           new std::shared_ptr<int>(std::move(owned)))](int x) {
+        return **p + x;
+      });
+  REQUIRE(fn);
+  REQUIRE(fn(1) == 8);
+
+  apex::InlineFunction<int(int)> moved(std::move(fn));
+  REQUIRE(!fn);
+  REQUIRE(moved(2) == 9);
+  REQUIRE(!watch.expired());
+  moved = nullptr;
+  REQUIRE(watch.expired());
+
+  // realtime event loop accepts inline functions on both queue types
+  for (auto queue :
+       {apex::RealtimeEventLoop::QueueType::locked,
+        apex::RealtimeEventLoop::QueueType::lockfree}) {
+    apex::RealtimeEventLoop::Options options;
+    options.queue_type = queue;
+    apex::RealtimeEventLoop evloop(options, []() { return false; });
+    std::promise<int> result;
+    evloop.dispatch(apex::EventLoop::inline_fn(
+        [&result, v = std::make_unique<int>(3)]() { result.set_value(*v); }));
+    REQUIRE(result.get_future().get() == 3);
+  }
+}
+
+
+TEST_CASE("tick_file_cache")
+{
+  auto fn = std::filesystem::temp_directory_path() /
+    ("apex_tick_file_cache_" + std::to_string(::getpid()) + ".bin");
+  {
+    std::ofstream os(fn, std::ios::binary);
+    os << "tickbin-bytes";
+  }
+
+  apex::TickFileCache cache;
+  auto first = cache.open(fn);
+  auto second = cache.open(fn);
+
+  // repeated opens share the one mapping
+  REQUIRE(first.get() == second.get());
+  REQUIRE(cache.size() == 1);
+  REQUIRE(std::string(first->begin(), first->end()) == "tickbin-bytes");
+
+  // a mapping outlives removal of the file
+  std::filesystem::remove(fn);
+  REQUIRE(first->size() == 13);
+  REQUIRE(*(first->end() - 1) == 's');
+}
+
+
+TEST_CASE("tickbin2")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tickbin2_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto at = [](std::chrono::microseconds offset) {
+    return apex::Time{std::chrono::seconds(1700000000) + offset};
+  };
+
+  // write L1 ticks, using small blocks so the file has many
+  apex::Tickbin2FileWriter::Options options;
+  options.block_records = 3;
+  auto l1_fn = dir / "l1.bin2";
+  {
+    apex::Tickbin2FileWriter writer(l1_fn, apex::MdStream::L1,
+                                    {{"c", "l1"}}, options);
+    for (int i = 0; i < 10; i++) {
+      apex::TickTop tick;
+      tick.bid_price = 100.0 + i;
+      tick.bid_qty = 1.0;
+      tick.ask_price = 101.0 + i;
+      tick.ask_qty = 2.0;
+      writer.write(at(std::chrono::seconds(i)), tick);
+    }
+    writer.close();
+    REQUIRE(writer.block_count() == 4);
+  }
+
+  // replay all
+  {
+    apex::MarketData md;
+    apex::Tickbin2FileReader reader(l1_fn, &md, apex::MdStream::L1);
+    REQUIRE(reader.block_count() == 4);
+    int count = 0;
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() == at(std::chrono::seconds(count)));
+      reader.consume_next_event();
+      REQUIRE(md.bid() == 100.0 + count);
+      REQUIRE(md.ask() == 101.0 + count);
+      count++;
+    }
+    REQUIRE(count == 10);
+  }
+
+  // wind forward uses the block index
+  {
+    apex::MarketData md;
+    apex::Tickbin2FileReader reader(l1_fn, &md, apex::MdStream::L1);
+    reader.wind_forward(at(std::chrono::milliseconds(6500)));
+    REQUIRE(reader.next_event_time() == at(std::chrono::seconds(7)));
+    reader.wind_forward(at(std::chrono::seconds(60)));
+    REQUIRE(!reader.has_next_event());
+  }
+
+  // a capture time going backwards, across a block boundary, is clamped to
+  // the previous time, so the block index stays sorted for wind forward
+  auto skew_fn = dir / "skew.bin2";
+  {
+    apex::Tickbin2FileWriter writer(skew_fn, apex::MdStream::L1,
+                                    {{"c", "l1"}}, options);
+    const int seconds[] = {0, 1, 2, 10, 11, 12, 5, 6, 7, 20};
+    for (int i = 0; i < 10; i++) {
+      apex::TickTop tick;
+      tick.bid_price = 100.0 + i;
+      tick.bid_qty = 1.0;
+      tick.ask_price = 101.0 + i;
+      tick.ask_qty = 2.0;
+      writer.write(at(std::chrono::seconds(seconds[i])), tick);
+    }
+    writer.close();
+    REQUIRE(writer.clamped_count() == 3);
+  }
+  {
+    apex::MarketData md;
+    apex::Tickbin2FileReader reader(skew_fn, &md, apex::MdStream::L1);
+    std::vector<apex::Time> times;
+    while (reader.has_next_event()) {
+      times.push_back(reader.next_event_time());
+      reader.consume_next_event();
+    }
+    REQUIRE(times.size() == 10);
+    REQUIRE(std::is_sorted(times.begin(), times.end()));
+    REQUIRE(times[6] == at(std::chrono::seconds(12)));
+  }
+  {
+    apex::MarketData md;
+    apex::Tickbin2FileReader reader(skew_fn, &md, apex::MdStream::L1);
+    reader.wind_forward(at(std::chrono::seconds(15)));
+    REQUIRE(reader.next_event_time() == at(std::chrono::seconds(20)));
+    reader.consume_next_event();
+    REQUIRE(md.bid() == 109.0);
+  }
+
+  // convert a tickbin1 trades file
+  auto v1_fn = dir / "trades.bin";
+  {
+    std::ofstream os(v1_fn, std::ios::binary);
+    auto preamble = apex::encode_tickbin_file_header("TICK1", {{"c", "aggtrades"}});
+    os.write(preamble.data(), preamble.size());
+    for (int i = 0; i < 5; i++) {
+      apex::TickTrade tick;
+      tick.price = 50.0 + i;
+      tick.qty = 0.5;
+      tick.et = at(std::chrono::milliseconds(i * 100));
+      tick.aggr_side = (i % 2) ? apex::Side::sell : apex::Side::buy;
+      auto bytes = apex::tickbin::Serialiser::serialise(
+          at(std::chrono::milliseconds(i * 100 + 7)), tick);
+      os.write(bytes.data(), bytes.size());
+    }
+  }
+  auto v2_fn = dir / "trades.bin2";
+  REQUIRE(apex::convert_tickbin1_to_tickbin2(v1_fn, v2_fn) == 5);
+  {
+    apex::MarketData md;
+    apex::Tickbin2FileReader reader(v2_fn, &md, apex::MdStream::AggTrades);
+    REQUIRE(reader.meta()["c"] == "aggtrades");
+    int count = 0;
+    while (reader.has_next_event()) {
+      reader.consume_next_event();
+      REQUIRE(md.last().price == 50.0 + count);
+      REQUIRE(md.last().et == at(std::chrono::milliseconds(count * 100)));
+      REQUIRE(md.last().aggr_side ==
+              ((count % 2) ? apex::Side::sell : apex::Side::buy));
+      count++;
+    }
+    REQUIRE(count == 5);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tickbin_serialiser")
+{
+  using apex::tickbin::Serialiser;
+  using apex::tickbin::View;
+
+  apex::Time at{std::chrono::microseconds(1700000000123456)};
+  char arena[2 * Serialiser::max_record_size + 1];
+
+  // records are written in place, at any alignment
+  apex::TickTop top;
+  top.bid_price = 99.5;
+  top.bid_qty = 2;
+  top.ask_price = 100.5;
+  top.ask_qty = 3;
+  apex::TickTrade trade;
+  trade.price = 100.25;
+  trade.qty = 0.5;
+  trade.et = at;
+  trade.aggr_side = apex::Side::sell;
+  size_t used = 1;
+  used += Serialiser::serialise(arena + used, at, top);
+  REQUIRE(used == 1 + Serialiser::record_size<apex::TickTop>);
+  used += Serialiser::serialise(arena + used, at, trade);
+  REQUIRE(used == 1 + Serialiser::record_size<apex::TickTop> +
+                      Serialiser::record_size<apex::TickTrade>);
+
+  // and read through views, without copying
+  apex::tickbin::Header head;
+  memcpy(&head, arena + 1, sizeof(head));
+  REQUIRE(View<apex::tickbin::TickLevel1>::matches(head));
+  REQUIRE(!View<apex::tickbin::TickAggTrade>::matches(head));
+  View<apex::tickbin::TickLevel1> l1(arena + 1);
+  REQUIRE(l1.capture_time() == 1700000000123456);
+  REQUIRE(l1->bid_price == 99.5);
+  REQUIRE(l1->ask_qty == 3);
+  View<apex::tickbin::TickAggTrade> agg(arena + 1 + l1.size);
+  REQUIRE(agg->side == 's');
+  REQUIRE(agg->et == 1700000000123456);
+
+  // deserialise decodes the same fields
+  apex::TickTop top2;
+  Serialiser::deserialise(arena + 1, top2);
+  REQUIRE((top2.bid_price == 99.5 && top2.ask_price == 100.5));
+  apex::TickTrade trade2;
+  Serialiser::deserialise(arena + 1 + l1.size, trade2);
+  REQUIRE((trade2.price == 100.25 && trade2.qty == 0.5));
+  REQUIRE(trade2.aggr_side == apex::Side::sell);
+  REQUIRE(trade2.et == at);
+
+  // the allocating form produces the same bytes
+  auto bytes = Serialiser::serialise(at, trade);
+  REQUIRE(bytes.size() == agg.size);
+  REQUIRE(memcmp(bytes.data(), arena + 1 + l1.size, bytes.size()) == 0);
+}
+
+
+TEST_CASE("tickbin_index")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tickbin_index_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  auto at = [](int i) {
+    return apex::Time{std::chrono::seconds(1700000000) + std::chrono::milliseconds(i)};
+  };
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::StreamInfo info{instrument, "l1"};
+  apex::TickFileBucketId bucketid{2023, 11, 14};
+
+  // write across two sessions, as the tick collector does
+  const int total = 20000;
+  for (int session = 0; session < 2; session++) {
+    apex::TickbinFileWriter writer(bucketid, dir, "BTCUSDT.bin", info);
+    for (int i = session * total / 2; i < (session + 1) * total / 2; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      tick.ask_price = i + 1;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+
+  auto fn = dir / "BTCUSDT.bin";
+  auto index_fn = apex::tickbin_index_path(fn);
+  auto entries = std::filesystem::file_size(index_fn) / sizeof(apex::tickbin::IndexEntry);
+  REQUIRE(entries > 3);
+
+  // a rebuilt index matches that written incrementally
+  REQUIRE(apex::build_tickbin_index(fn) == entries);
+
+  // wind forward lands on the first event at or after the seek time
+  for (int seek : {0, 5, 12345, total - 1}) {
+    apex::MarketData md;
+    apex::TickbinFileReader reader(fn, &md, apex::MdStream::L1);
+    reader.wind_forward(at(seek));
+    REQUIRE(reader.next_event_time() == at(seek));
+    reader.consume_next_event();
+    REQUIRE(md.bid() == seek);
+  }
+
+  // replay with a small paging window, so that pages behind the read position
+  // are released and prefetched many times over, and with the file populated
+  for (size_t populate : {size_t{0}, size_t{1} << 30}) {
+    apex::MmapOptions mmap;
+    mmap.window = 4096;
+    mmap.populate_max_size = populate;
+    apex::MarketData md;
+    apex::TickbinFileReader reader(fn, &md, apex::MdStream::L1, nullptr, mmap);
+    reader.wind_forward(at(100));
+    int i = 100;
+    while (reader.has_next_event()) {
+      reader.consume_next_event();
+      REQUIRE(md.bid() == i);
+      i++;
+    }
+    REQUIRE(i == total);
+  }
+
+  // a stale index is ignored
+  {
+    std::ofstream os(index_fn, std::ios::binary | std::ios::trunc);
+    apex::tickbin::IndexEntry bogus{12345, 90000};
+    os.write(reinterpret_cast<const char*>(&bogus), sizeof(bogus));
+  }
+  apex::TickbinFileReader reader(fn, nullptr, apex::MdStream::L1);
+  reader.wind_forward(at(7000));
+  REQUIRE(reader.next_event_time() == at(7000));
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tick_replay_filter")
+{
+  using namespace std::chrono_literals;
+
+  // windows wrapping midnight are split in two
+  auto wrapped = apex::TickFilter::parse({"23:00-01:00"}, 0us);
+  REQUIRE(wrapped.windows.size() == 2);
+  auto day = [](std::chrono::minutes m) {
+    return apex::Time{std::chrono::seconds(1699920000) + m};
+  };
+  REQUIRE(wrapped.admits(day(-30min)));
+  REQUIRE(wrapped.admits(day(30min)));
+  REQUIRE(!wrapped.admits(day(12h)));
+  REQUIRE(wrapped.next_admitted(day(12h)) == day(23h));
+
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tick_replay_filter_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  // 20 s of ticks, one per ms, from 22:13:20
+  auto at = [](int i) {
+    return apex::Time{std::chrono::seconds(1700000000) + std::chrono::milliseconds(i)};
+  };
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::StreamInfo info{instrument, "l1"};
+  const int total = 20000;
+  {
+    apex::TickbinFileWriter writer({2023, 11, 14}, dir, "BTCUSDT.bin", info);
+    for (int i = 0; i < total; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      tick.ask_price = i + 1;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+  auto fn = dir / "BTCUSDT.bin";
+
+  // the bids of the ticks a filter admits, read one event at a time
+  auto replay = [&](const apex::TickFilter& filter) {
+    std::vector<int> bids;
+    apex::MarketData md;
+    apex::TickbinFileReader reader(fn, &md, apex::MdStream::L1, nullptr, {},
+                                   filter);
+    while (reader.has_next_event()) {
+      reader.consume_next_event();
+      bids.push_back(static_cast<int>(md.bid()));
+    }
+    return bids;
+  };
+
+  auto windowed = replay(apex::TickFilter::parse({"22:13:25-22:13:30"}, 0us));
+  REQUIRE(windowed.size() == 5000);
+  REQUIRE(windowed.front() == 5000);
+  REQUIRE(windowed.back() == 9999);
+
+  // conflation keeps the last tick of each interval
+  auto conflated = replay(apex::TickFilter::parse({}, 100ms));
+  REQUIRE(conflated.size() == total / 100);
+  for (size_t i = 0; i < conflated.size(); i++)
+    REQUIRE(conflated[i] == static_cast<int>(i * 100 + 99));
+
+  auto both = replay(apex::TickFilter::parse({"22:13:25-22:13:30"}, 100ms));
+  REQUIRE(both.size() == 50);
+  REQUIRE(both.front() == 5099);
+
+  // batched consumption stops at the end of each window, and skips the gap
+  struct ReaderSource : apex::BacktestEventSource {
+    apex::TickbinFileReader& reader;
+    size_t events = 0;
+    explicit ReaderSource(apex::TickbinFileReader& reader) : reader(reader) {}
+    apex::Time get_next_event_time() override
+    {
+      return reader.next_event_time();
+    }
+    void consume_next_event() override
+    {
+      reader.consume_next_event();
+      ++events;
+    }
+    size_t consume_events(apex::BacktestBatch& batch) override
+    {
+      auto count = reader.consume_events(batch);
+      events += count;
+      return count;
+    }
+    void init_backtest_time_range(apex::Time, apex::Time) override {}
+  };
+  apex::MarketData md;
+  apex::TickbinFileReader reader(
+      fn, &md, apex::MdStream::L1, nullptr, {},
+      apex::TickFilter::parse({"22:13:21-22:13:22", "22:13:30-22:13:31"}, 0us));
+  apex::BacktestEventLoop evloop(at(0));
+  evloop.set_time(at(0));
+  apex::BacktestEventLoop::ProgressOptions options;
+  options.interval = std::chrono::milliseconds(0);
+  evloop.set_progress_options(options);
+  ReaderSource source(reader);
+  evloop.add_event_source(&source);
+  evloop.run_loop(at(total));
+  REQUIRE(source.events == 2000);
+  REQUIRE(md.bid() == 10999);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tardis_read_ahead")
+{
+  auto fn = std::filesystem::temp_directory_path() /
+    ("apex_tardis_" + std::to_string(::getpid()) + ".csv.gz");
+
+  // enough rows to span several read buffers & read-ahead chunks
+  const long t0 = 1700000000000000;
+  const int rows = 30000;
+  {
+    gzFile gz = gzopen(fn.c_str(), "wb");
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp,id,side,price,amount\n");
+    for (int i = 0; i < rows; i++)
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,%d,%s,%d.5,0.25\n", t0 + i * 1000,
+               t0 + i * 1000 + 10, i, (i % 2) ? "sell" : "buy", i);
+    gzclose(gz);
+  }
+
+  for (bool read_ahead : {false, true}) {
+    apex::MarketData md;
+    apex::TardisFileReader reader(fn, &md, apex::MdStream::Trades,
+                                  apex::TardisFileReader::DataType::trades,
+                                  read_ahead);
+
+    reader.wind_forward(apex::Time{std::chrono::microseconds(t0 + 2500 * 1000)});
+    int i = 2500;
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() ==
+              apex::Time{std::chrono::microseconds(t0 + i * 1000)});
+      reader.consume_next_event();
+      REQUIRE(md.last().price == i + 0.5);
+      REQUIRE(md.last().aggr_side ==
+              ((i % 2) ? apex::Side::sell : apex::Side::buy));
+      i++;
+    }
+    REQUIRE(i == rows);
+  }
+
+  // a reader destroyed before the file is consumed stops its thread
+  {
+    apex::TardisFileReader reader(fn, nullptr, apex::MdStream::Trades,
+                                  apex::TardisFileReader::DataType::trades,
+                                  true);
+    REQUIRE(reader.has_next_event());
+  }
+
+  std::filesystem::remove(fn);
+}
+
+
+TEST_CASE("tardis_incremental_book")
+{
+  auto fn = std::filesystem::temp_directory_path() /
+    ("apex_tardis_l2_" + std::to_string(::getpid()) + ".csv.gz");
+
+  // a snapshot of ten levels a side, then messages of two rows, mostly deep
+  // in the book; every 100th changes the touch, and every 100th, offset by
+  // 50, the fourth level
+  const long t0 = 1700000000000000;
+  const int messages = 20000;
+  {
+    gzFile gz = gzopen(fn.c_str(), "wb");
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp,is_snapshot,side,"
+                 "price,amount\n");
+    for (int i = 0; i < 10; i++) {
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,true,bid,%d,1\n", t0, t0 + 10,
+               100 - i);
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,true,ask,%d,1\n", t0, t0 + 10,
+               101 + i);
+    }
+    for (int i = 1; i <= messages; i++) {
+      const long t = t0 + i * 1000;
+      int price = (i % 100 == 0) ? 100 : (i % 100 == 50) ? 97 : 92;
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,false,bid,%d,%d\n", t, t + 10,
+               price, i);
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld,false,ask,%d,%d\n", t, t + 10,
+               201 - price, i);
+    }
+    gzclose(gz);
+  }
+
+  for (bool read_ahead : {false, true}) {
+    apex::MarketData md;
+    md.set_book_event_depth(5);
+    int tops = 0;
+    int books = 0;
+    md.subscribe_events([&](apex::MarketData::EventType ev) {
+      tops += ev.is_top();
+      books++;
+    }, apex::MarketData::EventType::top | apex::MarketData::EventType::full_book);
+
+    apex::TardisFileReader reader(
+        fn, &md, apex::MdStream::L3,
+        apex::TardisFileReader::DataType::incremental_book_L2, read_ahead);
+    int events = 0;
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() ==
+              apex::Time{std::chrono::microseconds(t0 + events * 1000)});
+      reader.consume_next_event();
+      events++;
+    }
+
+    // the last message, ending the file, is read too
+    REQUIRE(events == messages + 1);
+    REQUIRE(md.book().bid_depth() == 10);
+    REQUIRE(md.book().ask_depth() == 10);
+    REQUIRE(md.l1_bid().price == 100);
+    REQUIRE(md.l1_bid().qty == messages);
+    REQUIRE(md.book().bid(8).qty == messages - 1);
+    REQUIRE(md.book().ask(0).qty == messages);
+
+    // the snapshot, and the messages that changed the top five levels
+    REQUIRE(tops == 1 + messages / 100);
+    REQUIRE(books == 1 + 2 * messages / 100);
+  }
+
+  std::filesystem::remove(fn);
+}
+
+
+TEST_CASE("async_buffered_file_reader")
+{
+  struct StringFile {
+    std::string content;
+    size_t pos = 0;
+    bool is_open() const { return true; }
+    bool is_eof() const { return pos == content.size(); }
+    size_t read(char* buf, size_t len) {
+      len = std::min(len, content.size() - pos);
+      memcpy(buf, content.data() + pos, len);
+      pos += len;
+      return len;
+    }
+  };
+
+  // lines of varied length, some longer than the headroom
+  StringFile file;
+  std::vector<std::string> lines;
+  for (int i = 0; i < 5000; i++) {
+    lines.push_back(std::to_string(i) + std::string(i % 97, 'x'));
+    file.content += lines.back() + "\n";
+  }
+
+  apex::AsyncBufferedFileReader<StringFile> reader(file, 1000, 3, 32);
+  auto next_line = [&](std::string& line) {
+    while (true) {
+      auto* nl = static_cast<char*>(memchr(reader.data(), '\n', reader.avail()));
+      if (nl) {
+        line.assign(reader.data(), nl);
+        reader.discard(nl + 1 - reader.data());
+        return true;
+      }
+      if (reader.read() == 0)
+        return false;
+    }
+  };
+
+  std::string line;
+  size_t count = 0;
+  while (next_line(line)) {
+    REQUIRE(line == lines[count]);
+    count++;
+  }
+  REQUIRE(count == lines.size());
+
+  // after a reset, reading resumes from the repositioned file
+  reader.reset();
+  file.pos = file.content.find("\n4000") + 1;
+  count = 4000;
+  while (next_line(line)) {
+    REQUIRE(line == lines[count]);
+    count++;
+  }
+  REQUIRE(count == lines.size());
+}
+
+
+TEST_CASE("gz_index")
+{
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() /
+    ("apex_gz_index_" + std::to_string(::getpid()));
+  auto fn = dir / "trades.csv.gz";
+  fs::create_directories(dir);
+
+  // enough rows for a couple of access points at the default span
+  const long t0 = 1700000000000000;
+  const int rows = 300000;
+  std::string content =
+    "exchange,symbol,timestamp,local_timestamp,id,side,price,amount\n";
+  for (int i = 0; i < rows; i++) {
+    char line[128];
+    snprintf(line, sizeof line, "binance,BTCUSDT,%ld,%ld,%d,%s,%d.5,0.25\n",
+             t0 + i * 1000L, t0 + i * 1000L + 10, i, (i % 2) ? "sell" : "buy",
+             i);
+    content += line;
+  }
+  {
+    gzFile gz = gzopen(fn.c_str(), "wb");
+    gzwrite(gz, content.data(), content.size());
+    gzclose(gz);
+  }
+
+  auto read_all = [](apex::GzFile& file) {
+    std::string out;
+    char buf[70000];
+    while (size_t n = file.read(buf, sizeof buf))
+      out.append(buf, n);
+    return out;
+  };
+
+  // the first complete read builds the index
+  apex::GzFile::Options options;
+  options.indexed = true;
+  options.index_span = 100000;
+  {
+    apex::GzFile file;
+    file.open(fn, options);
+    REQUIRE(file.seek_points().empty());
+    REQUIRE(read_all(file) == content);
+    REQUIRE(file.is_eof());
+    REQUIRE(!file.is_bad());
+  }
+  REQUIRE(fs::exists(apex::gz_index_path(fn)));
+
+  // later opens can resume at any access point
+  {
+    apex::GzFile file;
+    file.open(fn, options);
+    auto points = file.seek_points();
+    REQUIRE(points.size() > 10);
+    for (size_t i : {points.size() - 1, size_t{0}, points.size() / 2}) {
+      file.seek(i);
+      REQUIRE(file.tell() == points[i]);
+      char buf[1000];
+      REQUIRE(file.read(buf, sizeof buf) == sizeof buf);
+      REQUIRE(std::string(buf, sizeof buf) == content.substr(points[i], 1000));
+    }
+    file.seek(points.size() / 2);
+    REQUIRE(read_all(file) == content.substr(points[points.size() / 2]));
+    REQUIRE(file.is_eof());
+  }
+
+  // Tardis readers index the file at the default span, and later wind
+  // forward by access point
+  fs::remove(apex::gz_index_path(fn));
+  {
+    apex::TardisFileReader reader(fn, nullptr, apex::MdStream::Trades,
+                                  apex::TardisFileReader::DataType::trades);
+    apex::TardisEvent event;
+    while (reader.has_next_event())
+      reader.consume_next_event(event);
+  }
+  REQUIRE(fs::exists(apex::gz_index_path(fn)));
+
+  for (bool read_ahead : {false, true}) {
+    apex::MarketData md;
+    apex::TardisFileReader reader(fn, &md, apex::MdStream::Trades,
+                                  apex::TardisFileReader::DataType::trades,
+                                  read_ahead);
+    const int start = rows - 1000;
+    reader.wind_forward(apex::Time{std::chrono::microseconds(t0 + start * 1000L)});
+    int i = start;
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() ==
+              apex::Time{std::chrono::microseconds(t0 + i * 1000L)});
+      reader.consume_next_event();
+      REQUIRE(md.last().price == i + 0.5);
+      i++;
+    }
+    REQUIRE(i == rows);
+  }
+
+  // a stale index is ignored, and rebuilt
+  fs::last_write_time(fn, fs::last_write_time(fn) + std::chrono::seconds(1));
+  {
+    apex::GzFile file;
+    file.open(fn, options);
+    REQUIRE(file.seek_points().empty());
+    REQUIRE(read_all(file) == content);
+    file.close();
+    file.open(fn, options);
+    REQUIRE(!file.seek_points().empty());
+  }
+
+  fs::remove_all(dir);
+}
+
+
+TEST_CASE("tardis_tickbin2_cache")
+{
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() /
+    ("apex_tardis_cache_" + std::to_string(::getpid()));
+  auto fn = dir / "BTCUSDT.csv.gz";
+  fs::create_directories(dir);
+
+  const long t0 = 1700000000000000;
+  const int rows = 5000;
+  {
+    gzFile gz = gzopen(fn.c_str(), "wb");
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp");
+    for (int level = 0; level < 5; level++)
+      gzprintf(gz, ",asks[%d].price,asks[%d].amount,bids[%d].price,bids[%d].amount",
+               level, level, level, level);
+    gzprintf(gz, "\n");
+    for (int i = 0; i < rows; i++) {
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld", t0 + i * 1000, t0 + i * 1000 + 10);
+      for (int level = 0; level < 5; level++)
+        gzprintf(gz, ",%d.5,%d,%d.25,%d", 1000 + i + level, level + 1,
+                 1000 + i - level, level + 2);
+      gzprintf(gz, "\n");
+    }
+    gzclose(gz);
+  }
+
+  auto cache_dir = dir / "cache";
+  auto datatype = apex::TardisFileReader::DataType::book_snapshot_5;
+  auto cached = apex::tardis_cached_tickbin2(cache_dir, fn, datatype);
+  REQUIRE(fs::exists(cached));
+  auto write_time = fs::last_write_time(cached);
+
+  // a second lookup is served from the cache
+  REQUIRE(apex::tardis_cached_tickbin2(cache_dir, fn, datatype) == cached);
+  REQUIRE(fs::last_write_time(cached) == write_time);
+
+  // replay of the cached file matches the direct CSV replay
+  apex::MarketData csv_md;
+  apex::MarketData bin_md;
+  apex::TardisFileReader csv_reader(fn, &csv_md, apex::MdStream::L1, datatype);
+  apex::Tickbin2FileReader bin_reader(cached, &bin_md, apex::MdStream::L1);
+  REQUIRE(bin_reader.layout() == apex::tickbin2::Layout::Book5);
+
+  int count = 0;
+  while (csv_reader.has_next_event()) {
+    REQUIRE(bin_reader.has_next_event());
+    REQUIRE(bin_reader.next_event_time() == csv_reader.next_event_time());
+    csv_reader.consume_next_event();
+    bin_reader.consume_next_event();
+    REQUIRE(bin_md.bid() == csv_md.bid());
+    REQUIRE(bin_md.ask() == csv_md.ask());
+    count++;
+  }
+  REQUIRE(count == rows);
+  REQUIRE(!bin_reader.has_next_event());
+
+  fs::remove_all(dir);
+}
+
+
+TEST_CASE("book_snapshot_25")
+{
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() /
+    ("apex_book25_" + std::to_string(::getpid()));
+  auto fn = dir / "BTCUSDT.csv.gz";
+  fs::create_directories(dir);
+
+  // the touch moves every row, deeper levels only every tenth row
+  const long t0 = 1700000000000000;
+  const int rows = 3000;
+  {
+    gzFile gz = gzopen(fn.c_str(), "wb");
+    gzprintf(gz, "exchange,symbol,timestamp,local_timestamp");
+    for (int level = 0; level < 25; level++)
+      gzprintf(gz, ",asks[%d].price,asks[%d].amount,bids[%d].price,bids[%d].amount",
+               level, level, level, level);
+    gzprintf(gz, "\n");
+    for (int i = 0; i < rows; i++) {
+      gzprintf(gz, "binance,BTCUSDT,%ld,%ld", t0 + i * 1000, t0 + i * 1000 + 10);
+      for (int level = 0; level < 25; level++) {
+        int step = level ? i / 10 : i;
+        gzprintf(gz, ",%d.5,%d,%d.25,%d", 1000 + step + level, level + 1,
+                 1000 + step - level, level + 2);
+      }
+      gzprintf(gz, "\n");
+    }
+    gzclose(gz);
+  }
+
+  auto datatype = apex::TardisFileReader::DataType::book_snapshot_25;
+  auto bin = dir / "BTCUSDT.bin2";
+  apex::Tickbin2FileWriter::Options options;
+  options.block_records = 256;
+  REQUIRE(apex::convert_tardis_to_tickbin2(fn, bin, datatype, options) == rows);
+
+  // only the changed levels are stored
+  REQUIRE(fs::file_size(bin) < rows * sizeof(apex::TickBookSnapshot25::levels) / 10);
+
+  auto same_book = [](const apex::MarketData& lhs, const apex::MarketData& rhs) {
+    auto& x = lhs.book();
+    auto& y = rhs.book();
+    if (x.bid_depth() != 25 || y.bid_depth() != 25 || x.ask_depth() != 25 ||
+        y.ask_depth() != 25)
+      return false;
+    for (size_t i = 0; i < 25; i++)
+      if (x.bid(i).price != y.bid(i).price || x.bid(i).qty != y.bid(i).qty ||
+          x.ask(i).price != y.ask(i).price || x.ask(i).qty != y.ask(i).qty)
+        return false;
+    return true;
+  };
+
+  // replay of the tickbin2 file matches the direct CSV replay, level by level
+  {
+    apex::MarketData csv_md;
+    apex::MarketData bin_md;
+    int deep_events = 0;
+    bin_md.subscribe_events([&](apex::MarketData::EventType event) {
+      deep_events += event.is_deep_book();
+    });
+    apex::TardisFileReader csv_reader(fn, &csv_md, apex::MdStream::L2, datatype);
+    apex::Tickbin2FileReader bin_reader(bin, &bin_md, apex::MdStream::L2);
+    REQUIRE(bin_reader.layout() == apex::tickbin2::Layout::Book25);
+    REQUIRE(bin_reader.block_count() > 1);
+
+    int count = 0;
+    while (csv_reader.has_next_event()) {
+      REQUIRE(bin_reader.has_next_event());
+      REQUIRE(bin_reader.next_event_time() == csv_reader.next_event_time());
+      csv_reader.consume_next_event();
+      bin_reader.consume_next_event();
+      REQUIRE(same_book(csv_md, bin_md));
+      REQUIRE(bin_md.bid() == csv_md.bid());
+      count++;
+    }
+    REQUIRE(count == rows);
+    REQUIRE(deep_events == rows);
+  }
+
+  // after a wind-forward, within a block, the next snapshot is complete
+  {
+    apex::MarketData csv_md;
+    apex::MarketData bin_md;
+    apex::TardisFileReader csv_reader(fn, &csv_md, apex::MdStream::L2, datatype);
+    apex::Tickbin2FileReader bin_reader(bin, &bin_md, apex::MdStream::L2);
+    apex::Time seek{std::chrono::microseconds(t0 + 1234 * 1000)};
+    csv_reader.wind_forward(seek);
+    bin_reader.wind_forward(seek);
+    REQUIRE(bin_reader.next_event_time() == seek);
+    csv_reader.consume_next_event();
+    bin_reader.consume_next_event();
+    REQUIRE(same_book(csv_md, bin_md));
+  }
+
+  // a snapshot flagging one changed level only copies that level
+  apex::Book book;
+  apex::TickBookSnapshot25 snapshot;
+  for (int i = 0; i < 25; i++)
+    snapshot.levels[i] = {100.0 - i, 1, 101.0 + i, 1};
+  book.apply(snapshot);
+  snapshot.levels[3].bid_qty = 7;
+  snapshot.levels[4].bid_qty = 9;
+  snapshot.changed = 1u << 3;
+  book.apply(snapshot);
+  REQUIRE(book.bid(3).qty == 7);
+  REQUIRE(book.bid(4).qty == 1);
+
+  fs::remove_all(dir);
+}
+
+
+TEST_CASE("csv_scan")
+{
+  // fields spanning several vector blocks, with empty fields and a tail
+  std::string line = "binance,BTCUSDT,1700000000000000,,37000.5,0.001,"
+                     "36999.25,12.75,tail";
+  for (auto split : {apex::csv::split_fields, apex::csv::split_fields_scalar}) {
+    std::string text = line;
+    char* fields[8];
+    auto count = split(text.data(), text.data() + text.size(), ',', fields, 8);
+    REQUIRE(count == 8);
+    REQUIRE(std::string(fields[2]) == "1700000000000000");
+    REQUIRE(std::string(fields[3]).empty());
+    REQUIRE(std::string(fields[7]) == "12.75");
+
+    // too many fields is reported
+    text = line;
+    REQUIRE(split(text.data(), text.data() + text.size(), ',', fields, 4) == 5);
+  }
+
+  // the fast decimal parser agrees exactly with strtod
+  std::mt19937 gen(42);
+  for (int i = 0; i < 100000; i++) {
+    auto whole = gen() % 100000;
+    auto frac = gen() % 100000000;
+    char text[64];
+    snprintf(text, sizeof(text), "%s%u.%08u", (i % 3) ? "" : "-",
+             unsigned(whole), unsigned(frac));
+    double value;
+    REQUIRE(apex::csv::parse_decimal(text, value));
+    REQUIRE(value == strtod(text, nullptr));
+  }
+  double value;
+  REQUIRE(!apex::csv::parse_decimal("1e-5", value));
+  REQUIRE(!apex::csv::parse_decimal("", value));
+  REQUIRE(!apex::csv::parse_decimal("1234567890.1234567", value));
+
+  uint64_t t;
+  REQUIRE(apex::csv::parse_uint("1700000000000000", t));
+  REQUIRE(t == 1700000000000000ULL);
+  REQUIRE(!apex::csv::parse_uint("17x", t));
+}
+
+
+TEST_CASE("cpu_dispatch")
+{
+  const auto& features = apex::cpu_features();
+  if (features.best == apex::Isa::avx512)
+    REQUIRE((features.avx2 && features.avx512f && features.avx512bw));
+  if (features.best >= apex::Isa::avx2)
+    REQUIRE(features.avx2);
+  REQUIRE(apex::dispatch_isa() <= features.best);
+
+  // the best variant allowed is chosen, and recorded
+  using Fn = int (*)();
+  auto chosen = apex::select_kernel<Fn>(
+      "test_kernel", {{apex::Isa::avx512, []() { return 3; }},
+                      {apex::Isa::avx2, []() { return 2; }},
+                      {apex::Isa::sse2, []() { return 1; }},
+                      {apex::Isa::scalar, []() { return 0; }}});
+  REQUIRE(chosen.isa == apex::dispatch_isa());
+  REQUIRE(chosen.fn() == static_cast<int>(apex::dispatch_isa()));
+
+  // kernels are selected as the program loads
+  std::map<std::string, apex::Isa> selected;
+  for (auto& selection : apex::kernel_selections())
+    selected[selection.kernel] = selection.isa;
+  REQUIRE(selected.count("csv_split") == 1);
+  REQUIRE(selected.count("ws_mask") == 1);
+  REQUIRE(selected["test_kernel"] == chosen.isa);
+  REQUIRE(std::string(apex::to_string(selected["csv_split"])) ==
+          apex::csv::split_fields_isa());
+
+  // the selected splitter agrees with the scalar one over many vector blocks
+  std::string line;
+  for (int i = 0; i < 100; i++)
+    line += std::string(i % 7, 'x') + ",";
+  std::string fast = line, slow = line;
+  char* fast_fields[100];
+  char* slow_fields[100];
+  REQUIRE(apex::csv::split_fields(fast.data(), fast.data() + fast.size(), ',',
+                                  fast_fields, 100) == 100);
+  REQUIRE(apex::csv::split_fields_scalar(slow.data(),
+                                         slow.data() + slow.size(), ',',
+                                         slow_fields, 100) == 100);
+  for (int i = 0; i < 100; i++)
+    REQUIRE(fast_fields[i] - fast.data() == slow_fields[i] - slow.data());
+}
+
+
+TEST_CASE("tick_replayer_prefetch")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_replayer_prefetch_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::StreamInfo info{instrument, "l1"};
+  auto base = dir / "tickbin1" / instrument.exchange_name() / "l1";
+
+  // one file per day, with a day missing; ticks are numbered across days
+  const int per_day = 1000;
+  std::list<apex::Time> dates;
+  for (int day = 0; day < 4; day++) {
+    apex::Time date{std::chrono::seconds(1700006400 + day * 86400)};
+    dates.push_back(date);
+    if (day == 2)
+      continue;
+    auto bucketid = apex::TickFileBucketId::from_time(date);
+    auto day_dir = base / date.strftime("%Y") / date.strftime("%m") /
+      date.strftime("%d");
+    apex::TickbinFileWriter writer(bucketid, day_dir, "BTCUSDT.bin", info);
+    for (int i = 0; i < per_day; i++) {
+      apex::TickTop tick;
+      tick.bid_price = day * per_day + i;
+      auto t = apex::Time{date.as_epoch_us() + std::chrono::seconds(i)};
+      auto bytes = apex::tickbin::Serialiser::serialise(t, tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+
+  for (bool prefetch : {false, true}) {
+    apex::TickReplayOptions options;
+    options.prefetch_next_file = prefetch;
+    apex::MarketData md;
+    apex::TickReplayer replayer(dir, apex::TickFormat::tickbin1, instrument,
+                                &md, apex::MdStream::L1, dates.front(), dates,
+                                options);
+    REQUIRE(replayer.file_count() == 3);
+
+    std::vector<double> bids;
+    while (replayer.get_next_event_time() != apex::Time{}) {
+      replayer.consume_next_event();
+      bids.push_back(md.bid());
+    }
+    REQUIRE(bids.size() == 3 * per_day);
+    REQUIRE(bids[0] == 0);
+    REQUIRE(bids[per_day] == per_day);
+    REQUIRE(bids[2 * per_day] == 3 * per_day);
+    REQUIRE(bids.back() == 4 * per_day - 1);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tick_merge")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tick_merge_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  auto at = [](int ms) {
+    return apex::Time{std::chrono::seconds(1700000000) + std::chrono::milliseconds(ms)};
+  };
+
+  // the shard of a stream is stable, and spread over the shards
+  std::set<size_t> shards;
+  for (auto symbol : {"BTCUSDT", "ETHUSDT", "ETHBTC", "BNBUSDT", "ADAUSDT",
+                      "XRPUSDT", "SOLUSDT", "DOGEUSDT"}) {
+    auto shard = apex::tick_stream_shard("binance", symbol, "l1", 4);
+    REQUIRE(shard < 4);
+    REQUIRE(shard == apex::tick_stream_shard("binance", symbol, "l1", 4));
+    shards.insert(shard);
+  }
+  REQUIRE(shards.size() > 1);
+  REQUIRE(apex::tick_stream_shard("binance", "BTCUSDT", "l1", 1) == 0);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::StreamInfo info{instrument, "l1"};
+  apex::TickFileBucketId bucketid{2023, 11, 14};
+  auto rel = std::filesystem::path("binance") / "l1" / "2023" / "11" / "14";
+
+  // two shards collect the stream redundantly, each with a gap: ticks 0-599
+  // and 400-999, so 400-599 are held by both
+  auto write = [&](const std::filesystem::path& root, const std::string& name,
+                   int from, int to) {
+    apex::TickbinFileWriter writer(bucketid, root / rel, name, info);
+    for (int i = from; i < to; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  };
+  write(dir / "a", "BTCUSDT.bin", 0, 600);
+  write(dir / "b", "BTCUSDT.bin", 400, 1000);
+  write(dir / "b", "ETHUSDT.bin", 0, 10); // of one shard only
+
+  auto roots = std::vector<std::filesystem::path>{dir / "a", dir / "b"};
+  auto dest = dir / "merged";
+
+  auto verify = apex::merge_tick_trees(roots, dest, true);
+  REQUIRE(verify.errors.empty());
+  REQUIRE(verify.files_merged == 1);
+  REQUIRE(verify.files_copied == 1);
+  REQUIRE(!std::filesystem::exists(dest));
+
+  auto stats = apex::merge_tick_trees(roots, dest, false);
+  REQUIRE(stats.errors.empty());
+  REQUIRE(stats.files_merged == 1);
+  REQUIRE(stats.files_copied == 1);
+  REQUIRE(stats.records == 1000);
+  REQUIRE(stats.duplicates == 200);
+  REQUIRE(std::filesystem::exists(dest / rel / "ETHUSDT.bin"));
+
+  auto fn = dest / rel / "BTCUSDT.bin";
+  REQUIRE(std::filesystem::exists(apex::tickbin_index_path(fn)));
+  apex::MarketData md;
+  apex::TickbinFileReader reader(fn, &md, apex::MdStream::L1);
+  int i = 0;
+  while (reader.has_next_event()) {
+    REQUIRE(reader.next_event_time() == at(i));
+    reader.consume_next_event();
+    REQUIRE(md.bid() == i);
+    i++;
+  }
+  REQUIRE(i == 1000);
+
+  // merging again into the result changes nothing
+  auto again = apex::merge_tick_trees(roots, dest, false);
+  REQUIRE(again.errors.empty());
+  REQUIRE(again.records == 1000);
+  REQUIRE(again.duplicates == 1200);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tickbin_mixed")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tickbin_mixed_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::Time date{std::chrono::seconds(1700006400)};
+  auto bucketid = apex::TickFileBucketId::from_time(date);
+  auto day_path = [&](const std::string& stream) {
+    return dir / "tickbin1" / instrument.exchange_name() / stream /
+      date.strftime("%Y") / date.strftime("%m") / date.strftime("%d");
+  };
+  auto at = [&](int ms) {
+    return apex::Time{date.as_epoch_us() + std::chrono::milliseconds(ms)};
+  };
+
+  // tops on even, trades on odd milliseconds
+  const int total = 2000;
+  {
+    apex::TickbinFileWriter l1(bucketid, day_path("l1"), "BTCUSDT.bin",
+                               {instrument, "l1"});
+    apex::TickbinFileWriter trades(bucketid, day_path("aggtrades"),
+                                   "BTCUSDT.bin", {instrument, "aggtrades"});
+    for (int i = 0; i < total; i++) {
+      if (i % 2 == 0) {
+        apex::TickTop tick;
+        tick.bid_price = i;
+        tick.ask_price = i + 1;
+        auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+        l1.write_bytes(bytes.data(), bytes.size());
+      }
+      else {
+        apex::TickTrade tick;
+        tick.price = i;
+        tick.qty = 1;
+        tick.aggr_side = apex::Side::buy;
+        auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+        trades.write_bytes(bytes.data(), bytes.size());
+      }
+    }
+  }
+
+  auto mixed_fn = day_path(apex::tickbin_mixed_channel) / "BTCUSDT.bin";
+  REQUIRE(apex::interleave_tickbin_streams(
+              {day_path("l1") / "BTCUSDT.bin",
+               day_path("aggtrades") / "BTCUSDT.bin"},
+              mixed_fn) == total);
+
+  // both streams are replayed by one replayer, in capture time order
+  apex::MarketData md;
+  std::vector<int> events;
+  md.subscribe_events([&](apex::MarketData::EventType et) {
+    if (et.is_top())
+      events.push_back(static_cast<int>(md.bid()));
+    else if (et.is_trade())
+      events.push_back(static_cast<int>(md.last().price));
+  });
+  apex::TickReplayer replayer(dir, apex::TickFormat::tickbin1, instrument,
+                              &md, apex::tickbin_mixed_streams, date, {date},
+                              {});
+  REQUIRE(replayer.file_count() == 1);
+  while (replayer.get_next_event_time() != apex::Time{})
+    replayer.consume_next_event();
+  REQUIRE(events.size() == total);
+  for (int i = 0; i < total; i++)
+    REQUIRE(events[i] == i);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("universe_tick_file")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_universe_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  auto at = [](int ms) {
+    return apex::Time{std::chrono::seconds(1700000000) + std::chrono::milliseconds(ms)};
+  };
+  apex::TickFileBucketId bucketid{2023, 11, 14};
+
+  auto make_instrument = [](const std::string& base) {
+    return apex::Instrument(apex::InstrumentType::coinpair, base + "USDT.BNC",
+                            {base, "binance", 8}, {"USDT", "binance", 8},
+                            base + "USDT", "binance");
+  };
+  auto btc = make_instrument("BTC");
+  auto eth = make_instrument("ETH");
+
+  // three streams, with interleaved times; ties occur between the L1 streams
+  const int count = 1000;
+  std::vector<std::filesystem::path> inputs;
+  for (auto* instrument : {&btc, &eth}) {
+    auto name = instrument->native_symbol() + ".bin";
+    apex::TickbinFileWriter writer(bucketid, dir / "l1", name, {*instrument, "l1"});
+    for (int i = 0; i < count; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(2 * i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+    inputs.push_back(dir / "l1" / name);
+  }
+  {
+    apex::TickbinFileWriter writer(bucketid, dir / "aggtrades", "BTCUSDT.bin",
+                                   {btc, "aggtrades"});
+    for (int i = 0; i < count; i++) {
+      apex::TickTrade tick;
+      tick.price = i;
+      tick.qty = 1;
+      tick.aggr_side = apex::Side::buy;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(2 * i + 1), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+    inputs.push_back(dir / "aggtrades" / "BTCUSDT.bin");
+  }
+
+  auto fn = dir / "universe.bin";
+  REQUIRE(apex::build_universe_tick_file(inputs, fn) == 3 * count);
+
+  // replay the BTC streams only, from part way through
+  apex::MarketData btc_md;
+  apex::UniverseTickReplayer replayer(fn, at(100));
+  REQUIRE(replayer.stream_count() == 3);
+  REQUIRE(replayer.subscribe(btc.id(), apex::MdStream::L1, &btc_md));
+  REQUIRE(replayer.subscribe(btc.id(), apex::MdStream::AggTrades, &btc_md));
+  REQUIRE(!replayer.subscribe(eth.id(), apex::MdStream::AggTrades, &btc_md));
+
+  int events = 0;
+  apex::Time prev;
+  for (apex::Time t; (t = replayer.get_next_event_time()) != apex::Time{};) {
+    REQUIRE(t >= at(100));
+    REQUIRE(t >= prev);
+    replayer.consume_next_event();
+    int ms = events + 100;
+    if (ms % 2)
+      REQUIRE(btc_md.last().price == ms / 2);
+    else
+      REQUIRE(btc_md.bid() == ms / 2);
+    prev = t;
+    events++;
+  }
+  REQUIRE(events == 2 * count - 100);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("async_tickbin_writer")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_async_writer_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  auto path_fn = [&](const apex::StreamInfo& info,
+                     const apex::TickFileBucketId& bucketid) {
+    return std::make_pair(dir / bucketid.as_string(),
+                          std::filesystem::path(info.channel + ".bin"));
+  };
+
+  // a tiny arena forces frequent hand-overs and growth; ticks span midnight
+  const int count = 20000;
+  const apex::Time midnight{std::chrono::seconds(1700006400)};
+  auto at = [&](int i) {
+    return apex::Time{midnight.as_epoch_us() + std::chrono::milliseconds(i - count / 2)};
+  };
+  {
+    apex::AsyncTickbinWriter::Options options;
+    options.arena_size = 1024;
+    options.fsync_interval = std::chrono::milliseconds(10);
+    apex::AsyncTickbinWriter writer(path_fn, {}, options);
+    auto* l1 = writer.add_stream({instrument, "l1"});
+    auto* trades = writer.add_stream({instrument, "aggtrades"});
+    for (int i = 0; i < count; i++) {
+      apex::TickTop top;
+      top.bid_price = i;
+      l1->write(at(i), top);
+      apex::TickTrade trade;
+      trade.price = i;
+      trade.et = at(i);
+      trades->write(at(i), trade);
+      if (i % 1000 == 0)
+        writer.flush();
+    }
+    REQUIRE(writer.stats().records == 2 * count);
+  }
+
+  // each day's file holds its ticks, in order
+  for (auto* channel : {"l1", "aggtrades"}) {
+    int i = 0;
+    for (auto* day : {"20231114", "20231115"}) {
+      apex::MarketData md;
+      auto stream = std::string(channel) == "l1" ? apex::MdStream::L1
+                                                 : apex::MdStream::AggTrades;
+      apex::TickbinFileReader reader(dir / day / (std::string(channel) + ".bin"),
+                                     &md, stream);
+      while (reader.has_next_event()) {
+        REQUIRE(reader.next_event_time() == at(i));
+        reader.consume_next_event();
+        REQUIRE((stream == apex::MdStream::L1 ? md.bid() : md.last().price) == i);
+        i++;
+      }
+      REQUIRE(i == (std::string(day) == "20231114" ? count / 2 : count));
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("bar_file")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_bar_file_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  auto path_fn = [&](const apex::StreamInfo& info,
+                     const apex::TickFileBucketId& bucketid) {
+    return std::make_pair(dir / bucketid.as_string(),
+                          std::filesystem::path(info.channel + ".bin"));
+  };
+
+  // a trade and a quote every second for three minutes, the price rising
+  const apex::Time start{std::chrono::seconds(1700006400)};
+  auto at = [&](int i) {
+    return apex::Time{start.as_epoch_us() + std::chrono::seconds(i)};
+  };
+  {
+    apex::AsyncTickbinWriter writer(path_fn, {}, {});
+    auto* l1 = writer.add_stream({instrument, "l1"});
+    auto* trades = writer.add_stream({instrument, "aggtrades"});
+    for (int i = 0; i < 180; i++) {
+      apex::TickTop top;
+      top.bid_price = 100 + i;
+      top.ask_price = 101 + i + (i % 2);
+      l1->write(at(i), top);
+      apex::TickTrade trade;
+      trade.price = 100 + i;
+      trade.qty = 1 + (i % 3);
+      trade.et = at(i);
+      trades->write(at(i), trade);
+    }
+  }
+
+  auto day = dir / "20231115";
+  auto fn = dir / "bars" / "BTCUSDT.bars";
+  auto count = apex::build_bar_file({day / "aggtrades.bin", day / "l1.bin"},
+                                    std::chrono::seconds(60), fn);
+  REQUIRE(count == 3);
+
+  std::vector<apex::Bar> bars;
+  apex::BarReplayer replayer({fn}, at(60),
+                             [&](const apex::Bar& bar) { bars.push_back(bar); });
+  std::vector<apex::Time> times;
+  while (!replayer.get_next_event_time().empty()) {
+    times.push_back(replayer.get_next_event_time());
+    replayer.consume_next_event();
+  }
+
+  // the first bar precedes the replay start; bars replay as they end
+  REQUIRE(replayer.bar_count() == 2);
+  REQUIRE(times.size() == 2);
+  REQUIRE(times[0] == at(120));
+  REQUIRE(times[1] == at(180));
+
+  auto& bar = bars[0];
+  REQUIRE(bar.start_time() == at(60));
+  REQUIRE(bar.open == 160);
+  REQUIRE(bar.high == 219);
+  REQUIRE(bar.low == 160);
+  REQUIRE(bar.close == 219);
+  REQUIRE(bar.trades == 60);
+  REQUIRE(bar.quotes == 60);
+  REQUIRE(bar.volume == 120);
+  double notional = 0;
+  for (int i = 60; i < 120; i++)
+    notional += (100 + i) * (1 + (i % 3));
+  REQUIRE(bar.vwap() == notional / 120);
+  REQUIRE(bar.spread_min == 1);
+  REQUIRE(bar.spread_max == 2);
+  REQUIRE(bar.spread_mean == 1.5);
+  REQUIRE(bar.bid == 219);
+  REQUIRE(bar.ask == 221);
+
+  // a file of another version is refused
+  {
+    std::ofstream os(dir / "other.bars", std::ios::binary);
+    auto preamble = apex::encode_tickbin_file_header("TICKBIN2", {});
+    os.write(preamble.data(), preamble.size());
+  }
+  apex::BarReplayer other({dir / "other.bars"}, start, [](const apex::Bar&) {});
+  bool threw = false;
+  try {
+    other.get_next_event_time();
+  } catch (std::exception&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tickbin_compressed")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tickbin_compressed_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  // ticks from 22:30 to 23:30, so spanning two hourly files
+  const int count = 20000;
+  auto at = [](int i) {
+    return apex::Time{std::chrono::seconds(1700001000) + std::chrono::milliseconds(i * 180)};
+  };
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::StreamInfo info{instrument, "l1"};
+  apex::TickFileBucketId bucketid{2023, 11, 14};
+  apex::TickbinFileWriter::Options options;
+  options.compress = true;
+  options.frame_size = 4096;
+
+  auto write = [&](int from, int upto) {
+    apex::TickbinFileWriter writer(bucketid, dir, "BTCUSDT.bin", info, {}, options);
+    std::vector<char> buf;
+    for (int i = from; i < upto; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      tick.ask_price = i + 1;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      buf.insert(buf.end(), bytes.begin(), bytes.end());
+      if (buf.size() > 1000 || i + 1 == upto) {
+        writer.write_bytes(buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+  };
+
+  // replay both hours, returning the number of ticks found in order
+  auto replay = [&]() {
+    int i = 0;
+    for (int hour : {22, 23}) {
+      apex::MarketData md;
+      apex::TickbinFileReader reader(
+        apex::tickbin_part_path(dir / "BTCUSDT.bin", hour), &md, apex::MdStream::L1);
+      while (reader.has_next_event()) {
+        REQUIRE(reader.next_event_time() == at(i));
+        reader.consume_next_event();
+        REQUIRE(md.bid() == i);
+        i++;
+      }
+    }
+    return i;
+  };
+
+  write(0, count);
+  auto part22 = dir / "BTCUSDT.22.binz";
+  auto part23 = dir / "BTCUSDT.23.binz";
+  REQUIRE(std::filesystem::exists(part22));
+  REQUIRE(std::filesystem::exists(part23));
+  REQUIRE(!std::filesystem::exists(dir / "BTCUSDT.bin"));
+  REQUIRE(std::filesystem::file_size(part22) + std::filesystem::file_size(part23) <
+          count * sizeof(apex::tickbin::FullMsg<apex::tickbin::TickLevel1>) / 2);
+  REQUIRE(replay() == count);
+
+  // wind forward uses the frame index
+  for (int seek : {10000, 15000, count - 1}) {
+    apex::MarketData md;
+    apex::TickbinFileReader reader(part23, &md, apex::MdStream::L1);
+    reader.wind_forward(at(seek));
+    REQUIRE(reader.next_event_time() == at(seek));
+    reader.consume_next_event();
+    REQUIRE(md.bid() == seek);
+  }
+
+  // a crash loses the index and tears the final frame; earlier frames are
+  // replayed, and the writer continues after the last complete frame
+  std::filesystem::resize_file(part23,
+                               std::filesystem::file_size(part23) * 9 / 10);
+  int recovered = replay();
+  REQUIRE(recovered > count / 2);
+  REQUIRE(recovered < count);
+  write(recovered, count);
+  REQUIRE(replay() == count);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("tickbin_delta")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tickbin_delta_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  const int count = 50000;
+  auto at = [](int i) {
+    return apex::Time{std::chrono::seconds(1700001000) + std::chrono::milliseconds(i * 10)};
+  };
+
+  // prices on a 0.01 grid and quantities of 0.001 lots, except one tick
+  // that is off the grid, so must be written raw
+  const int off_grid = 777;
+  auto bid_at = [&](int i) {
+    return i == off_grid ? 30000.005 : (3000000 + i % 50) / 100.0;
+  };
+  auto ask_at = [](int i) { return (3000001 + i % 50) / 100.0; };
+  auto qty_at = [](int i) { return (i % 7 + 1) / 1000.0; };
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  instrument.tick_size = apex::ScaledInt(1, -2);
+  instrument.lot_size = apex::ScaledInt(1, -3);
+  apex::TickFileBucketId bucketid{2023, 11, 14};
+  apex::TickbinFileWriter::Options options;
+  options.delta = true;
+
+  auto write = [&](const std::string& channel, int from, int upto) {
+    apex::TickbinFileWriter writer(bucketid, dir, channel + ".bin",
+                                   {instrument, channel}, {}, options);
+    std::vector<char> buf;
+    for (int i = from; i < upto; i++) {
+      apex::tickbin::Serialiser::bytes bytes;
+      if (channel == "l1") {
+        apex::TickTop tick;
+        tick.bid_price = bid_at(i);
+        tick.ask_price = ask_at(i);
+        tick.bid_qty = qty_at(i);
+        tick.ask_qty = qty_at(i + 1);
+        bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      }
+      else {
+        apex::TickTrade tick;
+        tick.price = bid_at(i);
+        tick.qty = qty_at(i);
+        tick.et = at(i - 1);
+        tick.aggr_side = i % 2 ? apex::Side::buy : apex::Side::sell;
+        bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      }
+      buf.insert(buf.end(), bytes.begin(), bytes.end());
+      if (buf.size() > 1000 || i + 1 == upto) {
+        writer.write_bytes(buf.data(), buf.size());
+        buf.clear();
+      }
+    }
+  };
+
+  // check the ticks replayed from `from`, returning the number found
+  auto replay = [&](const std::string& channel, int from) {
+    apex::MarketData md;
+    auto stream = channel == "l1" ? apex::MdStream::L1 : apex::MdStream::AggTrades;
+    apex::TickbinFileReader reader(dir / (channel + ".bin"), &md, stream);
+    if (from)
+      reader.wind_forward(at(from));
+    int i = from;
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() == at(i));
+      reader.consume_next_event();
+      if (stream == apex::MdStream::L1) {
+        REQUIRE(md.bid() == bid_at(i));
+        REQUIRE(md.ask() == ask_at(i));
+        REQUIRE(md.l1_bid().qty == qty_at(i));
+        REQUIRE(md.l1_ask().qty == qty_at(i + 1));
+      }
+      else {
+        REQUIRE(md.last().price == bid_at(i));
+        REQUIRE(md.last().qty == qty_at(i));
+        REQUIRE(md.last().et == at(i - 1));
+        REQUIRE(md.last().aggr_side == (i % 2 ? apex::Side::buy : apex::Side::sell));
+      }
+      i++;
+    }
+    return i;
+  };
+
+  for (std::string channel : {"l1", "aggtrades"}) {
+    // the second write appends, beginning with a key record
+    write(channel, 0, count / 2);
+    write(channel, count / 2, count);
+    auto fn = dir / (channel + ".bin");
+    REQUIRE(apex::decode_tickbin_file_header(apex::MappedFile(fn).begin()).version ==
+            apex::tickbin::delta_version);
+    REQUIRE(std::filesystem::file_size(fn) <
+            count * sizeof(apex::tickbin::FullMsg<apex::tickbin::TickLevel1>) / 3);
+    REQUIRE(replay(channel, 0) == count);
+
+    // wind forward seeks to an indexed key record
+    for (int seek : {off_grid, count / 2, count - 1})
+      REQUIRE(replay(channel, seek) == count);
+    REQUIRE(apex::build_tickbin_index(fn) > 1);
+    REQUIRE(replay(channel, count * 3 / 4) == count);
+  }
+
+  // delta encoding is not combined with compression
+  options.compress = true;
+  bool threw = false;
+  try {
+    apex::TickbinFileWriter writer(bucketid, dir, "l1.bin", {instrument, "l1"},
+                                   {}, options);
+  } catch (std::exception&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("binance_decoder")
+{
+  using namespace apex::binance;
+
+  StreamMessage msg;
+  std::string book =
+      R"({"stream":"btcusdt@bookTicker","data":{"u":400900217,"s":"BTCUSDT",)"
+      R"("b":"25.35190000","B":"31.21000000","a":"25.36520000","A":"40.66000000"}})";
+  REQUIRE(decode_stream_message(book, msg));
+  REQUIRE(msg.stream == "btcusdt@bookTicker");
+
+  apex::TickTop top;
+  REQUIRE(decode_book_ticker(msg.data, top));
+  REQUIRE(top.bid_price == 25.3519);
+  REQUIRE(top.bid_qty == 31.21);
+  REQUIRE(top.ask_price == 25.3652);
+  REQUIRE(top.ask_qty == 40.66);
+  REQUIRE(top.exact_bid_price == apex::ScaledInt(2535190000, -8));
+  REQUIRE(top.exact_ask_price == apex::ScaledInt(2536520000, -8));
+
+  // all-market updates are routed by symbol before their prices are decoded
+  std::string_view symbol;
+  REQUIRE(decode_symbol(msg.data, symbol));
+  REQUIRE(symbol == "BTCUSDT");
+  REQUIRE(!decode_symbol(R"({"u":400900217,"b":"25.35190000"})", symbol));
+
+  std::string trade =
+      R"({ "stream" : "btcusdt@aggTrade", "data" : {"e":"aggTrade","E":1672515782136,)"
+      R"("s":"BTCUSDT","a":12345,"p":"0.001","q":"100","f":100,"l":105,)"
+      R"("T":1672515782135,"m":true,"M":true} })";
+  REQUIRE(decode_stream_message(trade, msg));
+  apex::TickTrade tick;
+  REQUIRE(decode_agg_trade(msg.data, tick));
+  REQUIRE(tick.price == 0.001);
+  REQUIRE(tick.exact_price == apex::ScaledInt(1, -3));
+  REQUIRE(tick.qty == 100);
+  REQUIRE(tick.aggr_side == apex::Side::sell);
+  REQUIRE(tick.xt == apex::Time(1672515782, std::chrono::milliseconds(135)));
+  REQUIRE(tick.et == apex::Time(1672515782, std::chrono::milliseconds(136)));
+
+  // update ids, by which the copies of a dual feed are matched
+  uint64_t id = 0;
+  REQUIRE(decode_update_id(book.substr(book.find("{\"u\"")), 'u', id));
+  REQUIRE(id == 400900217);
+  REQUIRE(decode_update_id(msg.data, 'a', id));
+  REQUIRE(id == 12345);
+  REQUIRE(!decode_update_id(msg.data, 'u', id));
+  REQUIRE(!decode_update_id(R"({"u":"400900217"})", 'u', id));
+
+  // subscription replies, escaped strings, missing fields and truncated
+  // messages are left to the json parser
+  REQUIRE(!decode_stream_message(R"({"result":null,"id":1})", msg));
+  REQUIRE(!decode_stream_message(R"({"stream":"a\"b","data":{}})", msg));
+  REQUIRE(!decode_book_ticker(R"({"b":"1.0","B":"2.0","a":"3.0"})", top));
+  REQUIRE(!decode_book_ticker(R"({"b":"1.0","B":"2.0","a":"3.0","A":"x"})", top));
+  REQUIRE(!decode_stream_message(book.substr(0, book.size() - 1), msg));
+
+  ExecutionReport report;
+  std::string fill =
+      R"({"C":"","E":1650880969417,"F":"0.00000000","I":9933907061,)"
+      R"("L":"38638.48000000","M":true,"N":"BTC","O":1650880969417,"S":"BUY",)"
+      R"("X":"FILLED","c":"TEST000002","e":"executionReport","f":"GTC","g":-1,)"
+      R"("i":4815055021,"l":"0.00129000","m":false,"N":null,"x":"TRADE"})";
+  REQUIRE(decode_execution_report(fill, report));
+  REQUIRE(report.execution_type == "TRADE");
+  REQUIRE(report.order_status == "FILLED");
+  REQUIRE(report.client_order_id == "TEST000002");
+  REQUIRE(report.orig_client_order_id.empty());
+  REQUIRE(report.last_executed_price == "38638.48000000");
+  REQUIRE(report.last_executed_qty == "0.00129000");
+  REQUIRE(report.order_id == "4815055021");
+  REQUIRE(!decode_execution_report(
+      R"({"e":"outboundAccountPosition","E":1564034571105,"B":[{"a":"ETH","f":"1"}]})",
+      report));
+}
+
+
+TEST_CASE("binance_stale_l1")
+{
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  apex::IoLoop ioloop;
+  apex::SslContext ssl(apex::SslConfig(true));
+  auto sync = [&evloop]() {
+    std::promise<void> done;
+    evloop.dispatch([&done]() { done.set_value(); });
+    done.get_future().wait();
+  };
+  auto book = [](uint64_t id, const char* bid) {
+    return std::string(R"({"stream":"btcusdt@bookTicker","data":{"u":)") +
+           std::to_string(id) + R"(,"s":"BTCUSDT","b":")" + bid +
+           R"(","B":"1.0","a":"101.0","A":"1.0"}})";
+  };
+
+  for (bool json_path : {false, true}) {
+    apex::BinanceSession::Params params;
+    params.http_warm_connections = 0;
+    auto session = std::make_shared<apex::BinanceSession>(
+        apex::BaseExchangeSession::EventCallbacks{}, params,
+        apex::RunMode::paper, &ioloop, evloop, &ssl);
+
+    std::vector<double> bids;
+    apex::Symbol symbol;
+    symbol.native = "BTCUSDT";
+    session->subscribe_top(symbol, apex::subscription_options(),
+                           [&bids](const apex::TickTop& tick) {
+                             bids.push_back(tick.bid_price);
+                           });
+    sync();
+
+    // an update resent, or overtaken, is dropped before it is delivered
+    session->replay_md_frame(book(10, "100.0"), json_path);
+    session->replay_md_frame(book(12, "100.2"), json_path);
+    session->replay_md_frame(book(11, "100.1"), json_path);
+    session->replay_md_frame(book(12, "100.2"), json_path);
+    session->replay_md_frame(book(13, "100.3"), json_path);
+    sync();
+    REQUIRE((bids == std::vector<double>{100.0, 100.2, 100.3}));
+    session.reset();
+  }
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("binance_dual_feed")
+{
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  apex::IoLoop ioloop;
+  apex::SslContext ssl(apex::SslConfig(true));
+  auto sync = [&evloop]() {
+    std::promise<void> done;
+    evloop.dispatch([&done]() { done.set_value(); });
+    done.get_future().wait();
+  };
+  auto book = [](const char* stream, const char* symbol, uint64_t id) {
+    return std::string(R"({"stream":")") + stream + R"(","data":{"u":)" +
+           std::to_string(id) + R"(,"s":")" + symbol + R"(","b":")" +
+           std::to_string(100 + id) + R"(","B":"1.0","a":"200.0","A":"1.0"}})";
+  };
+
+  // each update is delivered once, in update order, from whichever feed has
+  // it first; copies arriving second, and updates overtaken, are dropped
+  for (bool all_book_ticker : {false, true}) {
+    apex::BinanceSession::Params params;
+    params.http_warm_connections = 0;
+    params.md_dual_feed = true;
+    params.md_all_book_ticker = all_book_ticker;
+    auto session = std::make_shared<apex::BinanceSession>(
+        apex::BaseExchangeSession::EventCallbacks{}, params,
+        apex::RunMode::paper, &ioloop, evloop, &ssl);
+
+    std::map<std::string, std::vector<double>> bids;
+    for (const char* name : {"BTCUSDT", "ETHUSDT"}) {
+      apex::Symbol symbol;
+      symbol.native = name;
+      session->subscribe_top(symbol, apex::subscription_options(),
+                             [&bids, name](const apex::TickTop& tick) {
+                               bids[name].push_back(tick.bid_price);
+                             });
+    }
+    sync();
+    std::vector<std::string> requests;
+    auto on_request = [&requests](const std::string& r) {
+      requests.push_back(r);
+    };
+    auto primary = session->replay_md_connection(false, on_request);
+    auto mirror = session->replay_md_connection(true, on_request);
+    REQUIRE(requests.size() == 2); // one subscribe request on each feed
+
+    auto feed = [&](uint64_t connection, const char* symbol, uint64_t id) {
+      std::string stream = all_book_ticker
+                               ? std::string("!bookTicker")
+                               : apex::str_tolower(symbol) + "@bookTicker";
+      session->replay_md_frame(book(stream.c_str(), symbol, id), connection);
+    };
+    feed(primary, "BTCUSDT", 1); // first on the primary
+    feed(mirror, "BTCUSDT", 2);  // first on the mirror
+    feed(primary, "BTCUSDT", 2); // late copy
+    feed(mirror, "BTCUSDT", 3);
+    feed(primary, "BTCUSDT", 4);
+    feed(mirror, "BTCUSDT", 4); // late copy
+    feed(primary, "BTCUSDT", 3); // overtaken
+    feed(mirror, "BTCUSDT", 5);
+    feed(primary, "BTCUSDT", 4); // resent
+    // update ids are per stream, or per symbol on the all-market stream
+    feed(mirror, "ETHUSDT", 1);
+    feed(primary, "ETHUSDT", 1); // late copy
+    sync();
+
+    REQUIRE((bids["BTCUSDT"] == std::vector<double>{101, 102, 103, 104, 105}));
+    REQUIRE((bids["ETHUSDT"] == std::vector<double>{101}));
+    auto stats = session->get_md_feed_stats();
+    REQUIRE(stats.primary_first == 2);
+    REQUIRE(stats.mirror_first == 4);
+    REQUIRE(stats.duplicates == 5);
+    session.reset();
+  }
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("binance_all_book_ticker")
+{
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  apex::IoLoop ioloop;
+  apex::SslContext ssl(apex::SslConfig(true));
+  auto sync = [&evloop]() {
+    std::promise<void> done;
+    evloop.dispatch([&done]() { done.set_value(); });
+    done.get_future().wait();
+  };
+  auto book = [](const char* symbol, uint64_t id) {
+    return std::string(R"({"stream":"!bookTicker","data":{"u":)") +
+           std::to_string(id) + R"(,"s":")" + symbol + R"(","b":")" +
+           std::to_string(100 + id) + R"(","B":"1.0","a":"200.0","A":"1.0"}})";
+  };
+
+  apex::BinanceSession::Params params;
+  params.http_warm_connections = 0;
+  params.md_all_book_ticker = true;
+  auto session = std::make_shared<apex::BinanceSession>(
+      apex::BaseExchangeSession::EventCallbacks{}, params,
+      apex::RunMode::paper, &ioloop, evloop, &ssl);
+
+  // every symbol is served by the one all-market stream
+  std::map<std::string, std::vector<double>> bids;
+  for (const char* name : {"BTCUSDT", "ETHUSDT"}) {
+    apex::Symbol symbol;
+    symbol.native = name;
+    session->subscribe_top(symbol, apex::subscription_options(),
+                           [&bids, name](const apex::TickTop& tick) {
+                             bids[name].push_back(tick.bid_price);
+                           });
+  }
+  sync();
+  std::vector<std::string> requests;
+  auto connection = session->replay_md_connection(
+      false, [&requests](const std::string& r) { requests.push_back(r); });
+  REQUIRE(requests.size() == 1);
+  REQUIRE((json::parse(requests[0])["params"] == json::array({"!bookTicker"})));
+
+  // updates reach the subscription of their symbol
+  session->replay_md_frame(book("BTCUSDT", 1), connection);
+  session->replay_md_frame(book("ETHUSDT", 1), connection);
+  session->replay_md_frame(book("BTCUSDT", 2), connection);
+  sync();
+  REQUIRE((bids["BTCUSDT"] == std::vector<double>{101, 102}));
+  REQUIRE((bids["ETHUSDT"] == std::vector<double>{101}));
+
+  // and those of symbols not subscribed are dropped as they arrive, without
+  // an allocation, or any event dispatched
+  std::vector<std::string> others;
+  for (int i = 0; i < 100; i++)
+    others.push_back(book("XRPUSDT", 1 + i));
+  session->replay_md_frame(others[0], connection);
+  const auto allocations = apex::alloc::thread_counters.count;
+  for (auto& frame : others)
+    session->replay_md_frame(frame, connection);
+  REQUIRE(apex::alloc::thread_counters.count == allocations);
+  sync();
+  REQUIRE(bids.size() == 2);
+  REQUIRE(bids["BTCUSDT"].size() == 2);
+
+  session.reset();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("binance_md_sharding")
+{
+  using namespace std::chrono_literals;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  apex::IoLoop ioloop;
+  apex::SslContext ssl(apex::SslConfig(true));
+  auto sync = [&evloop]() {
+    std::promise<void> done;
+    evloop.dispatch([&done]() { done.set_value(); });
+    done.get_future().wait();
+  };
+
+  apex::BinanceSession::Params params;
+  params.http_warm_connections = 0;
+  auto session = std::make_shared<apex::BinanceSession>(
+      apex::BaseExchangeSession::EventCallbacks{}, params,
+      apex::RunMode::paper, &ioloop, evloop, &ssl);
+
+  std::map<std::string, std::vector<double>> bids; // event thread
+  auto symbol_of = [](size_t i) {
+    char name[16];
+    snprintf(name, sizeof(name), "S%04zuUSDT", i);
+    return std::string(name);
+  };
+  auto subscribe = [&](size_t i) {
+    apex::Symbol symbol;
+    symbol.native = symbol_of(i);
+    session->subscribe_top(symbol, apex::subscription_options(),
+                           [&bids, name = symbol.native](const apex::TickTop& t) {
+                             bids[name].push_back(t.bid_price);
+                           });
+  };
+  const size_t early = 6, count = 11;
+  for (size_t i = 0; i < early; i++)
+    subscribe(i);
+  sync();
+
+  // the requests each connection sends, with the streams of each; event
+  // thread, so read once synced
+  struct Request {
+    std::string method;
+    std::vector<std::string> streams;
+    std::chrono::steady_clock::time_point sent;
+  };
+  std::map<int, std::vector<Request>> requests;
+  auto recorder = [&requests](int conn) {
+    return [&requests, conn](const std::string& text) {
+      auto j = json::parse(text);
+      requests[conn].push_back({j["method"].get<std::string>(),
+                                j["params"].get<std::vector<std::string>>(),
+                                std::chrono::steady_clock::now()});
+    };
+  };
+  auto streams_of = [&](int conn, const char* method) {
+    std::set<std::string> streams;
+    for (auto& r : requests[conn])
+      if (r.method == method)
+        streams.insert(r.streams.begin(), r.streams.end());
+    return streams;
+  };
+  auto wait_for = [&](auto done) {
+    for (int i = 0; i < 300; i++) {
+      sync();
+      if (done())
+        return true;
+      std::this_thread::sleep_for(10ms);
+    }
+    return false;
+  };
+  auto book = [&](size_t i, uint64_t id) {
+    auto symbol = symbol_of(i);
+    return R"({"stream":")" + apex::str_tolower(symbol) +
+           R"(@bookTicker","data":{"u":)" + std::to_string(id) +
+           R"(,"s":")" + symbol + R"(","b":")" + std::to_string(id) +
+           R"(","B":"1.0","a":"200.0","A":"1.0"}})";
+  };
+
+  // a connection takes every stream made before it, in one request
+  auto first = session->replay_md_connection(false, recorder(1));
+  sync();
+  REQUIRE(requests[1].size() == 1);
+  REQUIRE(requests[1][0].method == "SUBSCRIBE");
+  REQUIRE(requests[1][0].streams.size() == early);
+
+  // and each made since, in a request of its own, up to four a second; the
+  // rest wait for the window to pass, and are then batched
+  for (size_t i = early; i < count; i++) {
+    subscribe(i);
+    sync();
+  }
+  REQUIRE(requests[1].size() == 4);
+  REQUIRE(wait_for([&]() { return requests[1].size() == 5; }));
+  REQUIRE(requests[1][4].streams.size() == 2);
+  REQUIRE(requests[1][4].sent - requests[1][0].sent >= 900ms);
+  REQUIRE(streams_of(1, "SUBSCRIBE").size() == count);
+
+  // a stream updates only from the connection carrying it
+  const size_t moved = 0, kept = count - 1;
+  session->replay_md_frame(book(moved, 1), first);
+  session->replay_md_frame(book(kept, 1), first);
+
+  // a second connection takes its share of the streams, in one request,
+  // which the first unsubscribes; no stream is carried by both, nor by
+  // neither
+  auto second = session->replay_md_connection(false, recorder(2));
+  REQUIRE(wait_for([&]() {
+    return streams_of(1, "UNSUBSCRIBE").size() == count / 2;
+  }));
+  REQUIRE(requests[2].size() == 1);
+  REQUIRE(streams_of(2, "SUBSCRIBE").size() == count / 2);
+  REQUIRE(streams_of(2, "SUBSCRIBE") == streams_of(1, "UNSUBSCRIBE"));
+  auto moved_stream = apex::str_tolower(symbol_of(moved)) + "@bookTicker";
+  auto kept_stream = apex::str_tolower(symbol_of(kept)) + "@bookTicker";
+  REQUIRE(streams_of(2, "SUBSCRIBE").count(moved_stream) == 1);
+  REQUIRE(streams_of(2, "SUBSCRIBE").count(kept_stream) == 0);
+
+  // until the first connection's unsubscribe takes effect both carry the
+  // moved stream, but its updates are taken from the second alone, and
+  // none is lost: the second has every update from the move
+  session->replay_md_frame(book(moved, 2), first);
+  session->replay_md_frame(book(moved, 2), second);
+  session->replay_md_frame(book(moved, 3), first);
+  session->replay_md_frame(book(moved, 3), second);
+  session->replay_md_frame(book(kept, 2), second);
+  session->replay_md_frame(book(kept, 2), first);
+  sync();
+  REQUIRE((bids[symbol_of(moved)] == std::vector<double>{1, 2, 3}));
+  REQUIRE((bids[symbol_of(kept)] == std::vector<double>{1, 2}));
+
+  session.reset();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("binance_ws_api")
+{
+  apex::binance::WsApiRequests requests("KEY", "SECRET", 5000);
+
+  int reply_status = -1;
+  json reply_body;
+  auto on_reply = [&](int status, json& body) {
+    reply_status = status;
+    reply_body = body;
+  };
+
+  // params are signed, and sent, in key order, with the credentials added
+  auto text = requests.make_signed(
+      "order.place",
+      {{"symbol", "BTCUSDT"}, {"side", "BUY"}, {"price", "100.5"},
+       {"quantity", "0.1"}, {"newClientOrderId", "x1"}},
+      1700000000000, on_reply);
+  auto request = json::parse(text);
+  REQUIRE(request["id"] == 1);
+  REQUIRE(request["method"] == "order.place");
+  std::string payload =
+      "apiKey=KEY&newClientOrderId=x1&price=100.5&quantity=0.1&"
+      "recvWindow=5000&side=BUY&symbol=BTCUSDT&timestamp=1700000000000";
+  REQUIRE(request["params"]["signature"] ==
+          apex::HMACSHA256_base4("SECRET", 6, payload.c_str(), payload.size()));
+  REQUIRE(request["params"]["timestamp"] == 1700000000000);
+  REQUIRE(request["params"]["apiKey"] == "KEY");
+  REQUIRE(requests.pending() == 1);
+
+  // replies are matched to their request by id
+  auto unknown = json::parse(R"({"id":9,"status":200,"result":{}})");
+  REQUIRE(!requests.on_message(unknown));
+  auto ok = json::parse(
+      R"({"id":1,"status":200,"result":{"orderId":7,"status":"NEW"}})");
+  REQUIRE(requests.on_message(ok));
+  REQUIRE(reply_status == 200);
+  REQUIRE(reply_body["orderId"] == 7);
+  REQUIRE(requests.pending() == 0);
+
+  requests.make_signed("order.cancel", {{"orderId", "7"}}, 1700000000001, on_reply);
+  auto failed = json::parse(
+      R"({"id":2,"status":400,"error":{"code":-2011,"msg":"Unknown order sent."}})");
+  REQUIRE(requests.on_message(failed));
+  REQUIRE(reply_status == 400);
+  REQUIRE(reply_body["code"] == -2011);
+
+  // requests in flight when the connection is lost are completed with 0
+  requests.make_signed("order.cancel", {{"orderId", "8"}}, 1700000000002, on_reply);
+  requests.fail_all("lost");
+  REQUIRE(reply_status == 0);
+  REQUIRE(reply_body["msg"] == "lost");
+  REQUIRE(requests.pending() == 0);
+}
+
+
+TEST_CASE("request_signer")
+{
+  // RFC 4231, test case 2
+  apex::HmacSha256 jefe("Jefe");
+  REQUIRE(jefe.sign_hex("what do ya want for nothing?") ==
+          "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+
+  // agrees with the one-shot signing, including for keys longer than the
+  // block size, which are first hashed
+  std::string short_key = "SECRET";
+  std::string long_key(100, 'k');
+  std::string msg = "symbol=BTCUSDT&side=BUY&timestamp=1700000000000";
+  for (auto& key : {short_key, long_key}) {
+    apex::HmacSha256 hmac(key);
+    auto expected =
+        apex::HMACSHA256_base4(key.c_str(), key.size(), msg.c_str(), msg.size());
+    auto first = hmac.sign_hex(msg);
+    auto second = hmac.sign_hex(msg);
+    REQUIRE(first == expected);
+    REQUIRE(second == expected);
+  }
+
+  // the query is built in order, and signed over everything before the
+  // signature field
+  apex::HmacSha256 hmac(short_key);
+  apex::SignedQuery query(16);
+  query.add("symbol", "BTCUSDT")
+      .add("quantity", 0.25, true, 8)
+      .add("price", 100.0, true, 9)
+      .add("timestamp", int64_t(1700000000000));
+  std::string unsigned_part =
+      "symbol=BTCUSDT&quantity=0.25&price=100.0&timestamp=1700000000000";
+  REQUIRE(query.str() == unsigned_part);
+  query.sign(hmac);
+  REQUIRE(query.str() == unsigned_part + "&signature=" +
+                             hmac.sign_hex(unsigned_part));
+
+  // reused after clear
+  query.clear().add("orderId", "7");
+  REQUIRE(query.view() == "orderId=7");
+}
+
+
+TEST_CASE("gx_binary_format")
+{
+  // header flags survive the conversion to network order
+  apex::gx::Header header;
+  apex::gx::Header::init(&header, sizeof(apex::gx::bin::TickTop),
+                         apex::gx::Type::tick_top,
+                         static_cast<uint8_t>(apex::gx::Flags::binary));
+  header.id = 42;
+  header.hton();
+  REQUIRE(header.flags == static_cast<uint8_t>(apex::gx::Flags::binary));
+  REQUIRE(ntohs(header.len) == sizeof(apex::gx::Header) + 48);
+
+  // payloads decode in place, if of the expected size
+  char buf[sizeof(apex::gx::bin::TickTop) + 1] = {0};
+  apex::gx::bin::TickTop top{1.5, 2, 3.5, 4, 0, 0};
+  memcpy(buf + 1, &top, sizeof(top));
+  auto* decoded = apex::gx::bin::cast<apex::gx::bin::TickTop>(buf + 1, sizeof(top));
+  REQUIRE(decoded != nullptr);
+  REQUIRE(decoded->ask_price == 3.5);
+  REQUIRE(apex::gx::bin::cast<apex::gx::bin::TickTop>(buf, sizeof(buf)) == nullptr);
+
+  // ids are held in fixed fields, so longer ids cannot be encoded
+  apex::gx::bin::OrderFill fill;
+  REQUIRE(apex::gx::bin::set_id(fill.order_id, std::string(32, 'x')));
+  REQUIRE(apex::gx::bin::get_id(fill.order_id) == std::string(32, 'x'));
+  REQUIRE(apex::gx::bin::set_id(fill.order_id, "mm1000000a"));
+  REQUIRE(apex::gx::bin::get_id(fill.order_id) == "mm1000000a");
+  REQUIRE(!apex::gx::bin::set_id(fill.order_id, std::string(33, 'x')));
+}
+
+
+TEST_CASE("gx_frame")
+{
+  // a frame holds the complete message, in network order, ready to write
+  apex::gx::bin::TickTop top{1.5, 2, 3.5, 4, 0, 0};
+  apex::gx::Frame frame(apex::gx::Type::tick_top, 7, &top, sizeof(top));
+  REQUIRE(frame.size() == sizeof(apex::gx::Header) + sizeof(top));
+  REQUIRE(frame.id() == 7);
+
+  auto* header = reinterpret_cast<const apex::gx::Header*>(frame.data());
+  REQUIRE(ntohs(header->len) == frame.size());
+  REQUIRE(ntohs(header->id) == 7);
+  REQUIRE(header->type == apex::gx::Type::tick_top);
+  REQUIRE(header->flags == static_cast<uint8_t>(apex::gx::Flags::binary));
+
+  auto* decoded = apex::gx::bin::cast<apex::gx::bin::TickTop>(
+      frame.data() + sizeof(apex::gx::Header), sizeof(top));
+  REQUIRE(decoded != nullptr);
+  REQUIRE(decoded->bid_qty == 2);
+}
+
+
+TEST_CASE("gx_tick_queue")
+{
+  using Queue = apex::GxTickQueue;
+  using Frame = std::shared_ptr<const apex::gx::Frame>;
+  auto make = [](apex::gx::Type type) {
+    int payload = 0;
+    return std::make_shared<const apex::gx::Frame>(type, 0, &payload,
+                                                   sizeof(payload));
+  };
+  auto top = [&]() { return make(apex::gx::Type::tick_top); };
+  auto trade = [&]() { return make(apex::gx::Type::trade); };
+
+  // the socket backlog is set by the test
+  size_t backlog = 0;
+  Queue queue([&backlog]() { return backlog; });
+  Queue::Options options;
+  options.high_watermark = 1000;
+  options.low_watermark = 100;
+  options.max_queued_trades = 2;
+  options.max_stall = std::chrono::seconds(5);
+  queue.set_options(options);
+
+  std::vector<std::pair<Frame, apex::gx::t_msgid>> sent;
+  auto send = [&sent](const Frame& frame, apex::gx::t_msgid id) {
+    sent.push_back({frame, id});
+  };
+  const auto t0 = Queue::Clock::now();
+  int stream_a = 0, stream_b = 0;
+
+  // below the high watermark, ticks are sent as they come
+  REQUIRE(queue.offer(top(), 1, &stream_a, t0) == Queue::Offer::send);
+  REQUIRE(queue.check(send, t0) == Queue::Check::idle);
+
+  // once above it, ticks are queued; a later top of a stream replaces the
+  // queued one in its place
+  backlog = 2000;
+  auto a1 = top(), a2 = top(), b1 = top(), t1 = trade(), t2 = trade();
+  REQUIRE(queue.offer(a1, 1, &stream_a, t0) == Queue::Offer::backed_up);
+  REQUIRE(queue.offer(t1, 1, &stream_a, t0) == Queue::Offer::queued);
+  REQUIRE(queue.offer(b1, 2, &stream_b, t0) == Queue::Offer::queued);
+  REQUIRE(queue.offer(a2, 1, &stream_a, t0) == Queue::Offer::queued);
+  REQUIRE(queue.offer(t2, 1, &stream_a, t0) == Queue::Offer::queued);
+  REQUIRE(queue.size() == 4);
+  REQUIRE(queue.conflated() == 1);
+
+  // under "disconnect", the trade beyond the cap overflows
+  REQUIRE(queue.offer(trade(), 1, &stream_a, t0) == Queue::Offer::overflow);
+
+  // drained only once the backlog falls to the low watermark
+  backlog = 500;
+  REQUIRE(queue.check(send, t0) == Queue::Check::waiting);
+  REQUIRE(sent.empty());
+  backlog = 50;
+  REQUIRE(queue.check(send, t0) == Queue::Check::recovered);
+  REQUIRE(sent.size() == 4);
+  REQUIRE(sent[0].first == a2);
+  REQUIRE(sent[1].first == t1);
+  REQUIRE((sent[2] == std::pair<Frame, apex::gx::t_msgid>{b1, 2}));
+  REQUIRE(sent[3].first == t2);
+  REQUIRE(!queue.backed_up());
+  REQUIRE(queue.size() == 0);
+  REQUIRE(queue.offer(top(), 1, &stream_a, t0) == Queue::Offer::send);
+
+  // under "drop_oldest", the oldest trade is dropped, and skipped on drain
+  options.policy = Queue::Options::Policy::drop_oldest;
+  queue.set_options(options);
+  backlog = 2000;
+  auto t3 = trade(), t4 = trade(), t5 = trade();
+  REQUIRE(queue.offer(t3, 1, &stream_a, t0) == Queue::Offer::backed_up);
+  REQUIRE(queue.offer(t4, 1, &stream_a, t0) == Queue::Offer::queued);
+  REQUIRE(queue.offer(t5, 1, &stream_a, t0) == Queue::Offer::queued);
+  REQUIRE(queue.dropped() == 1);
+  REQUIRE(queue.size() == 3);
+  sent.clear();
+  backlog = 0;
+  REQUIRE(queue.check(send, t0) == Queue::Check::recovered);
+  REQUIRE(sent.size() == 2);
+  REQUIRE(sent[0].first == t4);
+  REQUIRE(sent[1].first == t5);
+
+  // a queue backed up for longer than max_stall has stalled
+  backlog = 2000;
+  REQUIRE(queue.offer(top(), 1, &stream_a, t0) == Queue::Offer::backed_up);
+  REQUIRE(queue.check(send, t0 + std::chrono::seconds(5)) ==
+          Queue::Check::waiting);
+  REQUIRE(queue.check(send, t0 + std::chrono::seconds(6)) ==
+          Queue::Check::stalled);
+}
+
+
+TEST_CASE("gx_message_cache")
+{
+  // one reusable instance per message class, cleared on each use, and
+  // keeping the storage of its string fields
+  apex::gx::MessageCache cache;
+
+  auto& order = cache.get<apex::pb::NewOrder>();
+  order.set_symbol("BTCUSDT");
+  order.set_order_id("order-with-an-id-longer-than-small-string");
+  order.set_price(37000.5);
+  std::string wire = order.SerializeAsString();
+  const void* id_storage = order.order_id().data();
+
+  auto& cleared = cache.get<apex::pb::NewOrder>();
+  REQUIRE(&cleared == &order);
+  REQUIRE(cleared.symbol().empty());
+  REQUIRE(cleared.price() == 0);
+
+  auto& parsed = cache.parse<apex::pb::NewOrder>(wire.data(), wire.size());
+  REQUIRE(&parsed == &order);
+  REQUIRE(parsed.symbol() == "BTCUSDT");
+  REQUIRE(parsed.price() == 37000.5);
+  REQUIRE(static_cast<const void*>(parsed.order_id().data()) == id_storage);
+
+  // other classes have instances of their own
+  auto& cancel = cache.get<apex::pb::CancelOrder>();
+  cancel.set_symbol("ETHUSDT");
+  REQUIRE(order.symbol() == "BTCUSDT");
+  REQUIRE(cache.get<apex::pb::CancelOrder>().symbol().empty());
+}
+
+
+namespace
+{
+/* Exchange session with a single tick per stream, emitted once on
+ * subscription, so that later subscribers rely on the server snapshot. */
+class QuietExchange : public apex::ExchangeSession<QuietExchange>
+{
+public:
+  QuietExchange(EventCallbacks callbacks, apex::IoLoop* ioloop,
+                apex::RealtimeEventLoop& event_loop)
+    : ExchangeSession(std::move(callbacks), apex::ExchangeId::binance,
+                      apex::RunMode::live, ioloop, event_loop, nullptr)
+  {
+  }
+
+  void start() override {}
+
+  // the account holds two assets, reported on subscription
+  void subscribe_account(
+      std::function<void(std::vector<apex::AccountUpdate>)> callback) override
+  {
+    account_callback = std::move(callback);
+    account_callback({{apex::Asset("BTC", "binance", 0), 1.0},
+                      {apex::Asset("USDT", "binance", 0), 100.0}});
+  }
+
+  void subscribe_trades(apex::Symbol, apex::subscription_options,
+                        std::function<void(const apex::TickTrade&)> callback) override
+  {
+    apex::TickTrade tick;
+    tick.price = 100.5;
+    tick.qty = 2;
+    tick.aggr_side = apex::Side::sell;
+    callback(tick);
+  }
+
+  void subscribe_top(apex::Symbol symbol, apex::subscription_options,
+                     std::function<void(const apex::TickTop&)> callback) override
+  {
+    if (!is_event_thread())
+      off_thread_calls++;
+    apex::TickTop tick;
+    tick.bid_price = 100 + symbol.native.size();
+    tick.bid_qty = 1;
+    tick.ask_price = 101 + symbol.native.size();
+    tick.ask_qty = 3;
+    callback(tick);
+  }
+
+  void submit_order(apex::OrderParams, SubmitOrderCallbacks) override {}
+  void cancel_order(std::string, std::string, std::string,
+                    SubmitOrderCallbacks) override {}
+
+  // report a fill of an order, as if executed at the venue
+  void fill(std::string order_id, double size)
+  {
+    apex::OrderFill fill;
+    fill.size = size;
+    fill.price = 100.0;
+    _callbacks.on_order_fill(*this, std::move(order_id), fill);
+  }
+
+  // subscriptions made other than on the session's event loop
+  std::atomic<int> off_thread_calls{0};
+
+  std::function<void(std::vector<apex::AccountUpdate>)> account_callback;
+};
+} // namespace
+
+
+TEST_CASE("gx_subscribe_snapshot")
+{
+  // The exchange ticks once per symbol, before any GX subscriber is added, so
+  // market data becomes good only from the snapshot sent on subscription.
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5796}}});
+  server.add_venue([](apex::BaseExchangeSession::EventCallbacks callbacks,
+                      apex::IoLoop* ioloop, apex::RealtimeEventLoop& event_loop) {
+    return std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                           event_loop);
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto client = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+      nullptr);
+  client->set_traffic_stats(true);
+
+  // subscriptions made in succession go as one batch
+  const std::vector<std::string> symbols = {"BTCUSDT", "ETHUSDT", "DOGEUSDT"};
+  std::vector<std::unique_ptr<apex::MarketData>> markets;
+  for (auto& symbol : symbols) {
+    markets.push_back(std::make_unique<apex::MarketData>());
+    client->subscribe(symbol, apex::ExchangeId::binance, markets.back().get());
+  }
+
+  // a subscription of top of book only is sent no trades
+  apex::MarketData top_only;
+  client->subscribe("SOLUSDT", apex::ExchangeId::binance, &top_only,
+                    static_cast<int>(apex::MdStream::L1));
+  client->start_connecting();
+
+  auto all_good = [&]() {
+    std::promise<bool> good;
+    evloop.dispatch([&]() {
+      bool result = top_only.has_bid_ask();
+      for (auto& market : markets)
+        result = result && market->is_good();
+      good.set_value(result);
+    });
+    return good.get_future().get();
+  };
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!all_good() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(all_good());
+
+  std::promise<void> checked;
+  evloop.dispatch([&]() {
+    for (size_t i = 0; i < symbols.size(); i++) {
+      REQUIRE(markets[i]->bid() == 100 + symbols[i].size());
+      REQUIRE(markets[i]->l1_ask().qty == 3);
+      REQUIRE(markets[i]->last().price == 100.5);
+      REQUIRE(markets[i]->last().aggr_side == apex::Side::sell);
+    }
+    REQUIRE(top_only.bid() == 107);
+    REQUIRE(!top_only.has_last());
+    checked.set_value();
+  });
+  checked.get_future().get();
+
+  bool batched = false;
+  for (auto& [type, stats] : client->traffic_stats())
+    if (type == apex::gx::Type::subscribe_batch)
+      batched = stats.out_messages == 1;
+  REQUIRE(batched);
+
+  client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gx_subscribe_bulk")
+{
+  // a strategy's universe subscribed once connected goes as a single batch,
+  // however soon the event thread takes up the subscriptions
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5796}}});
+  server.add_venue([](apex::BaseExchangeSession::EventCallbacks callbacks,
+                      apex::IoLoop* ioloop, apex::RealtimeEventLoop& event_loop) {
+    return std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                           event_loop);
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto client = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+      nullptr);
+  client->set_traffic_stats(true);
+  client->start_connecting();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!client->is_connected() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(client->is_connected());
+
+  std::vector<std::unique_ptr<apex::MarketData>> markets;
+  std::vector<apex::GxClientSession::MarketViewSubscription> subs;
+  for (int i = 0; i < 50; i++) {
+    markets.push_back(std::make_unique<apex::MarketData>());
+    subs.push_back({"SYM" + std::to_string(i) + "USDT",
+                    apex::ExchangeId::binance, markets.back().get(),
+                    static_cast<int>(apex::MdStream::L1)});
+  }
+  client->subscribe(std::move(subs));
+
+  auto all_good = [&]() {
+    std::promise<bool> good;
+    evloop.dispatch([&]() {
+      bool result = true;
+      for (auto& market : markets)
+        result = result && market->has_bid_ask();
+      good.set_value(result);
+    });
+    return good.get_future().get();
+  };
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!all_good() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(all_good());
+
+  size_t batches = 0;
+  size_t singles = 0;
+  for (auto& [type, stats] : client->traffic_stats()) {
+    if (type == apex::gx::Type::subscribe_batch)
+      batches = stats.out_messages;
+    if (type == apex::gx::Type::subscribe)
+      singles = stats.out_messages;
+  }
+  REQUIRE(batches == 1);
+  REQUIRE(singles == 0);
+
+  client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gx_link_probe")
+{
+  // client and server share a clock, so the estimated offset is within the
+  // round trip time of the loopback link
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5799}}});
+  server.add_venue([](apex::BaseExchangeSession::EventCallbacks callbacks,
+                      apex::IoLoop* ioloop, apex::RealtimeEventLoop& event_loop) {
+    return std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                           event_loop);
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto client = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+      nullptr);
+  client->set_probe_interval(std::chrono::milliseconds(20));
+  REQUIRE(client->rtt_ns() == 0);
+  client->start_connecting();
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (client->probes_answered() < 3 &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(client->probes_answered() >= 3);
+  REQUIRE(client->rtt_ns() > 0);
+  REQUIRE(client->rtt_ns() < 1000000000);
+  REQUIRE(std::abs(client->clock_offset_ns()) <= client->rtt_ns());
+
+  client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+TEST_CASE("gx_account_deltas")
+{
+  // a subscriber is sent the balances held, then only those that change
+  std::shared_ptr<QuietExchange> venue;
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5795}}});
+  server.add_venue([&venue](apex::BaseExchangeSession::EventCallbacks callbacks,
+                            apex::IoLoop* ioloop,
+                            apex::RealtimeEventLoop& event_loop) {
+    venue = std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                            event_loop);
+    return venue;
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto client = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+      nullptr);
+  client->set_traffic_stats(true);
+  apex::Account account;
+  client->subscribe_account("binance", account);
+  client->start_connecting();
+
+  auto balance = [&](const std::string& symbol) {
+    for (auto& [asset, avail] : account.data())
+      if (asset.symbol() == symbol)
+        return avail;
+    return -1.0;
+  };
+  auto account_updates = [&]() {
+    for (auto& [type, stats] : client->traffic_stats())
+      if (type == apex::gx::Type::account_update)
+        return stats.in_messages;
+    return uint64_t(0);
+  };
+  auto wait_for = [](auto done) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return done();
+  };
+  REQUIRE(wait_for([&]() { return balance("USDT") == 100.0; }));
+  REQUIRE(balance("BTC") == 1.0);
+  REQUIRE(account_updates() == 2);
+
+  // of an update of both assets, only the changed one is sent
+  venue->run_on_evloop([](QuietExchange* self) {
+    self->account_callback({{apex::Asset("BTC", "binance", 0), 1.0},
+                            {apex::Asset("USDT", "binance", 0), 90.0}});
+  });
+  REQUIRE(wait_for([&]() { return balance("USDT") == 90.0; }));
+  REQUIRE(account_updates() == 3);
+
+  client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gx_strategy_routing")
+{
+  // a strategy id, and every order id beginning with it, share one key; ids
+  // shorter than a strategy id have none
+  REQUIRE(apex::strategy_key("AAAAA") != 0);
+  REQUIRE(apex::strategy_key("AAAAA") ==
+          apex::strategy_key("AAAAA662adef300000000"));
+  REQUIRE(apex::strategy_key("AAAAA") != apex::strategy_key("AAAAB"));
+  REQUIRE(apex::strategy_key("BAAAA") != apex::strategy_key("AAAAB"));
+  REQUIRE(apex::strategy_key("AAAA") == 0);
+  REQUIRE(apex::strategy_key("") == 0);
+  REQUIRE(apex::strategy_of(apex::strategy_key("DEM01662adef3")) == "DEM01");
+
+  std::shared_ptr<QuietExchange> venue;
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5794}}});
+  server.add_venue([&venue](apex::BaseExchangeSession::EventCallbacks callbacks,
+                            apex::IoLoop* ioloop,
+                            apex::RealtimeEventLoop& event_loop) {
+    venue = std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                            event_loop);
+    return venue;
+  });
+  server.start();
+
+  struct NullRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    bool is_up() const override { return true; }
+  } router;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+
+  // one client per strategy, each with orders of its own
+  struct Client {
+    apex::Services services;
+    apex::OrderService orders;
+    std::shared_ptr<apex::GxClientSession> session;
+    std::shared_ptr<apex::Order> order;
+    std::atomic<int> accepted{0};
+    std::atomic<int> rejected{0};
+    Client(apex::Time start) : services(apex::RunMode::backtest, {start, start}),
+                               orders(&services) {}
+  };
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  const std::string strategies[] = {"AAAAA", "BBBBB", "BBBBBB"};
+  std::vector<std::unique_ptr<Client>> clients;
+  for (auto& strategy : strategies) {
+    auto& client = *clients.emplace_back(std::make_unique<Client>(start));
+    client.session = std::make_shared<apex::GxClientSession>(
+        ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+        &client.orders);
+    client.session->om_logon_observable().subscribe(
+        [&client](std::string error) {
+          (error.empty() ? client.accepted : client.rejected)++;
+        });
+    client.order = client.orders.create(&router, instrument, apex::Side::buy,
+                                        1.0, 100.0, apex::TimeInForce::gtc,
+                                        strategy.substr(0, 5), nullptr, {});
+    client.session->start_connecting();
+  }
+
+  auto wait_for = [](auto done) {
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return done();
+  };
+  auto on_evloop = [&](auto fn) {
+    std::promise<decltype(fn())> result;
+    evloop.dispatch([&]() { result.set_value(fn()); });
+    return result.get_future().get();
+  };
+  for (size_t i = 0; i < clients.size(); i++) {
+    auto& client = *clients[i];
+    REQUIRE(wait_for([&]() { return client.session->is_connected(); }));
+    on_evloop([&]() {
+      client.session->strategy_logon(strategies[i], apex::RunMode::live);
+      return true;
+    });
+  }
+
+  // only an id of exactly the strategy id size may log on
+  REQUIRE(wait_for([&]() { return clients[0]->accepted == 1; }));
+  REQUIRE(wait_for([&]() { return clients[1]->accepted == 1; }));
+  REQUIRE(wait_for([&]() { return clients[2]->rejected == 1; }));
+  REQUIRE(clients[2]->accepted == 0);
+
+  // fills are routed to the session of the strategy the order id begins with
+  const std::string id_a = clients[0]->order->order_id();
+  const std::string id_b = clients[1]->order->order_id();
+  venue->run_on_evloop([id_a, id_b](QuietExchange* self) {
+    self->fill(id_b, 0.5);
+    self->fill(id_a, 0.25);
+    self->fill(id_b, 0.125);
+    self->fill("CCCCC662adef300000000", 1.0);
+  });
+  auto filled = [&](int i) {
+    return on_evloop([&]() { return clients[i]->order->filled_size(); });
+  };
+  REQUIRE(wait_for([&]() { return filled(1) == 0.625; }));
+  REQUIRE(wait_for([&]() { return filled(0) == 0.25; }));
+  REQUIRE(filled(2) == 0.0);
+
+  for (auto& client : clients)
+    client->session->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gateway_failover")
+{
+  // the sessions are not connected; their connection states are fed to the
+  // failover directly
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto primary = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", "5801", nullptr);
+  auto standby = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", "5802", nullptr);
+  apex::GatewayFailover failover(apex::ExchangeId::binance, primary, standby);
+  REQUIRE(failover.active() == primary);
+  REQUIRE(primary->is_feed_active());
+  REQUIRE(!standby->is_feed_active());
+
+  // a standby connecting before the primary takes over, but with no failover
+  // counted, there having been no drop
+  failover.on_connected(1, true);
+  REQUIRE(failover.active_index() == 1);
+  REQUIRE(failover.failovers() == 0);
+  failover.on_connected(0, true);
+  REQUIRE(failover.active_index() == 1);
+
+  // the active session dropping switches at once to the other, connected,
+  // session, which stays active when the dropped one recovers
+  failover.on_connected(1, false);
+  REQUIRE(failover.active_index() == 0);
+  REQUIRE(failover.failovers() == 1);
+  REQUIRE(primary->is_feed_active());
+  REQUIRE(!standby->is_feed_active());
+  failover.on_connected(1, true);
+  REQUIRE(failover.active_index() == 0);
+
+  // with both down, the first to reconnect becomes active
+  failover.on_connected(1, false);
+  failover.on_connected(0, false);
+  REQUIRE(failover.active_index() == 0);
+  failover.on_connected(1, true);
+  REQUIRE(failover.active_index() == 1);
+  REQUIRE(failover.failovers() == 2);
+  REQUIRE(standby->is_feed_active());
+  REQUIRE(!primary->is_feed_active());
+
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("paper_exchange")
+{
+  // a venue whose ticks are pushed by the test
+  class FeedExchange : public apex::ExchangeSession<FeedExchange>
+  {
+  public:
+    FeedExchange(EventCallbacks callbacks, apex::RealtimeEventLoop& event_loop)
+      : ExchangeSession(std::move(callbacks), apex::ExchangeId::binance,
+                        apex::RunMode::paper, nullptr, event_loop, nullptr)
+    {
+    }
+
+    void start() override {}
+    void subscribe_account(
+        std::function<void(std::vector<apex::AccountUpdate>)>) override {}
+    void subscribe_trades(
+        apex::Symbol, apex::subscription_options,
+        std::function<void(const apex::TickTrade&)> callback) override
+    {
+      on_trade = std::move(callback);
+    }
+    void subscribe_top(apex::Symbol, apex::subscription_options,
+                       std::function<void(const apex::TickTop&)> callback) override
+    {
+      on_top = std::move(callback);
+    }
+    void submit_order(apex::OrderParams, SubmitOrderCallbacks) override {}
+    void cancel_order(std::string, std::string, std::string,
+                      SubmitOrderCallbacks) override {}
+
+    std::function<void(const apex::TickTrade&)> on_trade;
+    std::function<void(const apex::TickTop&)> on_top;
+  };
+
+  std::vector<std::pair<std::string, apex::OrderFill>> fills;
+  std::vector<std::pair<std::string, apex::OrderUpdate>> cancels;
+  apex::BaseExchangeSession::EventCallbacks callbacks;
+  callbacks.on_order_fill = [&](apex::BaseExchangeSession&, std::string id,
+                                apex::OrderFill fill) {
+    fills.emplace_back(id, fill);
+  };
+  callbacks.on_order_cancel = [&](apex::BaseExchangeSession&, std::string id,
+                                  apex::OrderUpdate update) {
+    cancels.emplace_back(id, update);
+  };
+
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto venue = std::make_shared<FeedExchange>(callbacks, evloop);
+  auto paper =
+      std::make_shared<apex::PaperExchange>(callbacks, venue, nullptr, evloop);
+
+  std::promise<void> done;
+  evloop.dispatch([&]() {
+    int ticks = 0;
+    paper->subscribe_trades({"BTCUSDT"}, {}, [&](const apex::TickTrade&) { ticks++; });
+    paper->subscribe_top({"BTCUSDT"}, {}, [&](const apex::TickTop&) { ticks++; });
+
+    std::vector<apex::OrderUpdate> replies;
+    std::vector<std::string> rejects;
+    apex::BaseExchangeSession::SubmitOrderCallbacks reply;
+    reply.on_reply = [&](apex::OrderUpdate update) { replies.push_back(update); };
+    reply.on_rejected = [&](std::string code, std::string) {
+      rejects.push_back(code);
+    };
+    auto order = [](const char* id, apex::Side side, double size, double price,
+                    apex::TimeInForce tif) {
+      apex::OrderParams params;
+      params.symbol = "BTCUSDT";
+      params.exchange = apex::ExchangeId::binance;
+      params.side = side;
+      params.size = size;
+      params.price = price;
+      params.time_in_force = tif;
+      params.order_id = id;
+      return params;
+    };
+
+    // without market data, orders are refused
+    paper->submit_order(order("AAAAA1", apex::Side::buy, 2, 100,
+                              apex::TimeInForce::gtc), reply);
+    REQUIRE(rejects == std::vector<std::string>{apex::error::e0102});
+
+    apex::TickTop top;
+    top.bid_price = 100;
+    top.bid_qty = 5;
+    top.ask_price = 101;
+    top.ask_qty = 3;
+    venue->on_top(top);
+    REQUIRE(ticks == 1);
+
+    // one engine joins the bid, behind its visible size
+    paper->submit_order(order("AAAAA1", apex::Side::buy, 2, 100,
+                              apex::TimeInForce::gtc), reply);
+    REQUIRE(replies.size() == 1);
+    REQUIRE(replies[0].state == apex::OrderState::live);
+    const std::string resting_id = replies[0].ext_order_id.str();
+
+    // another takes the offer, filling at once against its visible size, the
+    // rest of the order then expiring
+    paper->submit_order(order("BBBBB1", apex::Side::buy, 4, 101,
+                              apex::TimeInForce::ioc), reply);
+    REQUIRE(replies.size() == 2);
+    REQUIRE(fills.size() == 1);
+    REQUIRE(fills[0].first == "BBBBB1");
+    REQUIRE(fills[0].second.size == 3);
+    REQUIRE(fills[0].second.price == 101);
+    REQUIRE(cancels.size() == 1);
+    REQUIRE(cancels[0].first == "BBBBB1");
+    REQUIRE(cancels[0].second.close_reason == apex::OrderCloseReason::lapsed);
+
+    // a fill-or-kill larger than the offer does not trade
+    paper->submit_order(order("BBBBB2", apex::Side::buy, 4, 101,
+                              apex::TimeInForce::fok), reply);
+    REQUIRE(replies.back().state == apex::OrderState::closed);
+    REQUIRE(fills.size() == 1);
+    REQUIRE(paper->open_orders("BTCUSDT") == 1);
+
+    // trades at the bid consume the queue ahead of the resting order first
+    apex::TickTrade trade;
+    trade.price = 100;
+    trade.qty = 6;
+    trade.aggr_side = apex::Side::sell;
+    venue->on_trade(trade);
+    REQUIRE(ticks == 2);
+    REQUIRE(fills.size() == 2);
+    REQUIRE(fills[1].first == "AAAAA1");
+    REQUIRE(fills[1].second.size == 1);
+    REQUIRE(!fills[1].second.is_fully_filled);
+
+    // the rest is cancelled, and only once
+    paper->cancel_order("BTCUSDT", "AAAAA1", resting_id, reply);
+    REQUIRE(replies.back().close_reason == apex::OrderCloseReason::cancelled);
+    paper->cancel_order("BTCUSDT", "AAAAA1", resting_id, reply);
+    REQUIRE(rejects.back() == apex::error::e0103);
+    REQUIRE(paper->open_orders("BTCUSDT") == 0);
+    done.set_value();
+  });
+  done.get_future().get();
+  evloop.sync_stop();
+}
+
+
+TEST_CASE("embedded_gateway")
+{
+  /* Exchange session that ticks once on each subscription, and replies to
+   * orders within the request. */
+  class EchoExchange : public apex::ExchangeSession<EchoExchange>
+  {
+  public:
+    EchoExchange(EventCallbacks callbacks, apex::IoLoop* ioloop,
+                 apex::RealtimeEventLoop& event_loop)
+      : ExchangeSession(std::move(callbacks), apex::ExchangeId::binance,
+                        apex::RunMode::live, ioloop, event_loop, nullptr)
+    {
+    }
+
+    void start() override { started = true; }
+    void subscribe_account(
+        std::function<void(std::vector<apex::AccountUpdate>)>) override {}
+
+    void subscribe_trades(apex::Symbol, apex::subscription_options,
+                          std::function<void(const apex::TickTrade&)> callback) override
+    {
+      trade_subs++;
+      apex::TickTrade tick;
+      tick.price = 100.5;
+      tick.qty = 2;
+      callback(tick);
+    }
+
+    void subscribe_top(apex::Symbol, apex::subscription_options,
+                       std::function<void(const apex::TickTop&)> callback) override
+    {
+      top_subs++;
+      apex::TickTop tick;
+      tick.bid_price = 100;
+      tick.bid_qty = 1;
+      tick.ask_price = 101;
+      tick.ask_qty = 1;
+      callback(tick);
+    }
+
+    void submit_order(apex::OrderParams params,
+                      SubmitOrderCallbacks callbacks) override
+    {
+      submitted.push_back(params);
+      if (params.price <= 0)
+        callbacks.on_rejected("e9999", "bad price");
+      else
+        callbacks.on_reply(apex::OrderUpdate{apex::OrderState::live, {}, "X1"});
+    }
+
+    void cancel_order(std::string, std::string order_id, std::string ext_order_id,
+                      SubmitOrderCallbacks callbacks) override
+    {
+      cancelled.push_back(order_id + "/" + ext_order_id);
+      callbacks.on_reply(apex::OrderUpdate{apex::OrderState::closed,
+                                           apex::OrderCloseReason::cancelled,
+                                           ext_order_id});
+    }
+
+    bool started = false;
+    int trade_subs = 0;
+    int top_subs = 0;
+    std::vector<apex::OrderParams> submitted;
+    std::vector<std::string> cancelled;
+  };
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto on_evloop = [&](std::function<void()> fn) {
+    std::promise<void> done;
+    evloop.dispatch([&]() {
+      fn();
+      done.set_value();
+    });
+    done.get_future().get();
+  };
+
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+
+  std::shared_ptr<apex::EmbeddedGateway> gateway;
+  std::shared_ptr<EchoExchange> exchange;
+  apex::MarketData market;
+  on_evloop([&]() {
+    gateway = std::make_shared<apex::EmbeddedGateway>(
+        ioloop, evloop, nullptr,
+        [&](apex::BaseExchangeSession::EventCallbacks callbacks,
+            apex::IoLoop* io, apex::RealtimeEventLoop& ev) {
+          exchange = std::make_shared<EchoExchange>(std::move(callbacks), io, ev);
+          return exchange;
+        });
+    REQUIRE(exchange->started);
+    REQUIRE(gateway->exchange_id() == apex::ExchangeId::binance);
+
+    // ticks are applied directly; a later subscription adds only the
+    // streams not yet subscribed to
+    gateway->subscribe("BTCUSDT", &market, static_cast<int>(apex::MdStream::L1));
+    REQUIRE(market.bid() == 100);
+    REQUIRE(!market.has_last());
+    gateway->subscribe("BTCUSDT", &market);
+    REQUIRE(market.last().price == 100.5);
+    REQUIRE(exchange->top_subs == 1);
+    REQUIRE(exchange->trade_subs == 1);
+  });
+
+  apex::EmbeddedOrderRouter router(gateway);
+  auto order = std::make_shared<apex::Order>(
+      &services, &router, instrument, apex::Side::buy, 1.0, 99.0,
+      apex::TimeInForce::gtc, "TST1");
+  auto bad = std::make_shared<apex::Order>(
+      &services, &router, instrument, apex::Side::buy, 1.0, -1.0,
+      apex::TimeInForce::gtc, "TST2");
+
+  // a reply within the request follows the order becoming 'sent'
+  on_evloop([&]() {
+    order->send();
+    bad->send();
+    REQUIRE(order->state() == apex::OrderState::sent);
+    REQUIRE(exchange->submitted.size() == 2);
+    REQUIRE(exchange->submitted[0].order_id.str() == "TST1");
+    REQUIRE(exchange->submitted[0].symbol.str() == "BTCUSDT");
+    REQUIRE(exchange->submitted[0].price == 99.0);
+    REQUIRE(exchange->submitted[0].side == apex::Side::buy);
+  });
+  on_evloop([&]() {
+    REQUIRE(order->is_live());
+    REQUIRE(order->exch_order_id() == "X1");
+    REQUIRE(bad->is_rejected());
+    REQUIRE(bad->error_code() == "e9999");
+    REQUIRE(order->cancel());
+  });
+  on_evloop([&]() {
+    REQUIRE(exchange->cancelled.size() == 1);
+    REQUIRE(exchange->cancelled[0] == "TST1/X1");
+    REQUIRE(order->is_closed());
+    REQUIRE(order->close_reason() == apex::OrderCloseReason::cancelled);
+  });
+
+  on_evloop([&]() {
+    gateway.reset();
+    exchange.reset();
+  });
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gx_subscribe_proto")
+{
+  // proto3 ticks carry no symbol, and are routed by the subscription id
+  apex::TickTop top;
+  top.bid_price = 100;
+  top.ask_price = 101;
+  auto frame = apex::GxServerSession::encode(top);
+  apex::pb::TickTop encoded;
+  REQUIRE(encoded.ParseFromArray(frame->data() + sizeof(apex::gx::Header),
+                                 frame->size() - sizeof(apex::gx::Header)));
+  REQUIRE(encoded.symbol().empty());
+  REQUIRE(encoded.bid_price() == 100);
+
+  apex::GxServer server(apex::RunMode::live,
+                        apex::Config{json{{"port", 5798}}});
+  server.add_venue([](apex::BaseExchangeSession::EventCallbacks callbacks,
+                      apex::IoLoop* ioloop, apex::RealtimeEventLoop& event_loop) {
+    return std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                           event_loop);
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  auto client = std::make_shared<apex::GxClientSession>(
+      ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+      nullptr);
+  client->set_binary_encoding(false);
+
+  const std::vector<std::string> symbols = {"BTCUSDT", "DOGEUSDT"};
+  std::vector<std::unique_ptr<apex::MarketData>> markets;
+  for (auto& symbol : symbols) {
+    markets.push_back(std::make_unique<apex::MarketData>());
+    client->subscribe(symbol, apex::ExchangeId::binance, markets.back().get());
+  }
+  client->start_connecting();
+
+  auto all_ticked = [&]() {
+    std::promise<bool> ticked;
+    evloop.dispatch([&]() {
+      bool result = true;
+      for (auto& market : markets)
+        result = result && market->has_bid_ask() && market->has_last();
+      ticked.set_value(result);
+    });
+    return ticked.get_future().get();
+  };
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!all_ticked() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(all_ticked());
+
+  std::promise<void> checked;
+  evloop.dispatch([&]() {
+    for (size_t i = 0; i < symbols.size(); i++) {
+      REQUIRE(markets[i]->bid() == 100 + symbols[i].size());
+      REQUIRE(markets[i]->last().price == 100.5);
+    }
+    checked.set_value();
+  });
+  checked.get_future().get();
+
+  client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("gx_venue_threads")
+{
+  // The venue runs on loops of its own, and GX sessions are spread over two
+  // IO loops listening on the same port.
+  apex::GxServer server(
+      apex::RunMode::live,
+      apex::Config{json{{"port", 5797}, {"venue_threads", true},
+                        {"gx_io_threads", 2}}});
+  std::shared_ptr<QuietExchange> venue;
+  server.add_venue([&](apex::BaseExchangeSession::EventCallbacks callbacks,
+                       apex::IoLoop* ioloop,
+                       apex::RealtimeEventLoop& event_loop) {
+    venue = std::make_shared<QuietExchange>(std::move(callbacks), ioloop,
+                                            event_loop);
+    return venue;
+  });
+  server.start();
+
+  apex::IoLoop ioloop;
+  apex::RealtimeEventLoop evloop([]() { return false; });
+  std::vector<std::shared_ptr<apex::GxClientSession>> clients;
+  std::vector<std::unique_ptr<apex::MarketData>> markets;
+  for (auto& symbol : {"BTCUSDT", "ETHUSDT", "DOGEUSDT", "SOLUSDT"}) {
+    auto client = std::make_shared<apex::GxClientSession>(
+        ioloop, evloop, "127.0.0.1", std::to_string(server.get_listen_port()),
+        nullptr);
+    markets.push_back(std::make_unique<apex::MarketData>());
+    client->subscribe(symbol, apex::ExchangeId::binance, markets.back().get());
+    client->start_connecting();
+    clients.push_back(std::move(client));
+  }
+
+  auto all_good = [&]() {
+    std::promise<bool> good;
+    evloop.dispatch([&]() {
+      bool result = true;
+      for (auto& market : markets)
+        result = result && market->is_good();
+      good.set_value(result);
+    });
+    return good.get_future().get();
+  };
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (!all_good() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  REQUIRE(all_good());
+
+  REQUIRE(venue);
+  REQUIRE(venue->off_thread_calls == 0);
+
+  for (auto& client : clients)
+    client->close();
+  evloop.sync_stop();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("ioloop_defer_fn")
+{
+  // deferred functions run on the IO thread at the end of an iteration, and
+  // not before their delay has elapsed
+  apex::IoLoop ioloop;
+
+  std::promise<bool> on_io;
+  ioloop.defer_fn([&]() { on_io.set_value(ioloop.this_thread_is_io()); });
+  REQUIRE(on_io.get_future().get());
+
+  // functions deferred from the IO thread, including by a deferred function
+  std::promise<int> nested;
+  ioloop.push_fn([&]() {
+    ioloop.defer_fn([&]() {
+      ioloop.defer_fn([&]() { nested.set_value(2); });
+    });
+  });
+  REQUIRE(nested.get_future().get() == 2);
+
+  auto start = std::chrono::steady_clock::now();
+  std::promise<std::chrono::steady_clock::time_point> delayed;
+  ioloop.defer_fn([&]() { delayed.set_value(std::chrono::steady_clock::now()); },
+                  std::chrono::milliseconds(20));
+  auto elapsed = delayed.get_future().get() - start;
+  REQUIRE(elapsed >= std::chrono::milliseconds(20));
+
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("read_buffer_pool")
+{
+  apex::ReadBufferPool pool;
+
+  // buffers are recycled, so steady state reads allocate nothing
+  char* first = pool.acquire();
+  pool.release(first);
+  REQUIRE(pool.acquire() == first);
+  pool.release(first);
+  REQUIRE(pool.stats().capacity == apex::ReadBufferPool::buffers_per_slab);
+
+  // a further slab is added only once all buffers are in flight
+  std::vector<char*> held;
+  for (size_t i = 0; i <= apex::ReadBufferPool::buffers_per_slab; i++)
+    held.push_back(pool.acquire());
+  auto stats = pool.stats();
+  REQUIRE(stats.in_flight == held.size());
+  REQUIRE(stats.capacity == 2 * apex::ReadBufferPool::buffers_per_slab);
+  REQUIRE(std::set<char*>(held.begin(), held.end()).size() == held.size());
+
+  for (auto* buf : held)
+    pool.release(buf);
+  stats = pool.stats();
+  REQUIRE(stats.in_flight == 0);
+  REQUIRE(stats.peak_in_flight == held.size());
+  REQUIRE(stats.acquired == held.size() + 2);
+}
+
+
+TEST_CASE("binance_depth")
+{
+  using namespace apex::binance;
+
+  apex::TickBookDelta snapshot;
+  uint64_t last_update_id = 0;
+  REQUIRE(decode_depth_snapshot(
+      R"({"lastUpdateId":160,"bids":[["10.0","1"],["9.0","2"],["11.0","3"]],)"
+      R"("asks":[["12.0","4"],["13.0","5"]]})",
+      last_update_id, snapshot));
+  REQUIRE(last_update_id == 160);
+  REQUIRE(snapshot.is_snapshot);
+  REQUIRE(snapshot.bids.size() == 3);
+
+  apex::Book book;
+  book.apply(snapshot);
+  REQUIRE(book.is_valid());
+  REQUIRE(book.bid_depth() == 3);
+  REQUIRE(book.bid(0).price == 11.0);
+  REQUIRE(book.bid(2).price == 9.0);
+  REQUIRE(book.ask(0).price == 12.0);
+
+  DepthUpdate update;
+  apex::TickBookDelta delta;
+  REQUIRE(decode_depth_update(
+      R"({"e":"depthUpdate","E":123456789,"s":"BNBBTC","U":157,"u":161,)"
+      R"("b":[["11.0","0"],["10.5","7"]],"a":[["12.5","1"],["13.0","6"]]})",
+      update, delta));
+  REQUIRE(update.first_update_id == 157);
+  REQUIRE(update.final_update_id == 161);
+  REQUIRE(!delta.is_snapshot);
+
+  // zero quantity removes a level, others are inserted or replaced
+  book.apply(delta);
+  REQUIRE(book.bid_depth() == 3);
+  REQUIRE(book.bid(0).price == 10.5);
+  REQUIRE(book.bid(0).qty == 7);
+  REQUIRE(book.bid(1).price == 10.0);
+  REQUIRE(book.ask_depth() == 3);
+  REQUIRE(book.ask(0).price == 12.0);
+  REQUIRE(book.ask(1).price == 12.5);
+  REQUIRE(book.ask(2).qty == 6);
+
+  // a snapshot replaces all levels
+  snapshot.bids.resize(1);
+  book.apply(snapshot);
+  REQUIRE(book.bid_depth() == 1);
+  REQUIRE(book.ask_depth() == 2);
+
+  REQUIRE(!decode_depth_update(R"({"U":1,"u":2,"b":[["1.0"]],"a":[]})",
+                               update, delta));
+}
+
+
+TEST_CASE("fixed_book")
+{
+  apex::TickBookDelta delta;
+  delta.is_snapshot = true;
+  delta.bids = {{100.0, 1}, {99.0, 2}, {98.0, 3}};
+  delta.asks = {{101.0, 2}, {102.0, 2}, {103.0, 4}, {104.0, 1}};
+
+  apex::Book book;
+  book.apply(delta);
+
+  apex::FixedBook<3> fixed;
+  REQUIRE(!fixed.is_valid());
+  fixed.assign(book);
+  REQUIRE(fixed.is_valid());
+  REQUIRE(fixed.bids().depth == 3);
+  REQUIRE(fixed.asks().depth == 3);
+  REQUIRE(fixed.asks().price[0] == 101.0);
+  REQUIRE(fixed.asks().price[2] == 103.0);
+  REQUIRE(fixed.asks().qty[3] == 0); // padding
+
+  REQUIRE(fixed.depth_to_size(apex::Side::buy, 2) == 101.0);
+  REQUIRE(fixed.depth_to_size(apex::Side::buy, 3) == 102.0);
+  REQUIRE(fixed.depth_to_size(apex::Side::sell, 6) == 98.0);
+  REQUIRE(std::isnan(fixed.depth_to_size(apex::Side::buy, 9)));
+
+  REQUIRE(fixed.vwap_to_fill(apex::Side::buy, 2) == 101.0);
+  REQUIRE(fixed.vwap_to_fill(apex::Side::buy, 4) == 101.5);
+  REQUIRE(fixed.vwap_to_fill(apex::Side::sell, 3) == (100.0 + 2 * 99.0) / 3);
+  REQUIRE(std::isnan(fixed.vwap_to_fill(apex::Side::sell, 7)));
+
+  REQUIRE(fixed.imbalance(1) == (1.0 - 2.0) / 3.0);
+  REQUIRE(fixed.imbalance() == (6.0 - 8.0) / 14.0);
+
+  fixed.clear();
+  REQUIRE(!fixed.is_valid());
+  REQUIRE(std::isnan(fixed.imbalance()));
+}
+
+
+TEST_CASE("seqlock_snapshot")
+{
+  // readers must never observe a torn value
+  struct Pair {
+    uint64_t a;
+    uint64_t b;
+    uint64_t pad[6];
+  };
+  apex::SeqLock<Pair> lock(Pair{0, 0, {}});
+  std::atomic<bool> done{false};
+  std::atomic<int> torn{0};
+
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 2; i++)
+    readers.emplace_back([&]() {
+      while (!done) {
+        Pair p = lock.read();
+        if (p.a != p.b)
+          torn++;
+      }
+    });
+
+  for (uint64_t i = 1; i <= 200000; i++)
+    lock.write(Pair{i, i, {}});
+  done = true;
+  for (auto& t : readers)
+    t.join();
+  REQUIRE(torn == 0);
+  REQUIRE(lock.version() == 200000);
+  REQUIRE(lock.read().a == 200000);
+
+  apex::MarketData md;
+  REQUIRE(md.snapshot() == nullptr);
+  md.enable_snapshot();
+  REQUIRE(md.snapshot() != nullptr);
+
+  apex::TickTop top;
+  top.bid_price = 10;
+  top.bid_qty = 1;
+  top.ask_price = 11;
+  top.ask_qty = 2;
+  md.apply(top);
+
+  apex::TickTrade trade;
+  trade.price = 10.5;
+  trade.qty = 3;
+  trade.aggr_side = apex::Side::buy;
+  md.apply(trade);
+
+  auto snap = md.snapshot()->read();
+  REQUIRE(snap.bid.price == 10);
+  REQUIRE(snap.ask.qty == 2);
+  REQUIRE(snap.last_price == 10.5);
+  REQUIRE(snap.last_side == apex::Side::buy);
+  REQUIRE(std::isnan(snap.bids[0].price));
+}
+
+
+TEST_CASE("indicators")
+{
+  using namespace std::chrono_literals;
+
+  apex::Ewma ewma(1s);
+  ewma.update(apex::Time(0, 0ms), 10.0);
+  REQUIRE(ewma.value() == 10.0);
+  ewma.update(apex::Time(1, 0ms), 20.0);
+  REQUIRE(std::abs(ewma.value() - 15.0) < 1e-9);
+
+  apex::Welford w;
+  for (double x : {2.0, 4.0, 4.0, 4.0, 5.0, 5.0, 7.0, 9.0})
+    w.update(x);
+  REQUIRE(w.count() == 8);
+  REQUIRE(w.mean() == 5.0);
+  REQUIRE(std::abs(w.variance() - 32.0 / 7.0) < 1e-12);
+
+  apex::RollingMax high(2s);
+  high.update(apex::Time(0, 0ms), 5);
+  high.update(apex::Time(1, 0ms), 3);
+  REQUIRE(high.value() == 5);
+  high.update(apex::Time(2, 500ms), 4);
+  REQUIRE(high.value() == 4); // 5 has left the window
+  high.update(apex::Time(3, 0ms), 1);
+  REQUIRE(high.value() == 4);
+
+  // shared between users, and updated ahead of listeners
+  apex::MarketData md;
+  auto& vwap = md.indicators().vwap(1h);
+  REQUIRE(&vwap == &md.indicators().vwap(1h));
+  auto& flow = md.indicators().trade_flow(1h);
+  auto& low = md.indicators().trade_low(1h);
+
+  double seen = 0;
+  md.subscribe_events([&](apex::MarketData::EventType) { seen = vwap.value(); });
+
+  apex::TickTrade trade;
+  trade.et = apex::Time(100, 0ms);
+  trade.price = 10;
+  trade.qty = 1;
+  trade.aggr_side = apex::Side::buy;
+  md.apply(trade);
+  REQUIRE(seen == 10);
+  trade.price = 13;
+  trade.qty = 2;
+  trade.aggr_side = apex::Side::sell;
+  md.apply(trade);
+  REQUIRE(std::abs(vwap.value() - 12.0) < 1e-4);
+  REQUIRE(std::abs(flow.value() + 1.0 / 3.0) < 1e-4);
+  REQUIRE(low.value() == 10);
+  REQUIRE(std::abs(seen - vwap.value()) < 1e-12);
+}
+
+
+TEST_CASE("tick_path_allocations")
+{
+  // decode, dispatch, market-data update and binary frame encode of a tick
+  // must not allocate once warm
+  std::string data =
+      R"({"e":"aggTrade","E":1672515782136,"s":"BTCUSDT","a":12345,)"
+      R"("p":"16500.12","q":"0.25","f":100,"l":105,"T":1672515782135,)"
+      R"("m":true,"M":true})";
+
+  apex::MarketData md;
+  double seen = 0;
+  md.subscribe_events([&](apex::MarketData::EventType) { seen = md.last().price; });
+  auto& vwap = md.indicators().vwap(std::chrono::seconds(10));
+  apex::gx::FramePool pool;
+  std::vector<std::shared_ptr<const apex::gx::Frame>> queued;
+  queued.reserve(8);
+
+  std::function<void(const apex::TickTrade&)> callback =
+      [&](const apex::TickTrade& tick) {
+        md.apply(tick);
+        queued.push_back(apex::GxServerSession::encode_binary(pool, tick));
+      };
+
+  auto one_tick = [&]() {
+    apex::TickTrade tick;
+    REQUIRE(apex::binance::decode_agg_trade(data, tick));
+    apex::EventLoop::inline_fn fn([&callback, tick] { callback(tick); });
+    fn();
+    if (queued.size() == 4)
+      queued.clear(); // as if written to the sockets
+  };
+
+  for (int i = 0; i < 16; i++)
+    one_tick();
+
+  const auto allocations = apex::alloc::thread_counters.count;
+  for (int i = 0; i < 1000; i++)
+    one_tick();
+  REQUIRE(apex::alloc::thread_counters.count == allocations);
+  REQUIRE(seen == 16500.12);
+  REQUIRE(vwap.is_valid());
+  REQUIRE(pool.size() <= 5);
+}
+
+
+TEST_CASE("latency_trace")
+{
+  auto& tracer = apex::trace::tracer();
+  tracer.snapshot(apex::trace::Stage::md_apply, true);
+  tracer.snapshot(apex::trace::Stage::gx_decode, true);
+
+  // untraced ticks, and any tick while disabled, record nothing
+  REQUIRE(!tracer.receive().is_traced());
+  apex::MarketData md;
+  apex::TickTrade trade;
+  trade.price = 1;
+  trade.qty = 1;
+  md.apply(trade);
+  REQUIRE(tracer.snapshot(apex::trace::Stage::md_apply).since_previous.count == 0);
+
+  tracer.enable(true);
+  auto stamp = tracer.receive();
+  REQUIRE(stamp.is_traced());
+  REQUIRE(stamp.rt == stamp.st);
+
+  // carried across the binary encoding
+  trade.trace = stamp;
+  apex::gx::FramePool pool;
+  auto frame = apex::GxServerSession::encode_binary(pool, trade);
+  auto* msg = apex::gx::bin::cast<apex::gx::bin::TickTrade>(
+      frame->data() + sizeof(apex::gx::Header),
+      frame->size() - sizeof(apex::gx::Header));
+  REQUIRE(msg != nullptr);
+  REQUIRE(msg->rt == stamp.rt);
+
+  apex::trace::Stamp decoded{msg->rt, msg->st};
+  std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  tracer.mark(apex::trace::Stage::gx_decode, decoded);
+  REQUIRE(decoded.st >= stamp.rt + 1000000);
+
+  trade.trace = decoded;
+  md.apply(trade);
+  REQUIRE(md.last_trace().rt == stamp.rt);
+  REQUIRE(md.last_trace().st >= decoded.st);
+  tracer.enable(false);
+
+  auto decode = tracer.snapshot(apex::trace::Stage::gx_decode, true);
+  auto apply = tracer.snapshot(apex::trace::Stage::md_apply, true);
+  REQUIRE(decode.since_previous.count == 1);
+  REQUIRE(decode.since_receive.max >= 1000000);
+  REQUIRE(apply.since_previous.count == 1);
+  REQUIRE(apply.since_previous.max < apply.since_receive.max);
+}
+
+
+TEST_CASE("metrics_registry")
+{
+  auto& registry = apex::metrics::registry();
+
+  // updates from several threads are summed across their cells
+  auto& counter = registry.counter("test_events_total", "Test events");
+  REQUIRE(&registry.counter("test_events_total", "") == &counter);
+  const uint64_t start = counter.value();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 20; t++)
+    threads.emplace_back([&counter] {
+      for (int i = 0; i < 1000; i++)
+        counter.add();
+    });
+  for (auto& thread : threads)
+    thread.join();
+  REQUIRE(counter.value() == start + 20000);
+
+  bool threw = false;
+  try {
+    registry.gauge("test_events_total", "");
+  } catch (std::exception&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+
+  auto& gauge = registry.gauge("test_level", "Test level");
+  gauge.set(5);
+  gauge.add(-2);
+  REQUIRE(gauge.value() == 3);
+
+  // bucket i holds values above 2^(i-1) and up to 2^i
+  using apex::metrics::Histogram;
+  REQUIRE(Histogram::bucket_of(0) == 0);
+  REQUIRE(Histogram::bucket_of(1) == 0);
+  REQUIRE(Histogram::bucket_of(2) == 1);
+  REQUIRE(Histogram::bucket_of(3) == 2);
+  REQUIRE(Histogram::bucket_of(1024) == 10);
+  REQUIRE(Histogram::bucket_of(1025) == 11);
+  REQUIRE(Histogram::bucket_of(~uint64_t(0)) == Histogram::bucket_count - 1);
+
+  auto& hist = registry.histogram("test_latency_ns", "Test latency");
+  for (uint64_t v : {1, 1000, 1000, 5000})
+    hist.record(v);
+  auto snap = hist.snapshot();
+  REQUIRE(snap.count == 4);
+  REQUIRE(snap.sum == 7001);
+  REQUIRE(snap.counts[10] == 2);
+
+  // collectors refresh gauges on read
+  auto id = registry.add_collector([&gauge] { gauge.set(42); });
+  std::ostringstream oss;
+  registry.write_prometheus(oss);
+  registry.remove_collector(id);
+  const auto text = oss.str();
+  REQUIRE(text.find("# TYPE test_events_total counter\ntest_events_total " +
+                    std::to_string(start + 20000) + "\n") != std::string::npos);
+  REQUIRE(text.find("test_level 42\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_ns_bucket{le=\"1\"} 1\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_ns_bucket{le=\"1024\"} 3\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_ns_bucket{le=\"+Inf\"} 4\n") != std::string::npos);
+  REQUIRE(text.find("test_latency_ns_sum 7001\n") != std::string::npos);
+  REQUIRE(text.find("apex_evloop_events_total") != std::string::npos);
+}
+
+
+TEST_CASE("gx_traffic_stats")
+{
+  using apex::gx::Type;
+  auto& in_trades = apex::metrics::registry().counter(
+    "apex_gx_in_messages_total{type=\"trade\"}", "");
+  const uint64_t start = in_trades.value();
+
+  apex::gx::TrafficTable table;
+  table.record_in(Type::trade, 40, 100);
+  table.record_in(Type::trade, 48, 300);
+  table.record_out(Type::trade, 40);
+  table.record_out(Type::new_order, 64);
+
+  auto stats = table.snapshot();
+  REQUIRE(stats.size() == 2);
+  REQUIRE(stats[0].first == Type::new_order); // 'D' precedes 't'
+  REQUIRE(stats[0].second.in_messages == 0);
+  REQUIRE(stats[0].second.out_messages == 1);
+  REQUIRE(stats[0].second.out_bytes == 64);
+  REQUIRE(stats[1].first == Type::trade);
+  REQUIRE(stats[1].second.in_messages == 2);
+  REQUIRE(stats[1].second.in_bytes == 88);
+  REQUIRE(stats[1].second.in_nanos == 400);
+  REQUIRE(stats[1].second.out_bytes == 40);
+
+  // also accumulated into the process wide counters, labelled by type
+  REQUIRE(in_trades.value() == start + 2);
+  std::ostringstream oss;
+  apex::metrics::registry().write_prometheus(oss);
+  const auto text = oss.str();
+  REQUIRE(text.find("# TYPE apex_gx_out_bytes_total counter\n") !=
+          std::string::npos);
+  REQUIRE(text.find("apex_gx_out_bytes_total{type=\"new_order\"} ") !=
+          std::string::npos);
+  REQUIRE(text.find("# TYPE apex_gx_in_messages_total counter\n") ==
+          text.rfind("# TYPE apex_gx_in_messages_total"));
+  REQUIRE(std::string(apex::gx::type_name(Type::order_exec)) == "order_exec");
+}
+
+
+TEST_CASE("profiler_zones")
+{
+  auto& profiler = apex::profile::profiler();
+
+  { APEX_PROFILE_ZONE("test_disabled_zone"); }
+
+  profiler.set_ring_capacity(8);
+  profiler.enable(true);
+  std::thread worker([&] {
+    profiler.set_thread_name("test \"worker\"");
+    for (int i = 0; i < 20; i++) {
+      APEX_PROFILE_ZONE("test_zone");
+    }
+    APEX_PROFILE_ZONE("test_outer_zone");
+    std::ostringstream oss;
+    // the ring keeps the most recent zones; the outer zone is still open
+    REQUIRE(profiler.write_chrome_trace(oss) >= 8);
+    const auto text = oss.str();
+    REQUIRE(text.find("\"name\":\"test_zone\"") != std::string::npos);
+    REQUIRE(text.find("test_outer_zone") == std::string::npos);
+    REQUIRE(text.find("{\"name\":\"test \\\"worker\\\"\"}") !=
+            std::string::npos);
+  });
+  worker.join();
+  profiler.enable(false);
+  profiler.set_ring_capacity(32768);
+
+  // the rings of exited threads are released
+  std::ostringstream oss;
+  profiler.write_chrome_trace(oss);
+  REQUIRE(oss.str().find("test_zone") == std::string::npos);
+  REQUIRE(oss.str().find("test_disabled_zone") == std::string::npos);
+}
+
+
+TEST_CASE("alloc_guard")
+{
+  namespace alloc = apex::alloc;
+
+  // allocations are counted by hand, on top of those counted by the hook;
+  // disabled scopes see nothing
+  auto allocate = [](int n) {
+    APEX_NO_ALLOC_SCOPE("test_alloc_scope");
+    alloc::thread_counters.count += n;
+  };
+  allocate(1);
+  REQUIRE(alloc::total_violations() == 0);
+
+  alloc::set_guard_mode(alloc::GuardMode::log);
+  allocate(0);
+  REQUIRE(alloc::total_violations() == 0);
+  allocate(3);
+  allocate(2);
+  alloc::set_guard_mode(alloc::GuardMode::off);
+  REQUIRE(alloc::total_violations() == 2);
+  std::ostringstream oss;
+  REQUIRE(alloc::write_report(oss) == 1);
+  REQUIRE(oss.str() == "test_alloc_scope: 2 violations, 5 allocations\n");
+
+  alloc::reset_violations();
+  REQUIRE(alloc::total_violations() == 0);
+
+  // the hook is linked into the test runner, so the config enables the guards
+  REQUIRE(alloc::hook_installed());
+  alloc::configure(apex::Config(json::parse(R"({
+    "alloc_guard": { "mode": "log" } })")));
+  REQUIRE(alloc::guard_mode() == alloc::GuardMode::log);
+  alloc::set_guard_mode(alloc::GuardMode::off);
+  bool threw = false;
+  try {
+    alloc::configure(apex::Config(json::parse(R"({
+      "alloc_guard": { "mode": "sometimes" } })")));
+  } catch (apex::ConfigError&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+}
+
+
+TEST_CASE("memory_account")
+{
+  namespace memory = apex::memory;
+
+  // charges follow their owners, copies charge again, moves transfer
+  static memory::Account account("test_subsystem");
+  {
+    memory::Charge charge(account);
+    charge.set(1000);
+    REQUIRE(account.bytes() == 1000);
+    {
+      memory::Charge copy(charge);
+      REQUIRE(account.bytes() == 2000);
+      memory::Charge moved(std::move(copy));
+      moved.set(500);
+      REQUIRE(account.bytes() == 1500);
+    }
+    REQUIRE(account.bytes() == 1000);
+    REQUIRE(account.peak() == 2000);
+  }
+  REQUIRE(account.bytes() == 0);
+
+  auto& gauge = apex::metrics::registry().gauge(
+      "apex_memory_peak_bytes{subsystem=\"test_subsystem\"}", "");
+  REQUIRE(gauge.value() == 2000);
+
+  // a decode buffer is charged at its capacity as it grows
+  auto& decode = apex::metrics::registry().gauge(
+      "apex_memory_bytes{subsystem=\"decode_buffers\"}", "");
+  const auto before = decode.value();
+  {
+    apex::DecodeBuffer buf(100, 100000);
+    std::string bytes(5000, 'x');
+    buf.consume(bytes.data(), bytes.size());
+    REQUIRE(decode.value() >= before + 5000);
+  }
+  REQUIRE(decode.value() == before);
+
+  // pooled blocks stay charged while free, until the pool releases them
+  {
+    apex::BlockPool pool(1, &account);
+    auto* a = pool.allocate(64);
+    auto* b = pool.allocate(64);
+    REQUIRE(account.bytes() == 128);
+    pool.deallocate(a, 64);
+    pool.deallocate(b, 64);
+    REQUIRE(account.bytes() == 64);
+  }
+  REQUIRE(account.bytes() == 0);
+
+  std::ostringstream os;
+  memory::write_report(os);
+  REQUIRE(os.str().find("test_subsystem") != std::string::npos);
+  REQUIRE(os.str().find("resident") != std::string::npos);
+  REQUIRE(memory::resident_bytes() > 0);
+}
+
+
+TEST_CASE("memory_arena")
+{
+  using apex::memory::Arena;
+
+  // sizes round up to whole 2MB pages, whatever the backing obtained
+  Arena arena(3 * 1024 * 1024, true);
+  REQUIRE(arena.size() == 4 * 1024 * 1024);
+  REQUIRE(arena.huge_page_bytes() <= arena.size());
+  if (arena.backing() != apex::memory::Backing::normal)
+    REQUIRE(arena.huge_page_bytes() > 0);
+
+  auto* first = static_cast<char*>(arena.allocate(10, 1));
+  auto* second = static_cast<char*>(arena.allocate(64, 64));
+  REQUIRE(first != nullptr);
+  REQUIRE(reinterpret_cast<uintptr_t>(second) % 64 == 0);
+  REQUIRE(second >= first + 10);
+  REQUIRE(arena.contains(first));
+  REQUIRE(arena.contains(second + 63));
+  REQUIRE(arena.allocate(arena.size(), 1) == nullptr);
+  REQUIRE(arena.used() == size_t(second + 64 - first));
+
+  // without a process arena, storage comes from the heap
+  REQUIRE(apex::memory::arena() == nullptr);
+  auto values = apex::memory::make_array<std::string>(3);
+  values[2] = "x";
+  REQUIRE(values[0].empty());
+  REQUIRE(!apex::memory::in_arena(values.get()));
+}
+
+
+TEST_CASE("numa_placement")
+{
+  namespace numa = apex::numa;
+
+  // every node of a host with sysfs lists its cpus
+  const int nodes = numa::node_count();
+  for (int node = 0; node < nodes; node++)
+    REQUIRE(!numa::node_cpus(node).empty());
+  REQUIRE(numa::node_cpus(nodes).empty());
+  REQUIRE(numa::interface_node("lo") == -1);
+
+  // threads default to the configured node, unless given their own
+  REQUIRE(numa::default_node() == -1);
+  REQUIRE(apex::parse_thread_params(apex::Config::empty_config()).empty());
+  numa::set_default_node(0);
+  auto params = apex::parse_thread_params(apex::Config::empty_config());
+  REQUIRE(params.numa_node == 0);
+  params = apex::parse_thread_params(apex::Config{json{{"numa_node", 1}}});
+  REQUIRE(params.numa_node == 1);
+  numa::set_default_node(-1);
+
+  // no "numa" field, no placement
+  REQUIRE(numa::configure(apex::Config{json{{"io", json::object()}}}) == -1);
+  bool threw = false;
+  try {
+    numa::configure(apex::Config{json{{"numa", {{"node", nodes}}}}});
+  } catch (apex::ConfigError&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+  REQUIRE(numa::default_node() == -1);
+}
+
+
+TEST_CASE("warmup_router")
+{
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::WarmupOrderRouter router(&services);
+  REQUIRE(router.is_up());
+
+  std::vector<std::shared_ptr<apex::Order>> orders;
+  for (int i = 0; i < 3; i++) {
+    orders.push_back(std::make_shared<apex::Order>(
+        &services, &router, instrument, apex::Side::buy, 1.0, 100.0 - i,
+        apex::TimeInForce::gtc, "TST" + std::to_string(i)));
+    orders.back()->send();
+  }
+  REQUIRE(router.orders_sent() == 3);
+
+  // accepted on the event loop, like an exchange reply
+  REQUIRE(orders[0]->state() == apex::OrderState::sent);
+  services.backtest_evloop()->run_loop({});
+  for (auto& order : orders)
+    REQUIRE(order->is_live());
+
+  orders[0]->cancel();
+  REQUIRE(orders[1]->amend(97.0, 2.0));
+  services.backtest_evloop()->run_loop({});
+  REQUIRE(orders[0]->is_closed());
+  REQUIRE(orders[0]->close_reason() == apex::OrderCloseReason::cancelled);
+  REQUIRE(orders[1]->price() == 97.0);
+  REQUIRE(orders[1]->is_live());
+
+  // closing ends the orders outright, even one with an amend pending
+  REQUIRE(orders[2]->amend(96.0, 1.0));
+  router.close_all();
+  services.backtest_evloop()->run_loop({});
+  for (auto& order : orders)
+    REQUIRE(order->is_closed());
+  REQUIRE(orders[2]->price() == 98.0);
+
+  // a reserved table does not move its entries as it fills
+  apex::OpenAddressMap<int> map;
+  map.reserve(100);
+  int* first = &map.insert(1, 1);
+  for (uint64_t key = 2; key <= 100; key++)
+    map.insert(key, static_cast<int>(key));
+  REQUIRE(map.find(1) == first);
+}
+
+
+TEST_CASE("bot_timer")
+{
+  struct TimerBot : apex::Bot {
+    TimerBot(apex::Strategy* strategy, const apex::Instrument& instrument)
+      : apex::Bot("timer", strategy, instrument)
+    {
+    }
+    void on_timer() override
+    {
+      calls.push_back(_services->now());
+      if (hook)
+        hook();
+    }
+    std::vector<apex::Time> calls;
+    std::function<void()> hook;
+  };
+
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto at = [start](int ms) {
+    auto t = start;
+    t += std::chrono::milliseconds(ms);
+    return t;
+  };
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::Strategy strategy(&services, apex::Config(json::parse(R"({
+    "code": "TIMER", "bot_timer": { "interval_ms": 1000, "stagger": 2 } })")));
+
+  // two bots, in different groups, called half an interval apart; added as
+  // by Bot::init, but on market data of their own
+  apex::MarketData md;
+  TimerBot first(&strategy, btc);
+  TimerBot second(&strategy, btc);
+  for (auto* bot : {&first, &second}) {
+    bot->begin_warmup(&md, nullptr);
+    strategy.add_timer_bot(bot);
+  }
+
+  // backtests skip the bots while their market data is unchanged
+  services.backtest_evloop()->run_loop(at(3000));
+  REQUIRE(first.calls.size() == 1);
+  REQUIRE(second.calls.size() == 1);
+  REQUIRE(first.calls[0] == at(500));
+  REQUIRE(second.calls[0] == at(1000));
+
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.ask_price = 101.0;
+  md.apply(top);
+  services.backtest_evloop()->run_loop(at(5000));
+  REQUIRE(first.calls.size() == 2);
+  REQUIRE(first.calls[1] == at(4500));
+  REQUIRE(second.calls.size() == 2); // same market data
+  REQUIRE(second.calls[1] == at(4000));
+
+  // a bot removed by the on_timer of an earlier one of its group does not
+  // cost the bot after it its call
+  apex::Strategy single(&services, apex::Config(json::parse(R"({
+    "code": "ALONE", "bot_timer": { "interval_ms": 1000 } })")));
+  TimerBot w(&single, btc), x(&single, btc), y(&single, btc), z(&single, btc);
+  for (auto* bot : {&w, &x, &y, &z}) {
+    bot->begin_warmup(&md, nullptr);
+    single.add_timer_bot(bot);
+  }
+  x.hook = [&]() { single.remove_timer_bot(&w); single.remove_timer_bot(&x); };
+  top.bid_price = 99.0;
+  md.apply(top);
+  services.backtest_evloop()->run_loop(at(6000));
+  REQUIRE(w.calls.size() == 1);
+  REQUIRE(x.calls.size() == 1);
+  REQUIRE(y.calls.size() == 1);
+  REQUIRE(z.calls.size() == 1);
+
+  // a removal off the EV thread has taken effect on return
+  std::thread([&]() { single.remove_timer_bot(&y); }).join();
+  top.bid_price = 98.0;
+  md.apply(top);
+  services.backtest_evloop()->run_loop(at(7000));
+  REQUIRE(y.calls.size() == 1);
+  REQUIRE(z.calls.size() == 2);
+}
+
+
+TEST_CASE("config_update")
+{
+  REQUIRE(apex::json_merge_diff(json::parse(R"({"a": 1, "b": {"c": 2, "d": 3}})"),
+                                json::parse(R"({"a": 1, "b": {"c": 4}, "e": 5})")) ==
+          json::parse(R"({"b": {"c": 4, "d": null}, "e": 5})"));
+  REQUIRE(apex::json_merge_diff(json::parse("[1]"), json::parse("[1]")).empty());
+
+  struct ParamBot : apex::Bot {
+    ParamBot(apex::Strategy* strategy, const apex::Instrument& instrument)
+      : apex::Bot("param", strategy, instrument)
+    {
+    }
+    void on_config_update(const json& changes) override
+    {
+      updates.push_back(changes);
+    }
+    std::vector<json> updates;
+  };
+
+  // bots depend on only the params of their own symbol
+  struct ParamStrategy : apex::Strategy {
+    using apex::Strategy::Strategy;
+    json bot_config(const apex::Instrument& instrument) const override
+    {
+      return _config.raw().at("params").value(instrument.native_symbol(),
+                                               json::object());
+    }
+    void on_config_update(const json& changes) override
+    {
+      updates.push_back(changes);
+    }
+    std::vector<json> updates;
+  };
+
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  ParamStrategy strategy(&services, apex::Config(json::parse(R"({
+    "code": "PARAM", "params": { "BTCUSDT": { "edge": 1, "size": 2 } } })")));
+  auto bot = std::make_unique<ParamBot>(&strategy, btc);
+  auto* bot_ptr = bot.get();
+  strategy.add_bot(std::move(bot));
+
+  strategy.update_config(apex::Config(json::parse(R"({
+    "code": "PARAM", "params": { "BTCUSDT": { "edge": 3, "size": 2 } } })")));
+  REQUIRE(bot_ptr->updates.size() == 1);
+  REQUIRE(bot_ptr->updates[0] == json::parse(R"({"edge": 3})"));
+  REQUIRE(strategy.updates.size() == 1);
+
+  // a change no bot depends on only reaches the strategy
+  strategy.update_config(apex::Config(json::parse(R"({ "code": "PARAM",
+    "params": { "BTCUSDT": { "edge": 3, "size": 2 } }, "limit": 9 })")));
+  REQUIRE(bot_ptr->updates.size() == 1);
+  REQUIRE(strategy.updates.size() == 2);
+  REQUIRE(strategy.updates[1] == json::parse(R"({"limit": 9})"));
+
+  // the strategy code cannot change
+  strategy.update_config(apex::Config(json::parse(R"({"code": "OTHER"})")));
+  REQUIRE(strategy.updates.size() == 2);
+  REQUIRE(strategy.bot_config(btc).at("edge") == 3);
+}
+
+
+TEST_CASE("static_bot")
+{
+  // handlers are called directly; top of book ticks are not delivered to a
+  // bot without on_tick_book
+  struct TradeBot final : apex::StaticBot<TradeBot> {
+    TradeBot(apex::Strategy* strategy, const apex::Instrument& instrument)
+      : apex::StaticBot<TradeBot>("static", strategy, instrument)
+    {
+    }
+    void attach(apex::MarketData* md)
+    {
+      begin_warmup(md, nullptr);
+      listen(md);
+    }
+    void on_tick_trade(apex::MarketData::EventType) override
+    {
+      prices.push_back(market().last().price);
+    }
+    std::vector<double> prices;
+  };
+  struct BookBot final : apex::StaticBot<BookBot> {
+    BookBot(apex::Strategy* strategy, const apex::Instrument& instrument)
+      : apex::StaticBot<BookBot>("static", strategy, instrument)
+    {
+    }
+    void attach(apex::MarketData* md)
+    {
+      begin_warmup(md, nullptr);
+      listen(md);
+    }
+    void on_tick_book(apex::MarketData::EventType) override { tops++; }
+    int tops = 0;
+  };
+
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::Strategy strategy(&services, apex::Config(json::parse(R"({
+    "code": "STATB" })")));
+  apex::MarketData md;
+  TradeBot bot(&strategy, btc);
+  BookBot book_bot(&strategy, btc);
+  bot.attach(&md);
+  book_bot.attach(&md);
+
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.ask_price = 101.0;
+  md.apply(top);
+  apex::TickTrade trade;
+  trade.price = 100.5;
+  trade.qty = 1.0;
+  md.apply(trade);
+  REQUIRE((bot.prices == std::vector<double>{100.5}));
+  REQUIRE(book_bot.tops == 1);
+
+  // stopping bots see no events
+  bot.stop();
+  trade.price = 100.75;
+  md.apply(trade);
+  REQUIRE(bot.prices.size() == 1);
+}
+
+
+TEST_CASE("strategy_host")
+{
+  struct HostedStrategy : apex::Strategy {
+    HostedStrategy(apex::Services* services, apex::Config config)
+      : apex::Strategy(services, config)
+    {
+    }
+  };
+  struct OtherStrategy final : HostedStrategy {
+    using HostedStrategy::HostedStrategy;
+  };
+
+  // strategies of several types are created by the "type" of their config
+  apex::StrategyFactories factories;
+  factories.add<HostedStrategy>("hosted").add<OtherStrategy>("other");
+
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::Config first_config(json::parse(R"({"type": "hosted", "code": "HOSTA"})"));
+  apex::Config second_config(json::parse(R"({"type": "other", "code": "HOSTB"})"));
+  auto first = factories.create(first_config, &services);
+  auto second = factories.create(second_config, &services);
+  REQUIRE(first->strategy_id() == "HOSTA");
+  REQUIRE(dynamic_cast<OtherStrategy*>(second.get()) != nullptr);
+  REQUIRE(first->services() == second->services());
+
+  bool threw = false;
+  try {
+    apex::Config unknown(json::parse(R"({"type": "none", "code": "HOSTC"})"));
+    factories.create(unknown, &services);
+  } catch (apex::ConfigError&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+
+  // drivers that choose the strategy at run time find it by type
+  REQUIRE(factories.find("other") != nullptr);
+  REQUIRE(factories.find("none") == nullptr);
+  REQUIRE((factories.types() == std::vector<std::string>{"hosted", "other"}));
+  apex::strategy_registry().add<OtherStrategy>("test_other");
+  auto registered = apex::strategy_registry().find("test_other");
+  REQUIRE(registered != nullptr);
+  REQUIRE(dynamic_cast<OtherStrategy*>(
+              registered->create(second_config, &services).get()) != nullptr);
+
+  // the portfolio limits of shared services apply to the sum of the
+  // strategies' portfolios
+  apex::Instrument sol(apex::InstrumentType::coinpair, "SOLUSDT.BINANCE",
+                       apex::Asset("SOL", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "SOLUSDT",
+                       "binance");
+  auto sol_iid = apex::InstrumentTable::instance().resolve(sol).iid();
+  apex::RiskService risk(&services,
+                         apex::Config(json::parse(R"({"max_net_usd": 3000})")));
+  risk.add_portfolio(&first->portfolio());
+  risk.add_portfolio(&second->portfolio());
+  apex::Portfolio::Entry first_entry(&first->portfolio());
+  apex::Portfolio::Entry second_entry(&second->portfolio());
+  first_entry.update(0, 2000);
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) == 0);
+  second_entry.update(0, 1000);
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) ==
+          apex::risk_net_exposure);
+  risk.remove_portfolio(&second->portfolio());
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) == 0);
+}
+
+
+TEST_CASE("status_segment")
+{
+  struct StatusBot final : apex::StaticBot<StatusBot> {
+    StatusBot(apex::Strategy* strategy, const apex::Instrument& instrument)
+      : apex::StaticBot<StatusBot>("status", strategy, instrument)
+    {
+    }
+    void attach(apex::MarketData* md)
+    {
+      begin_warmup(md, nullptr);
+      listen(md);
+    }
+  };
+
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::Strategy strategy(&services, apex::Config(json::parse(R"({
+    "code": "STATS" })")));
+  apex::MarketData md;
+  StatusBot bot(&strategy, btc);
+  bot.attach(&md);
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.bid_qty = 2.0;
+  top.ask_price = 101.0;
+  top.ask_qty = 3.0;
+  md.apply(top);
+
+  const std::string name = "/apex_test_status_" + std::to_string(::getpid());
+  auto segment = apex::StatusSegment::create(name, 2);
+  REQUIRE(segment->claim(3) == -1);
+  REQUIRE(segment->claim(1) == 0);
+  REQUIRE(segment->claim(1) == 1);
+  REQUIRE(segment->claim(1) == -1);
+
+  apex::BotStatus status;
+  apex::StatusPublisher::fill(bot, strategy.strategy_id(), 42, status);
+  segment->write(1, status);
+  segment->mark_published(42);
+
+  // a monitor maps the segment read-only, and sees only written slots
+  auto reader = apex::StatusSegment::open(name);
+  REQUIRE(reader->size() == 2);
+  REQUIRE(reader->engine_pid() == ::getpid());
+  REQUIRE(reader->publish_count() == 1);
+  REQUIRE(reader->published_us() == 42);
+  apex::BotStatus seen;
+  REQUIRE(!reader->read(0, seen));
+  REQUIRE(reader->read(1, seen));
+  REQUIRE(std::string(seen.strategy_id) == "STATS");
+  REQUIRE(std::string(seen.instrument_id) == "BTCUSDT.BINANCE");
+  REQUIRE(seen.update_us == 42);
+  REQUIRE(seen.bid == 100.0);
+  REQUIRE(seen.ask_qty == 3.0);
+  REQUIRE(seen.position == 0.0);
+  REQUIRE(seen.open_orders == 0);
+  REQUIRE(std::isnan(seen.last_price));
+
+  // a newer write replaces the slot
+  status.position = 1.5;
+  segment->write(1, status);
+  REQUIRE(reader->read(1, seen));
+  REQUIRE(seen.position == 1.5);
+
+  // the creator unlinks the segment
+  segment.reset();
+  bool threw = false;
+  try {
+    apex::StatusSegment::open(name);
+  } catch (std::exception&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+}
+
+
+TEST_CASE("risk_checks")
+{
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  apex::Instrument eth(apex::InstrumentType::coinpair, "ETHUSDT.BINANCE",
+                       apex::Asset("ETH", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "ETHUSDT",
+                       "binance");
+  auto btc_iid = apex::InstrumentTable::instance().resolve(btc).iid();
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+
+  apex::RiskService risk(&services, apex::Config(json::parse(R"({
+    "max_order_qty": 2.0, "max_notional": 1000, "max_position": 3.0,
+    "max_orders_per_sec": 4,
+    "instruments": { "ETHUSDT.BINANCE": { "max_notional": 0 } } })")));
+
+  // limits are resolved per instrument, with overrides field by field
+  auto eth_iid = apex::InstrumentTable::instance().resolve(eth).iid();
+  REQUIRE(risk.limits(btc_iid).max_notional == 1000.0);
+  REQUIRE(risk.limits(eth_iid).max_notional == apex::RiskLimits::none);
+  REQUIRE(risk.limits(eth_iid).max_order_qty == 2.0);
+  REQUIRE(risk.limits(btc_iid).price_band == apex::RiskLimits::none);
+
+  REQUIRE(risk.check(btc_iid, apex::Side::buy, 100.0, 1.0) == 0);
+  REQUIRE(risk.check(btc_iid, apex::Side::buy, 100.0, 2.5) ==
+          apex::risk_order_qty);
+  REQUIRE(risk.check(btc_iid, apex::Side::buy, 600.0, 2.0) ==
+          apex::risk_notional);
+  REQUIRE(risk.check(eth_iid, apex::Side::buy, 600.0, 2.0) == 0);
+  REQUIRE(apex::RiskService::describe(apex::risk_order_qty |
+                                      apex::risk_notional) ==
+          "max_order_qty,max_notional");
+
+  // the position counts fills, and over its limit may only be reduced
+  risk.add_position(btc_iid, 2.0);
+  risk.apply_fill(btc_iid, apex::Side::buy, 1.5);
+  REQUIRE(risk.position(btc_iid) == 3.5);
+  REQUIRE(risk.check(btc_iid, apex::Side::buy, 100.0, 0.1) ==
+          apex::risk_position);
+  REQUIRE(risk.check(btc_iid, apex::Side::sell, 100.0, 0.1) == 0);
+
+  // passing orders count towards the rate, within a one-second window
+  REQUIRE(risk.check(btc_iid, apex::Side::sell, 100.0, 0.1) == 0);
+  REQUIRE(risk.check(btc_iid, apex::Side::sell, 100.0, 0.1) == 0);
+  REQUIRE(risk.check(btc_iid, apex::Side::sell, 100.0, 0.1) ==
+          apex::risk_order_rate);
+  REQUIRE(risk.rejects() == 4);
+
+  // working orders count towards the position limit, on their side only
+  apex::RiskService working(&services, apex::Config(json::parse(R"({
+    "max_position": 3.0 })")));
+  working.add_position(eth_iid, 1.0);
+  working.add_position(eth_iid, 0.5); // a second bot on the instrument
+  REQUIRE(working.position(eth_iid) == 1.5);
+  REQUIRE(working.check(eth_iid, apex::Side::buy, 100.0, 1.0) == 0);
+  working.add_working(eth_iid, apex::Side::buy, 1.0);
+  REQUIRE(working.check(eth_iid, apex::Side::buy, 100.0, 1.0) ==
+          apex::risk_position);
+  REQUIRE(working.check(eth_iid, apex::Side::sell, 100.0, 1.0) == 0);
+
+  // an amend is checked net of what the order already holds
+  REQUIRE(working.check(eth_iid, apex::Side::buy, 100.0, 1.5, 1.0) == 0);
+
+  // a fill moves size from working to the position; a close releases it
+  working.apply_fill(eth_iid, apex::Side::buy, 0.5);
+  working.add_working(eth_iid, apex::Side::buy, -0.5);
+  REQUIRE(working.check(eth_iid, apex::Side::buy, 100.0, 1.0) ==
+          apex::risk_position);
+  working.add_working(eth_iid, apex::Side::buy, -0.5);
+  REQUIRE(working.working(eth_iid, apex::Side::buy) == 0.0);
+  REQUIRE(working.check(eth_iid, apex::Side::buy, 100.0, 1.0) == 0);
+}
+
+
+TEST_CASE("rate_limiter")
+{
+  using namespace std::chrono_literals;
+  auto t0 = apex::TokenBucket::clock::time_point(1000s);
+
+  // ten tokens a second, the last two kept for requests with priority
+  apex::TokenBucket bucket(10, 1s, 2);
+  REQUIRE(bucket.available(t0) == 10);
+  for (int i = 0; i < 8; i++)
+    REQUIRE(bucket.try_acquire(1, false, t0));
+  REQUIRE(!bucket.try_acquire(1, false, t0));
+  REQUIRE(bucket.try_acquire(2, true, t0));
+  REQUIRE(!bucket.try_acquire(1, true, t0));
+  REQUIRE(bucket.available(t0 + 500ms) == 5);
+
+  // usage reported by the exchange tightens the bucket, but never loosens it
+  apex::TokenBucket synced(10, 1s);
+  synced.sync_used(7, t0);
+  REQUIRE(synced.available(t0) == 3);
+  synced.sync_used(1, t0);
+  REQUIRE(synced.available(t0) == 3);
+  synced.block(t0 + 2s);
+  REQUIRE(synced.available(t0 + 2s) == 0);
+  REQUIRE(synced.available(t0 + 3s) == 10);
+
+  apex::binance::RateLimiter::Limits limits;
+  limits.weight_per_min = 600;
+  limits.orders_per_10s = 3;
+  limits.cancel_reserve = 60;
+  apex::binance::RateLimiter limiter(limits);
+  using Request = apex::binance::RateLimiter::Request;
+
+  // orders are held to the order count, while cancels still pass
+  for (int i = 0; i < 3; i++)
+    REQUIRE(limiter.try_acquire(Request::new_order, t0));
+  REQUIRE(!limiter.try_acquire(Request::replace, t0));
+  REQUIRE(limiter.try_acquire(Request::cancel, t0));
+  REQUIRE(limiter.throttled() == 1);
+  REQUIRE(limiter.budget(t0).new_orders == 0);
+  REQUIRE(limiter.budget(t0 + 10s).new_orders == 3);
+
+  // headers of REST replies, and the rate limits of WebSocket API replies;
+  // new orders leave the cancel reserve of the weight
+  limits.orders_per_10s = 100;
+  apex::binance::RateLimiter weighted(limits);
+  weighted.on_header("HTTP/1.1 200 OK", t0);
+  weighted.on_header("x-mbx-used-weight-1m: 550", t0);
+  REQUIRE(weighted.budget(t0).weight == 50);
+  REQUIRE(!weighted.try_acquire(Request::new_order, t0));
+  REQUIRE(weighted.try_acquire(Request::cancel_all, t0));
+  limiter.on_ws_rate_limits(json::parse(R"([
+    {"rateLimitType":"ORDERS","interval":"DAY","intervalNum":1,
+     "limit":200000,"count":199990}])"), t0);
+  REQUIRE(limiter.budget(t0).orders_day == 10);
+  limiter.on_header("HTTP/2 429", t0);
+  limiter.on_header("Retry-After: 30", t0);
+  REQUIRE(limiter.violations() == 1);
+  REQUIRE(limiter.budget(t0 + 30s).weight == 0);
+  REQUIRE(!limiter.try_acquire(Request::cancel, t0 + 30s));
+}
+
+
+TEST_CASE("merge_audit_files")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_audit_merge_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto write = [&](const char* name, std::vector<std::string> rows) {
+    std::ofstream os(dir / name);
+    os << "time,symbol,\n";
+    for (auto& row : rows)
+      os << row << "\n";
+    return dir / name;
+  };
+
+  auto shard0 = write("shard0.csv", {"2024-02-01 00:00:01.000000,BTCUSDT,",
+                                     "2024-02-01 00:00:03.000000,BTCUSDT,"});
+  auto shard1 = write("shard1.csv", {"2024-02-01 00:00:01.000000,ETHUSDT,",
+                                     "2024-02-01 00:00:02.000000,ETHUSDT,",
+                                     "2024-02-01 00:00:04.000000,ETHUSDT,"});
+  auto empty = write("shard2.csv", {});
+
+  auto merged_fn = dir / "merged.csv";
+  REQUIRE(apex::merge_audit_files({shard0, shard1, empty}, merged_fn) == 5);
+
+  // rows in time order, and of equal time in the order of the inputs
+  std::ifstream is(merged_fn);
+  std::vector<std::string> lines;
+  for (std::string line; std::getline(is, line);)
+    lines.push_back(line);
+  REQUIRE(lines.size() == 6);
+  REQUIRE(lines[0] == "time,symbol,");
+  REQUIRE(lines[1] == "2024-02-01 00:00:01.000000,BTCUSDT,");
+  REQUIRE(lines[2] == "2024-02-01 00:00:01.000000,ETHUSDT,");
+  REQUIRE(lines[3] == "2024-02-01 00:00:02.000000,ETHUSDT,");
+  REQUIRE(lines[4] == "2024-02-01 00:00:03.000000,BTCUSDT,");
+  REQUIRE(lines[5] == "2024-02-01 00:00:04.000000,ETHUSDT,");
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("plan_time_shards")
+{
+  using namespace std::chrono_literals;
+  apex::BacktestPeriod period{apex::Time("2024-02-01T00:00:00"),
+                              apex::Time("2024-02-03T12:00:00")};
+
+  auto shards = apex::plan_time_shards(period, 24h, 1h);
+  REQUIRE(shards.size() == 3);
+  REQUIRE(shards[0].warmup_from == period.from);
+  REQUIRE(shards[0].from == period.from);
+  REQUIRE(shards[0].upto == apex::Time("2024-02-02T00:00:00"));
+  REQUIRE(shards[1].warmup_from == apex::Time("2024-02-01T23:00:00"));
+  REQUIRE(shards[1].from == apex::Time("2024-02-02T00:00:00"));
+  REQUIRE(shards[1].upto == apex::Time("2024-02-03T00:00:00"));
+  REQUIRE(shards[2].warmup_from == apex::Time("2024-02-02T23:00:00"));
+  REQUIRE(shards[2].upto == period.upto); // the last shard is cut short
+
+  REQUIRE(apex::plan_time_shards(period, 96h, 1h).size() == 1);
+
+  bool threw = false;
+  try {
+    apex::plan_time_shards(period, 0s, 1h);
+  }
+  catch (const apex::ConfigError&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+}
+
+
+TEST_CASE("backtest_result_cache")
+{
+  namespace fs = std::filesystem;
+  auto dir = fs::temp_directory_path() /
+    ("apex_result_cache_" + std::to_string(::getpid()));
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::BacktestPeriod period{apex::Time("2024-02-01T00:00:00"),
+                              apex::Time("2024-02-03T00:00:00")};
+  auto shards = apex::plan_time_shards(period, std::chrono::hours(24),
+                                       std::chrono::hours(1));
+
+  json config = {{"spread", 2}};
+  auto key = apex::BacktestResultCache::make_key(config, instrument, shards[1]);
+  REQUIRE(key.size() == 64);
+  REQUIRE(key != apex::BacktestResultCache::make_key(config, instrument,
+                                                     shards[0]));
+  REQUIRE(key != apex::BacktestResultCache::make_key({{"spread", 3}},
+                                                     instrument, shards[1]));
+
+  auto tick_fn = dir / "BTCUSDT.bin";
+  std::ofstream(tick_fn) << "ticks";
+  auto audit_fn = dir / "audit-transactions-1.csv";
+  std::ofstream(audit_fn) << "time,symbol,venue,\n"
+                          << "2024-02-02 00:00:01.000000,BTCUSDT,binance,\n"
+                          << "2024-02-02 00:00:02.000000,ETHUSDT,binance,\n";
+
+  apex::BacktestResultCache cache(dir / "cache");
+  REQUIRE(!cache.find(key));
+
+  apex::CachedBotResult result;
+  result.bot.symbol = "BTCUSDT";
+  result.bot.exchange = "binance";
+  result.bot.pnl_usd = 12.5;
+  result.audit.fills = 3;
+  result.tick_files.push_back(apex::FileFingerprint::of(tick_fn));
+  cache.store(key, shards[1], result, {audit_fn});
+
+  auto found = cache.find(key);
+  REQUIRE(found);
+  REQUIRE(found->bot.pnl_usd == 12.5);
+  REQUIRE(found->audit.fills == 3);
+  REQUIRE(found->tick_files == result.tick_files);
+
+  // only the rows of the bot's instrument are kept
+  std::ifstream is(cache.audit_file(key));
+  std::string line;
+  size_t rows = 0;
+  while (std::getline(is, line))
+    rows++;
+  REQUIRE(rows == 2);
+
+  apex::BacktestResultCache::Filter filter;
+  filter.symbol = "ETHUSDT";
+  REQUIRE(cache.entries(filter).empty());
+  filter.symbol = "BTCUSDT";
+  filter.from = apex::Time("2024-02-02T12:00:00");
+  REQUIRE(cache.entries(filter).size() == 1);
+  filter.stale = true;
+  REQUIRE(cache.entries(filter).empty());
+
+  // a changed tick file makes the entry stale
+  std::ofstream(tick_fn) << "more ticks";
+  REQUIRE(!cache.find(key));
+  REQUIRE(cache.invalidate(filter) == 1);
+  REQUIRE(cache.entries(apex::BacktestResultCache::Filter{}).empty());
+  REQUIRE(cache.hits() == 1);
+  REQUIRE(cache.misses() == 2);
+
+  fs::remove_all(dir);
+}
+
+
+TEST_CASE("decoded_tick_cache")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_decoded_tick_cache_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  const int count = 5000;
+  auto at = [](int i) {
+    return apex::Time{std::chrono::seconds(1700001000) + std::chrono::seconds(i)};
+  };
+
+  // compressed ticks over two hourly files
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::TickbinFileWriter::Options options;
+  options.compress = true;
+  options.frame_size = 4096;
+  {
+    apex::TickbinFileWriter writer({2023, 11, 14}, dir, "BTCUSDT.bin",
+                                   {instrument, "l1"}, {}, options);
+    for (int i = 0; i < count; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      tick.ask_price = i + 1;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+  auto part22 = dir / "BTCUSDT.22.binz";
+  auto part23 = dir / "BTCUSDT.23.binz";
+
+  // decoded once, after which the same entry is returned
+  apex::DecodedTickCache cache(dir / "cache", 1 << 30);
+  auto decoded22 = cache.get(part22, apex::MdStream::L1);
+  REQUIRE(!decoded22.empty());
+  REQUIRE(std::filesystem::exists(apex::tickbin_index_path(decoded22)));
+  REQUIRE(cache.get(part22, apex::MdStream::L1) == decoded22);
+  auto decoded23 = cache.get(part23, apex::MdStream::L1);
+  REQUIRE(decoded23 != decoded22);
+
+  // the decoded images replay exactly as the compressed files
+  int i = 0;
+  for (auto& fn : {decoded22, decoded23}) {
+    apex::MarketData md;
+    apex::TickbinFileReader reader(fn, &md, apex::MdStream::L1);
+    while (reader.has_next_event()) {
+      REQUIRE(reader.next_event_time() == at(i));
+      reader.consume_next_event();
+      REQUIRE(md.bid() == i);
+      i++;
+    }
+  }
+  REQUIRE(i == count);
+
+  // files already raw are not cached
+  REQUIRE(cache.get(dir / "BTCUSDT.bin", apex::MdStream::L1).empty());
+
+  // over budget, the least recently used entry is removed
+  apex::DecodedTickCache small(dir / "cache", 1);
+  std::filesystem::last_write_time(
+      decoded22, std::filesystem::last_write_time(decoded23) - std::chrono::hours(1));
+  small.evict(decoded23);
+  REQUIRE(!std::filesystem::exists(decoded22));
+  REQUIRE(!std::filesystem::exists(apex::tickbin_index_path(decoded22)));
+  REQUIRE(std::filesystem::exists(decoded23));
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("backtest_progress")
+{
+  // a source of one event per second, which dispatches on every other event
+  class CountingSource : public apex::BacktestEventSource
+  {
+  public:
+    CountingSource(apex::BacktestEventLoop& evloop, apex::Time start, int count)
+      : _evloop(evloop), _next(start), _remaining(count) {}
+
+    apex::Time get_next_event_time() override
+    {
+      return _remaining > 0 ? _next : apex::Time{};
+    }
+
+    void consume_next_event() override
+    {
+      if (_remaining-- % 2)
+        _evloop.dispatch([]() {});
+      _next += std::chrono::seconds(1);
+    }
+
+    void init_backtest_time_range(apex::Time, apex::Time) override {}
+    const char* event_source_kind() const override { return "counting"; }
+
+  private:
+    apex::BacktestEventLoop& _evloop;
+    apex::Time _next;
+    int _remaining;
+  };
+
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  const int count = 3000;
+  apex::BacktestEventLoop evloop(start);
+  evloop.set_time(start);
+  CountingSource source(evloop, start, count);
+  evloop.add_event_source(&source);
+
+  std::vector<apex::BacktestProgress> reports;
+  apex::BacktestEventLoop::ProgressOptions options;
+  options.interval = std::chrono::milliseconds(0);
+  options.callback = [&](const apex::BacktestProgress& progress) {
+    reports.push_back(progress);
+  };
+  evloop.set_progress_options(options);
+  evloop.run_loop({});
+
+  // with the heartbeat disabled only the final summary is reported
+  REQUIRE(reports.size() == 1);
+  auto& summary = reports.back();
+  REQUIRE(summary.complete);
+  REQUIRE(summary.events == count);
+  REQUIRE(summary.sim_start == start);
+  REQUIRE(summary.sim_time - summary.sim_start ==
+          std::chrono::seconds(count - 1));
+  REQUIRE(summary.wall.count() > 0);
+  REQUIRE(summary.events_per_sec() > 0);
+  REQUIRE(summary.sim_speed() > 0);
+
+  std::vector<std::string> names;
+  std::chrono::nanoseconds split{0};
+  for (auto& [name, spent] : summary.time_split) {
+    names.push_back(name);
+    split += spent;
+  }
+  REQUIRE((names == std::vector<std::string>{"scheduling", "dispatch",
+                                              "batch_end", "timers",
+                                              "counting"}));
+  REQUIRE(split <= summary.wall);
+  REQUIRE(evloop.progress().events == count);
+
+  // without the time split, nothing is timed; the loop is already complete
+  options.time_split = false;
+  evloop.set_progress_options(options);
+  REQUIRE(evloop.progress().time_split.empty());
+}
+
+
+TEST_CASE("backtest_batch_consumption")
+{
+  // events, callbacks and hooks are run in the same order whether or not
+  // sources consume their events in batches
+  class ScriptedSource : public apex::BacktestEventSource
+  {
+  public:
+    ScriptedSource(apex::BacktestEventLoop& evloop, int id,
+                   std::vector<apex::Time> times, std::vector<std::string>& log)
+      : _evloop(evloop), _id(id), _times(std::move(times)), _log(log) {}
+
+    apex::Time get_next_event_time() override
+    {
+      return _next < _times.size() ? _times[_next] : apex::Time{};
+    }
+
+    void consume_next_event() override
+    {
+      const size_t i = _next++;
+      _log.push_back("src" + std::to_string(_id) + ":" + std::to_string(i) +
+                     "@" + std::to_string(_evloop.get_time().as_epoch_us().count()));
+      if (i % 7 == 3)
+        _evloop.dispatch([this, i]() {
+          _log.push_back("cb" + std::to_string(_id) + ":" + std::to_string(i));
+        });
+      if (i % 11 == 5)
+        _evloop.dispatch(std::chrono::milliseconds(2), [this, i]() {
+          _log.push_back("timer" + std::to_string(_id) + ":" + std::to_string(i));
+          return std::chrono::milliseconds(0);
+        });
+    }
+
+    size_t consume_events(apex::BacktestBatch& batch) override
+    {
+      auto count = apex::BacktestEventSource::consume_events(batch);
+      batched += count;
+      return count;
+    }
+
+    void init_backtest_time_range(apex::Time, apex::Time) override {}
+
+    size_t batched = 0;
+
+  private:
+    apex::BacktestEventLoop& _evloop;
+    int _id;
+    std::vector<apex::Time> _times;
+    size_t _next = 0;
+    std::vector<std::string>& _log;
+  };
+
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto at = [&](int ms) {
+    return apex::Time(start.as_epoch_us() + std::chrono::milliseconds(ms));
+  };
+
+  // a busy source with repeated times, and a sparse one sharing some times
+  std::vector<apex::Time> busy, sparse;
+  for (int i = 0; i < 200; i++)
+    busy.push_back(at(i / 3));
+  for (int i = 0; i < 10; i++)
+    sparse.push_back(at(i * 7));
+
+  size_t batched_events = 0;
+  auto replay = [&](bool batching) {
+    std::vector<std::string> log;
+    apex::BacktestEventLoop evloop(start);
+    evloop.set_time(start);
+    evloop.set_batching(batching);
+    apex::BacktestEventLoop::ProgressOptions options;
+    options.interval = std::chrono::milliseconds(0);
+    evloop.set_progress_options(options);
+    ScriptedSource busy_source(evloop, 1, busy, log);
+    ScriptedSource sparse_source(evloop, 2, sparse, log);
+    evloop.add_event_source(&sparse_source);
+    evloop.add_event_source(&busy_source);
+    evloop.dispatch(std::chrono::milliseconds(10), [&]() {
+      log.push_back("tick@" +
+                    std::to_string(evloop.get_time().as_epoch_us().count()));
+      return std::chrono::milliseconds(10);
+    });
+    evloop.add_batch_end_hook([&]() {
+      log.push_back("end@" +
+                    std::to_string(evloop.get_time().as_epoch_us().count()));
+    });
+    evloop.run_loop(at(60));
+    log.push_back("events:" + std::to_string(evloop.progress().events));
+    batched_events += busy_source.batched + sparse_source.batched;
+    return log;
+  };
+
+  auto batched = replay(true);
+  auto unbatched = replay(false);
+  REQUIRE(batched.size() > 300);
+  REQUIRE(batched == unbatched);
+  REQUIRE(batched_events > 100);
+}
+
+
+TEST_CASE("market_data_tick_blocks")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_tick_blocks_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  const int count = 3000;
+  const apex::Time start{std::chrono::seconds(1700000000)};
+  auto at = [&](int i) {
+    return apex::Time(start.as_epoch_us() + std::chrono::milliseconds(i));
+  };
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  {
+    apex::TickbinFileWriter writer({2023, 11, 14}, dir, "BTCUSDT.bin",
+                                   {instrument, "l1"}, {});
+    for (int i = 0; i < count; i++) {
+      apex::TickTop tick;
+      tick.bid_price = i;
+      tick.ask_price = i + 1;
+      auto bytes = apex::tickbin::Serialiser::serialise(at(i), tick);
+      writer.write_bytes(bytes.data(), bytes.size());
+    }
+  }
+
+  // replays a reader as an event source, as TickReplayer does
+  struct ReaderSource : apex::BacktestEventSource {
+    explicit ReaderSource(apex::BaseTickFileReader& r) : reader(r) {}
+    apex::Time get_next_event_time() override
+    {
+      return reader.has_next_event() ? reader.next_event_time() : apex::Time{};
+    }
+    void consume_next_event() override { reader.consume_next_event(); }
+    size_t consume_events(apex::BacktestBatch& batch) override
+    {
+      return reader.consume_events(batch);
+    }
+    void init_backtest_time_range(apex::Time, apex::Time) override {}
+    apex::BaseTickFileReader& reader;
+  };
+
+  struct Collector : apex::MarketData::BlockListener {
+    void on_top_block(const apex::TickTopBlock& block) override
+    {
+      ++blocks;
+      for (size_t i = 0; i < block.size; i++) {
+        bids.push_back(block[i].bid_price);
+        if (block.times)
+          timed.push_back({block[i].bid_price, block.times[i]});
+      }
+    }
+    size_t blocks = 0;
+    std::vector<double> bids;
+    std::vector<std::pair<double, apex::Time>> timed;
+  };
+
+  struct EachTop : apex::MarketData::Listener {
+    void on_market_event(apex::MarketData::EventType) override { ++events; }
+    bool needs_each_top() const override { return each; }
+    bool each = false;
+    int events = 0;
+  };
+
+  auto replay = [&](bool each) {
+    apex::MarketData md;
+    Collector collector;
+    EachTop listener;
+    listener.each = each;
+    md.add_block_listener(&collector);
+    md.add_listener(&listener);
+
+    apex::BacktestEventLoop evloop(start);
+    evloop.set_time(start);
+    apex::BacktestEventLoop::ProgressOptions progress;
+    progress.interval = std::chrono::milliseconds(0);
+    evloop.set_progress_options(progress);
+
+    apex::TickbinFileReader reader(dir / "BTCUSDT.bin", &md,
+                                   apex::MdStream::L1);
+    ReaderSource source(reader);
+    evloop.add_event_source(&source);
+
+    // a block ends before each timer, so timers see the ticks before them
+    std::vector<double> seen;
+    evloop.dispatch(std::chrono::milliseconds(100), [&]() {
+      seen.push_back(md.bid());
+      return reader.has_next_event() ? std::chrono::milliseconds(100)
+                                     : std::chrono::milliseconds(0);
+    });
+    evloop.run_loop({});
+
+    for (size_t i = 0; i < seen.size(); i++)
+      REQUIRE(seen[i] == 100.0 * (i + 1) - 1);
+    REQUIRE(seen.size() == count / 100);
+    REQUIRE(collector.bids.size() == count);
+    for (int i = 0; i < count; i++)
+      REQUIRE(collector.bids[i] == i);
+    REQUIRE(md.bid() == count - 1);
+    return std::make_tuple(collector.blocks, collector.timed, listener.events);
+  };
+
+  // ticks arrive in blocks, with their times; other listeners see each block
+  // the ticks consumed singly, first and after each timer, are blocks of one
+  auto [blocks, timed, events] = replay(false);
+  REQUIRE(blocks < count / 10);
+  REQUIRE(events == static_cast<int>(blocks));
+  REQUIRE(timed.size() > count * 9 / 10);
+  for (auto& [bid, time] : timed)
+    REQUIRE(time == at(static_cast<int>(bid)));
+
+  // a listener needing each tick receives each, and blocks are of one tick
+  std::tie(blocks, timed, events) = replay(true);
+  REQUIRE(blocks == count);
+  REQUIRE(timed.empty());
+  REQUIRE(events == count);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("fixed_string")
+{
+  apex::FixedString<8> sym("BTCUSDT");
+  REQUIRE(sym.size() == 7);
+  REQUIRE(sym == "BTCUSDT");
+  REQUIRE(sym != std::string("ETHUSDT"));
+  REQUIRE(std::string_view(sym) == "BTCUSDT");
+  REQUIRE(strlen(sym.c_str()) == 7);
+
+  // copies are bitwise, and equal strings bitwise equal
+  apex::FixedString<8> longer("ETHUSDTX");
+  longer = std::string("BTCUSDT");
+  REQUIRE(memcmp(&longer, &sym, sizeof(sym)) == 0);
+
+  std::ostringstream os;
+  os << sym;
+  REQUIRE(os.str() == "BTCUSDT");
+
+  bool threw = false;
+  try {
+    sym = "BTCUSDTUSDC";
+  } catch (apex::Error&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+
+  apex::OrderParams params;
+  params.order_id = "TST65a0f3c1000000ff";
+  apex::OrderParams copied = params;
+  REQUIRE(copied.order_id == "TST65a0f3c1000000ff");
+  REQUIRE(copied.symbol.empty());
+}
+
+
+TEST_CASE("open_address_map")
+{
+  // churn against a reference map, with sequential keys as order handles are
+  apex::OpenAddressMap<int> table;
+  std::map<uint64_t, int> ref;
+  std::mt19937_64 rng(7);
+  uint64_t next_key = (uint64_t(0x65000000) << 32) | 1;
+  for (int i = 0; i < 20000; i++) {
+    if (ref.empty() || rng() % 3) {
+      table.insert(next_key, i);
+      ref[next_key++] = i;
+    } else {
+      auto iter = ref.begin();
+      std::advance(iter, rng() % ref.size());
+      REQUIRE(table.erase(iter->first));
+      REQUIRE(!table.erase(iter->first));
+      ref.erase(iter);
+    }
+  }
+  REQUIRE(table.size() == ref.size());
+  for (auto& item : ref) {
+    auto* v = table.find(item.first);
+    REQUIRE(v != nullptr);
+    REQUIRE(*v == item.second);
+  }
+  REQUIRE(table.find(next_key) == nullptr);
+
+  // zero marks an empty slot, so is never found
+  REQUIRE(table.find(0) == nullptr);
+  REQUIRE(!table.erase(0));
+  REQUIRE(table.size() == ref.size());
+
+  size_t visited = 0;
+  table.for_each([&](uint64_t, int&) { visited++; });
+  REQUIRE(visited == ref.size());
+
+  REQUIRE(apex::OrderService::decode_handle("TST65a0f3c1000000ff") ==
+          0x65a0f3c1000000ffull);
+  REQUIRE(apex::OrderService::decode_handle("65a0f3c1000000f") == 0);
+  REQUIRE(apex::OrderService::decode_handle("TST65a0f3c1000000fX") == 0);
+}
+
+
+TEST_CASE("order_id_generator")
+{
+  struct NullRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    bool is_up() const override { return true; }
+  } router;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto create = [&](apex::OrderService& service, const std::string& strategy) {
+    return service.create(&router, instrument, apex::Side::buy, 1.0, 100.0,
+                          apex::TimeInForce::gtc, strategy, nullptr, {});
+  };
+  auto hex8 = [](uint64_t value) {
+    char text[9];
+    snprintf(text, sizeof(text), "%08llx", (unsigned long long)value);
+    return std::string(text);
+  };
+
+  // ids are the strategy id, the startup time and one counter; alternating
+  // strategies, of different lengths, rebuild the cached prefix each time
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::OrderService orders(&services);
+  const uint64_t epoch = services.startup_time().as_epoch_ms().count() / 1000;
+  const std::string strategies[] = {"ALPHA", "BETA22", "ALPHA", "GAMMA",
+                                    "BETA22", "BETA22"};
+  std::vector<std::shared_ptr<apex::Order>> made;
+  for (auto& strategy : strategies)
+    made.push_back(create(orders, strategy));
+  for (size_t i = 0; i < made.size(); i++) {
+    auto& id = made[i]->order_id();
+    REQUIRE(id == strategies[i] + hex8(epoch) + hex8(i));
+
+    // and end with the handle, by which the order is found
+    REQUIRE(apex::OrderService::decode_handle(id) == ((epoch << 32) | i));
+    REQUIRE(orders.find_order(id) == made[i]);
+  }
+
+  // a shard takes its own range of the counter, and refuses orders once the
+  // range is spent
+  apex::Services shard(apex::RunMode::backtest, {start, start},
+                       apex::Config::empty_config(),
+                       apex::ShardInfo{1, size_t(1) << 31});
+  apex::OrderService shard_orders(&shard);
+  auto order = create(shard_orders, "ALPHA");
+  REQUIRE(apex::OrderService::decode_handle(order->order_id()) ==
+          ((epoch << 32) | 2));
+  bool threw = false;
+  try {
+    create(shard_orders, "ALPHA");
+  } catch (const std::exception& e) {
+    threw = std::string(e.what()).find(
+                "no more order IDs available, cannot create order") !=
+            std::string::npos;
+  }
+  REQUIRE(threw);
+}
+
+
+TEST_CASE("perfect_hash_map")
+{
+  std::vector<std::pair<std::string, int>> items;
+  for (int i = 0; i < 500; i++)
+    items.emplace_back("sym" + std::to_string(i) + "usdt@bookTicker", i);
+  items.emplace_back("sym0usdt@bookTicker", -1); // repeated, keeps the first
+
+  apex::PerfectHashMap<int> map(items);
+  REQUIRE(map.size() == 500);
+  for (int i = 0; i < 500; i++) {
+    auto* v = map.find("sym" + std::to_string(i) + "usdt@bookTicker");
+    REQUIRE(v != nullptr);
+    REQUIRE(*v == i);
+  }
+  REQUIRE(map.find("sym0usdt@trade") == nullptr);
+  REQUIRE(map.find("") == nullptr);
+
+  apex::PerfectHashMap<int> empty;
+  REQUIRE(empty.empty());
+  REQUIRE(empty.find("sym0usdt@bookTicker") == nullptr);
+
+  // a large universe builds as quickly, at a few slots a key, where a
+  // single seed for all keys needs a table of about the square of the keys
+  items.clear();
+  for (int i = 0; i < 20000; i++)
+    items.emplace_back("sym" + std::to_string(i) + "usdt@bookTicker", i);
+  apex::PerfectHashMap<int> large(items);
+  REQUIRE(large.size() == 20000);
+  for (int i = 0; i < 20000; i++) {
+    auto* v = large.find("sym" + std::to_string(i) + "usdt@bookTicker");
+    REQUIRE((v != nullptr && *v == i));
+  }
+  REQUIRE(large.find("sym20000usdt@bookTicker") == nullptr);
+}
+
+
+TEST_CASE("raw_capture")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_raw_capture_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  // a small segment size, so the stream rolls over several segments
+  apex::RawCaptureWriter::Options options;
+  options.segment_size = 256;
+  options.batch_size = 64;
+  std::vector<std::string> sent;
+  {
+    apex::RawCaptureWriter writer(dir, options);
+    for (int i = 0; i < 40; i++) {
+      sent.push_back(R"({"e":"executionReport","i":)" + std::to_string(i) +
+                     "}\n");
+      writer.write("userdata", std::string_view(sent.back()));
+    }
+    writer.write("new_order_reply", std::string_view("{}"));
+  }
+
+  std::vector<std::filesystem::path> segments;
+  for (auto& entry : std::filesystem::directory_iterator(dir))
+    if (entry.path().filename().string().rfind("userdata-", 0) == 0)
+      segments.push_back(entry.path());
+  std::sort(segments.begin(), segments.end());
+  REQUIRE(segments.size() > 1);
+
+  std::vector<std::string> replayed;
+  apex::RawCaptureReader::Record rec;
+  for (auto& segment : segments) {
+    apex::RawCaptureReader reader(segment);
+    while (reader.next(rec)) {
+      REQUIRE(rec.time.as_epoch_us().count() > 0);
+      replayed.push_back(rec.msg);
+    }
+  }
+  REQUIRE(replayed == sent);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("gx_capture_replay")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_gx_capture_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+
+  auto frame = [](apex::gx::Type type, uint8_t flags, apex::gx::t_msgid id,
+                  std::string payload) {
+    std::string msg(sizeof(apex::gx::Header), '\0');
+    auto* header = reinterpret_cast<apex::gx::Header*>(msg.data());
+    apex::gx::Header::init(header, payload.size(), type, flags);
+    header->id = id;
+    return msg + payload;
+  };
+  auto binary = static_cast<uint8_t>(apex::gx::Flags::binary);
+  const apex::gx::t_msgid captured_id = 7; // assigned by the live session
+
+  {
+    apex::RawCaptureWriter writer(dir);
+    apex::pb::SubscribeTicks sub;
+    sub.set_symbol("BTCUSDT");
+    writer.write(apex::GxClientSession::capture_stream,
+                 frame(apex::gx::Type::subscribe,
+                       static_cast<uint8_t>(apex::gx::Flags::proto3),
+                       captured_id, sub.SerializeAsString()));
+
+    apex::gx::bin::TickTop top{100.0, 1.0, 101.0, 2.0, 0, 0};
+    writer.write(apex::GxClientSession::capture_stream,
+                 frame(apex::gx::Type::tick_top, binary, captured_id,
+                       std::string(reinterpret_cast<char*>(&top), sizeof top)));
+
+    apex::gx::bin::TickTrade trade{};
+    trade.price = 100.5;
+    trade.qty = 0.25;
+    trade.aggr_side = static_cast<uint8_t>(apex::Side::buy);
+    writer.write(apex::GxClientSession::capture_stream,
+                 frame(apex::gx::Type::trade, binary, captured_id,
+                       std::string(reinterpret_cast<char*>(&trade),
+                                   sizeof trade)));
+
+    // order traffic of the live session is not replayed
+    apex::gx::bin::OrderFill fill{};
+    writer.write(apex::GxClientSession::capture_stream,
+                 frame(apex::gx::Type::order_fill, binary, 0,
+                       std::string(reinterpret_cast<char*>(&fill),
+                                   sizeof fill)));
+  }
+
+  apex::MarketData md;
+  apex::GxCaptureReplayer replayer(dir, apex::Time{});
+  REQUIRE(replayer.files().size() == 1);
+  replayer.subscribe("BTCUSDT", apex::ExchangeId::binance, &md);
+
+  std::vector<apex::Time> times;
+  for (auto t = replayer.get_next_event_time(); !t.empty();
+       t = replayer.get_next_event_time()) {
+    times.push_back(t);
+    replayer.consume_next_event();
+  }
+  REQUIRE(times.size() == 4);
+  REQUIRE(std::is_sorted(times.begin(), times.end()));
+
+  REQUIRE(md.bid() == 100.0);
+  REQUIRE(md.ask() == 101.0);
+  REQUIRE(md.has_last());
+  REQUIRE(md.last().price == 100.5);
+  REQUIRE(md.last().qty == 0.25);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("sim_fill_model")
+{
+  apex::MarketData md;
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.bid_qty = 5.0;
+  top.ask_price = 101.0;
+  top.ask_qty = 2.0;
+  md.apply(top);
+
+  apex::QueueFillModel model;
+  REQUIRE(model.initial_queue(md, apex::Side::buy, 100.0) == 5.0);
+  REQUIRE(model.initial_queue(md, apex::Side::buy, 100.5) == 0.0);
+  REQUIRE(model.initial_queue(md, apex::Side::sell, 101.0) == 2.0);
+  REQUIRE(model.initial_queue(md, apex::Side::sell, 102.0) == 2.0); // not visible
+
+  // trades at the price consume the queue before reaching the order
+  double queue = 5.0;
+  REQUIRE(model.on_trade(queue, 3.0, false) == 0.0);
+  REQUIRE(queue == 2.0);
+  REQUIRE(model.on_trade(queue, 3.0, false) == 1.0);
+  REQUIRE(queue == 0.0);
+
+  // visible size falls below the queue, so the queue is capped at it
+  queue = 5.0;
+  model.on_level_qty(queue, 6.0);
+  REQUIRE(queue == 5.0);
+  model.on_level_qty(queue, 1.5);
+  REQUIRE(queue == 1.5);
+  REQUIRE(model.on_trade(queue, 1.0, true) == 1.0);
+  REQUIRE(queue == 0.0);
+
+  apex::ThroughFillModel through;
+  queue = 0.0;
+  REQUIRE(through.on_trade(queue, 1.0, false) == 0.0);
+  REQUIRE(through.on_trade(queue, 1.0, true) == 1.0);
+  REQUIRE(apex::make_sim_fill_model("through") != nullptr);
+  REQUIRE(apex::to_sim_cross_fill("visible") == apex::SimCrossFill::visible);
+  REQUIRE(apex::to_sim_cross_fill("none") == apex::SimCrossFill::none);
+}
+
+
+TEST_CASE("sim_latency_model")
+{
+  using std::chrono::microseconds;
+  const apex::Time midnight(microseconds(1672531200000000)); // 2023-01-01
+  auto at = [&](int hours) {
+    return apex::Time(midnight.as_epoch_us() + std::chrono::hours(hours));
+  };
+
+  // paths default to a constant 100ms
+  auto defaults = apex::make_sim_latencies(apex::Config::empty_config());
+  REQUIRE(defaults.fill->next(midnight) == std::chrono::milliseconds(100));
+
+  auto path = std::filesystem::temp_directory_path() / "apex_test_latency.txt";
+  {
+    std::ofstream ofs(path);
+    ofs << "# latency usec\n1000\n\n2000\n3000\n";
+  }
+
+  auto config = apex::Config(json::parse(R"({
+    "order": {"type": "constant", "usec": 250},
+    "fill": {"type": "time_of_day", "schedule": [
+      {"from": "08:00", "type": "constant", "usec": 5000},
+      {"from": "16:30", "type": "empirical", "file": ")" +
+                                               path.string() + R"(", "seed": 3}
+    ]}
+  })"));
+  auto latencies = apex::make_sim_latencies(config);
+  REQUIRE(latencies.order->next(midnight) == microseconds(250));
+  REQUIRE(latencies.cancel->next(midnight) == std::chrono::milliseconds(100));
+  REQUIRE(latencies.fill->next(at(9)) == microseconds(5000));
+
+  // before the first start time, the last entry applies
+  std::set<int64_t> seen;
+  for (int i = 0; i < 100; i++) {
+    seen.insert(latencies.fill->next(at(2)).count());
+    seen.insert(latencies.fill->next(at(23)).count());
+  }
+  REQUIRE((seen == std::set<int64_t>{1000, 2000, 3000}));
+
+  // seeded, so repeatable
+  apex::EmpiricalLatency first(apex::EmpiricalLatency::load(path.string()), 7);
+  apex::EmpiricalLatency second(apex::EmpiricalLatency::load(path.string()), 7);
+  for (int i = 0; i < 20; i++)
+    REQUIRE(first.next(midnight) == second.next(midnight));
+  std::filesystem::remove(path);
+}
+
+
+TEST_CASE("sim_matching_book")
+{
+  struct Fills : apex::SimMatchingBook::Handler {
+    void on_sim_fill(apex::SimRestingOrder& order, double, double size,
+                     bool) override
+    {
+      fills.push_back({order.id(), size});
+    }
+    std::vector<std::pair<uint64_t, double>> fills;
+  };
+  auto buy = [](uint64_t id, double size, double price) {
+    return std::make_shared<apex::SimRestingOrder>(id, apex::Side::buy, size,
+                                                   price);
+  };
+  auto ids = [](apex::SimMatchingBook& book) {
+    std::vector<uint64_t> result;
+    book.for_each_order([&](apex::SimRestingOrder& order) {
+      result.push_back(order.id());
+    });
+    return result;
+  };
+
+  apex::MarketData md;
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.bid_qty = 5.0;
+  top.ask_price = 101.0;
+  top.ask_qty = 2.0;
+  md.apply(top);
+  apex::QueueFillModel model;
+  Fills handler;
+  apex::SimMatchingBook book(md, model, apex::SimCrossFill::visible, handler);
+
+  // orders of a level queue in arrival order, and a trade through the level
+  // fills them in that order
+  for (uint64_t id = 1; id <= 3; id++)
+    book.rest(buy(id, 1.0, 99.0));
+  book.rest(buy(4, 1.0, 99.5));
+  REQUIRE(book.level_count(apex::Side::buy) == 2);
+  REQUIRE((ids(book) == std::vector<uint64_t>{4, 1, 2, 3}));
+  book.apply_trade(98.5, 2.5);
+  REQUIRE(handler.fills.size() == 3);
+  REQUIRE((handler.fills[0] == std::pair<uint64_t, double>{4, 1.0}));
+  REQUIRE((handler.fills[1] == std::pair<uint64_t, double>{1, 1.0}));
+  REQUIRE((handler.fills[2] == std::pair<uint64_t, double>{2, 0.5}));
+  REQUIRE((ids(book) == std::vector<uint64_t>{2, 3}));
+  REQUIRE(book.level_count(apex::Side::buy) == 1);
+  REQUIRE(book.find(4) == nullptr);
+  REQUIRE(book.find(2)->size_remain() == 0.5);
+
+  // cancels from the middle, the head and the tail of a level keep the
+  // order of the rest; the emptied level is removed
+  for (uint64_t id = 5; id <= 7; id++)
+    book.rest(buy(id, 1.0, 99.0));
+  REQUIRE((ids(book) == std::vector<uint64_t>{2, 3, 5, 6, 7}));
+  book.erase(*book.find(5));
+  REQUIRE((ids(book) == std::vector<uint64_t>{2, 3, 6, 7}));
+  book.erase(*book.find(2));
+  REQUIRE((ids(book) == std::vector<uint64_t>{3, 6, 7}));
+  book.erase(*book.find(7));
+  REQUIRE((ids(book) == std::vector<uint64_t>{3, 6}));
+  book.rest(buy(8, 1.0, 99.0));
+  REQUIRE((ids(book) == std::vector<uint64_t>{3, 6, 8}));
+  for (uint64_t id : {3, 6, 8})
+    book.erase(*book.find(id));
+  REQUIRE(book.empty());
+  REQUIRE(book.level_count(apex::Side::buy) == 0);
+
+  // an order joins behind the visible size at its price; as the market's
+  // size at the level shrinks, so does the queue ahead, and a trade at the
+  // price then reaches the order sooner
+  handler.fills.clear();
+  book.rest(buy(9, 1.0, 100.0));
+  book.apply_trade(100.0, 4.5);
+  REQUIRE(handler.fills.empty()); // 0.5 of the 5.0 ahead remains
+  top.bid_qty = 0.2;
+  md.apply(top);
+  book.apply_book_change();
+  book.apply_trade(100.0, 0.5);
+  REQUIRE(handler.fills.size() == 1);
+  REQUIRE(std::abs(handler.fills[0].second - 0.3) < 1e-9);
+}
+
+
+TEST_CASE("sim_cross_fill")
+{
+  struct Fills : apex::SimMatchingBook::Handler {
+    void on_sim_fill(apex::SimRestingOrder& order, double price, double size,
+                     bool fully_filled) override
+    {
+      fills.push_back({order.id(), price, size, fully_filled});
+    }
+    struct Fill {
+      uint64_t id;
+      double price;
+      double size;
+      bool fully_filled;
+    };
+    std::vector<Fill> fills;
+  };
+  auto buy = [](uint64_t id, double size, double price) {
+    return std::make_shared<apex::SimRestingOrder>(id, apex::Side::buy, size,
+                                                   price);
+  };
+  apex::QueueFillModel model;
+
+  // a resting bid fills once the ask reaches it, by the size offered
+  {
+    apex::MarketData md;
+    apex::TickTop top;
+    top.bid_price = 100.0;
+    top.bid_qty = 5.0;
+    top.ask_price = 101.0;
+    top.ask_qty = 2.0;
+    md.apply(top);
+    Fills handler;
+    apex::SimMatchingBook book(md, model, apex::SimCrossFill::visible, handler);
+    book.rest(buy(1, 1.0, 100.5));
+    book.match_crosses();
+    REQUIRE(handler.fills.empty());
+
+    top.ask_price = 100.5;
+    top.ask_qty = 0.4;
+    md.apply(top);
+    book.apply_book_change();
+    REQUIRE(handler.fills.size() == 1);
+    REQUIRE(handler.fills[0].size == 0.4);
+    REQUIRE(handler.fills[0].price == 100.5);
+    REQUIRE(!handler.fills[0].fully_filled);
+
+    top.ask_qty = 3.0;
+    md.apply(top);
+    book.apply_book_change();
+    REQUIRE(handler.fills.size() == 2);
+    REQUIRE(std::abs(handler.fills[1].size - 0.6) < 1e-9);
+    REQUIRE(handler.fills[1].fully_filled);
+    REQUIRE(book.empty());
+  }
+
+  // "visible" fills no more than the displayed size across all our crossed
+  // levels, best level first
+  {
+    apex::MarketData md;
+    apex::TickTop top;
+    top.bid_price = 100.0;
+    top.bid_qty = 5.0;
+    top.ask_price = 102.0;
+    top.ask_qty = 2.0;
+    md.apply(top);
+    Fills handler;
+    apex::SimMatchingBook book(md, model, apex::SimCrossFill::visible, handler);
+    book.rest(buy(1, 2.0, 100.8));
+    book.rest(buy(2, 2.0, 101.0));
+    book.match_crosses();
+    REQUIRE(handler.fills.empty());
+
+    top.ask_price = 100.8;
+    top.ask_qty = 3.0;
+    md.apply(top);
+    REQUIRE(book.opposite_qty(apex::Side::buy, 101.0) == 3.0);
+    book.apply_book_change();
+    REQUIRE(handler.fills.size() == 2);
+    REQUIRE(handler.fills[0].id == 2);
+    REQUIRE(handler.fills[0].size == 2.0);
+    REQUIRE(handler.fills[1].id == 1);
+    REQUIRE(handler.fills[1].size == 1.0);
+
+    // both fill at the ask, below the price of the order at 101
+    REQUIRE(handler.fills[0].price == 100.8);
+    REQUIRE(handler.fills[1].price == 100.8);
+    REQUIRE(book.size() == 1);
+    REQUIRE(book.find(1)->size_remain() == 1.0);
+  }
+
+  // "none" leaves crossed orders to fill by trades alone, as before cross
+  // fills were simulated
+  {
+    apex::MarketData md;
+    apex::TickTop top;
+    top.bid_price = 100.0;
+    top.bid_qty = 5.0;
+    top.ask_price = 100.5;
+    top.ask_qty = 3.0;
+    md.apply(top);
+    Fills handler;
+    apex::SimMatchingBook book(md, model, apex::SimCrossFill::none, handler);
+    book.rest(buy(1, 1.0, 101.0));
+    book.match_crosses();
+    book.apply_book_change();
+    REQUIRE(handler.fills.empty());
+
+    book.apply_trade(100.5, 0.25);
+    REQUIRE(handler.fills.size() == 1);
+    REQUIRE(handler.fills[0].price == 100.5);
+    REQUIRE(handler.fills[0].size == 0.25);
+    REQUIRE(book.size() == 1);
+  }
+
+  // an order marketable on arrival at a SimExchange is filled, but the fill
+  // is not reported before the order's ack, even if fills are quicker
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto at = [start](int ms) {
+    auto t = start;
+    t += std::chrono::milliseconds(ms);
+    return t;
+  };
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_sim_cross_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto csv = dir / "instruments.csv";
+  std::ofstream(csv)
+      << "instId,symbol,type,venue,baseAsset,quoteAsset,lotQty,tickSize,"
+         "minNotional,minQty,baseAssetPrecision,quoteAssetPrecision\n"
+         "BTCUSDT.BINANCE,BTCUSDT,coinpair,binance,BTC,USDT,0.00001,0.01,5,"
+         "0.00001,8,8\n";
+  apex::Services services(apex::RunMode::backtest, {start, at(1000)});
+  // no tick files are replayed: the ticks are applied by the test; a log
+  // file of its own keeps the backtest clock out of the shared logger
+  services.init_services(apex::Config(json{
+      {"log_file", (dir / "backtest.log").string()},
+      {"ref_data", {{"instruments_csv", csv.string()}, {"use_snapshot", false}}},
+      {"persist", {{"path", dir.string()}}},
+      {"backtest", {{"replay_filter", {{"streams", {"l3"}}}}}}}));
+  apex::SimLatencies latencies;
+  latencies.order =
+      std::make_unique<apex::ConstantLatency>(std::chrono::milliseconds(300));
+  latencies.fill =
+      std::make_unique<apex::ConstantLatency>(std::chrono::milliseconds(10));
+  apex::SimExchange exchange(&services, std::make_unique<apex::QueueFillModel>(),
+                             std::move(latencies));
+  exchange.add_instrument(btc);
+
+  auto* md = services.market_data_service()->find_market_data(btc);
+  REQUIRE(md != nullptr);
+  apex::TickTop top;
+  top.bid_price = 100.0;
+  top.bid_qty = 5.0;
+  top.ask_price = 101.0;
+  top.ask_qty = 2.0;
+  md->apply(top);
+
+  auto order = std::make_shared<apex::Order>(
+      &services, &exchange, btc, apex::Side::buy, 1.0, 101.5,
+      apex::TimeInForce::gtc, "TST0000000000000001");
+  // the order goes live, then fills, both when the ack is due
+  std::vector<std::pair<std::string, apex::Time>> events;
+  order->events().subscribe([&](const apex::OrderEvent& ev) {
+    if (ev.is_fill())
+      events.push_back({"fill", services.now()});
+    else if (order->state() == apex::OrderState::live)
+      events.push_back({"live", services.now()});
+  });
+  order->send();
+  // the risk service counts the order as working until it fills
+  auto* risk = services.risk_service();
+  const auto btc_iid = order->instrument().iid();
+  REQUIRE(risk->working(btc_iid, apex::Side::buy) == 1.0);
+  services.backtest_evloop()->run_loop(at(1000));
+  REQUIRE(risk->working(btc_iid, apex::Side::buy) == 0.0);
+  REQUIRE(risk->position(btc_iid) == 1.0);
+  REQUIRE(events.size() == 2);
+  REQUIRE(events[0].first == "live");
+  REQUIRE(events[1].first == "fill");
+  REQUIRE(events[0].second == at(300));
+  REQUIRE(events[1].second == at(300));
+  REQUIRE(order->is_closed());
+  REQUIRE(order->filled_size() == 1.0);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("order_cache_levels")
+{
+  struct NullRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    bool is_up() const override { return true; }
+  } router;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+
+  apex::OrderCache cache(0.5);
+  int id = 0;
+  auto add = [&](apex::Side side, double price, double size) {
+    auto order = std::make_shared<apex::Order>(
+        nullptr, &router, instrument, side, size, price,
+        apex::TimeInForce::gtc, "TST" + std::to_string(++id));
+    cache.add_new_order(order);
+    return order;
+  };
+  add(apex::Side::buy, 100.0, 1.0);
+  add(apex::Side::buy, 100.0, 2.0);
+  auto far_bid = add(apex::Side::buy, 98.0, 1.0);
+  add(apex::Side::buy, 99.5, 1.0);
+  add(apex::Side::sell, 101.0, 3.0);
+  auto far_ask = add(apex::Side::sell, 103.5, 1.0);
+
+  REQUIRE(cache.order_count() == 6);
+  REQUIRE(cache.has_pending_orders());
+  REQUIRE(!cache.has_live_orders());
+  REQUIRE(cache.level_count(apex::Side::buy) == 3);
+  REQUIRE(cache.level_count(apex::Side::sell) == 2);
+  REQUIRE(cache.resting_size(apex::Side::buy, 100.0) == 3.0);
+  REQUIRE(cache.resting_size(apex::Side::buy, 100.1) == 3.0); // nearest tick
+  REQUIRE(cache.resting_size(apex::Side::sell, 100.0) == 0.0);
+
+  // bids more than 2 ticks below 100.5, asks more than 2 ticks above 101
+  std::vector<std::shared_ptr<apex::Order>> beyond;
+  cache.orders_beyond(apex::Side::buy, 100.5, 2, beyond);
+  REQUIRE(beyond.size() == 1);
+  REQUIRE(beyond[0] == far_bid);
+  cache.orders_beyond(apex::Side::sell, 101.0, 2, beyond);
+  REQUIRE(beyond.size() == 1);
+  REQUIRE(beyond[0] == far_ask);
+  cache.orders_beyond(apex::Side::buy, 100.5, 0, beyond);
+  REQUIRE(beyond.size() == 4);
+
+  // only state changes are applied
+  cache.apply(apex::OrderEvent(far_bid, apex::OrderEvent::Flags::fill, {},
+                               apex::OrderState::init, apex::OrderState::init));
+  REQUIRE(cache.order_count() == 6);
+}
+
+
+TEST_CASE("order_amend")
+{
+  struct ReplaceRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    void replace_order(apex::Order&) override { replaces++; }
+    bool is_up() const override { return true; }
+    int replaces = 0;
+  } router;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+
+  auto order = std::make_shared<apex::Order>(
+      &services, &router, instrument, apex::Side::buy, 2.0, 100.0,
+      apex::TimeInForce::gtc, "TST1");
+  apex::OrderCache cache(0.5);
+  cache.add_new_order(order);
+  int amends = 0;
+  order->events().subscribe([&](const apex::OrderEvent& ev) {
+    cache.apply(ev);
+    if (ev.is_amend())
+      amends++;
+  });
+
+  // only a live order can be amended
+  REQUIRE(!order->amend(99.0, 1.0));
+  order->send();
+  order->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+  order->apply(apex::OrderFill{false, start, 100.0, 0.5});
+  REQUIRE(order->amend(99.0, 1.0));
+  REQUIRE(router.replaces == 1);
+  REQUIRE(order->is_amending());
+  REQUIRE(!order->amend(98.0, 1.0));
+
+  // the replacement keeps the fills so far; the close of the original is
+  // then ignored
+  order->apply_amend(apex::OrderUpdate{apex::OrderState::live, {}, "B"});
+  REQUIRE(amends == 1);
+  REQUIRE(!order->is_amending());
+  REQUIRE(order->price() == 99.0);
+  REQUIRE(order->size() == 1.5);
+  REQUIRE(order->exch_order_id() == "B");
+  REQUIRE(cache.resting_size(apex::Side::buy, 100.0) == 0.0);
+  REQUIRE(cache.resting_size(apex::Side::buy, 99.0) == 1.0);
+  order->apply(apex::OrderUpdate{apex::OrderState::closed,
+                                 apex::OrderCloseReason::cancelled, "A"});
+  REQUIRE(order->is_live());
+
+  // a cancel seen while an amend is pending applies once that is rejected
+  REQUIRE(order->amend(98.0, 1.0));
+  order->apply(apex::OrderUpdate{apex::OrderState::closed,
+                                 apex::OrderCloseReason::cancelled, "B"});
+  REQUIRE(order->is_live());
+  order->apply_amend_reject("e0103", "order not found");
+  REQUIRE(order->is_amend_rejected());
+  REQUIRE(order->is_closed());
+  REQUIRE(order->price() == 99.0);
+  REQUIRE(cache.order_count() == 0);
+}
+
+
+TEST_CASE("order_batch")
+{
+  struct BatchRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override { singles++; }
+    void cancel_order(apex::Order&) override { singles++; }
+    void send_orders(const std::vector<apex::Order*>& orders) override
+    {
+      batches.push_back(orders.size());
+    }
+    void cancel_orders(const std::vector<apex::Order*>& orders,
+                       bool all_open) override
+    {
+      if (fail)
+        throw std::runtime_error("router down");
+      batches.push_back(orders.size());
+      last_all_open = all_open;
+    }
+    bool is_up() const override { return true; }
+    int singles = 0;
+    bool fail = false;
+    bool last_all_open = false;
+    std::vector<size_t> batches;
+  } first, second;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+
+  std::vector<std::shared_ptr<apex::Order>> orders;
+  for (int i = 0; i < 5; i++)
+    orders.push_back(std::make_shared<apex::Order>(
+        &services, i < 3 ? &first : &second, instrument, apex::Side::buy, 1.0,
+        100.0 - i, apex::TimeInForce::gtc, "TST" + std::to_string(i)));
+
+  // one request per router
+  apex::Order::send_all(orders);
+  REQUIRE((first.batches == std::vector<size_t>{3}));
+  REQUIRE((second.batches == std::vector<size_t>{2}));
+  REQUIRE(first.singles == 0);
+  for (auto& order : orders)
+    REQUIRE(order->state() == apex::OrderState::sent);
+  bool resend_failed = false;
+  try {
+    apex::Order::send_all(orders);
+  } catch (std::exception&) {
+    resend_failed = true;
+  }
+  REQUIRE(resend_failed);
+
+  // closed and canceling orders are skipped
+  orders[0]->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+  orders[0]->apply(apex::OrderUpdate{apex::OrderState::closed,
+                                     apex::OrderCloseReason::filled, "A"});
+  REQUIRE(orders[1]->cancel());
+  REQUIRE(first.singles == 1);
+  first.batches.clear();
+  second.batches.clear();
+  second.fail = true;
+  auto sent = apex::Order::cancel_all(orders, true);
+  REQUIRE(sent == 1);
+  REQUIRE((first.batches == std::vector<size_t>{1}));
+  REQUIRE(first.last_all_open);
+  REQUIRE(orders[2]->is_canceling());
+  REQUIRE(!orders[3]->is_canceling());
+  REQUIRE(apex::Order::cancel_all(orders) == 0);
+}
+
+
+namespace
+{
+// Places an order, waits for it to go live, and cancels it unless filled
+// within 20ms.
+apex::co::Task order_workflow(apex::EventLoop& evloop,
+                              std::shared_ptr<apex::Order> order,
+                              std::vector<std::string>& trail)
+{
+  order->send();
+  if (!co_await order->live()) {
+    trail.push_back("rejected");
+    co_return;
+  }
+  trail.push_back("live");
+  auto which = co_await apex::any(
+      order->filled(), apex::sleep(evloop, std::chrono::milliseconds(20)));
+  trail.push_back(which == 0 ? "filled" : "timeout");
+  if (which == 1)
+    order->cancel();
+  co_await order->closed();
+  trail.push_back("closed");
+}
+} // namespace
+
+
+TEST_CASE("order_coroutine")
+{
+  // the router replies to a cancel from the event loop, as a gateway would
+  struct CancelRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order& order) override
+    {
+      evloop->dispatch([o = order.shared_from_this()]() {
+        o->apply(apex::OrderUpdate{apex::OrderState::closed,
+                                   apex::OrderCloseReason::cancelled, "A"});
+      });
+    }
+    bool is_up() const override { return true; }
+    apex::EventLoop* evloop = nullptr;
+  } router;
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                              apex::Asset("BTC", "binance", 8),
+                              apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                              "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  auto new_order = [&](const char* id) {
+    return std::make_shared<apex::Order>(&services, &router, instrument,
+                                         apex::Side::buy, 1.0, 100.0,
+                                         apex::TimeInForce::gtc, id);
+  };
+  const std::vector<std::string> timed_out{"live", "timeout", "closed"};
+
+  // backtest: the timeout elapses in backtest time
+  {
+    apex::BacktestEventLoop evloop(start);
+    evloop.set_time(start);
+    router.evloop = &evloop;
+    std::vector<std::string> trail;
+    auto order = new_order("TST1");
+    auto task = order_workflow(evloop, order, trail);
+    REQUIRE(trail.empty());
+    order->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+    REQUIRE((trail == std::vector<std::string>{"live"}));
+    evloop.run_loop({});
+    REQUIRE(trail == timed_out);
+    REQUIRE(task.done());
+    REQUIRE(evloop.get_time().as_epoch_us() ==
+            start.as_epoch_us() + std::chrono::milliseconds(20));
+
+    // a fill ends the wait, and stops the timer
+    trail.clear();
+    order = new_order("TST2");
+    task = order_workflow(evloop, order, trail);
+    order->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+    order->apply(apex::OrderFill{true, start, 100.0, 1.0});
+    REQUIRE((trail == std::vector<std::string>{"live", "filled", "closed"}));
+    REQUIRE(task.done());
+
+    // a rejected order never goes live
+    trail.clear();
+    order = new_order("TST3");
+    task = order_workflow(evloop, order, trail);
+    order->set_is_rejected("e1", "rejected");
+    REQUIRE((trail == std::vector<std::string>{"rejected"}));
+
+    // destroying the task of a suspended workflow ends its waits
+    trail.clear();
+    order = new_order("TST4");
+    task = order_workflow(evloop, order, trail);
+    order->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+    task.reset();
+    evloop.run_loop({});
+    order->apply(apex::OrderFill{true, start, 100.0, 1.0});
+    REQUIRE((trail == std::vector<std::string>{"live"}));
+  }
+
+  // realtime: the same workflow, run on the event thread
+  {
+    apex::RealtimeEventLoop evloop([]() { return false; });
+    router.evloop = &evloop;
+    std::vector<std::string> trail;
+    std::atomic<bool> done{false};
+    auto order = new_order("TST5");
+    evloop.dispatch([&]() {
+      order_workflow(evloop, order, trail).detach();
+      order->apply(apex::OrderUpdate{apex::OrderState::live, {}, "A"});
+    });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      evloop.dispatch([&]() { done = order->is_closed(); });
+    }
+    REQUIRE(done);
+    evloop.sync_stop();
+    REQUIRE(trail == timed_out);
+  }
+}
+
+
+TEST_CASE("rx_local_subject")
+{
+  apex::rx::local_subject<int> local;
+  apex::rx::subject<int> shared;
+  std::vector<int> seen;
+  local.subscribe([&](const int& v) { seen.push_back(v); });
+  local.subscribe([&](const int& v) { seen.push_back(-v); });
+  shared.subscribe([&](const int& v) { seen.push_back(v * 10); });
+  local.next(1);
+  shared.next(2);
+  REQUIRE(local.size() == 2);
+  REQUIRE((seen == std::vector<int>{1, -1, 20}));
+
+  apex::rx::local_observable<int>& obs = local;
+  obs.subscribe([&](const int&) { seen.clear(); });
+  local.next(3);
+  REQUIRE(seen.empty());
+}
+
+
+TEST_CASE("expiring_key_set")
+{
+  using std::chrono::minutes;
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto at = [&](int mins) {
+    return apex::Time(start.as_epoch_us() + minutes(mins));
+  };
+
+  // one hour retention, in 20 minute slices
+  apex::ExpiringKeySet keys(std::chrono::hours(1));
+  keys.insert(1, at(0));
+  keys.insert(2, at(30));
+  REQUIRE(keys.contains(1, at(59)));
+  REQUIRE(keys.contains(2, at(59)));
+  REQUIRE(!keys.contains(3, at(59)));
+
+  // key 1 is dropped with its generation, key 2 survives at least an hour
+  REQUIRE(!keys.contains(1, at(80)));
+  REQUIRE(keys.contains(2, at(90)));
+  REQUIRE(!keys.contains(2, at(120)));
+
+  // a long gap drops everything, and memory stays flat under churn
+  keys.insert(4, at(121));
+  REQUIRE(!keys.contains(4, at(24 * 60)));
+  REQUIRE(keys.size() == 0);
+  for (int i = 0; i < 3 * 24 * 60; i++)
+    keys.insert(uint64_t(i + 100), at(2 * 24 * 60 + i));
+  REQUIRE(keys.size() <= 80);
+}
+
+
+TEST_CASE("object_pool")
+{
+  struct Item : std::enable_shared_from_this<Item> {
+    explicit Item(int v) : value(v) {}
+    int value;
+    char payload[200];
+  };
+
+  auto pool = std::make_shared<apex::BlockPool>(8);
+  std::vector<std::shared_ptr<Item>> live;
+  live.reserve(8);
+  for (int i = 0; i < 8; i++)
+    live.push_back(apex::make_pooled<Item>(pool, i));
+  live.clear();
+  REQUIRE(pool->free_count() == 8);
+
+  // steady state create and release, including weak pointers, is served from
+  // the pool
+  const auto allocations = apex::alloc::thread_counters.count;
+  for (int i = 0; i < 1000; i++) {
+    auto item = apex::make_pooled<Item>(pool, i);
+    std::weak_ptr<Item> wp = item->weak_from_this();
+    live.push_back(std::move(item));
+    if (live.size() == 8)
+      live.clear();
+    REQUIRE(wp.lock() == nullptr || wp.lock()->value == i);
+  }
+  REQUIRE(apex::alloc::thread_counters.count == allocations);
+
+  // objects keep the pool alive after its owner releases it
+  auto survivor = apex::make_pooled<Item>(pool, 42);
+  std::weak_ptr<apex::BlockPool> weak_pool = pool;
+  pool.reset();
+  REQUIRE(!weak_pool.expired());
+  survivor.reset();
+  live.clear();
+  REQUIRE(weak_pool.expired());
+}
+
+
+TEST_CASE("log_line_format")
+{
+  enum Plain { plain_value = 3 };
+  const char* null_str = nullptr;
+  std::string str = "abc";
+  apex::Time t(std::chrono::microseconds(1700000000123456));
+
+  // the direct path renders as the default ostream output does
+  auto render = [&](auto& out) -> auto& {
+    return out << "s=" << str << " c=" << 'x' << " i8=" << int8_t(65)
+               << " i=" << -42 << " u=" << 42u << " ll=" << -1234567890123ll
+               << " b=" << true << " d=" << 16500.0 << " e=" << 1.5e-7
+               << " p=" << 0.30000000000000004 << " f=" << 2.5f
+               << " ld=" << 1e300L << " enum=" << plain_value << " t=" << t;
+  };
+  apex::LogLine line;
+  std::ostringstream oss;
+  render(line);
+  render(oss);
+  REQUIRE(std::move(line).str() == oss.str());
+
+  // once a manipulator is seen, later output keeps its state
+  apex::LogLine hex_line;
+  hex_line << "v=" << 255 << std::hex << " h=" << 255;
+  REQUIRE(std::move(hex_line).str() == "v=255 h=ff");
+
+  // a null C string is skipped, rather than failing the whole line
+  apex::LogLine null_line;
+  null_line << "a" << null_str << "b";
+  REQUIRE(std::move(null_line).str() == "ab");
+
+  // statements below the compiled-in level are discarded
+  REQUIRE(_APEX_LOG_COMPILED_(apex::Logger::level::error));
+  REQUIRE(LOG_LEVEL_ENABLED(apex::Logger::level::debug) ==
+          apex::Logger::instance().is_debug_enabled());
+}
+
+
+TEST_CASE("async_logger")
+{
+  auto& logger = apex::Logger::instance();
+  auto prior_mask = logger.get_mask();
+  logger.set_level(apex::Logger::level::info);
+
+  std::ostringstream captured;
+  auto* prior_buf = std::cout.rdbuf(captured.rdbuf());
+
+  // a small ring, so that producers also wait on the writer
+  logger.start_async(8);
+  REQUIRE(logger.is_async());
+  auto producer = [](int id) {
+    for (int i = 0; i < 200; i++)
+      LOG_INFO("producer " << id << " line " << i);
+  };
+  std::thread t1(producer, 1);
+  std::thread t2(producer, 2);
+  producer(0);
+  t1.join();
+  t2.join();
+  logger.flush();
+  logger.stop_async();
+  REQUIRE(!logger.is_async());
+  LOG_INFO("producer 0 line 200"); // synchronous again
+
+  std::cout.rdbuf(prior_buf);
+  logger.set_mask(prior_mask);
+
+  // every line arrives, and each thread's lines stay in order
+  std::vector<int> next(3, 0);
+  std::istringstream lines(captured.str());
+  std::string line;
+  size_t count = 0;
+  while (std::getline(lines, line)) {
+    auto pos = line.find("producer ");
+    REQUIRE(pos != std::string::npos);
+    int id = 0, i = 0;
+    REQUIRE(sscanf(line.c_str() + pos, "producer %d line %d", &id, &i) == 2);
+    REQUIRE(i == next[id]);
+    next[id]++;
+    count++;
+  }
+  REQUIRE(count == 601);
+}
+
+
+TEST_CASE("binary_log")
+{
+  auto fn = std::filesystem::temp_directory_path() /
+    ("apex_test_binary_log_" + std::to_string(::getpid()) + ".blog");
+  auto& logger = apex::Logger::instance();
+  auto prior_mask = logger.get_mask();
+  logger.set_mask(apex::Logger::mask_levels_all());
+
+  apex::Time t0(std::chrono::microseconds(1700000000123456));
+  apex::Logger::set_thread_clock_source([&t0]() { return t0; });
+
+  logger.start_binary(fn.string());
+  logger.register_thread_id("main");
+  for (int i = 0; i < 3; i++)
+    LOG_INFO("repeated site " << i);
+  LOG_WARN("warning " << 1.5);
+  logger.stop_binary();
+  apex::Logger::set_thread_clock_source({});
+  logger.set_mask(prior_mask);
+
+  std::ifstream is(fn, std::ios::binary);
+  apex::BinaryLogReader reader(is);
+  apex::BinaryLogReader::Entry entry;
+  std::vector<std::string> msgs;
+  std::set<int> lines;
+  while (reader.next(entry)) {
+    REQUIRE(entry.time == t0);
+    REQUIRE(entry.tid == apex::thread_id());
+    REQUIRE(entry.file == __FILE__);
+    REQUIRE(entry.thread_label.find("main") != std::string_view::npos);
+    msgs.emplace_back(entry.msg);
+    lines.insert(entry.line);
+  }
+  REQUIRE((msgs == std::vector<std::string>{"repeated site 0", "repeated site 1",
+                                            "repeated site 2", "warning 1.5"}));
+  REQUIRE(lines.size() == 2);
+  REQUIRE(entry.lvl == apex::Logger::level::warn);
+
+  // rendering matches the text output
+  std::ostringstream line;
+  apex::Logger::render_line(line, entry.time, entry.lvl, entry.tid, {},
+                            entry.msg, entry.file, entry.line, false);
+  REQUIRE(line.str() == "2023-11-14 | 22:13:20.123456 | WARN  | warning 1.5\n");
+
+  // each site's file name is written once, so repeats cost only the record;
+  // a thread record is written for each thread registered so far in the
+  // process, so those are not counted
+  std::ifstream raw(fn, std::ios::binary);
+  raw.seekg(sizeof(apex::binlog::FileHeader));
+  size_t sites = 0, entries = 0, entry_bytes = 0;
+  apex::binlog::RecordHeader head;
+  while (raw.read(reinterpret_cast<char*>(&head), sizeof(head))) {
+    auto kind = static_cast<apex::binlog::Kind>(head.kind);
+    if (kind == apex::binlog::Kind::site) {
+      sites++;
+      REQUIRE(head.size == 4 + strlen(__FILE__));
+    } else if (kind == apex::binlog::Kind::entry) {
+      entries++;
+      entry_bytes += head.size;
+    }
+    raw.seekg(head.size, std::ios::cur);
+  }
+  size_t msg_bytes = 0;
+  for (auto& msg : msgs)
+    msg_bytes += msg.size();
+  REQUIRE(sites == 2);
+  REQUIRE(entries == msgs.size());
+  REQUIRE(entry_bytes == msg_bytes);
+  std::filesystem::remove(fn);
+}
+
+
+TEST_CASE("log_context")
+{
+  // two threads, as of two backtest Services, each logging with a context of
+  // its own clock and sink
+  auto& logger = apex::Logger::instance();
+  auto prior_mask = logger.get_mask();
+  logger.set_mask(apex::Logger::mask_level_and_above(apex::Logger::info));
+
+  std::vector<apex::Time> clocks = {
+    apex::Time(std::chrono::microseconds(1700000000000000)),
+    apex::Time(std::chrono::microseconds(1710000000000000))};
+  std::vector<std::ostringstream*> sinks;
+  std::vector<std::shared_ptr<apex::LogContext>> contexts;
+  for (auto& t : clocks) {
+    auto os = std::make_unique<std::ostringstream>();
+    sinks.push_back(os.get());
+    contexts.push_back(std::make_shared<apex::LogContext>(
+        [&t]() { return t; }, std::move(os)));
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < contexts.size(); i++)
+    threads.emplace_back([&, i]() {
+      apex::Logger::set_thread_context(contexts[i]);
+      for (int n = 0; n < 100; n++)
+        LOG_INFO("instance " << i << " line " << n);
+      apex::Logger::set_thread_context(nullptr);
+    });
+  for (auto& t : threads)
+    t.join();
+  logger.set_mask(prior_mask);
+  REQUIRE(!apex::Logger::thread_context());
+
+  for (size_t i = 0; i < sinks.size(); i++) {
+    std::istringstream is(sinks[i]->str());
+    auto date = clocks[i].strftime("%Y-%m-%d");
+    std::string line;
+    int count = 0;
+    while (std::getline(is, line)) {
+      REQUIRE(line.rfind(date, 0) == 0);
+      REQUIRE(line.find("instance " + std::to_string(i) + " ") !=
+              std::string::npos);
+      count++;
+    }
+    REQUIRE(count == 100);
+  }
+}
+
+
+TEST_CASE("audit_binary_writer")
+{
+  auto stem = std::filesystem::temp_directory_path() /
+    ("apex_test_audit_" + std::to_string(::getpid()));
+  const int count = 1000;
+  {
+    // a small buffer, so that records are written over many swaps
+    apex::AuditBinaryWriter writer(stem, 64);
+    for (int i = 0; i < count; i++) {
+      apex::auditbin::Record rec{};
+      rec.time = 1700000000000000 + i;
+      rec.order_id = writer.intern("ORD" + std::to_string(i / 4));
+      rec.symbol = writer.intern("BTCUSDT");
+      rec.side = (i % 2) ? -1 : 1;
+      rec.price = 16500.0 + i;
+      writer.add(rec);
+      if (i == count / 2)
+        writer.flush();
+    }
+    REQUIRE(writer.record_count() == count);
+  }
+
+  auto path = [&stem](const char* ext) {
+    auto p = stem;
+    p += ext;
+    return p;
+  };
+
+  std::ifstream schema_file(path(".schema.json"));
+  auto schema = json::parse(schema_file);
+  REQUIRE(schema["record_size"] == sizeof(apex::auditbin::Record));
+  REQUIRE(schema["fields"][0]["name"] == "time");
+
+  std::vector<std::string> strings;
+  std::ifstream strings_file(path(".strings"));
+  for (std::string line; std::getline(strings_file, line);)
+    strings.push_back(line);
+  REQUIRE(strings.size() == count / 4 + 1);
+
+  REQUIRE(std::filesystem::file_size(path(".bin")) ==
+          count * sizeof(apex::auditbin::Record));
+  std::ifstream records_file(path(".bin"), std::ios::binary);
+  std::vector<apex::auditbin::Record> records(count);
+  records_file.read(reinterpret_cast<char*>(records.data()),
+                    count * sizeof(apex::auditbin::Record));
+  for (int i = 0; i < count; i++) {
+    REQUIRE(records[i].time == 1700000000000000 + i);
+    REQUIRE(strings.at(records[i].order_id) == "ORD" + std::to_string(i / 4));
+    REQUIRE(strings.at(records[i].symbol) == "BTCUSDT");
+    REQUIRE(records[i].price == 16500.0 + i);
+  }
+
+  for (auto ext : {".bin", ".strings", ".schema.json"})
+    std::filesystem::remove(path(ext));
+}
+
+
+TEST_CASE("fixed_position")
+{
+  using apex::Side;
+
+  // tick 0.01, lot 0.001; values in units of 1e-5
+  apex::FixedPosition pos(apex::ScaledInt(1, -2), apex::ScaledInt(1, -3), 0.5);
+  apex::Position reference(0.5);
+  auto fill = [&](Side side, double qty, double price) {
+    pos.apply_fill(side, qty, price);
+    reference.apply_fill(side, qty, price);
+  };
+
+  fill(Side::buy, 0.3, 100.10);
+  fill(Side::buy, 0.1, 100.50);
+  pos.mark(101.00);
+  REQUIRE(pos.net_lots() == 900);
+  REQUIRE(pos.realised_pnl() == 0);
+  REQUIRE(std::abs(pos.unrealised_pnl() - 0.32) < 1e-9);
+
+  // a partial close realises against the average cost, 100.20
+  fill(Side::sell, 0.2, 100.70);
+  REQUIRE(std::abs(pos.realised_pnl() - 0.1) < 1e-9);
+  REQUIRE(std::abs(pos.unrealised_pnl() - 0.16) < 1e-9);
+
+  // flipping short closes the rest, and opens at the fill price
+  fill(Side::sell, 0.5, 99.90);
+  REQUIRE(pos.net_lots() == 200);
+  REQUIRE(std::abs(pos.realised_pnl() - 0.04) < 1e-9);
+  pos.mark(99.00);
+  REQUIRE(std::abs(pos.unrealised_pnl() - 0.27) < 1e-9);
+
+  // the total agrees with the double model, and is exact in units
+  REQUIRE(std::abs(pos.total_pnl() - reference.total_pnl(99.00)) < 1e-9);
+  REQUIRE(std::abs(pos.total_turnover() - reference.total_turnover(99.00)) < 1e-9);
+  REQUIRE(std::abs(pos.net_qty() - reference.net_qty()) < 1e-12);
+
+  // averages that do not divide evenly leave the total exact
+  apex::FixedPosition uneven(apex::ScaledInt(1, 0), apex::ScaledInt(1, 0));
+  uneven.apply_fill(Side::buy, 3, 10);
+  uneven.apply_fill(Side::buy, 3, 11);
+  uneven.apply_fill(Side::sell, 1, 12);
+  uneven.mark(12);
+  REQUIRE(uneven.realised_pnl() + uneven.unrealised_pnl() == 9);
+  REQUIRE(uneven.total_pnl() == 9);
+}
+
+
+TEST_CASE("portfolio_totals")
+{
+  // totals follow the entries as they change, and drop those destroyed
+  apex::Portfolio portfolio;
+  {
+    apex::Portfolio::Entry first(&portfolio);
+    apex::Portfolio::Entry second(&portfolio);
+    first.update(10.5, 1000);
+    second.update(-2, -400);
+    first.update(12, 1500);
+    REQUIRE(portfolio.pnl() == 10);
+    REQUIRE(portfolio.net_exposure() == 1100);
+    REQUIRE(portfolio.gross_exposure() == 1900);
+
+    second.update(apex::nan, apex::nan);
+    REQUIRE(portfolio.pnl() == 12);
+    REQUIRE(portfolio.gross_exposure() == 1500);
+  }
+  REQUIRE(portfolio.pnl() == 0);
+  REQUIRE(portfolio.net_exposure() == 0);
+  REQUIRE(portfolio.gross_exposure() == 0);
+
+  // portfolio limits of the risk service, read from the running totals
+  apex::Instrument sol(apex::InstrumentType::coinpair, "SOLUSDT.BINANCE",
+                       apex::Asset("SOL", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "SOLUSDT",
+                       "binance");
+  auto sol_iid = apex::InstrumentTable::instance().resolve(sol).iid();
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::RiskService risk(&services, apex::Config(json::parse(
+                                        R"({"max_gross_usd": 5000,
+                                            "max_net_usd": 3000})")));
+  risk.add_portfolio(&portfolio);
+  risk.add_position(sol_iid, 10);
+
+  apex::Portfolio::Entry sol_entry(&portfolio);
+  sol_entry.update(0, 2000);
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) == 0);
+
+  // at the net limit only the reducing side passes
+  sol_entry.update(0, 3000);
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) ==
+          apex::risk_net_exposure);
+  REQUIRE(risk.check(sol_iid, apex::Side::sell, 100, 1) == 0);
+
+  // at the gross limit only orders reducing their position pass
+  apex::Portfolio::Entry other_entry(&portfolio);
+  other_entry.update(0, -2500);
+  REQUIRE(portfolio.gross_exposure() == 5500);
+  REQUIRE(risk.check(sol_iid, apex::Side::buy, 100, 1) ==
+          apex::risk_gross_exposure);
+  REQUIRE(risk.check(sol_iid, apex::Side::sell, 100, 1) == 0);
+  REQUIRE(apex::RiskService::describe(apex::risk_gross_exposure |
+                                      apex::risk_net_exposure) ==
+          "max_gross_usd,max_net_usd");
+}
+
+
+TEST_CASE("performance_stats")
+{
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  auto at = [&](std::chrono::minutes offset) {
+    auto t = start;
+    t += offset;
+    return t;
+  };
+
+  apex::PerformanceStats stats(std::chrono::hours(1));
+  stats.on_order(1000);
+  stats.on_fill(400, true);
+  stats.on_fill(100, false);
+  stats.on_order(-500);
+  stats.mark(at(std::chrono::minutes(0)), 0);
+  stats.mark(at(std::chrono::minutes(30)), 10);
+  stats.mark(at(std::chrono::minutes(90)), 5);
+  stats.mark(at(std::chrono::minutes(150)), apex::nan); // ignored
+
+  // crosses three sample ends, the last two of which saw no change
+  stats.mark(at(std::chrono::minutes(250)), 20);
+
+  auto summary = stats.summary();
+  REQUIRE(summary.orders == 2);
+  REQUIRE(summary.filled_orders == 1);
+  REQUIRE(summary.fills == 2);
+  REQUIRE(summary.fill_ratio() == 0.5);
+  REQUIRE(summary.turnover_usd == 500);
+  REQUIRE(std::fabs(summary.fill_value_ratio() - 1.0 / 3) < 1e-12);
+  REQUIRE(summary.pnl_usd == 20);
+  REQUIRE(summary.peak_pnl_usd == 20);
+  REQUIRE(summary.max_drawdown_usd == 5);
+
+  // hourly changes 10, -5, 0, 0
+  REQUIRE(summary.samples == 4);
+  const double mean = 1.25;
+  const double stddev = std::sqrt((8.75 * 8.75 + 6.25 * 6.25 + 2 * 1.25 * 1.25) / 3);
+  REQUIRE(std::fabs(summary.sharpe - mean / stddev * std::sqrt(24 * 365)) < 1e-9);
+
+  // the auditor keeps the stats per bot and strategy, and writes a summary
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_auditor_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  apex::Instrument sol(apex::InstrumentType::coinpair, "SOLUSDT.BINANCE",
+                       apex::Asset("SOL", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "SOLUSDT",
+                       "binance");
+  auto& interned = apex::InstrumentTable::instance().resolve(sol);
+  std::filesystem::path summary_path;
+  {
+    apex::Services services(apex::RunMode::backtest, {start, start});
+    apex::Auditor auditor(&services, dir.string());
+    auditor.mark_to_market(at(std::chrono::minutes(0)), interned, 3, 3);
+    auditor.mark_to_market(at(std::chrono::minutes(10)), interned, -4, -6);
+    REQUIRE(auditor.performance().max_drawdown_usd == 9);
+    REQUIRE(auditor.performance(interned.iid()).max_drawdown_usd == 7);
+    summary_path = auditor.summary_path();
+  }
+  std::ifstream is(summary_path);
+  auto doc = json::parse(is);
+  REQUIRE(doc.at("strategy").at("pnl_usd").get<double>() == -6);
+  REQUIRE(doc.at("strategy").at("sharpe").is_null());
+  REQUIRE(doc.at("bots").size() == 1);
+  REQUIRE(doc.at("bots")[0].at("symbol").get<std::string>() == "SOLUSDT");
+  REQUIRE(doc.at("bots")[0].at("max_drawdown_usd").get<double>() == 7);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("auditor_deferred_writes")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_auditor_deferred_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  apex::Instrument sol(apex::InstrumentType::coinpair, "SOLUSDT.BINANCE",
+                       apex::Asset("SOL", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "SOLUSDT",
+                       "binance");
+  auto& interned = apex::InstrumentTable::instance().resolve(sol);
+  const apex::Time now(std::chrono::microseconds(1672531200000000));
+
+  struct NullRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    bool is_up() const override { return true; }
+  } router;
+
+  {
+    apex::Services services(apex::RunMode::backtest, {now, now});
+    apex::Auditor auditor(&services, dir.string());
+    auto order = std::make_shared<apex::Order>(
+        &services, &router, interned, apex::Side::buy, 2.0, 20.0,
+        apex::TimeInForce::gtc, "test_00000001");
+    apex::Position position;
+    apex::MarketData md;
+
+    // a transaction is captured, and counted, but not yet written
+    for (int i = 0; i < 3; i++)
+      auditor.add_transaction(now, "test",
+                              apex::OrderEvent(order, apex::OrderEvent::fill,
+                                               now, apex::OrderState::live,
+                                               apex::OrderState::live),
+                              "EVENT", position, &md, 1.0, true, 0.5, 20.0);
+    REQUIRE(auditor.summary().fills == 3);
+    REQUIRE(auditor.pending_transactions() == 3);
+
+    // until the end of the batch
+    auditor.flush_transactions();
+    REQUIRE(auditor.pending_transactions() == 0);
+  }
+
+  std::vector<std::string> lines;
+  for (auto& entry : std::filesystem::directory_iterator(dir)) {
+    if (entry.path().extension() != ".csv")
+      continue;
+    std::ifstream is(entry.path());
+    for (std::string line; std::getline(is, line);)
+      lines.push_back(line);
+  }
+  REQUIRE(lines.size() == 4);
+  REQUIRE(lines[1].find("SOLUSDT,binance,fill,") != std::string::npos);
+  REQUIRE(lines[1].find(",test_00000001,") != std::string::npos);
+  REQUIRE(lines[1].find(",0.5,20.0,") != std::string::npos);
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("state_journal")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+             ("apex_journal_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  auto path = dir / "state_journal.test.mmap";
+
+  apex::Instrument sol(apex::InstrumentType::coinpair, "SOLUSDT.BINANCE",
+                       apex::Asset("SOL", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "SOLUSDT",
+                       "binance");
+  auto& interned = apex::InstrumentTable::instance().resolve(sol);
+  const apex::Time now(std::chrono::microseconds(1672531200000000));
+  const apex::StateJournal::Options options{8, 4};
+
+  struct NullRouter : apex::OrderRouter {
+    void send_order(apex::Order&) override {}
+    void cancel_order(apex::Order&) override {}
+    bool is_up() const override { return true; }
+  } router;
+  apex::Services services(apex::RunMode::backtest, {now, now});
+  auto make_order = [&](const char* id, double price) {
+    return std::make_shared<apex::Order>(&services, &router, interned,
+                                         apex::Side::buy, 2.0, price,
+                                         apex::TimeInForce::gtc, id);
+  };
+  auto live = make_order("test_00000001", 20.0);
+  auto cancelled = make_order("test_00000002", 19.0);
+  auto filled = make_order("test_00000003", 18.0);
+
+  {
+    apex::StateJournal journal(path, "test", options);
+    REQUIRE(journal.open_orders().empty());
+
+    auto slot = journal.position_slot(interned);
+    REQUIRE(journal.position_slot(interned) == slot);
+    journal.record_position(slot, 1.5, now);
+    journal.record_position(slot, 2.5, now);
+
+    live->restore(apex::OrderState::live, "X1", 0.5);
+    journal.record_order(*live, 1, now);
+    cancelled->restore(apex::OrderState::sent, "", 0.0);
+    journal.record_order(*cancelled, 2, now);
+    cancelled->restore(apex::OrderState::closed, "X2", 0.0);
+    journal.record_order(*cancelled, 2, now);
+    filled->restore(apex::OrderState::live, "X3", 0.0);
+    journal.record_order(*filled, 3, now);
+
+    // the journal is held by one engine at a time
+    bool threw = false;
+    try {
+      apex::StateJournal other(path, "test", options);
+    } catch (std::exception&) {
+      threw = true;
+    }
+    REQUIRE(threw);
+  }
+
+  {
+    apex::StateJournal journal(path, "test", options);
+    REQUIRE(journal.torn_slots() == 0);
+    auto orders = journal.open_orders();
+    REQUIRE(orders.size() == 2);
+    std::sort(orders.begin(), orders.end(),
+              [](auto& a, auto& b) { return a.handle < b.handle; });
+    REQUIRE(orders[0].handle == 1);
+    REQUIRE(orders[0].order_id.str() == "test_00000001");
+    REQUIRE(orders[0].ext_order_id.str() == "X1");
+    REQUIRE(orders[0].native_symbol.str() == "SOLUSDT");
+    REQUIRE(orders[0].state == apex::OrderState::live);
+    REQUIRE(orders[0].filled == 0.5);
+    REQUIRE(orders[0].price == 20.0);
+    REQUIRE(orders[1].handle == 3);
+
+    auto positions = journal.positions();
+    REQUIRE(positions.size() == 1);
+    REQUIRE(positions[0].native_symbol.str() == "SOLUSDT");
+    REQUIRE(positions[0].qty == 2.5);
+
+    // the slot of the closed order was freed, and is reused
+    filled->restore(apex::OrderState::closed, "X3", 2.0);
+    journal.record_order(*filled, 3, now);
+    REQUIRE(journal.open_orders().size() == 1);
+  }
+
+  // a crash part way through writing the first order slot leaves its
+  // sequence number odd; the slot is discarded on opening
+  {
+    std::fstream fs(path, std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t seq = 0;
+    fs.seekg(4096);
+    fs.read(reinterpret_cast<char*>(&seq), sizeof(seq));
+    seq |= 1;
+    fs.seekp(4096);
+    fs.write(reinterpret_cast<const char*>(&seq), sizeof(seq));
+  }
+  {
+    apex::StateJournal journal(path, "test", options);
+    REQUIRE(journal.torn_slots() == 1);
+    REQUIRE(journal.open_orders().empty());
+    REQUIRE(journal.positions().size() == 1);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("market_data_streams")
+{
+  apex::Instrument btc(apex::InstrumentType::coinpair, "BTCUSDT.BINANCE",
+                       apex::Asset("BTC", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "BTCUSDT",
+                       "binance");
+  apex::Instrument eur(apex::InstrumentType::coinpair, "EURUSDT.BINANCE",
+                       apex::Asset("EUR", "binance", 8),
+                       apex::Asset("USDT", "binance", 8), "EURUSDT",
+                       "binance");
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+
+  const int l1 = static_cast<int>(apex::MdStream::L1);
+  const int trades = static_cast<int>(apex::MdStream::Trades);
+  const int aggtrades = static_cast<int>(apex::MdStream::AggTrades);
+
+  // without config, instruments have trades and top of book
+  apex::MarketDataService defaults(&services);
+  REQUIRE(defaults.default_streams().mask == (aggtrades | l1));
+  REQUIRE(defaults.configured_streams(eur, {l1}).mask == l1);
+
+  // instrument streams take precedence over both default and requested
+  apex::MarketDataService configured(&services, apex::Config(json::parse(R"({
+    "streams": ["l1", "trades"],
+    "instruments": { "EURUSDT.BINANCE": { "streams": ["l1"] } } })")));
+  REQUIRE(configured.default_streams().mask == (l1 | trades));
+  REQUIRE(configured.configured_streams(eur, {aggtrades | l1}).mask == l1);
+  REQUIRE(configured.configured_streams(btc, {aggtrades}).mask == aggtrades);
+  REQUIRE(configured.subscribed_streams(btc).mask == 0);
+
+  REQUIRE(apex::parse_md_stream("aggtrades") == apex::MdStream::AggTrades);
+  for (auto bad : {R"({"streams": ["depth"]})", R"({"streams": "l1"})",
+                   R"({"instruments": {"EURUSDT.BINANCE": ["l1"]}})"}) {
+    bool rejected = false;
+    try {
+      apex::MarketDataService svc(&services, apex::Config(json::parse(bad)));
+    } catch (apex::ConfigError&) {
+      rejected = true;
+    }
+    REQUIRE(rejected);
+  }
+}
+
+
+TEST_CASE("fx_rate_conflation")
+{
+  const apex::Time start(std::chrono::microseconds(1672531200000000));
+  apex::Services services(apex::RunMode::backtest, {start, start});
+  apex::MarketData eur_market;
+  apex::MarketData gbp_market;
+  apex::FxRateService fx(&services, apex::Config(json{{"interval_ms", 1000}}));
+  REQUIRE(fx.interval() == std::chrono::seconds(1));
+
+  // the notional currencies need no conversion
+  REQUIRE(fx.has_rate(apex::FxRateService::notional_asset_id));
+  REQUIRE(fx.rate(apex::FxRateService::notional_asset_id) == 1.0);
+  REQUIRE(!fx.has_rate(apex::no_asset_id));
+
+  apex::Asset eur("EUR", "binance", 8);
+  auto eur_id = fx.add_source(eur, &eur_market);
+  REQUIRE(eur_id != apex::FxRateService::notional_asset_id);
+  REQUIRE(fx.add_source(eur, &gbp_market) == eur_id);
+  REQUIRE(!fx.has_rate(eur_id));
+
+  auto top = [](double bid, double ask) {
+    apex::TickTop tick;
+    tick.bid_price = bid;
+    tick.bid_qty = 1;
+    tick.ask_price = ask;
+    tick.ask_qty = 1;
+    return tick;
+  };
+
+  // the first rate is taken at once, later ones at most once per interval
+  eur_market.apply(top(1.08, 1.10));
+  REQUIRE(fx.rate(eur_id) == 1.09);
+  eur_market.apply(top(1.18, 1.20));
+  eur_market.apply(top(1.28, 1.30));
+  REQUIRE(fx.rate(eur_id) == 1.09);
+  REQUIRE(fx.conflated() == 2);
+  auto later = start;
+  later += std::chrono::seconds(1);
+  services.backtest_evloop()->set_time(later);
+  services.backtest_evloop()->run_loop(later);
+  eur_market.apply(top(1.38, 1.40));
+  REQUIRE(fx.rate(eur_id) == 1.39);
+  REQUIRE(fx.updates() == 2);
+
+  // without a top of book, the last trade gives the rate
+  auto gbp_id = fx.add_source(apex::Asset("GBP", "binance", 8), &gbp_market);
+  REQUIRE(gbp_id != eur_id);
+  apex::TickTrade trade;
+  trade.price = 1.25;
+  trade.qty = 1;
+  gbp_market.apply(trade);
+  REQUIRE(fx.has_rate(gbp_id));
+  REQUIRE(fx.rate(gbp_id) == 1.25);
+}
+
+
+TEST_CASE("bar_service")
+{
+  const apex::Time start(std::chrono::seconds(1672531200));
+  auto at = [&](int sec) {
+    return apex::Time{start.as_epoch_us() + std::chrono::seconds(sec)};
+  };
+  apex::Services services(apex::RunMode::backtest, {start, at(600)});
+  auto* evloop = services.backtest_evloop();
+
+  apex::Instrument instrument(apex::InstrumentType::coinpair, "BTCUSDT.BNC",
+                              {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                              "BTCUSDT", "binance");
+  apex::MarketData market;
+  apex::BarService bar_service(&services,
+                               apex::Config(json{{"capacity", 2}}));
+  auto* minutes = bar_service.subscribe(instrument, std::chrono::seconds(60),
+                                        &market);
+  auto* fives = bar_service.subscribe(instrument, std::chrono::seconds(300),
+                                      &market);
+  REQUIRE(minutes != fives);
+  REQUIRE(bar_service.subscribe(instrument, std::chrono::seconds(60)) == minutes);
+  REQUIRE(bar_service.find(instrument, std::chrono::seconds(300)) == fives);
+
+  struct Counter : apex::BarSeries::Listener {
+    std::vector<apex::Time> closes;
+    apex::Services* services;
+    void on_bar_close(const apex::BarSeries&) override
+    {
+      closes.push_back(services->now());
+    }
+  } counter;
+  counter.services = &services;
+  minutes->add_listener(&counter);
+
+  // ticks replayed at their times, interleaved with the service's timers
+  class TickSource : public apex::BacktestEventSource
+  {
+  public:
+    std::vector<std::pair<apex::Time, std::function<void()>>> ticks;
+    size_t next = 0;
+
+    apex::Time get_next_event_time() override
+    {
+      return next < ticks.size() ? ticks[next].first : apex::Time{};
+    }
+    void consume_next_event() override { ticks[next++].second(); }
+    void init_backtest_time_range(apex::Time, apex::Time) override {}
+    const char* event_source_kind() const override { return "ticks"; }
+  } source;
+
+  auto trade = [&](int sec, double price, double qty) {
+    source.ticks.push_back({at(sec), [&market, price, qty]() {
+      apex::TickTrade tick;
+      tick.price = price;
+      tick.qty = qty;
+      market.apply(tick);
+    }});
+  };
+  trade(10, 100, 1);
+  source.ticks.push_back({at(30), [&]() {
+    apex::TickTop top;
+    top.bid_price = 99;
+    top.bid_qty = 1;
+    top.ask_price = 101;
+    top.ask_qty = 1;
+    market.apply(top);
+  }});
+  trade(30, 102, 2);
+  trade(60, 98, 1);
+  trade(200, 97, 1);
+  evloop->add_event_source(&source);
+  evloop->run_loop(at(600));
+
+  // a tick of the next minute closes the first, else it closes at its end
+  REQUIRE(counter.closes.size() == 3);
+  REQUIRE(counter.closes[0] == at(60));
+  REQUIRE(counter.closes[1] == at(120));
+  REQUIRE(counter.closes[2] == at(240));
+
+  // the ring keeps the latest bars only
+  REQUIRE(minutes->total() == 3);
+  REQUIRE(minutes->size() == 2);
+  REQUIRE(minutes->at(0).start_time() == at(180));
+  REQUIRE(minutes->at(0).close == 97);
+  auto& second = minutes->at(1);
+  REQUIRE(second.start_time() == at(60));
+  REQUIRE(second.open == 98);
+  REQUIRE(second.trades == 1);
+  REQUIRE(second.bid == 99);
+
+  // the five minute bar spans all the ticks
+  REQUIRE(fives->total() == 1);
+  auto& five = fives->last();
+  REQUIRE(five.end_time() == at(300));
+  REQUIRE(five.open == 100);
+  REQUIRE(five.high == 102);
+  REQUIRE(five.low == 97);
+  REQUIRE(five.close == 97);
+  REQUIRE(five.volume == 5);
+  REQUIRE(five.trades == 4);
+  REQUIRE(five.quotes == 1);
+  REQUIRE(five.spread_mean == 2);
+
+  minutes->remove_listener(&counter);
+}
+
+
+TEST_CASE("position_log")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_test_position_log_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto path = dir / "positions.wal";
+  apex::Time ts(std::chrono::microseconds(1700000000123456));
+
+  auto position = [](std::string strategy, std::string symbol, double qty) {
+    apex::RestoredPosition p;
+    p.strategy_id = std::move(strategy);
+    p.exchange = "binance";
+    p.native_symbol = std::move(symbol);
+    p.qty = qty;
+    return p;
+  };
+
+  auto qty_of = [](const std::vector<apex::RestoredPosition>& positions,
+                   const std::string& symbol) {
+    for (auto& p : positions)
+      if (p.native_symbol == symbol)
+        return p.qty;
+    return -1.0;
+  };
+
+  apex::PositionLog::Options options;
+  options.fsync = false;
+  options.compact_min_frames = 64;
+
+  // group committed from the background thread, and compacted on the way
+  {
+    apex::PositionLog log(path, options);
+    for (int i = 1; i <= 1000; i++) {
+      log.append(position("S1", "BTCUSDT", i * 0.5), ts);
+      log.append(position("S2", "ETHUSDT", -i), ts);
+    }
+    log.sync();
+    REQUIRE(log.frame_count() < 200);
+    REQUIRE(qty_of(log.positions("S1"), "BTCUSDT") == 500.0);
+  }
+
+  // replay at startup
+  {
+    apex::PositionLog log(path, options);
+    REQUIRE(log.positions("S1").size() == 1);
+    REQUIRE(qty_of(log.positions("S1"), "BTCUSDT") == 500.0);
+    REQUIRE(qty_of(log.positions("S2"), "ETHUSDT") == -1000.0);
+  }
+
+  // a torn final frame, as left by a crash mid-write, is dropped
+  auto good_size = std::filesystem::file_size(path);
+  {
+    options.background = false;
+    apex::PositionLog log(path, options);
+    log.append(position("S1", "BTCUSDT", 7.0), ts);
+  }
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+  {
+    apex::PositionLog log(path, options);
+    REQUIRE(qty_of(log.positions("S1"), "BTCUSDT") == 500.0);
+    REQUIRE(std::filesystem::file_size(path) == good_size);
+
+    // and a corrupt frame ends the replay
+    log.append(position("S1", "BTCUSDT", 8.0), ts);
+  }
+  {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(-2, std::ios::end);
+    f.put('#');
+  }
+  {
+    apex::PositionLog log(path, options);
+    REQUIRE(qty_of(log.positions("S1"), "BTCUSDT") == 500.0);
+  }
+
+  // a failed write is reported by sync, inline or from the background
+  // thread; the log's descriptor is replaced by a read-only one to fail it
+  auto fail_writes = [&]() {
+    for (auto& entry : std::filesystem::directory_iterator("/proc/self/fd")) {
+      std::error_code ec;
+      if (std::filesystem::read_symlink(entry.path(), ec) == path) {
+        int fd = ::open("/dev/null", O_RDONLY);
+        ::dup2(fd, std::stoi(entry.path().filename().string()));
+        ::close(fd);
+        return true;
+      }
+    }
+    return false;
+  };
+  for (bool background : {false, true}) {
+    options.background = background;
+    apex::PositionLog log(path, options);
+    log.append(position("S1", "BTCUSDT", 9.0), ts);
+    log.sync();
+    REQUIRE(fail_writes());
+    log.append(position("S1", "BTCUSDT", 10.0), ts);
+    for (int i = 0; i < 2; i++) {
+      bool threw = false;
+      try {
+        log.sync();
+      } catch (const apex::Error& e) {
+        threw = std::string(e.what()).find("position log write failed") !=
+                std::string::npos;
+      }
+      REQUIRE(threw);
+    }
+  }
+  {
+    apex::PositionLog log(path, options);
+    REQUIRE(qty_of(log.positions("S1"), "BTCUSDT") == 9.0);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("position_snapshot")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_test_position_snapshot_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto path = dir / "positions.S1.json";
+  apex::Time ts(std::chrono::microseconds(1700000000123456));
+
+  auto position = [](std::string symbol, double qty) {
+    apex::RestoredPosition p;
+    p.strategy_id = "S1";
+    p.exchange = "binance";
+    p.native_symbol = std::move(symbol);
+    p.qty = qty;
+    return p;
+  };
+
+  // many instruments, imported with one write
+  {
+    apex::PositionSnapshot snapshot(path, "S1", false);
+    REQUIRE(!snapshot.exists());
+    std::vector<apex::RestoredPosition> imported;
+    for (int i = 0; i < 2000; i++)
+      imported.push_back(position("SYM" + std::to_string(i), i * 0.25));
+    snapshot.update(imported, ts);
+    REQUIRE(snapshot.exists());
+    snapshot.update(position("SYM7", -3.5), ts);
+  }
+
+  // and restored in one read, with no temporary file left behind
+  {
+    apex::PositionSnapshot snapshot(path, "S1", false);
+    REQUIRE(snapshot.exists());
+    auto positions = snapshot.positions();
+    REQUIRE(positions.size() == 2000);
+    size_t found = 0;
+    for (auto& p : positions) {
+      REQUIRE(p.strategy_id == "S1");
+      if (p.native_symbol == "SYM7")
+        found += p.qty == -3.5;
+      if (p.native_symbol == "SYM1999")
+        found += p.qty == 1999 * 0.25;
+    }
+    REQUIRE(found == 2);
+  }
+  REQUIRE(!std::filesystem::exists(dir / "positions.S1.json.tmp"));
+
+  // an update that does not change a quantity does not rewrite the document
+  {
+    apex::PositionSnapshot snapshot(path, "S1", false);
+    auto written = std::filesystem::last_write_time(path);
+    std::filesystem::last_write_time(path, written - std::chrono::hours(1));
+    snapshot.update(position("SYM7", -3.5), ts);
+    REQUIRE(std::filesystem::last_write_time(path) ==
+            written - std::chrono::hours(1));
+  }
+
+  // a document that cannot be parsed is not silently taken as empty
+  {
+    std::ofstream(path) << "{ \"positions\": [";
+    bool threw = false;
+    try {
+      apex::PositionSnapshot snapshot(path, "S1", false);
+    } catch (std::exception&) {
+      threw = true;
+    }
+    REQUIRE(threw);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("refdata_snapshot")
+{
+  auto dir = std::filesystem::temp_directory_path() /
+    ("apex_test_refdata_snapshot_" + std::to_string(::getpid()));
+  std::filesystem::create_directories(dir);
+  auto csv = dir / "instruments.csv";
+  auto snapshot = dir / "instruments.csv.snapshot";
+  {
+    std::ofstream f(csv);
+    f << "instId,symbol,type,venue,baseAsset,quoteAsset,lotQty,tickSize,"
+         "minNotional,minQty,baseAssetPrecision,quoteAssetPrecision\n"
+      << "BTCUSDT.BNC,BTCUSDT,coinpair,binance,BTC,USDT,0.00001,0.01,5,0.00001,8,8\n"
+      << "ETHUSDT.BNC,ETHUSDT,coinpair,binance,ETH,USDT,0.0001,0.01,5,0.0001,8,8\n"
+      << "BTCUSDT.BNCP,BTCUSDT,perp,binance,BTC,USDT,0.001,0.1,5,0.001,8,8\n";
+  }
+
+  auto check = [](apex::RefDataService& refdata) {
+    REQUIRE(refdata.instrument_count() == 3);
+    auto& eth = refdata.get_instrument(apex::InstrumentQuery("ETHUSDT"));
+    REQUIRE(eth.id() == "ETHUSDT.BNC");
+    REQUIRE(eth.tick_size == apex::ScaledInt("0.01"));
+    REQUIRE(eth.minimum_size == 0.0001);
+
+    auto index = refdata.get_instrument_id(
+        apex::InstrumentQuery("BTCUSDT", apex::InstrumentType::perpetual));
+    REQUIRE(refdata.instrument_at(index).id() == "BTCUSDT.BNCP");
+    REQUIRE(refdata.instrument_at(index).iid() == index);
+    REQUIRE(refdata.instrument_at(index).lot_size == apex::ScaledInt("0.001"));
+
+    bool ambiguous = false;
+    try {
+      refdata.get_instrument(apex::InstrumentQuery("BTCUSDT"));
+    } catch (std::exception&) {
+      ambiguous = true;
+    }
+    REQUIRE(ambiguous);
+  };
+
+  json config = {{"instruments_csv", csv.string()}};
+
+  // first load parses the csv and writes the snapshot
+  {
+    apex::RefDataService refdata(nullptr, apex::Config(config));
+    REQUIRE(std::filesystem::exists(snapshot));
+    check(refdata);
+  }
+
+  // second load uses it
+  {
+    std::vector<apex::RefDataRow> rows;
+    REQUIRE(apex::read_refdata_snapshot(snapshot, csv, rows));
+    REQUIRE(rows.size() == 3);
+    apex::RefDataService refdata(nullptr, apex::Config(config));
+    check(refdata);
+  }
+
+  // a changed csv makes the snapshot stale
+  {
+    std::ofstream f(csv, std::ios::app);
+    f << "SOLUSDT.BNC,SOLUSDT,coinpair,binance,SOL,USDT,0.01,0.01,5,0.01,8,8\n";
+  }
+  {
+    std::vector<apex::RefDataRow> rows;
+    REQUIRE(!apex::read_refdata_snapshot(snapshot, csv, rows));
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+
+TEST_CASE("instrument_table")
+{
+  auto& table = apex::InstrumentTable::instance();
+  auto make = [](const std::string& id, const std::string& tick_size) {
+    apex::Instrument instrument(apex::InstrumentType::coinpair, id,
+                                {"BTC", "binance", 8}, {"USDT", "binance", 8},
+                                "BTCUSDT", "binance");
+    instrument.tick_size = apex::ScaledInt(tick_size);
+    return instrument;
+  };
+
+  auto adhoc = make("BTCUSDT.TABLE", "0.01");
+  REQUIRE(adhoc.iid() == apex::no_instrument_id);
+
+  // equal instruments share one entry, which is then found by id
+  auto& interned = table.intern(adhoc);
+  REQUIRE(interned.iid() != apex::no_instrument_id);
+  REQUIRE(&table.intern(make("BTCUSDT.TABLE", "0.01")) == &interned);
+  REQUIRE(&table.resolve(adhoc) == &interned);
+  REQUIRE(&table.resolve(interned) == &interned);
+  REQUIRE(&table.at(interned.iid()) == &interned);
+
+  // an instrument of the same id but different data is a new entry
+  auto& changed = table.intern(make("BTCUSDT.TABLE", "0.1"));
+  REQUIRE(changed.iid() != interned.iid());
+  REQUIRE(table.size() > changed.iid());
+
+  apex::InstrumentMap<int> map;
+  REQUIRE(map.find(interned) == nullptr);
+  map.insert(adhoc, 1);
+  map.insert(changed, 2);
+  REQUIRE(map.insert(interned, 3) == 1);
+  REQUIRE(*map.find(interned) == 1);
+  REQUIRE(*map.find(adhoc) == 1);
+  REQUIRE(*map.find(changed) == 2);
+
+  int total = 0;
+  map.for_each([&](const apex::Instrument& instrument, int v) {
+    REQUIRE(instrument.id() == "BTCUSDT.TABLE");
+    total += v;
+  });
+  REQUIRE(total == 3);
+}
+
+
+TEST_CASE("shard_bus")
+{
+  apex::RealtimeEventLoop loop0([]() { return false; });
+  apex::RealtimeEventLoop loop1([]() { return false; });
+
+  // handlers run on the event loop of their shard, so only the vectors are
+  // accessed afterwards, once each loop has been synced
+  std::vector<apex::ShardMessage> received0, received1;
+  apex::ShardBus bus(2, 4);
+  bus.attach(0, &loop0, [&](const apex::ShardMessage& msg) {
+    received0.push_back(msg);
+  });
+  bus.attach(1, &loop1, [&](const apex::ShardMessage& msg) {
+    received1.push_back(msg);
+  });
+  auto sync = [](apex::EventLoop& loop) {
+    std::promise<void> done;
+    loop.dispatch([&]() { done.set_value(); });
+    done.get_future().wait();
+  };
+
+  for (int i = 0; i < 3; i++) {
+    apex::ShardMessage msg;
+    msg.from = 0;
+    msg.type = i;
+    REQUIRE(bus.post(1, msg));
+  }
+  apex::ShardMessage report;
+  report.from = 1;
+  report.values = {100.0, 5.0, 0.0, 0.0};
+  REQUIRE(bus.broadcast(report) == 1);
+  sync(loop0);
+  sync(loop1);
+
+  REQUIRE(received1.size() == 3);
+  for (int i = 0; i < 3; i++)
+    REQUIRE(received1[i].type == i);
+  REQUIRE(received0.size() == 1);
+  REQUIRE(received0[0].from == 1);
+
+  // with its event loop busy, the inbox of a shard fills and refuses posts
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  loop1.dispatch([released]() { released.wait(); });
+  size_t accepted = 0;
+  for (int i = 0; i < 10; i++)
+    if (bus.post(1, apex::ShardMessage{}))
+      accepted++;
+  REQUIRE(accepted == 4);
+  REQUIRE(bus.dropped() == 6);
+  release.set_value();
+  sync(loop1);
+  REQUIRE(received1.size() == 7);
+
+  // after detach, messages are discarded
+  bus.detach(1);
+  REQUIRE(bus.post(1, apex::ShardMessage{}));
+  sync(loop1);
+  REQUIRE(received1.size() == 7);
+
+  apex::ShardTotals totals(3);
+  totals.update(received0[0]);
+  totals.update(2, {-40.0, 2.0, 0.0, 0.0});
+  REQUIRE(totals.of(1)[0] == 100.0);
+  REQUIRE(totals.total(0) == 60.0);
+  REQUIRE(totals.total(1) == 7.0);
+}
+
+
+// Minimal HTTP/1.1 server, for the client tests: keeps each connection open
+// and replies to every request with its method and path, after a short delay
+// so that concurrent requests overlap.
+class KeepAliveHttpServer
+{
+public:
+  KeepAliveHttpServer()
+  {
+    _listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ::bind(_listen_fd, (sockaddr*)&addr, sizeof(addr));
+    ::listen(_listen_fd, 16);
+    socklen_t len = sizeof(addr);
+    ::getsockname(_listen_fd, (sockaddr*)&addr, &len);
+    _port = ntohs(addr.sin_port);
+    _acceptor = std::thread([this]() { accept_loop(); });
+  }
+
+  ~KeepAliveHttpServer()
+  {
+    _stop = true;
+    ::shutdown(_listen_fd, SHUT_RDWR);
+    _acceptor.join();
+    ::close(_listen_fd);
+    for (auto& t : _sessions)
+      t.join();
+  }
+
+  std::string url(const std::string& path) const
+  {
+    return "http://127.0.0.1:" + std::to_string(_port) + path;
+  }
+
+  int accepted() const { return _accepted; }
+
+private:
+  void accept_loop()
+  {
+    while (!_stop) {
+      int fd = ::accept(_listen_fd, nullptr, nullptr);
+      if (fd < 0)
+        return;
+      _accepted++;
+      _sessions.emplace_back([this, fd]() { serve(fd); });
+    }
+  }
+
+  void serve(int fd)
+  {
+    timeval tv = {0, 100000};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::string buf;
+    char tmp[4096];
+    while (!_stop) {
+      auto end = buf.find("\r\n\r\n");
+      if (end == std::string::npos) {
+        auto n = ::recv(fd, tmp, sizeof(tmp), 0);
+        if (n == 0)
+          break;
+        if (n > 0)
+          buf.append(tmp, n);
+        continue;
+      }
+      size_t body = 0;
+      auto cl = buf.find("Content-Length: ");
+      if (cl != std::string::npos && cl < end)
+        body = std::stoul(buf.substr(cl + 16));
+      if (buf.size() < end + 4 + body) {
+        auto n = ::recv(fd, tmp, sizeof(tmp), 0);
+        if (n == 0)
+          break;
+        if (n > 0)
+          buf.append(tmp, n);
+        continue;
+      }
+      std::string reply = buf.substr(0, buf.find(" HTTP/1.1"));
+      buf.erase(0, end + 4 + body);
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      std::string msg = "HTTP/1.1 200 OK\r\nContent-Length: " +
+                        std::to_string(reply.size()) + "\r\n\r\n" + reply;
+      ::send(fd, msg.data(), msg.size(), MSG_NOSIGNAL);
+    }
+    ::close(fd);
+  }
+
+  int _listen_fd = -1;
+  int _port = 0;
+  std::atomic<bool> _stop{false};
+  std::atomic<int> _accepted{0};
+  std::thread _acceptor;
+  std::vector<std::thread> _sessions;
+};
+
+
+TEST_CASE("http_client_pool")
+{
+  KeepAliveHttpServer server;
+
+  struct Results {
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<std::string> replies;
+
+    apex::HttpClientPool::result_fn collect()
+    {
+      return [this](std::string reply, std::string error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        replies.push_back(error.empty() ? reply : error);
+        cond.notify_one();
+      };
+    }
+
+    bool wait_for(size_t n)
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      return cond.wait_for(lock, std::chrono::seconds(5),
+                           [&]() { return replies.size() >= n; });
+    }
+  };
+
+  {
+    apex::HttpClientPool::Options options;
+    options.max_connections = 2;
+    apex::HttpClientPool pool(options);
+
+    // sequential requests reuse one connection
+    Results results;
+    for (size_t i = 0; i < 5; i++) {
+      pool.request(apex::HttpRequestType::get, server.url("/seq"), {}, nullptr,
+                   results.collect());
+      REQUIRE(results.wait_for(i + 1));
+    }
+    REQUIRE(results.replies[4] == "GET /seq");
+    REQUIRE(pool.connections_opened() == 1);
+    REQUIRE(server.accepted() == 1);
+
+    // concurrent requests are in flight together, limited to the maximum
+    // connections per host
+    Results concurrent;
+    for (int i = 0; i < 6; i++)
+      pool.request(apex::HttpRequestType::post, server.url("/order"),
+                   "a=" + std::to_string(i), {"X-Test: 1"}, concurrent.collect());
+    REQUIRE(concurrent.wait_for(6));
+    for (auto& reply : concurrent.replies)
+      REQUIRE(reply == "POST /order");
+    REQUIRE(pool.connections_opened() == 2);
+    REQUIRE(server.accepted() == 2);
+    REQUIRE(pool.requests_completed() == 11);
+  }
+
+  // connections are opened by the keep-warm pings, before any request
+  apex::HttpClientPool::Options options;
+  options.max_connections = 2;
+  options.warm_connections = 2;
+  options.keep_warm_url = server.url("/ping");
+  apex::HttpClientPool pool(options);
+  for (int i = 0; i < 500 && pool.requests_completed() < 2; i++)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(pool.connections_opened() == 2);
+
+  Results results;
+  pool.request(apex::HttpRequestType::del, server.url("/order"), {}, nullptr,
+               results.collect());
+  REQUIRE(results.wait_for(1));
+  REQUIRE(results.replies[0] == "DELETE /order");
+  REQUIRE(pool.connections_opened() == 2);
+}
+
+
+TEST_CASE("ring_decode_buffer")
+{
+  apex::RingDecodeBuffer buf(1, 64 * 1024);
+  const size_t initial_capacity = buf.capacity();
+  REQUIRE(initial_capacity >= 4096);
+
+  // messages of 100 bytes, fed in uneven chunks, so that partial messages
+  // are held over and wrap around the end of the ring
+  std::string stream;
+  for (int i = 0; i < 1000; i++)
+    stream += std::string(100, static_cast<char>('a' + i % 26));
+
+  size_t pos = 0;
+  size_t decoded = 0;
+  bool contiguous = true;
+  while (pos < stream.size()) {
+    size_t chunk = std::min<size_t>(1 + (pos * 7) % 333, stream.size() - pos);
+    REQUIRE(buf.consume(stream.data() + pos, chunk) == chunk);
+    pos += chunk;
+
+    auto rd = buf.read_ptr();
+    while (rd.avail() >= 100) {
+      const char c = static_cast<char>('a' + decoded % 26);
+      contiguous &= rd[0] == c && rd[99] == c;
+      rd.advance(100);
+      decoded++;
+    }
+    buf.discard(rd);
+  }
+  REQUIRE(contiguous);
+  REQUIRE(decoded == 1000);
+  REQUIRE(buf.avail() == 0);
+  REQUIRE(buf.capacity() == initial_capacity);
+
+  // the ring grows to hold a large message, retaining the unread bytes
+  std::string big(10000, 'z');
+  buf.consume("ab", 2);
+  REQUIRE(buf.consume(big.data(), big.size()) == big.size());
+  REQUIRE(buf.capacity() > initial_capacity);
+  auto rd = buf.read_ptr();
+  REQUIRE(rd.avail() == 10002);
+  REQUIRE(rd[0] == 'a');
+  REQUIRE(rd[10001] == 'z');
+}
+
+
+
+TEST_CASE("decode_buffer_policy")
+{
+  auto& overflows = apex::metrics::registry().counter(
+      "apex_decode_buffer_overflows_total", "");
+
+  // growth is geometric, so a burst of small reads regrows rarely
+  apex::DecodeBuffer buf(apex::DecodeBufferPolicy{100, 10000, 2.0, 4});
+  std::string bytes(10000, 'x');
+  REQUIRE(buf.consume(bytes.data(), 150) == 150);
+  REQUIRE(buf.capacity() == 200);
+  REQUIRE(buf.consume(bytes.data(), 60) == 60);
+  REQUIRE(buf.capacity() == 400);
+  REQUIRE(buf.stats().grows == 2);
+  REQUIRE(buf.stats().high_water == 210);
+
+  // growth stops at the max size, then overflow is typed and counted
+  buf.consume(bytes.data(), bytes.size());
+  REQUIRE(buf.capacity() == 10000);
+  const auto before = overflows.value();
+  bool threw = false;
+  try {
+    buf.consume("y", 1);
+  } catch (apex::decode_buffer_overflow&) {
+    threw = true;
+  }
+  REQUIRE(threw);
+  REQUIRE(overflows.value() == before + 1);
+
+  // after the burst is decoded, reads that fit the initial size shrink it
+  auto rd = buf.read_ptr();
+  rd.advance(rd.avail() - 10);
+  buf.discard(rd);
+  for (int i = 0; i < 2; i++) {
+    rd = buf.read_ptr();
+    buf.discard(rd);
+    REQUIRE(buf.capacity() == 10000);
+  }
+  rd = buf.read_ptr();
+  buf.discard(rd);
+  REQUIRE(buf.capacity() == 100);
+  REQUIRE(buf.avail() == 10);
+  REQUIRE(buf.read_ptr()[0] == 'x');
+  REQUIRE(buf.stats().shrinks == 1);
+  REQUIRE(buf.stats().high_water == 10000);
+
+  // the ring is sized by the same policy, in pages
+  apex::RingDecodeBuffer ring(apex::DecodeBufferPolicy{4096, 1 << 20, 2.0, 2});
+  const auto baseline = ring.capacity();
+  REQUIRE(ring.consume(bytes.data(), bytes.size()) == bytes.size());
+  REQUIRE(ring.capacity() > baseline);
+  REQUIRE(ring.stats().grows == 1);
+  rd = ring.read_ptr();
+  rd.advance(rd.avail());
+  ring.discard(rd);
+  rd = ring.read_ptr();
+  ring.discard(rd);
+  REQUIRE(ring.capacity() == baseline);
+  REQUIRE(ring.stats().shrinks == 1);
+
+  auto policy = apex::parse_decode_buffer_policy(apex::Config(json::parse(
+      R"({ "initial_kb": 4, "max_kb": 64, "growth": 1.5 })")));
+  REQUIRE(policy.initial_size == 4096);
+  REQUIRE(policy.max_size == 65536);
+  REQUIRE(policy.growth == 1.5);
+  REQUIRE(policy.shrink_after == apex::DecodeBufferPolicy{}.shrink_after);
+  REQUIRE(apex::parse_decode_buffer_policy(apex::Config::empty_config())
+              .initial_size == apex::DecodeBufferPolicy{}.initial_size);
+}
+
+TEST_CASE("websocket_frame")
+{
+  // headers round trip, for each length encoding, masked and unmasked
+  uint32_t key = 0x44332211;
+  for (uint64_t len : {0ull, 125ull, 126ull, 65535ull, 65536ull, 5000000ull}) {
+    for (bool masked : {false, true}) {
+      char header[apex::ws::max_header_size];
+      size_t header_len = apex::ws::encode_header(
+          header, true, apex::ws::Opcode::text, len, masked ? &key : nullptr);
+
+      apex::ws::FrameHeader fh;
+      REQUIRE(apex::ws::decode_header(header, header_len - 1, fh) == 0);
+      REQUIRE(apex::ws::decode_header(header, header_len, fh) == header_len);
+      REQUIRE(fh.fin);
+      REQUIRE(fh.opcode == apex::ws::Opcode::text);
+      REQUIRE(fh.payload_len == len);
+      REQUIRE(fh.masked == masked);
+      REQUIRE(fh.mask_key == (masked ? key : 0));
+    }
+  }
+
+  // a masked frame from RFC6455 section 5.7, "Hello"
+  const unsigned char hello[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f,
+                                 0x9f, 0x4d, 0x51, 0x58};
+  std::string frame(reinterpret_cast<const char*>(hello), sizeof(hello));
+  apex::ws::FrameHeader fh;
+  REQUIRE(apex::ws::decode_header(frame.data(), frame.size(), fh) == 6);
+  REQUIRE(fh.payload_len == 5);
+  apex::ws::apply_mask(frame.data() + 6, frame.data() + 6, 5, fh.mask_key);
+  REQUIRE(frame.substr(6) == "Hello");
+
+  // vector masking matches the scalar version, at every offset, including
+  // when a payload is masked in pieces
+  std::string payload;
+  for (int i = 0; i < 1000; i++)
+    payload += static_cast<char>(i * 31);
+  bool same = true;
+  for (size_t len : {0, 1, 7, 15, 16, 33, 100, 1000})
+    for (size_t offset = 0; offset < 4; offset++) {
+      std::string fast(len, 0), slow(len, 0);
+      apex::ws::apply_mask(fast.data(), payload.data(), len, key, offset);
+      apex::ws::apply_mask_scalar(slow.data(), payload.data(), len, key,
+                                  offset);
+      same &= fast == slow;
+    }
+  std::string whole(1000, 0), pieces(1000, 0);
+  apex::ws::apply_mask(whole.data(), payload.data(), 1000, key);
+  apex::ws::apply_mask(pieces.data(), payload.data(), 333, key, 0);
+  apex::ws::apply_mask(pieces.data() + 333, payload.data() + 333, 667, key, 333);
+  REQUIRE(same);
+  REQUIRE(whole == pieces);
+  REQUIRE(std::string(apex::ws::apply_mask_isa()).size() > 0);
+
+  // malformed headers are protocol errors
+  auto rejected = [](std::initializer_list<unsigned char> bytes) {
+    std::string h(bytes.begin(), bytes.end());
+    apex::ws::FrameHeader out;
+    try {
+      apex::ws::decode_header(h.data(), h.size(), out);
+    } catch (const apex::protocol_error&) {
+      return true;
+    }
+    return false;
+  };
+  REQUIRE(rejected({0xA1, 0x00}));       // reserved bit
+  REQUIRE(rejected({0xC9, 0x00}));       // compressed ping
+  REQUIRE(rejected({0x83, 0x00}));       // unknown opcode
+  REQUIRE(rejected({0x09, 0x00}));       // fragmented ping
+  REQUIRE(rejected({0x89, 0x7E, 0x00, 0x7E})); // ping payload over 125
+  REQUIRE(!rejected({0x89, 0x7D}));
+}
+
+
+TEST_CASE("websocket_deflate")
+{
+  // negotiation
+  apex::ws::DeflateParams params;
+  REQUIRE(apex::ws::parse_deflate_response(
+      "permessage-deflate; server_no_context_takeover; "
+      "client_max_window_bits=10",
+      params));
+  REQUIRE(params.server_no_context_takeover);
+  REQUIRE(params.client_max_window_bits == 10);
+  REQUIRE(params.server_max_window_bits == 15);
+  REQUIRE(!apex::ws::parse_deflate_response("", params));
+  auto refused = [](const std::string& header) {
+    apex::ws::DeflateParams out;
+    try {
+      apex::ws::parse_deflate_response(header, out);
+    } catch (const apex::handshake_error&) {
+      return true;
+    }
+    return false;
+  };
+  REQUIRE(refused("x-webkit-deflate-frame"));
+  REQUIRE(refused("permessage-deflate; server_max_window_bits=16"));
+  REQUIRE(refused("permessage-deflate; unknown_param"));
+
+  // messages compressed as a server would, sharing one deflate context, with
+  // the final empty block stripped
+  z_stream zs{};
+  REQUIRE(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                       Z_DEFAULT_STRATEGY) == Z_OK);
+  auto compress = [&](const std::string& msg) {
+    std::string out(msg.size() + 1024, 0);
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(msg.data()));
+    zs.avail_in = msg.size();
+    zs.next_out = reinterpret_cast<Bytef*>(out.data());
+    zs.avail_out = out.size();
+    deflate(&zs, Z_SYNC_FLUSH);
+    out.resize(out.size() - zs.avail_out - 4);
+    return out;
+  };
+
+  std::string first = R"({"stream":"btcusdt@trade","data":{"p":"1.0"}})";
+  std::string second = R"({"stream":"btcusdt@trade","data":{"p":"2.0"}})";
+  std::string large;
+  while (large.size() < 200000)
+    large += second;
+
+  apex::ws::Inflater inflater{apex::ws::DeflateParams{}};
+  char buf[1024];
+  auto c1 = compress(first);
+  auto c2 = compress(second);
+  auto c3 = compress(large);
+  deflateEnd(&zs);
+
+  REQUIRE(inflater.inflate(c1.data(), c1.size(), buf, sizeof(buf), 1 << 20) ==
+          first);
+  // the second message refers back into the first
+  REQUIRE(c2.size() < c1.size());
+  REQUIRE(inflater.inflate(c2.data(), c2.size(), buf, sizeof(buf), 1 << 20) ==
+          second);
+  // output larger than the buffer spills over
+  REQUIRE(inflater.inflate(c3.data(), c3.size(), buf, sizeof(buf), 1 << 20) ==
+          large);
+  REQUIRE(inflater.inflate(c1.data(), 0, buf, sizeof(buf), 1 << 20).empty());
+  REQUIRE(inflater.bytes_in() == c1.size() + c2.size() + c3.size());
+  REQUIRE(inflater.bytes_out() == first.size() + second.size() + large.size());
+
+  bool too_big = false;
+  apex::ws::Inflater limited{apex::ws::DeflateParams{}};
+  try {
+    limited.inflate(c1.data(), c1.size(), buf, 8, 16);
+  } catch (const apex::protocol_error&) {
+    too_big = true;
+  }
+  REQUIRE(too_big);
+}
+
+
+TEST_CASE("websocket_serialiser")
+{
+  using apex::serialiser_type;
+  using apex::WebsocketProtocol;
+
+  int both = serialiser_type::msgpack | serialiser_type::json;
+  REQUIRE(WebsocketProtocol::subprotocol_offer((int)serialiser_type::json) ==
+          "json");
+  REQUIRE(WebsocketProtocol::subprotocol_offer(both) == "msgpack, json");
+
+  // the first listed that is also supported; peers offering none get none
+  REQUIRE(WebsocketProtocol::select_subprotocol("msgpack, json", both) ==
+          serialiser_type::msgpack);
+  REQUIRE(WebsocketProtocol::select_subprotocol(
+              "msgpack, json", (int)serialiser_type::json) ==
+          serialiser_type::json);
+  REQUIRE(WebsocketProtocol::select_subprotocol("wamp.2.json,  MsgPack", both) ==
+          serialiser_type::msgpack);
+  REQUIRE(WebsocketProtocol::select_subprotocol("wamp.2.json", both) ==
+          serialiser_type::none);
+
+  json msg = {{"stream", "btcusdt@bookTicker"},
+              {"data", {{"u", 400900217}, {"b", 25.35190000}, {"B", 31.21}}}};
+  for (auto type : {serialiser_type::json, serialiser_type::msgpack}) {
+    auto payload = apex::encode_payload(msg, type);
+    REQUIRE(apex::decode_payload(payload.data(), payload.size(), type) == msg);
+  }
+  auto text = apex::encode_payload(msg, serialiser_type::json);
+  auto packed = apex::encode_payload(msg, serialiser_type::msgpack);
+  REQUIRE(packed.size() < text.size());
+
+  auto malformed = [](const std::string& payload, serialiser_type type) {
+    try {
+      apex::decode_payload(payload.data(), payload.size(), type);
+    } catch (const apex::protocol_error&) {
+      return true;
+    }
+    return false;
+  };
+  REQUIRE(malformed(text.substr(0, text.size() - 1), serialiser_type::json));
+  REQUIRE(malformed(packed.substr(0, packed.size() - 1),
+                    serialiser_type::msgpack));
+}
+
+
+TEST_CASE("ktls_keys")
+{
+  // record boundaries, fed a byte at a time
+  std::string stream;
+  auto add_record = [&stream](uint8_t type, size_t len) {
+    char hdr[5] = {static_cast<char>(type), 3, 3, static_cast<char>(len >> 8),
+                   static_cast<char>(len & 0xFF)};
+    stream.append(hdr, sizeof(hdr));
+    stream.append(len, 'x');
+  };
+  add_record(20, 1); // change_cipher_spec, not counted
+  add_record(23, 300);
+  add_record(23, 2);
+  {
+    apex::ktls::RecordCounter counter;
+    for (size_t i = 0; i < stream.size(); ++i) {
+      counter.feed(stream.data() + i, 1);
+      size_t end = i + 1;
+      REQUIRE(counter.at_boundary() ==
+              (end == 6 || end == 311 || end == stream.size()));
+    }
+    REQUIRE(counter.offset() == stream.size());
+    REQUIRE(counter.records_before(6) == 0);
+    REQUIRE(counter.records_before(310) == 0);
+    REQUIRE(counter.records_before(311) == 1);
+    REQUIRE(counter.records_before(stream.size()) == 2);
+  }
+
+  // an in-memory TLS 1.3 connection, whose server traffic secret, obtained
+  // the same way as SslSession does, must decrypt a server record
+  EVP_PKEY* pkey = EVP_EC_gen("P-256");
+  REQUIRE(pkey != nullptr);
+  X509* cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, pkey);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                             (const unsigned char*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(cert));
+  REQUIRE(X509_sign(cert, pkey, EVP_sha256()) > 0);
+
+  SSL_CTX* sctx = SSL_CTX_new(TLS_server_method());
+  SSL_CTX* cctx = SSL_CTX_new(TLS_client_method());
+  REQUIRE(SSL_CTX_use_certificate(sctx, cert) == 1);
+  REQUIRE(SSL_CTX_use_PrivateKey(sctx, pkey) == 1);
+  SSL_CTX_set_min_proto_version(cctx, TLS1_3_VERSION);
+  SSL_CTX_set_ciphersuites(cctx, "TLS_AES_128_GCM_SHA256");
+
+  static std::string server_secret;
+  server_secret.clear();
+  SSL_CTX_set_keylog_callback(cctx, [](const SSL*, const char* line) {
+    std::string s = line;
+    if (s.rfind("SERVER_TRAFFIC_SECRET_0 ", 0) == 0) {
+      std::string hex = s.substr(s.rfind(' ') + 1);
+      for (size_t i = 0; i + 1 < hex.size(); i += 2)
+        server_secret.push_back(std::stoi(hex.substr(i, 2), nullptr, 16));
+    }
+  });
+
+  SSL* client = SSL_new(cctx);
+  SSL* server = SSL_new(sctx);
+  BIO* c_rbio = BIO_new(BIO_s_mem());
+  BIO* c_wbio = BIO_new(BIO_s_mem());
+  BIO* s_rbio = BIO_new(BIO_s_mem());
+  BIO* s_wbio = BIO_new(BIO_s_mem());
+  SSL_set_bio(client, c_rbio, c_wbio);
+  SSL_set_bio(server, s_rbio, s_wbio);
+  SSL_set_connect_state(client);
+  SSL_set_accept_state(server);
+
+  apex::ktls::RecordCounter from_server;
+  std::string server_bytes;
+  auto pump = [&](BIO* from, BIO* to, bool to_client) {
+    char buf[16384];
+    int n;
+    while ((n = BIO_read(from, buf, sizeof(buf))) > 0) {
+      BIO_write(to, buf, n);
+      if (to_client) {
+        from_server.feed(buf, n);
+        server_bytes.append(buf, n);
+      }
+    }
+  };
+
+  for (int i = 0; i < 10 && !(SSL_is_init_finished(client) &&
+                              SSL_is_init_finished(server));
+       ++i) {
+    SSL_do_handshake(client);
+    pump(c_wbio, s_rbio, false);
+    SSL_do_handshake(server);
+    pump(s_wbio, c_rbio, true);
+  }
+  REQUIRE(SSL_is_init_finished(client) == 1);
+  REQUIRE(SSL_version(client) == TLS1_3_VERSION);
+
+  // records the client consumed in completing the handshake were protected by
+  // the handshake keys; those after, such as session tickets, are not
+  uint64_t base =
+      from_server.records_before(server_bytes.size() - BIO_ctrl_pending(c_rbio));
+  REQUIRE(base > 0);
+
+  REQUIRE(SSL_write(server, "hello", 5) == 5);
+  pump(s_wbio, c_rbio, true);
+  REQUIRE(from_server.at_boundary());
+  uint64_t app_records = from_server.records_before(server_bytes.size()) - base;
+  REQUIRE(app_records >= 1);
+  uint64_t seq = app_records - 1; // the hello record is the last
+
+  apex::ktls::TrafficKeys keys;
+  REQUIRE(apex::ktls::derive_keys(SSL_get_current_cipher(client),
+                                  server_secret, keys));
+  REQUIRE(keys.key_len == 16);
+
+  // decrypt the final record: nonce is iv xor seq, header is the aad
+  const size_t rec_len = 5 + 5 + 1 + 16;
+  REQUIRE(server_bytes.size() >= rec_len);
+  auto rec = reinterpret_cast<const unsigned char*>(server_bytes.data()) +
+             server_bytes.size() - rec_len;
+  REQUIRE(rec[0] == 23);
+  unsigned char nonce[12];
+  memcpy(nonce, keys.iv, sizeof(nonce));
+  for (int i = 0; i < 8; ++i)
+    nonce[11 - i] ^= static_cast<unsigned char>(seq >> (8 * i));
+
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  unsigned char plain[6];
+  int len = 0;
+  REQUIRE(EVP_DecryptInit_ex(ctx, EVP_aes_128_gcm(), nullptr, keys.key,
+                             nonce) == 1);
+  REQUIRE(EVP_DecryptUpdate(ctx, nullptr, &len, rec, 5) == 1);
+  REQUIRE(EVP_DecryptUpdate(ctx, plain, &len, rec + 5, 6) == 1);
+  EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, 16,
+                      const_cast<unsigned char*>(rec + 11));
+  REQUIRE(EVP_DecryptFinal_ex(ctx, plain + len, &len) == 1);
+  REQUIRE(memcmp(plain, "hello\x17", 6) == 0);
+  EVP_CIPHER_CTX_free(ctx);
+
+  // the client still reads it itself
+  char out[16];
+  REQUIRE(SSL_read(client, out, sizeof(out)) == 5);
+
+  SSL_free(client);
+  SSL_free(server);
+  SSL_CTX_free(cctx);
+  SSL_CTX_free(sctx);
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+}
+
+
+TEST_CASE("ssl_session_resumption")
+{
+  // a server, with a certificate strong enough for the client security level
+  EVP_PKEY* pkey = EVP_EC_gen("P-384");
+  REQUIRE(pkey != nullptr);
+  X509* cert = X509_new();
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+  X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+  X509_set_pubkey(cert, pkey);
+  X509_NAME_add_entry_by_txt(X509_get_subject_name(cert), "CN", MBSTRING_ASC,
+                             (const unsigned char*)"localhost", -1, -1, 0);
+  X509_set_issuer_name(cert, X509_get_subject_name(cert));
+  REQUIRE(X509_sign(cert, pkey, EVP_sha384()) > 0);
+  SSL_CTX* sctx = SSL_CTX_new(TLS_server_method());
+  REQUIRE(SSL_CTX_use_certificate(sctx, cert) == 1);
+  REQUIRE(SSL_CTX_use_PrivateKey(sctx, pkey) == 1);
+
+  apex::SslContext client_ctx{apex::SslConfig{true}};
+
+  // connect a client session, and read what the server sends after the
+  // handshake, which includes its session tickets
+  auto connect = [&](const std::string& peer) {
+    apex::SslSession client(&client_ctx, apex::connect_mode::active);
+    client_ctx.resume_session(client, peer);
+
+    SSL* server = SSL_new(sctx);
+    SSL_set_bio(server, BIO_new(BIO_s_mem()), BIO_new(BIO_s_mem()));
+    SSL_set_accept_state(server);
+
+    auto pump = [](BIO* from, BIO* to) {
+      char buf[16384];
+      int n;
+      while ((n = BIO_read(from, buf, sizeof(buf))) > 0)
+        BIO_write(to, buf, n);
+    };
+    for (int i = 0; i < 10 && !(SSL_is_init_finished(client.ssl) &&
+                                SSL_is_init_finished(server));
+         ++i) {
+      SSL_do_handshake(client.ssl);
+      pump(client.wbio, SSL_get_rbio(server));
+      SSL_do_handshake(server);
+      pump(SSL_get_wbio(server), client.rbio);
+    }
+    REQUIRE(SSL_is_init_finished(client.ssl) == 1);
+    client_ctx.count_handshake(client.ssl);
+    bool resumed = SSL_session_reused(client.ssl) == 1;
+
+    char buf[16];
+    REQUIRE(SSL_read(client.ssl, buf, sizeof(buf)) <= 0);
+    SSL_free(server);
+    return resumed;
+  };
+
+  REQUIRE(connect("localhost:443") == false);
+  auto stats = client_ctx.get_session_stats();
+  REQUIRE(stats.full == 1);
+  REQUIRE(stats.cached >= 1);
+
+  // tickets are kept per peer
+  REQUIRE(connect("otherhost:443") == false);
+  REQUIRE(connect("localhost:443") == true);
+  stats = client_ctx.get_session_stats();
+  REQUIRE(stats.resumed == 1);
+  REQUIRE(stats.full == 2);
+
+  // each ticket is used once, but each connection receives new ones
+  for (int i = 0; i < 8; i++)
+    REQUIRE(connect("localhost:443") == true);
+  REQUIRE(client_ctx.get_session_stats().resumed == 9);
+
+  SSL_CTX_free(sctx);
+  X509_free(cert);
+  EVP_PKEY_free(pkey);
+}
+
+
+TEST_CASE("shm_ring")
+{
+  auto name = apex::gx::shm_ring_name();
+  auto producer = apex::ShmRing::create(name, 4096);
+  auto consumer = apex::ShmRing::open(name);
+  producer->unlink();
+  REQUIRE(consumer->capacity() == 4096);
+
+  // messages are read in order, across many wraps of the ring, including
+  // those that need padding at the end of the ring
+  size_t written = 0;
+  size_t read = 0;
+  bool in_order = true;
+  for (int round = 0; round < 200; round++) {
+    for (int i = 0; i < 7; i++) {
+      std::string msg(1 + (written * 37) % 500, static_cast<char>('a' + written % 26));
+      if (!producer->write(msg.data(), msg.size()))
+        break;
+      written++;
+    }
+    consumer->read([&](char* msg, size_t len) {
+      in_order &= (len == 1 + (read * 37) % 500) &&
+                  (msg[0] == static_cast<char>('a' + read % 26));
+      read++;
+    });
+  }
+  REQUIRE(in_order);
+  REQUIRE(read == written);
+  REQUIRE(written > 200);
+  REQUIRE(producer->used_bytes() == 0);
+
+  // a full ring refuses further messages
+  std::string big(1000, 'x');
+  while (producer->write(big.data(), big.size())) {
+  }
+  REQUIRE(consumer->read([](char*, size_t) {}) > 0);
+
+  // a waiting consumer is woken by a message from another thread
+  std::thread writer([&]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    producer->write("hello", 5);
+  });
+  auto start = std::chrono::steady_clock::now();
+  bool available = false;
+  while (!available &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    available = consumer->wait(std::chrono::seconds(1));
+  writer.join();
+  REQUIRE(available);
+
+  std::string received;
+  consumer->read([&](char* msg, size_t len) { received.assign(msg, len); });
+  REQUIRE(received == "hello");
+
+  producer->close();
+  REQUIRE(consumer->is_closed());
+  REQUIRE(!consumer->wait(std::chrono::milliseconds(1)));
+}
+
+
+TEST_CASE("udp_multicast")
+{
+  apex::IoLoop ioloop;
+
+  apex::UdpSocket::MulticastOptions options;
+  options.group = "239.255.57.81";
+  options.port = 45781;
+  options.interface = "127.0.0.1";
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::vector<std::string> received;
+
+  apex::UdpSocket rx(ioloop);
+  auto rx_err = rx.open_receiver(options, [&](const char* src, size_t len) {
+    std::lock_guard<std::mutex> guard(lock);
+    received.emplace_back(src, len);
+    cond.notify_one();
+  }).get();
+  REQUIRE(!rx_err);
+
+  apex::UdpSocket tx(ioloop);
+  REQUIRE(!tx.open_sender(options).get());
+
+  // sends from the IO thread and from other threads arrive as datagrams
+  tx.send("first", 5);
+  ioloop.push_fn([&]() { tx.send("second", 6); });
+
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait_for(guard, std::chrono::seconds(2),
+                [&]() { return received.size() >= 2; });
+  REQUIRE(received.size() == 2);
+  REQUIRE(received[0] == "first");
+  REQUIRE(received[1] == "second");
+  REQUIRE(tx.datagrams_sent() == 2);
+  guard.unlock();
+
+  rx.close();
+  tx.close();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("io_loop_requests")
+{
+  apex::IoLoop ioloop;
+
+  // more requests than the ring holds, from several threads at once, so some
+  // go via the overflow; each thread's requests must still run in order
+  const int threads = 4;
+  const int per_thread = 20000;
+  std::vector<int> last(threads, -1); // IO thread only
+  std::atomic<int> out_of_order{0};
+  std::atomic<int> done{0};
+
+  std::vector<std::thread> pushers;
+  for (int t = 0; t < threads; t++)
+    pushers.emplace_back([&, t]() {
+      for (int i = 0; i < per_thread; i++)
+        ioloop.push_fn([&, t, i]() {
+          if (last[t] != i - 1)
+            out_of_order++;
+          last[t] = i;
+          done++;
+        });
+    });
+  for (auto& t : pushers)
+    t.join();
+
+  std::promise<void> drained;
+  ioloop.push_fn([&]() { drained.set_value(); });
+  drained.get_future().wait();
+  REQUIRE(done == threads * per_thread);
+  REQUIRE(out_of_order == 0);
+
+  ioloop.sync_stop();
+  bool closed = false;
+  try {
+    ioloop.push_fn([]() {});
+  } catch (apex::IoLoopClosed&) {
+    closed = true;
+  }
+  REQUIRE(closed);
+}
+
+
+TEST_CASE("tcp_direct_write")
+{
+  apex::IoLoop ioloop;
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::string received;
+
+  std::unique_ptr<apex::TcpSocket> accepted;
+  apex::TcpSocket server(ioloop);
+  REQUIRE(!server
+               .listen("127.0.0.1", "0",
+                       [&](std::unique_ptr<apex::TcpSocket>& sock,
+                           apex::UvErr ec) {
+                         if (ec)
+                           return;
+                         accepted = std::move(sock);
+                         accepted->start_read(
+                             [&](char* src, size_t len) {
+                               std::lock_guard<std::mutex> guard(lock);
+                               received.append(src, len);
+                               cond.notify_one();
+                             },
+                             [](apex::UvErr) {});
+                       })
+               .get());
+
+  apex::TcpSocket client(ioloop);
+  REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+
+  auto& direct_writes = apex::metrics::registry().counter(
+      "apex_tcp_direct_writes_total", "");
+  const auto direct_before = direct_writes.value();
+
+  // writes from this thread are sent directly while nothing is queued; the
+  // large writes can exceed the socket buffer, so leave a remainder queued
+  // for the IO thread, which later writes must not overtake
+  std::string expected;
+  for (int i = 0; i < 200; i++) {
+    std::string chunk = std::to_string(i) + ":";
+    chunk.resize((i % 50 == 0) ? 200000 : 64, char('a' + i % 26));
+    client.write(chunk.data(), chunk.size());
+    expected += chunk;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait_for(guard, std::chrono::seconds(5),
+                [&]() { return received.size() >= expected.size(); });
+  REQUIRE(received == expected);
+  guard.unlock();
+
+  REQUIRE(direct_writes.value() > direct_before);
+  REQUIRE(client.bytes_written() == expected.size());
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("address_cache")
+{
+  apex::IoLoop ioloop;
+
+  std::mutex lock;
+  std::vector<std::unique_ptr<apex::TcpSocket>> accepted;
+  apex::TcpSocket server(ioloop);
+  REQUIRE(!server
+               .listen("127.0.0.1", "0",
+                       [&](std::unique_ptr<apex::TcpSocket>& sock,
+                           apex::UvErr ec) {
+                         if (ec)
+                           return;
+                         std::lock_guard<std::mutex> guard(lock);
+                         accepted.push_back(std::move(sock));
+                       })
+               .get());
+  const auto port = std::to_string(server.get_local_port());
+
+  apex::AddressCache::Options options;
+  options.probe_interval = std::chrono::seconds(1);
+  apex::AddressCache cache(options);
+
+  cache.prefetch("127.0.0.1", port); // numeric, so never cached
+  REQUIRE(cache.lookup("127.0.0.1", port, AF_UNSPEC).empty());
+  REQUIRE(cache.lookup("localhost", port, AF_UNSPEC).empty());
+
+  // resolved and probed in the background; the probe's connect is accepted
+  // only on 127.0.0.1, which must then rank first
+  cache.prefetch("localhost", port);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (cache.stats().probes == 0 &&
+         std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE(cache.stats().hosts == 1);
+  REQUIRE(cache.stats().probes > 0);
+
+  auto addresses = cache.lookup("localhost", port, AF_UNSPEC);
+  REQUIRE(!addresses.empty());
+  REQUIRE(addresses.front().to_string() == "127.0.0.1");
+  REQUIRE(addresses.front().port() == server.get_local_port());
+  for (auto& addr : cache.lookup("localhost", port, AF_INET))
+    REQUIRE(addr.to_string().find(':') == std::string::npos);
+
+  server.close().wait();
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    for (auto& sock : accepted)
+      sock->close().wait();
+  }
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("tcp_write_producers")
+{
+  // several threads write to one socket, each a numbered sequence; the peer
+  // sees every message, and each thread's in order, whether queued for the
+  // IO thread or sent directly
+  const uint32_t producers = 4, messages = 5000;
+  for (bool direct_write : {false, true}) {
+    apex::IoLoop ioloop;
+
+    std::vector<uint32_t> next(producers, 0);
+    std::string partial;
+    bool ordered = true;
+    std::promise<void> all_read;
+    size_t count = 0;
+
+    std::unique_ptr<apex::TcpSocket> accepted;
+    std::promise<void> ready;
+    apex::TcpSocket server(ioloop);
+    REQUIRE(!server
+                 .listen("127.0.0.1", "0",
+                         [&](std::unique_ptr<apex::TcpSocket>& sock,
+                             apex::UvErr ec) {
+                           if (ec)
+                             return;
+                           accepted = std::move(sock);
+                           ready.set_value();
+                         })
+                 .get());
+
+    apex::TcpSocket::options options;
+    options.direct_write = direct_write;
+    apex::TcpSocket client(ioloop, options);
+    REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+    ready.get_future().wait();
+    REQUIRE(!accepted
+                 ->start_read(
+                     [&](char* src, size_t len) {
+                       partial.append(src, len);
+                       size_t pos = 0;
+                       for (; pos + 8 <= partial.size(); pos += 8) {
+                         uint32_t msg[2];
+                         memcpy(msg, partial.data() + pos, 8);
+                         if (msg[0] >= producers || msg[1] != next[msg[0]]++)
+                           ordered = false;
+                         if (++count == producers * messages)
+                           all_read.set_value();
+                       }
+                       partial.erase(0, pos);
+                     },
+                     [](apex::UvErr) {})
+                 .get());
+
+    std::vector<std::thread> threads;
+    for (uint32_t p = 0; p < producers; p++)
+      threads.emplace_back([&, p]() {
+        for (uint32_t i = 0; i < messages; i++) {
+          uint32_t msg[2] = {p, i};
+          client.write(reinterpret_cast<const char*>(msg), sizeof(msg));
+        }
+      });
+    for (auto& t : threads)
+      t.join();
+
+    REQUIRE(all_read.get_future().wait_for(std::chrono::seconds(10)) ==
+            std::future_status::ready);
+    REQUIRE(ordered);
+    REQUIRE(client.bytes_written() == producers * messages * 8);
+
+    client.close().wait();
+    accepted->close().wait();
+    server.close().wait();
+    ioloop.sync_stop();
+  }
+}
+
+
+TEST_CASE("tcp_write_partial_direct")
+{
+  // frames larger than a small send buffer are only partly sent directly;
+  // what remains must reach the peer ahead of any other producer's frame
+  struct SmallSendBuffer : apex::TcpSocket {
+    using apex::TcpSocket::TcpSocket;
+    void shrink()
+    {
+      int size = 4096;
+      ::setsockopt(native_fd(), SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+  };
+
+  const uint32_t producers = 4, messages = 200, frame_size = 20000;
+  apex::IoLoop ioloop;
+
+  std::vector<uint32_t> next(producers, 0);
+  std::string partial;
+  bool framed = true;
+  std::promise<void> all_read;
+  size_t count = 0;
+
+  std::unique_ptr<apex::TcpSocket> accepted;
+  std::promise<void> ready;
+  apex::TcpSocket server(ioloop);
+  REQUIRE(!server
+               .listen("127.0.0.1", "0",
+                       [&](std::unique_ptr<apex::TcpSocket>& sock,
+                           apex::UvErr ec) {
+                         if (ec)
+                           return;
+                         accepted = std::move(sock);
+                         ready.set_value();
+                       })
+               .get());
+
+  apex::TcpSocket::options options;
+  options.direct_write = true;
+  SmallSendBuffer client(ioloop, options);
+  REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+  client.shrink();
+  ready.get_future().wait();
+  REQUIRE(!accepted
+               ->start_read(
+                   [&](char* src, size_t len) {
+                     partial.append(src, len);
+                     size_t pos = 0;
+                     for (; pos + frame_size <= partial.size();
+                          pos += frame_size) {
+                       uint32_t head[3];
+                       memcpy(head, partial.data() + pos, sizeof(head));
+                       if (head[0] != frame_size || head[1] >= producers ||
+                           head[2] != next[head[1]]++) {
+                         framed = false;
+                         continue;
+                       }
+                       const char fill = char('a' + head[1]);
+                       for (size_t i = sizeof(head); i < frame_size; i++)
+                         if (partial[pos + i] != fill) {
+                           framed = false;
+                           break;
+                         }
+                       if (++count == producers * messages)
+                         all_read.set_value();
+                     }
+                     partial.erase(0, pos);
+                   },
+                   [](apex::UvErr) {})
+               .get());
+
+  // producers hold back while a few frames are unsent, within the limit on
+  // pending bytes
+  std::atomic<size_t> queued{0};
+  std::vector<std::thread> threads;
+  for (uint32_t p = 0; p < producers; p++)
+    threads.emplace_back([&, p]() {
+      std::string frame(frame_size, char('a' + p));
+      for (uint32_t i = 0; i < messages; i++) {
+        uint32_t head[3] = {frame_size, p, i};
+        memcpy(frame.data(), head, sizeof(head));
+        while (queued.load() - client.bytes_written() > 8 * frame_size)
+          std::this_thread::yield();
+        queued += frame_size;
+        client.write(frame.data(), frame.size());
+      }
+    });
+  for (auto& t : threads)
+    t.join();
+
+  REQUIRE(all_read.get_future().wait_for(std::chrono::seconds(20)) ==
+          std::future_status::ready);
+  REQUIRE(framed);
+  REQUIRE(client.bytes_written() == size_t(producers) * messages * frame_size);
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("tcp_rx_timestamps")
+{
+#ifdef __linux__
+  apex::IoLoop ioloop;
+
+  std::unique_ptr<apex::TcpSocket> accepted;
+  std::promise<void> ready;
+  apex::TcpSocket server(ioloop);
+  REQUIRE(!server
+               .listen("127.0.0.1", "0",
+                       [&](std::unique_ptr<apex::TcpSocket>& sock,
+                           apex::UvErr ec) {
+                         if (ec)
+                           return;
+                         accepted = std::move(sock);
+                         ready.set_value();
+                       })
+               .get());
+
+  apex::TcpSocket::options options;
+  options.rx_timestamps = true;
+  apex::TcpSocket client(ioloop, options);
+  REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+  ready.get_future().wait();
+
+  // the kernel stamps the data on arrival, before it is read
+  std::promise<uint64_t> rx_time;
+  REQUIRE(!client
+               .start_read(
+                   [&](char*, size_t) { rx_time.set_value(client.rx_time()); },
+                   [](apex::UvErr) {})
+               .get());
+  const auto before = apex::trace::now_ns();
+  accepted->write("x", 1);
+  auto stamped = rx_time.get_future().get();
+  const auto after = apex::trace::now_ns();
+
+  REQUIRE(stamped >= before);
+  REQUIRE(stamped <= after);
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+#endif
+}
+
+
+TEST_CASE("io_uring_echo")
+{
+  if (!apex::IoUring::is_supported())
+    return;
+
+  apex::IoLoop ioloop;
+  apex::IoUring::Options options;
+  options.enabled = true;
+  options.recv_buffers = 4;
+  options.recv_buffer_size = 4096;
+  REQUIRE(ioloop.enable_io_uring(options));
+
+  // server echoes whatever it reads
+  std::unique_ptr<apex::TcpSocket> accepted;
+  apex::TcpSocket server(ioloop);
+  auto listen_err =
+      server
+          .listen("127.0.0.1", "0",
+                  [&](std::unique_ptr<apex::TcpSocket>& sock, apex::UvErr ec) {
+                    if (ec)
+                      return;
+                    accepted = std::move(sock);
+                    auto* peer = accepted.get();
+                    peer->start_read(
+                        [peer](char* src, size_t len) { peer->write(src, len); },
+                        [](apex::UvErr) {});
+                  })
+          .get();
+  REQUIRE(!listen_err);
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::string received;
+
+  apex::TcpSocket client(ioloop);
+  REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+  REQUIRE(!client.start_read(
+                     [&](char* src, size_t len) {
+                       std::lock_guard<std::mutex> guard(lock);
+                       received.append(src, len);
+                       cond.notify_one();
+                     },
+                     [](apex::UvErr) {})
+               .get());
+
+  // larger than the provided buffers in total, so the receive is rearmed
+  std::string expected;
+  for (int i = 0; i < 2000; i++)
+    expected += std::to_string(i) + ",";
+  client.write(expected.data(), expected.size() / 2);
+  client.write(expected.data() + expected.size() / 2,
+               expected.size() - expected.size() / 2);
+
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait_for(guard, std::chrono::seconds(5),
+                [&]() { return received.size() >= expected.size(); });
+  REQUIRE(received == expected);
+  guard.unlock();
+
+  auto stats = ioloop.uring()->stats();
+  REQUIRE(stats.recv_bytes == 2 * expected.size());
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+}
+
+
+TEST_CASE("io_busy_poll_echo")
+{
+  auto options = apex::parse_busy_poll_options(
+      apex::Config(json{{"busy_poll", true}, {"socket_busy_poll_us", 0}}));
+  REQUIRE(options.enabled);
+
+  apex::IoLoop ioloop;
+  REQUIRE(!ioloop.is_busy_polling());
+  ioloop.enable_busy_poll(options);
+  REQUIRE(ioloop.is_busy_polling());
+
+  // requests are taken by the spinning IO thread, without a wake-up
+  std::promise<bool> ran;
+  ioloop.push_fn([&]() { ran.set_value(ioloop.this_thread_is_io()); });
+  REQUIRE(ran.get_future().get());
+  std::promise<void> deferred;
+  ioloop.defer_fn([&]() { deferred.set_value(); },
+                  std::chrono::microseconds(2000));
+  deferred.get_future().wait();
+
+  std::unique_ptr<apex::TcpSocket> accepted;
+  apex::TcpSocket server(ioloop);
+  auto listen_err =
+      server
+          .listen("127.0.0.1", "0",
+                  [&](std::unique_ptr<apex::TcpSocket>& sock, apex::UvErr ec) {
+                    if (ec)
+                      return;
+                    accepted = std::move(sock);
+                    auto* peer = accepted.get();
+                    peer->start_read(
+                        [peer](char* src, size_t len) { peer->write(src, len); },
+                        [](apex::UvErr) {});
+                  })
+          .get();
+  REQUIRE(!listen_err);
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::string received;
+
+  apex::TcpSocket client(ioloop);
+  REQUIRE(!client.connect("127.0.0.1", server.get_local_port()).get());
+  REQUIRE(!client.start_read(
+                     [&](char* src, size_t len) {
+                       std::lock_guard<std::mutex> guard(lock);
+                       received.append(src, len);
+                       cond.notify_one();
+                     },
+                     [](apex::UvErr) {})
+               .get());
+
+  const std::string expected = "busy polled";
+  client.write(expected.data(), expected.size());
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait_for(guard, std::chrono::seconds(5),
+                [&]() { return received.size() >= expected.size(); });
+  REQUIRE(received == expected);
+  guard.unlock();
+
+  client.close().wait();
+  accepted->close().wait();
+  server.close().wait();
+  ioloop.sync_stop();
+}
+
+
 int main(int argc, char** argv)
 {
   try {
@@ -0,0 +1,489 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/TickReplayer.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/Time.hpp>
+#include <apex/util/utils.hpp>
+
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Download Tardis CSV datasets and convert them to tickbin2, for a range of
+ * days and a list of symbols of one exchange.  Files are fetched by a pool of
+ * download threads, and handed, through a bounded queue, to a pool of
+ * conversion threads, each of which inflates & parses one file on a
+ * background thread while compressing & writing the previous records.  The
+ * queue bounds the downloaded files waiting for conversion.
+ *
+ * usage: apex-tardis-ingest --tickdata DIR --exchange NAME --from YYYYMMDD
+ *                           [--upto YYYYMMDD] [--types TYPE,...]
+ *                           [--tardis-exchange NAME] [--api-key KEY]
+ *                           [--base-url URL] [--fetch-jobs N]
+ *                           [--convert-jobs N] [--queue N] [--keep-csv]
+ *                           [--force] SYMBOL...
+ *
+ * Types are "trades", "book_snapshot_5" and "book_snapshot_25" (the default
+ * is the first two).  The CSV
+ * files are downloaded into the layout read by the "tardis" tick format,
+ *
+ *     DIR/tardis/EXCHANGE/TYPE/YYYY/MM/DD/SYMBOL.csv.gz
+ *
+ * and converted into the layout read by the "tickbin2" tick format, trades
+ * as the aggtrades stream, five level book snapshots as the l1 stream and 25
+ * level snapshots as the l2 stream:
+ *
+ *     DIR/tickbin2/EXCHANGE/aggtrades/YYYY/MM/DD/SYMBOL.bin2
+ *
+ * Files already converted are skipped, as are downloads already present,
+ * unless --force.  The CSV files are removed once converted, unless
+ * --keep-csv.  The API key defaults to $TARDIS_API_KEY; without a key, only
+ * the free datasets (the first day of each month) can be fetched.  Exits with
+ * status 2 if any file failed. */
+
+using namespace apex;
+namespace fs = std::filesystem;
+
+namespace
+{
+
+struct Options {
+  fs::path tickdata;
+  std::string exchange;
+  std::string tardis_exchange;
+  Time from;
+  Time upto;
+  std::vector<std::string> types{"trades", "book_snapshot_5"};
+  std::vector<std::string> symbols;
+  std::string api_key;
+  std::string base_url = "https://datasets.tardis.dev/v1";
+  unsigned fetch_jobs = 4;
+  unsigned convert_jobs = std::max(1u, std::thread::hardware_concurrency() / 2);
+  size_t queue = 8;
+  bool keep_csv = false;
+  bool force = false;
+};
+
+
+struct Job {
+  std::string symbol;
+  std::string type;
+  Time date;
+  fs::path csv;
+  fs::path out;
+  std::string url;
+  TardisFileReader::DataType datatype;
+};
+
+
+/* Blocking queue of bounded capacity; once closed, pop() returns empty once
+ * the queue has drained. */
+template <typename T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity) : _capacity(std::max<size_t>(1, capacity)) {}
+
+  void push(T item)
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_full.wait(lock, [this]() { return _items.size() < _capacity; });
+    _items.push_back(std::move(item));
+    _not_empty.notify_one();
+  }
+
+  std::optional<T> pop()
+  {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _not_empty.wait(lock, [this]() { return !_items.empty() || _closed; });
+    if (_items.empty())
+      return std::nullopt;
+    T item = std::move(_items.front());
+    _items.pop_front();
+    _not_full.notify_one();
+    return item;
+  }
+
+  void close()
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _not_empty.notify_all();
+  }
+
+private:
+  const size_t _capacity;
+  std::mutex _mutex;
+  std::condition_variable _not_full;
+  std::condition_variable _not_empty;
+  std::deque<T> _items;
+  bool _closed = false;
+};
+
+
+struct Totals {
+  std::atomic<size_t> fetched{0};
+  std::atomic<uint64_t> fetched_bytes{0};
+  std::atomic<size_t> converted{0};
+  std::atomic<uint64_t> records{0};
+  std::atomic<size_t> skipped{0};
+  std::atomic<size_t> missing{0};
+  std::atomic<size_t> failed{0};
+};
+
+
+std::mutex output_mutex;
+
+void report(const std::string& line)
+{
+  std::lock_guard<std::mutex> lock(output_mutex);
+  std::cout << line << std::endl;
+}
+
+
+std::vector<Job> build_jobs(const Options& options)
+{
+  const std::chrono::hours one_day{24};
+  std::vector<Job> jobs;
+  for (auto day = options.from; !(options.upto < day); day += one_day)
+    for (auto& symbol : options.symbols)
+      for (auto& type : options.types) {
+        Job job;
+        job.symbol = symbol;
+        job.type = type;
+        job.date = day;
+
+        std::string stream;
+        if (type == "trades") {
+          job.datatype = TardisFileReader::DataType::trades;
+          stream = "aggtrades";
+        }
+        else if (type == "book_snapshot_5") {
+          job.datatype = TardisFileReader::DataType::book_snapshot_5;
+          stream = "l1";
+        }
+        else if (type == "book_snapshot_25") {
+          job.datatype = TardisFileReader::DataType::book_snapshot_25;
+          stream = "l2";
+        }
+        else
+          THROW("unsupported Tardis data type " << QUOTE(type));
+
+        auto dated = fs::path(day.strftime("%Y")) / day.strftime("%m") /
+                     day.strftime("%d");
+        job.csv = options.tickdata / to_string(TickFormat::tardis) /
+                  options.exchange / type / dated / (symbol + ".csv.gz");
+        job.out = options.tickdata / to_string(TickFormat::tickbin2) /
+                  options.exchange / stream / dated / (symbol + ".bin2");
+        job.url = options.base_url + "/" + options.tardis_exchange + "/" +
+                  type + "/" + day.strftime("%Y/%m/%d") + "/" + symbol +
+                  ".csv.gz";
+        jobs.push_back(std::move(job));
+      }
+  return jobs;
+}
+
+
+// a download failure that retrying will not cure
+struct FetchError : std::runtime_error {
+  FetchError(const std::string& what, long status)
+    : std::runtime_error(what), status(status) {}
+  long status;
+};
+
+
+/* Download `url` to `dest`, via a temporary file renamed into place, so that
+ * an interrupted download is never taken as complete.  Returns the bytes
+ * downloaded. */
+uint64_t download(const std::string& url, const std::string& api_key,
+                  const fs::path& dest)
+{
+  fs::create_directories(dest.parent_path());
+  auto tmp = dest;
+  tmp += ".part";
+
+  FILE* fp = fopen(tmp.c_str(), "wb");
+  if (!fp)
+    THROW("failed to open " << tmp << ": " << strerror(errno));
+
+  CURL* curl = curl_easy_init();
+  curl_slist* headers = nullptr;
+  if (!api_key.empty())
+    headers = curl_slist_append(headers, ("Authorization: Bearer " + api_key).c_str());
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+  char errbuf[CURL_ERROR_SIZE] = {0};
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+
+  auto rc = curl_easy_perform(curl);
+  long status = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+  curl_slist_free_all(headers);
+  curl_easy_cleanup(curl);
+  const bool write_ok = (fclose(fp) == 0);
+
+  // file:// transfers report no status
+  const bool http_ok = status == 0 || (status >= 200 && status < 300);
+  if (rc != CURLE_OK || !http_ok || !write_ok) {
+    std::error_code err;
+    fs::remove(tmp, err);
+    if (rc == CURLE_FILE_COULDNT_READ_FILE) // file:// equivalent of a 404
+      throw FetchError("download failed: no such file", 404);
+    if (rc != CURLE_OK)
+      throw std::runtime_error(std::string("download failed: ") +
+                               (errbuf[0] ? errbuf : curl_easy_strerror(rc)));
+    if (!write_ok)
+      THROW("failed to write " << tmp);
+    std::ostringstream oss;
+    oss << "download failed: HTTP status " << status;
+    if (status >= 400 && status < 500 && status != 429)
+      throw FetchError(oss.str(), status);
+    throw std::runtime_error(oss.str());
+  }
+
+  fs::rename(tmp, dest);
+  return fs::file_size(dest);
+}
+
+
+/* Download, retrying transient failures (connection errors, rate limiting
+ * and server errors) with an increasing delay. */
+uint64_t fetch(const Job& job, const Options& options)
+{
+  const int attempts = 4;
+  for (int attempt = 1;; attempt++) {
+    try {
+      return download(job.url, options.api_key, job.csv);
+    }
+    catch (const FetchError&) {
+      throw;
+    }
+    catch (const std::exception& e) {
+      if (attempt == attempts)
+        throw;
+      report("retrying " + job.url + " (" + e.what() + ")");
+      std::this_thread::sleep_for(std::chrono::seconds(2 << attempt));
+    }
+  }
+}
+
+
+double elapsed_secs(std::chrono::steady_clock::time_point since)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - since)
+      .count();
+}
+
+
+void convert(const Job& job, const Options& options, Totals& totals)
+{
+  const auto t0 = std::chrono::steady_clock::now();
+  fs::create_directories(job.out.parent_path());
+  auto tmp = job.out;
+  tmp += ".tmp";
+  size_t records = 0;
+  try {
+    records = convert_tardis_to_tickbin2(job.csv, tmp, job.datatype);
+    fs::rename(tmp, job.out);
+  }
+  catch (...) {
+    std::error_code err;
+    fs::remove(tmp, err);
+    throw;
+  }
+
+  if (!options.keep_csv)
+    fs::remove(job.csv);
+
+  totals.converted++;
+  totals.records += records;
+  std::ostringstream oss;
+  oss << "converted " << job.out.string() << ": " << records << " records, "
+      << elapsed_secs(t0) << "s";
+  report(oss.str());
+}
+
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+  try {
+    Options options;
+    if (const char* key = getenv("TARDIS_API_KEY"))
+      options.api_key = key;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "--tickdata") == 0)
+        options.tickdata = arg();
+      else if (strcmp(argv[i], "--exchange") == 0)
+        options.exchange = arg();
+      else if (strcmp(argv[i], "--tardis-exchange") == 0)
+        options.tardis_exchange = arg();
+      else if (strcmp(argv[i], "--from") == 0)
+        options.from = Time(arg());
+      else if (strcmp(argv[i], "--upto") == 0)
+        options.upto = Time(arg());
+      else if (strcmp(argv[i], "--types") == 0)
+        options.types = split(arg(), ',');
+      else if (strcmp(argv[i], "--api-key") == 0)
+        options.api_key = arg();
+      else if (strcmp(argv[i], "--base-url") == 0)
+        options.base_url = arg();
+      else if (strcmp(argv[i], "--fetch-jobs") == 0)
+        options.fetch_jobs = std::max(1, std::stoi(arg()));
+      else if (strcmp(argv[i], "--convert-jobs") == 0)
+        options.convert_jobs = std::max(1, std::stoi(arg()));
+      else if (strcmp(argv[i], "--queue") == 0)
+        options.queue = std::max(1, std::stoi(arg()));
+      else if (strcmp(argv[i], "--keep-csv") == 0)
+        options.keep_csv = true;
+      else if (strcmp(argv[i], "--force") == 0)
+        options.force = true;
+      else if (argv[i][0] == '-')
+        THROW("unknown option " << argv[i]);
+      else
+        options.symbols.emplace_back(argv[i]);
+    }
+    if (options.tickdata.empty())
+      THROW("provide the tick data directory, --tickdata");
+    if (options.exchange.empty())
+      THROW("provide the exchange, --exchange");
+    if (options.from.empty())
+      THROW("provide the first day, --from");
+    if (options.symbols.empty())
+      THROW("provide one or more symbols");
+    if (options.upto.empty())
+      options.upto = options.from;
+    if (options.upto < options.from)
+      THROW("--upto must not be before --from");
+    if (options.tardis_exchange.empty())
+      options.tardis_exchange = options.exchange;
+
+    // converters log only problems of their own
+    Logger::instance().set_level(Logger::level::warn);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    const auto t0 = std::chrono::steady_clock::now();
+    auto jobs = build_jobs(options);
+    Totals totals;
+    BoundedQueue<const Job*> ready(options.queue);
+
+    // fetch stage: jobs already converted are skipped, and downloads already
+    // present are passed straight on
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> fetchers;
+    for (unsigned t = 0; t < std::min<size_t>(options.fetch_jobs, jobs.size()); t++)
+      fetchers.emplace_back([&]() {
+        for (size_t i; (i = next.fetch_add(1)) < jobs.size();) {
+          auto& job = jobs[i];
+          if (!options.force && fs::exists(job.out)) {
+            totals.skipped++;
+            continue;
+          }
+          try {
+            if (options.force || !fs::exists(job.csv)) {
+              const auto start = std::chrono::steady_clock::now();
+              auto bytes = fetch(job, options);
+              totals.fetched++;
+              totals.fetched_bytes += bytes;
+              std::ostringstream oss;
+              oss << "fetched " << job.url << ": " << (bytes >> 20) << " MB, "
+                  << elapsed_secs(start) << "s";
+              report(oss.str());
+            }
+            ready.push(&job);
+          }
+          catch (const FetchError& e) {
+            if (e.status == 404) {
+              totals.missing++;
+              report("not available: " + job.url);
+            }
+            else {
+              totals.failed++;
+              report("error: " + job.url + ": " + e.what());
+            }
+          }
+          catch (const std::exception& e) {
+            totals.failed++;
+            report("error: " + job.url + ": " + e.what());
+          }
+        }
+      });
+
+    // conversion stage
+    std::vector<std::thread> converters;
+    for (unsigned t = 0; t < options.convert_jobs; t++)
+      converters.emplace_back([&]() {
+        while (auto job = ready.pop()) {
+          try {
+            convert(**job, options, totals);
+          }
+          catch (const std::exception& e) {
+            totals.failed++;
+            report("error: " + (*job)->csv.string() + ": " + e.what());
+          }
+        }
+      });
+
+    for (auto& fetcher : fetchers)
+      fetcher.join();
+    ready.close();
+    for (auto& converter : converters)
+      converter.join();
+    curl_global_cleanup();
+
+    std::cout << jobs.size() << " files: " << totals.converted << " converted ("
+              << totals.records << " records), " << totals.fetched
+              << " fetched (" << (totals.fetched_bytes >> 20) << " MB), "
+              << totals.skipped << " up to date, " << totals.missing
+              << " not available, " << totals.failed << " failed, in "
+              << elapsed_secs(t0) << "s" << std::endl;
+    return totals.failed ? 2 : 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+  return 1;
+}
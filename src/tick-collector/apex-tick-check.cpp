@@ -0,0 +1,356 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* Check the tick files under one or more directories before a backtest.  Each
+ * file is replayed with the same reader a backtest would use, reporting event
+ * times that go backwards (which the backtest event loop warns as "event time
+ * is in the past"), gaps between events, crossed books and invalid trades.
+ * Files are checked in parallel, one per thread.  Raw tickbin files that have
+ * no time index, or an index older than the file, are indexed on the way.
+ *
+ * usage: apex-tick-check [-j THREADS] [--gap SECS] [--json] [--no-index]
+ *                        DIR|FILE...
+ *
+ * The stream of a file is taken from the tick directory layout, e.g.
+ * "aggtrades", "l1" or "l2" for tickbin, "trades", "book_snapshot_5" or
+ * "book_snapshot_25" for Tardis.
+ * Exits with status 2 if any file has problems. */
+
+using namespace apex;
+namespace fs = std::filesystem;
+
+struct Options {
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::chrono::microseconds gap = std::chrono::seconds(60);
+  bool json = false;
+  bool index = true;
+};
+
+
+struct FileReport {
+  fs::path path;
+  std::string format;
+  std::string error;
+  bool indexed = false;
+  uint64_t events = 0;
+  Time first;
+  Time last;
+  uint64_t out_of_order = 0;
+  std::chrono::microseconds max_backstep{0};
+  uint64_t gaps = 0;
+  std::chrono::microseconds max_gap{0};
+  Time max_gap_at;
+  uint64_t crossed = 0;
+  uint64_t bad_trades = 0;
+
+  [[nodiscard]] bool ok() const
+  {
+    return error.empty() && out_of_order == 0 && gaps == 0 && crossed == 0 &&
+           bad_trades == 0;
+  }
+
+  [[nodiscard]] json to_json() const
+  {
+    json report = {{"path", path.string()},
+                   {"format", format},
+                   {"ok", ok()},
+                   {"events", events},
+                   {"out_of_order", out_of_order},
+                   {"max_backstep_us", max_backstep.count()},
+                   {"gaps", gaps},
+                   {"max_gap_us", max_gap.count()},
+                   {"crossed", crossed},
+                   {"bad_trades", bad_trades},
+                   {"indexed", indexed}};
+    if (events) {
+      report["first"] = first.as_iso8601(Time::Resolution::micro);
+      report["last"] = last.as_iso8601(Time::Resolution::micro);
+    }
+    if (gaps)
+      report["max_gap_at"] = max_gap_at.as_iso8601(Time::Resolution::micro);
+    if (!error.empty())
+      report["error"] = error;
+    return report;
+  }
+
+  void print(std::ostream& os) const
+  {
+    os << (ok() ? "ok   " : "FAIL ") << path.string() << ": " << format
+       << ", events " << events;
+    if (events)
+      os << ", " << first.as_iso8601(Time::Resolution::micro) << " to "
+         << last.as_iso8601(Time::Resolution::micro);
+    if (out_of_order)
+      os << ", out-of-order " << out_of_order << " (max "
+         << max_backstep.count() << " us)";
+    if (gaps)
+      os << ", gaps " << gaps << " (max " << max_gap.count() / 1e6
+         << " secs after " << max_gap_at.as_iso8601(Time::Resolution::micro)
+         << ")";
+    if (crossed)
+      os << ", crossed " << crossed;
+    if (bad_trades)
+      os << ", bad trades " << bad_trades;
+    if (indexed)
+      os << ", indexed";
+    if (!error.empty())
+      os << ", error: " << error;
+    os << "\n";
+  }
+};
+
+
+bool has_component(const fs::path& path, const char* name)
+{
+  return std::any_of(path.begin(), path.end(),
+                     [name](const fs::path& part) { return part == name; });
+}
+
+
+bool ends_with(const std::string& s, const char* suffix)
+{
+  auto n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+
+bool is_tick_file(const fs::path& path)
+{
+  auto name = path.filename().string();
+  return ends_with(name, ".bin") || ends_with(name, ".binz") ||
+         ends_with(name, ".bin2") || ends_with(name, ".csv.gz");
+}
+
+
+/* Index a raw tickbin file if its index is missing or older than the file;
+ * returns true if an index was written. */
+bool ensure_tickbin_index(const fs::path& fn)
+{
+  auto index_fn = tickbin_index_path(fn);
+  if (fs::exists(index_fn) &&
+      fs::last_write_time(index_fn) >= fs::last_write_time(fn))
+    return false;
+  build_tickbin_index(fn);
+  return true;
+}
+
+
+std::unique_ptr<BaseTickFileReader> open_reader(const fs::path& fn,
+                                                MarketData* md,
+                                                const Options& options,
+                                                FileReport& report)
+{
+  auto name = fn.filename().string();
+
+  if (ends_with(name, ".csv.gz")) {
+    report.format = "tardis";
+    if (has_component(fn, "trades"))
+      return std::make_unique<TardisFileReader>(
+          fn, md, MdStream::AggTrades, TardisFileReader::DataType::trades);
+    if (has_component(fn, "book_snapshot_5"))
+      return std::make_unique<TardisFileReader>(
+          fn, md, MdStream::L1, TardisFileReader::DataType::book_snapshot_5);
+    if (has_component(fn, "book_snapshot_25"))
+      return std::make_unique<TardisFileReader>(
+          fn, md, MdStream::L2, TardisFileReader::DataType::book_snapshot_25);
+    THROW("cannot tell Tardis data type from path");
+  }
+
+  MdStream stream;
+  if (has_component(fn, "aggtrades"))
+    stream = MdStream::AggTrades;
+  else if (has_component(fn, "l1"))
+    stream = MdStream::L1;
+  else if (has_component(fn, "l2"))
+    stream = MdStream::L2;
+  else
+    THROW("cannot tell tickbin stream from path");
+
+  if (ends_with(name, ".bin2")) {
+    report.format = "tickbin2";
+    return std::make_unique<Tickbin2FileReader>(fn, md, stream);
+  }
+
+  report.format = ends_with(name, ".binz") ? "tickbin1z" : "tickbin1";
+  if (options.index && report.format == "tickbin1")
+    report.indexed = ensure_tickbin_index(fn);
+  return std::make_unique<TickbinFileReader>(fn, md, stream);
+}
+
+
+FileReport check_file(const fs::path& fn, const Options& options)
+{
+  FileReport report;
+  report.path = fn;
+
+  try {
+    auto md = std::make_unique<MarketData>();
+    auto reader = open_reader(fn, md.get(), options, report);
+
+    md->subscribe_events([&](MarketData::EventType et) {
+      if (et.is_top() && md->bid() != 0.0 && md->ask() != 0.0 &&
+          md->is_crossed())
+        report.crossed++;
+      if (et.is_trade()) {
+        auto& last = md->last();
+        if (!(last.price > 0.0) || !(last.qty > 0.0))
+          report.bad_trades++;
+      }
+    });
+
+    while (reader->has_next_event()) {
+      auto t = reader->next_event_time();
+      if (report.events == 0)
+        report.first = t;
+      else if (t < report.last) {
+        report.out_of_order++;
+        report.max_backstep = std::max(report.max_backstep,
+                                       report.last.as_epoch_us() - t.as_epoch_us());
+      }
+      else if (t.as_epoch_us() - report.last.as_epoch_us() >= options.gap) {
+        report.gaps++;
+        auto gap = t.as_epoch_us() - report.last.as_epoch_us();
+        if (gap > report.max_gap) {
+          report.max_gap = gap;
+          report.max_gap_at = report.last;
+        }
+      }
+      // as the event loop does, time never goes backwards
+      if (report.events == 0 || report.last < t)
+        report.last = t;
+      report.events++;
+
+      reader->consume_next_event();
+    }
+  }
+  catch (std::exception& e) {
+    report.error = e.what();
+  }
+  return report;
+}
+
+
+int main(int argc, char** argv)
+{
+  try {
+    Options options;
+    std::vector<fs::path> roots;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "-j") == 0)
+        options.threads = std::max(1, std::stoi(arg()));
+      else if (strcmp(argv[i], "--gap") == 0)
+        options.gap = std::chrono::microseconds(
+            static_cast<int64_t>(std::stod(arg()) * 1e6));
+      else if (strcmp(argv[i], "--json") == 0)
+        options.json = true;
+      else if (strcmp(argv[i], "--no-index") == 0)
+        options.index = false;
+      else
+        roots.emplace_back(argv[i]);
+    }
+    if (roots.empty())
+      THROW("provide tick directories or files to check");
+
+    // files are sorted, so that reports are in a stable order
+    std::vector<fs::path> files;
+    for (auto& root : roots) {
+      if (fs::is_directory(root)) {
+        for (auto& entry : fs::recursive_directory_iterator(root))
+          if (entry.is_regular_file() && is_tick_file(entry.path()))
+            files.push_back(entry.path());
+      }
+      else if (fs::is_regular_file(root))
+        files.push_back(root);
+      else
+        THROW("no such file or directory " << root);
+    }
+    std::sort(files.begin(), files.end());
+
+    // readers log only problems of their own
+    Logger::instance().set_level(Logger::level::warn);
+
+    // the largest files are started first, so that one long file does not
+    // hold up the end of the run
+    std::vector<size_t> order(files.size());
+    std::vector<uintmax_t> sizes(files.size());
+    for (size_t i = 0; i < files.size(); i++) {
+      order[i] = i;
+      sizes[i] = fs::file_size(files[i]);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](size_t lhs, size_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+    std::vector<FileReport> reports(files.size());
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < std::min<size_t>(options.threads, files.size()); t++)
+      workers.emplace_back([&]() {
+        for (size_t i; (i = next.fetch_add(1)) < order.size();)
+          reports[order[i]] = check_file(files[order[i]], options);
+      });
+    for (auto& worker : workers)
+      worker.join();
+
+    size_t failed = std::count_if(reports.begin(), reports.end(),
+                                  [](const FileReport& r) { return !r.ok(); });
+    if (options.json) {
+      json out = json::array();
+      for (auto& report : reports)
+        out.push_back(report.to_json());
+      std::cout << out.dump(2) << "\n";
+    }
+    else {
+      for (auto& report : reports)
+        report.print(std::cout);
+      std::cout << reports.size() << " files checked, " << failed
+                << " with problems\n";
+    }
+    std::cout.flush();
+    return failed ? 2 : 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
@@ -15,7 +15,9 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <apex/backtest/AsyncTickFileWriter.hpp>
 #include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/TickShards.hpp>
 #include <apex/backtest/TickbinMsgs.hpp>
 #include <apex/gx/BinanceSession.hpp>
 #include <apex/gx/GxServer.hpp>
@@ -25,8 +27,10 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 #include <apex/util/Config.hpp>
 #include <apex/util/json.hpp>
 #include <apex/util/Error.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
 
 #include <unistd.h>
+#include <atomic>
 #include <utility>
 #include <vector>
 #include <variant>
@@ -37,10 +41,20 @@ with Apex. If not, see <https://www.gnu.org/licenses/>.
 
 namespace apex {
 
-/* Capture ticks related to a single instrument and single stream/channel. As a
- base class this largely defines an interface that derived classes have to
- implement. */
-class BaseCollector {
+/* Capture time of a tick: the receive time of its exchange frame, which
+ * latency tracing, enabled by the collector, stamps on every tick; that is
+ * the kernel's receive timestamp if the session has "rx_timestamps" set. */
+static apex::Time capture_time(const apex::trace::Stamp& stamp)
+{
+  if (stamp.is_traced())
+    return apex::Time(std::chrono::nanoseconds(stamp.rt));
+  return apex::Time::realtime_now();
+}
+
+/* Capture ticks related to a single instrument and single stream/channel.
+ Ticks are serialised straight into the stream's arena of the asynchronous
+ writer, which writes them to disk on its own thread. */
+class StreamCollector {
 public:
 
   static constexpr std::chrono::seconds stale_interval{60};
@@ -49,162 +63,38 @@ public:
   // have not arrived for a specified interval, `stale_interval`
   bool is_stale;
 
-  BaseCollector(std::string descr,
-                StreamInfo info) :
+  StreamCollector(std::string descr,
+                  apex::AsyncTickbinWriter::Stream* stream) :
     is_stale(false),
     _descr(std::move(descr)),
-    _info(std::move(info))
+    _stream(stream)
   {}
 
-
-  virtual ~BaseCollector() = default;
-
-  [[nodiscard]] virtual size_t tick_count() const = 0;
-
-  [[nodiscard]] virtual size_t total_tick_count() const { return _count; }
-
-  [[nodiscard]] virtual apex::TickFileBucketId earliest_tick_bucket_id() const = 0;
-
-  virtual size_t write_to_file(apex::TickbinFileWriter&) = 0;
-
-  [[nodiscard]] const std::string & descr() const { return _descr; }
-  [[nodiscard]] const apex::StreamInfo& info() const { return _info; }
-
-  // Time elapse since the most recent tick arrived
-  [[nodiscard]] std::chrono::milliseconds duration_since_update() const {
-    return apex::Time::realtime_now().as_epoch_ms() - _last_data.as_epoch_ms() ;
-  }
-
-protected:
-  apex::Time _last_data; // time last data arrived
-  size_t _count = 0; // count of ticks collected
-
-private:
-  std::string _descr; // description, for logging purpose
-  apex::StreamInfo _info; // instrument & stream
-};
-
-
-/* Base class for tick-collectors that use a single data type for capturing
-   ticks. */
-template<typename T>
-class BaseCollectorImpl : public BaseCollector {
-public:
-
-  BaseCollectorImpl(std::string descr, apex::StreamInfo info)
-    : BaseCollector(descr, info) {}
-
-  [[nodiscard]] size_t tick_count() const override { return this->_ticks.size(); }
-
-  [[nodiscard]] apex::TickFileBucketId earliest_tick_bucket_id() const override {
-    if (tick_count() == 0)
-      return apex::TickFileBucketId{};
-
-    auto bucketid = apex::TickFileBucketId::from_time(_ticks.front().recv_time);
-    return bucketid;
-  }
-
-
-  size_t write_ticks_impl(TickbinFileWriter& file,
-                          std::function<size_t(T&)> write_fn) {
-    size_t byte_count = 0;
-    auto iter = this->_ticks.begin();
-    while (iter != _ticks.end() &&
-           (TickFileBucketId::from_time(iter->recv_time) == file.bucketid())) {
-      byte_count += write_fn(*iter);
-      iter++;
-    }
-    this->_ticks.erase(this->_ticks.begin(), iter);
-    return byte_count;
-  }
-
-protected:
-  std::list<T> _ticks;
-};
-
-
-struct CapturedVariantTick {
-  apex::Time recv_time;
-  std::variant<apex::TickTop, apex::TickTrade> tick;
-};
-
-// VariantCollector is able to collect streams of heterogeneous tick types
-class VariantCollector : public BaseCollectorImpl<CapturedVariantTick> {
-public:
-  VariantCollector(std::string descr, apex::StreamInfo info)
-    : BaseCollectorImpl<CapturedVariantTick>(std::move(descr), std::move(info)) {
-  }
-
-
   template<typename T>
   void add_tick(apex::Time captured, const T& tick) {
     _count++;
-    this->_last_data = apex::Time::realtime_now();
-    _ticks.push_back({captured, tick});
+    _last_data_ms = captured.as_epoch_ms().count();
+    _stream->write(captured, tick);
   }
 
+  [[nodiscard]] size_t total_tick_count() const { return _count; }
 
-  template<typename T>
-  size_t write(apex::TickbinFileWriter& file, CapturedVariantTick& item) {
-    if (std::holds_alternative<T>(item.tick)) {
-      auto bytes = _serialiser.serialise(item.recv_time, std::get<T>(item.tick));
-      file.write_bytes(&bytes[0], bytes.size());
-      return bytes.size();
-    }
-    else
-      return 0;
-  }
+  [[nodiscard]] const std::string & descr() const { return _descr; }
+  [[nodiscard]] const apex::StreamInfo& info() const { return _stream->info(); }
 
-  size_t write_to_file(apex::TickbinFileWriter& file) override {
-    auto write_fn= [&](CapturedVariantTick& item) ->size_t{
-      size_t bytes;
-      if ((bytes = this->write<apex::TickTop>(file, item)))
-        return bytes;
-      if ((bytes = this->write<apex::TickTrade>(file, item)))
-        return bytes;
-      throw std::runtime_error("cannot serialise collected tick, unsupported tick variant");
-    };
-    return this->write_ticks_impl(file, write_fn);
+  // Time elapse since the most recent tick arrived
+  [[nodiscard]] std::chrono::milliseconds duration_since_update() const {
+    return apex::Time::realtime_now().as_epoch_ms() -
+      std::chrono::milliseconds(_last_data_ms.load());
   }
 
 private:
-  apex::tickbin::Serialiser _serialiser;
-};
-
-
-template <typename T>
-struct CapturedSingleTick {
-  apex::Time recv_time;
-  T tick;
+  std::atomic<int64_t> _last_data_ms{0}; // time last data arrived
+  std::atomic<size_t> _count{0}; // count of ticks collected
+  std::string _descr; // description, for logging purpose
+  apex::AsyncTickbinWriter::Stream* _stream;
 };
 
-// SingleTypeCollector is able to collect streams of a single tick type (which
-// is provided via the template argument T).
-template <typename T>
-class SingleTypeCollector : public BaseCollectorImpl<CapturedSingleTick<T> > {
-public:
-
-  SingleTypeCollector(std::string descr, apex::StreamInfo info)
-    : BaseCollectorImpl<CapturedSingleTick<T> > (std::move(descr), info) {}
-
-  void add_tick(apex::Time captured, T& tick) {
-    this->_count++;
-    this->_last_data = apex::Time::realtime_now();
-    this->_ticks.push_back({captured, tick});
-  }
-
-  size_t write_to_file(apex::TickbinFileWriter& file) override {
-
-    auto write_fn = [&]( CapturedSingleTick<T> & item) -> size_t {
-      auto bytes = apex::tickbin::Serialiser::serialise(item.recv_time,
-                                                        item.tick);
-      file.write_bytes(&bytes[0], bytes.size());
-      return bytes.size();
-    };
-
-    return this->write_ticks_impl(file, write_fn);
-  }
-};
 
 /* Apex tick collection service */
 
@@ -224,10 +114,58 @@ public:
   {
     apex::SslConfig sslconf(true);
     _ssl = std::make_unique<apex::SslContext>(sslconf);
+
+    // ticks then carry the receive time of their frame, as capture time
+    apex::trace::tracer().enable(true);
+
+    auto config = _services->config().get_sub_config("tick_collector",
+                                                     apex::Config::empty_config());
+    apex::AsyncTickbinWriter::Options options;
+    options.arena_size = config.get_uint("arena_mb", options.arena_size >> 20) << 20;
+    options.fsync_interval = std::chrono::milliseconds(
+      config.get_uint("fsync_interval_ms", options.fsync_interval.count()));
+    _flush_interval = std::chrono::seconds(
+      config.get_uint("flush_interval_sec", _flush_interval.count()));
+    options.file.compress = config.get_bool("compress", options.file.compress);
+    options.file.compression_level = static_cast<int>(
+      config.get_uint("compression_level", options.file.compression_level));
+    options.file.frame_size =
+      config.get_uint("frame_kb", options.file.frame_size >> 10) << 10;
+    options.file.delta = config.get_bool("delta", options.file.delta);
+    if (options.file.compress && options.file.delta)
+      throw apex::ConfigError(
+        "tick_collector options 'compress' and 'delta' are exclusive");
+
+    // the streams can be spread over several exchange sessions, each with IO
+    // and event threads of its own, and over several collector processes,
+    // each collecting one "shard" of the streams configured
+    _session_count = std::max<size_t>(config.get_uint("sessions", 1), 1);
+    auto shard = config.get_sub_config("shard", apex::Config::empty_config());
+    _shard_count = std::max<size_t>(shard.get_uint("count", 1), 1);
+    _shard_index = shard.get_uint("index", 0);
+    if (_shard_index >= _shard_count)
+      throw apex::ConfigError("tick_collector shard index must be less than its count");
+    _output_dir = config.get_string(
+      "output_dir", (_services->paths_config().tickdata / "bin1").string());
+
+    json meta;
+    meta["loc"] = _location;
+    _writer = std::make_unique<apex::AsyncTickbinWriter>(
+      [this](const apex::StreamInfo& info, const apex::TickFileBucketId& bucketid) {
+        return build_tickbin_filename(bucketid, info);
+      },
+      meta, options);
   }
 
   void start();
+
+  /* Add the collectors of the "streams" of the tick_collector config, each
+   * {"symbol", "exchange", "channels"}, or else of a default set; with a
+   * "shard" configured, only those of the shard. */
+  void add_configured_collectors(apex::Config);
+
   void check_collector_queues();
+  void log_statistics();
 
   // add a new collector for a specified instrument
   void add_collector(std::string symbol, apex::ExchangeId exchange_id, std::string stream) {
@@ -244,13 +182,22 @@ public:
     _streams_to_add.insert(info);
   }
 
+  // whether a stream is collected by the shard of this process
+  [[nodiscard]] bool is_own_stream(apex::ExchangeId exchange_id,
+                                   const std::string& symbol,
+                                   const std::string& stream) const {
+    return apex::tick_stream_shard(apex::exchange_id_to_string(exchange_id),
+                                   symbol, stream, _shard_count) == _shard_index;
+  }
+
   [[nodiscard]] const std::string& location() const { return _location; }
 
 private:
   std::pair<std::filesystem::path, std::filesystem::path>
   build_tickbin_filename(apex::TickFileBucketId bucketid,
-                         BaseCollector& collector);
+                         const apex::StreamInfo& info);
   void create_exchange_sessions();
+  apex::BaseExchangeSession* assign_session(const apex::StreamInfo&);
   void setup_collectors();
   void setup_collector_l1(apex::BaseExchangeSession*, const apex::StreamInfo&);
   void setup_collector_aggtrades(apex::BaseExchangeSession*, const apex::StreamInfo&);
@@ -261,20 +208,39 @@ private:
   apex::IoLoop* _ioloop;
   std::unique_ptr<apex::SslContext> _ssl;
 
-  std::map<apex::ExchangeId, std::shared_ptr<apex::BaseExchangeSession>> _exchange_sessions;
+  // threads of the sessions other than the first, which uses the service's
+  struct SessionLoops {
+    std::unique_ptr<apex::IoLoop> io;
+    std::unique_ptr<apex::RealtimeEventLoop> ev;
+  };
+  std::vector<SessionLoops> _session_loops;
+
+  // sessions of each exchange, streams being assigned to them in turn
+  size_t _session_count = 1;
+  std::map<apex::ExchangeId, std::vector<std::shared_ptr<apex::BaseExchangeSession>>>
+    _exchange_sessions;
+  std::map<apex::ExchangeId, size_t> _next_session;
+
+  size_t _shard_count = 1;
+  size_t _shard_index = 0;
+  std::string _output_dir;
 
   // container of tick collections pending creation
   std::set<apex::StreamInfo> _streams_to_add;
-  std::vector<std::shared_ptr<BaseCollector>> _collectors;
+  std::vector<std::shared_ptr<StreamCollector>> _collectors;
+
+  // interval at which captured ticks are handed to the writer thread
+  std::chrono::seconds _flush_interval{1};
+  std::unique_ptr<apex::AsyncTickbinWriter> _writer;
 };
 
 
 std::pair<std::filesystem::path, std::filesystem::path>
 TickCollectorService::build_tickbin_filename(
   apex::TickFileBucketId bucketid,
-  BaseCollector& collector) {
+  const apex::StreamInfo& info) {
 
-  auto directory = _services->paths_config().tickdata / "bin1";
+  std::filesystem::path directory = _output_dir;
 
   char year[8] = {0};
   char month[8] = {0};
@@ -284,10 +250,10 @@ TickCollectorService::build_tickbin_filename(
   snprintf(month, sizeof(month), "%02d", bucketid.month);
   snprintf(day, sizeof(day), "%02d", bucketid.day);
 
-  auto dir = directory / exchange_id_to_string(collector.info().exchange_id())  /
-    collector.info().channel / year / month / day;
+  auto dir = directory / exchange_id_to_string(info.exchange_id())  /
+    info.channel / year / month / day;
 
-  std::filesystem::path fn = collector.info().symbol();
+  std::filesystem::path fn = info.symbol();
   fn += ".bin";
   return {dir, fn};
 }
@@ -295,39 +261,31 @@ TickCollectorService::build_tickbin_filename(
 
 void TickCollectorService::check_collector_queues()
 {
-  /* For all collector objects, check the contents of their tick queue, and
-   decide if a write to disk is required. */
+  /* For all collector objects, check whether the stream is still live, and
+   then hand captured ticks to the writer thread. */
   for (auto& collector : _collectors) {
     auto duration_since_update = collector->duration_since_update();
-    if (duration_since_update > BaseCollector::stale_interval && !collector->is_stale) {
+    if (duration_since_update > StreamCollector::stale_interval && !collector->is_stale) {
       LOG_WARN("no update on stream " << collector->descr());
       collector->is_stale = true;
     }
     else {
       collector->is_stale = false;
     }
+  }
 
-    if (!collector->tick_count())
-      continue;
-
-    auto bucketid = collector->earliest_tick_bucket_id();
-
-    auto tickbin = build_tickbin_filename(bucketid, *collector);
-
-    json meta;
-    meta["loc"] = _location;
+  _writer->flush();
+}
 
-    apex::TickbinFileWriter file(bucketid,
-                                 tickbin.first,
-                                 tickbin.second,
-                                 collector->info(),
-                                 meta);
 
-    auto byte_count = collector->write_to_file(file);
-    LOG_INFO("stream: " << collector->descr() << ", file: " << file.full_path()
-             << ", wrote bytes: " << byte_count
+void TickCollectorService::log_statistics()
+{
+  auto stats = _writer->stats();
+  LOG_INFO("tick writer: ticks " << stats.records << ", bytes written "
+           << stats.bytes << ", arena growths " << stats.arena_growths);
+  for (auto& collector : _collectors)
+    LOG_INFO("stream: " << collector->descr()
              << ", total ticks: " << collector->total_tick_count());
-  }
 }
 
 
@@ -336,10 +294,11 @@ void TickCollectorService::setup_collector_aggtrades(apex::BaseExchangeSession*
   std::ostringstream oss;
   oss << info.symbol() << "." << "aggtrades";
 
-  auto collector = std::make_shared<SingleTypeCollector<apex::TickTrade>>(oss.str(), info);
+  auto collector = std::make_shared<StreamCollector>(oss.str(),
+                                                     _writer->add_stream(info));
 
-  auto callback = [collector](apex::TickTrade tick) {
-    collector->add_tick(apex::Time::realtime_now(), tick);
+  auto callback = [collector](const apex::TickTrade& tick) {
+    collector->add_tick(capture_time(tick.trace), tick);
   };
 
   // make subscriptions
@@ -356,11 +315,11 @@ void TickCollectorService::setup_collector_l1(apex::BaseExchangeSession* sp,
                                               const apex::StreamInfo& info) {
   std::ostringstream oss;
   oss << info.symbol() << "." << "l1";
-  auto collector = std::make_shared<SingleTypeCollector<apex::TickTop>>(
-    oss.str(), info);
+  auto collector = std::make_shared<StreamCollector>(oss.str(),
+                                                     _writer->add_stream(info));
 
-  auto callback = [collector](apex::TickTop tick) {
-    collector->add_tick(apex::Time::realtime_now(), tick);
+  auto callback = [collector](const apex::TickTop& tick) {
+    collector->add_tick(capture_time(tick.trace), tick);
   };
 
   // make the subscriptions required to receive L1 market data model
@@ -377,16 +336,28 @@ void TickCollectorService::setup_collector_l1(apex::BaseExchangeSession* sp,
  * exchange sessions that will provide the underlying market data access.
  */
 void TickCollectorService::create_exchange_sessions() {
+  for (size_t i = 1; i < _session_count; i++) {
+    SessionLoops loops;
+    loops.io = std::make_unique<apex::IoLoop>();
+    loops.ev = std::make_unique<apex::RealtimeEventLoop>([]() { return false; });
+    _session_loops.push_back(std::move(loops));
+  }
+
   for (auto & item : _streams_to_add)  {
     auto iter = _exchange_sessions.find(item.exchange_id());
     if (iter == std::end(_exchange_sessions)) {
       if (item.exchange_id() == apex::ExchangeId::binance) {
-        apex::BaseExchangeSession::EventCallbacks callbacks;
-        apex::BinanceSession::Params params;
-        auto sp = std::make_shared<apex::BinanceSession>(
-          callbacks, params, apex::RunMode::paper, _ioloop, *_event_loop, _ssl.get());
-        _exchange_sessions.insert({apex::ExchangeId::binance, sp});
-        sp->start();
+        auto& sessions = _exchange_sessions[apex::ExchangeId::binance];
+        for (size_t i = 0; i < _session_count; i++) {
+          auto* ioloop = i ? _session_loops[i - 1].io.get() : _ioloop;
+          auto* event_loop = i ? _session_loops[i - 1].ev.get() : _event_loop;
+          apex::BaseExchangeSession::EventCallbacks callbacks;
+          apex::BinanceSession::Params params;
+          auto sp = std::make_shared<apex::BinanceSession>(
+            callbacks, params, apex::RunMode::paper, ioloop, *event_loop, _ssl.get());
+          sessions.push_back(sp);
+          sp->start();
+        }
       }
       else
         THROW("cannot setup tick collector for unknown exchange '"
@@ -396,24 +367,38 @@ void TickCollectorService::create_exchange_sessions() {
 }
 
 
+apex::BaseExchangeSession* TickCollectorService::assign_session(
+  const apex::StreamInfo& info)
+{
+  auto iter = _exchange_sessions.find(info.exchange_id());
+  if (iter == std::end(_exchange_sessions)) {
+    THROW("no exchange session for '"<< info.exchange_id() << "'");
+  }
+  auto& next = _next_session[info.exchange_id()];
+  auto* session = iter->second[next].get();
+  next = (next + 1) % iter->second.size();
+  return session;
+}
+
+
 void TickCollectorService::setup_collectors()
 {
+  size_t added = 0;
   for (auto & item : _streams_to_add)  {
-    auto iter = _exchange_sessions.find(item.exchange_id());
-    if (iter == std::end(_exchange_sessions)) {
-      THROW("no exchange session for '"<<item.exchange_id()<< "'");
-    }
-    auto sp = iter->second;
+    auto* sp = assign_session(item);
 
     if (item.channel == "l1")
-      setup_collector_l1(sp.get(), item);
+      setup_collector_l1(sp, item);
     else if (item.channel == "aggtrades")
-      setup_collector_aggtrades(sp.get(), item);
+      setup_collector_aggtrades(sp, item);
     else
       THROW("cannot setup tick collector for unknown stream type '"
             << item.channel << "'");
 
-    usleep(1000 * 1000);
+    // subscriptions are paced per session, so one is made on each session
+    // before pausing
+    if (++added % _session_count == 0)
+      usleep(1000 * 1000);
 
     LOG_INFO("created tick-collector for " << item.exchange_id() << "/"
                                            << item.channel << "/"<< item.symbol());
@@ -421,6 +406,35 @@ void TickCollectorService::setup_collectors()
 }
 
 
+void TickCollectorService::add_configured_collectors(apex::Config config)
+{
+  json streams = json::array();
+  if (config.contains("streams"))
+    streams = config.get_sub_config("streams").raw();
+  else
+    for (auto symbol : {"ETHUSDT", "ETHBTC", "BTCUSDT", "BNBUSDT", "ADAUSDT"})
+      streams.push_back(
+        {{"symbol", symbol}, {"exchange", "binance"}, {"channels", {"l1", "aggtrades"}}});
+
+  size_t skipped = 0;
+  for (auto& item : streams) {
+    auto exchange_id = apex::to_exchange_id(item.at("exchange").get<std::string>());
+    auto symbol = item.at("symbol").get<std::string>();
+    for (auto& channel : item.at("channels")) {
+      auto stream = channel.get<std::string>();
+      if (is_own_stream(exchange_id, symbol, stream))
+        add_collector(symbol, exchange_id, stream);
+      else
+        skipped++;
+    }
+  }
+  if (_shard_count > 1)
+    LOG_NOTICE("collecting shard " << _shard_index << " of " << _shard_count
+               << ": " << _streams_to_add.size() << " streams, "
+               << skipped << " left to other shards");
+}
+
+
 void TickCollectorService::start()
 {
   // create the exchange-session components required by the tick collectors
@@ -430,11 +444,11 @@ void TickCollectorService::start()
   setup_collectors();
 
   // create a period callback that will check the state of tick collectors,
-  // possibly leading to disk-writes
-  auto save_internal = std::chrono::seconds(60);
+  // and pass captured ticks to the writer thread
+  auto flush_interval = _flush_interval;
   _event_loop->dispatch(
-    save_internal,
-    [this, save_internal]() -> std::chrono::milliseconds {
+    flush_interval,
+    [this, flush_interval]() -> std::chrono::milliseconds {
       try {
         this->check_collector_queues();
       }
@@ -444,12 +458,20 @@ void TickCollectorService::start()
       catch (...) {
         LOG_ERROR("check_collector_queues() caught unknown exception");
       }
-      return save_internal;
+      return flush_interval;
+    });
+
+  auto stats_interval = std::chrono::seconds(60);
+  _event_loop->dispatch(
+    stats_interval,
+    [this, stats_interval]() -> std::chrono::milliseconds {
+      this->log_statistics();
+      return stats_interval;
     });
 }
 } // namespace
 
-int main(int , char** )
+int main(int argc, char** argv)
 {
   try {
 
@@ -460,27 +482,19 @@ int main(int , char** )
 
     // Create core-services configured for paper trading, which provides
     // real-time a real time event loop and market-data but no access to
-    // production trading.
-    auto services = apex::Services::create(apex::RunMode::paper);
+    // production trading.  The config file, if given, sets the streams
+    // collected, and optionally the shard of them collected by this process.
+    auto services = std::make_unique<apex::Services>(apex::RunMode::paper);
+    services->init_services(
+      argc > 1 ? apex::Config(apex::read_json_config_file(argv[1]))
+               : apex::Config::empty_config());
+    auto config = services->config().get_sub_config(
+      "tick_collector", apex::Config::empty_config());
 
     // capture location of the collection;
-    auto location = "london";
+    auto location = config.get_string("location", "london");
     apex::TickCollectorService tick_collector_svc(services.get(), location);
-
-    tick_collector_svc.add_collector("ETHUSDT", apex::ExchangeId::binance, "l1");
-    tick_collector_svc.add_collector("ETHUSDT", apex::ExchangeId::binance, "aggtrades");
-
-    tick_collector_svc.add_collector("ETHBTC", apex::ExchangeId::binance, "l1");
-    tick_collector_svc.add_collector("ETHBTC", apex::ExchangeId::binance, "aggtrades");
-
-    tick_collector_svc.add_collector("BTCUSDT", apex::ExchangeId::binance, "l1");
-    tick_collector_svc.add_collector("BTCUSDT", apex::ExchangeId::binance, "aggtrades");
-
-    tick_collector_svc.add_collector("BNBUSDT", apex::ExchangeId::binance, "l1");
-    tick_collector_svc.add_collector("BNBUSDT", apex::ExchangeId::binance, "aggtrades");
-
-    tick_collector_svc.add_collector("ADAUSDT", apex::ExchangeId::binance, "l1");
-    tick_collector_svc.add_collector("ADAUSDT", apex::ExchangeId::binance, "aggtrades");
+    tick_collector_svc.add_configured_collectors(config);
 
     // start the collector service after the various streams have been
     // configured.
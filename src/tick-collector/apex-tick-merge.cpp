@@ -0,0 +1,104 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/TickShards.hpp>
+#include <apex/backtest/TickFileWriter.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Combine the tick file trees written by the shards of a sharded tick
+ * collection (see the "shard" option of apex-tick-collector) into one tree,
+ * in the per-day layout read by backtests.  Files held by one shard are
+ * copied; raw tickbin files held by several shards, e.g. by overlapping
+ * shards, or after streams moved between shards, are merged in capture time
+ * order, with records held by more than one written once.  Files already in
+ * the destination are merged alike, so a merge can be repeated.
+ *
+ * usage: apex-tick-merge [--verify] DEST_DIR SHARD_DIR...
+ *
+ * With --verify nothing is written; files that could not be merged, and raw
+ * files with an incomplete record, are reported.  Exits with status 2 if
+ * there are any such problems.
+ *
+ * usage: apex-tick-merge --interleave DEST_FILE TICK_FILE...
+ *
+ * With --interleave, the raw tick files of the streams of one instrument and
+ * day, e.g. its l1 and aggtrades files, are instead interleaved into the
+ * mixed tick file DEST_FILE, which a backtest with "mixed_tick_files" replays
+ * as one stream; DEST_FILE is then indexed. */
+
+using namespace apex;
+namespace fs = std::filesystem;
+
+int main(int argc, char** argv)
+{
+  try {
+    bool verify_only = false;
+    bool interleave = false;
+    std::vector<fs::path> dirs;
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--verify") == 0)
+        verify_only = true;
+      else if (strcmp(argv[i], "--interleave") == 0)
+        interleave = true;
+      else
+        dirs.emplace_back(argv[i]);
+    }
+
+    if (interleave) {
+      if (dirs.size() < 2)
+        THROW("provide the destination file and one or more tick files");
+      const std::vector<fs::path> inputs(dirs.begin() + 1, dirs.end());
+      auto records = interleave_tickbin_streams(inputs, dirs.front());
+      build_tickbin_index(dirs.front());
+      std::cout << "interleaved " << records << " records\n";
+      return 0;
+    }
+
+    if (dirs.size() < 2)
+      THROW("provide the destination directory and one or more shard directories");
+
+    Logger::instance().set_level(Logger::level::warn);
+
+    const fs::path dest = dirs.front();
+    const std::vector<fs::path> shards(dirs.begin() + 1, dirs.end());
+    auto stats = merge_tick_trees(shards, dest, verify_only);
+
+    for (auto& error : stats.errors)
+      std::cout << "problem: " << error << "\n";
+    std::cout << (verify_only ? "would copy " : "copied ") << stats.files_copied
+              << " files, " << (verify_only ? "would merge " : "merged ")
+              << stats.files_merged << " files";
+    if (!verify_only)
+      std::cout << " (" << stats.records << " records, " << stats.duplicates
+                << " duplicates dropped)";
+    std::cout << ", " << stats.errors.size() << " problems\n";
+    std::cout.flush();
+    return stats.errors.empty() ? 0 : 2;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
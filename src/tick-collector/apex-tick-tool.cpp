@@ -15,7 +15,10 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <apex/backtest/TardisFileReader.hpp>
 #include <apex/backtest/TickFileWriter.hpp>
+#include <apex/backtest/UniverseTickFile.hpp>
+#include <apex/backtest/Tickbin2File.hpp>
 #include <apex/backtest/TickbinMsgs.hpp>
 #include <apex/infra/TcpSocket.hpp>
 #include <apex/util/Error.hpp>
@@ -43,6 +46,41 @@ json read_meta(const std::vector<char> & bytes, size_t meta_len) {
 int main(int argc, char** argv)
 {
   try {
+    // usage: apex-tick-tool FILE [--index | --tickbin2 OUTFILE |
+    //                              --from-tardis DATATYPE OUTFILE]
+    //        apex-tick-tool --universe OUTFILE FILE...
+    if (argc >= 4 && strcmp(argv[1], "--universe") == 0) {
+      std::vector<std::filesystem::path> inputs(argv + 3, argv + argc);
+      auto count = build_universe_tick_file(inputs, argv[2]);
+      std::cout << "merged " << count << " records from " << inputs.size()
+                << " files to " << argv[2] << "\n";
+      return 0;
+    }
+    if (argc == 3 && strcmp(argv[2], "--index") == 0) {
+      auto count = build_tickbin_index(argv[1]);
+      std::cout << "wrote " << count << " index entries to "
+                << tickbin_index_path(argv[1]) << "\n";
+      return 0;
+    }
+    if (argc == 4 && strcmp(argv[2], "--tickbin2") == 0) {
+      auto count = convert_tickbin1_to_tickbin2(argv[1], argv[3]);
+      std::cout << "converted " << count << " records to " << argv[3] << "\n";
+      return 0;
+    }
+    if (argc == 5 && strcmp(argv[2], "--from-tardis") == 0) {
+      TardisFileReader::DataType datatype;
+      if (strcmp(argv[3], "trades") == 0)
+        datatype = TardisFileReader::DataType::trades;
+      else if (strcmp(argv[3], "book_snapshot_5") == 0)
+        datatype = TardisFileReader::DataType::book_snapshot_5;
+      else if (strcmp(argv[3], "book_snapshot_25") == 0)
+        datatype = TardisFileReader::DataType::book_snapshot_25;
+      else
+        THROW("Tardis datatype must be trades, book_snapshot_5 or book_snapshot_25");
+      auto count = convert_tardis_to_tickbin2(argv[1], argv[4], datatype);
+      std::cout << "converted " << count << " records to " << argv[4] << "\n";
+      return 0;
+    }
     if (argc != 2) {
       THROW("provide name of tickbin file");
     }
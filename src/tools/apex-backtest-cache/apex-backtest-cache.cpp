@@ -0,0 +1,102 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BacktestResultCache.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+/* List, or invalidate, the entries of a backtest result cache, as used by
+ * TimeShardedBacktest with the result_cache_dir option.
+ *
+ * usage: apex-backtest-cache [--symbol SYM] [--from TIME] [--upto TIME]
+ *                            [--stale] list|clear DIR
+ *
+ * Entries are selected by symbol, and by shards overlapping the time range;
+ * --stale selects only those that would no longer be reused, being of another
+ * build of the library or of tick files since changed.  A TIME may be a date,
+ * YYYY-MM-DD. */
+
+using namespace apex;
+
+
+static Time parse_time_arg(std::string arg)
+{
+  if (arg.size() == 10)
+    arg += "T00:00:00";
+  return Time(arg);
+}
+
+
+int main(int argc, char** argv)
+{
+  try {
+    BacktestResultCache::Filter filter;
+    std::string command;
+    const char* dir = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "--symbol") == 0)
+        filter.symbol = arg();
+      else if (strcmp(argv[i], "--from") == 0)
+        filter.from = parse_time_arg(arg());
+      else if (strcmp(argv[i], "--upto") == 0)
+        filter.upto = parse_time_arg(arg());
+      else if (strcmp(argv[i], "--stale") == 0)
+        filter.stale = true;
+      else if (command.empty())
+        command = argv[i];
+      else if (!dir)
+        dir = argv[i];
+      else
+        THROW("unexpected argument " << QUOTE(argv[i]));
+    }
+    if (command != "list" && command != "clear")
+      THROW("provide a command, list or clear");
+    if (!dir)
+      THROW("provide the cache directory");
+
+    Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+    BacktestResultCache cache(dir);
+
+    if (command == "clear") {
+      auto removed = cache.invalidate(filter);
+      std::cout << "removed " << removed << " entries" << std::endl;
+      return 0;
+    }
+
+    for (auto& entry : cache.entries(filter))
+      std::cout << entry.exchange << " " << entry.symbol << " "
+                << entry.from.as_iso8601() << " " << entry.upto.as_iso8601()
+                << " " << entry.key << (entry.stale ? " stale" : "")
+                << std::endl;
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
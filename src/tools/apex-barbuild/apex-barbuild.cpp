@@ -0,0 +1,140 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/backtest/BarFile.hpp>
+#include <apex/backtest/TickReplayer.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/* Build the bar files of instruments, from the tick files of a tick-data
+ * directory, for backtests replaying the "bars" stream.
+ *
+ * usage: apex-barbuild --tickdata DIR --exchange EXCH --from DATE
+ *                      [--upto DATE] [--format FMT] [--interval SECS] SYMBOL...
+ *
+ * Days are built from DATE up to and including --upto, which defaults to
+ * DATE, reading the trades and top of book files of the --format, tickbin2 by
+ * default.  Bars are written to DIR/bars/EXCH/<SECS>s/Y/m/d/SYMBOL.bars; a day
+ * with neither tick file is skipped. */
+
+using namespace apex;
+namespace fs = std::filesystem;
+
+
+static Time parse_date_arg(std::string arg)
+{
+  if (arg.size() != 10)
+    THROW("expected a date, YYYY-MM-DD, got " << QUOTE(arg));
+  return Time(arg + "T00:00:00");
+}
+
+
+// Tick file of a day, as laid out by TickReplayer; empty if absent.
+static fs::path tick_file(const fs::path& tick_dir, TickFormat format,
+                          const std::string& exchange, bool trades, Time date,
+                          const std::string& symbol)
+{
+  auto fn = tick_dir / to_string(format) / exchange;
+  if (format == TickFormat::tardis)
+    fn /= trades ? "trades" : "book_snapshot_5";
+  else
+    fn /= trades ? "aggtrades" : "l1";
+  fn /= date.strftime("%Y");
+  fn /= date.strftime("%m");
+  fn /= date.strftime("%d");
+  fn /= symbol;
+  switch (format) {
+    case TickFormat::tardis: fn += ".csv.gz"; break;
+    case TickFormat::tickbin2: fn += ".bin2"; break;
+    default: fn += ".bin";
+  }
+  return fs::exists(fn) ? fn : fs::path{};
+}
+
+
+int main(int argc, char** argv)
+{
+  try {
+    fs::path tick_dir;
+    std::string exchange;
+    TickFormat format = TickFormat::tickbin2;
+    std::chrono::seconds interval{60};
+    Time from, upto;
+    std::vector<std::string> symbols;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "--tickdata") == 0)
+        tick_dir = arg();
+      else if (strcmp(argv[i], "--exchange") == 0)
+        exchange = arg();
+      else if (strcmp(argv[i], "--format") == 0)
+        format = parse_tick_format(arg());
+      else if (strcmp(argv[i], "--interval") == 0)
+        interval = std::chrono::seconds(std::stol(arg()));
+      else if (strcmp(argv[i], "--from") == 0)
+        from = parse_date_arg(arg());
+      else if (strcmp(argv[i], "--upto") == 0)
+        upto = parse_date_arg(arg());
+      else
+        symbols.push_back(argv[i]);
+    }
+    if (tick_dir.empty())
+      THROW("provide the tick-data directory, --tickdata");
+    if (exchange.empty())
+      THROW("provide the exchange, --exchange");
+    if (from.empty())
+      THROW("provide the first day, --from");
+    if (symbols.empty())
+      THROW("provide the symbols to build bars for");
+    if (upto.empty())
+      upto = from;
+
+    Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+    for (auto date = from; date <= upto; date += std::chrono::hours(24))
+      for (auto& symbol : symbols) {
+        BarInputs inputs;
+        inputs.trades = tick_file(tick_dir, format, exchange, true, date, symbol);
+        inputs.top = tick_file(tick_dir, format, exchange, false, date, symbol);
+        if (inputs.trades.empty() && inputs.top.empty()) {
+          std::cout << date.strftime("%Y-%m-%d") << " " << symbol
+                    << ": no tick files" << std::endl;
+          continue;
+        }
+        auto dest = bar_file_path(tick_dir, interval, date, exchange, symbol);
+        auto count = build_bar_file(inputs, interval, dest);
+        std::cout << date.strftime("%Y-%m-%d") << " " << symbol << ": "
+                  << count << " bars, " << dest.string() << std::endl;
+      }
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
@@ -0,0 +1,130 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/BinaryLog.hpp>
+#include <apex/util/Error.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+
+/* Render a binary log file, as written with the logging "binary_file" option,
+ * in the same text format as the logger, and optionally filter it.
+ *
+ * usage: apex-logcat [-d] [--level LEVEL] [--grep TEXT] [--file NAME]
+ *                    [--thread TID] [--from TIME] [--upto TIME] FILE
+ *
+ * FILE may be "-" to read standard input; -d includes thread labels and
+ * source locations. */
+
+using namespace apex;
+
+struct Filter {
+  int mask = Logger::mask_levels_all();
+  std::string grep;
+  std::string file;
+  std::optional<int> tid;
+  std::optional<Time> from;
+  std::optional<Time> upto;
+
+  bool accept(const BinaryLogReader::Entry& entry) const
+  {
+    if (!(entry.lvl & mask))
+      return false;
+    if (tid && entry.tid != *tid)
+      return false;
+    if (from && entry.time < *from)
+      return false;
+    if (upto && !(entry.time < *upto))
+      return false;
+    if (!file.empty()) {
+      auto slash = entry.file.rfind('/');
+      auto name = slash == std::string_view::npos ? entry.file
+                                                  : entry.file.substr(slash + 1);
+      if (name != file)
+        return false;
+    }
+    if (!grep.empty() && entry.msg.find(grep) == std::string_view::npos)
+      return false;
+    return true;
+  }
+};
+
+
+int main(int argc, char** argv)
+{
+  try {
+    Filter filter;
+    bool detailed = false;
+    const char* fn = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "-d") == 0)
+        detailed = true;
+      else if (strcmp(argv[i], "--level") == 0)
+        filter.mask = Logger::mask_level_and_above(Logger::string_to_level(arg()));
+      else if (strcmp(argv[i], "--grep") == 0)
+        filter.grep = arg();
+      else if (strcmp(argv[i], "--file") == 0)
+        filter.file = arg();
+      else if (strcmp(argv[i], "--thread") == 0)
+        filter.tid = std::stoi(arg());
+      else if (strcmp(argv[i], "--from") == 0)
+        filter.from = Time(arg());
+      else if (strcmp(argv[i], "--upto") == 0)
+        filter.upto = Time(arg());
+      else if (!fn)
+        fn = argv[i];
+      else
+        THROW("unexpected argument " << QUOTE(argv[i]));
+    }
+    if (!fn)
+      THROW("provide name of binary log file");
+
+    std::ifstream file;
+    std::istream* is = &std::cin;
+    if (strcmp(fn, "-") != 0) {
+      file.open(fn, std::ios::binary);
+      if (!file)
+        THROW("cannot open " << QUOTE(fn));
+      is = &file;
+    }
+
+    BinaryLogReader reader(*is);
+    BinaryLogReader::Entry entry;
+    while (reader.next(entry)) {
+      if (filter.accept(entry))
+        Logger::render_line(std::cout, entry.time, entry.lvl, entry.tid,
+                            entry.thread_label, entry.msg, entry.file,
+                            entry.line, detailed);
+    }
+    std::cout.flush();
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
@@ -0,0 +1,102 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/Logger.hpp>
+#include <apex/core/StatusSegment.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/Time.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/* Print the bot status published by an engine to a shared memory segment,
+ * as configured by the "status" section of its config.  The segment is
+ * mapped read-only, so the engine is not affected, however often it is read.
+ *
+ * usage: apex-status [--watch MS] SHM_NAME
+ *
+ * With --watch the status is printed again every MS milliseconds. */
+
+using namespace apex;
+
+
+static void print_status(const StatusSegment& segment)
+{
+  std::cout << "engine pid " << segment.engine_pid() << ", published "
+            << segment.publish_count() << " times, last at "
+            << Time(std::chrono::microseconds(segment.published_us()))
+            << "\n";
+  std::cout << std::left << std::setw(12) << "strategy" << std::setw(24)
+            << "instrument" << std::right << std::setw(14) << "position"
+            << std::setw(12) << "pnl_usd" << std::setw(8) << "orders"
+            << std::setw(14) << "bid" << std::setw(14) << "ask"
+            << std::setw(14) << "last" << std::setw(8) << "alerts" << "\n";
+  BotStatus status;
+  for (size_t i = 0; i < segment.size(); i++) {
+    if (!segment.read(i, status))
+      continue;
+    std::cout << std::left << std::setw(12) << status.strategy_id
+              << std::setw(24) << status.instrument_id << std::right
+              << std::setw(14) << status.position << std::setw(12)
+              << status.pnl_usd << std::setw(8) << status.open_orders
+              << std::setw(14) << status.bid << std::setw(14) << status.ask
+              << std::setw(14) << status.last_price << std::setw(8)
+              << status.alerts << "\n";
+  }
+  std::cout.flush();
+}
+
+
+int main(int argc, char** argv)
+{
+  try {
+    const char* name = nullptr;
+    long watch_ms = 0;
+
+    for (int i = 1; i < argc; i++) {
+      if (strcmp(argv[i], "--watch") == 0) {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        watch_ms = std::stol(argv[++i]);
+      }
+      else if (!name)
+        name = argv[i];
+      else
+        THROW("unexpected argument " << QUOTE(argv[i]));
+    }
+    if (!name)
+      THROW("provide name of status segment");
+
+    auto segment = StatusSegment::open(name);
+    print_status(*segment);
+    while (watch_ms > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(watch_ms));
+      std::cout << "\n";
+      print_status(*segment);
+    }
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
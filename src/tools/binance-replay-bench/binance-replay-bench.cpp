@@ -0,0 +1,222 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <apex/core/Logger.hpp>
+#include <apex/gx/BinanceDecoder.hpp>
+#include <apex/gx/BinanceSession.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/infra/ssl.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/RawCapture.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/util/utils.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Replay captured Binance market-data frames, as written to the "market_data"
+ * segments of a raw capture (see raw_capture_dir), through a BinanceSession
+ * as fast as possible, to benchmark message handling on real traffic without
+ * a network connection.  Each frame takes the path of a live one: the raw
+ * decoders, or the json parser and on_websocket_msg, then the callbacks of
+ * subscribe_top and subscribe_trades, which the tool makes for every
+ * bookTicker and aggTrade stream found in the capture.  Frames of other
+ * streams are skipped.
+ *
+ * usage: binance-replay-bench [--json] [--passes N] PATH...
+ *
+ * PATH is a capture segment, or a directory whose market_data segments are
+ * replayed in order; --json sends every frame down the json path.  On
+ * passes after the first, bookTicker frames are dropped as stale, by their
+ * update ids, so those passes measure the filter rather than the delivery.
+ *
+ * Latency is the cost of each frame on the replaying thread, which stands in
+ * for the IO thread, in nanoseconds, by stream type; for the raw path that is
+ * decode and routing, and for the json path the parse.  The rate covers each
+ * pass until the last callback has run on the event thread.  Results are
+ * written as one JSON object per line. */
+
+using namespace apex;
+
+struct Frame {
+  std::string msg;
+  std::string type;
+};
+
+
+static std::vector<std::filesystem::path> segment_files(const char* arg)
+{
+  std::filesystem::path path(arg);
+  if (!std::filesystem::is_directory(path))
+    return {path};
+
+  std::vector<std::filesystem::path> files;
+  for (auto& entry : std::filesystem::directory_iterator(path))
+    if (entry.path().filename().string().rfind("market_data-", 0) == 0)
+      files.push_back(entry.path());
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+
+// Wait for everything already queued on the event loop to have run.
+static void sync_event_loop(RealtimeEventLoop& event_loop)
+{
+  std::promise<void> done;
+  event_loop.dispatch([&done]() { done.set_value(); });
+  done.get_future().wait();
+}
+
+
+int main(int argc, char** argv)
+{
+  try {
+    bool json_path = false;
+    int passes = 1;
+    std::vector<std::filesystem::path> files;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "--json") == 0)
+        json_path = true;
+      else if (strcmp(argv[i], "--passes") == 0)
+        passes = std::max(std::stoi(arg()), 1);
+      else
+        for (auto& file : segment_files(argv[i]))
+          files.push_back(file);
+    }
+    if (files.empty())
+      THROW("provide capture segments to replay");
+
+    Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+    // load every frame first, so that replay is not paced by the disk
+    std::vector<Frame> frames;
+    std::map<std::string, std::string> streams; // stream name, to its type
+    size_t skipped = 0;
+    RawCaptureReader::Record rec;
+    for (auto& file : files) {
+      RawCaptureReader reader(file);
+      while (reader.next(rec)) {
+        binance::StreamMessage msg;
+        if (!binance::decode_stream_message(rec.msg, msg)) {
+          skipped++;
+          continue;
+        }
+        auto at = msg.stream.find('@');
+        std::string type(msg.stream.substr(at == std::string_view::npos
+                                               ? msg.stream.size()
+                                               : at + 1));
+        if (type != "bookTicker" && type != "aggTrade") {
+          skipped++;
+          continue;
+        }
+        streams.emplace(msg.stream, type);
+        frames.push_back({std::move(rec.msg), std::move(type)});
+      }
+    }
+    if (frames.empty())
+      THROW("no bookTicker or aggTrade frames found");
+
+    RealtimeEventLoop event_loop([]() { return true; });
+    IoLoop ioloop;
+    SslContext ssl(SslConfig(true));
+
+    BinanceSession::Params params;
+    params.http_warm_connections = 0;
+    auto session = std::make_shared<BinanceSession>(
+        BaseExchangeSession::EventCallbacks{}, params, RunMode::paper, &ioloop,
+        event_loop, &ssl);
+
+    // callbacks run on the event thread, so the counts are read after a sync
+    uint64_t callbacks = 0;
+    for (auto& [stream, type] : streams) {
+      Symbol symbol;
+      symbol.native = str_toupper(stream.substr(0, stream.find('@')));
+      if (type == "bookTicker")
+        session->subscribe_top(symbol, subscription_options(),
+                               [&callbacks](const TickTop&) { callbacks++; });
+      else
+        session->subscribe_trades(
+            symbol, subscription_options(StreamType::AggTrades),
+            [&callbacks](const TickTrade&) { callbacks++; });
+    }
+    sync_event_loop(event_loop);
+
+    std::map<std::string, LatencyHistogram> latency;
+    for (auto& frame : frames)
+      latency[frame.type];
+
+    uint64_t replayed = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (int pass = 0; pass < passes; pass++) {
+      for (auto& frame : frames) {
+        const auto start = std::chrono::steady_clock::now();
+        session->replay_md_frame(frame.msg, json_path);
+        const auto end = std::chrono::steady_clock::now();
+        latency[frame.type].record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                .count());
+      }
+      replayed += frames.size();
+    }
+    sync_event_loop(event_loop);
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const char* path = json_path ? "json" : "raw";
+    for (auto& [type, histogram] : latency) {
+      auto snap = histogram.snapshot();
+      std::cout << "{\"bench\":\"binance_replay\",\"path\":\"" << path
+                << "\",\"type\":\"" << type << "\",\"messages\":" << snap.count
+                << ",\"mean_ns\":" << static_cast<uint64_t>(snap.mean())
+                << ",\"p50_ns\":" << snap.value_at(0.5)
+                << ",\"p99_ns\":" << snap.value_at(0.99)
+                << ",\"p999_ns\":" << snap.value_at(0.999)
+                << ",\"max_ns\":" << snap.max << "}" << std::endl;
+    }
+
+    const double secs = std::chrono::duration<double>(t1 - t0).count();
+    std::cout << "{\"bench\":\"binance_replay\",\"path\":\"" << path
+              << "\",\"type\":\"all\",\"streams\":" << streams.size()
+              << ",\"messages\":" << replayed << ",\"callbacks\":" << callbacks
+              << ",\"skipped\":" << skipped << ",\"msgs_per_sec\":"
+              << static_cast<uint64_t>(replayed / secs) << "}" << std::endl;
+
+    session.reset();
+    event_loop.sync_stop();
+    ioloop.sync_stop();
+    return 0;
+  }
+  catch (std::exception& e) {
+    std::cout << "error: " << e.what() << std::endl;
+  }
+
+  return 1;
+}
@@ -0,0 +1,707 @@
+/* Copyright 2024 Automated Algo (www.automatedalgo.com)
+
+This file is part of Automated Algo's "Apex" project.
+
+Apex is free software: you can redistribute it and/or modify it under the terms
+of the GNU Lesser General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later
+version.
+
+Apex is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License along
+with Apex. If not, see <https://www.gnu.org/licenses/>.
+*/
+/* Replay-driven load generator for a GX server.  Captured tick files, read
+ * with the tickbin and Tardis file readers, are replayed by an exchange
+ * session standing in for the venue, at their recorded pace scaled by a speed
+ * factor, or as fast as possible; so the server sees the bursts of a real
+ * market rather than a uniform rate.  A number of simulated engines, each
+ * with its own IO and event threads and GX client session, subscribe to the
+ * replayed symbols.  Each file can be replayed as several symbols, to scale
+ * the symbol count while keeping the burst shape.
+ *
+ * The server event loop is owned by the tool, as for an embedded gateway, so
+ * that its queue can be reported.  Tick latency is the time from a tick
+ * leaving the replay to it being applied at an engine, so covers the server
+ * event loop, encoding and fan-out, the GX transport and the engine event
+ * loop; it is only measured with the binary encoding, which carries the
+ * trace stamps.  Each interval, and at the end of the run, the tool writes
+ * the ticks replayed and received, the latency, the deepest event queues and
+ * the process CPU use; ticks received short of those sent show conflation by
+ * the server of slow consumers.
+ *
+ * Usage: gx-replay-load CONFIG, where CONFIG is a JSON file:
+ *
+ *   {
+ *     "files": [                    // replayed together, in time order
+ *       {"path": "BTCUSDT.bin", "format": "tickbin", "stream": "aggtrades",
+ *        "symbol": "BTCUSDT"},
+ *       {"path": "binance_book_snapshot_5_2024-02-01_BTCUSDT.csv.gz",
+ *        "format": "tardis", "stream": "top", "symbol": "BTCUSDT"}
+ *     ],
+ *     "from": "2024-02-01T10:00:00", // optional start time within the files
+ *     "speed": 1,                   // multiple of the recorded pace; 0 or "max"
+ *     "seconds": 0,                 // replay duration limit; 0 for none
+ *     "symbol_copies": 1,           // symbols each file is replayed as
+ *     "engines": 4,                 // simulated engines
+ *     "symbols_per_engine": 0,      // symbols each subscribes to; 0 for all
+ *     "interval_seconds": 1,        // reporting interval
+ *     "read_ahead": true,           // parse Tardis files on a background thread
+ *     "gx": {},                     // GxServer config, eg "batching", "shm"
+ *     "gateway": {}                 // engine session config, "binary", "shm"
+ *   }
+ *
+ * Tickbin streams are "trades", "aggtrades" or "top", and Tardis streams
+ * "trades", or "top" for a book_snapshot_5 file.  Copies of a symbol beyond
+ * the first are named with a suffix, eg "BTCUSDT_1".  Latencies are
+ * nanoseconds.  Results are written as one JSON object per line. */
+
+#include <apex/backtest/TardisFileReader.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
+#include <apex/comm/GxClientSession.hpp>
+#include <apex/core/Errors.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/gx/ExchangeSession.hpp>
+#include <apex/gx/GxServer.hpp>
+#include <apex/infra/IoLoop.hpp>
+#include <apex/model/MarketData.hpp>
+#include <apex/util/Config.hpp>
+#include <apex/util/LatencyHistogram.hpp>
+#include <apex/util/LatencyTrace.hpp>
+#include <apex/util/RealtimeEventLoop.hpp>
+#include <apex/util/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace apex;
+
+
+/* Exchange session publishing replayed ticks.  Subscriptions are made, and
+ * ticks delivered, on the server event loop; ticks are published from the
+ * replay thread. */
+class ReplayExchange : public ExchangeSession<ReplayExchange>
+{
+public:
+  ReplayExchange(EventCallbacks callbacks, IoLoop* ioloop,
+                 RealtimeEventLoop& event_loop,
+                 const std::vector<std::string>& symbols)
+    : ExchangeSession(std::move(callbacks), ExchangeId::binance,
+                      RunMode::live, ioloop, event_loop, nullptr),
+      _targets(symbols.size()),
+      _published(symbols.size())
+  {
+    for (size_t i = 0; i < symbols.size(); i++)
+      _symbol_ids[symbols[i]] = i;
+  }
+
+  void start() override {}
+
+  void subscribe_account(
+      std::function<void(std::vector<AccountUpdate>)>) override
+  {
+  }
+
+  void subscribe_trades(Symbol symbol, subscription_options,
+                        std::function<void(const TickTrade&)> callback) override
+  {
+    if (auto* target = find_target(symbol.native)) {
+      target->on_trade = std::move(callback);
+      _subscribed++;
+    }
+  }
+
+  void subscribe_top(Symbol symbol, subscription_options,
+                     std::function<void(const TickTop&)> callback) override
+  {
+    if (auto* target = find_target(symbol.native))
+      target->on_top = std::move(callback);
+  }
+
+  void submit_order(OrderParams, SubmitOrderCallbacks callbacks) override
+  {
+    callbacks.on_rejected(error::e0102, "replay does not accept orders");
+  }
+
+  void cancel_order(std::string, std::string, std::string,
+                    SubmitOrderCallbacks callbacks) override
+  {
+    callbacks.on_rejected(error::e0103, "order not found");
+  }
+
+  /* Hand a tick of a symbol to the server event loop, as a decoded exchange
+   * message is; called on the replay thread. */
+  template <typename T> void publish(size_t symbol_id, T tick)
+  {
+    tick.trace = trace::tracer().receive();
+    _published[symbol_id].fetch_add(1, std::memory_order_relaxed);
+    run_on_evloop([symbol_id, tick](ReplayExchange* self) {
+      auto& target = self->_targets[symbol_id];
+      if constexpr (std::is_same_v<T, TickTrade>) {
+        if (target.on_trade)
+          target.on_trade(tick);
+      } else {
+        if (target.on_top)
+          target.on_top(tick);
+      }
+    });
+  }
+
+  [[nodiscard]] size_t subscribed_count() const { return _subscribed; }
+
+  [[nodiscard]] uint64_t published(size_t symbol_id) const
+  {
+    return _published[symbol_id].load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Target {
+    std::function<void(const TickTrade&)> on_trade;
+    std::function<void(const TickTop&)> on_top;
+  };
+
+  Target* find_target(const std::string& symbol)
+  {
+    auto iter = _symbol_ids.find(symbol);
+    if (iter == _symbol_ids.end()) {
+      LOG_WARN("replay has no symbol " << QUOTE(symbol));
+      return nullptr;
+    }
+    return &_targets[iter->second];
+  }
+
+  std::map<std::string, size_t> _symbol_ids; // fixed once constructed
+  std::vector<Target> _targets;            // event loop only
+  std::vector<std::atomic<uint64_t>> _published;
+  std::atomic<size_t> _subscribed{0};
+};
+
+
+/* One replayed file.  Its reader applies events to a MarketData, from which
+ * each tick is rebuilt and published as every copy of the symbol. */
+class ReplayStream : public MarketData::Listener
+{
+public:
+  ReplayStream(Config file, bool read_ahead)
+  {
+    const auto path = file.get_string("path");
+    const auto format = file.get_string("format", "tickbin");
+    const auto stream = file.get_string("stream", "trades");
+    symbol = file.get_string("symbol");
+
+    if (stream != "trades" && stream != "aggtrades" && stream != "top")
+      throw std::runtime_error("unknown stream '" + stream + "' for " + path);
+    _trades = stream != "top";
+
+    if (format == "tickbin") {
+      auto type = stream == "top"     ? MdStream::L1
+                  : stream == "trades" ? MdStream::Trades
+                                       : MdStream::AggTrades;
+      _reader = std::make_unique<TickbinFileReader>(path, &_market, type);
+    } else if (format == "tardis") {
+      if (stream == "aggtrades")
+        throw std::runtime_error("Tardis files do not hold aggtrades: " + path);
+      _reader = std::make_unique<TardisFileReader>(
+          path, &_market, _trades ? MdStream::Trades : MdStream::L1,
+          _trades ? TardisFileReader::DataType::trades
+                  : TardisFileReader::DataType::book_snapshot_5,
+          read_ahead);
+    } else {
+      throw std::runtime_error("unknown format '" + format + "' for " + path);
+    }
+    _market.add_listener(this, _trades ? MarketData::EventType::trade
+                                       : MarketData::EventType::top);
+  }
+
+  ~ReplayStream() override { _market.remove_listener(this); }
+
+  void attach(ReplayExchange* exchange, std::vector<size_t> symbol_ids)
+  {
+    _exchange = exchange;
+    _symbol_ids = std::move(symbol_ids);
+  }
+
+  void on_market_event(MarketData::EventType) override
+  {
+    if (_trades) {
+      for (auto id : _symbol_ids)
+        _exchange->publish(id, _market.last());
+    } else {
+      TickTop tick;
+      tick.bid_price = _market.l1_bid().price;
+      tick.bid_qty = _market.l1_bid().qty;
+      tick.ask_price = _market.l1_ask().price;
+      tick.ask_qty = _market.l1_ask().qty;
+      for (auto id : _symbol_ids)
+        _exchange->publish(id, tick);
+    }
+  }
+
+  BaseTickFileReader& reader() { return *_reader; }
+
+  std::string symbol;
+
+private:
+  bool _trades = true;
+  MarketData _market;
+  std::unique_ptr<BaseTickFileReader> _reader;
+  ReplayExchange* _exchange = nullptr;
+  std::vector<size_t> _symbol_ids;
+};
+
+
+/* Counters shared between the replay thread and the reporting thread. */
+struct ReplayProgress {
+  std::atomic<uint64_t> events{0};
+  std::atomic<uint64_t> lag_max_us{0}; // since last reset
+  std::atomic<bool> done{false};
+};
+
+
+/* Consume events of all streams in time order.  With a positive speed each is
+ * released when due, relative to the first event, and the lateness of those
+ * released late is recorded; otherwise they are released immediately. */
+static void replay(std::vector<std::unique_ptr<ReplayStream>>& streams,
+                   double speed, std::chrono::seconds limit,
+                   ReplayProgress& progress)
+{
+  const auto start = std::chrono::steady_clock::now();
+  const auto deadline = limit.count() ? start + limit
+                                      : std::chrono::steady_clock::time_point::max();
+  int64_t first_us = -1;
+
+  while (true) {
+    ReplayStream* next = nullptr;
+    for (auto& stream : streams)
+      if (stream->reader().has_next_event() &&
+          (!next || stream->reader().next_event_time() <
+                        next->reader().next_event_time()))
+        next = stream.get();
+    if (!next)
+      break;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now > deadline)
+      break;
+
+    if (speed > 0) {
+      const int64_t event_us =
+          next->reader().next_event_time().as_epoch_us().count();
+      if (first_us < 0)
+        first_us = event_us;
+      const auto due = start + std::chrono::microseconds(static_cast<int64_t>(
+                                   (event_us - first_us) / speed));
+      if (due > now) {
+        std::this_thread::sleep_until(due);
+      } else {
+        const auto lag = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - due)
+                .count());
+        if (lag > progress.lag_max_us.load(std::memory_order_relaxed))
+          progress.lag_max_us.store(lag, std::memory_order_relaxed);
+      }
+    }
+
+    next->reader().consume_next_event();
+    progress.events.fetch_add(1, std::memory_order_relaxed);
+  }
+  progress.done = true;
+}
+
+
+/* A simulated engine: its own IO and event threads, and a GX client session
+ * subscribed to a set of symbols. */
+class Engine
+{
+public:
+  Engine(Config gateway, const std::string& port,
+         const std::vector<std::string>& symbols, std::vector<size_t> ids)
+    : symbol_ids(std::move(ids))
+  {
+    RealtimeEventLoop::Options options;
+    options.instrument = true;
+    _evloop = std::make_unique<RealtimeEventLoop>(options,
+                                                  [] { return false; });
+    _ioloop = std::make_unique<IoLoop>();
+
+    _session = std::make_shared<GxClientSession>(*_ioloop, *_evloop,
+                                                 "127.0.0.1", port, nullptr);
+    _session->set_binary_encoding(gateway.get_bool("binary", true));
+    auto shm_config = gateway.get_sub_config("shm", Config::empty_config());
+    GxClientSession::ShmOptions shm;
+    shm.enabled = shm_config.get_bool("enabled", true);
+    shm.poll = shm_config.get_bool("poll", false);
+    shm.ring_size = shm_config.get_uint("ring_kb", shm.ring_size / 1024) * 1024;
+    _session->set_shm_options(shm);
+
+    for (auto id : symbol_ids) {
+      auto market = std::make_unique<MarketData>();
+      auto* md = market.get();
+      md->subscribe_events(
+          [this, md](MarketData::EventType) { on_tick(md->last_trace()); });
+      _session->subscribe(symbols[id], ExchangeId::binance, md);
+      _markets.push_back(std::move(market));
+    }
+    _session->start_connecting();
+  }
+
+  ~Engine()
+  {
+    _ioloop->sync_stop();
+    _evloop->sync_stop();
+    _session.reset();
+  }
+
+  [[nodiscard]] bool is_connected() { return _session->is_connected(); }
+
+  [[nodiscard]] uint64_t received() const
+  {
+    return _received.load(std::memory_order_relaxed);
+  }
+
+  LatencyHistogram::Snapshot latency(bool reset) { return _latency.snapshot(reset); }
+
+  EventLoopStats loop_stats(bool reset) { return _evloop->stats(reset); }
+
+  const std::vector<size_t> symbol_ids;
+
+  // accumulated by the reporting thread
+  LatencyHistogram::Snapshot total_latency;
+  size_t queue_depth_hwm = 0;
+
+private:
+  // event thread
+  void on_tick(const trace::Stamp& stamp)
+  {
+    _received.fetch_add(1, std::memory_order_relaxed);
+    if (stamp.is_traced()) {
+      auto now = trace::now_ns();
+      _latency.record(now > stamp.rt ? now - stamp.rt : 0);
+    }
+  }
+
+  std::unique_ptr<RealtimeEventLoop> _evloop;
+  std::unique_ptr<IoLoop> _ioloop;
+  std::vector<std::unique_ptr<MarketData>> _markets;
+  std::shared_ptr<GxClientSession> _session;
+  LatencyHistogram _latency;
+  std::atomic<uint64_t> _received{0};
+};
+
+
+static double process_cpu_seconds()
+{
+  rusage usage{};
+  ::getrusage(RUSAGE_SELF, &usage);
+  auto secs = [](const timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+  return secs(usage.ru_utime) + secs(usage.ru_stime);
+}
+
+
+static std::string latency_fields(const LatencyHistogram::Snapshot& snap)
+{
+  std::ostringstream oss;
+  oss << "\"samples\":" << snap.count << ",\"p50_ns\":" << snap.value_at(0.5)
+      << ",\"p99_ns\":" << snap.value_at(0.99)
+      << ",\"p999_ns\":" << snap.value_at(0.999) << ",\"max_ns\":" << snap.max;
+  return oss.str();
+}
+
+
+template <typename F>
+static bool wait_for(F condition, std::chrono::seconds timeout)
+{
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!condition()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return true;
+}
+
+
+int main(int argc, char** argv)
+{
+  if (argc != 2) {
+    std::cerr << "usage: " << argv[0] << " CONFIG" << std::endl;
+    return 1;
+  }
+
+  Logger::instance().set_mask(Logger::mask_level_and_above(Logger::warn));
+
+  try {
+    Config config{read_json_config_file(argv[1])};
+
+    const json& raw = config.raw();
+    double speed = 1.0;
+    if (raw.contains("speed"))
+      speed = raw["speed"].is_string() && raw["speed"] == "max"
+                  ? 0.0
+                  : raw["speed"].get<double>();
+    const auto limit = std::chrono::seconds(config.get_uint("seconds", 0));
+    const size_t copies = std::max<uint64_t>(config.get_uint("symbol_copies", 1), 1);
+    const size_t engine_count = config.get_uint("engines", 4);
+    const size_t interval_secs =
+        std::max<uint64_t>(config.get_uint("interval_seconds", 1), 1);
+    const bool read_ahead = config.get_bool("read_ahead", true);
+    if (speed < 0)
+      throw std::runtime_error("speed must not be negative");
+
+    // streams, and the symbols they are published as
+    auto files = config.get_sub_config("files");
+    std::vector<std::unique_ptr<ReplayStream>> streams;
+    for (size_t i = 0; i < files.array_size(); i++)
+      streams.push_back(
+          std::make_unique<ReplayStream>(files.array_item(i), read_ahead));
+    if (streams.empty())
+      throw std::runtime_error("no files to replay");
+    if (config.contains("from")) {
+      Time from{config.get_string("from")};
+      for (auto& stream : streams)
+        stream->reader().wind_forward(from);
+    }
+
+    std::vector<std::string> symbols;
+    std::map<std::string, size_t> symbol_ids;
+    std::vector<std::vector<size_t>> stream_ids(streams.size());
+    for (size_t i = 0; i < streams.size(); i++)
+      for (size_t copy = 0; copy < copies; copy++) {
+        auto name = streams[i]->symbol;
+        if (copy)
+          name += "_" + std::to_string(copy);
+        auto ins = symbol_ids.insert({name, symbols.size()});
+        if (ins.second)
+          symbols.push_back(name);
+        stream_ids[i].push_back(ins.first->second);
+      }
+
+    trace::tracer().enable(true);
+
+    // the server, on an event loop of our own, so that it can be reported
+    RealtimeEventLoop::Options server_options;
+    server_options.instrument = true;
+    auto server_loop = std::make_unique<RealtimeEventLoop>(
+        server_options, [] { return false; });
+
+    json gx_config = config.get_sub_config("gx", Config::empty_config()).raw();
+    if (gx_config.is_null())
+      gx_config = json::object();
+    auto server = std::make_unique<GxServer>(server_loop.get(), RunMode::live,
+                                             Config{gx_config});
+
+    std::shared_ptr<ReplayExchange> exchange;
+    server->add_venue([&](BaseExchangeSession::EventCallbacks callbacks,
+                          IoLoop* ioloop, RealtimeEventLoop& event_loop) {
+      exchange = std::make_shared<ReplayExchange>(std::move(callbacks), ioloop,
+                                                  event_loop, symbols);
+      return exchange;
+    });
+    for (size_t i = 0; i < streams.size(); i++)
+      streams[i]->attach(exchange.get(), stream_ids[i]);
+    server->start();
+
+    // engines, each subscribing to a window of the symbols, spread evenly
+    auto gateway = config.get_sub_config("gateway", Config::empty_config());
+    size_t per_engine = config.get_uint("symbols_per_engine", 0);
+    if (per_engine == 0 || per_engine > symbols.size())
+      per_engine = symbols.size();
+    std::vector<bool> wanted(symbols.size());
+    std::vector<std::unique_ptr<Engine>> engines;
+    for (size_t e = 0; e < engine_count; e++) {
+      std::vector<size_t> ids;
+      for (size_t k = 0; k < per_engine; k++) {
+        auto id = (e * per_engine + k) % symbols.size();
+        ids.push_back(id);
+        wanted[id] = true;
+      }
+      engines.push_back(std::make_unique<Engine>(
+          gateway, std::to_string(server->get_listen_port()), symbols,
+          std::move(ids)));
+    }
+
+    const auto wanted_count =
+        static_cast<size_t>(std::count(wanted.begin(), wanted.end(), true));
+    if (!wait_for(
+            [&] {
+              return exchange->subscribed_count() == wanted_count &&
+                     std::all_of(engines.begin(), engines.end(),
+                                 [](auto& e) { return e->is_connected(); });
+            },
+            std::chrono::seconds(30)))
+      throw std::runtime_error("engines did not subscribe to the GX server");
+
+    // subscriptions of later engines to symbols already subscribed by the
+    // exchange are not observable; allow them time to complete
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto expected = [&](const Engine& engine) {
+      uint64_t total = 0;
+      for (auto id : engine.symbol_ids)
+        total += exchange->published(id);
+      return total;
+    };
+    auto published = [&] {
+      uint64_t total = 0;
+      for (size_t id = 0; id < symbols.size(); id++)
+        total += exchange->published(id);
+      return total;
+    };
+    auto received = [&] {
+      uint64_t total = 0;
+      for (auto& engine : engines)
+        total += engine->received();
+      return total;
+    };
+
+    ReplayProgress progress;
+    const auto start = std::chrono::steady_clock::now();
+    const double cpu_start = process_cpu_seconds();
+    std::thread replay_thread(
+        [&] { replay(streams, speed, limit, progress); });
+
+    std::ostringstream run_desc;
+    run_desc << "\"speed\":" << speed << ",\"engines\":" << engine_count
+             << ",\"symbols\":" << symbols.size()
+             << ",\"symbols_per_engine\":" << per_engine;
+
+    LatencyHistogram::Snapshot total_latency;
+    size_t server_hwm = 0;
+    uint64_t lag_max_us = 0;
+    uint64_t last_events = 0, last_published = 0, last_received = 0;
+    double last_cpu = cpu_start;
+    auto last_time = start;
+
+    // the final report, once drained, is skipped if nothing arrived since
+    // the last; its short interval would only distort the rates
+    auto report_interval = [&](bool final_report) {
+      const auto now = std::chrono::steady_clock::now();
+      const double cpu = process_cpu_seconds();
+      const double wall = std::chrono::duration<double>(now - last_time).count();
+      const uint64_t events = progress.events, sent = published(),
+                     recv = received();
+      const uint64_t lag = progress.lag_max_us.exchange(0);
+      lag_max_us = std::max(lag_max_us, lag);
+
+      LatencyHistogram::Snapshot latency;
+      size_t engine_hwm = 0;
+      for (auto& engine : engines) {
+        auto snap = engine->latency(true);
+        engine->total_latency.merge(snap);
+        latency.merge(snap);
+        auto stats = engine->loop_stats(true);
+        engine->queue_depth_hwm =
+            std::max(engine->queue_depth_hwm, stats.queue_depth_hwm);
+        engine_hwm = std::max(engine_hwm, stats.queue_depth_hwm);
+      }
+      total_latency.merge(latency);
+      auto server_stats = server_loop->stats(true);
+      server_hwm = std::max(server_hwm, server_stats.queue_depth_hwm);
+      if (final_report && events == last_events && recv == last_received)
+        return;
+
+      std::cout << "{\"bench\":\"gx_replay_load_interval\"," << run_desc.str()
+                << ",\"t\":"
+                << std::chrono::duration<double>(now - start).count()
+                << ",\"events\":" << events - last_events
+                << ",\"ticks\":" << sent - last_published
+                << ",\"received\":" << recv - last_received
+                << ",\"cpu_pct\":"
+                << (wall > 0 ? 100.0 * (cpu - last_cpu) / wall : 0.0)
+                << ",\"replay_lag_max_us\":" << lag
+                << ",\"server_queue_p99_ns\":"
+                << server_stats.queue_latency.value_at(0.99)
+                << ",\"server_queue_hwm\":" << server_stats.queue_depth_hwm
+                << ",\"engine_queue_hwm\":" << engine_hwm << ","
+                << latency_fields(latency) << "}" << std::endl;
+
+      last_events = events;
+      last_published = sent;
+      last_received = recv;
+      last_cpu = cpu;
+      last_time = now;
+    };
+
+    auto next_report = start + std::chrono::seconds(interval_secs);
+    while (!progress.done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      if (std::chrono::steady_clock::now() >= next_report) {
+        report_interval(false);
+        next_report += std::chrono::seconds(interval_secs);
+      }
+    }
+    replay_thread.join();
+    const auto replay_end = std::chrono::steady_clock::now();
+
+    // wait for the engines to drain, unless ticks stop arriving
+    uint64_t seen = received();
+    auto last_progress = std::chrono::steady_clock::now();
+    wait_for([&] {
+      uint64_t want = 0;
+      for (auto& engine : engines)
+        want += expected(*engine);
+      auto recv = received();
+      auto now = std::chrono::steady_clock::now();
+      if (recv != seen) {
+        seen = recv;
+        last_progress = now;
+      }
+      return recv >= want || now - last_progress > std::chrono::seconds(1);
+    }, std::chrono::seconds(10));
+    report_interval(true);
+
+    const double replay_secs =
+        std::chrono::duration<double>(replay_end - start).count();
+    uint64_t want = 0;
+    for (auto& engine : engines) {
+      const auto engine_expected = expected(*engine);
+      want += engine_expected;
+      std::cout << "{\"bench\":\"gx_replay_load_engine\"," << run_desc.str()
+                << ",\"engine\":" << (&engine - &engines[0])
+                << ",\"expected\":" << engine_expected
+                << ",\"received\":" << engine->received()
+                << ",\"queue_hwm\":" << engine->queue_depth_hwm << ","
+                << latency_fields(engine->total_latency) << "}" << std::endl;
+    }
+    std::cout << "{\"bench\":\"gx_replay_load\"," << run_desc.str()
+              << ",\"events\":" << progress.events
+              << ",\"ticks\":" << published() << ",\"expected\":" << want
+              << ",\"received\":" << received()
+              << ",\"seconds\":" << replay_secs << ",\"events_per_sec\":"
+              << static_cast<uint64_t>(progress.events / replay_secs)
+              << ",\"cpu_pct\":"
+              << 100.0 * (process_cpu_seconds() - cpu_start) /
+                     std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()
+              << ",\"replay_lag_max_us\":" << lag_max_us
+              << ",\"server_queue_hwm\":" << server_hwm << ","
+              << latency_fields(total_latency) << "}" << std::endl;
+
+    engines.clear();
+    server_loop->sync_stop();
+    server.reset();
+    server_loop.reset();
+    streams.clear();
+  }
+  catch (std::exception& e) {
+    std::cerr << "error: " << e.what() << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -15,87 +15,536 @@ You should have received a copy of the GNU Lesser General Public License along
 with Apex. If not, see <https://www.gnu.org/licenses/>.
 */
 
-#include <apex/core/Bot.hpp>
-#include <apex/core/GatewayService.hpp>
-#include <apex/core/Strategy.hpp>
-#include <apex/core/MarketDataService.hpp>
-#include <apex/gx/GxServer.hpp>
-#include <apex/util/BacktestEventLoop.hpp>
+#include <apex/backtest/TickFileCache.hpp>
+#include <apex/backtest/TickbinFileReader.hpp>
 #include <apex/backtest/TickbinMsgs.hpp>
-#include <apex/util/json.hpp>
+#include <apex/core/Logger.hpp>
+#include <apex/util/Error.hpp>
+#include <apex/util/Time.hpp>
 
+#include <zlib.h>
+
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
 
-#include <unistd.h>
-#include <errno.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <sys/mman.h>
+/* Print, or summarise, the ticks held in a tickbin file, raw, compressed or
+ * delta encoded.
+ * The file is read directly through a memory mapping, and the time index is
+ * used to seek to the start of the range.
+ *
+ * usage: ticktail [-f] [--from TIME] [--to TIME] [--type l1|trade]
+ *                 [--side buy|sell] [--min-qty QTY] [--stats] [--gap SECS]
+ *                 [--interval SECS] FILE
+ *
+ * -f follows a file still being written by the tick collector, polling for
+ * new records; --stats prints a summary of tick rates, gaps and spreads
+ * instead of the ticks, and in follow mode prints one every --interval
+ * seconds; --gap sets the shortest interval between ticks reported as a
+ * gap.  --side and --min-qty select trades only. */
 
-/* This uses the Bot class to just print the tick-data, so that we can quickly
-   view the ticks contained without our tick-data files.
-*/
-class TickBot : public apex::Bot
+using namespace apex;
+namespace fs = std::filesystem;
+
+struct Options {
+  bool follow = false;
+  bool stats = false;
+  std::optional<Time> from;
+  std::optional<Time> to;
+  int type = 0; // a tickbin::MsgType, or zero for all
+  char side = 0;
+  double min_qty = 0;
+  std::chrono::microseconds gap = std::chrono::seconds(1);
+  std::chrono::seconds interval = std::chrono::seconds(10);
+};
+
+
+/* Buffered output of tick lines, formatted without iostreams, so that a
+ * full day of ticks can be written in a few seconds. */
+class Printer
 {
 public:
+  ~Printer() { flush(); }
 
-  std::chrono::seconds _order_lifetime = std::chrono::seconds{60};
-  TickBot(apex::Strategy* strategy, const apex::Instrument& instrument)
-    : apex::Bot("", strategy, instrument) {}
+  void print(const tickbin::FullMsg<tickbin::TickLevel1>& msg)
+  {
+    append_time(msg.head.capture_time);
+    _buf.append(" L1 bid ");
+    append(msg.body.bid_price);
+    _buf.append(" x ");
+    append(msg.body.bid_qty);
+    _buf.append(" ask ");
+    append(msg.body.ask_price);
+    _buf.append(" x ");
+    append(msg.body.ask_qty);
+    end_line();
+  }
 
+  void print(const tickbin::FullMsg<tickbin::TickAggTrade>& msg)
+  {
+    append_time(msg.head.capture_time);
+    _buf.append(" TR ");
+    _buf.append(to_string(tickbin::Serialiser::decode_side(msg.body.side)));
+    _buf.push_back(' ');
+    append(msg.body.price);
+    _buf.append(" x ");
+    append(msg.body.qty);
+    end_line();
+  }
 
-  void dump_market_data() {
-    std::ostringstream oss;
-    oss << ticker()
-        << " bid: " << market().bid()
-        << ", ask: " << market().ask()
-        << ", last: " << market().last();
-    LOG_INFO(oss.str());
+  void flush()
+  {
+    fwrite(_buf.data(), 1, _buf.size(), stdout);
+    fflush(stdout);
+    _buf.clear();
   }
 
-  void on_timer() override
+private:
+  void append(double value)
   {
-    dump_market_data();
+    char tmp[32];
+    auto result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+    _buf.append(tmp, result.ptr);
   }
 
-  void on_tick_trade(apex::MarketData::EventType) override {
-    LOG_INFO(ticker() << ": trade " << last_price());
+  // the date and time is only formatted when the second changes
+  void append_time(uint64_t usec)
+  {
+    uint64_t sec = usec / 1000000;
+    if (sec != _sec || _sec_text.empty()) {
+      _sec = sec;
+      _sec_text = Time(std::chrono::seconds(sec)).strftime("%Y-%m-%dT%H:%M:%S");
+    }
+    char frac[8];
+    snprintf(frac, sizeof(frac), ".%06u", static_cast<unsigned>(usec % 1000000));
+    _buf.append(_sec_text);
+    _buf.append(frac);
+  }
+
+  void end_line()
+  {
+    _buf.push_back('\n');
+    if (_buf.size() >= (1 << 16))
+      flush();
   }
+
+  std::string _buf;
+  uint64_t _sec = 0;
+  std::string _sec_text;
 };
 
 
-int main()
+class Stats
 {
-  try {
-    // backtest time range
-    apex::Time from{"2024-02-01T00:00:00"};
-    apex::Time upto{"2024-02-03"};
+public:
+  explicit Stats(std::chrono::microseconds gap) : _gap(gap.count()) {}
+
+  void add(const tickbin::Header& head)
+  {
+    auto t = head.capture_time;
+    if (_count == 0)
+      _first = t;
+    else if (t >= _last + _gap) {
+      _gaps++;
+      if (t - _last > _max_gap) {
+        _max_gap = t - _last;
+        _max_gap_at = _last;
+      }
+    }
+    _last = t;
+    _count++;
+
+    if (t / 1000000 != _sec) {
+      _sec = t / 1000000;
+      _sec_count = 0;
+    }
+    _max_per_sec = std::max(_max_per_sec, ++_sec_count);
+  }
 
-    // create core engine, configured for backtest
-    auto services = apex::Services::create(apex::RunMode::backtest, {from, upto});
+  void add(const tickbin::FullMsg<tickbin::TickLevel1>& msg)
+  {
+    add(msg.head);
+    _l1++;
+    auto spread = msg.body.ask_price - msg.body.bid_price;
+    if (spread <= 0)
+      _crossed++;
+    _spread_min = std::min(_spread_min, spread);
+    _spread_max = std::max(_spread_max, spread);
+    _spread_sum += spread;
+  }
 
-    // ----- Strategy -----
+  void add(const tickbin::FullMsg<tickbin::TickAggTrade>& msg)
+  {
+    add(msg.head);
+    _trades++;
+    _volume += msg.body.qty;
+  }
 
-    // create a Strategy object, which is a container for individual Bots
-    apex::Strategy strategy(services, "ticks");
+  void print() const
+  {
+    std::cout << "ticks: " << _count << " (l1 " << _l1 << ", trades " << _trades
+              << ")\n";
+    if (_count == 0)
+      return;
 
-    // add a bot to the strategy, responsible for trading a single name
-    strategy.create_bot<TickBot>(
-      apex::InstrumentQuery("BTCUSDT", apex::ExchangeId::binance));
-    strategy.create_bot<TickBot>(
-      apex::InstrumentQuery("ETHUSDT", apex::ExchangeId::binance));
+    auto secs = (_last - _first) / 1e6;
+    std::cout << "range: " << Time(std::chrono::microseconds(_first)).as_iso8601(Time::Resolution::micro)
+              << " to " << Time(std::chrono::microseconds(_last)).as_iso8601(Time::Resolution::micro)
+              << " (" << secs << " secs)\n";
+    std::cout << "rate: " << (secs > 0 ? _count / secs : 0) << " ticks/sec, max "
+              << _max_per_sec << " in one sec\n";
+    std::cout << "gaps: " << _gaps << " of " << _gap / 1e6 << " secs or more";
+    if (_gaps)
+      std::cout << ", longest " << _max_gap / 1e6 << " secs after "
+                << Time(std::chrono::microseconds(_max_gap_at)).as_iso8601(Time::Resolution::micro);
+    std::cout << "\n";
+    if (_l1)
+      std::cout << "spread: min " << _spread_min << ", mean " << _spread_sum / _l1
+                << ", max " << _spread_max << ", crossed " << _crossed << "\n";
+    if (_trades)
+      std::cout << "volume: " << _volume << "\n";
+    std::cout.flush();
+  }
 
+private:
+  uint64_t _gap;
+  uint64_t _count = 0;
+  uint64_t _l1 = 0;
+  uint64_t _trades = 0;
+  uint64_t _first = 0;
+  uint64_t _last = 0;
+  uint64_t _gaps = 0;
+  uint64_t _max_gap = 0;
+  uint64_t _max_gap_at = 0;
+  uint64_t _sec = 0;
+  uint64_t _sec_count = 0;
+  uint64_t _max_per_sec = 0;
+  uint64_t _crossed = 0;
+  double _spread_min = std::numeric_limits<double>::infinity();
+  double _spread_max = -std::numeric_limits<double>::infinity();
+  double _spread_sum = 0;
+  double _volume = 0;
+};
+
+
+/* Reads the records of a tickbin file from a given offset; the file may grow
+ * between reads, in which case it is mapped again. */
+class TickTail
+{
+public:
+  TickTail(fs::path fn, const Options& options)
+    : _fn(std::move(fn)), _options(options), _stats(options.gap)
+  {
+    remap();
+    auto header = decode_tickbin_file_header(_file->begin());
+    _compressed = header.version == tickbin::compressed_version;
+    if (header.version == tickbin::delta_version) {
+      auto meta = json::parse(_file->begin() + TickbinHeader::header_lead_length,
+                              _file->begin() + header.length);
+      _delta = std::make_unique<tickbin::DeltaSerialiser>(
+          tickbin::DeltaSerialiser::from_meta(meta));
+    }
+    _offset = header.length;
+    if (_options.from)
+      seek(_options.from->as_epoch_us().count());
+  }
+
+  /* Read all complete records currently in the file; returns false once the
+   * end of the requested time range has been passed. */
+  bool read()
+  {
+    if (fs::file_size(_fn) != _file->size())
+      remap();
+    if (_compressed)
+      read_frames();
+    else if (_delta)
+      _offset += read_delta(_file->begin() + _offset, _file->end());
+    else
+      _offset += read_records(_file->begin() + _offset, _file->end());
+    _printer.flush();
+    return !_done;
+  }
 
-    // initialise all bots, so they can begin trading
-    strategy.init_bots();
+  const Stats& stats() const { return _stats; }
 
-    // run until backtest range completed
-    services->run();
-  } catch (std::exception& e) {
+private:
+  void remap()
+  {
+    MmapOptions mmap_options;
+    mmap_options.window = 0;
+    mmap_options.release = false;
+    _file = std::make_unique<MappedFile>(_fn, mmap_options);
+    if (_file->size() < _offset)
+      THROW("file truncated while being read, " << _fn);
+  }
+
+  /* Start reading from the last indexed record, or frame, before `t`. */
+  void seek(uint64_t t)
+  {
+    std::vector<tickbin::IndexEntry> index;
+    if (_compressed) {
+      size_t end = 0;
+      index = find_tickbin_frames(_file->begin(), _file->size(), _offset, false, end);
+    }
+    else
+      index = load_index();
+
+    auto iter = std::lower_bound(
+        std::begin(index), std::end(index), t,
+        [](const tickbin::IndexEntry& entry, uint64_t value) {
+          return entry.capture_time < value;
+        });
+    if (iter != std::begin(index))
+      _offset = std::prev(iter)->offset;
+  }
+
+  // Only entries pointing at a record with the same capture time, and in
+  // time order, are used; as for TickbinFileReader.  Entries of a delta
+  // encoded file must point at a key record.
+  std::vector<tickbin::IndexEntry> load_index() const
+  {
+    std::vector<tickbin::IndexEntry> index;
+    std::ifstream is(tickbin_index_path(_fn), std::ios::binary);
+    tickbin::IndexEntry entry{};
+    while (is.read(reinterpret_cast<char*>(&entry), sizeof(entry))) {
+      if (entry.offset < _offset ||
+          entry.offset + sizeof(tickbin::Header) > _file->size())
+        break;
+      uint64_t capture_time = 0;
+      if (_delta) {
+        if (!tickbin::DeltaSerialiser::key_time(_file->begin() + entry.offset,
+                                                _file->size() - entry.offset,
+                                                capture_time))
+          break;
+      }
+      else {
+        tickbin::Header head;
+        memcpy(&head, _file->begin() + entry.offset, sizeof(head));
+        capture_time = head.capture_time;
+      }
+      if (capture_time != entry.capture_time)
+        break;
+      if (!index.empty() && entry.capture_time < index.back().capture_time)
+        break;
+      index.push_back(entry);
+    }
+    return index;
+  }
+
+  void read_frames()
+  {
+    size_t end = _offset;
+    auto frames = find_tickbin_frames(_file->begin(), _file->size(), _offset,
+                                      false, end);
+    for (auto& frame : frames) {
+      tickbin::FrameHeader head;
+      memcpy(&head, _file->begin() + frame.offset, sizeof(head));
+      if (_done)
+        break;
+      if (_options.from &&
+          head.last_time < uint64_t(_options.from->as_epoch_us().count()))
+        continue;
+
+      const char* src = _file->begin() + frame.offset + sizeof(head);
+      _frame_buf.resize(head.raw_size);
+      uLongf raw_len = head.raw_size;
+      if (crc32(0L, reinterpret_cast<const Bytef*>(src), head.compressed_size) != head.crc ||
+          uncompress(reinterpret_cast<Bytef*>(_frame_buf.data()), &raw_len,
+                     reinterpret_cast<const Bytef*>(src),
+                     head.compressed_size) != Z_OK ||
+          raw_len != head.raw_size)
+        THROW("corrupt tickbin frame at offset " << frame.offset << ", file " << _fn);
+      read_records(_frame_buf.data(), _frame_buf.data() + _frame_buf.size());
+    }
+    _offset = end;
+  }
+
+  /* Process the complete records in [begin, end), returning the bytes
+   * consumed. */
+  size_t read_records(const char* begin, const char* end)
+  {
+    const uint64_t from = _options.from ? _options.from->as_epoch_us().count() : 0;
+    const uint64_t to = _options.to ? _options.to->as_epoch_us().count()
+                                    : std::numeric_limits<uint64_t>::max();
+    const char* ptr = begin;
+    while (!_done && ptr + sizeof(tickbin::Header) <= end) {
+      tickbin::Header head;
+      memcpy(&head, ptr, sizeof(head));
+      if (head.size < sizeof(head))
+        THROW("invalid tickbin record at offset " << (ptr - begin) << ", file " << _fn);
+      if (ptr + head.size > end)
+        break;
+
+      if (head.capture_time >= to)
+        _done = true;
+      else if (head.capture_time >= from)
+        process(head, ptr);
+      ptr += head.size;
+    }
+    return ptr - begin;
+  }
+
+  /* Process the complete delta encoded records in [begin, end), each
+   * converted to its raw record, returning the bytes consumed. */
+  size_t read_delta(const char* begin, const char* end)
+  {
+    const uint64_t from = _options.from ? _options.from->as_epoch_us().count() : 0;
+    const uint64_t to = _options.to ? _options.to->as_epoch_us().count()
+                                    : std::numeric_limits<uint64_t>::max();
+    const char* ptr = begin;
+    tickbin::DeltaSerialiser::Record rec;
+    char raw[tickbin::Serialiser::max_record_size];
+    while (!_done) {
+      auto size = _delta->deserialise(ptr, end - ptr, rec);
+      if (!size)
+        break;
+      ptr += size;
+
+      Time capture_time{std::chrono::microseconds(rec.capture_time)};
+      if (rec.type == tickbin::MsgType::TickLevel1)
+        tickbin::Serialiser::serialise(raw, capture_time, rec.top);
+      else
+        tickbin::Serialiser::serialise(raw, capture_time, rec.trade);
+      tickbin::Header head;
+      memcpy(&head, raw, sizeof(head));
+      head.msg_type = static_cast<uint8_t>(rec.type);
+      memcpy(raw, &head, sizeof(head));
+
+      if (head.capture_time >= to)
+        _done = true;
+      else if (head.capture_time >= from)
+        process(head, raw);
+    }
+    return ptr - begin;
+  }
+
+  void process(const tickbin::Header& head, const char* ptr)
+  {
+    if (_options.type && head.msg_type != _options.type)
+      return;
+
+    using L1View = tickbin::View<tickbin::TickLevel1>;
+    using TradeView = tickbin::View<tickbin::TickAggTrade>;
+
+    if (head.msg_type == int(tickbin::MsgType::TickLevel1) &&
+        head.size == L1View::size) {
+      if (_options.side || _options.min_qty > 0)
+        return;
+      L1View view(ptr);
+      if (_options.stats)
+        _stats.add(view.msg());
+      else
+        _printer.print(view.msg());
+    }
+    else if (head.msg_type == int(tickbin::MsgType::TickAggTrade) &&
+             head.size == TradeView::size) {
+      TradeView view(ptr);
+      if ((_options.side && view->side != _options.side) ||
+          view->qty < _options.min_qty)
+        return;
+      if (_options.stats)
+        _stats.add(view.msg());
+      else
+        _printer.print(view.msg());
+    }
+  }
+
+  fs::path _fn;
+  Options _options;
+  std::unique_ptr<MappedFile> _file;
+  bool _compressed = false;
+  std::unique_ptr<tickbin::DeltaSerialiser> _delta;
+  size_t _offset = 0;
+  bool _done = false;
+  std::vector<char> _frame_buf;
+  Printer _printer;
+  Stats _stats;
+};
+
+
+int main(int argc, char** argv)
+{
+  try {
+    Options options;
+    const char* fn = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+      auto arg = [&]() -> const char* {
+        if (i + 1 >= argc)
+          THROW("missing value for " << argv[i]);
+        return argv[++i];
+      };
+      if (strcmp(argv[i], "-f") == 0)
+        options.follow = true;
+      else if (strcmp(argv[i], "--stats") == 0)
+        options.stats = true;
+      else if (strcmp(argv[i], "--from") == 0)
+        options.from = Time(arg());
+      else if (strcmp(argv[i], "--to") == 0)
+        options.to = Time(arg());
+      else if (strcmp(argv[i], "--type") == 0) {
+        std::string type = arg();
+        if (type == "l1")
+          options.type = int(tickbin::MsgType::TickLevel1);
+        else if (type == "trade")
+          options.type = int(tickbin::MsgType::TickAggTrade);
+        else
+          THROW("unknown tick type " << QUOTE(type));
+      }
+      else if (strcmp(argv[i], "--side") == 0) {
+        std::string side = arg();
+        if (side == "buy")
+          options.side = tickbin::Serialiser::encode_side(Side::buy);
+        else if (side == "sell")
+          options.side = tickbin::Serialiser::encode_side(Side::sell);
+        else
+          THROW("unknown side " << QUOTE(side));
+      }
+      else if (strcmp(argv[i], "--min-qty") == 0)
+        options.min_qty = std::stod(arg());
+      else if (strcmp(argv[i], "--gap") == 0)
+        options.gap = std::chrono::microseconds(
+            static_cast<int64_t>(std::stod(arg()) * 1e6));
+      else if (strcmp(argv[i], "--interval") == 0)
+        options.interval = std::chrono::seconds(std::stoi(arg()));
+      else if (!fn)
+        fn = argv[i];
+      else
+        THROW("unexpected argument " << QUOTE(argv[i]));
+    }
+    if (!fn)
+      THROW("provide name of tickbin file");
+
+    TickTail tail(fn, options);
+    bool more = tail.read();
+    auto next_stats = std::chrono::steady_clock::now() + options.interval;
+    while (options.follow && more) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      more = tail.read();
+      if (options.stats && std::chrono::steady_clock::now() >= next_stats) {
+        tail.stats().print();
+        next_stats += options.interval;
+      }
+    }
+    if (options.stats)
+      tail.stats().print();
+    return 0;
+  }
+  catch (std::exception& e) {
     std::cout << "error: " << e.what() << std::endl;
-    return 1;
   }
+
+  return 1;
 }